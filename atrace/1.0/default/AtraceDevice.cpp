@@ -14,7 +14,10 @@
  * limitations under the License.
  */
 
-#include <android-base/file.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
 #include <android-base/logging.h>
 
 #include "AtraceDevice.h"
@@ -70,30 +73,40 @@ Return<::android::hardware::atrace::V1_0::Status> AtraceDevice::enableCategories
     if (!categories.size()) {
         return Status::ERROR_INVALID_ARGUMENT;
     }
+    // Check them all before enabling any, so a bad request leaves tracing untouched
+    for (auto& c : categories) {
+        if (!kTracingMap.count(c)) {
+            return Status::ERROR_INVALID_ARGUMENT;
+        }
+    }
+    std::lock_guard<std::mutex> lock(mLock);
     for (auto& c : categories) {
-        if (kTracingMap.count(c)) {
-            for (auto& p : kTracingMap.at(c).paths) {
-                if (!android::base::WriteStringToFile("1", p.first)) {
-                    LOG(ERROR) << "Failed to enable tracing on: " << p.first;
-                    if (p.second) {
-                        // disable before return
-                        disableAllCategories();
-                        return Status::ERROR_TRACING_POINT;
-                    }
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (auto& p : kTracingMap.at(c).paths) {
+            if (!setTracePointLocked(p.first, true)) {
+                LOG(ERROR) << "Failed to enable tracing on: " << p.first;
+                if (p.second) {
+                    // disable before return
+                    disableAllCategoriesLocked();
+                    return Status::ERROR_TRACING_POINT;
                 }
             }
-        } else {
-            return Status::ERROR_INVALID_ARGUMENT;
         }
+        mEnableLatencies[c] = systemTime(SYSTEM_TIME_MONOTONIC) - start;
     }
     return Status::SUCCESS;
 }
 
 Return<::android::hardware::atrace::V1_0::Status> AtraceDevice::disableAllCategories() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return disableAllCategoriesLocked();
+}
+
+Status AtraceDevice::disableAllCategoriesLocked() {
     auto ret = Status::SUCCESS;
     for (auto& c : kTracingMap) {
         for (auto& p : c.second.paths) {
-            if (!android::base::WriteStringToFile("0", p.first)) {
+            if (!setTracePointLocked(p.first, false)) {
                 LOG(ERROR) << "Failed to disable tracing on: " << p.first;
                 if (p.second) {
                     ret = Status::ERROR_TRACING_POINT;
@@ -104,6 +117,37 @@ Return<::android::hardware::atrace::V1_0::Status> AtraceDevice::disableAllCatego
     return ret;
 }
 
+bool AtraceDevice::setTracePointLocked(const std::string& path, bool enable) {
+    auto it = mEnableFds.find(path);
+    if (it == mEnableFds.end()) {
+        android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDWR | O_CLOEXEC)));
+        if (fd < 0) {
+            // Not cached, the node may show up once its driver loads
+            return false;
+        }
+        it = mEnableFds.emplace(path, std::move(fd)).first;
+    }
+    const char state = enable ? '1' : '0';
+    // Enabling an event is far slower than reading it back, skip nodes already set
+    char current;
+    if (TEMP_FAILURE_RETRY(pread(it->second, &current, 1, 0)) == 1 && current == state) {
+        return true;
+    }
+    return TEMP_FAILURE_RETRY(pwrite(it->second, &state, 1, 0)) == 1;
+}
+
+Return<void> AtraceDevice::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* args */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        return Void();
+    }
+    std::lock_guard<std::mutex> lock(mLock);
+    dprintf(fd->data[0], "Last enable latency per category:\n");
+    for (auto& l : mEnableLatencies) {
+        dprintf(fd->data[0], "  %s: %.3f ms\n", l.first.c_str(), l.second / 1000000.0);
+    }
+    return Void();
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace atrace
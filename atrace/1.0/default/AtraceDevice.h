@@ -17,9 +17,15 @@
 #ifndef ANDROID_HARDWARE_ATRACE_V1_0_ATRACEDEVICE_H
 #define ANDROID_HARDWARE_ATRACE_V1_0_ATRACEDEVICE_H
 
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <android-base/unique_fd.h>
 #include <android/hardware/atrace/1.0/IAtraceDevice.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <utils/Timers.h>
 
 namespace android {
 namespace hardware {
@@ -29,6 +35,7 @@ namespace implementation {
 
 using ::android::sp;
 using ::android::hardware::hidl_array;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_memory;
 using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
@@ -43,6 +50,18 @@ struct AtraceDevice : public IAtraceDevice {
     Return<::android::hardware::atrace::V1_0::Status> disableAllCategories() override;
 
     // Methods from ::android::hidl::base::V1_0::IBase follow.
+    // Dumps how long enabling each category took the last time.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override;
+
+  private:
+    ::android::hardware::atrace::V1_0::Status disableAllCategoriesLocked();
+    // Writes the state to the tracefs enable node unless it is already in it.
+    bool setTracePointLocked(const std::string& path, bool enable);
+
+    std::mutex mLock;  // Protects all members below
+    // The tracefs enable nodes stay open, tracing sessions come and go
+    std::map<std::string, android::base::unique_fd> mEnableFds;
+    std::map<std::string, nsecs_t> mEnableLatencies;
 };
 
 }  // namespace implementation
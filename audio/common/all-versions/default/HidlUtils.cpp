@@ -50,9 +50,8 @@ void HidlUtils::audioGainConfigFromHal(const struct audio_gain_config& halConfig
     config->index = halConfig.index;
     config->mode = EnumBitfield<AudioGainMode>(halConfig.mode);
     config->channelMask = EnumBitfield<AudioChannelMask>(halConfig.channel_mask);
-    for (size_t i = 0; i < sizeof(audio_channel_mask_t) * 8; ++i) {
-        config->values[i] = halConfig.values[i];
-    }
+    static_assert(sizeof(config->values) == sizeof(halConfig.values), "gain values mismatch");
+    memcpy(config->values.data(), halConfig.values, sizeof(halConfig.values));
     config->rampDurationMs = halConfig.ramp_duration_ms;
 }
 
@@ -61,10 +60,8 @@ void HidlUtils::audioGainConfigToHal(const AudioGainConfig& config,
     halConfig->index = config.index;
     halConfig->mode = static_cast<audio_gain_mode_t>(config.mode);
     halConfig->channel_mask = static_cast<audio_channel_mask_t>(config.channelMask);
-    memset(halConfig->values, 0, sizeof(halConfig->values));
-    for (size_t i = 0; i < sizeof(audio_channel_mask_t) * 8; ++i) {
-        halConfig->values[i] = config.values[i];
-    }
+    static_assert(sizeof(config.values) == sizeof(halConfig->values), "gain values mismatch");
+    memcpy(halConfig->values, config.values.data(), sizeof(halConfig->values));
     halConfig->ramp_duration_ms = config.rampDurationMs;
 }
 
@@ -218,7 +215,7 @@ void HidlUtils::audioPortConfigToHal(const AudioPortConfig& config,
 void HidlUtils::audioPortConfigsFromHal(unsigned int numHalConfigs,
                                         const struct audio_port_config* halConfigs,
                                         hidl_vec<AudioPortConfig>* configs) {
-    configs->resize(numHalConfigs);
+    resizeIfNeeded(configs, numHalConfigs);
     for (unsigned int i = 0; i < numHalConfigs; ++i) {
         audioPortConfigFromHal(halConfigs[i], &(*configs)[i]);
     }
@@ -238,19 +235,21 @@ void HidlUtils::audioPortFromHal(const struct audio_port& halPort, AudioPort* po
     port->role = AudioPortRole(halPort.role);
     port->type = AudioPortType(halPort.type);
     port->name.setToExternal(halPort.name, strlen(halPort.name));
-    port->sampleRates.resize(halPort.num_sample_rates);
+    // Converting into a port of the same shape, e.g. the one being queried,
+    // reuses its arrays
+    resizeIfNeeded(&port->sampleRates, halPort.num_sample_rates);
     for (size_t i = 0; i < halPort.num_sample_rates; ++i) {
         port->sampleRates[i] = halPort.sample_rates[i];
     }
-    port->channelMasks.resize(halPort.num_channel_masks);
+    resizeIfNeeded(&port->channelMasks, halPort.num_channel_masks);
     for (size_t i = 0; i < halPort.num_channel_masks; ++i) {
         port->channelMasks[i] = EnumBitfield<AudioChannelMask>(halPort.channel_masks[i]);
     }
-    port->formats.resize(halPort.num_formats);
+    resizeIfNeeded(&port->formats, halPort.num_formats);
     for (size_t i = 0; i < halPort.num_formats; ++i) {
         port->formats[i] = AudioFormat(halPort.formats[i]);
     }
-    port->gains.resize(halPort.num_gains);
+    resizeIfNeeded(&port->gains, halPort.num_gains);
     for (size_t i = 0; i < halPort.num_gains; ++i) {
         audioGainFromHal(halPort.gains[i], &port->gains[i]);
     }
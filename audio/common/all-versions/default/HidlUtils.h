@@ -63,6 +63,15 @@ class HidlUtils {
     static void audioPortToHal(const AudioPort& port, struct audio_port* halPort);
     static void uuidFromHal(const audio_uuid_t& halUuid, Uuid* uuid);
     static void uuidToHal(const Uuid& uuid, audio_uuid_t* halUuid);
+
+   private:
+    // hidl_vec::resize always reallocates
+    template <typename T>
+    static void resizeIfNeeded(hidl_vec<T>* vec, size_t size) {
+        if (vec->size() != size) {
+            vec->resize(size);
+        }
+    }
 };
 
 }  // namespace implementation
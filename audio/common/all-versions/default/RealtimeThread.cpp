@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AudioHalRealtimeThread"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <log/log.h>
+#include <utils/Timers.h>
+
+#include "common/all-versions/default/RealtimeThread.h"
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+namespace android {
+
+namespace {
+
+// sched_setattr(2) has no libc wrapper
+struct SchedAttr {
+    uint32_t size;
+    uint32_t schedPolicy;
+    uint64_t schedFlags;
+    int32_t schedNice;
+    uint32_t schedPriority;
+    uint64_t schedRuntime;
+    uint64_t schedDeadline;
+    uint64_t schedPeriod;
+};
+
+// Parse a CPU list like "0-3,6"
+std::vector<int> parseCpus(const char* list) {
+    std::vector<int> cpus;
+    const char* p = list;
+    while (*p != '\0') {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            cpus.push_back(cpu);
+        }
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return cpus;
+}
+
+}  // namespace
+
+// static
+RealtimePolicy RealtimePolicy::fromProperties() {
+    RealtimePolicy policy;
+    policy.priority = property_get_int32("ro.vendor.audio.hal.rt.priority", 0);
+    char cpus[PROPERTY_VALUE_MAX];
+    if (property_get("ro.vendor.audio.hal.rt.cpus", cpus, "") > 0) {
+        policy.cpus = parseCpus(cpus);
+    }
+    policy.deadline = property_get_bool("ro.vendor.audio.hal.rt.deadline", false);
+    policy.runtimePercent = property_get_int32("ro.vendor.audio.hal.rt.runtime_percent", 20);
+    return policy;
+}
+
+status_t RealtimePolicy::apply(pid_t tid, uint64_t periodNs) const {
+    status_t status = OK;
+    if (!cpus.empty()) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (int cpu : cpus) {
+            CPU_SET(cpu, &cpuSet);
+        }
+        if (sched_setaffinity(tid, sizeof(cpuSet), &cpuSet) != 0) {
+            ALOGW("failed to set the CPUs of thread %d: %s", tid, strerror(errno));
+            status = -errno;
+        }
+    }
+    if (priority <= 0) {
+        return status;
+    }
+
+    if (deadline && periodNs != 0 && runtimePercent > 0 && runtimePercent <= 100) {
+        SchedAttr attr = {};
+        attr.size = sizeof(attr);
+        attr.schedPolicy = SCHED_DEADLINE;
+        attr.schedRuntime = periodNs * runtimePercent / 100;
+        attr.schedDeadline = periodNs;
+        attr.schedPeriod = periodNs;
+        if (syscall(__NR_sched_setattr, tid, &attr, 0) == 0) {
+            return status;
+        }
+        ALOGW("failed to set SCHED_DEADLINE on thread %d, using SCHED_FIFO: %s", tid,
+              strerror(errno));
+    }
+    struct sched_param param = {};
+    param.sched_priority = priority;
+    if (sched_setscheduler(tid, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) != 0) {
+        ALOGW("failed to set SCHED_FIFO priority %d on thread %d: %s", priority, tid,
+              strerror(errno));
+        status = -errno;
+    }
+    return status;
+}
+
+constexpr int64_t WakeupJitterHistogram::kBucketBoundsUs[];
+
+void WakeupJitterHistogram::setPeriod(uint64_t periodNs) {
+    mPeriodNs.store(periodNs, std::memory_order_relaxed);
+}
+
+void WakeupJitterHistogram::onWakeup() {
+    int64_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    int64_t intervalNs = mLastWakeupNs == 0 ? 0 : now - mLastWakeupNs;
+    mLastWakeupNs = now;
+    int64_t referenceNs = mPeriodNs.load(std::memory_order_relaxed);
+    if (referenceNs == 0) {
+        referenceNs = mLastIntervalNs;
+    }
+    mLastIntervalNs = intervalNs;
+    if (intervalNs == 0 || referenceNs == 0 || intervalNs > 4 * referenceNs) {
+        return;
+    }
+
+    int64_t jitterUs = llabs(intervalNs - referenceNs) / 1000;
+    size_t bucket = 0;
+    while (bucket < kBucketCount - 1 && jitterUs >= kBucketBoundsUs[bucket]) {
+        bucket++;
+    }
+    mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void WakeupJitterHistogram::dump(int fd, const char* name) const {
+    dprintf(fd, "%s thread wake-up jitter (period %llu us):\n", name,
+            static_cast<unsigned long long>(mPeriodNs.load(std::memory_order_relaxed) / 1000));
+    for (size_t i = 0; i < kBucketCount; i++) {
+        unsigned long long count = mBuckets[i].load(std::memory_order_relaxed);
+        if (i < kBucketCount - 1) {
+            dprintf(fd, "  < %5lld us: %llu\n", static_cast<long long>(kBucketBoundsUs[i]), count);
+        } else {
+            dprintf(fd, "  >= %4lld us: %llu\n", static_cast<long long>(kBucketBoundsUs[i - 1]),
+                    count);
+        }
+    }
+}
+
+}  // namespace android
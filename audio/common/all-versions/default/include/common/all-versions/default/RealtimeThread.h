@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_audio_common_RealtimeThread_H_
+#define android_hardware_audio_common_RealtimeThread_H_
+
+#include <sys/types.h>
+#include <atomic>
+#include <vector>
+
+#include <utils/Errors.h>
+
+namespace android {
+
+/**
+ * Scheduling policy of the HAL threads serving the FMQs: the stream writer
+ * and reader threads, and the effect process thread. It is read from:
+ *   ro.vendor.audio.hal.rt.priority   SCHED_FIFO priority. 0, the default,
+ *                                     leaves the threads as they are created.
+ *   ro.vendor.audio.hal.rt.cpus       CPUs the threads run on, e.g. "4-7" or
+ *                                     "2,3". All the CPUs when not set.
+ *   ro.vendor.audio.hal.rt.deadline   Use SCHED_DEADLINE instead of SCHED_FIFO
+ *                                     for the threads with a known period.
+ *   ro.vendor.audio.hal.rt.runtime_percent
+ *                                     SCHED_DEADLINE runtime in percent of the
+ *                                     period, 20 by default.
+ */
+struct RealtimePolicy {
+    int priority = 0;
+    std::vector<int> cpus;
+    bool deadline = false;
+    int runtimePercent = 20;
+
+    static RealtimePolicy fromProperties();
+
+    /**
+     * Apply the policy to the thread tid, which runs once per periodNs, or 0
+     * if the period is not known. SCHED_DEADLINE falls back to SCHED_FIFO when
+     * it cannot be set.
+     */
+    status_t apply(pid_t tid, uint64_t periodNs) const;
+};
+
+/**
+ * Histogram of the wake-up jitter of a thread: how far the time between two
+ * wake-ups is from the period of the thread, or from the previous time
+ * between wake-ups when the period is not known. A gap over 4 periods is a
+ * pause of the stream and is not counted.
+ *
+ * onWakeup is called by the thread; the other methods can be called from
+ * any thread.
+ */
+class WakeupJitterHistogram {
+   public:
+    void setPeriod(uint64_t periodNs);
+    void onWakeup();
+    void dump(int fd, const char* name) const;
+
+   private:
+    // Upper bounds of the buckets, in microseconds; the last bucket has no bound
+    static constexpr int64_t kBucketBoundsUs[] = {50, 100, 200, 500, 1000, 2000, 5000};
+    static constexpr size_t kBucketCount = sizeof(kBucketBoundsUs) / sizeof(int64_t) + 1;
+
+    std::atomic<uint64_t> mPeriodNs{0};
+    std::atomic<uint64_t> mBuckets[kBucketCount] = {};
+    // Only used by the thread
+    int64_t mLastWakeupNs = 0;
+    int64_t mLastIntervalNs = 0;
+};
+
+}  // namespace android
+
+#endif  // android_hardware_audio_common_RealtimeThread_H_
@@ -54,10 +54,18 @@ Result Device::analyzeStatus(const char* funcName, int status,
 
 void Device::closeInputStream(audio_stream_in_t* stream) {
     mDevice->close_input_stream(mDevice, stream);
+    invalidateAudioPortCache();
 }
 
 void Device::closeOutputStream(audio_stream_out_t* stream) {
     mDevice->close_output_stream(mDevice, stream);
+    invalidateAudioPortCache();
+}
+
+void Device::invalidateAudioPortCache() {
+    std::lock_guard<std::mutex> lock(mAudioPortCacheLock);
+    mAudioPortCache.clear();
+    mAudioPortCacheGeneration++;
 }
 
 char* Device::halGetParameters(const char* keys) {
@@ -65,7 +73,10 @@ char* Device::halGetParameters(const char* keys) {
 }
 
 int Device::halSetParameters(const char* keysAndValues) {
-    return mDevice->set_parameters(mDevice, keysAndValues);
+    int status = mDevice->set_parameters(mDevice, keysAndValues);
+    // Covers device connection and routing changes
+    invalidateAudioPortCache();
+    return status;
 }
 
 // Methods from ::android::hardware::audio::CPP_VERSION::IDevice follow.
@@ -159,6 +170,7 @@ std::tuple<Result, sp<IStreamOut>> Device::openOutputStreamImpl(int32_t ioHandle
     sp<IStreamOut> streamOut;
     if (status == OK) {
         streamOut = new StreamOut(this, halStream);
+        invalidateAudioPortCache();
     }
     HidlUtils::audioConfigFromHal(halConfig, suggestedConfig);
     return {analyzeStatus("open_output_stream", status, {EINVAL} /*ignore*/), streamOut};
@@ -185,6 +197,7 @@ std::tuple<Result, sp<IStreamIn>> Device::openInputStreamImpl(
     sp<IStreamIn> streamIn;
     if (status == OK) {
         streamIn = new StreamIn(this, halStream);
+        invalidateAudioPortCache();
     }
     HidlUtils::audioConfigFromHal(halConfig, suggestedConfig);
     return {analyzeStatus("open_input_stream", status, {EINVAL} /*ignore*/), streamIn};
@@ -266,6 +279,7 @@ Return<void> Device::createAudioPatch(const hidl_vec<AudioPortConfig>& sources,
         retval = analyzeStatus("create_audio_patch",
                                mDevice->create_audio_patch(mDevice, sources.size(), &halSources[0],
                                                            sinks.size(), &halSinks[0], &halPatch));
+        invalidateAudioPortCache();
         if (retval == Result::OK) {
             patch = static_cast<AudioPatchHandle>(halPatch);
         }
@@ -276,20 +290,39 @@ Return<void> Device::createAudioPatch(const hidl_vec<AudioPortConfig>& sources,
 
 Return<Result> Device::releaseAudioPatch(int32_t patch) {
     if (version() >= AUDIO_DEVICE_API_VERSION_3_0) {
-        return analyzeStatus(
+        Result retval = analyzeStatus(
             "release_audio_patch",
             mDevice->release_audio_patch(mDevice, static_cast<audio_patch_handle_t>(patch)));
+        invalidateAudioPortCache();
+        return retval;
     }
     return Result::NOT_SUPPORTED;
 }
 
 Return<void> Device::getAudioPort(const AudioPort& port, getAudioPort_cb _hidl_cb) {
+    // The legacy HAL fills the port in from its id alone, so the reply can be
+    // reused until something changes the ports.
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mAudioPortCacheLock);
+        auto cached = mAudioPortCache.find(port.id);
+        if (cached != mAudioPortCache.end()) {
+            _hidl_cb(Result::OK, cached->second);
+            return Void();
+        }
+        generation = mAudioPortCacheGeneration;
+    }
     audio_port halPort;
     HidlUtils::audioPortToHal(port, &halPort);
     Result retval = analyzeStatus("get_audio_port", mDevice->get_audio_port(mDevice, &halPort));
     AudioPort resultPort = port;
     if (retval == Result::OK) {
         HidlUtils::audioPortFromHal(halPort, &resultPort);
+        std::lock_guard<std::mutex> lock(mAudioPortCacheLock);
+        // Unless the ports changed while the HAL was being queried
+        if (generation == mAudioPortCacheGeneration) {
+            mAudioPortCache[port.id] = resultPort;
+        }
     }
     _hidl_cb(retval, resultPort);
     return Void();
@@ -299,8 +332,10 @@ Return<Result> Device::setAudioPortConfig(const AudioPortConfig& config) {
     if (version() >= AUDIO_DEVICE_API_VERSION_3_0) {
         struct audio_port_config halPortConfig;
         HidlUtils::audioPortConfigToHal(config, &halPortConfig);
-        return analyzeStatus("set_audio_port_config",
-                             mDevice->set_audio_port_config(mDevice, &halPortConfig));
+        Result retval = analyzeStatus("set_audio_port_config",
+                                      mDevice->set_audio_port_config(mDevice, &halPortConfig));
+        invalidateAudioPortCache();
+        return retval;
     }
     return Result::NOT_SUPPORTED;
 }
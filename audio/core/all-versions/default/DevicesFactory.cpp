@@ -21,8 +21,11 @@
 #include "core/default/PrimaryDevice.h"
 
 #include <string.h>
+#include <unistd.h>
 
 #include <android/log.h>
+#include <cutils/properties.h>
+#include <tinyxml2.h>
 
 namespace android {
 namespace hardware {
@@ -30,6 +33,78 @@ namespace audio {
 namespace CPP_VERSION {
 namespace implementation {
 
+namespace {
+
+const char* const kAudioPolicyConfigLocations[] = {"/odm/etc", "/vendor/etc", "/system/etc"};
+constexpr char kAudioPolicyConfigFileName[] = "audio_policy_configuration.xml";
+// the module files are included by the main file, and do not include any other
+constexpr int kMaxIncludeDepth = 2;
+
+void collectModuleNames(const std::string& dir, const tinyxml2::XMLElement* element, int depth,
+                        std::vector<std::string>* names);
+
+void collectModuleNames(const std::string& dir, const std::string& fileName, int depth,
+                        std::vector<std::string>* names) {
+    tinyxml2::XMLDocument doc;
+    std::string path = dir + '/' + fileName;
+    if (doc.LoadFile(path.c_str()) != tinyxml2::XML_SUCCESS) {
+        ALOGW("%s: could not parse %s", __func__, path.c_str());
+        return;
+    }
+    collectModuleNames(dir, doc.RootElement(), depth, names);
+}
+
+void collectModuleNames(const std::string& dir, const tinyxml2::XMLElement* element, int depth,
+                        std::vector<std::string>* names) {
+    for (; element != nullptr; element = element->NextSiblingElement()) {
+        if (strcmp(element->Name(), "module") == 0) {
+            const char* name = element->Attribute("name");
+            if (name != nullptr) names->push_back(name);
+            continue;
+        }
+        if (strcmp(element->Name(), "xi:include") == 0) {
+            const char* href = element->Attribute("href");
+            if (href != nullptr && depth < kMaxIncludeDepth) {
+                collectModuleNames(dir, href, depth + 1, names);
+            }
+            continue;
+        }
+        collectModuleNames(dir, element->FirstChildElement(), depth, names);
+    }
+}
+
+// Returns the names of the modules of the audio policy configuration
+std::vector<std::string> getAudioPolicyModuleNames() {
+    std::vector<std::string> names;
+    for (const char* location : kAudioPolicyConfigLocations) {
+        std::string path = std::string(location) + '/' + kAudioPolicyConfigFileName;
+        if (access(path.c_str(), R_OK) == 0) {
+            collectModuleNames(location, kAudioPolicyConfigFileName, 0, &names);
+            break;
+        }
+    }
+    return names;
+}
+
+}  // namespace
+
+DevicesFactory::DevicesFactory() {
+    if (property_get_bool("ro.vendor.audio.hal.preload_modules", false)) {
+        preloadAudioInterfaces(getAudioPolicyModuleNames());
+    }
+}
+
+DevicesFactory::~DevicesFactory() {
+    // close the devices that were never asked for
+    std::lock_guard<std::mutex> lock(mPreloadedLock);
+    for (auto& entry : mPreloaded) {
+        LoadedInterface loaded = entry.second.get();
+        if (loaded.status == OK) {
+            audio_hw_device_close(loaded.device);
+        }
+    }
+}
+
 #if MAJOR_VERSION == 2
 Return<void> DevicesFactory::openDevice(IDevicesFactory::Device device, openDevice_cb _hidl_cb) {
     switch (device) {
@@ -68,7 +143,7 @@ Return<void> DevicesFactory::openDevice(const char* moduleName, Callback _hidl_c
     audio_hw_device_t* halDevice;
     Result retval(Result::INVALID_ARGUMENTS);
     sp<DeviceShim> result;
-    int halStatus = loadAudioInterface(moduleName, &halDevice);
+    int halStatus = takeOrLoadAudioInterface(moduleName, &halDevice);
     if (halStatus == OK) {
         result = new DeviceShim(halDevice);
         retval = Result::OK;
@@ -109,6 +184,40 @@ out:
     return rc;
 }
 
+void DevicesFactory::preloadAudioInterfaces(const std::vector<std::string>& moduleNames) {
+    std::lock_guard<std::mutex> lock(mPreloadedLock);
+    for (const std::string& name : moduleNames) {
+        if (mPreloaded.count(name) != 0) continue;
+        ALOGI("%s preloading audio hw module %s", __func__, name.c_str());
+        mPreloaded[name] = std::async(std::launch::async, [name] {
+            LoadedInterface loaded;
+            loaded.status = loadAudioInterface(name.c_str(), &loaded.device);
+            return loaded;
+        });
+    }
+}
+
+int DevicesFactory::takeOrLoadAudioInterface(const char* if_name, audio_hw_device_t** dev) {
+    std::future<LoadedInterface> preloaded;
+    {
+        std::lock_guard<std::mutex> lock(mPreloadedLock);
+        auto iter = mPreloaded.find(if_name);
+        if (iter != mPreloaded.end()) {
+            preloaded = std::move(iter->second);
+            mPreloaded.erase(iter);
+        }
+    }
+    if (preloaded.valid()) {
+        LoadedInterface loaded = preloaded.get();
+        if (loaded.status == OK) {
+            *dev = loaded.device;
+            return OK;
+        }
+        // the error has been logged, try again in case it was transient
+    }
+    return loadAudioInterface(if_name, dev);
+}
+
 IDevicesFactory* HIDL_FETCH_IDevicesFactory(const char* name) {
     return strcmp(name, "default") == 0 ? new DevicesFactory() : nullptr;
 }
@@ -18,6 +18,9 @@
 #include "core/default/Conversions.h"
 #include "core/default/Util.h"
 
+#include <string.h>
+
+#include <hardware/audio.h>
 #include <system/audio.h>
 
 namespace android {
@@ -67,10 +70,19 @@ Result ParametersUtil::getParam(const char* name, int* value) {
 }
 
 Result ParametersUtil::getParam(const char* name, String8* value, AudioParameter context) {
+    const bool cacheable = context.size() == 0 && isCacheableParam(name);
+    uint64_t generation = 0;
+    if (cacheable && getCachedParam(name, value, &generation)) {
+        return Result::OK;
+    }
     const String8 halName(name);
     context.addKey(halName);
     std::unique_ptr<AudioParameter> params = getParams(context);
-    return getHalStatusToResult(params->get(halName, *value));
+    Result retval = getHalStatusToResult(params->get(halName, *value));
+    if (cacheable && retval == Result::OK) {
+        cacheParam(name, *value, generation);
+    }
+    return retval;
 }
 
 void ParametersUtil::getParametersImpl(
@@ -157,9 +169,53 @@ Result ParametersUtil::setParam(const char* name, const DeviceAddress& address)
 
 Result ParametersUtil::setParams(const AudioParameter& param) {
     int halStatus = halSetParameters(param.toString().string());
+    // Invalidate even on failure, the HAL may have applied some of the keys.
+    invalidateParams(param);
     return util::analyzeStatus(halStatus);
 }
 
+// static
+bool ParametersUtil::isCacheableParam(const char* name) {
+    // Device state set by the framework. Keys like hw_av_sync or the stream routing
+    // can change inside the HAL and are always read from it.
+    static const char* const kCacheableParams[] = {
+        AudioParameter::keyBtNrec,           AudioParameter::keyScreenState,
+        AUDIO_PARAMETER_KEY_BT_SCO_WB,       AUDIO_PARAMETER_KEY_TTY_MODE,
+        AUDIO_PARAMETER_KEY_HAC,             AUDIO_PARAMETER_KEY_HFP_ENABLE,
+    };
+    for (const char* key : kCacheableParams) {
+        if (strcmp(name, key) == 0) return true;
+    }
+    return false;
+}
+
+bool ParametersUtil::getCachedParam(const char* name, String8* value, uint64_t* generation) {
+    std::lock_guard<std::mutex> lock(mCacheLock);
+    *generation = mCacheGeneration;
+    auto it = mCache.find(name);
+    if (it == mCache.end()) return false;
+    *value = it->second;
+    return true;
+}
+
+void ParametersUtil::cacheParam(const char* name, const String8& value, uint64_t generation) {
+    std::lock_guard<std::mutex> lock(mCacheLock);
+    if (generation == mCacheGeneration) {
+        mCache[name] = value;
+    }
+}
+
+void ParametersUtil::invalidateParams(const AudioParameter& param) {
+    std::lock_guard<std::mutex> lock(mCacheLock);
+    mCacheGeneration++;
+    String8 key, value;
+    for (size_t i = 0; i < param.size(); ++i) {
+        if (param.getAt(i, key, value) == OK) {
+            mCache.erase(key.string());
+        }
+    }
+}
+
 }  // namespace implementation
 }  // namespace CPP_VERSION
 }  // namespace audio
@@ -42,7 +42,8 @@ class ReadThread : public Thread {
    public:
     // ReadThread's lifespan never exceeds StreamIn's lifespan.
     ReadThread(std::atomic<bool>* stop, audio_stream_in_t* stream, StreamIn::CommandMQ* commandMQ,
-               StreamIn::DataMQ* dataMQ, StreamIn::StatusMQ* statusMQ, EventFlag* efGroup)
+               StreamIn::DataMQ* dataMQ, StreamIn::StatusMQ* statusMQ, EventFlag* efGroup,
+               WakeupJitterHistogram* jitter)
         : Thread(false /*canCallJava*/),
           mStop(stop),
           mStream(stream),
@@ -50,6 +51,7 @@ class ReadThread : public Thread {
           mDataMQ(dataMQ),
           mStatusMQ(statusMQ),
           mEfGroup(efGroup),
+          mJitter(jitter),
           mBuffer(nullptr) {}
     bool init() {
         mBuffer.reset(new (std::nothrow) uint8_t[mDataMQ->getQuantumCount()]);
@@ -64,6 +66,7 @@ class ReadThread : public Thread {
     StreamIn::DataMQ* mDataMQ;
     StreamIn::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
+    WakeupJitterHistogram* mJitter;
     std::unique_ptr<uint8_t[]> mBuffer;
     IStreamIn::ReadParameters mParameters;
     IStreamIn::ReadStatus mStatus;
@@ -84,11 +87,22 @@ void ReadThread::doRead() {
             (int32_t)requestedToRead, (int32_t)availableToWrite);
         requestedToRead = availableToWrite;
     }
-    ssize_t readResult = mStream->read(mStream, &mBuffer[0], requestedToRead);
+    // Let the legacy HAL read straight into the shared queue memory. Only a
+    // region wrapping around the end of the queue is read into the buffer first.
+    StreamIn::DataMQ::MemTransaction tx;
+    uint8_t* data = &mBuffer[0];
+    bool inPlace = mDataMQ->beginWrite(requestedToRead, &tx) &&
+                   tx.getSecondRegion().getLength() == 0;
+    if (inPlace) {
+        data = tx.getFirstRegion().getAddress();
+    }
+    ssize_t readResult = mStream->read(mStream, data, requestedToRead);
     mStatus.retval = Result::OK;
     if (readResult >= 0) {
         mStatus.reply.read = readResult;
-        if (!mDataMQ->write(&mBuffer[0], readResult)) {
+        bool written = inPlace ? mDataMQ->commitWrite(readResult)
+                               : mDataMQ->write(&mBuffer[0], readResult);
+        if (!written) {
             ALOGW("data message queue write failed");
         }
     } else {
@@ -111,6 +125,7 @@ bool ReadThread::threadLoop() {
         if (!(efState & static_cast<uint32_t>(MessageQueueFlagBits::NOT_FULL))) {
             continue;  // Nothing to do.
         }
+        mJitter->onWakeup();
         if (!mCommandMQ->read(&mParameters)) {
             continue;  // Nothing to do.
         }
@@ -159,6 +174,7 @@ StreamIn::~StreamIn() {
         status_t status = EventFlag::deleteEventFlag(&mEfGroup);
         ALOGE_IF(status, "read MQ event flag deletion error: %s", strerror(-status));
     }
+    mStreamMmap->stopPositionUpdates();
     mDevice->closeInputStream(mStream);
     mStream = nullptr;
 }
@@ -244,7 +260,9 @@ Return<Result> StreamIn::setHwAvSync(uint32_t hwAvSync) {
 
 #if MAJOR_VERSION == 2
 Return<Result> StreamIn::setConnectedState(const DeviceAddress& address, bool connected) {
-    return mStreamCommon->setConnectedState(address, connected);
+    Return<Result> result = mStreamCommon->setConnectedState(address, connected);
+    mDevice->invalidateAudioPortCache();
+    return result;
 }
 
 Return<AudioDevice> StreamIn::getDevice() {
@@ -252,7 +270,9 @@ Return<AudioDevice> StreamIn::getDevice() {
 }
 
 Return<Result> StreamIn::setDevice(const DeviceAddress& address) {
-    return mStreamCommon->setDevice(address);
+    Return<Result> result = mStreamCommon->setDevice(address);
+    mDevice->invalidateAudioPortCache();
+    return result;
 }
 
 Return<void> StreamIn::getParameters(const hidl_vec<hidl_string>& keys, getParameters_cb _hidl_cb) {
@@ -260,7 +280,9 @@ Return<void> StreamIn::getParameters(const hidl_vec<hidl_string>& keys, getParam
 }
 
 Return<Result> StreamIn::setParameters(const hidl_vec<ParameterValue>& parameters) {
-    return mStreamCommon->setParameters(parameters);
+    Return<Result> result = mStreamCommon->setParameters(parameters);
+    mDevice->invalidateAudioPortCache();
+    return result;
 }
 
 Return<void> StreamIn::debugDump(const hidl_handle& fd) {
@@ -272,7 +294,9 @@ Return<void> StreamIn::getDevices(getDevices_cb _hidl_cb) {
 }
 
 Return<Result> StreamIn::setDevices(const hidl_vec<DeviceAddress>& devices) {
-    return mStreamCommon->setDevices(devices);
+    Return<Result> result = mStreamCommon->setDevices(devices);
+    mDevice->invalidateAudioPortCache();
+    return result;
 }
 Return<void> StreamIn::getParameters(const hidl_vec<ParameterValue>& context,
                                      const hidl_vec<hidl_string>& keys, getParameters_cb _hidl_cb) {
@@ -281,7 +305,9 @@ Return<void> StreamIn::getParameters(const hidl_vec<ParameterValue>& context,
 
 Return<Result> StreamIn::setParameters(const hidl_vec<ParameterValue>& context,
                                        const hidl_vec<ParameterValue>& parameters) {
-    return mStreamCommon->setParameters(context, parameters);
+    Return<Result> result = mStreamCommon->setParameters(context, parameters);
+    mDevice->invalidateAudioPortCache();
+    return result;
 }
 #endif
 
@@ -389,7 +415,8 @@ Return<void> StreamIn::prepareForReading(uint32_t frameSize, uint32_t framesCoun
     // Create and launch the thread.
     auto tempReadThread =
         std::make_unique<ReadThread>(&mStopReadThread, mStream, tempCommandMQ.get(),
-                                     tempDataMQ.get(), tempStatusMQ.get(), tempElfGroup.get());
+                                     tempDataMQ.get(), tempStatusMQ.get(), tempElfGroup.get(),
+                                     &mReadJitter);
     if (!tempReadThread->init()) {
         ALOGW("failed to start reader thread: %s", strerror(-status));
         sendError(Result::INVALID_ARGUMENTS);
@@ -409,6 +436,11 @@ Return<void> StreamIn::prepareForReading(uint32_t frameSize, uint32_t framesCoun
     mEfGroup = tempElfGroup.release();
     threadInfo.pid = getpid();
     threadInfo.tid = mReadThread->getTid();
+    // The client reads one buffer of framesCount frames per period.
+    uint32_t sampleRate = mStream->common.get_sample_rate(&mStream->common);
+    uint64_t periodNs = sampleRate != 0 ? uint64_t(framesCount) * 1000000000 / sampleRate : 0;
+    mReadJitter.setPeriod(periodNs);
+    RealtimePolicy::fromProperties().apply(threadInfo.tid, periodNs);
     _hidl_cb(Result::OK, *mCommandMQ->getDesc(), *mDataMQ->getDesc(), *mStatusMQ->getDesc(),
              threadInfo);
     return Void();
@@ -445,7 +477,11 @@ Return<void> StreamIn::getCapturePosition(getCapturePosition_cb _hidl_cb) {
 }
 
 Return<void> StreamIn::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
-    return mStreamCommon->debug(fd, options);
+    mStreamCommon->debug(fd, options);
+    if (fd.getNativeHandle() != nullptr && fd->numFds > 0) {
+        mReadJitter.dump(fd->data[0], "Reader");
+    }
+    return Void();
 }
 
 #if MAJOR_VERSION >= 4
@@ -36,12 +36,17 @@ namespace implementation {
 
 namespace {
 
+// Commands a client may queue before waiting for their status: a write followed
+// by the presentation position and latency queries.
+constexpr size_t kMaxQueuedCommands = 3;
+
 class WriteThread : public Thread {
    public:
     // WriteThread's lifespan never exceeds StreamOut's lifespan.
     WriteThread(std::atomic<bool>* stop, audio_stream_out_t* stream,
                 StreamOut::CommandMQ* commandMQ, StreamOut::DataMQ* dataMQ,
-                StreamOut::StatusMQ* statusMQ, EventFlag* efGroup)
+                StreamOut::StatusMQ* statusMQ, EventFlag* efGroup,
+                WakeupJitterHistogram* jitter)
         : Thread(false /*canCallJava*/),
           mStop(stop),
           mStream(stream),
@@ -49,6 +54,7 @@ class WriteThread : public Thread {
           mDataMQ(dataMQ),
           mStatusMQ(statusMQ),
           mEfGroup(efGroup),
+          mJitter(jitter),
           mBuffer(nullptr) {}
     bool init() {
         mBuffer.reset(new (std::nothrow) uint8_t[mDataMQ->getQuantumCount()]);
@@ -63,6 +69,7 @@ class WriteThread : public Thread {
     StreamOut::DataMQ* mDataMQ;
     StreamOut::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
+    WakeupJitterHistogram* mJitter;
     std::unique_ptr<uint8_t[]> mBuffer;
     IStreamOut::WriteStatus mStatus;
 
@@ -77,13 +84,23 @@ void WriteThread::doWrite() {
     const size_t availToRead = mDataMQ->availableToRead();
     mStatus.retval = Result::OK;
     mStatus.reply.written = 0;
-    if (mDataMQ->read(&mBuffer[0], availToRead)) {
-        ssize_t writeResult = mStream->write(mStream, &mBuffer[0], availToRead);
-        if (writeResult >= 0) {
-            mStatus.reply.written = writeResult;
-        } else {
-            mStatus.retval = Stream::analyzeStatus("write", writeResult);
-        }
+    // Pass the data to the legacy HAL straight from the shared queue memory. Only
+    // data wrapping around the end of the queue is copied, to keep a single write.
+    StreamOut::DataMQ::MemTransaction tx;
+    if (!mDataMQ->beginRead(availToRead, &tx)) {
+        return;
+    }
+    const uint8_t* data = tx.getFirstRegion().getAddress();
+    if (tx.getSecondRegion().getLength() != 0) {
+        tx.copyFrom(&mBuffer[0], 0, availToRead);
+        data = &mBuffer[0];
+    }
+    ssize_t writeResult = mStream->write(mStream, data, availToRead);
+    mDataMQ->commitRead(availToRead);
+    if (writeResult >= 0) {
+        mStatus.reply.written = writeResult;
+    } else {
+        mStatus.retval = Stream::analyzeStatus("write", writeResult);
     }
 }
 
@@ -108,26 +125,34 @@ bool WriteThread::threadLoop() {
         if (!(efState & static_cast<uint32_t>(MessageQueueFlagBits::NOT_EMPTY))) {
             continue;  // Nothing to do.
         }
-        if (!mCommandMQ->read(&mStatus.replyTo)) {
-            continue;  // Nothing to do.
+        mJitter->onWakeup();
+        // Answer every queued command before waking the client once, so that a
+        // write and the position and latency queries following it cost a single
+        // wake/wait cycle when the client queues them together.
+        size_t replies = 0;
+        while (mCommandMQ->read(&mStatus.replyTo)) {
+            switch (mStatus.replyTo) {
+                case IStreamOut::WriteCommand::WRITE:
+                    doWrite();
+                    break;
+                case IStreamOut::WriteCommand::GET_PRESENTATION_POSITION:
+                    doGetPresentationPosition();
+                    break;
+                case IStreamOut::WriteCommand::GET_LATENCY:
+                    doGetLatency();
+                    break;
+                default:
+                    ALOGE("Unknown write thread command code %d", mStatus.replyTo);
+                    mStatus.retval = Result::NOT_SUPPORTED;
+                    break;
+            }
+            if (!mStatusMQ->write(&mStatus)) {
+                ALOGE("status message queue write failed");
+            }
+            replies++;
         }
-        switch (mStatus.replyTo) {
-            case IStreamOut::WriteCommand::WRITE:
-                doWrite();
-                break;
-            case IStreamOut::WriteCommand::GET_PRESENTATION_POSITION:
-                doGetPresentationPosition();
-                break;
-            case IStreamOut::WriteCommand::GET_LATENCY:
-                doGetLatency();
-                break;
-            default:
-                ALOGE("Unknown write thread command code %d", mStatus.replyTo);
-                mStatus.retval = Result::NOT_SUPPORTED;
-                break;
-        }
-        if (!mStatusMQ->write(&mStatus)) {
-            ALOGE("status message queue write failed");
+        if (replies == 0) {
+            continue;  // Nothing to do.
         }
         mEfGroup->wake(static_cast<uint32_t>(MessageQueueFlagBits::NOT_FULL));
     }
@@ -159,6 +184,7 @@ StreamOut::~StreamOut() {
         ALOGE_IF(status, "write MQ event flag deletion error: %s", strerror(-status));
     }
     mCallback.clear();
+    mStreamMmap->stopPositionUpdates();
     mDevice->closeOutputStream(mStream);
     // Closing the output stream in the HAL waits for the callback to finish,
     // and joins the callback thread. Thus is it guaranteed that the callback
@@ -247,7 +273,9 @@ Return<Result> StreamOut::setHwAvSync(uint32_t hwAvSync) {
 
 #if MAJOR_VERSION == 2
 Return<Result> StreamOut::setConnectedState(const DeviceAddress& address, bool connected) {
-    return mStreamCommon->setConnectedState(address, connected);
+    Return<Result> result = mStreamCommon->setConnectedState(address, connected);
+    mDevice->invalidateAudioPortCache();
+    return result;
 }
 
 Return<AudioDevice> StreamOut::getDevice() {
@@ -255,7 +283,9 @@ Return<AudioDevice> StreamOut::getDevice() {
 }
 
 Return<Result> StreamOut::setDevice(const DeviceAddress& address) {
-    return mStreamCommon->setDevice(address);
+    Return<Result> result = mStreamCommon->setDevice(address);
+    mDevice->invalidateAudioPortCache();
+    return result;
 }
 
 Return<void> StreamOut::getParameters(const hidl_vec<hidl_string>& keys,
@@ -264,7 +294,9 @@ Return<void> StreamOut::getParameters(const hidl_vec<hidl_string>& keys,
 }
 
 Return<Result> StreamOut::setParameters(const hidl_vec<ParameterValue>& parameters) {
-    return mStreamCommon->setParameters(parameters);
+    Return<Result> result = mStreamCommon->setParameters(parameters);
+    mDevice->invalidateAudioPortCache();
+    return result;
 }
 
 Return<void> StreamOut::debugDump(const hidl_handle& fd) {
@@ -276,7 +308,9 @@ Return<void> StreamOut::getDevices(getDevices_cb _hidl_cb) {
 }
 
 Return<Result> StreamOut::setDevices(const hidl_vec<DeviceAddress>& devices) {
-    return mStreamCommon->setDevices(devices);
+    Return<Result> result = mStreamCommon->setDevices(devices);
+    mDevice->invalidateAudioPortCache();
+    return result;
 }
 Return<void> StreamOut::getParameters(const hidl_vec<ParameterValue>& context,
                                       const hidl_vec<hidl_string>& keys,
@@ -286,7 +320,9 @@ Return<void> StreamOut::getParameters(const hidl_vec<ParameterValue>& context,
 
 Return<Result> StreamOut::setParameters(const hidl_vec<ParameterValue>& context,
                                         const hidl_vec<ParameterValue>& parameters) {
-    return mStreamCommon->setParameters(context, parameters);
+    Return<Result> result = mStreamCommon->setParameters(context, parameters);
+    mDevice->invalidateAudioPortCache();
+    return result;
 }
 #endif
 
@@ -335,7 +371,7 @@ Return<void> StreamOut::prepareForWriting(uint32_t frameSize, uint32_t framesCou
         sendError(Result::INVALID_STATE);
         return Void();
     }
-    std::unique_ptr<CommandMQ> tempCommandMQ(new CommandMQ(1));
+    std::unique_ptr<CommandMQ> tempCommandMQ(new CommandMQ(kMaxQueuedCommands));
 
     // Check frameSize and framesCount
     if (frameSize == 0 || framesCount == 0) {
@@ -351,7 +387,7 @@ Return<void> StreamOut::prepareForWriting(uint32_t frameSize, uint32_t framesCou
     }
     std::unique_ptr<DataMQ> tempDataMQ(new DataMQ(frameSize * framesCount, true /* EventFlag */));
 
-    std::unique_ptr<StatusMQ> tempStatusMQ(new StatusMQ(1));
+    std::unique_ptr<StatusMQ> tempStatusMQ(new StatusMQ(kMaxQueuedCommands));
     if (!tempCommandMQ->isValid() || !tempDataMQ->isValid() || !tempStatusMQ->isValid()) {
         ALOGE_IF(!tempCommandMQ->isValid(), "command MQ is invalid");
         ALOGE_IF(!tempDataMQ->isValid(), "data MQ is invalid");
@@ -372,7 +408,8 @@ Return<void> StreamOut::prepareForWriting(uint32_t frameSize, uint32_t framesCou
     // Create and launch the thread.
     auto tempWriteThread =
         std::make_unique<WriteThread>(&mStopWriteThread, mStream, tempCommandMQ.get(),
-                                      tempDataMQ.get(), tempStatusMQ.get(), tempElfGroup.get());
+                                      tempDataMQ.get(), tempStatusMQ.get(), tempElfGroup.get(),
+                                      &mWriteJitter);
     if (!tempWriteThread->init()) {
         ALOGW("failed to start writer thread: %s", strerror(-status));
         sendError(Result::INVALID_ARGUMENTS);
@@ -392,6 +429,11 @@ Return<void> StreamOut::prepareForWriting(uint32_t frameSize, uint32_t framesCou
     mEfGroup = tempElfGroup.release();
     threadInfo.pid = getpid();
     threadInfo.tid = mWriteThread->getTid();
+    // The client writes one buffer of framesCount frames per period.
+    uint32_t sampleRate = mStream->common.get_sample_rate(&mStream->common);
+    uint64_t periodNs = sampleRate != 0 ? uint64_t(framesCount) * 1000000000 / sampleRate : 0;
+    mWriteJitter.setPeriod(periodNs);
+    RealtimePolicy::fromProperties().apply(threadInfo.tid, periodNs);
     _hidl_cb(Result::OK, *mCommandMQ->getDesc(), *mDataMQ->getDesc(), *mStatusMQ->getDesc(),
              threadInfo);
     return Void();
@@ -542,7 +584,11 @@ Return<void> StreamOut::getMmapPosition(getMmapPosition_cb _hidl_cb) {
 }
 
 Return<void> StreamOut::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
-    return mStreamCommon->debug(fd, options);
+    mStreamCommon->debug(fd, options);
+    if (fd.getNativeHandle() != nullptr && fd->numFds > 0) {
+        mWriteJitter.dump(fd->data[0], "Writer");
+    }
+    return Void();
 }
 
 #if MAJOR_VERSION >= 4
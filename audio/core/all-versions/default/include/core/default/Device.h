@@ -22,6 +22,8 @@
 #include "ParametersUtil.h"
 
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include <hardware/audio.h>
 #include <media/AudioParameter.h>
@@ -123,10 +125,18 @@ struct Device : public IDevice, public ParametersUtil {
     void closeInputStream(audio_stream_in_t* stream);
     void closeOutputStream(audio_stream_out_t* stream);
     audio_hw_device_t* device() const { return mDevice; }
+    // Drops the ports cached by getAudioPort, on any change that may alter them. Must be called
+    // once the change is done: a getAudioPort racing with it then either sees the new ports or
+    // does not cache what it read.
+    void invalidateAudioPortCache();
 
    private:
     audio_hw_device_t* mDevice;
 
+    std::mutex mAudioPortCacheLock;  // Protects the members below
+    std::unordered_map<AudioPortHandle, AudioPort> mAudioPortCache;
+    uint64_t mAudioPortCacheGeneration = 0;
+
     virtual ~Device();
 
     // Methods from ParametersUtil.
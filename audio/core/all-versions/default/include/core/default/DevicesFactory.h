@@ -19,6 +19,12 @@
 
 #include PATH(android/hardware/audio/FILE_VERSION/IDevicesFactory.h)
 
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include <hardware/audio.h>
 
 #include <hidl/Status.h>
@@ -38,6 +44,9 @@ using ::android::hardware::Void;
 using namespace ::android::hardware::audio::CPP_VERSION;
 
 struct DevicesFactory : public IDevicesFactory {
+    DevicesFactory();
+    ~DevicesFactory() override;
+
 #if MAJOR_VERSION == 2
     Return<void> openDevice(IDevicesFactory::Device device, openDevice_cb _hidl_cb) override;
 #elif MAJOR_VERSION >= 4
@@ -51,6 +60,20 @@ struct DevicesFactory : public IDevicesFactory {
     Return<void> openDevice(const char* moduleName, openDevice_cb _hidl_cb);
 
     static int loadAudioInterface(const char* if_name, audio_hw_device_t** dev);
+
+    // Result of loadAudioInterface
+    struct LoadedInterface {
+        int status;
+        audio_hw_device_t* device;
+    };
+
+    // Starts loading each module on a thread of its own. openDevice takes the first
+    // device of a module from there, waiting for its load to complete if needed.
+    void preloadAudioInterfaces(const std::vector<std::string>& moduleNames);
+    int takeOrLoadAudioInterface(const char* if_name, audio_hw_device_t** dev);
+
+    std::mutex mPreloadedLock;
+    std::map<std::string, std::future<LoadedInterface>> mPreloaded;
 };
 
 extern "C" IDevicesFactory* HIDL_FETCH_IDevicesFactory(const char* name);
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUDIO_MMAP_POSITION_CHANNEL_H
+#define ANDROID_HARDWARE_AUDIO_MMAP_POSITION_CHANNEL_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace android {
+namespace hardware {
+namespace audio {
+namespace CPP_VERSION {
+namespace implementation {
+
+/**
+ * The latest MMAP position of a stream, published by a single writer and read
+ * without locking by any number of readers. A sequence counter that is odd
+ * while an update is in progress lets readers detect, and retry, a read racing
+ * with an update (seqlock), so they always get a time and a position from the
+ * same update. The layout only holds lock free atomics, so it can be placed in
+ * memory shared with another process.
+ */
+class MmapPositionChannel {
+   public:
+    void publish(int64_t timeNanoseconds, int64_t positionFrames) {
+        const uint32_t seq = mSeq.load(std::memory_order_relaxed);
+        mSeq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        mTimeNanoseconds.store(timeNanoseconds, std::memory_order_relaxed);
+        mPositionFrames.store(positionFrames, std::memory_order_relaxed);
+        mSeq.store(seq + 2, std::memory_order_release);
+    }
+
+    /** Makes readers fall back to querying the HAL. */
+    void invalidate() { publish(0, 0); }
+
+    /** @return false if there is no valid position or the writer kept racing the reader. */
+    bool read(int64_t* timeNanoseconds, int64_t* positionFrames) const {
+        for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt) {
+            const uint32_t seq = mSeq.load(std::memory_order_acquire);
+            if (seq & 1) {
+                continue;
+            }
+            const int64_t time = mTimeNanoseconds.load(std::memory_order_relaxed);
+            const int64_t position = mPositionFrames.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (mSeq.load(std::memory_order_relaxed) != seq) {
+                continue;
+            }
+            if (time == 0) {
+                return false;
+            }
+            *timeNanoseconds = time;
+            *positionFrames = position;
+            return true;
+        }
+        return false;
+    }
+
+   private:
+    static constexpr int kMaxReadAttempts = 8;
+
+    std::atomic<uint32_t> mSeq{0};
+    std::atomic<int64_t> mTimeNanoseconds{0};
+    std::atomic<int64_t> mPositionFrames{0};
+};
+
+}  // namespace implementation
+}  // namespace CPP_VERSION
+}  // namespace audio
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_AUDIO_MMAP_POSITION_CHANNEL_H
@@ -20,7 +20,10 @@
 #include PATH(android/hardware/audio/FILE_VERSION/types.h)
 
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
 
 #include <hidl/HidlSupport.h>
 #include <media/AudioParameter.h>
@@ -59,6 +62,19 @@ class ParametersUtil {
 
     virtual char* halGetParameters(const char* keys) = 0;
     virtual int halSetParameters(const char* keysAndValues) = 0;
+
+   private:
+    // Values of the keys that only change when set through setParams, kept to serve
+    // repeated reads without calling the legacy HAL. Any set of a key drops its value.
+    static bool isCacheableParam(const char* name);
+    bool getCachedParam(const char* name, String8* value, uint64_t* generation);
+    void cacheParam(const char* name, const String8& value, uint64_t generation);
+    void invalidateParams(const AudioParameter& param);
+
+    std::mutex mCacheLock;
+    std::map<std::string, String8> mCache;
+    // Incremented by each set, so that a read racing with a set does not cache a stale value.
+    uint64_t mCacheGeneration = 0;
 };
 
 }  // namespace implementation
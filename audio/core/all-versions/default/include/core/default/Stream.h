@@ -19,10 +19,18 @@
 
 #include PATH(android/hardware/audio/FILE_VERSION/IStream.h)
 
+#include "MmapPositionChannel.h"
 #include "ParametersUtil.h"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <vector>
 
+#include <cutils/properties.h>
+
 #include <hardware/audio.h>
 #include <hidl/Status.h>
 
@@ -121,7 +129,17 @@ struct Stream : public IStream, public ParametersUtil {
 
 template <typename T>
 struct StreamMmap : public RefBase {
-    explicit StreamMmap(T* stream) : mStream(stream) {}
+    /**
+     * While the stream is started, the position is polled from the HAL every
+     * ro.vendor.audio.mmap_position_period_us and getMmapPosition returns the
+     * latest poll, at most one period old, without calling into the HAL.
+     * 0 (the default) queries the HAL on every call.
+     */
+    explicit StreamMmap(T* stream)
+        : mStream(stream),
+          mPositionPeriod(std::max(
+              property_get_int32("ro.vendor.audio.mmap_position_period_us", 0), 0)) {}
+    ~StreamMmap() { stopPositionUpdates(); }
 
     Return<Result> start();
     Return<Result> stop();
@@ -129,26 +147,80 @@ struct StreamMmap : public RefBase {
                                   IStream::createMmapBuffer_cb _hidl_cb);
     Return<void> getMmapPosition(IStream::getMmapPosition_cb _hidl_cb);
 
+    /** Must be called before the legacy stream is closed. */
+    void stopPositionUpdates();
+
    private:
     StreamMmap() {}
 
+    void startPositionUpdates();
+    void updatePositionLoop();
+
     T* mStream;
+    const std::chrono::microseconds mPositionPeriod;
+    MmapPositionChannel mPosition;
+    std::mutex mUpdateLock;  // Protects the members below
+    std::condition_variable mUpdateCondition;
+    std::thread mUpdateThread;
+    bool mStopUpdates = false;
 };
 
 template <typename T>
 Return<Result> StreamMmap<T>::start() {
     if (mStream->start == NULL) return Result::NOT_SUPPORTED;
     int result = mStream->start(mStream);
+    if (result == 0) {
+        startPositionUpdates();
+    }
     return Stream::analyzeStatus("start", result);
 }
 
 template <typename T>
 Return<Result> StreamMmap<T>::stop() {
     if (mStream->stop == NULL) return Result::NOT_SUPPORTED;
+    stopPositionUpdates();
     int result = mStream->stop(mStream);
     return Stream::analyzeStatus("stop", result);
 }
 
+template <typename T>
+void StreamMmap<T>::startPositionUpdates() {
+    if (mPositionPeriod.count() == 0 || mStream->get_mmap_position == NULL) return;
+    std::lock_guard<std::mutex> lock(mUpdateLock);
+    if (mUpdateThread.joinable()) return;
+    mStopUpdates = false;
+    mUpdateThread = std::thread(&StreamMmap<T>::updatePositionLoop, this);
+}
+
+template <typename T>
+void StreamMmap<T>::stopPositionUpdates() {
+    std::thread updateThread;
+    {
+        std::lock_guard<std::mutex> lock(mUpdateLock);
+        mStopUpdates = true;
+        updateThread = std::move(mUpdateThread);
+    }
+    mUpdateCondition.notify_all();
+    if (updateThread.joinable()) {
+        updateThread.join();
+    }
+    mPosition.invalidate();
+}
+
+template <typename T>
+void StreamMmap<T>::updatePositionLoop() {
+    std::unique_lock<std::mutex> lock(mUpdateLock);
+    while (!mStopUpdates) {
+        struct audio_mmap_position halPosition;
+        if (mStream->get_mmap_position(mStream, &halPosition) == 0) {
+            mPosition.publish(halPosition.time_nanoseconds, halPosition.position_frames);
+        } else {
+            mPosition.invalidate();
+        }
+        mUpdateCondition.wait_for(lock, mPositionPeriod, [this] { return mStopUpdates; });
+    }
+}
+
 template <typename T>
 Return<void> StreamMmap<T>::createMmapBuffer(int32_t minSizeFrames, size_t frameSize,
                                              IStream::createMmapBuffer_cb _hidl_cb) {
@@ -196,6 +268,12 @@ Return<void> StreamMmap<T>::getMmapPosition(IStream::getMmapPosition_cb _hidl_cb
     Result retval(Result::NOT_SUPPORTED);
     MmapPosition position;
 
+    int64_t positionFrames;
+    if (mPosition.read(&position.timeNanoseconds, &positionFrames)) {
+        position.positionFrames = positionFrames;
+        _hidl_cb(Result::OK, position);
+        return Void();
+    }
     if (mStream->get_mmap_position != NULL) {
         struct audio_mmap_position halPosition;
         retval = Stream::analyzeStatus("get_mmap_position",
@@ -22,6 +22,8 @@
 #include "Device.h"
 #include "Stream.h"
 
+#include "common/all-versions/default/RealtimeThread.h"
+
 #include <atomic>
 #include <memory>
 
@@ -131,6 +133,7 @@ struct StreamIn : public IStreamIn {
     EventFlag* mEfGroup;
     std::atomic<bool> mStopReadThread;
     sp<Thread> mReadThread;
+    WakeupJitterHistogram mReadJitter;
 
     virtual ~StreamIn();
 };
@@ -22,6 +22,8 @@
 #include "Device.h"
 #include "Stream.h"
 
+#include "common/all-versions/default/RealtimeThread.h"
+
 #include <atomic>
 #include <memory>
 
@@ -138,6 +140,7 @@ struct StreamOut : public IStreamOut {
     EventFlag* mEfGroup;
     std::atomic<bool> mStopWriteThread;
     sp<Thread> mWriteThread;
+    WakeupJitterHistogram mWriteJitter;
 
     virtual ~StreamOut();
 
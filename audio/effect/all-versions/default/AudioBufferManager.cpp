@@ -24,30 +24,55 @@ namespace android {
 
 ANDROID_SINGLETON_STATIC_INSTANCE(AudioBufferManager);
 
+// static
+size_t AudioBufferManager::shardIndex(uint64_t id) {
+    // Buffer ids are usually allocated in sequence, mix the bits before taking the shard.
+    id ^= id >> 33;
+    id *= 0xff51afd7ed558ccdULL;
+    id ^= id >> 33;
+    return id % kShardCount;
+}
+
+// static
+sp<AudioBufferWrapper> AudioBufferManager::findLocked(Shard& shard, const AudioBuffer& buffer) {
+    ssize_t idx = shard.buffers.indexOfKey(buffer.id);
+    if (idx < 0) return nullptr;
+    sp<AudioBufferWrapper> wrapper = shard.buffers[idx].promote();
+    if (wrapper != nullptr) {
+        wrapper->getHalBuffer()->frameCount = buffer.frameCount;
+    }
+    return wrapper;
+}
+
 bool AudioBufferManager::wrap(const AudioBuffer& buffer, sp<AudioBufferWrapper>* wrapper) {
-    // Check if we have this buffer already
-    std::lock_guard<std::mutex> lock(mLock);
-    ssize_t idx = mBuffers.indexOfKey(buffer.id);
-    if (idx >= 0) {
-        *wrapper = mBuffers[idx].promote();
-        if (*wrapper != nullptr) {
-            (*wrapper)->getHalBuffer()->frameCount = buffer.frameCount;
-            return true;
-        }
-        mBuffers.removeItemsAt(idx);
+    Shard& shard = mShards[shardIndex(buffer.id)];
+    // Check if we have this buffer already, in which case its memory is already mapped.
+    {
+        std::lock_guard<std::mutex> lock(shard.lock);
+        *wrapper = findLocked(shard, buffer);
+        if (*wrapper != nullptr) return true;
     }
-    // Need to create and init a new AudioBufferWrapper.
+    // Need to create and init a new AudioBufferWrapper. Mapping the memory is slow,
+    // do it without holding the lock.
     sp<AudioBufferWrapper> tempBuffer(new AudioBufferWrapper(buffer));
     if (!tempBuffer->init()) return false;
+    std::lock_guard<std::mutex> lock(shard.lock);
+    // Another effect could have wrapped the same buffer in the meantime.
+    *wrapper = findLocked(shard, buffer);
+    if (*wrapper != nullptr) return true;
     *wrapper = tempBuffer;
-    mBuffers.add(buffer.id, *wrapper);
+    shard.buffers.replaceValueFor(buffer.id, *wrapper);
     return true;
 }
 
-void AudioBufferManager::removeEntry(uint64_t id) {
-    std::lock_guard<std::mutex> lock(mLock);
-    ssize_t idx = mBuffers.indexOfKey(id);
-    if (idx >= 0) mBuffers.removeItemsAt(idx);
+void AudioBufferManager::removeEntry(uint64_t id, AudioBufferWrapper* wrapper) {
+    Shard& shard = mShards[shardIndex(id)];
+    std::lock_guard<std::mutex> lock(shard.lock);
+    ssize_t idx = shard.buffers.indexOfKey(id);
+    // The entry may already belong to a new wrapper of the same buffer.
+    if (idx >= 0 && shard.buffers[idx].unsafe_get() == wrapper) {
+        shard.buffers.removeItemsAt(idx);
+    }
 }
 
 namespace hardware {
@@ -60,7 +85,7 @@ AudioBufferWrapper::AudioBufferWrapper(const AudioBuffer& buffer)
     : mHidlBuffer(buffer), mHalBuffer{0, {nullptr}} {}
 
 AudioBufferWrapper::~AudioBufferWrapper() {
-    AudioBufferManager::getInstance().removeEntry(mHidlBuffer.id);
+    AudioBufferManager::getInstance().removeEntry(mHidlBuffer.id, this);
 }
 
 bool AudioBufferWrapper::init() {
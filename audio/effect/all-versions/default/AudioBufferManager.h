@@ -72,11 +72,23 @@ class AudioBufferManager : public Singleton<AudioBufferManager> {
    private:
     friend class hardware::audio::effect::CPP_VERSION::implementation::AudioBufferWrapper;
 
+    // The buffers are spread over shards by id, so that effects wrapping
+    // different buffers do not contend on a single lock.
+    static constexpr size_t kShardCount = 16;
+
+    struct Shard {
+        std::mutex lock;
+        KeyedVector<uint64_t, wp<AudioBufferWrapper>> buffers;
+    };
+
+    static size_t shardIndex(uint64_t id);
+    // Returns the live wrapper of the buffer, updating its frame count, or null.
+    static sp<AudioBufferWrapper> findLocked(Shard& shard, const AudioBuffer& buffer);
+
     // Called by AudioBufferWrapper.
-    void removeEntry(uint64_t id);
+    void removeEntry(uint64_t id, AudioBufferWrapper* wrapper);
 
-    std::mutex mLock;
-    KeyedVector<uint64_t, wp<AudioBufferWrapper>> mBuffers;
+    Shard mShards[kShardCount];
 };
 
 }  // namespace android
@@ -49,7 +49,7 @@ class ProcessThread : public Thread {
     // ProcessThread's lifespan never exceeds Effect's lifespan.
     ProcessThread(std::atomic<bool>* stop, effect_handle_t effect,
                   std::atomic<audio_buffer_t*>* inBuffer, std::atomic<audio_buffer_t*>* outBuffer,
-                  Effect::StatusMQ* statusMQ, EventFlag* efGroup)
+                  Effect::StatusMQ* statusMQ, EventFlag* efGroup, WakeupJitterHistogram* jitter)
         : Thread(false /*canCallJava*/),
           mStop(stop),
           mEffect(effect),
@@ -57,7 +57,8 @@ class ProcessThread : public Thread {
           mInBuffer(inBuffer),
           mOutBuffer(outBuffer),
           mStatusMQ(statusMQ),
-          mEfGroup(efGroup) {}
+          mEfGroup(efGroup),
+          mJitter(jitter) {}
     virtual ~ProcessThread() {}
 
    private:
@@ -68,6 +69,7 @@ class ProcessThread : public Thread {
     std::atomic<audio_buffer_t*>* mOutBuffer;
     Effect::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
+    WakeupJitterHistogram* mJitter;
 
     bool threadLoop() override;
 };
@@ -82,6 +84,7 @@ bool ProcessThread::threadLoop() {
             (efState & static_cast<uint32_t>(MessageQueueFlagBits::REQUEST_QUIT))) {
             continue;  // Nothing to do or time to quit.
         }
+        mJitter->onWakeup();
         Result retval = Result::OK;
         if (efState & static_cast<uint32_t>(MessageQueueFlagBits::REQUEST_PROCESS_REVERSE) &&
             !mHasProcessReverse) {
@@ -372,13 +375,16 @@ Return<void> Effect::prepareForProcessing(prepareForProcessing_cb _hidl_cb) {
 
     // Create and launch the thread.
     mProcessThread = new ProcessThread(&mStopProcessThread, mHandle, &mHalInBufferPtr,
-                                       &mHalOutBufferPtr, tempStatusMQ.get(), mEfGroup);
+                                       &mHalOutBufferPtr, tempStatusMQ.get(), mEfGroup,
+                                       &mProcessJitter);
     status = mProcessThread->run("effect", PRIORITY_URGENT_AUDIO);
     if (status != OK) {
         ALOGW("failed to start effect processing thread: %s", strerror(-status));
         _hidl_cb(Result::INVALID_ARGUMENTS, MQDescriptorSync<Result>());
         return Void();
     }
+    // The processing period is only known to the client, so no SCHED_DEADLINE here.
+    RealtimePolicy::fromProperties().apply(mProcessThread->getTid(), 0);
 
     mStatusMQ = std::move(tempStatusMQ);
     _hidl_cb(Result::OK, *mStatusMQ->getDesc());
@@ -714,6 +720,7 @@ Return<void> Effect::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /
     if (fd.getNativeHandle() != nullptr && fd->numFds == 1) {
         uint32_t cmdData = fd->data[0];
         (void)sendCommand(EFFECT_CMD_DUMP, "DUMP", sizeof(cmdData), &cmdData);
+        mProcessJitter.dump(fd->data[0], "Process");
     }
     return Void();
 }
@@ -20,6 +20,7 @@
 #include PATH(android/hardware/audio/effect/FILE_VERSION/IEffect.h)
 
 #include "AudioBufferManager.h"
+#include "common/all-versions/default/RealtimeThread.h"
 
 #include <atomic>
 #include <memory>
@@ -180,6 +181,7 @@ struct Effect : public IEffect {
     EventFlag* mEfGroup;
     std::atomic<bool> mStopProcessThread;
     sp<Thread> mProcessThread;
+    WakeupJitterHistogram mProcessJitter;
 
     virtual ~Effect();
 
@@ -55,40 +55,53 @@ namespace implementation {
 
 using ::android::hardware::audio::common::CPP_VERSION::implementation::HidlUtils;
 
+namespace {
+
+template <typename T>
+sp<IEffect> createEffectInstance(effect_handle_t handle) {
+    return new T(handle);
+}
+
+}  // namespace
+
+EffectsFactory::EffectsFactory() {
+    std::lock_guard<std::mutex> lock(mDescriptorsLock);
+    loadDescriptorsLocked();
+}
+
+// static
+const EffectsFactory::UuidMap<EffectsFactory::EffectCreator>& EffectsFactory::getEffectCreators() {
+    static const UuidMap<EffectCreator> creators = {
+        {UuidKey(*FX_IID_AEC), createEffectInstance<AcousticEchoCancelerEffect>},
+        {UuidKey(*FX_IID_AGC), createEffectInstance<AutomaticGainControlEffect>},
+        {UuidKey(*SL_IID_BASSBOOST), createEffectInstance<BassBoostEffect>},
+        {UuidKey(*EFFECT_UIID_DOWNMIX), createEffectInstance<DownmixEffect>},
+        {UuidKey(*SL_IID_ENVIRONMENTALREVERB), createEffectInstance<EnvironmentalReverbEffect>},
+        {UuidKey(*SL_IID_EQUALIZER), createEffectInstance<EqualizerEffect>},
+        {UuidKey(*FX_IID_LOUDNESS_ENHANCER), createEffectInstance<LoudnessEnhancerEffect>},
+        {UuidKey(*FX_IID_NS), createEffectInstance<NoiseSuppressionEffect>},
+        {UuidKey(*SL_IID_PRESETREVERB), createEffectInstance<PresetReverbEffect>},
+        {UuidKey(*SL_IID_VIRTUALIZER), createEffectInstance<VirtualizerEffect>},
+        {UuidKey(*SL_IID_VISUALIZATION), createEffectInstance<VisualizerEffect>},
+    };
+    return creators;
+}
+
 // static
 sp<IEffect> EffectsFactory::dispatchEffectInstanceCreation(const effect_descriptor_t& halDescriptor,
                                                            effect_handle_t handle) {
-    const effect_uuid_t* halUuid = &halDescriptor.type;
-    if (memcmp(halUuid, FX_IID_AEC, sizeof(effect_uuid_t)) == 0) {
-        return new AcousticEchoCancelerEffect(handle);
-    } else if (memcmp(halUuid, FX_IID_AGC, sizeof(effect_uuid_t)) == 0) {
-        return new AutomaticGainControlEffect(handle);
-    } else if (memcmp(halUuid, SL_IID_BASSBOOST, sizeof(effect_uuid_t)) == 0) {
-        return new BassBoostEffect(handle);
-    } else if (memcmp(halUuid, EFFECT_UIID_DOWNMIX, sizeof(effect_uuid_t)) == 0) {
-        return new DownmixEffect(handle);
-    } else if (memcmp(halUuid, SL_IID_ENVIRONMENTALREVERB, sizeof(effect_uuid_t)) == 0) {
-        return new EnvironmentalReverbEffect(handle);
-    } else if (memcmp(halUuid, SL_IID_EQUALIZER, sizeof(effect_uuid_t)) == 0) {
-        return new EqualizerEffect(handle);
-    } else if (memcmp(halUuid, FX_IID_LOUDNESS_ENHANCER, sizeof(effect_uuid_t)) == 0) {
-        return new LoudnessEnhancerEffect(handle);
-    } else if (memcmp(halUuid, FX_IID_NS, sizeof(effect_uuid_t)) == 0) {
-        return new NoiseSuppressionEffect(handle);
-    } else if (memcmp(halUuid, SL_IID_PRESETREVERB, sizeof(effect_uuid_t)) == 0) {
-        return new PresetReverbEffect(handle);
-    } else if (memcmp(halUuid, SL_IID_VIRTUALIZER, sizeof(effect_uuid_t)) == 0) {
-        return new VirtualizerEffect(handle);
-    } else if (memcmp(halUuid, SL_IID_VISUALIZATION, sizeof(effect_uuid_t)) == 0) {
-        return new VisualizerEffect(handle);
+    const auto& creators = getEffectCreators();
+    auto creator = creators.find(UuidKey(halDescriptor.type));
+    if (creator != creators.end()) {
+        return creator->second(handle);
     }
     return new Effect(handle);
 }
 
-// Methods from ::android::hardware::audio::effect::CPP_VERSION::IEffectsFactory follow.
-Return<void> EffectsFactory::getAllDescriptors(getAllDescriptors_cb _hidl_cb) {
-    Result retval(Result::OK);
-    hidl_vec<EffectDescriptor> result;
+Result EffectsFactory::loadDescriptorsLocked() {
+    if (mDescriptorsLoaded) {
+        return Result::OK;
+    }
     uint32_t numEffects;
     status_t status;
 
@@ -96,17 +109,13 @@ restart:
     numEffects = 0;
     status = EffectQueryNumberEffects(&numEffects);
     if (status != OK) {
-        retval = Result::NOT_INITIALIZED;
         ALOGE("Error querying number of effects: %s", strerror(-status));
-        goto exit;
+        return Result::NOT_INITIALIZED;
     }
-    result.resize(numEffects);
+    mHalDescriptors.resize(numEffects);
     for (uint32_t i = 0; i < numEffects; ++i) {
-        effect_descriptor_t halDescriptor;
-        status = EffectQueryEffect(i, &halDescriptor);
-        if (status == OK) {
-            effectDescriptorFromHal(halDescriptor, &result[i]);
-        } else {
+        status = EffectQueryEffect(i, &mHalDescriptors[i]);
+        if (status != OK) {
             ALOGE("Error querying effect at position %d / %d: %s", i, numEffects,
                   strerror(-status));
             switch (status) {
@@ -116,26 +125,51 @@ restart:
                 }
                 case -ENOENT: {
                     // No more effects available.
-                    result.resize(i);
+                    mHalDescriptors.resize(i);
                     break;
                 }
                 default: {
-                    result.resize(0);
-                    retval = Result::NOT_INITIALIZED;
+                    mHalDescriptors.clear();
+                    return Result::NOT_INITIALIZED;
                 }
             }
             break;
         }
     }
 
-exit:
-    _hidl_cb(retval, result);
+    mDescriptors.resize(mHalDescriptors.size());
+    mDescriptorIndex.clear();
+    for (size_t i = 0; i < mHalDescriptors.size(); ++i) {
+        effectDescriptorFromHal(mHalDescriptors[i], &mDescriptors[i]);
+        mDescriptorIndex.emplace(UuidKey(mHalDescriptors[i].uuid), i);
+    }
+    mDescriptorsLoaded = true;
+    return Result::OK;
+}
+
+// Methods from ::android::hardware::audio::effect::CPP_VERSION::IEffectsFactory follow.
+Return<void> EffectsFactory::getAllDescriptors(getAllDescriptors_cb _hidl_cb) {
+    // The effect libraries are only loaded when libeffects initializes, so the list
+    // queried once stays valid.
+    std::lock_guard<std::mutex> lock(mDescriptorsLock);
+    Result retval = loadDescriptorsLocked();
+    _hidl_cb(retval, retval == Result::OK ? mDescriptors : hidl_vec<EffectDescriptor>());
     return Void();
 }
 
 Return<void> EffectsFactory::getDescriptor(const Uuid& uid, getDescriptor_cb _hidl_cb) {
     effect_uuid_t halUuid;
     HidlUtils::uuidToHal(uid, &halUuid);
+    {
+        std::lock_guard<std::mutex> lock(mDescriptorsLock);
+        if (loadDescriptorsLocked() == Result::OK) {
+            auto index = mDescriptorIndex.find(UuidKey(halUuid));
+            if (index != mDescriptorIndex.end()) {
+                _hidl_cb(Result::OK, mDescriptors[index->second]);
+                return Void();
+            }
+        }
+    }
     effect_descriptor_t halDescriptor;
     status_t status = EffectGetDescriptor(&halUuid, &halDescriptor);
     EffectDescriptor descriptor;
@@ -166,7 +200,9 @@ Return<void> EffectsFactory::createEffect(const Uuid& uid, int32_t session, int3
     if (status == OK) {
         effect_descriptor_t halDescriptor;
         memset(&halDescriptor, 0, sizeof(effect_descriptor_t));
-        status = (*handle)->get_descriptor(handle, &halDescriptor);
+        if (!findHalDescriptor(halUuid, &halDescriptor)) {
+            status = (*handle)->get_descriptor(handle, &halDescriptor);
+        }
         if (status == OK) {
             effect = dispatchEffectInstanceCreation(halDescriptor, handle);
             effectId = EffectMap::getInstance().add(handle);
@@ -188,6 +224,20 @@ Return<void> EffectsFactory::createEffect(const Uuid& uid, int32_t session, int3
     return Void();
 }
 
+bool EffectsFactory::findHalDescriptor(const effect_uuid_t& uuid,
+                                       effect_descriptor_t* halDescriptor) {
+    std::lock_guard<std::mutex> lock(mDescriptorsLock);
+    if (!mDescriptorsLoaded) {
+        return false;
+    }
+    auto index = mDescriptorIndex.find(UuidKey(uuid));
+    if (index == mDescriptorIndex.end()) {
+        return false;
+    }
+    *halDescriptor = mHalDescriptors[index->second];
+    return true;
+}
+
 Return<void> EffectsFactory::debugDump(const hidl_handle& fd) {
     return debug(fd, {} /* options */);
 }
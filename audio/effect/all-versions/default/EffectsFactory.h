@@ -17,6 +17,12 @@
 #ifndef ANDROID_HARDWARE_AUDIO_EFFECT_EFFECTSFACTORY_H
 #define ANDROID_HARDWARE_AUDIO_EFFECT_EFFECTSFACTORY_H
 
+#include <string.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 #include <system/audio_effect.h>
 
 #include PATH(android/hardware/audio/effect/FILE_VERSION/IEffectsFactory.h)
@@ -45,6 +51,9 @@ using namespace ::android::hardware::audio::common::CPP_VERSION;
 using namespace ::android::hardware::audio::effect::CPP_VERSION;
 
 struct EffectsFactory : public IEffectsFactory {
+    // Queries the descriptors of all effects once, for every later lookup.
+    EffectsFactory();
+
     // Methods from ::android::hardware::audio::effect::CPP_VERSION::IEffectsFactory follow.
     Return<void> getAllDescriptors(getAllDescriptors_cb _hidl_cb) override;
     Return<void> getDescriptor(const Uuid& uid, getDescriptor_cb _hidl_cb) override;
@@ -55,8 +64,38 @@ struct EffectsFactory : public IEffectsFactory {
     Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
 
    private:
+    // An effect UUID as a hashable key
+    struct UuidKey {
+        explicit UuidKey(const effect_uuid_t& uuid) { memcpy(words, &uuid, sizeof(words)); }
+        bool operator==(const UuidKey& other) const {
+            return words[0] == other.words[0] && words[1] == other.words[1];
+        }
+        uint64_t words[2];
+    };
+    static_assert(sizeof(effect_uuid_t) == sizeof(UuidKey::words), "unexpected effect_uuid_t");
+    struct UuidKeyHash {
+        size_t operator()(const UuidKey& key) const {
+            return std::hash<uint64_t>()(key.words[0] ^ (key.words[1] * 0x9e3779b97f4a7c15ULL));
+        }
+    };
+    template <typename T>
+    using UuidMap = std::unordered_map<UuidKey, T, UuidKeyHash>;
+    using EffectCreator = sp<IEffect> (*)(effect_handle_t handle);
+
+    // Effect type to the IEffect implementation wrapping it
+    static const UuidMap<EffectCreator>& getEffectCreators();
     static sp<IEffect> dispatchEffectInstanceCreation(const effect_descriptor_t& halDescriptor,
                                                       effect_handle_t handle);
+
+    // Retried on the next call if libeffects could not be queried.
+    Result loadDescriptorsLocked();
+    bool findHalDescriptor(const effect_uuid_t& uuid, effect_descriptor_t* halDescriptor);
+
+    std::mutex mDescriptorsLock;  // Protects the members below
+    bool mDescriptorsLoaded = false;
+    std::vector<effect_descriptor_t> mHalDescriptors;
+    hidl_vec<EffectDescriptor> mDescriptors;
+    UuidMap<size_t> mDescriptorIndex;  // Effect implementation UUID to descriptor
 };
 
 extern "C" IEffectsFactory* HIDL_FETCH_IEffectsFactory(const char* name);
@@ -19,9 +19,14 @@
 #include "EvsCamera.h"
 #include "EvsEnumerator.h"
 
+#include <cutils/properties.h>
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
 
+#include <inttypes.h>
+#include <algorithm>
+#include <utility>
+
 
 namespace android {
 namespace hardware {
@@ -39,10 +44,19 @@ const char EvsCamera::kCameraName_Backup[]    = "backup";
 // Safeguards against unreasonable resource consumption and provides a testable limit
 const unsigned MAX_BUFFERS_IN_FLIGHT = 100;
 
+// The client index is carried in the upper bits of the bufferId we hand out, so a
+// returned frame can be credited to the client which held it
+const unsigned MAX_CLIENTS = 16;
+const unsigned CLIENT_ID_SHIFT = 16;
+const uint32_t BUFFER_INDEX_MASK = (1u << CLIENT_ID_SHIFT) - 1;
+
 
 EvsCamera::EvsCamera(const char *id) :
+        mMaxClients(std::min<unsigned>(MAX_CLIENTS,
+                std::max(1, property_get_int32("ro.vendor.evs.max_clients", 1)))),
         mFramesAllowed(0),
         mFramesInUse(0),
+        mFramesPerClient(0),
         mStreamState(STOPPED) {
 
     ALOGD("EvsCamera instantiated");
@@ -89,7 +103,7 @@ void EvsCamera::forceShutdown()
     if (mBuffers.size() > 0) {
         GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
         for (auto&& rec : mBuffers) {
-            if (rec.inUse) {
+            if (rec.inUse()) {
                 ALOGE("Error - releasing buffer despite remote ownership");
             }
             alloc.free(rec.handle);
@@ -131,9 +145,12 @@ Return<EvsResult> EvsCamera::setMaxFramesInFlight(uint32_t bufferCount) {
     }
 
     // Update our internal state
-    if (setAvailableFrames_Locked(bufferCount)) {
+    unsigned previousFramesPerClient = mFramesPerClient;
+    mFramesPerClient = bufferCount;
+    if (resizePool_Locked(std::max(1u, activeClients_Locked()))) {
         return EvsResult::OK;
     } else {
+        mFramesPerClient = previousFramesPerClient;
         return EvsResult::BUFFER_NOT_AVAILABLE;
     }
 }
@@ -148,21 +165,60 @@ Return<EvsResult> EvsCamera::startVideoStream(const ::android::sp<IEvsCameraStre
         ALOGE("ignoring startVideoStream call when camera has been lost.");
         return EvsResult::OWNERSHIP_LOST;
     }
+    if (mStreamState == RUNNING && activeClients_Locked() < mMaxClients) {
+        // Share the running stream with another client.  Grow the pool so this client
+        // can hold as many frames as the others without starving them.
+        if (!resizePool_Locked(activeClients_Locked() + 1)) {
+            ALOGE("Failed to add a stream client because we couldn't get graphics buffers");
+            return EvsResult::BUFFER_NOT_AVAILABLE;
+        }
+        // Reuse the record of a client that went away and returned all its frames
+        size_t clientIdx = 0;
+        while (clientIdx < mClients.size() &&
+               (mClients[clientIdx].stream != nullptr || mClients[clientIdx].framesHeld > 0)) {
+            clientIdx++;
+        }
+        if (clientIdx == mClients.size()) {
+            if (clientIdx >= MAX_CLIENTS) {
+                ALOGE("ignoring startVideoStream call because there are too many clients.");
+                return EvsResult::STREAM_ALREADY_RUNNING;
+            }
+            mClients.emplace_back(stream);
+        } else {
+            mClients[clientIdx] = ClientRecord(stream);
+        }
+        ALOGI("Added stream client %zu", clientIdx);
+        return EvsResult::OK;
+    }
     if (mStreamState != STOPPED) {
         ALOGE("ignoring startVideoStream call when a stream is already running.");
         return EvsResult::STREAM_ALREADY_RUNNING;
     }
 
     // If the client never indicated otherwise, configure ourselves for a single streaming buffer
-    if (mFramesAllowed < 1) {
-        if (!setAvailableFrames_Locked(1)) {
-            ALOGE("Failed to start stream because we couldn't get a graphics buffer");
-            return EvsResult::BUFFER_NOT_AVAILABLE;
+    if (mFramesPerClient < 1) {
+        mFramesPerClient = 1;
+    }
+
+    // Frames the clients of the last stream never returned go back to the pool.  Their
+    // holder bits would otherwise be credited to the new clients that reuse the same
+    // indices, and a late doneWithFrame for one of them is now ignored as already free.
+    for (unsigned bufferIdx = 0; bufferIdx < mBuffers.size(); bufferIdx++) {
+        for (unsigned clientIdx = 0; mBuffers[bufferIdx].inUse(); clientIdx++) {
+            if (mBuffers[bufferIdx].holders & (1u << clientIdx)) {
+                releaseFrame_Locked(clientIdx, bufferIdx);
+            }
         }
     }
+    mClients.clear();
+
+    if (!resizePool_Locked(1)) {
+        ALOGE("Failed to start stream because we couldn't get a graphics buffer");
+        return EvsResult::BUFFER_NOT_AVAILABLE;
+    }
 
     // Record the user's callback for use when we have a frame ready
-    mStream = stream;
+    mClients.emplace_back(stream);
 
     // Start the frame generation thread
     mStreamState = RUNNING;
@@ -177,31 +233,26 @@ Return<void> EvsCamera::doneWithFrame(const BufferDesc& buffer)  {
     {  // lock context
         std::lock_guard <std::mutex> lock(mAccessLock);
 
+        const unsigned clientIdx = buffer.bufferId >> CLIENT_ID_SHIFT;
+        const unsigned bufferIdx = buffer.bufferId & BUFFER_INDEX_MASK;
         if (buffer.memHandle == nullptr) {
             ALOGE("ignoring doneWithFrame called with null handle");
-        } else if (buffer.bufferId >= mBuffers.size()) {
+        } else if (bufferIdx >= mBuffers.size() || clientIdx >= MAX_CLIENTS) {
             ALOGE("ignoring doneWithFrame called with invalid bufferId %d (max is %zu)",
                   buffer.bufferId, mBuffers.size()-1);
-        } else if (!mBuffers[buffer.bufferId].inUse) {
+        } else if (!(mBuffers[bufferIdx].holders & (1u << clientIdx))) {
             ALOGE("ignoring doneWithFrame called on frame %d which is already free",
                   buffer.bufferId);
         } else {
-            // Mark the frame as available
-            mBuffers[buffer.bufferId].inUse = false;
-            mFramesInUse--;
-
-            // If this frame's index is high in the array, try to move it down
-            // to improve locality after mFramesAllowed has been reduced.
-            if (buffer.bufferId >= mFramesAllowed) {
-                // Find an empty slot lower in the array (which should always exist in this case)
-                for (auto&& rec : mBuffers) {
-                    if (rec.handle == nullptr) {
-                        rec.handle = mBuffers[buffer.bufferId].handle;
-                        mBuffers[buffer.bufferId].handle = nullptr;
-                        break;
-                    }
-                }
+            if (clientIdx < mClients.size()) {
+                ClientRecord& client = mClients[clientIdx];
+                const nsecs_t age = systemTime(SYSTEM_TIME_MONOTONIC) -
+                        mBuffers[bufferIdx].deliveredTime;
+                client.framesReturned++;
+                client.totalFrameAge += age;
+                client.maxFrameAge = std::max(client.maxFrameAge, age);
             }
+            releaseFrame_Locked(clientIdx, bufferIdx);
         }
     }
 
@@ -224,8 +275,21 @@ Return<void> EvsCamera::stopVideoStream()  {
         mCaptureThread.join();
         lock.lock();
 
+        // Frames still held by the clients are credited to them when they come back,
+        // so the client records are kept until the next stream starts and reclaims
+        // whatever is still out
+        for (size_t i = 0; i < mClients.size(); i++) {
+            ClientRecord& client = mClients[i];
+            client.stream = nullptr;
+            ALOGI("Stream client %zu: %" PRIu64 " frames delivered, %" PRIu64 " dropped, "
+                  "frame age avg %" PRId64 " us, max %" PRId64 " us", i,
+                  client.framesDelivered, client.framesDropped,
+                  client.framesReturned ? client.totalFrameAge / 1000 /
+                          static_cast<nsecs_t>(client.framesReturned) : 0,
+                  client.maxFrameAge / 1000);
+        }
+
         mStreamState = STOPPED;
-        mStream = nullptr;
         ALOGD("Stream marked STOPPED.");
     }
 
@@ -262,6 +326,57 @@ Return<EvsResult> EvsCamera::setExtendedInfo(uint32_t /*opaqueIdentifier*/, int3
 }
 
 
+unsigned EvsCamera::activeClients_Locked() const {
+    unsigned count = 0;
+    for (auto&& client : mClients) {
+        if (client.stream != nullptr) {
+            count++;
+        }
+    }
+    return count;
+}
+
+
+bool EvsCamera::resizePool_Locked(unsigned numClients) {
+    // Every client may hold mFramesPerClient frames, so with this many buffers there is
+    // always a free one for a client that is below its limit
+    return setAvailableFrames_Locked(mFramesPerClient * numClients);
+}
+
+
+void EvsCamera::releaseFrame_Locked(unsigned clientIdx, unsigned bufferIdx) {
+    BufferRecord& rec = mBuffers[bufferIdx];
+    rec.holders &= ~(1u << clientIdx);
+
+    // A frame from before the last restart may come back to a client that has no
+    // record of it
+    if (clientIdx < mClients.size() && mClients[clientIdx].framesHeld > 0) {
+        mClients[clientIdx].framesHeld--;
+    }
+
+    if (rec.inUse()) {
+        // Another client still holds this frame
+        return;
+    }
+
+    // Mark the frame as available
+    mFramesInUse--;
+
+    // If this frame's index is high in the array, try to move it down
+    // to improve locality after mFramesAllowed has been reduced.
+    if (bufferIdx >= mFramesAllowed) {
+        // Find an empty slot lower in the array (which should always exist in this case)
+        for (auto&& slot : mBuffers) {
+            if (slot.handle == nullptr) {
+                slot.handle = rec.handle;
+                rec.handle = nullptr;
+                break;
+            }
+        }
+    }
+}
+
+
 bool EvsCamera::setAvailableFrames_Locked(unsigned bufferCount) {
     if (bufferCount < 1) {
         ALOGE("Ignoring request to set buffer count to zero");
@@ -328,7 +443,7 @@ unsigned EvsCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
             if (rec.handle == nullptr) {
                 // Use this existing entry
                 rec.handle = memHandle;
-                rec.inUse = false;
+                rec.holders = 0;
                 stored = true;
                 break;
             }
@@ -354,7 +469,7 @@ unsigned EvsCamera::decreaseAvailableFrames_Locked(unsigned numToRemove) {
 
     for (auto&& rec : mBuffers) {
         // Is this record not in use, but holding a buffer that we can free?
-        if ((rec.inUse == false) && (rec.handle != nullptr)) {
+        if (!rec.inUse() && (rec.handle != nullptr)) {
             // Release buffer and update the record so we can recognize it as "empty"
             alloc.free(rec.handle);
             rec.handle = nullptr;
@@ -383,6 +498,9 @@ void EvsCamera::generateFrames() {
         bool timeForFrame = false;
         nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
+        // The clients which get this frame, and their callbacks
+        std::vector<std::pair<unsigned, sp<IEvsCameraStream>>> receivers;
+
         // Lock scope for updating shared state
         {
             std::lock_guard<std::mutex> lock(mAccessLock);
@@ -392,14 +510,31 @@ void EvsCamera::generateFrames() {
                 break;
             }
 
+            // A client holding too many frames misses this one, but we never wait
+            // for it so the other clients keep getting fresh frames
+            for (unsigned i = 0; i < mClients.size(); i++) {
+                ClientRecord& client = mClients[i];
+                if (client.stream == nullptr) {
+                    continue;
+                }
+                if (client.framesHeld >= mFramesPerClient) {
+                    client.framesDropped++;
+                } else {
+                    receivers.emplace_back(i, client.stream);
+                }
+            }
+
             // Are we allowed to issue another buffer?
-            if (mFramesInUse >= mFramesAllowed) {
+            if (receivers.empty() || mFramesInUse >= mFramesAllowed) {
                 // Can't do anything right now -- skip this frame
                 ALOGW("Skipped a frame because too many are in flight\n");
+                for (auto&& receiver : receivers) {
+                    mClients[receiver.first].framesDropped++;
+                }
             } else {
                 // Identify an available buffer to fill
                 for (idx = 0; idx < mBuffers.size(); idx++) {
-                    if (!mBuffers[idx].inUse) {
+                    if (!mBuffers[idx].inUse()) {
                         if (mBuffers[idx].handle != nullptr) {
                             // Found an available record, so stop looking
                             break;
@@ -410,8 +545,13 @@ void EvsCamera::generateFrames() {
                     // This shouldn't happen since we already checked mFramesInUse vs mFramesAllowed
                     ALOGE("Failed to find an available buffer slot\n");
                 } else {
-                    // We're going to make the frame busy
-                    mBuffers[idx].inUse = true;
+                    // We're going to make the frame busy, once for each receiving client
+                    for (auto&& receiver : receivers) {
+                        mBuffers[idx].holders |= 1u << receiver.first;
+                        mClients[receiver.first].framesHeld++;
+                        mClients[receiver.first].framesDelivered++;
+                    }
+                    mBuffers[idx].deliveredTime = startTime;
                     mFramesInUse++;
                     timeForFrame = true;
                 }
@@ -426,29 +566,41 @@ void EvsCamera::generateFrames() {
             buff.stride     = mStride;
             buff.format     = mFormat;
             buff.usage      = mUsage;
-            buff.bufferId   = idx;
             buff.memHandle  = mBuffers[idx].handle;
 
             // Write test data into the image buffer
             fillTestFrame(buff);
 
-            // Issue the (asynchronous) callback to the client -- can't be holding the lock
-            auto result = mStream->deliverFrame(buff);
-            if (result.isOk()) {
-                ALOGD("Delivered %p as id %d", buff.memHandle.getNativeHandle(), buff.bufferId);
-            } else {
-                // This can happen if the client dies and is likely unrecoverable.
-                // To avoid consuming resources generating failing calls, we stop sending
-                // frames.  Note, however, that the stream remains in the "STREAMING" state
-                // until cleaned up on the main thread.
-                ALOGE("Frame delivery call failed in the transport layer.");
+            // Issue the (asynchronous) callbacks to the clients -- can't be holding the lock.
+            // Every client gets the same graphics buffer.
+            unsigned failed = 0;
+            for (auto&& receiver : receivers) {
+                buff.bufferId = (receiver.first << CLIENT_ID_SHIFT) | idx;
+                auto result = receiver.second->deliverFrame(buff);
+                if (result.isOk()) {
+                    ALOGD("Delivered %p as id %d", buff.memHandle.getNativeHandle(),
+                          buff.bufferId);
+                } else {
+                    // This can happen if the client dies and is likely unrecoverable.
+                    // To avoid consuming resources generating failing calls, we stop sending
+                    // frames to this client.  Note, however, that the stream remains in the
+                    // "STREAMING" state until cleaned up on the main thread.
+                    ALOGE("Frame delivery call failed in the transport layer.");
+
+                    // Since we didn't actually deliver it, mark the frame as available
+                    std::lock_guard<std::mutex> lock(mAccessLock);
+                    releaseFrame_Locked(receiver.first, idx);
+                    mClients[receiver.first].framesDelivered--;
+                    mClients[receiver.first].stream = nullptr;
+                    failed++;
+                }
+            }
 
-                // Since we didn't actually deliver it, mark the frame as available
+            if (failed > 0) {
                 std::lock_guard<std::mutex> lock(mAccessLock);
-                mBuffers[idx].inUse = false;
-                mFramesInUse--;
-
-                break;
+                if (activeClients_Locked() == 0) {
+                    break;
+                }
             }
         }
 
@@ -464,10 +616,21 @@ void EvsCamera::generateFrames() {
     }
 
     // If we've been asked to stop, send one last NULL frame to signal the actual end of stream
+    std::vector<sp<IEvsCameraStream>> streams;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        for (auto&& client : mClients) {
+            if (client.stream != nullptr) {
+                streams.push_back(client.stream);
+            }
+        }
+    }
     BufferDesc nullBuff = {};
-    auto result = mStream->deliverFrame(nullBuff);
-    if (!result.isOk()) {
-        ALOGE("Error delivering end of stream marker");
+    for (auto&& stream : streams) {
+        auto result = stream->deliverFrame(nullBuff);
+        if (!result.isOk()) {
+            ALOGE("Error delivering end of stream marker");
+        }
     }
 
     return;
@@ -77,18 +77,43 @@ private:
     uint32_t mUsage  = 0;       // Values from from Gralloc.h
     uint32_t mStride = 0;       // Bytes per line in the buffers
 
-    sp <IEvsCameraStream> mStream = nullptr;  // The callback used to deliver each frame
+    // Each receiver of our frames.  The first one is the receiver passed to the
+    // startVideoStream call that started the stream.  More receivers may join the
+    // running stream when ro.vendor.evs.max_clients is greater than one; they all
+    // get the same graphics buffers, which are refcounted in BufferRecord.
+    struct ClientRecord {
+        sp <IEvsCameraStream> stream;   // nullptr once delivery to this client has failed
+        unsigned framesHeld      = 0;   // How many frames this client has not returned yet
+        uint64_t framesDelivered = 0;
+        uint64_t framesDropped   = 0;   // Skipped because the client held too many frames
+        uint64_t framesReturned  = 0;
+        nsecs_t  totalFrameAge   = 0;   // Sum of the time between delivery and return
+        nsecs_t  maxFrameAge     = 0;
+
+        explicit ClientRecord(const sp <IEvsCameraStream>& s) : stream(s) {};
+    };
 
     struct BufferRecord {
         buffer_handle_t handle;
-        bool inUse;
+        uint32_t holders;           // Bit mask of the clients holding this buffer
+        nsecs_t  deliveredTime;     // When the frame in this buffer was delivered
 
-        explicit BufferRecord(buffer_handle_t h) : handle(h), inUse(false) {};
+        explicit BufferRecord(buffer_handle_t h) : handle(h), holders(0), deliveredTime(0) {};
+        bool inUse() const { return holders != 0; };
     };
 
+    // These are expected to be called while mAccessLock is held
+    unsigned activeClients_Locked() const;
+    bool resizePool_Locked(unsigned numClients);
+    void releaseFrame_Locked(unsigned clientIdx, unsigned bufferIdx);
+
+    std::vector <ClientRecord> mClients;
+    const unsigned mMaxClients;  // How many clients may share the stream
+
     std::vector <BufferRecord> mBuffers;           // Graphics buffers to transfer images
     unsigned mFramesAllowed;     // How many buffers are we currently using
-    unsigned mFramesInUse;       // How many buffers are currently outstanding
+    unsigned mFramesInUse;       // How many buffers are currently held by any client
+    unsigned mFramesPerClient;   // How many frames each client may hold at once
 
     enum StreamStateValues {
         STOPPED,
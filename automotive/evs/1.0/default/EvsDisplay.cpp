@@ -18,9 +18,12 @@
 
 #include "EvsDisplay.h"
 
+#include <cutils/properties.h>
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
 
+#include <algorithm>
+
 
 namespace android {
 namespace hardware {
@@ -45,6 +48,14 @@ EvsDisplay::EvsDisplay() {
     mBuffer.usage       = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_COMPOSER;
     mBuffer.bufferId    = 0x3870;  // Arbitrary magic number for self recognition
     mBuffer.pixelSize   = 4;
+
+    // Size of the swap chain, a single buffer is presented synchronously
+    unsigned bufferCount = std::clamp(property_get_int32("ro.vendor.evs.display_buffers", 1),
+                                      1, static_cast<int32_t>(kMaxBufferCount));
+    mBuffers.resize(bufferCount);
+    for (unsigned i = 0; i < bufferCount; i++) {
+        mBuffers[i].id = mBuffer.bufferId + i;
+    }
 }
 
 
@@ -60,26 +71,87 @@ EvsDisplay::~EvsDisplay() {
 void EvsDisplay::forceShutdown()
 {
     ALOGD("EvsDisplay forceShutdown");
-    std::lock_guard<std::mutex> lock(mAccessLock);
+    std::unique_lock<std::mutex> lock(mAccessLock);
 
-    // If the buffer isn't being held by a remote client, release it now as an
+    // Put this object into an unrecoverable error state since somebody else
+    // is going to own the display now.
+    mRequestedState = DisplayState::DEAD;
+
+    // Let frames already queued finish before their buffers go away
+    mStopPresenting = true;
+    mPresentSignal.notify_all();
+    mBufferReleased.notify_all();
+    if (mPresentThread.joinable()) {
+        lock.unlock();
+        mPresentThread.join();
+        lock.lock();
+    }
+
+    // If the buffers aren't being held by a remote client, release them now as an
     // optimization to release the resources more quickly than the destructor might
     // get called.
-    if (mBuffer.memHandle) {
+    freeBuffersLocked();
+}
+
+
+bool EvsDisplay::allocateBuffersLocked() {
+    GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
+    for (auto&& buffer : mBuffers) {
+        if (buffer.handle) {
+            continue;
+        }
+
+        // Allocate the buffer that will hold our displayable image
+        buffer_handle_t handle = nullptr;
+        status_t result = alloc.allocate(
+            mBuffer.width, mBuffer.height, mBuffer.format, 1, mBuffer.usage,
+            &handle, &buffer.stride, 0, "EvsDisplay");
+        if (result != NO_ERROR) {
+            ALOGE("Error %d allocating %d x %d graphics buffer",
+                  result, mBuffer.width, mBuffer.height);
+            return false;
+        }
+        if (!handle) {
+            ALOGE("We didn't get a buffer handle back from the allocator");
+            return false;
+        }
+
+        buffer.handle = handle;
+        buffer.state = DisplayBuffer::State::FREE;
+        ALOGD("Allocated new buffer %p with stride %u", handle, buffer.stride);
+    }
+    return true;
+}
+
+
+void EvsDisplay::freeBuffersLocked() {
+    GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
+    for (auto&& buffer : mBuffers) {
+        if (!buffer.handle) {
+            continue;
+        }
+
         // Report if we're going away while a buffer is outstanding
-        if (mFrameBusy) {
+        if (buffer.state == DisplayBuffer::State::HELD_BY_CLIENT) {
             ALOGE("EvsDisplay going down while client is holding a buffer");
         }
 
         // Drop the graphics buffer we've been using
-        GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
-        alloc.free(mBuffer.memHandle);
-        mBuffer.memHandle = nullptr;
+        alloc.free(buffer.handle);
+        buffer.handle = nullptr;
+        buffer.state = DisplayBuffer::State::FREE;
     }
+    mPresentQueue.clear();
+}
 
-    // Put this object into an unrecoverable error state since somebody else
-    // is going to own the display now.
-    mRequestedState = DisplayState::DEAD;
+
+EvsDisplay::DisplayBuffer* EvsDisplay::findBufferLocked(uint32_t bufferId) {
+    for (auto&& buffer : mBuffers) {
+        if (buffer.id == bufferId && buffer.handle) {
+            return &buffer;
+        }
+    }
+    return nullptr;
 }
 
 
@@ -152,7 +224,7 @@ Return<DisplayState> EvsDisplay::getDisplayState()  {
 // TODO: We need to know if/when our client dies so we can get the buffer back! (blocked b/31632518)
 Return<void> EvsDisplay::getTargetBuffer(getTargetBuffer_cb _hidl_cb)  {
     ALOGD("getTargetBuffer");
-    std::lock_guard<std::mutex> lock(mAccessLock);
+    std::unique_lock<std::mutex> lock(mAccessLock);
 
     if (mRequestedState == DisplayState::DEAD) {
         ALOGE("Rejecting buffer request from object that lost ownership of the display.");
@@ -161,39 +233,36 @@ Return<void> EvsDisplay::getTargetBuffer(getTargetBuffer_cb _hidl_cb)  {
         return Void();
     }
 
-    // If we don't already have a buffer, allocate one now
-    if (!mBuffer.memHandle) {
-        // Allocate the buffer that will hold our displayable image
-        buffer_handle_t handle = nullptr;
-        GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
-        status_t result = alloc.allocate(
-            mBuffer.width, mBuffer.height, mBuffer.format, 1, mBuffer.usage,
-            &handle, &mBuffer.stride, 0, "EvsDisplay");
-        if (result != NO_ERROR) {
-            ALOGE("Error %d allocating %d x %d graphics buffer",
-                  result, mBuffer.width, mBuffer.height);
-            BufferDesc nullBuff = {};
-            _hidl_cb(nullBuff);
-            return Void();
+    // If we don't already have our buffers, allocate them now
+    if (!allocateBuffersLocked()) {
+        BufferDesc nullBuff = {};
+        _hidl_cb(nullBuff);
+        return Void();
+    }
+
+    // Do we have a frame available?  A buffer still being presented will be free shortly.
+    DisplayBuffer* target = nullptr;
+    while (!target && mRequestedState != DisplayState::DEAD) {
+        bool presenting = false;
+        for (auto&& buffer : mBuffers) {
+            if (buffer.state == DisplayBuffer::State::FREE) {
+                target = &buffer;
+                break;
+            }
+            presenting |= buffer.state == DisplayBuffer::State::PRESENTING;
         }
-        if (!handle) {
-            ALOGE("We didn't get a buffer handle back from the allocator");
-            BufferDesc nullBuff = {};
-            _hidl_cb(nullBuff);
-            return Void();
+        if (!target && !presenting) {
+            break;
+        }
+        if (!target) {
+            mBufferReleased.wait(lock);
         }
-
-        mBuffer.memHandle = handle;
-        mFrameBusy = false;
-        ALOGD("Allocated new buffer %p with stride %u",
-              mBuffer.memHandle.getNativeHandle(), mBuffer.stride);
     }
 
-    // Do we have a frame available?
-    if (mFrameBusy) {
+    if (!target || !target->handle) {
         // This means either we have a 2nd client trying to compete for buffers
         // (an unsupported mode of operation) or else the client hasn't returned
-        // a previously issued buffer yet (they're behaving badly).
+        // previously issued buffers yet (they're behaving badly).
         // NOTE:  We have to make the callback even if we have nothing to provide
         ALOGE("getTargetBuffer called while no buffers available.");
         BufferDesc nullBuff = {};
@@ -201,12 +270,15 @@ Return<void> EvsDisplay::getTargetBuffer(getTargetBuffer_cb _hidl_cb)  {
         return Void();
     } else {
         // Mark our buffer as busy
-        mFrameBusy = true;
+        target->state = DisplayBuffer::State::HELD_BY_CLIENT;
 
         // Send the buffer to the client
-        ALOGD("Providing display buffer handle %p as id %d",
-              mBuffer.memHandle.getNativeHandle(), mBuffer.bufferId);
-        _hidl_cb(mBuffer);
+        BufferDesc desc = mBuffer;
+        desc.memHandle = target->handle;
+        desc.stride = target->stride;
+        desc.bufferId = target->id;
+        ALOGD("Providing display buffer handle %p as id %d", target->handle, target->id);
+        _hidl_cb(desc);
         return Void();
     }
 }
@@ -225,16 +297,17 @@ Return<EvsResult> EvsDisplay::returnTargetBufferForDisplay(const BufferDesc& buf
         ALOGE ("returnTargetBufferForDisplay called without a valid buffer handle.\n");
         return EvsResult::INVALID_ARG;
     }
-    if (buffer.bufferId != mBuffer.bufferId) {
+    DisplayBuffer* target = findBufferLocked(buffer.bufferId);
+    if (!target) {
         ALOGE ("Got an unrecognized frame returned.\n");
         return EvsResult::INVALID_ARG;
     }
-    if (!mFrameBusy) {
+    if (target->state != DisplayBuffer::State::HELD_BY_CLIENT) {
         ALOGE ("A frame was returned with no outstanding frames.\n");
         return EvsResult::BUFFER_NOT_AVAILABLE;
     }
 
-    mFrameBusy = false;
+    target->state = DisplayBuffer::State::FREE;
 
     // If we've been displaced by another owner of the display, then we can't do anything else
     if (mRequestedState == DisplayState::DEAD) {
@@ -250,75 +323,117 @@ Return<EvsResult> EvsDisplay::returnTargetBufferForDisplay(const BufferDesc& buf
     if (mRequestedState != DisplayState::VISIBLE) {
         // We shouldn't get frames back when we're not visible.
         ALOGE ("Got an unexpected frame returned while not visible - ignoring.\n");
+    } else if (mBuffers.size() == 1) {
+        // Nothing to overlap the presentation with, so report the result to the client
+        if (!checkFrame(*target)) {
+            return EvsResult::UNDERLYING_SERVICE_ERROR;
+        }
     } else {
-        // This is where the buffer would be made visible.
-        // For now we simply validate it has the data we expect in it by reading it back
-
-        // Lock our display buffer for reading
-        uint32_t* pixels = nullptr;
-        GraphicBufferMapper &mapper = GraphicBufferMapper::get();
-        mapper.lock(mBuffer.memHandle,
-                    GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_NEVER,
-                    android::Rect(mBuffer.width, mBuffer.height),
-                    (void **)&pixels);
-
-        // If we failed to lock the pixel buffer, we're about to crash, but log it first
-        if (!pixels) {
-            ALOGE("Display failed to gain access to image buffer for reading");
+        // Hand the frame over to the present thread and let the client render the next one
+        target->state = DisplayBuffer::State::PRESENTING;
+        mPresentQueue.push_back(target);
+        if (!mPresentThread.joinable()) {
+            mPresentThread = std::thread([this]() { presentThreadLoop(); });
         }
+        mPresentSignal.notify_one();
+    }
 
-        // Check the test pixels
-        bool frameLooksGood = true;
-        for (unsigned row = 0; row < mBuffer.height; row++) {
-            for (unsigned col = 0; col < mBuffer.width; col++) {
-                // Index into the row to check the pixel at this column.
-                // We expect 0xFF in the LSB channel, a vertical gradient in the
-                // second channel, a horitzontal gradient in the third channel, and
-                // 0xFF in the MSB.
-                // The exception is the very first 32 bits which is used for the
-                // time varying frame signature to avoid getting fooled by a static image.
-                uint32_t expectedPixel = 0xFF0000FF           | // MSB and LSB
-                                         ((row & 0xFF) <<  8) | // vertical gradient
-                                         ((col & 0xFF) << 16);  // horizontal gradient
-                if ((row | col) == 0) {
-                    // we'll check the "uniqueness" of the frame signature below
-                    continue;
-                }
-                // Walk across this row (we'll step rows below)
-                uint32_t receivedPixel = pixels[col];
-                if (receivedPixel != expectedPixel) {
-                    ALOGE("Pixel check mismatch in frame buffer");
-                    frameLooksGood = false;
-                    break;
-                }
-            }
+    return EvsResult::OK;
+}
 
-            if (!frameLooksGood) {
-                break;
-            }
 
-            // Point to the next row (NOTE:  gralloc reports stride in units of pixels)
-            pixels = pixels + mBuffer.stride;
+void EvsDisplay::presentThreadLoop() {
+    std::unique_lock<std::mutex> lock(mAccessLock);
+    while (true) {
+        mPresentSignal.wait(lock, [this]() {
+            return mStopPresenting || !mPresentQueue.empty();
+        });
+        if (mPresentQueue.empty()) {
+            break;
         }
 
-        // Ensure we don't see the same buffer twice without it being rewritten
-        static uint32_t prevSignature = ~0;
-        uint32_t signature = pixels[0] & 0xFF;
-        if (prevSignature == signature) {
-            frameLooksGood = false;
-            ALOGE("Duplicate, likely stale frame buffer detected");
+        DisplayBuffer* buffer = mPresentQueue.front();
+        mPresentQueue.pop_front();
+
+        // The buffer isn't freed while PRESENTING, see forceShutdown()
+        lock.unlock();
+        if (!checkFrame(*buffer)) {
+            ALOGE("Presented a frame that failed validation");
         }
+        lock.lock();
 
+        buffer->state = DisplayBuffer::State::FREE;
+        mBufferReleased.notify_all();
+    }
+}
 
-        // Release our output buffer
-        mapper.unlock(mBuffer.memHandle);
+
+/**
+ * This is where the buffer would be made visible.
+ * For now we simply validate it has the data we expect in it by reading it back
+ */
+bool EvsDisplay::checkFrame(const DisplayBuffer& buffer) const {
+    // Lock our display buffer for reading
+    uint32_t* pixels = nullptr;
+    GraphicBufferMapper &mapper = GraphicBufferMapper::get();
+    mapper.lock(buffer.handle,
+                GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_NEVER,
+                android::Rect(mBuffer.width, mBuffer.height),
+                (void **)&pixels);
+
+    // If we failed to lock the pixel buffer, we're about to crash, but log it first
+    if (!pixels) {
+        ALOGE("Display failed to gain access to image buffer for reading");
+    }
+
+    // Check the test pixels
+    bool frameLooksGood = true;
+    for (unsigned row = 0; row < mBuffer.height; row++) {
+        for (unsigned col = 0; col < mBuffer.width; col++) {
+            // Index into the row to check the pixel at this column.
+            // We expect 0xFF in the LSB channel, a vertical gradient in the
+            // second channel, a horitzontal gradient in the third channel, and
+            // 0xFF in the MSB.
+            // The exception is the very first 32 bits which is used for the
+            // time varying frame signature to avoid getting fooled by a static image.
+            uint32_t expectedPixel = 0xFF0000FF           | // MSB and LSB
+                                     ((row & 0xFF) <<  8) | // vertical gradient
+                                     ((col & 0xFF) << 16);  // horizontal gradient
+            if ((row | col) == 0) {
+                // we'll check the "uniqueness" of the frame signature below
+                continue;
+            }
+            // Walk across this row (we'll step rows below)
+            uint32_t receivedPixel = pixels[col];
+            if (receivedPixel != expectedPixel) {
+                ALOGE("Pixel check mismatch in frame buffer");
+                frameLooksGood = false;
+                break;
+            }
+        }
 
         if (!frameLooksGood) {
-            return EvsResult::UNDERLYING_SERVICE_ERROR;
+            break;
         }
+
+        // Point to the next row (NOTE:  gralloc reports stride in units of pixels)
+        pixels = pixels + buffer.stride;
     }
 
-    return EvsResult::OK;
+    // Ensure we don't see the same buffer twice without it being rewritten.
+    // Frames are checked by one thread at a time, in the order they were returned.
+    static uint32_t prevSignature = ~0;
+    uint32_t signature = pixels[0] & 0xFF;
+    if (prevSignature == signature) {
+        frameLooksGood = false;
+        ALOGE("Duplicate, likely stale frame buffer detected");
+    }
+
+
+    // Release our output buffer
+    mapper.unlock(buffer.handle);
+
+    return frameLooksGood;
 }
 
 } // namespace implementation
@@ -20,6 +20,11 @@
 #include <android/hardware/automotive/evs/1.0/IEvsDisplay.h>
 #include <ui/GraphicBuffer.h>
 
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -44,10 +49,40 @@ public:
     void forceShutdown();   // This gets called if another caller "steals" ownership of the display
 
 private:
+    // A target buffer of the swap chain and who is holding it
+    struct DisplayBuffer {
+        enum class State {
+            FREE,
+            HELD_BY_CLIENT,
+            PRESENTING,
+        };
+
+        buffer_handle_t handle  = nullptr;
+        uint32_t        stride  = 0;
+        uint32_t        id      = 0;
+        State           state   = State::FREE;
+    };
+
+    static const unsigned kMaxBufferCount = 4;
+
+    bool allocateBuffersLocked();
+    void freeBuffersLocked();
+    DisplayBuffer* findBufferLocked(uint32_t bufferId);
+    bool checkFrame(const DisplayBuffer& buffer) const;
+    void presentThreadLoop();
+
     DisplayDesc     mInfo           = {};
-    BufferDesc      mBuffer         = {};       // A graphics buffer into which we'll store images
+    BufferDesc      mBuffer         = {};       // Description shared by all our target buffers
+
+    // The client renders into one buffer while the previous ones are being presented.
+    // With a single buffer the frame is presented before returnTargetBufferForDisplay returns.
+    std::vector<DisplayBuffer> mBuffers;
+    std::deque<DisplayBuffer*> mPresentQueue;
+    std::thread     mPresentThread;
+    bool            mStopPresenting = false;
+    std::condition_variable mPresentSignal;     // Notifies the present thread of queued frames
+    std::condition_variable mBufferReleased;    // Notifies the client of presented frames
 
-    bool            mFrameBusy      = false;    // A flag telling us our buffer is in use
     DisplayState    mRequestedState = DisplayState::NOT_VISIBLE;
 
     std::mutex      mAccessLock;
@@ -28,7 +28,7 @@ using namespace android::hardware;
 using namespace android::hardware::automotive::vehicle::V2_0;
 
 int main(int /* argc */, char* /* argv */ []) {
-    auto store = std::make_unique<VehiclePropertyStore>();
+    auto store = std::make_unique<VehiclePropertyStore>(VehiclePropertyStore::Mode::CONCURRENT);
     auto hal = std::make_unique<impl::EmulatedVehicleHal>(store.get());
     auto emulator = std::make_unique<impl::VehicleEmulator>(hal.get());
     auto service = std::make_unique<VehicleHalManager>(hal.get());
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <utils/SystemClock.h>
+
+#include "vhal_v2_0/SubscriptionManager.h"
+#include "vhal_v2_0/VehicleHal.h"
+#include "vhal_v2_0/VehicleHalManager.h"
+#include "vhal_v2_0/VehicleObjectPool.h"
+#include "vhal_v2_0/VehiclePropertyStore.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+constexpr int32_t kGlobalProp = toInt(VehicleProperty::PERF_VEHICLE_SPEED);
+constexpr int32_t kZonedProp = toInt(VehicleProperty::HVAC_FAN_SPEED);
+constexpr int32_t kEventProp = toInt(VehicleProperty::HVAC_FAN_SPEED);
+
+VehiclePropValue makeValue(int32_t prop, int32_t area, int64_t timestamp) {
+    VehiclePropValue v {};
+    v.prop = prop;
+    v.areaId = area;
+    v.timestamp = timestamp;
+    v.value.int32Values = hidl_vec<int32_t> { static_cast<int32_t>(timestamp) };
+    return v;
+}
+
+/* Returns store shared by all benchmark threads, stores are created once for every mode. */
+VehiclePropertyStore* getStore(int64_t mode) {
+    static const auto stores = [] {
+        std::vector<std::unique_ptr<VehiclePropertyStore>> stores;
+        for (auto m : { VehiclePropertyStore::Mode::SERIALIZED,
+                        VehiclePropertyStore::Mode::CONCURRENT,
+                        VehiclePropertyStore::Mode::FLAT_INDEX }) {
+            stores.emplace_back(new VehiclePropertyStore(m));
+            stores.back()->registerProperty(VehiclePropConfig { .prop = kGlobalProp });
+            stores.back()->registerProperty(VehiclePropConfig { .prop = kZonedProp });
+            stores.back()->writeValue(makeValue(kGlobalProp, 0, 0), true);
+            stores.back()->writeValue(makeValue(kZonedProp, 1, 0), true);
+        }
+        return stores;
+    }();
+    return stores[mode].get();
+}
+
+void BM_PropertyStoreRead(benchmark::State& state) {
+    VehiclePropertyStore* store = getStore(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(store->readValueOrNull(kZonedProp, 1));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PropertyStoreRead)->DenseRange(0, 2)->Threads(1)->Threads(4)->UseRealTime();
+
+void BM_PropertyStoreWrite(benchmark::State& state) {
+    VehiclePropertyStore* store = getStore(state.range(0));
+    int64_t timestamp = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(store->writeValue(makeValue(kGlobalProp, 0, ++timestamp), true));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PropertyStoreWrite)->DenseRange(0, 2)->Threads(1)->Threads(4)->UseRealTime();
+
+class NoopVehicleCallback : public IVehicleCallback {
+public:
+    Return<void> onPropertyEvent(const hidl_vec<VehiclePropValue>& /* values */) override {
+        return Return<void>();
+    }
+    Return<void> onPropertySet(const VehiclePropValue& /* value */) override {
+        return Return<void>();
+    }
+    Return<void> onPropertySetError(StatusCode /* errorCode */,
+                                    int32_t /* propId */,
+                                    int32_t /* areaId */) override {
+        return Return<void>();
+    }
+};
+
+/* Arg 0 is the number of clients, arg 1 is the number of properties every client subscribed to. */
+void BM_DistributeValuesToClients(benchmark::State& state) {
+    const int clients = state.range(0);
+    const int props = state.range(1);
+
+    SubscriptionManager manager([] (int32_t) {});
+    hidl_vec<SubscribeOptions> options;
+    options.resize(props);
+    for (int i = 0; i < props; i++) {
+        options[i] = SubscribeOptions { .propId = kZonedProp + i,
+                                        .flags = SubscribeFlags::EVENTS_FROM_CAR };
+    }
+    std::list<SubscribeOptions> updatedOptions;
+    for (int c = 0; c < clients; c++) {
+        manager.addOrUpdateSubscription(c + 1, new NoopVehicleCallback(), options,
+                                        &updatedOptions);
+    }
+
+    VehiclePropValuePool pool;
+    std::vector<recyclable_ptr<VehiclePropValue>> values;
+    for (int i = 0; i < props; i++) {
+        values.push_back(pool.obtainInt32(i));
+        values.back()->prop = kZonedProp + i;
+    }
+
+    DistributedValues distributed;
+    for (auto _ : state) {
+        manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR, &distributed);
+        benchmark::DoNotOptimize(distributed.size());
+        distributed.clear();
+    }
+    state.SetItemsProcessed(state.iterations() * props);
+}
+BENCHMARK(BM_DistributeValuesToClients)
+        ->ArgPair(1, 1)
+        ->ArgPair(1, 40)
+        ->ArgPair(6, 40)
+        ->ArgPair(16, 40)
+        ->ArgPair(16, 200);
+
+/* Arg 0 is the vector size of obtained INT32_VEC values, the pool is shared by all threads. */
+void BM_ValuePoolObtainRecycle(benchmark::State& state) {
+    static VehiclePropValuePool pool;
+    for (auto _ : state) {
+        auto v = pool.obtain(VehiclePropertyType::INT32_VEC, state.range(0));
+        benchmark::DoNotOptimize(v.get());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["magazine_hit_rate"] = benchmark::Counter(
+            PoolStats::instance()->getMagazineHitRate(), benchmark::Counter::kAvgThreads);
+}
+BENCHMARK(BM_ValuePoolObtainRecycle)->Arg(1)->Arg(16)->Threads(1)->Threads(4)->UseRealTime();
+
+class EventSourceVehicleHal : public VehicleHal {
+public:
+    std::vector<VehiclePropConfig> listProperties() override {
+        return { VehiclePropConfig { .prop = kEventProp,
+                                     .access = VehiclePropertyAccess::READ,
+                                     .changeMode = VehiclePropertyChangeMode::ON_CHANGE } };
+    }
+
+    VehiclePropValuePtr get(const VehiclePropValue& /* requestedPropValue */,
+                            StatusCode* outStatus) override {
+        *outStatus = StatusCode::NOT_AVAILABLE;
+        return nullptr;
+    }
+
+    StatusCode set(const VehiclePropValue& /* propValue */) override {
+        return StatusCode::ACCESS_DENIED;
+    }
+
+    StatusCode subscribe(int32_t /* property */, float /* sampleRate */) override {
+        return StatusCode::OK;
+    }
+
+    StatusCode unsubscribe(int32_t /* property */) override {
+        return StatusCode::OK;
+    }
+
+    void sendPropEvent(VehiclePropValuePtr value) {
+        doHalEvent(std::move(value));
+    }
+};
+
+/* Measures time between VehicleHal#doHalEvent and client callback using event timestamps. */
+class LatencyVehicleCallback : public NoopVehicleCallback {
+private:
+    using MuxGuard = std::lock_guard<std::mutex>;
+public:
+    Return<void> onPropertyEvent(const hidl_vec<VehiclePropValue>& values) override {
+        int64_t now = elapsedRealtimeNano();
+        {
+            MuxGuard g(mLock);
+            for (const auto& v : values) {
+                mLatencies.push_back(now - v.timestamp);
+            }
+        }
+        mCond.notify_one();
+        return Return<void>();
+    }
+
+    void waitForEvents(size_t count) {
+        std::unique_lock<std::mutex> g(mLock);
+        mCond.wait(g, [this, count] { return mLatencies.size() >= count; });
+    }
+
+    std::vector<int64_t> takeLatencies() {
+        MuxGuard g(mLock);
+        return std::move(mLatencies);
+    }
+
+private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::vector<int64_t> mLatencies;
+};
+
+/*
+ * Arg 0 selects VehicleHalManager options: 0 - defaults, 1 - adaptive batching,
+ * 2 - adaptive batching with lock-free event queue and per-client dispatcher.
+ */
+VehicleHalManager::Options makeManagerOptions(int64_t config) {
+    VehicleHalManager::Options options;
+    options.adaptiveBatching = config >= 1;
+    options.lockFreeEventQueue = config >= 2;
+    options.clientDispatchThreads = config >= 2 ? 2 : 0;
+    return options;
+}
+
+void BM_HalEventToCallbackLatency(benchmark::State& state) {
+    EventSourceVehicleHal hal;
+    VehicleHalManager manager(&hal, makeManagerOptions(state.range(0)));
+    sp<LatencyVehicleCallback> callback = new LatencyVehicleCallback();
+    manager.subscribe(callback, { SubscribeOptions { .propId = kEventProp,
+                                                     .flags = SubscribeFlags::EVENTS_FROM_CAR } });
+
+    size_t sent = 0;
+    for (auto _ : state) {
+        auto v = hal.getValuePool()->obtainInt32(sent);
+        v->prop = kEventProp;
+        v->timestamp = elapsedRealtimeNano();
+        hal.sendPropEvent(std::move(v));
+        callback->waitForEvents(++sent);
+    }
+
+    std::vector<int64_t> latencies = callback->takeLatencies();
+    if (latencies.empty()) return;
+    std::sort(latencies.begin(), latencies.end());
+    auto percentileUs = [&latencies] (size_t percent) {
+        return latencies[(latencies.size() - 1) * percent / 100] / 1000.0;
+    };
+    state.counters["p50_us"] = percentileUs(50);
+    state.counters["p99_us"] = percentileUs(99);
+}
+BENCHMARK(BM_HalEventToCallbackLatency)->DenseRange(0, 2)->Iterations(200)->UseRealTime();
+
+}  // namespace anonymous
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
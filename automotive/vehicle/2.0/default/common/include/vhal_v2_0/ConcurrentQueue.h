@@ -17,25 +17,53 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_ConcurrentQueue_H_
 #define android_hardware_automotive_vehicle_V2_0_ConcurrentQueue_H_
 
+#include <algorithm>
+#include <chrono>
 #include <queue>
 #include <atomic>
 #include <thread>
 #include <condition_variable>
 #include <iostream>
+#include <memory>
+
+#include "Histogram.h"
 
 namespace android {
 
+/* Multi-producer queue consumed by BatchingConsumer. */
 template<typename T>
-class ConcurrentQueue {
+class EventQueue {
 public:
-    void waitForItems() {
+    virtual ~EventQueue() = default;
+
+    /* Blocks until there is at least one item in the queue or queue is deactivated. */
+    virtual void waitForItems() = 0;
+
+    /* Removes and returns all items from the queue, returns nothing once deactivated. */
+    virtual std::vector<T> flush() = 0;
+
+    virtual void push(T&& item) = 0;
+
+    /* Returns number of queued items, result can be approximate if producers are active. */
+    virtual size_t size() const = 0;
+
+    /* Deactivates the queue, thus no one can push items to it, also
+     * notifies all waiting thread.
+     */
+    virtual void deactivate() = 0;
+};
+
+template<typename T>
+class ConcurrentQueue : public EventQueue<T> {
+public:
+    void waitForItems() override {
         std::unique_lock<std::mutex> g(mLock);
         while (mQueue.empty() && mIsActive) {
             mCond.wait(g);
         }
     }
 
-    std::vector<T> flush() {
+    std::vector<T> flush() override {
         std::vector<T> items;
 
         MuxGuard g(mLock);
@@ -49,7 +77,7 @@ public:
         return items;
     }
 
-    void push(T&& item) {
+    void push(T&& item) override {
         {
             MuxGuard g(mLock);
             if (!mIsActive) {
@@ -60,10 +88,12 @@ public:
         mCond.notify_one();
     }
 
-    /* Deactivates the queue, thus no one can push items to it, also
-     * notifies all waiting thread.
-     */
-    void deactivate() {
+    size_t size() const override {
+        MuxGuard g(mLock);
+        return mQueue.size();
+    }
+
+    void deactivate() override {
         {
             MuxGuard g(mLock);
             mIsActive = false;
@@ -84,6 +114,154 @@ private:
     std::queue<T> mQueue;
 };
 
+/**
+ * Bounded lock-free multi-producer / single-consumer ring buffer.
+ *
+ * Producers never take a lock unless the consumer is sleeping in #waitForItems, thus a producer
+ * can not be blocked by the consumer (no priority inversion). When the ring is full new items are
+ * dropped and counted, see #getDroppedCount.
+ *
+ * Only one thread may call #waitForItems / #flush at a time.
+ */
+template<typename T>
+class LockFreeQueue : public EventQueue<T> {
+public:
+    /* Capacity is rounded up to the nearest power of two. */
+    explicit LockFreeQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mMask = size - 1;
+        mCells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++) {
+            mCells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    LockFreeQueue(const LockFreeQueue &) = delete;
+    LockFreeQueue &operator=(const LockFreeQueue &) = delete;
+
+    void waitForItems() override {
+        if (!isEmpty() || !mIsActive) return;
+
+        // Producers check this flag after publishing an item, so either they see it set or the
+        // check below sees their item. This fence pairs with the one in #push: without them the
+        // flag store and the emptiness check, or the producer's publish and flag load, may be
+        // reordered and both sides miss each other.
+        mConsumerWaiting.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> g(mWaitLock);
+            while (isEmpty() && mIsActive) {
+                mCond.wait(g);
+            }
+        }
+        mConsumerWaiting.store(false);
+    }
+
+    std::vector<T> flush() override {
+        std::vector<T> items;
+        if (!mIsActive) return items;
+
+        for (;;) {
+            Cell& cell = mCells[mDequeuePos & mMask];
+            if (cell.sequence.load(std::memory_order_acquire) != mDequeuePos + 1) break;
+
+            items.push_back(std::move(cell.item));
+            cell.item = T();
+            cell.sequence.store(mDequeuePos + mMask + 1, std::memory_order_release);
+            mDequeuePos++;
+        }
+        return items;
+    }
+
+    void push(T&& item) override {
+        if (!mIsActive) return;
+
+        size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = mCells[pos & mMask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.item = std::move(item);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    break;
+                }
+            } else if (diff < 0) {
+                mDroppedCount.fetch_add(1, std::memory_order_relaxed);
+                return;  // Ring is full.
+            } else {
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mConsumerWaiting.load()) {
+            { std::lock_guard<std::mutex> g(mWaitLock); }
+            mCond.notify_one();
+        }
+    }
+
+    /* Must be called only by the consumer. */
+    size_t size() const override {
+        return mEnqueuePos.load(std::memory_order_relaxed) - mDequeuePos;
+    }
+
+    void deactivate() override {
+        {
+            std::lock_guard<std::mutex> g(mWaitLock);
+            mIsActive = false;
+        }
+        mCond.notify_all();  // To unblock all waiting consumers.
+    }
+
+    size_t getCapacity() const {
+        return mMask + 1;
+    }
+
+    /* Returns number of items that were dropped because the ring was full. */
+    uint64_t getDroppedCount() const {
+        return mDroppedCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    bool isEmpty() const {
+        return mCells[mDequeuePos & mMask].sequence.load() != mDequeuePos + 1;
+    }
+
+private:
+    std::unique_ptr<Cell[]> mCells;
+    size_t mMask;
+    std::atomic<size_t> mEnqueuePos { 0 };
+    size_t mDequeuePos = 0;  // Accessed only by consumer.
+
+    std::atomic<bool> mIsActive { true };
+    std::atomic<bool> mConsumerWaiting { false };
+    std::atomic<uint64_t> mDroppedCount { 0 };
+    std::mutex mWaitLock;
+    std::condition_variable mCond;
+};
+
+/**
+ * Parameters of adaptive batching, see BatchingConsumer#run.
+ */
+struct AdaptiveBatchingOptions {
+    // Upper limit of the batching window.
+    std::chrono::nanoseconds maxBatchInterval;
+    // Items are delivered without waiting if both number of pending items and average batch size
+    // are below this value.
+    size_t lowLoadThreshold;
+    // Batch is delivered as soon as this number of items is queued. The batching window grows
+    // linearly with the load and reaches maxBatchInterval at this load.
+    size_t flushThreshold;
+};
+
 template<typename T>
 class BatchingConsumer {
 private:
@@ -102,7 +280,7 @@ public:
 
     using OnBatchReceivedFunc = std::function<void(const std::vector<T>& vec)>;
 
-    void run(ConcurrentQueue<T>* queue,
+    void run(EventQueue<T>* queue,
              std::chrono::nanoseconds batchInterval,
              const OnBatchReceivedFunc& func) {
         mQueue = queue;
@@ -112,6 +290,29 @@ public:
             &BatchingConsumer<T>::runInternal, this, func);
     }
 
+    /*
+     * Same as above, but batching window is chosen based on the current load: a lone item is
+     * delivered immediately, under load the window widens up to options.maxBatchInterval and
+     * batch is delivered early once options.flushThreshold items are queued.
+     */
+    void run(EventQueue<T>* queue,
+             const AdaptiveBatchingOptions& options,
+             const OnBatchReceivedFunc& func) {
+        mAdaptive = true;
+        mAdaptiveOptions = options;
+        run(queue, options.maxBatchInterval, func);
+    }
+
+    /* Histogram of number of items in delivered batches. */
+    const Log2Histogram& getBatchSizeHistogram() const {
+        return mBatchSizeHistogram;
+    }
+
+    /* Histogram of time (in microseconds) between the first item arrival and batch delivery. */
+    const Log2Histogram& getBatchLatencyHistogram() const {
+        return mBatchLatencyHistogram;
+    }
+
     void requestStop() {
         mState = State::STOP_REQUESTED;
     }
@@ -129,12 +330,23 @@ private:
                 mQueue->waitForItems();
                 if (State::STOP_REQUESTED == mState) break;
 
-                std::this_thread::sleep_for(mBatchInterval);
+                auto firstItemTime = std::chrono::steady_clock::now();
+                if (mAdaptive) {
+                    waitForAdaptiveBatch(firstItemTime);
+                } else {
+                    std::this_thread::sleep_for(mBatchInterval);
+                }
                 if (State::STOP_REQUESTED == mState) break;
 
                 std::vector<T> items = mQueue->flush();
 
                 if (items.size() > 0) {
+                    auto latency = std::chrono::steady_clock::now() - firstItemTime;
+                    mBatchLatencyHistogram.add(
+                        std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+                    mBatchSizeHistogram.add(items.size());
+                    mAverageBatchSize = 0.75f * mAverageBatchSize + 0.25f * items.size();
+
                     onBatchReceived(items);
                 }
             }
@@ -143,12 +355,38 @@ private:
         mState = State::STOPPED;
     }
 
+    void waitForAdaptiveBatch(std::chrono::steady_clock::time_point firstItemTime) {
+        // Granularity of checking whether flush threshold was reached.
+        constexpr std::chrono::milliseconds kPollInterval(1);
+
+        const auto& opts = mAdaptiveOptions;
+        float load = std::max(static_cast<float>(mQueue->size()), mAverageBatchSize);
+        if (load < opts.lowLoadThreshold) return;  // Deliver immediately.
+
+        float ratio = std::min(1.0f, load / std::max<size_t>(opts.flushThreshold, 1));
+        auto deadline = firstItemTime + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                opts.maxBatchInterval * ratio);
+
+        for (auto now = firstItemTime; now < deadline; now = std::chrono::steady_clock::now()) {
+            if (State::RUNNING != mState || mQueue->size() >= opts.flushThreshold) return;
+            std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(kPollInterval,
+                                                                          deadline - now));
+        }
+    }
+
 private:
     std::thread mWorkerThread;
 
     std::atomic<State> mState;
     std::chrono::nanoseconds mBatchInterval;
-    ConcurrentQueue<T>* mQueue;
+    EventQueue<T>* mQueue;
+
+    bool mAdaptive = false;
+    AdaptiveBatchingOptions mAdaptiveOptions {};
+    float mAverageBatchSize = 0;  // Accessed only by worker thread.
+
+    Log2Histogram mBatchSizeHistogram;
+    Log2Histogram mBatchLatencyHistogram;
 };
 
 }  // namespace android
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_Histogram_H_
+#define android_hardware_automotive_vehicle_V2_0_Histogram_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace android {
+
+/*
+ * Lock-free histogram with power-of-two buckets: bucket i counts samples in range
+ * [2^(i-1), 2^i), bucket 0 counts zeros.
+ *
+ * This class is thread-safe: samples can be added from one thread while another thread dumps it.
+ */
+class Log2Histogram {
+public:
+    static constexpr size_t kBucketCount = 32;
+
+    void add(uint64_t sample) {
+        size_t bucket = 0;
+        while (sample != 0 && bucket < kBucketCount - 1) {
+            sample >>= 1;
+            bucket++;
+        }
+        mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t getCount(size_t bucket) const {
+        return mBuckets[bucket].load(std::memory_order_relaxed);
+    }
+
+    uint64_t getTotalCount() const {
+        uint64_t total = 0;
+        for (const auto& bucket : mBuckets) {
+            total += bucket.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    /* Returns human-readable representation, only non-empty buckets are printed. */
+    std::string dump(const std::string& unit) const {
+        std::string out;
+        for (size_t i = 0; i < kBucketCount; i++) {
+            uint64_t count = getCount(i);
+            if (count == 0) continue;
+            uint64_t upperBound = i == 0 ? 0 : (1ull << i) - 1;
+            out += "  <= " + std::to_string(upperBound) + unit + ": " + std::to_string(count)
+                   + "\n";
+        }
+        return out;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, kBucketCount> mBuckets {};
+};
+
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_Histogram_H_
@@ -17,6 +17,7 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_Obd2SensorStore_H_
 #define android_hardware_automotive_vehicle_V2_0_Obd2SensorStore_H_
 
+#include <string>
 #include <vector>
 
 #include <android/hardware/automotive/vehicle/2.0/types.h>
@@ -31,6 +32,10 @@ namespace V2_0 {
 // It allows storing sensor values, setting appropriate bitmasks as needed,
 // and returning appropriately laid out storage of sensor values suitable
 // for being returned via a VehicleHal implementation.
+//
+// Sensor values are kept pre-packed in the layout of an OBD2 frame, so setting a sensor
+// touches a single slot and bitmask bit, and filling a frame is a bulk copy. Sensors changed
+// since the last delta frame are tracked to build delta frames.
 class Obd2SensorStore {
    public:
     // Creates a sensor storage with a given number of vendor-specific sensors.
@@ -47,15 +52,23 @@ class Obd2SensorStore {
     StatusCode setFloatSensor(size_t index, float value);
 
     // Returns a vector that contains all integer sensors stored.
-    const std::vector<int32_t>& getIntegerSensors() const;
+    const hidl_vec<int32_t>& getIntegerSensors() const;
     // Returns a vector that contains all float sensors stored.
-    const std::vector<float>& getFloatSensors() const;
+    const hidl_vec<float>& getFloatSensors() const;
     // Returns a vector that contains a bitmask for all stored sensors.
-    const std::vector<uint8_t>& getSensorsBitmask() const;
+    const hidl_vec<uint8_t>& getSensorsBitmask() const;
 
     // Given a stringValue, fill in a VehiclePropValue
     void fillPropValue(const std::string& dtc, VehiclePropValue* propValue) const;
 
+    // Given a stringValue, fill in a VehiclePropValue with a frame whose bitmask only has
+    // sensors changed since the previous delta frame. If propValue already has a frame of this
+    // store's layout, e.g. the previous delta frame, only changed sensor slots are copied.
+    void fillDeltaPropValue(const std::string& dtc, VehiclePropValue* propValue);
+
+    // Returns true if any sensor changed since the previous delta frame.
+    bool hasChangedSensors() const;
+
    private:
     class BitmaskInVector {
        public:
@@ -64,15 +77,23 @@ class Obd2SensorStore {
         bool get(size_t index) const;
         void set(size_t index, bool value);
 
-        const std::vector<uint8_t>& getBitmask() const;
+        const hidl_vec<uint8_t>& getBitmask() const;
 
        private:
-        std::vector<uint8_t> mStorage;
+        hidl_vec<uint8_t> mStorage;
     };
 
-    std::vector<int32_t> mIntegerSensors;
-    std::vector<float> mFloatSensors;
+    size_t getSensorCount() const;
+
+    void markChanged(size_t sensorIndex);
+
+    hidl_vec<int32_t> mIntegerSensors;
+    hidl_vec<float> mFloatSensors;
     BitmaskInVector mSensorsBitmask;
+
+    // Sensors changed since the previous delta frame, bitmask indices are used for both.
+    BitmaskInVector mChangedSensorsBitmask;
+    std::vector<size_t> mChangedSensors;
 };
 
 }  // namespace V2_0
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_PropertyEventDispatcher_H_
+#define android_hardware_automotive_vehicle_V2_0_PropertyEventDispatcher_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
+
+#include "SubscriptionManager.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+/**
+ * Delivers property events to HalClients using a small pool of worker threads, thus a client
+ * that is slow to handle IVehicleCallback#onPropertyEvent doesn't delay others.
+ *
+ * Every client has its own queue of pending values. While a client is busy, newer values of a
+ * CONTINUOUS property replace the pending ones for the same (prop, area), so a slow client
+ * receives only the most recent samples. Values of other properties, such as ON_CHANGE events,
+ * VMS messages and OBD2 freeze frames, are all delivered in the order they were dispatched.
+ *
+ * Events for a given client are always delivered by one thread at a time and in order.
+ *
+ * This class is thread-safe.
+ */
+class PropertyEventDispatcher {
+public:
+    /* Returns whether the property is CONTINUOUS, i.e. whether its values may be coalesced. */
+    using IsContinuousFn = std::function<bool(int32_t prop)>;
+
+    PropertyEventDispatcher(size_t workerCount, IsContinuousFn isContinuous);
+    ~PropertyEventDispatcher();
+
+    PropertyEventDispatcher(const PropertyEventDispatcher&) = delete;
+    PropertyEventDispatcher& operator=(const PropertyEventDispatcher&) = delete;
+
+    /* Copies values to the client's queue and schedules delivery, doesn't block on the client. */
+    void dispatch(const HalClientValues& clientValues);
+
+    /* Number of values that were replaced by a newer value before being delivered. */
+    uint64_t getCoalescedCount() const {
+        return mCoalescedCount;
+    }
+
+private:
+    struct ClientQueue {
+        sp<HalClient> client;
+        // Grow-only arenas, values are deep-copied since originals are recycled once dispatch
+        // returns. Pending and in-flight arenas are swapped when delivery starts.
+        VehiclePropValueArena pending;
+        // Parallel to pending, kNoKey for values that are never coalesced.
+        std::vector<uint64_t /* prop, area */> pendingKeys;
+        VehiclePropValueArena inFlight;  // Accessed only by the worker delivering events.
+        bool scheduled = false;  // In ready queue or being delivered.
+    };
+
+    void workerLoop();
+    void deliver(ClientQueue* queue);
+    void removeReleasedClientsLocked();
+
+    static constexpr uint64_t kNoKey = UINT64_MAX;
+
+    static uint64_t makeKey(const VehiclePropValue& value) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(value.prop)) << 32)
+               | static_cast<uint32_t>(value.areaId);
+    }
+
+private:
+    using MuxGuard = std::lock_guard<std::mutex>;
+
+    const IsContinuousFn mIsContinuous;
+
+    std::mutex mLock;
+    std::condition_variable mCond;
+    bool mStopRequested = false;
+    std::map<HalClient*, std::unique_ptr<ClientQueue>> mQueues;
+    std::deque<ClientQueue*> mReadyQueues;
+
+    std::atomic<uint64_t> mCoalescedCount { 0 };
+    std::vector<std::thread> mWorkers;
+};
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_PropertyEventDispatcher_H_
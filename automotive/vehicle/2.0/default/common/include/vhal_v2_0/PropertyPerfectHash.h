@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_PropertyPerfectHash_H_
+#define android_hardware_automotive_vehicle_V2_0_PropertyPerfectHash_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace perfect_hash_internal {
+
+constexpr size_t nextPowerOfTwo(size_t n) {
+    size_t power = 1;
+    while (power < n) power <<= 1;
+    return power;
+}
+
+constexpr uint32_t mix(int32_t id, uint32_t seed) {
+    uint32_t h = static_cast<uint32_t>(id) ^ (seed * 0x9e3779b9u);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+}  // namespace perfect_hash_internal
+
+/*
+ * Perfect hash over a fixed set of N property ids, mapping each id to its position in the array it
+ * was built from. It is built once at startup, e.g. EmulatedVehicleHal hashes the ids of its static
+ * configs when it is created, and never modified afterwards.
+ *
+ * Lookups hash the id twice and compare it with a single slot, without locks or allocations.
+ *
+ * The ids are split into buckets by a first hash. Then, starting from the largest bucket, a seed is
+ * searched for each bucket such that a second hash seeded with it sends every id of the bucket to a
+ * free slot. The slot table is kept at least twice as large as N so that the search stays short;
+ * isValid() is false when it fails, which only happens with duplicate ids. Callers must check it
+ * and fall back to another lookup.
+ */
+template <size_t N>
+class PropertyPerfectHash {
+public:
+    static constexpr size_t kBucketCount = N / 2 + 1;
+    static constexpr size_t kSlotCount = perfect_hash_internal::nextPowerOfTwo(2 * N);
+
+    constexpr explicit PropertyPerfectHash(const int32_t (&ids)[N]) {
+        uint16_t bucketSizes[kBucketCount] {};
+        for (size_t i = 0; i < N; i++) {
+            bucketSizes[bucketOf(ids[i])]++;
+        }
+
+        // order the buckets by decreasing size, large buckets are the hardest to place
+        uint16_t order[kBucketCount] {};
+        for (size_t b = 0; b < kBucketCount; b++) {
+            size_t pos = b;
+            while (pos > 0 && bucketSizes[order[pos - 1]] < bucketSizes[b]) {
+                order[pos] = order[pos - 1];
+                pos--;
+            }
+            order[pos] = static_cast<uint16_t>(b);
+        }
+
+        for (size_t b : order) {
+            if (bucketSizes[b] == 0) break;
+            if (!placeBucket(ids, b)) {
+                mValid = false;
+                return;
+            }
+        }
+        mValid = true;
+    }
+
+    /* Returns false if the ids could not be hashed, e.g. because some of them are duplicated. */
+    constexpr bool isValid() const { return mValid; }
+
+    /* Returns the position of the id in the array the hash was built from, or -1 if it isn't in. */
+    constexpr int indexOf(int32_t id) const {
+        size_t slot = slotOf(id, mSeeds[bucketOf(id)]);
+        return mSlots[slot] != 0 && mIds[slot] == id ? mSlots[slot] - 1 : -1;
+    }
+
+private:
+    static constexpr uint16_t kMaxSeed = UINT16_MAX;
+
+    // slots hold the position of their id plus one, 0 marks an empty slot
+    static_assert(N > 0 && N < UINT16_MAX, "unsupported number of property ids");
+
+    static constexpr size_t bucketOf(int32_t id) {
+        return perfect_hash_internal::mix(id, 0) % kBucketCount;
+    }
+
+    static constexpr size_t slotOf(int32_t id, uint16_t seed) {
+        return perfect_hash_internal::mix(id, seed + 1u) & (kSlotCount - 1);
+    }
+
+    constexpr bool placeBucket(const int32_t (&ids)[N], size_t bucket) {
+        for (uint16_t seed = 0; seed < kMaxSeed; seed++) {
+            if (tryPlaceBucket(ids, bucket, seed)) {
+                mSeeds[bucket] = seed;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    constexpr bool tryPlaceBucket(const int32_t (&ids)[N], size_t bucket, uint16_t seed) {
+        size_t placed = 0;
+        for (size_t i = 0; i < N; i++) {
+            if (bucketOf(ids[i]) != bucket) continue;
+
+            size_t slot = slotOf(ids[i], seed);
+            if (mSlots[slot] != 0) {
+                // roll back the ids of the bucket placed so far
+                for (size_t j = 0; j < i && placed > 0; j++) {
+                    if (bucketOf(ids[j]) != bucket) continue;
+                    mSlots[slotOf(ids[j], seed)] = 0;
+                    placed--;
+                }
+                return false;
+            }
+            mIds[slot] = ids[i];
+            mSlots[slot] = static_cast<uint16_t>(i + 1);
+            placed++;
+        }
+        return true;
+    }
+
+    bool mValid = false;
+    uint16_t mSeeds[kBucketCount] {};
+    int32_t mIds[kSlotCount] {};
+    uint16_t mSlots[kSlotCount] {};
+};
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif // android_hardware_automotive_vehicle_V2_0_PropertyPerfectHash_H_
@@ -17,20 +17,31 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_RecurrentTimer_H_
 #define android_hardware_automotive_vehicle_V2_0_RecurrentTimer_H_
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <functional>
-#include <list>
+#include <map>
 #include <mutex>
-#include <set>
+#include <queue>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
 /**
  * This class allows to specify multiple time intervals to receive
  * notifications. A single thread is used internally.
+ *
+ * Cookies that share the same interval are grouped and reported in a single wake-up. Groups are
+ * ordered by their next deadline in a min-heap, so scheduling is O(log n) in number of distinct
+ * intervals. Deadlines are absolute and advance by whole intervals, thus the period doesn't drift
+ * when the action takes long to run.
  */
 class RecurrentTimer {
 private:
@@ -40,12 +51,27 @@ private:
 public:
     using Action = std::function<void(const std::vector<int32_t>& cookies)>;
 
-    RecurrentTimer(const Action& action) : mAction(action) {
+    /**
+     * Constructs RecurrentTimer
+     *
+     * @param useTimerFd - wait for deadlines using a timerfd armed with absolute CLOCK_MONOTONIC
+     * time instead of a condition variable. Falls back to the condition variable if a timerfd
+     * can't be created.
+     */
+    RecurrentTimer(const Action& action, bool useTimerFd = false) : mAction(action) {
+        if (useTimerFd) {
+            mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+            mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (mTimerFd < 0 || mWakeFd < 0) {
+                closeFds();
+            }
+        }
         mTimerThread = std::thread(&RecurrentTimer::loop, this, action);
     }
 
     virtual ~RecurrentTimer() {
         stop();
+        closeFds();
     }
 
     /**
@@ -54,66 +80,114 @@ public:
      * interval provided before.
      */
     void registerRecurrentEvent(std::chrono::nanoseconds interval, int32_t cookie) {
-        TimePoint now = Clock::now();
-        // Align event time point among all intervals. Thus if we have two intervals 1ms and 2ms,
-        // during every second wake-up both intervals will be triggered.
-        TimePoint absoluteTime = now - Nanos(now.time_since_epoch().count() % interval.count());
-
         {
             std::lock_guard<std::mutex> g(mLock);
-            mCookieToEventsMap[cookie] = { interval, cookie, absoluteTime };
+            auto it = mCookieToInterval.find(cookie);
+            if (it != mCookieToInterval.end()) {
+                if (it->second == interval) return;
+                removeCookieLocked(it->second, cookie);
+            }
+            mCookieToInterval[cookie] = interval;
+
+            auto groupIt = mIntervalGroups.find(interval);
+            if (groupIt == mIntervalGroups.end()) {
+                TimePoint now = Clock::now();
+                // Align event time point among all intervals. Thus if we have two intervals 1ms
+                // and 2ms, during every second wake-up both intervals will be triggered.
+                TimePoint absoluteTime =
+                        now - Nanos(now.time_since_epoch().count() % interval.count());
+                groupIt = mIntervalGroups.emplace(interval,
+                                                  IntervalGroup { {}, absoluteTime }).first;
+                mDeadlines.push(Deadline { absoluteTime, interval });
+            }
+            groupIt->second.cookies.push_back(cookie);
         }
-        mCond.notify_one();
+        wakeUp();
     }
 
     void unregisterRecurrentEvent(int32_t cookie) {
         {
             std::lock_guard<std::mutex> g(mLock);
-            mCookieToEventsMap.erase(cookie);
+            auto it = mCookieToInterval.find(cookie);
+            if (it == mCookieToInterval.end()) return;
+            removeCookieLocked(it->second, cookie);
+            mCookieToInterval.erase(it);
         }
-        mCond.notify_one();
+        wakeUp();
     }
 
 
 private:
 
-    struct RecurrentEvent {
-        Nanos interval;
-        int32_t cookie;
+    struct IntervalGroup {
+        std::vector<int32_t> cookies;
         TimePoint absoluteTime;  // Absolute time of the next event.
 
-        void updateNextEventTime(TimePoint now) {
+        void updateNextEventTime(TimePoint now, Nanos interval) {
             // We want to move time to next event by adding some number of intervals (usually 1)
-            // to previous absoluteTime.
-            int intervalMultiplier = (now - absoluteTime) / interval;
-            if (intervalMultiplier <= 0) intervalMultiplier = 1;
+            // to previous absoluteTime. Events that were missed are skipped rather than fired in
+            // a burst, the next event time is always in the future.
+            int64_t intervalMultiplier = (now - absoluteTime) / interval + 1;
             absoluteTime += intervalMultiplier * interval;
         }
     };
 
+    struct Deadline {
+        TimePoint time;
+        Nanos interval;
+
+        bool operator>(const Deadline& other) const {
+            return time > other.time;
+        }
+    };
+
+    void removeCookieLocked(Nanos interval, int32_t cookie) {
+        auto groupIt = mIntervalGroups.find(interval);
+        if (groupIt == mIntervalGroups.end()) return;
+        auto& cookies = groupIt->second.cookies;
+        cookies.erase(std::remove(cookies.begin(), cookies.end(), cookie), cookies.end());
+        if (cookies.empty()) {
+            // Its deadline stays in the heap and is discarded once it is on top.
+            mIntervalGroups.erase(groupIt);
+        }
+    }
+
+    /* Returns group if the deadline is still current, nullptr if it has been superseded. */
+    IntervalGroup* getGroupLocked(const Deadline& deadline) {
+        auto it = mIntervalGroups.find(deadline.interval);
+        return it != mIntervalGroups.end() && it->second.absoluteTime == deadline.time
+               ? &it->second : nullptr;
+    }
+
     void loop(const Action& action) {
         static constexpr auto kInvalidTime = TimePoint(Nanos::max());
 
         std::vector<int32_t> cookies;
 
         while (!mStopRequested) {
-            auto now = Clock::now();
             auto nextEventTime = kInvalidTime;
             cookies.clear();
 
             {
                 std::unique_lock<std::mutex> g(mLock);
+                auto now = Clock::now();
 
-                for (auto&& it : mCookieToEventsMap) {
-                    RecurrentEvent& event = it.second;
-                    if (event.absoluteTime <= now) {
-                        event.updateNextEventTime(now);
-                        cookies.push_back(event.cookie);
-                    }
+                while (!mDeadlines.empty() && mDeadlines.top().time <= now) {
+                    Deadline deadline = mDeadlines.top();
+                    mDeadlines.pop();
+                    IntervalGroup* group = getGroupLocked(deadline);
+                    if (group == nullptr) continue;
 
-                    if (nextEventTime > event.absoluteTime) {
-                        nextEventTime = event.absoluteTime;
-                    }
+                    group->updateNextEventTime(now, deadline.interval);
+                    cookies.insert(cookies.end(), group->cookies.begin(), group->cookies.end());
+                    mDeadlines.push(Deadline { group->absoluteTime, deadline.interval });
+                }
+                // Discard superseded deadlines, so they don't cause spurious wake-ups.
+                while (!mDeadlines.empty() && getGroupLocked(mDeadlines.top()) == nullptr) {
+                    mDeadlines.pop();
+                }
+                if (!mDeadlines.empty()) {
+                    nextEventTime = mDeadlines.top().time;
                 }
             }
 
@@ -121,8 +195,54 @@ private:
                 action(cookies);
             }
 
-            std::unique_lock<std::mutex> g(mLock);
-            mCond.wait_until(g, nextEventTime);  // nextEventTime can be nanoseconds::max()
+            if (mTimerFd >= 0) {
+                waitWithTimerFd(nextEventTime);
+            } else {
+                std::unique_lock<std::mutex> g(mLock);
+                // nextEventTime can be nanoseconds::max()
+                mCond.wait_until(g, nextEventTime, [this] { return mWakeUpRequested; });
+                mWakeUpRequested = false;
+            }
+        }
+    }
+
+    void waitWithTimerFd(TimePoint deadline) {
+        itimerspec spec {};  // Zero value disarms the timer.
+        if (deadline != TimePoint::max()) {
+            auto sinceEpoch = deadline.time_since_epoch().count();
+            spec.it_value.tv_sec = sinceEpoch / 1000000000;
+            spec.it_value.tv_nsec = sinceEpoch % 1000000000;
+            if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+                spec.it_value.tv_nsec = 1;
+            }
+        }
+        timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+
+        pollfd fds[] = { { mTimerFd, POLLIN, 0 }, { mWakeFd, POLLIN, 0 } };
+        if (poll(fds, 2, -1) > 0) {
+            if (fds[0].revents & POLLIN) drain(mTimerFd);
+            if (fds[1].revents & POLLIN) drain(mWakeFd);
+        }
+    }
+
+    /* Resets counter of timerfd or eventfd. */
+    static void drain(int fd) {
+        uint64_t count;
+        ssize_t res = read(fd, &count, sizeof(count));
+        (void) res;
+    }
+
+    void wakeUp() {
+        if (mWakeFd >= 0) {
+            uint64_t one = 1;
+            ssize_t res = write(mWakeFd, &one, sizeof(one));
+            (void) res;
+        } else {
+            {
+                std::lock_guard<std::mutex> g(mLock);
+                mWakeUpRequested = true;
+            }
+            mCond.notify_one();
         }
     }
 
@@ -130,20 +250,33 @@ private:
         mStopRequested = true;
         {
             std::lock_guard<std::mutex> g(mLock);
-            mCookieToEventsMap.clear();
+            mCookieToInterval.clear();
+            mIntervalGroups.clear();
         }
-        mCond.notify_one();
+        wakeUp();
         if (mTimerThread.joinable()) {
             mTimerThread.join();
         }
     }
+
+    void closeFds() {
+        if (mTimerFd >= 0) close(mTimerFd);
+        if (mWakeFd >= 0) close(mWakeFd);
+        mTimerFd = -1;
+        mWakeFd = -1;
+    }
 private:
     mutable std::mutex mLock;
     std::thread mTimerThread;
     std::condition_variable mCond;
     std::atomic_bool mStopRequested { false };
+    bool mWakeUpRequested = false;
+    int mTimerFd = -1;
+    int mWakeFd = -1;
     Action mAction;
-    std::unordered_map<int32_t, RecurrentEvent> mCookieToEventsMap;
+    std::unordered_map<int32_t, Nanos> mCookieToInterval;
+    std::map<Nanos, IntervalGroup> mIntervalGroups;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> mDeadlines;
 };
 
 
@@ -17,10 +17,12 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_SubscriptionManager_H_
 #define android_hardware_automotive_vehicle_V2_0_SubscriptionManager_H_
 
+#include <algorithm>
 #include <memory>
 #include <map>
 #include <set>
 #include <list>
+#include <unordered_map>
 
 #include <android/log.h>
 #include <hidl/HidlSupport.h>
@@ -29,6 +31,7 @@
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 
 #include "ConcurrentQueue.h"
+#include "Histogram.h"
 #include "VehicleObjectPool.h"
 
 namespace android {
@@ -50,10 +53,34 @@ public:
 
     void addOrUpdateSubscription(const SubscribeOptions &opts);
     bool isSubscribed(int32_t propId, SubscribeFlags flags);
+    /* Returns subscription for given property or options with UNDEFINED flags. */
+    SubscribeOptions getSubscribeOptions(int32_t propId) const;
     std::vector<int32_t> getSubscribedProperties() const;
 
+    /**
+     * Decides whether value of a continuous property should be delivered to this client, so
+     * that it receives no more than one value per minIntervalNs for every (prop, area).
+     * Decisions are based on value timestamps, values without timestamp are always delivered.
+     *
+     * Must be called only by the thread distributing events.
+     */
+    bool shouldDeliver(const VehiclePropValue& value, int64_t minIntervalNs);
+    /* Storage for outgoing events, must be used only by the thread delivering events. */
+    VehiclePropValueArena* getEventArena() {
+        return &mEventArena;
+    }
+
+    /* Time spent in onPropertyEvent calls to this client, in microseconds. */
+    Log2Histogram* getCallbackLatencyHistogram() {
+        return &mCallbackLatencyHistogram;
+    }
+
 private:
     const sp<IVehicleCallback> mCallback;
+    VehiclePropValueArena mEventArena;
+    Log2Histogram mCallbackLatencyHistogram;
+    // Next timestamp to deliver keyed by (prop, area), used only by the distribution thread.
+    std::unordered_map<uint64_t, int64_t> mNextDeliveryTimestamps;
 
     std::map<int32_t, SubscribeOptions> mSubscriptions;
 };
@@ -73,9 +100,89 @@ public:
     using SortedVector::isEmpty;
 };
 
+/* Values that should be delivered to a single client, points into DistributedValues storage. */
 struct HalClientValues {
     sp<HalClient> client;
-    std::list<VehiclePropValue *> values;
+    VehiclePropValue* const* values;
+    size_t count;
+
+    VehiclePropValue* const* begin() const {
+        return values;
+    }
+
+    VehiclePropValue* const* end() const {
+        return values + count;
+    }
+};
+
+/*
+ * Immutable snapshot of subscriptions: for every property a contiguous range of subscribers with
+ * their flags resolved. Rebuilt on every subscription change and published atomically.
+ */
+struct FanOutTable {
+    struct Subscriber {
+        uint32_t clientIndex;
+        SubscribeFlags flags;
+        int64_t minIntervalNs;  // Derived from sample rate, 0 if values are not decimated.
+    };
+
+    struct PropEntry {
+        int32_t prop;
+        uint32_t begin;  // Range in subscribers.
+        uint32_t end;
+    };
+
+    std::vector<sp<HalClient>> clients;
+    std::vector<PropEntry> props;  // Sorted by prop.
+    std::vector<Subscriber> subscribers;
+
+    const PropEntry* find(int32_t prop) const {
+        auto it = std::lower_bound(props.begin(), props.end(), prop,
+                                   [] (const PropEntry& e, int32_t p) { return e.prop < p; });
+        return it != props.end() && it->prop == prop ? &*it : nullptr;
+    }
+};
+
+/*
+ * Result of SubscriptionManager#distributeValuesToClients grouped by client, values of every
+ * client are stored contiguously.
+ *
+ * Meant to be reused by a single thread for every batch, so once buffers have grown to the
+ * steady-state size, distribution doesn't allocate memory.
+ */
+class DistributedValues {
+public:
+    size_t size() const {
+        return mClientValues.size();
+    }
+
+    const HalClientValues& operator[](size_t i) const {
+        return mClientValues[i];
+    }
+
+    std::vector<HalClientValues>::const_iterator begin() const {
+        return mClientValues.begin();
+    }
+
+    std::vector<HalClientValues>::const_iterator end() const {
+        return mClientValues.end();
+    }
+
+    /* Releases references to clients, keeps buffers for the next batch. */
+    void clear() {
+        mClientValues.clear();
+        mTable.reset();
+    }
+
+private:
+    friend class SubscriptionManager;
+
+    std::shared_ptr<const FanOutTable> mTable;  // Keeps clients alive.
+    std::vector<const FanOutTable::PropEntry*> mEntries;  // Parallel to distributed values.
+    std::vector<bool> mDecisions;  // Whether subscriber gets the value, in distribution order.
+    std::vector<uint32_t> mOffsets;  // Per client of mTable.
+    std::vector<VehiclePropValue*> mValues;
+    std::vector<HalClientValues> mClientValues;
 };
 
 using ClientId = uint64_t;
@@ -107,12 +214,14 @@ public:
                                        std::list<SubscribeOptions>* outUpdatedOptions);
 
     /**
-     * Returns a list of IVehicleCallback -> list of VehiclePropValue ready for
-     * dispatching to its clients.
+     * Groups values by subscribed clients ready for dispatching, results are stored in out.
+     *
+     * This method reads the latest subscription snapshot and doesn't take any locks.
      */
-    std::list<HalClientValues> distributeValuesToClients(
+    void distributeValuesToClients(
             const std::vector<recyclable_ptr<VehiclePropValue>>& propValues,
-            SubscribeFlags flags) const;
+            SubscribeFlags flags,
+            DistributedValues* out) const;
 
     std::list<sp<HalClient>> getSubscribedClients(int32_t propId, SubscribeFlags flags) const;
     /**
@@ -120,6 +229,8 @@ public:
      * in the constructor will be called.
      */
     void unsubscribe(ClientId clientId, int32_t propId);
+
+    std::vector<sp<HalClient>> getClients() const;
 private:
     std::list<sp<HalClient>> getSubscribedClientsLocked(int32_t propId,
                                                         SubscribeFlags flags) const;
@@ -135,6 +246,8 @@ private:
 
     void onCallbackDead(uint64_t cookie);
 
+    void rebuildFanOutTableLocked();
+
 private:
     using OnClientDead = std::function<void(uint64_t)>;
 
@@ -163,6 +276,8 @@ private:
     std::map<ClientId, sp<HalClient>> mClients;
     std::map<int32_t, sp<HalClientVector>> mPropToClients;
     std::map<int32_t, SubscribeOptions> mHalEventSubscribeOptions;
+    // Replaced under mLock, read with atomic_load without locking.
+    std::shared_ptr<const FanOutTable> mFanOutTable { std::make_shared<FanOutTable>() };
 
     OnPropertyUnsubscribed mOnPropertyUnsubscribed;
     sp<DeathRecipient> mCallbackDeathRecipient;
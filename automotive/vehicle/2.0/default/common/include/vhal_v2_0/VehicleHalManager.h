@@ -29,8 +29,10 @@
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 
 #include "ConcurrentQueue.h"
+#include "PropertyEventDispatcher.h"
 #include "SubscriptionManager.h"
 #include "VehicleHal.h"
+#include "VehicleHalMetrics.h"
 #include "VehicleObjectPool.h"
 #include "VehiclePropConfigIndex.h"
 
@@ -48,8 +50,32 @@ namespace V2_0 {
  */
 class VehicleHalManager : public IVehicle {
 public:
-    VehicleHalManager(VehicleHal* vehicleHal)
+    struct Options {
+        // Use bounded lock-free ring for events coming from VehicleHal instead of blocking
+        // queue. Events are dropped (and counted) once the ring is full.
+        bool lockFreeEventQueue = false;
+        size_t eventQueueCapacity = 1024;
+
+        // Choose batching window of events from VehicleHal based on the load instead of using
+        // fixed window, see BatchingConsumer.
+        bool adaptiveBatching = false;
+        AdaptiveBatchingOptions adaptiveBatchingOptions {
+            .maxBatchInterval = std::chrono::milliseconds(20),
+            .lowLoadThreshold = 2,
+            .flushThreshold = 64,
+        };
+
+        // If non-zero, events are delivered to clients by a pool of this many threads with
+        // per-client queues, see PropertyEventDispatcher. Otherwise clients are notified one
+        // after another on the batching thread.
+        size_t clientDispatchThreads = 0;
+    };
+
+    VehicleHalManager(VehicleHal* vehicleHal) : VehicleHalManager(vehicleHal, Options()) {}
+
+    VehicleHalManager(VehicleHal* vehicleHal, const Options& options)
         : mHal(vehicleHal),
+          mOptions(options),
           mSubscriptionManager(std::bind(&VehicleHalManager::onAllClientsUnsubscribed,
                                          this, std::placeholders::_1)) {
         init();
@@ -73,6 +99,9 @@ public:
                                    int32_t propId)  override;
     Return<void> debugDump(debugDump_cb _hidl_cb = nullptr) override;
 
+    // Writes the debugDump output, e.g. for lshal debug.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
 private:
     using VehiclePropValuePtr = VehicleHal::VehiclePropValuePtr;
     // Returns true if needs to call again shortly.
@@ -104,14 +133,17 @@ private:
     static ClientId getClientId(const sp<IVehicleCallback>& callback);
 private:
     VehicleHal* mHal;
+    const Options mOptions;
     std::unique_ptr<VehiclePropConfigIndex> mConfigIndex;
     SubscriptionManager mSubscriptionManager;
+    DistributedValues mDistributedValues;  // Used only by the batching consumer thread.
 
-    hidl_vec<VehiclePropValue> mHidlVecOfVehiclePropValuePool;
-
-    ConcurrentQueue<VehiclePropValuePtr> mEventQueue;
+    std::unique_ptr<EventQueue<VehiclePropValuePtr>> mEventQueue;
+    LockFreeQueue<VehiclePropValuePtr>* mLockFreeEventQueue = nullptr;  // Owned by mEventQueue.
     BatchingConsumer<VehiclePropValuePtr> mBatchingConsumer;
     VehiclePropValuePool mValueObjectPool;
+    std::unique_ptr<PropertyEventDispatcher> mEventDispatcher;
+    VehicleHalMetrics mMetrics;
 };
 
 }  // namespace V2_0
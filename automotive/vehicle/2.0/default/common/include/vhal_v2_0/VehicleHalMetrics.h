@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_VehicleHalMetrics_H_
+#define android_hardware_automotive_vehicle_V2_0_VehicleHalMetrics_H_
+
+#include <sched.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "Histogram.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+/*
+ * Counter split into cache line sized slots picked by the current CPU, so that threads on
+ * different CPUs incrementing it don't bounce the same cache line.
+ *
+ * This class is thread-safe, the value read is approximate while increments are in flight.
+ */
+class PerCpuCounter {
+public:
+    static constexpr size_t kSlotCount = 16;  // Power of two.
+
+    void inc(uint64_t delta = 1) {
+        int cpu = sched_getcpu();
+        size_t slot = cpu < 0 ? 0 : static_cast<size_t>(cpu) & (kSlotCount - 1);
+        mSlots[slot].value.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const {
+        uint64_t total = 0;
+        for (const auto& slot : mSlots) {
+            total += slot.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> value {0};
+    };
+    std::array<Slot, kSlotCount> mSlots {};
+};
+
+/* Always-on counters and latency histograms of the VehicleHalManager hot paths. */
+struct VehicleHalMetrics {
+    PerCpuCounter getCount;
+    PerCpuCounter getErrorCount;
+    Log2Histogram getLatencyUs;
+
+    PerCpuCounter setCount;
+    PerCpuCounter setErrorCount;
+    Log2Histogram setLatencyUs;
+
+    PerCpuCounter halEventCount;
+
+    static uint64_t microsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::string dump() const {
+        std::string out;
+        out += "get calls: " + std::to_string(getCount.get())
+               + ", errors: " + std::to_string(getErrorCount.get()) + "\n";
+        out += "get latencies:\n" + getLatencyUs.dump("us");
+        out += "set calls: " + std::to_string(setCount.get())
+               + ", errors: " + std::to_string(setErrorCount.get()) + "\n";
+        out += "set latencies:\n" + setLatencyUs.dump("us");
+        out += "HAL events: " + std::to_string(halEventCount.get()) + "\n";
+        return out;
+    }
+};
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_VehicleHalMetrics_H_
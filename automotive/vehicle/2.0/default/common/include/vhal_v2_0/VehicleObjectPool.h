@@ -18,9 +18,12 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_VehicleObjectPool_H_
 #define android_hardware_automotive_vehicle_V2_0_VehicleObjectPool_H_
 
-#include <deque>
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 #include <android/hardware/automotive/vehicle/2.0/types.h>
 
@@ -36,6 +39,25 @@ struct PoolStats {
     std::atomic<uint32_t> Obtained {0};
     std::atomic<uint32_t> Created {0};
     std::atomic<uint32_t> Recycled {0};
+    std::atomic<uint32_t> MagazineMisses {0};  // Had to go to the shared depot.
+    std::atomic<uint32_t> ArenaSlotsCreated {0};
+    std::atomic<uint32_t> ArenaBuffersAllocated {0};
+
+    /*
+     * Obtained from a thread-local magazine. Derived rather than counted, so the lock-free
+     * path doesn't touch another shared cache line.
+     */
+    uint32_t getMagazineHits() const {
+        uint32_t obtained = Obtained;
+        uint32_t misses = MagazineMisses;
+        return obtained > misses ? obtained - misses : 0;
+    }
+
+    /* Share of obtained recyclable objects served without taking a lock. */
+    float getMagazineHitRate() const {
+        uint32_t obtained = Obtained;
+        return obtained == 0 ? 0.0f : static_cast<float>(getMagazineHits()) / obtained;
+    }
 
     static PoolStats* instance() {
         static PoolStats inst;
@@ -70,6 +92,11 @@ using recyclable_ptr = typename std::unique_ptr<T, Deleter<T>>;
  * Generic abstract object pool class. Users of this class must implement
  * #createObject method.
  *
+ * Every thread keeps a small magazine of recycled objects per pool, so obtaining
+ * and recycling objects on the same thread doesn't take any locks. Magazines
+ * exchange half of their capacity with the shared depot when they run empty or
+ * full, and are returned to the depot when the thread exits.
+ *
  * This class is thread-safe. Concurrent calls to #obtain(...) method from
  * multiple threads is OK, also client can obtain an object in one thread and
  * then move ownership to another thread.
@@ -78,19 +105,26 @@ using recyclable_ptr = typename std::unique_ptr<T, Deleter<T>>;
 template<typename T>
 class ObjectPool {
 public:
-    ObjectPool() = default;
+    ObjectPool()
+        : mId(nextPoolId()),
+          mDepot(std::make_shared<Depot>()),
+          mDeleter(std::bind(&ObjectPool::recycle, this, std::placeholders::_1)) {}
     virtual ~ObjectPool() = default;
 
     virtual recyclable_ptr<T> obtain() {
-        std::lock_guard<std::mutex> g(mLock);
         INC_METRIC_IF_DEBUG(Obtained)
-        if (mObjects.empty()) {
-            INC_METRIC_IF_DEBUG(Created)
-            return wrap(createObject());
+        Magazine* magazine = getMagazine();
+        if (magazine->objects.empty()) {
+            INC_METRIC_IF_DEBUG(MagazineMisses)
+            refill(magazine);
+            if (magazine->objects.empty()) {
+                INC_METRIC_IF_DEBUG(Created)
+                return wrap(createObject());
+            }
         }
 
-        auto o = wrap(mObjects.front().release());
-        mObjects.pop_front();
+        auto o = wrap(magazine->objects.back().release());
+        magazine->objects.pop_back();
 
         return o;
     }
@@ -103,28 +137,100 @@ protected:
 
     virtual void recycle(T* o) {
         INC_METRIC_IF_DEBUG(Recycled)
-        std::lock_guard<std::mutex> g(mLock);
-        mObjects.push_back(std::unique_ptr<T> { o } );
+        Magazine* magazine = getMagazine();
+        if (magazine->objects.size() == kMagazineSize) {
+            spill(magazine);
+        }
+        magazine->objects.push_back(std::unique_ptr<T> { o } );
     }
 
 private:
-    const Deleter<T>& getDeleter() {
-        if (!mDeleter.get()) {
-            Deleter<T> *d = new Deleter<T>(std::bind(
-                &ObjectPool::recycle, this, std::placeholders::_1));
-            mDeleter.reset(d);
+    static constexpr size_t kMagazineSize = 16;
+
+    struct Depot {
+        std::mutex lock;
+        std::vector<std::unique_ptr<T>> objects;
+    };
+
+    struct Magazine {
+        uint64_t poolId;
+        std::weak_ptr<Depot> depot;  // Expires when the pool is destroyed.
+        std::vector<std::unique_ptr<T>> objects;
+    };
+
+    /* Magazines of all pools of type T used by the calling thread. */
+    struct ThreadCache {
+        std::vector<std::unique_ptr<Magazine>> magazines;
+        size_t lastUsed = 0;
+
+        ~ThreadCache() {
+            for (auto& magazine : magazines) {
+                if (auto depot = magazine->depot.lock()) {
+                    std::lock_guard<std::mutex> g(depot->lock);
+                    for (auto& o : magazine->objects) {
+                        depot->objects.push_back(std::move(o));
+                    }
+                }
+            }
+        }
+    };
+
+    static uint64_t nextPoolId() {
+        static std::atomic<uint64_t> sNextId {1};
+        return sNextId++;
+    }
+
+    Magazine* getMagazine() {
+        static thread_local ThreadCache cache;
+        auto& magazines = cache.magazines;
+        if (cache.lastUsed < magazines.size() && magazines[cache.lastUsed]->poolId == mId) {
+            return magazines[cache.lastUsed].get();
+        }
+        for (size_t i = 0; i < magazines.size(); i++) {
+            if (magazines[i]->poolId == mId) {
+                cache.lastUsed = i;
+                return magazines[i].get();
+            }
+        }
+
+        // First use of this pool on the calling thread, drop magazines of destroyed pools.
+        magazines.erase(std::remove_if(magazines.begin(), magazines.end(),
+                                       [] (const std::unique_ptr<Magazine>& m) {
+                                           return m->depot.expired();
+                                       }),
+                        magazines.end());
+        std::unique_ptr<Magazine> magazine { new Magazine { mId, mDepot, {} } };
+        magazine->objects.reserve(kMagazineSize);
+        magazines.push_back(std::move(magazine));
+        cache.lastUsed = magazines.size() - 1;
+        return magazines.back().get();
+    }
+
+    void refill(Magazine* magazine) {
+        std::lock_guard<std::mutex> g(mDepot->lock);
+        auto& objects = mDepot->objects;
+        while (!objects.empty() && magazine->objects.size() < kMagazineSize / 2) {
+            magazine->objects.push_back(std::move(objects.back()));
+            objects.pop_back();
+        }
+    }
+
+    void spill(Magazine* magazine) {
+        std::lock_guard<std::mutex> g(mDepot->lock);
+        while (magazine->objects.size() > kMagazineSize / 2) {
+            mDepot->objects.push_back(std::move(magazine->objects.back()));
+            magazine->objects.pop_back();
         }
-        return *mDeleter.get();
     }
 
     recyclable_ptr<T> wrap(T* raw) {
-        return recyclable_ptr<T> { raw, getDeleter() };
+        return recyclable_ptr<T> { raw, mDeleter };
     }
 
 private:
-    mutable std::mutex mLock;
-    std::deque<std::unique_ptr<T>> mObjects;
-    std::unique_ptr<Deleter<T>> mDeleter;
+    const uint64_t mId;
+    const std::shared_ptr<Depot> mDepot;
+    const Deleter<T> mDeleter;
 };
 
 /**
@@ -174,7 +280,10 @@ public:
      *
      */
     VehiclePropValuePool(size_t maxRecyclableVectorSize = 4) :
-        mMaxRecyclableVectorSize(maxRecyclableVectorSize) {};
+        mMaxRecyclableVectorSize(maxRecyclableVectorSize),
+        mValueTypePools(kRecyclableTypeCount * (maxRecyclableVectorSize + 1)) {};
+
+    ~VehiclePropValuePool();
 
     RecyclableType obtain(VehiclePropertyType type);
 
@@ -200,6 +309,9 @@ private:
     RecyclableType obtainRecylable(VehiclePropertyType type,
                                    size_t vecSize);
 
+    /* Returns index of recyclable type in the pool table or -1 if values aren't recycled. */
+    static int32_t getRecyclableTypeIndex(VehiclePropertyType type);
+
     class InternalPool: public ObjectPool<VehiclePropValue> {
     public:
         InternalPool(VehiclePropertyType type, size_t vectorSize)
@@ -231,9 +343,67 @@ private:
     };
 
 private:
-    mutable std::mutex mLock;
+    static constexpr size_t kRecyclableTypeCount = 8;
+
+    mutable std::mutex mLock;  // Guards creation of internal pools.
     const size_t mMaxRecyclableVectorSize;
-    std::map<int32_t, std::unique_ptr<InternalPool>> mValueTypePools;
+    // Indexed by recyclable type index * (mMaxRecyclableVectorSize + 1) + vector size, pools are
+    // created lazily and never removed, so lookup doesn't need a lock.
+    std::vector<std::atomic<InternalPool*>> mValueTypePools;
+};
+
+/**
+ * Grow-only storage for outgoing hidl_vec<VehiclePropValue>.
+ *
+ * Slots are kept between batches: #clear only resets the size, and deep copies of values reuse
+ * vector buffers of the slot when sizes match. Thus once the arena has grown to the steady-state
+ * batch size, building a batch doesn't allocate memory. Growth is counted in PoolStats.
+ *
+ * An arena should be filled either with shallow or with deep copies, not both.
+ *
+ * This class is not thread-safe, it is meant to be owned by a single client and used by the thread
+ * that delivers events to that client.
+ */
+class VehiclePropValueArena {
+public:
+    void clear() {
+        mSize = 0;
+    }
+
+    size_t size() const {
+        return mSize;
+    }
+
+    bool empty() const {
+        return mSize == 0;
+    }
+
+    VehiclePropValue& operator[](size_t i) {
+        return mSlots[i];
+    }
+
+    const VehiclePropValue& operator[](size_t i) const {
+        return mSlots[i];
+    }
+
+    /* Appends value that refers to src data, src must outlive the arena content. */
+    void appendShallowCopy(const VehiclePropValue& src);
+
+    /* Appends a copy of src, reusing buffers of the slot if possible. */
+    void appendDeepCopy(const VehiclePropValue& src);
+
+    /* Replaces value at given position with a copy of src, reusing its buffers if possible. */
+    void replaceWithDeepCopy(size_t i, const VehiclePropValue& src);
+
+    /* Returns hidl_vec pointing to arena content, valid until arena is modified. */
+    hidl_vec<VehiclePropValue> toHidlVec();
+
+private:
+    VehiclePropValue& nextSlot();
+
+private:
+    std::vector<VehiclePropValue> mSlots;
+    size_t mSize = 0;
 };
 
 }  // namespace V2_0
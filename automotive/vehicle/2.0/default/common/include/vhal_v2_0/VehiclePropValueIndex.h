@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_VehiclePropValueIndex_H_
+#define android_hardware_automotive_vehicle_V2_0_VehiclePropValueIndex_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <android/hardware/automotive/vehicle/2.0/types.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+/*
+ * Open-addressing hash index of VehiclePropValues keyed by packed (prop, area).
+ *
+ * Values are stored densely in a vector, the hash table only holds keys and indices into that
+ * vector, so a lookup is a few probes over a small contiguous array instead of a tree walk. The
+ * indices of the values of every property are kept as well, so the values of a property are
+ * visited in O(values of the property). Iteration order is unspecified.
+ *
+ * This class is not thread-safe.
+ */
+class VehiclePropValueIndex {
+public:
+    VehiclePropValueIndex() : mSlots(kInitialCapacity, Slot { 0, kEmpty }) {}
+
+    VehiclePropValue* find(int32_t prop, int32_t area) {
+        int32_t index = mSlots[findSlot(makeKey(prop, area))].index;
+        return index >= 0 ? &mEntries[index].value : nullptr;
+    }
+
+    const VehiclePropValue* find(int32_t prop, int32_t area) const {
+        return const_cast<VehiclePropValueIndex*>(this)->find(prop, area);
+    }
+
+    /* Inserts a copy of given value, the value must not be present in the index. */
+    void insert(int32_t prop, int32_t area, const VehiclePropValue& value) {
+        if ((mEntries.size() + mTombstones + 1) * 2 > mSlots.size()) {
+            rehash(mEntries.size() * 4 > mSlots.size() ? mSlots.size() * 2 : mSlots.size());
+        }
+        uint64_t key = makeKey(prop, area);
+        size_t slot = findInsertSlot(key);
+        if (mSlots[slot].index == kTombstone) mTombstones--;
+        mSlots[slot] = Slot { key, static_cast<int32_t>(mEntries.size()) };
+        mPropertyEntries[prop].push_back(static_cast<int32_t>(mEntries.size()));
+        mEntries.push_back(Entry { key, value });
+    }
+
+    bool erase(int32_t prop, int32_t area) {
+        size_t slot = findSlot(makeKey(prop, area));
+        int32_t index = mSlots[slot].index;
+        if (index < 0) return false;
+
+        mSlots[slot].index = kTombstone;
+        mTombstones++;
+        replacePropertyEntry(prop, index, kEmpty);
+
+        // Keep entries dense by moving the last one into the freed position.
+        int32_t last = static_cast<int32_t>(mEntries.size() - 1);
+        if (index != last) {
+            mEntries[index] = std::move(mEntries.back());
+            mSlots[findSlot(mEntries[index].key)].index = index;
+            replacePropertyEntry(getProp(mEntries[index].key), last, index);
+        }
+        mEntries.pop_back();
+        return true;
+    }
+
+    void eraseProperty(int32_t prop) {
+        auto it = mPropertyEntries.find(prop);
+        if (it == mPropertyEntries.end()) return;
+
+        std::vector<int32_t> areas;
+        areas.reserve(it->second.size());
+        for (int32_t index : it->second) {
+            areas.push_back(getArea(mEntries[index].key));
+        }
+        for (int32_t area : areas) {
+            erase(prop, area);
+        }
+    }
+
+    template <typename Func>
+    void forEachValue(Func&& func) const {
+        for (const auto& entry : mEntries) {
+            func(entry.value);
+        }
+    }
+
+    template <typename Func>
+    void forEachValueOfProperty(int32_t prop, Func&& func) const {
+        auto it = mPropertyEntries.find(prop);
+        if (it == mPropertyEntries.end()) return;
+
+        for (int32_t index : it->second) {
+            func(mEntries[index].value);
+        }
+    }
+
+    size_t size() const {
+        return mEntries.size();
+    }
+
+private:
+    static constexpr size_t kInitialCapacity = 64;  // Must be a power of two.
+    static constexpr int32_t kEmpty = -1;
+    static constexpr int32_t kTombstone = -2;
+
+    struct Slot {
+        uint64_t key;
+        int32_t index;
+    };
+
+    struct Entry {
+        uint64_t key;
+        VehiclePropValue value;
+    };
+
+    static uint64_t makeKey(int32_t prop, int32_t area) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(prop)) << 32)
+               | static_cast<uint32_t>(area);
+    }
+
+    static int32_t getProp(uint64_t key) {
+        return static_cast<int32_t>(key >> 32);
+    }
+
+    static int32_t getArea(uint64_t key) {
+        return static_cast<int32_t>(key & 0xffffffff);
+    }
+
+    size_t hashOf(uint64_t key) const {
+        // Fibonacci hashing, properties differ mostly in low bits of the id.
+        return static_cast<size_t>((key * 0x9e3779b97f4a7c15ull) >> 32) & (mSlots.size() - 1);
+    }
+
+    /* Returns slot holding given key or empty slot where the probe sequence ended. */
+    size_t findSlot(uint64_t key) const {
+        size_t mask = mSlots.size() - 1;
+        for (size_t slot = hashOf(key);; slot = (slot + 1) & mask) {
+            const Slot& s = mSlots[slot];
+            if (s.index == kEmpty || (s.index >= 0 && s.key == key)) return slot;
+        }
+    }
+
+    size_t findInsertSlot(uint64_t key) const {
+        size_t mask = mSlots.size() - 1;
+        for (size_t slot = hashOf(key);; slot = (slot + 1) & mask) {
+            if (mSlots[slot].index < 0) return slot;
+        }
+    }
+
+    /* Replaces index by newIndex in the entries of prop, or removes it if newIndex is kEmpty. */
+    void replacePropertyEntry(int32_t prop, int32_t index, int32_t newIndex) {
+        auto it = mPropertyEntries.find(prop);
+        std::vector<int32_t>& indices = it->second;
+        auto pos = std::find(indices.begin(), indices.end(), index);
+        if (newIndex != kEmpty) {
+            *pos = newIndex;
+            return;
+        }
+        *pos = indices.back();
+        indices.pop_back();
+        if (indices.empty()) mPropertyEntries.erase(it);
+    }
+
+    void rehash(size_t capacity) {
+        mSlots.assign(capacity, Slot { 0, kEmpty });
+        mTombstones = 0;
+        for (size_t i = 0; i < mEntries.size(); i++) {
+            mSlots[findInsertSlot(mEntries[i].key)] = Slot { mEntries[i].key,
+                                                             static_cast<int32_t>(i) };
+        }
+    }
+
+private:
+    std::vector<Slot> mSlots;
+    std::vector<Entry> mEntries;
+    // Indices into mEntries of the values of every property.
+    std::unordered_map<int32_t, std::vector<int32_t>> mPropertyEntries;
+    size_t mTombstones = 0;
+};
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif // android_hardware_automotive_vehicle_V2_0_VehiclePropValueIndex_H_
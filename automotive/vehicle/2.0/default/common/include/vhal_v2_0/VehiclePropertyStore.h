@@ -18,12 +18,18 @@
 #define android_hardware_automotive_vehicle_V2_0_impl_PropertyDb_H_
 
 #include <cstdint>
+#include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 
+#include "VehiclePropValueIndex.h"
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -37,13 +43,32 @@ namespace V2_0 {
  * VehiclePropertyValues stored in a sorted map thus it makes easier to get range of values, e.g.
  * to get value for all areas for particular property.
  *
- * This class is thread-safe, however it uses blocking synchronization across all methods.
+ * This class is thread-safe. In Mode::SERIALIZED (default) it uses blocking synchronization across
+ * all methods. In Mode::CONCURRENT values of every property are kept in an immutable snapshot which
+ * writers replace atomically (copy-on-write), thus readers never wait for writers and writers of
+ * different properties do not contend with each other. Mode::FLAT_INDEX is blocking as well, but
+ * keeps values with a zero token in an open-addressing hash index keyed by (prop, area), so reads
+ * take O(1) probes over contiguous memory and reading all values of a property takes O(values of
+ * the property); values with a non-zero token, which only properties with a token function have,
+ * are kept in the sorted map.
+ *
+ * The values can be saved to a snapshot file, e.g. on shutdown, and restored from it in one bulk
+ * load on the next boot, so that reads return the last known values before the vehicle bus has
+ * reported any.
  */
 class VehiclePropertyStore {
 public:
     /* Function that used to calculate unique token for given VehiclePropValue */
     using TokenFunction = std::function<int64_t(const VehiclePropValue& value)>;
 
+    enum class Mode {
+        SERIALIZED,
+        CONCURRENT,
+        FLAT_INDEX,
+    };
+
+    explicit VehiclePropertyStore(Mode mode = Mode::SERIALIZED);
+
 private:
     struct RecordConfig {
         VehiclePropConfig propConfig;
@@ -62,6 +87,17 @@ private:
     using PropertyMap = std::map<RecordId, VehiclePropValue>;
     using PropertyMapRange = std::pair<PropertyMap::const_iterator, PropertyMap::const_iterator>;
 
+    /* Used only in Mode::CONCURRENT, holds config and values of a single property. */
+    struct PropertyShard {
+        RecordConfig config;
+        std::mutex writeLock;  // Serializes writers of this property only.
+        // Immutable snapshot of values, must be accessed with std::atomic_load/atomic_store.
+        std::shared_ptr<const PropertyMap> values;
+    };
+
+    using ShardMap = std::unordered_map<int32_t /* VehicleProperty */,
+                                        std::shared_ptr<PropertyShard>>;
+
 public:
     void registerProperty(const VehiclePropConfig& config, TokenFunction tokenFunc = nullptr);
 
@@ -82,17 +118,58 @@ public:
     const VehiclePropConfig* getConfigOrNull(int32_t propId) const;
     const VehiclePropConfig* getConfigOrDie(int32_t propId) const;
 
+    /* Writes all values to a snapshot file, replacing the previous one atomically. Returns false
+     * if the file could not be written. */
+    bool saveSnapshot(const std::string& path) const;
+
+    /* Loads the values of allowedProps from a snapshot written by saveSnapshot, replacing the
+     * current ones. Values of other properties, or of properties that are not registered, are
+     * skipped. Restored values keep the timestamps they were saved with, which may be from a
+     * previous boot.
+     * Must be called after the properties are registered and before values are written from the
+     * vehicle bus. Returns the number of values restored, 0 if the file is missing or invalid. */
+    size_t restoreSnapshot(const std::string& path, const std::unordered_set<int32_t>& allowedProps);
+
 private:
     RecordId getRecordIdLocked(const VehiclePropValue& valuePrototype) const;
     const VehiclePropValue* getValueOrNullLocked(const RecordId& recId) const;
     PropertyMapRange findRangeLocked(int32_t propId) const;
 
+    static RecordId getRecordId(const RecordConfig& config, const VehiclePropValue& valuePrototype);
+    std::shared_ptr<PropertyShard> getShardOrNull(int32_t propId) const;
+    static std::shared_ptr<const PropertyMap> getValuesSnapshot(const PropertyShard& shard);
+
+    bool writeValueLocked(const VehiclePropValue& propValue, bool updateStatus,
+                          RecordId* outRecId);
+    size_t writeValuesBulk(const std::vector<VehiclePropValue>& values);
+
+    bool writeValueConcurrent(const VehiclePropValue& propValue, bool updateStatus);
+    void removeValueConcurrent(const VehiclePropValue& propValue);
+    void removeValuesForPropertyConcurrent(int32_t propId);
+    std::vector<VehiclePropValue> readAllValuesConcurrent() const;
+    std::vector<VehiclePropValue> readValuesForPropertyConcurrent(int32_t propId) const;
+    static std::unique_ptr<VehiclePropValue> readValueOrNullConcurrent(
+            const PropertyShard& shard, const RecordId& recId);
+
+    bool isFlatIndexedLocked(const RecordId& recId) const {
+        return mMode == Mode::FLAT_INDEX && recId.token == 0;
+    }
+
 private:
     using MuxGuard = std::lock_guard<std::mutex>;
+    const Mode mMode;
     mutable std::mutex mLock;
     std::unordered_map<int32_t /* VehicleProperty */, RecordConfig> mConfigs;
 
     PropertyMap mPropertyValues;  // Sorted map of RecordId : VehiclePropValue.
+
+    // Used only in Mode::FLAT_INDEX for values with token == 0, values with non-zero token are
+    // stored in mPropertyValues.
+    VehiclePropValueIndex mFlatValues;
+
+    // Used only in Mode::CONCURRENT. The map is replaced as a whole under mLock when new property
+    // is registered and must be accessed with std::atomic_load/atomic_store.
+    std::shared_ptr<const ShardMap> mShards;
 };
 
 }  // namespace V2_0
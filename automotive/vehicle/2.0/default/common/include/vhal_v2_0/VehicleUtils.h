@@ -66,8 +66,17 @@ std::unique_ptr<VehiclePropValue> createVehiclePropValue(
 size_t getVehicleRawValueVectorSize(
     const VehiclePropValue::RawValue& value, VehiclePropertyType type);
 
-void copyVehicleRawValue(VehiclePropValue::RawValue* dest,
-                                const VehiclePropValue::RawValue& src);
+/**
+ * Deep copies src into dest. Vectors of dest that already have the size of the source are
+ * written in place, so copying into a value of the same shape doesn't allocate.
+ *
+ * Returns the number of buffers that had to be allocated.
+ */
+size_t copyVehicleRawValue(VehiclePropValue::RawValue* dest,
+                           const VehiclePropValue::RawValue& src);
+
+/* Same as copyVehicleRawValue, for the whole value. */
+size_t copyVehiclePropValue(VehiclePropValue* dest, const VehiclePropValue& src);
 
 template<typename T>
 void shallowCopyHidlVec(hidl_vec<T>* dest, const hidl_vec<T>& src);
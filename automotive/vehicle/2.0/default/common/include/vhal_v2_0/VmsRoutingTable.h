@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_VmsRoutingTable_H_
+#define android_hardware_automotive_vehicle_V2_0_VmsRoutingTable_H_
+
+#include <unordered_set>
+
+#include <android/hardware/automotive/vehicle/2.0/types.h>
+
+#include "VmsUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace vms {
+
+// VmsRoutingTable answers whether anybody is subscribed to data of a given layer and publisher,
+// so HAL publishers can drop VMS data nobody listens to before it is sent to Android.
+//
+// The table is keyed by (layer type, subtype, version) for layers subscribed from any publisher
+// and by (layer type, subtype, version, publisher id) for associated layers. It is updated from
+// VmsMessageType.SUBSCRIPTIONS_CHANGE and SUBSCRIPTIONS_RESPONSE messages, older states than the
+// last applied one are ignored. Sequence numbers start over with every session, so the table is
+// reset on VmsMessageType.START_SESSION. Until a state is known, all data is routed, as without
+// the table.
+//
+// This class is not thread-safe.
+class VmsRoutingTable {
+  public:
+    // Applies the subscriptions state carried by the message if it's newer than the current one.
+    // Returns false if the message is not a valid subscriptions state or is out of date.
+    bool update(const VehiclePropValue& subscriptions_state);
+
+    // Returns true if data of the layer from the publisher has at least one subscriber.
+    bool isSubscribed(const VmsLayerAndPublisher& layer_publisher) const;
+
+    // Returns true if the value is a VmsMessageType.DATA message with at least one subscriber, or
+    // with no subscriptions state known yet.
+    bool shouldRoute(const VehiclePropValue& data_message) const;
+
+    // Forgets the subscriptions state, for a new session.
+    void reset();
+
+    // Returns sequence number of the applied subscriptions state or -1 if there is none.
+    int32_t getSequenceNumber() const { return mSequenceNumber; }
+
+  private:
+    struct LayerPublisherHash {
+        size_t operator()(const VmsLayerAndPublisher& layer_publisher) const;
+    };
+
+    struct LayerPublisherEqual {
+        bool operator()(const VmsLayerAndPublisher& a, const VmsLayerAndPublisher& b) const {
+            return a.layer == b.layer && a.publisher_id == b.publisher_id;
+        }
+    };
+
+    int32_t mSequenceNumber = -1;
+    std::unordered_set<VmsLayer, VmsLayer::VmsLayerHashFunction> mLayers;
+    std::unordered_set<VmsLayerAndPublisher, LayerPublisherHash, LayerPublisherEqual>
+            mLayerPublishers;
+};
+
+}  // namespace vms
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_VmsRoutingTable_H_
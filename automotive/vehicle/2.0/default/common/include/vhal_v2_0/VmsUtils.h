@@ -23,6 +23,8 @@
 
 #include <android/hardware/automotive/vehicle/2.0/types.h>
 
+#include "VehicleObjectPool.h"
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -53,8 +55,8 @@ struct VmsLayer {
       public:
         // Hash of the variables is returned.
         size_t operator()(const VmsLayer& layer) const {
-            return std::hash<int>()(layer.type) ^ std::hash<int>()(layer.type) ^
-                   std::hash<int>()(layer.type);
+            return (std::hash<int>()(layer.type) * 31 + std::hash<int>()(layer.subtype)) * 31 +
+                   std::hash<int>()(layer.version);
         }
     };
 };
@@ -231,6 +233,77 @@ VmsSessionStatus parseStartSessionMessage(const VehiclePropValue& start_session,
                                           const int current_service_id, const int current_client_id,
                                           int* new_service_id);
 
+// A non-owning view of a message of type VmsMessageType.DATA. The payload points into the
+// VehiclePropValue it was parsed from and is only valid while that value is alive and unchanged.
+struct VmsDataView {
+    VmsDataView() : layer_publisher(VmsLayer(0, 0, 0), 0) {}
+    VmsLayerAndPublisher layer_publisher;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+// Parses the layer, publisher and payload of a message of type VmsMessageType.DATA in place,
+// without copying the payload. Returns false if the value is not a valid DATA message.
+bool parseDataView(const VehiclePropValue& value, VmsDataView* data_view);
+
+// A non-owning view of a message of type VmsMessageType.SUBSCRIPTIONS_CHANGE or
+// VmsMessageType.SUBSCRIPTIONS_RESPONSE. Layers are decoded on access directly from the
+// int32Values of the parsed VehiclePropValue, which must outlive the view and stay unchanged.
+class VmsSubscriptionsStateView {
+  public:
+    // Returns false if the value is not a subscriptions state message or if its layer lists
+    // are truncated. The view is empty after a failed parse.
+    bool parse(const VehiclePropValue& value);
+
+    int32_t getSequenceNumber() const { return mSequenceNumber; }
+
+    size_t getLayerCount() const { return mLayerCount; }
+    VmsLayer getLayer(size_t index) const;
+
+    size_t getAssociatedLayerCount() const { return mAssociatedLayerCount; }
+
+    // Calls func(const VmsLayer& layer, const int32_t* publisher_ids, size_t publisher_id_count)
+    // for every associated layer in message order.
+    template <typename Func>
+    void forEachAssociatedLayer(Func&& func) const {
+        const int32_t* current = mAssociatedLayers;
+        for (size_t i = 0; i < mAssociatedLayerCount; i++) {
+            const size_t publisher_id_count = current[3];
+            func(VmsLayer(current[0], current[1], current[2]), current + 4, publisher_id_count);
+            current += 4 + publisher_id_count;
+        }
+    }
+
+  private:
+    int32_t mSequenceNumber = -1;
+    size_t mLayerCount = 0;
+    const int32_t* mLayers = nullptr;
+    size_t mAssociatedLayerCount = 0;
+    const int32_t* mAssociatedLayers = nullptr;
+};
+
+// Builds messages of type VmsMessageType.DATA for a publisher out of recycled VehiclePropValues.
+// Released messages return to the builder keeping their header and payload storage, so
+// publishing payloads of a steady size doesn't allocate. The builder must outlive the messages.
+//
+// This class is thread-safe.
+class VmsDataMessageBuilder {
+  public:
+    recyclable_ptr<VehiclePropValue> build(const VmsLayerAndPublisher& layer_publisher,
+                                           const uint8_t* data, size_t size);
+    recyclable_ptr<VehiclePropValue> build(const VmsLayerAndPublisher& layer_publisher,
+                                           const std::string& vms_packet);
+
+  private:
+    class MessagePool : public ObjectPool<VehiclePropValue> {
+      protected:
+        VehiclePropValue* createObject() override;
+        void recycle(VehiclePropValue* o) override;
+    };
+
+    MessagePool mPool;
+};
+
 }  // namespace vms
 }  // namespace V2_0
 }  // namespace vehicle
@@ -16,6 +16,8 @@
 
 #include "Obd2SensorStore.h"
 
+#include <algorithm>
+
 #include <utils/SystemClock.h>
 #include "VehicleUtils.h"
 
@@ -30,7 +32,8 @@ Obd2SensorStore::BitmaskInVector::BitmaskInVector(size_t numBits) {
 }
 
 void Obd2SensorStore::BitmaskInVector::resize(size_t numBits) {
-    mStorage = std::vector<uint8_t>((numBits + 7) / 8, 0);
+    mStorage.resize((numBits + 7) / 8);
+    std::fill(mStorage.begin(), mStorage.end(), 0);
 }
 
 void Obd2SensorStore::BitmaskInVector::set(size_t index, bool value) {
@@ -48,18 +51,34 @@ bool Obd2SensorStore::BitmaskInVector::get(size_t index) const {
     return (byte & (1 << bitIndex)) != 0;
 }
 
-const std::vector<uint8_t>& Obd2SensorStore::BitmaskInVector::getBitmask() const {
+const hidl_vec<uint8_t>& Obd2SensorStore::BitmaskInVector::getBitmask() const {
     return mStorage;
 }
 
+namespace {
+
+// Copies src into dst reusing dst storage if it already has the right size.
+template <typename T>
+void copyVec(const hidl_vec<T>& src, hidl_vec<T>* dst) {
+    if (dst->size() != src.size()) {
+        dst->resize(src.size());
+    }
+    std::copy(src.begin(), src.end(), dst->begin());
+}
+
+}  // namespace
+
 Obd2SensorStore::Obd2SensorStore(size_t numVendorIntegerSensors, size_t numVendorFloatSensors) {
     // because the last index is valid *inclusive*
     const size_t numSystemIntegerSensors =
         toInt(DiagnosticIntegerSensorIndex::LAST_SYSTEM_INDEX) + 1;
     const size_t numSystemFloatSensors = toInt(DiagnosticFloatSensorIndex::LAST_SYSTEM_INDEX) + 1;
-    mIntegerSensors = std::vector<int32_t>(numSystemIntegerSensors + numVendorIntegerSensors, 0);
-    mFloatSensors = std::vector<float>(numSystemFloatSensors + numVendorFloatSensors, 0);
-    mSensorsBitmask.resize(mIntegerSensors.size() + mFloatSensors.size());
+    mIntegerSensors.resize(numSystemIntegerSensors + numVendorIntegerSensors);
+    std::fill(mIntegerSensors.begin(), mIntegerSensors.end(), 0);
+    mFloatSensors.resize(numSystemFloatSensors + numVendorFloatSensors);
+    std::fill(mFloatSensors.begin(), mFloatSensors.end(), 0);
+    mSensorsBitmask.resize(getSensorCount());
+    mChangedSensorsBitmask.resize(getSensorCount());
 }
 
 StatusCode Obd2SensorStore::setIntegerSensor(DiagnosticIntegerSensorIndex index, int32_t value) {
@@ -70,35 +89,85 @@ StatusCode Obd2SensorStore::setFloatSensor(DiagnosticFloatSensorIndex index, flo
 }
 
 StatusCode Obd2SensorStore::setIntegerSensor(size_t index, int32_t value) {
+    if (index >= mIntegerSensors.size()) {
+        return StatusCode::INVALID_ARG;
+    }
     mIntegerSensors[index] = value;
     mSensorsBitmask.set(index, true);
+    markChanged(index);
     return StatusCode::OK;
 }
 
 StatusCode Obd2SensorStore::setFloatSensor(size_t index, float value) {
+    if (index >= mFloatSensors.size()) {
+        return StatusCode::INVALID_ARG;
+    }
     mFloatSensors[index] = value;
     mSensorsBitmask.set(index + mIntegerSensors.size(), true);
+    markChanged(index + mIntegerSensors.size());
     return StatusCode::OK;
 }
 
-const std::vector<int32_t>& Obd2SensorStore::getIntegerSensors() const {
+const hidl_vec<int32_t>& Obd2SensorStore::getIntegerSensors() const {
     return mIntegerSensors;
 }
 
-const std::vector<float>& Obd2SensorStore::getFloatSensors() const {
+const hidl_vec<float>& Obd2SensorStore::getFloatSensors() const {
     return mFloatSensors;
 }
 
-const std::vector<uint8_t>& Obd2SensorStore::getSensorsBitmask() const {
+const hidl_vec<uint8_t>& Obd2SensorStore::getSensorsBitmask() const {
     return mSensorsBitmask.getBitmask();
 }
 
 void Obd2SensorStore::fillPropValue(const std::string& dtc, VehiclePropValue* propValue) const {
     propValue->timestamp = elapsedRealtimeNano();
-    propValue->value.int32Values = getIntegerSensors();
-    propValue->value.floatValues = getFloatSensors();
-    propValue->value.bytes = getSensorsBitmask();
+    copyVec(getIntegerSensors(), &propValue->value.int32Values);
+    copyVec(getFloatSensors(), &propValue->value.floatValues);
+    copyVec(getSensorsBitmask(), &propValue->value.bytes);
+    propValue->value.stringValue = dtc;
+}
+
+void Obd2SensorStore::fillDeltaPropValue(const std::string& dtc, VehiclePropValue* propValue) {
+    propValue->timestamp = elapsedRealtimeNano();
+    auto& int32Values = propValue->value.int32Values;
+    auto& floatValues = propValue->value.floatValues;
+    if (int32Values.size() == mIntegerSensors.size()
+            && floatValues.size() == mFloatSensors.size()) {
+        for (size_t sensor : mChangedSensors) {
+            if (sensor < mIntegerSensors.size()) {
+                int32Values[sensor] = mIntegerSensors[sensor];
+            } else {
+                floatValues[sensor - mIntegerSensors.size()] =
+                    mFloatSensors[sensor - mIntegerSensors.size()];
+            }
+        }
+    } else {
+        copyVec(getIntegerSensors(), &int32Values);
+        copyVec(getFloatSensors(), &floatValues);
+    }
+    copyVec(mChangedSensorsBitmask.getBitmask(), &propValue->value.bytes);
     propValue->value.stringValue = dtc;
+
+    for (size_t sensor : mChangedSensors) {
+        mChangedSensorsBitmask.set(sensor, false);
+    }
+    mChangedSensors.clear();
+}
+
+bool Obd2SensorStore::hasChangedSensors() const {
+    return !mChangedSensors.empty();
+}
+
+size_t Obd2SensorStore::getSensorCount() const {
+    return mIntegerSensors.size() + mFloatSensors.size();
+}
+
+void Obd2SensorStore::markChanged(size_t sensorIndex) {
+    if (!mChangedSensorsBitmask.get(sensorIndex)) {
+        mChangedSensorsBitmask.set(sensorIndex, true);
+        mChangedSensors.push_back(sensorIndex);
+    }
 }
 
 }  // namespace V2_0
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "automotive.vehicle@2.0-impl"
+
+#include "PropertyEventDispatcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+#include <android/log.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+PropertyEventDispatcher::PropertyEventDispatcher(size_t workerCount, IsContinuousFn isContinuous)
+        : mIsContinuous(std::move(isContinuous)) {
+    for (size_t i = 0; i < workerCount; i++) {
+        mWorkers.push_back(std::thread(&PropertyEventDispatcher::workerLoop, this));
+    }
+}
+
+PropertyEventDispatcher::~PropertyEventDispatcher() {
+    {
+        MuxGuard g(mLock);
+        mStopRequested = true;
+    }
+    mCond.notify_all();
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+void PropertyEventDispatcher::dispatch(const HalClientValues& clientValues) {
+    const sp<HalClient>& client = clientValues.client;
+    {
+        MuxGuard g(mLock);
+        auto& queue = mQueues[client.get()];
+        if (queue == nullptr) {
+            removeReleasedClientsLocked();
+            queue.reset(new ClientQueue());
+            queue->client = client;
+        }
+
+        for (const VehiclePropValue* value : clientValues) {
+            if (!mIsContinuous(value->prop)) {
+                queue->pendingKeys.push_back(kNoKey);
+                queue->pending.appendDeepCopy(*value);
+                continue;
+            }
+
+            uint64_t key = makeKey(*value);
+            // Linear search over contiguous keys is cheap while the client keeps up and doesn't
+            // allocate.
+            auto it = std::find(queue->pendingKeys.begin(), queue->pendingKeys.end(), key);
+            if (it == queue->pendingKeys.end()) {
+                queue->pendingKeys.push_back(key);
+                queue->pending.appendDeepCopy(*value);
+            } else {
+                // Client hasn't received previous value yet, replace it with the fresher one.
+                queue->pending.replaceWithDeepCopy(it - queue->pendingKeys.begin(), *value);
+                mCoalescedCount++;
+            }
+        }
+
+        if (queue->scheduled || queue->pending.empty()) return;
+        queue->scheduled = true;
+        mReadyQueues.push_back(queue.get());
+    }
+    mCond.notify_one();
+}
+
+void PropertyEventDispatcher::workerLoop() {
+    std::unique_lock<std::mutex> g(mLock);
+    while (!mStopRequested) {
+        if (mReadyQueues.empty()) {
+            mCond.wait(g);
+            continue;
+        }
+
+        ClientQueue* queue = mReadyQueues.front();
+        mReadyQueues.pop_front();
+        std::swap(queue->inFlight, queue->pending);
+        queue->pendingKeys.clear();
+
+        g.unlock();
+        deliver(queue);
+        g.lock();
+
+        queue->inFlight.clear();  // Keeps slots for the next delivery.
+        if (queue->pending.empty()) {
+            queue->scheduled = false;
+        } else {
+            // More values arrived while client was busy.
+            mReadyQueues.push_back(queue);
+        }
+    }
+}
+
+void PropertyEventDispatcher::deliver(ClientQueue* queue) {
+    auto start = std::chrono::steady_clock::now();
+    auto status = queue->client->getCallback()->onPropertyEvent(queue->inFlight.toHidlVec());
+    queue->client->getCallbackLatencyHistogram()->add(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+    if (!status.isOk()) {
+        ALOGE("Failed to notify client %s, err: %s",
+              toString(queue->client->getCallback()).c_str(),
+              status.description().c_str());
+    }
+}
+
+void PropertyEventDispatcher::removeReleasedClientsLocked() {
+    // Queues hold strong references to clients, release queues of clients that are idle and no
+    // longer referenced by SubscriptionManager.
+    for (auto it = mQueues.begin(); it != mQueues.end();) {
+        const auto& queue = it->second;
+        if (queue != nullptr && !queue->scheduled && queue->client->getStrongCount() == 1) {
+            it = mQueues.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
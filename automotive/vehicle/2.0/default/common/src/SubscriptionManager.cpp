@@ -74,6 +74,37 @@ bool HalClient::isSubscribed(int32_t propId,
     return res;
 }
 
+SubscribeOptions HalClient::getSubscribeOptions(int32_t propId) const {
+    auto it = mSubscriptions.find(propId);
+    return it == mSubscriptions.end()
+           ? SubscribeOptions { .propId = propId, .flags = SubscribeFlags::UNDEFINED }
+           : it->second;
+}
+
+bool HalClient::shouldDeliver(const VehiclePropValue& value, int64_t minIntervalNs) {
+    if (minIntervalNs <= 0 || value.timestamp <= 0) {
+        return true;
+    }
+
+    uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(value.prop)) << 32)
+                   | static_cast<uint32_t>(value.areaId);
+    auto it = mNextDeliveryTimestamps.find(key);
+    if (it == mNextDeliveryTimestamps.end()) {
+        mNextDeliveryTimestamps.emplace(key, value.timestamp + minIntervalNs);
+        return true;
+    }
+
+    // Samples of the source may jitter around the client's period, accept slightly early ones.
+    int64_t& next = it->second;
+    if (value.timestamp < next - minIntervalNs / 10) {
+        return false;
+    }
+    // Keep the client's cadence unless there was a gap of more than one period.
+    next = value.timestamp >= next + minIntervalNs ? value.timestamp + minIntervalNs
+                                                   : next + minIntervalNs;
+    return true;
+}
+
 std::vector<int32_t> HalClient::getSubscribedProperties() const {
     std::vector<int32_t> props;
     for (const auto& subscription : mSubscriptions) {
@@ -114,34 +145,70 @@ StatusCode SubscriptionManager::addOrUpdateSubscription(
         }
     }
 
+    rebuildFanOutTableLocked();
     return StatusCode::OK;
 }
 
-std::list<HalClientValues> SubscriptionManager::distributeValuesToClients(
+void SubscriptionManager::distributeValuesToClients(
         const std::vector<recyclable_ptr<VehiclePropValue>>& propValues,
-        SubscribeFlags flags) const {
-    std::map<sp<HalClient>, std::list<VehiclePropValue*>> clientValuesMap;
-
-    {
-        MuxGuard g(mLock);
-        for (const auto& propValue: propValues) {
-            VehiclePropValue* v = propValue.get();
-            auto clients = getSubscribedClientsLocked(v->prop, flags);
-            for (const auto& client : clients) {
-                clientValuesMap[client].push_back(v);
+        SubscribeFlags flags,
+        DistributedValues* out) const {
+    out->mTable = std::atomic_load(&mFanOutTable);
+    const FanOutTable& table = *out->mTable;
+
+    // First pass counts values per client, second pass puts them into contiguous ranges.
+    // Decimation updates client state, so decisions made in the first pass are recorded.
+    auto& offsets = out->mOffsets;
+    offsets.assign(table.clients.size() + 1, 0);
+    out->mEntries.resize(propValues.size());
+    out->mDecisions.clear();
+    for (size_t i = 0; i < propValues.size(); i++) {
+        const FanOutTable::PropEntry* entry = table.find(propValues[i]->prop);
+        out->mEntries[i] = entry;
+        if (entry == nullptr) continue;
+        for (uint32_t j = entry->begin; j < entry->end; j++) {
+            const auto& subscriber = table.subscribers[j];
+            bool deliver = (subscriber.flags & flags)
+                           && table.clients[subscriber.clientIndex]->shouldDeliver(
+                                  *propValues[i], subscriber.minIntervalNs);
+            out->mDecisions.push_back(deliver);
+            if (deliver) {
+                offsets[subscriber.clientIndex + 1]++;
             }
         }
     }
-
-    std::list<HalClientValues> clientValues;
-    for (const auto& entry : clientValuesMap) {
-        clientValues.push_back(HalClientValues {
-            .client = entry.first,
-            .values = entry.second
-        });
+    for (size_t i = 1; i < offsets.size(); i++) {
+        offsets[i] += offsets[i - 1];
+    }
+    out->mValues.resize(offsets.back());
+
+    size_t decision = 0;
+    for (size_t i = 0; i < propValues.size(); i++) {
+        const FanOutTable::PropEntry* entry = out->mEntries[i];
+        if (entry == nullptr) continue;
+        for (uint32_t j = entry->begin; j < entry->end; j++) {
+            const auto& subscriber = table.subscribers[j];
+            if (out->mDecisions[decision++]) {
+                // Offsets of client i temporarily point to the end of its filled range.
+                out->mValues[offsets[subscriber.clientIndex]++] = propValues[i].get();
+            }
+        }
     }
 
-    return clientValues;
+    // Offsets have shifted by one client, range of client i is [offsets[i - 1], offsets[i]).
+    out->mClientValues.clear();
+    uint32_t begin = 0;
+    for (size_t i = 0; i < table.clients.size(); i++) {
+        uint32_t end = offsets[i];
+        if (end > begin) {
+            out->mClientValues.push_back(HalClientValues {
+                .client = table.clients[i],
+                .values = &out->mValues[begin],
+                .count = end - begin
+            });
+        }
+        begin = end;
+    }
 }
 
 std::list<sp<HalClient>> SubscriptionManager::getSubscribedClients(int32_t propId,
@@ -150,6 +217,16 @@ std::list<sp<HalClient>> SubscriptionManager::getSubscribedClients(int32_t propI
     return getSubscribedClientsLocked(propId, flags);
 }
 
+std::vector<sp<HalClient>> SubscriptionManager::getClients() const {
+    MuxGuard g(mLock);
+    std::vector<sp<HalClient>> clients;
+    clients.reserve(mClients.size());
+    for (const auto& it : mClients) {
+        clients.push_back(it.second);
+    }
+    return clients;
+}
+
 std::list<sp<HalClient>> SubscriptionManager::getSubscribedClientsLocked(
     int32_t propId, SubscribeFlags flags) const {
     std::list<sp<HalClient>> subscribedClients;
@@ -263,6 +340,7 @@ void SubscriptionManager::unsubscribe(ClientId clientId,
             }
             mClients.erase(clientIter);
         }
+        rebuildFanOutTableLocked();
     }
 
     if (propertyClients == nullptr || propertyClients->isEmpty()) {
@@ -271,6 +349,37 @@ void SubscriptionManager::unsubscribe(ClientId clientId,
     }
 }
 
+void SubscriptionManager::rebuildFanOutTableLocked() {
+    auto table = std::make_shared<FanOutTable>();
+
+    std::map<HalClient*, uint32_t> clientIndices;
+    for (const auto& entry : mClients) {
+        clientIndices.emplace(entry.second.get(), table->clients.size());
+        table->clients.push_back(entry.second);
+    }
+
+    // mPropToClients is ordered by property, so are the entries.
+    for (const auto& entry : mPropToClients) {
+        FanOutTable::PropEntry propEntry { entry.first,
+                                           static_cast<uint32_t>(table->subscribers.size()), 0 };
+        const sp<HalClientVector>& propClients = entry.second;
+        for (size_t i = 0; i < propClients->size(); i++) {
+            const sp<HalClient>& client = propClients->itemAt(i);
+            auto it = clientIndices.find(client.get());
+            if (it == clientIndices.end()) continue;
+            SubscribeOptions opts = client->getSubscribeOptions(entry.first);
+            int64_t minIntervalNs = opts.sampleRate > 0
+                                    ? static_cast<int64_t>(1000000000.0 / opts.sampleRate) : 0;
+            table->subscribers.push_back(FanOutTable::Subscriber {
+                it->second, opts.flags, minIntervalNs });
+        }
+        propEntry.end = table->subscribers.size();
+        table->props.push_back(propEntry);
+    }
+
+    std::atomic_store(&mFanOutTable, std::shared_ptr<const FanOutTable>(std::move(table)));
+}
+
 void SubscriptionManager::onCallbackDead(uint64_t cookie) {
     ALOGI("%s, cookie: 0x%" PRIx64, __func__, cookie);
     ClientId clientId = cookie;
@@ -18,6 +18,10 @@
 
 #include "VehicleHalManager.h"
 
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <fstream>
 
@@ -38,12 +42,6 @@ constexpr std::chrono::milliseconds kHalEventBatchingTimeWindow(10);
 
 const VehiclePropValue kEmptyValue{};
 
-/**
- * Indicates what's the maximum size of hidl_vec<VehiclePropValue> we want
- * to store in reusable object pool.
- */
-constexpr auto kMaxHidlVecOfVehiclPropValuePoolSize = 20;
-
 Return<void> VehicleHalManager::getAllPropConfigs(getAllPropConfigs_cb _hidl_cb) {
     ALOGI("getAllPropConfigs called");
     hidl_vec<VehiclePropConfig> hidlConfigs;
@@ -91,7 +89,13 @@ Return<void> VehicleHalManager::get(const VehiclePropValue& requestedPropValue,
     }
 
     StatusCode status;
+    auto start = std::chrono::steady_clock::now();
     auto value = mHal->get(requestedPropValue, &status);
+    mMetrics.getLatencyUs.add(VehicleHalMetrics::microsSince(start));
+    mMetrics.getCount.inc();
+    if (status != StatusCode::OK) {
+        mMetrics.getErrorCount.inc();
+    }
     _hidl_cb(status, value.get() ? *value : kEmptyValue);
 
 
@@ -112,7 +116,13 @@ Return<StatusCode> VehicleHalManager::set(const VehiclePropValue &value) {
 
     handlePropertySetEvent(value);
 
+    auto start = std::chrono::steady_clock::now();
     auto status = mHal->set(value);
+    mMetrics.setLatencyUs.add(VehicleHalMetrics::microsSince(start));
+    mMetrics.setCount.inc();
+    if (status != StatusCode::OK) {
+        mMetrics.setErrorCount.inc();
+    }
 
     return Return<StatusCode>(status);
 }
@@ -168,20 +178,78 @@ Return<StatusCode> VehicleHalManager::unsubscribe(const sp<IVehicleCallback>& ca
 }
 
 Return<void> VehicleHalManager::debugDump(IVehicle::debugDump_cb _hidl_cb) {
-    _hidl_cb("");
+    std::string dump;
+    if (mLockFreeEventQueue != nullptr) {
+        dump += "Lock-free event queue, capacity: "
+                + std::to_string(mLockFreeEventQueue->getCapacity())
+                + ", dropped events: " + std::to_string(mLockFreeEventQueue->getDroppedCount())
+                + "\n";
+    }
+    if (mEventDispatcher != nullptr) {
+        dump += "Client dispatch threads: " + std::to_string(mOptions.clientDispatchThreads)
+                + ", coalesced events: " + std::to_string(mEventDispatcher->getCoalescedCount())
+                + "\n";
+    }
+    dump += "Event batch sizes:\n"
+            + mBatchingConsumer.getBatchSizeHistogram().dump(" events");
+    dump += "Event batch latencies:\n"
+            + mBatchingConsumer.getBatchLatencyHistogram().dump("us");
+    dump += "Event queue depth: " + std::to_string(mEventQueue->size()) + "\n";
+    dump += mMetrics.dump();
+
+    const PoolStats* poolStats = PoolStats::instance();
+    dump += "Value pool obtained: " + std::to_string(poolStats->Obtained)
+            + ", created: " + std::to_string(poolStats->Created)
+            + ", magazine hit rate: " + std::to_string(poolStats->getMagazineHitRate()) + "\n";
+
+    for (const auto& client : mSubscriptionManager.getClients()) {
+        dump += "Client " + toString(client->getCallback()) + " callback latencies:\n"
+                + client->getCallbackLatencyHistogram()->dump("us");
+    }
+    _hidl_cb(dump);
+    return Void();
+}
+
+Return<void> VehicleHalManager::debug(const hidl_handle& fd,
+                                      const hidl_vec<hidl_string>& /* options */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        ALOGE("Invalid parameters passed to debug()");
+        return Void();
+    }
+    debugDump([&fd](const hidl_string& dump) {
+        dprintf(fd->data[0], "%s", dump.c_str());
+    });
     return Void();
 }
 
 void VehicleHalManager::init() {
     ALOGI("VehicleHalManager::init");
 
-    mHidlVecOfVehiclePropValuePool.resize(kMaxHidlVecOfVehiclPropValuePoolSize);
+    if (mOptions.lockFreeEventQueue) {
+        mLockFreeEventQueue = new LockFreeQueue<VehiclePropValuePtr>(mOptions.eventQueueCapacity);
+        mEventQueue.reset(mLockFreeEventQueue);
+    } else {
+        mEventQueue.reset(new ConcurrentQueue<VehiclePropValuePtr>());
+    }
 
+    if (mOptions.clientDispatchThreads > 0) {
+        // Values reach the dispatcher only for subscribed clients, which can't exist before the
+        // config index is initialized below.
+        mEventDispatcher.reset(new PropertyEventDispatcher(
+                mOptions.clientDispatchThreads, [this](int32_t prop) {
+                    const VehiclePropConfig* config = getPropConfigOrNull(prop);
+                    return config != nullptr
+                           && config->changeMode == VehiclePropertyChangeMode::CONTINUOUS;
+                }));
+    }
 
-    mBatchingConsumer.run(&mEventQueue,
-                          kHalEventBatchingTimeWindow,
-                          std::bind(&VehicleHalManager::onBatchHalEvent,
-                                    this, _1));
+    auto onBatchReceived = std::bind(&VehicleHalManager::onBatchHalEvent, this, _1);
+    if (mOptions.adaptiveBatching) {
+        mBatchingConsumer.run(mEventQueue.get(), mOptions.adaptiveBatchingOptions,
+                              onBatchReceived);
+    } else {
+        mBatchingConsumer.run(mEventQueue.get(), kHalEventBatchingTimeWindow, onBatchReceived);
+    }
 
     mHal->init(&mValueObjectPool,
                std::bind(&VehicleHalManager::onHalEvent, this, _1),
@@ -201,15 +269,18 @@ void VehicleHalManager::init() {
 
 VehicleHalManager::~VehicleHalManager() {
     mBatchingConsumer.requestStop();
-    mEventQueue.deactivate();
+    mEventQueue->deactivate();
     // We have to wait until consumer thread is fully stopped because it may
     // be in a state of running callback (onBatchHalEvent).
     mBatchingConsumer.waitStopped();
+    // Wait for in-flight deliveries to clients.
+    mEventDispatcher.reset();
     ALOGI("VehicleHalManager::dtor");
 }
 
 void VehicleHalManager::onHalEvent(VehiclePropValuePtr v) {
-    mEventQueue.push(std::move(v));
+    mMetrics.halEventCount.inc();
+    mEventQueue->push(std::move(v));
 }
 
 void VehicleHalManager::onHalPropertySetError(StatusCode errorCode,
@@ -224,29 +295,33 @@ void VehicleHalManager::onHalPropertySetError(StatusCode errorCode,
 }
 
 void VehicleHalManager::onBatchHalEvent(const std::vector<VehiclePropValuePtr>& values) {
-    const auto& clientValues =
-        mSubscriptionManager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR);
-
-    for (const HalClientValues& cv : clientValues) {
-        auto vecSize = cv.values.size();
-        hidl_vec<VehiclePropValue> vec;
-        if (vecSize < kMaxHidlVecOfVehiclPropValuePoolSize) {
-            vec.setToExternal(&mHidlVecOfVehiclePropValuePool[0], vecSize);
-        } else {
-            vec.resize(vecSize);
+    mSubscriptionManager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR,
+                                                   &mDistributedValues);
+
+    for (const HalClientValues& cv : mDistributedValues) {
+        if (mEventDispatcher != nullptr) {
+            mEventDispatcher->dispatch(cv);
+            continue;
         }
 
-        int i = 0;
-        for (VehiclePropValue* pValue : cv.values) {
-            shallowCopy(&(vec)[i++], *pValue);
+        // Arena is owned by the client and grows to the largest batch, so steady-state delivery
+        // doesn't allocate.
+        VehiclePropValueArena* arena = cv.client->getEventArena();
+        arena->clear();
+        for (VehiclePropValue* pValue : cv) {
+            arena->appendShallowCopy(*pValue);
         }
-        auto status = cv.client->getCallback()->onPropertyEvent(vec);
+        auto start = std::chrono::steady_clock::now();
+        auto status = cv.client->getCallback()->onPropertyEvent(arena->toHidlVec());
+        cv.client->getCallbackLatencyHistogram()->add(VehicleHalMetrics::microsSince(start));
         if (!status.isOk()) {
             ALOGE("Failed to notify client %s, err: %s",
                   toString(cv.client->getCallback()).c_str(),
                   status.description().c_str());
         }
     }
+    // Don't hold references to clients until the next batch.
+    mDistributedValues.clear();
 }
 
 bool VehicleHalManager::isSampleRateFixed(VehiclePropertyChangeMode mode) {
@@ -45,12 +45,8 @@ VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtain(
     size_t vecSize = getVehicleRawValueVectorSize(src.value, type);;
     auto dest = obtain(type, vecSize);
 
-    dest->prop = src.prop;
-    dest->areaId = src.areaId;
-    dest->status = src.status;
-    dest->timestamp = src.timestamp;
-    copyVehicleRawValue(&dest->value, src.value);
-
+    // Recycled objects of this type and size already have vectors of the right size.
+    copyVehiclePropValue(dest.get(), src);
     return dest;
 }
 
@@ -86,20 +82,44 @@ VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainComplex() {
     return obtain(VehiclePropertyType::MIXED);
 }
 
+VehiclePropValuePool::~VehiclePropValuePool() {
+    for (auto& pool : mValueTypePools) {
+        delete pool.load();
+    }
+}
+
+int32_t VehiclePropValuePool::getRecyclableTypeIndex(VehiclePropertyType type) {
+    switch (type) {
+        case VehiclePropertyType::BOOLEAN: return 0;
+        case VehiclePropertyType::INT32: return 1;
+        case VehiclePropertyType::INT32_VEC: return 2;
+        case VehiclePropertyType::INT64: return 3;
+        case VehiclePropertyType::INT64_VEC: return 4;
+        case VehiclePropertyType::FLOAT: return 5;
+        case VehiclePropertyType::FLOAT_VEC: return 6;
+        case VehiclePropertyType::BYTES: return 7;
+        default: return -1;
+    }
+}
+
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainRecylable(
         VehiclePropertyType type, size_t vecSize) {
-    // VehiclePropertyType is not overlapping with vectorSize.
-    int32_t key = static_cast<int32_t>(type)
-                  | static_cast<int32_t>(vecSize);
-
-    std::lock_guard<std::mutex> g(mLock);
-    auto it = mValueTypePools.find(key);
+    int32_t typeIndex = getRecyclableTypeIndex(type);
+    if (typeIndex < 0) {
+        return obtainDisposable(type, vecSize);
+    }
 
-    if (it == mValueTypePools.end()) {
-        auto newPool(std::make_unique<InternalPool>(type, vecSize));
-        it = mValueTypePools.emplace(key, std::move(newPool)).first;
+    auto& slot = mValueTypePools[typeIndex * (mMaxRecyclableVectorSize + 1) + vecSize];
+    InternalPool* pool = slot.load(std::memory_order_acquire);
+    if (pool == nullptr) {
+        std::lock_guard<std::mutex> g(mLock);
+        pool = slot.load(std::memory_order_relaxed);
+        if (pool == nullptr) {
+            pool = new InternalPool(type, vecSize);
+            slot.store(pool, std::memory_order_release);
+        }
     }
-    return it->second->obtain();
+    return pool->obtain();
 }
 
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainBoolean(
@@ -153,6 +173,34 @@ VehiclePropValue* VehiclePropValuePool::InternalPool::createObject() {
     return createVehiclePropValue(mPropType, mVectorSize).release();
 }
 
+void VehiclePropValueArena::appendShallowCopy(const VehiclePropValue& src) {
+    shallowCopy(&nextSlot(), src);
+}
+
+void VehiclePropValueArena::appendDeepCopy(const VehiclePropValue& src) {
+    PoolStats::instance()->ArenaBuffersAllocated += copyVehiclePropValue(&nextSlot(), src);
+}
+
+void VehiclePropValueArena::replaceWithDeepCopy(size_t i, const VehiclePropValue& src) {
+    PoolStats::instance()->ArenaBuffersAllocated += copyVehiclePropValue(&mSlots[i], src);
+}
+
+hidl_vec<VehiclePropValue> VehiclePropValueArena::toHidlVec() {
+    hidl_vec<VehiclePropValue> vec;
+    if (mSize > 0) {
+        vec.setToExternal(mSlots.data(), mSize);
+    }
+    return vec;
+}
+
+VehiclePropValue& VehiclePropValueArena::nextSlot() {
+    if (mSize == mSlots.size()) {
+        INC_METRIC_IF_DEBUG(ArenaSlotsCreated)
+        mSlots.emplace_back();
+    }
+    return mSlots[mSize++];
+}
+
 }  // namespace V2_0
 }  // namespace vehicle
 }  // namespace automotive
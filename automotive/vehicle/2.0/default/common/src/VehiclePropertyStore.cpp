@@ -16,6 +16,15 @@
 #define LOG_TAG "VehiclePropertyStore"
 #include <log/log.h>
 
+#include <algorithm>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <common/include/vhal_v2_0/VehicleUtils.h>
 #include "VehiclePropertyStore.h"
 
@@ -25,6 +34,109 @@ namespace automotive {
 namespace vehicle {
 namespace V2_0 {
 
+namespace {
+
+/* Snapshot files are a SnapshotHeader followed by count records, each a SnapshotRecordHeader
+ * followed by the int32, float, int64, byte and string values of the VehiclePropValue. Fields are
+ * in host byte order, as a snapshot is only ever read back on the device that wrote it. */
+constexpr uint32_t kSnapshotMagic = 0x53504856;  // "VHPS"
+constexpr uint32_t kSnapshotVersion = 1;
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct SnapshotRecordHeader {
+    int32_t prop;
+    int32_t areaId;
+    int64_t timestamp;
+    int32_t status;
+    uint32_t int32Count;
+    uint32_t floatCount;
+    uint32_t int64Count;
+    uint32_t bytesCount;
+    uint32_t stringLength;
+};
+
+template <typename T>
+void appendToSnapshot(std::vector<uint8_t>* out, const T* data, size_t count) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    out->insert(out->end(), bytes, bytes + count * sizeof(T));
+}
+
+class SnapshotReader {
+public:
+    SnapshotReader(const uint8_t* data, size_t size) : mData(data), mSize(size) {}
+
+    template <typename T>
+    bool read(T* out, size_t count = 1) {
+        if (count > (mSize - mOffset) / sizeof(T)) return false;
+        if (count == 0) return true;
+        memcpy(out, mData + mOffset, count * sizeof(T));
+        mOffset += count * sizeof(T);
+        return true;
+    }
+
+    bool atEnd() const { return mOffset == mSize; }
+
+private:
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mOffset = 0;
+};
+
+bool parseSnapshot(const uint8_t* data, size_t size, std::vector<VehiclePropValue>* outValues) {
+    SnapshotReader reader(data, size);
+    SnapshotHeader header;
+    if (!reader.read(&header) || header.magic != kSnapshotMagic ||
+        header.version != kSnapshotVersion) {
+        return false;
+    }
+
+    // Every record takes at least its header, so a corrupt count cannot make us reserve much.
+    outValues->reserve(std::min<size_t>(header.count, size / sizeof(SnapshotRecordHeader)));
+    for (uint32_t i = 0; i < header.count; i++) {
+        SnapshotRecordHeader record;
+        if (!reader.read(&record)) return false;
+
+        VehiclePropValue value;
+        value.prop = record.prop;
+        value.areaId = record.areaId;
+        value.timestamp = record.timestamp;
+        value.status = static_cast<VehiclePropertyStatus>(record.status);
+        std::string stringValue(record.stringLength, '\0');
+        value.value.int32Values.resize(record.int32Count);
+        value.value.floatValues.resize(record.floatCount);
+        value.value.int64Values.resize(record.int64Count);
+        value.value.bytes.resize(record.bytesCount);
+        if (!reader.read(value.value.int32Values.data(), record.int32Count) ||
+            !reader.read(value.value.floatValues.data(), record.floatCount) ||
+            !reader.read(value.value.int64Values.data(), record.int64Count) ||
+            !reader.read(value.value.bytes.data(), record.bytesCount) ||
+            !reader.read(&stringValue[0], record.stringLength)) {
+            return false;
+        }
+        value.value.stringValue = stringValue;
+        outValues->push_back(std::move(value));
+    }
+    return reader.atEnd();
+}
+
+bool writeFully(int fd, const std::vector<uint8_t>& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = TEMP_FAILURE_RETRY(write(fd, data.data() + written, data.size() - written));
+        if (n <= 0) return false;
+        written += n;
+    }
+    return true;
+}
+
+}  // namespace
+
 bool VehiclePropertyStore::RecordId::operator==(const VehiclePropertyStore::RecordId& other) const {
     return prop == other.prop && area == other.area && token == other.token;
 }
@@ -35,34 +147,70 @@ bool VehiclePropertyStore::RecordId::operator<(const VehiclePropertyStore::Recor
            || (prop == other.prop && area == other.area && token < other.token);
 }
 
+VehiclePropertyStore::VehiclePropertyStore(Mode mode)
+    : mMode(mode), mShards(std::make_shared<const ShardMap>()) {}
+
 void VehiclePropertyStore::registerProperty(const VehiclePropConfig& config,
                                             VehiclePropertyStore::TokenFunction tokenFunc) {
     MuxGuard g(mLock);
+    if (mMode == Mode::CONCURRENT) {
+        auto current = std::atomic_load(&mShards);
+        if (current->count(config.prop)) return;
+
+        auto shard = std::make_shared<PropertyShard>();
+        shard->config = RecordConfig { config, tokenFunc };
+        shard->values = std::make_shared<const PropertyMap>();
+
+        auto updated = std::make_shared<ShardMap>(*current);
+        updated->insert({ config.prop, std::move(shard) });
+        std::atomic_store(&mShards, std::shared_ptr<const ShardMap>(std::move(updated)));
+        return;
+    }
     mConfigs.insert({ config.prop, RecordConfig { config, tokenFunc } });
 }
 
 bool VehiclePropertyStore::writeValue(const VehiclePropValue& propValue,
                                         bool updateStatus) {
+    if (mMode == Mode::CONCURRENT) return writeValueConcurrent(propValue, updateStatus);
+
     MuxGuard g(mLock);
+    RecordId recId;
+    return writeValueLocked(propValue, updateStatus, &recId);
+}
+
+bool VehiclePropertyStore::writeValueLocked(const VehiclePropValue& propValue, bool updateStatus,
+                                            RecordId* outRecId) {
     if (!mConfigs.count(propValue.prop)) return false;
 
     RecordId recId = getRecordIdLocked(propValue);
     VehiclePropValue* valueToUpdate = const_cast<VehiclePropValue*>(getValueOrNullLocked(recId));
     if (valueToUpdate == nullptr) {
-        mPropertyValues.insert({ recId, propValue });
+        if (isFlatIndexedLocked(recId)) {
+            mFlatValues.insert(recId.prop, recId.area, propValue);
+        } else {
+            mPropertyValues.insert({ recId, propValue });
+        }
     } else {
         valueToUpdate->timestamp = propValue.timestamp;
-        valueToUpdate->value = propValue.value;
+        copyVehicleRawValue(&valueToUpdate->value, propValue.value);
         if (updateStatus) {
             valueToUpdate->status = propValue.status;
         }
     }
+    *outRecId = recId;
     return true;
 }
 
 void VehiclePropertyStore::removeValue(const VehiclePropValue& propValue) {
+    if (mMode == Mode::CONCURRENT) {
+        removeValueConcurrent(propValue);
+        return;
+    }
+
     MuxGuard g(mLock);
     RecordId recId = getRecordIdLocked(propValue);
+    if (isFlatIndexedLocked(recId) && mFlatValues.erase(recId.prop, recId.area)) return;
+
     auto it = mPropertyValues.find(recId);
     if (it != mPropertyValues.end()) {
         mPropertyValues.erase(it);
@@ -70,15 +218,28 @@ void VehiclePropertyStore::removeValue(const VehiclePropValue& propValue) {
 }
 
 void VehiclePropertyStore::removeValuesForProperty(int32_t propId) {
+    if (mMode == Mode::CONCURRENT) {
+        removeValuesForPropertyConcurrent(propId);
+        return;
+    }
+
     MuxGuard g(mLock);
+    if (mMode == Mode::FLAT_INDEX) {
+        mFlatValues.eraseProperty(propId);
+    }
     auto range = findRangeLocked(propId);
     mPropertyValues.erase(range.first, range.second);
 }
 
 std::vector<VehiclePropValue> VehiclePropertyStore::readAllValues() const {
+    if (mMode == Mode::CONCURRENT) return readAllValuesConcurrent();
+
     MuxGuard g(mLock);
     std::vector<VehiclePropValue> allValues;
-    allValues.reserve(mPropertyValues.size());
+    allValues.reserve(mPropertyValues.size() + mFlatValues.size());
+    mFlatValues.forEachValue([&allValues] (const VehiclePropValue& value) {
+        allValues.push_back(value);
+    });
     for (auto&& it : mPropertyValues) {
         allValues.push_back(it.second);
     }
@@ -86,8 +247,13 @@ std::vector<VehiclePropValue> VehiclePropertyStore::readAllValues() const {
 }
 
 std::vector<VehiclePropValue> VehiclePropertyStore::readValuesForProperty(int32_t propId) const {
+    if (mMode == Mode::CONCURRENT) return readValuesForPropertyConcurrent(propId);
+
     std::vector<VehiclePropValue> values;
     MuxGuard g(mLock);
+    mFlatValues.forEachValueOfProperty(propId, [&values] (const VehiclePropValue& value) {
+        values.push_back(value);
+    });
     auto range = findRangeLocked(propId);
     for (auto it = range.first; it != range.second; ++it) {
         values.push_back(it->second);
@@ -98,6 +264,12 @@ std::vector<VehiclePropValue> VehiclePropertyStore::readValuesForProperty(int32_
 
 std::unique_ptr<VehiclePropValue> VehiclePropertyStore::readValueOrNull(
         const VehiclePropValue& request) const {
+    if (mMode == Mode::CONCURRENT) {
+        auto shard = getShardOrNull(request.prop);
+        return shard ? readValueOrNullConcurrent(*shard, getRecordId(shard->config, request))
+                     : nullptr;
+    }
+
     MuxGuard g(mLock);
     RecordId recId = getRecordIdLocked(request);
     const VehiclePropValue* internalValue = getValueOrNullLocked(recId);
@@ -107,6 +279,11 @@ std::unique_ptr<VehiclePropValue> VehiclePropertyStore::readValueOrNull(
 std::unique_ptr<VehiclePropValue> VehiclePropertyStore::readValueOrNull(
         int32_t prop, int32_t area, int64_t token) const {
     RecordId recId = {prop, isGlobalProp(prop) ? 0 : area, token };
+    if (mMode == Mode::CONCURRENT) {
+        auto shard = getShardOrNull(prop);
+        return shard ? readValueOrNullConcurrent(*shard, recId) : nullptr;
+    }
+
     MuxGuard g(mLock);
     const VehiclePropValue* internalValue = getValueOrNullLocked(recId);
     return internalValue ? std::make_unique<VehiclePropValue>(*internalValue) : nullptr;
@@ -114,8 +291,17 @@ std::unique_ptr<VehiclePropValue> VehiclePropertyStore::readValueOrNull(
 
 
 std::vector<VehiclePropConfig> VehiclePropertyStore::getAllConfigs() const {
-    MuxGuard g(mLock);
     std::vector<VehiclePropConfig> configs;
+    if (mMode == Mode::CONCURRENT) {
+        auto shards = std::atomic_load(&mShards);
+        configs.reserve(shards->size());
+        for (auto&& shardIt : *shards) {
+            configs.push_back(shardIt.second->config.propConfig);
+        }
+        return configs;
+    }
+
+    MuxGuard g(mLock);
     configs.reserve(mConfigs.size());
     for (auto&& recordConfigIt: mConfigs) {
         configs.push_back(recordConfigIt.second.propConfig);
@@ -124,6 +310,12 @@ std::vector<VehiclePropConfig> VehiclePropertyStore::getAllConfigs() const {
 }
 
 const VehiclePropConfig* VehiclePropertyStore::getConfigOrNull(int32_t propId) const {
+    if (mMode == Mode::CONCURRENT) {
+        // Shards are never removed, so the pointer remains valid for the lifetime of the store.
+        auto shard = getShardOrNull(propId);
+        return shard ? &shard->config.propConfig : nullptr;
+    }
+
     MuxGuard g(mLock);
     auto recordConfigIt = mConfigs.find(propId);
     return recordConfigIt != mConfigs.end() ? &recordConfigIt->second.propConfig : nullptr;
@@ -138,25 +330,147 @@ const VehiclePropConfig* VehiclePropertyStore::getConfigOrDie(int32_t propId) co
     return cfg;
 }
 
+bool VehiclePropertyStore::saveSnapshot(const std::string& path) const {
+    std::vector<VehiclePropValue> values = readAllValues();
+
+    std::vector<uint8_t> buffer;
+    SnapshotHeader header { kSnapshotMagic, kSnapshotVersion,
+                            static_cast<uint32_t>(values.size()), 0 };
+    appendToSnapshot(&buffer, &header, 1);
+    for (auto&& value : values) {
+        const auto& raw = value.value;
+        SnapshotRecordHeader record {
+            value.prop, value.areaId, value.timestamp, toInt(value.status),
+            static_cast<uint32_t>(raw.int32Values.size()),
+            static_cast<uint32_t>(raw.floatValues.size()),
+            static_cast<uint32_t>(raw.int64Values.size()),
+            static_cast<uint32_t>(raw.bytes.size()),
+            static_cast<uint32_t>(raw.stringValue.size()),
+        };
+        appendToSnapshot(&buffer, &record, 1);
+        appendToSnapshot(&buffer, raw.int32Values.data(), raw.int32Values.size());
+        appendToSnapshot(&buffer, raw.floatValues.data(), raw.floatValues.size());
+        appendToSnapshot(&buffer, raw.int64Values.data(), raw.int64Values.size());
+        appendToSnapshot(&buffer, raw.bytes.data(), raw.bytes.size());
+        appendToSnapshot(&buffer, raw.stringValue.c_str(), raw.stringValue.size());
+    }
+
+    // Written aside and renamed, so that a crash never leaves a truncated snapshot behind.
+    std::string tmpPath = path + ".tmp";
+    int fd = TEMP_FAILURE_RETRY(open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                     0600));
+    if (fd < 0) {
+        ALOGE("%s: failed to open %s: %s", __func__, tmpPath.c_str(), strerror(errno));
+        return false;
+    }
+    bool written = writeFully(fd, buffer) && fsync(fd) == 0;
+    close(fd);
+    if (!written || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        ALOGE("%s: failed to write %s: %s", __func__, path.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+size_t VehiclePropertyStore::restoreSnapshot(const std::string& path,
+                                             const std::unordered_set<int32_t>& allowedProps) {
+    int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            ALOGW("%s: failed to open %s: %s", __func__, path.c_str(), strerror(errno));
+        }
+        return 0;
+    }
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        ALOGW("%s: failed to map %s", __func__, path.c_str());
+        return 0;
+    }
+
+    std::vector<VehiclePropValue> values;
+    bool valid = parseSnapshot(static_cast<const uint8_t*>(data), st.st_size, &values);
+    munmap(data, st.st_size);
+    if (!valid) {
+        ALOGW("%s: ignoring invalid snapshot %s", __func__, path.c_str());
+        return 0;
+    }
+
+    values.erase(std::remove_if(values.begin(), values.end(),
+                                [&allowedProps](const VehiclePropValue& value) {
+                                    return allowedProps.count(value.prop) == 0;
+                                }),
+                 values.end());
+    return writeValuesBulk(values);
+}
+
+size_t VehiclePropertyStore::writeValuesBulk(const std::vector<VehiclePropValue>& values) {
+    size_t written = 0;
+    if (mMode != Mode::CONCURRENT) {
+        MuxGuard g(mLock);
+        for (auto&& value : values) {
+            RecordId recId;
+            if (writeValueLocked(value, true /* updateStatus */, &recId)) {
+                written++;
+            }
+        }
+        return written;
+    }
+
+    // Publish one new snapshot per property rather than one per value.
+    std::map<int32_t, std::vector<const VehiclePropValue*>> valuesByProp;
+    for (auto&& value : values) {
+        valuesByProp[value.prop].push_back(&value);
+    }
+    for (auto&& propIt : valuesByProp) {
+        auto shard = getShardOrNull(propIt.first);
+        if (shard == nullptr) continue;
+
+        MuxGuard g(shard->writeLock);
+        auto updated = std::make_shared<PropertyMap>(*getValuesSnapshot(*shard));
+        for (const VehiclePropValue* value : propIt.second) {
+            RecordId recId = getRecordId(shard->config, *value);
+            (*updated)[recId] = *value;
+            written++;
+        }
+        std::atomic_store(&shard->values, std::shared_ptr<const PropertyMap>(std::move(updated)));
+    }
+    return written;
+}
+
 VehiclePropertyStore::RecordId VehiclePropertyStore::getRecordIdLocked(
         const VehiclePropValue& valuePrototype) const {
+    auto it = mConfigs.find(valuePrototype.prop);
+    if (it == mConfigs.end()) return {};
+
+    return getRecordId(it->second, valuePrototype);
+}
+
+VehiclePropertyStore::RecordId VehiclePropertyStore::getRecordId(
+        const RecordConfig& config, const VehiclePropValue& valuePrototype) {
     RecordId recId = {
         .prop = valuePrototype.prop,
         .area = isGlobalProp(valuePrototype.prop) ? 0 : valuePrototype.areaId,
         .token = 0
     };
 
-    auto it = mConfigs.find(recId.prop);
-    if (it == mConfigs.end()) return {};
-
-    if (it->second.tokenFunction != nullptr) {
-        recId.token = it->second.tokenFunction(valuePrototype);
+    if (config.tokenFunction != nullptr) {
+        recId.token = config.tokenFunction(valuePrototype);
     }
     return recId;
 }
 
 const VehiclePropValue* VehiclePropertyStore::getValueOrNullLocked(
         const VehiclePropertyStore::RecordId& recId) const  {
+    if (isFlatIndexedLocked(recId)) {
+        const VehiclePropValue* value = mFlatValues.find(recId.prop, recId.area);
+        if (value != nullptr) return value;
+    }
     auto it = mPropertyValues.find(recId);
     return it == mPropertyValues.end() ? nullptr : &it->second;
 }
@@ -169,6 +483,101 @@ VehiclePropertyStore::PropertyMapRange VehiclePropertyStore::findRangeLocked(int
     return  PropertyMapRange { beginIt, endIt };
 }
 
+std::shared_ptr<VehiclePropertyStore::PropertyShard> VehiclePropertyStore::getShardOrNull(
+        int32_t propId) const {
+    auto shards = std::atomic_load(&mShards);
+    auto it = shards->find(propId);
+    return it == shards->end() ? nullptr : it->second;
+}
+
+std::shared_ptr<const VehiclePropertyStore::PropertyMap> VehiclePropertyStore::getValuesSnapshot(
+        const PropertyShard& shard) {
+    return std::atomic_load(&shard.values);
+}
+
+bool VehiclePropertyStore::writeValueConcurrent(const VehiclePropValue& propValue,
+                                                bool updateStatus) {
+    auto shard = getShardOrNull(propValue.prop);
+    if (shard == nullptr) return false;
+
+    RecordId recId = getRecordId(shard->config, propValue);
+
+    {
+        MuxGuard g(shard->writeLock);
+        // Readers may still hold the current snapshot, so modifications are made to a copy which
+        // is then published atomically.
+        auto updated = std::make_shared<PropertyMap>(*getValuesSnapshot(*shard));
+        auto it = updated->find(recId);
+        if (it == updated->end()) {
+            updated->insert({ recId, propValue });
+        } else {
+            it->second.timestamp = propValue.timestamp;
+            copyVehicleRawValue(&it->second.value, propValue.value);
+            if (updateStatus) {
+                it->second.status = propValue.status;
+            }
+        }
+        std::atomic_store(&shard->values, std::shared_ptr<const PropertyMap>(std::move(updated)));
+    }
+    return true;
+}
+
+void VehiclePropertyStore::removeValueConcurrent(const VehiclePropValue& propValue) {
+    auto shard = getShardOrNull(propValue.prop);
+    if (shard == nullptr) return;
+
+    RecordId recId = getRecordId(shard->config, propValue);
+
+    MuxGuard g(shard->writeLock);
+    auto current = getValuesSnapshot(*shard);
+    if (!current->count(recId)) return;
+
+    auto updated = std::make_shared<PropertyMap>(*current);
+    updated->erase(recId);
+    std::atomic_store(&shard->values, std::shared_ptr<const PropertyMap>(std::move(updated)));
+}
+
+void VehiclePropertyStore::removeValuesForPropertyConcurrent(int32_t propId) {
+    auto shard = getShardOrNull(propId);
+    if (shard == nullptr) return;
+
+    MuxGuard g(shard->writeLock);
+    std::atomic_store(&shard->values, std::make_shared<const PropertyMap>());
+}
+
+std::vector<VehiclePropValue> VehiclePropertyStore::readAllValuesConcurrent() const {
+    std::vector<VehiclePropValue> allValues;
+    auto shards = std::atomic_load(&mShards);
+    for (auto&& shardIt : *shards) {
+        auto values = getValuesSnapshot(*shardIt.second);
+        for (auto&& it : *values) {
+            allValues.push_back(it.second);
+        }
+    }
+    return allValues;
+}
+
+std::vector<VehiclePropValue> VehiclePropertyStore::readValuesForPropertyConcurrent(
+        int32_t propId) const {
+    std::vector<VehiclePropValue> values;
+    auto shard = getShardOrNull(propId);
+    if (shard == nullptr) return values;
+
+    auto snapshot = getValuesSnapshot(*shard);
+    values.reserve(snapshot->size());
+    for (auto&& it : *snapshot) {
+        values.push_back(it.second);
+    }
+    return values;
+}
+
+std::unique_ptr<VehiclePropValue> VehiclePropertyStore::readValueOrNullConcurrent(
+        const PropertyShard& shard, const RecordId& recId) {
+    auto snapshot = getValuesSnapshot(shard);
+    auto it = snapshot->find(recId);
+    return it == snapshot->end() ? nullptr : std::make_unique<VehiclePropValue>(it->second);
+}
+
 }  // namespace V2_0
 }  // namespace vehicle
 }  // namespace automotive
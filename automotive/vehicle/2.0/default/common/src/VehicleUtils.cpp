@@ -79,19 +79,36 @@ size_t getVehicleRawValueVectorSize(
 }
 
 template<typename T>
-inline void copyHidlVec(hidl_vec <T>* dest, const hidl_vec <T>& src) {
-    for (size_t i = 0; i < std::min(dest->size(), src.size()); i++) {
-        (*dest)[i] = src[i];
+inline size_t copyHidlVecReusingBuffer(hidl_vec<T>* dest, const hidl_vec<T>& src) {
+    if (dest->size() == src.size()) {
+        for (size_t i = 0; i < src.size(); i++) {
+            (*dest)[i] = src[i];
+        }
+        return 0;
     }
+    *dest = src;
+    return src.size() > 0 ? 1 : 0;
 }
 
-void copyVehicleRawValue(VehiclePropValue::RawValue* dest,
-                         const VehiclePropValue::RawValue& src) {
-    dest->int32Values = src.int32Values;
-    dest->floatValues = src.floatValues;
-    dest->int64Values = src.int64Values;
-    dest->bytes = src.bytes;
-    dest->stringValue = src.stringValue;
+size_t copyVehicleRawValue(VehiclePropValue::RawValue* dest,
+                           const VehiclePropValue::RawValue& src) {
+    size_t allocated = copyHidlVecReusingBuffer(&dest->int32Values, src.int32Values) +
+                       copyHidlVecReusingBuffer(&dest->floatValues, src.floatValues) +
+                       copyHidlVecReusingBuffer(&dest->int64Values, src.int64Values) +
+                       copyHidlVecReusingBuffer(&dest->bytes, src.bytes);
+    if (dest->stringValue != src.stringValue) {
+        dest->stringValue = src.stringValue;
+        allocated += src.stringValue.empty() ? 0 : 1;
+    }
+    return allocated;
+}
+
+size_t copyVehiclePropValue(VehiclePropValue* dest, const VehiclePropValue& src) {
+    dest->prop = src.prop;
+    dest->areaId = src.areaId;
+    dest->status = src.status;
+    dest->timestamp = src.timestamp;
+    return copyVehicleRawValue(&dest->value, src.value);
 }
 
 template<typename T>
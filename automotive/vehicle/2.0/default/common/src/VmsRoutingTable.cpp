@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "VmsRoutingTable.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace vms {
+
+size_t VmsRoutingTable::LayerPublisherHash::operator()(
+        const VmsLayerAndPublisher& layer_publisher) const {
+    return VmsLayer::VmsLayerHashFunction()(layer_publisher.layer) * 31 +
+           std::hash<int>()(layer_publisher.publisher_id);
+}
+
+bool VmsRoutingTable::update(const VehiclePropValue& subscriptions_state) {
+    VmsSubscriptionsStateView state;
+    if (!state.parse(subscriptions_state) || state.getSequenceNumber() <= mSequenceNumber) {
+        return false;
+    }
+
+    // Subscription states are snapshots, clearing the sets keeps their bucket arrays so applying
+    // a state of a similar size doesn't rehash.
+    mLayers.clear();
+    mLayerPublishers.clear();
+    for (size_t i = 0; i < state.getLayerCount(); i++) {
+        mLayers.insert(state.getLayer(i));
+    }
+    state.forEachAssociatedLayer([this](const VmsLayer& layer, const int32_t* publisher_ids,
+                                        size_t publisher_id_count) {
+        for (size_t i = 0; i < publisher_id_count; i++) {
+            mLayerPublishers.insert(VmsLayerAndPublisher(layer, publisher_ids[i]));
+        }
+    });
+    mSequenceNumber = state.getSequenceNumber();
+    return true;
+}
+
+bool VmsRoutingTable::isSubscribed(const VmsLayerAndPublisher& layer_publisher) const {
+    return mLayers.count(layer_publisher.layer) != 0 ||
+           mLayerPublishers.count(layer_publisher) != 0;
+}
+
+bool VmsRoutingTable::shouldRoute(const VehiclePropValue& data_message) const {
+    VmsDataView data_view;
+    if (!parseDataView(data_message, &data_view)) {
+        return false;
+    }
+    return mSequenceNumber < 0 || isSubscribed(data_view.layer_publisher);
+}
+
+void VmsRoutingTable::reset() {
+    mSequenceNumber = -1;
+    mLayers.clear();
+    mLayerPublishers.clear();
+}
+
+}  // namespace vms
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -16,6 +16,8 @@
 
 #include "VmsUtils.h"
 
+#include <string.h>
+
 #include <common/include/vhal_v2_0/VehicleUtils.h>
 
 namespace android {
@@ -132,7 +134,8 @@ std::unique_ptr<VehiclePropValue> createDataMessageWithLayerPublisherInfo(
     result->value.int32Values = hidl_vec<int32_t>{
             toInt(VmsMessageType::DATA), layer_publisher.layer.type, layer_publisher.layer.subtype,
             layer_publisher.layer.version, layer_publisher.publisher_id};
-    result->value.bytes = std::vector<uint8_t>(vms_packet.begin(), vms_packet.end());
+    result->value.bytes.resize(vms_packet.size());
+    memcpy(result->value.bytes.data(), vms_packet.data(), vms_packet.size());
     return result;
 }
 
@@ -214,51 +217,36 @@ int32_t getSequenceNumberForSubscriptionsState(const VehiclePropValue& subscript
 
 std::vector<VmsLayer> getSubscribedLayers(const VehiclePropValue& subscription_change,
                                           const VmsOffers& offers) {
+    VmsSubscriptionsStateView state;
     if (isValidVmsMessage(subscription_change) &&
         parseMessageType(subscription_change) == VmsMessageType::SUBSCRIPTIONS_CHANGE &&
-        subscription_change.value.int32Values.size() > kSubscriptionStateSequenceNumberIndex) {
-        const int32_t num_of_layers = subscription_change.value.int32Values[toInt(
-                VmsSubscriptionsStateIntegerValuesIndex::NUMBER_OF_LAYERS)];
-        const int32_t num_of_associated_layers = subscription_change.value.int32Values[toInt(
-                VmsSubscriptionsStateIntegerValuesIndex ::NUMBER_OF_ASSOCIATED_LAYERS)];
-
+        state.parse(subscription_change)) {
         std::unordered_set<VmsLayer, VmsLayer::VmsLayerHashFunction> offered_layers;
         for (const auto& offer : offers.offerings) {
             offered_layers.insert(offer.layer);
         }
         std::vector<VmsLayer> subscribed_layers;
 
-        int current_index = toInt(VmsSubscriptionsStateIntegerValuesIndex::SUBSCRIPTIONS_START);
         // Add all subscribed layers which are offered by the current publisher.
-        for (int i = 0; i < num_of_layers; i++) {
-            VmsLayer layer = VmsLayer(subscription_change.value.int32Values[current_index],
-                                      subscription_change.value.int32Values[current_index + 1],
-                                      subscription_change.value.int32Values[current_index + 2]);
+        for (size_t i = 0; i < state.getLayerCount(); i++) {
+            VmsLayer layer = state.getLayer(i);
             if (offered_layers.find(layer) != offered_layers.end()) {
                 subscribed_layers.push_back(layer);
             }
-            current_index += kLayerSize;
         }
         // Add all subscribed associated layers which are offered by the current publisher.
         // For this, we need to check if the associated layer has a publisher ID which is
         // same as that of the current publisher.
-        for (int i = 0; i < num_of_associated_layers; i++) {
-            VmsLayer layer = VmsLayer(subscription_change.value.int32Values[current_index],
-                                      subscription_change.value.int32Values[current_index + 1],
-                                      subscription_change.value.int32Values[current_index + 2]);
-            current_index += kLayerSize;
+        state.forEachAssociatedLayer([&](const VmsLayer& layer, const int32_t* publisher_ids,
+                                         size_t publisher_id_count) {
             if (offered_layers.find(layer) != offered_layers.end()) {
-                int32_t num_of_publisher_ids = subscription_change.value.int32Values[current_index];
-                current_index++;
-                for (int j = 0; j < num_of_publisher_ids; j++) {
-                    if (subscription_change.value.int32Values[current_index] ==
-                        offers.publisher_id) {
+                for (size_t j = 0; j < publisher_id_count; j++) {
+                    if (publisher_ids[j] == offers.publisher_id) {
                         subscribed_layers.push_back(layer);
                     }
-                    current_index++;
                 }
             }
-        }
+        });
         return subscribed_layers;
     }
     return {};
@@ -297,6 +285,115 @@ VmsSessionStatus parseStartSessionMessage(const VehiclePropValue& start_session,
     return VmsSessionStatus::kInvalidMessage;
 }
 
+bool parseDataView(const VehiclePropValue& value, VmsDataView* data_view) {
+    if (!isValidVmsMessage(value) || parseMessageType(value) != VmsMessageType::DATA ||
+        value.value.int32Values.size() < kMessageTypeSize + kLayerAndPublisherSize) {
+        return false;
+    }
+    const auto& header = value.value.int32Values;
+    data_view->layer_publisher =
+            VmsLayerAndPublisher(VmsLayer(header[1], header[2], header[3]), header[4]);
+    data_view->data = value.value.bytes.data();
+    data_view->size = value.value.bytes.size();
+    return true;
+}
+
+bool VmsSubscriptionsStateView::parse(const VehiclePropValue& value) {
+    *this = VmsSubscriptionsStateView();
+    if (!isValidVmsMessage(value)) {
+        return false;
+    }
+    VmsMessageType type = parseMessageType(value);
+    if (type != VmsMessageType::SUBSCRIPTIONS_CHANGE &&
+        type != VmsMessageType::SUBSCRIPTIONS_RESPONSE) {
+        return false;
+    }
+
+    const auto& values = value.value.int32Values;
+    const size_t start = toInt(VmsSubscriptionsStateIntegerValuesIndex::SUBSCRIPTIONS_START);
+    if (values.size() < start) {
+        return false;
+    }
+    const int32_t layer_count =
+            values[toInt(VmsSubscriptionsStateIntegerValuesIndex::NUMBER_OF_LAYERS)];
+    const int32_t associated_layer_count =
+            values[toInt(VmsSubscriptionsStateIntegerValuesIndex::NUMBER_OF_ASSOCIATED_LAYERS)];
+    if (layer_count < 0 || associated_layer_count < 0) {
+        return false;
+    }
+
+    // Walk associated layers once to make sure every publisher ID list is within bounds.
+    size_t current_index = start + static_cast<size_t>(layer_count) * kLayerSize;
+    const size_t associated_layers_index = current_index;
+    for (int32_t i = 0; i < associated_layer_count; i++) {
+        if (current_index + kLayerSize + kLayerNumberSize > values.size() ||
+            values[current_index + kLayerSize] < 0) {
+            return false;
+        }
+        current_index += kLayerSize + kLayerNumberSize + values[current_index + kLayerSize];
+    }
+    if (current_index > values.size()) {
+        return false;
+    }
+
+    mSequenceNumber = values[kSubscriptionStateSequenceNumberIndex];
+    mLayerCount = layer_count;
+    mLayers = values.data() + start;
+    mAssociatedLayerCount = associated_layer_count;
+    mAssociatedLayers = values.data() + associated_layers_index;
+    return true;
+}
+
+VmsLayer VmsSubscriptionsStateView::getLayer(size_t index) const {
+    const int32_t* layer = mLayers + index * kLayerSize;
+    return VmsLayer(layer[0], layer[1], layer[2]);
+}
+
+recyclable_ptr<VehiclePropValue> VmsDataMessageBuilder::build(
+        const VmsLayerAndPublisher& layer_publisher, const uint8_t* data, size_t size) {
+    auto message = mPool.obtain();
+    auto& header = message->value.int32Values;
+    header[0] = toInt(VmsMessageType::DATA);
+    header[1] = layer_publisher.layer.type;
+    header[2] = layer_publisher.layer.subtype;
+    header[3] = layer_publisher.layer.version;
+    header[4] = layer_publisher.publisher_id;
+
+    auto& bytes = message->value.bytes;
+    if (bytes.size() != size) {
+        bytes.resize(size);
+    }
+    if (size > 0) {
+        memcpy(bytes.data(), data, size);
+    }
+    return message;
+}
+
+recyclable_ptr<VehiclePropValue> VmsDataMessageBuilder::build(
+        const VmsLayerAndPublisher& layer_publisher, const std::string& vms_packet) {
+    return build(layer_publisher, reinterpret_cast<const uint8_t*>(vms_packet.data()),
+                 vms_packet.size());
+}
+
+VehiclePropValue* VmsDataMessageBuilder::MessagePool::createObject() {
+    return createBaseVmsMessage(kMessageTypeSize + kLayerAndPublisherSize).release();
+}
+
+void VmsDataMessageBuilder::MessagePool::recycle(VehiclePropValue* o) {
+    // Users may have modified the message, only keep messages that still have the DATA layout.
+    if (o->prop != toInt(VehicleProperty::VEHICLE_MAP_SERVICE) ||
+        o->value.int32Values.size() != kMessageTypeSize + kLayerAndPublisherSize ||
+        o->value.int64Values.size() != 0 || o->value.floatValues.size() != 0 ||
+        o->value.stringValue.size() != 0) {
+        delete o;
+        return;
+    }
+    o->areaId = toInt(VehicleArea::GLOBAL);
+    o->timestamp = 0;
+    o->status = VehiclePropertyStatus::AVAILABLE;
+    ObjectPool<VehiclePropValue>::recycle(o);
+}
+
 }  // namespace vms
 }  // namespace V2_0
 }  // namespace vehicle
@@ -42,28 +42,38 @@ void CommConn::stop() {
 }
 
 void CommConn::sendMessage(emulator::EmulatorMessage const& msg) {
+    std::lock_guard<std::mutex> lock(mTxLock);
     int numBytes = msg.ByteSize();
-    std::vector<uint8_t> buffer(static_cast<size_t>(numBytes));
-    if (!msg.SerializeToArray(buffer.data(), numBytes)) {
+    if (mTxBuffer.size() < static_cast<size_t>(numBytes)) {
+        mTxBuffer.resize(static_cast<size_t>(numBytes));
+    }
+    if (!msg.SerializeToArray(mTxBuffer.data(), numBytes)) {
         ALOGE("%s: SerializeToString failed!", __func__);
         return;
     }
 
-    write(buffer);
+    write(mTxBuffer.data(), static_cast<size_t>(numBytes));
+}
+
+void CommConn::sendSerialized(const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mTxLock);
+    write(data, size);
 }
 
 void CommConn::readThread() {
-    std::vector<uint8_t> buffer;
+    // Messages are reused, so protobuf keeps its allocations between iterations.
+    emulator::EmulatorMessage rxMsg;
+    emulator::EmulatorMessage respMsg;
     while (isOpen()) {
-        buffer = read();
-        if (buffer.size() == 0) {
+        size_t size = 0;
+        const uint8_t* data = read(&size);
+        if (data == nullptr) {
             ALOGI("%s: Read returned empty message, exiting read loop.", __func__);
             break;
         }
 
-        emulator::EmulatorMessage rxMsg;
-        if (rxMsg.ParseFromArray(buffer.data(), static_cast<int32_t>(buffer.size()))) {
-            emulator::EmulatorMessage respMsg;
+        if (rxMsg.ParseFromArray(data, static_cast<int32_t>(size))) {
+            respMsg.Clear();
             mMessageProcessor->processMessage(rxMsg, respMsg);
 
             sendMessage(respMsg);
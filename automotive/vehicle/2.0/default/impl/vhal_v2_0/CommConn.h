@@ -18,6 +18,7 @@
 #define android_hardware_automotive_vehicle_V2_0_impl_CommBase_H_
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -74,31 +75,44 @@ class CommConn {
     virtual bool isOpen() = 0;
 
     /**
-     * Blocking call to read data from the connection.
+     * Blocking call to read next message from the connection.
      *
-     * @return std::vector<uint8_t> Serialized protobuf data received from emulator.  This will be
-     *              an empty vector if the connection was closed or some other error occurred.
+     * @param outSize Size of serialized protobuf message received from emulator.
+     *
+     * @return const uint8_t* Message data owned by the connection, valid until the next call to
+     *              read(). This will be nullptr if the connection was closed or some other error
+     *              occurred.
      */
-    virtual std::vector<uint8_t> read() = 0;
+    virtual const uint8_t* read(size_t* outSize) = 0;
 
     /**
-     * Transmits a string of data to the emulator.
+     * Transmits a single message frame to the emulator.
      *
      * @param data Serialized protobuf data to transmit.
+     * @param size Size of the data.
      *
      * @return int Number of bytes transmitted, or -1 if failed.
      */
-    virtual int write(const std::vector<uint8_t>& data) = 0;
+    virtual int write(const uint8_t* data, size_t size) = 0;
 
     /**
      * Serialized and send the given message to the other side.
      */
     void sendMessage(emulator::EmulatorMessage const& msg);
 
+    /**
+     * Sends already serialized message, used to serialize once when broadcasting.
+     */
+    void sendSerialized(const uint8_t* data, size_t size);
+
    protected:
     std::unique_ptr<std::thread> mReadThread;
     MessageProcessor* mMessageProcessor;
 
+    // Read thread replies while HAL sends property updates, frames must not interleave.
+    std::mutex mTxLock;
+    std::vector<uint8_t> mTxBuffer;  // Grow-only, guarded by mTxLock.
+
     /**
      * A thread that reads messages in a loop, and responds. You can stop this thread by calling
      * stop().
@@ -122,6 +122,8 @@ enum class FakeDataCommand : int32_t {
      * Caller must provide additional data:
      *     int32Values[1] - number of iterations. If it is not provided or -1. The iteration will be
      *                      repeated infinite times.
+     *     floatValues[0] - time compression, e.g. 10 replays the file 10 times faster than
+     *                      recorded. If it is not provided, events are replayed in real time.
      *     stringValue    - path to the fake values JSON file
      */
     StartJson = 2,
@@ -196,15 +198,6 @@ const ConfigDeclaration kVehicleProperties[]{
                  },
          .initialValue = {.int32Values = {1}}},
 
-        {.config =
-                 {
-                         .prop = toInt(VehicleProperty::INFO_DRIVER_SEAT),
-                         .access = VehiclePropertyAccess::READ,
-                         .changeMode = VehiclePropertyChangeMode::STATIC,
-                         .areaConfigs = {VehicleAreaConfig{.areaId = (0)}},
-                 },
-         .initialValue = {.int32Values = {SEAT_1_LEFT}}},
-
         {.config =
                  {
                          .prop = toInt(VehicleProperty::INFO_FUEL_DOOR_LOCATION),
@@ -17,6 +17,9 @@
 
 #include <android/log.h>
 #include <android-base/macros.h>
+#include <android-base/properties.h>
+
+#include <unordered_set>
 
 #include "EmulatedVehicleHal.h"
 #include "JsonFakeValueGenerator.h"
@@ -31,6 +34,36 @@ namespace V2_0 {
 
 namespace impl {
 
+// The property values are saved here when the AP shuts down or enters deep sleep, and restored
+// from here on the next boot, if persist.vendor.vehicle.snapshot is set.
+static const char* kPropertySnapshotPath = "/data/vendor/vehicle/properties.snapshot";
+
+static bool isPropertySnapshotEnabled() {
+    return android::base::GetBoolProperty("persist.vendor.vehicle.snapshot", false);
+}
+
+// Only the settings the user chose are restored from the snapshot. Power state, VMS and sensor
+// values describe the previous boot and must come from the vehicle again.
+static const std::unordered_set<int32_t> kSnapshotRestoredProperties {
+    toInt(VehicleProperty::HVAC_FAN_SPEED),
+    toInt(VehicleProperty::HVAC_FAN_DIRECTION),
+    toInt(VehicleProperty::HVAC_TEMPERATURE_SET),
+    toInt(VehicleProperty::HVAC_DEFROSTER),
+    toInt(VehicleProperty::HVAC_AC_ON),
+    toInt(VehicleProperty::HVAC_MAX_AC_ON),
+    toInt(VehicleProperty::HVAC_MAX_DEFROST_ON),
+    toInt(VehicleProperty::HVAC_RECIRC_ON),
+    toInt(VehicleProperty::HVAC_AUTO_RECIRC_ON),
+    toInt(VehicleProperty::HVAC_DUAL_ON),
+    toInt(VehicleProperty::HVAC_AUTO_ON),
+    toInt(VehicleProperty::HVAC_SEAT_TEMPERATURE),
+    toInt(VehicleProperty::HVAC_SEAT_VENTILATION),
+    toInt(VehicleProperty::HVAC_STEERING_WHEEL_HEAT),
+    toInt(VehicleProperty::HVAC_TEMPERATURE_DISPLAY_UNITS),
+    toInt(VehicleProperty::VEHICLE_SPEED_DISPLAY_UNITS),
+    toInt(VehicleProperty::DISPLAY_BRIGHTNESS),
+};
+
 static std::unique_ptr<Obd2SensorStore> fillDefaultObd2Frame(size_t numVendorIntegerSensors,
                                                              size_t numVendorFloatSensors) {
     std::unique_ptr<Obd2SensorStore> sensorStore(
@@ -89,15 +122,14 @@ static std::unique_ptr<Obd2SensorStore> fillDefaultObd2Frame(size_t numVendorInt
 
 EmulatedVehicleHal::EmulatedVehicleHal(VehiclePropertyStore* propStore)
     : mPropStore(propStore),
+      mStaticConfigIndex(buildStaticConfigIndex()),
       mHvacPowerProps(std::begin(kHvacPowerProperties), std::end(kHvacPowerProperties)),
       mRecurrentTimer(
-          std::bind(&EmulatedVehicleHal::onContinuousPropertyTimer, this, std::placeholders::_1)),
+          std::bind(&EmulatedVehicleHal::onContinuousPropertyTimer, this, std::placeholders::_1),
+          true /* useTimerFd */),
       mGeneratorHub(
           std::bind(&EmulatedVehicleHal::onFakeValueGenerated, this, std::placeholders::_1)) {
     initStaticConfig();
-    for (size_t i = 0; i < arraysize(kVehicleProperties); i++) {
-        mPropStore->registerProperty(kVehicleProperties[i].config);
-    }
 }
 
 VehicleHal::VehiclePropValuePtr EmulatedVehicleHal::get(
@@ -152,10 +184,19 @@ StatusCode EmulatedVehicleHal::set(const VehiclePropValue& propValue) {
         switch (propValue.prop) {
             case OBD2_FREEZE_FRAME_CLEAR:
                 return clearObd2FreezeFrames(propValue);
-            case VEHICLE_MAP_SERVICE:
+            case VEHICLE_MAP_SERVICE: {
                 // Placeholder for future implementation of VMS property in the default hal. For
-                // now, just returns OK; otherwise, hal clients crash with property not supported.
+                // now, only subscription states are tracked to drop data nobody subscribed to;
+                // otherwise, hal clients crash with property not supported.
+                std::lock_guard<std::mutex> g(mVmsLock);
+                if (vms::isValidVmsMessage(propValue) &&
+                    vms::parseMessageType(propValue) == VmsMessageType::START_SESSION) {
+                    mVmsRoutingTable.reset();
+                } else {
+                    mVmsRoutingTable.update(propValue);
+                }
                 return StatusCode::OK;
+            }
             case AP_POWER_STATE_REPORT:
                 switch (propValue.value.int32Values[0]) {
                     case toInt(VehicleApPowerStateReport::DEEP_SLEEP_EXIT):
@@ -166,6 +207,10 @@ StatusCode EmulatedVehicleHal::set(const VehiclePropValue& propValue) {
                         break;
                     case toInt(VehicleApPowerStateReport::DEEP_SLEEP_ENTRY):
                     case toInt(VehicleApPowerStateReport::SHUTDOWN_START):
+                        if (isPropertySnapshotEnabled() &&
+                            !mPropStore->saveSnapshot(kPropertySnapshotPath)) {
+                            ALOGW("%s: failed to save the property snapshot", __func__);
+                        }
                         // CPMS is in WAIT_FOR_FINISH state, send the FINISHED command
                         doHalEvent(createApPowerStateReq(VehicleApPowerStateReq::FINISHED, 0));
                         break;
@@ -269,6 +314,13 @@ void EmulatedVehicleHal::onCreate() {
     }
     initObd2LiveFrame(*mPropStore->getConfigOrDie(OBD2_LIVE_FRAME));
     initObd2FreezeFrame(*mPropStore->getConfigOrDie(OBD2_FREEZE_FRAME));
+
+    // Replace the default user settings with the ones of the last shutdown
+    if (isPropertySnapshotEnabled()) {
+        size_t restored = mPropStore->restoreSnapshot(kPropertySnapshotPath,
+                                                      kSnapshotRestoredProperties);
+        ALOGI("%s: restored %zu property values from the snapshot", __func__, restored);
+    }
 }
 
 std::vector<VehiclePropConfig> EmulatedVehicleHal::listProperties()  {
@@ -315,7 +367,7 @@ StatusCode EmulatedVehicleHal::unsubscribe(int32_t property) {
 }
 
 bool EmulatedVehicleHal::isContinuousProperty(int32_t propId) const {
-    const VehiclePropConfig* config = mPropStore->getConfigOrNull(propId);
+    const VehiclePropConfig* config = getStaticConfigOrNull(propId);
     if (config == nullptr) {
         ALOGW("Config not found for property: 0x%x", propId);
         return false;
@@ -333,6 +385,17 @@ bool EmulatedVehicleHal::setPropertyFromVehicle(const VehiclePropValue& propValu
         }
     }
 
+    if (vms::isValidVmsMessage(propValue)) {
+        VmsMessageType type = vms::parseMessageType(propValue);
+        std::lock_guard<std::mutex> g(mVmsLock);
+        if (type == VmsMessageType::START_SESSION) {
+            mVmsRoutingTable.reset();
+        } else if (type == VmsMessageType::DATA && !mVmsRoutingTable.shouldRoute(propValue)) {
+            // Nobody subscribed to the layer, no need to send the payload to Android.
+            return true;
+        }
+    }
+
     if (mPropStore->writeValue(propValue, shouldUpdateStatus)) {
         doHalEvent(getValuePool()->obtain(propValue));
         return true;
@@ -458,13 +521,35 @@ void EmulatedVehicleHal::onFakeValueGenerated(const VehiclePropValue& value) {
         updatedPropValue->timestamp = elapsedRealtimeNano();
         updatedPropValue->status = VehiclePropertyStatus::AVAILABLE;
         mPropStore->writeValue(*updatedPropValue, shouldUpdateStatus);
-        auto changeMode = mPropStore->getConfigOrDie(value.prop)->changeMode;
-        if (VehiclePropertyChangeMode::ON_CHANGE == changeMode) {
+        auto config = getStaticConfigOrNull(value.prop);
+        if (config == nullptr) {
+            ALOGW("%s: no config for generated property: 0x%x", __func__, value.prop);
+            return;
+        }
+        if (VehiclePropertyChangeMode::ON_CHANGE == config->changeMode) {
             doHalEvent(std::move(updatedPropValue));
         }
     }
 }
 
+const VehiclePropConfig* EmulatedVehicleHal::getStaticConfigOrNull(int32_t propId) const {
+    int index = mStaticConfigIndex.isValid() ? mStaticConfigIndex.indexOf(propId) : -1;
+    return index >= 0 ? &kVehicleProperties[index].config : mPropStore->getConfigOrNull(propId);
+}
+
+EmulatedVehicleHal::StaticConfigIndex EmulatedVehicleHal::buildStaticConfigIndex() {
+    int32_t ids[arraysize(kVehicleProperties)];
+    for (size_t i = 0; i < arraysize(kVehicleProperties); i++) {
+        ids[i] = kVehicleProperties[i].config.prop;
+    }
+    StaticConfigIndex index(ids);
+    if (!index.isValid()) {
+        // Only happens if a property is declared twice; the store still has every config.
+        ALOGW("Duplicate properties in kVehicleProperties, looking configs up in the store");
+    }
+    return index;
+}
+
 void EmulatedVehicleHal::initStaticConfig() {
     for (auto&& it = std::begin(kVehicleProperties); it != std::end(kVehicleProperties); ++it) {
         const auto& cfg = it->config;
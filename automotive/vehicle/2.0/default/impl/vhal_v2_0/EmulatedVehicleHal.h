@@ -19,15 +19,19 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <sys/socket.h>
 #include <thread>
 #include <unordered_set>
 
+#include <android-base/macros.h>
 #include <utils/SystemClock.h>
 
+#include <vhal_v2_0/PropertyPerfectHash.h>
 #include <vhal_v2_0/RecurrentTimer.h>
 #include <vhal_v2_0/VehicleHal.h>
 #include "vhal_v2_0/VehiclePropertyStore.h"
+#include "vhal_v2_0/VmsRoutingTable.h"
 
 #include "DefaultConfig.h"
 #include "GeneratorHub.h"
@@ -61,6 +65,8 @@ public:
     std::vector<VehiclePropValue> getAllProperties() const override;
 
 private:
+    using StaticConfigIndex = PropertyPerfectHash<arraysize(kVehicleProperties)>;
+
     constexpr std::chrono::nanoseconds hertzToNanoseconds(float hz) const {
         return std::chrono::nanoseconds(static_cast<int64_t>(1000000000L / hz));
     }
@@ -74,6 +80,10 @@ private:
     void onContinuousPropertyTimer(const std::vector<int32_t>& properties);
     bool isContinuousProperty(int32_t propId) const;
     void initStaticConfig();
+    // Hashes the ids of kVehicleProperties, so the index cannot go out of sync with the array
+    static StaticConfigIndex buildStaticConfigIndex();
+    // Looks the config up in kVehicleProperties, or in the store for properties added by vendors
+    const VehiclePropConfig* getStaticConfigOrNull(int32_t propId) const;
     void initObd2LiveFrame(const VehiclePropConfig& propConfig);
     void initObd2FreezeFrame(const VehiclePropConfig& propConfig);
     StatusCode fillObd2FreezeFrame(const VehiclePropValue& requestedPropValue,
@@ -83,9 +93,13 @@ private:
 
     /* Private members */
     VehiclePropertyStore* mPropStore;
+    const StaticConfigIndex mStaticConfigIndex;
     std::unordered_set<int32_t> mHvacPowerProps;
     RecurrentTimer mRecurrentTimer;
     GeneratorHub mGeneratorHub;
+
+    std::mutex mVmsLock;
+    vms::VmsRoutingTable mVmsRoutingTable;  // Guarded by mVmsLock.
 };
 
 }  // impl
@@ -16,6 +16,7 @@
 
 #define LOG_TAG "JsonFakeValueGenerator"
 
+#include <cctype>
 #include <fstream>
 #include <type_traits>
 #include <typeinfo>
@@ -35,17 +36,18 @@ namespace impl {
 
 JsonFakeValueGenerator::JsonFakeValueGenerator(const VehiclePropValue& request) {
     const auto& v = request.value;
-    const char* file = v.stringValue.c_str();
-    std::ifstream ifs(file);
-    if (!ifs) {
-        ALOGE("%s: couldn't open %s for parsing.", __func__, file);
+    mFileName = v.stringValue;
+    mStream.open(mFileName);
+    if (!mStream) {
+        ALOGE("%s: couldn't open %s for parsing.", __func__, mFileName.c_str());
     }
-    mGenCfg = {
-        .index = 0,
-        .events = parseFakeValueJson(ifs),
-    };
     // Iterate infinitely if repetition number is not provided
     mNumOfIterations = v.int32Values.size() < 2 ? -1 : v.int32Values[1];
+    // Replay in real time if time compression is not provided
+    mTimeCompression = v.floatValues.size() < 1 || v.floatValues[0] <= 0 ? 1.0f
+                                                                         : v.floatValues[0];
+    mLastEventTime = Clock::now();
+    mHasNextEvent = readNextEvent(&mNextEvent);
 }
 
 VehiclePropValue JsonFakeValueGenerator::nextEvent() {
@@ -53,92 +55,155 @@ VehiclePropValue JsonFakeValueGenerator::nextEvent() {
     if (!hasNext()) {
         return generatedValue;
     }
-    TimePoint eventTime = Clock::now();
-    if (mGenCfg.index != 0) {
-        // All events (start from 2nd one) are supposed to happen in the future with a delay
-        // equals to the duration between previous and current event.
-        eventTime += Nanos(mGenCfg.events[mGenCfg.index].timestamp -
-                           mGenCfg.events[mGenCfg.index - 1].timestamp);
+    generatedValue = std::move(mNextEvent);
+
+    int64_t traceTimestamp = generatedValue.timestamp;
+    if (mNextEventStartsIteration) {
+        // Next iteration starts right after the last event of the previous one.
+        mIterationStartTime = mLastEventTime;
+        mIterationFirstTimestamp = traceTimestamp;
+        mNextEventStartsIteration = false;
     }
-    generatedValue = mGenCfg.events[mGenCfg.index];
+    // All events are supposed to happen in the future with a delay equal to the duration between
+    // the first and the current event in the trace.
+    TimePoint eventTime = mIterationStartTime
+            + Nanos(static_cast<int64_t>((traceTimestamp - mIterationFirstTimestamp)
+                                         / mTimeCompression));
+    mLastEventTime = eventTime;
     generatedValue.timestamp = eventTime.time_since_epoch().count();
 
-    mGenCfg.index++;
-    if (mGenCfg.index == mGenCfg.events.size()) {
-        mGenCfg.index = 0;
-        if (mNumOfIterations > 0) {
-            mNumOfIterations--;
-        }
-    }
+    mHasNextEvent = readNextEvent(&mNextEvent);
     return generatedValue;
 }
 
 bool JsonFakeValueGenerator::hasNext() {
-    return mNumOfIterations != 0 && mGenCfg.events.size() > 0;
+    return mHasNextEvent;
 }
 
-std::vector<VehiclePropValue> JsonFakeValueGenerator::parseFakeValueJson(std::istream& is) {
-    std::vector<VehiclePropValue> fakeVhalEvents;
-
-    Json::Reader reader;
-    Json::Value rawEvents;
-    if (!reader.parse(is, rawEvents)) {
-        ALOGE("%s: Failed to parse fake data JSON file. Error: %s", __func__,
-              reader.getFormattedErrorMessages().c_str());
-        return fakeVhalEvents;
-    }
+bool JsonFakeValueGenerator::readNextEvent(VehiclePropValue* event) {
+    while (mNumOfIterations != 0) {
+        while (readNextJsonObject(&mObjectBuffer)) {
+            Json::Value rawEvent;
+            if (!mReader.parse(mObjectBuffer, rawEvent)) {
+                ALOGE("%s: Failed to parse fake data JSON event. Error: %s", __func__,
+                      mReader.getFormattedErrorMessages().c_str());
+                continue;
+            }
+            if (parseFakeValueJson(rawEvent, event)) {
+                mHasValidEvents = true;
+                return true;
+            }
+        }
 
-    for (Json::Value::ArrayIndex i = 0; i < rawEvents.size(); i++) {
-        Json::Value rawEvent = rawEvents[i];
-        if (!rawEvent.isObject()) {
-            ALOGE("%s: VHAL JSON event should be an object, %s", __func__,
-                  rawEvent.toStyledString().c_str());
-            continue;
+        // Reached the end of trace.
+        if (!mHasValidEvents) {
+            return false;
         }
-        if (rawEvent["prop"].empty() || rawEvent["areaId"].empty() || rawEvent["value"].empty() ||
-            rawEvent["timestamp"].empty()) {
-            ALOGE("%s: VHAL JSON event has missing fields, skip it, %s", __func__,
-                  rawEvent.toStyledString().c_str());
-            continue;
+        if (mNumOfIterations > 0) {
+            mNumOfIterations--;
         }
-        VehiclePropValue event = {
-                .timestamp = rawEvent["timestamp"].asInt64(),
-                .areaId = rawEvent["areaId"].asInt(),
-                .prop = rawEvent["prop"].asInt(),
-        };
-
-        Json::Value rawEventValue = rawEvent["value"];
-        auto& value = event.value;
-        switch (getPropType(event.prop)) {
-            case VehiclePropertyType::BOOLEAN:
-            case VehiclePropertyType::INT32:
-                value.int32Values.resize(1);
-                value.int32Values[0] = rawEventValue.asInt();
-                break;
-            case VehiclePropertyType::INT64:
-                value.int64Values.resize(1);
-                value.int64Values[0] = rawEventValue.asInt64();
-                break;
-            case VehiclePropertyType::FLOAT:
-                value.floatValues.resize(1);
-                value.floatValues[0] = rawEventValue.asFloat();
-                break;
-            case VehiclePropertyType::STRING:
-                value.stringValue = rawEventValue.asString();
-                break;
-            case VehiclePropertyType::MIXED:
-                copyMixedValueJson(value, rawEventValue);
-                if (isDiagnosticProperty(event.prop)) {
-                    value.bytes = generateDiagnosticBytes(value);
-                }
-                break;
-            default:
-                ALOGE("%s: unsupported type for property: 0x%x", __func__, event.prop);
-                continue;
+        mStream.clear();
+        mStream.seekg(0);
+        mNextEventStartsIteration = true;
+    }
+    return false;
+}
+
+bool JsonFakeValueGenerator::readNextJsonObject(std::string* out) {
+    out->clear();
+    char c;
+    // Skip array punctuation and whitespace preceding the next object.
+    while (mStream.get(c)) {
+        if (c == '{') break;
+        if (c == ']') return false;
+        if (c == '[' || c == ',' || isspace(static_cast<unsigned char>(c))) continue;
+        ALOGE("%s: Unexpected character '%c' in %s, events should be objects in an array",
+              __func__, c, mFileName.c_str());
+        return false;
+    }
+    if (!mStream) {
+        return false;
+    }
+
+    // Copy object text until its closing brace, braces inside of strings don't count.
+    out->push_back(c);
+    int depth = 1;
+    bool inString = false;
+    bool escaped = false;
+    while (depth > 0 && mStream.get(c)) {
+        out->push_back(c);
+        if (inString) {
+            if (escaped) {
+                escaped = false;
+            } else if (c == '\\') {
+                escaped = true;
+            } else if (c == '"') {
+                inString = false;
+            }
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}') {
+            depth--;
         }
-        fakeVhalEvents.push_back(event);
     }
-    return fakeVhalEvents;
+    if (depth > 0) {
+        ALOGE("%s: Unexpected end of %s", __func__, mFileName.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool JsonFakeValueGenerator::parseFakeValueJson(const Json::Value& rawEvent,
+                                                VehiclePropValue* event) {
+    if (!rawEvent.isObject()) {
+        ALOGE("%s: VHAL JSON event should be an object, %s", __func__,
+              rawEvent.toStyledString().c_str());
+        return false;
+    }
+    if (rawEvent["prop"].empty() || rawEvent["areaId"].empty() || rawEvent["value"].empty() ||
+        rawEvent["timestamp"].empty()) {
+        ALOGE("%s: VHAL JSON event has missing fields, skip it, %s", __func__,
+              rawEvent.toStyledString().c_str());
+        return false;
+    }
+    *event = {
+            .timestamp = rawEvent["timestamp"].asInt64(),
+            .areaId = rawEvent["areaId"].asInt(),
+            .prop = rawEvent["prop"].asInt(),
+    };
+
+    const Json::Value& rawEventValue = rawEvent["value"];
+    auto& value = event->value;
+    switch (getPropType(event->prop)) {
+        case VehiclePropertyType::BOOLEAN:
+        case VehiclePropertyType::INT32:
+            value.int32Values.resize(1);
+            value.int32Values[0] = rawEventValue.asInt();
+            break;
+        case VehiclePropertyType::INT64:
+            value.int64Values.resize(1);
+            value.int64Values[0] = rawEventValue.asInt64();
+            break;
+        case VehiclePropertyType::FLOAT:
+            value.floatValues.resize(1);
+            value.floatValues[0] = rawEventValue.asFloat();
+            break;
+        case VehiclePropertyType::STRING:
+            value.stringValue = rawEventValue.asString();
+            break;
+        case VehiclePropertyType::MIXED:
+            copyMixedValueJson(value, rawEventValue);
+            if (isDiagnosticProperty(event->prop)) {
+                value.bytes = generateDiagnosticBytes(value);
+            }
+            break;
+        default:
+            ALOGE("%s: unsupported type for property: 0x%x", __func__, event->prop);
+            return false;
+    }
+    return true;
 }
 
 void JsonFakeValueGenerator::copyMixedValueJson(VehiclePropValue::RawValue& dest,
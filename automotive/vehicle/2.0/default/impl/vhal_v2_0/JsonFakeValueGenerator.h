@@ -18,7 +18,9 @@
 #define android_hardware_automotive_vehicle_V2_0_impl_JsonFakeValueGenerator_H_
 
 #include <chrono>
+#include <fstream>
 #include <iostream>
+#include <string>
 
 #include <json/json.h>
 
@@ -32,13 +34,15 @@ namespace V2_0 {
 
 namespace impl {
 
+/**
+ * Replays VHAL events from a JSON file that contains an array of event objects.
+ *
+ * The file is streamed: only one event is parsed ahead of time, so start-up time and memory use
+ * don't depend on the length of the trace. Events are released at
+ * start time + (trace timestamp - first trace timestamp) / time compression, so pacing follows
+ * the trace without accumulating drift.
+ */
 class JsonFakeValueGenerator : public FakeValueGenerator {
-private:
-    struct GeneratorCfg {
-        size_t index;
-        std::vector<VehiclePropValue> events;
-    };
-
 public:
     JsonFakeValueGenerator(const VehiclePropValue& request);
     ~JsonFakeValueGenerator() = default;
@@ -48,7 +52,13 @@ public:
     bool hasNext();
 
 private:
-    std::vector<VehiclePropValue> parseFakeValueJson(std::istream& is);
+    /* Reads the next valid event, rewinds the file if more iterations are requested. */
+    bool readNextEvent(VehiclePropValue* event);
+
+    /* Extracts text of the next object of the top-level array, false at the end of array. */
+    bool readNextJsonObject(std::string* out);
+
+    bool parseFakeValueJson(const Json::Value& rawEvent, VehiclePropValue* event);
     void copyMixedValueJson(VehiclePropValue::RawValue& dest, const Json::Value& jsonValue);
 
     template <typename T>
@@ -59,8 +69,21 @@ private:
     void setBit(hidl_vec<uint8_t>& bytes, size_t idx);
 
 private:
-    GeneratorCfg mGenCfg;
+    std::string mFileName;
+    std::ifstream mStream;
+    Json::Reader mReader;
+    std::string mObjectBuffer;  // Reused for text of every event.
+
+    VehiclePropValue mNextEvent;  // Prefetched event with the original trace timestamp.
+    bool mHasNextEvent = false;
+    bool mNextEventStartsIteration = true;
+    bool mHasValidEvents = false;  // Guards from rewinding a file without events forever.
+
     int32_t mNumOfIterations;
+    float mTimeCompression;
+    TimePoint mIterationStartTime;
+    int64_t mIterationFirstTimestamp = 0;
+    TimePoint mLastEventTime;
 };
 
 }  // namespace impl
@@ -24,6 +24,8 @@
 
 #define CAR_SERVICE_NAME "pipe:qemud:car"
 
+static constexpr int MAX_RX_MSG_SZ = 2048;
+
 
 namespace android {
 namespace hardware {
@@ -33,7 +35,8 @@ namespace V2_0 {
 
 namespace impl {
 
-PipeComm::PipeComm(MessageProcessor* messageProcessor) : CommConn(messageProcessor), mPipeFd(-1) {}
+PipeComm::PipeComm(MessageProcessor* messageProcessor)
+    : CommConn(messageProcessor), mPipeFd(-1), mRxBuffer(MAX_RX_MSG_SZ) {}
 
 void PipeComm::start() {
     int fd = qemu_pipe_open(CAR_SERVICE_NAME);
@@ -57,31 +60,29 @@ void PipeComm::stop() {
     CommConn::stop();
 }
 
-std::vector<uint8_t> PipeComm::read() {
-    static constexpr int MAX_RX_MSG_SZ = 2048;
-    std::vector<uint8_t> msg = std::vector<uint8_t>(MAX_RX_MSG_SZ);
+const uint8_t* PipeComm::read(size_t* outSize) {
     int numBytes;
 
-    numBytes = qemu_pipe_frame_recv(mPipeFd, msg.data(), msg.size());
+    numBytes = qemu_pipe_frame_recv(mPipeFd, mRxBuffer.data(), mRxBuffer.size());
 
     if (numBytes == MAX_RX_MSG_SZ) {
         ALOGE("%s: Received max size = %d", __FUNCTION__, MAX_RX_MSG_SZ);
     } else if (numBytes > 0) {
-        msg.resize(numBytes);
-        return msg;
+        *outSize = static_cast<size_t>(numBytes);
+        return mRxBuffer.data();
     } else {
         ALOGD("%s: Connection terminated on pipe %d, numBytes=%d", __FUNCTION__, mPipeFd, numBytes);
         mPipeFd = -1;
     }
 
-    return std::vector<uint8_t>();
+    return nullptr;
 }
 
-int PipeComm::write(const std::vector<uint8_t>& data) {
+int PipeComm::write(const uint8_t* data, size_t size) {
     int retVal = 0;
 
     if (mPipeFd != -1) {
-        retVal = qemu_pipe_frame_send(mPipeFd, data.data(), data.size());
+        retVal = qemu_pipe_frame_send(mPipeFd, data, size);
     }
 
     if (retVal < 0) {
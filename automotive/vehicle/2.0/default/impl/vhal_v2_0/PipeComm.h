@@ -43,13 +43,14 @@ class PipeComm : public CommConn {
     void start() override;
     void stop() override;
 
-    std::vector<uint8_t> read() override;
-    int write(const std::vector<uint8_t>& data) override;
+    const uint8_t* read(size_t* outSize) override;
+    int write(const uint8_t* data, size_t size) override;
 
     inline bool isOpen() override { return mPipeFd > 0; }
 
    private:
     int mPipeFd;
+    std::vector<uint8_t> mRxBuffer;  // Reused for every received frame.
 };
 
 }  // impl
@@ -21,13 +21,20 @@
 #include <arpa/inet.h>
 #include <log/log.h>
 #include <netinet/in.h>
+#include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include "SocketComm.h"
 
 // Socket to use when communicating with Host PC
 static constexpr int DEBUG_SOCKET = 33452;
 
+static constexpr size_t MSG_HEADER_LEN = 4;
+static constexpr size_t RX_BUFFER_SIZE = 16 * 1024;
+static constexpr size_t MAX_MSG_SIZE = 4 * 1024 * 1024;
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -62,8 +69,22 @@ void SocketComm::stop() {
 
 void SocketComm::sendMessage(emulator::EmulatorMessage const& msg) {
     std::lock_guard<std::mutex> lock(mMutex);
+    if (mOpenConnections.empty()) {
+        return;
+    }
+
+    // Serialize once for all clients.
+    int numBytes = msg.ByteSize();
+    if (mTxBuffer.size() < static_cast<size_t>(numBytes)) {
+        mTxBuffer.resize(static_cast<size_t>(numBytes));
+    }
+    if (!msg.SerializeToArray(mTxBuffer.data(), numBytes)) {
+        ALOGE("%s: SerializeToString failed!", __func__);
+        return;
+    }
+
     for (std::unique_ptr<SocketConn> const& conn : mOpenConnections) {
-        conn->sendMessage(msg);
+        conn->sendSerialized(mTxBuffer.data(), static_cast<size_t>(numBytes));
     }
 }
 
@@ -137,50 +158,54 @@ void SocketComm::removeClosedConnections() {
 }
 
 SocketConn::SocketConn(MessageProcessor* messageProcessor, int sfd)
-    : CommConn(messageProcessor), mSockFd(sfd) {}
+    : CommConn(messageProcessor), mSockFd(sfd), mRxBuffer(RX_BUFFER_SIZE) {}
 
-/**
- * Reads, in a loop, exactly numBytes from the given fd. If the connection is closed, returns
- * an empty buffer, otherwise will return exactly the given number of bytes.
- */
-std::vector<uint8_t> readExactly(int fd, int numBytes) {
-    std::vector<uint8_t> buffer(numBytes);
-    int totalRead = 0;
-    int offset = 0;
-    while (totalRead < numBytes) {
-        int numRead = ::read(fd, &buffer.data()[offset], numBytes - offset);
-        if (numRead == 0) {
-            buffer.resize(0);
-            return buffer;
-        }
-
-        totalRead += numRead;
-    }
-    return buffer;
-}
+const uint8_t* SocketConn::read(size_t* outSize) {
+    // Message returned by the previous call has been processed.
+    mRxBegin = mRxNext;
 
-/**
- * Reads an int, guaranteed to be non-zero, from the given fd. If the connection is closed, returns
- * -1.
- */
-int32_t readInt(int fd) {
-    std::vector<uint8_t> buffer = readExactly(fd, sizeof(int32_t));
-    if (buffer.size() == 0) {
-        return -1;
-    }
+    while (true) {
+        size_t available = mRxEnd - mRxBegin;
+        size_t frameSize = MSG_HEADER_LEN;
+        if (available >= MSG_HEADER_LEN) {
+            uint32_t msgLen;
+            memcpy(&msgLen, &mRxBuffer[mRxBegin], MSG_HEADER_LEN);
+            msgLen = ntohl(msgLen);
+            if (msgLen == 0 || msgLen > MAX_MSG_SIZE) {
+                ALOGD("%s: Connection terminated on socket %d, msgLen=%u", __FUNCTION__, mSockFd,
+                      msgLen);
+                return nullptr;
+            }
+
+            frameSize += msgLen;
+            if (available >= frameSize) {
+                *outSize = msgLen;
+                mRxNext = mRxBegin + frameSize;
+                return &mRxBuffer[mRxBegin + MSG_HEADER_LEN];
+            }
+        }
 
-    int32_t value = *reinterpret_cast<int32_t*>(buffer.data());
-    return ntohl(value);
-}
+        // Move incomplete frame to the front, so the rest of the buffer can be filled.
+        if (mRxBegin > 0) {
+            memmove(mRxBuffer.data(), &mRxBuffer[mRxBegin], available);
+            mRxBegin = 0;
+            mRxNext = 0;
+            mRxEnd = available;
+        }
+        if (mRxBuffer.size() < frameSize) {
+            mRxBuffer.resize(frameSize);
+        }
 
-std::vector<uint8_t> SocketConn::read() {
-    int32_t msgSize = readInt(mSockFd);
-    if (msgSize <= 0) {
-        ALOGD("%s: Connection terminated on socket %d", __FUNCTION__, mSockFd);
-        return std::vector<uint8_t>();
+        ssize_t numRead = ::read(mSockFd, &mRxBuffer[mRxEnd], mRxBuffer.size() - mRxEnd);
+        if (numRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (numRead <= 0) {
+            ALOGD("%s: Connection terminated on socket %d", __FUNCTION__, mSockFd);
+            return nullptr;
+        }
+        mRxEnd += static_cast<size_t>(numRead);
     }
-
-    return readExactly(mSockFd, msgSize);
 }
 
 void SocketConn::stop() {
@@ -190,27 +215,47 @@ void SocketConn::stop() {
     }
 }
 
-int SocketConn::write(const std::vector<uint8_t>& data) {
-    static constexpr int MSG_HEADER_LEN = 4;
-    int retVal = 0;
-    union {
-        uint32_t msgLen;
-        uint8_t msgLenBytes[MSG_HEADER_LEN];
-    };
+int SocketConn::write(const uint8_t* data, size_t size) {
+    if (mSockFd <= 0) {
+        return 0;
+    }
 
     // Prepare header for the message
-    msgLen = static_cast<uint32_t>(data.size());
-    msgLen = htonl(msgLen);
-
-    if (mSockFd > 0) {
-        retVal = ::write(mSockFd, msgLenBytes, MSG_HEADER_LEN);
+    uint32_t msgLen = htonl(static_cast<uint32_t>(size));
+    iovec iov[] = {
+        { &msgLen, MSG_HEADER_LEN },
+        { const_cast<uint8_t*>(data), size },
+    };
 
-        if (retVal == MSG_HEADER_LEN) {
-            retVal = ::write(mSockFd, data.data(), data.size());
+    size_t total = MSG_HEADER_LEN + size;
+    size_t written = 0;
+    iovec* vec = iov;
+    int vecCount = 2;
+    while (written < total) {
+        ssize_t retVal = ::writev(mSockFd, vec, vecCount);
+        if (retVal < 0 && errno == EINTR) {
+            continue;
+        }
+        if (retVal <= 0) {
+            ALOGE("%s: writev failed on socket %d, errno=%d", __FUNCTION__, mSockFd, errno);
+            return -1;
+        }
+        written += static_cast<size_t>(retVal);
+
+        // Skip fully written buffers in case of a partial write.
+        size_t consumed = static_cast<size_t>(retVal);
+        while (vecCount > 0 && consumed >= vec->iov_len) {
+            consumed -= vec->iov_len;
+            vec++;
+            vecCount--;
+        }
+        if (vecCount > 0) {
+            vec->iov_base = static_cast<uint8_t*>(vec->iov_base) + consumed;
+            vec->iov_len -= consumed;
         }
     }
 
-    return retVal;
+    return static_cast<int>(written);
 }
 
 }  // impl
@@ -55,6 +55,7 @@ class SocketComm {
     std::vector<std::unique_ptr<SocketConn>> mOpenConnections;
     MessageProcessor* mMessageProcessor;
     std::mutex mMutex;
+    std::vector<uint8_t> mTxBuffer;  // Grow-only, guarded by mMutex.
 
     /**
      * Opens the socket and begins listening.
@@ -86,12 +87,10 @@ class SocketConn : public CommConn {
     virtual ~SocketConn() = default;
 
     /**
-     * Blocking call to read data from the connection.
-     *
-     * @return std::vector<uint8_t> Serialized protobuf data received from emulator.  This will be
-     *              an empty vector if the connection was closed or some other error occurred.
+     * Blocking call to read next message from the connection. Socket data is read in large
+     * chunks into a reusable buffer, messages are returned in place without copying.
      */
-    std::vector<uint8_t> read() override;
+    const uint8_t* read(size_t* outSize) override;
 
     /**
      * Closes a connection if it is open.
@@ -99,18 +98,22 @@ class SocketConn : public CommConn {
     void stop() override;
 
     /**
-     * Transmits a string of data to the emulator.
-     *
-     * @param data Serialized protobuf data to transmit.
+     * Transmits header and message to the emulator in a single writev call.
      *
-     * @return int Number of bytes transmitted, or -1 if failed.
+     * @return int Number of bytes transmitted including the header, or -1 if failed.
      */
-    int write(const std::vector<uint8_t>& data) override;
+    int write(const uint8_t* data, size_t size) override;
 
     inline bool isOpen() override { return mSockFd > 0; }
 
    private:
     int mSockFd;
+
+    // Receive buffer, [mRxBegin, mRxEnd) holds data that hasn't been consumed yet.
+    std::vector<uint8_t> mRxBuffer;
+    size_t mRxBegin = 0;
+    size_t mRxEnd = 0;
+    size_t mRxNext = 0;  // Start of the frame following the last returned message.
 };
 
 }  // impl
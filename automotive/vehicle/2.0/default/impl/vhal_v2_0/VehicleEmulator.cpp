@@ -151,7 +151,18 @@ void VehicleEmulator::doGetPropertyAll(VehicleEmulator::EmulatorMessage const& /
 
 void VehicleEmulator::doSetProperty(VehicleEmulator::EmulatorMessage const& rxMsg,
                                     VehicleEmulator::EmulatorMessage& respMsg) {
-    emulator::VehiclePropValue protoVal = rxMsg.value(0);
+    respMsg.set_msg_type(emulator::SET_PROPERTY_RESP);
+
+    // A single message may carry many values, e.g. when replaying drive logs. All values are
+    // applied, status is OK only if every one of them was accepted.
+    bool halRes = rxMsg.value_size() > 0;
+    for (int i = 0; i < rxMsg.value_size(); i++) {
+        halRes &= setPropertyFromProto(rxMsg.value(i));
+    }
+    respMsg.set_status(halRes ? emulator::RESULT_OK : emulator::ERROR_INVALID_PROPERTY);
+}
+
+bool VehicleEmulator::setPropertyFromProto(emulator::VehiclePropValue const& protoVal) {
     VehiclePropValue val = {
             .timestamp = elapsedRealtimeNano(),
             .areaId = protoVal.area_id(),
@@ -159,8 +170,6 @@ void VehicleEmulator::doSetProperty(VehicleEmulator::EmulatorMessage const& rxMs
             .status = (VehiclePropertyStatus)protoVal.status(),
     };
 
-    respMsg.set_msg_type(emulator::SET_PROPERTY_RESP);
-
     // Copy value data if it is set.  This automatically handles complex data types if needed.
     if (protoVal.has_string_value()) {
         val.value.stringValue = protoVal.string_value().c_str();
@@ -186,8 +195,7 @@ void VehicleEmulator::doSetProperty(VehicleEmulator::EmulatorMessage const& rxMs
                                                      protoVal.float_values().end() };
     }
 
-    bool halRes = mHal->setPropertyFromVehicle(val);
-    respMsg.set_status(halRes ? emulator::RESULT_OK : emulator::ERROR_INVALID_PROPERTY);
+    return mHal->setPropertyFromVehicle(val);
 }
 
 void VehicleEmulator::processMessage(emulator::EmulatorMessage const& rxMsg,
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <set>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/ConcurrentQueue.h"
+
+namespace android {
+
+namespace {
+
+using std::chrono::milliseconds;
+
+TEST(LockFreeQueueTest, pushAndFlush) {
+    LockFreeQueue<int> queue(4);
+    ASSERT_EQ(4u, queue.getCapacity());
+    ASSERT_TRUE(queue.flush().empty());
+
+    queue.push(1);
+    queue.push(2);
+    auto items = queue.flush();
+    ASSERT_EQ(std::vector<int>({1, 2}), items);
+    ASSERT_TRUE(queue.flush().empty());
+}
+
+TEST(LockFreeQueueTest, dropsWhenFull) {
+    LockFreeQueue<int> queue(3);  // Rounded up to 4.
+    for (int i = 0; i < 6; i++) {
+        queue.push(std::move(i));
+    }
+    ASSERT_EQ(2u, queue.getDroppedCount());
+    ASSERT_EQ(std::vector<int>({0, 1, 2, 3}), queue.flush());
+
+    // Ring wraps around after it was drained.
+    for (int i = 10; i < 14; i++) {
+        queue.push(std::move(i));
+    }
+    ASSERT_EQ(std::vector<int>({10, 11, 12, 13}), queue.flush());
+    ASSERT_EQ(2u, queue.getDroppedCount());
+}
+
+TEST(LockFreeQueueTest, waitForItemsWakesUp) {
+    LockFreeQueue<int> queue(16);
+    std::thread producer([&queue] () {
+        std::this_thread::sleep_for(milliseconds(20));
+        queue.push(42);
+    });
+
+    queue.waitForItems();
+    ASSERT_EQ(std::vector<int>({42}), queue.flush());
+    producer.join();
+}
+
+TEST(LockFreeQueueTest, deactivate) {
+    LockFreeQueue<int> queue(16);
+    std::thread stopper([&queue] () {
+        std::this_thread::sleep_for(milliseconds(20));
+        queue.deactivate();
+    });
+
+    queue.waitForItems();  // Must return once deactivated.
+    stopper.join();
+
+    queue.push(1);
+    ASSERT_TRUE(queue.flush().empty());
+}
+
+TEST(LockFreeQueueTest, multipleProducers) {
+    // P producers push N unique items each while single consumer drains the queue.
+    const int P = 4;
+    const int N = 10000;
+
+    LockFreeQueue<int> queue(P * N);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < P; p++) {
+        producers.push_back(std::thread([&queue, p] () {
+            for (int i = 0; i < N; i++) {
+                queue.push(p * N + i);
+            }
+        }));
+    }
+
+    std::set<int> received;
+    while (received.size() < static_cast<size_t>(P * N)) {
+        queue.waitForItems();
+        for (int item : queue.flush()) {
+            ASSERT_TRUE(received.insert(item).second) << "Duplicate item: " << item;
+        }
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    ASSERT_EQ(0u, queue.getDroppedCount());
+}
+
+TEST(Log2HistogramTest, buckets) {
+    Log2Histogram histogram;
+    histogram.add(0);
+    histogram.add(1);
+    histogram.add(2);
+    histogram.add(3);
+    histogram.add(1000);
+
+    ASSERT_EQ(1u, histogram.getCount(0));
+    ASSERT_EQ(1u, histogram.getCount(1));
+    ASSERT_EQ(2u, histogram.getCount(2));
+    ASSERT_EQ(1u, histogram.getCount(10));
+    ASSERT_EQ(5u, histogram.getTotalCount());
+    ASSERT_EQ("  <= 0us: 1\n  <= 1us: 1\n  <= 3us: 2\n  <= 1023us: 1\n",
+              histogram.dump("us"));
+}
+
+class AdaptiveBatchingTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        AdaptiveBatchingOptions options {
+            .maxBatchInterval = milliseconds(200),
+            .lowLoadThreshold = 2,
+            .flushThreshold = 8,
+        };
+        consumer.run(&queue, options, [this] (const std::vector<int>& items) {
+            {
+                std::lock_guard<std::mutex> g(lock);
+                batches.push_back(items);
+            }
+            cond.notify_one();
+        });
+    }
+
+    void TearDown() override {
+        consumer.requestStop();
+        queue.deactivate();
+        consumer.waitStopped();
+    }
+
+    bool waitForBatches(size_t count, milliseconds timeout) {
+        std::unique_lock<std::mutex> g(lock);
+        return cond.wait_for(g, timeout, [this, count] { return batches.size() >= count; });
+    }
+
+public:
+    ConcurrentQueue<int> queue;
+    BatchingConsumer<int> consumer;
+
+    std::mutex lock;
+    std::condition_variable cond;
+    std::vector<std::vector<int>> batches;
+};
+
+TEST_F(AdaptiveBatchingTest, loneItemDeliveredImmediately) {
+    queue.push(1);
+    // Much less than maxBatchInterval.
+    ASSERT_TRUE(waitForBatches(1, milliseconds(50)));
+    ASSERT_EQ(std::vector<int>({1}), batches[0]);
+    ASSERT_EQ(1u, consumer.getBatchSizeHistogram().getCount(1));
+    ASSERT_EQ(1u, consumer.getBatchLatencyHistogram().getTotalCount());
+}
+
+TEST_F(AdaptiveBatchingTest, burstFlushedAtThreshold) {
+    for (int round = 0; round < 5; round++) {
+        for (int i = 0; i < 8; i++) {
+            queue.push(std::move(i));
+        }
+        size_t batchCount;
+        {
+            std::lock_guard<std::mutex> g(lock);
+            batchCount = batches.size();
+        }
+        ASSERT_TRUE(waitForBatches(batchCount + 1, milliseconds(100)));
+        std::this_thread::sleep_for(milliseconds(5));
+    }
+
+    std::lock_guard<std::mutex> g(lock);
+    size_t delivered = 0;
+    for (const auto& batch : batches) delivered += batch.size();
+    ASSERT_EQ(40u, delivered);
+    ASSERT_EQ(batches.size(), consumer.getBatchSizeHistogram().getTotalCount());
+}
+
+}  // namespace anonymous
+
+}  // namespace android
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/Obd2SensorStore.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+constexpr size_t kVendorIntegerSensors = 2;
+constexpr size_t kVendorFloatSensors = 3;
+constexpr size_t kIntegerSensors =
+    toInt(DiagnosticIntegerSensorIndex::LAST_SYSTEM_INDEX) + 1 + kVendorIntegerSensors;
+constexpr size_t kFloatSensors =
+    toInt(DiagnosticFloatSensorIndex::LAST_SYSTEM_INDEX) + 1 + kVendorFloatSensors;
+
+bool isBitSet(const hidl_vec<uint8_t>& bitmask, size_t index) {
+    return (bitmask[index / 8] & (1 << (index % 8))) != 0;
+}
+
+size_t countBits(const hidl_vec<uint8_t>& bitmask) {
+    size_t count = 0;
+    for (size_t i = 0; i < bitmask.size() * 8; i++) {
+        if (isBitSet(bitmask, i)) count++;
+    }
+    return count;
+}
+
+TEST(Obd2SensorStoreTest, fillPropValue) {
+    Obd2SensorStore store(kVendorIntegerSensors, kVendorFloatSensors);
+    ASSERT_EQ(StatusCode::OK, store.setIntegerSensor(DiagnosticIntegerSensorIndex::FUEL_TYPE, 4));
+    ASSERT_EQ(StatusCode::OK, store.setFloatSensor(DiagnosticFloatSensorIndex::ENGINE_RPM, 800.));
+    ASSERT_EQ(StatusCode::INVALID_ARG, store.setIntegerSensor(kIntegerSensors, 1));
+    ASSERT_EQ(StatusCode::INVALID_ARG, store.setFloatSensor(kFloatSensors, 1.));
+
+    VehiclePropValue frame {};
+    store.fillPropValue("P0070", &frame);
+    ASSERT_EQ(kIntegerSensors, frame.value.int32Values.size());
+    ASSERT_EQ(kFloatSensors, frame.value.floatValues.size());
+    ASSERT_EQ((kIntegerSensors + kFloatSensors + 7) / 8, frame.value.bytes.size());
+    ASSERT_EQ("P0070", std::string(frame.value.stringValue));
+
+    const size_t fuelType = toInt(DiagnosticIntegerSensorIndex::FUEL_TYPE);
+    const size_t engineRpm = toInt(DiagnosticFloatSensorIndex::ENGINE_RPM);
+    ASSERT_EQ(4, frame.value.int32Values[fuelType]);
+    ASSERT_FLOAT_EQ(800., frame.value.floatValues[engineRpm]);
+    ASSERT_EQ(2u, countBits(frame.value.bytes));
+    ASSERT_TRUE(isBitSet(frame.value.bytes, fuelType));
+    ASSERT_TRUE(isBitSet(frame.value.bytes, kIntegerSensors + engineRpm));
+}
+
+TEST(Obd2SensorStoreTest, deltaFrames) {
+    Obd2SensorStore store(kVendorIntegerSensors, kVendorFloatSensors);
+    ASSERT_FALSE(store.hasChangedSensors());
+    store.setIntegerSensor(DiagnosticIntegerSensorIndex::FUEL_TYPE, 4);
+    store.setFloatSensor(DiagnosticFloatSensorIndex::ENGINE_RPM, 800.);
+    ASSERT_TRUE(store.hasChangedSensors());
+
+    VehiclePropValue delta {};
+    store.fillDeltaPropValue("", &delta);
+    ASSERT_FALSE(store.hasChangedSensors());
+    ASSERT_EQ(kIntegerSensors, delta.value.int32Values.size());
+    ASSERT_EQ(2u, countBits(delta.value.bytes));
+
+    // Only the sensor changed after the first delta is reported, other slots keep their values.
+    const size_t engineRpm = toInt(DiagnosticFloatSensorIndex::ENGINE_RPM);
+    store.setFloatSensor(DiagnosticFloatSensorIndex::ENGINE_RPM, 1200.);
+    store.setFloatSensor(DiagnosticFloatSensorIndex::ENGINE_RPM, 1500.);
+    store.fillDeltaPropValue("", &delta);
+    ASSERT_EQ(1u, countBits(delta.value.bytes));
+    ASSERT_TRUE(isBitSet(delta.value.bytes, kIntegerSensors + engineRpm));
+    ASSERT_FLOAT_EQ(1500., delta.value.floatValues[engineRpm]);
+    ASSERT_EQ(4, delta.value.int32Values[toInt(DiagnosticIntegerSensorIndex::FUEL_TYPE)]);
+
+    store.fillDeltaPropValue("", &delta);
+    ASSERT_EQ(0u, countBits(delta.value.bytes));
+
+    // Full frames still report every sensor ever set.
+    VehiclePropValue full {};
+    store.fillPropValue("", &full);
+    ASSERT_EQ(2u, countBits(full.value.bytes));
+}
+
+}  // namespace anonymous
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/PropertyEventDispatcher.h"
+
+#include "VehicleHalTestUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+constexpr int32_t kContinuousProp = toInt(VehicleProperty::PERF_VEHICLE_SPEED);
+constexpr int32_t kOnChangeProp = toInt(VehicleProperty::HVAC_FAN_SPEED);
+
+/* Callback that blocks in onPropertyEvent until unblocked. */
+class BlockingVehicleCallback : public MockedVehicleCallback {
+public:
+    Return<void> onPropertyEvent(const hidl_vec<VehiclePropValue>& values) override {
+        {
+            std::unique_lock<std::mutex> g(mBlockLock);
+            mBlockCond.wait(g, [this] { return !mBlocked; });
+        }
+        return MockedVehicleCallback::onPropertyEvent(values);
+    }
+
+    void unblock() {
+        {
+            std::lock_guard<std::mutex> g(mBlockLock);
+            mBlocked = false;
+        }
+        mBlockCond.notify_all();
+    }
+
+private:
+    std::mutex mBlockLock;
+    std::condition_variable mBlockCond;
+    bool mBlocked = true;
+};
+
+class PropertyEventDispatcherTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        slowCallback = new BlockingVehicleCallback();
+        fastCallback = new MockedVehicleCallback();
+        slowClient = new HalClient(slowCallback);
+        fastClient = new HalClient(fastCallback);
+        dispatcher.reset(new PropertyEventDispatcher(
+                2, [](int32_t prop) { return prop == kContinuousProp; }));
+    }
+
+    void TearDown() override {
+        slowCallback->unblock();
+        dispatcher.reset();
+    }
+
+    void dispatch(const sp<HalClient>& client, int32_t area, int32_t value,
+                  int32_t prop = kContinuousProp) {
+        VehiclePropValue v {};
+        v.prop = prop;
+        v.areaId = area;
+        v.value.int32Values = hidl_vec<int32_t> { value };
+        VehiclePropValue* values[] = { &v };
+        dispatcher->dispatch(HalClientValues { client, values, 1 });
+    }
+
+public:
+    sp<BlockingVehicleCallback> slowCallback;
+    sp<MockedVehicleCallback> fastCallback;
+    sp<HalClient> slowClient;
+    sp<HalClient> fastClient;
+    std::unique_ptr<PropertyEventDispatcher> dispatcher;
+};
+
+TEST_F(PropertyEventDispatcherTest, slowClientDoesNotBlockOthers) {
+    dispatch(slowClient, 1, 1);
+    for (int i = 0; i < 3; i++) {
+        dispatch(fastClient, 1, i);
+        ASSERT_TRUE(fastCallback->waitForExpectedEvents(i + 1));
+    }
+    ASSERT_EQ(0u, slowCallback->getReceivedEvents().size());
+}
+
+TEST_F(PropertyEventDispatcherTest, coalescesWhileClientIsBusy) {
+    dispatch(slowClient, 1, 0);  // Worker will be blocked delivering this value.
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    for (int i = 1; i <= 10; i++) {
+        dispatch(slowClient, 1, i);
+        dispatch(slowClient, 2, i);
+    }
+    slowCallback->unblock();
+
+    ASSERT_TRUE(slowCallback->waitForExpectedEvents(2));
+    const auto& events = slowCallback->getReceivedEvents();
+    ASSERT_EQ(1u, events[0].size());
+    ASSERT_EQ(0, events[0][0].value.int32Values[0]);
+
+    // Only the latest value of every (prop, area) is delivered and in the original order.
+    ASSERT_EQ(2u, events[1].size());
+    ASSERT_EQ(1, events[1][0].areaId);
+    ASSERT_EQ(10, events[1][0].value.int32Values[0]);
+    ASSERT_EQ(2, events[1][1].areaId);
+    ASSERT_EQ(10, events[1][1].value.int32Values[0]);
+    ASSERT_EQ(18u, dispatcher->getCoalescedCount());
+}
+
+TEST_F(PropertyEventDispatcherTest, deliversOnChangeEventsInOrder) {
+    dispatch(slowClient, 1, 0, kOnChangeProp);  // Worker will be blocked delivering this value.
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    dispatch(slowClient, 1, 1, kOnChangeProp);
+    dispatch(slowClient, 1, 1);
+    dispatch(slowClient, 1, 2, kOnChangeProp);
+    dispatch(slowClient, 1, 2);
+    slowCallback->unblock();
+
+    ASSERT_TRUE(slowCallback->waitForExpectedEvents(2));
+    const auto& events = slowCallback->getReceivedEvents();
+
+    // Every ON_CHANGE value is delivered, only the continuous one is coalesced.
+    ASSERT_EQ(3u, events[1].size());
+    ASSERT_EQ(kOnChangeProp, events[1][0].prop);
+    ASSERT_EQ(1, events[1][0].value.int32Values[0]);
+    ASSERT_EQ(kContinuousProp, events[1][1].prop);
+    ASSERT_EQ(2, events[1][1].value.int32Values[0]);
+    ASSERT_EQ(kOnChangeProp, events[1][2].prop);
+    ASSERT_EQ(2, events[1][2].value.int32Values[0]);
+    ASSERT_EQ(1u, dispatcher->getCoalescedCount());
+}
+
+}  // namespace anonymous
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+
+#include <android-base/macros.h>
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/PropertyPerfectHash.h"
+
+#include "VehicleHalTestUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+constexpr int32_t kPropertyIds[] = {
+    toInt(VehicleProperty::INFO_MAKE),
+    toInt(VehicleProperty::HVAC_FAN_SPEED),
+    toInt(VehicleProperty::HVAC_SEAT_TEMPERATURE),
+    toInt(VehicleProperty::INFO_FUEL_CAPACITY),
+    toInt(VehicleProperty::DISPLAY_BRIGHTNESS),
+    toInt(VehicleProperty::OBD2_LIVE_FRAME),
+    toInt(VehicleProperty::OBD2_FREEZE_FRAME),
+    kCustomComplexProperty,
+};
+
+constexpr PropertyPerfectHash<arraysize(kPropertyIds)> kPropertyIndex(kPropertyIds);
+
+// the hash is computed by the compiler
+static_assert(kPropertyIndex.isValid(), "failed to hash kPropertyIds");
+static_assert(kPropertyIndex.indexOf(toInt(VehicleProperty::DISPLAY_BRIGHTNESS)) == 4,
+              "wrong index of DISPLAY_BRIGHTNESS");
+
+TEST(PropertyPerfectHashTest, indexOf) {
+    for (size_t i = 0; i < arraysize(kPropertyIds); i++) {
+        ASSERT_EQ(static_cast<int>(i), kPropertyIndex.indexOf(kPropertyIds[i]));
+    }
+    ASSERT_EQ(-1, kPropertyIndex.indexOf(toInt(VehicleProperty::PERF_VEHICLE_SPEED)));
+    ASSERT_EQ(-1, kPropertyIndex.indexOf(0));
+}
+
+TEST(PropertyPerfectHashTest, manyProperties) {
+    int32_t ids[512] = {};
+    for (size_t i = 0; i < arraysize(ids); i++) {
+        ids[i] = static_cast<int32_t>(0x0100 + i) | VehiclePropertyGroup::VENDOR |
+                 VehiclePropertyType::INT32 | VehicleArea::GLOBAL;
+    }
+    std::unique_ptr<PropertyPerfectHash<arraysize(ids)>> index(
+            new PropertyPerfectHash<arraysize(ids)>(ids));
+    ASSERT_TRUE(index->isValid());
+    for (size_t i = 0; i < arraysize(ids); i++) {
+        ASSERT_EQ(static_cast<int>(i), index->indexOf(ids[i]));
+    }
+    ASSERT_EQ(-1, index->indexOf(ids[0] + 0x1000));
+}
+
+TEST(PropertyPerfectHashTest, duplicates) {
+    const int32_t ids[] = {
+        toInt(VehicleProperty::INFO_MAKE),
+        toInt(VehicleProperty::HVAC_FAN_SPEED),
+        toInt(VehicleProperty::INFO_MAKE),
+    };
+    ASSERT_FALSE(PropertyPerfectHash<arraysize(ids)>(ids).isValid());
+}
+
+}  // namespace anonymous
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -70,4 +70,60 @@ TEST(RecurrentTimerTest, multipleIntervals) {
     ASSERT_EQ_WITH_TOLERANCE(20, counter5ms.load(), 5);
 }
 
+TEST(RecurrentTimerTest, oneIntervalTimerFd) {
+    std::atomic<int64_t> counter { 0L };
+    auto counterRef = std::ref(counter);
+    RecurrentTimer timer([&counterRef](const std::vector<int32_t>& cookies) {
+        ASSERT_EQ(1u, cookies.size());
+        ASSERT_EQ(0xdead, cookies.front());
+        counterRef.get()++;
+    }, true /* useTimerFd */);
+
+    timer.registerRecurrentEvent(milliseconds(1), 0xdead);
+    std::this_thread::sleep_for(milliseconds(100));
+    ASSERT_EQ_WITH_TOLERANCE(100, counter.load(), 20);
+}
+
+TEST(RecurrentTimerTest, sharedIntervalIsGrouped) {
+    std::atomic<int64_t> wakeUps { 0L };
+    std::atomic<int64_t> events { 0L };
+    auto wakeUpsRef = std::ref(wakeUps);
+    auto eventsRef = std::ref(events);
+    RecurrentTimer timer([&wakeUpsRef, &eventsRef](const std::vector<int32_t>& cookies) {
+        wakeUpsRef.get()++;
+        eventsRef.get() += cookies.size();
+    });
+
+    for (int32_t cookie = 1; cookie <= 10; cookie++) {
+        timer.registerRecurrentEvent(milliseconds(5), cookie);
+    }
+    std::this_thread::sleep_for(milliseconds(100));
+    // 10 cookies with the same interval are reported in a single wake-up.
+    ASSERT_EQ_WITH_TOLERANCE(20, wakeUps.load(), 5);
+    ASSERT_LE(wakeUps.load() * 9, events.load());
+}
+
+TEST(RecurrentTimerTest, reregisterAndUnregister) {
+    std::atomic<int64_t> counter { 0L };
+    auto counterRef = std::ref(counter);
+    RecurrentTimer timer([&counterRef](const std::vector<int32_t>& cookies) {
+        for (int32_t cookie : cookies) {
+            if (cookie != 0xdead) FAIL();
+        }
+        counterRef.get()++;
+    });
+
+    timer.registerRecurrentEvent(milliseconds(1), 0xdead);
+    // Overrides interval provided before.
+    timer.registerRecurrentEvent(milliseconds(10), 0xdead);
+    std::this_thread::sleep_for(milliseconds(100));
+    ASSERT_EQ_WITH_TOLERANCE(10, counter.load(), 3);
+
+    timer.unregisterRecurrentEvent(0xdead);
+    std::this_thread::sleep_for(milliseconds(5));
+    int64_t afterUnregister = counter.load();
+    std::this_thread::sleep_for(milliseconds(50));
+    ASSERT_EQ(afterUnregister, counter.load());
+}
+
 }  // anonymous namespace
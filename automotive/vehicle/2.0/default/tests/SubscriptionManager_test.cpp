@@ -188,6 +188,128 @@ TEST_F(SubscriptionManagerTest, unsubscribe) {
     assertLastUnsubscribedProperty(PROP1);
 }
 
+TEST_F(SubscriptionManagerTest, distributeValuesToClients) {
+    std::list<SubscribeOptions> updatedOptions;
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(1, cb1, subscrToProp1, &updatedOptions));
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(2, cb2, subscrToProp2, &updatedOptions));
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(3, cb3, subscrToProp1and2, &updatedOptions));
+
+    VehiclePropValuePool pool;
+    std::vector<recyclable_ptr<VehiclePropValue>> values;
+    for (int32_t prop : { PROP1, PROP2, PROP1, toInt(VehicleProperty::INFO_MAKE) }) {
+        values.push_back(pool.obtainInt32(prop));
+        values.back()->prop = prop;
+    }
+
+    DistributedValues distributed;
+    manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR, &distributed);
+    std::map<sp<IVehicleCallback>, std::vector<VehiclePropValue*>> received;
+    for (const auto& cv : distributed) {
+        received[cv.client->getCallback()].assign(cv.begin(), cv.end());
+    }
+    ASSERT_EQ(3u, received.size());
+    ASSERT_EQ((std::vector<VehiclePropValue*> { values[0].get(), values[2].get() }), received[cb1]);
+    ASSERT_EQ((std::vector<VehiclePropValue*> { values[1].get() }), received[cb2]);
+    ASSERT_EQ((std::vector<VehiclePropValue*> { values[0].get(), values[1].get(),
+                                                values[2].get() }),
+              received[cb3]);
+
+    // Flags are resolved per subscriber.
+    manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_ANDROID, &distributed);
+    ASSERT_EQ(0u, distributed.size());
+
+    // Fan-out is rebuilt on unsubscribe.
+    manager.unsubscribe(3, PROP1);
+    manager.unsubscribe(3, PROP2);
+    manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR, &distributed);
+    ASSERT_EQ(2u, distributed.size());
+    for (const auto& cv : distributed) {
+        ASSERT_NE(cb3, cv.client->getCallback());
+    }
+
+    distributed.clear();
+    ASSERT_EQ(0u, distributed.size());
+}
+
+TEST_F(SubscriptionManagerTest, decimatePerClientSampleRate) {
+    const int32_t prop = toInt(VehicleProperty::PERF_VEHICLE_SPEED);
+    std::list<SubscribeOptions> updatedOptions;
+    ASSERT_EQ(StatusCode::OK, manager.addOrUpdateSubscription(
+        1, cb1, { SubscribeOptions { .propId = prop, .sampleRate = 100,
+                                     .flags = SubscribeFlags::EVENTS_FROM_CAR } },
+        &updatedOptions));
+    ASSERT_EQ(StatusCode::OK, manager.addOrUpdateSubscription(
+        2, cb2, { SubscribeOptions { .propId = prop, .sampleRate = 1,
+                                     .flags = SubscribeFlags::EVENTS_FROM_CAR } },
+        &updatedOptions));
+    ASSERT_EQ(StatusCode::OK, manager.addOrUpdateSubscription(
+        3, cb3, { SubscribeOptions { .propId = prop, .sampleRate = 10,
+                                     .flags = SubscribeFlags::EVENTS_FROM_CAR } },
+        &updatedOptions));
+
+    // 100 Hz source with a bit of jitter during 10 seconds.
+    VehiclePropValuePool pool;
+    DistributedValues distributed;
+    std::map<sp<IVehicleCallback>, int> received;
+    for (int i = 0; i < 1000; i++) {
+        std::vector<recyclable_ptr<VehiclePropValue>> values;
+        values.push_back(pool.obtainFloat(i));
+        values.back()->prop = prop;
+        values.back()->timestamp = 1000000000ll + i * 10000000ll + (i % 2 ? 100000 : -100000);
+        manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR, &distributed);
+        for (const auto& cv : distributed) {
+            received[cv.client->getCallback()] += cv.count;
+        }
+    }
+
+    // Decimated clients may get one extra value depending on the phase of the source.
+    ASSERT_EQ(1000, received[cb1]);
+    ASSERT_LE(10, received[cb2]);
+    ASSERT_GE(11, received[cb2]);
+    ASSERT_LE(100, received[cb3]);
+    ASSERT_GE(101, received[cb3]);
+}
+
+TEST_F(SubscriptionManagerTest, distributeValuesToManyClients) {
+    // C clients are subscribed to all of P properties, every batch has a value for each property.
+    const int C = 6;
+    const int P = 40;
+    const int N = 10000;
+
+    hidl_vec<SubscribeOptions> options;
+    options.resize(P);
+    for (int i = 0; i < P; i++) {
+        options[i] = SubscribeOptions { .propId = PROP1 + i,
+                                        .flags = SubscribeFlags::EVENTS_FROM_CAR };
+    }
+    std::list<SubscribeOptions> updatedOptions;
+    for (int c = 0; c < C; c++) {
+        ASSERT_EQ(StatusCode::OK, manager.addOrUpdateSubscription(
+            c + 1, new MockedVehicleCallback(), options, &updatedOptions));
+    }
+
+    VehiclePropValuePool pool;
+    std::vector<recyclable_ptr<VehiclePropValue>> values;
+    for (int i = 0; i < P; i++) {
+        values.push_back(pool.obtainInt32(i));
+        values.back()->prop = PROP1 + i;
+    }
+
+    DistributedValues distributed;
+    size_t distributedCount = 0;
+    for (int i = 0; i < N; i++) {
+        manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR, &distributed);
+        for (const auto& cv : distributed) {
+            distributedCount += cv.count;
+        }
+    }
+
+    ASSERT_EQ(static_cast<size_t>(C * P * N), distributedCount);
+}
+
 }  // namespace anonymous
 
 }  // namespace V2_0
@@ -287,6 +287,50 @@ TEST_F(VehicleHalManagerTest, subscribe) {
               toString(cb->getReceivedEvents().front()[0]));
 }
 
+TEST_F(VehicleHalManagerTest, subscribe_LockFreeEventQueue) {
+    VehicleHalManager::Options managerOptions;
+    managerOptions.lockFreeEventQueue = true;
+    manager.reset(new VehicleHalManager(hal.get(), managerOptions));
+    objectPool = hal->getValuePool();
+
+    const auto PROP = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+    sp<MockedVehicleCallback> cb = new MockedVehicleCallback();
+    hidl_vec<SubscribeOptions> options = {
+        SubscribeOptions{.propId = PROP, .flags = SubscribeFlags::EVENTS_FROM_CAR}};
+    ASSERT_EQ(StatusCode::OK, manager->subscribe(cb, options));
+
+    auto subscribedValue = objectPool->obtain(VehiclePropertyType::INT32);
+    subscribedValue->prop = PROP;
+    subscribedValue->value.int32Values[0] = 42;
+    VehiclePropValue expectedValue(*subscribedValue.get());
+    hal->sendPropEvent(std::move(subscribedValue));
+
+    ASSERT_TRUE(cb->waitForExpectedEvents(1));
+    ASSERT_EQ(toString(expectedValue), toString(cb->getReceivedEvents().front()[0]));
+}
+
+TEST_F(VehicleHalManagerTest, subscribe_ClientDispatchThreads) {
+    VehicleHalManager::Options managerOptions;
+    managerOptions.clientDispatchThreads = 2;
+    manager.reset(new VehicleHalManager(hal.get(), managerOptions));
+    objectPool = hal->getValuePool();
+
+    const auto PROP = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+    sp<MockedVehicleCallback> cb = new MockedVehicleCallback();
+    hidl_vec<SubscribeOptions> options = {
+        SubscribeOptions{.propId = PROP, .flags = SubscribeFlags::EVENTS_FROM_CAR}};
+    ASSERT_EQ(StatusCode::OK, manager->subscribe(cb, options));
+
+    auto subscribedValue = objectPool->obtain(VehiclePropertyType::INT32);
+    subscribedValue->prop = PROP;
+    subscribedValue->value.int32Values[0] = 42;
+    VehiclePropValue expectedValue(*subscribedValue.get());
+    hal->sendPropEvent(std::move(subscribedValue));
+
+    ASSERT_TRUE(cb->waitForExpectedEvents(1));
+    ASSERT_EQ(toString(expectedValue), toString(cb->getReceivedEvents().front()[0]));
+}
+
 TEST_F(VehicleHalManagerTest, subscribe_WriteOnly) {
     const auto PROP = toInt(VehicleProperty::HVAC_SEAT_TEMPERATURE);
 
@@ -416,6 +460,19 @@ TEST_F(VehicleHalManagerTest, set_DifferentAreas) {
     }
 }
 
+TEST_F(VehicleHalManagerTest, debugDump_Metrics) {
+    auto value = hal->getValuePool()->obtainInt32(7);
+    value->prop = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+    ASSERT_EQ(StatusCode::OK, manager->set(*value.get()));
+    invokeGet(toInt(VehicleProperty::MIRROR_Z_MOVE), 0);  // Rejected before reaching the HAL.
+    invokeGet(toInt(VehicleProperty::INFO_MAKE), 0);
+
+    std::string dump;
+    manager->debugDump([&dump](const hidl_string& out) { dump = out; });
+    ASSERT_NE(std::string::npos, dump.find("get calls: 1, errors: 0\n"));
+    ASSERT_NE(std::string::npos, dump.find("set calls: 1, errors: 0\n"));
+}
+
 TEST_F(VehicleHalManagerTest, set_Retriable) {
     const auto PROP = toInt(VehicleProperty::MIRROR_FOLD);
 
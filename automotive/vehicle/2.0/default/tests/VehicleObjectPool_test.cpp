@@ -21,6 +21,7 @@
 #include <utils/SystemClock.h>
 
 #include "vhal_v2_0/VehicleObjectPool.h"
+#include "vhal_v2_0/VehicleUtils.h"
 
 namespace android {
 namespace hardware {
@@ -49,6 +50,9 @@ private:
         stats->Obtained = 0;
         stats->Created = 0;
         stats->Recycled = 0;
+        stats->MagazineMisses = 0;
+        stats->ArenaSlotsCreated = 0;
+        stats->ArenaBuffersAllocated = 0;
     }
 
 public:
@@ -122,6 +126,115 @@ TEST_F(VehicleObjectPoolTest, valuePoolMultithreadedBenchmark) {
                                  // Typically it takes about 0.1s on Nexus6P.
 }
 
+TEST_F(VehicleObjectPoolTest, valuePoolMagazineHits) {
+    for (int i = 0; i < 100; i++) {
+        auto value = valuePool->obtain(VehiclePropertyType::INT32_VEC, 3);
+        ASSERT_EQ(3u, value->value.int32Values.size());
+    }
+    // Only the very first obtain had to go to the shared depot.
+    ASSERT_EQ(1u, stats->Created);
+    ASSERT_EQ(1u, stats->MagazineMisses);
+    ASSERT_EQ(99u, stats->getMagazineHits());
+    ASSERT_FLOAT_EQ(0.99f, stats->getMagazineHitRate());
+}
+
+TEST_F(VehicleObjectPoolTest, valuePoolCrossThreadRecycle) {
+    // Values obtained on one thread and recycled on another must be reused through the depot.
+    const int N = 40;
+    for (int round = 0; round < 10; round++) {
+        std::vector<recyclable_ptr<VehiclePropValue>> values;
+        for (int i = 0; i < N; i++) {
+            values.push_back(valuePool->obtain(VehiclePropertyType::FLOAT));
+        }
+        std::thread([&values] () {
+            values.clear();
+        }).join();
+    }
+    ASSERT_GE(static_cast<uint32_t>(N), stats->Created);
+    ASSERT_EQ(stats->Obtained, stats->Recycled);
+}
+
+TEST_F(VehicleObjectPoolTest, arenaDeepCopy) {
+    VehiclePropValueArena arena;
+    auto a = valuePool->obtainInt32(1);
+    a->prop = 10;
+    auto b = valuePool->obtainFloat(2.0f);
+    b->prop = 20;
+
+    arena.appendDeepCopy(*a);
+    arena.appendDeepCopy(*b);
+    ASSERT_EQ(2u, arena.size());
+
+    // Arena owns its copies, updating the originals doesn't affect them.
+    a->value.int32Values[0] = 5;
+    ASSERT_EQ(1, arena[0].value.int32Values[0]);
+    ASSERT_EQ(20, arena[1].prop);
+
+    arena.replaceWithDeepCopy(0, *a);
+    ASSERT_EQ(5, arena[0].value.int32Values[0]);
+
+    hidl_vec<VehiclePropValue> vec = arena.toHidlVec();
+    ASSERT_EQ(2u, vec.size());
+    ASSERT_EQ(&arena[0], &vec[0]);
+
+    arena.clear();
+    ASSERT_TRUE(arena.empty());
+    ASSERT_EQ(0u, arena.toHidlVec().size());
+}
+
+TEST_F(VehicleObjectPoolTest, valuePoolCopyReusesBuffers) {
+    auto src = valuePool->obtainInt32(42);
+    src->prop = toInt(VehicleProperty::HVAC_FAN_SPEED);
+
+    auto recycled = valuePool->obtainInt32(0);
+    const int32_t* data = recycled->value.int32Values.data();
+    recycled.reset();
+
+    // The copy lands in the recycled object and is written into its vector.
+    auto copy = valuePool->obtain(*src);
+    ASSERT_EQ(data, copy->value.int32Values.data());
+    ASSERT_EQ(42, copy->value.int32Values[0]);
+    ASSERT_EQ(src->prop, copy->prop);
+}
+
+TEST_F(VehicleObjectPoolTest, arenaNoAllocationsInSteadyState) {
+    VehiclePropValueArena arena;
+    std::vector<recyclable_ptr<VehiclePropValue>> values;
+    for (int i = 0; i < 10; i++) {
+        values.push_back(valuePool->obtainInt64(i));
+    }
+
+    for (const auto& v : values) {
+        arena.appendDeepCopy(*v);
+    }
+    ASSERT_EQ(10u, stats->ArenaSlotsCreated);
+    uint32_t buffersAllocated = stats->ArenaBuffersAllocated;
+
+    // Batches of the same shape reuse slots and their buffers.
+    for (int batch = 0; batch < 100; batch++) {
+        arena.clear();
+        for (const auto& v : values) {
+            v->value.int64Values[0] = batch;
+            arena.appendDeepCopy(*v);
+        }
+        ASSERT_EQ(batch, arena[9].value.int64Values[0]);
+    }
+    ASSERT_EQ(10u, stats->ArenaSlotsCreated);
+    ASSERT_EQ(buffersAllocated, stats->ArenaBuffersAllocated);
+}
+
+TEST_F(VehicleObjectPoolTest, arenaShallowCopy) {
+    VehiclePropValueArena arena;
+    auto value = valuePool->obtainInt32(7);
+    for (int batch = 0; batch < 10; batch++) {
+        arena.clear();
+        arena.appendShallowCopy(*value);
+        ASSERT_EQ(value->value.int32Values.data(), arena[0].value.int32Values.data());
+    }
+    ASSERT_EQ(1u, stats->ArenaSlotsCreated);
+    ASSERT_EQ(0u, stats->ArenaBuffersAllocated);
+}
+
 }  // namespace anonymous
 
 }  // namespace V2_0
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <map>
+#include <set>
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/VehiclePropValueIndex.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+constexpr int32_t kProp = toInt(VehicleProperty::HVAC_FAN_SPEED);
+
+VehiclePropValue makeValue(int32_t prop, int32_t area) {
+    VehiclePropValue v {};
+    v.prop = prop;
+    v.areaId = area;
+    v.value.int32Values = hidl_vec<int32_t> { area };
+    return v;
+}
+
+TEST(VehiclePropValueIndexTest, insertFindErase) {
+    VehiclePropValueIndex index;
+    ASSERT_EQ(nullptr, index.find(kProp, 1));
+
+    index.insert(kProp, 1, makeValue(kProp, 1));
+    index.insert(kProp, 2, makeValue(kProp, 2));
+    ASSERT_EQ(2u, index.size());
+    ASSERT_EQ(1, index.find(kProp, 1)->areaId);
+    ASSERT_EQ(2, index.find(kProp, 2)->areaId);
+    ASSERT_EQ(nullptr, index.find(kProp + 1, 1));
+
+    ASSERT_TRUE(index.erase(kProp, 1));
+    ASSERT_FALSE(index.erase(kProp, 1));
+    ASSERT_EQ(nullptr, index.find(kProp, 1));
+    ASSERT_EQ(2, index.find(kProp, 2)->areaId);
+    ASSERT_EQ(1u, index.size());
+}
+
+TEST(VehiclePropValueIndexTest, eraseProperty) {
+    VehiclePropValueIndex index;
+    for (int32_t area = 0; area < 10; area++) {
+        index.insert(kProp, area, makeValue(kProp, area));
+        index.insert(kProp + 1, area, makeValue(kProp + 1, area));
+    }
+
+    index.eraseProperty(kProp);
+    ASSERT_EQ(10u, index.size());
+
+    size_t count = 0;
+    index.forEachValueOfProperty(kProp + 1, [&count] (const VehiclePropValue& v) {
+        ASSERT_EQ(kProp + 1, v.prop);
+        count++;
+    });
+    ASSERT_EQ(10u, count);
+    index.forEachValueOfProperty(kProp, [] (const VehiclePropValue&) { FAIL(); });
+}
+
+TEST(VehiclePropValueIndexTest, matchesSortedMap) {
+    // Grows the index well past its initial capacity while erasing values to exercise rehashing
+    // and tombstones, std::map is used as a reference.
+    VehiclePropValueIndex index;
+    std::map<std::pair<int32_t, int32_t>, int32_t> reference;
+
+    for (int32_t i = 0; i < 5000; i++) {
+        int32_t prop = kProp + i % 37;
+        int32_t area = (i * 7919) % 101;
+        auto key = std::make_pair(prop, area);
+        if (reference.count(key)) {
+            ASSERT_TRUE(index.erase(prop, area));
+            reference.erase(key);
+        } else {
+            index.insert(prop, area, makeValue(prop, area));
+            reference[key] = area;
+        }
+    }
+
+    ASSERT_EQ(reference.size(), index.size());
+    for (const auto& entry : reference) {
+        const VehiclePropValue* v = index.find(entry.first.first, entry.first.second);
+        ASSERT_NE(nullptr, v);
+        ASSERT_EQ(entry.second, v->value.int32Values[0]);
+    }
+
+    for (int32_t prop = kProp; prop < kProp + 37; prop++) {
+        std::set<int32_t> areas;
+        index.forEachValueOfProperty(prop, [prop, &areas] (const VehiclePropValue& v) {
+            ASSERT_EQ(prop, v.prop);
+            ASSERT_TRUE(areas.insert(v.areaId).second);
+        });
+        std::set<int32_t> expected;
+        for (auto it = reference.lower_bound(std::make_pair(prop, INT32_MIN));
+             it != reference.end() && it->first.first == prop; ++it) {
+            expected.insert(it->first.second);
+        }
+        ASSERT_EQ(expected, areas);
+    }
+}
+
+}  // namespace anonymous
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <thread>
+#include <unordered_set>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/VehiclePropertyStore.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+constexpr int32_t kGlobalProp = toInt(VehicleProperty::PERF_VEHICLE_SPEED);
+constexpr int32_t kZonedProp = toInt(VehicleProperty::HVAC_FAN_SPEED);
+constexpr int32_t kTokenProp = toInt(VehicleProperty::OBD2_FREEZE_FRAME);
+
+VehiclePropValue makeValue(int32_t prop, int32_t area, int64_t timestamp) {
+    VehiclePropValue v {};
+    v.prop = prop;
+    v.areaId = area;
+    v.timestamp = timestamp;
+    v.value.int32Values = hidl_vec<int32_t> { static_cast<int32_t>(timestamp) };
+    return v;
+}
+
+class VehiclePropertyStoreTest
+        : public ::testing::TestWithParam<VehiclePropertyStore::Mode> {
+protected:
+    void SetUp() override {
+        store.reset(new VehiclePropertyStore(GetParam()));
+        store->registerProperty(VehiclePropConfig { .prop = kGlobalProp });
+        store->registerProperty(VehiclePropConfig { .prop = kZonedProp });
+        store->registerProperty(VehiclePropConfig { .prop = kTokenProp },
+                                [] (const VehiclePropValue& v) { return v.timestamp; });
+    }
+
+public:
+    std::unique_ptr<VehiclePropertyStore> store;
+};
+
+TEST_P(VehiclePropertyStoreTest, configs) {
+    ASSERT_EQ(3u, store->getAllConfigs().size());
+    ASSERT_NE(nullptr, store->getConfigOrNull(kGlobalProp));
+    ASSERT_EQ(kZonedProp, store->getConfigOrNull(kZonedProp)->prop);
+    ASSERT_EQ(nullptr, store->getConfigOrNull(toInt(VehicleProperty::INFO_MAKE)));
+}
+
+TEST_P(VehiclePropertyStoreTest, writeAndRead) {
+    ASSERT_EQ(nullptr, store->readValueOrNull(kGlobalProp));
+    ASSERT_FALSE(store->writeValue(makeValue(toInt(VehicleProperty::INFO_MAKE), 0, 1), true));
+
+    ASSERT_TRUE(store->writeValue(makeValue(kGlobalProp, 0, 1), true));
+    ASSERT_TRUE(store->writeValue(makeValue(kGlobalProp, 0, 2), true));
+    auto v = store->readValueOrNull(kGlobalProp);
+    ASSERT_NE(nullptr, v.get());
+    ASSERT_EQ(2, v->timestamp);
+
+    ASSERT_TRUE(store->writeValue(makeValue(kZonedProp, 1, 10), true));
+    ASSERT_TRUE(store->writeValue(makeValue(kZonedProp, 4, 20), true));
+    ASSERT_EQ(10, store->readValueOrNull(kZonedProp, 1)->timestamp);
+    ASSERT_EQ(20, store->readValueOrNull(makeValue(kZonedProp, 4, 0))->timestamp);
+    ASSERT_EQ(2u, store->readValuesForProperty(kZonedProp).size());
+    ASSERT_EQ(3u, store->readAllValues().size());
+}
+
+TEST_P(VehiclePropertyStoreTest, updateStatus) {
+    auto value = makeValue(kGlobalProp, 0, 1);
+    value.status = VehiclePropertyStatus::UNAVAILABLE;
+    ASSERT_TRUE(store->writeValue(value, true));
+
+    value.status = VehiclePropertyStatus::AVAILABLE;
+    ASSERT_TRUE(store->writeValue(value, false));
+    ASSERT_EQ(VehiclePropertyStatus::UNAVAILABLE, store->readValueOrNull(kGlobalProp)->status);
+
+    ASSERT_TRUE(store->writeValue(value, true));
+    ASSERT_EQ(VehiclePropertyStatus::AVAILABLE, store->readValueOrNull(kGlobalProp)->status);
+}
+
+TEST_P(VehiclePropertyStoreTest, tokensAndRemoval) {
+    for (int64_t token = 1; token <= 5; token++) {
+        ASSERT_TRUE(store->writeValue(makeValue(kTokenProp, 0, token), true));
+    }
+    ASSERT_EQ(5u, store->readValuesForProperty(kTokenProp).size());
+    ASSERT_NE(nullptr, store->readValueOrNull(kTokenProp, 0, 3).get());
+
+    store->removeValue(makeValue(kTokenProp, 0, 3));
+    ASSERT_EQ(nullptr, store->readValueOrNull(kTokenProp, 0, 3).get());
+    ASSERT_EQ(4u, store->readValuesForProperty(kTokenProp).size());
+
+    store->removeValuesForProperty(kTokenProp);
+    ASSERT_EQ(0u, store->readValuesForProperty(kTokenProp).size());
+}
+
+TEST_P(VehiclePropertyStoreTest, snapshotRoundTrip) {
+    const std::string path = ::testing::TempDir() + "vhal_store_snapshot";
+    auto zoned = makeValue(kZonedProp, 4, 20);
+    zoned.value.floatValues = hidl_vec<float> { 1.5f, 2.5f };
+    zoned.value.bytes = hidl_vec<uint8_t> { 1, 2, 3 };
+    zoned.value.stringValue = "fan";
+    zoned.status = VehiclePropertyStatus::UNAVAILABLE;
+    ASSERT_TRUE(store->writeValue(makeValue(kGlobalProp, 0, 1), true));
+    ASSERT_TRUE(store->writeValue(zoned, true));
+    for (int64_t token = 1; token <= 3; token++) {
+        ASSERT_TRUE(store->writeValue(makeValue(kTokenProp, 0, token), true));
+    }
+    ASSERT_TRUE(store->saveSnapshot(path));
+
+    std::unique_ptr<VehiclePropertyStore> restored(new VehiclePropertyStore(GetParam()));
+    restored->registerProperty(VehiclePropConfig { .prop = kGlobalProp });
+    restored->registerProperty(VehiclePropConfig { .prop = kTokenProp },
+                               [] (const VehiclePropValue& v) { return v.timestamp; });
+    const std::unordered_set<int32_t> allowed { kGlobalProp, kTokenProp, kZonedProp };
+    // kTokenProp is not allowed, so its values are skipped
+    ASSERT_EQ(1u, restored->restoreSnapshot(path, { kGlobalProp }));
+    ASSERT_EQ(0u, restored->readValuesForProperty(kTokenProp).size());
+    // kZonedProp is not registered, so its value is skipped
+    ASSERT_EQ(4u, restored->restoreSnapshot(path, allowed));
+    ASSERT_EQ(nullptr, restored->readValueOrNull(kZonedProp, 4).get());
+    ASSERT_EQ(3u, restored->readValuesForProperty(kTokenProp).size());
+    ASSERT_NE(nullptr, restored->readValueOrNull(kTokenProp, 0, 2).get());
+
+    auto global = restored->readValueOrNull(kGlobalProp);
+    ASSERT_NE(nullptr, global.get());
+    ASSERT_EQ(1, global->timestamp);
+    ASSERT_TRUE(restored->writeValue(makeValue(kGlobalProp, 0, 5), true));
+    ASSERT_EQ(5, restored->readValueOrNull(kGlobalProp)->timestamp);
+
+    restored->registerProperty(VehiclePropConfig { .prop = kZonedProp });
+    ASSERT_EQ(5u, restored->restoreSnapshot(path, allowed));
+    auto zonedRestored = restored->readValueOrNull(kZonedProp, 4);
+    ASSERT_NE(nullptr, zonedRestored.get());
+    ASSERT_EQ(VehiclePropertyStatus::UNAVAILABLE, zonedRestored->status);
+    ASSERT_EQ(zoned.value.floatValues, zonedRestored->value.floatValues);
+    ASSERT_EQ(zoned.value.bytes, zonedRestored->value.bytes);
+    ASSERT_EQ(zoned.value.stringValue, zonedRestored->value.stringValue);
+
+    unlink(path.c_str());
+}
+
+TEST_P(VehiclePropertyStoreTest, snapshotInvalid) {
+    const std::string path = ::testing::TempDir() + "vhal_store_snapshot_invalid";
+    ASSERT_EQ(0u, store->restoreSnapshot(path, { kGlobalProp }));
+
+    ASSERT_TRUE(store->writeValue(makeValue(kGlobalProp, 0, 1), true));
+    ASSERT_TRUE(store->saveSnapshot(path));
+    ASSERT_EQ(0, truncate(path.c_str(), 20));
+    ASSERT_EQ(0u, store->restoreSnapshot(path, { kGlobalProp }));
+    auto global = store->readValueOrNull(kGlobalProp);
+    ASSERT_NE(nullptr, global.get());
+    ASSERT_EQ(1, global->timestamp);
+
+    unlink(path.c_str());
+}
+
+TEST_P(VehiclePropertyStoreTest, contendedReads) {
+    // W writer threads continuously update properties while R reader threads fetch them,
+    // every reader performs N reads.
+    const int W = 2;
+    const int R = 4;
+    const int N = 20000;
+
+    ASSERT_TRUE(store->writeValue(makeValue(kGlobalProp, 0, 0), true));
+    ASSERT_TRUE(store->writeValue(makeValue(kZonedProp, 1, 0), true));
+
+    std::atomic<bool> stopWriters { false };
+    auto storePtr = store.get();
+
+    std::vector<std::thread> writers;
+    for (int i = 0; i < W; i++) {
+        writers.push_back(std::thread([storePtr, &stopWriters] () {
+            for (int64_t t = 1; !stopWriters; t++) {
+                storePtr->writeValue(makeValue(kGlobalProp, 0, t), true);
+                storePtr->writeValue(makeValue(kZonedProp, 1, t), true);
+            }
+        }));
+    }
+
+    std::vector<std::thread> readers;
+    std::atomic<int> misses { 0 };
+    for (int i = 0; i < R; i++) {
+        readers.push_back(std::thread([storePtr, &misses] () {
+            for (int j = 0; j < N; j++) {
+                auto v = storePtr->readValueOrNull(j % 2 ? kGlobalProp : kZonedProp, 1);
+                if (v == nullptr) misses++;
+            }
+        }));
+    }
+    for (auto& t : readers) {
+        t.join();
+    }
+
+    stopWriters = true;
+    for (auto& t : writers) {
+        t.join();
+    }
+
+    ASSERT_EQ(0, misses);
+}
+
+INSTANTIATE_TEST_CASE_P(AllModes, VehiclePropertyStoreTest,
+                        ::testing::Values(VehiclePropertyStore::Mode::SERIALIZED,
+                                          VehiclePropertyStore::Mode::CONCURRENT,
+                                          VehiclePropertyStore::Mode::FLAT_INDEX));
+
+}  // namespace anonymous
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/VehicleUtils.h"
+#include "vhal_v2_0/VmsRoutingTable.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace vms {
+
+namespace {
+
+std::unique_ptr<VehiclePropValue> createSubscriptionsChange(int32_t sequence_number) {
+    auto message = createBaseVmsMessage(2);
+    message->value.int32Values = hidl_vec<int32_t>{toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE),
+                                                   sequence_number,
+                                                   1,  // number of layers
+                                                   1,  // number of associated layers
+                                                   1,  // layer 1
+                                                   0,
+                                                   1,
+                                                   2,    // associated layer
+                                                   0,
+                                                   1,
+                                                   2,     // number of publisher IDs
+                                                   111,   // publisher IDs
+                                                   123};
+    return message;
+}
+
+TEST(VmsRoutingTableTest, routeSubscribedLayers) {
+    VmsRoutingTable table;
+    EXPECT_FALSE(table.isSubscribed(VmsLayerAndPublisher(VmsLayer(1, 0, 1), 123)));
+
+    ASSERT_TRUE(table.update(*createSubscriptionsChange(10)));
+    EXPECT_EQ(10, table.getSequenceNumber());
+
+    // Layers are subscribed for any publisher, associated layers only for listed publishers.
+    EXPECT_TRUE(table.isSubscribed(VmsLayerAndPublisher(VmsLayer(1, 0, 1), 123)));
+    EXPECT_TRUE(table.isSubscribed(VmsLayerAndPublisher(VmsLayer(1, 0, 1), 5)));
+    EXPECT_FALSE(table.isSubscribed(VmsLayerAndPublisher(VmsLayer(1, 1, 1), 123)));
+    EXPECT_FALSE(table.isSubscribed(VmsLayerAndPublisher(VmsLayer(1, 0, 2), 123)));
+    EXPECT_TRUE(table.isSubscribed(VmsLayerAndPublisher(VmsLayer(2, 0, 1), 111)));
+    EXPECT_TRUE(table.isSubscribed(VmsLayerAndPublisher(VmsLayer(2, 0, 1), 123)));
+    EXPECT_FALSE(table.isSubscribed(VmsLayerAndPublisher(VmsLayer(2, 0, 1), 5)));
+
+    EXPECT_TRUE(table.shouldRoute(*createDataMessageWithLayerPublisherInfo(
+            VmsLayerAndPublisher(VmsLayer(2, 0, 1), 123), "data")));
+    EXPECT_FALSE(table.shouldRoute(*createDataMessageWithLayerPublisherInfo(
+            VmsLayerAndPublisher(VmsLayer(3, 0, 1), 123), "data")));
+    EXPECT_FALSE(table.shouldRoute(*createSubscribeMessage(VmsLayer(1, 0, 1))));
+}
+
+TEST(VmsRoutingTableTest, updateWithNewerState) {
+    VmsRoutingTable table;
+    ASSERT_TRUE(table.update(*createSubscriptionsChange(10)));
+
+    auto unsubscribed = createBaseVmsMessage(2);
+    unsubscribed->value.int32Values = hidl_vec<int32_t>{
+            toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE), 9, 0, 0};
+    EXPECT_FALSE(table.update(*unsubscribed));
+    EXPECT_TRUE(table.isSubscribed(VmsLayerAndPublisher(VmsLayer(1, 0, 1), 123)));
+
+    unsubscribed->value.int32Values[1] = 11;
+    EXPECT_TRUE(table.update(*unsubscribed));
+    EXPECT_EQ(11, table.getSequenceNumber());
+    EXPECT_FALSE(table.isSubscribed(VmsLayerAndPublisher(VmsLayer(1, 0, 1), 123)));
+    EXPECT_FALSE(table.isSubscribed(VmsLayerAndPublisher(VmsLayer(2, 0, 1), 123)));
+}
+
+TEST(VmsRoutingTableTest, routeAllDataWithoutState) {
+    VmsRoutingTable table;
+    EXPECT_TRUE(table.shouldRoute(*createDataMessageWithLayerPublisherInfo(
+            VmsLayerAndPublisher(VmsLayer(3, 0, 1), 123), "data")));
+    EXPECT_FALSE(table.shouldRoute(*createSubscribeMessage(VmsLayer(1, 0, 1))));
+}
+
+TEST(VmsRoutingTableTest, resetForNewSession) {
+    VmsRoutingTable table;
+    ASSERT_TRUE(table.update(*createSubscriptionsChange(10)));
+    EXPECT_FALSE(table.shouldRoute(*createDataMessageWithLayerPublisherInfo(
+            VmsLayerAndPublisher(VmsLayer(3, 0, 1), 123), "data")));
+
+    table.reset();
+    EXPECT_EQ(-1, table.getSequenceNumber());
+    EXPECT_TRUE(table.shouldRoute(*createDataMessageWithLayerPublisherInfo(
+            VmsLayerAndPublisher(VmsLayer(3, 0, 1), 123), "data")));
+
+    // The new session numbers its states from the start again.
+    auto restarted = createBaseVmsMessage(2);
+    restarted->value.int32Values = hidl_vec<int32_t>{
+            toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE), 0, 0, 0};
+    EXPECT_TRUE(table.update(*restarted));
+    EXPECT_FALSE(table.shouldRoute(*createDataMessageWithLayerPublisherInfo(
+            VmsLayerAndPublisher(VmsLayer(1, 0, 1), 123), "data")));
+}
+
+TEST(VmsRoutingTableTest, ignoreInvalidState) {
+    VmsRoutingTable table;
+    auto message = createSubscriptionsChange(10);
+    message->value.int32Values.resize(message->value.int32Values.size() - 1);
+    EXPECT_FALSE(table.update(*message));
+    EXPECT_FALSE(table.update(*createSubscribeMessage(VmsLayer(1, 0, 1))));
+    EXPECT_EQ(-1, table.getSequenceNumber());
+}
+
+}  // namespace anonymous
+
+}  // namespace vms
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -319,6 +319,128 @@ TEST(VmsUtilsTest, subscribedLayersWithDifferentPublisherId) {
     EXPECT_TRUE(getSubscribedLayers(*message, offers).empty());
 }
 
+TEST(VmsUtilsTest, subscribedLayersSkipsPublisherIdsOfNotOfferedLayers) {
+    VmsOffers offers = {123, {VmsLayerOffering(VmsLayer(2, 0, 1))}};
+    auto message = createBaseVmsMessage(2);
+    message->value.int32Values = hidl_vec<int32_t>{toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE),
+                                                   1234,  // sequence number
+                                                   0,     // number of layers
+                                                   2,     // number of associated layers
+                                                   1,     // associated layer 1, not offered
+                                                   0,
+                                                   1,
+                                                   1,    // number of publisher IDs
+                                                   123,  // publisher ID 1
+                                                   2,    // associated layer 2
+                                                   0,
+                                                   1,
+                                                   1,     // number of publisher IDs
+                                                   123};  // publisher ID 1
+    auto result = getSubscribedLayers(*message, offers);
+    ASSERT_EQ(1u, result.size());
+    EXPECT_EQ(result.at(0), VmsLayer(2, 0, 1));
+}
+
+TEST(VmsUtilsTest, subscriptionsStateView) {
+    auto message = createBaseVmsMessage(2);
+    message->value.int32Values = hidl_vec<int32_t>{toInt(VmsMessageType::SUBSCRIPTIONS_RESPONSE),
+                                                   1234,  // sequence number
+                                                   2,     // number of layers
+                                                   1,     // number of associated layers
+                                                   1,     // layer 1
+                                                   0,
+                                                   1,
+                                                   4,  // layer 2
+                                                   1,
+                                                   1,
+                                                   2,  // associated layer
+                                                   0,
+                                                   1,
+                                                   2,    // number of publisher IDs
+                                                   111,  // publisher IDs
+                                                   123};
+    VmsSubscriptionsStateView state;
+    ASSERT_TRUE(state.parse(*message));
+    EXPECT_EQ(1234, state.getSequenceNumber());
+    ASSERT_EQ(2u, state.getLayerCount());
+    EXPECT_EQ(VmsLayer(1, 0, 1), state.getLayer(0));
+    EXPECT_EQ(VmsLayer(4, 1, 1), state.getLayer(1));
+    ASSERT_EQ(1u, state.getAssociatedLayerCount());
+
+    int associated_layers = 0;
+    state.forEachAssociatedLayer([&](const VmsLayer& layer, const int32_t* publisher_ids,
+                                     size_t publisher_id_count) {
+        associated_layers++;
+        EXPECT_EQ(VmsLayer(2, 0, 1), layer);
+        ASSERT_EQ(2u, publisher_id_count);
+        EXPECT_EQ(111, publisher_ids[0]);
+        EXPECT_EQ(123, publisher_ids[1]);
+    });
+    EXPECT_EQ(1, associated_layers);
+}
+
+TEST(VmsUtilsTest, truncatedSubscriptionsStateView) {
+    auto message = createBaseVmsMessage(2);
+    message->value.int32Values = hidl_vec<int32_t>{toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE),
+                                                   1234,  // sequence number
+                                                   0,     // number of layers
+                                                   1,     // number of associated layers
+                                                   2,     // associated layer
+                                                   0,
+                                                   1,
+                                                   3,     // number of publisher IDs
+                                                   111};  // missing publisher IDs
+    VmsSubscriptionsStateView state;
+    EXPECT_FALSE(state.parse(*message));
+    EXPECT_EQ(0u, state.getAssociatedLayerCount());
+    EXPECT_TRUE(getSubscribedLayers(*message, {123, {VmsLayerOffering(VmsLayer(2, 0, 1))}})
+                        .empty());
+
+    EXPECT_FALSE(state.parse(*createSubscribeMessage(VmsLayer(1, 0, 1))));
+}
+
+TEST(VmsUtilsTest, parseDataView) {
+    const std::string bytes = "aaa";
+    const VmsLayerAndPublisher layer_and_publisher(VmsLayer(1, 0, 1), 123);
+    auto message = createDataMessageWithLayerPublisherInfo(layer_and_publisher, bytes);
+    VmsDataView data_view;
+    ASSERT_TRUE(parseDataView(*message, &data_view));
+    EXPECT_EQ(VmsLayer(1, 0, 1), data_view.layer_publisher.layer);
+    EXPECT_EQ(123, data_view.layer_publisher.publisher_id);
+    EXPECT_EQ(message->value.bytes.data(), data_view.data);
+    EXPECT_EQ(bytes.size(), data_view.size);
+
+    EXPECT_FALSE(parseDataView(*createSubscribeMessage(VmsLayer(1, 0, 1)), &data_view));
+}
+
+TEST(VmsUtilsTest, dataMessageBuilder) {
+    VmsDataMessageBuilder builder;
+    const VmsLayerAndPublisher layer_and_publisher(VmsLayer(2, 0, 1), 123);
+    const std::string bytes(4096, 'a');
+
+    const uint8_t* payload = nullptr;
+    {
+        auto message = builder.build(layer_and_publisher, bytes);
+        ASSERT_NE(message, nullptr);
+        EXPECT_TRUE(isValidVmsMessage(*message));
+        EXPECT_EQ(parseData(*message), bytes);
+        VmsDataView data_view;
+        ASSERT_TRUE(parseDataView(*message, &data_view));
+        EXPECT_EQ(VmsLayer(2, 0, 1), data_view.layer_publisher.layer);
+        EXPECT_EQ(123, data_view.layer_publisher.publisher_id);
+        payload = message->value.bytes.data();
+    }
+
+    // Payload buffer of the recycled message is reused for the payload of the same size.
+    const std::string other_bytes(4096, 'b');
+    auto message = builder.build(layer_and_publisher, other_bytes);
+    EXPECT_EQ(payload, message->value.bytes.data());
+    EXPECT_EQ(parseData(*message), other_bytes);
+
+    auto small_message = builder.build(layer_and_publisher, "c");
+    EXPECT_EQ(parseData(*small_message), "c");
+}
+
 TEST(VmsUtilsTest, serviceNewlyStarted) {
     auto message = createBaseVmsMessage(2);
     message->value.int32Values = hidl_vec<int32_t>{toInt(VmsMessageType::AVAILABILITY_CHANGE), 0};
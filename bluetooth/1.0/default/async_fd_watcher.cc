@@ -18,37 +18,56 @@
 
 #include "async_fd_watcher.h"
 
+#include <inttypes.h>
 #include <log/log.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <algorithm>
 #include <atomic>
-#include <condition_variable>
-#include <map>
 #include <mutex>
 #include <thread>
-#include <vector>
-#include "fcntl.h"
-#include "sys/select.h"
 #include "unistd.h"
 
 static const int INVALID_FD = -1;
 
 static const int BT_RT_PRIORITY = 1;
 
+// Upper bound on the events harvested per epoll_wait(); the watcher only ever
+// has a handful of fds (the UARTs plus the internal eventfd).
+static const int kMaxEvents = 8;
+
 namespace android {
 namespace hardware {
 namespace bluetooth {
 namespace async {
 
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
 int AsyncFdWatcher::WatchFdForNonBlockingReads(
     int file_descriptor, const ReadCallback& on_read_fd_ready_callback) {
+  // Start the thread if not started yet
+  if (tryStartThread()) return -1;
+
   // Add file descriptor and callback
-  {
-    std::unique_lock<std::mutex> guard(internal_mutex_);
-    watched_fds_[file_descriptor] = on_read_fd_ready_callback;
+  std::unique_lock<std::mutex> guard(internal_mutex_);
+  watched_fds_[file_descriptor].callback = on_read_fd_ready_callback;
+
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = file_descriptor;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, file_descriptor, &event) &&
+      (errno != EEXIST ||
+       epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, file_descriptor, &event))) {
+    ALOGE("%s unable to watch fd %d: %s", __func__, file_descriptor,
+          strerror(errno));
+    watched_fds_.erase(file_descriptor);
+    return -1;
   }
-
-  // Start the thread if not started yet
-  return tryStartThread();
+  return 0;
 }
 
 int AsyncFdWatcher::ConfigureTimeout(
@@ -65,21 +84,41 @@ int AsyncFdWatcher::ConfigureTimeout(
   return 0;
 }
 
+void AsyncFdWatcher::ResetTimeout() {
+  {
+    std::unique_lock<std::mutex> guard(timeout_mutex_);
+    if (timeout_ms_ == milliseconds(0)) return;
+  }
+
+  // Any wakeup restarts the timeout, see ThreadRoutine().
+  notifyThread();
+}
+
 void AsyncFdWatcher::StopWatchingFileDescriptors() { stopThread(); }
 
 AsyncFdWatcher::~AsyncFdWatcher() {}
 
-// Make sure to call this with at least one file descriptor ready to be
-// watched upon or the thread routine will return immediately
 int AsyncFdWatcher::tryStartThread() {
   if (std::atomic_exchange(&running_, true)) return 0;
 
-  // Set up the communication channel
-  int pipe_fds[2];
-  if (pipe2(pipe_fds, O_NONBLOCK)) return -1;
+  // Set up the epoll set and the communication channel
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  notification_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ == INVALID_FD || notification_fd_ == INVALID_FD) {
+    ALOGE("%s unable to create watcher fds: %s", __func__, strerror(errno));
+    stopThread();
+    return -1;
+  }
 
-  notification_listen_fd_ = pipe_fds[0];
-  notification_write_fd_ = pipe_fds[1];
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = notification_fd_;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, notification_fd_, &event)) {
+    ALOGE("%s unable to watch the notification fd: %s", __func__,
+          strerror(errno));
+    stopThread();
+    return -1;
+  }
 
   thread_ = std::thread([this]() { ThreadRoutine(); });
   if (!thread_.joinable()) return -1;
@@ -91,12 +130,13 @@ int AsyncFdWatcher::stopThread() {
   if (!std::atomic_exchange(&running_, false)) return 0;
 
   notifyThread();
-  if (std::this_thread::get_id() != thread_.get_id()) {
+  if (thread_.joinable() && std::this_thread::get_id() != thread_.get_id()) {
     thread_.join();
   }
 
   {
     std::unique_lock<std::mutex> guard(internal_mutex_);
+    dumpLatencies();
     watched_fds_.clear();
   }
 
@@ -105,20 +145,50 @@ int AsyncFdWatcher::stopThread() {
     timeout_cb_ = nullptr;
   }
 
-  close(notification_listen_fd_);
-  close(notification_write_fd_);
+  for (int* fd : {&epoll_fd_, &notification_fd_}) {
+    if (*fd != INVALID_FD) close(*fd);
+    *fd = INVALID_FD;
+  }
 
   return 0;
 }
 
 int AsyncFdWatcher::notifyThread() {
-  uint8_t buffer[] = {0};
-  if (TEMP_FAILURE_RETRY(write(notification_write_fd_, &buffer, 1)) < 0) {
+  uint64_t value = 1;
+  if (notification_fd_ == INVALID_FD ||
+      TEMP_FAILURE_RETRY(write(notification_fd_, &value, sizeof(value))) < 0) {
     return -1;
   }
   return 0;
 }
 
+void AsyncFdWatcher::onTimeout() {
+  // Allow the timeout callback to modify the timeout.
+  TimeoutCallback saved_cb;
+  {
+    std::unique_lock<std::mutex> guard(timeout_mutex_);
+    if (timeout_ms_ > milliseconds(0)) saved_cb = timeout_cb_;
+  }
+  if (saved_cb != nullptr) saved_cb();
+}
+
+void AsyncFdWatcher::dumpLatencies() {
+  for (auto& it : watched_fds_) {
+    const CallbackLatency& latency = it.second.latency;
+    if (latency.count == 0) continue;
+    ALOGI("%s fd %d: %" PRIu64 " callbacks, avg %lld us, max %lld us, "
+          "max queue delay %lld us",
+          __func__, it.first, latency.count,
+          static_cast<long long>(
+              duration_cast<microseconds>(latency.total_run).count() /
+              latency.count),
+          static_cast<long long>(
+              duration_cast<microseconds>(latency.max_run).count()),
+          static_cast<long long>(
+              duration_cast<microseconds>(latency.max_queue_delay).count()));
+  }
+}
+
 void AsyncFdWatcher::ThreadRoutine() {
   // Make watching thread RT.
   struct sched_param rt_params;
@@ -129,57 +199,55 @@ void AsyncFdWatcher::ThreadRoutine() {
   }
 
   while (running_) {
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    FD_SET(notification_listen_fd_, &read_fds);
-    int max_read_fd = INVALID_FD;
-    for (auto& it : watched_fds_) {
-      FD_SET(it.first, &read_fds);
-      max_read_fd = std::max(max_read_fd, it.first);
-    }
-
-    struct timeval timeout;
-    struct timeval* timeout_ptr = NULL;
-    if (timeout_ms_ > std::chrono::milliseconds(0)) {
-      timeout.tv_sec = timeout_ms_.count() / 1000;
-      timeout.tv_usec = (timeout_ms_.count() % 1000) * 1000;
-      timeout_ptr = &timeout;
+    // The timeout restarts whenever the thread wakes up, so it only fires
+    // after a full period without any activity.
+    int timeout = -1;
+    {
+      std::unique_lock<std::mutex> guard(timeout_mutex_);
+      if (timeout_ms_ > milliseconds(0)) timeout = timeout_ms_.count();
     }
 
     // Wait until there is data available to read on some FD.
-    int nfds = std::max(notification_listen_fd_, max_read_fd);
-    int retval = select(nfds + 1, &read_fds, NULL, NULL, timeout_ptr);
+    struct epoll_event events[kMaxEvents];
+    int nfds = epoll_wait(epoll_fd_, events, kMaxEvents, timeout);
 
     // There was some error.
-    if (retval < 0) continue;
+    if (nfds < 0) continue;
 
     // Timeout.
-    if (retval == 0) {
-      // Allow the timeout callback to modify the timeout.
-      TimeoutCallback saved_cb;
-      {
-        std::unique_lock<std::mutex> guard(timeout_mutex_);
-        if (timeout_ms_ > std::chrono::milliseconds(0)) saved_cb = timeout_cb_;
-      }
-      if (saved_cb != nullptr) saved_cb();
+    if (nfds == 0) {
+      onTimeout();
       continue;
     }
 
-    // Read data from the notification FD.
-    if (FD_ISSET(notification_listen_fd_, &read_fds)) {
-      char buffer[] = {0};
-      TEMP_FAILURE_RETRY(read(notification_listen_fd_, buffer, 1));
-      continue;
-    }
+    steady_clock::time_point wakeup = steady_clock::now();
+    for (int i = 0; i < nfds && running_; i++) {
+      int fd = events[i].data.fd;
 
-    // Invoke the data ready callbacks if appropriate.
-    {
-      // Hold the mutex to make sure that the callbacks are still valid.
-      std::unique_lock<std::mutex> guard(internal_mutex_);
-      for (auto& it : watched_fds_) {
-        if (FD_ISSET(it.first, &read_fds)) {
-          it.second(it.first);
-        }
+      // Read data from the notification FD.
+      if (fd == notification_fd_) {
+        uint64_t value;
+        TEMP_FAILURE_RETRY(read(notification_fd_, &value, sizeof(value)));
+        continue;
+      }
+
+      // Invoke the data ready callback if appropriate.
+      {
+        // Hold the mutex to make sure that the callback is still valid.
+        std::unique_lock<std::mutex> guard(internal_mutex_);
+        auto it = watched_fds_.find(fd);
+        if (it == watched_fds_.end()) continue;
+
+        steady_clock::time_point start = steady_clock::now();
+        it->second.callback(fd);
+
+        CallbackLatency& latency = it->second.latency;
+        nanoseconds run = steady_clock::now() - start;
+        latency.count++;
+        latency.total_run += run;
+        latency.max_run = std::max(latency.max_run, run);
+        latency.max_queue_delay =
+            std::max(latency.max_queue_delay, nanoseconds(start - wakeup));
       }
     }
   }
@@ -16,9 +16,13 @@
 
 #pragma once
 
-#include <map>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
 
 namespace android {
 namespace hardware {
@@ -28,6 +32,22 @@ namespace async {
 using ReadCallback = std::function<void(int)>;
 using TimeoutCallback = std::function<void(void)>;
 
+// Dispatch statistics kept for every watched file descriptor. The queue delay
+// is the time between epoll_wait() returning and the callback starting, i.e.
+// how long the fd was stuck behind the other callbacks served by the same
+// thread; the run time is how long the callback itself took.
+struct CallbackLatency {
+  uint64_t count = 0;
+  std::chrono::nanoseconds total_run{0};
+  std::chrono::nanoseconds max_run{0};
+  std::chrono::nanoseconds max_queue_delay{0};
+};
+
+// Watches file descriptors for readability on a single thread backed by
+// epoll; the timeout fires after a period without any activity. Each watcher
+// owns exactly one thread, so callbacks that must not be delayed by each other
+// (e.g. ACL data and HCI events on separate UARTs, or FM/ANT channels
+// sharing the controller) should be registered on separate watchers.
 class AsyncFdWatcher {
  public:
   AsyncFdWatcher() = default;
@@ -37,15 +57,25 @@ class AsyncFdWatcher {
                                  const ReadCallback& on_read_fd_ready_callback);
   int ConfigureTimeout(const std::chrono::milliseconds timeout,
                        const TimeoutCallback& on_timeout_callback);
+  // Restarts the timeout period as if one of the watched fds had been
+  // readable, for activity served by another watcher.
+  void ResetTimeout();
   void StopWatchingFileDescriptors();
 
  private:
   AsyncFdWatcher(const AsyncFdWatcher&) = delete;
   AsyncFdWatcher& operator=(const AsyncFdWatcher&) = delete;
 
+  struct WatchedFd {
+    ReadCallback callback;
+    CallbackLatency latency;
+  };
+
   int tryStartThread();
   int stopThread();
   int notifyThread();
+  void onTimeout();
+  void dumpLatencies();
   void ThreadRoutine();
 
   std::atomic_bool running_{false};
@@ -53,11 +83,11 @@ class AsyncFdWatcher {
   std::mutex internal_mutex_;
   std::mutex timeout_mutex_;
 
-  std::map<int, ReadCallback> watched_fds_;
-  int notification_listen_fd_;
-  int notification_write_fd_;
+  std::unordered_map<int, WatchedFd> watched_fds_;
+  int epoll_fd_ = -1;
+  int notification_fd_ = -1;
   TimeoutCallback timeout_cb_;
-  std::chrono::milliseconds timeout_ms_;
+  std::chrono::milliseconds timeout_ms_{0};
 };
 
 }  // namespace async
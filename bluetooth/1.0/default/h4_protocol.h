@@ -51,7 +51,6 @@ class H4Protocol : public HciProtocol {
   PacketReadCallback acl_cb_;
   PacketReadCallback sco_cb_;
 
-  HciPacketType hci_packet_type_{HCI_PACKET_TYPE_UNKNOWN};
   hci::HciPacketizer hci_packetizer_;
 };
 
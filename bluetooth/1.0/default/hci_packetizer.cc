@@ -21,6 +21,8 @@
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
 #include <unistd.h>
 #include <utils/Log.h>
 
@@ -46,61 +48,95 @@ namespace hardware {
 namespace bluetooth {
 namespace hci {
 
+// Initial size of the read buffer, it grows to fit larger packets.
+static constexpr size_t kReadBufferSize = 16 * 1024;
+
+HciPacketizer::HciPacketizer(HciPacketReadyCallback packet_cb)
+    : buffer_(kReadBufferSize), packet_ready_cb_(packet_cb) {}
+
+HciPacketizer::~HciPacketizer() {
+  ALOGI("%s: received %" PRIu64 " events (%" PRIu64 " bytes), %" PRIu64
+        " ACL (%" PRIu64 " bytes), %" PRIu64 " SCO (%" PRIu64 " bytes)",
+        __func__, counters_.packets[HCI_PACKET_TYPE_EVENT],
+        counters_.bytes[HCI_PACKET_TYPE_EVENT],
+        counters_.packets[HCI_PACKET_TYPE_ACL_DATA],
+        counters_.bytes[HCI_PACKET_TYPE_ACL_DATA],
+        counters_.packets[HCI_PACKET_TYPE_SCO_DATA],
+        counters_.bytes[HCI_PACKET_TYPE_SCO_DATA]);
+}
+
 const hidl_vec<uint8_t>& HciPacketizer::GetPacket() const { return packet_; }
 
+HciPacketType HciPacketizer::GetPacketType() const { return packet_type_; }
+
+const HciPacketCounters& HciPacketizer::GetCounters() const {
+  return counters_;
+}
+
 void HciPacketizer::OnDataReady(int fd, HciPacketType packet_type) {
-  switch (state_) {
-    case HCI_PREAMBLE: {
-      ssize_t bytes_read = TEMP_FAILURE_RETRY(
-          read(fd, preamble_ + bytes_read_,
-               preamble_size_for_type[packet_type] - bytes_read_));
-      if (bytes_read == 0) {
-        // This is only expected if the UART got closed when shutting down.
-        ALOGE("%s: Unexpected EOF reading the header!", __func__);
-        sleep(5);  // Expect to be shut down within 5 seconds.
-        return;
-      }
-      if (bytes_read < 0) {
-        LOG_ALWAYS_FATAL("%s: Read header error: %s", __func__,
-                         strerror(errno));
-      }
-      bytes_read_ += bytes_read;
-      if (bytes_read_ == preamble_size_for_type[packet_type]) {
-        size_t packet_length =
-            HciGetPacketLengthForType(packet_type, preamble_);
-        packet_.resize(preamble_size_for_type[packet_type] + packet_length);
-        memcpy(packet_.data(), preamble_, preamble_size_for_type[packet_type]);
-        bytes_remaining_ = packet_length;
-        state_ = HCI_PAYLOAD;
-        bytes_read_ = 0;
-      }
-      break;
-    }
+  // Make room at the end of the buffer for the next packet at least.
+  if (begin_ > 0 && (end_ == buffer_.size() ||
+                     begin_ + bytes_needed_ > buffer_.size())) {
+    memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+  }
+  if (bytes_needed_ > buffer_.size()) {
+    buffer_.resize(bytes_needed_);
+  }
 
-    case HCI_PAYLOAD: {
-      ssize_t bytes_read = TEMP_FAILURE_RETRY(read(
-          fd,
-          packet_.data() + preamble_size_for_type[packet_type] + bytes_read_,
-          bytes_remaining_));
-      if (bytes_read == 0) {
-        // This is only expected if the UART got closed when shutting down.
-        ALOGE("%s: Unexpected EOF reading the payload!", __func__);
-        sleep(5);  // Expect to be shut down within 5 seconds.
-        return;
-      }
-      if (bytes_read < 0) {
-        LOG_ALWAYS_FATAL("%s: Read payload error: %s", __func__,
-                         strerror(errno));
-      }
-      bytes_remaining_ -= bytes_read;
-      bytes_read_ += bytes_read;
-      if (bytes_remaining_ == 0) {
-        packet_ready_cb_();
-        state_ = HCI_PREAMBLE;
-        bytes_read_ = 0;
-      }
+  ssize_t bytes_read = TEMP_FAILURE_RETRY(
+      read(fd, buffer_.data() + end_, buffer_.size() - end_));
+  if (bytes_read == 0) {
+    // This is only expected if the UART got closed when shutting down.
+    ALOGE("%s: Unexpected EOF reading the %s!", __func__,
+          end_ == begin_ ? "header" : "payload");
+    sleep(5);  // Expect to be shut down within 5 seconds.
+    return;
+  }
+  if (bytes_read < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+    LOG_ALWAYS_FATAL("%s: Read error: %s", __func__, strerror(errno));
+  }
+  end_ += bytes_read;
+  DeliverPackets(packet_type);
+}
+
+void HciPacketizer::DeliverPackets(HciPacketType packet_type) {
+  // H4 has the packet type before each packet.
+  const size_t type_size = packet_type == HCI_PACKET_TYPE_UNKNOWN ? 1 : 0;
+  while (true) {
+    size_t available = end_ - begin_;
+    uint8_t* data = buffer_.data() + begin_;
+    bytes_needed_ = 0;
+    if (available < type_size) break;
+    HciPacketType type =
+        type_size ? static_cast<HciPacketType>(data[0]) : packet_type;
+    if (type != HCI_PACKET_TYPE_ACL_DATA && type != HCI_PACKET_TYPE_SCO_DATA &&
+        type != HCI_PACKET_TYPE_EVENT) {
+      LOG_ALWAYS_FATAL("%s: Unimplemented packet type %d", __func__,
+                       static_cast<int>(type));
+    }
+    size_t preamble_size = preamble_size_for_type[type];
+    if (available < type_size + preamble_size) break;
+    size_t packet_size =
+        preamble_size + HciGetPacketLengthForType(type, data + type_size);
+    if (available < type_size + packet_size) {
+      bytes_needed_ = type_size + packet_size;
       break;
     }
+
+    packet_.setToExternal(data + type_size, packet_size);
+    packet_type_ = type;
+    counters_.packets[type]++;
+    counters_.bytes[type] += packet_size;
+    packet_ready_cb_();
+    packet_.setToExternal(nullptr, 0);
+    begin_ += type_size + packet_size;
+  }
+  if (begin_ == end_) {
+    begin_ = 0;
+    end_ = 0;
   }
 }
 
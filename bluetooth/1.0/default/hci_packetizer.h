@@ -17,6 +17,7 @@
 #pragma once
 
 #include <functional>
+#include <vector>
 
 #include <hidl/HidlSupport.h>
 
@@ -30,20 +31,44 @@ namespace hci {
 using ::android::hardware::hidl_vec;
 using HciPacketReadyCallback = std::function<void(void)>;
 
+// Received packets and bytes per packet type
+struct HciPacketCounters {
+  uint64_t packets[HCI_PACKET_TYPE_EVENT + 1];
+  uint64_t bytes[HCI_PACKET_TYPE_EVENT + 1];
+};
+
+// Reads all the bytes available from the transport at once into a buffer,
+// and slices the complete packets out of it in place, so that a burst of
+// packets costs a single read.
 class HciPacketizer {
  public:
-  HciPacketizer(HciPacketReadyCallback packet_cb)
-      : packet_ready_cb_(packet_cb){};
+  HciPacketizer(HciPacketReadyCallback packet_cb);
+  ~HciPacketizer();
+
+  // Reads the available bytes and invokes the callback for each complete
+  // packet. packet_type is HCI_PACKET_TYPE_UNKNOWN for a H4 transport, where
+  // each packet is preceded by its type.
   void OnDataReady(int fd, HciPacketType packet_type);
+
+  // The packet and its type, only valid in the packet ready callback
   const hidl_vec<uint8_t>& GetPacket() const;
+  HciPacketType GetPacketType() const;
+
+  const HciPacketCounters& GetCounters() const;
 
  protected:
-  enum State { HCI_PREAMBLE, HCI_PAYLOAD };
-  State state_{HCI_PREAMBLE};
-  uint8_t preamble_[HCI_PREAMBLE_SIZE_MAX];
+  // Delivers the complete packets at the start of the buffer.
+  void DeliverPackets(HciPacketType packet_type);
+
+  std::vector<uint8_t> buffer_;
+  // The bytes read and not delivered yet are buffer_[begin_, end_).
+  size_t begin_{0};
+  size_t end_{0};
+  // Bytes needed at begin_ to complete the next packet, or 0 if not known
+  size_t bytes_needed_{0};
   hidl_vec<uint8_t> packet_;
-  size_t bytes_remaining_{0};
-  size_t bytes_read_{0};
+  HciPacketType packet_type_{HCI_PACKET_TYPE_UNKNOWN};
+  HciPacketCounters counters_{};
   HciPacketReadyCallback packet_ready_cb_;
 };
 
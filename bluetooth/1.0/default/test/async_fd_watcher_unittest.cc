@@ -18,6 +18,7 @@
 
 #include "async_fd_watcher.h"
 #include <gtest/gtest.h>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include <vector>
@@ -325,6 +326,46 @@ TEST_F(AsyncFdWatcherSocketTest, WatchTwoFileDescriptors) {
   watcher.StopWatchingFileDescriptors();
 }
 
+// A slow callback on one AsyncFdWatcher doesn't delay another watcher.
+TEST_F(AsyncFdWatcherSocketTest, SeparateWatchersDontBlockEachOther) {
+  int slow_fds[2];
+  int fast_fds[2];
+  socketpair(AF_LOCAL, SOCK_STREAM, 0, slow_fds);
+  socketpair(AF_LOCAL, SOCK_STREAM, 0, fast_fds);
+  std::atomic_bool slow_done(false);
+  std::atomic_bool fast_called(false);
+
+  AsyncFdWatcher slow_watcher;
+  slow_watcher.WatchFdForNonBlockingReads(slow_fds[0], [&slow_done](int fd) {
+    char read_buf[1] = {0};
+    TEMP_FAILURE_RETRY(read(fd, read_buf, sizeof(read_buf)));
+    sleep(2);
+    slow_done = true;
+  });
+
+  AsyncFdWatcher fast_watcher;
+  fast_watcher.WatchFdForNonBlockingReads(fast_fds[0], [&fast_called](int fd) {
+    char read_buf[1] = {0};
+    TEMP_FAILURE_RETRY(read(fd, read_buf, sizeof(read_buf)));
+    fast_called = true;
+  });
+
+  char one_buf[1] = {'1'};
+  TEMP_FAILURE_RETRY(write(slow_fds[1], one_buf, sizeof(one_buf)));
+  usleep(100000);
+  TEMP_FAILURE_RETRY(write(fast_fds[1], one_buf, sizeof(one_buf)));
+
+  sleep(1);
+
+  EXPECT_TRUE(fast_called);
+  EXPECT_FALSE(slow_done);
+
+  slow_watcher.StopWatchingFileDescriptors();
+  fast_watcher.StopWatchingFileDescriptors();
+  EXPECT_TRUE(slow_done);
+  for (int fd : {slow_fds[0], slow_fds[1], fast_fds[0], fast_fds[1]}) close(fd);
+}
+
 // Use two AsyncFdWatchers to set up a server socket.
 TEST_F(AsyncFdWatcherSocketTest, ClientServer) {
   ConfigureServer();
@@ -385,6 +426,31 @@ TEST_F(AsyncFdWatcherSocketTest, RepeatedTimeOutTest) {
   CleanUpServer();
 }
 
+// Activity served by another watcher keeps the timeout from firing.
+TEST(AsyncFdWatcherTest, ResetTimeout) {
+  int pipe_fds[2];
+  ASSERT_EQ(0, pipe(pipe_fds));
+
+  AsyncFdWatcher watcher;
+  std::atomic<int> timeouts{0};
+  watcher.WatchFdForNonBlockingReads(pipe_fds[0], [](int) {});
+  watcher.ConfigureTimeout(std::chrono::milliseconds(200),
+                           [&timeouts]() { timeouts++; });
+
+  for (int i = 0; i < 12; i++) {
+    usleep(50 * 1000);
+    watcher.ResetTimeout();
+  }
+  EXPECT_EQ(0, timeouts);
+
+  usleep(400 * 1000);
+  EXPECT_LE(1, timeouts);
+
+  watcher.StopWatchingFileDescriptors();
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace bluetooth
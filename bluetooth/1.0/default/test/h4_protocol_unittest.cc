@@ -118,24 +118,24 @@ class H4ProtocolTest : public ::testing::Test {
     preamble[3] = length & 0xFF;
     preamble[4] = (length >> 8) & 0xFF;
 
-    ALOGD("%s writing", __func__);
-    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
-    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
-
-    ALOGD("%s waiting", __func__);
+    // Expect the packet before writing it, it may be delivered right away.
     std::mutex mutex;
     std::condition_variable done;
     EXPECT_CALL(acl_cb_, Call(HidlVecMatches(preamble + 1, sizeof(preamble) - 1,
                                              payload)))
         .WillOnce(Notify(&mutex, &done));
+    // Hold the lock until waiting, so that the notification is not missed.
+    std::unique_lock<std::mutex> lock(mutex);
+
+    ALOGD("%s writing", __func__);
+    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
+    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
 
+    ALOGD("%s waiting", __func__);
     // Fail if it takes longer than 100 ms.
     auto timeout_time =
         std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
-    {
-      std::unique_lock<std::mutex> lock(mutex);
-      done.wait_until(lock, timeout_time);
-    }
+    done.wait_until(lock, timeout_time);
   }
 
   void WriteAndExpectInboundScoData(char* payload) {
@@ -143,44 +143,73 @@ class H4ProtocolTest : public ::testing::Test {
     char preamble[4] = {HCI_PACKET_TYPE_SCO_DATA, 20, 17, 0};
     preamble[3] = strlen(payload) & 0xFF;
 
-    ALOGD("%s writing", __func__);
-    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
-    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
-
-    ALOGD("%s waiting", __func__);
+    // Expect the packet before writing it, it may be delivered right away.
     std::mutex mutex;
     std::condition_variable done;
     EXPECT_CALL(sco_cb_, Call(HidlVecMatches(preamble + 1, sizeof(preamble) - 1,
                                              payload)))
         .WillOnce(Notify(&mutex, &done));
+    // Hold the lock until waiting, so that the notification is not missed.
+    std::unique_lock<std::mutex> lock(mutex);
+
+    ALOGD("%s writing", __func__);
+    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
+    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
 
+    ALOGD("%s waiting", __func__);
     // Fail if it takes longer than 100 ms.
     auto timeout_time =
         std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
-    {
-      std::unique_lock<std::mutex> lock(mutex);
-      done.wait_until(lock, timeout_time);
-    }
+    done.wait_until(lock, timeout_time);
   }
 
   void WriteAndExpectInboundEvent(char* payload) {
     // h4 type[1] + event_code[1] + size[1]
     char preamble[3] = {HCI_PACKET_TYPE_EVENT, 9, 0};
     preamble[2] = strlen(payload) & 0xFF;
-    ALOGD("%s writing", __func__);
-    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
-    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
-
-    ALOGD("%s waiting", __func__);
+    // Expect the packet before writing it, it may be delivered right away.
     std::mutex mutex;
     std::condition_variable done;
     EXPECT_CALL(event_cb_, Call(HidlVecMatches(preamble + 1,
                                                sizeof(preamble) - 1, payload)))
         .WillOnce(Notify(&mutex, &done));
+    // Hold the lock until waiting, so that the notification is not missed.
+    std::unique_lock<std::mutex> lock(mutex);
+
+    ALOGD("%s writing", __func__);
+    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
+    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
+
+    ALOGD("%s waiting", __func__);
+    done.wait(lock);
+  }
+
+  static std::vector<uint8_t> MakeEvent(char* payload) {
+    // h4 type[1] + event_code[1] + size[1]
+    std::vector<uint8_t> packet = {HCI_PACKET_TYPE_EVENT, 9,
+                                   static_cast<uint8_t>(strlen(payload))};
+    packet.insert(packet.end(), payload, payload + strlen(payload));
+    return packet;
+  }
+
+  static std::vector<uint8_t> MakeAclData(size_t length) {
+    // h4 type[1] + handle[2] + size[2]
+    std::vector<uint8_t> packet = {HCI_PACKET_TYPE_ACL_DATA, 19, 92,
+                                   static_cast<uint8_t>(length & 0xFF),
+                                   static_cast<uint8_t>(length >> 8)};
+    for (size_t i = 0; i < length; i++) {
+      packet.push_back(static_cast<uint8_t>(i));
+    }
+    return packet;
+  }
 
-    {
-      std::unique_lock<std::mutex> lock(mutex);
-      done.wait(lock);
+  void WriteAll(const std::vector<uint8_t>& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+      ssize_t ret = TEMP_FAILURE_RETRY(
+          write(fake_uart_, data.data() + written, data.size() - written));
+      ASSERT_GT(ret, 0);
+      written += ret;
     }
   }
 
@@ -206,6 +235,53 @@ TEST_F(H4ProtocolTest, TestReads) {
   WriteAndExpectInboundEvent(event_data);
 }
 
+// Ensure packets arriving in a single burst are all delivered, in order
+TEST_F(H4ProtocolTest, TestBatchedReads) {
+  std::vector<uint8_t> burst = MakeEvent(sample_data1);
+  std::vector<uint8_t> acl = MakeAclData(strlen(acl_data));
+  memcpy(acl.data() + 5, acl_data, strlen(acl_data));
+  burst.insert(burst.end(), acl.begin(), acl.end());
+  std::vector<uint8_t> event = MakeEvent(event_data);
+  burst.insert(burst.end(), event.begin(), event.end());
+
+  std::mutex mutex;
+  std::condition_variable done;
+  {
+    ::testing::InSequence sequence;
+    EXPECT_CALL(event_cb_,
+                Call(HidlVecMatches(burst.data() + 1, 2, sample_data1)));
+    EXPECT_CALL(acl_cb_, Call(HidlVecMatches(acl.data() + 1, 4, acl_data)));
+    EXPECT_CALL(event_cb_, Call(HidlVecMatches(event.data() + 1, 2, event_data)))
+        .WillOnce(Notify(&mutex, &done));
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  WriteAll(burst);
+  // Fail if it takes longer than 100 ms.
+  done.wait_for(lock, std::chrono::milliseconds(100));
+}
+
+// Ensure a packet larger than the read buffer is reassembled
+TEST_F(H4ProtocolTest, TestLargeRead) {
+  const size_t kAclLength = 40000;
+  std::vector<uint8_t> acl = MakeAclData(kAclLength);
+
+  std::mutex mutex;
+  std::condition_variable done;
+  std::vector<uint8_t> received;
+  EXPECT_CALL(acl_cb_, Call(::testing::_))
+      .WillOnce(::testing::DoAll(
+          ::testing::Invoke([&received](const hidl_vec<uint8_t>& packet) {
+            received.assign(packet.data(), packet.data() + packet.size());
+          }),
+          Notify(&mutex, &done)));
+
+  std::unique_lock<std::mutex> lock(mutex);
+  WriteAll(acl);
+  done.wait_for(lock, std::chrono::milliseconds(1000));
+  EXPECT_EQ(std::vector<uint8_t>(acl.begin() + 1, acl.end()), received);
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace bluetooth
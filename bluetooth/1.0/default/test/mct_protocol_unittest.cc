@@ -123,25 +123,25 @@ class MctProtocolTest : public ::testing::Test {
     preamble[2] = length & 0xFF;
     preamble[3] = (length >> 8) & 0xFF;
 
-    ALOGD("%s writing", __func__);
-    TEMP_FAILURE_RETRY(
-        write(fake_uart_[CH_ACL_IN], preamble, sizeof(preamble)));
-    TEMP_FAILURE_RETRY(write(fake_uart_[CH_ACL_IN], payload, strlen(payload)));
-
-    ALOGD("%s waiting", __func__);
+    // Expect the packet before writing it, it may be delivered right away.
     std::mutex mutex;
     std::condition_variable done;
     EXPECT_CALL(acl_cb_,
                 Call(HidlVecMatches(preamble, sizeof(preamble), payload)))
         .WillOnce(Notify(&mutex, &done));
+    // Hold the lock until waiting, so that the notification is not missed.
+    std::unique_lock<std::mutex> lock(mutex);
 
+    ALOGD("%s writing", __func__);
+    TEMP_FAILURE_RETRY(
+        write(fake_uart_[CH_ACL_IN], preamble, sizeof(preamble)));
+    TEMP_FAILURE_RETRY(write(fake_uart_[CH_ACL_IN], payload, strlen(payload)));
+
+    ALOGD("%s waiting", __func__);
     // Fail if it takes longer than 100 ms.
     auto timeout_time =
         std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
-    {
-      std::unique_lock<std::mutex> lock(mutex);
-      done.wait_until(lock, timeout_time);
-    }
+    done.wait_until(lock, timeout_time);
   }
 
   void WriteAndExpectInboundEvent(char* payload) {
@@ -149,24 +149,24 @@ class MctProtocolTest : public ::testing::Test {
     char preamble[2] = {9, 0};
     preamble[1] = strlen(payload) & 0xFF;
 
-    ALOGD("%s writing", __func__);
-    TEMP_FAILURE_RETRY(write(fake_uart_[CH_EVT], preamble, sizeof(preamble)));
-    TEMP_FAILURE_RETRY(write(fake_uart_[CH_EVT], payload, strlen(payload)));
-
-    ALOGD("%s waiting", __func__);
+    // Expect the packet before writing it, it may be delivered right away.
     std::mutex mutex;
     std::condition_variable done;
     EXPECT_CALL(event_cb_,
                 Call(HidlVecMatches(preamble, sizeof(preamble), payload)))
         .WillOnce(Notify(&mutex, &done));
+    // Hold the lock until waiting, so that the notification is not missed.
+    std::unique_lock<std::mutex> lock(mutex);
 
+    ALOGD("%s writing", __func__);
+    TEMP_FAILURE_RETRY(write(fake_uart_[CH_EVT], preamble, sizeof(preamble)));
+    TEMP_FAILURE_RETRY(write(fake_uart_[CH_EVT], payload, strlen(payload)));
+
+    ALOGD("%s waiting", __func__);
     // Fail if it takes longer than 100 ms.
     auto timeout_time =
         std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
-    {
-      std::unique_lock<std::mutex> lock(mutex);
-      done.wait_until(lock, timeout_time);
-    }
+    done.wait_until(lock, timeout_time);
   }
 
   testing::MockFunction<void(const hidl_vec<uint8_t>&)> event_cb_;
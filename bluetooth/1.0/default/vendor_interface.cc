@@ -159,6 +159,23 @@ class FirmwareStartupTimer {
   std::chrono::steady_clock::time_point start_time_;
 };
 
+// Logs how long each step of Open took, so a slow start can be attributed.
+class StartupStageTimer {
+ public:
+  StartupStageTimer() : stage_start_time_(std::chrono::steady_clock::now()) {}
+
+  // Logs the time spent since the previous stage completed.
+  void StageCompleted(const char* stage) {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> duration = now - stage_start_time_;
+    stage_start_time_ = now;
+    ALOGI("%s: %.3fs", stage, duration.count());
+  }
+
+ private:
+  std::chrono::steady_clock::time_point stage_start_time_;
+};
+
 bool VendorInterface::Initialize(
     InitializeCompleteCallback initialize_complete_cb,
     PacketReadCallback event_cb, PacketReadCallback acl_cb,
@@ -187,6 +204,7 @@ bool VendorInterface::Open(InitializeCompleteCallback initialize_complete_cb,
                            PacketReadCallback acl_cb,
                            PacketReadCallback sco_cb) {
   initialize_complete_cb_ = initialize_complete_cb;
+  StartupStageTimer stage_timer;
 
   // Initialize vendor interface
 
@@ -204,6 +222,7 @@ bool VendorInterface::Open(InitializeCompleteCallback initialize_complete_cb,
           VENDOR_LIBRARY_SYMBOL_NAME, VENDOR_LIBRARY_NAME, dlerror());
     return false;
   }
+  stage_timer.StageCompleted("Vendor library loaded");
 
   // Get the local BD address
 
@@ -211,6 +230,8 @@ bool VendorInterface::Open(InitializeCompleteCallback initialize_complete_cb,
   if (!BluetoothAddress::get_local_address(local_bda)) {
     LOG_ALWAYS_FATAL("%s: No Bluetooth Address!", __func__);
   }
+  stage_timer.StageCompleted("Local address read");
+
   int status = lib_interface_->init(&lib_callbacks, (unsigned char*)local_bda);
   if (status) {
     ALOGE("%s unable to initialize vendor library: %d", __func__, status);
@@ -218,11 +239,13 @@ bool VendorInterface::Open(InitializeCompleteCallback initialize_complete_cb,
   }
 
   ALOGD("%s vendor library loaded", __func__);
+  stage_timer.StageCompleted("Vendor library initialized");
 
   // Power on the controller
 
   int power_state = BT_VND_PWR_ON;
   lib_interface_->op(BT_VND_OP_POWER_CTRL, &power_state);
+  stage_timer.StageCompleted("Controller powered on");
 
   // Get the UART socket(s)
 
@@ -240,6 +263,7 @@ bool VendorInterface::Open(InitializeCompleteCallback initialize_complete_cb,
       return false;
     }
   }
+  stage_timer.StageCompleted("UART opened");
 
   event_cb_ = event_cb;
   PacketReadCallback intercept_events = [this](const hidl_vec<uint8_t>& event) {
@@ -257,8 +281,12 @@ bool VendorInterface::Open(InitializeCompleteCallback initialize_complete_cb,
         new hci::MctProtocol(fd_list, intercept_events, acl_cb);
     fd_watcher_.WatchFdForNonBlockingReads(
         fd_list[CH_EVT], [mct_hci](int fd) { mct_hci->OnEventDataReady(fd); });
-    fd_watcher_.WatchFdForNonBlockingReads(
-        fd_list[CH_ACL_IN], [mct_hci](int fd) { mct_hci->OnAclDataReady(fd); });
+    // ACL data counts as activity for the LPM idle timeout on fd_watcher_.
+    acl_fd_watcher_.WatchFdForNonBlockingReads(
+        fd_list[CH_ACL_IN], [this, mct_hci](int fd) {
+          mct_hci->OnAclDataReady(fd);
+          fd_watcher_.ResetTimeout();
+        });
     hci_ = mct_hci;
   }
 
@@ -281,6 +309,7 @@ void VendorInterface::Close() {
   }
 
   fd_watcher_.StopWatchingFileDescriptors();
+  acl_fd_watcher_.StopWatchingFileDescriptors();
 
   if (hci_ != nullptr) {
     delete hci_;
@@ -61,6 +61,9 @@ class VendorInterface {
   void* lib_handle_ = nullptr;
   bt_vendor_interface_t* lib_interface_ = nullptr;
   async::AsyncFdWatcher fd_watcher_;
+  // Serves the ACL-in UART of MCT controllers on its own thread so incoming
+  // ACL data is never queued behind HCI event processing.
+  async::AsyncFdWatcher acl_fd_watcher_;
   InitializeCompleteCallback initialize_complete_cb_;
   hci::HciProtocol* hci_ = nullptr;
 
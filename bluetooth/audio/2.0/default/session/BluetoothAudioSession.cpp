@@ -18,8 +18,11 @@
 
 #include "BluetoothAudioSession.h"
 
+#include <algorithm>
+
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
+#include <utils/Timers.h>
 
 namespace android {
 namespace bluetooth {
@@ -43,7 +46,11 @@ AudioConfiguration BluetoothAudioSession::invalidSoftwareAudioConfiguration =
 AudioConfiguration BluetoothAudioSession::invalidOffloadAudioConfiguration = {};
 
 static constexpr int kFmqSendTimeoutMs = 1000;  // 1000 ms timeout for sending
-static constexpr int kWritePollMs = 1;          // polled non-blocking interval
+// The reader may not notify NOT_FULL, so a wait for space never exceeds this
+static constexpr int kWritePollMs = 1;
+// FMQ event flag bits, the same as the ones of MessageQueue::writeBlocking()
+static constexpr uint32_t kFmqNotEmpty = 1 << 0;
+static constexpr uint32_t kFmqNotFull = 1 << 1;
 
 static inline timespec timespec_convert_from_hal(const TimeSpec& TS) {
   return {.tv_sec = static_cast<long>(TS.tvSec),
@@ -51,7 +58,11 @@ static inline timespec timespec_convert_from_hal(const TimeSpec& TS) {
 }
 
 BluetoothAudioSession::BluetoothAudioSession(const SessionType& session_type)
-    : session_type_(session_type), stack_iface_(nullptr), mDataMQ(nullptr) {
+    : session_type_(session_type),
+      stack_iface_(nullptr),
+      data_path_(nullptr),
+      underruns_(0),
+      overflows_(0) {
   invalidSoftwareAudioConfiguration.pcmConfig(kInvalidPcmParameters);
   invalidOffloadAudioConfiguration.codecConfig(kInvalidCodecConfiguration);
 }
@@ -79,6 +90,8 @@ void BluetoothAudioSession::OnSessionStarted(
              : kInvalidSoftwareAudioConfiguration);
   } else {
     stack_iface_ = stack_iface;
+    underruns_ = 0;
+    overflows_ = 0;
     LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
               << ", AudioConfiguration=" << toString(audio_config);
     ReportSessionStatus();
@@ -92,6 +105,10 @@ void BluetoothAudioSession::OnSessionEnded() {
   std::lock_guard<std::recursive_mutex> guard(mutex_);
   if (IsSessionReady()) {
     ReportSessionStatus();
+    if (data_path_ != nullptr) {
+      LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
+                << ", underruns=" << underruns_ << ", overflows=" << overflows_;
+    }
   }
   audio_config_ = (session_type_ == SessionType::A2DP_HARDWARE_OFFLOAD_DATAPATH
                        ? kInvalidOffloadAudioConfiguration
@@ -147,23 +164,37 @@ bool BluetoothAudioSession::IsSessionReady() {
   std::lock_guard<std::recursive_mutex> guard(mutex_);
   bool dataMQ_valid =
       (session_type_ == SessionType::A2DP_HARDWARE_OFFLOAD_DATAPATH ||
-       (mDataMQ != nullptr && mDataMQ->isValid()));
+       (data_path_ != nullptr && data_path_->data_mq->isValid()));
   return stack_iface_ != nullptr && dataMQ_valid;
 }
 
+BluetoothAudioSession::DataPath::~DataPath() {
+  if (event_flag != nullptr) {
+    EventFlag::deleteEventFlag(&event_flag);
+  }
+}
+
 bool BluetoothAudioSession::UpdateDataPath(const DataMQ::Descriptor* dataMQ) {
   if (dataMQ == nullptr) {
     // usecase of reset by nullptr
-    mDataMQ = nullptr;
+    data_path_ = nullptr;
     return true;
   }
-  std::unique_ptr<DataMQ> tempDataMQ;
-  tempDataMQ.reset(new DataMQ(*dataMQ));
-  if (!tempDataMQ || !tempDataMQ->isValid()) {
-    mDataMQ = nullptr;
+  std::shared_ptr<DataPath> tempDataPath = std::make_shared<DataPath>();
+  tempDataPath->data_mq.reset(new DataMQ(*dataMQ));
+  if (!tempDataPath->data_mq || !tempDataPath->data_mq->isValid()) {
+    data_path_ = nullptr;
     return false;
   }
-  mDataMQ = std::move(tempDataMQ);
+  // Without an event flag the writer polls for space
+  if (tempDataPath->data_mq->getEventFlagWord() != nullptr &&
+      EventFlag::createEventFlag(tempDataPath->data_mq->getEventFlagWord(),
+                                 &tempDataPath->event_flag) != ::android::OK) {
+    LOG(WARNING) << __func__ << " - SessionType=" << toString(session_type_)
+                 << " failed to create the DataMQ EventFlag";
+    tempDataPath->event_flag = nullptr;
+  }
+  data_path_ = std::move(tempDataPath);
   return true;
 }
 
@@ -370,36 +401,68 @@ void BluetoothAudioSession::UpdateTracksMetadata(
 size_t BluetoothAudioSession::OutWritePcmData(const void* buffer,
                                               size_t bytes) {
   if (buffer == nullptr || !bytes) return 0;
+  std::shared_ptr<DataPath> data_path;
+  {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    if (!IsSessionReady() || data_path_ == nullptr) return 0;
+    data_path = data_path_;
+  }
+  // The data path stays alive while this holds it, even if the session ends,
+  // so the copy does not need the session lock. There is a single writer.
+  DataMQ* data_mq = data_path->data_mq.get();
+  EventFlag* event_flag = data_path->event_flag;
+  if (data_mq->availableToRead() == 0) {
+    ++underruns_;
+  }
   size_t totalWritten = 0;
-  int ms_timeout = kFmqSendTimeoutMs;
+  int64_t ms_timeout = kFmqSendTimeoutMs;
   do {
-    std::unique_lock<std::recursive_mutex> lock(mutex_);
-    if (!IsSessionReady()) break;
-    size_t availableToWrite = mDataMQ->availableToWrite();
+    size_t availableToWrite = data_mq->availableToWrite();
     if (availableToWrite) {
       if (availableToWrite > (bytes - totalWritten)) {
         availableToWrite = bytes - totalWritten;
       }
 
-      if (!mDataMQ->write(static_cast<const uint8_t*>(buffer) + totalWritten,
+      if (!data_mq->write(static_cast<const uint8_t*>(buffer) + totalWritten,
                           availableToWrite)) {
         ALOGE("FMQ datapath writting %zu/%zu failed", totalWritten, bytes);
         return totalWritten;
       }
       totalWritten += availableToWrite;
+      if (event_flag != nullptr) {
+        event_flag->wake(kFmqNotEmpty);
+      }
     } else if (ms_timeout >= kWritePollMs) {
-      lock.unlock();
-      usleep(kWritePollMs * 1000);
-      ms_timeout -= kWritePollMs;
+      {
+        // Stop waiting for a data path the session has already dropped
+        std::lock_guard<std::recursive_mutex> guard(mutex_);
+        if (data_path_ != data_path) break;
+      }
+      // Wake up as soon as the reader notifies NOT_FULL, or poll again.
+      int64_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+      if (event_flag != nullptr) {
+        uint32_t ef_state = 0;
+        event_flag->wait(kFmqNotFull, &ef_state, kWritePollMs * 1000000);
+      } else {
+        usleep(kWritePollMs * 1000);
+      }
+      int64_t waited_ms =
+          (systemTime(SYSTEM_TIME_MONOTONIC) - start_ns) / 1000000;
+      ms_timeout -= std::max<int64_t>(waited_ms, 1);
     } else {
+      ++overflows_;
       ALOGD("data %zu/%zu overflow %d ms", totalWritten, bytes,
-            (kFmqSendTimeoutMs - ms_timeout));
+            kFmqSendTimeoutMs);
       return totalWritten;
     }
   } while (totalWritten < bytes);
   return totalWritten;
 }
 
+DataPathCounters BluetoothAudioSession::GetDataPathCounters() {
+  return {.underruns = underruns_, .overflows = overflows_};
+}
+
 std::unique_ptr<BluetoothAudioSessionInstance>
     BluetoothAudioSessionInstance::instance_ptr =
         std::unique_ptr<BluetoothAudioSessionInstance>(
@@ -16,10 +16,12 @@
 
 #pragma once
 
+#include <atomic>
 #include <mutex>
 #include <unordered_map>
 
 #include <android/hardware/bluetooth/audio/2.0/IBluetoothAudioPort.h>
+#include <fmq/EventFlag.h>
 #include <fmq/MessageQueue.h>
 #include <hardware/audio.h>
 #include <hidl/MQDescriptor.h>
@@ -29,6 +31,7 @@ namespace bluetooth {
 namespace audio {
 
 using ::android::sp;
+using ::android::hardware::EventFlag;
 using ::android::hardware::kSynchronizedReadWrite;
 using ::android::hardware::MessageQueue;
 using ::android::hardware::bluetooth::audio::V2_0::AudioConfiguration;
@@ -78,6 +81,15 @@ struct PortStatusCallbacks {
   std::function<void(uint16_t cookie)> session_changed_cb_;
 };
 
+// The health of the software encoding data path (FMQ) of a session
+struct DataPathCounters {
+  // times the writer found the FMQ drained, so the Bluetooth stack has likely
+  // run out of data
+  uint64_t underruns;
+  // times the FMQ stayed full until the write timed out and data was dropped
+  uint64_t overflows;
+};
+
 class BluetoothAudioSession {
  private:
   // using recursive_mutex to allow hwbinder to re-enter agian.
@@ -86,8 +98,16 @@ class BluetoothAudioSession {
 
   // audio control path to use for both software and offloading
   sp<IBluetoothAudioPort> stack_iface_;
-  // audio data path (FMQ) for software encoding
-  std::unique_ptr<DataMQ> mDataMQ;
+  // audio data path (FMQ) for software encoding. It is shared with the writer,
+  // which copies the data without holding mutex_.
+  struct DataPath {
+    std::unique_ptr<DataMQ> data_mq;
+    EventFlag* event_flag = nullptr;
+    ~DataPath();
+  };
+  std::shared_ptr<DataPath> data_path_;
+  std::atomic<uint64_t> underruns_;
+  std::atomic<uint64_t> overflows_;
   // audio data configuration for both software and offloading
   AudioConfiguration audio_config_;
 
@@ -154,6 +174,10 @@ class BluetoothAudioSession {
   // The control function writes stream to FMQ
   size_t OutWritePcmData(const void* buffer, size_t bytes);
 
+  // The report function is for the Bluetooth stack to check the underruns and
+  // overflows of the data path since the session was started
+  DataPathCounters GetDataPathCounters();
+
   static constexpr PcmParameters kInvalidPcmParameters = {
       .sampleRate = SampleRate::RATE_UNKNOWN,
       .channelMode = ChannelMode::UNKNOWN,
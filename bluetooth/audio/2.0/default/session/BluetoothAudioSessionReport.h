@@ -56,6 +56,16 @@ class BluetoothAudioSessionReport {
       session_ptr->ReportControlStatus(start_resp, status);
     }
   }
+  // The API reports the underruns and overflows of the software encoding data
+  // path since the session was started
+  static DataPathCounters GetDataPathCounters(const SessionType& session_type) {
+    std::shared_ptr<BluetoothAudioSession> session_ptr =
+        BluetoothAudioSessionInstance::GetSessionInstance(session_type);
+    if (session_ptr != nullptr) {
+      return session_ptr->GetDataPathCounters();
+    }
+    return {};
+  }
 };
 
 }  // namespace audio
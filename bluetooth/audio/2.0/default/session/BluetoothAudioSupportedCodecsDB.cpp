@@ -42,7 +42,7 @@ using ::android::hardware::bluetooth::audio::V2_0::SbcNumSubbands;
 using ::android::hardware::bluetooth::audio::V2_0::SbcParameters;
 
 // Default Supported PCM Parameters
-static const PcmParameters kDefaultSoftwarePcmCapabilities = {
+static constexpr PcmParameters kDefaultSoftwarePcmCapabilities = {
     .sampleRate = static_cast<SampleRate>(
         SampleRate::RATE_44100 | SampleRate::RATE_48000 |
         SampleRate::RATE_88200 | SampleRate::RATE_96000 |
@@ -56,7 +56,7 @@ static const PcmParameters kDefaultSoftwarePcmCapabilities = {
 // Default Supported Codecs
 // SBC: mSampleRate:(44100), mBitsPerSample:(16), mChannelMode:(MONO|STEREO)
 //      all blocks | subbands 8 | Loudness
-static const SbcParameters kDefaultOffloadSbcCapability = {
+static constexpr SbcParameters kDefaultOffloadSbcCapability = {
     .sampleRate = SampleRate::RATE_44100,
     .channelMode = static_cast<SbcChannelMode>(SbcChannelMode::MONO |
                                                SbcChannelMode::JOINT_STEREO),
@@ -70,7 +70,7 @@ static const SbcParameters kDefaultOffloadSbcCapability = {
     .maxBitpool = 53};
 
 // AAC: mSampleRate:(44100), mBitsPerSample:(16), mChannelMode:(STEREO)
-static const AacParameters kDefaultOffloadAacCapability = {
+static constexpr AacParameters kDefaultOffloadAacCapability = {
     .objectType = AacObjectType::MPEG2_LC,
     .sampleRate = SampleRate::RATE_44100,
     .channelMode = ChannelMode::STEREO,
@@ -79,7 +79,7 @@ static const AacParameters kDefaultOffloadAacCapability = {
 
 // LDAC: mSampleRate:(44100|48000|88200|96000), mBitsPerSample:(16|24|32),
 //       mChannelMode:(DUAL|STEREO)
-static const LdacParameters kDefaultOffloadLdacCapability = {
+static constexpr LdacParameters kDefaultOffloadLdacCapability = {
     .sampleRate = static_cast<SampleRate>(
         SampleRate::RATE_44100 | SampleRate::RATE_48000 |
         SampleRate::RATE_88200 | SampleRate::RATE_96000),
@@ -91,7 +91,7 @@ static const LdacParameters kDefaultOffloadLdacCapability = {
                                                 BitsPerSample::BITS_32)};
 
 // aptX: mSampleRate:(44100|48000), mBitsPerSample:(16), mChannelMode:(STEREO)
-static const AptxParameters kDefaultOffloadAptxCapability = {
+static constexpr AptxParameters kDefaultOffloadAptxCapability = {
     .sampleRate = static_cast<SampleRate>(SampleRate::RATE_44100 |
                                           SampleRate::RATE_48000),
     .channelMode = ChannelMode::STEREO,
@@ -100,7 +100,7 @@ static const AptxParameters kDefaultOffloadAptxCapability = {
 
 // aptX HD: mSampleRate:(44100|48000), mBitsPerSample:(24),
 //          mChannelMode:(STEREO)
-static const AptxParameters kDefaultOffloadAptxHdCapability = {
+static constexpr AptxParameters kDefaultOffloadAptxHdCapability = {
     .sampleRate = static_cast<SampleRate>(SampleRate::RATE_44100 |
                                           SampleRate::RATE_48000),
     .channelMode = ChannelMode::STEREO,
@@ -114,19 +114,14 @@ const std::vector<CodecCapabilities> kDefaultOffloadA2dpCodecCapabilities = {
     {.codecType = CodecType::APTX, .capabilities = {}},
     {.codecType = CodecType::APTX_HD, .capabilities = {}}};
 
-static bool IsSingleBit(uint32_t bitmasks, uint32_t bitfield) {
-  bool single = false;
-  uint32_t test_bit = 0x00000001;
-  while (test_bit <= bitmasks && test_bit <= bitfield) {
-    if (bitfield & test_bit && bitmasks & test_bit) {
-      if (single) return false;
-      single = true;
-    }
-    if (test_bit == 0x80000000) break;
-    test_bit <<= 1;
-  }
-  return single;
+// Whether exactly one of the bits in bitfield is set in bitmasks
+static constexpr bool IsSingleBit(uint32_t bitmasks, uint32_t bitfield) {
+  return (bitmasks & bitfield) != 0 &&
+         ((bitmasks & bitfield) & ((bitmasks & bitfield) - 1)) == 0;
 }
+static_assert(IsSingleBit(0x10, 0xf0) && IsSingleBit(0x13, 0xf0) &&
+                  !IsSingleBit(0x30, 0xf0) && !IsSingleBit(0x03, 0xf0),
+              "IsSingleBit only counts the bits of the bitfield");
 
 static bool IsOffloadSbcConfigurationValid(
     const CodecConfiguration::CodecSpecific& codec_specific);
@@ -337,18 +332,28 @@ std::vector<CodecCapabilities> GetOffloadCodecCapabilities(
   return offload_a2dp_codec_capabilities;
 }
 
+// Whether value is a single bit of bitfield, with no other bit set
+static constexpr bool IsSingleBitOf(uint32_t value, uint32_t bitfield) {
+  return (value & bitfield) == value && IsSingleBit(value, bitfield);
+}
+
+// The valid software PCM values are all the values the software encoding
+// datapath supports. Each of them is a single bit of the capabilities.
+static constexpr uint32_t kValidSoftwarePcmSampleRates =
+    SampleRate::RATE_44100 | SampleRate::RATE_48000 | SampleRate::RATE_88200 |
+    SampleRate::RATE_96000 | SampleRate::RATE_16000 | SampleRate::RATE_24000;
+static constexpr uint32_t kValidSoftwarePcmBitsPerSample =
+    BitsPerSample::BITS_16 | BitsPerSample::BITS_24 | BitsPerSample::BITS_32;
+static constexpr uint32_t kValidSoftwarePcmChannelModes =
+    ChannelMode::MONO | ChannelMode::STEREO;
+
 bool IsSoftwarePcmConfigurationValid(const PcmParameters& pcm_config) {
-  if ((pcm_config.sampleRate != SampleRate::RATE_44100 &&
-       pcm_config.sampleRate != SampleRate::RATE_48000 &&
-       pcm_config.sampleRate != SampleRate::RATE_88200 &&
-       pcm_config.sampleRate != SampleRate::RATE_96000 &&
-       pcm_config.sampleRate != SampleRate::RATE_16000 &&
-       pcm_config.sampleRate != SampleRate::RATE_24000) ||
-      (pcm_config.bitsPerSample != BitsPerSample::BITS_16 &&
-       pcm_config.bitsPerSample != BitsPerSample::BITS_24 &&
-       pcm_config.bitsPerSample != BitsPerSample::BITS_32) ||
-      (pcm_config.channelMode != ChannelMode::MONO &&
-       pcm_config.channelMode != ChannelMode::STEREO)) {
+  if (!IsSingleBitOf(static_cast<uint32_t>(pcm_config.sampleRate),
+                     kValidSoftwarePcmSampleRates) ||
+      !IsSingleBitOf(static_cast<uint32_t>(pcm_config.bitsPerSample),
+                     kValidSoftwarePcmBitsPerSample) ||
+      !IsSingleBitOf(static_cast<uint32_t>(pcm_config.channelMode),
+                     kValidSoftwarePcmChannelModes)) {
     LOG(WARNING) << __func__
                  << ": Invalid PCM Configuration=" << toString(pcm_config);
     return false;
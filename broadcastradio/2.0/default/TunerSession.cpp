@@ -21,6 +21,8 @@
 #include <android-base/logging.h>
 #include <broadcastradio-utils-2x/Utils.h>
 
+#include <algorithm>
+
 namespace android {
 namespace hardware {
 namespace broadcastradio {
@@ -34,7 +36,6 @@ using utils::tunesTo;
 using std::lock_guard;
 using std::move;
 using std::mutex;
-using std::sort;
 using std::vector;
 
 namespace delay {
@@ -43,9 +44,17 @@ static constexpr auto seek = 200ms;
 static constexpr auto step = 100ms;
 static constexpr auto tune = 150ms;
 static constexpr auto list = 1s;
+static constexpr auto sweepStep = 100ms;
 
 }  // namespace delay
 
+// Keeps each onProgramListUpdated transaction well below the binder buffer size, even for DAB
+// services carrying a lot of metadata.
+static constexpr size_t kProgramListChunkSize = 64;
+
+// Number of programs a single sweep step looks at before publishing what it found.
+static constexpr size_t kSweepStepSize = 4;
+
 TunerSession::TunerSession(BroadcastRadio& module, const sp<ITunerCallback>& callback)
     : mCallback(callback), mModule(module) {
     auto&& ranges = module.getAmFmConfig().ranges;
@@ -79,6 +88,15 @@ void TunerSession::tuneInternalLocked(const ProgramSelector& sel) {
     mIsTuneCompleted = true;
 
     mCallback->onCurrentProgramInfoChanged(programInfo);
+    finishTuneLocked();
+}
+
+void TunerSession::finishTuneLocked() {
+    mIsTunePending = false;
+    if (mIsSweepDeferred && !mIsClosed) {
+        mIsSweepDeferred = false;
+        scheduleSweepStepLocked(delay::sweepStep);
+    }
 }
 
 const BroadcastRadio& TunerSession::module() const {
@@ -108,6 +126,7 @@ Return<Result> TunerSession::tune(const ProgramSelector& sel) {
     cancelLocked();
 
     mIsTuneCompleted = false;
+    mIsTunePending = true;
     auto task = [this, sel]() {
         lock_guard<mutex> lk(mMut);
         tuneInternalLocked(sel);
@@ -125,23 +144,25 @@ Return<Result> TunerSession::scan(bool directionUp, bool skipSubChannel) {
 
     cancelLocked();
 
-    auto list = virtualRadio().getProgramList();
+    auto programs = virtualRadio().getProgramList();
+    auto& list = *programs;
 
     if (list.empty()) {
         mIsTuneCompleted = false;
+        mIsTunePending = true;
         auto task = [this]() {
             LOG(DEBUG) << "program list is empty, seek couldn't stop";
 
+            lock_guard<mutex> lk(mMut);
             mCallback->onTuneFailed(Result::TIMEOUT, {});
+            finishTuneLocked();
         };
         mThread.schedule(task, delay::seek);
 
         return Result::OK;
     }
 
-    // Not optimal (O(sort) instead of O(n)), but not a big deal here;
-    // also, it's likely that list is already sorted (so O(n) anyway).
-    sort(list.begin(), list.end());
+    // VirtualRadio keeps its list sorted.
     auto current = mCurrentProgram;
     auto found = lower_bound(list.begin(), list.end(), VirtualProgram({current}));
     if (directionUp) {
@@ -160,6 +181,7 @@ Return<Result> TunerSession::scan(bool directionUp, bool skipSubChannel) {
     auto tuneTo = found->selector;
 
     mIsTuneCompleted = false;
+    mIsTunePending = true;
     auto task = [this, tuneTo, directionUp]() {
         LOG(VERBOSE) << "executing seek up=" << directionUp;
 
@@ -199,6 +221,7 @@ Return<Result> TunerSession::step(bool directionUp) {
     if (stepTo < range->lowerBound) stepTo = range->upperBound;
 
     mIsTuneCompleted = false;
+    mIsTunePending = true;
     auto task = [this, stepTo]() {
         LOG(VERBOSE) << "executing step to " << stepTo;
 
@@ -218,6 +241,7 @@ void TunerSession::cancelLocked() {
     if (utils::getType(mCurrentProgram.primaryId) != IdentifierType::INVALID) {
         mIsTuneCompleted = true;
     }
+    finishTuneLocked();
 }
 
 Return<void> TunerSession::cancel() {
@@ -234,30 +258,110 @@ Return<Result> TunerSession::startProgramListUpdates(const ProgramFilter& filter
     lock_guard<mutex> lk(mMut);
     if (mIsClosed) return Result::INVALID_STATE;
 
-    auto list = virtualRadio().getProgramList();
-    vector<VirtualProgram> filteredList;
-    auto filterCb = [&filter](const VirtualProgram& program) {
-        return utils::satisfies(filter, program.selector);
-    };
-    std::copy_if(list.begin(), list.end(), std::back_inserter(filteredList), filterCb);
+    mSweepThread.cancelAll();
+    mIsSweepDeferred = false;
+    mProgramFilter = filter;
+    // The client has nothing yet, so clear whatever an earlier session left behind.
+    mPurgePending = mProgramListSnapshot.empty();
+    mSweepPrograms = virtualRadio().getProgramList();
+    mSweepPosition = 0;
+    mSweepResults.clear();
 
-    auto task = [this, list]() {
-        lock_guard<mutex> lk(mMut);
+    scheduleSweepStepLocked(delay::list);
 
-        ProgramListChunk chunk = {};
-        chunk.purge = true;
-        chunk.complete = true;
-        chunk.modified = hidl_vec<ProgramInfo>(list.begin(), list.end());
+    return Result::OK;
+}
 
-        mCallback->onProgramListUpdated(chunk);
+void TunerSession::scheduleSweepStepLocked(std::chrono::milliseconds delay) {
+    auto task = [this]() {
+        lock_guard<mutex> lk(mMut);
+        sweepStepLocked();
     };
-    mThread.schedule(task, delay::list);
+    mSweepThread.schedule(task, delay);
+}
 
-    return Result::OK;
+/**
+ * Sweeps the next few programs and publishes the ones that are new to the client.
+ *
+ * The sweep steps aside while a tune, seek or step is in flight, so those are never delayed
+ * by a background scan; finishTuneLocked resumes it once the operation is over.
+ */
+void TunerSession::sweepStepLocked() {
+    // updates were stopped before this task ran
+    if (!mProgramFilter || !mSweepPrograms) return;
+
+    if (mIsTunePending) {
+        mIsSweepDeferred = true;
+        return;
+    }
+
+    auto& programs = *mSweepPrograms;
+    auto end = std::min(programs.size(), mSweepPosition + kSweepStepSize);
+    vector<ProgramInfo> modified;
+    for (; mSweepPosition < end; mSweepPosition++) {
+        auto& program = programs[mSweepPosition];
+        if (!utils::satisfies(*mProgramFilter, program.selector)) continue;
+
+        ProgramInfo info = program;
+        mSweepResults.insert(info);
+
+        auto it = mProgramListSnapshot.find(info);
+        if (it != mProgramListSnapshot.end()) {
+            if (mProgramFilter->excludeModifications || *it == info) continue;
+            mProgramListSnapshot.erase(it);
+        }
+        mProgramListSnapshot.insert(info);
+        modified.push_back(move(info));
+    }
+
+    if (mSweepPosition < programs.size()) {
+        if (!modified.empty()) {
+            ProgramListChunk chunk = {};
+            chunk.modified = move(modified);
+            sendProgramListChunkLocked(chunk);
+        }
+        scheduleSweepStepLocked(delay::sweepStep);
+        return;
+    }
+
+    // The sweep is over: drop whatever went off the air and mark the list complete.
+    auto chunks = utils::diffProgramList(mProgramListSnapshot, mSweepResults, true,
+                                         kProgramListChunkSize);
+    for (auto it = mProgramListSnapshot.begin(); it != mProgramListSnapshot.end();) {
+        if (mSweepResults.count(*it) == 0) {
+            it = mProgramListSnapshot.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    mSweepResults.clear();
+    mSweepPrograms.reset();
+
+    if (!modified.empty()) {
+        ProgramListChunk chunk = {};
+        chunk.modified = move(modified);
+        sendProgramListChunkLocked(chunk);
+    }
+    for (auto&& chunk : chunks) {
+        sendProgramListChunkLocked(chunk);
+    }
+}
+
+void TunerSession::sendProgramListChunkLocked(ProgramListChunk& chunk) {
+    chunk.purge = mPurgePending;
+    mPurgePending = false;
+    mCallback->onProgramListUpdated(chunk);
 }
 
 Return<void> TunerSession::stopProgramListUpdates() {
     LOG(DEBUG) << "requested program list updates to stop";
+    lock_guard<mutex> lk(mMut);
+    mSweepThread.cancelAll();
+    mIsSweepDeferred = false;
+    mProgramFilter.reset();
+    mProgramListSnapshot.clear();
+    mSweepPrograms.reset();
+    mSweepResults.clear();
     return {};
 }
 
@@ -293,6 +397,7 @@ Return<void> TunerSession::close() {
 
     mIsClosed = true;
     mThread.cancelAll();
+    mSweepThread.cancelAll();
     return {};
 }
 
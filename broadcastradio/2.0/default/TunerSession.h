@@ -20,6 +20,7 @@
 
 #include <android/hardware/broadcastradio/2.0/ITunerCallback.h>
 #include <android/hardware/broadcastradio/2.0/ITunerSession.h>
+#include <broadcastradio-utils-2x/Utils.h>
 #include <broadcastradio-utils/WorkerThread.h>
 
 #include <optional>
@@ -55,15 +56,37 @@ struct TunerSession : public ITunerSession {
    private:
     std::mutex mMut;
     WorkerThread mThread;
+    // Runs program list sweeps, so they never queue up in front of a tune.
+    WorkerThread mSweepThread;
     bool mIsClosed = false;
 
     const sp<ITunerCallback> mCallback;
 
     std::reference_wrapper<BroadcastRadio> mModule;
     bool mIsTuneCompleted = false;
+    // Set from scheduling a tune, seek or step until it completes, fails or is cancelled.
+    bool mIsTunePending = false;
     ProgramSelector mCurrentProgram = {};
 
+    // Set while program list updates are running.
+    std::optional<ProgramFilter> mProgramFilter;
+    // The filtered program list as last sent to the client.
+    utils::ProgramInfoSet mProgramListSnapshot;
+    // Whether the next chunk sent to the client has to purge its list.
+    bool mPurgePending = false;
+
+    // State of the sweep in progress, if any.
+    std::shared_ptr<const std::vector<VirtualProgram>> mSweepPrograms;
+    size_t mSweepPosition = 0;
+    utils::ProgramInfoSet mSweepResults;
+    // Set when the sweep stepped aside for a pending tune and waits for it to finish.
+    bool mIsSweepDeferred = false;
+
     void cancelLocked();
+    void finishTuneLocked();
+    void scheduleSweepStepLocked(std::chrono::milliseconds delay);
+    void sweepStepLocked();
+    void sendProgramListChunkLocked(ProgramListChunk& chunk);
     void tuneInternalLocked(const ProgramSelector& sel);
     const VirtualRadio& virtualRadio() const;
     const BroadcastRadio& module() const;
@@ -17,15 +17,16 @@
 
 #include <broadcastradio-utils-2x/Utils.h>
 
+#include <algorithm>
+
 namespace android {
 namespace hardware {
 namespace broadcastradio {
 namespace V2_0 {
 namespace implementation {
 
-using std::lock_guard;
-using std::move;
-using std::mutex;
+using std::make_shared;
+using std::shared_ptr;
 using std::vector;
 using utils::make_selector_amfm;
 using utils::make_selector_dab;
@@ -52,21 +53,24 @@ VirtualRadio gDabRadio(
     });
 // clang-format on
 
+static shared_ptr<const vector<VirtualProgram>> makeSortedList(vector<VirtualProgram> list) {
+    std::sort(list.begin(), list.end());
+    return make_shared<const vector<VirtualProgram>>(std::move(list));
+}
+
 VirtualRadio::VirtualRadio(const std::string& name, const vector<VirtualProgram>& initialList)
-    : mName(name), mPrograms(initialList) {}
+    : mName(name), mPrograms(makeSortedList(initialList)) {}
 
 std::string VirtualRadio::getName() const {
     return mName;
 }
 
-vector<VirtualProgram> VirtualRadio::getProgramList() const {
-    lock_guard<mutex> lk(mMut);
+shared_ptr<const vector<VirtualProgram>> VirtualRadio::getProgramList() const {
     return mPrograms;
 }
 
 bool VirtualRadio::getProgram(const ProgramSelector& selector, VirtualProgram& programOut) const {
-    lock_guard<mutex> lk(mMut);
-    for (auto&& program : mPrograms) {
+    for (auto&& program : *mPrograms) {
         if (utils::tunesTo(selector, program.selector)) {
             programOut = program;
             return true;
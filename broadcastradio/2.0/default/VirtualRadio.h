@@ -18,7 +18,7 @@
 
 #include "VirtualProgram.h"
 
-#include <mutex>
+#include <memory>
 #include <vector>
 
 namespace android {
@@ -34,19 +34,22 @@ namespace implementation {
  * not a captured station list in the radio tuner memory.
  *
  * It's meant to abstract out radio content from default tuner implementation.
+ *
+ * The program list is an immutable, sorted snapshot shared by all sessions, so
+ * readers (including background sweeps) never copy it or hold a lock while
+ * walking it.
  */
 class VirtualRadio {
    public:
     VirtualRadio(const std::string& name, const std::vector<VirtualProgram>& initialList);
 
     std::string getName() const;
-    std::vector<VirtualProgram> getProgramList() const;
+    std::shared_ptr<const std::vector<VirtualProgram>> getProgramList() const;
     bool getProgram(const ProgramSelector& selector, VirtualProgram& program) const;
 
    private:
-    mutable std::mutex mMut;
     std::string mName;
-    std::vector<VirtualProgram> mPrograms;
+    std::shared_ptr<const std::vector<VirtualProgram>> mPrograms;
 };
 
 /** AM/FM virtual radio space. */
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <broadcastradio-utils-2x/Utils.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+namespace {
+
+namespace V2_0 = android::hardware::broadcastradio::V2_0;
+namespace utils = android::hardware::broadcastradio::utils;
+
+using android::hardware::hidl_vec;
+using V2_0::MetadataKey;
+using V2_0::ProgramInfo;
+
+ProgramInfo makeProgram(uint32_t frequency, const std::string& name) {
+    ProgramInfo info = {};
+    info.selector = utils::make_selector_amfm(frequency);
+    info.metadata = hidl_vec<V2_0::Metadata>({utils::make_metadata(MetadataKey::RDS_PS, name)});
+    return info;
+}
+
+utils::ProgramInfoSet applyAll(utils::ProgramInfoSet list,
+                               const std::vector<V2_0::ProgramListChunk>& chunks) {
+    for (auto&& chunk : chunks) utils::updateProgramList(list, chunk);
+    return list;
+}
+
+TEST(ProgramListTest, diffAddsModifiesAndRemoves) {
+    utils::ProgramInfoSet from = {makeProgram(88100, "A"), makeProgram(94900, "B"),
+                                  makeProgram(101100, "C")};
+    utils::ProgramInfoSet to = {makeProgram(88100, "A"), makeProgram(94900, "B2"),
+                                makeProgram(106100, "D")};
+
+    auto chunks = utils::diffProgramList(from, to, false, 64);
+    ASSERT_EQ(1u, chunks.size());
+    EXPECT_TRUE(chunks[0].complete);
+    EXPECT_FALSE(chunks[0].purge);
+    EXPECT_EQ(2u, chunks[0].modified.size());  // B2 and D, A is unchanged
+    ASSERT_EQ(1u, chunks[0].removed.size());
+    EXPECT_EQ(101100u, chunks[0].removed[0].value);
+
+    auto result = applyAll(from, chunks);
+    ASSERT_EQ(to.size(), result.size());
+    for (auto&& info : to) {
+        auto it = result.find(info);
+        ASSERT_NE(result.end(), it);
+        EXPECT_EQ(info, *it);
+    }
+}
+
+TEST(ProgramListTest, diffExcludesModifications) {
+    utils::ProgramInfoSet from = {makeProgram(94900, "B")};
+    utils::ProgramInfoSet to = {makeProgram(94900, "B2"), makeProgram(106100, "D")};
+
+    auto chunks = utils::diffProgramList(from, to, true, 64);
+    ASSERT_EQ(1u, chunks.size());
+    ASSERT_EQ(1u, chunks[0].modified.size());
+    EXPECT_EQ(106100u, chunks[0].modified[0].selector.primaryId.value);
+}
+
+TEST(ProgramListTest, diffIsChunked) {
+    utils::ProgramInfoSet from;
+    utils::ProgramInfoSet to;
+    for (uint32_t i = 0; i < 250; i++) {
+        from.insert(makeProgram(87500 + i * 100, "old"));
+        to.insert(makeProgram(87500 + i * 100 + 50, "new"));
+    }
+
+    auto chunks = utils::diffProgramList(from, to, false, 64);
+    ASSERT_EQ(8u, chunks.size());  // 500 entries in chunks of 64
+    for (size_t i = 0; i < chunks.size(); i++) {
+        EXPECT_LE(chunks[i].modified.size() + chunks[i].removed.size(), 64u);
+        EXPECT_EQ(i == chunks.size() - 1, chunks[i].complete);
+    }
+    EXPECT_EQ(to.size(), applyAll(from, chunks).size());
+}
+
+TEST(ProgramListTest, diffOfEqualListsIsOneEmptyCompleteChunk) {
+    utils::ProgramInfoSet list = {makeProgram(88100, "A")};
+
+    auto chunks = utils::diffProgramList(list, list, false, 64);
+    ASSERT_EQ(1u, chunks.size());
+    EXPECT_TRUE(chunks[0].complete);
+    EXPECT_EQ(0u, chunks[0].modified.size());
+    EXPECT_EQ(0u, chunks[0].removed.size());
+}
+
+TEST(ProgramListTest, indexAppliesChunks) {
+    utils::ProgramInfoIndex index;
+    V2_0::ProgramListChunk chunk = {};
+    chunk.purge = true;
+    chunk.modified = hidl_vec<ProgramInfo>({makeProgram(88100, "A"), makeProgram(94900, "B")});
+    index.apply(chunk);
+    ASSERT_EQ(2u, index.size());
+
+    chunk = {};
+    chunk.modified = hidl_vec<ProgramInfo>({makeProgram(94900, "B2")});
+    chunk.removed = hidl_vec<V2_0::ProgramIdentifier>(
+        {utils::make_identifier(V2_0::IdentifierType::AMFM_FREQUENCY, 88100)});
+    index.apply(chunk);
+    ASSERT_EQ(1u, index.size());
+
+    auto primaryId = utils::make_identifier(V2_0::IdentifierType::AMFM_FREQUENCY, 94900);
+    ASSERT_NE(nullptr, index.find(primaryId));
+    EXPECT_EQ(std::optional<std::string>("B2"),
+              index.getMetadataString(primaryId, MetadataKey::RDS_PS));
+    EXPECT_EQ(std::nullopt, index.getMetadataString(primaryId, MetadataKey::RDS_PTY));
+}
+
+TEST(ProgramListTest, indexFilterMatchesSatisfies) {
+    utils::ProgramInfoIndex index;
+    std::vector<ProgramInfo> programs = {makeProgram(88100, "A"), makeProgram(94900, "B")};
+    ProgramInfo dab = {};
+    dab.selector = utils::make_selector_dab(0xA00001, 0x1001);
+    programs.push_back(dab);
+    for (auto&& info : programs) index.insert(info);
+
+    auto count = [&programs](const V2_0::ProgramFilter& filter) {
+        return std::count_if(programs.begin(), programs.end(), [&filter](const ProgramInfo& info) {
+            return utils::satisfies(filter, info.selector);
+        });
+    };
+
+    V2_0::ProgramFilter filter = {};
+    EXPECT_EQ(size_t(count(filter)), index.filter(filter).size());
+
+    filter.identifierTypes = hidl_vec<uint32_t>(
+        {static_cast<uint32_t>(V2_0::IdentifierType::DAB_ENSEMBLE)});
+    EXPECT_EQ(1u, index.filter(filter).size());
+    EXPECT_EQ(size_t(count(filter)), index.filter(filter).size());
+
+    filter = {};
+    filter.identifiers = hidl_vec<V2_0::ProgramIdentifier>(
+        {utils::make_identifier(V2_0::IdentifierType::AMFM_FREQUENCY, 94900)});
+    auto result = index.filter(filter);
+    ASSERT_EQ(1u, result.size());
+    EXPECT_EQ(94900u, result[0]->selector.primaryId.value);
+}
+
+}  // anonymous namespace
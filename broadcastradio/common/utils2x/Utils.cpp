@@ -350,9 +350,7 @@ bool satisfies(const ProgramFilter& filter, const ProgramSelector& sel) {
     return true;
 }
 
-size_t ProgramInfoHasher::operator()(const ProgramInfo& info) const {
-    auto& id = info.selector.primaryId;
-
+size_t ProgramIdentifierHasher::operator()(const ProgramIdentifier& id) const {
     /* This is not the best hash implementation, but good enough for default HAL
      * implementation and tests. */
     auto h = std::hash<uint32_t>{}(id.type);
@@ -362,6 +360,10 @@ size_t ProgramInfoHasher::operator()(const ProgramInfo& info) const {
     return h;
 }
 
+size_t ProgramInfoHasher::operator()(const ProgramInfo& info) const {
+    return ProgramIdentifierHasher{}(info.selector.primaryId);
+}
+
 bool ProgramInfoKeyEqual::operator()(const ProgramInfo& info1, const ProgramInfo& info2) const {
     auto& id1 = info1.selector.primaryId;
     auto& id2 = info2.selector.primaryId;
@@ -371,7 +373,11 @@ bool ProgramInfoKeyEqual::operator()(const ProgramInfo& info1, const ProgramInfo
 void updateProgramList(ProgramInfoSet& list, const ProgramListChunk& chunk) {
     if (chunk.purge) list.clear();
 
-    list.insert(chunk.modified.begin(), chunk.modified.end());
+    for (auto&& info : chunk.modified) {
+        // insert() would keep the stale entry, since entries are keyed by primary id only
+        list.erase(info);
+        list.insert(info);
+    }
 
     for (auto&& id : chunk.removed) {
         ProgramInfo info = {};
@@ -380,6 +386,45 @@ void updateProgramList(ProgramInfoSet& list, const ProgramListChunk& chunk) {
     }
 }
 
+vector<ProgramListChunk> diffProgramList(const ProgramInfoSet& from, const ProgramInfoSet& to,
+                                         bool excludeModifications, size_t maxChunkSize) {
+    vector<ProgramInfo> modified;
+    vector<ProgramIdentifier> removed;
+
+    for (auto&& info : to) {
+        auto it = from.find(info);
+        if (it == from.end() || (!excludeModifications && !(*it == info))) {
+            modified.push_back(info);
+        }
+    }
+    for (auto&& info : from) {
+        if (to.count(info) == 0) removed.push_back(info.selector.primaryId);
+    }
+
+    if (maxChunkSize == 0) maxChunkSize = 1;
+    vector<ProgramListChunk> chunks;
+    auto modifiedIt = modified.begin();
+    auto removedIt = removed.begin();
+    do {
+        ProgramListChunk chunk = {};
+        size_t space = maxChunkSize;
+
+        size_t count = std::min<size_t>(space, removed.end() - removedIt);
+        chunk.removed = hidl_vec<ProgramIdentifier>(removedIt, removedIt + count);
+        removedIt += count;
+        space -= count;
+
+        count = std::min<size_t>(space, modified.end() - modifiedIt);
+        chunk.modified = hidl_vec<ProgramInfo>(modifiedIt, modifiedIt + count);
+        modifiedIt += count;
+
+        chunks.push_back(std::move(chunk));
+    } while (modifiedIt != modified.end() || removedIt != removed.end());
+    chunks.back().complete = true;
+
+    return chunks;
+}
+
 std::optional<std::string> getMetadataString(const V2_0::ProgramInfo& info,
                                              const V2_0::MetadataKey key) {
     auto isKey = [key](const V2_0::Metadata& item) {
@@ -392,6 +437,120 @@ std::optional<std::string> getMetadataString(const V2_0::ProgramInfo& info,
     return it->stringValue;
 }
 
+void ProgramInfoIndex::apply(const ProgramListChunk& chunk) {
+    if (chunk.purge) clear();
+
+    for (auto&& id : chunk.removed) {
+        erase(id);
+    }
+    for (auto&& info : chunk.modified) {
+        insert(info);
+    }
+}
+
+void ProgramInfoIndex::insert(const ProgramInfo& info) {
+    auto& primaryId = info.selector.primaryId;
+    erase(primaryId);
+
+    Entry& entry = mPrograms[primaryId];
+    entry.info = info;
+    for (size_t i = 0; i < info.metadata.size(); i++) {
+        // the first occurrence of a key wins, as in getMetadataString(info, key)
+        entry.metadata.emplace(info.metadata[i].key, i);
+    }
+    for (auto&& id : info.selector) {
+        mByIdentifier[id].insert(primaryId);
+        mByType[id.type].insert(primaryId);
+    }
+}
+
+bool ProgramInfoIndex::erase(const ProgramIdentifier& primaryId) {
+    auto it = mPrograms.find(primaryId);
+    if (it == mPrograms.end()) return false;
+
+    unindex(it->second);
+    mPrograms.erase(it);
+    return true;
+}
+
+void ProgramInfoIndex::unindex(const Entry& entry) {
+    auto& primaryId = entry.info.selector.primaryId;
+    auto drop = [&primaryId](auto& index, const auto& key) {
+        auto it = index.find(key);
+        if (it == index.end()) return;
+        it->second.erase(primaryId);
+        if (it->second.empty()) index.erase(it);
+    };
+
+    for (auto&& id : entry.info.selector) {
+        drop(mByIdentifier, id);
+        drop(mByType, id.type);
+    }
+}
+
+void ProgramInfoIndex::clear() {
+    mPrograms.clear();
+    mByIdentifier.clear();
+    mByType.clear();
+}
+
+const ProgramInfo* ProgramInfoIndex::find(const ProgramIdentifier& primaryId) const {
+    auto it = mPrograms.find(primaryId);
+    if (it == mPrograms.end()) return nullptr;
+    return &it->second.info;
+}
+
+vector<const ProgramInfo*> ProgramInfoIndex::filter(const ProgramFilter& filter) const {
+    vector<const ProgramInfo*> result;
+
+    // Narrow down to the programs carrying one of the requested identifiers (or identifier
+    // types), then check the remaining criteria on those only.
+    IdSet candidates;
+    bool narrowed = false;
+    if (filter.identifiers.size() > 0) {
+        narrowed = true;
+        for (auto&& id : filter.identifiers) {
+            auto it = mByIdentifier.find(id);
+            if (it != mByIdentifier.end()) candidates.insert(it->second.begin(), it->second.end());
+        }
+    } else if (filter.identifierTypes.size() > 0) {
+        narrowed = true;
+        for (auto&& type : filter.identifierTypes) {
+            auto it = mByType.find(type);
+            if (it != mByType.end()) candidates.insert(it->second.begin(), it->second.end());
+        }
+    }
+
+    auto check = [&filter, &result](const ProgramInfo& info) {
+        if (satisfies(filter, info.selector)) result.push_back(&info);
+    };
+    if (narrowed) {
+        result.reserve(candidates.size());
+        for (auto&& primaryId : candidates) {
+            check(mPrograms.at(primaryId).info);
+        }
+    } else {
+        result.reserve(mPrograms.size());
+        for (auto&& entry : mPrograms) {
+            check(entry.second.info);
+        }
+    }
+
+    return result;
+}
+
+std::optional<std::string> ProgramInfoIndex::getMetadataString(const ProgramIdentifier& primaryId,
+                                                               const MetadataKey key) const {
+    auto program = mPrograms.find(primaryId);
+    if (program == mPrograms.end()) return std::nullopt;
+
+    auto& entry = program->second;
+    auto it = entry.metadata.find(static_cast<uint32_t>(key));
+    if (it == entry.metadata.end()) return std::nullopt;
+
+    return entry.info.metadata[it->second].stringValue;
+}
+
 V2_0::ProgramIdentifier make_hdradio_station_name(const std::string& name) {
     constexpr size_t maxlen = 8;
 
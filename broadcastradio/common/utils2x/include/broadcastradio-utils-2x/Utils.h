@@ -21,6 +21,7 @@
 #include <optional>
 #include <queue>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace android {
@@ -132,6 +133,10 @@ V2_0::Metadata make_metadata(V2_0::MetadataKey key, std::string value);
 
 bool satisfies(const V2_0::ProgramFilter& filter, const V2_0::ProgramSelector& sel);
 
+struct ProgramIdentifierHasher {
+    size_t operator()(const V2_0::ProgramIdentifier& id) const;
+};
+
 struct ProgramInfoHasher {
     size_t operator()(const V2_0::ProgramInfo& info) const;
 };
@@ -145,9 +150,72 @@ typedef std::unordered_set<V2_0::ProgramInfo, ProgramInfoHasher, ProgramInfoKeyE
 
 void updateProgramList(ProgramInfoSet& list, const V2_0::ProgramListChunk& chunk);
 
+/**
+ * Computes the updates that turn a client's copy of the program list into a new one.
+ *
+ * Entries of to that are missing in from, or differ from their counterpart there, are sent as
+ * modified (only the missing ones, if excludeModifications is set). Entries of from that are
+ * missing in to are sent as removed. The result is split into chunks of at most maxChunkSize
+ * entries, of which only the last one is complete. There is always at least one chunk.
+ *
+ * @param from The list as the client has it.
+ * @param to The new list, already restricted to the client's filter.
+ * @param excludeModifications Whether the client asked for additions only.
+ * @param maxChunkSize Maximum number of modified and removed entries per chunk.
+ * @return Chunks to be sent in order.
+ */
+std::vector<V2_0::ProgramListChunk> diffProgramList(const ProgramInfoSet& from,
+                                                    const ProgramInfoSet& to,
+                                                    bool excludeModifications,
+                                                    size_t maxChunkSize);
+
 std::optional<std::string> getMetadataString(const V2_0::ProgramInfo& info,
                                              const V2_0::MetadataKey key);
 
+/**
+ * Program list indexed by primary identifier, by every identifier a program carries and by
+ * identifier type, with a metadata key index per program.
+ *
+ * Applying a chunk costs O(changes) and a filter on identifiers or identifier types only visits
+ * the programs that carry them, instead of checking every identifier of every program.
+ */
+class ProgramInfoIndex {
+   public:
+    void apply(const V2_0::ProgramListChunk& chunk);
+    void insert(const V2_0::ProgramInfo& info);
+    bool erase(const V2_0::ProgramIdentifier& primaryId);
+    void clear();
+
+    size_t size() const { return mPrograms.size(); }
+    const V2_0::ProgramInfo* find(const V2_0::ProgramIdentifier& primaryId) const;
+
+    /**
+     * Returns the programs satisfying the filter, in no particular order. The pointers are
+     * valid until the index is modified.
+     */
+    std::vector<const V2_0::ProgramInfo*> filter(const V2_0::ProgramFilter& filter) const;
+
+    std::optional<std::string> getMetadataString(const V2_0::ProgramIdentifier& primaryId,
+                                                 const V2_0::MetadataKey key) const;
+
+   private:
+    typedef std::unordered_set<V2_0::ProgramIdentifier, ProgramIdentifierHasher> IdSet;
+
+    struct Entry {
+        V2_0::ProgramInfo info;
+        // metadata key -> position in info.metadata
+        std::unordered_map<uint32_t, size_t> metadata;
+    };
+
+    std::unordered_map<V2_0::ProgramIdentifier, Entry, ProgramIdentifierHasher> mPrograms;
+    // identifier -> primary ids of the programs carrying it
+    std::unordered_map<V2_0::ProgramIdentifier, IdSet, ProgramIdentifierHasher> mByIdentifier;
+    // identifier type -> primary ids of the programs carrying an identifier of that type
+    std::unordered_map<uint32_t, IdSet> mByType;
+
+    void unindex(const Entry& entry);
+};
+
 V2_0::ProgramIdentifier make_hdradio_station_name(const std::string& name);
 
 }  // namespace utils
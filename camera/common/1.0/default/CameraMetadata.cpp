@@ -34,22 +34,22 @@ namespace helper {
     (((uintptr_t)(val) + ((alignment) - 1)) & ~((alignment) - 1))
 
 CameraMetadata::CameraMetadata() :
-        mBuffer(NULL), mLocked(false) {
+        mBuffer(NULL), mLocked(false), mTagIndexValid(false) {
 }
 
 CameraMetadata::CameraMetadata(size_t entryCapacity, size_t dataCapacity) :
-        mLocked(false)
+        mLocked(false), mTagIndexValid(false)
 {
     mBuffer = allocate_camera_metadata(entryCapacity, dataCapacity);
 }
 
 CameraMetadata::CameraMetadata(const CameraMetadata &other) :
-        mLocked(false) {
+        mLocked(false), mTagIndexValid(false) {
     mBuffer = clone_camera_metadata(other.mBuffer);
 }
 
 CameraMetadata::CameraMetadata(camera_metadata_t *buffer) :
-        mBuffer(NULL), mLocked(false) {
+        mBuffer(NULL), mLocked(false), mTagIndexValid(false) {
     acquire(buffer);
 }
 
@@ -102,6 +102,7 @@ camera_metadata_t* CameraMetadata::release() {
     }
     camera_metadata_t *released = mBuffer;
     mBuffer = NULL;
+    invalidateTagIndex();
     return released;
 }
 
@@ -114,6 +115,7 @@ void CameraMetadata::clear() {
         free_camera_metadata(mBuffer);
         mBuffer = NULL;
     }
+    invalidateTagIndex();
 }
 
 void CameraMetadata::acquire(camera_metadata_t *buffer) {
@@ -149,6 +151,7 @@ status_t CameraMetadata::append(const camera_metadata_t* other) {
     size_t extraEntries = get_camera_metadata_entry_count(other);
     size_t extraData = get_camera_metadata_data_count(other);
     resizeIfNeeded(extraEntries, extraData);
+    invalidateTagIndex();
 
     return append_camera_metadata(mBuffer, other);
 }
@@ -167,6 +170,7 @@ status_t CameraMetadata::sort() {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return INVALID_OPERATION;
     }
+    invalidateTagIndex();
     return sort_camera_metadata(mBuffer);
 }
 
@@ -290,6 +294,37 @@ status_t CameraMetadata::update(const camera_metadata_ro_entry &entry) {
     return updateImpl(entry.tag, (const void*)entry.data.u8, entry.count);
 }
 
+status_t CameraMetadata::updateMany(const camera_metadata_ro_entry *entries,
+        size_t entryCount) {
+    status_t res;
+    if (mLocked) {
+        ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
+        return INVALID_OPERATION;
+    }
+    if (entryCount > 0 && entries == NULL) {
+        return BAD_VALUE;
+    }
+    size_t extraData = 0;
+    for (size_t i = 0; i < entryCount; i++) {
+        if ( (res = checkType(entries[i].tag, entries[i].type)) != OK) {
+            return res;
+        }
+        extraData += calculate_camera_metadata_entry_data_size(entries[i].type,
+                entries[i].count);
+    }
+    // Grow once up front so the updates below do not reallocate one by one
+    if ( (res = resizeIfNeeded(entryCount, extraData)) != OK) {
+        return res;
+    }
+    for (size_t i = 0; i < entryCount; i++) {
+        res = updateImpl(entries[i].tag, (const void*)entries[i].data.u8, entries[i].count);
+        if (res != OK) {
+            return res;
+        }
+    }
+    return OK;
+}
+
 status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
         size_t data_count) {
     status_t res;
@@ -319,14 +354,25 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
     res = resizeIfNeeded(1, data_size);
 
     if (res == OK) {
-        camera_metadata_entry_t entry;
-        res = find_camera_metadata_entry(mBuffer, tag, &entry);
+        size_t index = 0;
+        if (!mTagIndexValid) {
+            buildTagIndex();
+        }
+        res = findIndexed(tag, &index);
+        if (res == INVALID_OPERATION) {
+            camera_metadata_entry_t entry;
+            res = find_camera_metadata_entry(mBuffer, tag, &entry);
+            index = entry.index;
+        }
         if (res == NAME_NOT_FOUND) {
             res = add_camera_metadata_entry(mBuffer,
                     tag, data, data_count);
+            if (res == OK && mTagIndexValid) {
+                mTagIndex[tag] = get_camera_metadata_entry_count(mBuffer) - 1;
+            }
         } else if (res == OK) {
             res = update_camera_metadata_entry(mBuffer,
-                    entry.index, data, data_count, NULL);
+                    index, data, data_count, NULL);
         }
     }
 
@@ -348,6 +394,11 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
 }
 
 bool CameraMetadata::exists(uint32_t tag) const {
+    size_t index;
+    status_t res = findIndexed(tag, &index);
+    if (res != INVALID_OPERATION) {
+        return res == OK;
+    }
     camera_metadata_ro_entry entry;
     return find_camera_metadata_ro_entry(mBuffer, tag, &entry) == 0;
 }
@@ -360,7 +411,16 @@ camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
         entry.count = 0;
         return entry;
     }
-    res = find_camera_metadata_entry(mBuffer, tag, &entry);
+    if (!mTagIndexValid) {
+        buildTagIndex();
+    }
+    size_t index;
+    res = findIndexed(tag, &index);
+    if (res == OK) {
+        res = get_camera_metadata_entry(mBuffer, index, &entry);
+    } else if (res == INVALID_OPERATION) {
+        res = find_camera_metadata_entry(mBuffer, tag, &entry);
+    }
     if (CC_UNLIKELY( res != OK )) {
         entry.count = 0;
         entry.data.u8 = NULL;
@@ -371,7 +431,13 @@ camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
 camera_metadata_ro_entry_t CameraMetadata::find(uint32_t tag) const {
     status_t res;
     camera_metadata_ro_entry entry;
-    res = find_camera_metadata_ro_entry(mBuffer, tag, &entry);
+    size_t index;
+    res = findIndexed(tag, &index);
+    if (res == OK) {
+        res = get_camera_metadata_ro_entry(mBuffer, index, &entry);
+    } else if (res == INVALID_OPERATION) {
+        res = find_camera_metadata_ro_entry(mBuffer, tag, &entry);
+    }
     if (CC_UNLIKELY( res != OK )) {
         entry.count = 0;
         entry.data.u8 = NULL;
@@ -380,13 +446,21 @@ camera_metadata_ro_entry_t CameraMetadata::find(uint32_t tag) const {
 }
 
 status_t CameraMetadata::erase(uint32_t tag) {
-    camera_metadata_entry_t entry;
+    size_t index = 0;
     status_t res;
     if (mLocked) {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return INVALID_OPERATION;
     }
-    res = find_camera_metadata_entry(mBuffer, tag, &entry);
+    if (!mTagIndexValid) {
+        buildTagIndex();
+    }
+    res = findIndexed(tag, &index);
+    if (res == INVALID_OPERATION) {
+        camera_metadata_entry_t entry;
+        res = find_camera_metadata_entry(mBuffer, tag, &entry);
+        index = entry.index;
+    }
     if (res == NAME_NOT_FOUND) {
         return OK;
     } else if (res != OK) {
@@ -395,11 +469,20 @@ status_t CameraMetadata::erase(uint32_t tag) {
               get_local_camera_metadata_tag_name(tag, mBuffer), tag, strerror(-res), res);
         return res;
     }
-    res = delete_camera_metadata_entry(mBuffer, entry.index);
+    res = delete_camera_metadata_entry(mBuffer, index);
     if (res != OK) {
         ALOGE("%s: Error deleting entry %s.%s (%x): %s %d", __FUNCTION__,
               get_local_camera_metadata_section_name(tag, mBuffer),
               get_local_camera_metadata_tag_name(tag, mBuffer), tag, strerror(-res), res);
+        invalidateTagIndex();
+        return res;
+    }
+    // Entries after the deleted one moved down by one
+    mTagIndex.erase(tag);
+    for (auto& pair : mTagIndex) {
+        if (pair.second > index) {
+            pair.second--;
+        }
     }
     return res;
 }
@@ -460,6 +543,42 @@ void CameraMetadata::swap(CameraMetadata& other) {
 
     other.mBuffer = thisBuf;
     mBuffer = otherBuf;
+
+    mTagIndex.swap(other.mTagIndex);
+    std::swap(mTagIndexValid, other.mTagIndexValid);
+}
+
+void CameraMetadata::invalidateTagIndex() {
+    mTagIndex.clear();
+    mTagIndexValid = false;
+}
+
+void CameraMetadata::buildTagIndex() {
+    mTagIndex.clear();
+    size_t count = entryCount();
+    mTagIndex.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        camera_metadata_ro_entry entry;
+        if (get_camera_metadata_ro_entry(mBuffer, i, &entry) != OK) {
+            ALOGE("%s: Cannot read entry %zu", __FUNCTION__, i);
+            invalidateTagIndex();
+            return;
+        }
+        mTagIndex.emplace(entry.tag, i);
+    }
+    mTagIndexValid = true;
+}
+
+status_t CameraMetadata::findIndexed(uint32_t tag, size_t *index) const {
+    if (!mTagIndexValid) {
+        return INVALID_OPERATION;
+    }
+    auto it = mTagIndex.find(tag);
+    if (it == mTagIndex.end()) {
+        return NAME_NOT_FOUND;
+    }
+    *index = it->second;
+    return OK;
 }
 
 status_t CameraMetadata::getTagFromName(const char *name,
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+
+#define LOG_TAG "CamComm1.0-MDDelta"
+#include <log/log.h>
+#include <utils/Errors.h>
+#include <string.h>
+
+#include "CameraMetadataDelta.h"
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace common {
+namespace V1_0 {
+namespace helper {
+
+namespace {
+
+bool entryEquals(const camera_metadata_ro_entry& a, const camera_metadata_ro_entry& b) {
+    return a.type == b.type && a.count == b.count && (a.count == 0 ||
+            memcmp(a.data.u8, b.data.u8, camera_metadata_type_size[a.type] * a.count) == 0);
+}
+
+void serialize(const camera_metadata_t* metadata, const std::vector<uint32_t>& erasedTags,
+        std::vector<uint8_t>* out) {
+    size_t metadataSize = get_camera_metadata_size(metadata);
+    size_t erasedSize = erasedTags.size() * sizeof(uint32_t);
+    out->resize(metadataSize + erasedSize);
+    memcpy(out->data(), metadata, metadataSize);
+    if (erasedSize > 0) {
+        memcpy(out->data() + metadataSize, erasedTags.data(), erasedSize);
+    }
+}
+
+} // anonymous namespace
+
+MetadataDeltaEncoder::MetadataDeltaEncoder(uint32_t keyframeInterval) :
+        mKeyframeInterval(keyframeInterval), mResultsSinceKeyframe(0) {
+}
+
+status_t MetadataDeltaEncoder::encode(const camera_metadata_t* result, std::vector<uint8_t>* out) {
+    if (result == nullptr || out == nullptr) {
+        return BAD_VALUE;
+    }
+
+    bool keyframe = mPrevious.isEmpty() || ++mResultsSinceKeyframe >= mKeyframeInterval;
+    if (keyframe) {
+        mResultsSinceKeyframe = 0;
+    }
+
+    const camera_metadata_t* previous = mPrevious.getAndLock();
+    size_t entryCount = get_camera_metadata_entry_count(result);
+    size_t previousCount = previous == nullptr ? 0 : get_camera_metadata_entry_count(previous);
+
+    // Tags that disappeared since the previous result
+    std::vector<uint32_t> erasedTags;
+    for (size_t i = 0; i < previousCount; i++) {
+        camera_metadata_ro_entry prevEntry;
+        get_camera_metadata_ro_entry(previous, i, &prevEntry);
+        camera_metadata_ro_entry entry;
+        if (find_camera_metadata_ro_entry(result, prevEntry.tag, &entry) == NAME_NOT_FOUND) {
+            erasedTags.push_back(prevEntry.tag);
+        }
+    }
+
+    camera_metadata_t* delta = nullptr;
+    if (!keyframe) {
+        delta = allocate_camera_metadata(entryCount, get_camera_metadata_data_count(result));
+        status_t res = delta == nullptr ? NO_MEMORY : OK;
+        size_t changed = 0;
+        for (size_t i = 0; i < entryCount && res == OK; i++) {
+            camera_metadata_ro_entry entry;
+            get_camera_metadata_ro_entry(result, i, &entry);
+            camera_metadata_ro_entry prevEntry;
+            if (find_camera_metadata_ro_entry(previous, entry.tag, &prevEntry) == OK &&
+                    entryEquals(entry, prevEntry)) {
+                continue;
+            }
+            res = add_camera_metadata_entry(delta, entry.tag, entry.data.u8, entry.count);
+            changed++;
+        }
+        if (res != OK) {
+            // Send the complete result instead
+            ALOGE("%s: cannot build delta metadata: %d", __FUNCTION__, res);
+            free_camera_metadata(delta);
+            delta = nullptr;
+        } else {
+            ALOGV("%s: delta with %zu of %zu entries", __FUNCTION__, changed, entryCount);
+        }
+    }
+    mPrevious.unlock(previous);
+
+    serialize(delta != nullptr ? delta : result, erasedTags, out);
+    free_camera_metadata(delta);
+    mPrevious = result;
+    return OK;
+}
+
+void MetadataDeltaEncoder::reset() {
+    mPrevious.clear();
+    mResultsSinceKeyframe = 0;
+}
+
+status_t MetadataDeltaDecoder::decode(const uint8_t* data, size_t size, CameraMetadata* result) {
+    if (data == nullptr || result == nullptr) {
+        return BAD_VALUE;
+    }
+
+    const camera_metadata_t* delta = reinterpret_cast<const camera_metadata_t*>(data);
+    if (validate_camera_metadata_structure(delta, &size) != OK) {
+        ALOGE("%s: invalid delta metadata", __FUNCTION__);
+        return BAD_VALUE;
+    }
+    size_t metadataSize = get_camera_metadata_size(delta);
+    size_t erasedSize = size - metadataSize;
+    if (erasedSize % sizeof(uint32_t) != 0) {
+        ALOGE("%s: invalid erased tag list of %zu bytes", __FUNCTION__, erasedSize);
+        return BAD_VALUE;
+    }
+
+    status_t res = OK;
+    for (size_t offset = metadataSize; offset < size && res == OK; offset += sizeof(uint32_t)) {
+        uint32_t tag;
+        memcpy(&tag, data + offset, sizeof(tag));
+        if (mCurrent.exists(tag)) {
+            res = mCurrent.erase(tag);
+        }
+    }
+    size_t entryCount = get_camera_metadata_entry_count(delta);
+    for (size_t i = 0; i < entryCount && res == OK; i++) {
+        camera_metadata_ro_entry entry;
+        get_camera_metadata_ro_entry(delta, i, &entry);
+        res = mCurrent.update(entry);
+    }
+    if (res != OK) {
+        ALOGE("%s: cannot apply delta: %d", __FUNCTION__, res);
+        reset();
+        return res;
+    }
+
+    *result = mCurrent;
+    return OK;
+}
+
+void MetadataDeltaDecoder::reset() {
+    mCurrent.clear();
+}
+
+} // namespace helper
+} // namespace V1_0
+} // namespace common
+} // namespace camera
+} // namespace hardware
+} // namespace android
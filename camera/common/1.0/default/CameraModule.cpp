@@ -18,6 +18,16 @@
 #define ATRACE_TAG ATRACE_TAG_CAMERA
 //#define LOG_NDEBUG 0
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/system_properties.h>
+#include <unistd.h>
+
+#include <string>
+
 #include <utils/Trace.h>
 
 #include "CameraModule.h"
@@ -29,6 +39,149 @@ namespace common {
 namespace V1_0 {
 namespace helper {
 
+namespace {
+
+// The characteristics derived for each camera are persisted here, so that deriving them again
+// on later boots is skipped as long as neither the HAL output nor the vendor build changed.
+const char* kSnapshotDir = "/data/vendor/camera/characteristics";
+const uint32_t kSnapshotMagic = 0x50534843; // "CHSP"
+// Bump when deriveCameraCharacteristicsKeys changes what it derives
+const uint32_t kSnapshotVersion = 1;
+const uint32_t kMaxSnapshotSize = 16 << 20;
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t deviceVersion;
+    uint32_t size;      // of the derived camera_metadata_t following the header
+    uint64_t rawHash;   // of the characteristics reported by the HAL
+    char fingerprint[PROP_VALUE_MAX];
+};
+
+void fillSnapshotHeader(uint32_t deviceVersion, uint64_t rawHash, SnapshotHeader* header) {
+    memset(header, 0, sizeof(*header));
+    header->magic = kSnapshotMagic;
+    header->version = kSnapshotVersion;
+    header->deviceVersion = deviceVersion;
+    header->rawHash = rawHash;
+    __system_property_get("ro.vendor.build.fingerprint", header->fingerprint);
+}
+
+// Hashes the entries rather than the buffer, whose spare capacity may be uninitialized.
+uint64_t hashCameraMetadata(const camera_metadata_t* metadata) {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+    auto mix = [&hash](const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+    };
+    size_t count = get_camera_metadata_entry_count(metadata);
+    for (size_t i = 0; i < count; i++) {
+        camera_metadata_ro_entry_t entry;
+        if (get_camera_metadata_ro_entry(metadata, i, &entry) != OK) {
+            continue;
+        }
+        mix(&entry.tag, sizeof(entry.tag));
+        mix(&entry.type, sizeof(entry.type));
+        mix(&entry.count, sizeof(entry.count));
+        mix(entry.data.u8, entry.count * camera_metadata_type_size[entry.type]);
+    }
+    return hash;
+}
+
+std::string getSnapshotPath(int cameraId) {
+    return std::string(kSnapshotDir) + "/" + std::to_string(cameraId);
+}
+
+bool readFully(int fd, void* data, size_t size) {
+    uint8_t* bytes = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        ssize_t n = TEMP_FAILURE_RETRY(read(fd, bytes, size));
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool writeFully(int fd, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        ssize_t n = TEMP_FAILURE_RETRY(write(fd, bytes, size));
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool loadCharacteristicsSnapshot(int cameraId, uint32_t deviceVersion, uint64_t rawHash,
+        CameraMetadata* chars) {
+    ATRACE_CALL();
+    int fd = open(getSnapshotPath(cameraId).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    SnapshotHeader expected, header;
+    fillSnapshotHeader(deviceVersion, rawHash, &expected);
+    if (!readFully(fd, &header, sizeof(header)) || header.magic != expected.magic ||
+            header.version != expected.version || header.deviceVersion != expected.deviceVersion ||
+            header.rawHash != expected.rawHash ||
+            strncmp(header.fingerprint, expected.fingerprint, sizeof(header.fingerprint)) ||
+            header.size == 0 || header.size > kMaxSnapshotSize) {
+        ALOGV("%s: snapshot of camera %d is stale", __FUNCTION__, cameraId);
+        close(fd);
+        return false;
+    }
+    // Allocated like allocate_camera_metadata does, so CameraMetadata can free it
+    camera_metadata_t* buffer = static_cast<camera_metadata_t*>(malloc(header.size));
+    bool ok = buffer != nullptr && readFully(fd, buffer, header.size);
+    close(fd);
+    size_t expectedSize = header.size;
+    if (!ok || validate_camera_metadata_structure(buffer, &expectedSize) != OK) {
+        ALOGW("%s: ignoring corrupted snapshot of camera %d", __FUNCTION__, cameraId);
+        free(buffer);
+        return false;
+    }
+    chars->acquire(buffer);
+    return true;
+}
+
+void saveCharacteristicsSnapshot(int cameraId, uint32_t deviceVersion, uint64_t rawHash,
+        const CameraMetadata& chars) {
+    ATRACE_CALL();
+    if (mkdir(kSnapshotDir, 0770) != 0 && errno != EEXIST) {
+        ALOGV("%s: cannot create %s: %s", __FUNCTION__, kSnapshotDir, strerror(errno));
+        return;
+    }
+    const std::string path = getSnapshotPath(cameraId);
+    const std::string tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0660);
+    if (fd < 0) {
+        ALOGW("%s: cannot create %s: %s", __FUNCTION__, tmpPath.c_str(), strerror(errno));
+        return;
+    }
+    SnapshotHeader header;
+    fillSnapshotHeader(deviceVersion, rawHash, &header);
+    const camera_metadata_t* metadata = chars.getAndLock();
+    header.size = get_camera_metadata_size(metadata);
+    bool ok = writeFully(fd, &header, sizeof(header)) && writeFully(fd, metadata, header.size);
+    chars.unlock(metadata);
+    ok = (close(fd) == 0) && ok;
+    // Written aside and renamed, so a crash never leaves a partial snapshot behind
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        ALOGW("%s: cannot write snapshot of camera %d", __FUNCTION__, cameraId);
+        unlink(tmpPath.c_str());
+    }
+}
+
+} // anonymous namespace
+
 void CameraModule::deriveCameraCharacteristicsKeys(
         uint32_t deviceVersion, CameraMetadata &chars) {
     ATRACE_CALL();
@@ -314,9 +467,15 @@ int CameraModule::getCameraInfo(int cameraId, struct camera_info *info) {
             *info = rawInfo;
             return ret;
         }
+        // Derived on the first request for each camera rather than at provider init, and
+        // after the first boot, read back from the snapshot instead
         CameraMetadata m;
-        m.append(rawInfo.static_camera_characteristics);
-        deriveCameraCharacteristicsKeys(rawInfo.device_version, m);
+        uint64_t rawHash = hashCameraMetadata(rawInfo.static_camera_characteristics);
+        if (!loadCharacteristicsSnapshot(cameraId, deviceVersion, rawHash, &m)) {
+            m.append(rawInfo.static_camera_characteristics);
+            deriveCameraCharacteristicsKeys(rawInfo.device_version, m);
+            saveCharacteristicsSnapshot(cameraId, deviceVersion, rawHash, m);
+        }
         cameraInfo = rawInfo;
         cameraInfo.static_camera_characteristics = m.release();
         index = mCameraInfoMap.add(cameraId, cameraInfo);
@@ -374,18 +533,49 @@ int CameraModule::getPhysicalCameraInfo(int physicalCameraId, camera_metadata_t
     return OK;
 }
 
+int CameraModule::getRawCameraInfo(int cameraId, struct camera_info *info) {
+    ATRACE_CALL();
+    Mutex::Autolock lock(mCameraInfoLock);
+    return getRawCameraInfoLocked(cameraId, info);
+}
+
+int CameraModule::getRawCameraInfoLocked(int cameraId, struct camera_info *info) {
+    if (cameraId < 0) {
+        ALOGE("%s: Invalid camera ID %d", __FUNCTION__, cameraId);
+        return -EINVAL;
+    }
+    ATRACE_BEGIN("camera_module->get_camera_info");
+    int ret = mModule->get_camera_info(cameraId, info);
+    ATRACE_END();
+    if (ret != 0) {
+        return ret;
+    }
+    if (mModule->common.module_api_version < CAMERA_MODULE_API_VERSION_2_0) {
+        info->device_version = CAMERA_DEVICE_API_VERSION_1_0;
+    }
+    if (mDeviceVersionMap.indexOfKey(cameraId) == NAME_NOT_FOUND) {
+        mDeviceVersionMap.add(cameraId, info->device_version);
+    }
+    return OK;
+}
+
 int CameraModule::getDeviceVersion(int cameraId) {
+    Mutex::Autolock lock(mCameraInfoLock);
     ssize_t index = mDeviceVersionMap.indexOfKey(cameraId);
     if (index == NAME_NOT_FOUND) {
         int deviceVersion;
         if (getModuleApiVersion() >= CAMERA_MODULE_API_VERSION_2_0) {
-            struct camera_info info;
-            getCameraInfo(cameraId, &info);
+            // The version alone doesn't need the characteristics to be derived
+            struct camera_info info = {};
+            getRawCameraInfoLocked(cameraId, &info);
             deviceVersion = info.device_version;
         } else {
             deviceVersion = CAMERA_DEVICE_API_VERSION_1_0;
         }
-        index = mDeviceVersionMap.add(cameraId, deviceVersion);
+        index = mDeviceVersionMap.indexOfKey(cameraId);
+        if (index == NAME_NOT_FOUND) {
+            index = mDeviceVersionMap.add(cameraId, deviceVersion);
+        }
     }
     assert(index != NAME_NOT_FOUND);
     return mDeviceVersionMap[index];
@@ -539,6 +729,12 @@ status_t CameraModule::filterOpenErrorCode(status_t err) {
 }
 
 void CameraModule::removeCamera(int cameraId) {
+    Mutex::Autolock lock(mCameraInfoLock);
+    mDeviceVersionMap.removeItem(cameraId);
+    // Characteristics are only derived once asked for, so the camera may have none cached
+    if (mCameraInfoMap.indexOfKey(cameraId) == NAME_NOT_FOUND) {
+        return;
+    }
     std::unordered_set<std::string> physicalIds;
     camera_metadata_t *metadata = const_cast<camera_metadata_t*>(
             mCameraInfoMap.valueFor(cameraId).static_camera_characteristics);
@@ -558,7 +754,6 @@ void CameraModule::removeCamera(int cameraId) {
     }
     free_camera_metadata(metadata);
     mCameraInfoMap.removeItem(cameraId);
-    mDeviceVersionMap.removeItem(cameraId);
 }
 
 uint16_t CameraModule::getModuleApiVersion() const {
@@ -23,6 +23,7 @@
 #include <inttypes.h>
 #include <math.h>
 #include <stdint.h>
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -249,6 +250,14 @@ class ExifUtilsImpl : public ExifUtils {
     // GenerateAPP1().
     virtual unsigned int getApp1Length();
 
+    // Remembers the tags currently set as the template.
+    // Returns false if ExifUtils is not initialized.
+    virtual bool saveTemplate();
+
+    // Removes the tags that are not part of the template and the APP1 segment.
+    // Returns false if ExifUtils is not initialized.
+    virtual bool restoreTemplate();
+
   protected:
     // sets the version of this standard supported.
     // Returns false if memory allocation fails.
@@ -313,6 +322,8 @@ class ExifUtilsImpl : public ExifUtils {
     uint8_t* app1_buffer_;
     // The length of |app1_buffer_|.
     unsigned int app1_length_;
+    // The tags of each IFD saved by saveTemplate().
+    std::vector<ExifTag> template_tags_[EXIF_IFD_COUNT];
 
 };
 
@@ -785,6 +796,46 @@ unsigned int ExifUtilsImpl::getApp1Length() {
     return app1_length_;
 }
 
+bool ExifUtilsImpl::saveTemplate() {
+    if (exif_data_ == nullptr) {
+        ALOGE("%s: ExifUtils is not initialized", __FUNCTION__);
+        return false;
+    }
+    for (int ifd = 0; ifd < EXIF_IFD_COUNT; ifd++) {
+        ExifContent* content = exif_data_->ifd[ifd];
+        template_tags_[ifd].clear();
+        for (unsigned int i = 0; i < content->count; i++) {
+            template_tags_[ifd].push_back(content->entries[i]->tag);
+        }
+    }
+    return true;
+}
+
+bool ExifUtilsImpl::restoreTemplate() {
+    if (exif_data_ == nullptr) {
+        ALOGE("%s: ExifUtils is not initialized", __FUNCTION__);
+        return false;
+    }
+    destroyApp1();
+    // The thumbnail belongs to the caller, see reset()
+    exif_data_->data = nullptr;
+    exif_data_->size = 0;
+    for (int ifd = 0; ifd < EXIF_IFD_COUNT; ifd++) {
+        ExifContent* content = exif_data_->ifd[ifd];
+        const std::vector<ExifTag>& tags = template_tags_[ifd];
+        std::vector<ExifEntry*> removed;
+        for (unsigned int i = 0; i < content->count; i++) {
+            if (std::find(tags.begin(), tags.end(), content->entries[i]->tag) == tags.end()) {
+                removed.push_back(content->entries[i]);
+            }
+        }
+        for (ExifEntry* entry : removed) {
+            exif_content_remove_entry(content, entry);
+        }
+    }
+    return true;
+}
+
 bool ExifUtilsImpl::setExifVersion(const std::string& exif_version) {
     SET_STRING(EXIF_IFD_EXIF, EXIF_TAG_EXIF_VERSION, EXIF_FORMAT_UNDEFINED, exif_version);
     return true;
@@ -802,6 +853,9 @@ bool ExifUtilsImpl::setModel(const std::string& model) {
 
 void ExifUtilsImpl::reset() {
     destroyApp1();
+    for (auto& tags : template_tags_) {
+        tags.clear();
+    }
     if (exif_data_) {
         /*
          * Since we decided to ignore the original APP1, we are sure that there is
@@ -78,6 +78,64 @@ void VendorTagDescriptor::copyFrom(const VendorTagDescriptor& src) {
     mSections = src.mSections;
     mTagCount = src.mTagCount;
     mVendorOps = src.mVendorOps;
+    mDenseFirstSectionId = src.mDenseFirstSectionId;
+    mDenseSections = src.mDenseSections;
+    mHasDenseIndex = src.mHasDenseIndex;
+}
+
+void VendorTagDescriptor::buildDenseIndex() {
+    mDenseSections.clear();
+    mHasDenseIndex = false;
+    size_t size = mTagToNameMap.size();
+    if (size == 0) {
+        return;
+    }
+
+    // mTagToNameMap is sorted by tag, so the sections and offsets come in order
+    uint32_t firstSectionId = mTagToNameMap.keyAt(0) >> 16;
+    uint32_t lastSectionId = mTagToNameMap.keyAt(size - 1) >> 16;
+    std::vector<DenseSection> sections(lastSectionId - firstSectionId + 1);
+    size_t numSlots = 0;
+    for (size_t i = 0; i < size; ++i) {
+        uint32_t tag = mTagToNameMap.keyAt(i);
+        DenseSection& section = sections[(tag >> 16) - firstSectionId];
+        uint32_t offset = tag & 0xFFFF;
+        if (section.tags.empty()) {
+            section.firstOffset = offset;
+        }
+        size_t slot = offset - section.firstOffset;
+        if (slot >= section.tags.size()) {
+            numSlots += slot + 1 - section.tags.size();
+            section.tags.resize(slot + 1);
+        }
+        section.tags[slot].name = mTagToNameMap.valueAt(i);
+        section.tags[slot].type = mTagToTypeMap.at(tag);
+        section.tags[slot].sectionIndex = mTagToSectionMap.valueFor(tag);
+    }
+
+    // Don't trade a few lookups for a lot of memory on an oddly numbered tag set
+    const size_t kMaxSlotsPerTag = 4;
+    if (sections.size() > size || numSlots > size * kMaxSlotsPerTag) {
+        ALOGW("%s: %zu vendor tags too sparse for a dense index (%zu sections, %zu slots)",
+                __FUNCTION__, size, sections.size(), numSlots);
+        return;
+    }
+    mDenseFirstSectionId = firstSectionId;
+    mDenseSections = std::move(sections);
+    mHasDenseIndex = true;
+}
+
+const VendorTagDescriptor::DenseTagEntry* VendorTagDescriptor::findDenseTag(uint32_t tag) const {
+    uint32_t sectionSlot = (tag >> 16) - mDenseFirstSectionId;
+    if (sectionSlot >= mDenseSections.size()) {
+        return nullptr;
+    }
+    const DenseSection& section = mDenseSections[sectionSlot];
+    uint32_t slot = (tag & 0xFFFF) - section.firstOffset;
+    if (slot >= section.tags.size() || section.tags[slot].type < 0) {
+        return nullptr;
+    }
+    return &section.tags[slot];
 }
 
 int VendorTagDescriptor::getTagCount() const {
@@ -96,6 +154,11 @@ void VendorTagDescriptor::getTagArray(uint32_t* tagArray) const {
 }
 
 const char* VendorTagDescriptor::getSectionName(uint32_t tag) const {
+    if (mHasDenseIndex) {
+        const DenseTagEntry* entry = findDenseTag(tag);
+        return entry != nullptr ? mSections[entry->sectionIndex].string()
+                                : VENDOR_SECTION_NAME_ERR;
+    }
     ssize_t index = mTagToSectionMap.indexOfKey(tag);
     if (index < 0) {
         return VENDOR_SECTION_NAME_ERR;
@@ -104,10 +167,18 @@ const char* VendorTagDescriptor::getSectionName(uint32_t tag) const {
 }
 
 ssize_t VendorTagDescriptor::getSectionIndex(uint32_t tag) const {
+    if (mHasDenseIndex) {
+        const DenseTagEntry* entry = findDenseTag(tag);
+        return entry != nullptr ? static_cast<ssize_t>(entry->sectionIndex) : -1;
+    }
     return mTagToSectionMap.valueFor(tag);
 }
 
 const char* VendorTagDescriptor::getTagName(uint32_t tag) const {
+    if (mHasDenseIndex) {
+        const DenseTagEntry* entry = findDenseTag(tag);
+        return entry != nullptr ? entry->name.string() : VENDOR_TAG_NAME_ERR;
+    }
     ssize_t index = mTagToNameMap.indexOfKey(tag);
     if (index < 0) {
         return VENDOR_TAG_NAME_ERR;
@@ -116,6 +187,10 @@ const char* VendorTagDescriptor::getTagName(uint32_t tag) const {
 }
 
 int VendorTagDescriptor::getTagType(uint32_t tag) const {
+    if (mHasDenseIndex) {
+        const DenseTagEntry* entry = findDenseTag(tag);
+        return entry != nullptr ? entry->type : VENDOR_TAG_TYPE_ERR;
+    }
     auto iter = mTagToTypeMap.find(tag);
     if (iter == mTagToTypeMap.end()) {
         return VENDOR_TAG_TYPE_ERR;
@@ -368,6 +443,8 @@ status_t VendorTagDescriptor::createDescriptorFromOps(const vendor_tag_ops_t* vO
         desc->mReverseMapping[reverseIndex]->add(desc->mTagToNameMap.valueFor(tag), tag);
     }
 
+    desc->buildDenseIndex();
+
     descriptor = desc;
     return OK;
 }
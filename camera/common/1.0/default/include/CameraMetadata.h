@@ -21,6 +21,7 @@
 
 #include <utils/String8.h>
 #include <utils/Vector.h>
+#include <unordered_map>
 
 namespace android {
 namespace hardware {
@@ -152,6 +153,12 @@ class CameraMetadata {
         return update(tag, data.array(), data.size());
     }
 
+    /**
+     * Update several metadata entries at once. The buffer is grown at most
+     * once for all of them. Stops at the first entry that fails to update.
+     */
+    status_t updateMany(const camera_metadata_ro_entry *entries, size_t entryCount);
+
     /**
      * Check if a metadata entry exists for a given tag id
      *
@@ -203,6 +210,24 @@ class CameraMetadata {
     camera_metadata_t *mBuffer;
     mutable bool       mLocked;
 
+    /**
+     * Tag -> entry index of mBuffer, so find() does not scan the buffer.
+     * Built by non-const lookups and kept up to date by update() and erase();
+     * const lookups only use it when it is valid. Anything that reorders or
+     * replaces the entries invalidates it.
+     */
+    std::unordered_map<uint32_t, size_t> mTagIndex;
+    bool mTagIndexValid;
+
+    void invalidateTagIndex();
+    void buildTagIndex();
+    /**
+     * Look the entry index of tag up through the tag index. Returns
+     * NAME_NOT_FOUND if the tag is not in the buffer, or INVALID_OPERATION if
+     * the index is not valid.
+     */
+    status_t findIndexed(uint32_t tag, size_t *index) const;
+
     /**
      * Check if tag has a given type
      */
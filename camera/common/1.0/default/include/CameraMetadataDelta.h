@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAMERA_COMMON_1_0_CAMERAMETADATADELTA_H
+#define CAMERA_COMMON_1_0_CAMERAMETADATADELTA_H
+
+#include <vector>
+
+#include "CameraMetadata.h"
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace common {
+namespace V1_0 {
+namespace helper {
+
+/**
+ * Result metadata delta encoding.
+ *
+ * Consecutive capture results usually repeat most of their tags. In delta
+ * mode the HAL sends, for each result carrying metadata, only the entries
+ * that changed since the previous result. The tags present in the previous
+ * result but missing from the current one follow the metadata buffer, as a
+ * list of uint32_t tags the receiver erases:
+ *
+ *     [camera_metadata_t of get_camera_metadata_size() bytes][erased tags]
+ *
+ * Every keyframeInterval results, or when the delta cannot be built, the
+ * encoder sends the complete result plus the erased tags, so decoding it
+ * always yields the exact result.
+ *
+ * Delta mode only makes sense when each result carries the complete
+ * metadata, i.e. android.request.partialResultCount is 1. The encoder and
+ * the decoder must see the same sequence of results, in order.
+ */
+class MetadataDeltaEncoder {
+  public:
+    explicit MetadataDeltaEncoder(uint32_t keyframeInterval);
+
+    /**
+     * Encode the complete result metadata into out, in the format above.
+     */
+    status_t encode(const camera_metadata_t* result, std::vector<uint8_t>* out);
+
+    /**
+     * Forget the previous result; the next result is sent as a keyframe.
+     */
+    void reset();
+
+  private:
+    const uint32_t mKeyframeInterval;
+    uint32_t mResultsSinceKeyframe;
+    CameraMetadata mPrevious;
+};
+
+class MetadataDeltaDecoder {
+  public:
+    /**
+     * Apply the size bytes of an encoded delta to the current result and
+     * return the rebuilt complete result in result.
+     */
+    status_t decode(const uint8_t* data, size_t size, CameraMetadata* result);
+
+    void reset();
+
+  private:
+    CameraMetadata mCurrent;
+};
+
+} // namespace helper
+} // namespace V1_0
+} // namespace common
+} // namespace camera
+} // namespace hardware
+} // namespace android
+
+#endif
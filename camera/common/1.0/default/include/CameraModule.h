@@ -50,6 +50,10 @@ public:
     int init();
 
     int getCameraInfo(int cameraId, struct camera_info *info);
+    // Like getCameraInfo, but static_camera_characteristics is left as the HAL reports it,
+    // without deriving the keys defined after its device version. For callers that only need
+    // the version, facing or resource cost, such as provider init.
+    int getRawCameraInfo(int cameraId, struct camera_info *info);
     int getDeviceVersion(int cameraId);
     int getNumberOfCameras(void);
     int open(const char* id, struct hw_device_t** device);
@@ -83,10 +87,11 @@ private:
     static void appendAvailableKeys(CameraMetadata &chars,
             int32_t keyTag, const Vector<int32_t>& appendKeys);
     status_t filterOpenErrorCode(status_t err);
+    int getRawCameraInfoLocked(int cameraId, struct camera_info *info);
     camera_module_t *mModule;
     int mNumberOfCameras;
     KeyedVector<int, camera_info> mCameraInfoMap;
-    KeyedVector<int, int> mDeviceVersionMap;
+    KeyedVector<int, int> mDeviceVersionMap; // guarded by mCameraInfoLock
     KeyedVector<int, camera_metadata_t*> mPhysicalCameraInfoMap;
     Mutex mCameraInfoLock;
 };
@@ -31,7 +31,8 @@ namespace helper {
 
 // ExifUtils can generate APP1 segment with tags which caller set. ExifUtils can
 // also add a thumbnail in the APP1 segment if thumbnail size is specified.
-// ExifUtils can be reused with different images by calling initialize().
+// ExifUtils can be reused with different images by calling initialize(), or
+// by calling restoreTemplate() to keep the tags set before saveTemplate().
 //
 // Example of using this class :
 //  std::unique_ptr<ExifUtils> utils(ExifUtils::Create());
@@ -242,6 +243,17 @@ class ExifUtils {
     // Gets length of APP1 segment. This method must be called only after calling
     // GenerateAPP1().
     virtual unsigned int getApp1Length() = 0;
+
+    // Remembers the tags set so far, e.g. make and model, as a template that
+    // stays valid for following images.
+    // Returns false if ExifUtils is not initialized.
+    virtual bool saveTemplate() = 0;
+
+    // Removes the tags added since saveTemplate() and the generated APP1
+    // segment, so the next image only sets its own tags instead of
+    // initializing again.
+    // Returns false if ExifUtils is not initialized.
+    virtual bool restoreTemplate() = 0;
 };
 
 
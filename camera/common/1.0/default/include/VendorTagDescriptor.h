@@ -25,6 +25,7 @@
 
 #include <stdint.h>
 #include <unordered_map>
+#include <vector>
 
 namespace android {
 namespace hardware {
@@ -92,6 +93,31 @@ class VendorTagDescriptor {
         void dump(int fd, int verbosity, int indentation) const;
 
     protected:
+        /**
+         * Builds the dense tag index from the maps below. Vendor tags are numbered
+         * (section id << 16) + offset, and HALs number both densely, so the index is
+         * an array of sections each holding an array of tags by offset, and a tag is
+         * looked up by two array accesses. Left empty, falling back to the maps, for
+         * tag sets too sparse for it.
+         */
+        void buildDenseIndex();
+
+        struct DenseTagEntry {
+            String8 name;
+            int32_t type = -1;          // -1 for an unused offset
+            uint32_t sectionIndex = 0;  // offset in mSections
+        };
+        struct DenseSection {
+            uint32_t firstOffset = 0;
+            std::vector<DenseTagEntry> tags;
+        };
+        // Returns nullptr for a tag not defined.
+        const DenseTagEntry* findDenseTag(uint32_t tag) const;
+
+        uint32_t mDenseFirstSectionId = 0;
+        std::vector<DenseSection> mDenseSections;
+        bool mHasDenseIndex = false;
+
         KeyedVector<String8, KeyedVector<String8, uint32_t>*> mReverseMapping;
         KeyedVector<uint32_t, String8> mTagToNameMap;
         KeyedVector<uint32_t, uint32_t> mTagToSectionMap; // Value is offset in mSections
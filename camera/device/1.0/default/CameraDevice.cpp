@@ -15,6 +15,8 @@
  */
 
 #define LOG_TAG "CamDev@1.0-impl"
+#include <algorithm>
+
 #include <hardware/camera.h>
 #include <hardware/gralloc1.h>
 #include <hidlmemory/mapping.h>
@@ -324,6 +326,7 @@ CameraDevice::CameraHeapMemory::CameraHeapMemory(
             }
             mHidlHandle = native_handle_clone(mem.handle());
             mHidlHeap = hidl_memory("ashmem", mHidlHandle, size);
+            mRecyclable = true;
         });
 
     commonInitialization();
@@ -337,6 +340,7 @@ void CameraDevice::CameraHeapMemory::commonInitialization() {
         native_handle_delete(mHidlHandle);
         mHidlHeap = hidl_memory();
         mHidlHandle = nullptr;
+        mRecyclable = false;
         return;
     }
     mHidlHeapMemData = mHidlHeapMemory->getPointer();
@@ -368,6 +372,20 @@ camera_memory_t* CameraDevice::sGetMemory(int fd, size_t buf_size, uint_t num_bu
     }
 
     CameraHeapMemory* mem;
+    if (fd < 0) {
+        Mutex::Autolock _l(object->mRecycledHeapsLock);
+        auto& heaps = object->mRecycledHeaps;
+        auto it = std::find_if(heaps.begin(), heaps.end(), [&](CameraHeapMemory* heap) {
+            return heap->mBufSize == buf_size && heap->mNumBufs == num_bufs;
+        });
+        if (it != heaps.end()) {
+            mem = *it;
+            heaps.erase(it);
+            object->mRecycledHeapBytes -= mem->handle.size;
+            // Still registered and in mMemoryMap, and the strong reference moves back to the HAL
+            return &mem->handle;
+        }
+    }
     if (fd < 0) {
         mem = new CameraHeapMemory(object->mAshmemAllocator, buf_size, num_bufs);
     } else {
@@ -401,6 +419,14 @@ void CameraDevice::sPutMemory(camera_memory_t *data) {
     if (device->mDeviceCallback == nullptr) {
         ALOGE("%s: camera HAL return memory while camera is not opened!", __FUNCTION__);
     }
+    if (mem->mRecyclable) {
+        Mutex::Autolock _l(device->mRecycledHeapsLock);
+        if (device->mRecycledHeapBytes + mem->handle.size <= kMaxRecycledHeapBytes) {
+            device->mRecycledHeaps.push_back(mem);
+            device->mRecycledHeapBytes += mem->handle.size;
+            return;
+        }
+    }
     device->mDeviceCallback->unregisterMemory(mem->handle.mId);
     {
         Mutex::Autolock _l(device->mMemoryMapLock);
@@ -1061,6 +1087,26 @@ void CameraDevice::closeLocked() {
         }
         mDevice = nullptr;
     }
+    releaseRecycledHeaps();
+}
+
+void CameraDevice::releaseRecycledHeaps() {
+    std::vector<CameraHeapMemory*> heaps;
+    {
+        Mutex::Autolock _l(mRecycledHeapsLock);
+        heaps.swap(mRecycledHeaps);
+        mRecycledHeapBytes = 0;
+    }
+    for (CameraHeapMemory* mem : heaps) {
+        if (mDeviceCallback != nullptr) {
+            mDeviceCallback->unregisterMemory(mem->handle.mId);
+        }
+        {
+            Mutex::Autolock _l(mMemoryMapLock);
+            mMemoryMap.erase(mem->handle.mId);
+        }
+        mem->decStrong(mem);
+    }
 }
 
 }  // namespace implementation
@@ -128,6 +128,8 @@ private:
 
         size_t mBufSize;
         uint_t mNumBufs;
+        // Allocated by us rather than wrapping a HAL fd, so it can be handed out again
+        bool mRecyclable = false;
 
         // Shared memory related members
         hidl_memory      mHidlHeap;
@@ -178,6 +180,17 @@ private:
                                   // must not hold mLock after this lock is acquired
     std::unordered_map<MemoryId, CameraHeapMemory*> mMemoryMap;
 
+    // Heaps the HAL has put back, still registered with the client. Many HALs get and put a
+    // heap of the same size for every preview or video callback; handing a recycled heap out
+    // again skips the ashmem allocation, the mapping and the registerMemory round trip, and
+    // the client keeps seeing the same MemoryId. Each entry holds the strong reference the
+    // heap had while the HAL owned it. Flushed when the device is closed.
+    static const size_t kMaxRecycledHeapBytes = 16 * 1024 * 1024;
+    Mutex mRecycledHeapsLock; // must not be held while acquiring mMemoryMapLock
+    std::vector<CameraHeapMemory*> mRecycledHeaps;
+    size_t mRecycledHeapBytes = 0;
+    void releaseRecycledHeaps();
+
     bool mMetadataMode = false;
 
     mutable Mutex mBatchLock;
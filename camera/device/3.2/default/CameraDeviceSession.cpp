@@ -17,7 +17,12 @@
 #define LOG_TAG "CamDevSession@3.2-impl"
 #include <android/log.h>
 
+#include <algorithm>
 #include <set>
+#include <string.h>
+#include <linux/kcmp.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <cutils/properties.h>
 #include <utils/Trace.h>
 #include <hardware/gralloc.h>
@@ -59,6 +64,8 @@ CameraDeviceSession::CameraDeviceSession(
         mIsAELockAvailable(false),
         mDerivePostRawSensKey(false),
         mNumPartialResults(1),
+        mRetiredBufferCapacity(static_cast<size_t>(std::max(0,
+                property_get_int32("ro.vendor.camera.import_cache.size", /*default*/0)))),
         mResultBatcher(callback) {
     mDeviceInfo = deviceInfo;
     camera_metadata_entry partialResultsCount =
@@ -148,6 +155,17 @@ bool CameraDeviceSession::initialize() {
     }
     mResultBatcher.setResultMetadataQueue(mResultMetadataQueue);
 
+    // Delta results need every result to carry the complete metadata
+    uint32_t keyframeInterval = getResultDeltaKeyframeInterval();
+    if (keyframeInterval > 0) {
+        if (mNumPartialResults == 1) {
+            mResultBatcher.setResultMetadataDelta(keyframeInterval);
+        } else {
+            ALOGW("%s: result metadata delta ignored with %d partial results",
+                    __FUNCTION__, mNumPartialResults);
+        }
+    }
+
     return false;
 }
 
@@ -155,6 +173,14 @@ bool CameraDeviceSession::shouldFreeBufEarly() {
     return property_get_bool("ro.vendor.camera.free_buf_early", 0) == 1;
 }
 
+uint32_t CameraDeviceSession::getResultDeltaKeyframeInterval() {
+    // 0 (default) sends complete result metadata, as the framework expects
+    // unless it rebuilds results with MetadataDeltaDecoder
+    int32_t interval = property_get_int32(
+            "ro.vendor.camera.res.fmq.delta_keyframe_interval", /*default*/0);
+    return interval > 0 ? static_cast<uint32_t>(interval) : 0;
+}
+
 CameraDeviceSession::~CameraDeviceSession() {
     if (!isClosed()) {
         ALOGE("CameraDeviceSession deleted before close!");
@@ -194,6 +220,7 @@ void CameraDeviceSession::dumpState(const native_handle_t* fd) {
     if (!isClosed()) {
         mDevice->ops->dump(mDevice, fd->data[0]);
     }
+    mResultBatcher.dumpFmqStats(fd->data[0]);
 }
 
 /**
@@ -271,6 +298,14 @@ Status CameraDeviceSession::importBuffer(int32_t streamId,
         uint64_t bufId, buffer_handle_t buf,
         /*out*/buffer_handle_t** outBufPtr,
         bool allowEmptyBuf) {
+    Mutex::Autolock _l(mInflightLock);
+    return importBufferLocked(streamId, bufId, buf, outBufPtr, allowEmptyBuf);
+}
+
+Status CameraDeviceSession::importBufferLocked(int32_t streamId,
+        uint64_t bufId, buffer_handle_t buf,
+        /*out*/buffer_handle_t** outBufPtr,
+        bool allowEmptyBuf) {
 
     if (buf == nullptr && bufId == BUFFER_ID_NO_BUFFER) {
         if (allowEmptyBuf) {
@@ -282,11 +317,17 @@ Status CameraDeviceSession::importBuffer(int32_t streamId,
         }
     }
 
-    Mutex::Autolock _l(mInflightLock);
     CirculatingBuffers& cbs = mCirculatingBuffers[streamId];
     if (cbs.count(bufId) == 0) {
         // Register a newly seen buffer
-        buffer_handle_t importedBuf = buf;
+        buffer_handle_t importedBuf = takeRetiredBufferLocked(streamId, bufId, buf);
+        if (importedBuf != nullptr) {
+            ALOGV("%s: reusing stream %d buffer %" PRIu64, __FUNCTION__, streamId, bufId);
+            cbs[bufId] = importedBuf;
+            *outBufPtr = &cbs[bufId];
+            return Status::OK;
+        }
+        importedBuf = buf;
         sHandleImporter.importBuffer(importedBuf);
         if (importedBuf == nullptr) {
             ALOGE("%s: output buffer for stream %d is invalid!", __FUNCTION__, streamId);
@@ -306,6 +347,21 @@ Status CameraDeviceSession::importRequest(
     return importRequestImpl(request, allBufPtrs, allFences);
 }
 
+bool CameraDeviceSession::readRequestSettings(uint64_t settingsSize, CameraMetadata* settings) {
+    std::vector<uint8_t>& buffer = mRequestScratch.settings;
+    if (buffer.size() < settingsSize) {
+        buffer.resize(settingsSize);
+    }
+    RequestMetadataQueue::MemTransaction tx;
+    if (!mRequestMetadataQueue->beginRead(settingsSize, &tx) ||
+            !tx.copyFrom(buffer.data(), 0, settingsSize)) {
+        return false;
+    }
+    mRequestMetadataQueue->commitRead(settingsSize);
+    settings->setToExternal(buffer.data(), settingsSize);
+    return true;
+}
+
 Status CameraDeviceSession::importRequestImpl(
         const CaptureRequest& request,
         hidl_vec<buffer_handle_t*>& allBufPtrs,
@@ -316,13 +372,16 @@ Status CameraDeviceSession::importRequestImpl(
     size_t numOutputBufs = request.outputBuffers.size();
     size_t numBufs = numOutputBufs + (hasInputBuf ? 1 : 0);
     // Validate all I/O buffers
-    hidl_vec<buffer_handle_t> allBufs;
-    hidl_vec<uint64_t> allBufIds;
+    std::vector<buffer_handle_t>& allBufs = mRequestScratch.allBufs;
+    std::vector<uint64_t>& allBufIds = mRequestScratch.allBufIds;
+    std::vector<int32_t>& streamIds = mRequestScratch.streamIds;
     allBufs.resize(numBufs);
     allBufIds.resize(numBufs);
-    allBufPtrs.resize(numBufs);
-    allFences.resize(numBufs);
-    std::vector<int32_t> streamIds(numBufs);
+    streamIds.resize(numBufs);
+    mRequestScratch.allBufPtrs.resize(numBufs);
+    mRequestScratch.allFences.resize(numBufs);
+    allBufPtrs.setToExternal(mRequestScratch.allBufPtrs.data(), numBufs);
+    allFences.setToExternal(mRequestScratch.allFences.data(), numBufs);
 
     for (size_t i = 0; i < numOutputBufs; i++) {
         allBufs[i] = request.outputBuffers[i].buffer.getNativeHandle();
@@ -409,8 +468,15 @@ void CameraDeviceSession::ResultBatcher::setBatchedStreams(
 
 void CameraDeviceSession::ResultBatcher::setResultMetadataQueue(
         std::shared_ptr<ResultMetadataQueue> q) {
-    Mutex::Autolock _l(mLock);
+    Mutex::Autolock _l(mProcessCaptureResultLock);
     mResultMetadataQueue = q;
+    mFmqHighWaterMark = 0;
+}
+
+void CameraDeviceSession::ResultBatcher::setResultMetadataDelta(uint32_t keyframeInterval) {
+    Mutex::Autolock _l(mProcessCaptureResultLock);
+    mResultDeltaEncoder =
+            std::make_unique<common::V1_0::helper::MetadataDeltaEncoder>(keyframeInterval);
 }
 
 void CameraDeviceSession::ResultBatcher::registerBatch(uint32_t frameNumber, uint32_t batchSize) {
@@ -726,21 +792,49 @@ void CameraDeviceSession::ResultBatcher::invokeProcessCaptureResultCallback(
             return;
         }
     }
+    // Must stay alive until the callback returns, results point into them
+    std::vector<std::vector<uint8_t>> deltas;
+    if (mResultDeltaEncoder != nullptr) {
+        deltas.resize(results.size());
+        for (size_t i = 0; i < results.size(); i++) {
+            CaptureResult &result = results[i];
+            if (result.result.size() == 0) {
+                continue;
+            }
+            const camera_metadata_t* full =
+                    reinterpret_cast<const camera_metadata_t*>(result.result.data());
+            if (mResultDeltaEncoder->encode(full, &deltas[i]) == OK) {
+                result.result.setToExternal(deltas[i].data(), deltas[i].size());
+            } else {
+                ALOGE("%s: encoding result %d metadata delta failed, sending it complete",
+                        __FUNCTION__, result.frameNumber);
+            }
+        }
+    }
+
     if (tryWriteFmq && mResultMetadataQueue->availableToWrite() > 0) {
         for (CaptureResult &result : results) {
             if (result.result.size() > 0) {
                 if (mResultMetadataQueue->write(result.result.data(), result.result.size())) {
                     result.fmqResultSize = result.result.size();
                     result.result.resize(0);
+                    recordFmqWrite(/*written*/true);
                 } else {
                     ALOGW("%s: couldn't utilize fmq, fall back to hwbinder, result size: %zu,"
                     "shared message queue available size: %zu",
                         __FUNCTION__, result.result.size(),
                         mResultMetadataQueue->availableToWrite());
                     result.fmqResultSize = 0;
+                    recordFmqWrite(/*written*/false);
                 }
             }
         }
+    } else if (tryWriteFmq) {
+        for (CaptureResult &result : results) {
+            if (result.result.size() > 0) {
+                recordFmqWrite(/*written*/false);
+            }
+        }
     }
     auto ret = mCallback->processCaptureResult(results);
     if (!ret.isOk()) {
@@ -750,6 +844,26 @@ void CameraDeviceSession::ResultBatcher::invokeProcessCaptureResultCallback(
     mProcessCaptureResultLock.unlock();
 }
 
+void CameraDeviceSession::ResultBatcher::recordFmqWrite(bool written) {
+    if (!written) {
+        mFmqFallbacks++;
+        return;
+    }
+    mFmqWrites++;
+    // Only the HAL writes, so this is the queue occupancy right after the write
+    size_t used = mResultMetadataQueue->getQuantumCount() -
+            mResultMetadataQueue->availableToWrite();
+    if (used > mFmqHighWaterMark) {
+        mFmqHighWaterMark = used;
+    }
+}
+
+void CameraDeviceSession::ResultBatcher::dumpFmqStats(int fd) const {
+    dprintf(fd, "Result FMQ: %" PRIu64 " writes, %" PRIu64 " hwbinder fallbacks,"
+            " high-water mark %zu bytes\n",
+            mFmqWrites.load(), mFmqFallbacks.load(), mFmqHighWaterMark.load());
+}
+
 void CameraDeviceSession::ResultBatcher::processOneCaptureResult(CaptureResult& result) {
     hidl_vec<CaptureResult> results;
     results.resize(1);
@@ -1096,10 +1210,60 @@ Return<void> CameraDeviceSession::configureStreams(
 // Needs to get called after acquiring 'mInflightLock'
 void CameraDeviceSession::cleanupBuffersLocked(int id) {
     for (auto& pair : mCirculatingBuffers.at(id)) {
-        sHandleImporter.freeBuffer(pair.second);
+        if (mRetiredBufferCapacity > 0) {
+            mRetiredBuffers.push_front({id, pair.first, pair.second});
+        } else {
+            sHandleImporter.freeBuffer(pair.second);
+        }
     }
     mCirculatingBuffers[id].clear();
     mCirculatingBuffers.erase(id);
+    freeRetiredBuffersLocked(mRetiredBufferCapacity);
+}
+
+buffer_handle_t CameraDeviceSession::takeRetiredBufferLocked(
+        int streamId, uint64_t bufId, const buffer_handle_t buf) {
+    for (auto it = mRetiredBuffers.begin(); it != mRetiredBuffers.end(); it++) {
+        if (it->streamId != streamId || it->bufferId != bufId) {
+            continue;
+        }
+        buffer_handle_t handle = it->handle;
+        mRetiredBuffers.erase(it);
+        if (buf != nullptr && isSameBuffer(handle, buf)) {
+            return handle;
+        }
+        // The bufferId now refers to a different buffer
+        sHandleImporter.freeBuffer(handle);
+        return nullptr;
+    }
+    return nullptr;
+}
+
+void CameraDeviceSession::freeRetiredBuffersLocked(size_t keep) {
+    while (mRetiredBuffers.size() > keep) {
+        sHandleImporter.freeBuffer(mRetiredBuffers.back().handle);
+        mRetiredBuffers.pop_back();
+    }
+}
+
+bool CameraDeviceSession::isSameBuffer(const native_handle_t* a, const native_handle_t* b) {
+    if (a->numFds != b->numFds || a->numInts != b->numInts) {
+        return false;
+    }
+    if (memcmp(&a->data[a->numFds], &b->data[b->numFds], sizeof(int) * a->numInts) != 0) {
+        return false;
+    }
+    // The imported handle holds dups of the descriptors camera service sent
+    // the first time, so the same buffer resolves to the same open file.
+    pid_t pid = getpid();
+    for (int i = 0; i < a->numFds; i++) {
+        int ret = syscall(SYS_kcmp, pid, pid, KCMP_FILE, a->data[i], b->data[i]);
+        if (ret != 0) {
+            // Different files, or kcmp is not available: do not guess
+            return false;
+        }
+    }
+    return true;
 }
 
 void CameraDeviceSession::updateBufferCaches(const hidl_vec<BufferCache>& cachesToRemove) {
@@ -1172,8 +1336,7 @@ Status CameraDeviceSession::processOneCaptureRequest(const CaptureRequest& reque
     if (request.fmqSettingsSize > 0) {
         // non-blocking read; client must write metadata before calling
         // processOneCaptureRequest
-        settingsFmq.resize(request.fmqSettingsSize);
-        bool read = mRequestMetadataQueue->read(settingsFmq.data(), request.fmqSettingsSize);
+        bool read = readRequestSettings(request.fmqSettingsSize, &settingsFmq);
         if (read) {
             converted = convertFromHidl(settingsFmq, &halRequest.settings);
         } else {
@@ -1212,7 +1375,7 @@ Status CameraDeviceSession::processOneCaptureRequest(const CaptureRequest& reque
         return status;
     }
 
-    hidl_vec<camera3_stream_buffer_t> outHalBufs;
+    std::vector<camera3_stream_buffer_t>& outHalBufs = mRequestScratch.outHalBufs;
     outHalBufs.resize(numOutputBufs);
     bool aeCancelTriggerNeeded = false;
     ::android::hardware::camera::common::V1_0::helper::CameraMetadata settingsOverride;
@@ -1323,6 +1486,7 @@ Return<void> CameraDeviceSession::close()  {
 
         // free all imported buffers
         Mutex::Autolock _l(mInflightLock);
+        freeRetiredBuffersLocked(/*keep*/0);
         for(auto& pair : mCirculatingBuffers) {
             CirculatingBuffers& buffers = pair.second;
             for (auto& p2 : buffers) {
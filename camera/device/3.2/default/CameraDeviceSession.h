@@ -23,10 +23,14 @@
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 #include <include/convert.h>
+#include <atomic>
 #include <deque>
+#include <list>
 #include <map>
 #include <unordered_map>
+#include <vector>
 #include "CameraMetadata.h"
+#include "CameraMetadataDelta.h"
 #include "HandleImporter.h"
 #include "hardware/camera3.h"
 #include "hardware/camera_common.h"
@@ -171,6 +175,20 @@ protected:
     // Stream ID -> circulating buffers map
     std::map<int, CirculatingBuffers> mCirculatingBuffers;
 
+    // Imported buffers of deleted streams, most recently retired first. If the
+    // stream ID is configured again and camera service sends the same buffer
+    // for the same bufferId, the imported handle is reused instead of being
+    // imported again. Bounded by ro.vendor.camera.import_cache.size (0, the
+    // default, frees buffers as soon as their stream is deleted).
+    // Protected by mInflightLock.
+    struct RetiredBuffer {
+        int streamId;
+        uint64_t bufferId;
+        buffer_handle_t handle;
+    };
+    std::list<RetiredBuffer> mRetiredBuffers;
+    const size_t mRetiredBufferCapacity;
+
     static HandleImporter sHandleImporter;
     static buffer_handle_t sEmptyBuffer;
 
@@ -181,6 +199,23 @@ protected:
 
     using RequestMetadataQueue = MessageQueue<uint8_t, kSynchronizedReadWrite>;
     std::unique_ptr<RequestMetadataQueue> mRequestMetadataQueue;
+
+    // Storage reused by every capture request so that submitting requests does
+    // not allocate once the vectors have grown to the largest request seen.
+    // Like the request FMQ, only used by processCaptureRequest, which the
+    // framework does not call concurrently.
+    struct RequestScratch {
+        // Settings read from the request FMQ; a separate buffer since the HAL
+        // needs them aligned and they may wrap around the end of the queue
+        std::vector<uint8_t> settings;
+        std::vector<buffer_handle_t> allBufs;
+        std::vector<uint64_t> allBufIds;
+        std::vector<int32_t> streamIds;
+        std::vector<buffer_handle_t*> allBufPtrs;
+        std::vector<int> allFences;
+        std::vector<camera3_stream_buffer_t> outHalBufs;
+    };
+    RequestScratch mRequestScratch;
     using ResultMetadataQueue = MessageQueue<uint8_t, kSynchronizedReadWrite>;
     std::shared_ptr<ResultMetadataQueue> mResultMetadataQueue;
 
@@ -190,6 +225,13 @@ protected:
         void setNumPartialResults(uint32_t n);
         void setBatchedStreams(const std::vector<int>& streamsToBatch);
         void setResultMetadataQueue(std::shared_ptr<ResultMetadataQueue> q);
+        // Send result metadata as deltas against the previous result, with a
+        // full keyframe every keyframeInterval results. See CameraMetadataDelta.h
+        void setResultMetadataDelta(uint32_t keyframeInterval);
+
+        // Result FMQ usage since the session was opened, to help size
+        // ro.vendor.camera.res.fmq.size
+        void dumpFmqStats(int fd) const;
 
         void registerBatch(uint32_t frameNumber, uint32_t batchSize);
         void notify(NotifyMsg& msg);
@@ -278,6 +320,9 @@ protected:
         void notifySingleMsg(NotifyMsg& msg);
         void processOneCaptureResult(CaptureResult& result);
         void invokeProcessCaptureResultCallback(hidl_vec<CaptureResult> &results, bool tryWriteFmq);
+        // Count one metadata blob written to (or not fitting in) the result FMQ.
+        // Must be called with mProcessCaptureResultLock held
+        void recordFmqWrite(bool written);
 
         // Protect access to mInflightBatches, mNumPartialResults and mStreamsToBatch
         // processCaptureRequest, processCaptureResult, notify will compete for this lock
@@ -289,9 +334,17 @@ protected:
         const sp<ICameraDeviceCallback> mCallback;
         std::shared_ptr<ResultMetadataQueue> mResultMetadataQueue;
 
-        // Protect against invokeProcessCaptureResultCallback()
+        // Protect against invokeProcessCaptureResultCallback() and mResultMetadataQueue
         Mutex mProcessCaptureResultLock;
 
+        // Set before the first result; used with mProcessCaptureResultLock held
+        std::unique_ptr<common::V1_0::helper::MetadataDeltaEncoder> mResultDeltaEncoder;
+
+        // Updated in invokeProcessCaptureResultCallback, read by dumpState
+        std::atomic<uint64_t> mFmqWrites{0};
+        std::atomic<uint64_t> mFmqFallbacks{0};
+        std::atomic<size_t> mFmqHighWaterMark{0};
+
     } mResultBatcher;
 
     std::vector<int> mVideoStreamIds;
@@ -300,9 +353,16 @@ protected:
 
     static bool shouldFreeBufEarly();
 
+    static uint32_t getResultDeltaKeyframeInterval();
+
     Status initStatus() const;
 
-    // Validate and import request's input buffer and acquire fence
+    // Reads the settings of a request from the request FMQ into
+    // mRequestScratch, which settings then points to until the next call
+    bool readRequestSettings(uint64_t settingsSize, CameraMetadata* settings);
+
+    // Validate and import request's input buffer and acquire fence.
+    // allBufPtrs and allFences point into mRequestScratch on success
     virtual Status importRequest(
             const CaptureRequest& request,
             hidl_vec<buffer_handle_t*>& allBufPtrs,
@@ -319,12 +379,23 @@ protected:
             uint64_t bufId, buffer_handle_t buf,
             /*out*/buffer_handle_t** outBufPtr,
             bool allowEmptyBuf);
+    // For importing several buffers under a single mInflightLock acquisition
+    Status importBufferLocked(int32_t streamId,
+            uint64_t bufId, buffer_handle_t buf,
+            /*out*/buffer_handle_t** outBufPtr,
+            bool allowEmptyBuf);
 
     static void cleanupInflightFences(
             hidl_vec<int>& allFences, size_t numFences);
 
     void cleanupBuffersLocked(int id);
 
+    // Take the imported handle of a retired buffer if buf is the same buffer
+    buffer_handle_t takeRetiredBufferLocked(int streamId, uint64_t bufId,
+            const buffer_handle_t buf);
+    void freeRetiredBuffersLocked(size_t keep);
+    static bool isSameBuffer(const native_handle_t* a, const native_handle_t* b);
+
     void updateBufferCaches(const hidl_vec<BufferCache>& cachesToRemove);
 
     android_dataspace mapToLegacyDataspace(
@@ -351,8 +351,7 @@ Status CameraDeviceSession::processOneCaptureRequest_3_4(const V3_4::CaptureRequ
     if (request.v3_2.fmqSettingsSize > 0) {
         // non-blocking read; client must write metadata before calling
         // processOneCaptureRequest
-        settingsFmq.resize(request.v3_2.fmqSettingsSize);
-        bool read = mRequestMetadataQueue->read(settingsFmq.data(), request.v3_2.fmqSettingsSize);
+        bool read = readRequestSettings(request.v3_2.fmqSettingsSize, &settingsFmq);
         if (read) {
             converted = V3_2::implementation::convertFromHidl(settingsFmq, &halRequest.settings);
         } else {
@@ -392,7 +391,7 @@ Status CameraDeviceSession::processOneCaptureRequest_3_4(const V3_4::CaptureRequ
         return status;
     }
 
-    hidl_vec<camera3_stream_buffer_t> outHalBufs;
+    std::vector<camera3_stream_buffer_t>& outHalBufs = mRequestScratch.outHalBufs;
     outHalBufs.resize(numOutputBufs);
     bool aeCancelTriggerNeeded = false;
     ::android::hardware::camera::common::V1_0::helper::CameraMetadata settingsOverride;
@@ -722,9 +721,11 @@ void CameraDeviceSession::ResultBatcher_3_4::invokeProcessCaptureResultCallback_
                         result.v3_2.result.size())) {
                     result.v3_2.fmqResultSize = result.v3_2.result.size();
                     result.v3_2.result.resize(0);
+                    recordFmqWrite(/*written*/true);
                 } else {
                     ALOGW("%s: couldn't utilize fmq, fall back to hwbinder", __FUNCTION__);
                     result.v3_2.fmqResultSize = 0;
+                    recordFmqWrite(/*written*/false);
                 }
             }
 
@@ -733,9 +734,22 @@ void CameraDeviceSession::ResultBatcher_3_4::invokeProcessCaptureResultCallback_
                         onePhysMetadata.metadata.size())) {
                     onePhysMetadata.fmqMetadataSize = onePhysMetadata.metadata.size();
                     onePhysMetadata.metadata.resize(0);
+                    recordFmqWrite(/*written*/true);
                 } else {
                     ALOGW("%s: couldn't utilize fmq, fall back to hwbinder", __FUNCTION__);
                     onePhysMetadata.fmqMetadataSize = 0;
+                    recordFmqWrite(/*written*/false);
+                }
+            }
+        }
+    } else if (tryWriteFmq) {
+        for (CaptureResult &result : results) {
+            if (result.v3_2.result.size() > 0) {
+                recordFmqWrite(/*written*/false);
+            }
+            for (auto& onePhysMetadata : result.physicalCameraMetadata) {
+                if (onePhysMetadata.metadata.size() > 0) {
+                    recordFmqWrite(/*written*/false);
                 }
             }
         }
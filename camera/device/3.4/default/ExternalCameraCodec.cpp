@@ -0,0 +1,722 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "ExtCamCodec@3.4"
+//#define LOG_NDEBUG 0
+#include <log/log.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+#include <utils/Trace.h>
+#include "ExternalCameraCodec.h"
+
+#define HAVE_JPEG // required for libyuv.h to export MJPEG decode APIs
+#include <libyuv.h>
+
+#include <jpeglib.h>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace V3_4 {
+namespace implementation {
+
+namespace {
+
+size_t getYU12Size(const Size& sz) {
+    return sz.width * sz.height * 3 / 2;
+}
+
+} // anonymous namespace
+
+std::unique_ptr<JpegCodec> JpegCodec::create(const ExternalCameraConfig& cfg) {
+    switch (cfg.jpegCodecType) {
+        case ExternalCameraConfig::JpegCodecType::V4L2_M2M:
+            return std::make_unique<V4L2M2MJpegCodec>(cfg.jpegDecoderNode, cfg.jpegEncoderNode);
+        case ExternalCameraConfig::JpegCodecType::SOFTWARE:
+        default:
+            return std::make_unique<SoftwareJpegCodec>();
+    }
+}
+
+int SoftwareJpegCodec::decodeToYU12(const uint8_t* inData, size_t inDataSize,
+        const Size& sz, const YCbCrLayout& out) {
+    ATRACE_CALL();
+    return libyuv::MJPGToI420(
+            inData, inDataSize, static_cast<uint8_t*>(out.y), out.yStride,
+            static_cast<uint8_t*>(out.cb), out.cStride,
+            static_cast<uint8_t*>(out.cr), out.cStride,
+            sz.width, sz.height, sz.width, sz.height);
+}
+
+int SoftwareJpegCodec::encodeYU12(
+        const Size & inSz, const YCbCrLayout& inLayout,
+        int jpegQuality, const void *app1Buffer, size_t app1Size,
+        void *out, const size_t maxOutSize, size_t &actualCodeSize)
+{
+    ATRACE_CALL();
+    /* libjpeg is a C library so we use C-style "inheritance" by
+     * putting libjpeg's jpeg_destination_mgr first in our custom
+     * struct. This allows us to cast jpeg_destination_mgr* to
+     * CustomJpegDestMgr* when we get it passed to us in a callback */
+    struct CustomJpegDestMgr {
+        struct jpeg_destination_mgr mgr;
+        JOCTET *mBuffer;
+        size_t mBufferSize;
+        size_t mEncodedSize;
+        bool mSuccess;
+    } dmgr;
+
+    jpeg_compress_struct cinfo = {};
+    jpeg_error_mgr jerr;
+
+    /* Initialize error handling with standard callbacks, but
+     * then override output_message (to print to ALOG) and
+     * error_exit to set a flag and print a message instead
+     * of killing the whole process */
+    cinfo.err = jpeg_std_error(&jerr);
+
+    cinfo.err->output_message = [](j_common_ptr cinfo) {
+        char buffer[JMSG_LENGTH_MAX];
+
+        /* Create the message */
+        (*cinfo->err->format_message)(cinfo, buffer);
+        ALOGE("libjpeg error: %s", buffer);
+    };
+    cinfo.err->error_exit = [](j_common_ptr cinfo) {
+        (*cinfo->err->output_message)(cinfo);
+        if(cinfo->client_data) {
+            auto & dmgr =
+                *reinterpret_cast<CustomJpegDestMgr*>(cinfo->client_data);
+            dmgr.mSuccess = false;
+        }
+    };
+    /* Now that we initialized some callbacks, let's create our compressor */
+    jpeg_create_compress(&cinfo);
+
+    /* Initialize our destination manager */
+    dmgr.mBuffer = static_cast<JOCTET*>(out);
+    dmgr.mBufferSize = maxOutSize;
+    dmgr.mEncodedSize = 0;
+    dmgr.mSuccess = true;
+    cinfo.client_data = static_cast<void*>(&dmgr);
+
+    /* These lambdas become C-style function pointers and as per C++11 spec
+     * may not capture anything */
+    dmgr.mgr.init_destination = [](j_compress_ptr cinfo) {
+        auto & dmgr = reinterpret_cast<CustomJpegDestMgr&>(*cinfo->dest);
+        dmgr.mgr.next_output_byte = dmgr.mBuffer;
+        dmgr.mgr.free_in_buffer = dmgr.mBufferSize;
+        ALOGV("%s:%d jpeg start: %p [%zu]",
+              __FUNCTION__, __LINE__, dmgr.mBuffer, dmgr.mBufferSize);
+    };
+
+    dmgr.mgr.empty_output_buffer = [](j_compress_ptr cinfo __unused) {
+        ALOGV("%s:%d Out of buffer", __FUNCTION__, __LINE__);
+        return 0;
+    };
+
+    dmgr.mgr.term_destination = [](j_compress_ptr cinfo) {
+        auto & dmgr = reinterpret_cast<CustomJpegDestMgr&>(*cinfo->dest);
+        dmgr.mEncodedSize = dmgr.mBufferSize - dmgr.mgr.free_in_buffer;
+        ALOGV("%s:%d Done with jpeg: %zu", __FUNCTION__, __LINE__, dmgr.mEncodedSize);
+    };
+    cinfo.dest = reinterpret_cast<struct jpeg_destination_mgr*>(&dmgr);
+
+    /* We are going to be using JPEG in raw data mode, so we are passing
+     * straight subsampled planar YCbCr and it will not touch our pixel
+     * data or do any scaling or anything */
+    cinfo.image_width = inSz.width;
+    cinfo.image_height = inSz.height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_YCbCr;
+
+    /* Initialize defaults and then override what we want */
+    jpeg_set_defaults(&cinfo);
+
+    jpeg_set_quality(&cinfo, jpegQuality, 1);
+    jpeg_set_colorspace(&cinfo, JCS_YCbCr);
+    cinfo.raw_data_in = 1;
+    cinfo.dct_method = JDCT_IFAST;
+
+    /* Configure sampling factors. The sampling factor is JPEG subsampling 420
+     * because the source format is YUV420. Note that libjpeg sampling factors
+     * are... a little weird. Sampling of Y=2,U=1,V=1 means there is 1 U and
+     * 1 V value for each 2 Y values */
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = 2;
+    cinfo.comp_info[1].h_samp_factor = 1;
+    cinfo.comp_info[1].v_samp_factor = 1;
+    cinfo.comp_info[2].h_samp_factor = 1;
+    cinfo.comp_info[2].v_samp_factor = 1;
+
+    /* Let's not hardcode YUV420 in 6 places... 5 was enough */
+    int maxVSampFactor = std::max( {
+        cinfo.comp_info[0].v_samp_factor,
+        cinfo.comp_info[1].v_samp_factor,
+        cinfo.comp_info[2].v_samp_factor
+    });
+    int cVSubSampling = cinfo.comp_info[0].v_samp_factor /
+                        cinfo.comp_info[1].v_samp_factor;
+
+    /* Start the compressor */
+    jpeg_start_compress(&cinfo, TRUE);
+
+    /* Compute our macroblock height, so we can pad our input to be vertically
+     * macroblock aligned.
+     * TODO: Does it need to be horizontally MCU aligned too? */
+
+    size_t mcuV = DCTSIZE*maxVSampFactor;
+    size_t paddedHeight = mcuV * ((inSz.height + mcuV - 1) / mcuV);
+
+    /* libjpeg uses arrays of row pointers, which makes it really easy to pad
+     * data vertically (unfortunately doesn't help horizontally) */
+    std::vector<JSAMPROW> yLines (paddedHeight);
+    std::vector<JSAMPROW> cbLines(paddedHeight/cVSubSampling);
+    std::vector<JSAMPROW> crLines(paddedHeight/cVSubSampling);
+
+    uint8_t *py = static_cast<uint8_t*>(inLayout.y);
+    uint8_t *pcr = static_cast<uint8_t*>(inLayout.cr);
+    uint8_t *pcb = static_cast<uint8_t*>(inLayout.cb);
+
+    for(uint32_t i = 0; i < paddedHeight; i++)
+    {
+        /* Once we are in the padding territory we still point to the last line
+         * effectively replicating it several times ~ CLAMP_TO_EDGE */
+        int li = std::min(i, inSz.height - 1);
+        yLines[i]  = static_cast<JSAMPROW>(py + li * inLayout.yStride);
+        if(i < paddedHeight / cVSubSampling)
+        {
+            crLines[i] = static_cast<JSAMPROW>(pcr + li * inLayout.cStride);
+            cbLines[i] = static_cast<JSAMPROW>(pcb + li * inLayout.cStride);
+        }
+    }
+
+    /* If APP1 data was passed in, use it */
+    if(app1Buffer && app1Size)
+    {
+        jpeg_write_marker(&cinfo, JPEG_APP0 + 1,
+             static_cast<const JOCTET*>(app1Buffer), app1Size);
+    }
+
+    /* While we still have padded height left to go, keep giving it one
+     * macroblock at a time. */
+    while (cinfo.next_scanline < cinfo.image_height) {
+        const uint32_t batchSize = DCTSIZE * maxVSampFactor;
+        const uint32_t nl = cinfo.next_scanline;
+        JSAMPARRAY planes[3]{ &yLines[nl],
+                              &cbLines[nl/cVSubSampling],
+                              &crLines[nl/cVSubSampling] };
+
+        uint32_t done = jpeg_write_raw_data(&cinfo, planes, batchSize);
+
+        if (done != batchSize) {
+            ALOGE("%s: compressed %u lines, expected %u (total %u/%u)",
+              __FUNCTION__, done, batchSize, cinfo.next_scanline,
+              cinfo.image_height);
+            return -1;
+        }
+    }
+
+    /* This will flush everything */
+    jpeg_finish_compress(&cinfo);
+
+    /* Grab the actual code size and set it */
+    actualCodeSize = dmgr.mEncodedSize;
+
+    return 0;
+}
+
+V4L2M2MJpegCodec::V4L2M2MJpegCodec(
+        const std::string& decoderNode, const std::string& encoderNode) {
+    if (!decoderNode.empty()) {
+        mDecoder = std::make_unique<M2MDevice>(
+                decoderNode, V4L2_PIX_FMT_JPEG, V4L2_PIX_FMT_YUV420);
+        if (!mDecoder->isValid()) {
+            ALOGW("%s: JPEG decoder %s not usable, using software decoder",
+                    __FUNCTION__, decoderNode.c_str());
+            mDecoder.reset();
+        }
+    }
+    if (!encoderNode.empty()) {
+        mEncoder = std::make_unique<M2MDevice>(
+                encoderNode, V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_JPEG);
+        if (!mEncoder->isValid()) {
+            ALOGW("%s: JPEG encoder %s not usable, using software encoder",
+                    __FUNCTION__, encoderNode.c_str());
+            mEncoder.reset();
+        }
+    }
+}
+
+int V4L2M2MJpegCodec::decodeToYU12(const uint8_t* inData, size_t inDataSize,
+        const Size& sz, const YCbCrLayout& out) {
+    ATRACE_CALL();
+    {
+        std::lock_guard<std::mutex> lk(mDecoderLock);
+        if (mDecoder != nullptr) {
+            // MJPEG frames are much smaller than the decoded frame, so sizing
+            // the OUTPUT buffer to the YU12 size avoids reallocating it when
+            // the compressed frame size varies.
+            int ret = mDecoder->process(sz,
+                    std::max(inDataSize, getYU12Size(sz)), getYU12Size(sz),
+                    [&](uint8_t* dst, size_t dstSize) -> size_t {
+                        if (inDataSize > dstSize) {
+                            return 0;
+                        }
+                        memcpy(dst, inData, inDataSize);
+                        return inDataSize;
+                    },
+                    [&](const uint8_t* src, size_t srcSize) -> int {
+                        const uint32_t yStride = mDecoder->getBytesPerLine(/*capture*/true);
+                        const uint32_t cStride = yStride / 2;
+                        const size_t ySize = yStride * sz.height;
+                        const size_t cSize = cStride * sz.height / 2;
+                        if (srcSize < ySize + 2 * cSize) {
+                            ALOGE("%s: decoded frame too small: %zu", __FUNCTION__, srcSize);
+                            return -EINVAL;
+                        }
+                        return libyuv::I420Copy(
+                                src, yStride,
+                                src + ySize, cStride,
+                                src + ySize + cSize, cStride,
+                                static_cast<uint8_t*>(out.y), out.yStride,
+                                static_cast<uint8_t*>(out.cb), out.cStride,
+                                static_cast<uint8_t*>(out.cr), out.cStride,
+                                sz.width, sz.height);
+                    });
+            if (ret == 0) {
+                return 0;
+            }
+            ALOGV("%s: hardware decode failed (%d), using software decoder",
+                    __FUNCTION__, ret);
+        }
+    }
+    return mFallback.decodeToYU12(inData, inDataSize, sz, out);
+}
+
+int V4L2M2MJpegCodec::encodeYU12(const Size& inSz, const YCbCrLayout& inLayout,
+        int jpegQuality, const void* app1Buffer, size_t app1Size,
+        void* out, size_t maxOutSize, size_t& actualCodeSize) {
+    ATRACE_CALL();
+    // APP1 segment: marker, 2 bytes of length (which counts itself), then payload
+    const bool writeApp1 = app1Buffer != nullptr && app1Size > 0;
+    const size_t app1SegmentSize = writeApp1 ? app1Size + 4 : 0;
+    if (app1Size + 2 > 0xFFFF) {
+        ALOGE("%s: APP1 size %zu is too large", __FUNCTION__, app1Size);
+        return -EINVAL;
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(mEncoderLock);
+        if (mEncoder != nullptr && maxOutSize > app1SegmentSize) {
+            mEncoder->setQuality(jpegQuality);
+            int ret = mEncoder->process(inSz, getYU12Size(inSz), maxOutSize - app1SegmentSize,
+                    [&](uint8_t* dst, size_t dstSize) -> size_t {
+                        const uint32_t yStride = mEncoder->getBytesPerLine(/*capture*/false);
+                        const uint32_t cStride = yStride / 2;
+                        const size_t ySize = yStride * inSz.height;
+                        const size_t cSize = cStride * inSz.height / 2;
+                        if (dstSize < ySize + 2 * cSize) {
+                            return 0;
+                        }
+                        int res = libyuv::I420Copy(
+                                static_cast<uint8_t*>(inLayout.y), inLayout.yStride,
+                                static_cast<uint8_t*>(inLayout.cb), inLayout.cStride,
+                                static_cast<uint8_t*>(inLayout.cr), inLayout.cStride,
+                                dst, yStride,
+                                dst + ySize, cStride,
+                                dst + ySize + cSize, cStride,
+                                inSz.width, inSz.height);
+                        return res == 0 ? ySize + 2 * cSize : 0;
+                    },
+                    [&](const uint8_t* src, size_t srcSize) -> int {
+                        // Insert the APP1 segment right after SOI
+                        if (srcSize < 2 || src[0] != 0xFF || src[1] != 0xD8) {
+                            ALOGE("%s: encoder output does not start with SOI", __FUNCTION__);
+                            return -EINVAL;
+                        }
+                        if (srcSize + app1SegmentSize > maxOutSize) {
+                            ALOGE("%s: encoded size %zu exceeds buffer size %zu",
+                                    __FUNCTION__, srcSize + app1SegmentSize, maxOutSize);
+                            return -ENOSPC;
+                        }
+                        uint8_t* dst = static_cast<uint8_t*>(out);
+                        memcpy(dst, src, 2);
+                        if (writeApp1) {
+                            dst[2] = 0xFF;
+                            dst[3] = JPEG_APP0 + 1;
+                            dst[4] = static_cast<uint8_t>((app1Size + 2) >> 8);
+                            dst[5] = static_cast<uint8_t>((app1Size + 2) & 0xFF);
+                            memcpy(dst + 6, app1Buffer, app1Size);
+                        }
+                        memcpy(dst + 2 + app1SegmentSize, src + 2, srcSize - 2);
+                        actualCodeSize = srcSize + app1SegmentSize;
+                        return 0;
+                    });
+            if (ret == 0) {
+                return 0;
+            }
+            ALOGV("%s: hardware encode failed (%d), using software encoder",
+                    __FUNCTION__, ret);
+        }
+    }
+    return mFallback.encodeYU12(inSz, inLayout, jpegQuality, app1Buffer, app1Size,
+            out, maxOutSize, actualCodeSize);
+}
+
+V4L2M2MJpegCodec::M2MDevice::M2MDevice(
+        const std::string& node, uint32_t outputFourcc, uint32_t captureFourcc) :
+        mNode(node), mOutputFourcc(outputFourcc), mCaptureFourcc(captureFourcc) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(node.c_str(), O_RDWR | O_NONBLOCK)));
+    if (fd.get() < 0) {
+        ALOGE("%s: open %s failed: %s", __FUNCTION__, node.c_str(), strerror(errno));
+        return;
+    }
+
+    struct v4l2_capability capability;
+    if (TEMP_FAILURE_RETRY(ioctl(fd.get(), VIDIOC_QUERYCAP, &capability)) < 0) {
+        ALOGE("%s: VIDIOC_QUERYCAP on %s failed: %s",
+                __FUNCTION__, node.c_str(), strerror(errno));
+        return;
+    }
+    uint32_t caps = (capability.capabilities & V4L2_CAP_DEVICE_CAPS) ?
+            capability.device_caps : capability.capabilities;
+    if (!(caps & V4L2_CAP_STREAMING)) {
+        ALOGE("%s: %s does not support streaming I/O", __FUNCTION__, node.c_str());
+        return;
+    }
+    if (caps & V4L2_CAP_VIDEO_M2M_MPLANE) {
+        mOutputType = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        mCaptureType = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    } else if (caps & V4L2_CAP_VIDEO_M2M) {
+        mOutputType = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        mCaptureType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    } else {
+        ALOGE("%s: %s is not a memory-to-memory device", __FUNCTION__, node.c_str());
+        return;
+    }
+
+    mFd = std::move(fd);
+    if (!supportsFormat(mOutputType, mOutputFourcc) ||
+            !supportsFormat(mCaptureType, mCaptureFourcc)) {
+        ALOGE("%s: %s does not support the required formats", __FUNCTION__, node.c_str());
+        mFd.reset();
+        return;
+    }
+    ALOGI("%s: using %s (%s)", __FUNCTION__, node.c_str(), capability.card);
+}
+
+V4L2M2MJpegCodec::M2MDevice::~M2MDevice() {
+    reset();
+}
+
+bool V4L2M2MJpegCodec::M2MDevice::supportsFormat(uint32_t type, uint32_t fourcc) {
+    struct v4l2_fmtdesc fmtdesc {};
+    fmtdesc.index = 0;
+    fmtdesc.type = type;
+    while (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_ENUM_FMT, &fmtdesc)) == 0) {
+        if (fmtdesc.pixelformat == fourcc) {
+            return true;
+        }
+        fmtdesc.index++;
+    }
+    return false;
+}
+
+int V4L2M2MJpegCodec::M2MDevice::setQuality(int jpegQuality) {
+    if (jpegQuality == mQuality) {
+        return 0;
+    }
+    struct v4l2_control control {};
+    control.id = V4L2_CID_JPEG_COMPRESSION_QUALITY;
+    control.value = jpegQuality;
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_S_CTRL, &control)) < 0) {
+        // Not all encoders expose the quality control, use the driver default
+        ALOGV("%s: set JPEG quality %d failed: %s", __FUNCTION__, jpegQuality, strerror(errno));
+        return -errno;
+    }
+    mQuality = jpegQuality;
+    return 0;
+}
+
+template <typename FillFn, typename ReadFn>
+int V4L2M2MJpegCodec::M2MDevice::process(const Size& sz, size_t inSize, size_t captureSize,
+        FillFn fillInput, ReadFn readCapture) {
+    for (const auto& unsupported : mUnsupportedSizes) {
+        if (unsupported == sz) {
+            return -EINVAL;
+        }
+    }
+
+    int ret = configure(sz, inSize, captureSize);
+    if (ret != 0) {
+        ALOGW("%s: %s cannot process %dx%d, using software codec for this size",
+                __FUNCTION__, mNode.c_str(), sz.width, sz.height);
+        mUnsupportedSizes.push_back(sz);
+        return ret;
+    }
+
+    size_t bytesUsed = fillInput(static_cast<uint8_t*>(mOutputBuffer.data), mOutputBuffer.length);
+    if (bytesUsed == 0) {
+        return -EINVAL;
+    }
+
+    size_t captureUsed = 0;
+    size_t outputUsed = 0;
+    if ((ret = queueBuffer(mCaptureType, 0)) != 0 ||
+            (ret = queueBuffer(mOutputType, bytesUsed)) != 0 ||
+            (ret = dequeueBuffer(mCaptureType, &captureUsed)) != 0 ||
+            (ret = dequeueBuffer(mOutputType, &outputUsed)) != 0) {
+        // Streaming off returns all queued buffers, start over on next frame
+        reset();
+        return ret;
+    }
+
+    return readCapture(static_cast<const uint8_t*>(mCaptureBuffer.data), captureUsed);
+}
+
+int V4L2M2MJpegCodec::M2MDevice::configure(const Size& sz, size_t inSize, size_t captureSize) {
+    if (mConfigured && mSize == sz && inSize <= mInSize && captureSize <= mCaptureSize) {
+        return 0;
+    }
+    reset();
+
+    int ret = setFormat(mOutputType, mOutputFourcc, sz, inSize, &mOutputBytesPerLine);
+    if (ret == 0) {
+        ret = setFormat(mCaptureType, mCaptureFourcc, sz, captureSize, &mCaptureBytesPerLine);
+    }
+    if (ret == 0) {
+        ret = allocateBuffer(mOutputType, &mOutputBuffer);
+    }
+    if (ret == 0) {
+        ret = allocateBuffer(mCaptureType, &mCaptureBuffer);
+    }
+    if (ret == 0 && (mOutputBuffer.length < inSize || mCaptureBuffer.length < captureSize)) {
+        ALOGE("%s: %s buffers too small: %zu/%zu, %zu/%zu", __FUNCTION__, mNode.c_str(),
+                mOutputBuffer.length, inSize, mCaptureBuffer.length, captureSize);
+        ret = -ENOMEM;
+    }
+    for (uint32_t type : {mOutputType, mCaptureType}) {
+        if (ret == 0 && TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_STREAMON, &type)) < 0) {
+            ALOGE("%s: VIDIOC_STREAMON on %s failed: %s",
+                    __FUNCTION__, mNode.c_str(), strerror(errno));
+            ret = -errno;
+        }
+    }
+    if (ret != 0) {
+        reset();
+        return ret;
+    }
+
+    mConfigured = true;
+    mSize = sz;
+    mInSize = inSize;
+    mCaptureSize = captureSize;
+    return 0;
+}
+
+void V4L2M2MJpegCodec::M2MDevice::reset() {
+    if (mFd.get() < 0) {
+        return;
+    }
+    for (uint32_t type : {mOutputType, mCaptureType}) {
+        TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_STREAMOFF, &type));
+    }
+    for (MappedBuffer* buf : {&mOutputBuffer, &mCaptureBuffer}) {
+        if (buf->data != nullptr) {
+            munmap(buf->data, buf->length);
+        }
+        *buf = MappedBuffer();
+    }
+    for (uint32_t type : {mOutputType, mCaptureType}) {
+        struct v4l2_requestbuffers req_buffers {};
+        req_buffers.type = type;
+        req_buffers.memory = V4L2_MEMORY_MMAP;
+        req_buffers.count = 0;
+        TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_REQBUFS, &req_buffers));
+    }
+    mConfigured = false;
+}
+
+int V4L2M2MJpegCodec::M2MDevice::setFormat(uint32_t type, uint32_t fourcc, const Size& sz,
+        size_t size, /*out*/uint32_t* bytesPerLine) {
+    const bool mplane = (type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE ||
+                         type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE);
+    struct v4l2_format fmt {};
+    fmt.type = type;
+    if (mplane) {
+        fmt.fmt.pix_mp.width = sz.width;
+        fmt.fmt.pix_mp.height = sz.height;
+        fmt.fmt.pix_mp.pixelformat = fourcc;
+        fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+        fmt.fmt.pix_mp.num_planes = 1;
+        fmt.fmt.pix_mp.plane_fmt[0].sizeimage = size;
+    } else {
+        fmt.fmt.pix.width = sz.width;
+        fmt.fmt.pix.height = sz.height;
+        fmt.fmt.pix.pixelformat = fourcc;
+        fmt.fmt.pix.field = V4L2_FIELD_NONE;
+        fmt.fmt.pix.sizeimage = size;
+    }
+
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_S_FMT, &fmt)) < 0) {
+        ALOGE("%s: S_FMT %dx%d on %s failed: %s",
+                __FUNCTION__, sz.width, sz.height, mNode.c_str(), strerror(errno));
+        return -errno;
+    }
+
+    uint32_t width, height, pixelformat, numPlanes;
+    if (mplane) {
+        width = fmt.fmt.pix_mp.width;
+        height = fmt.fmt.pix_mp.height;
+        pixelformat = fmt.fmt.pix_mp.pixelformat;
+        numPlanes = fmt.fmt.pix_mp.num_planes;
+        *bytesPerLine = fmt.fmt.pix_mp.plane_fmt[0].bytesperline;
+    } else {
+        width = fmt.fmt.pix.width;
+        height = fmt.fmt.pix.height;
+        pixelformat = fmt.fmt.pix.pixelformat;
+        numPlanes = 1;
+        *bytesPerLine = fmt.fmt.pix.bytesperline;
+    }
+
+    if (pixelformat != fourcc || numPlanes != 1) {
+        ALOGE("%s: %s changed format to %c%c%c%c with %d planes", __FUNCTION__, mNode.c_str(),
+                pixelformat & 0xFF, (pixelformat >> 8) & 0xFF,
+                (pixelformat >> 16) & 0xFF, (pixelformat >> 24) & 0xFF, numPlanes);
+        return -EINVAL;
+    }
+    // Only the raw image has to match exactly, the JPEG side is sized by
+    // the driver from the image
+    if (fourcc == V4L2_PIX_FMT_YUV420 &&
+            (width != sz.width || height != sz.height || *bytesPerLine < sz.width)) {
+        ALOGE("%s: %s changed size %dx%d to %dx%d (stride %d)", __FUNCTION__, mNode.c_str(),
+                sz.width, sz.height, width, height, *bytesPerLine);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+int V4L2M2MJpegCodec::M2MDevice::allocateBuffer(uint32_t type, /*out*/MappedBuffer* buf) {
+    const bool mplane = (type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE ||
+                         type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE);
+    struct v4l2_requestbuffers req_buffers {};
+    req_buffers.type = type;
+    req_buffers.memory = V4L2_MEMORY_MMAP;
+    req_buffers.count = 1;
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_REQBUFS, &req_buffers)) < 0 ||
+            req_buffers.count < 1) {
+        ALOGE("%s: VIDIOC_REQBUFS on %s failed: %s",
+                __FUNCTION__, mNode.c_str(), strerror(errno));
+        return -ENOMEM;
+    }
+
+    struct v4l2_buffer buffer {};
+    struct v4l2_plane plane {};
+    buffer.type = type;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = 0;
+    if (mplane) {
+        buffer.m.planes = &plane;
+        buffer.length = 1;
+    }
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_QUERYBUF, &buffer)) < 0) {
+        ALOGE("%s: VIDIOC_QUERYBUF on %s failed: %s",
+                __FUNCTION__, mNode.c_str(), strerror(errno));
+        return -errno;
+    }
+
+    size_t length = mplane ? plane.length : buffer.length;
+    off_t offset = mplane ? plane.m.mem_offset : buffer.m.offset;
+    void* addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, mFd.get(), offset);
+    if (addr == MAP_FAILED) {
+        ALOGE("%s: mmap %zu bytes on %s failed: %s",
+                __FUNCTION__, length, mNode.c_str(), strerror(errno));
+        return -errno;
+    }
+    buf->data = addr;
+    buf->length = length;
+    return 0;
+}
+
+int V4L2M2MJpegCodec::M2MDevice::queueBuffer(uint32_t type, size_t bytesUsed) {
+    struct v4l2_buffer buffer {};
+    struct v4l2_plane plane {};
+    buffer.type = type;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = 0;
+    if (type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE || type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+        plane.bytesused = bytesUsed;
+        buffer.m.planes = &plane;
+        buffer.length = 1;
+    } else {
+        buffer.bytesused = bytesUsed;
+    }
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_QBUF, &buffer)) < 0) {
+        ALOGE("%s: VIDIOC_QBUF on %s failed: %s", __FUNCTION__, mNode.c_str(), strerror(errno));
+        return -errno;
+    }
+    return 0;
+}
+
+int V4L2M2MJpegCodec::M2MDevice::dequeueBuffer(uint32_t type, /*out*/size_t* bytesUsed) {
+    const bool mplane = (type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE ||
+                         type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE);
+    const bool capture = (type == mCaptureType);
+    struct pollfd pfd = { mFd.get(), static_cast<short>(capture ? POLLIN : POLLOUT), 0 };
+    int ret = TEMP_FAILURE_RETRY(poll(&pfd, 1, kProcessTimeoutMs));
+    if (ret == 0) {
+        ALOGE("%s: %s timed out", __FUNCTION__, mNode.c_str());
+        return -ETIMEDOUT;
+    } else if (ret < 0 || (pfd.revents & POLLERR)) {
+        ALOGE("%s: poll on %s failed: %s", __FUNCTION__, mNode.c_str(),
+                ret < 0 ? strerror(errno) : "POLLERR");
+        return -EIO;
+    }
+
+    struct v4l2_buffer buffer {};
+    struct v4l2_plane plane {};
+    buffer.type = type;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    if (mplane) {
+        buffer.m.planes = &plane;
+        buffer.length = 1;
+    }
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_DQBUF, &buffer)) < 0) {
+        ALOGE("%s: VIDIOC_DQBUF on %s failed: %s", __FUNCTION__, mNode.c_str(), strerror(errno));
+        return -errno;
+    }
+    if (buffer.flags & V4L2_BUF_FLAG_ERROR) {
+        // Typically a frame the hardware could not parse
+        ALOGV("%s: %s returned an error buffer", __FUNCTION__, mNode.c_str());
+        return -EIO;
+    }
+    *bytesUsed = mplane ? plane.bytesused : buffer.bytesused;
+    return 0;
+}
+
+}  // namespace implementation
+}  // namespace V3_4
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
@@ -20,6 +20,7 @@
 
 #include <algorithm>
 #include <array>
+#include <set>
 #include <linux/videodev2.h>
 #include "android-base/macros.h"
 #include "CameraMetadata.h"
@@ -149,6 +150,24 @@ Return<void> ExternalCameraDevice::open(
         }
     }
 
+    if (mFormatsFromCache) {
+        // Formats from the cache are checked once against the device, in case the camera was
+        // updated without its firmware revision changing.
+        mFormatsFromCache = false;
+        if (!cachedFormatsMatchDeviceLocked(fd.get())) {
+            ALOGW("%s: cached formats of %s are stale, enumerating again", __FUNCTION__,
+                    mCameraId.c_str());
+            ExternalCameraFormatCache::getInstance().invalidate(mFormatCacheKey);
+            mSupportedFormats.clear();
+            mCameraCharacteristics.clear();
+            if (initCameraCharacteristics() != OK) {
+                mLock.unlock();
+                _hidl_cb(Status::INTERNAL_ERROR, nullptr);
+                return Void();
+            }
+        }
+    }
+
     session = createSession(
             callback, mCfg, mSupportedFormats, mCroppingType,
             mCameraCharacteristics, mCameraId, std::move(fd));
@@ -202,12 +221,24 @@ Return<void> ExternalCameraDevice::dumpState(const ::android::hardware::hidl_han
 
 status_t ExternalCameraDevice::initCameraCharacteristics() {
     if (mCameraCharacteristics.isEmpty()) {
-        // init camera characteristics
-        unique_fd fd(::open(mCameraId.c_str(), O_RDWR));
-        if (fd.get() < 0) {
-            ALOGE("%s: v4l2 device open %s failed", __FUNCTION__, mCameraId.c_str());
-            return DEAD_OBJECT;
+        // A camera model seen before gets its formats from the cache, and is not touched at
+        // all. Only the format enumeration depends on the device; everything else below is
+        // built from the formats and the config.
+        ExternalCameraFormatCache& formatCache = ExternalCameraFormatCache::getInstance();
+        const std::string cacheKey = ExternalCameraFormatCache::getDeviceKey(mCameraId);
+        unique_fd fd;
+        if (!formatCache.lookup(cacheKey, mCfg, &mSupportedFormats, &mCroppingType)) {
+            fd.reset(::open(mCameraId.c_str(), O_RDWR));
+            if (fd.get() < 0) {
+                ALOGE("%s: v4l2 device open %s failed", __FUNCTION__, mCameraId.c_str());
+                return DEAD_OBJECT;
+            }
+        } else {
+            ALOGV("%s: using cached formats of %s (%s)", __FUNCTION__, mCameraId.c_str(),
+                    cacheKey.c_str());
         }
+        mFormatCacheKey = cacheKey;
+        mFormatsFromCache = fd.get() < 0;
 
         status_t ret;
         ret = initDefaultCharsKeys(&mCameraCharacteristics);
@@ -237,6 +268,10 @@ status_t ExternalCameraDevice::initCameraCharacteristics() {
             mCameraCharacteristics.clear();
             return ret;
         }
+
+        if (fd.get() >= 0) {
+            formatCache.store(cacheKey, mCfg, mSupportedFormats, mCroppingType);
+        }
     }
     return OK;
 }
@@ -678,7 +713,10 @@ bool ExternalCameraDevice::calculateMinFps(
 
 status_t ExternalCameraDevice::initOutputCharsKeys(
     int fd, ::android::hardware::camera::common::V1_0::helper::CameraMetadata* metadata) {
-    initSupportedFormatsLocked(fd);
+    // Already filled in from ExternalCameraFormatCache otherwise
+    if (mSupportedFormats.empty()) {
+        initSupportedFormatsLocked(fd);
+    }
     if (mSupportedFormats.empty()) {
         ALOGE("%s: Init supported format list failed", __FUNCTION__);
         return UNKNOWN_ERROR;
@@ -940,6 +978,32 @@ void ExternalCameraDevice::updateFpsBounds(
     }
 }
 
+bool ExternalCameraDevice::cachedFormatsMatchDeviceLocked(int fd) const {
+    // Only the formats and sizes are listed; the frame interval sweep is what the cache saves.
+    std::set<std::array<uint32_t, 3>> deviceSizes;
+    struct v4l2_fmtdesc fmtdesc {
+        .index = 0,
+        .type = V4L2_BUF_TYPE_VIDEO_CAPTURE};
+    for (; TEMP_FAILURE_RETRY(ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc)) == 0; ++fmtdesc.index) {
+        v4l2_frmsizeenum frameSize {
+                .index = 0,
+                .pixel_format = fmtdesc.pixelformat};
+        for (; TEMP_FAILURE_RETRY(ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &frameSize)) == 0;
+                ++frameSize.index) {
+            if (frameSize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+                deviceSizes.insert({fmtdesc.pixelformat, frameSize.discrete.width,
+                        frameSize.discrete.height});
+            }
+        }
+    }
+    for (const auto& format : mSupportedFormats) {
+        if (deviceSizes.count({format.fourcc, format.width, format.height}) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void ExternalCameraDevice::initSupportedFormatsLocked(int fd) {
     std::vector<SupportedV4L2Format> horizontalFmts = getCandidateSupportedFormatsLocked(
         fd, HORIZONTAL, mCfg.fpsLimits, mCfg.depthFpsLimits, mCfg.minStreamSize, mCfg.depthEnabled);
@@ -18,6 +18,7 @@
 #define ATRACE_TAG ATRACE_TAG_CAMERA
 #include <log/log.h>
 
+#include <algorithm>
 #include <inttypes.h>
 #include "ExternalCameraDeviceSession.h"
 
@@ -25,13 +26,12 @@
 #include <utils/Timers.h>
 #include <utils/Trace.h>
 #include <linux/videodev2.h>
+#include <poll.h>
 #include <sync/sync.h>
 
 #define HAVE_JPEG // required for libyuv.h to export MJPEG decode APIs
 #include <libyuv.h>
 
-#include <jpeglib.h>
-
 
 namespace android {
 namespace hardware {
@@ -148,6 +148,8 @@ bool ExternalCameraDeviceSession::initialize() {
         return true;
     }
     mOutputThread->setExifMakeModel(make, model);
+    mOutputThread->setJpegCodec(JpegCodec::create(mCfg));
+    mOutputThread->setOutputWorkerCount(mCfg.outputWorkerCount);
 
     status_t status = initDefaultRequests();
     if (status != OK) {
@@ -280,12 +282,17 @@ void ExternalCameraDeviceSession::dumpState(const native_handle_t* handle) {
                 mV4l2StreamingFps);
 
         size_t numDequeuedV4l2Buffers = 0;
+        size_t numReadyV4l2Frames = 0;
         {
             std::lock_guard<std::mutex> lk(mV4l2BufferLock);
             numDequeuedV4l2Buffers = mNumDequeuedV4l2Buffers;
+            numReadyV4l2Frames = mReadyV4l2Frames.size();
         }
         dprintf(fd, "V4L2 buffer queue size %zu, dequeued %zu\n",
                 v4L2BufferCount, numDequeuedV4l2Buffers);
+        if (mCfg.v4l2CaptureThread) {
+            dprintf(fd, "V4L2 capture thread, ready frames %zu\n", numReadyV4l2Frames);
+        }
     }
 
     dprintf(fd, "In-flight frames (not sorted):");
@@ -294,6 +301,7 @@ void ExternalCameraDeviceSession::dumpState(const native_handle_t* handle) {
     }
     dprintf(fd, "\n");
     mOutputThread->dump(fd);
+    mRequestTimelines.dump(fd);
     dprintf(fd, "\n");
 
     if (intfLocked) {
@@ -604,6 +612,21 @@ void ExternalCameraDeviceSession::cleanupInflightFences(
     }
 }
 
+int ExternalCameraDeviceSession::waitForV4L2FrameReadyLocked(std::unique_lock<std::mutex>& lk) {
+    ATRACE_CALL();
+    std::chrono::seconds timeout = std::chrono::seconds(kBufferWaitTimeoutSec);
+    mLock.unlock();
+    bool ready = mV4L2FrameReady.wait_for(lk, timeout,
+            [this] { return !mReadyV4l2Frames.empty(); });
+    // Same lock order as waitForV4L2BufferReturnLocked
+    mLock.lock();
+    if (!ready) {
+        ALOGE("%s: wait for V4L2 frame timeout!", __FUNCTION__);
+        return -1;
+    }
+    return 0;
+}
+
 int ExternalCameraDeviceSession::waitForV4L2BufferReturnLocked(std::unique_lock<std::mutex>& lk) {
     ATRACE_CALL();
     std::chrono::seconds timeout = std::chrono::seconds(kBufferWaitTimeoutSec);
@@ -715,6 +738,8 @@ Status ExternalCameraDeviceSession::processOneCaptureRequest(const CaptureReques
         }
 
         if (requestFpsMax != mV4l2StreamingFps) {
+            // Ready frames are not returned until the capture thread stops
+            stopV4l2CaptureThreadLocked();
             {
                 std::unique_lock<std::mutex> lk(mV4l2BufferLock);
                 while (mNumDequeuedV4l2Buffers != 0) {
@@ -747,6 +772,8 @@ Status ExternalCameraDeviceSession::processOneCaptureRequest(const CaptureReques
     halReq->setting = mLatestReqSetting;
     halReq->frameIn = frameIn;
     halReq->shutterTs = shutterTs;
+    halReq->timeline.captureNs = shutterTs;
+    halReq->timeline.dequeueNs = systemTime(SYSTEM_TIME_MONOTONIC);
     halReq->buffers.resize(numOutputBufs);
     for (size_t i = 0; i < numOutputBufs; i++) {
         HalStreamBuffer& halBuf = halReq->buffers[i];
@@ -885,6 +912,8 @@ Status ExternalCameraDeviceSession::processCaptureResult(std::shared_ptr<HalRequ
     // Callback into framework
     invokeProcessCaptureResultCallback(results, /* tryWriteFmq */true);
     freeReleaseFences(results);
+    req->timeline.resultNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    mRequestTimelines.record(req->timeline);
     return Status::OK;
 }
 
@@ -945,9 +974,26 @@ void ExternalCameraDeviceSession::freeReleaseFences(hidl_vec<CaptureResult>& res
 
 ExternalCameraDeviceSession::OutputThread::OutputThread(
         wp<ExternalCameraDeviceSession> parent,
-        CroppingType ct) : mParent(parent), mCroppingType(ct) {}
+        CroppingType ct) : mParent(parent), mCroppingType(ct),
+        mDecodeThread(new DecodeThread(this)),
+        mJpegCodec(std::make_unique<SoftwareJpegCodec>()) {}
+
+ExternalCameraDeviceSession::OutputThread::~OutputThread() {
+    mDecodeThread->requestExit();
+    mDecodeThread->join();
+}
+
+status_t ExternalCameraDeviceSession::OutputThread::readyToRun() {
+    return mDecodeThread->run("ExtCamDecode", PRIORITY_DISPLAY);
+}
 
-ExternalCameraDeviceSession::OutputThread::~OutputThread() {}
+void ExternalCameraDeviceSession::OutputThread::requestExit() {
+    Thread::requestExit();
+    mDecodeThread->requestExit();
+    std::lock_guard<std::mutex> lk(mRequestListLock);
+    mRequestCond.notify_all();
+    mPipelineCond.notify_all();
+}
 
 void ExternalCameraDeviceSession::OutputThread::setExifMakeModel(
         const std::string& make, const std::string& model) {
@@ -955,6 +1001,33 @@ void ExternalCameraDeviceSession::OutputThread::setExifMakeModel(
     mExifModel = model;
 }
 
+void ExternalCameraDeviceSession::OutputThread::setJpegCodec(std::unique_ptr<JpegCodec> codec) {
+    if (codec != nullptr) {
+        mJpegCodec = std::move(codec);
+    }
+}
+
+void ExternalCameraDeviceSession::OutputThread::setOutputWorkerCount(size_t count) {
+    mOutputWorkers.reset(count > 0 ? new OutputWorkerPool(count) : nullptr);
+}
+
+void ExternalCameraDeviceSession::OutputThread::recordCodecTiming(
+        bool decode, nsecs_t durationNs) {
+    std::lock_guard<std::mutex> lk(mCodecTimingLock);
+    (decode ? mDecodeTiming : mEncodeTiming).record(durationNs);
+}
+
+void ExternalCameraDeviceSession::OutputThread::dumpCodecTiming(
+        int fd, const char* name, const CodecTiming& timing) {
+    if (timing.frameCount == 0) {
+        dprintf(fd, "  %s: no frames\n", name);
+        return;
+    }
+    dprintf(fd, "  %s: %" PRIu64 " frames, last %.2f ms, avg %.2f ms, max %.2f ms\n",
+            name, timing.frameCount, timing.lastNs / 1e6,
+            timing.totalNs / 1e6 / timing.frameCount, timing.maxNs / 1e6);
+}
+
 uint32_t ExternalCameraDeviceSession::OutputThread::getFourCcFromLayout(
         const YCbCrLayout& layout) {
     intptr_t cb = reinterpret_cast<intptr_t>(layout.cb);
@@ -1075,12 +1148,16 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
         return 0;
     }
 
-    auto it = mScaledYu12Frames.find(outSz);
     sp<AllocatedFrame> scaledYu12Buf;
-    if (it != mScaledYu12Frames.end()) {
-        scaledYu12Buf = it->second;
-    } else {
-        it = mIntermediateBuffers.find(outSz);
+    {
+        std::lock_guard<std::mutex> scaledLk(mScaledFramesLock);
+        auto scaledIt = mScaledYu12Frames.find(outSz);
+        if (scaledIt != mScaledYu12Frames.end()) {
+            scaledYu12Buf = scaledIt->second;
+        }
+    }
+    if (scaledYu12Buf == nullptr) {
+        auto it = mIntermediateBuffers.find(outSz);
         if (it == mIntermediateBuffers.end()) {
             ALOGE("%s: failed to find intermediate buffer size %dx%d",
                     __FUNCTION__, outSz.width, outSz.height);
@@ -1124,6 +1201,7 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
     }
 
     *out = outLayout;
+    std::lock_guard<std::mutex> scaledLk(mScaledFramesLock);
     mScaledYu12Frames.insert({outSz, scaledYu12Buf});
     return 0;
 }
@@ -1274,6 +1352,126 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleThumbLocked(
     return 0;
 }
 
+int ExternalCameraDeviceSession::OutputThread::cropScaleConvertLocked(
+        sp<AllocatedFrame>& in, const Size& outSz, const YCbCrLayout& out, uint32_t format) {
+    Size inSz = {in->mWidth, in->mHeight};
+
+    IMapper::Rect inputCrop {0, 0,
+            static_cast<int32_t>(inSz.width), static_cast<int32_t>(inSz.height)};
+    int ret;
+    if (!(inSz == outSz)) {
+        ret = getCropRect(mCroppingType, inSz, outSz, &inputCrop);
+        if (ret != 0) {
+            ALOGE("%s: failed to compute crop rect for output size %dx%d",
+                    __FUNCTION__, outSz.width, outSz.height);
+            return ret;
+        }
+    }
+
+    YCbCrLayout croppedLayout;
+    ret = in->getCroppedLayout(inputCrop, &croppedLayout);
+    if (ret != 0) {
+        ALOGE("%s: failed to crop input image %dx%d to output size %dx%d",
+                __FUNCTION__, inSz.width, inSz.height, outSz.width, outSz.height);
+        return ret;
+    }
+
+    bool needScale = inputCrop.width != static_cast<int32_t>(outSz.width) ||
+            inputCrop.height != static_cast<int32_t>(outSz.height);
+    if (!needScale) {
+        // Crop only: the conversion is already a single pass over the source
+        return formatConvertLocked(croppedLayout, out, outSz, format);
+    }
+
+    switch (format) {
+        case V4L2_PIX_FMT_YVU420: // YV12
+        case V4L2_PIX_FMT_YUV420: // YU12
+            ret = libyuv::I420Scale(
+                    static_cast<uint8_t*>(croppedLayout.y),
+                    croppedLayout.yStride,
+                    static_cast<uint8_t*>(croppedLayout.cb),
+                    croppedLayout.cStride,
+                    static_cast<uint8_t*>(croppedLayout.cr),
+                    croppedLayout.cStride,
+                    inputCrop.width,
+                    inputCrop.height,
+                    static_cast<uint8_t*>(out.y),
+                    out.yStride,
+                    static_cast<uint8_t*>(out.cb),
+                    out.cStride,
+                    static_cast<uint8_t*>(out.cr),
+                    out.cStride,
+                    outSz.width,
+                    outSz.height,
+                    libyuv::FilterMode::kFilterNone);
+            if (ret != 0) {
+                ALOGE("%s: failed to scale buffer from %dx%d to %dx%d. Ret %d",
+                        __FUNCTION__, inputCrop.width, inputCrop.height,
+                        outSz.width, outSz.height, ret);
+                return ret;
+            }
+            return 0;
+        case V4L2_PIX_FMT_NV21:
+        case V4L2_PIX_FMT_NV12: {
+            // Scale the luma plane straight into the output buffer. The chroma
+            // planes are scaled into the (quarter sized) chroma planes of the
+            // intermediate buffer and then interleaved into the output buffer.
+            auto it = mIntermediateBuffers.find(outSz);
+            if (it == mIntermediateBuffers.end()) {
+                ALOGE("%s: failed to find intermediate buffer size %dx%d",
+                        __FUNCTION__, outSz.width, outSz.height);
+                return -1;
+            }
+            YCbCrLayout chromaLayout;
+            ret = it->second->getLayout(&chromaLayout);
+            if (ret != 0) {
+                ALOGE("%s: failed to get intermediate buffer layout", __FUNCTION__);
+                return ret;
+            }
+
+            int cropCw = (inputCrop.width + 1) / 2;
+            int cropCh = (inputCrop.height + 1) / 2;
+            int outCw = static_cast<int>((outSz.width + 1) / 2);
+            int outCh = static_cast<int>((outSz.height + 1) / 2);
+            libyuv::ScalePlane(
+                    static_cast<uint8_t*>(croppedLayout.y), croppedLayout.yStride,
+                    inputCrop.width, inputCrop.height,
+                    static_cast<uint8_t*>(out.y), out.yStride,
+                    outSz.width, outSz.height,
+                    libyuv::FilterMode::kFilterNone);
+            libyuv::ScalePlane(
+                    static_cast<uint8_t*>(croppedLayout.cb), croppedLayout.cStride,
+                    cropCw, cropCh,
+                    static_cast<uint8_t*>(chromaLayout.cb), chromaLayout.cStride,
+                    outCw, outCh,
+                    libyuv::FilterMode::kFilterNone);
+            libyuv::ScalePlane(
+                    static_cast<uint8_t*>(croppedLayout.cr), croppedLayout.cStride,
+                    cropCw, cropCh,
+                    static_cast<uint8_t*>(chromaLayout.cr), chromaLayout.cStride,
+                    outCw, outCh,
+                    libyuv::FilterMode::kFilterNone);
+            if (format == V4L2_PIX_FMT_NV21) {
+                libyuv::MergeUVPlane(
+                        static_cast<uint8_t*>(chromaLayout.cr), chromaLayout.cStride,
+                        static_cast<uint8_t*>(chromaLayout.cb), chromaLayout.cStride,
+                        static_cast<uint8_t*>(out.cr), out.cStride,
+                        outCw, outCh);
+            } else {
+                libyuv::MergeUVPlane(
+                        static_cast<uint8_t*>(chromaLayout.cb), chromaLayout.cStride,
+                        static_cast<uint8_t*>(chromaLayout.cr), chromaLayout.cStride,
+                        static_cast<uint8_t*>(out.cb), out.cStride,
+                        outCw, outCh);
+            }
+            return 0;
+        }
+        default:
+            ALOGE("%s: unsupported YUV format 0x%x!", __FUNCTION__, format);
+            return -1;
+    }
+}
+
 int ExternalCameraDeviceSession::OutputThread::formatConvertLocked(
         const YCbCrLayout& in, const YCbCrLayout& out, Size sz, uint32_t format) {
     int ret = 0;
@@ -1356,183 +1554,6 @@ int ExternalCameraDeviceSession::OutputThread::formatConvertLocked(
     return 0;
 }
 
-int ExternalCameraDeviceSession::OutputThread::encodeJpegYU12(
-        const Size & inSz, const YCbCrLayout& inLayout,
-        int jpegQuality, const void *app1Buffer, size_t app1Size,
-        void *out, const size_t maxOutSize, size_t &actualCodeSize)
-{
-    /* libjpeg is a C library so we use C-style "inheritance" by
-     * putting libjpeg's jpeg_destination_mgr first in our custom
-     * struct. This allows us to cast jpeg_destination_mgr* to
-     * CustomJpegDestMgr* when we get it passed to us in a callback */
-    struct CustomJpegDestMgr {
-        struct jpeg_destination_mgr mgr;
-        JOCTET *mBuffer;
-        size_t mBufferSize;
-        size_t mEncodedSize;
-        bool mSuccess;
-    } dmgr;
-
-    jpeg_compress_struct cinfo = {};
-    jpeg_error_mgr jerr;
-
-    /* Initialize error handling with standard callbacks, but
-     * then override output_message (to print to ALOG) and
-     * error_exit to set a flag and print a message instead
-     * of killing the whole process */
-    cinfo.err = jpeg_std_error(&jerr);
-
-    cinfo.err->output_message = [](j_common_ptr cinfo) {
-        char buffer[JMSG_LENGTH_MAX];
-
-        /* Create the message */
-        (*cinfo->err->format_message)(cinfo, buffer);
-        ALOGE("libjpeg error: %s", buffer);
-    };
-    cinfo.err->error_exit = [](j_common_ptr cinfo) {
-        (*cinfo->err->output_message)(cinfo);
-        if(cinfo->client_data) {
-            auto & dmgr =
-                *reinterpret_cast<CustomJpegDestMgr*>(cinfo->client_data);
-            dmgr.mSuccess = false;
-        }
-    };
-    /* Now that we initialized some callbacks, let's create our compressor */
-    jpeg_create_compress(&cinfo);
-
-    /* Initialize our destination manager */
-    dmgr.mBuffer = static_cast<JOCTET*>(out);
-    dmgr.mBufferSize = maxOutSize;
-    dmgr.mEncodedSize = 0;
-    dmgr.mSuccess = true;
-    cinfo.client_data = static_cast<void*>(&dmgr);
-
-    /* These lambdas become C-style function pointers and as per C++11 spec
-     * may not capture anything */
-    dmgr.mgr.init_destination = [](j_compress_ptr cinfo) {
-        auto & dmgr = reinterpret_cast<CustomJpegDestMgr&>(*cinfo->dest);
-        dmgr.mgr.next_output_byte = dmgr.mBuffer;
-        dmgr.mgr.free_in_buffer = dmgr.mBufferSize;
-        ALOGV("%s:%d jpeg start: %p [%zu]",
-              __FUNCTION__, __LINE__, dmgr.mBuffer, dmgr.mBufferSize);
-    };
-
-    dmgr.mgr.empty_output_buffer = [](j_compress_ptr cinfo __unused) {
-        ALOGV("%s:%d Out of buffer", __FUNCTION__, __LINE__);
-        return 0;
-    };
-
-    dmgr.mgr.term_destination = [](j_compress_ptr cinfo) {
-        auto & dmgr = reinterpret_cast<CustomJpegDestMgr&>(*cinfo->dest);
-        dmgr.mEncodedSize = dmgr.mBufferSize - dmgr.mgr.free_in_buffer;
-        ALOGV("%s:%d Done with jpeg: %zu", __FUNCTION__, __LINE__, dmgr.mEncodedSize);
-    };
-    cinfo.dest = reinterpret_cast<struct jpeg_destination_mgr*>(&dmgr);
-
-    /* We are going to be using JPEG in raw data mode, so we are passing
-     * straight subsampled planar YCbCr and it will not touch our pixel
-     * data or do any scaling or anything */
-    cinfo.image_width = inSz.width;
-    cinfo.image_height = inSz.height;
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_YCbCr;
-
-    /* Initialize defaults and then override what we want */
-    jpeg_set_defaults(&cinfo);
-
-    jpeg_set_quality(&cinfo, jpegQuality, 1);
-    jpeg_set_colorspace(&cinfo, JCS_YCbCr);
-    cinfo.raw_data_in = 1;
-    cinfo.dct_method = JDCT_IFAST;
-
-    /* Configure sampling factors. The sampling factor is JPEG subsampling 420
-     * because the source format is YUV420. Note that libjpeg sampling factors
-     * are... a little weird. Sampling of Y=2,U=1,V=1 means there is 1 U and
-     * 1 V value for each 2 Y values */
-    cinfo.comp_info[0].h_samp_factor = 2;
-    cinfo.comp_info[0].v_samp_factor = 2;
-    cinfo.comp_info[1].h_samp_factor = 1;
-    cinfo.comp_info[1].v_samp_factor = 1;
-    cinfo.comp_info[2].h_samp_factor = 1;
-    cinfo.comp_info[2].v_samp_factor = 1;
-
-    /* Let's not hardcode YUV420 in 6 places... 5 was enough */
-    int maxVSampFactor = std::max( {
-        cinfo.comp_info[0].v_samp_factor,
-        cinfo.comp_info[1].v_samp_factor,
-        cinfo.comp_info[2].v_samp_factor
-    });
-    int cVSubSampling = cinfo.comp_info[0].v_samp_factor /
-                        cinfo.comp_info[1].v_samp_factor;
-
-    /* Start the compressor */
-    jpeg_start_compress(&cinfo, TRUE);
-
-    /* Compute our macroblock height, so we can pad our input to be vertically
-     * macroblock aligned.
-     * TODO: Does it need to be horizontally MCU aligned too? */
-
-    size_t mcuV = DCTSIZE*maxVSampFactor;
-    size_t paddedHeight = mcuV * ((inSz.height + mcuV - 1) / mcuV);
-
-    /* libjpeg uses arrays of row pointers, which makes it really easy to pad
-     * data vertically (unfortunately doesn't help horizontally) */
-    std::vector<JSAMPROW> yLines (paddedHeight);
-    std::vector<JSAMPROW> cbLines(paddedHeight/cVSubSampling);
-    std::vector<JSAMPROW> crLines(paddedHeight/cVSubSampling);
-
-    uint8_t *py = static_cast<uint8_t*>(inLayout.y);
-    uint8_t *pcr = static_cast<uint8_t*>(inLayout.cr);
-    uint8_t *pcb = static_cast<uint8_t*>(inLayout.cb);
-
-    for(uint32_t i = 0; i < paddedHeight; i++)
-    {
-        /* Once we are in the padding territory we still point to the last line
-         * effectively replicating it several times ~ CLAMP_TO_EDGE */
-        int li = std::min(i, inSz.height - 1);
-        yLines[i]  = static_cast<JSAMPROW>(py + li * inLayout.yStride);
-        if(i < paddedHeight / cVSubSampling)
-        {
-            crLines[i] = static_cast<JSAMPROW>(pcr + li * inLayout.cStride);
-            cbLines[i] = static_cast<JSAMPROW>(pcb + li * inLayout.cStride);
-        }
-    }
-
-    /* If APP1 data was passed in, use it */
-    if(app1Buffer && app1Size)
-    {
-        jpeg_write_marker(&cinfo, JPEG_APP0 + 1,
-             static_cast<const JOCTET*>(app1Buffer), app1Size);
-    }
-
-    /* While we still have padded height left to go, keep giving it one
-     * macroblock at a time. */
-    while (cinfo.next_scanline < cinfo.image_height) {
-        const uint32_t batchSize = DCTSIZE * maxVSampFactor;
-        const uint32_t nl = cinfo.next_scanline;
-        JSAMPARRAY planes[3]{ &yLines[nl],
-                              &cbLines[nl/cVSubSampling],
-                              &crLines[nl/cVSubSampling] };
-
-        uint32_t done = jpeg_write_raw_data(&cinfo, planes, batchSize);
-
-        if (done != batchSize) {
-            ALOGE("%s: compressed %u lines, expected %u (total %u/%u)",
-              __FUNCTION__, done, batchSize, cinfo.next_scanline,
-              cinfo.image_height);
-            return -1;
-        }
-    }
-
-    /* This will flush everything */
-    jpeg_finish_compress(&cinfo);
-
-    /* Grab the actual code size and set it */
-    actualCodeSize = dmgr.mEncodedSize;
-
-    return 0;
-}
-
 /*
  * TODO: There needs to be a mechanism to discover allocated buffer size
  * in the HAL.
@@ -1720,13 +1741,16 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     }
 
     /* Encode the thumbnail image */
+    nsecs_t encodeNs = 0;
     if (outputThumbnail) {
-        ret = encodeJpegYU12(thumbSize, yu12Thumb,
+        nsecs_t startNs = systemTime(SYSTEM_TIME_MONOTONIC);
+        ret = mJpegCodec->encodeYU12(thumbSize, yu12Thumb,
                 thumbQuality, 0, 0,
                 &thumbCode[0], maxThumbCodeSize, thumbCodeSize);
+        encodeNs += systemTime(SYSTEM_TIME_MONOTONIC) - startNs;
 
         if (ret != 0) {
-            return lfail("%s: thumbnail encodeJpegYU12 failed with %d",__FUNCTION__, ret);
+            return lfail("%s: thumbnail encodeYU12 failed with %d",__FUNCTION__, ret);
         }
     }
 
@@ -1735,14 +1759,19 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     common::V1_0::helper::CameraMetadata meta(parent->mCameraCharacteristics);
     meta.append(req->setting);
 
-    /* Generate EXIF object */
-    std::unique_ptr<ExifUtils> utils(ExifUtils::create());
-    /* Make sure it's initialized */
-    utils->initialize();
+    /* Generate EXIF object. Make and model are set once and kept as the
+     * template, only the per capture tags are set here */
+    if (mExifUtils == nullptr || !mExifUtils->restoreTemplate()) {
+        mExifUtils.reset(ExifUtils::create());
+        if (!mExifUtils->initialize() || !mExifUtils->setMake(mExifMake) ||
+                !mExifUtils->setModel(mExifModel) || !mExifUtils->saveTemplate()) {
+            mExifUtils.reset();
+            return lfail("%s: initializing EXIF failed", __FUNCTION__);
+        }
+    }
+    ExifUtils* utils = mExifUtils.get();
 
     utils->setFromMetadata(meta, jpegSize.width, jpegSize.height);
-    utils->setMake(mExifMake);
-    utils->setModel(mExifModel);
 
     ret = utils->generateApp1(outputThumbnail ? &thumbCode[0] : 0, thumbCodeSize);
 
@@ -1763,9 +1792,11 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     }
 
     /* Encode the main jpeg image */
-    ret = encodeJpegYU12(jpegSize, yu12Main,
+    nsecs_t startNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    ret = mJpegCodec->encodeYU12(jpegSize, yu12Main,
             jpegQuality, exifData, exifDataSize,
             bufPtr, maxJpegCodeSize, jpegCodeSize);
+    encodeNs += systemTime(SYSTEM_TIME_MONOTONIC) - startNs;
 
     /* TODO: Not sure this belongs here, maybe better to pass jpegCodeSize out
      * and do this when returning buffer to parent */
@@ -1785,8 +1816,9 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     /* Check if our JPEG actually succeeded */
     if (ret != 0) {
         return lfail(
-            "%s: encodeJpegYU12 failed with %d",__FUNCTION__, ret);
+            "%s: encodeYU12 failed with %d",__FUNCTION__, ret);
     }
+    recordCodecTiming(/*decode*/false, encodeNs);
 
     ALOGV("%s: encoded JPEG (ret:%d) with Q:%d max size: %zu",
           __FUNCTION__, ret, jpegQuality, maxJpegCodeSize);
@@ -1794,13 +1826,8 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     return 0;
 }
 
-bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
+bool ExternalCameraDeviceSession::OutputThread::decodeLoop() {
     std::shared_ptr<HalRequest> req;
-    auto parent = mParent.promote();
-    if (parent == nullptr) {
-       ALOGE("%s: session has been disconnected!", __FUNCTION__);
-       return false;
-    }
 
     // TODO: maybe we need to setup a sensor thread to dq/enq v4l frames
     //       regularly to prevent v4l buffer queue filled with stale buffers
@@ -1808,174 +1835,498 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
     waitForNextRequest(&req);
     if (req == nullptr) {
         // No new request, wait again
-        return true;
+        return !exitPending();
     }
 
-    auto onDeviceError = [&](auto... args) {
-        ALOGE(args...);
-        parent->notifyError(
-                req->frameNumber, /*stream*/-1, ErrorCode::ERROR_DEVICE);
+    DecodedRequest decoded;
+    decoded.req = req;
+    req->timeline.decodeStartNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    decoded.result = decodeRequest(req, &decoded);
+    req->timeline.decodeEndNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (exitPending()) {
+        // Session is closing and has already flushed, drop the request
+        releaseDecodeFrame(decoded.yu12Frame);
         signalRequestDone();
         return false;
-    };
+    }
 
+    std::unique_lock<std::mutex> lk(mRequestListLock);
+    mDecodedRequests.push_back(std::move(decoded));
+    lk.unlock();
+    mPipelineCond.notify_all();
+    return true;
+}
+
+ExternalCameraDeviceSession::OutputThread::DecodeResult
+ExternalCameraDeviceSession::OutputThread::decodeRequest(
+        const std::shared_ptr<HalRequest>& req, DecodedRequest* out) {
     if (req->frameIn->mFourcc != V4L2_PIX_FMT_MJPEG && req->frameIn->mFourcc != V4L2_PIX_FMT_Z16) {
-        return onDeviceError("%s: do not support V4L2 format %c%c%c%c", __FUNCTION__,
+        ALOGE("%s: do not support V4L2 format %c%c%c%c", __FUNCTION__,
                 req->frameIn->mFourcc & 0xFF,
                 (req->frameIn->mFourcc >> 8) & 0xFF,
                 (req->frameIn->mFourcc >> 16) & 0xFF,
                 (req->frameIn->mFourcc >> 24) & 0xFF);
+        return DecodeResult::DEVICE_ERROR;
+    }
+
+    // Wait for a free intermediate YU12 frame first, this is what bounds the
+    // number of requests decoded ahead of OutputThread. Requests decoded
+    // straight into their output buffer do not need one.
+    bool toOutput = req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG && canDecodeToOutput(req);
+    if (req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG && !toOutput) {
+        out->yu12Frame = acquireDecodeFrame();
+        if (out->yu12Frame == nullptr) {
+            ALOGE("%s: no intermediate YU12 frame available", __FUNCTION__);
+            return DecodeResult::DEVICE_ERROR;
+        }
     }
 
+    if (!acquireBufferRequestSlot()) {
+        return DecodeResult::DEVICE_ERROR;
+    }
     int res = requestBufferStart(req->buffers);
     if (res != 0) {
         ALOGE("%s: send BufferRequest failed! res %d", __FUNCTION__, res);
-        return onDeviceError("%s: failed to send buffer request!", __FUNCTION__);
+        releaseBufferRequestSlot();
+        return DecodeResult::DEVICE_ERROR;
     }
+    out->bufferRequested = true;
 
-    std::unique_lock<std::mutex> lk(mBufferLock);
     // Convert input V4L2 frame to YU12 of the same size
     // TODO: see if we can save some computation by converting to YV12 here
     uint8_t* inData;
     size_t inDataSize;
     if (req->frameIn->map(&inData, &inDataSize) != 0) {
-        lk.unlock();
-        return onDeviceError("%s: V4L2 buffer map failed", __FUNCTION__);
+        ALOGE("%s: V4L2 buffer map failed", __FUNCTION__);
+        return DecodeResult::DEVICE_ERROR;
+    }
+
+    if (toOutput) {
+        res = decodeToOutput(req->buffers[0], inData, inDataSize);
+        if (res == 0) {
+            out->decodedToOutput = true;
+            return DecodeResult::OK;
+        } else if (res != -EAGAIN) {
+            ALOGE("%s: Decode V4L2 frame to output failed! res %d", __FUNCTION__, res);
+            return DecodeResult::REQUEST_ERROR;
+        }
+        // Output buffer is not planar, go through the intermediate YU12 frame
+        out->yu12Frame = acquireDecodeFrame();
+        if (out->yu12Frame == nullptr) {
+            ALOGE("%s: no intermediate YU12 frame available", __FUNCTION__);
+            return DecodeResult::DEVICE_ERROR;
+        }
     }
 
-    // TODO: in some special case maybe we can decode jpg directly to gralloc output?
     if (req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG) {
+        sp<AllocatedFrame>& yu12Frame = out->yu12Frame;
+        YCbCrLayout yu12Layout;
+        yu12Frame->getLayout(&yu12Layout);
+
         ATRACE_BEGIN("MJPGtoI420");
-        int res = libyuv::MJPGToI420(
-            inData, inDataSize, static_cast<uint8_t*>(mYu12FrameLayout.y), mYu12FrameLayout.yStride,
-            static_cast<uint8_t*>(mYu12FrameLayout.cb), mYu12FrameLayout.cStride,
-            static_cast<uint8_t*>(mYu12FrameLayout.cr), mYu12FrameLayout.cStride,
-            mYu12Frame->mWidth, mYu12Frame->mHeight, mYu12Frame->mWidth, mYu12Frame->mHeight);
+        nsecs_t startNs = systemTime(SYSTEM_TIME_MONOTONIC);
+        res = mJpegCodec->decodeToYU12(inData, inDataSize,
+                Size{yu12Frame->mWidth, yu12Frame->mHeight}, yu12Layout);
         ATRACE_END();
 
         if (res != 0) {
             // For some webcam, the first few V4L2 frames might be malformed...
             ALOGE("%s: Convert V4L2 frame to YU12 failed! res %d", __FUNCTION__, res);
-            lk.unlock();
-            Status st = parent->processCaptureRequestError(req);
-            if (st != Status::OK) {
-                return onDeviceError("%s: failed to process capture request error!", __FUNCTION__);
-            }
-            signalRequestDone();
-            return true;
+            return DecodeResult::REQUEST_ERROR;
         }
+        recordCodecTiming(/*decode*/true, systemTime(SYSTEM_TIME_MONOTONIC) - startNs);
     }
 
-    ATRACE_BEGIN("Wait for BufferRequest done");
-    res = waitForBufferRequestDone(&req->buffers);
-    ATRACE_END();
+    return DecodeResult::OK;
+}
+
+bool ExternalCameraDeviceSession::OutputThread::canDecodeToOutput(
+        const std::shared_ptr<HalRequest>& req) {
+    // A single YUV output of the V4L2 frame size needs no crop or scale, so
+    // the decoder can write it directly instead of going through mYu12Frame.
+    // Buffers requested from the framework (device@3.5) are not available yet.
+    if (req->buffers.size() != 1) {
+        return false;
+    }
+    const HalStreamBuffer& halBuf = req->buffers[0];
+    if (halBuf.bufPtr == nullptr || *(halBuf.bufPtr) == nullptr) {
+        return false;
+    }
+    if (halBuf.format != PixelFormat::YCBCR_420_888 && halBuf.format != PixelFormat::YV12) {
+        return false;
+    }
+    return halBuf.width == req->frameIn->mWidth && halBuf.height == req->frameIn->mHeight;
+}
+
+int ExternalCameraDeviceSession::OutputThread::decodeToOutput(
+        HalStreamBuffer& halBuf, const uint8_t* inData, size_t inDataSize) {
+    ATRACE_CALL();
+    const int kSyncWaitTimeoutMs = 500;
+    if (halBuf.acquireFence >= 0) {
+        if (sync_wait(halBuf.acquireFence, kSyncWaitTimeoutMs)) {
+            // Returned as an error buffer by processCaptureResult
+            halBuf.fenceTimeout = true;
+            return 0;
+        }
+        ::close(halBuf.acquireFence);
+        halBuf.acquireFence = -1;
+    }
+
+    IMapper::Rect outRect {0, 0,
+            static_cast<int32_t>(halBuf.width),
+            static_cast<int32_t>(halBuf.height)};
+    YCbCrLayout outLayout = sHandleImporter.lockYCbCr(
+            *(halBuf.bufPtr), halBuf.usage, outRect);
+    if (outLayout.y == nullptr) {
+        ALOGE("%s: lock output buffer failed", __FUNCTION__);
+        return -EAGAIN;
+    }
+
+    int ret = -EAGAIN;
+    uint32_t outputFourcc = getFourCcFromLayout(outLayout);
+    if (outputFourcc == V4L2_PIX_FMT_YUV420 || outputFourcc == V4L2_PIX_FMT_YVU420) {
+        ATRACE_BEGIN("MJPGtoOutput");
+        nsecs_t startNs = systemTime(SYSTEM_TIME_MONOTONIC);
+        ret = mJpegCodec->decodeToYU12(inData, inDataSize,
+                Size{halBuf.width, halBuf.height}, outLayout);
+        ATRACE_END();
+        if (ret == 0) {
+            recordCodecTiming(/*decode*/true, systemTime(SYSTEM_TIME_MONOTONIC) - startNs);
+        } else if (ret == -EAGAIN) {
+            ret = -EIO;
+        }
+    }
+
+    int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+    if (relFence >= 0) {
+        halBuf.acquireFence = relFence;
+    }
+    return ret;
+}
+
+sp<AllocatedFrame> ExternalCameraDeviceSession::OutputThread::acquireDecodeFrame() {
+    std::unique_lock<std::mutex> lk(mRequestListLock);
+    std::chrono::milliseconds timeout = std::chrono::milliseconds(kReqWaitTimeoutMs);
+    int waitTimes = 0;
+    while (mFreeYu12Frames.empty()) {
+        if (exitPending() || ++waitTimes > kReqWaitTimesMax) {
+            return nullptr;
+        }
+        mPipelineCond.wait_for(lk, timeout);
+    }
+    sp<AllocatedFrame> frame = mFreeYu12Frames.back();
+    mFreeYu12Frames.pop_back();
+    return frame;
+}
+
+void ExternalCameraDeviceSession::OutputThread::releaseDecodeFrame(sp<AllocatedFrame>& frame) {
+    if (frame == nullptr) {
+        return;
+    }
+    std::unique_lock<std::mutex> lk(mRequestListLock);
+    // Frames allocated before the last stream configuration are dropped
+    if (frame->mWidth == mYu12FrameSize.width && frame->mHeight == mYu12FrameSize.height) {
+        mFreeYu12Frames.push_back(frame);
+    }
+    frame.clear();
+    lk.unlock();
+    mPipelineCond.notify_all();
+}
+
+bool ExternalCameraDeviceSession::OutputThread::acquireBufferRequestSlot() {
+    std::unique_lock<std::mutex> lk(mRequestListLock);
+    std::chrono::milliseconds timeout = std::chrono::milliseconds(kReqWaitTimeoutMs);
+    int waitTimes = 0;
+    while (mBufferRequestPending) {
+        if (exitPending() || ++waitTimes > kReqWaitTimesMax) {
+            ALOGE("%s: wait for previous buffer request timeout!", __FUNCTION__);
+            return false;
+        }
+        mPipelineCond.wait_for(lk, timeout);
+    }
+    mBufferRequestPending = true;
+    return true;
+}
+
+void ExternalCameraDeviceSession::OutputThread::releaseBufferRequestSlot() {
+    std::unique_lock<std::mutex> lk(mRequestListLock);
+    mBufferRequestPending = false;
+    lk.unlock();
+    mPipelineCond.notify_all();
+}
+
+bool ExternalCameraDeviceSession::OutputThread::waitForDecodedRequest(DecodedRequest* out) {
+    ATRACE_CALL();
+    std::unique_lock<std::mutex> lk(mRequestListLock);
+    std::chrono::milliseconds timeout = std::chrono::milliseconds(kReqWaitTimeoutMs);
+    while (mDecodedRequests.empty()) {
+        if (exitPending()) {
+            return false;
+        }
+        if (mPipelineCond.wait_for(lk, timeout) == std::cv_status::timeout) {
+            return false;
+        }
+    }
+    *out = std::move(mDecodedRequests.front());
+    mDecodedRequests.pop_front();
+    mProcessingRequest = true;
+    mProcessingFrameNumer = out->req->frameNumber;
+    return true;
+}
+
+bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
+    auto parent = mParent.promote();
+    if (parent == nullptr) {
+       ALOGE("%s: session has been disconnected!", __FUNCTION__);
+       return false;
+    }
+
+    DecodedRequest decoded;
+    if (!waitForDecodedRequest(&decoded)) {
+        // No decoded request, wait again
+        return true;
+    }
+    std::shared_ptr<HalRequest>& req = decoded.req;
+    req->timeline.outputStartNs = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    auto onDeviceError = [&](auto... args) {
+        ALOGE(args...);
+        releaseDecodeFrame(decoded.yu12Frame);
+        parent->notifyError(
+                req->frameNumber, /*stream*/-1, ErrorCode::ERROR_DEVICE);
+        signalRequestDone();
+        return false;
+    };
+
+    int res = 0;
+    if (decoded.bufferRequested) {
+        ATRACE_BEGIN("Wait for BufferRequest done");
+        res = waitForBufferRequestDone(&req->buffers);
+        ATRACE_END();
+        releaseBufferRequestSlot();
+    }
+
+    if (decoded.result == DecodeResult::DEVICE_ERROR) {
+        return onDeviceError("%s: failed to decode request %d", __FUNCTION__, req->frameNumber);
+    }
 
     if (res != 0) {
         ALOGE("%s: wait for BufferRequest done failed! res %d", __FUNCTION__, res);
-        lk.unlock();
         return onDeviceError("%s: failed to process buffer request error!", __FUNCTION__);
     }
 
+    if (decoded.result == DecodeResult::REQUEST_ERROR) {
+        releaseDecodeFrame(decoded.yu12Frame);
+        Status st = parent->processCaptureRequestError(req);
+        if (st != Status::OK) {
+            return onDeviceError("%s: failed to process capture request error!", __FUNCTION__);
+        }
+        signalRequestDone();
+        return true;
+    }
+
+    uint8_t* inData;
+    size_t inDataSize;
+    if (req->frameIn->map(&inData, &inDataSize) != 0) {
+        return onDeviceError("%s: V4L2 buffer map failed", __FUNCTION__);
+    }
+
     ALOGV("%s processing new request", __FUNCTION__);
-    const int kSyncWaitTimeoutMs = 500;
-    for (auto& halBuf : req->buffers) {
-        if (*(halBuf.bufPtr) == nullptr) {
-            ALOGW("%s: buffer for stream %d missing", __FUNCTION__, halBuf.streamId);
-            halBuf.fenceTimeout = true;
-        } else if (halBuf.acquireFence >= 0) {
-            int ret = sync_wait(halBuf.acquireFence, kSyncWaitTimeoutMs);
-            if (ret) {
+    // With decodedToOutput the only output buffer is already written and
+    // unlocked by decodeToOutput
+    std::vector<OutputTask> tasks;
+    if (!decoded.decodedToOutput) {
+        // Wait for the output buffers before taking mBufferLock, which is only
+        // needed to fill them
+        const int kSyncWaitTimeoutMs = 500;
+        for (auto& halBuf : req->buffers) {
+            if (*(halBuf.bufPtr) == nullptr) {
+                ALOGW("%s: buffer for stream %d missing", __FUNCTION__, halBuf.streamId);
                 halBuf.fenceTimeout = true;
-            } else {
-                ::close(halBuf.acquireFence);
-                halBuf.acquireFence = -1;
+            } else if (halBuf.acquireFence >= 0) {
+                int ret = sync_wait(halBuf.acquireFence, kSyncWaitTimeoutMs);
+                if (ret) {
+                    halBuf.fenceTimeout = true;
+                } else {
+                    ::close(halBuf.acquireFence);
+                    halBuf.acquireFence = -1;
+                }
             }
         }
+        tasks = groupOutputBuffers(req->buffers);
+    }
+
+    std::unique_lock<std::mutex> lk(mBufferLock);
+    mYu12Frame = decoded.yu12Frame;
+
+    if (tasks.size() > 1 && mOutputWorkers != nullptr) {
+        ATRACE_BEGIN("fillOutputBuffersParallel");
+        std::vector<std::function<void()>> functions;
+        for (auto& task : tasks) {
+            functions.push_back([&, taskPtr = &task] {
+                runOutputTaskLocked(taskPtr, req, inData, inDataSize);
+            });
+        }
+        mOutputWorkers->run(functions);
+        ATRACE_END();
+    } else {
+        for (auto& task : tasks) {
+            runOutputTaskLocked(&task, req, inData, inDataSize);
+        }
+    }
+    mScaledYu12Frames.clear();
+    mYu12Frame.clear();
+
+    // Don't hold the lock while calling back to parent
+    lk.unlock();
+
+    for (const auto& task : tasks) {
+        req->timeline.convertNs += task.convertNs;
+        req->timeline.jpegNs += task.jpegNs;
+    }
+    for (const auto& task : tasks) {
+        if (task.result != 0) {
+            return onDeviceError("%s: failed to fill the %dx%d output buffers of request %d: %d",
+                    __FUNCTION__, task.size.width, task.size.height, req->frameNumber,
+                    task.result);
+        }
+    }
+    releaseDecodeFrame(decoded.yu12Frame);
+    Status st = parent->processCaptureResult(req);
+    if (st != Status::OK) {
+        return onDeviceError("%s: failed to process capture result!", __FUNCTION__);
+    }
+    signalRequestDone();
+    return true;
+}
 
+std::vector<ExternalCameraDeviceSession::OutputThread::OutputTask>
+ExternalCameraDeviceSession::OutputThread::groupOutputBuffers(
+        std::vector<HalStreamBuffer>& buffers) {
+    // JPEG outputs also share the thumbnail frame and the EXIF template, so
+    // a request with several of them is filled by a single task
+    size_t blobCount = std::count_if(buffers.begin(), buffers.end(),
+            [](const HalStreamBuffer& buf) { return buf.format == PixelFormat::BLOB; });
+
+    std::vector<OutputTask> tasks;
+    for (auto& halBuf : buffers) {
         if (halBuf.fenceTimeout) {
             continue;
         }
+        Size sz {halBuf.width, halBuf.height};
+        auto it = std::find_if(tasks.begin(), tasks.end(), [&](const OutputTask& task) {
+            return blobCount > 1 || task.size == sz;
+        });
+        if (it == tasks.end()) {
+            it = tasks.insert(tasks.end(), OutputTask{});
+            it->size = sz;
+        }
+        it->buffers.push_back(&halBuf);
+    }
+    return tasks;
+}
 
-        // Gralloc lockYCbCr the buffer
-        switch (halBuf.format) {
-            case PixelFormat::BLOB: {
-                int ret = createJpegLocked(halBuf, req);
+void ExternalCameraDeviceSession::OutputThread::runOutputTaskLocked(
+        OutputTask* task, const std::shared_ptr<HalRequest>& req,
+        const uint8_t* inData, size_t inDataSize) {
+    for (HalStreamBuffer* halBuf : task->buffers) {
+        task->result = fillOutputBufferLocked(*halBuf, req, inData, inDataSize, task);
+        if (task->result != 0) {
+            return;
+        }
+    }
+}
 
-                if(ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: createJpegLocked failed with %d",
-                          __FUNCTION__, ret);
-                }
-            } break;
-            case PixelFormat::Y16: {
-                void* outLayout = sHandleImporter.lock(*(halBuf.bufPtr), halBuf.usage, inDataSize);
+int ExternalCameraDeviceSession::OutputThread::fillOutputBufferLocked(
+        HalStreamBuffer& halBuf, const std::shared_ptr<HalRequest>& req,
+        const uint8_t* inData, size_t inDataSize, OutputTask* task) {
+    // Gralloc lockYCbCr the buffer
+    switch (halBuf.format) {
+        case PixelFormat::BLOB: {
+            nsecs_t startNs = systemTime(SYSTEM_TIME_MONOTONIC);
+            int ret = createJpegLocked(halBuf, req);
+            task->jpegNs += systemTime(SYSTEM_TIME_MONOTONIC) - startNs;
 
-                std::memcpy(outLayout, inData, inDataSize);
+            if(ret != 0) {
+                ALOGE("%s: createJpegLocked failed with %d", __FUNCTION__, ret);
+                return ret;
+            }
+        } break;
+        case PixelFormat::Y16: {
+            void* outLayout = sHandleImporter.lock(*(halBuf.bufPtr), halBuf.usage, inDataSize);
 
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
-                if (relFence >= 0) {
-                    halBuf.acquireFence = relFence;
-                }
-            } break;
-            case PixelFormat::YCBCR_420_888:
-            case PixelFormat::YV12: {
-                IMapper::Rect outRect {0, 0,
-                        static_cast<int32_t>(halBuf.width),
-                        static_cast<int32_t>(halBuf.height)};
-                YCbCrLayout outLayout = sHandleImporter.lockYCbCr(
-                        *(halBuf.bufPtr), halBuf.usage, outRect);
-                ALOGV("%s: outLayout y %p cb %p cr %p y_str %d c_str %d c_step %d",
-                        __FUNCTION__, outLayout.y, outLayout.cb, outLayout.cr,
-                        outLayout.yStride, outLayout.cStride, outLayout.chromaStep);
-
-                // Convert to output buffer size/format
-                uint32_t outputFourcc = getFourCcFromLayout(outLayout);
-                ALOGV("%s: converting to format %c%c%c%c", __FUNCTION__,
-                        outputFourcc & 0xFF,
-                        (outputFourcc >> 8) & 0xFF,
-                        (outputFourcc >> 16) & 0xFF,
-                        (outputFourcc >> 24) & 0xFF);
+            std::memcpy(outLayout, inData, inDataSize);
 
+            int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+            if (relFence >= 0) {
+                halBuf.acquireFence = relFence;
+            }
+        } break;
+        case PixelFormat::YCBCR_420_888:
+        case PixelFormat::YV12: {
+            IMapper::Rect outRect {0, 0,
+                    static_cast<int32_t>(halBuf.width),
+                    static_cast<int32_t>(halBuf.height)};
+            YCbCrLayout outLayout = sHandleImporter.lockYCbCr(
+                    *(halBuf.bufPtr), halBuf.usage, outRect);
+            ALOGV("%s: outLayout y %p cb %p cr %p y_str %d c_str %d c_step %d",
+                    __FUNCTION__, outLayout.y, outLayout.cb, outLayout.cr,
+                    outLayout.yStride, outLayout.cStride, outLayout.chromaStep);
+
+            // Convert to output buffer size/format
+            uint32_t outputFourcc = getFourCcFromLayout(outLayout);
+            ALOGV("%s: converting to format %c%c%c%c", __FUNCTION__,
+                    outputFourcc & 0xFF,
+                    (outputFourcc >> 8) & 0xFF,
+                    (outputFourcc >> 16) & 0xFF,
+                    (outputFourcc >> 24) & 0xFF);
+
+            nsecs_t startNs = systemTime(SYSTEM_TIME_MONOTONIC);
+            Size sz {halBuf.width, halBuf.height};
+            int ret;
+            bool scaled;
+            {
+                std::lock_guard<std::mutex> scaledLk(mScaledFramesLock);
+                scaled = mScaledYu12Frames.find(sz) != mScaledYu12Frames.end();
+            }
+            if (outputFourcc != FLEX_YUV_GENERIC && !scaled) {
+                ATRACE_BEGIN("cropScaleConvertLocked");
+                ret = cropScaleConvertLocked(mYu12Frame, sz, outLayout, outputFourcc);
+                ATRACE_END();
+                if (ret != 0) {
+                    ALOGE("%s: crop/scale/convert failed!", __FUNCTION__);
+                    return ret;
+                }
+            } else {
                 YCbCrLayout cropAndScaled;
                 ATRACE_BEGIN("cropAndScaleLocked");
-                int ret = cropAndScaleLocked(
-                        mYu12Frame,
-                        Size { halBuf.width, halBuf.height },
-                        &cropAndScaled);
+                ret = cropAndScaleLocked(mYu12Frame, sz, &cropAndScaled);
                 ATRACE_END();
                 if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: crop and scale failed!", __FUNCTION__);
+                    ALOGE("%s: crop and scale failed!", __FUNCTION__);
+                    return ret;
                 }
 
-                Size sz {halBuf.width, halBuf.height};
                 ATRACE_BEGIN("formatConvertLocked");
                 ret = formatConvertLocked(cropAndScaled, outLayout, sz, outputFourcc);
                 ATRACE_END();
                 if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: format coversion failed!", __FUNCTION__);
+                    ALOGE("%s: format coversion failed!", __FUNCTION__);
+                    return ret;
                 }
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
-                if (relFence >= 0) {
-                    halBuf.acquireFence = relFence;
-                }
-            } break;
-            default:
-                lk.unlock();
-                return onDeviceError("%s: unknown output format %x", __FUNCTION__, halBuf.format);
-        }
-    } // for each buffer
-    mScaledYu12Frames.clear();
-
-    // Don't hold the lock while calling back to parent
-    lk.unlock();
-    Status st = parent->processCaptureResult(req);
-    if (st != Status::OK) {
-        return onDeviceError("%s: failed to process capture result!", __FUNCTION__);
+            }
+            task->convertNs += systemTime(SYSTEM_TIME_MONOTONIC) - startNs;
+            int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+            if (relFence >= 0) {
+                halBuf.acquireFence = relFence;
+            }
+        } break;
+        default:
+            ALOGE("%s: unknown output format %x", __FUNCTION__, halBuf.format);
+            return -EINVAL;
     }
-    signalRequestDone();
-    return true;
+    return 0;
+
 }
 
 Status ExternalCameraDeviceSession::OutputThread::allocateIntermediateBuffers(
@@ -1989,15 +2340,22 @@ Status ExternalCameraDeviceSession::OutputThread::allocateIntermediateBuffers(
         return Status::INTERNAL_ERROR;
     }
 
-    // Allocating intermediate YU12 frame
-    if (mYu12Frame == nullptr || mYu12Frame->mWidth != v4lSize.width ||
-            mYu12Frame->mHeight != v4lSize.height) {
-        mYu12Frame.clear();
-        mYu12Frame = new AllocatedFrame(v4lSize.width, v4lSize.height);
-        int ret = mYu12Frame->allocate(&mYu12FrameLayout);
-        if (ret != 0) {
-            ALOGE("%s: allocating YU12 frame failed!", __FUNCTION__);
-            return Status::INTERNAL_ERROR;
+    // Allocating intermediate YU12 frames, one for each request in the decode
+    // pipeline plus the one being output
+    {
+        std::lock_guard<std::mutex> reqLk(mRequestListLock);
+        if (!(mYu12FrameSize == v4lSize)) {
+            mFreeYu12Frames.clear();
+            mYu12FrameSize = v4lSize;
+        }
+        while (mFreeYu12Frames.size() < kDecodeQueueDepth + 1) {
+            sp<AllocatedFrame> frame = new AllocatedFrame(v4lSize.width, v4lSize.height);
+            int ret = frame->allocate();
+            if (ret != 0) {
+                ALOGE("%s: allocating YU12 frame failed!", __FUNCTION__);
+                return Status::INTERNAL_ERROR;
+            }
+            mFreeYu12Frames.push_back(frame);
         }
     }
 
@@ -2075,10 +2433,12 @@ void ExternalCameraDeviceSession::OutputThread::flush() {
     std::unique_lock<std::mutex> lk(mRequestListLock);
     std::list<std::shared_ptr<HalRequest>> reqs = std::move(mRequestList);
     mRequestList.clear();
-    if (mProcessingRequest) {
+    if (mInflightRequests > 0) {
+        // Requests already taken by the decode pipeline are finished normally
         std::chrono::seconds timeout = std::chrono::seconds(kFlushWaitTimeoutSec);
-        auto st = mRequestDoneCond.wait_for(lk, timeout);
-        if (st == std::cv_status::timeout) {
+        bool done = mRequestDoneCond.wait_for(lk, timeout,
+                [this] { return mInflightRequests == 0; });
+        if (!done) {
             ALOGE("%s: wait for inflight request finish timeout!", __FUNCTION__);
         }
     }
@@ -2116,16 +2476,16 @@ void ExternalCameraDeviceSession::OutputThread::waitForNextRequest(
     }
     *out = mRequestList.front();
     mRequestList.pop_front();
-    mProcessingRequest = true;
-    mProcessingFrameNumer = (*out)->frameNumber;
+    mInflightRequests++;
 }
 
 void ExternalCameraDeviceSession::OutputThread::signalRequestDone() {
     std::unique_lock<std::mutex> lk(mRequestListLock);
+    mInflightRequests--;
     mProcessingRequest = false;
     mProcessingFrameNumer = 0;
     lk.unlock();
-    mRequestDoneCond.notify_one();
+    mRequestDoneCond.notify_all();
 }
 
 void ExternalCameraDeviceSession::OutputThread::dump(int fd) {
@@ -2135,11 +2495,22 @@ void ExternalCameraDeviceSession::OutputThread::dump(int fd) {
     } else {
         dprintf(fd, "OutputThread not processing any frames\n");
     }
+    dprintf(fd, "OutputThread decoded frames: ");
+    for (const auto& decoded : mDecodedRequests) {
+        dprintf(fd, "%d, ", decoded.req->frameNumber);
+    }
+    dprintf(fd, "\n");
     dprintf(fd, "OutputThread request list contains frame: ");
     for (const auto& req : mRequestList) {
         dprintf(fd, "%d, ", req->frameNumber);
     }
     dprintf(fd, "\n");
+    dprintf(fd, "OutputThread output workers: %s\n", mOutputWorkers ? "enabled" : "disabled");
+
+    std::lock_guard<std::mutex> timingLock(mCodecTimingLock);
+    dprintf(fd, "OutputThread JPEG codec: %s\n", mJpegCodec->getName());
+    dumpCodecTiming(fd, "decode", mDecodeTiming);
+    dumpCodecTiming(fd, "encode", mEncodeTiming);
 }
 
 void ExternalCameraDeviceSession::cleanupBuffersLocked(int id) {
@@ -2234,6 +2605,8 @@ int ExternalCameraDeviceSession::v4l2StreamOffLocked() {
         return OK;
     }
 
+    stopV4l2CaptureThreadLocked();
+
     {
         std::lock_guard<std::mutex> lk(mV4l2BufferLock);
         if (mNumDequeuedV4l2Buffers != 0)  {
@@ -2390,6 +2763,17 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(
 
     uint32_t v4lBufferCount = (fps >= kDefaultFps) ?
             mCfg.numVideoBuffers : mCfg.numStillBuffers;
+    if (mCfg.v4l2CaptureThread) {
+        // Frames are dequeued ahead of requests, so make room for a full pipeline
+        uint32_t pipelineDepth = 4;
+        camera_metadata_ro_entry entry =
+                mCameraCharacteristics.find(ANDROID_REQUEST_PIPELINE_MAX_DEPTH);
+        if (entry.count > 0) {
+            pipelineDepth = entry.data.u8[0];
+        }
+        v4lBufferCount = std::max(v4lBufferCount,
+                pipelineDepth + kV4l2CaptureThreadSpareBuffers);
+    }
     // VIDIOC_REQBUFS: create buffers
     v4l2_requestbuffers req_buffers{};
     req_buffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -2465,9 +2849,90 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(
                 __FUNCTION__, v4l2Fmt.width, v4l2Fmt.height, fps);
     mV4l2StreamingFmt = v4l2Fmt;
     mV4l2Streaming = true;
+    if (mCfg.v4l2CaptureThread) {
+        startV4l2CaptureThreadLocked();
+    }
     return OK;
 }
 
+void ExternalCameraDeviceSession::startV4l2CaptureThreadLocked() {
+    mV4l2CaptureThread = new V4l2CaptureThread(this);
+    status_t ret = mV4l2CaptureThread->run("ExtCamCapture", PRIORITY_DISPLAY);
+    if (ret != OK) {
+        ALOGE("%s: cannot start capture thread: %d, dequeue on request thread instead",
+                __FUNCTION__, ret);
+        mV4l2CaptureThread.clear();
+    }
+}
+
+void ExternalCameraDeviceSession::stopV4l2CaptureThreadLocked() {
+    if (mV4l2CaptureThread == nullptr) {
+        return;
+    }
+    mV4l2CaptureThread->requestExit();
+    mV4L2BufferReturned.notify_all();
+    mV4l2CaptureThread->join();
+    mV4l2CaptureThread.clear();
+
+    std::deque<ReadyV4l2Frame> readyFrames;
+    {
+        std::lock_guard<std::mutex> lk(mV4l2BufferLock);
+        readyFrames.swap(mReadyV4l2Frames);
+    }
+    for (auto& ready : readyFrames) {
+        enqueueV4l2Frame(ready.frame);
+    }
+}
+
+bool ExternalCameraDeviceSession::v4l2CaptureLoop() {
+    {
+        std::unique_lock<std::mutex> lk(mV4l2BufferLock);
+        if (mNumDequeuedV4l2Buffers >= mV4L2BufferCount) {
+            // Every buffer is ready or held by a request
+            mV4L2BufferReturned.wait_for(lk,
+                    std::chrono::milliseconds(kV4l2CapturePollTimeoutMs));
+            return true;
+        }
+    }
+
+    // Poll so that requestExit() is noticed while the camera is not producing frames
+    struct pollfd pfd = {.fd = mV4l2Fd.get(), .events = POLLIN};
+    int ret = TEMP_FAILURE_RETRY(poll(&pfd, 1, kV4l2CapturePollTimeoutMs));
+    if (ret == 0) {
+        return true;
+    }
+    if (ret < 0 || !(pfd.revents & POLLIN)) {
+        ALOGE("%s: poll failed: ret %d revents 0x%x: %s", __FUNCTION__, ret, pfd.revents,
+                strerror(errno));
+        usleep(kV4l2CapturePollTimeoutMs * 1000);
+        return true;
+    }
+
+    nsecs_t shutterTs = 0;
+    sp<V4L2Frame> frame = dequeueV4l2Buffer(&shutterTs);
+    if (frame == nullptr) {
+        usleep(kV4l2CapturePollTimeoutMs * 1000);
+        return true;
+    }
+
+    std::vector<sp<V4L2Frame>> recycledFrames;
+    {
+        std::lock_guard<std::mutex> lk(mV4l2BufferLock);
+        mReadyV4l2Frames.push_back({frame, shutterTs});
+        // Keep a buffer queued in the driver so the camera never runs dry: give
+        // the oldest ready frame back rather than dropping the coming ones
+        while (mNumDequeuedV4l2Buffers >= mV4L2BufferCount && mReadyV4l2Frames.size() > 1) {
+            recycledFrames.push_back(mReadyV4l2Frames.front().frame);
+            mReadyV4l2Frames.pop_front();
+        }
+    }
+    mV4L2FrameReady.notify_one();
+    for (auto& recycled : recycledFrames) {
+        enqueueV4l2Frame(recycled);
+    }
+    return true;
+}
+
 sp<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(/*out*/nsecs_t* shutterTs) {
     ATRACE_CALL();
     sp<V4L2Frame> ret = nullptr;
@@ -2477,6 +2942,20 @@ sp<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(/*out*/nsecs_t
         return ret;
     }
 
+    if (mV4l2CaptureThread != nullptr) {
+        std::unique_lock<std::mutex> lk(mV4l2BufferLock);
+        if (mReadyV4l2Frames.empty()) {
+            int waitRet = waitForV4L2FrameReadyLocked(lk);
+            if (waitRet != 0) {
+                return ret;
+            }
+        }
+        ret = mReadyV4l2Frames.front().frame;
+        *shutterTs = mReadyV4l2Frames.front().shutterTs;
+        mReadyV4l2Frames.pop_front();
+        return ret;
+    }
+
     {
         std::unique_lock<std::mutex> lk(mV4l2BufferLock);
         if (mNumDequeuedV4l2Buffers == mV4L2BufferCount) {
@@ -2487,6 +2966,11 @@ sp<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(/*out*/nsecs_t
         }
     }
 
+    return dequeueV4l2Buffer(shutterTs);
+}
+
+sp<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2Buffer(/*out*/nsecs_t* shutterTs) {
+    sp<V4L2Frame> ret = nullptr;
     ATRACE_BEGIN("VIDIOC_DQBUF");
     v4l2_buffer buffer{};
     buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -2550,7 +3034,7 @@ void ExternalCameraDeviceSession::enqueueV4l2Frame(const sp<V4L2Frame>& frame) {
         std::lock_guard<std::mutex> lk(mV4l2BufferLock);
         mNumDequeuedV4l2Buffers--;
     }
-    mV4L2BufferReturned.notify_one();
+    mV4L2BufferReturned.notify_all();
 }
 
 Status ExternalCameraDeviceSession::isStreamCombinationSupported(
@@ -2774,6 +3258,11 @@ Status ExternalCameraDeviceSession::configureStreams(
         }
     }
 
+    if (buildResultTemplate() != OK) {
+        ALOGE("%s: building result template failed!", __FUNCTION__);
+        return Status::INTERNAL_ERROR;
+    }
+
     mFirstRequest = true;
     return Status::OK;
 }
@@ -2914,8 +3403,9 @@ status_t ExternalCameraDeviceSession::initDefaultRequests() {
     return OK;
 }
 
-status_t ExternalCameraDeviceSession::fillCaptureResult(
-        common::V1_0::helper::CameraMetadata &md, nsecs_t timestamp) {
+status_t ExternalCameraDeviceSession::buildResultTemplate() {
+    common::V1_0::helper::CameraMetadata md;
+
     // android.control
     // For USB camera, we don't know the AE state. Set the state to converged to
     // indicate the frame should be good to use. Then apps don't have to wait the
@@ -2926,29 +3416,8 @@ status_t ExternalCameraDeviceSession::fillCaptureResult(
     const uint8_t ae_lock = ANDROID_CONTROL_AE_LOCK_OFF;
     UPDATE(md, ANDROID_CONTROL_AE_LOCK, &ae_lock, 1);
 
-    bool afTrigger = false;
-    {
-        std::lock_guard<std::mutex> lk(mAfTriggerLock);
-        afTrigger = mAfTrigger;
-        if (md.exists(ANDROID_CONTROL_AF_TRIGGER)) {
-            camera_metadata_entry entry = md.find(ANDROID_CONTROL_AF_TRIGGER);
-            if (entry.data.u8[0] == ANDROID_CONTROL_AF_TRIGGER_START) {
-                mAfTrigger = afTrigger = true;
-            } else if (entry.data.u8[0] == ANDROID_CONTROL_AF_TRIGGER_CANCEL) {
-                mAfTrigger = afTrigger = false;
-            }
-        }
-    }
-
-    // For USB camera, the USB camera handles everything and we don't have control
-    // over AF. We only simply fake the AF metadata based on the request
-    // received here.
-    uint8_t afState;
-    if (afTrigger) {
-        afState = ANDROID_CONTROL_AF_STATE_FOCUSED_LOCKED;
-    } else {
-        afState = ANDROID_CONTROL_AF_STATE_INACTIVE;
-    }
+    // Patched per frame by fillCaptureResult
+    const uint8_t afState = ANDROID_CONTROL_AF_STATE_INACTIVE;
     UPDATE(md, ANDROID_CONTROL_AF_STATE, &afState, 1);
 
     // Set AWB state to converged to indicate the frame should be good to use.
@@ -2981,6 +3450,8 @@ status_t ExternalCameraDeviceSession::fillCaptureResult(
     UPDATE(md, ANDROID_SCALER_CROP_REGION, crop_region, ARRAY_SIZE(crop_region));
 
     // android.sensor
+    // Patched per frame by fillCaptureResult
+    const int64_t timestamp = 0;
     UPDATE(md, ANDROID_SENSOR_TIMESTAMP, &timestamp, 1);
 
     // android.statistics
@@ -2990,6 +3461,66 @@ status_t ExternalCameraDeviceSession::fillCaptureResult(
     const uint8_t sceneFlicker = ANDROID_STATISTICS_SCENE_FLICKER_NONE;
     UPDATE(md, ANDROID_STATISTICS_SCENE_FLICKER, &sceneFlicker, 1);
 
+    mResultTemplateEntries.clear();
+    const camera_metadata_t* rawTemplate = md.getAndLock();
+    size_t count = get_camera_metadata_entry_count(rawTemplate);
+    mResultTemplateEntries.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        get_camera_metadata_ro_entry(rawTemplate, i, &mResultTemplateEntries[i]);
+    }
+    md.unlock(rawTemplate);
+    // Takes over the buffer the entries point into
+    mResultTemplate.acquire(md);
+    return OK;
+}
+
+status_t ExternalCameraDeviceSession::fillCaptureResult(
+        common::V1_0::helper::CameraMetadata &md, nsecs_t timestamp) {
+    if (mResultTemplateEntries.empty()) {
+        ALOGE("%s: result template is not built!", __FUNCTION__);
+        return -EINVAL;
+    }
+
+    bool afTrigger = false;
+    {
+        std::lock_guard<std::mutex> lk(mAfTriggerLock);
+        afTrigger = mAfTrigger;
+        if (md.exists(ANDROID_CONTROL_AF_TRIGGER)) {
+            camera_metadata_entry entry = md.find(ANDROID_CONTROL_AF_TRIGGER);
+            if (entry.data.u8[0] == ANDROID_CONTROL_AF_TRIGGER_START) {
+                mAfTrigger = afTrigger = true;
+            } else if (entry.data.u8[0] == ANDROID_CONTROL_AF_TRIGGER_CANCEL) {
+                mAfTrigger = afTrigger = false;
+            }
+        }
+    }
+
+    // Copy all static result tags at once, growing the settings buffer at
+    // most once, then patch the per frame values in place
+    if (md.updateMany(mResultTemplateEntries.data(), mResultTemplateEntries.size()) != OK) {
+        ALOGE("%s: applying result template failed!", __FUNCTION__);
+        return BAD_VALUE;
+    }
+
+    // For USB camera, the USB camera handles everything and we don't have control
+    // over AF. We only simply fake the AF metadata based on the request
+    // received here.
+    camera_metadata_entry afState = md.find(ANDROID_CONTROL_AF_STATE);
+    if (afState.count != 1) {
+        ALOGE("%s: cannot find AF state!", __FUNCTION__);
+        return BAD_VALUE;
+    }
+    afState.data.u8[0] = afTrigger ?
+            ANDROID_CONTROL_AF_STATE_FOCUSED_LOCKED : ANDROID_CONTROL_AF_STATE_INACTIVE;
+
+    // android.sensor
+    camera_metadata_entry sensorTimestamp = md.find(ANDROID_SENSOR_TIMESTAMP);
+    if (sensorTimestamp.count != 1) {
+        ALOGE("%s: cannot find sensor timestamp!", __FUNCTION__);
+        return BAD_VALUE;
+    }
+    sensorTimestamp.data.i64[0] = timestamp;
+
     return OK;
 }
 
@@ -17,8 +17,19 @@
 //#define LOG_NDEBUG 0
 #include <log/log.h>
 
+#include <algorithm>
 #include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <inttypes.h>
+#include <limits.h>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <linux/videodev2.h>
 #include "ExternalCameraUtils.h"
 
@@ -146,10 +157,322 @@ bool isAspectRatioClose(float ar1, float ar2) {
     return (std::abs(ar1 - ar2) < kAspectRatioMatchThres);
 }
 
+void RequestTimelineLog::record(const RequestTimeline& timeline) {
+    std::lock_guard<std::mutex> lk(mLock);
+    if (mTimelines.size() < kMaxTimelines) {
+        mTimelines.push_back(timeline);
+    } else {
+        mTimelines[mNextIndex] = timeline;
+    }
+    mNextIndex = (mNextIndex + 1) % kMaxTimelines;
+    mNumRecorded++;
+}
+
+void RequestTimelineLog::dumpStage(int fd, const char* name, std::vector<nsecs_t>& durations) {
+    if (durations.empty()) {
+        return;
+    }
+    std::sort(durations.begin(), durations.end());
+    auto percentile = [&durations](size_t p) {
+        return durations[(durations.size() - 1) * p / 100] / 1e6;
+    };
+    dprintf(fd, "  %-18s p50 %7.2f ms, p90 %7.2f ms, p99 %7.2f ms, max %7.2f ms (%zu)\n",
+            name, percentile(50), percentile(90), percentile(99), durations.back() / 1e6,
+            durations.size());
+}
+
+void RequestTimelineLog::dump(int fd) const {
+    std::vector<RequestTimeline> timelines;
+    uint64_t numRecorded;
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        timelines = mTimelines;
+        numRecorded = mNumRecorded;
+    }
+    dprintf(fd, "Request latency of the last %zu of %" PRIu64 " requests:\n",
+            timelines.size(), numRecorded);
+    if (timelines.empty()) {
+        return;
+    }
+
+    auto interval = [](nsecs_t start, nsecs_t end) {
+        return (start != 0 && end >= start) ? end - start : 0;
+    };
+    enum { QUEUE, DECODE, WAIT, CONVERT, JPEG, OUTPUT, TOTAL, CAPTURE_TO_RESULT, NUM_STAGES };
+    const char* kStageNames[NUM_STAGES] = {
+            "queued for decode", "decode", "wait for output", "convert", "jpeg",
+            "output", "dequeue to result", "capture to result" };
+    std::vector<nsecs_t> durations[NUM_STAGES];
+    for (const auto& t : timelines) {
+        nsecs_t stage[NUM_STAGES] = {
+                interval(t.dequeueNs, t.decodeStartNs),
+                interval(t.decodeStartNs, t.decodeEndNs),
+                interval(t.decodeEndNs, t.outputStartNs),
+                t.convertNs,
+                t.jpegNs,
+                interval(t.outputStartNs, t.resultNs),
+                interval(t.dequeueNs, t.resultNs),
+                interval(t.captureNs, t.resultNs) };
+        for (int i = 0; i < NUM_STAGES; i++) {
+            if (stage[i] > 0) {
+                durations[i].push_back(stage[i]);
+            }
+        }
+    }
+    for (int i = 0; i < NUM_STAGES; i++) {
+        dumpStage(fd, kStageNames[i], durations[i]);
+    }
+}
+
+namespace {
+
+// Bump when the cache file layout or the enumeration logic changes.
+const char* kFormatCacheVersion = "2";
+
+bool readSysfsLine(const std::string& path, std::string* value) {
+    std::ifstream in(path);
+    return static_cast<bool>(std::getline(in, *value)) && !value->empty();
+}
+
+void writeFpsLimits(std::ostringstream& out, const char* name,
+        const std::vector<external::common::ExternalCameraConfig::FpsLimitation>& limits) {
+    for (const auto& limit : limits) {
+        out << " " << name << limit.size.width << "x" << limit.size.height << "@"
+            << limit.fpsUpperBound;
+    }
+}
+
+} // anonymous namespace
+
+const char* ExternalCameraFormatCache::kCacheDir = "/data/vendor/camera/external_formats";
+
+ExternalCameraFormatCache& ExternalCameraFormatCache::getInstance() {
+    static ExternalCameraFormatCache* sInstance = new ExternalCameraFormatCache();
+    return *sInstance;
+}
+
+std::string ExternalCameraFormatCache::getDeviceKey(const std::string& devName) {
+    const std::string node = devName.substr(devName.find_last_of('/') + 1);
+    const std::string classPath = "/sys/class/video4linux/" + node;
+
+    // The device link points at the USB interface; the ids live in the USB device above it.
+    char interfacePath[PATH_MAX];
+    if (realpath((classPath + "/device").c_str(), interfacePath) == nullptr) {
+        return "";
+    }
+    const std::string usbPath = std::string(interfacePath) + "/..";
+    std::string vid, pid, rev, speed, index;
+    if (!readSysfsLine(usbPath + "/idVendor", &vid) ||
+            !readSysfsLine(usbPath + "/idProduct", &pid) ||
+            !readSysfsLine(usbPath + "/bcdDevice", &rev)) {
+        return "";
+    }
+    // A camera behind a slower link may offer fewer sizes or frame rates.
+    if (!readSysfsLine(usbPath + "/speed", &speed)) {
+        speed = "0";
+    }
+    std::string interface = "0";
+    readSysfsLine(std::string(interfacePath) + "/bInterfaceNumber", &interface);
+    if (!readSysfsLine(classPath + "/index", &index)) {
+        index = "0";
+    }
+    return vid + "_" + pid + "_" + rev + "_" + speed + "M_if" + interface + "_" + index;
+}
+
+std::string ExternalCameraFormatCache::getConfigSignature(
+        const external::common::ExternalCameraConfig& cfg) {
+    std::ostringstream out;
+    out << "v" << kFormatCacheVersion << " min" << cfg.minStreamSize.width << "x"
+        << cfg.minStreamSize.height << " depth" << cfg.depthEnabled;
+    writeFpsLimits(out, "fps", cfg.fpsLimits);
+    writeFpsLimits(out, "depthfps", cfg.depthFpsLimits);
+    return out.str();
+}
+
+std::string ExternalCameraFormatCache::getCachePath(const std::string& key) {
+    return std::string(kCacheDir) + "/" + key;
+}
+
+bool ExternalCameraFormatCache::readEntry(const std::string& key, Entry* entry) {
+    std::ifstream in(getCachePath(key));
+    if (!in) {
+        return false;
+    }
+    int croppingType;
+    size_t numFormats;
+    if (!std::getline(in, entry->cfgSignature) || !(in >> croppingType >> numFormats) ||
+            (croppingType != HORIZONTAL && croppingType != VERTICAL)) {
+        ALOGW("%s: ignoring corrupted format cache for %s", __FUNCTION__, key.c_str());
+        return false;
+    }
+    entry->croppingType = static_cast<CroppingType>(croppingType);
+    entry->formats.clear();
+    for (size_t i = 0; i < numFormats; i++) {
+        SupportedV4L2Format format;
+        size_t numFrameRates;
+        if (!(in >> format.fourcc >> format.width >> format.height >> numFrameRates)) {
+            break;
+        }
+        for (size_t j = 0; j < numFrameRates; j++) {
+            SupportedV4L2Format::FrameRate fr;
+            if (!(in >> fr.durationNumerator >> fr.durationDenominator) ||
+                    fr.durationNumerator == 0) {
+                break;
+            }
+            format.frameRates.push_back(fr);
+        }
+        if (format.frameRates.size() != numFrameRates) {
+            break;
+        }
+        entry->formats.push_back(format);
+    }
+    if (entry->formats.size() != numFormats || entry->formats.empty()) {
+        ALOGW("%s: ignoring corrupted format cache for %s", __FUNCTION__, key.c_str());
+        return false;
+    }
+    return true;
+}
+
+void ExternalCameraFormatCache::writeEntry(const std::string& key, const Entry& entry) {
+    if (mkdir(kCacheDir, 0770) != 0 && errno != EEXIST) {
+        ALOGW("%s: cannot create %s: %s", __FUNCTION__, kCacheDir, strerror(errno));
+        return;
+    }
+    // Write a temporary file and rename it, so a reader never sees a partial entry.
+    const std::string path = getCachePath(key);
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::trunc);
+        out << entry.cfgSignature << "\n" << entry.croppingType << " " << entry.formats.size()
+            << "\n";
+        for (const auto& format : entry.formats) {
+            out << format.fourcc << " " << format.width << " " << format.height << " "
+                << format.frameRates.size();
+            for (const auto& fr : format.frameRates) {
+                out << " " << fr.durationNumerator << " " << fr.durationDenominator;
+            }
+            out << "\n";
+        }
+        if (!out.flush()) {
+            ALOGW("%s: cannot write %s", __FUNCTION__, tmpPath.c_str());
+            unlink(tmpPath.c_str());
+            return;
+        }
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        ALOGW("%s: cannot rename %s: %s", __FUNCTION__, tmpPath.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+    }
+}
+
+bool ExternalCameraFormatCache::lookup(const std::string& key,
+        const external::common::ExternalCameraConfig& cfg,
+        std::vector<SupportedV4L2Format>* formats, CroppingType* croppingType) {
+    if (key.empty()) {
+        return false;
+    }
+    const std::string signature = getConfigSignature(cfg);
+    std::lock_guard<std::mutex> lk(mLock);
+    auto it = mEntries.find(key);
+    if (it == mEntries.end()) {
+        Entry entry;
+        if (!readEntry(key, &entry)) {
+            return false;
+        }
+        it = mEntries.emplace(key, std::move(entry)).first;
+    }
+    if (it->second.cfgSignature != signature) {
+        ALOGI("%s: format cache for %s was built with another config", __FUNCTION__,
+                key.c_str());
+        return false;
+    }
+    *formats = it->second.formats;
+    *croppingType = it->second.croppingType;
+    return true;
+}
+
+void ExternalCameraFormatCache::store(const std::string& key,
+        const external::common::ExternalCameraConfig& cfg,
+        const std::vector<SupportedV4L2Format>& formats, CroppingType croppingType) {
+    if (key.empty() || formats.empty()) {
+        return;
+    }
+    Entry entry{getConfigSignature(cfg), croppingType, formats};
+    std::lock_guard<std::mutex> lk(mLock);
+    writeEntry(key, entry);
+    mEntries[key] = std::move(entry);
+}
+
+void ExternalCameraFormatCache::invalidate(const std::string& key) {
+    if (key.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lk(mLock);
+    mEntries.erase(key);
+    if (unlink(getCachePath(key).c_str()) != 0 && errno != ENOENT) {
+        ALOGW("%s: cannot remove format cache for %s: %s", __FUNCTION__, key.c_str(),
+                strerror(errno));
+    }
+}
+
 double SupportedV4L2Format::FrameRate::getDouble() const {
     return durationDenominator / static_cast<double>(durationNumerator);
 }
 
+OutputWorkerPool::OutputWorkerPool(size_t workerCount) {
+    for (size_t i = 0; i < workerCount; i++) {
+        mThreads.emplace_back(&OutputWorkerPool::workerLoop, this);
+    }
+}
+
+OutputWorkerPool::~OutputWorkerPool() {
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        mExiting = true;
+    }
+    mTaskCond.notify_all();
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void OutputWorkerPool::run(const std::vector<std::function<void()>>& tasks) {
+    std::unique_lock<std::mutex> lk(mLock);
+    mTasks = &tasks;
+    mNextTask = 0;
+    mPendingTasks = tasks.size();
+    mTaskCond.notify_all();
+
+    runTasksLocked(lk);
+    mDoneCond.wait(lk, [this] { return mPendingTasks == 0; });
+    mTasks = nullptr;
+}
+
+void OutputWorkerPool::workerLoop() {
+    std::unique_lock<std::mutex> lk(mLock);
+    while (true) {
+        mTaskCond.wait(lk, [this] {
+            return mExiting || (mTasks != nullptr && mNextTask < mTasks->size());
+        });
+        if (mExiting) {
+            return;
+        }
+        runTasksLocked(lk);
+    }
+}
+
+void OutputWorkerPool::runTasksLocked(std::unique_lock<std::mutex>& lk) {
+    while (mTasks != nullptr && mNextTask < mTasks->size()) {
+        const std::function<void()>& task = (*mTasks)[mNextTask++];
+        lk.unlock();
+        task();
+        lk.lock();
+        if (--mPendingTasks == 0) {
+            mDoneCond.notify_all();
+        }
+    }
+}
+
 }  // namespace implementation
 }  // namespace V3_4
 }  // namespace device
@@ -284,10 +607,42 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
         ret.orientation = orientation->IntAttribute("degree", /*Default*/kDefaultOrientation);
     }
 
+    XMLElement *jpegCodec = deviceCfg->FirstChildElement("JpegCodec");
+    if (jpegCodec == nullptr) {
+        ALOGI("%s: no jpeg codec specified, using software codec", __FUNCTION__);
+    } else {
+        const char* type = jpegCodec->Attribute("type");
+        if (type != nullptr && strcmp(type, "v4l2m2m") == 0) {
+            ret.jpegCodecType = JpegCodecType::V4L2_M2M;
+            const char* decoderNode = jpegCodec->Attribute("decoder");
+            const char* encoderNode = jpegCodec->Attribute("encoder");
+            ret.jpegDecoderNode = decoderNode != nullptr ? decoderNode : "";
+            ret.jpegEncoderNode = encoderNode != nullptr ? encoderNode : "";
+        } else if (type != nullptr && strcmp(type, "software") != 0) {
+            ALOGW("%s: unknown jpeg codec type %s, using software codec", __FUNCTION__, type);
+        }
+    }
+
+    XMLElement *captureThread = deviceCfg->FirstChildElement("V4l2CaptureThread");
+    if (captureThread == nullptr) {
+        ALOGI("%s: no v4l2 capture thread setting specified", __FUNCTION__);
+    } else {
+        ret.v4l2CaptureThread = captureThread->BoolAttribute("enabled", false);
+    }
+
+    XMLElement *outputWorkers = deviceCfg->FirstChildElement("OutputWorkers");
+    if (outputWorkers == nullptr) {
+        ALOGI("%s: no output workers specified", __FUNCTION__);
+    } else {
+        ret.outputWorkerCount = outputWorkers->UnsignedAttribute("count", 0);
+    }
+
     ALOGI("%s: external camera cfg loaded: maxJpgBufSize %d,"
             " num video buffers %d, num still buffers %d, orientation %d",
             __FUNCTION__, ret.maxJpegBufSize,
             ret.numVideoBuffers, ret.numStillBuffers, ret.orientation);
+    ALOGI("%s: v4l2 capture thread %s, %u output workers", __FUNCTION__,
+            ret.v4l2CaptureThread ? "enabled" : "disabled", ret.outputWorkerCount);
     for (const auto& limit : ret.fpsLimits) {
         ALOGI("%s: fpsLimitList: %dx%d@%f", __FUNCTION__,
                 limit.size.width, limit.size.height, limit.fpsUpperBound);
@@ -298,6 +653,10 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
     }
     ALOGI("%s: minStreamSize: %dx%d" , __FUNCTION__,
          ret.minStreamSize.width, ret.minStreamSize.height);
+    if (ret.jpegCodecType == JpegCodecType::V4L2_M2M) {
+        ALOGI("%s: jpeg codec: v4l2m2m, decoder '%s', encoder '%s'", __FUNCTION__,
+                ret.jpegDecoderNode.c_str(), ret.jpegEncoderNode.c_str());
+    }
     return ret;
 }
 
@@ -334,7 +693,10 @@ ExternalCameraConfig::ExternalCameraConfig() :
         numVideoBuffers(kDefaultNumVideoBuffer),
         numStillBuffers(kDefaultNumStillBuffer),
         depthEnabled(false),
-        orientation(kDefaultOrientation) {
+        orientation(kDefaultOrientation),
+        jpegCodecType(JpegCodecType::SOFTWARE),
+        v4l2CaptureThread(false),
+        outputWorkerCount(0) {
     fpsLimits.push_back({/*Size*/{ 640,  480}, /*FPS upper bound*/30.0});
     fpsLimits.push_back({/*Size*/{1280,  720}, /*FPS upper bound*/7.5});
     fpsLimits.push_back({/*Size*/{1920, 1080}, /*FPS upper bound*/5.0});
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_CAMERA_DEVICE_V3_4_EXTCAMCODEC_H
+#define ANDROID_HARDWARE_CAMERA_DEVICE_V3_4_EXTCAMCODEC_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "android-base/unique_fd.h"
+#include "ExternalCameraUtils.h"
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace V3_4 {
+namespace implementation {
+
+using ::android::base::unique_fd;
+using ::android::hardware::camera::external::common::ExternalCameraConfig;
+using ::android::hardware::camera::external::common::Size;
+
+// JPEG codec used by the external camera HAL to decode MJPEG V4L2 frames into
+// YU12 intermediate buffers and to encode YU12 images into BLOB outputs.
+// decodeToYU12 is called from the decode thread and encodeYU12 from the output
+// thread, so implementations must allow one decode and one encode in parallel.
+class JpegCodec {
+public:
+    // Create the codec selected by cfg. Always returns a usable codec: the
+    // software codec is used when the selected one is not available.
+    static std::unique_ptr<JpegCodec> create(const ExternalCameraConfig& cfg);
+
+    virtual ~JpegCodec() {}
+
+    virtual const char* getName() const = 0;
+
+    // Decode inData into out, a YU12 buffer of size sz. Return 0 on success.
+    virtual int decodeToYU12(const uint8_t* inData, size_t inDataSize,
+            const Size& sz, const YCbCrLayout& out) = 0;
+
+    // Encode the YU12 image in inLayout. If app1Buffer is not null, it is
+    // written as the APP1 (EXIF) segment. Return 0 on success.
+    virtual int encodeYU12(const Size& inSz, const YCbCrLayout& inLayout,
+            int jpegQuality, const void* app1Buffer, size_t app1Size,
+            void* out, size_t maxOutSize, size_t& actualCodeSize) = 0;
+};
+
+// libyuv decoder and libjpeg encoder
+class SoftwareJpegCodec : public JpegCodec {
+public:
+    virtual const char* getName() const override { return "software"; }
+
+    virtual int decodeToYU12(const uint8_t* inData, size_t inDataSize,
+            const Size& sz, const YCbCrLayout& out) override;
+
+    virtual int encodeYU12(const Size& inSz, const YCbCrLayout& inLayout,
+            int jpegQuality, const void* app1Buffer, size_t app1Size,
+            void* out, size_t maxOutSize, size_t& actualCodeSize) override;
+};
+
+// Codec backed by V4L2 memory-to-memory JPEG decoder and encoder nodes. A
+// direction whose node cannot be opened, or a frame the hardware fails to
+// process, is handled by the software codec instead.
+class V4L2M2MJpegCodec : public JpegCodec {
+public:
+    V4L2M2MJpegCodec(const std::string& decoderNode, const std::string& encoderNode);
+
+    virtual const char* getName() const override { return "v4l2m2m"; }
+
+    virtual int decodeToYU12(const uint8_t* inData, size_t inDataSize,
+            const Size& sz, const YCbCrLayout& out) override;
+
+    virtual int encodeYU12(const Size& inSz, const YCbCrLayout& inLayout,
+            int jpegQuality, const void* app1Buffer, size_t app1Size,
+            void* out, size_t maxOutSize, size_t& actualCodeSize) override;
+
+private:
+    struct MappedBuffer {
+        void* data = nullptr;
+        size_t length = 0;
+    };
+
+    // One M2M node with a single mmap buffer on each of its queues. The
+    // queues are reconfigured whenever the image size changes.
+    class M2MDevice {
+    public:
+        M2MDevice(const std::string& node, uint32_t outputFourcc, uint32_t captureFourcc);
+        ~M2MDevice();
+
+        bool isValid() const { return mFd.get() >= 0; }
+        const std::string& getNode() const { return mNode; }
+
+        // Process one frame. inSize is the largest input the caller will
+        // submit for sz and is used to size the OUTPUT buffer. fillInput
+        // writes the input into the OUTPUT buffer and returns the number of
+        // bytes used; readCapture consumes the processed CAPTURE buffer.
+        template <typename FillFn, typename ReadFn>
+        int process(const Size& sz, size_t inSize, size_t captureSize,
+                FillFn fillInput, ReadFn readCapture);
+
+        // Bytes per line of the YU12 plane on the given queue, valid after
+        // configure() succeeded
+        uint32_t getBytesPerLine(bool capture) const {
+            return capture ? mCaptureBytesPerLine : mOutputBytesPerLine;
+        }
+
+        int setQuality(int jpegQuality);
+
+    private:
+        int configure(const Size& sz, size_t inSize, size_t captureSize);
+        void reset();
+        bool supportsFormat(uint32_t type, uint32_t fourcc);
+        int setFormat(uint32_t type, uint32_t fourcc, const Size& sz, size_t size,
+                /*out*/uint32_t* bytesPerLine);
+        int allocateBuffer(uint32_t type, /*out*/MappedBuffer* buf);
+        int queueBuffer(uint32_t type, size_t bytesUsed);
+        int dequeueBuffer(uint32_t type, /*out*/size_t* bytesUsed);
+
+        const std::string mNode;
+        const uint32_t mOutputFourcc;
+        const uint32_t mCaptureFourcc;
+        unique_fd mFd;
+        uint32_t mOutputType = 0;
+        uint32_t mCaptureType = 0;
+        // Sizes the driver refused to configure, handled by the software codec
+        std::vector<Size> mUnsupportedSizes;
+
+        bool mConfigured = false;
+        Size mSize = {0, 0};
+        size_t mInSize = 0;
+        size_t mCaptureSize = 0;
+        int mQuality = -1;
+        uint32_t mOutputBytesPerLine = 0;
+        uint32_t mCaptureBytesPerLine = 0;
+        MappedBuffer mOutputBuffer;
+        MappedBuffer mCaptureBuffer;
+    };
+
+    static const int kProcessTimeoutMs = 1000;
+
+    std::mutex mDecoderLock; // Protect mDecoder
+    std::unique_ptr<M2MDevice> mDecoder;
+    std::mutex mEncoderLock; // Protect mEncoder
+    std::unique_ptr<M2MDevice> mEncoder;
+    SoftwareJpegCodec mFallback;
+};
+
+}  // namespace implementation
+}  // namespace V3_4
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_CAMERA_DEVICE_V3_4_EXTCAMCODEC_H
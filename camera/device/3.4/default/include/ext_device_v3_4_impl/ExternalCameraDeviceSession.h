@@ -25,9 +25,11 @@
 #include <include/convert.h>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <list>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include "CameraMetadata.h"
 #include "HandleImporter.h"
 #include "Exif.h"
@@ -35,6 +37,7 @@
 #include "utils/Mutex.h"
 #include "utils/Thread.h"
 #include "android-base/unique_fd.h"
+#include "ExternalCameraCodec.h"
 #include "ExternalCameraUtils.h"
 
 namespace android {
@@ -168,6 +171,7 @@ protected:
         sp<V4L2Frame> frameIn;
         nsecs_t shutterTs;
         std::vector<HalStreamBuffer> buffers;
+        RequestTimeline timeline;
     };
 
     static const uint64_t BUFFER_ID_NO_BUFFER = 0;
@@ -183,6 +187,7 @@ protected:
 
     Status initStatus() const;
     status_t initDefaultRequests();
+    status_t buildResultTemplate();
     status_t fillCaptureResult(common::V1_0::helper::CameraMetadata& md, nsecs_t timestamp);
     Status configureStreams(const V3_2::StreamConfiguration&,
             V3_3::HalStreamConfiguration* out,
@@ -251,6 +256,27 @@ protected:
 
     int waitForV4L2BufferReturnLocked(std::unique_lock<std::mutex>& lk);
 
+    // With mCfg.v4l2CaptureThread set, V4l2CaptureThread dequeues V4L2 frames as
+    // the camera produces them into mReadyV4l2Frames, and dequeueV4l2FrameLocked
+    // takes the oldest ready frame instead of blocking in VIDIOC_DQBUF. The
+    // thread only runs while streaming and never acquires mLock; the streaming
+    // state it reads is only changed after stopV4l2CaptureThreadLocked().
+    class V4l2CaptureThread : public android::Thread {
+    public:
+        explicit V4l2CaptureThread(ExternalCameraDeviceSession* parent) : mParent(parent) {}
+        virtual bool threadLoop() override { return mParent->v4l2CaptureLoop(); }
+    private:
+        ExternalCameraDeviceSession* const mParent;
+    };
+    bool v4l2CaptureLoop();
+    // Falls back to dequeueing on the request thread if the thread cannot start
+    void startV4l2CaptureThreadLocked();
+    // Also returns the ready frames to the driver
+    void stopV4l2CaptureThreadLocked();
+    int waitForV4L2FrameReadyLocked(std::unique_lock<std::mutex>& lk);
+    // VIDIOC_DQBUF one frame. Does not need mLock.
+    sp<V4L2Frame> dequeueV4l2Buffer(/*out*/nsecs_t* shutterTs);
+
     class OutputThread : public android::Thread {
     public:
         OutputThread(wp<ExternalCameraDeviceSession> parent, CroppingType);
@@ -263,9 +289,15 @@ protected:
         Status submitRequest(const std::shared_ptr<HalRequest>&);
         void flush();
         void dump(int fd);
+        virtual status_t readyToRun() override;
         virtual bool threadLoop() override;
+        virtual void requestExit() override;
 
         void setExifMakeModel(const std::string& make, const std::string& model);
+        void setJpegCodec(std::unique_ptr<JpegCodec> codec);
+        // Number of threads, besides this one, filling the output buffers of
+        // a request in parallel. Must be set before the thread runs.
+        void setOutputWorkerCount(size_t count);
 
     protected:
         // Methods to request output buffer in parallel
@@ -285,6 +317,46 @@ protected:
         static const int kFlushWaitTimeoutSec = 3; // 3 sec
         static const int kReqWaitTimeoutMs = 33;   // 33ms
         static const int kReqWaitTimesMax = 90;    // 33ms * 90 ~= 3 sec
+        // Number of requests that can be decoded ahead of the one being output
+        static const size_t kDecodeQueueDepth = 2;
+
+        // The V4L2 frame of a request is decoded on DecodeThread, so the decode of
+        // request N+1 overlaps the crop/scale/convert/JPEG stage of request N on
+        // OutputThread. Both stages handle requests in submission order, so capture
+        // results are still sent in frameNumber order.
+        class DecodeThread : public android::Thread {
+        public:
+            explicit DecodeThread(OutputThread* output) : mOutput(output) {}
+            virtual bool threadLoop() override { return mOutput->decodeLoop(); }
+        private:
+            OutputThread* const mOutput;
+        };
+
+        enum class DecodeResult {
+            OK,
+            REQUEST_ERROR, // the V4L2 frame is malformed, fail this request only
+            DEVICE_ERROR,
+        };
+
+        struct DecodedRequest {
+            std::shared_ptr<HalRequest> req;
+            sp<AllocatedFrame> yu12Frame; // nullptr if the request has no decoded frame
+            bool bufferRequested = false;
+            // The V4L2 frame was decoded straight into the only output buffer
+            bool decodedToOutput = false;
+            DecodeResult result = DecodeResult::OK;
+        };
+
+        bool decodeLoop();
+        DecodeResult decodeRequest(const std::shared_ptr<HalRequest>& req,
+                DecodedRequest* out);
+        static bool canDecodeToOutput(const std::shared_ptr<HalRequest>& req);
+        int decodeToOutput(HalStreamBuffer& halBuf, const uint8_t* inData, size_t inDataSize);
+        sp<AllocatedFrame> acquireDecodeFrame();
+        void releaseDecodeFrame(sp<AllocatedFrame>& frame);
+        bool acquireBufferRequestSlot();
+        void releaseBufferRequestSlot();
+        bool waitForDecodedRequest(DecodedRequest* out);
 
         void waitForNextRequest(std::shared_ptr<HalRequest>* out);
         void signalRequestDone();
@@ -300,40 +372,99 @@ protected:
         int formatConvertLocked(const YCbCrLayout& in, const YCbCrLayout& out,
                 Size sz, uint32_t format);
 
-        static int encodeJpegYU12(const Size &inSz,
-                const YCbCrLayout& inLayout, int jpegQuality,
-                const void *app1Buffer, size_t app1Size,
-                void *out, size_t maxOutSize,
-                size_t &actualCodeSize);
+        // Crop and scale the input frame and write it into the output buffer
+        // layout in one step, without going through a scaled YU12 frame.
+        // format must not be FLEX_YUV_GENERIC.
+        int cropScaleConvertLocked(sp<AllocatedFrame>& in, const Size& outSize,
+                const YCbCrLayout& out, uint32_t format);
+
+        // Per-frame time spent in the JPEG codec
+        struct CodecTiming {
+            uint64_t frameCount = 0;
+            nsecs_t lastNs = 0;
+            nsecs_t totalNs = 0;
+            nsecs_t maxNs = 0;
+
+            void record(nsecs_t durationNs) {
+                frameCount++;
+                lastNs = durationNs;
+                totalNs += durationNs;
+                maxNs = std::max(maxNs, durationNs);
+            }
+        };
+
+        void recordCodecTiming(bool decode, nsecs_t durationNs);
+        static void dumpCodecTiming(int fd, const char* name, const CodecTiming& timing);
 
         int createJpegLocked(HalStreamBuffer &halBuf, const std::shared_ptr<HalRequest>& req);
 
+        // The output buffers of a request filled by one task. Buffers of the same size
+        // share the intermediate buffers of that size, so they are filled by the same
+        // task, one after another.
+        struct OutputTask {
+            Size size;
+            std::vector<HalStreamBuffer*> buffers;
+            nsecs_t convertNs = 0;
+            nsecs_t jpegNs = 0;
+            int result = 0;
+        };
+
+        static std::vector<OutputTask> groupOutputBuffers(std::vector<HalStreamBuffer>& buffers);
+        void runOutputTaskLocked(OutputTask* task, const std::shared_ptr<HalRequest>& req,
+                const uint8_t* inData, size_t inDataSize);
+        int fillOutputBufferLocked(HalStreamBuffer& halBuf, const std::shared_ptr<HalRequest>& req,
+                const uint8_t* inData, size_t inDataSize, OutputTask* task);
+
         const wp<ExternalCameraDeviceSession> mParent;
         const CroppingType mCroppingType;
 
         mutable std::mutex mRequestListLock;      // Protect acccess to mRequestList,
-                                                  // mProcessingRequest and mProcessingFrameNumer
+                                                  // mInflightRequests, mProcessingRequest,
+                                                  // mProcessingFrameNumer and the decode
+                                                  // pipeline state below
         std::condition_variable mRequestCond;     // signaled when a new request is submitted
         std::condition_variable mRequestDoneCond; // signaled when a request is done processing
+        std::condition_variable mPipelineCond;    // signaled when the decode pipeline changes
         std::list<std::shared_ptr<HalRequest>> mRequestList;
-        bool mProcessingRequest = false;
+        // Requests taken from mRequestList that are not done processing yet
+        size_t mInflightRequests = 0;
+        bool mProcessingRequest = false; // OutputThread is processing a decoded request
         uint32_t mProcessingFrameNumer = 0;
 
+        sp<DecodeThread> mDecodeThread;
+        std::list<DecodedRequest> mDecodedRequests;
+        std::vector<sp<AllocatedFrame>> mFreeYu12Frames;
+        Size mYu12FrameSize = {0, 0};
+        // device@3.5 buffer requests support one request at a time
+        bool mBufferRequestPending = false;
+
         // V4L2 frameIn
-        // (MJPG decode)-> mYu12Frame
+        // (MJPG decode on DecodeThread)-> mFreeYu12Frames entry
         // (Scale)-> mScaledYu12Frames
         // (Format convert) -> output gralloc frames
         mutable std::mutex mBufferLock; // Protect access to intermediate buffers
-        sp<AllocatedFrame> mYu12Frame;
+        sp<AllocatedFrame> mYu12Frame;  // decoded frame of the request being output
         sp<AllocatedFrame> mYu12ThumbFrame;
         std::unordered_map<Size, sp<AllocatedFrame>, SizeHasher> mIntermediateBuffers;
+        // Output tasks of a request run concurrently under mBufferLock held by
+        // OutputThread, each one using the intermediate buffers of its own size
+        std::unique_ptr<OutputWorkerPool> mOutputWorkers; // nullptr: tasks run on OutputThread
+        std::mutex mScaledFramesLock; // Protect mScaledYu12Frames while output tasks run
         std::unordered_map<Size, sp<AllocatedFrame>, SizeHasher> mScaledYu12Frames;
-        YCbCrLayout mYu12FrameLayout;
         YCbCrLayout mYu12ThumbFrameLayout;
         uint32_t mBlobBufferSize = 0; // 0 -> HAL derive buffer size, else: use given size
 
         std::string mExifMake;
         std::string mExifModel;
+        // Reused by every JPEG capture with make and model saved as its template
+        std::unique_ptr<ExifUtils> mExifUtils;
+
+        // Set before the thread runs, then used by DecodeThread (decode) and
+        // OutputThread (encode)
+        std::unique_ptr<JpegCodec> mJpegCodec;
+        std::mutex mCodecTimingLock; // Protect mDecodeTiming and mEncodeTiming
+        CodecTiming mDecodeTiming;
+        CodecTiming mEncodeTiming;
     };
 
     // Protect (most of) HIDL interface methods from synchronized-entering
@@ -369,12 +500,29 @@ protected:
     static const int kBufferWaitTimeoutSec = 3; // TODO: handle long exposure (or not allowing)
     std::mutex mV4l2BufferLock; // protect the buffer count and condition below
     std::condition_variable mV4L2BufferReturned;
+    // Includes the frames in mReadyV4l2Frames
     size_t mNumDequeuedV4l2Buffers = 0;
     uint32_t mMaxV4L2BufferSize = 0;
 
+    // Used with mCfg.v4l2CaptureThread only
+    // Besides the pipeline depth, one buffer stays queued in the driver and one
+    // is being dequeued
+    static const uint32_t kV4l2CaptureThreadSpareBuffers = 2;
+    static const int kV4l2CapturePollTimeoutMs = 100;
+    sp<V4l2CaptureThread> mV4l2CaptureThread;
+    struct ReadyV4l2Frame {
+        sp<V4L2Frame> frame;
+        nsecs_t shutterTs;
+    };
+    std::deque<ReadyV4l2Frame> mReadyV4l2Frames; // protected by mV4l2BufferLock
+    std::condition_variable mV4L2FrameReady;
+
     // Not protected by mLock (but might be used when mLock is locked)
     sp<OutputThread> mOutputThread;
 
+    // Completed request timelines, for dumpState
+    RequestTimelineLog mRequestTimelines;
+
     // Stream ID -> Camera3Stream cache
     std::unordered_map<int, Stream> mStreamMap;
 
@@ -395,6 +543,14 @@ protected:
     std::mutex mAfTriggerLock; // protect mAfTrigger
     bool mAfTrigger = false;
 
+    // Result tags that do not depend on the request, built by configureStreams
+    // and applied to every result in one batched update. Only read by
+    // fillCaptureResult, which cannot run concurrently with configureStreams
+    // since the latter requires no frames in flight.
+    // mResultTemplateEntries point into mResultTemplate's buffer.
+    common::V1_0::helper::CameraMetadata mResultTemplate;
+    std::vector<camera_metadata_ro_entry> mResultTemplateEntries;
+
     static HandleImporter sHandleImporter;
 
     /* Beginning of members not changed after initialize() */
@@ -101,6 +101,9 @@ protected:
 
     // Init supported w/h/format/fps in mSupportedFormats. Caller still owns fd
     void initSupportedFormatsLocked(int fd);
+    // Checks that the device still offers every format and size taken from
+    // ExternalCameraFormatCache. Caller still owns fd
+    bool cachedFormatsMatchDeviceLocked(int fd) const;
 
     // Calls into virtual member function. Do not use it in constructor
     status_t initCameraCharacteristics();
@@ -152,6 +155,10 @@ protected:
     const ExternalCameraConfig& mCfg;
     std::vector<SupportedV4L2Format> mSupportedFormats;
     CroppingType mCroppingType;
+    // Set while mSupportedFormats come from ExternalCameraFormatCache and have not been checked
+    // against the device yet
+    std::string mFormatCacheKey;
+    bool mFormatsFromCache = false;
 
     wp<ExternalCameraDeviceSession> mSession = nullptr;
 
@@ -19,11 +19,17 @@
 
 #include <android/hardware/graphics/mapper/2.0/IMapper.h>
 #include <inttypes.h>
+#include <condition_variable>
+#include <functional>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include "tinyxml2.h"  // XML parsing
 #include "utils/LightRefBase.h"
+#include "utils/Timers.h"
 
 using android::hardware::graphics::mapper::V2_0::IMapper;
 using android::hardware::graphics::mapper::V2_0::YCbCrLayout;
@@ -88,6 +94,28 @@ struct ExternalCameraConfig {
     // The value of android.sensor.orientation
     int32_t orientation;
 
+    // JPEG codec used to decode MJPEG frames and encode JPEG outputs
+    enum class JpegCodecType {
+        SOFTWARE,
+        V4L2_M2M,
+    };
+    JpegCodecType jpegCodecType;
+
+    // V4L2 memory-to-memory JPEG decoder/encoder nodes used by V4L2_M2M.
+    // An empty node means that direction uses the software codec.
+    std::string jpegDecoderNode;
+    std::string jpegEncoderNode;
+
+    // Dequeue V4L2 frames on a dedicated capture thread as soon as the camera
+    // produces them, instead of on the request thread. The V4L2 buffer queue
+    // is then sized to at least the pipeline depth plus spare buffers.
+    bool v4l2CaptureThread;
+
+    // Number of threads, besides the output thread, filling the output buffers
+    // of a request in parallel. 0 fills them one after another on the output
+    // thread.
+    uint32_t outputWorkerCount;
+
 private:
     ExternalCameraConfig();
     static bool updateFpsList(tinyxml2::XMLElement* fpsList, std::vector<FpsLimitation>& fpsLimits);
@@ -152,6 +180,35 @@ private:
     std::vector<uint8_t> mData;
 };
 
+// Monotonic timestamps of one capture request going through the external camera
+// pipeline. A zero timestamp or duration means the stage did not run.
+struct RequestTimeline {
+    nsecs_t captureNs = 0;     // V4L2 frame timestamp (shutter)
+    nsecs_t dequeueNs = 0;     // V4L2 frame assigned to the request
+    nsecs_t decodeStartNs = 0;
+    nsecs_t decodeEndNs = 0;
+    nsecs_t outputStartNs = 0; // OutputThread started filling the output buffers
+    nsecs_t convertNs = 0;     // crop/scale/format conversion, summed over streams
+    nsecs_t jpegNs = 0;        // JPEG output creation, summed over streams
+    nsecs_t resultNs = 0;      // capture result sent
+};
+
+// Keeps the timelines of the latest completed requests in a ring buffer and
+// dumps them as per stage latency percentiles.
+class RequestTimelineLog {
+public:
+    void record(const RequestTimeline& timeline);
+    void dump(int fd) const;
+private:
+    static const size_t kMaxTimelines = 256;
+    static void dumpStage(int fd, const char* name, std::vector<nsecs_t>& durations);
+
+    mutable std::mutex mLock; // Protect all members below
+    std::vector<RequestTimeline> mTimelines;
+    size_t mNextIndex = 0;
+    uint64_t mNumRecorded = 0;
+};
+
 enum CroppingType {
     HORIZONTAL = 0,
     VERTICAL = 1
@@ -165,6 +222,70 @@ const float kMinAspectRatio = 1.f;
 
 bool isAspectRatioClose(float ar1, float ar2);
 
+// Remembers the supported formats found by enumerating a camera, so that the next time the same
+// camera model is plugged in (or opened) the VIDIOC_ENUM_FMT/FRAMESIZES/FRAMEINTERVALS sweep,
+// which takes over a second on some UVC devices, can be skipped. Entries are kept in memory and
+// persisted under kCacheDir, one file per camera, so they survive a provider restart.
+class ExternalCameraFormatCache {
+public:
+    static const char* kCacheDir;
+
+    static ExternalCameraFormatCache& getInstance();
+
+    // Identifies the USB camera behind a V4L2 node by its vendor id, product id, firmware
+    // revision, USB link speed and video node index. Returns an empty string for a non USB
+    // device.
+    static std::string getDeviceKey(const std::string& devName);
+
+    // Entries found under a different ExternalCameraConfig are ignored, as the enumeration
+    // result depends on the configured fps limits and minimum stream size.
+    bool lookup(const std::string& key, const external::common::ExternalCameraConfig& cfg,
+                std::vector<SupportedV4L2Format>* formats, CroppingType* croppingType);
+    void store(const std::string& key, const external::common::ExternalCameraConfig& cfg,
+               const std::vector<SupportedV4L2Format>& formats, CroppingType croppingType);
+    // Drops an entry the device turned out not to match, from memory and from disk.
+    void invalidate(const std::string& key);
+
+private:
+    struct Entry {
+        std::string cfgSignature;
+        CroppingType croppingType;
+        std::vector<SupportedV4L2Format> formats;
+    };
+
+    static std::string getConfigSignature(const external::common::ExternalCameraConfig& cfg);
+    static std::string getCachePath(const std::string& key);
+    static bool readEntry(const std::string& key, Entry* entry);
+    static void writeEntry(const std::string& key, const Entry& entry);
+
+    std::mutex mLock; // Protect mEntries
+    std::unordered_map<std::string, Entry> mEntries;
+};
+
+// Fork-join pool: runs a batch of tasks on its worker threads and on the calling
+// thread, and returns once all of them are done.
+class OutputWorkerPool {
+public:
+    explicit OutputWorkerPool(size_t workerCount);
+    ~OutputWorkerPool();
+
+    void run(const std::vector<std::function<void()>>& tasks);
+
+private:
+    void workerLoop();
+    // Runs the tasks of the batch left to start. Called with mLock held.
+    void runTasksLocked(std::unique_lock<std::mutex>& lk);
+
+    std::mutex mLock; // Protect all members below but mThreads
+    std::condition_variable mTaskCond; // signaled when a batch is started or on exit
+    std::condition_variable mDoneCond; // signaled when the last task of a batch is done
+    const std::vector<std::function<void()>>* mTasks = nullptr;
+    size_t mNextTask = 0;
+    size_t mPendingTasks = 0;
+    bool mExiting = false;
+    std::vector<std::thread> mThreads;
+};
+
 }  // namespace implementation
 }  // namespace V3_4
 }  // namespace device
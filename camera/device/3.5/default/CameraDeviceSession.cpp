@@ -153,15 +153,6 @@ uint64_t CameraDeviceSession::getCapResultBufferId(const buffer_handle_t& buf, i
     return BUFFER_ID_NO_BUFFER;
 }
 
-Camera3Stream* CameraDeviceSession::getStreamPointer(int32_t streamId) {
-    Mutex::Autolock _l(mInflightLock);
-    if (mStreamMap.count(streamId) == 0) {
-        ALOGE("%s: unknown streamId %d", __FUNCTION__, streamId);
-        return nullptr;
-    }
-    return &mStreamMap[streamId];
-}
-
 void CameraDeviceSession::cleanupInflightBufferFences(
         std::vector<int>& fences, std::vector<std::pair<buffer_handle_t, int>>& bufs) {
     hidl_vec<int> hFences = fences;
@@ -194,11 +185,11 @@ camera3_buffer_request_status_t CameraDeviceSession::requestStreamBuffers(
                 status = s;
                 bufRets = std::move(rets);
             });
+    ATRACE_END();
     if (!err.isOk()) {
         ALOGE("%s: Transaction error: %s", __FUNCTION__, err.description().c_str());
         return CAMERA3_BUF_REQ_FAILED_UNKNOWN;
     }
-    ATRACE_END();
 
     switch (status) {
         case BufferRequestStatus::FAILED_CONFIGURING:
@@ -222,17 +213,6 @@ camera3_buffer_request_status_t CameraDeviceSession::requestStreamBuffers(
         return CAMERA3_BUF_REQ_FAILED_UNKNOWN;
     }
 
-    *num_returned_buf_reqs = num_buffer_reqs;
-    for (size_t i = 0; i < num_buffer_reqs; i++) {
-        // maybe we can query all streams in one call to avoid frequent locking device here?
-        Camera3Stream* stream = getStreamPointer(bufRets[i].streamId);
-        if (stream == nullptr) {
-            ALOGE("%s: unknown streamId %d", __FUNCTION__, bufRets[i].streamId);
-            return CAMERA3_BUF_REQ_FAILED_UNKNOWN;
-        }
-        returned_buf_reqs[i].stream = stream;
-    }
-
     // Handle failed streams
     for (size_t i = 0; i < num_buffer_reqs; i++) {
         if (bufRets[i].val.getDiscriminator() == StreamBuffersVal::hidl_discriminator::error) {
@@ -258,13 +238,53 @@ camera3_buffer_request_status_t CameraDeviceSession::requestStreamBuffers(
         }
     }
 
-    if (status == BufferRequestStatus::FAILED_UNKNOWN) {
-        return CAMERA3_BUF_REQ_FAILED_UNKNOWN;
+    // Look up the streams and import all returned buffers under one lock acquisition
+    {
+        Mutex::Autolock _l(mInflightLock);
+        for (size_t i = 0; i < num_buffer_reqs; i++) {
+            auto streamIt = mStreamMap.find(bufRets[i].streamId);
+            if (streamIt == mStreamMap.end()) {
+                ALOGE("%s: unknown streamId %d", __FUNCTION__, bufRets[i].streamId);
+                return CAMERA3_BUF_REQ_FAILED_UNKNOWN;
+            }
+            returned_buf_reqs[i].stream = &streamIt->second;
+        }
+        *num_returned_buf_reqs = num_buffer_reqs;
+
+        if (status == BufferRequestStatus::FAILED_UNKNOWN) {
+            return CAMERA3_BUF_REQ_FAILED_UNKNOWN;
+        }
+
+        // Only BufferRequestStatus::OK and BufferRequestStatus::FAILED_PARTIAL reaches here
+        for (size_t i = 0; i < num_buffer_reqs; i++) {
+            if (bufRets[i].val.getDiscriminator() !=
+                    StreamBuffersVal::hidl_discriminator::buffers) {
+                continue;
+            }
+            int streamId = bufRets[i].streamId;
+            const hidl_vec<StreamBuffer>& hBufs = bufRets[i].val.buffers();
+            camera3_stream_buffer_t* outBufs = returned_buf_reqs[i].output_buffers;
+            for (size_t b = 0; b < hBufs.size(); b++) {
+                const StreamBuffer& hBuf = hBufs[b];
+                camera3_stream_buffer_t& outBuf = outBufs[b];
+                Status s = importBufferLocked(streamId,
+                        hBuf.bufferId, hBuf.buffer.getNativeHandle(),
+                        /*out*/&(outBuf.buffer),
+                        /*allowEmptyBuf*/false);
+                // Buffer import should never fail - restart HAL since something is very wrong.
+                LOG_ALWAYS_FATAL_IF(s != Status::OK,
+                        "%s: import stream %d bufferId %" PRIu64 " failed!",
+                        __FUNCTION__, streamId, hBuf.bufferId);
+
+                bool succ = sHandleImporter.importFence(hBuf.acquireFence, outBuf.acquire_fence);
+                // Fence import should never fail - restart HAL since something is very wrong.
+                LOG_ALWAYS_FATAL_IF(!succ,
+                            "%s: stream %d bufferId %" PRIu64 "acquire fence is invalid",
+                            __FUNCTION__, streamId, hBuf.bufferId);
+            }
+        }
     }
 
-    // Only BufferRequestStatus::OK and BufferRequestStatus::FAILED_PARTIAL reaches here
-    std::vector<int> importedFences;
-    std::vector<std::pair<buffer_handle_t, int>> importedBuffers;
     for (size_t i = 0; i < num_buffer_reqs; i++) {
         if (bufRets[i].val.getDiscriminator() !=
                 StreamBuffersVal::hidl_discriminator::buffers) {
@@ -275,27 +295,8 @@ camera3_buffer_request_status_t CameraDeviceSession::requestStreamBuffers(
         camera3_stream_buffer_t* outBufs = returned_buf_reqs[i].output_buffers;
         returned_buf_reqs[i].num_output_buffers = hBufs.size();
         for (size_t b = 0; b < hBufs.size(); b++) {
-            const StreamBuffer& hBuf = hBufs[b];
             camera3_stream_buffer_t& outBuf = outBufs[b];
-            // maybe add importBuffers API to avoid frequent locking device?
-            Status s = importBuffer(streamId,
-                    hBuf.bufferId, hBuf.buffer.getNativeHandle(),
-                    /*out*/&(outBuf.buffer),
-                    /*allowEmptyBuf*/false);
-            // Buffer import should never fail - restart HAL since something is very wrong.
-            LOG_ALWAYS_FATAL_IF(s != Status::OK,
-                    "%s: import stream %d bufferId %" PRIu64 " failed!",
-                    __FUNCTION__, streamId, hBuf.bufferId);
-
-            pushBufferId(*(outBuf.buffer), hBuf.bufferId, streamId);
-            importedBuffers.push_back(std::make_pair(*(outBuf.buffer), streamId));
-
-            bool succ = sHandleImporter.importFence(hBuf.acquireFence, outBuf.acquire_fence);
-            // Fence import should never fail - restart HAL since something is very wrong.
-            LOG_ALWAYS_FATAL_IF(!succ,
-                        "%s: stream %d bufferId %" PRIu64 "acquire fence is invalid",
-                        __FUNCTION__, streamId, hBuf.bufferId);
-            importedFences.push_back(outBuf.acquire_fence);
+            pushBufferId(*(outBuf.buffer), hBufs[b].bufferId, streamId);
             outBuf.stream = returned_buf_reqs[i].stream;
             outBuf.status = CAMERA3_BUFFER_STATUS_OK;
             outBuf.release_fence = -1;
@@ -140,8 +140,6 @@ protected:
         }
     };
 
-    Camera3Stream* getStreamPointer(int32_t streamId);
-
     // Register buffer to mBufferIdMaps so we can find corresponding bufferId
     // when the buffer is returned to camera service
     void pushBufferId(const buffer_handle_t& buf, uint64_t bufferId, int streamId);
@@ -18,7 +18,10 @@
 //#define LOG_NDEBUG 0
 #include <log/log.h>
 
+#include <algorithm>
+#include <atomic>
 #include <regex>
+#include <thread>
 #include <sys/inotify.h>
 #include <errno.h>
 #include <linux/videodev2.h>
@@ -213,37 +216,81 @@ void ExternalCameraProviderImpl_2_4::addExternalCamera(const char* devName) {
     }
 }
 
-void ExternalCameraProviderImpl_2_4::deviceAdded(const char* devName) {
+bool ExternalCameraProviderImpl_2_4::probeDevice(const char* devName) {
     {
         base::unique_fd fd(::open(devName, O_RDWR));
         if (fd.get() < 0) {
             ALOGE("%s open v4l2 device %s failed:%s", __FUNCTION__, devName, strerror(errno));
-            return;
+            return false;
         }
 
         struct v4l2_capability capability;
         int ret = ioctl(fd.get(), VIDIOC_QUERYCAP, &capability);
         if (ret < 0) {
             ALOGE("%s v4l2 QUERYCAP %s failed", __FUNCTION__, devName);
-            return;
+            return false;
         }
 
-        if (!(capability.device_caps & V4L2_CAP_VIDEO_CAPTURE)) {
-            ALOGW("%s device %s does not support VIDEO_CAPTURE", __FUNCTION__, devName);
-            return;
+        // UVC cameras come with a metadata node next to each capture node; turn those away
+        // here, before the expensive device init.
+        uint32_t caps = (capability.capabilities & V4L2_CAP_DEVICE_CAPS) ?
+                capability.device_caps : capability.capabilities;
+        if (!(caps & V4L2_CAP_VIDEO_CAPTURE)) {
+            ALOGV("%s device %s does not support VIDEO_CAPTURE (caps 0x%x)",
+                    __FUNCTION__, devName, caps);
+            return false;
         }
     }
-    // See if we can initialize ExternalCameraDevice correctly
+    // See if we can initialize ExternalCameraDevice correctly. This enumerates the formats of
+    // a camera plugged in for the first time; known cameras are served from
+    // ExternalCameraFormatCache, which the device the framework opens later also reuses.
     sp<device::V3_4::implementation::ExternalCameraDevice> deviceImpl =
             new device::V3_4::implementation::ExternalCameraDevice(devName, mCfg);
     if (deviceImpl == nullptr || deviceImpl->isInitFailed()) {
         ALOGW("%s: Attempt to init camera device %s failed!", __FUNCTION__, devName);
+        return false;
+    }
+    return true;
+}
+
+void ExternalCameraProviderImpl_2_4::deviceAdded(const char* devName) {
+    if (probeDevice(devName)) {
+        addExternalCamera(devName);
+    }
+}
+
+void ExternalCameraProviderImpl_2_4::devicesAdded(std::vector<std::string> devNames) {
+    if (devNames.size() == 1) {
+        deviceAdded(devNames[0].c_str());
         return;
     }
-    deviceImpl.clear();
+    // Shorter names first, so /dev/video2 comes before /dev/video10
+    std::sort(devNames.begin(), devNames.end(), [](const std::string& a, const std::string& b) {
+        return a.size() != b.size() ? a.size() < b.size() : a < b;
+    });
+
+    // Each device is probed by whichever worker claims its index first.
+    std::vector<char> usable(devNames.size(), false);
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < devNames.size(); i = next++) {
+            usable[i] = probeDevice(devNames[i].c_str());
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min(devNames.size(), kMaxProbeThreads); i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : workers) {
+        t.join();
+    }
 
-    addExternalCamera(devName);
-    return;
+    for (size_t i = 0; i < devNames.size(); i++) {
+        if (usable[i]) {
+            addExternalCamera(devNames[i].c_str());
+        }
+    }
 }
 
 void ExternalCameraProviderImpl_2_4::deviceRemoved(const char* devName) {
@@ -280,6 +327,7 @@ bool ExternalCameraProviderImpl_2_4::HotplugThread::threadLoop() {
         return false;
     }
 
+    std::vector<std::string> existingDevices;
     struct dirent* de;
     while ((de = readdir(devdir)) != 0) {
         // Find external v4l devices that's existing before we start watching and add them
@@ -292,11 +340,14 @@ bool ExternalCameraProviderImpl_2_4::HotplugThread::threadLoop() {
                 char v4l2DevicePath[kMaxDevicePathLen];
                 snprintf(v4l2DevicePath, kMaxDevicePathLen,
                         "%s%s", kDevicePath, de->d_name);
-                mParent->deviceAdded(v4l2DevicePath);
+                existingDevices.push_back(v4l2DevicePath);
             }
         }
     }
     closedir(devdir);
+    if (!existingDevices.empty()) {
+        mParent->devicesAdded(std::move(existingDevices));
+    }
 
     // Watch new video devices
     mINotifyFD = inotify_init();
@@ -319,6 +370,8 @@ bool ExternalCameraProviderImpl_2_4::HotplugThread::threadLoop() {
         int offset = 0;
         int ret = read(mINotifyFD, eventBuf, sizeof(eventBuf));
         if (ret >= (int)sizeof(struct inotify_event)) {
+            // A dock attach creates several nodes at once; probe the ones of one read together.
+            std::vector<std::string> addedDevices;
             while (offset < ret) {
                 struct inotify_event* event = (struct inotify_event*)&eventBuf[offset];
                 if (event->wd == mWd) {
@@ -329,9 +382,14 @@ bool ExternalCameraProviderImpl_2_4::HotplugThread::threadLoop() {
                             snprintf(v4l2DevicePath, kMaxDevicePathLen,
                                     "%s%s", kDevicePath, event->name);
                             if (event->mask & IN_CREATE) {
-                                mParent->deviceAdded(v4l2DevicePath);
+                                addedDevices.push_back(v4l2DevicePath);
                             }
                             if (event->mask & IN_DELETE) {
+                                // Keep the events in order around a removal
+                                if (!addedDevices.empty()) {
+                                    mParent->devicesAdded(std::move(addedDevices));
+                                    addedDevices.clear();
+                                }
                                 mParent->deviceRemoved(v4l2DevicePath);
                             }
                         }
@@ -339,6 +397,9 @@ bool ExternalCameraProviderImpl_2_4::HotplugThread::threadLoop() {
                 }
                 offset += sizeof(struct inotify_event) + event->len;
             }
+            if (!addedDevices.empty()) {
+                mParent->devicesAdded(std::move(addedDevices));
+            }
         }
     }
 
@@ -20,6 +20,7 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include <utils/Mutex.h>
 #include <utils/Thread.h>
 #include <hidl/Status.h>
@@ -79,8 +80,17 @@ private:
 
     void addExternalCamera(const char* devName);
 
+    // Returns true if devName is a camera ExternalCameraDevice can be initialized on.
+    // Safe to call concurrently for different devices.
+    bool probeDevice(const char* devName);
+
     void deviceAdded(const char* devName);
 
+    // Probes the devices in parallel on up to kMaxProbeThreads threads, then adds the usable
+    // ones in device number order, so the camera ids are announced deterministically.
+    void devicesAdded(std::vector<std::string> devNames);
+    static constexpr size_t kMaxProbeThreads = 4;
+
     void deviceRemoved(const char* devName);
 
     class HotplugThread : public android::Thread {
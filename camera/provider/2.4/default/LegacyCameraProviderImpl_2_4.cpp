@@ -314,8 +314,10 @@ bool LegacyCameraProviderImpl_2_4::initialize() {
 
     mNumberOfLegacyCameras = mModule->getNumberOfCameras();
     for (int i = 0; i < mNumberOfLegacyCameras; i++) {
+        // Only the device version is checked here; the full characteristics are derived
+        // when the framework first asks for them
         struct camera_info info;
-        auto rc = mModule->getCameraInfo(i, &info);
+        auto rc = mModule->getRawCameraInfo(i, &info);
         if (rc != NO_ERROR) {
             ALOGE("%s: Camera info query failed!", __func__);
             mModule.clear();
@@ -17,6 +17,8 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "android.hardware.cas@1.0-DescramblerImpl"
 
+#include <sys/stat.h>
+
 #include <hidlmemory/mapping.h>
 #include <media/cas/DescramblerAPI.h>
 #include <media/hardware/CryptoAPI.h>
@@ -87,44 +89,101 @@ static inline bool validateRangeForSize(
     return isInRange<uint64_t, uint64_t>(0, size, offset, length);
 }
 
-Return<void> DescramblerImpl::descramble(
-        ScramblingControl scramblingControl,
-        const hidl_vec<SubSample>& subSamples,
-        const SharedBuffer& srcBuffer,
-        uint64_t srcOffset,
-        const DestinationBuffer& dstBuffer,
-        uint64_t dstOffset,
-        descramble_cb _hidl_cb) {
-    ALOGV("%s", __FUNCTION__);
+// Number of source heaps whose mappings are kept. A codec allocates its
+// input buffers from one heap, so this only needs to cover a few switches.
+static const size_t kMaxCachedHeaps = 4;
+
+bool DescramblerImpl::HeapKey::operator==(const HeapKey& other) const {
+    return dev == other.dev && ino == other.ino
+            && size == other.size && name == other.name;
+}
+
+// Returns false if the heap cannot be told apart from other heaps. fds from
+// /dev/ashmem all refer to the same device inode, so only heaps backed by
+// their own file (memfd) are cached; the others are mapped on every call.
+bool DescramblerImpl::getHeapKey(const hidl_memory& heapBase, HeapKey* key) {
+    const native_handle_t* handle = heapBase.handle();
+    if (handle == NULL || handle->numFds < 1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(handle->data[0], &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    key->dev = st.st_dev;
+    key->ino = st.st_ino;
+    key->size = heapBase.size();
+    key->name = heapBase.name();
+    return true;
+}
+
+sp<IMemory> DescramblerImpl::mapHeap(const hidl_memory& heapBase) {
+    HeapKey key;
+    if (!getHeapKey(heapBase, &key)) {
+        return mapMemory(heapBase);
+    }
+
+    std::lock_guard<std::mutex> lock(mHeapLock);
+    for (auto it = mHeapCache.begin(); it != mHeapCache.end(); ++it) {
+        if (it->key == key) {
+            mHeapCache.splice(mHeapCache.begin(), mHeapCache, it);
+            return it->mem;
+        }
+    }
+
+    sp<IMemory> mem = mapMemory(heapBase);
+    if (mem == NULL) {
+        return NULL;
+    }
+    ALOGV("%s: caching heap %s, size %llu", __FUNCTION__,
+            key.name.c_str(), (unsigned long long)key.size);
+    mHeapCache.push_front({key, mem});
+    if (mHeapCache.size() > kMaxCachedHeaps) {
+        mHeapCache.pop_back();
+    }
+    return mem;
+}
 
+status_t DescramblerImpl::mapSrcBuffer(
+        const SharedBuffer& srcBuffer, sp<IMemory>* srcMem) {
     // hidl_memory's size is stored in uint64_t, but mapMemory's mmap will map
     // size in size_t. If size is over SIZE_MAX, mapMemory mapMemory could succeed
     // but the mapped memory's actual size will be smaller than the reported size.
     if (srcBuffer.heapBase.size() > SIZE_MAX) {
         ALOGE("Invalid hidl_memory size: %llu", srcBuffer.heapBase.size());
         android_errorWriteLog(0x534e4554, "79376389");
-        _hidl_cb(toStatus(BAD_VALUE), 0, NULL);
-        return Void();
+        return BAD_VALUE;
     }
 
-    sp<IMemory> srcMem = mapMemory(srcBuffer.heapBase);
+    *srcMem = mapHeap(srcBuffer.heapBase);
 
     // Validate if the offset and size in the SharedBuffer is consistent with the
     // mapped ashmem, since the offset and size is controlled by client.
-    if (srcMem == NULL) {
+    if (*srcMem == NULL) {
         ALOGE("Failed to map src buffer.");
-        _hidl_cb(toStatus(BAD_VALUE), 0, NULL);
-        return Void();
+        return BAD_VALUE;
     }
     if (!validateRangeForSize(
-            srcBuffer.offset, srcBuffer.size, (uint64_t)srcMem->getSize())) {
+            srcBuffer.offset, srcBuffer.size, (uint64_t)(*srcMem)->getSize())) {
         ALOGE("Invalid src buffer range: offset %llu, size %llu, srcMem size %llu",
-                srcBuffer.offset, srcBuffer.size, (uint64_t)srcMem->getSize());
+                srcBuffer.offset, srcBuffer.size, (uint64_t)(*srcMem)->getSize());
         android_errorWriteLog(0x534e4554, "67962232");
-        _hidl_cb(toStatus(BAD_VALUE), 0, NULL);
-        return Void();
+        return BAD_VALUE;
     }
+    return OK;
+}
 
+status_t DescramblerImpl::descrambleUnit(
+        DescramblerPlugin* plugin,
+        const sp<IMemory>& srcMem,
+        ScramblingControl scramblingControl,
+        const hidl_vec<SubSample>& subSamples,
+        const SharedBuffer& srcBuffer,
+        uint64_t srcOffset,
+        const DestinationBuffer& dstBuffer,
+        uint64_t dstOffset,
+        int32_t* result,
+        AString* detailedError) {
     // use 64-bit here to catch bad subsample size that might be overflowing.
     uint64_t totalBytesInSubSamples = 0;
     for (size_t i = 0; i < subSamples.size(); i++) {
@@ -138,8 +197,7 @@ Return<void> DescramblerImpl::descramble(
                 "srcOffset %llu, totalBytesInSubSamples %llu, srcBuffer size %llu",
                 srcOffset, totalBytesInSubSamples, srcBuffer.size);
         android_errorWriteLog(0x534e4554, "67962232");
-        _hidl_cb(toStatus(BAD_VALUE), 0, NULL);
-        return Void();
+        return BAD_VALUE;
     }
 
     void *srcPtr = (uint8_t *)(void *)srcMem->getPointer() + srcBuffer.offset;
@@ -156,8 +214,7 @@ Return<void> DescramblerImpl::descramble(
                     "dstOffset %llu, totalBytesInSubSamples %llu, srcBuffer size %llu",
                     dstOffset, totalBytesInSubSamples, srcBuffer.size);
             android_errorWriteLog(0x534e4554, "67962232");
-            _hidl_cb(toStatus(BAD_VALUE), 0, NULL);
-            return Void();
+            return BAD_VALUE;
         }
     } else {
         native_handle_t *handle = const_cast<native_handle_t *>(
@@ -165,21 +222,10 @@ Return<void> DescramblerImpl::descramble(
         dstPtr = static_cast<void *>(handle);
     }
 
-    // Get a local copy of the shared_ptr for the plugin. Note that before
-    // calling the HIDL callback, this shared_ptr must be manually reset,
-    // since the client side could proceed as soon as the callback is called
-    // without waiting for this method to go out of scope.
-    std::shared_ptr<DescramblerPlugin> holder = std::atomic_load(&mPluginHolder);
-    if (holder.get() == nullptr) {
-        _hidl_cb(toStatus(INVALID_OPERATION), 0, NULL);
-        return Void();
-    }
-
     // Casting hidl SubSample to DescramblerPlugin::SubSample, but need
     // to ensure structs are actually idential
 
-    AString detailedError;
-    int32_t result = holder->descramble(
+    *result = plugin->descramble(
             dstBuffer.type != BufferType::SHARED_MEMORY,
             (DescramblerPlugin::ScramblingControl)scramblingControl,
             subSamples.size(),
@@ -188,19 +234,98 @@ Return<void> DescramblerImpl::descramble(
             srcOffset,
             dstPtr,
             dstOffset,
-            &detailedError);
+            detailedError);
+    return OK;
+}
+
+Return<void> DescramblerImpl::descramble(
+        ScramblingControl scramblingControl,
+        const hidl_vec<SubSample>& subSamples,
+        const SharedBuffer& srcBuffer,
+        uint64_t srcOffset,
+        const DestinationBuffer& dstBuffer,
+        uint64_t dstOffset,
+        descramble_cb _hidl_cb) {
+    ALOGV("%s", __FUNCTION__);
+
+    sp<IMemory> srcMem;
+    status_t err = mapSrcBuffer(srcBuffer, &srcMem);
+    if (err != OK) {
+        _hidl_cb(toStatus(err), 0, NULL);
+        return Void();
+    }
+
+    // Get a local copy of the shared_ptr for the plugin. Note that before
+    // calling the HIDL callback, this shared_ptr must be manually reset,
+    // since the client side could proceed as soon as the callback is called
+    // without waiting for this method to go out of scope.
+    std::shared_ptr<DescramblerPlugin> holder = std::atomic_load(&mPluginHolder);
+    if (holder.get() == nullptr) {
+        _hidl_cb(toStatus(INVALID_OPERATION), 0, NULL);
+        return Void();
+    }
+
+    AString detailedError;
+    int32_t result = 0;
+    err = descrambleUnit(holder.get(), srcMem, scramblingControl, subSamples,
+            srcBuffer, srcOffset, dstBuffer, dstOffset, &result, &detailedError);
 
     holder.reset();
+    if (err != OK) {
+        _hidl_cb(toStatus(err), 0, NULL);
+        return Void();
+    }
     _hidl_cb(toStatus(result >= 0 ? OK : result), result, detailedError.c_str());
     return Void();
 }
 
+Status DescramblerImpl::descrambleBatch(
+        const SharedBuffer& srcBuffer,
+        const DestinationBuffer& dstBuffer,
+        const std::vector<DescrambleUnit>& units,
+        std::vector<uint32_t>* bytesWritten,
+        AString* detailedError) {
+    ALOGV("%s: %zu units", __FUNCTION__, units.size());
+
+    bytesWritten->clear();
+
+    sp<IMemory> srcMem;
+    status_t err = mapSrcBuffer(srcBuffer, &srcMem);
+    if (err != OK) {
+        return toStatus(err);
+    }
+
+    std::shared_ptr<DescramblerPlugin> holder = std::atomic_load(&mPluginHolder);
+    if (holder.get() == nullptr) {
+        return toStatus(INVALID_OPERATION);
+    }
+
+    bytesWritten->reserve(units.size());
+    for (const DescrambleUnit& unit : units) {
+        int32_t result = 0;
+        err = descrambleUnit(holder.get(), srcMem, unit.scramblingControl,
+                unit.subSamples, srcBuffer, unit.srcOffset, dstBuffer,
+                unit.dstOffset, &result, detailedError);
+        if (err != OK) {
+            return toStatus(err);
+        }
+        if (result < 0) {
+            return toStatus(result);
+        }
+        bytesWritten->push_back(result);
+    }
+    return Status::OK;
+}
+
 Return<Status> DescramblerImpl::release() {
     ALOGV("%s: plugin=%p", __FUNCTION__, mPluginHolder.get());
 
     std::shared_ptr<DescramblerPlugin> holder(nullptr);
     std::atomic_store(&mPluginHolder, holder);
 
+    std::lock_guard<std::mutex> lock(mHeapLock);
+    mHeapCache.clear();
+
     return Status::OK;
 }
 
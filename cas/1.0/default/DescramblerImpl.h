@@ -17,10 +17,16 @@
 #ifndef ANDROID_HARDWARE_CAS_V1_0_DESCRAMBLER_IMPL_H_
 #define ANDROID_HARDWARE_CAS_V1_0_DESCRAMBLER_IMPL_H_
 
+#include <list>
+#include <mutex>
+#include <vector>
+
 #include <media/stagefright/foundation/ABase.h>
 #include <android/hardware/cas/native/1.0/IDescrambler.h>
+#include <android/hidl/memory/1.0/IMemory.h>
 
 namespace android {
+struct AString;
 struct DescramblerPlugin;
 using namespace hardware::cas::native::V1_0;
 
@@ -53,10 +59,69 @@ public:
 
     virtual Return<Status> release() override;
 
+    // One access unit of a descrambleBatch() call.
+    struct DescrambleUnit {
+        ScramblingControl scramblingControl;
+        hidl_vec<SubSample> subSamples;
+        uint64_t srcOffset;
+        uint64_t dstOffset;
+    };
+
+    // Descramble several access units from the same source and destination
+    // buffers, in order, mapping the source heap and taking the plugin once.
+    // Stops at the first unit that fails; bytesWritten has an entry for each
+    // unit that was descrambled. IDescrambler is frozen, so this is only
+    // available to callers in the same process.
+    Status descrambleBatch(
+            const SharedBuffer& srcBuffer,
+            const DestinationBuffer& dstBuffer,
+            const std::vector<DescrambleUnit>& units,
+            std::vector<uint32_t>* bytesWritten,
+            AString* detailedError);
+
 private:
+    // Identifies a shared heap across calls, which each carry a new fd for it.
+    struct HeapKey {
+        dev_t dev;
+        ino_t ino;
+        uint64_t size;
+        std::string name;
+
+        bool operator==(const HeapKey& other) const;
+    };
+
+    struct CachedHeap {
+        HeapKey key;
+        sp<hidl::memory::V1_0::IMemory> mem;
+    };
+
     sp<SharedLibrary> mLibrary;
     std::shared_ptr<DescramblerPlugin> mPluginHolder;
 
+    // Mappings of recently used source heaps, most recent first. An entry
+    // keeps its heap open, so its key cannot be reused by another heap.
+    std::mutex mHeapLock;
+    std::list<CachedHeap> mHeapCache;
+
+    static bool getHeapKey(const hidl_memory& heapBase, HeapKey* key);
+    sp<hidl::memory::V1_0::IMemory> mapHeap(const hidl_memory& heapBase);
+
+    status_t mapSrcBuffer(
+            const SharedBuffer& srcBuffer,
+            sp<hidl::memory::V1_0::IMemory>* srcMem);
+
+    status_t descrambleUnit(
+            DescramblerPlugin* plugin,
+            const sp<hidl::memory::V1_0::IMemory>& srcMem,
+            ScramblingControl scramblingControl,
+            const hidl_vec<SubSample>& subSamples,
+            const SharedBuffer& srcBuffer,
+            uint64_t srcOffset,
+            const DestinationBuffer& dstBuffer,
+            uint64_t dstOffset,
+            int32_t* result,
+            AString* detailedError);
+
     DISALLOW_EVIL_CONSTRUCTORS(DescramblerImpl);
 };
 
@@ -19,6 +19,7 @@
 
 #include <dirent.h>
 #include <dlfcn.h>
+#include "PluginIndex.h"
 #include "SharedLibrary.h"
 #include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
@@ -36,7 +37,7 @@ template <class T>
 class FactoryLoader {
 public:
     FactoryLoader(const char *name) :
-        mFactory(NULL), mCreateFactoryFuncName(name) {}
+        mFactory(NULL), mCreateFactoryFuncName(name), mIndex(name) {}
 
     virtual ~FactoryLoader() { closeFactory(); }
 
@@ -56,6 +57,7 @@ private:
     sp<SharedLibrary> mLibrary;
     KeyedVector<int32_t, String8> mCASystemIdToLibraryPathMap;
     KeyedVector<String8, wp<SharedLibrary> > mLibraryPathToOpenLibraryMap;
+    PluginIndex mIndex;
 
     bool loadFactoryForSchemeFromPath(
             const String8 &path,
@@ -83,12 +85,20 @@ bool FactoryLoader<T>::findFactoryForScheme(
 
     Mutex::Autolock autoLock(mMapLock);
 
+    // only asked whether the id is supported, no need to load anything
+    // the index has the answer for
+    bool needFactory = (library != NULL || factory != NULL);
+
     // first check cache
     ssize_t index = mCASystemIdToLibraryPathMap.indexOfKey(CA_system_id);
     if (index >= 0) {
+        const String8 &path = mCASystemIdToLibraryPathMap[index];
+        if (!needFactory && mIndex.lookup(path.string(), CA_system_id)
+                == PluginIndex::SUPPORTED) {
+            return true;
+        }
         return loadFactoryForSchemeFromPath(
-                mCASystemIdToLibraryPathMap[index],
-                CA_system_id, library, factory);
+                path, CA_system_id, library, factory);
     }
 
     // no luck, have to search
@@ -100,24 +110,37 @@ bool FactoryLoader<T>::findFactoryForScheme(
         return false;
     }
 
+    bool found = false;
     struct dirent* pEntry;
-    while ((pEntry = readdir(pDir))) {
+    while (!found && (pEntry = readdir(pDir))) {
         String8 pluginPath = dirPath + "/" + pEntry->d_name;
         if (pluginPath.getPathExtension() == ".so") {
-            if (loadFactoryForSchemeFromPath(
-                    pluginPath, CA_system_id, library, factory)) {
+            mIndex.addLibrary(pluginPath.string());
+            PluginIndex::Answer answer =
+                    mIndex.lookup(pluginPath.string(), CA_system_id);
+            if (answer == PluginIndex::UNSUPPORTED) {
+                continue;
+            }
+            if (answer == PluginIndex::SUPPORTED && !needFactory) {
+                found = true;
+            } else {
+                found = loadFactoryForSchemeFromPath(
+                        pluginPath, CA_system_id, library, factory);
+                mIndex.record(pluginPath.string(), CA_system_id, found);
+            }
+            if (found) {
                 mCASystemIdToLibraryPathMap.add(CA_system_id, pluginPath);
-                closedir(pDir);
-
-                return true;
             }
         }
     }
 
     closedir(pDir);
+    mIndex.save();
 
-    ALOGE("Failed to find plugin");
-    return false;
+    if (!found) {
+        ALOGE("Failed to find plugin");
+    }
+    return found;
 }
 
 template <class T>
@@ -141,9 +164,20 @@ bool FactoryLoader<T>::enumeratePlugins(
     while ((pEntry = readdir(pDir))) {
         String8 pluginPath = dirPath + "/" + pEntry->d_name;
         if (pluginPath.getPathExtension() == ".so") {
-            queryPluginsFromPath(pluginPath, results);
+            mIndex.addLibrary(pluginPath.string());
+            if (mIndex.getPlugins(pluginPath.string(), results)) {
+                continue;
+            }
+            // a library that is not a plugin is recorded with no plugins
+            vector<HidlCasPluginDescriptor> plugins;
+            queryPluginsFromPath(pluginPath, &plugins);
+            mIndex.setPlugins(pluginPath.string(), plugins);
+            results->insert(results->end(), plugins.begin(), plugins.end());
         }
     }
+
+    closedir(pDir);
+    mIndex.save();
     return true;
 }
 
@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "android.hardware.cas@1.0-PluginIndex"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+
+#include <cutils/properties.h>
+#include <utils/Log.h>
+
+#include "PluginIndex.h"
+
+namespace android {
+namespace hardware {
+namespace cas {
+namespace V1_0 {
+namespace implementation {
+
+// The file format is line based:
+//   F <build fingerprint>      must be the first line
+//   L <mtime ns> <size> <library path>
+//   A <CA system id>           id supported by the library above
+//   Q                          queryPlugins result of the library above follows
+//   P <CA system id> <name>
+const char *PluginIndex::kIndexDir = "/data/vendor/mediacas";
+
+// Keeps the index, and the time to read it, small whatever the plugins and
+// the clients do. What does not fit is asked to the libraries again.
+static const size_t kMaxLibraries = 64;
+static const size_t kMaxAnswers = 32;
+static const size_t kMaxPlugins = 32;
+
+static std::string getFingerprint() {
+    char fingerprint[PROPERTY_VALUE_MAX];
+    property_get("ro.vendor.build.fingerprint", fingerprint, "");
+    return fingerprint;
+}
+
+PluginIndex::PluginIndex(const char *entry) :
+    mPath(std::string(kIndexDir) + "/plugin_index_" + entry),
+    mFingerprint(getFingerprint()),
+    mDirty(false),
+    mWritePending(false),
+    mStopping(false) {
+    read();
+}
+
+PluginIndex::~PluginIndex() {
+    {
+        std::lock_guard<std::mutex> lock(mWriteLock);
+        mStopping = true;
+    }
+    mWriteCondition.notify_one();
+    if (mWriter.joinable()) {
+        mWriter.join();
+    }
+}
+
+void PluginIndex::read() {
+    std::ifstream in(mPath);
+    std::string line;
+    if (!std::getline(in, line) || line != "F " + mFingerprint) {
+        // missing, or written by another build
+        return;
+    }
+    Library *library = NULL;
+    while (std::getline(in, line)) {
+        if (line.empty() || (line.size() > 1 && line[1] != ' ')) {
+            continue;
+        }
+        long long mtimeNs, size;
+        int32_t id;
+        int rest = 0;
+        if (line[0] == 'L') {
+            library = NULL;
+            if (mLibraries.size() < kMaxLibraries &&
+                    sscanf(line.c_str(), "L %lld %lld %n",
+                    &mtimeNs, &size, &rest) == 2 && rest > 0) {
+                library = &mLibraries[line.substr(rest)];
+                library->mtimeNs = mtimeNs;
+                library->size = size;
+            }
+        } else if (library == NULL) {
+            continue;
+        } else if (line[0] == 'A') {
+            if (library->supported.size() < kMaxAnswers &&
+                    sscanf(line.c_str(), "A %d", &id) == 1) {
+                library->supported.insert(id);
+            }
+        } else if (line[0] == 'Q') {
+            library->queried = true;
+        } else if (line[0] == 'P') {
+            if (sscanf(line.c_str(), "P %d %n", &id, &rest) == 1 && rest > 0) {
+                library->plugins.push_back(HidlCasPluginDescriptor {
+                        .caSystemId = id,
+                        .name = line.substr(rest)});
+            }
+        }
+    }
+    for (auto &it : mLibraries) {
+        // an incomplete list of plugins must be queried again
+        if (it.second.plugins.size() > kMaxPlugins) {
+            it.second.queried = false;
+            it.second.plugins.clear();
+        }
+    }
+}
+
+void PluginIndex::addLibrary(const std::string &path) {
+    Library &library = mLibraries[path];
+    if (library.checked) {
+        return;
+    }
+    library.checked = true;
+
+    struct stat st;
+    int64_t mtimeNs = 0;
+    int64_t size = 0;
+    if (stat(path.c_str(), &st) == 0) {
+        mtimeNs = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        size = st.st_size;
+    }
+    if (library.mtimeNs != mtimeNs || library.size != size) {
+        library = Library();
+        library.mtimeNs = mtimeNs;
+        library.size = size;
+        library.checked = true;
+        mDirty = true;
+    }
+}
+
+const PluginIndex::Library *PluginIndex::getCheckedLibrary(
+        const std::string &path) const {
+    auto it = mLibraries.find(path);
+    if (it == mLibraries.end() || !it->second.checked) {
+        return NULL;
+    }
+    return &it->second;
+}
+
+PluginIndex::Answer PluginIndex::lookup(
+        const std::string &path, int32_t CA_system_id) const {
+    const Library *library = getCheckedLibrary(path);
+    if (library == NULL) {
+        return UNKNOWN;
+    }
+    if (library->supported.count(CA_system_id) > 0) {
+        return SUPPORTED;
+    }
+    if (library->unsupported.count(CA_system_id) > 0) {
+        return UNSUPPORTED;
+    }
+    return UNKNOWN;
+}
+
+void PluginIndex::record(
+        const std::string &path, int32_t CA_system_id, bool supported) {
+    if (getCheckedLibrary(path) == NULL) {
+        return;
+    }
+    Library &library = mLibraries[path];
+    if (!supported) {
+        if (library.supported.erase(CA_system_id) > 0) {
+            mDirty = true;
+        }
+        if (library.unsupported.size() >= kMaxAnswers) {
+            library.unsupported.clear();
+        }
+        library.unsupported.insert(CA_system_id);
+        return;
+    }
+    library.unsupported.erase(CA_system_id);
+    if (library.supported.size() < kMaxAnswers &&
+            library.supported.insert(CA_system_id).second) {
+        mDirty = true;
+    }
+}
+
+bool PluginIndex::getPlugins(
+        const std::string &path,
+        std::vector<HidlCasPluginDescriptor> *results) const {
+    const Library *library = getCheckedLibrary(path);
+    if (library == NULL || !library->queried) {
+        return false;
+    }
+    results->insert(results->end(),
+            library->plugins.begin(), library->plugins.end());
+    return true;
+}
+
+void PluginIndex::setPlugins(
+        const std::string &path,
+        const std::vector<HidlCasPluginDescriptor> &plugins) {
+    if (getCheckedLibrary(path) == NULL) {
+        return;
+    }
+    if (plugins.size() > kMaxPlugins) {
+        return;
+    }
+    Library &library = mLibraries[path];
+    library.queried = true;
+    library.plugins = plugins;
+    mDirty = true;
+}
+
+void PluginIndex::save() {
+    if (!mDirty) {
+        return;
+    }
+    mDirty = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mWriteLock);
+        mPendingContent = serialize();
+        mWritePending = true;
+        if (!mWriter.joinable()) {
+            mWriter = std::thread(&PluginIndex::writeLoop, this);
+        }
+    }
+    mWriteCondition.notify_one();
+}
+
+std::string PluginIndex::serialize() const {
+    std::ostringstream out;
+    out << "F " << mFingerprint << "\n";
+    size_t count = 0;
+    for (const auto &it : mLibraries) {
+        const Library &library = it.second;
+        // Keep what is known of libraries not looked at yet, unless removed
+        if (!library.checked && access(it.first.c_str(), F_OK) != 0) {
+            continue;
+        }
+        if (++count > kMaxLibraries) {
+            break;
+        }
+        out << "L " << library.mtimeNs << " " << library.size
+            << " " << it.first << "\n";
+        for (int32_t id : library.supported) {
+            out << "A " << id << "\n";
+        }
+        if (library.queried) {
+            out << "Q\n";
+            for (const auto &plugin : library.plugins) {
+                // Keep the index line based
+                std::string name = plugin.name;
+                for (char &c : name) {
+                    if (c == '\n' || c == '\r') {
+                        c = ' ';
+                    }
+                }
+                out << "P " << plugin.caSystemId << " " << name << "\n";
+            }
+        }
+    }
+    return out.str();
+}
+
+void PluginIndex::writeLoop() {
+    std::unique_lock<std::mutex> lock(mWriteLock);
+    while (true) {
+        mWriteCondition.wait(lock, [this] { return mWritePending || mStopping; });
+        if (!mWritePending) {
+            return;
+        }
+        std::string content;
+        content.swap(mPendingContent);
+        mWritePending = false;
+        lock.unlock();
+
+        std::string tmpPath = mPath + ".tmp";
+        bool written = false;
+        {
+            std::ofstream out(tmpPath, std::ios::trunc);
+            if (!out) {
+                ALOGV("Cannot write plugin index %s", tmpPath.c_str());
+            } else if (!(out << content).flush()) {
+                ALOGW("Failed to write plugin index %s", tmpPath.c_str());
+                unlink(tmpPath.c_str());
+            } else {
+                written = true;
+            }
+        }
+        if (written && rename(tmpPath.c_str(), mPath.c_str()) != 0) {
+            ALOGW("Failed to update plugin index %s", mPath.c_str());
+            unlink(tmpPath.c_str());
+        }
+
+        lock.lock();
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace cas
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_CAS_V1_0_PLUGIN_INDEX_H_
+#define ANDROID_HARDWARE_CAS_V1_0_PLUGIN_INDEX_H_
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android/hardware/cas/1.0/types.h>
+#include <media/stagefright/foundation/ABase.h>
+
+namespace android {
+namespace hardware {
+namespace cas {
+namespace V1_0 {
+namespace implementation {
+
+// Persistent record of the CA system ids each plugin library was found to
+// support, and of the plugins it reported, so that after a restart
+// isSystemIdSupported and enumeratePlugins are answered without dlopen'ing
+// every library. The record of a library is keyed by its modification time
+// and size, and is dropped as soon as either changes. The whole index is
+// dropped when ro.vendor.build.fingerprint changes.
+//
+// Only positive answers are persisted. Ids a library does not support are
+// remembered until the service exits, so that a stale answer never hides a
+// plugin after an update. The number of libraries, answers and plugins kept
+// is bounded.
+//
+// Not thread safe, FactoryLoader serializes its use. The file is written by
+// a thread of the index, off the binder thread that changed it.
+class PluginIndex {
+public:
+    enum Answer {
+        UNKNOWN,
+        SUPPORTED,
+        UNSUPPORTED,
+    };
+
+    static const char *kIndexDir;
+
+    // The index of the plugins loaded through entry.
+    explicit PluginIndex(const char *entry);
+
+    // Waits for the last save to be written.
+    ~PluginIndex();
+
+    // Checks the record of a library found in the plugin directory against
+    // its modification time and size. Only libraries added can be looked up.
+    void addLibrary(const std::string &path);
+
+    Answer lookup(const std::string &path, int32_t CA_system_id) const;
+    void record(const std::string &path, int32_t CA_system_id, bool supported);
+
+    // Appends the plugins the library reported, returns false if not known.
+    bool getPlugins(
+            const std::string &path,
+            std::vector<HidlCasPluginDescriptor> *results) const;
+    void setPlugins(
+            const std::string &path,
+            const std::vector<HidlCasPluginDescriptor> &plugins);
+
+    // Schedules the index to be written back if anything changed since it
+    // was read.
+    void save();
+
+private:
+    struct Library {
+        int64_t mtimeNs = 0;
+        int64_t size = 0;
+        bool checked = false;
+        std::set<int32_t> supported;
+        std::set<int32_t> unsupported;
+        bool queried = false;
+        std::vector<HidlCasPluginDescriptor> plugins;
+    };
+
+    void read();
+    const Library *getCheckedLibrary(const std::string &path) const;
+    std::string serialize() const;
+    void writeLoop();
+
+    const std::string mPath;
+    const std::string mFingerprint;
+    std::map<std::string, Library> mLibraries;
+    bool mDirty;
+
+    std::mutex mWriteLock;
+    std::condition_variable mWriteCondition;
+    std::string mPendingContent;
+    bool mWritePending;
+    bool mStopping;
+    std::thread mWriter;
+
+    DISALLOW_EVIL_CONSTRUCTORS(PluginIndex);
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace cas
+}  // namespace hardware
+}  // namespace android
+
+#endif // ANDROID_HARDWARE_CAS_V1_0_PLUGIN_INDEX_H_
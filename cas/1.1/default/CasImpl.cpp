@@ -17,6 +17,8 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "android.hardware.cas@1.1-CasImpl"
 
+#include <unistd.h>
+
 #include <android/hardware/cas/1.1/ICasListener.h>
 #include <media/cas/CasAPI.h>
 #include <utils/Log.h>
@@ -31,13 +33,16 @@ namespace cas {
 namespace V1_1 {
 namespace implementation {
 
-CasImpl::CasImpl(const sp<ICasListener>& listener) : mListener(listener) {
+CasImpl::CasImpl(const sp<ICasListener>& listener)
+    : mListener(listener), mStats(std::make_shared<CasPluginStats>()) {
     ALOGV("CTOR");
 }
 
 CasImpl::~CasImpl() {
     ALOGV("DTOR");
     release();
+    // the processing thread calls back into this object
+    mProcessingQueue.reset();
 }
 
 // static
@@ -67,6 +72,62 @@ void CasImpl::init(const sp<SharedLibrary>& library, CasPlugin* plugin) {
     std::atomic_store(&mPluginHolder, holder);
 }
 
+void CasImpl::setAsyncProcessingEnabled(bool enabled) {
+    if (!enabled) {
+        mProcessingQueue.reset();
+        return;
+    }
+    if (mProcessingQueue != nullptr) {
+        return;
+    }
+
+    mProcessingQueue = std::make_unique<CasProcessingQueue>(
+            [this](const CasSessionId& sessionId, const CasEcm& ecm) {
+                return runProcessEcm(sessionId, ecm);
+            },
+            [this](const CasEmm& emm) { return runProcessEmm(emm); },
+            [this](const CasSessionId& sessionId, status_t err) {
+                if (mListener != NULL) {
+                    mListener->onSessionEvent(sessionId, kEventEcmProcessed,
+                                              static_cast<int32_t>(toStatus(err)), HidlCasData());
+                }
+            },
+            [this](status_t err) {
+                if (mListener != NULL) {
+                    mListener->onEvent(kEventEmmProcessed, static_cast<int32_t>(toStatus(err)),
+                                       HidlCasData());
+                }
+            });
+}
+
+void CasImpl::setStats(const std::shared_ptr<CasPluginStats>& stats) {
+    mStats = stats;
+}
+
+status_t CasImpl::runProcessEcm(const CasSessionId& sessionId, const CasEcm& ecm) {
+    std::shared_ptr<CasPlugin> holder = std::atomic_load(&mPluginHolder);
+    if (holder.get() == nullptr) {
+        return INVALID_OPERATION;
+    }
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    status_t err = holder->processEcm(sessionId, ecm);
+    mStats->ecm.record(systemTime(SYSTEM_TIME_MONOTONIC) - start);
+    return err;
+}
+
+status_t CasImpl::runProcessEmm(const CasEmm& emm) {
+    std::shared_ptr<CasPlugin> holder = std::atomic_load(&mPluginHolder);
+    if (holder.get() == nullptr) {
+        return INVALID_OPERATION;
+    }
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    status_t err = holder->processEmm(emm);
+    mStats->emm.record(systemTime(SYSTEM_TIME_MONOTONIC) - start);
+    return err;
+}
+
 void CasImpl::onEvent(int32_t event, int32_t arg, uint8_t* data, size_t size) {
     if (mListener == NULL) {
         return;
@@ -139,6 +200,9 @@ Return<Status> CasImpl::closeSession(const HidlCasSessionId& sessionId) {
     if (holder.get() == nullptr) {
         return toStatus(INVALID_OPERATION);
     }
+    if (mProcessingQueue != nullptr) {
+        mProcessingQueue->removeSession(sessionId);
+    }
     return toStatus(holder->closeSession(sessionId));
 }
 
@@ -148,8 +212,13 @@ Return<Status> CasImpl::processEcm(const HidlCasSessionId& sessionId, const Hidl
     if (holder.get() == nullptr) {
         return toStatus(INVALID_OPERATION);
     }
+    holder.reset();
 
-    return toStatus(holder->processEcm(sessionId, ecm));
+    if (mProcessingQueue != nullptr) {
+        mProcessingQueue->queueEcm(sessionId, ecm);
+        return Status::OK;
+    }
+    return toStatus(runProcessEcm(sessionId, ecm));
 }
 
 Return<Status> CasImpl::processEmm(const HidlCasData& emm) {
@@ -158,8 +227,13 @@ Return<Status> CasImpl::processEmm(const HidlCasData& emm) {
     if (holder.get() == nullptr) {
         return toStatus(INVALID_OPERATION);
     }
+    holder.reset();
 
-    return toStatus(holder->processEmm(emm));
+    if (mProcessingQueue != nullptr) {
+        mProcessingQueue->queueEmm(emm);
+        return Status::OK;
+    }
+    return toStatus(runProcessEmm(emm));
 }
 
 Return<Status> CasImpl::sendEvent(int32_t event, int32_t arg, const HidlCasData& eventData) {
@@ -211,10 +285,30 @@ Return<Status> CasImpl::release() {
 
     std::shared_ptr<CasPlugin> holder(nullptr);
     std::atomic_store(&mPluginHolder, holder);
+    if (mProcessingQueue != nullptr) {
+        mProcessingQueue->clear();
+    }
 
     return Status::OK;
 }
 
+Return<void> CasImpl::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* options */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        return Void();
+    }
+
+    String8 out;
+    mStats->ecm.appendTo("processEcm", &out);
+    mStats->emm.appendTo("processEmm", &out);
+    if (mProcessingQueue != nullptr) {
+        mProcessingQueue->appendTo(&out);
+    } else {
+        out.append("asynchronous processing disabled\n");
+    }
+    write(fd->data[0], out.string(), out.size());
+    return Void();
+}
+
 }  // namespace implementation
 }  // namespace V1_1
 }  // namespace cas
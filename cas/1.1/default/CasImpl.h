@@ -20,6 +20,10 @@
 #include <android/hardware/cas/1.1/ICas.h>
 #include <media/stagefright/foundation/ABase.h>
 
+#include <memory>
+
+#include "CasProcessingQueue.h"
+
 namespace android {
 struct CasPlugin;
 
@@ -37,6 +41,13 @@ class SharedLibrary;
 
 class CasImpl : public ICas {
    public:
+    // Events sent to the listener when asynchronous processing is enabled, once an
+    // ECM (as a session event) or an EMM has been processed. arg is the Status.
+    // These codes are defined by this implementation, not by the HAL, so plugins
+    // must not send events with the same codes.
+    static constexpr int32_t kEventEcmProcessed = 0x7ca50001;
+    static constexpr int32_t kEventEmmProcessed = 0x7ca50002;
+
     CasImpl(const sp<ICasListener>& listener);
     virtual ~CasImpl();
 
@@ -46,6 +57,14 @@ class CasImpl : public ICas {
                             const CasSessionId* sessionId);
 
     void init(const sp<SharedLibrary>& library, CasPlugin* plugin);
+
+    // Makes processEcm and processEmm return once the message is queued, see
+    // CasProcessingQueue. Must be called before the CasImpl is handed to a client.
+    void setAsyncProcessingEnabled(bool enabled);
+
+    // Records the plugin latencies into stats, which may be shared with other
+    // instances of the plugin. Must be called before the CasImpl is handed to a client.
+    void setStats(const std::shared_ptr<CasPluginStats>& stats);
     void onEvent(int32_t event, int32_t arg, uint8_t* data, size_t size);
 
     void onEvent(const CasSessionId* sessionId, int32_t event, int32_t arg, uint8_t* data,
@@ -80,12 +99,23 @@ class CasImpl : public ICas {
 
     virtual Return<Status> release() override;
 
+    // IBase inherits
+
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
    private:
     struct PluginHolder;
+
+    status_t runProcessEcm(const CasSessionId& sessionId, const CasEcm& ecm);
+    status_t runProcessEmm(const CasEmm& emm);
+
     sp<SharedLibrary> mLibrary;
     std::shared_ptr<CasPlugin> mPluginHolder;
     sp<ICasListener> mListener;
 
+    std::shared_ptr<CasPluginStats> mStats;
+    std::unique_ptr<CasProcessingQueue> mProcessingQueue;
+
     DISALLOW_EVIL_CONSTRUCTORS(CasImpl);
 };
 
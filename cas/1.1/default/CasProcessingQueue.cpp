@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "android.hardware.cas@1.1-CasProcessingQueue"
+
+#include <algorithm>
+
+#include <utils/Log.h>
+
+#include "CasProcessingQueue.h"
+#include "TypeConvert.h"
+
+namespace android {
+namespace hardware {
+namespace cas {
+namespace V1_1 {
+namespace implementation {
+
+namespace {
+
+// FNV-1a, only used to tell most differing messages apart without comparing them
+uint64_t hashData(const CasData& data) {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint8_t byte : data) {
+        hash ^= byte;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+}  // namespace
+
+void CasLatencyStats::record(nsecs_t latencyNs) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mCount++;
+    mTotalNs += latencyNs;
+    mMaxNs = std::max(mMaxNs, latencyNs);
+}
+
+void CasLatencyStats::appendTo(const char* name, String8* out) const {
+    std::lock_guard<std::mutex> lock(mLock);
+    out->appendFormat("%s: count=%llu avg=%.3fms max=%.3fms\n", name,
+                      static_cast<unsigned long long>(mCount),
+                      mCount ? mTotalNs / 1e6 / mCount : 0.0, mMaxNs / 1e6);
+}
+
+CasProcessingQueue::Message::Message(const CasData& data) : data(data), hash(hashData(data)) {}
+
+CasProcessingQueue::CasProcessingQueue(ProcessEcmFunction processEcm,
+                                       ProcessEmmFunction processEmm,
+                                       EcmProcessedFunction onEcmProcessed,
+                                       EmmProcessedFunction onEmmProcessed)
+    : mProcessEcm(std::move(processEcm)),
+      mProcessEmm(std::move(processEmm)),
+      mOnEcmProcessed(std::move(onEcmProcessed)),
+      mOnEmmProcessed(std::move(onEmmProcessed)),
+      mThread(&CasProcessingQueue::threadLoop, this) {}
+
+CasProcessingQueue::~CasProcessingQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExiting = true;
+        mCondition.notify_all();
+    }
+    mThread.join();
+}
+
+void CasProcessingQueue::queueEcm(const CasSessionId& sessionId, const CasEcm& ecm) {
+    Message message(ecm);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    Session& session = mSessions[sessionId];
+    // the ECM the keys of the session will come from once the plugin is done
+    const Message& current = session.isProcessing ? session.processing : session.lastProcessed;
+    if (message == current) {
+        ALOGV("%s: sessionId=%s: dropping repeated ECM", __FUNCTION__,
+              sessionIdToString(sessionId).string());
+        if (session.hasPending) {
+            // the ECM has not changed after all, forget the one queued in between
+            session.hasPending = false;
+            mReplacedEcms++;
+        }
+        mDroppedEcms++;
+        return;
+    }
+
+    if (session.hasPending) {
+        if (message == session.pending) {
+            mDroppedEcms++;
+            return;
+        }
+        mReplacedEcms++;
+    }
+    session.pending = std::move(message);
+    session.hasPending = true;
+    if (!session.isReady) {
+        session.isReady = true;
+        mReadySessions.push_back(sessionId);
+    }
+    mCondition.notify_all();
+}
+
+void CasProcessingQueue::queueEmm(const CasEmm& emm) {
+    Message message(emm);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    // a failed EMM is not remembered, so that the plugin gets it again when it is resent
+    const Message& current = mProcessingEmm ? mEmmProcessing : mLastProcessedEmm;
+    if (message == current || (!mPendingEmms.empty() && message == mPendingEmms.back())) {
+        mDroppedEmms++;
+        return;
+    }
+    mPendingEmms.push_back(std::move(message));
+    mCondition.notify_all();
+}
+
+void CasProcessingQueue::removeSession(const CasSessionId& sessionId) {
+    std::unique_lock<std::mutex> lock(mLock);
+    auto iter = mSessions.find(sessionId);
+    if (iter == mSessions.end()) {
+        return;
+    }
+    iter->second.hasPending = false;
+    mCondition.wait(lock, [this, &sessionId] {
+        auto iter = mSessions.find(sessionId);
+        return iter == mSessions.end() || !iter->second.isProcessing;
+    });
+    // the ready queue entry, if any, is skipped once the session is gone
+    mSessions.erase(sessionId);
+}
+
+void CasProcessingQueue::clear() {
+    std::unique_lock<std::mutex> lock(mLock);
+    mPendingEmms.clear();
+    mReadySessions.clear();
+    for (auto& entry : mSessions) {
+        entry.second.hasPending = false;
+        entry.second.isReady = false;
+    }
+    mCondition.wait(lock, [this] {
+        if (mProcessingEmm) {
+            return false;
+        }
+        for (const auto& entry : mSessions) {
+            if (entry.second.isProcessing) {
+                return false;
+            }
+        }
+        return true;
+    });
+    mSessions.clear();
+    mLastProcessedEmm = Message();
+}
+
+void CasProcessingQueue::appendTo(String8* out) const {
+    std::lock_guard<std::mutex> lock(mLock);
+    out->appendFormat("sessions=%zu ready=%zu pendingEmms=%zu\n", mSessions.size(),
+                      mReadySessions.size(), mPendingEmms.size());
+    out->appendFormat("repeated ECMs dropped=%llu replaced=%llu, repeated EMMs dropped=%llu\n",
+                      static_cast<unsigned long long>(mDroppedEcms),
+                      static_cast<unsigned long long>(mReplacedEcms),
+                      static_cast<unsigned long long>(mDroppedEmms));
+}
+
+void CasProcessingQueue::threadLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mCondition.wait(lock, [this] {
+            return mExiting || !mPendingEmms.empty() || !mReadySessions.empty();
+        });
+        if (mExiting) {
+            return;
+        }
+
+        if (!mPendingEmms.empty()) {
+            mEmmProcessing = std::move(mPendingEmms.front());
+            mPendingEmms.pop_front();
+            mProcessingEmm = true;
+            lock.unlock();
+
+            status_t err = mProcessEmm(mEmmProcessing.data);
+
+            lock.lock();
+            if (err == OK) {
+                mLastProcessedEmm = std::move(mEmmProcessing);
+            }
+            mEmmProcessing = Message();
+            mProcessingEmm = false;
+            mCondition.notify_all();
+            lock.unlock();
+
+            mOnEmmProcessed(err);
+
+            lock.lock();
+            continue;
+        }
+
+        CasSessionId sessionId = std::move(mReadySessions.front());
+        mReadySessions.pop_front();
+        auto iter = mSessions.find(sessionId);
+        if (iter == mSessions.end()) {
+            continue;
+        }
+        Session& session = iter->second;
+        session.isReady = false;
+        if (!session.hasPending) {
+            continue;
+        }
+        session.processing = std::move(session.pending);
+        session.hasPending = false;
+        session.isProcessing = true;
+        lock.unlock();
+
+        status_t err = mProcessEcm(sessionId, session.processing.data);
+
+        lock.lock();
+        // removeSession and clear wait for isProcessing to be reset, so the session is still there
+        if (err == OK) {
+            session.lastProcessed = std::move(session.processing);
+        }
+        session.processing = Message();
+        session.isProcessing = false;
+        mCondition.notify_all();
+        lock.unlock();
+
+        mOnEcmProcessed(sessionId, err);
+
+        lock.lock();
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace cas
+}  // namespace hardware
+}  // namespace android
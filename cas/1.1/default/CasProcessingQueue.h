@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_CAS_V1_1_CAS_PROCESSING_QUEUE_H_
+#define ANDROID_HARDWARE_CAS_V1_1_CAS_PROCESSING_QUEUE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <media/cas/CasAPI.h>
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+namespace android {
+namespace hardware {
+namespace cas {
+namespace V1_1 {
+namespace implementation {
+
+// Latency of the calls made into a plugin, in nanoseconds
+class CasLatencyStats {
+   public:
+    void record(nsecs_t latencyNs);
+    void appendTo(const char* name, String8* out) const;
+
+   private:
+    mutable std::mutex mLock;
+    uint64_t mCount = 0;
+    nsecs_t mTotalNs = 0;
+    nsecs_t mMaxNs = 0;
+};
+
+// Latency of processEcm and processEmm, shared by the CasImpls of a CA system id
+struct CasPluginStats {
+    CasLatencyStats ecm;
+    CasLatencyStats emm;
+};
+
+// Processes the ECMs and EMMs of a CAS plugin on a thread of its own, so that the
+// caller of processEcm / processEmm does not wait on the plugin.
+//
+// Each session keeps at most one pending ECM: a newer ECM replaces the pending one,
+// so a channel change only waits for the ECM being processed, if any. ECMs
+// identical to the last one successfully processed for the session, or to the one
+// being processed, are dropped. Likewise for EMMs, which are also dropped when
+// identical to the last one queued. ECMs are processed in the order their sessions
+// became ready, and EMMs in the order they were queued, ahead of ECMs.
+//
+// The processed callbacks are made on the queue thread once the message is done
+// with, so they may queue messages or remove sessions themselves. removeSession and
+// clear do not wait for them.
+class CasProcessingQueue {
+   public:
+    using ProcessEcmFunction = std::function<status_t(const CasSessionId&, const CasEcm&)>;
+    using ProcessEmmFunction = std::function<status_t(const CasEmm&)>;
+    using EcmProcessedFunction = std::function<void(const CasSessionId&, status_t)>;
+    using EmmProcessedFunction = std::function<void(status_t)>;
+
+    CasProcessingQueue(ProcessEcmFunction processEcm, ProcessEmmFunction processEmm,
+                       EcmProcessedFunction onEcmProcessed, EmmProcessedFunction onEmmProcessed);
+    ~CasProcessingQueue();
+
+    void queueEcm(const CasSessionId& sessionId, const CasEcm& ecm);
+    void queueEmm(const CasEmm& emm);
+
+    // Drops the pending ECM of the session and waits for the one being processed
+    void removeSession(const CasSessionId& sessionId);
+
+    // Drops everything pending and waits for the ECM or EMM being processed
+    void clear();
+
+    void appendTo(String8* out) const;
+
+   private:
+    struct Message {
+        Message() = default;
+        explicit Message(const CasData& data);
+
+        bool operator==(const Message& other) const {
+            return hash == other.hash && data == other.data;
+        }
+        CasData data;
+        uint64_t hash = 0;
+    };
+
+    struct Session {
+        Message pending;
+        Message processing;
+        Message lastProcessed;
+        bool hasPending = false;
+        bool isProcessing = false;
+        // whether the session is in mReadySessions
+        bool isReady = false;
+    };
+
+    void threadLoop();
+
+    const ProcessEcmFunction mProcessEcm;
+    const ProcessEmmFunction mProcessEmm;
+    const EcmProcessedFunction mOnEcmProcessed;
+    const EmmProcessedFunction mOnEmmProcessed;
+
+    mutable std::mutex mLock;
+    std::condition_variable mCondition;
+    bool mExiting = false;
+
+    std::map<CasSessionId, Session> mSessions;
+    // sessions with a pending ECM, in the order they became ready
+    std::deque<CasSessionId> mReadySessions;
+    std::deque<Message> mPendingEmms;
+    Message mEmmProcessing;
+    Message mLastProcessedEmm;
+    bool mProcessingEmm = false;
+
+    uint64_t mDroppedEcms = 0;
+    uint64_t mReplacedEcms = 0;
+    uint64_t mDroppedEmms = 0;
+
+    std::thread mThread;
+
+    DISALLOW_EVIL_CONSTRUCTORS(CasProcessingQueue);
+};
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace cas
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_CAS_V1_1_CAS_PROCESSING_QUEUE_H_
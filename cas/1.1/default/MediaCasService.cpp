@@ -17,6 +17,9 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "android.hardware.cas@1.1-MediaCasService"
 
+#include <unistd.h>
+
+#include <android-base/properties.h>
 #include <android/hardware/cas/1.1/ICasListener.h>
 #include <media/cas/CasAPI.h>
 #include <media/cas/DescramblerAPI.h>
@@ -61,7 +64,9 @@ class Wrapper : public V1_1::ICasListener {
 };
 
 MediaCasService::MediaCasService()
-    : mCasLoader("createCasFactory"), mDescramblerLoader("createDescramblerFactory") {}
+    : mCasLoader("createCasFactory"),
+      mDescramblerLoader("createDescramblerFactory"),
+      mAsyncProcessing(base::GetBoolProperty("ro.vendor.cas.async_processing", false)) {}
 
 MediaCasService::~MediaCasService() {}
 
@@ -89,7 +94,9 @@ Return<sp<V1_0::ICas>> MediaCasService::createPlugin(int32_t CA_system_id,
 
     sp<V1_1::ICasListener> listenerV1_1 = Wrapper::wrap(listener);
 
-    result = createPluginExt(CA_system_id, listenerV1_1);
+    // cas@1.0 listeners do not get session events, so they could not tell when an
+    // ECM has been processed
+    result = createCas(CA_system_id, listenerV1_1, false /* asyncProcessing */);
 
     return result;
 }
@@ -99,6 +106,11 @@ Return<sp<ICas>> MediaCasService::createPluginExt(int32_t CA_system_id,
     ALOGV("%s: CA_system_id=%d", __FUNCTION__, CA_system_id);
     if (listener == NULL) ALOGV("%s: Listener is NULL", __FUNCTION__);
 
+    return createCas(CA_system_id, listener, mAsyncProcessing);
+}
+
+sp<ICas> MediaCasService::createCas(int32_t CA_system_id, const sp<ICasListener>& listener,
+                                    bool asyncProcessing) {
     sp<ICas> result;
 
     CasFactory* factory;
@@ -110,6 +122,8 @@ Return<sp<ICas>> MediaCasService::createPluginExt(int32_t CA_system_id,
                     OK &&
             plugin != NULL) {
             casImpl->init(library, plugin);
+            casImpl->setStats(getPluginStats(CA_system_id));
+            casImpl->setAsyncProcessingEnabled(asyncProcessing);
             result = casImpl;
         }
     }
@@ -117,6 +131,35 @@ Return<sp<ICas>> MediaCasService::createPluginExt(int32_t CA_system_id,
     return result;
 }
 
+std::shared_ptr<CasPluginStats> MediaCasService::getPluginStats(int32_t CA_system_id) {
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    std::shared_ptr<CasPluginStats>& stats = mPluginStats[CA_system_id];
+    if (stats == nullptr) {
+        stats = std::make_shared<CasPluginStats>();
+    }
+    return stats;
+}
+
+Return<void> MediaCasService::debug(const hidl_handle& fd,
+                                    const hidl_vec<hidl_string>& /* options */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        return Void();
+    }
+
+    String8 out;
+    out.appendFormat("asynchronous processing: %s\n", mAsyncProcessing ? "enabled" : "disabled");
+    {
+        std::lock_guard<std::mutex> lock(mStatsLock);
+        for (const auto& entry : mPluginStats) {
+            out.appendFormat("CA system id %#x:\n", entry.first);
+            entry.second->ecm.appendTo("  processEcm", &out);
+            entry.second->emm.appendTo("  processEmm", &out);
+        }
+    }
+    write(fd->data[0], out.string(), out.size());
+    return Void();
+}
+
 Return<bool> MediaCasService::isDescramblerSupported(int32_t CA_system_id) {
     ALOGV("%s: CA_system_id=%d", __FUNCTION__, CA_system_id);
 
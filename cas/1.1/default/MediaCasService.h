@@ -19,6 +19,11 @@
 
 #include <android/hardware/cas/1.1/IMediaCasService.h>
 
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "CasProcessingQueue.h"
 #include "FactoryLoader.h"
 
 namespace android {
@@ -50,10 +55,22 @@ class MediaCasService : public IMediaCasService {
 
     virtual Return<sp<IDescramblerBase>> createDescrambler(int32_t CA_system_id) override;
 
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
    private:
+    sp<ICas> createCas(int32_t CA_system_id, const sp<ICasListener>& listener,
+                       bool asyncProcessing);
+    std::shared_ptr<CasPluginStats> getPluginStats(int32_t CA_system_id);
+
     FactoryLoader<CasFactory> mCasLoader;
     FactoryLoader<DescramblerFactory> mDescramblerLoader;
 
+    // whether the plugins of cas@1.1 clients process ECMs and EMMs asynchronously
+    const bool mAsyncProcessing;
+
+    std::mutex mStatsLock;
+    std::map<int32_t, std::shared_ptr<CasPluginStats>> mPluginStats;
+
     virtual ~MediaCasService();
 };
 
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "CasProcessingQueue.h"
+
+namespace android {
+namespace hardware {
+namespace cas {
+namespace V1_1 {
+namespace implementation {
+
+namespace {
+
+constexpr std::chrono::seconds kTimeout(5);
+
+const CasSessionId kSession1 = {1};
+const CasSessionId kSession2 = {2};
+
+class CasProcessingQueueTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        mQueue = std::make_unique<CasProcessingQueue>(
+                [this](const CasSessionId& sessionId, const CasEcm& ecm) {
+                    std::unique_lock<std::mutex> lock(mLock);
+                    mProcessingCount++;
+                    mCondition.notify_all();
+                    mCondition.wait(lock, [this] { return !mBlocked; });
+                    mEcms.push_back({sessionId, ecm});
+                    return mResult;
+                },
+                [this](const CasEmm& emm) {
+                    std::lock_guard<std::mutex> lock(mLock);
+                    mEmms.push_back(emm);
+                    return mResult;
+                },
+                [this](const CasSessionId& sessionId, status_t err) {
+                    if (mOnEcmProcessed) {
+                        mOnEcmProcessed(sessionId);
+                    }
+                    std::lock_guard<std::mutex> lock(mLock);
+                    mEcmResults.push_back(err);
+                    mCondition.notify_all();
+                },
+                [this](status_t err) {
+                    std::lock_guard<std::mutex> lock(mLock);
+                    mEmmResults.push_back(err);
+                    mCondition.notify_all();
+                });
+    }
+
+    void TearDown() override {
+        setBlocked(false);
+        mQueue.reset();
+    }
+
+    void setBlocked(bool blocked) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mBlocked = blocked;
+        mCondition.notify_all();
+    }
+
+    void setResult(status_t result) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mResult = result;
+    }
+
+    bool waitForProcessing(size_t count) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCondition.wait_for(lock, kTimeout, [this, count] {
+            return mProcessingCount >= count;
+        });
+    }
+
+    bool waitForEcmResults(size_t count) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCondition.wait_for(lock, kTimeout, [this, count] {
+            return mEcmResults.size() >= count;
+        });
+    }
+
+    bool waitForEmmResults(size_t count) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCondition.wait_for(lock, kTimeout, [this, count] {
+            return mEmmResults.size() >= count;
+        });
+    }
+
+    std::unique_ptr<CasProcessingQueue> mQueue;
+    std::function<void(const CasSessionId&)> mOnEcmProcessed;
+
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    bool mBlocked = false;
+    status_t mResult = OK;
+    size_t mProcessingCount = 0;
+    std::vector<std::pair<CasSessionId, CasEcm>> mEcms;
+    std::vector<CasEmm> mEmms;
+    std::vector<status_t> mEcmResults;
+    std::vector<status_t> mEmmResults;
+};
+
+}  // namespace
+
+TEST_F(CasProcessingQueueTest, newerEcmReplacesPending) {
+    setBlocked(true);
+    mQueue->queueEcm(kSession1, {1});
+    ASSERT_TRUE(waitForProcessing(1));
+
+    // the ECM being processed is dropped, the pending one is replaced by the newest
+    mQueue->queueEcm(kSession1, {1});
+    mQueue->queueEcm(kSession1, {2});
+    mQueue->queueEcm(kSession1, {3});
+    mQueue->queueEcm(kSession2, {1});
+    setBlocked(false);
+    ASSERT_TRUE(waitForEcmResults(3));
+
+    std::lock_guard<std::mutex> lock(mLock);
+    ASSERT_EQ(3u, mEcms.size());
+    ASSERT_EQ(kSession1, mEcms[0].first);
+    ASSERT_EQ(CasEcm({1}), mEcms[0].second);
+    ASSERT_EQ(kSession1, mEcms[1].first);
+    ASSERT_EQ(CasEcm({3}), mEcms[1].second);
+    ASSERT_EQ(kSession2, mEcms[2].first);
+    ASSERT_EQ(CasEcm({1}), mEcms[2].second);
+}
+
+TEST_F(CasProcessingQueueTest, repeatedEcmDroppedOnlyOnceProcessed) {
+    setResult(UNKNOWN_ERROR);
+    mQueue->queueEcm(kSession1, {1});
+    ASSERT_TRUE(waitForEcmResults(1));
+
+    // the failed ECM is not remembered
+    setResult(OK);
+    mQueue->queueEcm(kSession1, {1});
+    ASSERT_TRUE(waitForEcmResults(2));
+
+    mQueue->queueEcm(kSession1, {1});
+    mQueue->queueEcm(kSession1, {2});
+    ASSERT_TRUE(waitForEcmResults(3));
+
+    std::lock_guard<std::mutex> lock(mLock);
+    ASSERT_EQ(3u, mEcms.size());
+    ASSERT_EQ(CasEcm({2}), mEcms[2].second);
+    ASSERT_EQ(UNKNOWN_ERROR, mEcmResults[0]);
+    ASSERT_EQ(OK, mEcmResults[1]);
+}
+
+TEST_F(CasProcessingQueueTest, repeatedEmmDroppedOnlyOnceProcessed) {
+    setResult(UNKNOWN_ERROR);
+    mQueue->queueEmm({7});
+    ASSERT_TRUE(waitForEmmResults(1));
+
+    // the failed EMM is not remembered
+    setResult(OK);
+    mQueue->queueEmm({7});
+    ASSERT_TRUE(waitForEmmResults(2));
+
+    mQueue->queueEmm({7});
+    mQueue->queueEmm({8});
+    ASSERT_TRUE(waitForEmmResults(3));
+
+    std::lock_guard<std::mutex> lock(mLock);
+    ASSERT_EQ(3u, mEmms.size());
+    ASSERT_EQ(CasEmm({7}), mEmms[0]);
+    ASSERT_EQ(CasEmm({7}), mEmms[1]);
+    ASSERT_EQ(CasEmm({8}), mEmms[2]);
+}
+
+TEST_F(CasProcessingQueueTest, callbackMayUseQueue) {
+    // the ECM is done with by the time of the callback, so the repeat is dropped and
+    // removing the session does not wait on the callback itself
+    mOnEcmProcessed = [this](const CasSessionId& sessionId) {
+        mQueue->queueEcm(sessionId, {1});
+        mQueue->removeSession(sessionId);
+    };
+    mQueue->queueEcm(kSession1, {1});
+    ASSERT_TRUE(waitForEcmResults(1));
+
+    mOnEcmProcessed = nullptr;
+    mQueue->queueEcm(kSession2, {1});
+    ASSERT_TRUE(waitForEcmResults(2));
+
+    std::lock_guard<std::mutex> lock(mLock);
+    ASSERT_EQ(2u, mEcms.size());
+    ASSERT_EQ(kSession2, mEcms[1].first);
+}
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace cas
+}  // namespace hardware
+}  // namespace android
@@ -22,7 +22,8 @@ LOCAL_SHARED_LIBRARIES := \
     liblog \
     libutils \
     android.hardware.configstore@1.0 \
-    android.hardware.configstore@1.1
+    android.hardware.configstore@1.1 \
+    android.hardware.configstore-utils
 
 include $(BUILD_EXECUTABLE)
 
@@ -16,9 +16,18 @@
 
 #define LOG_TAG "android.hardware.configstore@1.1-service"
 
+#include <stdio.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <string>
+
+#include <android-base/file.h>
 #include <android/hardware/configstore/1.1/ISurfaceFlingerConfigs.h>
+#include <configstore/Utils.h>
 #include <hidl/HidlTransportSupport.h>
 #include <hwminijail/HardwareMinijail.h>
+#include <log/log.h>
 
 #include "SurfaceFlingerConfigs.h"
 
@@ -31,12 +40,68 @@ using android::hardware::SetupMinijail;
 using android::hardware::configstore::V1_1::ISurfaceFlingerConfigs;
 using android::hardware::configstore::V1_1::implementation::SurfaceFlingerConfigs;
 
+using android::hardware::configstore::V1_1::DisplayOrientation;
+
+static std::string toSnapshotValue(bool value) {
+    return value ? "true" : "false";
+}
+
+static std::string toSnapshotValue(DisplayOrientation value) {
+    return std::to_string(static_cast<uint32_t>(value));
+}
+
+template <typename T>
+static std::string toSnapshotValue(T value) {
+    return std::to_string(value);
+}
+
+// Writes the values served below in the format configstore-utils reads before falling back to
+// the service, so that clients starting after this point read them without a binder call.
+static void writeSnapshot(const sp<ISurfaceFlingerConfigs>& configs) {
+    using android::hardware::details::kSnapshotPath;
+
+    std::ostringstream snapshot;
+    auto entry = [&snapshot](const char* name) {
+        return [&snapshot, name](const auto& optional) {
+            snapshot << name;
+            if (optional.specified) {
+                snapshot << '=' << toSnapshotValue(optional.value);
+            }
+            snapshot << '\n';
+        };
+    };
+    configs->vsyncEventPhaseOffsetNs(entry("vsyncEventPhaseOffsetNs"));
+    configs->vsyncSfEventPhaseOffsetNs(entry("vsyncSfEventPhaseOffsetNs"));
+    configs->useContextPriority(entry("useContextPriority"));
+    configs->hasWideColorDisplay(entry("hasWideColorDisplay"));
+    configs->hasHDRDisplay(entry("hasHDRDisplay"));
+    configs->presentTimeOffsetFromVSyncNs(entry("presentTimeOffsetFromVSyncNs"));
+    configs->useHwcForRGBtoYUV(entry("useHwcForRGBtoYUV"));
+    configs->maxVirtualDisplaySize(entry("maxVirtualDisplaySize"));
+    configs->hasSyncFramework(entry("hasSyncFramework"));
+    configs->useVrFlinger(entry("useVrFlinger"));
+    configs->maxFrameBufferAcquiredBuffers(entry("maxFrameBufferAcquiredBuffers"));
+    configs->startGraphicsAllocatorService(entry("startGraphicsAllocatorService"));
+    configs->primaryDisplayOrientation(entry("primaryDisplayOrientation"));
+
+    // Written aside and renamed, so that readers never map a partial snapshot
+    const std::string tmpPath = std::string(kSnapshotPath) + ".tmp";
+    if (!android::base::WriteStringToFile(snapshot.str(), tmpPath, 0444, getuid(), getgid()) ||
+        rename(tmpPath.c_str(), kSnapshotPath) != 0) {
+        ALOGW("Could not write %s, clients will use the service", kSnapshotPath);
+        unlink(tmpPath.c_str());
+    }
+}
+
 int main() {
     configureRpcThreadpool(10, true);
 
+    sp<ISurfaceFlingerConfigs> surfaceFlingerConfigs = new SurfaceFlingerConfigs;
+    // Before entering the sandbox, which has no rename or unlink
+    writeSnapshot(surfaceFlingerConfigs);
+
     SetupMinijail("/vendor/etc/seccomp_policy/configstore@1.1.policy");
 
-    sp<ISurfaceFlingerConfigs> surfaceFlingerConfigs = new SurfaceFlingerConfigs;
     status_t status = surfaceFlingerConfigs->registerAsService();
     LOG_ALWAYS_FATAL_IF(status != OK, "Could not register ISurfaceFlingerConfigs");
 
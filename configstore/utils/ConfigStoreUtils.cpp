@@ -16,7 +16,16 @@
 
 #define LOG_TAG "ConfigStore"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <mutex>
+
 #include <android-base/logging.h>
+#include <android-base/unique_fd.h>
 #include <configstore/Utils.h>
 
 namespace android {
@@ -35,6 +44,65 @@ void logAlwaysError(const std::string& message) {
     LOG(ERROR) << message;
 }
 
+std::string getConfigName(const char* prettyFunction) {
+    // e.g. "... func = &android::hardware::configstore::V1_0::ISurfaceFlingerConfigs::
+    // hasWideColorDisplay]"
+    std::string name = prettyFunction;
+    auto pos = name.find("func = ");
+    if (pos == std::string::npos) {
+        return "";
+    }
+    name = name.substr(pos + strlen("func = "));
+    name = name.substr(0, name.find_first_of("];"));
+    pos = name.rfind("::");
+    return pos == std::string::npos ? name : name.substr(pos + 2);
+}
+
+bool getSnapshotValue(const std::string& name, bool* specified, std::string* value) {
+    // Mapped once for the life of the process; the snapshot is a few hundred bytes
+    static const char* snapshot = nullptr;
+    static size_t snapshotSize = 0;
+    static std::once_flag once;
+    std::call_once(once, [] {
+        base::unique_fd fd(TEMP_FAILURE_RETRY(open(kSnapshotPath, O_RDONLY | O_CLOEXEC)));
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+            return;
+        }
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            return;
+        }
+        snapshot = static_cast<const char*>(data);
+        snapshotSize = st.st_size;
+    });
+
+    if (name.empty()) {
+        return false;
+    }
+    const char* end = snapshot + snapshotSize;
+    for (const char* line = snapshot; line < end;) {
+        const char* lineEnd = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        const size_t length = lineEnd - line;
+        if (length >= name.size() && memcmp(line, name.data(), name.size()) == 0) {
+            if (length == name.size()) {
+                *specified = false;
+                return true;
+            }
+            if (line[name.size()] == '=') {
+                *specified = true;
+                value->assign(line + name.size() + 1, lineEnd);
+                return true;
+            }
+        }
+        line = lineEnd + 1;
+    }
+    return false;
+}
+
 }  // namespace details
 }  // namespace hardware
 }  // namespace android
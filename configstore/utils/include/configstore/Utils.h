@@ -17,6 +17,8 @@
 #ifndef ANDROID_HARDWARE_CONFIGSTORE_UTILS_H
 #define ANDROID_HARDWARE_CONFIGSTORE_UTILS_H
 
+#include <android-base/parsebool.h>
+#include <android-base/parseint.h>
 #include <android/hardware/configstore/1.0/types.h>
 #include <android/hardware/configstore/1.1/types.h>
 #include <hidl/Status.h>
@@ -32,6 +34,59 @@ namespace details {
 bool wouldLogVerbose();
 void logAlwaysVerbose(const std::string& message);
 void logAlwaysError(const std::string& message);
+
+// The configstore service writes the values it serves to kSnapshotPath at startup, one
+// "name=value" line per method, or just "name" for a value it does not specify. Reading
+// them from there spares the hwbinder lookup and one transaction per value.
+constexpr char kSnapshotPath[] = "/dev/configstore/snapshot";
+
+// Returns the method name from the __PRETTY_FUNCTION__ of get() below.
+std::string getConfigName(const char* prettyFunction);
+
+// Returns false when there is no snapshot or it lacks the name. Otherwise *specified tells
+// whether the service specifies the value, and *value holds it.
+bool getSnapshotValue(const std::string& name, bool* specified, std::string* value);
+
+inline bool parseSnapshotValue(const std::string& str, bool* out) {
+    switch (::android::base::ParseBool(str)) {
+        case ::android::base::ParseBoolResult::kTrue:
+            *out = true;
+            return true;
+        case ::android::base::ParseBoolResult::kFalse:
+            *out = false;
+            return true;
+        default:
+            return false;
+    }
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, bool>::type
+parseSnapshotValue(const std::string& str, T* out) {
+    return ::android::base::ParseInt(str, out);
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value, bool>::type
+parseSnapshotValue(const std::string& str, T* out) {
+    return ::android::base::ParseUint(str, out);
+}
+
+template <typename T>
+typename std::enable_if<std::is_enum<T>::value, bool>::type
+parseSnapshotValue(const std::string& str, T* out) {
+    typename std::underlying_type<T>::type value;
+    if (!parseSnapshotValue(str, &value)) {
+        return false;
+    }
+    *out = static_cast<T>(value);
+    return true;
+}
+
+inline bool parseSnapshotValue(const std::string& str, hidl_string* out) {
+    *out = str;
+    return true;
+}
 }  // namespace details
 
 namespace configstore {
@@ -67,8 +122,16 @@ template<typename V, typename I, android::hardware::Return<void> (I::* func)
 decltype(V::value) get(const decltype(V::value) &defValue) {
     using namespace android::hardware::details;
     // static initializer used for synchronizations
-    auto getHelper = []()->V {
+    auto getHelper = [](const char* prettyFunction)->V {
         V ret;
+        bool specified;
+        std::string value;
+        if (getSnapshotValue(getConfigName(prettyFunction), &specified, &value) &&
+            (!specified || parseSnapshotValue(value, &ret.value))) {
+            ret.specified = specified;
+            return ret;
+        }
+
         sp<I> configs = getService<I>();
 
         if (!configs.get()) {
@@ -90,7 +153,7 @@ decltype(V::value) get(const decltype(V::value) &defValue) {
 
         return ret;
     };
-    static V cachedValue = getHelper();
+    static V cachedValue = getHelper(__PRETTY_FUNCTION__);
 
     if (wouldLogVerbose()) {
         std::string iname = __PRETTY_FUNCTION__;
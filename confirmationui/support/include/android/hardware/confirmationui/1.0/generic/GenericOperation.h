@@ -73,9 +73,9 @@ class Operation {
         // to read it from the shared buffer directly. Anyway we don't trust or interpret the
         // extra data in any way so all we do is take a snapshot and we don't care if it is
         // modified concurrently.
-        auto state = write(WriteState(formattedMessageBuffer_),
-                           map(pair(text("prompt"), text(promptStringBuffer_, promptText.size())),
-                               pair(text("extra"), bytes(extraData))));
+        auto state = writeConfirmationMessage(WriteState(formattedMessageBuffer_),
+                                              text(promptStringBuffer_, promptText.size()),
+                                              bytes(extraData));
         switch (state.error_) {
             case Error::OK:
                 break;
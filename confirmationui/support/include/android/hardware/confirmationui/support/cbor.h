@@ -327,6 +327,105 @@ WriteState write(WriteState wState, const Head& head, const Tail&... tail) {
     return write(wState, tail...);
 }
 
+/**
+ * Encodes a text string key whose content is known at compile time. The encoded form is the one
+ * byte header followed by the characters without the terminating 0, so the whole encoding
+ * occupies exactly size bytes.
+ */
+template <size_t size>
+struct ConstTextKey {
+    uint8_t bytes_[size];
+    constexpr ConstTextKey(const char (&str)[size]) : bytes_{} {
+        static_assert(size > 0 && size - 1 < 24, "key does not fit into a one byte header");
+        bytes_[0] = (static_cast<uint8_t>(Type::TEXT_STRING) << 5) | static_cast<uint8_t>(size - 1);
+        for (size_t i = 1; i < size; ++i) {
+            bytes_[i] = static_cast<uint8_t>(str[i - 1]);
+        }
+    }
+};
+
+template <size_t size>
+WriteState writeRaw(WriteState wState, const uint8_t (&raw)[size]) {
+    if (!wState) return wState;
+    uint8_t* buffer = wState.data_;
+    wState += size;
+    if (!wState) return wState;
+    copy(raw, raw + size, buffer);
+    return wState;
+}
+
+/**
+ * Formats the ConfirmationUI message {"prompt": prompt, "extra": extra}. The output is byte for
+ * byte what write(wState, map(pair(text("prompt"), prompt), pair(text("extra"), extra))) yields,
+ * but the map header and both keys are encoded at compile time, so only the two length headers
+ * and the payloads are produced at run time.
+ */
+template <typename P, typename E>
+WriteState writeConfirmationMessage(WriteState wState, const StringBuffer<P, TextStr>& prompt,
+                                    const StringBuffer<E, ByteStr>& extra) {
+    static constexpr uint8_t kMapHeader[] = {(static_cast<uint8_t>(Type::MAP) << 5) | 2};
+    static constexpr ConstTextKey<sizeof("prompt")> kPromptKey("prompt");
+    static constexpr ConstTextKey<sizeof("extra")> kExtraKey("extra");
+    wState = writeRaw(wState, kMapHeader);
+    wState = writeRaw(wState, kPromptKey.bytes_);
+    wState = write(wState, prompt);
+    wState = writeRaw(wState, kExtraKey.bytes_);
+    return write(wState, extra);
+}
+
+/**
+ * Single pass CBOR writer for strings and containers whose length is not known when they are
+ * started. open() reserves room for the largest possible header in the caller supplied arena and
+ * close() back-patches the minimal header and moves the payload down behind it. So the output is
+ * identical to what write() produces when the length is known up front.
+ *
+ * Items are added to the innermost open container with operator<<, payload bytes are appended to
+ * an open string with append(). Text strings are checked for well formed UTF-8 when closed.
+ */
+class StreamWriter {
+   public:
+    static constexpr size_t kMaxDepth = 8;
+    static constexpr size_t kMaxHeaderSize = 9;
+
+    explicit StreamWriter(const WriteState& wState) : wState_(wState), depth_(0) {}
+
+    bool open(Type type);
+    bool close();
+    StreamWriter& append(const uint8_t* data, size_t size);
+    StreamWriter& append(const char* data, size_t size) {
+        return append(reinterpret_cast<const uint8_t*>(data), size);
+    }
+
+    template <typename T>
+    StreamWriter& operator<<(const T& v) {
+        if (!countItem()) return *this;
+        wState_ = write(wState_, v);
+        return *this;
+    }
+
+    /**
+     * Returns the write state after the last item. If there are still open items the error is
+     * MALFORMED.
+     */
+    WriteState state() const {
+        if (wState_ && depth_) return WriteState(wState_.data_, wState_.size_, Error::MALFORMED);
+        return wState_;
+    }
+
+   private:
+    struct Frame {
+        Type type;
+        uint8_t* header;
+        uint64_t items;
+    };
+
+    bool countItem();
+
+    WriteState wState_;
+    Frame frames_[kMaxDepth];
+    size_t depth_;
+};
+
 }  // namespace support
 }  // namespace confirmationui
 }  // namespace hardware
@@ -17,6 +17,8 @@
 
 #include <android/hardware/confirmationui/support/cbor.h>
 
+#include <string.h>
+
 namespace android {
 namespace hardware {
 namespace confirmationui {
@@ -101,13 +103,108 @@ bool checkUTF8Copy(const char* begin, const char* const end, uint8_t* out) {
             // header thus > 3
             if (multi_byte_length > 3) return false;
         }
-        if (out) *out++ = *reinterpret_cast<const uint8_t*>(begin++);
+        if (out) *out++ = *reinterpret_cast<const uint8_t*>(begin);
+        ++begin;
     }
     // if the string ends in the middle of a multi byte char it is invalid
     if (multi_byte_length) return false;
     return true;
 }
 
+bool StreamWriter::countItem() {
+    if (!wState_) return false;
+    if (depth_) {
+        Frame& top = frames_[depth_ - 1];
+        if (top.type == Type::TEXT_STRING || top.type == Type::BYTE_STRING) {
+            // strings take payload bytes through append() only
+            wState_.error_ = Error::MALFORMED;
+            return false;
+        }
+        ++top.items;
+    }
+    return true;
+}
+
+bool StreamWriter::open(Type type) {
+    switch (type) {
+        case Type::BYTE_STRING:
+        case Type::TEXT_STRING:
+        case Type::ARRAY:
+        case Type::MAP:
+            break;
+        default:
+            wState_.error_ = Error::MALFORMED;
+            return false;
+    }
+    if (!countItem()) return false;
+    if (depth_ == kMaxDepth) {
+        wState_.error_ = Error::MALFORMED;
+        return false;
+    }
+    uint8_t* header = wState_.data_;
+    if (!(wState_ += kMaxHeaderSize)) return false;
+    frames_[depth_++] = {type, header, 0};
+    return true;
+}
+
+StreamWriter& StreamWriter::append(const uint8_t* data, size_t size) {
+    if (!wState_) return *this;
+    if (!depth_ || (frames_[depth_ - 1].type != Type::TEXT_STRING &&
+                    frames_[depth_ - 1].type != Type::BYTE_STRING)) {
+        wState_.error_ = Error::MALFORMED;
+        return *this;
+    }
+    uint8_t* buffer = wState_.data_;
+    if (!(wState_ += size)) return *this;
+    copy(data, data + size, buffer);
+    return *this;
+}
+
+bool StreamWriter::close() {
+    if (!wState_) return false;
+    if (!depth_) {
+        wState_.error_ = Error::MALFORMED;
+        return false;
+    }
+    const Frame& frame = frames_[--depth_];
+    uint8_t* payload = frame.header + kMaxHeaderSize;
+    size_t payloadSize = wState_.data_ - payload;
+    uint64_t length = frame.items;
+    switch (frame.type) {
+        case Type::TEXT_STRING:
+            if (!checkUTF8Copy(reinterpret_cast<const char*>(payload),
+                               reinterpret_cast<const char*>(payload + payloadSize), nullptr)) {
+                wState_.error_ = Error::MALFORMED_UTF8;
+                return false;
+            }
+            [[fallthrough]];
+        case Type::BYTE_STRING:
+            length = payloadSize;
+            break;
+        case Type::MAP:
+            if (length & 1) {
+                // a key without a value
+                wState_.error_ = Error::MALFORMED;
+                return false;
+            }
+            length /= 2;
+            break;
+        default:
+            break;
+    }
+    WriteState headerState = writeHeader(WriteState(frame.header, kMaxHeaderSize), frame.type,
+                                         length);
+    if (!headerState) {
+        wState_.error_ = headerState.error_;
+        return false;
+    }
+    size_t headerSize = headerState.data_ - frame.header;
+    memmove(frame.header + headerSize, payload, payloadSize);
+    wState_ = WriteState(frame.header + headerSize + payloadSize,
+                         wState_.size_ + (kMaxHeaderSize - headerSize));
+    return true;
+}
+
 }  // namespace support
 }  // namespace confirmationui
 }  // namespace hardware
@@ -195,3 +195,83 @@ TEST(Cbor, MinimalViableHeaderSizeTest) {
     state = writeHeader(state, Type::NUMBER, 0xffffffffffffffff);
     ASSERT_EQ(state.data_ - buffer, 9);
 }
+
+TEST(Cbor, ConfirmationMessageMatchesGenericWriter) {
+    uint8_t expected[0x1000];
+    uint8_t buffer[0x1000];
+    uint8_t extra[300];
+    for (size_t i = 0; i < sizeof(extra); ++i) extra[i] = i;
+    auto expectedState = write(WriteState(expected), map(pair(text("prompt"), text(fourHundredAs)),
+                                                         pair(text("extra"), bytes(extra))));
+    ASSERT_EQ(Error::OK, expectedState.error_);
+    auto state = writeConfirmationMessage(WriteState(buffer), text(fourHundredAs), bytes(extra));
+    ASSERT_EQ(Error::OK, state.error_);
+    ASSERT_EQ(expectedState.data_ - expected, state.data_ - buffer);
+    ASSERT_EQ(0, memcmp(buffer, expected, state.data_ - buffer));
+
+    char malformed[] = {char(0xc0), 0};
+    state = writeConfirmationMessage(WriteState(buffer), text(malformed), bytes(extra));
+    ASSERT_EQ(Error::MALFORMED_UTF8, state.error_);
+
+    state = writeConfirmationMessage(WriteState(buffer, 100), text(fourHundredAs), bytes(extra));
+    ASSERT_EQ(Error::OUT_OF_DATA, state.error_);
+}
+
+TEST(Cbor, StreamWriterMatchesFeatureTest) {
+    uint8_t buffer[0x1000];
+    StreamWriter writer{WriteState(buffer)};
+    writer.open(Type::MAP);
+    writer << text("key") << text("value");
+    writer << text("key");
+    writer.open(Type::BYTE_STRING);
+    // bytes("100101010010") keeps the terminating 0
+    constexpr char value[] = "100101010010";
+    writer.append(value, 6).append(value + 6, sizeof(value) - 6);
+    writer.close();
+    writer << 4 << 7 << (UINT64_C(1) << 62) << INT64_C(-2000000000000000);
+    writer.close();
+    writer.open(Type::ARRAY);
+    writer.open(Type::TEXT_STRING);
+    writer.append("♨⚖ⶖ", sizeof("♨⚖ⶖ") - 1);
+    writer.close();
+    writer.open(Type::BYTE_STRING);
+    for (size_t i = 0; i < sizeof(fourHundredAs); i += 100) {
+        size_t chunk = sizeof(fourHundredAs) - i < 100 ? sizeof(fourHundredAs) - i : 100;
+        writer.append(fourHundredAs + i, chunk);
+    }
+    writer.close();
+    writer.close();
+    auto state = writer.state();
+    ASSERT_EQ(Error::OK, state.error_);
+    ASSERT_EQ(sizeof(testVector), size_t(state.data_ - buffer));
+    ASSERT_EQ(0, memcmp(buffer, testVector, sizeof(testVector)));
+}
+
+TEST(Cbor, StreamWriterMalformed) {
+    uint8_t buffer[0x100];
+    {
+        StreamWriter writer{WriteState(buffer)};
+        writer.open(Type::MAP);
+        writer << text("key");
+        ASSERT_FALSE(writer.close());
+        ASSERT_EQ(Error::MALFORMED, writer.state().error_);
+    }
+    {
+        StreamWriter writer{WriteState(buffer)};
+        writer.open(Type::TEXT_STRING);
+        char malformed[] = {char(0x80)};
+        writer.append(malformed, sizeof(malformed));
+        ASSERT_FALSE(writer.close());
+        ASSERT_EQ(Error::MALFORMED_UTF8, writer.state().error_);
+    }
+    {
+        StreamWriter writer{WriteState(buffer)};
+        writer.open(Type::ARRAY);
+        ASSERT_EQ(Error::MALFORMED, writer.state().error_);
+    }
+    {
+        StreamWriter writer{WriteState(buffer, 4)};
+        writer.open(Type::BYTE_STRING);
+        ASSERT_EQ(Error::OUT_OF_DATA, writer.state().error_);
+    }
+}
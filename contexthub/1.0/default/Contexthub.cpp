@@ -18,6 +18,9 @@
 
 #include <inttypes.h>
 
+#include <sstream>
+
+#include <android-base/file.h>
 #include <log/log.h>
 
 #include <android/hardware/contexthub/1.0/IContexthub.h>
@@ -161,14 +164,16 @@ Return<Result> Contexthub::sendMessageToHub(uint32_t hubId,
         txMsg.message = &dummy;
     }
 
-    ALOGI("Sending msg of type %" PRIu32 ", size %" PRIu32 " to app 0x%" PRIx64,
+    ALOGV("Sending msg of type %" PRIu32 ", size %" PRIu32 " to app 0x%" PRIx64,
           txMsg.message_type,
           txMsg.message_len,
           txMsg.app_name.id);
 
+    auto start = std::chrono::steady_clock::now();
     if(mContextHubModule->send_message(hubId, &txMsg) != 0) {
         return Result::TRANSACTION_FAILED;
     }
+    recordTraffic(hubId, txMsg.app_name.id, true, txMsg.message_len, start);
 
     return Result::OK;
 }
@@ -291,19 +296,18 @@ int Contexthub::handleOsMessage(sp<IContexthubCallback> cb,
 
         case CONTEXT_HUB_QUERY_APPS:
         {
-            std::vector<HubAppInfo> apps;
+            hidl_vec<HubAppInfo> apps;
             int numApps = msgLen / sizeof(hub_app_info);
             const hub_app_info *unalignedInfoAddr = reinterpret_cast<const hub_app_info *>(msg);
 
+            apps.resize(numApps);
             for (int i = 0; i < numApps; i++) {
                 hub_app_info query_info;
                 memcpy(&query_info, &unalignedInfoAddr[i], sizeof(query_info));
-                HubAppInfo app;
+                HubAppInfo &app = apps[i];
                 app.appId = query_info.app_name.id;
                 app.version = query_info.version;
                 // TODO :: Add memory ranges
-
-                apps.push_back(app);
             }
 
             if (cb != nullptr) {
@@ -384,11 +388,15 @@ int Contexthub::contextHubCb(uint32_t hubId,
         msg.appName = rxMsg->app_name.id;
         msg.msgType = rxMsg->message_type;
         msg.hostEndPoint = static_cast<uint16_t>(HostEndPoint::BROADCAST);
-        msg.msg = std::vector<uint8_t>(static_cast<const uint8_t *>(rxMsg->message),
-                                       static_cast<const uint8_t *>(rxMsg->message) +
-                                       rxMsg->message_len);
+        // handleClientMsg() is synchronous, so the payload can be referenced in place
+        // rather than copied; the legacy HAL keeps it alive until this callback returns.
+        msg.msg.setToExternal(
+                const_cast<uint8_t *>(static_cast<const uint8_t *>(rxMsg->message)),
+                rxMsg->message_len);
 
+        auto start = std::chrono::steady_clock::now();
         cb->handleClientMsg(msg);
+        obj->recordTraffic(hubId, msg.appName, false, rxMsg->message_len, start);
     }
 
     return 0;
@@ -459,14 +467,17 @@ Return<Result> Contexthub::loadNanoApp(uint32_t hubId,
     };
     const uint8_t *headerBytes = reinterpret_cast<const uint8_t *>(&header);
 
-    std::vector<uint8_t> binaryWithHeader(appBinary.customBinary);
-    binaryWithHeader.insert(binaryWithHeader.begin(),
-                            headerBytes,
-                            headerBytes + sizeof(header));
+    // Sized once so the binary is copied a single time, straight behind the header.
+    mLoadMessage.clear();
+    mLoadMessage.reserve(sizeof(header) + appBinary.customBinary.size());
+    mLoadMessage.insert(mLoadMessage.end(), headerBytes, headerBytes + sizeof(header));
+    mLoadMessage.insert(mLoadMessage.end(),
+                        appBinary.customBinary.begin(),
+                        appBinary.customBinary.end());
 
     hubMsg.message_type = CONTEXT_HUB_LOAD_APP;
-    hubMsg.message_len = binaryWithHeader.size();
-    hubMsg.message = binaryWithHeader.data();
+    hubMsg.message_len = mLoadMessage.size();
+    hubMsg.message = mLoadMessage.data();
 
     if (mContextHubModule->send_message(hubId, &hubMsg) != 0) {
         return Result::TRANSACTION_FAILED;
@@ -569,6 +580,63 @@ Return<Result> Contexthub::queryApps(uint32_t hubId) {
     return Result::OK;
 }
 
+void Contexthub::NanoAppStats::record(size_t len, std::chrono::nanoseconds latency) {
+    messages++;
+    bytes += len;
+    totalLatency += latency;
+    if (latency > maxLatency) {
+        maxLatency = latency;
+    }
+}
+
+void Contexthub::recordTraffic(uint32_t hubId, uint64_t appId, bool toHub, size_t len,
+                               std::chrono::steady_clock::time_point start) {
+    auto latency = std::chrono::steady_clock::now() - start;
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    NanoAppTraffic &traffic = mNanoAppTraffic[std::make_pair(hubId, appId)];
+    (toHub ? traffic.toHub : traffic.toHost).record(len, latency);
+}
+
+Return<void> Contexthub::debug(const hidl_handle &handle, const hidl_vec<hidl_string> &) {
+    if (handle == nullptr || handle->numFds < 1) {
+        return Void();
+    }
+
+    int fd = handle->data[0];
+    std::stringstream output;
+
+    auto dumpStats = [&output](const char *direction, const NanoAppStats &stats) {
+        using std::chrono::duration_cast;
+        using std::chrono::microseconds;
+
+        if (stats.messages == 0) {
+            return;
+        }
+        output << "  " << direction << ": " << stats.messages << " msgs, " << stats.bytes
+               << " bytes, latency avg "
+               << duration_cast<microseconds>(stats.totalLatency / stats.messages).count()
+               << "us max " << duration_cast<microseconds>(stats.maxLatency).count() << "us"
+               << std::endl;
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(mStatsLock);
+        for (const auto &entry : mNanoAppTraffic) {
+            char appId[19];
+            snprintf(appId, sizeof(appId), "0x%016" PRIx64, entry.first.second);
+            output << "hub " << entry.first.first << " app " << appId << std::endl;
+            dumpStats("to hub", entry.second.toHub);
+            dumpStats("to host", entry.second.toHost);
+        }
+    }
+
+    if (!base::WriteStringToFd(output.str(), fd)) {
+        ALOGW("debug: cannot write to fd");
+    }
+
+    return Void();
+}
+
 bool Contexthub::isInitialized() {
     return (mInitCheck == OK && mContextHubModule != nullptr);
 }
@@ -17,7 +17,11 @@
 #ifndef ANDROID_HARDWARE_CONTEXTHUB_V1_0_CONTEXTHUB_H_
 #define ANDROID_HARDWARE_CONTEXTHUB_V1_0_CONTEXTHUB_H_
 
+#include <chrono>
+#include <map>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #include <android-base/macros.h>
 #include <android/hardware/contexthub/1.0/IContexthub.h>
@@ -60,6 +64,8 @@ struct Contexthub : public ::android::hardware::contexthub::V1_0::IContexthub {
 
     Return<Result> reboot(uint32_t hubId);
 
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override;
+
     bool isInitialized();
 
 private:
@@ -81,6 +87,23 @@ private:
         sp<Contexthub> mContexthub;
     };
 
+    // Per nanoapp traffic counters, reported through debug(). Latencies are the time spent
+    // in the legacy HAL send_message for messages to the hub and in handleClientMsg for
+    // messages to the host.
+    struct NanoAppStats {
+        uint64_t messages = 0;
+        uint64_t bytes = 0;
+        std::chrono::nanoseconds totalLatency{0};
+        std::chrono::nanoseconds maxLatency{0};
+
+        void record(size_t len, std::chrono::nanoseconds latency);
+    };
+
+    struct NanoAppTraffic {
+        NanoAppStats toHub;
+        NanoAppStats toHost;
+    };
+
     status_t mInitCheck;
     const struct context_hub_module_t *mContextHubModule;
     std::unordered_map<uint32_t, CachedHubInformation> mCachedHubInfo;
@@ -89,6 +112,14 @@ private:
     bool mIsTransactionPending;
     uint32_t mTransactionId;
 
+    // The load message sent last. The legacy HAL copies the message in send_message, this only
+    // keeps the capacity around.
+    std::vector<uint8_t> mLoadMessage;
+
+    std::mutex mStatsLock;
+    // keyed by (hubId, appId)
+    std::map<std::pair<uint32_t, uint64_t>, NanoAppTraffic> mNanoAppTraffic;
+
     bool isValidHubId(uint32_t hubId);
 
     sp<IContexthubCallback> getCallBackForHubId(uint32_t hubId);
@@ -107,6 +138,9 @@ private:
 
     bool setOsAppAsDestination(hub_message_t *msg, int hubId);
 
+    void recordTraffic(uint32_t hubId, uint64_t appId, bool toHub, size_t len,
+                       std::chrono::steady_clock::time_point start);
+
     DISALLOW_COPY_AND_ASSIGN(Contexthub);
 };
 
@@ -34,30 +34,31 @@ namespace implementation {
     // Methods from ::android::hardware::drm::V1_0::ICryptoFactory follow.
     Return<bool> CryptoFactory::isCryptoSchemeSupported(
             const hidl_array<uint8_t, 16>& uuid) {
-        for (size_t i = 0; i < loader.factoryCount(); i++) {
-            if (loader.getFactory(i)->isCryptoSchemeSupported(uuid.data())) {
-                return true;
-            }
-        }
-        return false;
+        return loader.isSupported(PluginIndex::schemeQuery(uuid.data()),
+                [&uuid](android::CryptoFactory* plugin) {
+                    return plugin->isCryptoSchemeSupported(uuid.data());
+                });
     }
 
     Return<void> CryptoFactory::createPlugin(const hidl_array<uint8_t, 16>& uuid,
             const hidl_vec<uint8_t>& initData, createPlugin_cb _hidl_cb) {
-        for (size_t i = 0; i < loader.factoryCount(); i++) {
-            if (loader.getFactory(i)->isCryptoSchemeSupported(uuid.data())) {
-                android::CryptoPlugin *legacyPlugin = NULL;
-                status_t status = loader.getFactory(i)->createPlugin(uuid.data(),
-                        initData.data(), initData.size(), &legacyPlugin);
-                CryptoPlugin *newPlugin = NULL;
-                if (legacyPlugin == NULL) {
-                    ALOGE("Crypto legacy HAL: failed to create crypto plugin");
-                } else {
-                    newPlugin = new CryptoPlugin(legacyPlugin);
-                }
-                _hidl_cb(toStatus(status), newPlugin);
-                return Void();
+        android::CryptoFactory *factory = loader.findFactory(
+                PluginIndex::schemeQuery(uuid.data()),
+                [&uuid](android::CryptoFactory* plugin) {
+                    return plugin->isCryptoSchemeSupported(uuid.data());
+                });
+        if (factory != NULL) {
+            android::CryptoPlugin *legacyPlugin = NULL;
+            status_t status = factory->createPlugin(uuid.data(),
+                    initData.data(), initData.size(), &legacyPlugin);
+            CryptoPlugin *newPlugin = NULL;
+            if (legacyPlugin == NULL) {
+                ALOGE("Crypto legacy HAL: failed to create crypto plugin");
+            } else {
+                newPlugin = new CryptoPlugin(legacyPlugin);
             }
+            _hidl_cb(toStatus(status), newPlugin);
+            return Void();
         }
         _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, NULL);
         return Void();
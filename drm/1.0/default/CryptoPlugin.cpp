@@ -54,31 +54,24 @@ namespace implementation {
         sp<IMemory> hidlMemory = mapMemory(base);
 
         // allow mapMemory to return nullptr
-        mSharedBufferMap[bufferId] = hidlMemory;
+        SharedBufferSlot& slot = bufferId < kSharedBufferSlots
+                ? mSharedBufferSlots[bufferId] : mSharedBufferMap[bufferId];
+        slot.set = true;
+        slot.memory = hidlMemory;
         return Void();
     }
 
-    Return<void> CryptoPlugin::decrypt(bool secure,
-            const hidl_array<uint8_t, 16>& keyId,
-            const hidl_array<uint8_t, 16>& iv, Mode mode,
-            const Pattern& pattern, const hidl_vec<SubSample>& subSamples,
-            const SharedBuffer& source, uint64_t offset,
-            const DestinationBuffer& destination,
-            decrypt_cb _hidl_cb) {
-
-        if (mSharedBufferMap.find(source.bufferId) == mSharedBufferMap.end()) {
-            _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "source decrypt buffer base not set");
-            return Void();
-        }
-
-        if (destination.type == BufferType::SHARED_MEMORY) {
-            const SharedBuffer& dest = destination.nonsecureMemory;
-            if (mSharedBufferMap.find(dest.bufferId) == mSharedBufferMap.end()) {
-                _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "destination decrypt buffer base not set");
-                return Void();
-            }
+    const CryptoPlugin::SharedBufferSlot* CryptoPlugin::findSharedBuffer(
+            uint32_t bufferId) const {
+        if (bufferId < kSharedBufferSlots) {
+            const SharedBufferSlot& slot = mSharedBufferSlots[bufferId];
+            return slot.set ? &slot : nullptr;
         }
+        auto it = mSharedBufferMap.find(bufferId);
+        return it == mSharedBufferMap.end() ? nullptr : &it->second;
+    }
 
+    static android::CryptoPlugin::Mode toLegacyMode(Mode mode) {
         android::CryptoPlugin::Mode legacyMode;
         switch(mode) {
         case Mode::UNENCRYPTED:
@@ -94,12 +87,46 @@ namespace implementation {
             legacyMode = android::CryptoPlugin::kMode_AES_CBC;
             break;
         }
+        return legacyMode;
+    }
+
+    static android::CryptoPlugin::Pattern toLegacyPattern(const Pattern& pattern) {
         android::CryptoPlugin::Pattern legacyPattern;
         legacyPattern.mEncryptBlocks = pattern.encryptBlocks;
         legacyPattern.mSkipBlocks = pattern.skipBlocks;
+        return legacyPattern;
+    }
+
+    Status CryptoPlugin::decryptUnit(bool secure, const uint8_t keyId[16],
+            const uint8_t iv[16], android::CryptoPlugin::Mode mode,
+            const android::CryptoPlugin::Pattern& pattern,
+            const hidl_vec<SubSample>& subSamples, const SharedBuffer& source,
+            uint64_t offset, const DestinationBuffer& destination,
+            uint64_t destOffset, uint32_t* bytesWritten,
+            AString* detailMessage) {
+        *bytesWritten = 0;
+
+        const SharedBufferSlot* sourceSlot = findSharedBuffer(source.bufferId);
+        if (sourceSlot == nullptr) {
+            detailMessage->setTo("source decrypt buffer base not set");
+            return Status::ERROR_DRM_CANNOT_HANDLE;
+        }
+
+        const SharedBufferSlot* destSlot = nullptr;
+        if (destination.type == BufferType::SHARED_MEMORY) {
+            const SharedBuffer& dest = destination.nonsecureMemory;
+            destSlot = findSharedBuffer(dest.bufferId);
+            if (destSlot == nullptr) {
+                detailMessage->setTo("destination decrypt buffer base not set");
+                return Status::ERROR_DRM_CANNOT_HANDLE;
+            }
+        }
 
-        std::unique_ptr<android::CryptoPlugin::SubSample[]> legacySubSamples =
-                std::make_unique<android::CryptoPlugin::SubSample[]>(subSamples.size());
+        // The legacy plugin takes a plain array. Reuse one per binder thread
+        // rather than allocating it for every access unit.
+        static thread_local std::vector<android::CryptoPlugin::SubSample>
+                legacySubSamples;
+        legacySubSamples.resize(subSamples.size());
 
         for (size_t i = 0; i < subSamples.size(); i++) {
             legacySubSamples[i].mNumBytesOfClearData
@@ -108,16 +135,15 @@ namespace implementation {
                 = subSamples[i].numBytesOfEncryptedData;
         }
 
-        AString detailMessage;
-        sp<IMemory> sourceBase = mSharedBufferMap[source.bufferId];
+        const sp<IMemory>& sourceBase = sourceSlot->memory;
         if (sourceBase == nullptr) {
-            _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "source is a nullptr");
-            return Void();
+            detailMessage->setTo("source is a nullptr");
+            return Status::ERROR_DRM_CANNOT_HANDLE;
         }
 
         if (source.offset + offset + source.size > sourceBase->getSize()) {
-            _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "invalid buffer size");
-            return Void();
+            detailMessage->setTo("invalid buffer size");
+            return Status::ERROR_DRM_CANNOT_HANDLE;
         }
 
         uint8_t *base = static_cast<uint8_t *>
@@ -127,41 +153,80 @@ namespace implementation {
         void *destPtr = NULL;
         if (destination.type == BufferType::SHARED_MEMORY) {
             const SharedBuffer& destBuffer = destination.nonsecureMemory;
-            sp<IMemory> destBase = mSharedBufferMap[destBuffer.bufferId];
+            const sp<IMemory>& destBase = destSlot->memory;
             if (destBase == nullptr) {
-                _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "destination is a nullptr");
-                return Void();
+                detailMessage->setTo("destination is a nullptr");
+                return Status::ERROR_DRM_CANNOT_HANDLE;
             }
 
-            if (destBuffer.offset + destBuffer.size > destBase->getSize()) {
-                _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "invalid buffer size");
-                return Void();
+            if (destBuffer.offset + destOffset + destBuffer.size > destBase->getSize()) {
+                detailMessage->setTo("invalid buffer size");
+                return Status::ERROR_DRM_CANNOT_HANDLE;
             }
-            destPtr = static_cast<void *>(base + destination.nonsecureMemory.offset);
+            destPtr = static_cast<void *>(base + destination.nonsecureMemory.offset
+                    + destOffset);
         } else if (destination.type == BufferType::NATIVE_HANDLE) {
             native_handle_t *handle = const_cast<native_handle_t *>(
                     destination.secureMemory.getNativeHandle());
             destPtr = static_cast<void *>(handle);
         }
-        ssize_t result = mLegacyPlugin->decrypt(secure, keyId.data(), iv.data(),
-                legacyMode, legacyPattern, srcPtr, legacySubSamples.get(),
-                subSamples.size(), destPtr, &detailMessage);
-
-        uint32_t status;
-        uint32_t bytesWritten;
+        ssize_t result = mLegacyPlugin->decrypt(secure, keyId, iv,
+                mode, pattern, srcPtr, legacySubSamples.data(),
+                subSamples.size(), destPtr, detailMessage);
 
-        if (result >= 0) {
-            status = android::OK;
-            bytesWritten = result;
-        } else {
-            status = result;
-            bytesWritten = 0;
+        if (result < 0) {
+            return toStatus(result);
         }
+        *bytesWritten = result;
+        return Status::OK;
+    }
 
-        _hidl_cb(toStatus(status), bytesWritten, detailMessage.c_str());
+    Return<void> CryptoPlugin::decrypt(bool secure,
+            const hidl_array<uint8_t, 16>& keyId,
+            const hidl_array<uint8_t, 16>& iv, Mode mode,
+            const Pattern& pattern, const hidl_vec<SubSample>& subSamples,
+            const SharedBuffer& source, uint64_t offset,
+            const DestinationBuffer& destination,
+            decrypt_cb _hidl_cb) {
+        AString detailMessage;
+        uint32_t bytesWritten;
+        Status status = decryptUnit(secure, keyId.data(), iv.data(),
+                toLegacyMode(mode), toLegacyPattern(pattern), subSamples,
+                source, offset, destination, 0, &bytesWritten, &detailMessage);
+
+        _hidl_cb(status, bytesWritten, detailMessage.c_str());
         return Void();
     }
 
+    Status CryptoPlugin::decryptBatch(bool secure,
+            const hidl_array<uint8_t, 16>& keyId, Mode mode,
+            const Pattern& pattern, const SharedBuffer& source,
+            const DestinationBuffer& destination,
+            const std::vector<DecryptUnit>& units,
+            std::vector<uint32_t>* bytesWritten, hidl_string* detailedError) {
+        android::CryptoPlugin::Mode legacyMode = toLegacyMode(mode);
+        android::CryptoPlugin::Pattern legacyPattern = toLegacyPattern(pattern);
+
+        bytesWritten->clear();
+        bytesWritten->reserve(units.size());
+
+        AString detailMessage;
+        for (const DecryptUnit& unit : units) {
+            uint32_t unitBytesWritten;
+            Status status = decryptUnit(secure, keyId.data(), unit.iv.data(),
+                    legacyMode, legacyPattern, unit.subSamples, source,
+                    unit.offset, destination, unit.destOffset,
+                    &unitBytesWritten, &detailMessage);
+            if (status != Status::OK) {
+                *detailedError = detailMessage.c_str();
+                return status;
+            }
+            bytesWritten->push_back(unitBytesWritten);
+        }
+        *detailedError = detailMessage.c_str();
+        return Status::OK;
+    }
+
 } // namespace implementation
 }  // namespace V1_0
 }  // namespace drm
@@ -17,12 +17,18 @@
 #ifndef ANDROID_HARDWARE_DRM_V1_0__CRYPTOPLUGIN_H
 #define ANDROID_HARDWARE_DRM_V1_0__CRYPTOPLUGIN_H
 
+#include <array>
+#include <map>
+#include <vector>
+
 #include <android/hidl/memory/1.0/IMemory.h>
 #include <android/hardware/drm/1.0/ICryptoPlugin.h>
 #include <hidl/Status.h>
 #include <media/hardware/CryptoAPI.h>
 
 namespace android {
+struct AString;
+
 namespace hardware {
 namespace drm {
 namespace V1_0 {
@@ -66,9 +72,50 @@ struct CryptoPlugin : public ICryptoPlugin {
             uint64_t offset, const DestinationBuffer& destination,
             decrypt_cb _hidl_cb) override;
 
+    // One access unit of a decryptBatch() call. destOffset is relative to
+    // destination.nonsecureMemory.offset and is ignored for secure buffers.
+    struct DecryptUnit {
+        hidl_array<uint8_t, 16> iv;
+        hidl_vec<SubSample> subSamples;
+        uint64_t offset;
+        uint64_t destOffset;
+    };
+
+    // Decrypt several access units that share a key, mode and pattern, in
+    // order, stopping at the first one that fails. bytesWritten has an entry
+    // for each unit that was decrypted. ICryptoPlugin 1.0 is frozen, so this
+    // is only available to callers in the same process.
+    Status decryptBatch(bool secure, const hidl_array<uint8_t, 16>& keyId,
+            Mode mode, const Pattern& pattern, const SharedBuffer& source,
+            const DestinationBuffer& destination,
+            const std::vector<DecryptUnit>& units,
+            std::vector<uint32_t>* bytesWritten, hidl_string* detailedError);
+
 private:
+    // Buffer ids are allocated sequentially by the client, so ids below
+    // kSharedBufferSlots are kept in a table; larger ones use a map.
+    static constexpr uint32_t kSharedBufferSlots = 32;
+
+    struct SharedBufferSlot {
+        bool set = false;
+        // May be null if the base could not be mapped.
+        sp<IMemory> memory;
+    };
+
+    // Returns null if no base was set for bufferId.
+    const SharedBufferSlot* findSharedBuffer(uint32_t bufferId) const;
+
+    Status decryptUnit(bool secure, const uint8_t keyId[16],
+            const uint8_t iv[16], android::CryptoPlugin::Mode mode,
+            const android::CryptoPlugin::Pattern& pattern,
+            const hidl_vec<SubSample>& subSamples, const SharedBuffer& source,
+            uint64_t offset, const DestinationBuffer& destination,
+            uint64_t destOffset, uint32_t* bytesWritten,
+            AString* detailMessage);
+
     android::CryptoPlugin *mLegacyPlugin;
-    std::map<uint32_t, sp<IMemory> > mSharedBufferMap;
+    std::array<SharedBufferSlot, kSharedBufferSlots> mSharedBufferSlots;
+    std::map<uint32_t, SharedBufferSlot> mSharedBufferMap;
 
     CryptoPlugin() = delete;
     CryptoPlugin(const CryptoPlugin &) = delete;
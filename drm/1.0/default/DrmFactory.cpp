@@ -34,41 +34,40 @@ namespace implementation {
     // Methods from ::android::hardware::drm::V1_0::IDrmFactory follow.
     Return<bool> DrmFactory::isCryptoSchemeSupported (
             const hidl_array<uint8_t, 16>& uuid) {
-        for (size_t i = 0; i < loader.factoryCount(); i++) {
-            if (loader.getFactory(i)->isCryptoSchemeSupported(uuid.data())) {
-                return true;
-            }
-        }
-        return false;
+        return loader.isSupported(PluginIndex::schemeQuery(uuid.data()),
+                [&uuid](android::DrmFactory* plugin) {
+                    return plugin->isCryptoSchemeSupported(uuid.data());
+                });
     }
 
     Return<bool> DrmFactory::isContentTypeSupported (
             const hidl_string& mimeType) {
-        for (size_t i = 0; i < loader.factoryCount(); i++) {
-            if (loader.getFactory(i)->isContentTypeSupported(String8(mimeType.c_str()))) {
-                return true;
-            }
-        }
-        return false;
+        return loader.isSupported(PluginIndex::mimeTypeQuery(mimeType.c_str()),
+                [&mimeType](android::DrmFactory* plugin) {
+                    return plugin->isContentTypeSupported(String8(mimeType.c_str()));
+                });
     }
 
     Return<void> DrmFactory::createPlugin(const hidl_array<uint8_t, 16>& uuid,
             const hidl_string& /* appPackageName */, createPlugin_cb _hidl_cb) {
 
-        for (size_t i = 0; i < loader.factoryCount(); i++) {
-            if (loader.getFactory(i)->isCryptoSchemeSupported(uuid.data())) {
-                android::DrmPlugin *legacyPlugin = NULL;
-                status_t status = loader.getFactory(i)->createDrmPlugin(
-                        uuid.data(), &legacyPlugin);
-                DrmPlugin *newPlugin = NULL;
-                if (legacyPlugin == NULL) {
-                    ALOGE("Drm legacy HAL: failed to create drm plugin");
-                } else {
-                    newPlugin = new DrmPlugin(legacyPlugin);
-                }
-                _hidl_cb(toStatus(status), newPlugin);
-                return Void();
+        android::DrmFactory *factory = loader.findFactory(
+                PluginIndex::schemeQuery(uuid.data()),
+                [&uuid](android::DrmFactory* plugin) {
+                    return plugin->isCryptoSchemeSupported(uuid.data());
+                });
+        if (factory != NULL) {
+            android::DrmPlugin *legacyPlugin = NULL;
+            status_t status = factory->createDrmPlugin(
+                    uuid.data(), &legacyPlugin);
+            DrmPlugin *newPlugin = NULL;
+            if (legacyPlugin == NULL) {
+                ALOGE("Drm legacy HAL: failed to create drm plugin");
+            } else {
+                newPlugin = new DrmPlugin(legacyPlugin);
             }
+            _hidl_cb(toStatus(status), newPlugin);
+            return Void();
         }
         _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, NULL);
         return Void();
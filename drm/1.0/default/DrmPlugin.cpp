@@ -27,6 +27,20 @@ namespace drm {
 namespace V1_0 {
 namespace implementation {
 
+    // Copies of the blobs passed to the key request and response calls. The
+    // legacy API takes them as Vectors, which cannot wrap the HIDL buffers,
+    // so these keep their storage from one call to the next. One set per
+    // binder thread, so that concurrent calls do not share them.
+    struct KeyBlobScratch {
+        Vector<uint8_t> scope;
+        Vector<uint8_t> data;
+    };
+
+    static KeyBlobScratch& keyBlobScratch() {
+        static thread_local KeyBlobScratch scratch;
+        return scratch;
+    }
+
     // Methods from ::android::hardware::drm::V1_0::IDrmPlugin follow.
 
     Return<void> DrmPlugin::openSession(openSession_cb _hidl_cb) {
@@ -69,6 +83,7 @@ namespace implementation {
 
         if (status == android::OK) {
             android::KeyedVector<String8, String8> legacyOptionalParameters;
+            legacyOptionalParameters.setCapacity(optionalParameters.size());
             for (size_t i = 0; i < optionalParameters.size(); i++) {
                 legacyOptionalParameters.add(String8(optionalParameters[i].key.c_str()),
                         String8(optionalParameters[i].value.c_str()));
@@ -77,8 +92,9 @@ namespace implementation {
             android::DrmPlugin::KeyRequestType legacyRequestType =
                     android::DrmPlugin::kKeyRequestType_Unknown;
 
-            status = mLegacyPlugin->getKeyRequest(toVector(scope),
-                    toVector(initData), String8(mimeType.c_str()), legacyKeyType,
+            KeyBlobScratch& scratch = keyBlobScratch();
+            status = mLegacyPlugin->getKeyRequest(toVector(scope, &scratch.scope),
+                    toVector(initData, &scratch.data), String8(mimeType.c_str()), legacyKeyType,
                     legacyOptionalParameters, legacyRequest, defaultUrl,
                     &legacyRequestType);
 
@@ -107,8 +123,10 @@ namespace implementation {
             const hidl_vec<uint8_t>& response, provideKeyResponse_cb _hidl_cb) {
 
         Vector<uint8_t> keySetId;
-        status_t status = mLegacyPlugin->provideKeyResponse(toVector(scope),
-                toVector(response), keySetId);
+        KeyBlobScratch& scratch = keyBlobScratch();
+        status_t status = mLegacyPlugin->provideKeyResponse(
+                toVector(scope, &scratch.scope), toVector(response, &scratch.data),
+                keySetId);
         _hidl_cb(toStatus(status), toHidlVec(keySetId));
         return Void();
     }
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.drm@1.0-helper"
+
+#include "PluginIndex.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+
+#include <cutils/properties.h>
+#include <utils/Log.h>
+
+namespace android {
+namespace hardware {
+namespace drm {
+namespace V1_0 {
+namespace helper {
+
+// The file format is line based:
+//   F <build fingerprint>   must be the first line
+//   L <mtime ns> <size> <library path>
+//   A <query>               query supported by the preceding library
+const char* PluginIndex::kIndexDir = "/data/vendor/mediadrm";
+
+// Keeps the index, and the time to read it, small whatever the plugins and
+// the clients do. What does not fit is asked to the libraries again.
+static const size_t kMaxLibraries = 64;
+static const size_t kMaxAnswers = 32;
+
+static std::string getFingerprint() {
+    char fingerprint[PROPERTY_VALUE_MAX];
+    property_get("ro.vendor.build.fingerprint", fingerprint, "");
+    return fingerprint;
+}
+
+PluginIndex::PluginIndex(const char* dir, const char* entry)
+        : mPath(getIndexPath(dir, entry)), mFingerprint(getFingerprint()) {
+    read();
+}
+
+PluginIndex::~PluginIndex() {
+    {
+        std::lock_guard<std::mutex> lock(mWriteLock);
+        mStopping = true;
+    }
+    mWriteCondition.notify_one();
+    if (mWriter.joinable()) {
+        mWriter.join();
+    }
+}
+
+std::string PluginIndex::getIndexPath(const char* dir, const char* entry) {
+    // One file per entry and directory, so 32 and 64-bit services do not
+    // keep overwriting each other's index
+    std::string name = std::string(entry) + dir;
+    for (char& c : name) {
+        if (c == '/') {
+            c = '_';
+        }
+    }
+    return std::string(kIndexDir) + "/plugin_index_" + name;
+}
+
+void PluginIndex::read() {
+    std::ifstream in(mPath);
+    std::string line;
+    if (!std::getline(in, line) || line != "F " + mFingerprint) {
+        // missing, or written by another build
+        return;
+    }
+    Library* library = nullptr;
+    while (std::getline(in, line)) {
+        if (line.size() < 2 || line[1] != ' ') {
+            continue;
+        }
+        if (line[0] == 'L') {
+            long long mtimeNs, size;
+            int pathStart = 0;
+            if (mLibraries.size() >= kMaxLibraries ||
+                    sscanf(line.c_str(), "L %lld %lld %n", &mtimeNs, &size,
+                    &pathStart) != 2 || pathStart == 0) {
+                library = nullptr;
+                continue;
+            }
+            library = &mLibraries[line.substr(pathStart)];
+            library->mtimeNs = mtimeNs;
+            library->size = size;
+        } else if (line[0] == 'A' && library != nullptr && line.size() > 2 &&
+                library->supported.size() < kMaxAnswers) {
+            library->supported.insert(line.substr(2));
+        }
+    }
+}
+
+void PluginIndex::addLibrary(const std::string& path) {
+    Library& library = mLibraries[path];
+    if (library.checked) {
+        return;
+    }
+    library.checked = true;
+
+    struct stat st;
+    int64_t mtimeNs = 0;
+    int64_t size = 0;
+    if (stat(path.c_str(), &st) == 0) {
+        mtimeNs = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        size = st.st_size;
+    }
+    if (library.mtimeNs != mtimeNs || library.size != size) {
+        library.mtimeNs = mtimeNs;
+        library.size = size;
+        library.supported.clear();
+        library.unsupported.clear();
+        mDirty = true;
+    }
+}
+
+PluginIndex::Answer PluginIndex::lookup(const std::string& path,
+        const std::string& query) const {
+    auto library = mLibraries.find(path);
+    if (library == mLibraries.end() || !library->second.checked) {
+        return UNKNOWN;
+    }
+    if (library->second.supported.count(query) > 0) {
+        return SUPPORTED;
+    }
+    if (library->second.unsupported.count(query) > 0) {
+        return UNSUPPORTED;
+    }
+    return UNKNOWN;
+}
+
+void PluginIndex::record(const std::string& path, const std::string& query,
+        bool supported) {
+    auto library = mLibraries.find(path);
+    if (library == mLibraries.end() || !library->second.checked) {
+        return;
+    }
+    if (!supported) {
+        if (library->second.supported.erase(query) > 0) {
+            mDirty = true;
+        }
+        if (library->second.unsupported.size() >= kMaxAnswers) {
+            library->second.unsupported.clear();
+        }
+        library->second.unsupported.insert(query);
+        return;
+    }
+    library->second.unsupported.erase(query);
+    if (library->second.supported.size() < kMaxAnswers &&
+            library->second.supported.insert(query).second) {
+        mDirty = true;
+    }
+}
+
+void PluginIndex::save() {
+    if (!mDirty) {
+        return;
+    }
+    mDirty = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mWriteLock);
+        mPendingContent = serialize();
+        mWritePending = true;
+        if (!mWriter.joinable()) {
+            mWriter = std::thread(&PluginIndex::writeLoop, this);
+        }
+    }
+    mWriteCondition.notify_one();
+}
+
+std::string PluginIndex::serialize() const {
+    std::ostringstream out;
+    out << "F " << mFingerprint << "\n";
+    size_t count = 0;
+    for (const auto& library : mLibraries) {
+        // Keep what is known of libraries not looked at yet, unless removed
+        if (!library.second.checked &&
+                access(library.first.c_str(), F_OK) != 0) {
+            continue;
+        }
+        if (++count > kMaxLibraries) {
+            break;
+        }
+        out << "L " << library.second.mtimeNs << " " << library.second.size
+            << " " << library.first << "\n";
+        for (const auto& query : library.second.supported) {
+            out << "A " << query << "\n";
+        }
+    }
+    return out.str();
+}
+
+void PluginIndex::writeLoop() {
+    std::unique_lock<std::mutex> lock(mWriteLock);
+    while (true) {
+        mWriteCondition.wait(lock, [this] { return mWritePending || mStopping; });
+        if (!mWritePending) {
+            return;
+        }
+        std::string content;
+        content.swap(mPendingContent);
+        mWritePending = false;
+        lock.unlock();
+
+        std::string tmpPath = mPath + ".tmp";
+        bool written = false;
+        {
+            std::ofstream out(tmpPath, std::ios::trunc);
+            if (!out) {
+                ALOGV("Cannot write plugin index %s", tmpPath.c_str());
+            } else if (!(out << content).flush()) {
+                ALOGW("Failed to write plugin index %s", tmpPath.c_str());
+                unlink(tmpPath.c_str());
+            } else {
+                written = true;
+            }
+        }
+        if (written && rename(tmpPath.c_str(), mPath.c_str()) != 0) {
+            ALOGW("Failed to update plugin index %s", mPath.c_str());
+            unlink(tmpPath.c_str());
+        }
+
+        lock.lock();
+    }
+}
+
+std::string PluginIndex::schemeQuery(const uint8_t uuid[16]) {
+    static const char kHex[] = "0123456789abcdef";
+    std::string query = "scheme:";
+    for (size_t i = 0; i < 16; i++) {
+        query += kHex[uuid[i] >> 4];
+        query += kHex[uuid[i] & 0xf];
+    }
+    return query;
+}
+
+std::string PluginIndex::mimeTypeQuery(const char* mimeType) {
+    std::string query = std::string("mime:") + mimeType;
+    // Keep the index line based
+    for (char& c : query) {
+        if (c == '\n' || c == '\r') {
+            c = ' ';
+        }
+    }
+    return query;
+}
+
+}
+}
+}
+}
+} // namespace android
@@ -17,6 +17,10 @@
 #ifndef ANDROID_HARDWARE_DRM_V1_0_TYPECONVERT
 #define ANDROID_HARDWARE_DRM_V1_0_TYPECONVERT
 
+#include <string.h>
+
+#include <type_traits>
+
 #include <android/hardware/drm/1.0/types.h>
 #include <media/stagefright/MediaErrors.h>
 #include <utils/Vector.h>
@@ -67,6 +71,24 @@ template<typename T, size_t SIZE> Vector<T> toVector(
     return vector;
 }
 
+/**
+ * Copy vec into scratch, keeping the storage that scratch already has, and
+ * return scratch. For blobs that the legacy plugin only reads, with a scratch
+ * Vector that outlives the call: a blob of about the same size as the last
+ * one is then copied without an allocation. If the plugin kept a copy of the
+ * previous contents, editArray() gives scratch a buffer of its own first.
+ */
+template<typename T> const Vector<T>& toVector(const hidl_vec<T> &vec,
+        Vector<T> *scratch) {
+    static_assert(std::is_trivially_copyable<T>::value,
+            "scratch conversion needs trivially copyable elements");
+    scratch->resize(vec.size());
+    if (vec.size() > 0) {
+        memcpy(scratch->editArray(), vec.data(), vec.size() * sizeof(T));
+    }
+    return *scratch;
+}
+
 Status toStatus(status_t legacyStatus);
 
 }  // namespace implementation
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLUGIN_INDEX_H_
+#define PLUGIN_INDEX_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace android {
+namespace hardware {
+namespace drm {
+namespace V1_0 {
+namespace helper {
+
+/**
+ * Persistent record of what the plugin libraries of a directory were found
+ * to support, so that after a restart queries can be answered without
+ * dlopen'ing every plugin. The answers of a library are keyed by its
+ * modification time and size, and are dropped as soon as either changes. The
+ * whole index is dropped when ro.vendor.build.fingerprint changes.
+ *
+ * Only positive answers are persisted. Queries a library does not support are
+ * remembered until the service exits, so that a stale answer never hides a
+ * plugin after an update. The number of libraries and answers kept is
+ * bounded.
+ *
+ * Not thread safe, PluginLoader serializes its use. The file is written by a
+ * thread of the index, off the binder thread that changed it.
+ */
+class PluginIndex {
+  public:
+    enum Answer {
+        UNKNOWN,
+        SUPPORTED,
+        UNSUPPORTED,
+    };
+
+    static const char* kIndexDir;
+
+    // The index of the plugins in dir that are loaded through entry.
+    PluginIndex(const char* dir, const char* entry);
+
+    // Waits for the last save to be written.
+    ~PluginIndex();
+
+    // Checks the answers of a library found in the directory against its
+    // modification time and size. Only libraries added can be looked up.
+    void addLibrary(const std::string& path);
+
+    Answer lookup(const std::string& path, const std::string& query) const;
+    void record(const std::string& path, const std::string& query,
+            bool supported);
+
+    // Schedules the index to be written back if anything changed since it
+    // was read.
+    void save();
+
+    static std::string schemeQuery(const uint8_t uuid[16]);
+    static std::string mimeTypeQuery(const char* mimeType);
+
+  private:
+    struct Library {
+        int64_t mtimeNs = 0;
+        int64_t size = 0;
+        bool checked = false;
+        std::set<std::string> supported;
+        std::set<std::string> unsupported;
+    };
+
+    static std::string getIndexPath(const char* dir, const char* entry);
+    void read();
+    std::string serialize() const;
+    void writeLoop();
+
+    const std::string mPath;
+    const std::string mFingerprint;
+    std::map<std::string, Library> mLibraries;
+    bool mDirty = false;
+
+    std::mutex mWriteLock;
+    std::condition_variable mWriteCondition;
+    std::string mPendingContent;
+    bool mWritePending = false;
+    bool mStopping = false;
+    std::thread mWriter;
+
+    PluginIndex(const PluginIndex &) = delete;
+    void operator=(const PluginIndex &) = delete;
+};
+
+}
+}
+}
+}
+} // namespace android
+
+#endif // PLUGIN_INDEX_H_
@@ -17,7 +17,12 @@
 #ifndef PLUGIN_LOADER_H_
 #define PLUGIN_LOADER_H_
 
+#include "PluginIndex.h"
 #include "SharedLibrary.h"
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <utils/Vector.h>
@@ -32,10 +37,12 @@ template <class T>
 class PluginLoader {
 
   public:
-    PluginLoader(const char *dir, const char *entry) {
+    PluginLoader(const char *dir, const char *entry)
+            : mEntry(entry), mIndex(dir, entry) {
         /**
          * scan all plugins in the plugin directory and add them to the
-         * factories list.
+         * factories list. Libraries the index knows to be plugins are only
+         * loaded once a query needs them.
          */
         String8 pluginDir(dir);
 
@@ -48,30 +55,126 @@ class PluginLoader {
                 String8 file(pEntry->d_name);
                 if (file.getPathExtension() == ".so") {
                     String8 path = pluginDir + "/" + pEntry->d_name;
-                    T *plugin = loadOne(path, entry);
-                    if (plugin) {
-                        factories.push(plugin);
+                    mIndex.addLibrary(path.string());
+                    switch (mIndex.lookup(path.string(), kEntryQuery)) {
+                        case PluginIndex::UNSUPPORTED:
+                            break;
+                        case PluginIndex::SUPPORTED:
+                            plugins.push_back(Plugin{path, NULL});
+                            break;
+                        case PluginIndex::UNKNOWN: {
+                            T *plugin = loadOne(path, entry);
+                            mIndex.record(path.string(), kEntryQuery, plugin != NULL);
+                            if (plugin) {
+                                plugins.push_back(Plugin{path, plugin});
+                            }
+                            break;
+                        }
                     }
                 }
             }
             closedir(pDir);
         }
+        mIndex.save();
     }
 
     ~PluginLoader() {
-        for (size_t i = 0; i < factories.size(); i++) {
-            delete factories[i];
+        for (size_t i = 0; i < plugins.size(); i++) {
+            delete plugins[i].factory;
         }
     }
 
+    // Loads every plugin not loaded yet.
     T *getFactory(size_t i) const {
-        return factories[i];
+        std::lock_guard<std::mutex> lock(mLock);
+        loadAllLocked();
+        return plugins[i].factory;
     }
 
-    size_t factoryCount() const {return factories.size();}
+    size_t factoryCount() const {
+        std::lock_guard<std::mutex> lock(mLock);
+        loadAllLocked();
+        return plugins.size();
+    }
+
+    /**
+     * Returns whether a plugin supports the query, which supports() answers
+     * for a loaded plugin. Plugins the index has an answer for are not loaded.
+     */
+    bool isSupported(const std::string& query,
+            const std::function<bool(T *)>& supports) const {
+        std::lock_guard<std::mutex> lock(mLock);
+        return findLocked(query, supports, NULL);
+    }
+
+    // Returns the first plugin that supports the query, or NULL.
+    T *findFactory(const std::string& query,
+            const std::function<bool(T *)>& supports) const {
+        std::lock_guard<std::mutex> lock(mLock);
+        T *factory = NULL;
+        findLocked(query, supports, &factory);
+        return factory;
+    }
 
   private:
-    T* loadOne(const char *path, const char *entry) {
+    struct Plugin {
+        String8 path;
+        T *factory;
+    };
+
+    static constexpr const char *kEntryQuery = "entry";
+
+    bool findLocked(const std::string& query,
+            const std::function<bool(T *)>& supports, T **factory) const {
+        bool found = false;
+        for (size_t i = 0; i < plugins.size() && !found;) {
+            const std::string path = plugins[i].path.string();
+            PluginIndex::Answer answer = mIndex.lookup(path, query);
+            if (answer == PluginIndex::UNSUPPORTED) {
+                i++;
+                continue;
+            }
+            if (answer == PluginIndex::SUPPORTED && factory == NULL) {
+                found = true;
+                break;
+            }
+            if (!loadLocked(i)) {
+                continue;
+            }
+            found = supports(plugins[i].factory);
+            mIndex.record(path, query, found);
+            if (found && factory != NULL) {
+                *factory = plugins[i].factory;
+            }
+            i++;
+        }
+        mIndex.save();
+        return found;
+    }
+
+    // Returns false, and drops the plugin, if it no longer loads.
+    bool loadLocked(size_t i) const {
+        if (plugins[i].factory == NULL) {
+            plugins[i].factory = loadOne(plugins[i].path, mEntry.string());
+            if (plugins[i].factory == NULL) {
+                mIndex.record(plugins[i].path.string(), kEntryQuery, false);
+                plugins.erase(plugins.begin() + i);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void loadAllLocked() const {
+        for (size_t i = 0; i < plugins.size();) {
+            if (loadLocked(i)) {
+                i++;
+            }
+        }
+        mIndex.save();
+    }
+
+    T* loadOne(const char *path, const char *entry) const {
         sp<SharedLibrary> library = new SharedLibrary(String8(path));
         if (!library.get()) {
             ALOGE("Failed to open plugin library %s: %s", path,
@@ -93,8 +196,11 @@ class PluginLoader {
         return NULL;
     }
 
-    Vector<T *> factories;
-    Vector<sp<SharedLibrary> > libraries;
+    const String8 mEntry;
+    mutable std::mutex mLock;
+    mutable PluginIndex mIndex;
+    mutable std::vector<Plugin> plugins;
+    mutable Vector<sp<SharedLibrary> > libraries;
 
     PluginLoader(const PluginLoader &) = delete;
     void operator=(const PluginLoader &) = delete;
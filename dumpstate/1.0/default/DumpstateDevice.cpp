@@ -21,8 +21,10 @@
 #include <hidl/HidlBinderSupport.h>
 #include <log/log.h>
 
+#include "DumpstateSections.h"
 #include "DumpstateUtil.h"
 
+using android::os::dumpstate::CommandOptions;
 using android::os::dumpstate::DumpFileToFd;
 using android::os::dumpstate::RunCommandToFd;
 
@@ -51,9 +53,17 @@ Return<void> DumpstateDevice::dumpstateBoard(const hidl_handle& handle) {
     ALOGI("Dumpstate HIDL not provided by device\n");
     dprintf(fd, "Dumpstate HIDL not provided by device; providing bogus data.\n");
 
-    // Shows some examples on how to use the libdumpstateutil API.
-    RunCommandToFd(fd, "DATE", {"/vendor/bin/date"});
-    DumpFileToFd(fd, "HOSTS", "/system/etc/hosts");
+    // Shows some examples on how to use the libdumpstateutil API. The file sections run in
+    // parallel, the command sections one at a time, and all are written in the order they are
+    // added.
+    using SectionType = DumpstateSections::SectionType;
+    DumpstateSections sections;
+    sections.add("DATE", SectionType::kCommand, std::chrono::seconds(10), [](int fd) {
+        RunCommandToFd(fd, "DATE", {"/vendor/bin/date"}, CommandOptions::WithTimeout(10).Build());
+    });
+    sections.add("HOSTS", SectionType::kRead, std::chrono::seconds(10),
+                 [](int fd) { DumpFileToFd(fd, "HOSTS", "/system/etc/hosts"); });
+    sections.run(fd);
 
     return Void();
 }
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "dumpstate"
+
+#include "DumpstateSections.h"
+
+#include <errno.h>
+#include <linux/memfd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <log/log.h>
+
+using android::base::unique_fd;
+using std::chrono::steady_clock;
+
+namespace android {
+namespace hardware {
+namespace dumpstate {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+struct SchedulerState {
+    std::mutex lock;
+    // notified whenever a section is done
+    std::condition_variable condition;
+    size_t running = 0;
+};
+
+struct SectionRun {
+    unique_fd buffer;
+    steady_clock::time_point start;
+    steady_clock::time_point end;
+    bool started = false;
+    bool done = false;
+    // timed out; the section no longer counts as running
+    bool abandoned = false;
+};
+
+unique_fd createBuffer(const std::string& title) {
+    return unique_fd(static_cast<int>(syscall(__NR_memfd_create, title.c_str(), MFD_CLOEXEC)));
+}
+
+// Copies what the section wrote so far. The section may still be writing if it timed out, so the
+// buffer is read at explicit offsets rather than through its file offset.
+void copyBuffer(int buffer, int fd) {
+    char data[16 * 1024];
+    off_t offset = 0;
+    while (true) {
+        ssize_t length = TEMP_FAILURE_RETRY(pread(buffer, data, sizeof(data), offset));
+        if (length <= 0) break;
+        if (!android::base::WriteFully(fd, data, length)) {
+            ALOGE("failed to write section: %s", strerror(errno));
+            break;
+        }
+        offset += length;
+    }
+}
+
+// Starts a thread with SIGCHLD blocked. The SIGCHLD of a command section run meanwhile then stays
+// pending for its sigtimedwait, instead of being delivered to, and ignored by, a section thread.
+void startThread(std::function<void()> function) {
+    sigset_t blocked;
+    sigset_t old;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &blocked, &old);
+    std::thread(std::move(function)).detach();
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+}
+
+}  // namespace
+
+DumpstateSections::DumpstateSections(size_t maxParallelSections)
+    : mMaxParallelSections(maxParallelSections > 0 ? maxParallelSections : 1) {}
+
+void DumpstateSections::add(const std::string& title, SectionType type,
+                            std::chrono::milliseconds deadline, SectionFunction function) {
+    mSections.push_back({title, type, deadline, std::move(function)});
+}
+
+void DumpstateSections::run(int fd) {
+    auto state = std::make_shared<SchedulerState>();
+    std::vector<std::shared_ptr<SectionRun>> runs;
+    for (size_t i = 0; i < mSections.size(); i++) {
+        runs.push_back(std::make_shared<SectionRun>());
+    }
+
+    std::unique_lock<std::mutex> lock(state->lock);
+    size_t next = 0;
+    // starts sections, in order, while there are free slots
+    auto startSections = [&] {
+        for (; next < mSections.size() && state->running < mMaxParallelSections; next++) {
+            const Section& section = mSections[next];
+            if (section.type == SectionType::kCommand) {
+                // run directly into fd when its turn comes
+                continue;
+            }
+            std::shared_ptr<SectionRun> run = runs[next];
+            run->buffer = createBuffer(section.title);
+            if (run->buffer < 0) {
+                // run it directly into fd when its turn comes
+                ALOGW("no buffer for section %s: %s", section.title.c_str(), strerror(errno));
+                continue;
+            }
+            run->start = steady_clock::now();
+            run->started = true;
+            state->running++;
+            startThread([state, run, function = section.function] {
+                function(run->buffer.get());
+                std::lock_guard<std::mutex> lock(state->lock);
+                run->end = steady_clock::now();
+                run->done = true;
+                if (!run->abandoned) state->running--;
+                state->condition.notify_all();
+            });
+        }
+    };
+
+    for (size_t i = 0; i < mSections.size(); i++) {
+        const Section& section = mSections[i];
+        std::shared_ptr<SectionRun> run = runs[i];
+
+        startSections();
+        if (!run->started) {
+            lock.unlock();
+            section.function(fd);
+            lock.lock();
+            continue;
+        }
+
+        steady_clock::time_point deadline = run->start + section.deadline;
+        while (!run->done && steady_clock::now() < deadline) {
+            state->condition.wait_until(lock, deadline);
+            // use the slots of the sections done meanwhile
+            startSections();
+        }
+        if (!run->done) {
+            run->abandoned = true;
+            state->running--;
+        }
+        bool timedOut = run->abandoned;
+        auto duration =
+                std::chrono::duration_cast<std::chrono::milliseconds>(run->end - run->start);
+        lock.unlock();
+
+        copyBuffer(run->buffer.get(), fd);
+        if (timedOut) {
+            ALOGW("section %s timed out after %lldms", section.title.c_str(),
+                  static_cast<long long>(section.deadline.count()));
+            dprintf(fd, "*** %s: timed out after %lldms, output truncated\n",
+                    section.title.c_str(), static_cast<long long>(section.deadline.count()));
+        } else {
+            ALOGD("section %s done in %lldms", section.title.c_str(),
+                  static_cast<long long>(duration.count()));
+        }
+
+        lock.lock();
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace dumpstate
+}  // namespace hardware
+}  // namespace android
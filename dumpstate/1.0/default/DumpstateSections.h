@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_DUMPSTATE_V1_0_DUMPSTATESECTIONS_H
+#define ANDROID_HARDWARE_DUMPSTATE_V1_0_DUMPSTATESECTIONS_H
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace dumpstate {
+namespace V1_0 {
+namespace implementation {
+
+/*
+ * Runs the sections of a board dump in parallel, each into a memory buffer of its own, and
+ * writes the buffers to the output fd in the order the sections were added, so the dump reads
+ * the same as if the sections had run one after the other.
+ *
+ * A section that is not done by its deadline, counted from its start, is written as far as it
+ * got, followed by a note, and its later output is dropped. Its thread is left to finish on its
+ * own.
+ *
+ * Only sections that read files, e.g. with DumpFileToFd, run in parallel. Sections that run
+ * commands, e.g. with RunCommandToFd, must be added as SectionType::kCommand: libdumpstateutil
+ * waits for the child with SIGCHLD blocked and sigtimedwait, so concurrent commands would take
+ * each other's SIGCHLD and be reported as timed out. Command sections run one at a time, on the
+ * thread calling run(), when their turn comes, while the read sections after them go on in the
+ * background; they are bounded by their CommandOptions timeout rather than by a deadline.
+ */
+class DumpstateSections {
+  public:
+    // Writes the section to fd
+    using SectionFunction = std::function<void(int fd)>;
+
+    enum class SectionType {
+        // Only reads files, runs in parallel with the other sections
+        kRead,
+        // Runs commands, runs alone on the thread calling run()
+        kCommand,
+    };
+
+    explicit DumpstateSections(size_t maxParallelSections = 4);
+
+    void add(const std::string& title, SectionType type, std::chrono::milliseconds deadline,
+             SectionFunction function);
+
+    // Runs the sections added so far and writes them to fd
+    void run(int fd);
+
+  private:
+    struct Section {
+        std::string title;
+        SectionType type;
+        std::chrono::milliseconds deadline;
+        SectionFunction function;
+    };
+
+    const size_t mMaxParallelSections;
+    std::vector<Section> mSections;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace dumpstate
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_DUMPSTATE_V1_0_DUMPSTATESECTIONS_H
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <thread>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "DumpstateSections.h"
+
+using android::base::ReadFileToString;
+using android::hardware::dumpstate::V1_0::implementation::DumpstateSections;
+using SectionType = DumpstateSections::SectionType;
+using std::chrono::milliseconds;
+
+namespace {
+
+std::string runSections(DumpstateSections* sections) {
+    TemporaryFile output;
+    sections->run(output.fd);
+    std::string content;
+    EXPECT_TRUE(ReadFileToString(output.path, &content));
+    return content;
+}
+
+// Returns the file descriptor the next open would return
+int lowestFreeFd() {
+    int fd = dup(STDIN_FILENO);
+    close(fd);
+    return fd;
+}
+
+TEST(DumpstateSectionsTest, writesSectionsInOrder) {
+    DumpstateSections sections;
+    // the first sections take the longest, so they finish last
+    for (int i = 0; i < 6; i++) {
+        sections.add("SECTION" + std::to_string(i), SectionType::kRead, milliseconds(5000),
+                     [i](int fd) {
+                         std::this_thread::sleep_for(milliseconds(10 * (6 - i)));
+                         dprintf(fd, "section %d\n", i);
+                     });
+    }
+    EXPECT_EQ("section 0\nsection 1\nsection 2\nsection 3\nsection 4\nsection 5\n",
+              runSections(&sections));
+}
+
+TEST(DumpstateSectionsTest, truncatesSectionAtDeadline) {
+    DumpstateSections sections;
+    sections.add("SLOW", SectionType::kRead, milliseconds(100), [](int fd) {
+        dprintf(fd, "partial\n");
+        std::this_thread::sleep_for(milliseconds(1000));
+        dprintf(fd, "late\n");
+    });
+    sections.add("FAST", SectionType::kRead, milliseconds(5000),
+                 [](int fd) { dprintf(fd, "fast\n"); });
+
+    std::string content = runSections(&sections);
+    EXPECT_EQ(0u, content.find("partial\n"));
+    EXPECT_NE(std::string::npos, content.find("SLOW: timed out after 100ms"));
+    EXPECT_NE(std::string::npos, content.find("fast\n"));
+    EXPECT_EQ(std::string::npos, content.find("late"));
+}
+
+TEST(DumpstateSectionsTest, runsCommandSectionsOnCallingThread) {
+    DumpstateSections sections;
+    std::thread::id readThread;
+    std::thread::id commandThread;
+    sections.add("READ", SectionType::kRead, milliseconds(5000), [&readThread](int fd) {
+        readThread = std::this_thread::get_id();
+        dprintf(fd, "read\n");
+    });
+    sections.add("COMMAND", SectionType::kCommand, milliseconds(5000), [&commandThread](int fd) {
+        commandThread = std::this_thread::get_id();
+        dprintf(fd, "command\n");
+    });
+
+    EXPECT_EQ("read\ncommand\n", runSections(&sections));
+    EXPECT_EQ(std::this_thread::get_id(), commandThread);
+    EXPECT_NE(std::this_thread::get_id(), readThread);
+}
+
+TEST(DumpstateSectionsTest, runsSectionsInlineWithoutBuffers) {
+    TemporaryFile output;
+    DumpstateSections sections;
+    std::thread::id sectionThread;
+    sections.add("FIRST", SectionType::kRead, milliseconds(5000), [&sectionThread](int fd) {
+        sectionThread = std::this_thread::get_id();
+        dprintf(fd, "first\n");
+    });
+    sections.add("SECOND", SectionType::kRead, milliseconds(5000),
+                 [](int fd) { dprintf(fd, "second\n"); });
+
+    // no file descriptor left for the memfd buffers
+    struct rlimit limit;
+    ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &limit));
+    struct rlimit lowered = limit;
+    lowered.rlim_cur = lowestFreeFd();
+    ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &lowered));
+    sections.run(output.fd);
+    ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &limit));
+
+    std::string content;
+    ASSERT_TRUE(ReadFileToString(output.path, &content));
+    EXPECT_EQ("first\nsecond\n", content);
+    EXPECT_EQ(std::this_thread::get_id(), sectionThread);
+}
+
+}  // namespace
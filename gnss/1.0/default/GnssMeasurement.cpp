@@ -31,9 +31,44 @@ GpsMeasurementCallbacks GnssMeasurement::sGnssMeasurementCbs = {
     .gnss_measurement_callback = gnssMeasurementCb
 };
 
+std::mutex GnssMeasurement::sGnssDataMutex;
+IGnssMeasurementCallback::GnssData GnssMeasurement::sGnssData;
+
 GnssMeasurement::GnssMeasurement(const GpsMeasurementInterface* gpsMeasurementIface)
     : mGnssMeasureIface(gpsMeasurementIface) {}
 
+void GnssMeasurement::convertMeasurement(const LegacyGnssMeasurement& in,
+                                         IGnssMeasurementCallback::GnssMeasurement* out) {
+    auto state = static_cast<GnssMeasurementState>(in.state);
+    if (state & IGnssMeasurementCallback::GnssMeasurementState::STATE_TOW_DECODED) {
+        state |= IGnssMeasurementCallback::GnssMeasurementState::STATE_TOW_KNOWN;
+    }
+    if (state & IGnssMeasurementCallback::GnssMeasurementState::STATE_GLO_TOD_DECODED) {
+        state |= IGnssMeasurementCallback::GnssMeasurementState::STATE_GLO_TOD_KNOWN;
+    }
+
+    out->flags = in.flags;
+    out->svid = in.svid;
+    out->constellation = static_cast<GnssConstellationType>(in.constellation);
+    out->timeOffsetNs = in.time_offset_ns;
+    out->state = state;
+    out->receivedSvTimeInNs = in.received_sv_time_in_ns;
+    out->receivedSvTimeUncertaintyInNs = in.received_sv_time_uncertainty_in_ns;
+    out->cN0DbHz = in.c_n0_dbhz;
+    out->pseudorangeRateMps = in.pseudorange_rate_mps;
+    out->pseudorangeRateUncertaintyMps = in.pseudorange_rate_uncertainty_mps;
+    out->accumulatedDeltaRangeState = in.accumulated_delta_range_state;
+    out->accumulatedDeltaRangeM = in.accumulated_delta_range_m;
+    out->accumulatedDeltaRangeUncertaintyM = in.accumulated_delta_range_uncertainty_m;
+    out->carrierFrequencyHz = in.carrier_frequency_hz;
+    out->carrierCycles = in.carrier_cycles;
+    out->carrierPhase = in.carrier_phase;
+    out->carrierPhaseUncertainty = in.carrier_phase_uncertainty;
+    out->multipathIndicator =
+            static_cast<IGnssMeasurementCallback::GnssMultipathIndicator>(in.multipath_indicator);
+    out->snrDb = in.snr_db;
+}
+
 void GnssMeasurement::gnssMeasurementCb(LegacyGnssData* legacyGnssData) {
     if (sGnssMeasureCbIface == nullptr) {
         ALOGE("%s: GNSSMeasurement Callback Interface configured incorrectly", __func__);
@@ -45,44 +80,16 @@ void GnssMeasurement::gnssMeasurementCb(LegacyGnssData* legacyGnssData) {
         return;
     }
 
-    IGnssMeasurementCallback::GnssData gnssData;
+    std::lock_guard<std::mutex> lock(sGnssDataMutex);
+    IGnssMeasurementCallback::GnssData& gnssData = sGnssData;
     gnssData.measurementCount = std::min(legacyGnssData->measurement_count,
                                          static_cast<size_t>(GnssMax::SVS_COUNT));
 
     for (size_t i = 0; i < gnssData.measurementCount; i++) {
-        auto entry = legacyGnssData->measurements[i];
-        auto state = static_cast<GnssMeasurementState>(entry.state);
-        if (state & IGnssMeasurementCallback::GnssMeasurementState::STATE_TOW_DECODED) {
-          state |= IGnssMeasurementCallback::GnssMeasurementState::STATE_TOW_KNOWN;
-        }
-        if (state & IGnssMeasurementCallback::GnssMeasurementState::STATE_GLO_TOD_DECODED) {
-          state |= IGnssMeasurementCallback::GnssMeasurementState::STATE_GLO_TOD_KNOWN;
-        }
-        gnssData.measurements[i] = {
-            .flags = entry.flags,
-            .svid = entry.svid,
-            .constellation = static_cast<GnssConstellationType>(entry.constellation),
-            .timeOffsetNs = entry.time_offset_ns,
-            .state = state,
-            .receivedSvTimeInNs = entry.received_sv_time_in_ns,
-            .receivedSvTimeUncertaintyInNs = entry.received_sv_time_uncertainty_in_ns,
-            .cN0DbHz = entry.c_n0_dbhz,
-            .pseudorangeRateMps = entry.pseudorange_rate_mps,
-            .pseudorangeRateUncertaintyMps = entry.pseudorange_rate_uncertainty_mps,
-            .accumulatedDeltaRangeState = entry.accumulated_delta_range_state,
-            .accumulatedDeltaRangeM = entry.accumulated_delta_range_m,
-            .accumulatedDeltaRangeUncertaintyM = entry.accumulated_delta_range_uncertainty_m,
-            .carrierFrequencyHz = entry.carrier_frequency_hz,
-            .carrierCycles = entry.carrier_cycles,
-            .carrierPhase = entry.carrier_phase,
-            .carrierPhaseUncertainty = entry.carrier_phase_uncertainty,
-            .multipathIndicator = static_cast<IGnssMeasurementCallback::GnssMultipathIndicator>(
-                    entry.multipath_indicator),
-            .snrDb = entry.snr_db
-        };
+        convertMeasurement(legacyGnssData->measurements[i], &gnssData.measurements[i]);
     }
 
-    auto clockVal = legacyGnssData->clock;
+    const auto& clockVal = legacyGnssData->clock;
     gnssData.clock = {
         .gnssClockFlags = clockVal.flags,
         .leapSecond = clockVal.leap_second,
@@ -119,13 +126,16 @@ void GnssMeasurement::gpsMeasurementCb(GpsData* gpsData) {
         return;
     }
 
-    IGnssMeasurementCallback::GnssData gnssData;
+    std::lock_guard<std::mutex> lock(sGnssDataMutex);
+    IGnssMeasurementCallback::GnssData& gnssData = sGnssData;
     gnssData.measurementCount = std::min(gpsData->measurement_count,
                                          static_cast<size_t>(GnssMax::SVS_COUNT));
 
 
     for (size_t i = 0; i < gnssData.measurementCount; i++) {
-        auto entry = gpsData->measurements[i];
+        const auto& entry = gpsData->measurements[i];
+        // fields GpsMeasurement lacks must not keep values from an earlier report
+        gnssData.measurements[i] = {};
         gnssData.measurements[i].flags = entry.flags;
         gnssData.measurements[i].svid = static_cast<int32_t>(entry.prn);
         if (entry.prn >= 1 && entry.prn <= 32) {
@@ -183,6 +193,8 @@ void GnssMeasurement::gpsMeasurementCb(GpsData* gpsData) {
     auto clockVal = gpsData->clock;
     static uint32_t discontinuity_count_to_handle_old_clock_type = 0;
 
+    gnssData.clock = {};
+
     gnssData.clock.leapSecond = clockVal.leap_second;
     /*
      * GnssClock only supports the more effective HW_CLOCK type, so type
@@ -17,6 +17,8 @@
 #ifndef android_hardware_gnss_V1_0_GnssMeasurement_H_
 #define android_hardware_gnss_V1_0_GnssMeasurement_H_
 
+#include <mutex>
+
 #include <ThreadCreationWrapper.h>
 #include <android/hardware/gnss/1.0/IGnssMeasurement.h>
 #include <hidl/Status.h>
@@ -37,6 +39,7 @@ using ::android::hardware::hidl_string;
 using ::android::sp;
 
 using LegacyGnssData = ::GnssData;
+using LegacyGnssMeasurement = ::GnssMeasurement;
 
 /*
  * Extended interface for GNSS Measurements support. Also contains wrapper methods to allow methods
@@ -71,8 +74,18 @@ struct GnssMeasurement : public IGnssMeasurement {
     static GpsMeasurementCallbacks sGnssMeasurementCbs;
 
  private:
+    static void convertMeasurement(const LegacyGnssMeasurement& in,
+                                   IGnssMeasurementCallback::GnssMeasurement* out);
+
     const GpsMeasurementInterface* mGnssMeasureIface = nullptr;
     static sp<IGnssMeasurementCallback> sGnssMeasureCbIface;
+
+    /*
+     * Conversion storage reused by the callbacks. GnssData holds room for SVS_COUNT
+     * measurements, so building it on the stack for every report is costly.
+     */
+    static std::mutex sGnssDataMutex;
+    static IGnssMeasurementCallback::GnssData sGnssData;
 };
 
 }  // namespace implementation
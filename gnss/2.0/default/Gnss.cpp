@@ -19,14 +19,16 @@
 #include "Gnss.h"
 
 #include <log/log.h>
-#include <utils/SystemClock.h>
 
 #include "AGnss.h"
 #include "AGnssRil.h"
 #include "GnssBatching.h"
 #include "GnssConfiguration.h"
+#include "GnssEpochScheduler.h"
 #include "GnssMeasurement.h"
 #include "GnssMeasurementCorrections.h"
+#include "GnssNavigationMessage.h"
+#include "GnssReplay.h"
 #include "GnssVisibilityControl.h"
 #include "Utils.h"
 
@@ -47,13 +49,11 @@ using GnssSvFlags = IGnssCallback::GnssSvFlags;
 sp<V2_0::IGnssCallback> Gnss::sGnssCallback_2_0 = nullptr;
 sp<V1_1::IGnssCallback> Gnss::sGnssCallback_1_1 = nullptr;
 
-namespace {
-
-V2_0::GnssLocation getMockLocationV2_0() {
+V2_0::GnssLocation Gnss::getMockLocationV2_0(int64_t epochTimeNs) {
     const ElapsedRealtime timestamp = {
             .flags = ElapsedRealtimeFlags::HAS_TIMESTAMP_NS |
                      ElapsedRealtimeFlags::HAS_TIME_UNCERTAINTY_NS,
-            .timestampNs = static_cast<uint64_t>(::android::elapsedRealtimeNano()),
+            .timestampNs = static_cast<uint64_t>(epochTimeNs),
             // This is an hardcoded value indicating a 1ms of uncertainty between the two clocks.
             // In an actual implementation provide an estimate of the synchronization uncertainty
             // or don't set the field.
@@ -63,7 +63,14 @@ V2_0::GnssLocation getMockLocationV2_0() {
     return location;
 }
 
-}  // namespace
+V2_0::GnssLocation Gnss::getLocationV2_0(EpochSource source, int64_t epochTimeNs) {
+    V2_0::GnssLocation location = getMockLocationV2_0(epochTimeNs);
+    GnssReplay* replay = GnssReplay::getInstance();
+    if (replay != nullptr) {
+        replay->getLocation(source, epochTimeNs, &location.v1_0);
+    }
+    return location;
+}
 
 Gnss::Gnss() : mMinIntervalMs(1000) {}
 
@@ -84,22 +91,16 @@ Return<bool> Gnss::start() {
     }
 
     mIsActive = true;
-    mThread = std::thread([this]() {
-        while (mIsActive == true) {
-            const auto location = getMockLocationV2_0();
-            this->reportLocation(location);
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(mMinIntervalMs));
-        }
-    });
+    GnssEpochScheduler::getInstance().setListener(
+            EpochSource::LOCATION, this, mMinIntervalMs, [this](int64_t epochTimeNs) {
+                this->reportLocation(getLocationV2_0(EpochSource::LOCATION, epochTimeNs));
+            });
     return true;
 }
 
 Return<bool> Gnss::stop() {
     mIsActive = false;
-    if (mThread.joinable()) {
-        mThread.join();
-    }
+    GnssEpochScheduler::getInstance().removeListener(EpochSource::LOCATION, this);
     return true;
 }
 
@@ -155,8 +156,8 @@ Return<sp<V1_0::IGnssMeasurement>> Gnss::getExtensionGnssMeasurement() {
 }
 
 Return<sp<V1_0::IGnssNavigationMessage>> Gnss::getExtensionGnssNavigationMessage() {
-    // TODO(b/124012850): Implement function.
-    return sp<V1_0::IGnssNavigationMessage>{};
+    ALOGD("Gnss::getExtensionGnssNavigationMessage");
+    return new GnssNavigationMessage();
 }
 
 Return<sp<V1_0::IGnssXtra>> Gnss::getExtensionXtra() {
@@ -280,7 +281,8 @@ Return<bool> Gnss::setCallback_2_0(const sp<V2_0::IGnssCallback>& callback) {
     sGnssCallback_2_0 = callback;
 
     using Capabilities = V2_0::IGnssCallback::Capabilities;
-    const auto capabilities = Capabilities::MEASUREMENTS | Capabilities::MEASUREMENT_CORRECTIONS |
+    const auto capabilities = Capabilities::MEASUREMENTS | Capabilities::NAV_MESSAGES |
+                              Capabilities::MEASUREMENT_CORRECTIONS |
                               Capabilities::LOW_POWER_MODE | Capabilities::SATELLITE_BLACKLIST;
     auto ret = sGnssCallback_2_0->gnssSetCapabilitiesCb_2_0(capabilities);
     if (!ret.isOk()) {
@@ -22,7 +22,7 @@
 #include <hidl/Status.h>
 #include <atomic>
 #include <mutex>
-#include <thread>
+#include "GnssEpochScheduler.h"
 
 namespace android {
 namespace hardware {
@@ -95,13 +95,19 @@ struct Gnss : public IGnss {
     Return<sp<V2_0::IGnssBatching>> getExtensionGnssBatching_2_0() override;
     Return<bool> injectBestLocation_2_0(const V2_0::GnssLocation& location) override;
 
+    // Returns the mock location of the epoch starting at epochTimeNs.
+    static V2_0::GnssLocation getMockLocationV2_0(int64_t epochTimeNs);
+
+    // Returns the location reported by source at epochTimeNs, replayed from the log when one is
+    // configured and has a fix, and the mock location otherwise.
+    static V2_0::GnssLocation getLocationV2_0(EpochSource source, int64_t epochTimeNs);
+
   private:
     Return<void> reportLocation(const V2_0::GnssLocation&) const;
     static sp<V2_0::IGnssCallback> sGnssCallback_2_0;
     static sp<V1_1::IGnssCallback> sGnssCallback_1_1;
     std::atomic<long> mMinIntervalMs;
     std::atomic<bool> mIsActive;
-    std::thread mThread;
     mutable std::mutex mMutex;
 };
 
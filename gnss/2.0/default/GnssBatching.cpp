@@ -17,6 +17,10 @@
 #define LOG_TAG "GnssBatching"
 
 #include "GnssBatching.h"
+#include "Gnss.h"
+#include "GnssEpochScheduler.h"
+
+#include <log/log.h>
 
 namespace android {
 namespace hardware {
@@ -26,6 +30,12 @@ namespace implementation {
 
 sp<V2_0::IGnssBatchingCallback> GnssBatching::sCallback = nullptr;
 
+GnssBatching::GnssBatching() : mBatchStart(0), mBatchCount(0), mWakeupOnFifoFull(false) {}
+
+GnssBatching::~GnssBatching() {
+    stop();
+}
+
 // Methods from ::android::hardware::gnss::V1_0::IGnssBatching follow.
 Return<bool> GnssBatching::init(const sp<V1_0::IGnssBatchingCallback>&) {
     // TODO implement
@@ -33,36 +43,102 @@ Return<bool> GnssBatching::init(const sp<V1_0::IGnssBatchingCallback>&) {
 }
 
 Return<uint16_t> GnssBatching::getBatchSize() {
-    // TODO implement
-    return uint16_t{};
+    return kBatchSize;
 }
 
-Return<bool> GnssBatching::start(const V1_0::IGnssBatching::Options&) {
-    // TODO implement
-    return bool{};
+Return<bool> GnssBatching::start(const V1_0::IGnssBatching::Options& options) {
+    using Flag = V1_0::IGnssBatching::Flag;
+    const int64_t periodMs = options.periodNanos / 1000000;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mWakeupOnFifoFull = (options.flags & static_cast<uint8_t>(Flag::WAKEUP_ON_FIFO_FULL)) != 0;
+    }
+    GnssEpochScheduler::getInstance().setListener(
+            EpochSource::BATCHING, this, periodMs > 0 ? periodMs : 1000,
+            [this](int64_t epochTimeNs) {
+                this->batchLocation(Gnss::getLocationV2_0(EpochSource::BATCHING, epochTimeNs));
+            });
+    return true;
 }
 
 Return<void> GnssBatching::flush() {
-    // TODO implement
+    hidl_vec<V2_0::GnssLocation> locations;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        locations = takeBatchLocked();
+    }
+    reportBatch(locations);
     return Void();
 }
 
 Return<bool> GnssBatching::stop() {
-    // TODO implement
-    return bool{};
+    GnssEpochScheduler::getInstance().removeListener(EpochSource::BATCHING, this);
+    return true;
 }
 
 Return<void> GnssBatching::cleanup() {
-    // TODO implement
+    stop();
+    std::unique_lock<std::mutex> lock(mMutex);
+    mBatchStart = 0;
+    mBatchCount = 0;
     return Void();
 }
 
 // Methods from V2_0::IGnssBatching follow.
 Return<bool> GnssBatching::init_2_0(const sp<V2_0::IGnssBatchingCallback>& callback) {
+    std::unique_lock<std::mutex> lock(mMutex);
     sCallback = callback;
     return true;
 }
 
+void GnssBatching::batchLocation(const V2_0::GnssLocation& location) {
+    hidl_vec<V2_0::GnssLocation> locations;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mBatchCount == kBatchSize) {
+            if (mWakeupOnFifoFull) {
+                locations = takeBatchLocked();
+            } else {
+                // Drop the oldest location
+                mBatchStart = (mBatchStart + 1) % kBatchSize;
+                mBatchCount--;
+            }
+        }
+        mBatch[(mBatchStart + mBatchCount) % kBatchSize] = location;
+        mBatchCount++;
+    }
+    if (locations.size() > 0) {
+        reportBatch(locations);
+    }
+}
+
+hidl_vec<V2_0::GnssLocation> GnssBatching::takeBatchLocked() {
+    hidl_vec<V2_0::GnssLocation> locations;
+    locations.resize(mBatchCount);
+    for (size_t i = 0; i < mBatchCount; i++) {
+        locations[i] = mBatch[(mBatchStart + i) % kBatchSize];
+    }
+    mBatchStart = 0;
+    mBatchCount = 0;
+    return locations;
+}
+
+void GnssBatching::reportBatch(const hidl_vec<V2_0::GnssLocation>& locations) {
+    sp<IGnssBatchingCallback> callback;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        callback = sCallback;
+    }
+    if (callback == nullptr) {
+        ALOGE("%s: GnssBatching::sCallback is null.", __func__);
+        return;
+    }
+    auto ret = callback->gnssLocationBatchCb(locations);
+    if (!ret.isOk()) {
+        ALOGE("%s: Unable to invoke callback", __func__);
+    }
+}
+
 }  // namespace implementation
 }  // namespace V2_0
 }  // namespace gnss
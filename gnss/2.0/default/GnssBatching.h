@@ -19,6 +19,8 @@
 #include <android/hardware/gnss/2.0/IGnssBatching.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <array>
+#include <mutex>
 
 namespace android {
 namespace hardware {
@@ -35,6 +37,8 @@ using ::android::hardware::Return;
 using ::android::hardware::Void;
 
 struct GnssBatching : public IGnssBatching {
+    GnssBatching();
+    ~GnssBatching();
     // Methods from ::android::hardware::gnss::V1_0::IGnssBatching follow.
     Return<bool> init(const sp<V1_0::IGnssBatchingCallback>& callback) override;
     Return<uint16_t> getBatchSize() override;
@@ -47,7 +51,22 @@ struct GnssBatching : public IGnssBatching {
     Return<bool> init_2_0(const sp<V2_0::IGnssBatchingCallback>& callback) override;
 
   private:
+    // Number of locations held before the oldest is dropped or the batch is delivered.
+    static constexpr uint16_t kBatchSize = 16;
+
+    void batchLocation(const V2_0::GnssLocation& location);
+    // Takes the batched locations, oldest first. Must be called with mMutex held.
+    hidl_vec<V2_0::GnssLocation> takeBatchLocked();
+    void reportBatch(const hidl_vec<V2_0::GnssLocation>& locations);
+
     static sp<IGnssBatchingCallback> sCallback;
+
+    // Ring of batched locations, mBatchCount of them starting at mBatchStart.
+    std::array<V2_0::GnssLocation, kBatchSize> mBatch;
+    size_t mBatchStart;
+    size_t mBatchCount;
+    bool mWakeupOnFifoFull;
+    mutable std::mutex mMutex;
 };
 
 }  // namespace implementation
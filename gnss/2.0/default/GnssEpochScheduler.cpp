@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GnssEpochScheduler"
+
+#include "GnssEpochScheduler.h"
+
+#include <log/log.h>
+#include <utils/SystemClock.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+namespace {
+
+// Epochs missed by more than this, e.g. while the device was suspended, are skipped rather than
+// reported in a burst.
+constexpr int64_t kMaxEpochLatenessNs = 100 * 1000 * 1000;
+
+}  // namespace
+
+GnssEpochScheduler& GnssEpochScheduler::getInstance() {
+    // Never destroyed, the scheduler thread may outlive static destruction.
+    static GnssEpochScheduler* sInstance = new GnssEpochScheduler();
+    return *sInstance;
+}
+
+GnssEpochScheduler::GnssEpochScheduler() : mLastEpochNs(0), mThreadRunning(false) {}
+
+void GnssEpochScheduler::setListener(EpochSource source, const void* owner, int64_t intervalMs,
+                                     EpochCallback callback) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mListeners[source] = {.owner = owner,
+                          .intervalNs = std::max<int64_t>(intervalMs, 1) * 1000000,
+                          .callback = std::move(callback)};
+    if (!mThreadRunning) {
+        if (mThread.joinable()) {
+            mThread.join();
+        }
+        mLastEpochNs = ::android::elapsedRealtimeNano();
+        mThreadRunning = true;
+        mThread = std::thread([this]() { run(); });
+    }
+    mCondition.notify_all();
+}
+
+void GnssEpochScheduler::removeListener(EpochSource source, const void* owner) {
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        auto listener = mListeners.find(source);
+        if (listener != mListeners.end() && listener->second.owner == owner) {
+            mListeners.erase(listener);
+            mCondition.notify_all();
+        }
+    }
+    // Wait for an epoch that may still be running a listener of owner, even one since replaced
+    std::unique_lock<std::mutex> dispatchLock(mDispatchMutex);
+}
+
+int64_t GnssEpochScheduler::getNextEpochLocked(int64_t timeNs) const {
+    int64_t nextEpochNs = std::numeric_limits<int64_t>::max();
+    for (const auto& listener : mListeners) {
+        const int64_t intervalNs = listener.second.intervalNs;
+        nextEpochNs = std::min(nextEpochNs, (timeNs / intervalNs + 1) * intervalNs);
+    }
+    return nextEpochNs;
+}
+
+void GnssEpochScheduler::run() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    std::vector<EpochCallback> callbacks;
+    while (!mListeners.empty()) {
+        const int64_t nowNs = ::android::elapsedRealtimeNano();
+        const int64_t epochNs =
+                getNextEpochLocked(std::max(mLastEpochNs, nowNs - kMaxEpochLatenessNs));
+        if (epochNs > nowNs) {
+            mCondition.wait_for(lock, std::chrono::nanoseconds(epochNs - nowNs));
+            continue;
+        }
+
+        mLastEpochNs = epochNs;
+        for (const auto& listener : mListeners) {
+            if (epochNs % listener.second.intervalNs == 0) {
+                callbacks.push_back(listener.second.callback);
+            }
+        }
+
+        std::unique_lock<std::mutex> dispatchLock(mDispatchMutex);
+        lock.unlock();
+        for (const auto& callback : callbacks) {
+            callback(epochNs);
+        }
+        callbacks.clear();
+        dispatchLock.unlock();
+        lock.lock();
+    }
+    ALOGD("No more listeners, stopping");
+    mThreadRunning = false;
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_GNSS_V2_0_GNSSEPOCHSCHEDULER_H
+#define ANDROID_HARDWARE_GNSS_V2_0_GNSSEPOCHSCHEDULER_H
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+// Listeners of the same epoch are called in this order.
+enum class EpochSource { LOCATION, MEASUREMENT, NAVIGATION_MESSAGE, BATCHING };
+
+// Drives all the mock GNSS outputs from a single thread. Epochs fall on multiples of the listener
+// intervals in the elapsed realtime timebase, so outputs with related intervals share the same
+// epochs, and every listener of an epoch is given the same epoch timestamp.
+class GnssEpochScheduler {
+  public:
+    using EpochCallback = std::function<void(int64_t epochTimeNs)>;
+
+    static GnssEpochScheduler& getInstance();
+
+    // Registers or replaces the listener of source on behalf of owner. Must not be called from an
+    // EpochCallback.
+    void setListener(EpochSource source, const void* owner, int64_t intervalMs,
+                     EpochCallback callback);
+
+    // Removes the listener of source if owner registered it. Once this returns the listener is not
+    // running and will not run again. Must not be called from an EpochCallback.
+    void removeListener(EpochSource source, const void* owner);
+
+  private:
+    struct Listener {
+        const void* owner;
+        int64_t intervalNs;
+        EpochCallback callback;
+    };
+
+    GnssEpochScheduler();
+
+    void run();
+
+    // Returns the earliest epoch of any listener after timeNs. Must be called with mMutex held.
+    int64_t getNextEpochLocked(int64_t timeNs) const;
+
+    std::map<EpochSource, Listener> mListeners;
+    int64_t mLastEpochNs;
+    bool mThreadRunning;
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+
+    // Held while listeners run, so that removeListener() can wait for them.
+    std::mutex mDispatchMutex;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_GNSS_V2_0_GNSSEPOCHSCHEDULER_H
@@ -16,9 +16,10 @@
 #define LOG_TAG "GnssMeasurement"
 
 #include "GnssMeasurement.h"
+#include "GnssEpochScheduler.h"
+#include "GnssReplay.h"
 
 #include <log/log.h>
-#include <utils/SystemClock.h>
 
 namespace android {
 namespace hardware {
@@ -47,8 +48,9 @@ Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> GnssMeasurement::setCallba
 
 Return<void> GnssMeasurement::close() {
     ALOGD("close");
-    std::unique_lock<std::mutex> lock(mMutex);
+    // Stop first, the epoch being reported may need mMutex
     stop();
+    std::unique_lock<std::mutex> lock(mMutex);
     sCallback = nullptr;
     return Void();
 }
@@ -64,8 +66,10 @@ Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> GnssMeasurement::setCallba
 Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> GnssMeasurement::setCallback_2_0(
     const sp<V2_0::IGnssMeasurementCallback>& callback, bool) {
     ALOGD("setCallback_2_0");
-    std::unique_lock<std::mutex> lock(mMutex);
-    sCallback = callback;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        sCallback = callback;
+    }
 
     if (mIsActive) {
         ALOGW("GnssMeasurement callback already set. Resetting the callback...");
@@ -79,76 +83,62 @@ Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> GnssMeasurement::setCallba
 void GnssMeasurement::start() {
     ALOGD("start");
     mIsActive = true;
-    mThread = std::thread([this]() {
-        while (mIsActive == true) {
-            auto measurement = this->getMockMeasurement();
-            this->reportMeasurement(measurement);
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(mMinIntervalMillis));
-        }
-    });
+    GnssEpochScheduler::getInstance().setListener(
+            EpochSource::MEASUREMENT, this, mMinIntervalMillis, [this](int64_t epochTimeNs) {
+                this->reportMeasurement(this->getMockMeasurement(epochTimeNs));
+            });
 }
 
 void GnssMeasurement::stop() {
     ALOGD("stop");
     mIsActive = false;
-    if (mThread.joinable()) {
-        mThread.join();
-    }
+    GnssEpochScheduler::getInstance().removeListener(EpochSource::MEASUREMENT, this);
 }
 
-GnssData GnssMeasurement::getMockMeasurement() {
-    V1_0::IGnssMeasurementCallback::GnssMeasurement measurement_1_0 = {
-            .flags = (uint32_t)GnssMeasurementFlags::HAS_CARRIER_FREQUENCY,
-            .svid = (int16_t)6,
-            .constellation = V1_0::GnssConstellationType::UNKNOWN,
-            .timeOffsetNs = 0.0,
-            .receivedSvTimeInNs = 8195997131077,
-            .receivedSvTimeUncertaintyInNs = 15,
-            .cN0DbHz = 30.0,
-            .pseudorangeRateMps = -484.13739013671875,
-            .pseudorangeRateUncertaintyMps = 1.0379999876022339,
-            .accumulatedDeltaRangeState = (uint32_t)V1_0::IGnssMeasurementCallback::
-                    GnssAccumulatedDeltaRangeState::ADR_STATE_UNKNOWN,
-            .accumulatedDeltaRangeM = 0.0,
-            .accumulatedDeltaRangeUncertaintyM = 0.0,
-            .carrierFrequencyHz = 1.59975e+09,
-            .multipathIndicator =
-                    V1_0::IGnssMeasurementCallback::GnssMultipathIndicator::INDICATOR_UNKNOWN};
-    V1_1::IGnssMeasurementCallback::GnssMeasurement measurement_1_1 = {.v1_0 = measurement_1_0};
-    V2_0::IGnssMeasurementCallback::GnssMeasurement measurement_2_0 = {
-            .v1_1 = measurement_1_1,
-            .codeType = "C",
-            .state = GnssMeasurementState::STATE_CODE_LOCK | GnssMeasurementState::STATE_BIT_SYNC |
-                     GnssMeasurementState::STATE_SUBFRAME_SYNC |
-                     GnssMeasurementState::STATE_TOW_DECODED |
-                     GnssMeasurementState::STATE_GLO_STRING_SYNC |
-                     GnssMeasurementState::STATE_GLO_TOD_DECODED,
-            .constellation = GnssConstellationType::GLONASS,
+const GnssData& GnssMeasurement::getMockMeasurement(int64_t epochTimeNs) {
+    static const NativeGnssMeasurement kMockMeasurements[] = {
+            {.flags = (uint32_t)GnssMeasurementFlags::HAS_CARRIER_FREQUENCY,
+             .svid = (int16_t)6,
+             .constellation = (uint8_t)GnssConstellationType::GLONASS,
+             .multipathIndicator = (uint8_t)V1_0::IGnssMeasurementCallback::
+                     GnssMultipathIndicator::INDICATOR_UNKNOWN,
+             .state = GnssMeasurementState::STATE_CODE_LOCK | GnssMeasurementState::STATE_BIT_SYNC |
+                      GnssMeasurementState::STATE_SUBFRAME_SYNC |
+                      GnssMeasurementState::STATE_TOW_DECODED |
+                      GnssMeasurementState::STATE_GLO_STRING_SYNC |
+                      GnssMeasurementState::STATE_GLO_TOD_DECODED,
+             .accumulatedDeltaRangeState = (uint16_t)V1_0::IGnssMeasurementCallback::
+                     GnssAccumulatedDeltaRangeState::ADR_STATE_UNKNOWN,
+             .codeType = "C",
+             .receivedSvTimeInNs = 8195997131077,
+             .receivedSvTimeUncertaintyInNs = 15,
+             .timeOffsetNs = 0.0,
+             .cN0DbHz = 30.0,
+             .pseudorangeRateMps = -484.13739013671875,
+             .pseudorangeRateUncertaintyMps = 1.0379999876022339,
+             .accumulatedDeltaRangeM = 0.0,
+             .accumulatedDeltaRangeUncertaintyM = 0.0,
+             .carrierFrequencyHz = 1.59975e+09},
     };
-
-    hidl_vec<IGnssMeasurementCallback::GnssMeasurement> measurements(1);
-    measurements[0] = measurement_2_0;
-    V1_0::IGnssMeasurementCallback::GnssClock clock = {.timeNs = 2713545000000,
-                                                       .fullBiasNs = -1226701900521857520,
-                                                       .biasNs = 0.59689998626708984,
-                                                       .biasUncertaintyNs = 47514.989972114563,
-                                                       .driftNsps = -51.757811607455452,
-                                                       .driftUncertaintyNsps = 310.64968328491528,
-                                                       .hwClockDiscontinuityCount = 1};
-
-    ElapsedRealtime timestamp = {
-            .flags = ElapsedRealtimeFlags::HAS_TIMESTAMP_NS |
-                     ElapsedRealtimeFlags::HAS_TIME_UNCERTAINTY_NS,
-            .timestampNs = static_cast<uint64_t>(::android::elapsedRealtimeNano()),
-            // This is an hardcoded value indicating a 1ms of uncertainty between the two clocks.
-            // In an actual implementation provide an estimate of the synchronization uncertainty
-            // or don't set the field.
-            .timeUncertaintyNs = 1000000};
-
-    GnssData gnssData = {
-            .measurements = measurements, .clock = clock, .elapsedRealtime = timestamp};
-    return gnssData;
+    static const V1_0::IGnssMeasurementCallback::GnssClock kMockClock = {
+            .timeNs = 2713545000000,
+            .fullBiasNs = -1226701900521857520,
+            .biasNs = 0.59689998626708984,
+            .biasUncertaintyNs = 47514.989972114563,
+            .driftNsps = -51.757811607455452,
+            .driftUncertaintyNsps = 310.64968328491528,
+            .hwClockDiscontinuityCount = 1};
+
+    GnssReplay* replay = GnssReplay::getInstance();
+    if (replay == nullptr || !replay->getMeasurements(epochTimeNs, &mFrameBuilder)) {
+        mFrameBuilder.setMeasurements(kMockMeasurements,
+                                      sizeof(kMockMeasurements) / sizeof(kMockMeasurements[0]));
+        mFrameBuilder.setClock(kMockClock);
+    }
+    // This is an hardcoded value indicating a 1ms of uncertainty between the two clocks.
+    // In an actual implementation provide an estimate of the synchronization uncertainty
+    // or don't set the field.
+    return mFrameBuilder.build(epochTimeNs, 1000000);
 }
 
 void GnssMeasurement::reportMeasurement(const GnssData& data) {
@@ -22,7 +22,7 @@
 #include <hidl/Status.h>
 #include <atomic>
 #include <mutex>
-#include <thread>
+#include "GnssMeasurementFrameBuilder.h"
 
 namespace android {
 namespace hardware {
@@ -59,14 +59,15 @@ struct GnssMeasurement : public IGnssMeasurement {
    private:
     void start();
     void stop();
-    GnssData getMockMeasurement();
+    const GnssData& getMockMeasurement(int64_t epochTimeNs);
     void reportMeasurement(const GnssData&);
 
     static sp<IGnssMeasurementCallback> sCallback;
     std::atomic<long> mMinIntervalMillis;
     std::atomic<bool> mIsActive;
-    std::thread mThread;
     mutable std::mutex mMutex;
+    // Only used from the epoch scheduler thread
+    GnssMeasurementFrameBuilder mFrameBuilder;
 };
 
 }  // namespace implementation
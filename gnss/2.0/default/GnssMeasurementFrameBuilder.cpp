@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GnssMeasurementFrameBuilder.h"
+
+#include <string.h>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+using GnssMultipathIndicator = V1_0::IGnssMeasurementCallback::GnssMultipathIndicator;
+
+void GnssMeasurementFrameBuilder::setMeasurements(const NativeGnssMeasurement* measurements,
+                                                  size_t count) {
+    if (mMeasurements.size() < count) {
+        mMeasurements.resize(count);
+    }
+    mMeasurementCount = count;
+
+    for (size_t i = 0; i < count; i++) {
+        const NativeGnssMeasurement& src = measurements[i];
+        V2_0::IGnssMeasurementCallback::GnssMeasurement& dst = mMeasurements[i];
+        V1_0::IGnssMeasurementCallback::GnssMeasurement& dst_1_0 = dst.v1_1.v1_0;
+
+        dst_1_0.flags = src.flags;
+        dst_1_0.svid = src.svid;
+        // Superseded by the 2.0 constellation and state fields
+        dst_1_0.constellation = V1_0::GnssConstellationType::UNKNOWN;
+        dst_1_0.state = 0;
+        dst_1_0.timeOffsetNs = src.timeOffsetNs;
+        dst_1_0.receivedSvTimeInNs = src.receivedSvTimeInNs;
+        dst_1_0.receivedSvTimeUncertaintyInNs = src.receivedSvTimeUncertaintyInNs;
+        dst_1_0.cN0DbHz = src.cN0DbHz;
+        dst_1_0.pseudorangeRateMps = src.pseudorangeRateMps;
+        dst_1_0.pseudorangeRateUncertaintyMps = src.pseudorangeRateUncertaintyMps;
+        dst_1_0.accumulatedDeltaRangeState = src.accumulatedDeltaRangeState;
+        dst_1_0.accumulatedDeltaRangeM = src.accumulatedDeltaRangeM;
+        dst_1_0.accumulatedDeltaRangeUncertaintyM = src.accumulatedDeltaRangeUncertaintyM;
+        dst_1_0.carrierFrequencyHz = src.carrierFrequencyHz;
+        dst_1_0.multipathIndicator = static_cast<GnssMultipathIndicator>(src.multipathIndicator);
+        dst_1_0.snrDb = src.snrDb;
+        dst_1_0.agcLevelDb = src.agcLevelDb;
+
+        dst.v1_1.accumulatedDeltaRangeState = src.accumulatedDeltaRangeState;
+        dst.state = src.state;
+        dst.constellation = static_cast<GnssConstellationType>(src.constellation);
+
+        // A slot usually tracks the same signal from one epoch to the next, only reallocate the
+        // string when the code type changes.
+        const size_t codeTypeLength = strnlen(src.codeType, sizeof(src.codeType));
+        if (dst.codeType.size() != codeTypeLength ||
+            memcmp(dst.codeType.c_str(), src.codeType, codeTypeLength) != 0) {
+            dst.codeType = hidl_string(src.codeType, codeTypeLength);
+        }
+    }
+}
+
+void GnssMeasurementFrameBuilder::setClock(const V1_0::IGnssMeasurementCallback::GnssClock& clock) {
+    mGnssData.clock = clock;
+}
+
+const GnssMeasurementFrameBuilder::GnssData& GnssMeasurementFrameBuilder::build(
+        int64_t elapsedRealtimeNs, uint64_t timeUncertaintyNs) {
+    // The vector may have grown since the last frame, point at its current storage
+    mGnssData.measurements.setToExternal(mMeasurements.data(), mMeasurementCount);
+    mGnssData.elapsedRealtime = {
+            .flags = ElapsedRealtimeFlags::HAS_TIMESTAMP_NS |
+                     ElapsedRealtimeFlags::HAS_TIME_UNCERTAINTY_NS,
+            .timestampNs = static_cast<uint64_t>(elapsedRealtimeNs),
+            .timeUncertaintyNs = timeUncertaintyNs};
+    return mGnssData;
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_GNSS_V2_0_GNSSMEASUREMENTFRAMEBUILDER_H
+#define ANDROID_HARDWARE_GNSS_V2_0_GNSSMEASUREMENTFRAMEBUILDER_H
+
+#include <android/hardware/gnss/2.0/IGnssMeasurementCallback.h>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+// Measurement as laid out by the chipset driver, before conversion to the HIDL types.
+struct NativeGnssMeasurement {
+    uint32_t flags;  // GnssMeasurementFlags
+    int16_t svid;
+    uint8_t constellation;       // V2_0::GnssConstellationType
+    uint8_t multipathIndicator;  // GnssMultipathIndicator
+    uint32_t state;              // V2_0 GnssMeasurementState
+    uint16_t accumulatedDeltaRangeState;  // V1_1 GnssAccumulatedDeltaRangeState
+    char codeType[8];                     // Not NUL terminated when all 8 chars are used
+    int64_t receivedSvTimeInNs;
+    int64_t receivedSvTimeUncertaintyInNs;
+    double timeOffsetNs;
+    double cN0DbHz;
+    double pseudorangeRateMps;
+    double pseudorangeRateUncertaintyMps;
+    double accumulatedDeltaRangeM;
+    double accumulatedDeltaRangeUncertaintyM;
+    float carrierFrequencyHz;
+    double snrDb;
+    double agcLevelDb;
+};
+
+// Builds the GnssData of successive epochs into the same storage. Once the builder has seen its
+// largest epoch, building a frame does not allocate, unless the code type of a measurement slot
+// changes.
+class GnssMeasurementFrameBuilder {
+  public:
+    using GnssData = V2_0::IGnssMeasurementCallback::GnssData;
+
+    // Converts a frame of count measurements.
+    void setMeasurements(const NativeGnssMeasurement* measurements, size_t count);
+    void setClock(const V1_0::IGnssMeasurementCallback::GnssClock& clock);
+
+    // Returns the frame. It refers to the builder's storage and is only valid until the next call
+    // to setMeasurements().
+    const GnssData& build(int64_t elapsedRealtimeNs, uint64_t timeUncertaintyNs);
+
+  private:
+    std::vector<V2_0::IGnssMeasurementCallback::GnssMeasurement> mMeasurements;
+    size_t mMeasurementCount = 0;
+    GnssData mGnssData = {};
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_GNSS_V2_0_GNSSMEASUREMENTFRAMEBUILDER_H
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "GnssNavigationMessage"
+
+#include "GnssNavigationMessage.h"
+#include "GnssEpochScheduler.h"
+
+#include <log/log.h>
+
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+using GnssNavigationMessageType = V1_0::IGnssNavigationMessageCallback::GnssNavigationMessageType;
+using NavigationMessageStatus = V1_0::IGnssNavigationMessageCallback::NavigationMessageStatus;
+
+// Interval of the mock navigation messages, one per measurement epoch.
+constexpr int64_t kNavigationMessageIntervalMs = 1000;
+
+// Size of a GLONASS L1 C/A string, padded to whole bytes.
+constexpr size_t kGloStringSizeBytes = 11;
+
+sp<V1_0::IGnssNavigationMessageCallback> GnssNavigationMessage::sCallback = nullptr;
+
+GnssNavigationMessage::~GnssNavigationMessage() {
+    close();
+}
+
+// Methods from V1_0::IGnssNavigationMessage follow.
+Return<V1_0::IGnssNavigationMessage::GnssNavigationMessageStatus>
+GnssNavigationMessage::setCallback(const sp<V1_0::IGnssNavigationMessageCallback>& callback) {
+    ALOGD("setCallback");
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        sCallback = callback;
+    }
+    GnssEpochScheduler::getInstance().setListener(
+            EpochSource::NAVIGATION_MESSAGE, this, kNavigationMessageIntervalMs,
+            [this](int64_t) { this->reportNavigationMessage(); });
+    return V1_0::IGnssNavigationMessage::GnssNavigationMessageStatus::SUCCESS;
+}
+
+Return<void> GnssNavigationMessage::close() {
+    ALOGD("close");
+    GnssEpochScheduler::getInstance().removeListener(EpochSource::NAVIGATION_MESSAGE, this);
+    std::unique_lock<std::mutex> lock(mMutex);
+    sCallback = nullptr;
+    return Void();
+}
+
+void GnssNavigationMessage::reportNavigationMessage() {
+    // Matches the GLONASS satellite of the mock measurements
+    GnssNavigationMessageData message = {
+            .svid = 6,
+            .type = GnssNavigationMessageType::GLO_L1CA,
+            .status = (uint16_t)NavigationMessageStatus::PARITY_PASSED,
+            .messageId = 1,
+            .submessageId = 1,
+            .data = std::vector<uint8_t>(kGloStringSizeBytes, 0)};
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (sCallback == nullptr) {
+        ALOGE("%s: GnssNavigationMessage::sCallback is null.", __func__);
+        return;
+    }
+    sCallback->gnssNavigationMessageCb(message);
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_GNSS_V2_0_GNSSNAVIGATIONMESSAGE_H
+#define ANDROID_HARDWARE_GNSS_V2_0_GNSSNAVIGATIONMESSAGE_H
+
+#include <android/hardware/gnss/1.0/IGnssNavigationMessage.h>
+#include <hidl/MQDescriptor.h>
+#include <hidl/Status.h>
+#include <mutex>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::sp;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+
+using GnssNavigationMessageData = V1_0::IGnssNavigationMessageCallback::GnssNavigationMessage;
+
+struct GnssNavigationMessage : public V1_0::IGnssNavigationMessage {
+    ~GnssNavigationMessage();
+    // Methods from V1_0::IGnssNavigationMessage follow.
+    Return<V1_0::IGnssNavigationMessage::GnssNavigationMessageStatus> setCallback(
+        const sp<V1_0::IGnssNavigationMessageCallback>& callback) override;
+    Return<void> close() override;
+
+   private:
+    void reportNavigationMessage();
+
+    static sp<V1_0::IGnssNavigationMessageCallback> sCallback;
+    mutable std::mutex mMutex;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_GNSS_V2_0_GNSSNAVIGATIONMESSAGE_H
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GnssReplay"
+
+#include "GnssReplay.h"
+
+#include <android-base/properties.h>
+#include <log/log.h>
+#include <string.h>
+
+#include <cstdlib>
+#include <utility>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::base::GetProperty;
+using common::GnssLogReader;
+using common::RawField;
+using common::RawGnssMeasurement;
+using GnssClockFlags = V1_0::IGnssMeasurementCallback::GnssClockFlags;
+using GnssMeasurementFlags = V1_0::IGnssMeasurementCallback::GnssMeasurementFlags;
+
+namespace {
+
+constexpr char kReplayPathProperty[] = "vendor.gnss.replay.path";
+constexpr char kReplayRateProperty[] = "vendor.gnss.replay.rate";
+
+}  // namespace
+
+GnssReplay* GnssReplay::getInstance() {
+    // Never destroyed, the scheduler thread may outlive static destruction.
+    static GnssReplay* sInstance = create();
+    return sInstance;
+}
+
+GnssReplay* GnssReplay::create() {
+    const std::string path = GetProperty(kReplayPathProperty, "");
+    if (path.empty()) {
+        return nullptr;
+    }
+    std::unique_ptr<GnssLogReader> reader = GnssLogReader::open(path);
+    if (reader == nullptr) {
+        ALOGE("%s: Unable to replay %s, reporting mock data", __func__, path.c_str());
+        return nullptr;
+    }
+    double rate = strtod(GetProperty(kReplayRateProperty, "1").c_str(), nullptr);
+    if (!(rate > 0)) {
+        ALOGW("%s: Ignoring replay rate %f", __func__, rate);
+        rate = 1;
+    }
+    ALOGI("Replaying %s at %.2fx", path.c_str(), rate);
+    return new GnssReplay(std::move(reader), rate);
+}
+
+GnssReplay::GnssReplay(std::unique_ptr<GnssLogReader> reader, double rate)
+    : mReader(std::move(reader)), mRate(rate) {}
+
+template <typename Record, typename ReadFunc>
+bool GnssReplay::advance(Stream<Record>* stream, int64_t epochTimeNs, ReadFunc read) {
+    if (stream->empty) {
+        return false;
+    }
+    if (!stream->started) {
+        stream->offset = 0;
+        stream->hasNext = read(&stream->offset, &stream->nextLogTimeNs, &stream->next);
+        if (!stream->hasNext) {
+            // Reading from the start found nothing, which would otherwise be done on every call
+            ALOGW("The log has no records for this output");
+            stream->empty = true;
+            return false;
+        }
+        stream->started = true;
+        stream->startLogTimeNs = stream->nextLogTimeNs;
+        stream->startEpochTimeNs = epochTimeNs;
+    }
+
+    const int64_t logTimeNs =
+            stream->startLogTimeNs +
+            static_cast<int64_t>((epochTimeNs - stream->startEpochTimeNs) * mRate);
+    while (stream->hasNext && stream->nextLogTimeNs <= logTimeNs) {
+        // Swapping keeps the storage of both records
+        std::swap(stream->current, stream->next);
+        stream->hasCurrent = true;
+        stream->hasNext = read(&stream->offset, &stream->nextLogTimeNs, &stream->next);
+    }
+    if (!stream->hasNext) {
+        ALOGD("Replayed the whole log, starting over");
+        stream->started = false;
+    }
+    return stream->hasCurrent;
+}
+
+bool GnssReplay::getLocation(EpochSource source, int64_t epochTimeNs,
+                             V1_0::GnssLocation* location) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    Stream<V1_0::GnssLocation>& stream = mLocationStreams[source];
+    const bool found = advance(&stream, epochTimeNs,
+                               [this](size_t* offset, int64_t* timeNs, V1_0::GnssLocation* fix) {
+                                   return mReader->readLocation(offset, timeNs, fix);
+                               });
+    if (found) {
+        *location = stream.current;
+    }
+    return found;
+}
+
+bool GnssReplay::getMeasurements(int64_t epochTimeNs, GnssMeasurementFrameBuilder* builder) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    Stream<std::vector<RawGnssMeasurement>>& stream = mMeasurementStream;
+    const bool found =
+            advance(&stream, epochTimeNs,
+                    [this](size_t* offset, int64_t* timeNs,
+                           std::vector<RawGnssMeasurement>* measurements) {
+                        return mReader->readMeasurements(offset, timeNs, measurements);
+                    });
+    if (!found) {
+        return false;
+    }
+
+    const std::vector<RawGnssMeasurement>& raw = stream.current;
+    mNativeMeasurements.resize(raw.size());
+    for (size_t i = 0; i < raw.size(); i++) {
+        const RawGnssMeasurement& src = raw[i];
+        NativeGnssMeasurement& dst = mNativeMeasurements[i];
+        dst = {.svid = src.svid,
+               .constellation = src.constellationType,
+               .multipathIndicator = src.multipathIndicator,
+               .state = src.state,
+               .accumulatedDeltaRangeState = src.accumulatedDeltaRangeState,
+               .receivedSvTimeInNs = src.receivedSvTimeNanos,
+               .receivedSvTimeUncertaintyInNs = src.receivedSvTimeUncertaintyNanos,
+               .timeOffsetNs = src.timeOffsetNanos,
+               .cN0DbHz = src.cn0DbHz,
+               .pseudorangeRateMps = src.pseudorangeRateMetersPerSecond,
+               .pseudorangeRateUncertaintyMps = src.pseudorangeRateUncertaintyMetersPerSecond,
+               .accumulatedDeltaRangeM = src.accumulatedDeltaRangeMeters,
+               .accumulatedDeltaRangeUncertaintyM = src.accumulatedDeltaRangeUncertaintyMeters,
+               .carrierFrequencyHz = src.carrierFrequencyHz,
+               .snrDb = src.snrInDb,
+               .agcLevelDb = src.agcDb};
+        if (src.has(RawField::CARRIER_FREQUENCY_HZ)) {
+            dst.flags |= GnssMeasurementFlags::HAS_CARRIER_FREQUENCY;
+        }
+        if (src.has(RawField::SNR_IN_DB)) {
+            dst.flags |= GnssMeasurementFlags::HAS_SNR;
+        }
+        if (src.has(RawField::AGC_DB)) {
+            dst.flags |= GnssMeasurementFlags::HAS_AUTOMATIC_GAIN_CONTROL;
+        }
+        if (src.has(RawField::CODE_TYPE)) {
+            memcpy(dst.codeType, src.codeType, sizeof(dst.codeType));
+        } else {
+            strncpy(dst.codeType, "UNKNOWN", sizeof(dst.codeType));
+        }
+    }
+
+    // The clock fields are the same in every record of an epoch
+    const RawGnssMeasurement& first = raw.front();
+    V1_0::IGnssMeasurementCallback::GnssClock clock = {
+            .leapSecond = static_cast<int16_t>(first.leapSecond),
+            .timeNs = first.timeNanos,
+            .timeUncertaintyNs = first.timeUncertaintyNanos,
+            .fullBiasNs = first.fullBiasNanos,
+            .biasNs = first.biasNanos,
+            .biasUncertaintyNs = first.biasUncertaintyNanos,
+            .driftNsps = first.driftNanosPerSecond,
+            .driftUncertaintyNsps = first.driftUncertaintyNanosPerSecond,
+            .hwClockDiscontinuityCount = first.hardwareClockDiscontinuityCount};
+    const std::pair<RawField, GnssClockFlags> clockFlags[] = {
+            {RawField::LEAP_SECOND, GnssClockFlags::HAS_LEAP_SECOND},
+            {RawField::TIME_UNCERTAINTY_NANOS, GnssClockFlags::HAS_TIME_UNCERTAINTY},
+            {RawField::FULL_BIAS_NANOS, GnssClockFlags::HAS_FULL_BIAS},
+            {RawField::BIAS_NANOS, GnssClockFlags::HAS_BIAS},
+            {RawField::BIAS_UNCERTAINTY_NANOS, GnssClockFlags::HAS_BIAS_UNCERTAINTY},
+            {RawField::DRIFT_NANOS_PER_SECOND, GnssClockFlags::HAS_DRIFT},
+            {RawField::DRIFT_UNCERTAINTY_NANOS_PER_SECOND, GnssClockFlags::HAS_DRIFT_UNCERTAINTY},
+    };
+    for (const auto& flag : clockFlags) {
+        if (first.has(flag.first)) {
+            clock.gnssClockFlags |= flag.second;
+        }
+    }
+
+    builder->setMeasurements(mNativeMeasurements.data(), mNativeMeasurements.size());
+    builder->setClock(clock);
+    return true;
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_GNSS_V2_0_GNSSREPLAY_H
+#define ANDROID_HARDWARE_GNSS_V2_0_GNSSREPLAY_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "GnssEpochScheduler.h"
+#include "GnssLogReader.h"
+#include "GnssMeasurementFrameBuilder.h"
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+// Replays a recorded log in place of the mock outputs when the vendor.gnss.replay.path property
+// names one, at the rate given by vendor.gnss.replay.rate (1 by default, 10 replays ten seconds of
+// the log every second). The properties are read once, when the outputs first start.
+//
+// Each output replays the log independently: at every epoch it reports the last record of the log
+// due at that point of the replay. The log starts over once an output has replayed all of it.
+class GnssReplay {
+  public:
+    // Returns nullptr when no log is configured or the log cannot be read.
+    static GnssReplay* getInstance();
+
+    // Sets location to the fix due at epochTimeNs for the output of source. Returns false, leaving
+    // location unchanged, if the log has no fix.
+    bool getLocation(EpochSource source, int64_t epochTimeNs, V1_0::GnssLocation* location);
+
+    // Sets the measurements and clock of builder to the epoch of measurements due at epochTimeNs.
+    // Returns false, leaving builder unchanged, if the log has no measurements.
+    bool getMeasurements(int64_t epochTimeNs, GnssMeasurementFrameBuilder* builder);
+
+  private:
+    // Position of an output in the log. The record after the current one is read ahead to know
+    // when it becomes due.
+    template <typename Record>
+    struct Stream {
+        // The log has no record for this output, so it is not read again
+        bool empty = false;
+        size_t offset = 0;
+        bool started = false;
+        int64_t startLogTimeNs = 0;
+        int64_t startEpochTimeNs = 0;
+        bool hasCurrent = false;
+        Record current = {};
+        bool hasNext = false;
+        int64_t nextLogTimeNs = 0;
+        Record next = {};
+    };
+
+    GnssReplay(std::unique_ptr<common::GnssLogReader> reader, double rate);
+    static GnssReplay* create();
+
+    // Moves stream to the record due at epochTimeNs, and returns false if there is none.
+    template <typename Record, typename ReadFunc>
+    bool advance(Stream<Record>* stream, int64_t epochTimeNs, ReadFunc read);
+
+    const std::unique_ptr<common::GnssLogReader> mReader;
+    const double mRate;
+    std::mutex mMutex;
+    std::map<EpochSource, Stream<V1_0::GnssLocation>> mLocationStreams;
+    Stream<std::vector<common::RawGnssMeasurement>> mMeasurementStream;
+    std::vector<NativeGnssMeasurement> mNativeMeasurements;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_GNSS_V2_0_GNSSREPLAY_H
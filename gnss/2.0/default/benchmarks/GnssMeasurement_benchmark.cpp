@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "GnssMeasurementFrameBuilder.h"
+
+namespace {
+
+std::atomic<uint64_t> gAllocationCount(0);
+
+}  // namespace
+
+// Count every heap allocation made by the process, benchmarks compare the counts around the
+// code under test.
+void* operator new(size_t size) {
+    gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+namespace {
+
+using GnssMeasurementFlags = V1_0::IGnssMeasurementCallback::GnssMeasurementFlags;
+
+std::vector<NativeGnssMeasurement> makeNativeMeasurements(size_t count) {
+    std::vector<NativeGnssMeasurement> measurements(count);
+    for (size_t i = 0; i < count; i++) {
+        NativeGnssMeasurement& m = measurements[i];
+        memset(&m, 0, sizeof(m));
+        m.flags = (uint32_t)GnssMeasurementFlags::HAS_CARRIER_FREQUENCY;
+        m.svid = static_cast<int16_t>(i % 32 + 1);
+        m.constellation = (uint8_t)(i % 2 == 0 ? GnssConstellationType::GPS
+                                               : GnssConstellationType::GLONASS);
+        m.state = V2_0::IGnssMeasurementCallback::GnssMeasurementState::STATE_CODE_LOCK;
+        m.codeType[0] = 'C';
+        m.receivedSvTimeInNs = 8195997131077 + i;
+        m.receivedSvTimeUncertaintyInNs = 15;
+        m.cN0DbHz = 30.0;
+        m.pseudorangeRateMps = -484.13739013671875;
+        m.pseudorangeRateUncertaintyMps = 1.0379999876022339;
+        m.carrierFrequencyHz = 1.59975e+09;
+    }
+    return measurements;
+}
+
+// Builds the frame the way GnssMeasurement did before the frame builder, a fresh hidl_vec of
+// aggregate initialized measurements every epoch.
+GnssMeasurementFrameBuilder::GnssData buildAllocating(
+        const std::vector<NativeGnssMeasurement>& native, int64_t epochTimeNs) {
+    hidl_vec<V2_0::IGnssMeasurementCallback::GnssMeasurement> measurements(native.size());
+    for (size_t i = 0; i < native.size(); i++) {
+        const NativeGnssMeasurement& src = native[i];
+        V1_0::IGnssMeasurementCallback::GnssMeasurement measurement_1_0 = {
+                .flags = src.flags,
+                .svid = src.svid,
+                .constellation = V1_0::GnssConstellationType::UNKNOWN,
+                .timeOffsetNs = src.timeOffsetNs,
+                .receivedSvTimeInNs = src.receivedSvTimeInNs,
+                .receivedSvTimeUncertaintyInNs = src.receivedSvTimeUncertaintyInNs,
+                .cN0DbHz = src.cN0DbHz,
+                .pseudorangeRateMps = src.pseudorangeRateMps,
+                .pseudorangeRateUncertaintyMps = src.pseudorangeRateUncertaintyMps,
+                .accumulatedDeltaRangeState = src.accumulatedDeltaRangeState,
+                .accumulatedDeltaRangeM = src.accumulatedDeltaRangeM,
+                .accumulatedDeltaRangeUncertaintyM = src.accumulatedDeltaRangeUncertaintyM,
+                .carrierFrequencyHz = src.carrierFrequencyHz};
+        V1_1::IGnssMeasurementCallback::GnssMeasurement measurement_1_1 = {
+                .v1_0 = measurement_1_0};
+        V2_0::IGnssMeasurementCallback::GnssMeasurement measurement_2_0 = {
+                .v1_1 = measurement_1_1,
+                .codeType = src.codeType,
+                .state = src.state,
+                .constellation = static_cast<GnssConstellationType>(src.constellation)};
+        measurements[i] = measurement_2_0;
+    }
+    GnssMeasurementFrameBuilder::GnssData gnssData = {
+            .measurements = measurements,
+            .elapsedRealtime = {.flags = ElapsedRealtimeFlags::HAS_TIMESTAMP_NS,
+                                .timestampNs = static_cast<uint64_t>(epochTimeNs)}};
+    return gnssData;
+}
+
+void BM_AllocatingFrame(benchmark::State& state) {
+    const std::vector<NativeGnssMeasurement> native = makeNativeMeasurements(state.range(0));
+    int64_t epochTimeNs = 0;
+    const uint64_t allocations = gAllocationCount.load();
+    for (auto _ : state) {
+        GnssMeasurementFrameBuilder::GnssData data = buildAllocating(native, epochTimeNs++);
+        benchmark::DoNotOptimize(data.measurements.data());
+    }
+    state.SetItemsProcessed(state.iterations() * native.size());
+    state.counters["allocs_per_epoch"] =
+            static_cast<double>(gAllocationCount.load() - allocations) / state.iterations();
+}
+BENCHMARK(BM_AllocatingFrame)->Arg(1)->Arg(64)->Arg(100);
+
+void BM_FrameBuilder(benchmark::State& state) {
+    const std::vector<NativeGnssMeasurement> native = makeNativeMeasurements(state.range(0));
+    GnssMeasurementFrameBuilder builder;
+    int64_t epochTimeNs = 0;
+    // Size the builder for the frame, as the first epoch reported by the HAL would
+    builder.setMeasurements(native.data(), native.size());
+    const uint64_t allocations = gAllocationCount.load();
+    for (auto _ : state) {
+        builder.setMeasurements(native.data(), native.size());
+        const GnssMeasurementFrameBuilder::GnssData& data = builder.build(epochTimeNs++, 1000000);
+        benchmark::DoNotOptimize(data.measurements.data());
+    }
+    state.SetItemsProcessed(state.iterations() * native.size());
+    state.counters["allocs_per_epoch"] =
+            static_cast<double>(gAllocationCount.load() - allocations) / state.iterations();
+}
+BENCHMARK(BM_FrameBuilder)->Arg(1)->Arg(64)->Arg(100);
+
+}  // namespace
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,557 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GnssLogReader"
+
+#include <GnssLogReader.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <log/log.h>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace common {
+
+namespace {
+
+using GnssLocationFlags = V1_0::GnssLocationFlags;
+
+// Multiplies the HDOP of a GGA sentence into a horizontal accuracy.
+constexpr double kUserRangeErrorMeters = 5.0;
+constexpr double kMetersPerSecondPerKnot = 1852.0 / 3600.0;
+
+const char* const kRawFieldNames[] = {
+        "ElapsedRealtimeMillis",
+        "TimeNanos",
+        "LeapSecond",
+        "TimeUncertaintyNanos",
+        "FullBiasNanos",
+        "BiasNanos",
+        "BiasUncertaintyNanos",
+        "DriftNanosPerSecond",
+        "DriftUncertaintyNanosPerSecond",
+        "HardwareClockDiscontinuityCount",
+        "Svid",
+        "TimeOffsetNanos",
+        "State",
+        "ReceivedSvTimeNanos",
+        "ReceivedSvTimeUncertaintyNanos",
+        "Cn0DbHz",
+        "PseudorangeRateMetersPerSecond",
+        "PseudorangeRateUncertaintyMetersPerSecond",
+        "AccumulatedDeltaRangeState",
+        "AccumulatedDeltaRangeMeters",
+        "AccumulatedDeltaRangeUncertaintyMeters",
+        "CarrierFrequencyHz",
+        "CarrierCycles",
+        "CarrierPhase",
+        "CarrierPhaseUncertainty",
+        "MultipathIndicator",
+        "SnrInDb",
+        "ConstellationType",
+        "AgcDb",
+        "CodeType",
+};
+static_assert(sizeof(kRawFieldNames) / sizeof(kRawFieldNames[0]) ==
+                      static_cast<size_t>(RawField::COUNT),
+              "Missing RawField name");
+
+// Splits line at each comma into at most maxFields fields, and returns the number of fields.
+size_t splitFields(std::string_view line, std::string_view* fields, size_t maxFields) {
+    size_t count = 0;
+    size_t start = 0;
+    while (count < maxFields) {
+        const size_t end = line.find(',', start);
+        if (end == std::string_view::npos) {
+            fields[count++] = line.substr(start);
+            break;
+        }
+        fields[count++] = line.substr(start, end - start);
+        start = end + 1;
+    }
+    return count;
+}
+
+bool parseNumber(std::string_view field, double* value) {
+    char buffer[32];
+    if (field.empty() || field.size() >= sizeof(buffer)) {
+        return false;
+    }
+    memcpy(buffer, field.data(), field.size());
+    buffer[field.size()] = '\0';
+    char* end;
+    *value = strtod(buffer, &end);
+    return end == buffer + field.size();
+}
+
+bool parseNumber(std::string_view field, int64_t* value) {
+    char buffer[32];
+    if (field.empty() || field.size() >= sizeof(buffer)) {
+        return false;
+    }
+    memcpy(buffer, field.data(), field.size());
+    buffer[field.size()] = '\0';
+    char* end;
+    *value = strtoll(buffer, &end, 10);
+    return end == buffer + field.size();
+}
+
+bool parseNumber(std::string_view field, float* value) {
+    double number;
+    if (!parseNumber(field, &number)) {
+        return false;
+    }
+    *value = static_cast<float>(number);
+    return true;
+}
+
+template <typename T>
+bool parseNumber(std::string_view field, T* value) {
+    int64_t number;
+    if (!parseNumber(field, &number)) {
+        return false;
+    }
+    *value = static_cast<T>(number);
+    return true;
+}
+
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+int twoDigits(std::string_view field, size_t position) {
+    const char high = field[position];
+    const char low = field[position + 1];
+    if (high < '0' || high > '9' || low < '0' || low > '9') {
+        return -1;
+    }
+    return (high - '0') * 10 + (low - '0');
+}
+
+// Returns the payload between '$' and '*' of an NMEA sentence with a valid checksum. GnssLogger
+// logs the sentences in "NMEA,<sentence>,<timestamp>" records.
+bool getNmeaPayload(std::string_view line, std::string_view* payload) {
+    if (line.substr(0, 5) == "NMEA,") {
+        line.remove_prefix(5);
+    }
+    if (line.empty() || line[0] != '$') {
+        return false;
+    }
+    const size_t star = line.find('*');
+    if (star == std::string_view::npos || star + 3 > line.size()) {
+        return false;
+    }
+    uint8_t checksum = 0;
+    for (size_t i = 1; i < star; i++) {
+        checksum ^= static_cast<uint8_t>(line[i]);
+    }
+    const int high = hexDigit(line[star + 1]);
+    const int low = hexDigit(line[star + 2]);
+    if (high < 0 || low < 0 || checksum != high * 16 + low) {
+        return false;
+    }
+    *payload = line.substr(1, star - 1);
+    return true;
+}
+
+// Converts a ddmm.mmmm or dddmm.mmmm coordinate into signed degrees.
+bool parseNmeaCoordinate(std::string_view value, std::string_view hemisphere, double* degrees) {
+    double coordinate;
+    if (!parseNumber(value, &coordinate) || hemisphere.size() != 1) {
+        return false;
+    }
+    const double wholeDegrees = std::floor(coordinate / 100);
+    *degrees = wholeDegrees + (coordinate - wholeDegrees * 100) / 60;
+    if (hemisphere[0] == 'S' || hemisphere[0] == 'W') {
+        *degrees = -*degrees;
+    }
+    return true;
+}
+
+int64_t daysFromCivil(int year, int month, int day) {
+    year -= month <= 2;
+    const int era = (year >= 0 ? year : year - 399) / 400;
+    const int yearOfEra = year - era * 400;
+    const int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return static_cast<int64_t>(era) * 146097 + dayOfEra - 719468;
+}
+
+// Converts the hhmmss.ss time and ddmmyy date of an RMC sentence into UTC milliseconds.
+bool parseNmeaUtcTime(std::string_view time, std::string_view date, int64_t* utcMs) {
+    double seconds;
+    if (time.size() < 6 || date.size() != 6 || !parseNumber(time.substr(4), &seconds)) {
+        return false;
+    }
+    const int hours = twoDigits(time, 0);
+    const int minutes = twoDigits(time, 2);
+    const int day = twoDigits(date, 0);
+    const int month = twoDigits(date, 2);
+    int year = twoDigits(date, 4);
+    if (hours < 0 || minutes < 0 || day < 1 || month < 1 || month > 12 || year < 0) {
+        return false;
+    }
+    year += year < 80 ? 2000 : 1900;
+    *utcMs = ((daysFromCivil(year, month, day) * 24 + hours) * 60 + minutes) * 60000 +
+             std::llround(seconds * 1000);
+    return true;
+}
+
+// $--RMC,time,status,lat,N/S,lon,E/W,speed knots,course,date,...
+bool applyRmc(const std::string_view* fields, size_t count, int64_t* utcMs,
+              V1_0::GnssLocation* location) {
+    if (count < 10 || fields[2] != "A" ||
+        !parseNmeaCoordinate(fields[3], fields[4], &location->latitudeDegrees) ||
+        !parseNmeaCoordinate(fields[5], fields[6], &location->longitudeDegrees) ||
+        !parseNmeaUtcTime(fields[1], fields[9], utcMs)) {
+        return false;
+    }
+    location->gnssLocationFlags |= GnssLocationFlags::HAS_LAT_LONG;
+    location->timestamp = *utcMs;
+    double value;
+    if (parseNumber(fields[7], &value)) {
+        location->speedMetersPerSec = static_cast<float>(value * kMetersPerSecondPerKnot);
+        location->gnssLocationFlags |= GnssLocationFlags::HAS_SPEED;
+    }
+    if (parseNumber(fields[8], &value)) {
+        location->bearingDegrees = static_cast<float>(value);
+        location->gnssLocationFlags |= GnssLocationFlags::HAS_BEARING;
+    }
+    return true;
+}
+
+// $--GGA,time,lat,N/S,lon,E/W,quality,satellites,hdop,altitude,M,geoid separation,M,...
+bool applyGga(const std::string_view* fields, size_t count, V1_0::GnssLocation* location) {
+    int64_t quality;
+    if (count < 12 || !parseNumber(fields[6], &quality) || quality == 0) {
+        return false;
+    }
+    double value;
+    if (parseNumber(fields[8], &value)) {
+        location->horizontalAccuracyMeters = static_cast<float>(value * kUserRangeErrorMeters);
+        location->gnssLocationFlags |= GnssLocationFlags::HAS_HORIZONTAL_ACCURACY;
+    }
+    if (parseNumber(fields[9], &value)) {
+        // GGA reports the altitude above the geoid, the HAL above the WGS84 ellipsoid
+        double separation;
+        location->altitudeMeters = value + (parseNumber(fields[11], &separation) ? separation : 0);
+        location->gnssLocationFlags |= GnssLocationFlags::HAS_ALTITUDE;
+    }
+    return true;
+}
+
+}  // namespace
+
+std::unique_ptr<GnssLogReader> GnssLogReader::open(const std::string& path) {
+    const int fd = TEMP_FAILURE_RETRY(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        ALOGE("%s: Unable to open %s: %s", __func__, path.c_str(), strerror(errno));
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ALOGE("%s: %s is empty or cannot be read", __func__, path.c_str());
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        ALOGE("%s: Unable to map %s: %s", __func__, path.c_str(), strerror(errno));
+        return nullptr;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    return std::unique_ptr<GnssLogReader>(
+            new GnssLogReader(static_cast<const char*>(data), st.st_size));
+}
+
+GnssLogReader::GnssLogReader(const char* data, size_t size) : mData(data), mSize(size) {
+    readRawHeader();
+}
+
+GnssLogReader::~GnssLogReader() {
+    munmap(const_cast<char*>(mData), mSize);
+}
+
+bool GnssLogReader::nextLine(size_t* offset, std::string_view* line) const {
+    if (*offset >= mSize) {
+        return false;
+    }
+    const char* start = mData + *offset;
+    const char* end = static_cast<const char*>(memchr(start, '\n', mSize - *offset));
+    size_t length = end != nullptr ? end - start : mSize - *offset;
+    *offset += end != nullptr ? length + 1 : length;
+    if (length > 0 && start[length - 1] == '\r') {
+        length--;
+    }
+    *line = std::string_view(start, length);
+    return true;
+}
+
+void GnssLogReader::readRawHeader() {
+    for (size_t i = 0; i < static_cast<size_t>(RawField::CODE_TYPE); i++) {
+        mRawColumns[i] = i + 1;
+    }
+    mRawColumns[static_cast<size_t>(RawField::CODE_TYPE)] = 0;
+
+    // GnssLogger describes its records in the comment block starting the log
+    size_t offset = 0;
+    std::string_view line;
+    while (nextLine(&offset, &line) && !line.empty() && line[0] == '#') {
+        if (line.substr(0, 6) != "# Raw,") {
+            continue;
+        }
+        Fields fields;
+        const size_t count = splitFields(line.substr(2), fields.data(), fields.size());
+        mRawColumns.fill(0);
+        for (size_t column = 1; column < count; column++) {
+            for (size_t i = 0; i < mRawColumns.size(); i++) {
+                if (fields[column] == kRawFieldNames[i]) {
+                    mRawColumns[i] = column;
+                    break;
+                }
+            }
+        }
+        break;
+    }
+}
+
+bool GnssLogReader::readLocation(size_t* offset, int64_t* timeNs,
+                                 V1_0::GnssLocation* location) const {
+    // The sentences of a fix share its time, the fix is complete at the first sentence of another
+    Fields fields;
+    std::string_view fixTime;
+    bool hasRmc = false;
+    bool hasGga = false;
+    int64_t utcMs = 0;
+    *location = {};
+
+    size_t position = *offset;
+    std::string_view line;
+    for (;;) {
+        const size_t lineStart = position;
+        if (!nextLine(&position, &line)) {
+            break;
+        }
+        std::string_view payload;
+        if (!getNmeaPayload(line, &payload)) {
+            continue;
+        }
+        const size_t count = splitFields(payload, fields.data(), fields.size());
+        if (count < 2 || fields[0].size() != 5) {
+            continue;
+        }
+        const std::string_view type = fields[0].substr(2);
+        const bool isRmc = type == "RMC";
+        if (!isRmc && type != "GGA") {
+            continue;
+        }
+        if ((hasRmc || hasGga) && fields[1] != fixTime) {
+            if (hasRmc) {
+                position = lineStart;
+                break;
+            }
+            // Without an RMC sentence the fix has no date, skip it
+            hasGga = false;
+            *location = {};
+        }
+        if (isRmc ? applyRmc(fields.data(), count, &utcMs, location)
+                  : applyGga(fields.data(), count, location)) {
+            hasRmc |= isRmc;
+            hasGga |= !isRmc;
+            fixTime = fields[1];
+        }
+    }
+
+    *offset = position;
+    if (!hasRmc) {
+        return false;
+    }
+    *timeNs = utcMs * 1000000;
+    return true;
+}
+
+bool GnssLogReader::readMeasurements(size_t* offset, int64_t* timeNs,
+                                     std::vector<RawGnssMeasurement>* measurements) const {
+    // The records of an epoch share its TimeNanos
+    const size_t timeColumn = mRawColumns[static_cast<size_t>(RawField::TIME_NANOS)];
+    Fields fields;
+    std::string_view epochTime;
+    measurements->clear();
+
+    size_t position = *offset;
+    std::string_view line;
+    for (;;) {
+        const size_t lineStart = position;
+        if (!nextLine(&position, &line)) {
+            break;
+        }
+        if (line.substr(0, 4) != "Raw,") {
+            continue;
+        }
+        const size_t count = splitFields(line, fields.data(), fields.size());
+        if (timeColumn == 0 || timeColumn >= count || fields[timeColumn].empty()) {
+            continue;
+        }
+        if (!measurements->empty() && fields[timeColumn] != epochTime) {
+            position = lineStart;
+            break;
+        }
+        epochTime = fields[timeColumn];
+        measurements->emplace_back();
+        parseRawMeasurement(fields, count, &measurements->back());
+    }
+
+    *offset = position;
+    if (measurements->empty()) {
+        return false;
+    }
+    *timeNs = measurements->front().timeNanos;
+    return true;
+}
+
+void GnssLogReader::parseRawMeasurement(const Fields& fields, size_t count,
+                                        RawGnssMeasurement* measurement) const {
+    for (size_t i = 0; i < mRawColumns.size(); i++) {
+        const size_t column = mRawColumns[i];
+        if (column == 0 || column >= count || fields[column].empty()) {
+            continue;
+        }
+        const std::string_view field = fields[column];
+        bool parsed = false;
+        switch (static_cast<RawField>(i)) {
+            case RawField::ELAPSED_REALTIME_MILLIS:
+                // Not replayed, the HAL reports its own elapsed realtime
+                parsed = true;
+                break;
+            case RawField::TIME_NANOS:
+                parsed = parseNumber(field, &measurement->timeNanos);
+                break;
+            case RawField::LEAP_SECOND:
+                parsed = parseNumber(field, &measurement->leapSecond);
+                break;
+            case RawField::TIME_UNCERTAINTY_NANOS:
+                parsed = parseNumber(field, &measurement->timeUncertaintyNanos);
+                break;
+            case RawField::FULL_BIAS_NANOS:
+                parsed = parseNumber(field, &measurement->fullBiasNanos);
+                break;
+            case RawField::BIAS_NANOS:
+                parsed = parseNumber(field, &measurement->biasNanos);
+                break;
+            case RawField::BIAS_UNCERTAINTY_NANOS:
+                parsed = parseNumber(field, &measurement->biasUncertaintyNanos);
+                break;
+            case RawField::DRIFT_NANOS_PER_SECOND:
+                parsed = parseNumber(field, &measurement->driftNanosPerSecond);
+                break;
+            case RawField::DRIFT_UNCERTAINTY_NANOS_PER_SECOND:
+                parsed = parseNumber(field, &measurement->driftUncertaintyNanosPerSecond);
+                break;
+            case RawField::HARDWARE_CLOCK_DISCONTINUITY_COUNT:
+                parsed = parseNumber(field, &measurement->hardwareClockDiscontinuityCount);
+                break;
+            case RawField::SVID:
+                parsed = parseNumber(field, &measurement->svid);
+                break;
+            case RawField::TIME_OFFSET_NANOS:
+                parsed = parseNumber(field, &measurement->timeOffsetNanos);
+                break;
+            case RawField::STATE:
+                parsed = parseNumber(field, &measurement->state);
+                break;
+            case RawField::RECEIVED_SV_TIME_NANOS:
+                parsed = parseNumber(field, &measurement->receivedSvTimeNanos);
+                break;
+            case RawField::RECEIVED_SV_TIME_UNCERTAINTY_NANOS:
+                parsed = parseNumber(field, &measurement->receivedSvTimeUncertaintyNanos);
+                break;
+            case RawField::CN0_DB_HZ:
+                parsed = parseNumber(field, &measurement->cn0DbHz);
+                break;
+            case RawField::PSEUDORANGE_RATE_METERS_PER_SECOND:
+                parsed = parseNumber(field, &measurement->pseudorangeRateMetersPerSecond);
+                break;
+            case RawField::PSEUDORANGE_RATE_UNCERTAINTY_METERS_PER_SECOND:
+                parsed = parseNumber(field,
+                                     &measurement->pseudorangeRateUncertaintyMetersPerSecond);
+                break;
+            case RawField::ACCUMULATED_DELTA_RANGE_STATE:
+                parsed = parseNumber(field, &measurement->accumulatedDeltaRangeState);
+                break;
+            case RawField::ACCUMULATED_DELTA_RANGE_METERS:
+                parsed = parseNumber(field, &measurement->accumulatedDeltaRangeMeters);
+                break;
+            case RawField::ACCUMULATED_DELTA_RANGE_UNCERTAINTY_METERS:
+                parsed = parseNumber(field, &measurement->accumulatedDeltaRangeUncertaintyMeters);
+                break;
+            case RawField::CARRIER_FREQUENCY_HZ:
+                parsed = parseNumber(field, &measurement->carrierFrequencyHz);
+                break;
+            case RawField::CARRIER_CYCLES:
+                parsed = parseNumber(field, &measurement->carrierCycles);
+                break;
+            case RawField::CARRIER_PHASE:
+                parsed = parseNumber(field, &measurement->carrierPhase);
+                break;
+            case RawField::CARRIER_PHASE_UNCERTAINTY:
+                parsed = parseNumber(field, &measurement->carrierPhaseUncertainty);
+                break;
+            case RawField::MULTIPATH_INDICATOR:
+                parsed = parseNumber(field, &measurement->multipathIndicator);
+                break;
+            case RawField::SNR_IN_DB:
+                parsed = parseNumber(field, &measurement->snrInDb);
+                break;
+            case RawField::CONSTELLATION_TYPE:
+                parsed = parseNumber(field, &measurement->constellationType);
+                break;
+            case RawField::AGC_DB:
+                parsed = parseNumber(field, &measurement->agcDb);
+                break;
+            case RawField::CODE_TYPE:
+                memset(measurement->codeType, 0, sizeof(measurement->codeType));
+                memcpy(measurement->codeType, field.data(),
+                       std::min(field.size(), sizeof(measurement->codeType)));
+                parsed = true;
+                break;
+            case RawField::COUNT:
+                break;
+        }
+        if (parsed) {
+            measurement->fields |= 1ull << i;
+        }
+    }
+}
+
+}  // namespace common
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
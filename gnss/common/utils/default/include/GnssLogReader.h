@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_gnss_common_default_GnssLogReader_H_
+#define android_hardware_gnss_common_default_GnssLogReader_H_
+
+#include <android/hardware/gnss/1.0/IGnss.h>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace common {
+
+// Columns of a "Raw" record of a GnssLogger log, in the default column order.
+enum class RawField : uint8_t {
+    ELAPSED_REALTIME_MILLIS,
+    TIME_NANOS,
+    LEAP_SECOND,
+    TIME_UNCERTAINTY_NANOS,
+    FULL_BIAS_NANOS,
+    BIAS_NANOS,
+    BIAS_UNCERTAINTY_NANOS,
+    DRIFT_NANOS_PER_SECOND,
+    DRIFT_UNCERTAINTY_NANOS_PER_SECOND,
+    HARDWARE_CLOCK_DISCONTINUITY_COUNT,
+    SVID,
+    TIME_OFFSET_NANOS,
+    STATE,
+    RECEIVED_SV_TIME_NANOS,
+    RECEIVED_SV_TIME_UNCERTAINTY_NANOS,
+    CN0_DB_HZ,
+    PSEUDORANGE_RATE_METERS_PER_SECOND,
+    PSEUDORANGE_RATE_UNCERTAINTY_METERS_PER_SECOND,
+    ACCUMULATED_DELTA_RANGE_STATE,
+    ACCUMULATED_DELTA_RANGE_METERS,
+    ACCUMULATED_DELTA_RANGE_UNCERTAINTY_METERS,
+    CARRIER_FREQUENCY_HZ,
+    CARRIER_CYCLES,
+    CARRIER_PHASE,
+    CARRIER_PHASE_UNCERTAINTY,
+    MULTIPATH_INDICATOR,
+    SNR_IN_DB,
+    CONSTELLATION_TYPE,
+    AGC_DB,
+    // Only in the header of newer logs
+    CODE_TYPE,
+    COUNT,
+};
+
+// Measurement of a "Raw" record. The enumerated values, e.g. state or constellation type, are
+// logged with the values of the HAL.
+struct RawGnssMeasurement {
+    uint64_t fields;  // Bit (1 << RawField) set for each non empty column
+
+    int64_t timeNanos;
+    int32_t leapSecond;
+    double timeUncertaintyNanos;
+    int64_t fullBiasNanos;
+    double biasNanos;
+    double biasUncertaintyNanos;
+    double driftNanosPerSecond;
+    double driftUncertaintyNanosPerSecond;
+    uint32_t hardwareClockDiscontinuityCount;
+
+    int16_t svid;
+    double timeOffsetNanos;
+    uint32_t state;
+    int64_t receivedSvTimeNanos;
+    int64_t receivedSvTimeUncertaintyNanos;
+    double cn0DbHz;
+    double pseudorangeRateMetersPerSecond;
+    double pseudorangeRateUncertaintyMetersPerSecond;
+    uint16_t accumulatedDeltaRangeState;
+    double accumulatedDeltaRangeMeters;
+    double accumulatedDeltaRangeUncertaintyMeters;
+    float carrierFrequencyHz;
+    int64_t carrierCycles;
+    double carrierPhase;
+    double carrierPhaseUncertainty;
+    uint8_t multipathIndicator;
+    double snrInDb;
+    uint8_t constellationType;
+    double agcDb;
+    char codeType[8];  // Not NUL terminated when all 8 chars are used
+
+    bool has(RawField field) const { return (fields & (1ull << static_cast<int>(field))) != 0; }
+};
+
+// Reads a recorded GNSS log, a GnssLogger log or a plain NMEA capture. The log is mapped rather
+// than read, and records are parsed as the reader moves through it, so that logs of any length can
+// be replayed. Locations come from the RMC and GGA NMEA sentences, measurements from the "Raw"
+// records.
+//
+// Readers hold no position of their own, any number of independent streams may read the same log
+// by each keeping an offset. The methods are const and may be called from any thread.
+class GnssLogReader {
+  public:
+    // Maps the log at path, and returns nullptr if it cannot be mapped.
+    static std::unique_ptr<GnssLogReader> open(const std::string& path);
+    ~GnssLogReader();
+
+    // Reads the first valid fix at or after *offset, and moves *offset past it. timeNs is the UTC
+    // time of the fix. Returns false at the end of the log.
+    bool readLocation(size_t* offset, int64_t* timeNs, V1_0::GnssLocation* location) const;
+
+    // Reads the measurements of the first epoch at or after *offset, and moves *offset past them.
+    // timeNs is the receiver clock time of the epoch. The storage of measurements is reused.
+    // Returns false at the end of the log.
+    bool readMeasurements(size_t* offset, int64_t* timeNs,
+                          std::vector<RawGnssMeasurement>* measurements) const;
+
+  private:
+    static constexpr size_t kMaxFields = 64;
+    using Fields = std::array<std::string_view, kMaxFields>;
+
+    GnssLogReader(const char* data, size_t size);
+
+    // Returns the line at *offset without its line terminator, and moves *offset to the next line.
+    bool nextLine(size_t* offset, std::string_view* line) const;
+    void readRawHeader();
+    void parseRawMeasurement(const Fields& fields, size_t count,
+                             RawGnssMeasurement* measurement) const;
+
+    const char* mData;
+    size_t mSize;
+    // Column of each RawField in a "Raw" record, or 0 when the log does not have it
+    std::array<size_t, static_cast<size_t>(RawField::COUNT)> mRawColumns;
+};
+
+}  // namespace common
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_gnss_common_default_GnssLogReader_H_
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AllocatorPassthroughBenchmark"
+
+#include <memory>
+#include <vector>
+
+#include <allocator-passthrough/2.0/GrallocLoader.h>
+#include <benchmark/benchmark.h>
+#include <mapper-passthrough/2.0/GrallocBufferDescriptor.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace allocator {
+namespace V2_0 {
+namespace passthrough {
+
+namespace {
+
+using common::V1_0::BufferUsage;
+using common::V1_0::PixelFormat;
+using mapper::V2_0::passthrough::grallocEncodeBufferDescriptor;
+
+/* Returns the gralloc1 HAL shared by all benchmarks, or nullptr on gralloc0 devices. */
+Gralloc1Hal* getGralloc1Hal() {
+    static const auto hal = []() -> std::unique_ptr<Gralloc1Hal> {
+        const hw_module_t* module = GrallocLoader::loadModule();
+        if (!module || GrallocLoader::getModuleMajorApiVersion(module) != 1) {
+            return nullptr;
+        }
+        auto hal = std::make_unique<Gralloc1Hal>();
+        return hal->initWithModule(module) ? std::move(hal) : nullptr;
+    }();
+    return hal.get();
+}
+
+/*
+ * Allocates and frees BufferQueue-style sets of 4K buffers.  Arg 0 is the number of buffers.
+ */
+void BM_AllocateBuffers4K(benchmark::State& state) {
+    Gralloc1Hal* hal = getGralloc1Hal();
+    if (!hal) {
+        state.SkipWithError("gralloc1 device not available");
+        return;
+    }
+
+    const BufferDescriptor descriptor = grallocEncodeBufferDescriptor({
+        3840, 2160, 1, PixelFormat::RGBA_8888,
+        static_cast<uint64_t>(BufferUsage::GPU_TEXTURE | BufferUsage::GPU_RENDER_TARGET |
+                              BufferUsage::COMPOSER_OVERLAY),
+    });
+    const uint32_t count = static_cast<uint32_t>(state.range(0));
+
+    for (auto _ : state) {
+        uint32_t stride = 0;
+        std::vector<const native_handle_t*> buffers;
+        if (hal->allocateBuffers(descriptor, count, &stride, &buffers) != Error::NONE) {
+            state.SkipWithError("allocateBuffers failed");
+            break;
+        }
+
+        state.PauseTiming();
+        hal->freeBuffers(buffers);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_AllocateBuffers4K)->Arg(3)->Arg(4)->Arg(5)->UseRealTime();
+
+/*
+ * Allocates and frees one small buffer, where the gralloc1 descriptor setup is a large part of
+ * the cost.  Arg 0 selects the descriptor cache.
+ */
+void BM_AllocateBufferDescriptorCache(benchmark::State& state) {
+    Gralloc1Hal* hal = getGralloc1Hal();
+    if (!hal) {
+        state.SkipWithError("gralloc1 device not available");
+        return;
+    }
+    hal->setDescriptorCacheEnabled(state.range(0) != 0);
+
+    const BufferDescriptor descriptor = grallocEncodeBufferDescriptor({
+        64, 64, 1, PixelFormat::RGBA_8888,
+        static_cast<uint64_t>(BufferUsage::CPU_WRITE_OFTEN | BufferUsage::GPU_TEXTURE),
+    });
+
+    for (auto _ : state) {
+        uint32_t stride = 0;
+        std::vector<const native_handle_t*> buffers;
+        if (hal->allocateBuffers(descriptor, 1, &stride, &buffers) != Error::NONE) {
+            state.SkipWithError("allocateBuffers failed");
+            break;
+        }
+
+        state.PauseTiming();
+        hal->freeBuffers(buffers);
+        state.ResumeTiming();
+    }
+    hal->setDescriptorCacheEnabled(true);
+}
+BENCHMARK(BM_AllocateBufferDescriptorCache)->Arg(0)->Arg(1)->UseRealTime();
+
+}  // namespace anonymous
+
+}  // namespace passthrough
+}  // namespace V2_0
+}  // namespace allocator
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -20,7 +20,10 @@
 #warning "Gralloc1Hal.h included without LOG_TAG"
 #endif
 
+#include <algorithm>
+#include <array>
 #include <cstring>  // for strerror
+#include <mutex>
 
 #include <allocator-hal/2.0/AllocatorHal.h>
 #include <hardware/gralloc1.h>
@@ -39,7 +42,9 @@ namespace detail {
 using common::V1_0::BufferUsage;
 using mapper::V2_0::BufferDescriptor;
 using mapper::V2_0::Error;
+using mapper::V2_0::passthrough::grallocBufferDescriptorSize;
 using mapper::V2_0::passthrough::grallocDecodeBufferDescriptor;
+using mapper::V2_0::passthrough::grallocIsValidBufferDescriptor;
 
 // Gralloc1HalImpl implements V2_*::hal::AllocatorHal on top of gralloc1
 template <typename Hal>
@@ -47,6 +52,7 @@ class Gralloc1HalImpl : public Hal {
    public:
     ~Gralloc1HalImpl() {
         if (mDevice) {
+            clearDescriptorCache();
             gralloc1_close(mDevice);
         }
     }
@@ -69,6 +75,11 @@ class Gralloc1HalImpl : public Hal {
         return true;
     }
 
+    // When enabled, the gralloc1 descriptors of recent allocations are kept
+    // and reused by allocations with the same BufferDescriptor, which is
+    // nearly all of them in a BufferQueue
+    void setDescriptorCacheEnabled(bool enabled) { mDescriptorCacheEnabled = enabled; }
+
     std::string dumpDebugInfo() override {
         uint32_t len = 0;
         mDispatch.dump(mDevice, &len, nullptr);
@@ -83,13 +94,9 @@ class Gralloc1HalImpl : public Hal {
 
     Error allocateBuffers(const BufferDescriptor& descriptor, uint32_t count, uint32_t* outStride,
                           std::vector<const native_handle_t*>* outBuffers) override {
-        mapper::V2_0::IMapper::BufferDescriptorInfo descriptorInfo;
-        if (!grallocDecodeBufferDescriptor(descriptor, &descriptorInfo)) {
-            return Error::BAD_DESCRIPTOR;
-        }
-
         gralloc1_buffer_descriptor_t desc;
-        Error error = createDescriptor(descriptorInfo, &desc);
+        bool cached = false;
+        Error error = obtainDescriptor(descriptor, &desc, &cached);
         if (error != Error::NONE) {
             return error;
         }
@@ -118,7 +125,7 @@ class Gralloc1HalImpl : public Hal {
             }
         }
 
-        mDispatch.destroyDescriptor(mDevice, desc);
+        releaseDescriptor(desc, cached);
 
         if (error != Error::NONE) {
             freeBuffers(buffers);
@@ -310,6 +317,79 @@ class Gralloc1HalImpl : public Hal {
         return toError(error);
     }
 
+    using DescriptorKey = std::array<uint32_t, grallocBufferDescriptorSize>;
+
+    // Returns a gralloc1 descriptor for the encoded descriptor, to be handed
+    // back to releaseDescriptor once the allocation is done
+    Error obtainDescriptor(const BufferDescriptor& descriptor,
+                           gralloc1_buffer_descriptor_t* outDescriptor, bool* outCached) {
+        *outCached = false;
+        if (!grallocIsValidBufferDescriptor(descriptor)) {
+            return Error::BAD_DESCRIPTOR;
+        }
+
+        DescriptorKey key;
+        std::copy_n(descriptor.data(), key.size(), key.begin());
+        if (mDescriptorCacheEnabled) {
+            std::lock_guard<std::mutex> lock(mDescriptorCacheMutex);
+            auto it = std::find_if(mDescriptorCache.begin(), mDescriptorCache.end(),
+                                   [&key](const CachedDescriptor& entry) { return entry.key == key; });
+            if (it != mDescriptorCache.end()) {
+                // keep the most recently used first
+                std::rotate(mDescriptorCache.begin(), it, it + 1);
+                mDescriptorCache.front().users++;
+                *outDescriptor = mDescriptorCache.front().descriptor;
+                *outCached = true;
+                return Error::NONE;
+            }
+        }
+
+        mapper::V2_0::IMapper::BufferDescriptorInfo descriptorInfo;
+        grallocDecodeBufferDescriptor(descriptor, &descriptorInfo);
+        Error error = createDescriptor(descriptorInfo, outDescriptor);
+        if (error != Error::NONE || !mDescriptorCacheEnabled) {
+            return error;
+        }
+
+        std::lock_guard<std::mutex> lock(mDescriptorCacheMutex);
+        if (mDescriptorCache.size() == kMaxCachedDescriptors) {
+            // evict the least recently used descriptor no allocation is using
+            auto victim = std::find_if(mDescriptorCache.rbegin(), mDescriptorCache.rend(),
+                                       [](const CachedDescriptor& entry) { return !entry.users; });
+            if (victim == mDescriptorCache.rend()) {
+                return Error::NONE;
+            }
+            mDispatch.destroyDescriptor(mDevice, victim->descriptor);
+            mDescriptorCache.erase(std::next(victim).base());
+        }
+        mDescriptorCache.insert(mDescriptorCache.begin(), {key, *outDescriptor, 1});
+        *outCached = true;
+        return Error::NONE;
+    }
+
+    void releaseDescriptor(gralloc1_buffer_descriptor_t descriptor, bool cached) {
+        if (!cached) {
+            mDispatch.destroyDescriptor(mDevice, descriptor);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mDescriptorCacheMutex);
+        for (auto& entry : mDescriptorCache) {
+            if (entry.descriptor == descriptor) {
+                entry.users--;
+                break;
+            }
+        }
+    }
+
+    void clearDescriptorCache() {
+        std::lock_guard<std::mutex> lock(mDescriptorCacheMutex);
+        for (const auto& entry : mDescriptorCache) {
+            mDispatch.destroyDescriptor(mDevice, entry.descriptor);
+        }
+        mDescriptorCache.clear();
+    }
+
     Error allocateOneBuffer(gralloc1_buffer_descriptor_t descriptor,
                             const native_handle_t** outBuffer, uint32_t* outStride) {
         const native_handle_t* buffer = nullptr;
@@ -333,6 +413,18 @@ class Gralloc1HalImpl : public Hal {
 
     gralloc1_device_t* mDevice = nullptr;
 
+    struct CachedDescriptor {
+        DescriptorKey key;
+        gralloc1_buffer_descriptor_t descriptor;
+        // allocations in progress with the descriptor, which pin it
+        uint32_t users;
+    };
+    static constexpr size_t kMaxCachedDescriptors = 8;
+    bool mDescriptorCacheEnabled = true;
+    std::mutex mDescriptorCacheMutex;
+    // most recently used first
+    std::vector<CachedDescriptor> mDescriptorCache;
+
     struct {
         bool layeredBuffers;
     } mCapabilities = {};
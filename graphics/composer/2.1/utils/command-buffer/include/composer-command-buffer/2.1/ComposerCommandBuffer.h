@@ -26,7 +26,9 @@
 
 #include <algorithm>
 #include <limits>
+#include <map>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include <inttypes.h>
@@ -50,16 +52,49 @@ using android::hardware::MessageQueue;
 
 using CommandQueueType = MessageQueue<uint32_t, kSynchronizedReadWrite>;
 
+// The last value of a layer attribute known to be set, used to skip commands
+// that would not change anything.  T must be trivially copyable and have no
+// padding, as values are compared bitwise.
+template <typename T>
+class ShadowValue {
+   public:
+    bool matches(const T& value) const {
+        return mValid && memcmp(&mValue, &value, sizeof(T)) == 0;
+    }
+
+    void set(const T& value) {
+        mValue = value;
+        mValid = true;
+    }
+
+    void invalidate() { mValid = false; }
+
+   private:
+    bool mValid = false;
+    T mValue;
+};
+
 // This class helps build a command queue.  Note that all sizes/lengths are in
 // units of uint32_t's.
+//
+// The message queue is reused across writeQueue calls as long as the commands
+// fit.  When a larger queue is needed, it is sized for twice the largest
+// command stream seen so far, so that steady-state frames neither reallocate
+// the queue nor require the client to call setInputCommandQueue again.
 class CommandWriterBase {
    public:
-    CommandWriterBase(uint32_t initialMaxSize) : mDataMaxSize(initialMaxSize) {
+    CommandWriterBase(uint32_t initialMaxSize)
+        : mDataMaxSize(initialMaxSize), mHighWaterMark(0) {
         mData = std::make_unique<uint32_t[]>(mDataMaxSize);
         reset();
     }
 
-    virtual ~CommandWriterBase() { reset(); }
+    virtual ~CommandWriterBase() {
+        reset();
+        for (auto handle : mFreeFenceHandles) {
+            native_handle_delete(handle);
+        }
+    }
 
     void reset() {
         mDataWritten = 0;
@@ -67,15 +102,75 @@ class CommandWriterBase {
 
         // handles in mDataHandles are owned by the caller
         mDataHandles.clear();
+        mHandleIndexOffsets.clear();
 
-        // handles in mTemporaryHandles are owned by the writer
+        // handles in mTemporaryHandles are owned by the writer; fence handles
+        // are kept for reuse by later commands
         for (auto handle : mTemporaryHandles) {
             native_handle_close(handle);
-            native_handle_delete(handle);
+            if (isFenceHandle(handle) && mFreeFenceHandles.size() < kMaxFreeFenceHandles) {
+                mFreeFenceHandles.push_back(handle);
+            } else {
+                native_handle_delete(handle);
+            }
         }
         mTemporaryHandles.clear();
     }
 
+    // Returns the largest command stream, in uint32_t's, passed to writeQueue.
+    uint32_t getHighWaterMark() const { return mHighWaterMark; }
+
+    // When enabled, layer attribute commands that would set the value last
+    // written for the selected layer are not written at all.  The caller must
+    // invalidate the cached state of a layer when it is destroyed or when the
+    // composer may not have applied a command, e.g. on a reported error or a
+    // failed executeCommands.
+    void setLayerStateCacheEnabled(bool enabled) {
+        mLayerStateCacheEnabled = enabled;
+        mLayerStates.clear();
+        mCurrentLayerState = nullptr;
+    }
+
+    void invalidateLayerState(Display display, Layer layer) {
+        mLayerStates.erase(std::make_pair(display, layer));
+        mCurrentLayerState = nullptr;
+    }
+
+    void invalidateLayerStates() {
+        mLayerStates.clear();
+        mCurrentLayerState = nullptr;
+    }
+
+    // Appends the commands written to other, which is left empty, taking over
+    // their handles.  Used to merge the output of commands executed with
+    // several writers, in the order they were executed.
+    void appendCommands(CommandWriterBase* other) {
+        if (other->mDataWritten == 0) {
+            return;
+        }
+
+        growData(other->mDataWritten);
+        std::copy_n(other->mData.get(), other->mDataWritten, &mData[mDataWritten]);
+
+        // handle indices are relative to the handles of the writer
+        const int32_t handleBase = static_cast<int32_t>(mDataHandles.size());
+        for (uint32_t offset : other->mHandleIndexOffsets) {
+            int32_t index;
+            memcpy(&index, &mData[mDataWritten + offset], sizeof(index));
+            index += handleBase;
+            memcpy(&mData[mDataWritten + offset], &index, sizeof(index));
+            mHandleIndexOffsets.push_back(mDataWritten + offset);
+        }
+        mDataWritten += other->mDataWritten;
+
+        mDataHandles.insert(mDataHandles.end(), other->mDataHandles.begin(),
+                            other->mDataHandles.end());
+        mTemporaryHandles.insert(mTemporaryHandles.end(), other->mTemporaryHandles.begin(),
+                                 other->mTemporaryHandles.end());
+        other->mTemporaryHandles.clear();
+        other->reset();
+    }
+
     IComposerClient::Command getCommand(uint32_t offset) {
         uint32_t val = (offset < mDataWritten) ? mData[offset] : 0;
         return static_cast<IComposerClient::Command>(
@@ -108,8 +203,10 @@ class CommandWriterBase {
             }
         }
 
-        // write data to queue, optionally resizing it
-        if (mQueue && (mDataMaxSize <= mQueue->getQuantumCount())) {
+        mHighWaterMark = std::max(mHighWaterMark, mDataWritten);
+
+        // write data to queue, replacing it only when the commands do not fit
+        if (mQueue && (mDataWritten <= mQueue->getQuantumCount())) {
             if (!mQueue->write(mData.get(), mDataWritten)) {
                 ALOGE("failed to write commands to message queue");
                 return false;
@@ -117,7 +214,7 @@ class CommandWriterBase {
 
             *outQueueChanged = false;
         } else {
-            auto newQueue = std::make_unique<CommandQueueType>(mDataMaxSize);
+            auto newQueue = std::make_unique<CommandQueueType>(getNewQueueSize());
             if (!newQueue->isValid() || !newQueue->write(mData.get(), mDataWritten)) {
                 ALOGE("failed to prepare a new message queue ");
                 return false;
@@ -143,6 +240,9 @@ class CommandWriterBase {
         beginCommand(IComposerClient::Command::SELECT_DISPLAY, kSelectDisplayLength);
         write64(display);
         endCommand();
+
+        mCurrentDisplay = display;
+        mCurrentLayerState = nullptr;
     }
 
     static constexpr uint16_t kSelectLayerLength = 2;
@@ -150,6 +250,9 @@ class CommandWriterBase {
         beginCommand(IComposerClient::Command::SELECT_LAYER, kSelectLayerLength);
         write64(layer);
         endCommand();
+
+        mCurrentLayer = layer;
+        mCurrentLayerState = nullptr;
     }
 
     static constexpr uint16_t kSetErrorLength = 2;
@@ -319,6 +422,9 @@ class CommandWriterBase {
 
     static constexpr uint16_t kSetLayerBlendModeLength = 1;
     void setLayerBlendMode(IComposerClient::BlendMode mode) {
+        if (isLayerStateUnchanged(&LayerState::blendMode, mode)) {
+            return;
+        }
         beginCommand(IComposerClient::Command::SET_LAYER_BLEND_MODE, kSetLayerBlendModeLength);
         writeSigned(static_cast<int32_t>(mode));
         endCommand();
@@ -326,6 +432,9 @@ class CommandWriterBase {
 
     static constexpr uint16_t kSetLayerColorLength = 1;
     void setLayerColor(IComposerClient::Color color) {
+        if (isLayerStateUnchanged(&LayerState::color, color)) {
+            return;
+        }
         beginCommand(IComposerClient::Command::SET_LAYER_COLOR, kSetLayerColorLength);
         writeColor(color);
         endCommand();
@@ -346,6 +455,9 @@ class CommandWriterBase {
 
     static constexpr uint16_t kSetLayerDisplayFrameLength = 4;
     void setLayerDisplayFrame(const IComposerClient::Rect& frame) {
+        if (isLayerStateUnchanged(&LayerState::displayFrame, frame)) {
+            return;
+        }
         beginCommand(IComposerClient::Command::SET_LAYER_DISPLAY_FRAME,
                      kSetLayerDisplayFrameLength);
         writeRect(frame);
@@ -354,6 +466,9 @@ class CommandWriterBase {
 
     static constexpr uint16_t kSetLayerPlaneAlphaLength = 1;
     void setLayerPlaneAlpha(float alpha) {
+        if (isLayerStateUnchanged(&LayerState::planeAlpha, alpha)) {
+            return;
+        }
         beginCommand(IComposerClient::Command::SET_LAYER_PLANE_ALPHA, kSetLayerPlaneAlphaLength);
         writeFloat(alpha);
         endCommand();
@@ -369,6 +484,9 @@ class CommandWriterBase {
 
     static constexpr uint16_t kSetLayerSourceCropLength = 4;
     void setLayerSourceCrop(const IComposerClient::FRect& crop) {
+        if (isLayerStateUnchanged(&LayerState::sourceCrop, crop)) {
+            return;
+        }
         beginCommand(IComposerClient::Command::SET_LAYER_SOURCE_CROP, kSetLayerSourceCropLength);
         writeFRect(crop);
         endCommand();
@@ -376,6 +494,9 @@ class CommandWriterBase {
 
     static constexpr uint16_t kSetLayerTransformLength = 1;
     void setLayerTransform(Transform transform) {
+        if (isLayerStateUnchanged(&LayerState::transform, transform)) {
+            return;
+        }
         beginCommand(IComposerClient::Command::SET_LAYER_TRANSFORM, kSetLayerTransformLength);
         writeSigned(static_cast<int32_t>(transform));
         endCommand();
@@ -397,6 +518,9 @@ class CommandWriterBase {
 
     static constexpr uint16_t kSetLayerZOrderLength = 1;
     void setLayerZOrder(uint32_t z) {
+        if (isLayerStateUnchanged(&LayerState::zOrder, z)) {
+            return;
+        }
         beginCommand(IComposerClient::Command::SET_LAYER_Z_ORDER, kSetLayerZOrderLength);
         write(z);
         endCommand();
@@ -423,7 +547,14 @@ class CommandWriterBase {
         endCommand();
     }
 
+    // Forgets all cached attributes of the selected layer, for commands that
+    // change some of them indirectly.
+    void invalidateSelectedLayerState() { invalidateLayerState(mCurrentDisplay, mCurrentLayer); }
+
     void setLayerDataspaceInternal(int32_t dataspace) {
+        if (isLayerStateUnchanged(&LayerState::dataspace, dataspace)) {
+            return;
+        }
         beginCommand(IComposerClient::Command::SET_LAYER_DATASPACE, kSetLayerDataspaceLength);
         writeSigned(dataspace);
         endCommand();
@@ -502,6 +633,7 @@ class CommandWriterBase {
         }
 
         mDataHandles.push_back(handle);
+        mHandleIndexOffsets.push_back(mDataWritten);
         writeSigned(mDataHandles.size() - 1);
     }
 
@@ -525,7 +657,13 @@ class CommandWriterBase {
     }
 
     native_handle_t* getTemporaryHandle(int numFds, int numInts) {
-        native_handle_t* handle = native_handle_create(numFds, numInts);
+        native_handle_t* handle;
+        if (numFds == 1 && numInts == 0 && !mFreeFenceHandles.empty()) {
+            handle = mFreeFenceHandles.back();
+            mFreeFenceHandles.pop_back();
+        } else {
+            handle = native_handle_create(numFds, numInts);
+        }
         if (handle) {
             mTemporaryHandles.push_back(handle);
         }
@@ -560,12 +698,67 @@ class CommandWriterBase {
         mData = std::move(newData);
     }
 
+    uint32_t getNewQueueSize() const {
+        uint64_t size = static_cast<uint64_t>(std::max(mHighWaterMark, mDataMaxSize)) * 2;
+        return static_cast<uint32_t>(
+            std::min<uint64_t>(size, std::numeric_limits<uint32_t>::max() / sizeof(uint32_t)));
+    }
+
+    // layer attributes cached by setLayerStateCacheEnabled
+    struct LayerState {
+        ShadowValue<IComposerClient::BlendMode> blendMode;
+        ShadowValue<IComposerClient::Color> color;
+        ShadowValue<int32_t> dataspace;
+        ShadowValue<IComposerClient::Rect> displayFrame;
+        ShadowValue<float> planeAlpha;
+        ShadowValue<IComposerClient::FRect> sourceCrop;
+        ShadowValue<Transform> transform;
+        ShadowValue<uint32_t> zOrder;
+    };
+
+    // Returns true if the command setting the attribute of the selected layer
+    // to value can be skipped, otherwise records value as the last one set.
+    template <typename T>
+    bool isLayerStateUnchanged(ShadowValue<T> LayerState::*attribute, const T& value) {
+        if (!mLayerStateCacheEnabled) {
+            return false;
+        }
+        if (!mCurrentLayerState) {
+            mCurrentLayerState = &mLayerStates[std::make_pair(mCurrentDisplay, mCurrentLayer)];
+        }
+        ShadowValue<T>& shadow = mCurrentLayerState->*attribute;
+        if (shadow.matches(value)) {
+            return true;
+        }
+        shadow.set(value);
+        return false;
+    }
+
+    static bool isFenceHandle(const native_handle_t* handle) {
+        return handle->numFds == 1 && handle->numInts == 0;
+    }
+
+    // enough for the release fences of a few frames worth of layers
+    static constexpr size_t kMaxFreeFenceHandles = 64;
+
     uint32_t mDataMaxSize;
+    // largest mDataWritten passed to writeQueue
+    uint32_t mHighWaterMark;
     // end offset of the current command
     uint32_t mCommandEnd;
 
     std::vector<hidl_handle> mDataHandles;
+    // offsets of the handle indices written, rebased by appendCommands
+    std::vector<uint32_t> mHandleIndexOffsets;
     std::vector<native_handle_t*> mTemporaryHandles;
+    // closed fence handles ready to be reused by writeFence
+    std::vector<native_handle_t*> mFreeFenceHandles;
+
+    bool mLayerStateCacheEnabled = false;
+    Display mCurrentDisplay = 0;
+    Layer mCurrentLayer = 0;
+    std::map<std::pair<Display, Layer>, LayerState> mLayerStates;
+    LayerState* mCurrentLayerState = nullptr;
 
     std::unique_ptr<CommandQueueType> mQueue;
 };
@@ -606,6 +799,29 @@ class CommandReaderBase {
         mDataRead = 0;
         mCommandBegin = 0;
         mCommandEnd = 0;
+        mCommandLocBase = 0;
+        mDataHandles.setToExternal(const_cast<hidl_handle*>(commandHandles.data()),
+                                   commandHandles.size());
+
+        return true;
+    }
+
+    // Like readQueue, but copies the commands from memory.  When they are a
+    // slice of a larger command stream, locBase is their offset in it, so that
+    // getCommandLoc still refers to the larger stream.
+    bool readCommands(const uint32_t* commands, uint32_t commandLength,
+                      const hidl_vec<hidl_handle>& commandHandles, uint32_t locBase) {
+        if (mDataMaxSize < commandLength) {
+            mDataMaxSize = commandLength;
+            mData = std::make_unique<uint32_t[]>(mDataMaxSize);
+        }
+        std::copy_n(commands, commandLength, mData.get());
+
+        mDataSize = commandLength;
+        mDataRead = 0;
+        mCommandBegin = 0;
+        mCommandEnd = 0;
+        mCommandLocBase = locBase;
         mDataHandles.setToExternal(const_cast<hidl_handle*>(commandHandles.data()),
                                    commandHandles.size());
 
@@ -617,6 +833,7 @@ class CommandReaderBase {
         mDataRead = 0;
         mCommandBegin = 0;
         mCommandEnd = 0;
+        mCommandLocBase = 0;
         mDataHandles.setToExternal(nullptr, 0);
     }
 
@@ -664,7 +881,11 @@ class CommandReaderBase {
         mCommandEnd = 0;
     }
 
-    uint32_t getCommandLoc() const { return mCommandBegin; }
+    uint32_t getCommandLoc() const { return mCommandLocBase + mCommandBegin; }
+
+    uint32_t getDataSize() const { return mDataSize; }
+
+    const hidl_vec<hidl_handle>& getDataHandles() const { return mDataHandles; }
 
     uint32_t read() { return mData[mDataRead++]; }
 
@@ -758,6 +979,8 @@ class CommandReaderBase {
     // begin/end offsets of the current command
     uint32_t mCommandBegin;
     uint32_t mCommandEnd;
+    // offset of the commands in the stream they were taken from
+    uint32_t mCommandLocBase;
 
     hidl_vec<hidl_handle> mDataHandles;
 };
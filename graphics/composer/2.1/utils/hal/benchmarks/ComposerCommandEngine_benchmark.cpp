@@ -0,0 +1,251 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ComposerCommandEngineBenchmark"
+
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <composer-hal/2.1/ComposerCommandEngine.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace composer {
+namespace V2_1 {
+namespace hal {
+
+namespace {
+
+constexpr Display kDisplay = 1;
+
+/* A composer that accepts every call and composes every layer on the device. */
+class FakeComposerHal : public ComposerHal {
+   public:
+    bool hasCapability(hwc2_capability_t) override { return false; }
+    std::string dumpDebugInfo() override { return {}; }
+    void registerEventCallback(EventCallback*) override {}
+    void unregisterEventCallback() override {}
+
+    uint32_t getMaxVirtualDisplayCount() override { return 0; }
+    Error createVirtualDisplay(uint32_t, uint32_t, PixelFormat*, Display*) override {
+        return Error::NO_RESOURCES;
+    }
+    Error destroyVirtualDisplay(Display) override { return Error::BAD_DISPLAY; }
+    Error createLayer(Display, Layer* outLayer) override {
+        *outLayer = ++mLastLayer;
+        return Error::NONE;
+    }
+    Error destroyLayer(Display, Layer) override { return Error::NONE; }
+
+    Error getActiveConfig(Display, Config* outConfig) override {
+        *outConfig = 0;
+        return Error::NONE;
+    }
+    Error getClientTargetSupport(Display, uint32_t, uint32_t, PixelFormat, Dataspace) override {
+        return Error::NONE;
+    }
+    Error getColorModes(Display, hidl_vec<ColorMode>* outModes) override {
+        *outModes = hidl_vec<ColorMode>{ColorMode::NATIVE};
+        return Error::NONE;
+    }
+    Error getDisplayAttribute(Display, Config, IComposerClient::Attribute,
+                              int32_t* outValue) override {
+        *outValue = 0;
+        return Error::NONE;
+    }
+    Error getDisplayConfigs(Display, hidl_vec<Config>* outConfigs) override {
+        *outConfigs = hidl_vec<Config>{0};
+        return Error::NONE;
+    }
+    Error getDisplayName(Display, hidl_string* outName) override {
+        *outName = "fake";
+        return Error::NONE;
+    }
+    Error getDisplayType(Display, IComposerClient::DisplayType* outType) override {
+        *outType = IComposerClient::DisplayType::PHYSICAL;
+        return Error::NONE;
+    }
+    Error getDozeSupport(Display, bool* outSupport) override {
+        *outSupport = false;
+        return Error::NONE;
+    }
+    Error getHdrCapabilities(Display, hidl_vec<Hdr>*, float*, float*, float*) override {
+        return Error::NONE;
+    }
+
+    Error setActiveConfig(Display, Config) override { return Error::NONE; }
+    Error setColorMode(Display, ColorMode) override { return Error::NONE; }
+    Error setPowerMode(Display, IComposerClient::PowerMode) override { return Error::NONE; }
+    Error setVsyncEnabled(Display, IComposerClient::Vsync) override { return Error::NONE; }
+
+    Error setColorTransform(Display, const float*, int32_t) override { return Error::NONE; }
+    Error setClientTarget(Display, buffer_handle_t, int32_t, int32_t,
+                          const std::vector<hwc_rect_t>&) override {
+        return Error::NONE;
+    }
+    Error setOutputBuffer(Display, buffer_handle_t, int32_t) override { return Error::NONE; }
+    Error validateDisplay(Display, std::vector<Layer>*, std::vector<IComposerClient::Composition>*,
+                          uint32_t* outDisplayRequestMask, std::vector<Layer>*,
+                          std::vector<uint32_t>*) override {
+        *outDisplayRequestMask = 0;
+        return Error::NONE;
+    }
+    Error acceptDisplayChanges(Display) override { return Error::NONE; }
+    Error presentDisplay(Display, int32_t* outPresentFence, std::vector<Layer>*,
+                         std::vector<int32_t>*) override {
+        *outPresentFence = -1;
+        return Error::NONE;
+    }
+
+    Error setLayerCursorPosition(Display, Layer, int32_t, int32_t) override { return Error::NONE; }
+    Error setLayerBuffer(Display, Layer, buffer_handle_t, int32_t) override { return Error::NONE; }
+    Error setLayerSurfaceDamage(Display, Layer, const std::vector<hwc_rect_t>&) override {
+        return Error::NONE;
+    }
+    Error setLayerBlendMode(Display, Layer, int32_t) override { return Error::NONE; }
+    Error setLayerColor(Display, Layer, IComposerClient::Color) override { return Error::NONE; }
+    Error setLayerCompositionType(Display, Layer, int32_t) override { return Error::NONE; }
+    Error setLayerDataspace(Display, Layer, int32_t) override { return Error::NONE; }
+    Error setLayerDisplayFrame(Display, Layer, const hwc_rect_t&) override { return Error::NONE; }
+    Error setLayerPlaneAlpha(Display, Layer, float) override { return Error::NONE; }
+    Error setLayerSidebandStream(Display, Layer, buffer_handle_t) override { return Error::NONE; }
+    Error setLayerSourceCrop(Display, Layer, const hwc_frect_t&) override { return Error::NONE; }
+    Error setLayerTransform(Display, Layer, int32_t) override { return Error::NONE; }
+    Error setLayerVisibleRegion(Display, Layer, const std::vector<hwc_rect_t>&) override {
+        return Error::NONE;
+    }
+    Error setLayerZOrder(Display, Layer, uint32_t) override { return Error::NONE; }
+
+   private:
+    Layer mLastLayer = 0;
+};
+
+enum FrameKind : int64_t {
+    // only the buffers and damage of the layers change, as in steady state
+    kBuffersOnly = 0,
+    // every layer attribute is sent with its own command
+    kFullState = 1,
+};
+
+void writeFrame(CommandWriterBase* writer, const std::vector<Layer>& layers, FrameKind kind,
+                int64_t frame) {
+    const IComposerClient::Rect rect{0, 0, 1920, 1080};
+    const std::vector<IComposerClient::Rect> damage{rect};
+
+    writer->selectDisplay(kDisplay);
+    for (size_t i = 0; i < layers.size(); i++) {
+        writer->selectLayer(layers[i]);
+        if (kind == kFullState) {
+            writer->setLayerBlendMode(IComposerClient::BlendMode::PREMULTIPLIED);
+            writer->setLayerColor({0, 0, 0, 0xff});
+            writer->setLayerCompositionType(IComposerClient::Composition::DEVICE);
+            writer->setLayerDataspace(Dataspace::UNKNOWN);
+            writer->setLayerDisplayFrame(rect);
+            writer->setLayerPlaneAlpha((frame % 2) ? 1.0f : 0.5f);
+            writer->setLayerSourceCrop({0.0f, 0.0f, 1920.0f, 1080.0f});
+            writer->setLayerTransform(static_cast<Transform>(0));
+            writer->setLayerZOrder(static_cast<uint32_t>(i));
+        }
+        // the buffers come from the layer buffer caches
+        writer->setLayerBuffer(static_cast<uint32_t>(frame % 3), nullptr, -1);
+        writer->setLayerSurfaceDamage(damage);
+    }
+    writer->presentOrvalidateDisplay();
+}
+
+/*
+ * Sends frames of a display through ComposerCommandEngine::execute, the way ComposerClient does
+ * for executeCommands.  Arg 0 is the number of layers, arg 1 the FrameKind.
+ */
+void BM_ExecuteCommands(benchmark::State& state) {
+    const size_t layerCount = static_cast<size_t>(state.range(0));
+    const auto kind = static_cast<FrameKind>(state.range(1));
+
+    FakeComposerHal hal;
+    // buffers are only used from the caches, so the resources need no mapper
+    ComposerResources resources;
+    resources.addPhysicalDisplay(kDisplay);
+    std::vector<Layer> layers(layerCount);
+    for (auto& layer : layers) {
+        hal.createLayer(kDisplay, &layer);
+        resources.addLayer(kDisplay, layer, 3);
+    }
+
+    ComposerCommandEngine engine(&hal, &resources);
+    CommandWriterBase writer(64);
+    std::unique_ptr<CommandQueueType> outputQueue;
+    std::vector<uint32_t> output;
+
+    int64_t frame = 0;
+    for (auto _ : state) {
+        writeFrame(&writer, layers, kind, frame++);
+
+        bool queueChanged = false;
+        uint32_t length = 0;
+        hidl_vec<hidl_handle> handles;
+        if (!writer.writeQueue(&queueChanged, &length, &handles)) {
+            state.SkipWithError("writeQueue failed");
+            break;
+        }
+        if (queueChanged) {
+            engine.setInputMQDescriptor(*writer.getMQDescriptor());
+        }
+
+        bool outQueueChanged = false;
+        uint32_t outLength = 0;
+        hidl_vec<hidl_handle> outHandles;
+        if (engine.execute(length, handles, &outQueueChanged, &outLength, &outHandles) !=
+            Error::NONE) {
+            state.SkipWithError("execute failed");
+            break;
+        }
+
+        // read the results back, as the client would
+        if (outQueueChanged || !outputQueue) {
+            outputQueue = std::make_unique<CommandQueueType>(*engine.getOutputMQDescriptor());
+        }
+        output.resize(outLength);
+        if (outLength && !outputQueue->read(output.data(), outLength)) {
+            state.SkipWithError("failed to read the results");
+            break;
+        }
+
+        engine.reset();
+        writer.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * layerCount);
+}
+void executeCommandsArgs(benchmark::internal::Benchmark* b) {
+    for (int layerCount : {4, 16, 64}) {
+        for (int kind : {kBuffersOnly, kFullState}) {
+            b->Args({layerCount, kind});
+        }
+    }
+}
+BENCHMARK(BM_ExecuteCommands)->ArgNames({"layers", "frame"})->Apply(executeCommandsArgs);
+
+}  // namespace anonymous
+
+}  // namespace hal
+}  // namespace V2_1
+}  // namespace composer
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -25,6 +25,7 @@
 #include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <vector>
 
 #include <android/hardware/graphics/composer/2.1/IComposer.h>
@@ -74,7 +75,10 @@ class ComposerImpl : public Interface {
     }
 
     Return<void> dumpDebugInfo(IComposer::dumpDebugInfo_cb hidl_cb) override {
-        hidl_cb(mHal->dumpDebugInfo());
+        std::string info = mHal->dumpDebugInfo();
+        info += "ComposerCommandEngine scratch allocations: " +
+                std::to_string(ComposerCommandEngine::getScratchAllocationCount()) + "\n";
+        hidl_cb(info);
         return Void();
     }
 
@@ -20,6 +20,9 @@
 #warning "ComposerClient.h included without LOG_TAG"
 #endif
 
+#include <algorithm>
+#include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <vector>
@@ -28,6 +31,7 @@
 #include <composer-hal/2.1/ComposerCommandEngine.h>
 #include <composer-hal/2.1/ComposerHal.h>
 #include <composer-hal/2.1/ComposerResources.h>
+#include <composer-hal/2.1/ComposerWorkerPool.h>
 #include <log/log.h>
 
 namespace android {
@@ -73,9 +77,15 @@ class ComposerClientImpl : public Interface {
             ALOGE("failed to create composer resources");
             return false;
         }
+        // replaced buffers are freed once executeCommands has replied
+        mResources->setDeferredFreeEnabled(true);
 
         mCommandEngine = createCommandEngine();
 
+        if (mHal->supportsConcurrentDisplays()) {
+            mWorkerPool = std::make_unique<ComposerWorkerPool>(kDisplayWorkerCount);
+        }
+
         return true;
     }
 
@@ -145,6 +155,10 @@ class ComposerClientImpl : public Interface {
         Error err = mHal->destroyVirtualDisplay(display);
         if (err == Error::NONE) {
             mResources->removeDisplay(display);
+
+            std::lock_guard<std::mutex> lock(mCommandEngineMutex);
+            mCommandEngine->invalidateDisplayLayerStates(display);
+            mDisplayCommandEngines.erase(display);
         }
 
         return err;
@@ -162,6 +176,10 @@ class ComposerClientImpl : public Interface {
                 // disconnect invalidates the display id. The implementation should
                 // ensure all layers for the display are destroyed.
                 layer = 0;
+            } else {
+                // The HAL may reuse ids of destroyed layers.
+                std::lock_guard<std::mutex> lock(mCommandEngineMutex);
+                invalidateLayerStateLocked(display, layer);
             }
         }
 
@@ -173,6 +191,9 @@ class ComposerClientImpl : public Interface {
         Error err = mHal->destroyLayer(display, layer);
         if (err == Error::NONE) {
             mResources->removeLayer(display, layer);
+
+            std::lock_guard<std::mutex> lock(mCommandEngineMutex);
+            invalidateLayerStateLocked(display, layer);
         }
 
         return err;
@@ -254,16 +275,26 @@ class ComposerClientImpl : public Interface {
 
     Return<Error> setActiveConfig(Display display, Config config) override {
         Error err = mHal->setActiveConfig(display, config);
+        if (err == Error::NONE) {
+            // the composition decided by the last validation may no longer hold
+            mResources->setDisplayMustValidateState(display, true);
+        }
         return err;
     }
 
     Return<Error> setColorMode(Display display, ColorMode mode) override {
         Error err = mHal->setColorMode(display, mode);
+        if (err == Error::NONE) {
+            mResources->setDisplayMustValidateState(display, true);
+        }
         return err;
     }
 
     Return<Error> setPowerMode(Display display, IComposerClient::PowerMode mode) override {
         Error err = mHal->setPowerMode(display, mode);
+        if (err == Error::NONE) {
+            mResources->setDisplayMustValidateState(display, true);
+        }
         return err;
     }
 
@@ -297,21 +328,99 @@ class ComposerClientImpl : public Interface {
 
     Return<void> executeCommands(uint32_t inLength, const hidl_vec<hidl_handle>& inHandles,
                                  IComposerClient::executeCommands_cb hidl_cb) override {
-        std::lock_guard<std::mutex> lock(mCommandEngineMutex);
-        bool outChanged = false;
-        uint32_t outLength = 0;
-        hidl_vec<hidl_handle> outHandles;
-        Error error =
-            mCommandEngine->execute(inLength, inHandles, &outChanged, &outLength, &outHandles);
+        {
+            std::lock_guard<std::mutex> lock(mCommandEngineMutex);
+            bool outChanged = false;
+            uint32_t outLength = 0;
+            hidl_vec<hidl_handle> outHandles;
+            Error error =
+                executeCommandsLocked(inLength, inHandles, &outChanged, &outLength, &outHandles);
 
-        hidl_cb(error, outChanged, outLength, outHandles);
+            hidl_cb(error, outChanged, outLength, outHandles);
 
-        mCommandEngine->reset();
+            mCommandEngine->reset();
+        }
+
+        // the reply has been sent, free the handles replaced by the commands
+        mResources->freeDeferredHandles();
 
         return Void();
     }
 
    protected:
+    // Executes commands with the command engine or, when the HAL supports
+    // concurrent displays, with an engine per display, on the worker pool.
+    // The output of each display is written in the order of the commands.
+    // mCommandEngineMutex must be held, and the command engine reset after
+    // the output is consumed.
+    Error executeCommandsLocked(uint32_t inLength, const hidl_vec<hidl_handle>& inHandles,
+                                bool* outChanged, uint32_t* outLength,
+                                hidl_vec<hidl_handle>* outHandles) {
+        if (!mWorkerPool) {
+            return mCommandEngine->execute(inLength, inHandles, outChanged, outLength,
+                                           outHandles);
+        }
+
+        if (!mCommandEngine->readDisplayCommands(inLength, inHandles, &mDisplayCommands)) {
+            return Error::BAD_PARAMETER;
+        }
+
+        // a display with several runs of commands must execute them in order
+        bool concurrent = mDisplayCommands.size() > 1;
+        mRunEngines.clear();
+        for (const auto& commands : mDisplayCommands) {
+            auto& engine = mDisplayCommandEngines[commands.display];
+            if (!engine) {
+                engine = createCommandEngine();
+            } else if (concurrent && std::find(mRunEngines.begin(), mRunEngines.end(),
+                                               engine.get()) != mRunEngines.end()) {
+                concurrent = false;
+            }
+            mRunEngines.push_back(engine.get());
+        }
+
+        mRunErrors.assign(mDisplayCommands.size(), Error::NONE);
+        if (concurrent) {
+            mRunTasks.clear();
+            for (size_t i = 0; i < mDisplayCommands.size(); i++) {
+                mRunTasks.push_back([this, i] {
+                    mRunErrors[i] =
+                        mRunEngines[i]->executeDisplayCommands(*mCommandEngine, mDisplayCommands[i]);
+                });
+            }
+            mWorkerPool->run(mRunTasks);
+        } else {
+            for (size_t i = 0; i < mDisplayCommands.size(); i++) {
+                mRunErrors[i] =
+                    mRunEngines[i]->executeDisplayCommands(*mCommandEngine, mDisplayCommands[i]);
+                if (mRunErrors[i] != Error::NONE) {
+                    break;
+                }
+            }
+        }
+
+        Error error = Error::NONE;
+        for (size_t i = 0; i < mRunEngines.size(); i++) {
+            mCommandEngine->appendOutput(mRunEngines[i]);
+            if (error == Error::NONE) {
+                error = mRunErrors[i];
+            }
+        }
+        if (error != Error::NONE) {
+            return error;
+        }
+
+        return mCommandEngine->writeOutput(outChanged, outLength, outHandles);
+    }
+
+    void invalidateLayerStateLocked(Display display, Layer layer) {
+        mCommandEngine->invalidateLayerState(display, layer);
+        auto it = mDisplayCommandEngines.find(display);
+        if (it != mDisplayCommandEngines.end()) {
+            it->second->invalidateLayerState(display, layer);
+        }
+    }
+
     virtual std::unique_ptr<ComposerResources> createResources() {
         return ComposerResources::create();
     }
@@ -381,6 +490,17 @@ class ComposerClientImpl : public Interface {
     std::mutex mCommandEngineMutex;
     std::unique_ptr<ComposerCommandEngine> mCommandEngine;
 
+    // Used only when the HAL supports concurrent displays.  The command
+    // engine then splits the commands, which are executed by the engines of
+    // their displays; an engine's layer state is only valid for its display.
+    static constexpr size_t kDisplayWorkerCount = 2;
+    std::unique_ptr<ComposerWorkerPool> mWorkerPool;
+    std::map<Display, std::unique_ptr<ComposerCommandEngine>> mDisplayCommandEngines;
+    std::vector<ComposerCommandEngine::DisplayCommands> mDisplayCommands;
+    std::vector<ComposerCommandEngine*> mRunEngines;
+    std::vector<Error> mRunErrors;
+    std::vector<std::function<void()>> mRunTasks;
+
     std::function<void()> mOnClientDestroyed;
     std::unique_ptr<HalEventCallback> mHalEventCallback;
 };
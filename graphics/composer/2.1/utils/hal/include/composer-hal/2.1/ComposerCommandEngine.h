@@ -20,6 +20,10 @@
 #warning "ComposerCommandEngine.h included without LOG_TAG"
 #endif
 
+#include <atomic>
+#include <map>
+#include <set>
+#include <utility>
 #include <vector>
 
 #include <composer-command-buffer/2.1/ComposerCommandBuffer.h>
@@ -54,26 +58,96 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return Error::BAD_PARAMETER;
         }
 
-        IComposerClient::Command command;
-        uint16_t length = 0;
-        while (!isEmpty()) {
-            if (!beginCommand(&command, &length)) {
-                break;
-            }
+        Error err = executeCommands();
+        if (err != Error::NONE) {
+            return err;
+        }
 
-            bool parsed = executeCommand(command, length);
-            endCommand();
+        return writeOutput(outQueueChanged, outCommandLength, outCommandHandles);
+    }
 
-            if (!parsed) {
-                ALOGE("failed to parse command 0x%x, length %" PRIu16, command, length);
+    // The commands of an executeCommands call for one display, as offsets
+    // into the command stream.  They start with SELECT_DISPLAY, except for the
+    // commands before the first SELECT_DISPLAY, which are for the display
+    // selected last by the previous call.
+    struct DisplayCommands {
+        Display display;
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    // Reads the commands of an executeCommands call, like execute, but splits
+    // them by display instead of executing them.  The commands are then
+    // executed with executeDisplayCommands, by one engine per display, and
+    // their output gathered with appendOutput and written with writeOutput.
+    //
+    // A malformed command ends the splitting; it is left at the end of the
+    // last display's commands, to be reported when they are executed.
+    bool readDisplayCommands(uint32_t inLength, const hidl_vec<hidl_handle>& inHandles,
+                             std::vector<DisplayCommands>* outDisplayCommands) {
+        outDisplayCommands->clear();
+        if (!readQueue(inLength, inHandles)) {
+            return false;
+        }
+
+        constexpr uint32_t opcodeMask =
+            static_cast<uint32_t>(IComposerClient::Command::OPCODE_MASK);
+        constexpr uint32_t lengthMask =
+            static_cast<uint32_t>(IComposerClient::Command::LENGTH_MASK);
+
+        const uint32_t size = getDataSize();
+        uint32_t offset = 0;
+        while (offset < size) {
+            auto command = static_cast<IComposerClient::Command>(mData[offset] & opcodeMask);
+            uint32_t length = mData[offset] & lengthMask;
+            if (offset + 1 + length > size) {
                 break;
             }
+
+            if (command == IComposerClient::Command::SELECT_DISPLAY &&
+                length == CommandWriterBase::kSelectDisplayLength) {
+                mCurrentDisplay = (static_cast<uint64_t>(mData[offset + 2]) << 32) |
+                                  mData[offset + 1];
+                outDisplayCommands->push_back({mCurrentDisplay, offset, offset});
+            } else if (outDisplayCommands->empty()) {
+                outDisplayCommands->push_back({mCurrentDisplay, 0, 0});
+            }
+            offset += 1 + length;
+            outDisplayCommands->back().end = offset;
+        }
+        if (offset < size) {
+            if (outDisplayCommands->empty()) {
+                outDisplayCommands->push_back({mCurrentDisplay, 0, 0});
+            }
+            outDisplayCommands->back().end = size;
         }
 
-        if (!isEmpty()) {
-            return Error::BAD_PARAMETER;
+        return true;
+    }
+
+    // Executes commands of source split by readDisplayCommands.  The engine
+    // must only ever execute the commands of that display, as it keeps the
+    // state of the layers of the displays it has executed commands for.
+    Error executeDisplayCommands(const ComposerCommandEngine& source,
+                                 const DisplayCommands& commands) {
+        readCommands(source.mData.get() + commands.begin, commands.end - commands.begin,
+                     source.getDataHandles(), commands.begin);
+        if (mCurrentDisplay != commands.display) {
+            mCurrentDisplay = commands.display;
+            mCurrentLayerState = nullptr;
         }
 
+        Error err = executeCommands();
+        CommandReaderBase::reset();
+        return err;
+    }
+
+    // Moves the output of the commands executed by other after the output of
+    // this engine.
+    void appendOutput(ComposerCommandEngine* other) { mWriter.appendCommands(&other->mWriter); }
+
+    Error writeOutput(bool* outQueueChanged, uint32_t* outCommandLength,
+                      hidl_vec<hidl_handle>* outCommandHandles) {
         return mWriter.writeQueue(outQueueChanged, outCommandLength, outCommandHandles)
                    ? Error::NONE
                    : Error::NO_RESOURCES;
@@ -86,7 +160,57 @@ class ComposerCommandEngine : protected CommandReaderBase {
         mWriter.reset();
     }
 
+    // Forgets the layer attributes applied by earlier commands, which are used
+    // to skip HAL calls that would not change anything.  Must be called when a
+    // layer is created or destroyed.
+    void invalidateLayerState(Display display, Layer layer) {
+        mLayerStates.erase(std::make_pair(display, layer));
+        mCurrentLayerState = nullptr;
+        markCompositionChanged(display);
+    }
+
+    void invalidateDisplayLayerStates(Display display) {
+        markCompositionChanged(display);
+        mLayerStates.erase(mLayerStates.lower_bound(std::make_pair(display, Layer(0))),
+                           mLayerStates.upper_bound(
+                               std::make_pair(display, std::numeric_limits<Layer>::max())));
+        mCurrentLayerState = nullptr;
+    }
+
+    // Returns the number of times the scratch storage of any engine had to
+    // grow.  It stops increasing once the engines have seen their largest
+    // frame.
+    static uint64_t getScratchAllocationCount() { return scratchAllocationCount().load(); }
+
+    // Returns the number of PRESENT_OR_VALIDATE_DISPLAY commands of any engine
+    // that presented without validating, because the HAL can skip validation
+    // or because nothing changed the composition since the previous validation.
+    static uint64_t getValidateSkipCount() { return validateSkipCount().load(); }
+
    protected:
+    Error executeCommands() {
+        IComposerClient::Command command;
+        uint16_t length = 0;
+        while (!isEmpty()) {
+            if (!beginCommand(&command, &length)) {
+                break;
+            }
+
+            if (changesComposition(command)) {
+                markCompositionChanged(mCurrentDisplay);
+            }
+            bool parsed = executeCommand(command, length);
+            endCommand();
+
+            if (!parsed) {
+                ALOGE("failed to parse command 0x%x, length %" PRIu16, command, length);
+                break;
+            }
+        }
+
+        return isEmpty() ? Error::NONE : Error::BAD_PARAMETER;
+    }
+
     virtual bool executeCommand(IComposerClient::Command command, uint16_t length) {
         switch (command) {
             case IComposerClient::Command::SELECT_DISPLAY:
@@ -146,6 +270,7 @@ class ComposerCommandEngine : protected CommandReaderBase {
         }
 
         mCurrentDisplay = read64();
+        mCurrentLayerState = nullptr;
         mWriter.selectDisplay(mCurrentDisplay);
 
         return true;
@@ -157,6 +282,7 @@ class ComposerCommandEngine : protected CommandReaderBase {
         }
 
         mCurrentLayer = read64();
+        mCurrentLayerState = nullptr;
 
         return true;
     }
@@ -191,7 +317,7 @@ class ComposerCommandEngine : protected CommandReaderBase {
         auto rawHandle = readHandle(&useCache);
         auto fence = readFence();
         auto dataspace = readSigned();
-        auto damage = readRegion((length - 4) / 4);
+        readRegion((length - 4) / 4, &mRegion);
         bool closeFence = true;
 
         const native_handle_t* clientTarget;
@@ -199,7 +325,7 @@ class ComposerCommandEngine : protected CommandReaderBase {
         auto err = mResources->getDisplayClientTarget(mCurrentDisplay, slot, useCache, rawHandle,
                                                       &clientTarget, &replacedClientTarget);
         if (err == Error::NONE) {
-            err = mHal->setClientTarget(mCurrentDisplay, clientTarget, fence, dataspace, damage);
+            err = mHal->setClientTarget(mCurrentDisplay, clientTarget, fence, dataspace, mRegion);
             if (err == Error::NONE) {
                 closeFence = false;
             }
@@ -250,18 +376,11 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
-        std::vector<Layer> changedLayers;
-        std::vector<IComposerClient::Composition> compositionTypes;
         uint32_t displayRequestMask = 0x0;
-        std::vector<Layer> requestedLayers;
-        std::vector<uint32_t> requestMasks;
-
-        auto err = mHal->validateDisplay(mCurrentDisplay, &changedLayers, &compositionTypes,
-                                         &displayRequestMask, &requestedLayers, &requestMasks);
-        mResources->setDisplayMustValidateState(mCurrentDisplay, false);
+        auto err = validateCurrentDisplay(&displayRequestMask);
         if (err == Error::NONE) {
-            mWriter.setChangedCompositionTypes(changedLayers, compositionTypes);
-            mWriter.setDisplayRequests(displayRequestMask, requestedLayers, requestMasks);
+            mWriter.setChangedCompositionTypes(mChangedLayers, mCompositionTypes);
+            mWriter.setDisplayRequests(displayRequestMask, mRequestedLayers, mRequestMasks);
         } else {
             mWriter.setError(getCommandLoc(), err);
         }
@@ -274,36 +393,39 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
-        // First try to Present as is.
-        if (mHal->hasCapability(HWC2_CAPABILITY_SKIP_VALIDATE)) {
+        // First try to Present as is.  Without HWC2_CAPABILITY_SKIP_VALIDATE
+        // that is only possible for HALs that opt in, and when nothing that
+        // may change the composition was set since the last validation.
+        bool canSkipValidate = mHal->hasCapability(HWC2_CAPABILITY_SKIP_VALIDATE);
+        bool reuseValidation = !canSkipValidate && mPresentReusesValidation &&
+                               mHal->canPresentWithoutRevalidation() &&
+                               mValidatedDisplays.count(mCurrentDisplay);
+        if (canSkipValidate || reuseValidation) {
             int presentFence = -1;
-            std::vector<Layer> layers;
-            std::vector<int> fences;
             auto err = mResources->mustValidateDisplay(mCurrentDisplay)
                            ? Error::NOT_VALIDATED
-                           : mHal->presentDisplay(mCurrentDisplay, &presentFence, &layers, &fences);
+                           : presentCurrentDisplay(&presentFence);
             if (err == Error::NONE) {
+                validateSkipCount()++;
                 mWriter.setPresentOrValidateResult(1);
                 mWriter.setPresentFence(presentFence);
-                mWriter.setReleaseFences(layers, fences);
+                mWriter.setReleaseFences(mReleasedLayers, mReleaseFences);
                 return true;
             }
+            if (reuseValidation && err == Error::NOT_VALIDATED &&
+                !mResources->mustValidateDisplay(mCurrentDisplay)) {
+                // the HAL wants a validation every frame, stop trying
+                mPresentReusesValidation = false;
+            }
         }
 
         // Present has failed. We need to fallback to validate
-        std::vector<Layer> changedLayers;
-        std::vector<IComposerClient::Composition> compositionTypes;
         uint32_t displayRequestMask = 0x0;
-        std::vector<Layer> requestedLayers;
-        std::vector<uint32_t> requestMasks;
-
-        auto err = mHal->validateDisplay(mCurrentDisplay, &changedLayers, &compositionTypes,
-                                         &displayRequestMask, &requestedLayers, &requestMasks);
-        mResources->setDisplayMustValidateState(mCurrentDisplay, false);
+        auto err = validateCurrentDisplay(&displayRequestMask);
         if (err == Error::NONE) {
             mWriter.setPresentOrValidateResult(0);
-            mWriter.setChangedCompositionTypes(changedLayers, compositionTypes);
-            mWriter.setDisplayRequests(displayRequestMask, requestedLayers, requestMasks);
+            mWriter.setChangedCompositionTypes(mChangedLayers, mCompositionTypes);
+            mWriter.setDisplayRequests(displayRequestMask, mRequestedLayers, mRequestMasks);
         } else {
             mWriter.setError(getCommandLoc(), err);
         }
@@ -330,12 +452,10 @@ class ComposerCommandEngine : protected CommandReaderBase {
         }
 
         int presentFence = -1;
-        std::vector<Layer> layers;
-        std::vector<int> fences;
-        auto err = mHal->presentDisplay(mCurrentDisplay, &presentFence, &layers, &fences);
+        auto err = presentCurrentDisplay(&presentFence);
         if (err == Error::NONE) {
             mWriter.setPresentFence(presentFence);
-            mWriter.setReleaseFences(layers, fences);
+            mWriter.setReleaseFences(mReleasedLayers, mReleaseFences);
         } else {
             mWriter.setError(getCommandLoc(), err);
         }
@@ -394,8 +514,8 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
-        auto damage = readRegion(length / 4);
-        auto err = mHal->setLayerSurfaceDamage(mCurrentDisplay, mCurrentLayer, damage);
+        readRegion(length / 4, &mRegion);
+        auto err = mHal->setLayerSurfaceDamage(mCurrentDisplay, mCurrentLayer, mRegion);
         if (err != Error::NONE) {
             mWriter.setError(getCommandLoc(), err);
         }
@@ -408,8 +528,17 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
-        auto err = mHal->setLayerBlendMode(mCurrentDisplay, mCurrentLayer, readSigned());
-        if (err != Error::NONE) {
+        auto value = readSigned();
+        auto& shadow = getCurrentLayerState()->blendMode;
+        if (shadow.matches(value)) {
+            return true;
+        }
+
+        markCompositionChanged(mCurrentDisplay);
+        auto err = mHal->setLayerBlendMode(mCurrentDisplay, mCurrentLayer, value);
+        if (err == Error::NONE) {
+            shadow.set(value);
+        } else {
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -421,8 +550,17 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
-        auto err = mHal->setLayerColor(mCurrentDisplay, mCurrentLayer, readColor());
-        if (err != Error::NONE) {
+        auto value = readColor();
+        auto& shadow = getCurrentLayerState()->color;
+        if (shadow.matches(value)) {
+            return true;
+        }
+
+        markCompositionChanged(mCurrentDisplay);
+        auto err = mHal->setLayerColor(mCurrentDisplay, mCurrentLayer, value);
+        if (err == Error::NONE) {
+            shadow.set(value);
+        } else {
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -447,8 +585,17 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
-        auto err = mHal->setLayerDataspace(mCurrentDisplay, mCurrentLayer, readSigned());
-        if (err != Error::NONE) {
+        auto value = readSigned();
+        auto& shadow = getCurrentLayerState()->dataspace;
+        if (shadow.matches(value)) {
+            return true;
+        }
+
+        markCompositionChanged(mCurrentDisplay);
+        auto err = mHal->setLayerDataspace(mCurrentDisplay, mCurrentLayer, value);
+        if (err == Error::NONE) {
+            shadow.set(value);
+        } else {
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -460,8 +607,17 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
-        auto err = mHal->setLayerDisplayFrame(mCurrentDisplay, mCurrentLayer, readRect());
-        if (err != Error::NONE) {
+        auto value = readRect();
+        auto& shadow = getCurrentLayerState()->displayFrame;
+        if (shadow.matches(value)) {
+            return true;
+        }
+
+        markCompositionChanged(mCurrentDisplay);
+        auto err = mHal->setLayerDisplayFrame(mCurrentDisplay, mCurrentLayer, value);
+        if (err == Error::NONE) {
+            shadow.set(value);
+        } else {
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -473,8 +629,17 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
-        auto err = mHal->setLayerPlaneAlpha(mCurrentDisplay, mCurrentLayer, readFloat());
-        if (err != Error::NONE) {
+        auto value = readFloat();
+        auto& shadow = getCurrentLayerState()->planeAlpha;
+        if (shadow.matches(value)) {
+            return true;
+        }
+
+        markCompositionChanged(mCurrentDisplay);
+        auto err = mHal->setLayerPlaneAlpha(mCurrentDisplay, mCurrentLayer, value);
+        if (err == Error::NONE) {
+            shadow.set(value);
+        } else {
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -507,8 +672,17 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
-        auto err = mHal->setLayerSourceCrop(mCurrentDisplay, mCurrentLayer, readFRect());
-        if (err != Error::NONE) {
+        auto value = readFRect();
+        auto& shadow = getCurrentLayerState()->sourceCrop;
+        if (shadow.matches(value)) {
+            return true;
+        }
+
+        markCompositionChanged(mCurrentDisplay);
+        auto err = mHal->setLayerSourceCrop(mCurrentDisplay, mCurrentLayer, value);
+        if (err == Error::NONE) {
+            shadow.set(value);
+        } else {
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -520,8 +694,17 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
-        auto err = mHal->setLayerTransform(mCurrentDisplay, mCurrentLayer, readSigned());
-        if (err != Error::NONE) {
+        auto value = readSigned();
+        auto& shadow = getCurrentLayerState()->transform;
+        if (shadow.matches(value)) {
+            return true;
+        }
+
+        markCompositionChanged(mCurrentDisplay);
+        auto err = mHal->setLayerTransform(mCurrentDisplay, mCurrentLayer, value);
+        if (err == Error::NONE) {
+            shadow.set(value);
+        } else {
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -534,8 +717,8 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
-        auto region = readRegion(length / 4);
-        auto err = mHal->setLayerVisibleRegion(mCurrentDisplay, mCurrentLayer, region);
+        readRegion(length / 4, &mRegion);
+        auto err = mHal->setLayerVisibleRegion(mCurrentDisplay, mCurrentLayer, mRegion);
         if (err != Error::NONE) {
             mWriter.setError(getCommandLoc(), err);
         }
@@ -548,8 +731,17 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
-        auto err = mHal->setLayerZOrder(mCurrentDisplay, mCurrentLayer, read());
-        if (err != Error::NONE) {
+        auto value = read();
+        auto& shadow = getCurrentLayerState()->zOrder;
+        if (shadow.matches(value)) {
+            return true;
+        }
+
+        markCompositionChanged(mCurrentDisplay);
+        auto err = mHal->setLayerZOrder(mCurrentDisplay, mCurrentLayer, value);
+        if (err == Error::NONE) {
+            shadow.set(value);
+        } else {
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -562,15 +754,55 @@ class ComposerCommandEngine : protected CommandReaderBase {
         };
     }
 
-    std::vector<hwc_rect_t> readRegion(size_t count) {
-        std::vector<hwc_rect_t> region;
-        region.reserve(count);
+    void readRegion(size_t count, std::vector<hwc_rect_t>* outRegion) {
+        outRegion->clear();
+        reserveScratch(outRegion, count);
         while (count > 0) {
-            region.emplace_back(readRect());
+            outRegion->emplace_back(readRect());
             count--;
         }
+    }
 
-        return region;
+    // validates the current display into the scratch vectors
+    Error validateCurrentDisplay(uint32_t* outDisplayRequestMask) {
+        auto capacity = getScratchCapacity();
+        mChangedLayers.clear();
+        mCompositionTypes.clear();
+        mRequestedLayers.clear();
+        mRequestMasks.clear();
+
+        auto err = mHal->validateDisplay(mCurrentDisplay, &mChangedLayers, &mCompositionTypes,
+                                         outDisplayRequestMask, &mRequestedLayers, &mRequestMasks);
+        mResources->setDisplayMustValidateState(mCurrentDisplay, false);
+        if (err == Error::NONE) {
+            mValidatedDisplays.insert(mCurrentDisplay);
+        } else {
+            markCompositionChanged(mCurrentDisplay);
+        }
+        countScratchAllocations(capacity);
+
+        return err;
+    }
+
+    // presents the current display, release fences are put in the scratch vectors
+    virtual Error presentCurrentDisplay(int32_t* outPresentFence) {
+        auto capacity = getScratchCapacity();
+        mReleasedLayers.clear();
+        mReleaseFences.clear();
+
+        auto err = mHal->presentDisplay(mCurrentDisplay, outPresentFence, &mReleasedLayers,
+                                        &mReleaseFences);
+        countScratchAllocations(capacity);
+
+        return err;
+    }
+
+    template <typename T>
+    static void reserveScratch(std::vector<T>* scratch, size_t count) {
+        if (scratch->capacity() < count) {
+            scratch->reserve(count);
+            scratchAllocationCount()++;
+        }
     }
 
     hwc_frect_t readFRect() {
@@ -579,6 +811,82 @@ class ComposerCommandEngine : protected CommandReaderBase {
         };
     }
 
+    // layer attributes last applied successfully by the HAL
+    struct LayerState {
+        ShadowValue<int32_t> blendMode;
+        ShadowValue<IComposerClient::Color> color;
+        ShadowValue<int32_t> dataspace;
+        ShadowValue<hwc_rect_t> displayFrame;
+        ShadowValue<float> planeAlpha;
+        ShadowValue<hwc_frect_t> sourceCrop;
+        ShadowValue<int32_t> transform;
+        ShadowValue<uint32_t> zOrder;
+    };
+
+    // Whether the command may change the composition the HAL decided when
+    // validating.  Commands that only update content, or that are checked
+    // against the shadowed layer state by their handler, do not.  A new layer
+    // buffer does, as its format, size or protection may not fit the plane the
+    // layer was assigned.
+    static bool changesComposition(IComposerClient::Command command) {
+        switch (command) {
+            case IComposerClient::Command::SELECT_DISPLAY:
+            case IComposerClient::Command::SELECT_LAYER:
+            case IComposerClient::Command::SET_CLIENT_TARGET:
+            case IComposerClient::Command::SET_OUTPUT_BUFFER:
+            case IComposerClient::Command::VALIDATE_DISPLAY:
+            case IComposerClient::Command::PRESENT_OR_VALIDATE_DISPLAY:
+            case IComposerClient::Command::ACCEPT_DISPLAY_CHANGES:
+            case IComposerClient::Command::PRESENT_DISPLAY:
+            case IComposerClient::Command::SET_LAYER_CURSOR_POSITION:
+            case IComposerClient::Command::SET_LAYER_SURFACE_DAMAGE:
+            case IComposerClient::Command::SET_LAYER_BLEND_MODE:
+            case IComposerClient::Command::SET_LAYER_COLOR:
+            case IComposerClient::Command::SET_LAYER_DATASPACE:
+            case IComposerClient::Command::SET_LAYER_DISPLAY_FRAME:
+            case IComposerClient::Command::SET_LAYER_PLANE_ALPHA:
+            case IComposerClient::Command::SET_LAYER_SOURCE_CROP:
+            case IComposerClient::Command::SET_LAYER_TRANSFORM:
+            case IComposerClient::Command::SET_LAYER_Z_ORDER:
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    void markCompositionChanged(Display display) { mValidatedDisplays.erase(display); }
+
+    static std::atomic<uint64_t>& validateSkipCount() {
+        static std::atomic<uint64_t> count{0};
+        return count;
+    }
+
+    static std::atomic<uint64_t>& scratchAllocationCount() {
+        static std::atomic<uint64_t> count{0};
+        return count;
+    }
+
+    // the HAL fills the validate and present vectors itself, growths are
+    // detected by comparing the capacities
+    size_t getScratchCapacity() const {
+        return mChangedLayers.capacity() + mCompositionTypes.capacity() +
+               mRequestedLayers.capacity() + mRequestMasks.capacity() +
+               mReleasedLayers.capacity() + mReleaseFences.capacity();
+    }
+
+    void countScratchAllocations(size_t oldCapacity) {
+        if (getScratchCapacity() != oldCapacity) {
+            scratchAllocationCount()++;
+        }
+    }
+
+    LayerState* getCurrentLayerState() {
+        if (!mCurrentLayerState) {
+            mCurrentLayerState = &mLayerStates[std::make_pair(mCurrentDisplay, mCurrentLayer)];
+        }
+        return mCurrentLayerState;
+    }
+
     ComposerHal* mHal;
     ComposerResources* mResources;
 
@@ -588,6 +896,23 @@ class ComposerCommandEngine : protected CommandReaderBase {
 
     Display mCurrentDisplay = 0;
     Layer mCurrentLayer = 0;
+
+    std::map<std::pair<Display, Layer>, LayerState> mLayerStates;
+    LayerState* mCurrentLayerState = nullptr;
+
+    // displays validated successfully with no composition change since
+    std::set<Display> mValidatedDisplays;
+    bool mPresentReusesValidation = true;
+
+    // Scratch storage reused across commands, so that a frame no larger than
+    // the previous ones makes no heap allocation in the engine.
+    std::vector<hwc_rect_t> mRegion;
+    std::vector<Layer> mChangedLayers;
+    std::vector<IComposerClient::Composition> mCompositionTypes;
+    std::vector<Layer> mRequestedLayers;
+    std::vector<uint32_t> mRequestMasks;
+    std::vector<Layer> mReleasedLayers;
+    std::vector<int> mReleaseFences;
 };
 
 }  // namespace hal
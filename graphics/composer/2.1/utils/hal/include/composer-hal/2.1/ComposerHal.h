@@ -49,6 +49,19 @@ class ComposerHal {
 
     virtual bool hasCapability(hwc2_capability_t capability) = 0;
 
+    // Returns true if calls for different displays may be made concurrently.
+    // Commands for several displays passed to one executeCommands are then
+    // executed on a thread per display.  Calls for one display are always
+    // made one at a time.
+    virtual bool supportsConcurrentDisplays() { return false; }
+
+    // Returns true if presentDisplay may be called without validateDisplay
+    // when nothing that may change the composition was set since the last
+    // successful validation of the display.  HWC2 requires a validation
+    // before every present unless HWC2_CAPABILITY_SKIP_VALIDATE is reported,
+    // so HALs must opt in.
+    virtual bool canPresentWithoutRevalidation() { return false; }
+
     // dump the debug information
     virtual std::string dumpDebugInfo() = 0;
 
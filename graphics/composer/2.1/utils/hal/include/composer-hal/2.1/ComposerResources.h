@@ -20,8 +20,10 @@
 #warning "ComposerResources.h included without LOG_TAG"
 #endif
 
+#include <atomic>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -279,6 +281,19 @@ class ComposerDisplayResource {
 
     bool removeLayer(Layer layer) { return mLayerResources.erase(layer) > 0; }
 
+    // removes the layer and returns its resource, so that it can be destroyed
+    // without holding any lock
+    std::unique_ptr<ComposerLayerResource> takeLayer(Layer layer) {
+        auto layerIter = mLayerResources.find(layer);
+        if (layerIter == mLayerResources.end()) {
+            return nullptr;
+        }
+
+        auto layerResource = std::move(layerIter->second);
+        mLayerResources.erase(layerIter);
+        return layerResource;
+    }
+
     ComposerLayerResource* findLayerResource(Layer layer) {
         auto layerIter = mLayerResources.find(layer);
         if (layerIter == mLayerResources.end()) {
@@ -301,11 +316,17 @@ class ComposerDisplayResource {
 
     bool mustValidate() const { return mMustValidate; }
 
+    // Locks the caches and layers of this display.  The must-validate state
+    // can be accessed without it.
+    std::unique_lock<std::mutex> lock() { return std::unique_lock<std::mutex>(mMutex); }
+
    protected:
     const DisplayType mType;
     ComposerHandleCache mClientTargetCache;
     ComposerHandleCache mOutputBufferCache;
-    bool mMustValidate;
+    std::atomic<bool> mMustValidate;
+
+    std::mutex mMutex;
 
     std::unordered_map<Layer, std::unique_ptr<ComposerLayerResource>> mLayerResources;
 };
@@ -322,14 +343,53 @@ class ComposerResources {
     }
 
     ComposerResources() = default;
-    virtual ~ComposerResources() = default;
+    virtual ~ComposerResources() { freeDeferredHandles(); }
 
     bool init() { return mImporter.init(); }
 
+    // A handle replaced in a cache is freed as soon as the ReplacedHandle
+    // holding it is reset or destroyed, which is right after the new handle
+    // has been passed to ComposerHal.  With deferred freeing, replaced handles
+    // are queued instead and freed in a batch by freeDeferredHandles, so that
+    // the mapper calls can be made off the command execution path.
+    void setDeferredFreeEnabled(bool enabled) {
+        mDeferFree = enabled;
+        if (!enabled) {
+            freeDeferredHandles();
+        }
+    }
+
+    void freeDeferredHandles() {
+        std::vector<DeferredHandle> handles;
+        {
+            std::lock_guard<std::mutex> lock(mDeferredHandlesMutex);
+            if (mDeferredHandles.empty()) {
+                return;
+            }
+            handles.swap(mDeferredHandles);
+        }
+
+        for (const auto& deferred : handles) {
+            if (deferred.isBuffer) {
+                mImporter.freeBuffer(deferred.handle);
+            } else {
+                mImporter.freeStream(deferred.handle);
+            }
+        }
+
+        // hand the storage back, so that queueing allocates nothing in steady
+        // state
+        handles.clear();
+        std::lock_guard<std::mutex> lock(mDeferredHandlesMutex);
+        if (mDeferredHandles.empty()) {
+            mDeferredHandles.swap(handles);
+        }
+    }
+
     using RemoveDisplay =
         std::function<void(Display display, bool isVirtual, const std::vector<Layer>& layers)>;
     void clear(RemoveDisplay removeDisplay) {
-        std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+        std::unique_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
         for (const auto& displayKey : mDisplayResources) {
             Display display = displayKey.first;
             const ComposerDisplayResource& displayResource = *displayKey.second;
@@ -342,7 +402,7 @@ class ComposerResources {
         auto displayResource =
             createDisplayResource(ComposerDisplayResource::DisplayType::PHYSICAL, 0);
 
-        std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+        std::unique_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
         auto result = mDisplayResources.emplace(display, std::move(displayResource));
         return result.second ? Error::NONE : Error::BAD_DISPLAY;
     }
@@ -351,23 +411,36 @@ class ComposerResources {
         auto displayResource = createDisplayResource(ComposerDisplayResource::DisplayType::VIRTUAL,
                                                      outputBufferCacheSize);
 
-        std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+        std::unique_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
         auto result = mDisplayResources.emplace(display, std::move(displayResource));
         return result.second ? Error::NONE : Error::BAD_DISPLAY;
     }
 
     Error removeDisplay(Display display) {
-        std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
-        return mDisplayResources.erase(display) > 0 ? Error::NONE : Error::BAD_DISPLAY;
+        // destroyed after unlocking, freeing its buffers must not block the
+        // other displays
+        std::unique_ptr<ComposerDisplayResource> displayResource;
+        {
+            std::unique_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
+            auto iter = mDisplayResources.find(display);
+            if (iter == mDisplayResources.end()) {
+                return Error::BAD_DISPLAY;
+            }
+            displayResource = std::move(iter->second);
+            mDisplayResources.erase(iter);
+        }
+
+        return Error::NONE;
     }
 
     Error setDisplayClientTargetCacheSize(Display display, uint32_t clientTargetCacheSize) {
-        std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+        std::shared_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
         ComposerDisplayResource* displayResource = findDisplayResourceLocked(display);
         if (!displayResource) {
             return Error::BAD_DISPLAY;
         }
 
+        auto displayLock = displayResource->lock();
         return displayResource->initClientTargetCache(clientTargetCacheSize) ? Error::NONE
                                                                              : Error::BAD_PARAMETER;
     }
@@ -375,24 +448,32 @@ class ComposerResources {
     Error addLayer(Display display, Layer layer, uint32_t bufferCacheSize) {
         auto layerResource = createLayerResource(bufferCacheSize);
 
-        std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+        std::shared_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
         ComposerDisplayResource* displayResource = findDisplayResourceLocked(display);
         if (!displayResource) {
             return Error::BAD_DISPLAY;
         }
 
+        auto displayLock = displayResource->lock();
         return displayResource->addLayer(layer, std::move(layerResource)) ? Error::NONE
                                                                           : Error::BAD_LAYER;
     }
 
     Error removeLayer(Display display, Layer layer) {
-        std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
-        ComposerDisplayResource* displayResource = findDisplayResourceLocked(display);
-        if (!displayResource) {
-            return Error::BAD_DISPLAY;
+        // destroyed after unlocking, like in removeDisplay
+        std::unique_ptr<ComposerLayerResource> layerResource;
+        {
+            std::shared_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
+            ComposerDisplayResource* displayResource = findDisplayResourceLocked(display);
+            if (!displayResource) {
+                return Error::BAD_DISPLAY;
+            }
+
+            auto displayLock = displayResource->lock();
+            layerResource = displayResource->takeLayer(layer);
         }
 
-        return displayResource->removeLayer(layer) ? Error::NONE : Error::BAD_LAYER;
+        return layerResource ? Error::NONE : Error::BAD_LAYER;
     }
 
     using ReplacedBufferHandle = ReplacedHandle<true>;
@@ -429,7 +510,7 @@ class ComposerResources {
     }
 
     void setDisplayMustValidateState(Display display, bool mustValidate) {
-        std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+        std::shared_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
         auto* displayResource = findDisplayResourceLocked(display);
         if (displayResource) {
             displayResource->setMustValidateState(mustValidate);
@@ -437,7 +518,7 @@ class ComposerResources {
     }
 
     bool mustValidateDisplay(Display display) {
-        std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+        std::shared_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
         auto* displayResource = findDisplayResourceLocked(display);
         if (displayResource) {
             return displayResource->mustValidate();
@@ -463,12 +544,37 @@ class ComposerResources {
         return iter->second.get();
     }
 
+    // frees a handle released by a ReplacedHandle, or queues it when freeing
+    // is deferred
+    void releaseReplacedHandle(const native_handle_t* handle, bool isBuffer) {
+        if (mDeferFree) {
+            std::lock_guard<std::mutex> lock(mDeferredHandlesMutex);
+            mDeferredHandles.push_back({handle, isBuffer});
+        } else if (isBuffer) {
+            mImporter.freeBuffer(handle);
+        } else {
+            mImporter.freeStream(handle);
+        }
+    }
+
     ComposerHandleImporter mImporter;
 
-    std::mutex mDisplayResourcesMutex;
+    // Guards the display table only.  Displays are added and removed with it
+    // locked exclusively, all other operations lock it shared and then lock
+    // the display they operate on, so that displays do not contend.
+    std::shared_mutex mDisplayResourcesMutex;
     std::unordered_map<Display, std::unique_ptr<ComposerDisplayResource>> mDisplayResources;
 
    private:
+    struct DeferredHandle {
+        const native_handle_t* handle;
+        bool isBuffer;
+    };
+
+    std::atomic<bool> mDeferFree{false};
+    std::mutex mDeferredHandlesMutex;
+    std::vector<DeferredHandle> mDeferredHandles;
+
     enum class Cache {
         CLIENT_TARGET,
         OUTPUT_BUFFER,
@@ -487,22 +593,18 @@ class ComposerResources {
 
         ~ReplacedHandle() { reset(); }
 
-        void reset(ComposerHandleImporter* importer = nullptr,
+        void reset(ComposerResources* resources = nullptr,
                    const native_handle_t* handle = nullptr) {
             if (mHandle) {
-                if (isBuffer) {
-                    mImporter->freeBuffer(mHandle);
-                } else {
-                    mImporter->freeStream(mHandle);
-                }
+                mResources->releaseReplacedHandle(mHandle, isBuffer);
             }
 
-            mImporter = importer;
+            mResources = resources;
             mHandle = handle;
         }
 
        private:
-        ComposerHandleImporter* mImporter = nullptr;
+        ComposerResources* mResources = nullptr;
         const native_handle_t* mHandle = nullptr;
     };
 
@@ -522,12 +624,16 @@ class ComposerResources {
             }
         }
 
-        std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+        std::shared_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
 
         // find display/layer resource
         const bool needLayerResource =
             (cache == Cache::LAYER_BUFFER || cache == Cache::LAYER_SIDEBAND_STREAM);
         ComposerDisplayResource* displayResource = findDisplayResourceLocked(display);
+        std::unique_lock<std::mutex> displayLock;
+        if (displayResource) {
+            displayLock = displayResource->lock();
+        }
         ComposerLayerResource* layerResource = (displayResource && needLayerResource)
                                                    ? displayResource->findLayerResource(layer)
                                                    : nullptr;
@@ -578,7 +684,7 @@ class ComposerResources {
             return error;
         }
 
-        outReplacedHandle->reset(&mImporter, replacedHandle);
+        outReplacedHandle->reset(this, replacedHandle);
 
         return Error::NONE;
     }
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace composer {
+namespace V2_1 {
+namespace hal {
+
+// ComposerWorkerPool runs batches of independent tasks on a few threads kept
+// across batches.  The calling thread takes part and run returns once every
+// task of the batch is done.  Batches must not be run concurrently.
+class ComposerWorkerPool {
+   public:
+    explicit ComposerWorkerPool(size_t threadCount) {
+        for (size_t i = 0; i < threadCount; i++) {
+            mThreads.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ComposerWorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mTaskCondition.notify_all();
+        for (auto& thread : mThreads) {
+            thread.join();
+        }
+    }
+
+    void run(const std::vector<std::function<void()>>& tasks) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mTasks = &tasks;
+        mNextTask = 0;
+        mPendingTasks = tasks.size();
+        mTaskCondition.notify_all();
+
+        while (runNextTaskLocked(lock)) {
+        }
+        mDoneCondition.wait(lock, [this] { return mPendingTasks == 0; });
+        mTasks = nullptr;
+    }
+
+   private:
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mTaskCondition.wait(lock, [this] {
+                return mStopping || (mTasks && mNextTask < mTasks->size());
+            });
+            if (mStopping) {
+                return;
+            }
+            runNextTaskLocked(lock);
+        }
+    }
+
+    // Runs the next task of the batch, if any, with the lock released.
+    bool runNextTaskLocked(std::unique_lock<std::mutex>& lock) {
+        if (!mTasks || mNextTask >= mTasks->size()) {
+            return false;
+        }
+
+        const std::function<void()>& task = (*mTasks)[mNextTask++];
+        lock.unlock();
+        task();
+        lock.lock();
+
+        if (--mPendingTasks == 0) {
+            mDoneCondition.notify_all();
+        }
+        return true;
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mTaskCondition;
+    std::condition_variable mDoneCondition;
+    const std::vector<std::function<void()>>* mTasks = nullptr;
+    size_t mNextTask = 0;
+    size_t mPendingTasks = 0;
+    bool mStopping = false;
+    std::vector<std::thread> mThreads;
+};
+
+}  // namespace hal
+}  // namespace V2_1
+}  // namespace composer
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
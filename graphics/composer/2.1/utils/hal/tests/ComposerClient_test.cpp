@@ -0,0 +1,488 @@
+/*
+ * Copyright 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ComposerClientTest"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <composer-hal/2.1/ComposerClient.h>
+#include <gtest/gtest.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace composer {
+namespace V2_1 {
+namespace hal {
+
+namespace {
+
+constexpr Display kDisplay1 = 1;
+constexpr Display kDisplay2 = 2;
+constexpr Layer kLayer = 1;
+
+constexpr std::chrono::seconds kTimeout(5);
+
+// Returns the inode of a pipe end, which identifies the pipe across dups.
+ino_t getInode(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 ? st.st_ino : 0;
+}
+
+/*
+ * A composer that supports concurrent displays.  Each present returns the read end of a new pipe
+ * as its fence.  Presents can be made to wait for each other, to check that they are concurrent.
+ * Validations are counted, and the composer may opt in to presents without revalidation.
+ */
+class FakeComposerHal : public ComposerHal {
+   public:
+    ~FakeComposerHal() override {
+        for (int fd : mPipeWriteEnds) {
+            close(fd);
+        }
+    }
+
+    bool supportsConcurrentDisplays() override { return true; }
+
+    bool canPresentWithoutRevalidation() override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mPresentWithoutRevalidation;
+    }
+
+    void setPresentWithoutRevalidation(bool enabled) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPresentWithoutRevalidation = enabled;
+    }
+
+    size_t getValidateCount() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mValidateCount;
+    }
+
+    // Makes the next presents wait until count of them are in progress.
+    void setPresentBarrier(size_t count) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mBarrierCount = count;
+        mBarrierArrived = 0;
+    }
+
+    void setPresentError(Display display, Error error) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPresentErrors[display] = error;
+    }
+
+    bool presentsMet() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mBarrierArrived >= mBarrierCount;
+    }
+
+    ino_t getPresentFenceInode(Display display) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mPresentFenceInodes[display];
+    }
+
+    Error presentDisplay(Display display, int32_t* outPresentFence, std::vector<Layer>*,
+                         std::vector<int32_t>*) override {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mBarrierCount > 0) {
+            mBarrierArrived++;
+            mBarrierCondition.notify_all();
+            mBarrierCondition.wait_for(lock, kTimeout,
+                                       [this] { return mBarrierArrived >= mBarrierCount; });
+        }
+
+        auto it = mPresentErrors.find(display);
+        if (it != mPresentErrors.end()) {
+            return it->second;
+        }
+
+        int fds[2];
+        if (pipe(fds)) {
+            return Error::NO_RESOURCES;
+        }
+        mPipeWriteEnds.push_back(fds[1]);
+        mPresentFenceInodes[display] = getInode(fds[0]);
+        *outPresentFence = fds[0];
+        return Error::NONE;
+    }
+
+    bool hasCapability(hwc2_capability_t) override { return false; }
+    std::string dumpDebugInfo() override { return {}; }
+    void registerEventCallback(EventCallback*) override {}
+    void unregisterEventCallback() override {}
+
+    uint32_t getMaxVirtualDisplayCount() override { return 0; }
+    Error createVirtualDisplay(uint32_t, uint32_t, PixelFormat*, Display*) override {
+        return Error::NO_RESOURCES;
+    }
+    Error destroyVirtualDisplay(Display) override { return Error::BAD_DISPLAY; }
+    Error createLayer(Display, Layer*) override { return Error::NO_RESOURCES; }
+    Error destroyLayer(Display, Layer) override { return Error::BAD_LAYER; }
+
+    Error getActiveConfig(Display, Config* outConfig) override {
+        *outConfig = 0;
+        return Error::NONE;
+    }
+    Error getClientTargetSupport(Display, uint32_t, uint32_t, PixelFormat, Dataspace) override {
+        return Error::NONE;
+    }
+    Error getColorModes(Display, hidl_vec<ColorMode>* outModes) override {
+        *outModes = hidl_vec<ColorMode>{ColorMode::NATIVE};
+        return Error::NONE;
+    }
+    Error getDisplayAttribute(Display, Config, IComposerClient::Attribute,
+                              int32_t* outValue) override {
+        *outValue = 0;
+        return Error::NONE;
+    }
+    Error getDisplayConfigs(Display, hidl_vec<Config>* outConfigs) override {
+        *outConfigs = hidl_vec<Config>{0};
+        return Error::NONE;
+    }
+    Error getDisplayName(Display, hidl_string* outName) override {
+        *outName = "fake";
+        return Error::NONE;
+    }
+    Error getDisplayType(Display, IComposerClient::DisplayType* outType) override {
+        *outType = IComposerClient::DisplayType::PHYSICAL;
+        return Error::NONE;
+    }
+    Error getDozeSupport(Display, bool* outSupport) override {
+        *outSupport = false;
+        return Error::NONE;
+    }
+    Error getHdrCapabilities(Display, hidl_vec<Hdr>*, float*, float*, float*) override {
+        return Error::NONE;
+    }
+
+    Error setActiveConfig(Display, Config) override { return Error::NONE; }
+    Error setColorMode(Display, ColorMode) override { return Error::NONE; }
+    Error setPowerMode(Display, IComposerClient::PowerMode) override { return Error::NONE; }
+    Error setVsyncEnabled(Display, IComposerClient::Vsync) override { return Error::NONE; }
+
+    Error setColorTransform(Display, const float*, int32_t) override { return Error::NONE; }
+    Error setClientTarget(Display, buffer_handle_t, int32_t, int32_t,
+                          const std::vector<hwc_rect_t>&) override {
+        return Error::NONE;
+    }
+    Error setOutputBuffer(Display, buffer_handle_t, int32_t) override { return Error::NONE; }
+    Error validateDisplay(Display, std::vector<Layer>*, std::vector<IComposerClient::Composition>*,
+                          uint32_t* outDisplayRequestMask, std::vector<Layer>*,
+                          std::vector<uint32_t>*) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mValidateCount++;
+        *outDisplayRequestMask = 0;
+        return Error::NONE;
+    }
+    Error acceptDisplayChanges(Display) override { return Error::NONE; }
+
+    Error setLayerCursorPosition(Display, Layer, int32_t, int32_t) override { return Error::NONE; }
+    Error setLayerBuffer(Display, Layer, buffer_handle_t, int32_t) override { return Error::NONE; }
+    Error setLayerSurfaceDamage(Display, Layer, const std::vector<hwc_rect_t>&) override {
+        return Error::NONE;
+    }
+    Error setLayerBlendMode(Display, Layer, int32_t) override { return Error::NONE; }
+    Error setLayerColor(Display, Layer, IComposerClient::Color) override { return Error::NONE; }
+    Error setLayerCompositionType(Display, Layer, int32_t) override { return Error::NONE; }
+    Error setLayerDataspace(Display, Layer, int32_t) override { return Error::NONE; }
+    Error setLayerDisplayFrame(Display, Layer, const hwc_rect_t&) override { return Error::NONE; }
+    Error setLayerPlaneAlpha(Display, Layer, float) override { return Error::NONE; }
+    Error setLayerSidebandStream(Display, Layer, buffer_handle_t) override { return Error::NONE; }
+    Error setLayerSourceCrop(Display, Layer, const hwc_frect_t&) override { return Error::NONE; }
+    Error setLayerTransform(Display, Layer, int32_t) override { return Error::NONE; }
+    Error setLayerVisibleRegion(Display, Layer, const std::vector<hwc_rect_t>&) override {
+        return Error::NONE;
+    }
+    Error setLayerZOrder(Display, Layer, uint32_t) override { return Error::NONE; }
+
+   private:
+    std::mutex mMutex;
+    std::condition_variable mBarrierCondition;
+    size_t mBarrierCount = 0;
+    size_t mBarrierArrived = 0;
+    std::map<Display, Error> mPresentErrors;
+    std::map<Display, ino_t> mPresentFenceInodes;
+    std::vector<int> mPipeWriteEnds;
+    bool mPresentWithoutRevalidation = false;
+    size_t mValidateCount = 0;
+};
+
+// A client whose resources need no mapper, as the commands carry no buffers.  kDisplay1 has a
+// layer with a single buffer slot.
+class TestComposerClient : public ComposerClient {
+   public:
+    using ComposerClient::ComposerClient;
+
+   protected:
+    std::unique_ptr<ComposerResources> createResources() override {
+        auto resources = std::make_unique<ComposerResources>();
+        resources->addPhysicalDisplay(kDisplay1);
+        resources->addPhysicalDisplay(kDisplay2);
+        resources->addLayer(kDisplay1, kLayer, 1);
+        return resources;
+    }
+};
+
+// The results of executeCommands, by display.
+struct DisplayResults {
+    ino_t presentFenceInode = 0;
+    std::vector<std::pair<uint32_t, int32_t>> errors;
+    // -1 without PRESENT_OR_VALIDATE_DISPLAY, 1 if it presented and 0 if it validated
+    int32_t presentOrValidateResult = -1;
+};
+
+class ResultReader : public CommandReaderBase {
+   public:
+    // Reads the results, taking the fences out of the handles.
+    bool parse(std::map<Display, DisplayResults>* outResults) {
+        Display display = 0;
+        while (!isEmpty()) {
+            IComposerClient::Command command;
+            uint16_t length;
+            if (!beginCommand(&command, &length)) {
+                return false;
+            }
+
+            switch (command) {
+                case IComposerClient::Command::SELECT_DISPLAY:
+                    display = read64();
+                    break;
+                case IComposerClient::Command::SET_ERROR: {
+                    uint32_t loc = read();
+                    int32_t err = readSigned();
+                    (*outResults)[display].errors.emplace_back(loc, err);
+                } break;
+                case IComposerClient::Command::SET_PRESENT_FENCE: {
+                    int fence = readFence();
+                    (*outResults)[display].presentFenceInode = getInode(fence);
+                    close(fence);
+                } break;
+                case IComposerClient::Command::SET_PRESENT_OR_VALIDATE_DISPLAY_RESULT:
+                    (*outResults)[display].presentOrValidateResult = readSigned();
+                    break;
+                case IComposerClient::Command::SET_DISPLAY_REQUESTS:
+                    // no requests are made, skip the display request mask
+                    for (uint16_t i = 0; i < length; i++) {
+                        read();
+                    }
+                    break;
+                default:
+                    return false;
+            }
+
+            endCommand();
+        }
+        return true;
+    }
+};
+
+class ComposerClientTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        mClient = std::make_unique<TestComposerClient>(&mHal);
+        ASSERT_TRUE(mClient->init());
+    }
+
+    // Executes the commands written to mWriter and returns the results by display.
+    void execute(std::map<Display, DisplayResults>* outResults) {
+        bool queueChanged = false;
+        uint32_t length = 0;
+        hidl_vec<hidl_handle> handles;
+        ASSERT_TRUE(mWriter.writeQueue(&queueChanged, &length, &handles));
+        if (queueChanged) {
+            ASSERT_EQ(Error::NONE,
+                      static_cast<Error>(mClient->setInputCommandQueue(*mWriter.getMQDescriptor())));
+        }
+
+        bool parsed = false;
+        mClient->executeCommands(length, handles,
+                                 [&](Error error, bool outQueueChanged, uint32_t outLength,
+                                     const hidl_vec<hidl_handle>& outHandles) {
+                                     ASSERT_EQ(Error::NONE, error);
+                                     if (outQueueChanged || !mReaderHasQueue) {
+                                         mClient->getOutputCommandQueue(
+                                                 [&](Error, const auto& descriptor) {
+                                                     mReaderHasQueue =
+                                                             mReader.setMQDescriptor(descriptor);
+                                                 });
+                                     }
+                                     ASSERT_TRUE(mReaderHasQueue);
+                                     ASSERT_TRUE(mReader.readQueue(outLength, outHandles));
+                                     parsed = mReader.parse(outResults);
+                                     mReader.reset();
+                                 });
+        ASSERT_TRUE(parsed);
+        mWriter.reset();
+    }
+
+    // Executes PRESENT_OR_VALIDATE_DISPLAY on kDisplay1, preceded by a buffer for kLayer if
+    // setBuffer, and presents if it validated.  Returns the PRESENT_OR_VALIDATE_DISPLAY result.
+    int32_t presentOrValidate(bool setBuffer) {
+        mWriter.selectDisplay(kDisplay1);
+        if (setBuffer) {
+            mWriter.selectLayer(kLayer);
+            mWriter.setLayerBuffer(0, nullptr, -1);
+        }
+        mWriter.presentOrvalidateDisplay();
+        std::map<Display, DisplayResults> results;
+        execute(&results);
+        EXPECT_TRUE(results[kDisplay1].errors.empty());
+        int32_t result = results[kDisplay1].presentOrValidateResult;
+        if (result == 0) {
+            mWriter.selectDisplay(kDisplay1);
+            mWriter.acceptDisplayChanges();
+            mWriter.presentDisplay();
+            results.clear();
+            execute(&results);
+            EXPECT_TRUE(results[kDisplay1].errors.empty());
+        }
+        return result;
+    }
+
+    FakeComposerHal mHal;
+    std::unique_ptr<TestComposerClient> mClient;
+    CommandWriterBase mWriter{64};
+    ResultReader mReader;
+    bool mReaderHasQueue = false;
+};
+
+}  // namespace
+
+TEST(CommandWriterBaseTest, appendCommandsRebasesHandleIndices) {
+    int fds[2][2];
+    ASSERT_EQ(0, pipe(fds[0]));
+    ASSERT_EQ(0, pipe(fds[1]));
+    const ino_t inodes[2] = {getInode(fds[0][0]), getInode(fds[1][0])};
+
+    CommandWriterBase writer(64);
+    CommandWriterBase other(64);
+    writer.selectDisplay(kDisplay1);
+    writer.setPresentFence(fds[0][0]);
+    other.selectDisplay(kDisplay2);
+    other.setPresentFence(fds[1][0]);
+    writer.appendCommands(&other);
+
+    bool queueChanged = false;
+    uint32_t length = 0;
+    hidl_vec<hidl_handle> handles;
+    ASSERT_TRUE(other.writeQueue(&queueChanged, &length, &handles));
+    ASSERT_EQ(0u, length);
+    ASSERT_TRUE(writer.writeQueue(&queueChanged, &length, &handles));
+    ASSERT_EQ(2u, handles.size());
+
+    ResultReader reader;
+    ASSERT_TRUE(reader.setMQDescriptor(*writer.getMQDescriptor()));
+    ASSERT_TRUE(reader.readQueue(length, handles));
+    std::map<Display, DisplayResults> results;
+    ASSERT_TRUE(reader.parse(&results));
+    EXPECT_EQ(inodes[0], results[kDisplay1].presentFenceInode);
+    EXPECT_EQ(inodes[1], results[kDisplay2].presentFenceInode);
+
+    close(fds[0][1]);
+    close(fds[1][1]);
+}
+
+TEST_F(ComposerClientTest, executesDisplaysConcurrently) {
+    // neither present returns until both are in progress
+    mHal.setPresentBarrier(2);
+
+    mWriter.selectDisplay(kDisplay1);
+    mWriter.presentDisplay();
+    mWriter.selectDisplay(kDisplay2);
+    mWriter.presentDisplay();
+    std::map<Display, DisplayResults> results;
+    ASSERT_NO_FATAL_FAILURE(execute(&results));
+    EXPECT_TRUE(mHal.presentsMet());
+
+    // the fence of the second display has its handle index rebased in the output
+    ASSERT_EQ(2u, results.size());
+    EXPECT_NE(0u, results[kDisplay1].presentFenceInode);
+    EXPECT_EQ(mHal.getPresentFenceInode(kDisplay1), results[kDisplay1].presentFenceInode);
+    EXPECT_NE(0u, results[kDisplay2].presentFenceInode);
+    EXPECT_EQ(mHal.getPresentFenceInode(kDisplay2), results[kDisplay2].presentFenceInode);
+    EXPECT_TRUE(results[kDisplay1].errors.empty());
+    EXPECT_TRUE(results[kDisplay2].errors.empty());
+
+    // the displays keep their engines across calls
+    mHal.setPresentBarrier(2);
+    mWriter.selectDisplay(kDisplay2);
+    mWriter.presentDisplay();
+    mWriter.selectDisplay(kDisplay1);
+    mWriter.presentDisplay();
+    results.clear();
+    ASSERT_NO_FATAL_FAILURE(execute(&results));
+    EXPECT_TRUE(mHal.presentsMet());
+    EXPECT_EQ(mHal.getPresentFenceInode(kDisplay1), results[kDisplay1].presentFenceInode);
+    EXPECT_EQ(mHal.getPresentFenceInode(kDisplay2), results[kDisplay2].presentFenceInode);
+}
+
+TEST_F(ComposerClientTest, errorsPointIntoCommandStream) {
+    mHal.setPresentError(kDisplay2, Error::NO_RESOURCES);
+
+    mWriter.selectDisplay(kDisplay1);
+    mWriter.presentDisplay();
+    mWriter.selectDisplay(kDisplay2);
+    mWriter.presentDisplay();
+    std::map<Display, DisplayResults> results;
+    ASSERT_NO_FATAL_FAILURE(execute(&results));
+
+    // the second present follows two SELECT_DISPLAY and a PRESENT_DISPLAY
+    const uint32_t presentLoc = 2 * (1 + CommandWriterBase::kSelectDisplayLength) + 1 +
+                                CommandWriterBase::kPresentDisplayLength;
+    EXPECT_EQ(mHal.getPresentFenceInode(kDisplay1), results[kDisplay1].presentFenceInode);
+    ASSERT_EQ(1u, results[kDisplay2].errors.size());
+    EXPECT_EQ(presentLoc, results[kDisplay2].errors[0].first);
+    EXPECT_EQ(static_cast<int32_t>(Error::NO_RESOURCES), results[kDisplay2].errors[0].second);
+}
+
+TEST_F(ComposerClientTest, presentOrValidateValidatesWithoutOptIn) {
+    EXPECT_EQ(0, presentOrValidate(false));
+    EXPECT_EQ(0, presentOrValidate(false));
+    EXPECT_EQ(2u, mHal.getValidateCount());
+}
+
+TEST_F(ComposerClientTest, presentOrValidateReusesValidation) {
+    mHal.setPresentWithoutRevalidation(true);
+
+    EXPECT_EQ(0, presentOrValidate(false));
+    EXPECT_EQ(1u, mHal.getValidateCount());
+
+    // nothing changed, the composition of the last validation holds
+    EXPECT_EQ(1, presentOrValidate(false));
+    EXPECT_EQ(1u, mHal.getValidateCount());
+
+    // a new buffer may not fit the plane of the layer
+    EXPECT_EQ(0, presentOrValidate(true));
+    EXPECT_EQ(2u, mHal.getValidateCount());
+
+    EXPECT_EQ(1, presentOrValidate(false));
+    EXPECT_EQ(2u, mHal.getValidateCount());
+}
+
+}  // namespace hal
+}  // namespace V2_1
+}  // namespace composer
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
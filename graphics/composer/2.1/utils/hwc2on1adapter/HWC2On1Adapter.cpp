@@ -24,10 +24,18 @@
 
 
 #include <inttypes.h>
+#include <semaphore.h>
+#include <sys/prctl.h>
+#include <time.h>
 
+#include <array>
+#include <cerrno>
 #include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <sstream>
+#include <thread>
 
 #include <hardware/hwcomposer.h>
 #include <log/log.h>
@@ -54,6 +62,179 @@ static constexpr Attribute ColorMode = static_cast<Attribute>(6);
 
 namespace android {
 
+// Delivers HWC1 events to the HWC2 callbacks from a dedicated thread, so the
+// HWC1 event thread never waits on mStateMutex or on the client. Vsync and
+// invalidate are posted without taking a lock, and if the dispatcher falls
+// behind only the latest vsync timestamp of each display is delivered.
+// Hotplugs are rare and must never be dropped, so they are queued under a
+// small mutex that is only held to push or swap the queue.
+class HWC2On1Adapter::CallbackDispatcher {
+    public:
+        explicit CallbackDispatcher(HWC2On1Adapter& adapter)
+          : mAdapter(adapter) {
+            for (auto& vsync : mPendingVsyncs) {
+                vsync.store(NoVsync, std::memory_order_relaxed);
+            }
+            sem_init(&mWakeup, 0, 0);
+        }
+
+        ~CallbackDispatcher() {
+            stop();
+            sem_destroy(&mWakeup);
+        }
+
+        void start() {
+            mThread = std::thread(&CallbackDispatcher::dispatchLoop, this);
+        }
+
+        void stop() {
+            if (!mThread.joinable()) {
+                return;
+            }
+            mStopping.store(true, std::memory_order_release);
+            sem_post(&mWakeup);
+            mThread.join();
+        }
+
+        void postInvalidate() {
+            if (!mPendingInvalidate.exchange(true, std::memory_order_acq_rel)) {
+                sem_post(&mWakeup);
+            }
+        }
+
+        void postVsync(int hwc1DisplayId, int64_t timestamp) {
+            if (hwc1DisplayId < 0 || hwc1DisplayId >= HWC_NUM_DISPLAY_TYPES) {
+                ALOGE("postVsync: Invalid HWC1 display id %d", hwc1DisplayId);
+                return;
+            }
+            auto previous = mPendingVsyncs[hwc1DisplayId].exchange(timestamp,
+                    std::memory_order_acq_rel);
+            if (previous != NoVsync) {
+                // The dispatcher hasn't picked up the previous vsync yet, it
+                // will deliver this timestamp in its place
+                mCoalescedVsyncs.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            sem_post(&mWakeup);
+        }
+
+        void postHotplug(int hwc1DisplayId, int connected) {
+            {
+                std::lock_guard<std::mutex> lock(mHotplugMutex);
+                mPendingHotplugs.emplace_back(hwc1DisplayId, connected);
+            }
+            sem_post(&mWakeup);
+        }
+
+        std::string dump() const;
+
+    private:
+        static constexpr int64_t NoVsync = INT64_MIN;
+
+        static int64_t now();
+
+        void dispatchLoop();
+        void recordVsyncLatency(int64_t timestamp);
+
+        HWC2On1Adapter& mAdapter;
+        std::thread mThread;
+        sem_t mWakeup;
+        std::atomic<bool> mStopping{false};
+
+        std::atomic<bool> mPendingInvalidate{false};
+        std::array<std::atomic<int64_t>, HWC_NUM_DISPLAY_TYPES> mPendingVsyncs;
+
+        std::mutex mHotplugMutex;
+        std::deque<std::pair<int, int>> mPendingHotplugs;
+
+        // Vsync latency is the time between the HWC1 timestamp and the
+        // dispatch of the HWC2 callback. These are only written by the
+        // dispatcher thread, but may be read concurrently by dump
+        std::atomic<uint64_t> mDispatchedVsyncs{0};
+        std::atomic<uint64_t> mCoalescedVsyncs{0};
+        std::atomic<int64_t> mTotalVsyncLatency{0};
+        std::atomic<int64_t> mMinVsyncLatency{INT64_MAX};
+        std::atomic<int64_t> mMaxVsyncLatency{0};
+};
+
+int64_t HWC2On1Adapter::CallbackDispatcher::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return int64_t(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+void HWC2On1Adapter::CallbackDispatcher::dispatchLoop() {
+    prctl(PR_SET_NAME, "HWC2On1Events", 0, 0, 0);
+
+    while (true) {
+        if (sem_wait(&mWakeup) != 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("dispatchLoop: sem_wait failed: %s", strerror(errno));
+            return;
+        }
+
+        if (mStopping.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        std::deque<std::pair<int, int>> hotplugs;
+        {
+            std::lock_guard<std::mutex> lock(mHotplugMutex);
+            hotplugs.swap(mPendingHotplugs);
+        }
+        for (const auto& hotplug : hotplugs) {
+            mAdapter.hwc1Hotplug(hotplug.first, hotplug.second);
+        }
+
+        for (int hwc1Id = 0; hwc1Id < HWC_NUM_DISPLAY_TYPES; ++hwc1Id) {
+            auto timestamp = mPendingVsyncs[hwc1Id].exchange(NoVsync,
+                    std::memory_order_acq_rel);
+            if (timestamp == NoVsync) {
+                continue;
+            }
+            recordVsyncLatency(timestamp);
+            mAdapter.hwc1Vsync(hwc1Id, timestamp);
+        }
+
+        if (mPendingInvalidate.exchange(false, std::memory_order_acq_rel)) {
+            mAdapter.hwc1Invalidate();
+        }
+    }
+}
+
+void HWC2On1Adapter::CallbackDispatcher::recordVsyncLatency(int64_t timestamp) {
+    auto latency = now() - timestamp;
+    mDispatchedVsyncs.fetch_add(1, std::memory_order_relaxed);
+    mTotalVsyncLatency.fetch_add(latency, std::memory_order_relaxed);
+    if (latency < mMinVsyncLatency.load(std::memory_order_relaxed)) {
+        mMinVsyncLatency.store(latency, std::memory_order_relaxed);
+    }
+    if (latency > mMaxVsyncLatency.load(std::memory_order_relaxed)) {
+        mMaxVsyncLatency.store(latency, std::memory_order_relaxed);
+    }
+}
+
+std::string HWC2On1Adapter::CallbackDispatcher::dump() const {
+    std::stringstream output;
+
+    auto dispatched = mDispatchedVsyncs.load(std::memory_order_relaxed);
+    output << "Vsync dispatch: " << dispatched << " dispatched, " <<
+            mCoalescedVsyncs.load(std::memory_order_relaxed) << " coalesced\n";
+    if (dispatched != 0) {
+        auto total = mTotalVsyncLatency.load(std::memory_order_relaxed);
+        output << "  Latency (us): min " <<
+                mMinVsyncLatency.load(std::memory_order_relaxed) / 1000 <<
+                ", avg " << total / static_cast<int64_t>(dispatched) / 1000 <<
+                ", max " <<
+                mMaxVsyncLatency.load(std::memory_order_relaxed) / 1000 << '\n';
+    }
+
+    return output.str();
+}
+
 class HWC2On1Adapter::Callbacks : public hwc_procs_t {
     public:
         explicit Callbacks(HWC2On1Adapter& adapter) : mAdapter(adapter) {
@@ -64,19 +245,21 @@ class HWC2On1Adapter::Callbacks : public hwc_procs_t {
 
         static void invalidateHook(const hwc_procs_t* procs) {
             auto callbacks = static_cast<const Callbacks*>(procs);
-            callbacks->mAdapter.hwc1Invalidate();
+            callbacks->mAdapter.mCallbackDispatcher->postInvalidate();
         }
 
         static void vsyncHook(const hwc_procs_t* procs, int display,
                 int64_t timestamp) {
             auto callbacks = static_cast<const Callbacks*>(procs);
-            callbacks->mAdapter.hwc1Vsync(display, timestamp);
+            callbacks->mAdapter.mCallbackDispatcher->postVsync(display,
+                    timestamp);
         }
 
         static void hotplugHook(const hwc_procs_t* procs, int display,
                 int connected) {
             auto callbacks = static_cast<const Callbacks*>(procs);
-            callbacks->mAdapter.hwc1Hotplug(display, connected);
+            callbacks->mAdapter.mCallbackDispatcher->postHotplug(display,
+                    connected);
         }
 
     private:
@@ -97,6 +280,7 @@ HWC2On1Adapter::HWC2On1Adapter(hwc_composer_device_1_t* hwc1Device)
     mHwc1SupportsVirtualDisplays(false),
     mHwc1SupportsBackgroundColor(false),
     mHwc1Callbacks(std::make_unique<Callbacks>(*this)),
+    mCallbackDispatcher(std::make_unique<CallbackDispatcher>(*this)),
     mCapabilities(),
     mLayers(),
     mHwc1VirtualDisplay(),
@@ -113,11 +297,15 @@ HWC2On1Adapter::HWC2On1Adapter(hwc_composer_device_1_t* hwc1Device)
     getFunction = getFunctionHook;
     populateCapabilities();
     populatePrimary();
+    mCallbackDispatcher->start();
     mHwc1Device->registerProcs(mHwc1Device,
             static_cast<const hwc_procs_t*>(mHwc1Callbacks.get()));
 }
 
 HWC2On1Adapter::~HWC2On1Adapter() {
+    // Stop dispatching first, since dispatched hotplugs may call into HWC1.
+    // Events posted after this are simply dropped.
+    mCallbackDispatcher->stop();
     hwc_close_1(mHwc1Device);
 }
 
@@ -385,6 +573,8 @@ void HWC2On1Adapter::dump(uint32_t* outSize, char* outBuffer) {
     }
     output << '\n';
 
+    output << mCallbackDispatcher->dump() << '\n';
+
     // Release the lock before calling into HWC1, and since we no longer require
     // mutual exclusion to access mCapabilities or mDisplays
     lock.unlock();
@@ -526,8 +716,8 @@ HWC2On1Adapter::Display::Display(HWC2On1Adapter& device, HWC2::DisplayType type)
     mHasColorTransform(false),
     mLayers(),
     mHwc1LayerMap(),
-    mNumAvailableRects(0),
-    mNextAvailableRect(nullptr),
+    mHwc1ContentsCapacity(0),
+    mHwc1TargetVisibleRect(),
     mGeometryChanged(false)
     {}
 
@@ -1231,6 +1421,8 @@ bool HWC2On1Adapter::Display::prepare() {
         auto& hwc1Layer = mHwc1RequestedContents->hwLayers[layer->getHwc1Id()];
         hwc1Layer.releaseFenceFd = -1;
         hwc1Layer.acquireFenceFd = -1;
+        // HWC1 may have set hints in the previous prepare
+        hwc1Layer.hints = 0;
         ALOGV("Applying states for layer %" PRIu64 " ", layer->getId());
         layer->applyState(hwc1Layer);
     }
@@ -1558,24 +1750,6 @@ std::string HWC2On1Adapter::Display::dump() const {
     return output.str();
 }
 
-hwc_rect_t* HWC2On1Adapter::Display::GetRects(size_t numRects) {
-    if (numRects == 0) {
-        return nullptr;
-    }
-
-    if (numRects > mNumAvailableRects) {
-        // This should NEVER happen since we calculated how many rects the
-        // display would need.
-        ALOGE("Rect allocation failure! SF is likely to crash soon!");
-        return nullptr;
-
-    }
-    hwc_rect_t* rects = mNextAvailableRect;
-    mNextAvailableRect += numRects;
-    mNumAvailableRects -= numRects;
-    return rects;
-}
-
 hwc_display_contents_1* HWC2On1Adapter::Display::getDisplayContents() {
     return mHwc1RequestedContents.get();
 }
@@ -1784,33 +1958,24 @@ void HWC2On1Adapter::Display::allocateRequestedContents() {
     // What needs to be allocated:
     // 1 hwc_display_contents_1_t
     // 1 hwc_layer_1_t for each layer
-    // 1 hwc_rect_t for each layer's surfaceDamage
-    // 1 hwc_rect_t for each layer's visibleRegion
     // 1 hwc_layer_1_t for the framebuffer
-    // 1 hwc_rect_t for the framebuffer's visibleRegion
-
-    // Count # of surfaceDamage
-    size_t numSurfaceDamages = 0;
-    for (const auto& layer : mLayers) {
-        numSurfaceDamages += layer->getNumSurfaceDamages();
-    }
-
-    // Count # of visibleRegions (start at 1 for mandatory framebuffer target
-    // region)
-    size_t numVisibleRegion = 1;
-    for (const auto& layer : mLayers) {
-        numVisibleRegion += layer->getNumVisibleRegions();
+    // Regions are owned by the layers and the display.
+    auto numLayers = mLayers.size() + 1;
+    if (mHwc1RequestedContents && numLayers <= mHwc1ContentsCapacity) {
+        return;
     }
 
-    size_t numRects = numVisibleRegion + numSurfaceDamages;
-    auto numLayers = mLayers.size() + 1;
+    // Leave room for more layers to avoid reallocating each time one is added
+    size_t capacity = numLayers * 2;
     size_t size = sizeof(hwc_display_contents_1_t) +
-            sizeof(hwc_layer_1_t) * numLayers +
-            sizeof(hwc_rect_t) * numRects;
+            sizeof(hwc_layer_1_t) * capacity;
     auto contents = static_cast<hwc_display_contents_1_t*>(std::calloc(size, 1));
     mHwc1RequestedContents.reset(contents);
-    mNextAvailableRect = reinterpret_cast<hwc_rect_t*>(&contents->hwLayers[numLayers]);
-    mNumAvailableRects = numRects;
+    mHwc1ContentsCapacity = capacity;
+
+    for (auto& layer : mLayers) {
+        layer->markHwc1StateDirty();
+    }
 }
 
 void HWC2On1Adapter::Display::assignHwc1LayerIds() {
@@ -1887,12 +2052,8 @@ void HWC2On1Adapter::Display::prepareFramebufferTarget() {
     hwc1Target.planeAlpha = 255;
 
     hwc1Target.visibleRegionScreen.numRects = 1;
-    hwc_rect_t* rects = GetRects(1);
-    rects[0].left = 0;
-    rects[0].top = 0;
-    rects[0].right = width;
-    rects[0].bottom = height;
-    hwc1Target.visibleRegionScreen.rects = rects;
+    mHwc1TargetVisibleRect = {0, 0, width, height};
+    hwc1Target.visibleRegionScreen.rects = &mHwc1TargetVisibleRect;
 
     // We will set this to the correct value in set
     hwc1Target.acquireFenceFd = -1;
@@ -1919,7 +2080,9 @@ HWC2On1Adapter::Layer::Layer(Display& display)
     mZ(0),
     mReleaseFence(),
     mHwc1Id(0),
-    mHasUnsupportedPlaneAlpha(false) {}
+    mHasUnsupportedPlaneAlpha(false),
+    mHwc1StateDirty(true),
+    mHwc1VisibleRegion() {}
 
 bool HWC2On1Adapter::SortLayersByZ::operator()(const std::shared_ptr<Layer>& lhs,
                                                const std::shared_ptr<Layer>& rhs) const {
@@ -1963,18 +2126,21 @@ Error HWC2On1Adapter::Layer::setSurfaceDamage(hwc_region_t damage) {
 
 Error HWC2On1Adapter::Layer::setBlendMode(BlendMode mode) {
     mBlendMode = mode;
+    mHwc1StateDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setColor(hwc_color_t color) {
     mColor = color;
+    mHwc1StateDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setCompositionType(Composition type) {
     mCompositionType = type;
+    mHwc1StateDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
@@ -1985,30 +2151,35 @@ Error HWC2On1Adapter::Layer::setDataspace(android_dataspace_t) {
 
 Error HWC2On1Adapter::Layer::setDisplayFrame(hwc_rect_t frame) {
     mDisplayFrame = frame;
+    mHwc1StateDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setPlaneAlpha(float alpha) {
     mPlaneAlpha = alpha;
+    mHwc1StateDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setSidebandStream(const native_handle_t* stream) {
     mSidebandStream = stream;
+    mHwc1StateDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setSourceCrop(hwc_frect_t crop) {
     mSourceCrop = crop;
+    mHwc1StateDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setTransform(Transform transform) {
     mTransform = transform;
+    mHwc1StateDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
@@ -2026,6 +2197,7 @@ Error HWC2On1Adapter::Layer::setVisibleRegion(hwc_region_t visible) {
                     compareRects)) {
         mVisibleRegion.resize(visible.numRects);
         std::copy_n(visible.rects, visible.numRects, mVisibleRegion.begin());
+        mHwc1StateDirty = true;
         mDisplay.markGeometryChanged();
     }
     return Error::None;
@@ -2046,7 +2218,10 @@ const sp<MiniFence>& HWC2On1Adapter::Layer::getReleaseFence() const {
 }
 
 void HWC2On1Adapter::Layer::applyState(hwc_layer_1_t& hwc1Layer) {
-    applyCommonState(hwc1Layer);
+    if (mHwc1StateDirty) {
+        applyCommonState(hwc1Layer);
+        mHwc1StateDirty = false;
+    }
     applyCompositionType(hwc1Layer);
     switch (mCompositionType) {
         case Composition::SolidColor : applySolidColorState(hwc1Layer); break;
@@ -2152,12 +2327,10 @@ void HWC2On1Adapter::Layer::applyCommonState(hwc_layer_1_t& hwc1Layer) {
     hwc1Layer.transform = static_cast<uint32_t>(mTransform);
 
     auto& hwc1VisibleRegion = hwc1Layer.visibleRegionScreen;
-    hwc1VisibleRegion.numRects = mVisibleRegion.size();
-    hwc_rect_t* rects = mDisplay.GetRects(hwc1VisibleRegion.numRects);
-    hwc1VisibleRegion.rects = rects;
-    for (size_t i = 0; i < mVisibleRegion.size(); i++) {
-        rects[i] = mVisibleRegion[i];
-    }
+    mHwc1VisibleRegion.assign(mVisibleRegion.begin(), mVisibleRegion.end());
+    hwc1VisibleRegion.numRects = mHwc1VisibleRegion.size();
+    hwc1VisibleRegion.rects =
+            mHwc1VisibleRegion.empty() ? nullptr : mHwc1VisibleRegion.data();
 }
 
 void HWC2On1Adapter::Layer::applySolidColorState(hwc_layer_1_t& hwc1Layer) {
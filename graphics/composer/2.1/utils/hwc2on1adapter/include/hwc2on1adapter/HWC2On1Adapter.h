@@ -271,9 +271,6 @@ private:
 
             std::string dump() const;
 
-            // Return a rect from the pool allocated during validate()
-            hwc_rect_t* GetRects(size_t numRects);
-
             hwc_display_contents_1* getDisplayContents();
 
             void markGeometryChanged() { mGeometryChanged = true; }
@@ -408,13 +405,14 @@ private:
             // which require locking.
             mutable std::recursive_mutex mStateMutex;
 
-            // Allocate RAM able to store all layers and rects used for
-            // communication with HWC1. Place allocated RAM in variable
-            // mHwc1RequestedContents.
+            // Make sure mHwc1RequestedContents can store all layers used for
+            // communication with HWC1. It is only reallocated when it grows,
+            // in which case all layers are marked dirty.
             void allocateRequestedContents();
 
             // Array of structs exchanged between client and hwc1 device.
-            // Sent to device upon calling prepare().
+            // Sent to device upon calling prepare(). It persists across
+            // frames and only the state of dirty layers is written again.
             std::unique_ptr<hwc_display_contents_1> mHwc1RequestedContents;
     private:
             DeferredFence mRetireFence;
@@ -449,10 +447,11 @@ private:
             // passed to HWC1 during validate/set and Layer object.
             std::unordered_map<size_t, std::shared_ptr<Layer>> mHwc1LayerMap;
 
-            // All communication with HWC1 via prepare/set is done with one
-            // alloc. This pointer is pointing to a pool of hwc_rect_t.
-            size_t mNumAvailableRects;
-            hwc_rect_t* mNextAvailableRect;
+            // Number of hwc_layer_1_t mHwc1RequestedContents has room for.
+            size_t mHwc1ContentsCapacity;
+
+            // Visible region of the HWC1 HWC_FRAMEBUFFER_TARGET layer
+            hwc_rect_t mHwc1TargetVisibleRect;
 
             // True if any of the Layers contained in this Display have been
             // updated with anything other than a buffer since last call to
@@ -557,12 +556,22 @@ private:
             void addReleaseFence(int fenceFd);
             const sp<MiniFence>& getReleaseFence() const;
 
-            void setHwc1Id(size_t id) { mHwc1Id = id; }
+            void setHwc1Id(size_t id) {
+                if (id != mHwc1Id) {
+                    mHwc1StateDirty = true;
+                }
+                mHwc1Id = id;
+            }
             size_t getHwc1Id() const { return mHwc1Id; }
 
-            // Write state to HWC1 communication struct.
+            // Write state to HWC1 communication struct. Attributes which did
+            // not change since the last call are assumed to be still there.
             void applyState(struct hwc_layer_1& hwc1Layer);
 
+            // Forces applyState to write all attributes, e.g. because the
+            // HWC1 communication struct was reallocated.
+            void markHwc1StateDirty() { mHwc1StateDirty = true; }
+
             std::string dump() const;
 
             std::size_t getNumVisibleRegions() { return mVisibleRegion.size(); }
@@ -605,6 +614,14 @@ private:
 
             size_t mHwc1Id;
             bool mHasUnsupportedPlaneAlpha;
+
+            // True if attributes applied by applyCommonState changed since
+            // they were last applied.
+            bool mHwc1StateDirty;
+
+            // The visible region as last applied, pointed at by the HWC1
+            // layer. mVisibleRegion may change before the next prepare.
+            std::vector<hwc_rect_t> mHwc1VisibleRegion;
     };
 
     // Utility tempate calling a Layer object method based on ID parameters:
@@ -679,7 +696,7 @@ private:
     std::vector<struct hwc_display_contents_1*> mHwc1Contents;
     HWC2::Error setAllDisplays();
 
-    // Callbacks
+    // Callbacks, called on the CallbackDispatcher thread
     void hwc1Invalidate();
     void hwc1Vsync(int hwc1DisplayId, int64_t timestamp);
     void hwc1Hotplug(int hwc1DisplayId, int connected);
@@ -695,6 +712,10 @@ private:
     class Callbacks;
     const std::unique_ptr<Callbacks> mHwc1Callbacks;
 
+    // Runs the callbacks above on its own thread, see HWC2On1Adapter.cpp
+    class CallbackDispatcher;
+    const std::unique_ptr<CallbackDispatcher> mCallbackDispatcher;
+
     std::unordered_set<HWC2::Capability> mCapabilities;
 
     // These are only accessed from the main SurfaceFlinger thread (not from
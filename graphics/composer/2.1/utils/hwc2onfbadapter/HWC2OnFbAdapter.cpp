@@ -217,22 +217,23 @@ int32_t getClientTargetSupportHook(hwc2_device_t* device, hwc2_display_t display
 }
 
 int32_t setClientTargetHook(hwc2_device_t* device, hwc2_display_t display, buffer_handle_t target,
-                            int32_t acquireFence, int32_t dataspace, hwc_region_t /*damage*/) {
-    if (acquireFence >= 0) {
-        sync_wait(acquireFence, -1);
-        close(acquireFence);
-    }
-
+                            int32_t acquireFence, int32_t dataspace, hwc_region_t damage) {
     auto& adapter = HWC2OnFbAdapter::cast(device);
+    int32_t error = HWC2_ERROR_NONE;
     if (adapter.getDisplayId() != display) {
-        return HWC2_ERROR_BAD_DISPLAY;
+        error = HWC2_ERROR_BAD_DISPLAY;
+    } else if (dataspace != HAL_DATASPACE_UNKNOWN) {
+        error = HWC2_ERROR_BAD_PARAMETER;
     }
-    if (dataspace != HAL_DATASPACE_UNKNOWN) {
-        return HWC2_ERROR_BAD_PARAMETER;
+    if (error != HWC2_ERROR_NONE) {
+        if (acquireFence >= 0) {
+            close(acquireFence);
+        }
+        return error;
     }
 
-    // no state change
-    adapter.setBuffer(target);
+    // no state change, the adapter takes ownership of acquireFence
+    adapter.setBuffer(target, acquireFence, damage);
     return HWC2_ERROR_NONE;
 }
 
@@ -663,7 +664,15 @@ HWC2OnFbAdapter::HWC2OnFbAdapter(framebuffer_device_t* fbDevice)
     // for FB devices
     mCapabilities.insert(Capability::PresentFenceIsNotReliable);
 
+    mAsyncPost = mFbDevice->numFramebuffers >= 3;
+    mPartialUpdate = mFbDevice->setUpdateRect != nullptr;
+    ALOGI("async post %s, partial update %s", mAsyncPost ? "enabled" : "disabled",
+          mPartialUpdate ? "enabled" : "disabled");
+
     mVsyncThread.start(0, mFbInfo.vsync_period_ns);
+    if (mAsyncPost) {
+        mPostThread.start(mFbDevice);
+    }
 }
 
 HWC2OnFbAdapter& HWC2OnFbAdapter::cast(hw_device_t* device) {
@@ -684,6 +693,13 @@ hwc2_config_t HWC2OnFbAdapter::getConfigId() {
 
 void HWC2OnFbAdapter::close() {
     mVsyncThread.stop();
+    if (mAsyncPost) {
+        mPostThread.stop();
+    }
+    if (mFrame.acquireFence >= 0) {
+        ::close(mFrame.acquireFence);
+        mFrame.acquireFence = -1;
+    }
     framebuffer_close(mFbDevice);
 }
 
@@ -761,7 +777,8 @@ void HWC2OnFbAdapter::clearDirtyLayers() {
  *  - calls setClientTarget, which maps to setBuffer below
  *  - calls presentDisplay, which maps to postBuffer below
  *
- * setBuffer should be a good place to call compositionComplete.
+ * Once the acquire fence of the client target has signaled is a good place
+ * to call compositionComplete.
  *
  * As for post, it
  *
@@ -773,20 +790,69 @@ void HWC2OnFbAdapter::clearDirtyLayers() {
  * SurfaceFlinger assumes the front buffer is available for rendering again
  * immediately after the back buffer is posted.  The locking semantics
  * hopefully are strong enough that the rendering will be blocked.
+ *
+ * When we are at least triple-buffered, the fence wait and the post are
+ * done on PostThread instead, and presentDisplay only waits for the
+ * previous frame to be posted.  The buffer released when setClientTarget is
+ * called is then never rendered to before its post has completed, which is
+ * the guarantee a release fence would otherwise provide.
  */
-void HWC2OnFbAdapter::setBuffer(buffer_handle_t buffer) {
-    if (mFbDevice->compositionComplete) {
-        mFbDevice->compositionComplete(mFbDevice);
+void HWC2OnFbAdapter::setBuffer(buffer_handle_t buffer, int acquireFence,
+                                const hwc_region_t& damage) {
+    if (mFrame.acquireFence >= 0) {
+        ::close(mFrame.acquireFence);
+    }
+    mFrame.buffer = buffer;
+    mFrame.acquireFence = acquireFence;
+
+    // an empty damage region means the whole buffer has changed
+    mFrame.hasUpdateRect = mPartialUpdate && damage.numRects > 0;
+    if (mFrame.hasUpdateRect) {
+        hwc_rect_t bounds = damage.rects[0];
+        for (size_t i = 1; i < damage.numRects; i++) {
+            const hwc_rect_t& rect = damage.rects[i];
+            bounds.left = std::min(bounds.left, rect.left);
+            bounds.top = std::min(bounds.top, rect.top);
+            bounds.right = std::max(bounds.right, rect.right);
+            bounds.bottom = std::max(bounds.bottom, rect.bottom);
+        }
+        mFrame.updateRect = bounds;
     }
-    mBuffer = buffer;
 }
 
 bool HWC2OnFbAdapter::postBuffer() {
-    int error = 0;
-    if (mBuffer) {
-        error = mFbDevice->post(mFbDevice, mBuffer);
+    if (!mFrame.buffer) {
+        return true;
     }
 
+    Frame frame = mFrame;
+    // the fence is owned by the posted frame from now on, and a re-post of
+    // the same buffer updates the whole screen
+    mFrame.acquireFence = -1;
+    mFrame.hasUpdateRect = false;
+
+    return mAsyncPost ? mPostThread.queue(frame) : postFrame(mFbDevice, frame);
+}
+
+bool HWC2OnFbAdapter::postFrame(framebuffer_device_t* fbDevice, Frame frame) {
+    if (frame.acquireFence >= 0) {
+        sync_wait(frame.acquireFence, -1);
+        ::close(frame.acquireFence);
+    }
+    if (fbDevice->compositionComplete) {
+        fbDevice->compositionComplete(fbDevice);
+    }
+
+    if (frame.hasUpdateRect) {
+        const hwc_rect_t& rect = frame.updateRect;
+        int error = fbDevice->setUpdateRect(fbDevice, rect.left, rect.top,
+                                            rect.right - rect.left, rect.bottom - rect.top);
+        ALOGW_IF(error, "setUpdateRect failed: %d", error);
+    }
+
+    int error = fbDevice->post(fbDevice, frame.buffer);
+    ALOGW_IF(error, "post failed: %d", error);
+
     return error == 0;
 }
 
@@ -908,4 +974,67 @@ void HWC2OnFbAdapter::VsyncThread::vsyncLoop() {
     }
 }
 
+void HWC2OnFbAdapter::PostThread::start(framebuffer_device_t* fbDevice) {
+    mFbDevice = fbDevice;
+    mStarted = true;
+    mThread = std::thread(&PostThread::postLoop, this);
+}
+
+void HWC2OnFbAdapter::PostThread::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStarted = false;
+    }
+    mCondition.notify_all();
+    mThread.join();
+
+    if (mHasFrame && mFrame.acquireFence >= 0) {
+        ::close(mFrame.acquireFence);
+    }
+    mHasFrame = false;
+}
+
+bool HWC2OnFbAdapter::PostThread::queue(Frame frame) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [this] { return (!mHasFrame && !mPosting) || !mStarted; });
+    if (!mStarted) {
+        if (frame.acquireFence >= 0) {
+            ::close(frame.acquireFence);
+        }
+        return false;
+    }
+
+    mFrame = frame;
+    mHasFrame = true;
+    lock.unlock();
+    mCondition.notify_all();
+
+    // errors can only be reported one frame late
+    return mLastPostSucceeded;
+}
+
+void HWC2OnFbAdapter::PostThread::postLoop() {
+    prctl(PR_SET_NAME, "PostThread", 0, 0, 0);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mCondition.wait(lock, [this] { return mHasFrame || !mStarted; });
+        if (!mStarted) {
+            break;
+        }
+
+        Frame frame = mFrame;
+        mHasFrame = false;
+        mPosting = true;
+        lock.unlock();
+
+        bool succeeded = postFrame(mFbDevice, frame);
+
+        lock.lock();
+        mPosting = false;
+        mLastPostSucceeded = succeeded;
+        mCondition.notify_all();
+    }
+}
+
 } // namespace android
@@ -74,7 +74,7 @@ public:
     const std::unordered_set<hwc2_layer_t>& getDirtyLayers() const;
     void clearDirtyLayers();
 
-    void setBuffer(buffer_handle_t buffer);
+    void setBuffer(buffer_handle_t buffer, int acquireFence, const hwc_region_t& damage);
     bool postBuffer();
 
     void setVsyncCallback(HWC2_PFN_VSYNC callback, hwc2_callback_data_t data);
@@ -93,7 +93,21 @@ private:
     std::unordered_set<hwc2_layer_t> mLayers;
     std::unordered_set<hwc2_layer_t> mDirtyLayers;
 
-    buffer_handle_t mBuffer{nullptr};
+    // Frames are posted asynchronously when the device is at least triple
+    // buffered, and only the damaged rectangle is updated when the device
+    // supports setUpdateRect
+    bool mAsyncPost{false};
+    bool mPartialUpdate{false};
+
+    struct Frame {
+        buffer_handle_t buffer{nullptr};
+        int acquireFence{-1};
+        bool hasUpdateRect{false};
+        hwc_rect_t updateRect{};
+    };
+    Frame mFrame;
+
+    static bool postFrame(framebuffer_device_t* fbDevice, Frame frame);
 
     std::unordered_set<HWC2::Capability> mCapabilities;
 
@@ -123,6 +137,30 @@ private:
         bool mCallbackEnabled{false};
     };
     VsyncThread mVsyncThread;
+
+    class PostThread {
+    public:
+        void start(framebuffer_device_t* fbDevice);
+        void stop();
+        // Hands the frame over for posting.  This waits for the previously
+        // queued frame to be posted, so that at most one frame is in flight.
+        bool queue(Frame frame);
+
+    private:
+        void postLoop();
+
+        framebuffer_device_t* mFbDevice{nullptr};
+        std::thread mThread;
+
+        std::mutex mMutex;
+        std::condition_variable mCondition;
+        bool mStarted{false};
+        bool mHasFrame{false};
+        bool mPosting{false};
+        bool mLastPostSucceeded{true};
+        Frame mFrame;
+    };
+    PostThread mPostThread;
 };
 
 } // namespace android
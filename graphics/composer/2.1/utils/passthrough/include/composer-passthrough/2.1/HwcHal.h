@@ -342,13 +342,16 @@ class HwcHalImpl : public Hal {
             return static_cast<Error>(err);
         }
 
-        std::vector<Layer> changedLayers(typesCount);
-        std::vector<IComposerClient::Composition> compositionTypes(typesCount);
-        err = getChangedCompositionTypes(display, &typesCount, changedLayers.data(),
-                                         compositionTypes.data());
+        // fill the output vectors in place so that their storage is reused
+        outChangedLayers->resize(typesCount);
+        outCompositionTypes->resize(typesCount);
+        err = getChangedCompositionTypes(display, &typesCount, outChangedLayers->data(),
+                                         outCompositionTypes->data());
         if (err != HWC2_ERROR_NONE) {
             return static_cast<Error>(err);
         }
+        outChangedLayers->resize(typesCount);
+        outCompositionTypes->resize(typesCount);
 
         int32_t displayReqs = 0;
         err = mDispatch.getDisplayRequests(mDevice, display, &displayReqs, &reqsCount, nullptr,
@@ -357,20 +360,18 @@ class HwcHalImpl : public Hal {
             return static_cast<Error>(err);
         }
 
-        std::vector<Layer> requestedLayers(reqsCount);
-        std::vector<uint32_t> requestMasks(reqsCount);
+        outRequestedLayers->resize(reqsCount);
+        outRequestMasks->resize(reqsCount);
         err = mDispatch.getDisplayRequests(mDevice, display, &displayReqs, &reqsCount,
-                                           requestedLayers.data(),
-                                           reinterpret_cast<int32_t*>(requestMasks.data()));
+                                           outRequestedLayers->data(),
+                                           reinterpret_cast<int32_t*>(outRequestMasks->data()));
         if (err != HWC2_ERROR_NONE) {
             return static_cast<Error>(err);
         }
+        outRequestedLayers->resize(reqsCount);
+        outRequestMasks->resize(reqsCount);
 
-        *outChangedLayers = std::move(changedLayers);
-        *outCompositionTypes = std::move(compositionTypes);
         *outDisplayRequestMask = displayReqs;
-        *outRequestedLayers = std::move(requestedLayers);
-        *outRequestMasks = std::move(requestMasks);
 
         return static_cast<Error>(err);
     }
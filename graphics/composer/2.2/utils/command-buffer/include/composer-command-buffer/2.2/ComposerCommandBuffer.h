@@ -76,6 +76,8 @@ class CommandWriterBase : public V2_1::CommandWriterBase {
 
     static constexpr uint16_t kSetLayerFloatColorLength = 4;
     void setLayerFloatColor(IComposerClient::FloatColor color) {
+        // the color set through setLayerColor is replaced as well
+        invalidateSelectedLayerState();
         beginCommand_2_2(IComposerClient::Command::SET_LAYER_FLOAT_COLOR,
                          kSetLayerFloatColorLength);
         writeFloatColor(color);
@@ -67,8 +67,15 @@ class ComposerClientImpl : public V2_1::hal::detail::ComposerClientImpl<Interfac
 
     Return<void> getReadbackBufferFence(
         Display display, IComposerClient::getReadbackBufferFence_cb hidl_cb) override {
+        // Prefer the fence collected right after the present that read back
         base::unique_fd fenceFd;
-        Error error = mHal->getReadbackBufferFence(display, &fenceFd);
+        bool collected = false;
+        auto resources = static_cast<ComposerResources*>(mResources.get());
+        resources->updateDisplayReadbackTracker(
+            display, [&](ComposerReadbackTracker& tracker) {
+                collected = tracker.getFence(&fenceFd);
+            });
+        Error error = collected ? Error::NONE : mHal->getReadbackBufferFence(display, &fenceFd);
         if (error != Error::NONE) {
             hidl_cb(error, nullptr);
             return Void();
@@ -96,7 +103,12 @@ class ComposerClientImpl : public V2_1::hal::detail::ComposerClientImpl<Interfac
             return error;
         }
 
-        return mHal->setReadbackBuffer(display, readbackBuffer, std::move(fenceFd));
+        error = mHal->setReadbackBuffer(display, readbackBuffer, std::move(fenceFd));
+        resources->updateDisplayReadbackTracker(
+            display, [&](ComposerReadbackTracker& tracker) {
+                tracker.setBuffer(error == Error::NONE);
+            });
+        return error;
     }
 
     Return<void> createVirtualDisplay_2_2(
@@ -119,7 +131,11 @@ class ComposerClientImpl : public V2_1::hal::detail::ComposerClientImpl<Interfac
     }
 
     Return<Error> setPowerMode_2_2(Display display, IComposerClient::PowerMode mode) override {
-        return mHal->setPowerMode_2_2(display, mode);
+        Error err = mHal->setPowerMode_2_2(display, mode);
+        if (err == Error::NONE) {
+            mResources->setDisplayMustValidateState(display, true);
+        }
+        return err;
     }
 
     Return<void> getColorModes_2_2(Display display,
@@ -139,7 +155,11 @@ class ComposerClientImpl : public V2_1::hal::detail::ComposerClientImpl<Interfac
     }
 
     Return<Error> setColorMode_2_2(Display display, ColorMode mode, RenderIntent intent) override {
-        return mHal->setColorMode_2_2(display, mode, intent);
+        Error err = mHal->setColorMode_2_2(display, mode, intent);
+        if (err == Error::NONE) {
+            mResources->setDisplayMustValidateState(display, true);
+        }
+        return err;
     }
 
     Return<void> getDataspaceSaturationMatrix(
@@ -155,16 +175,21 @@ class ComposerClientImpl : public V2_1::hal::detail::ComposerClientImpl<Interfac
 
     Return<void> executeCommands_2_2(uint32_t inLength, const hidl_vec<hidl_handle>& inHandles,
                                      IComposerClient::executeCommands_2_2_cb hidl_cb) override {
-        std::lock_guard<std::mutex> lock(mCommandEngineMutex);
-        bool outChanged = false;
-        uint32_t outLength = 0;
-        hidl_vec<hidl_handle> outHandles;
-        Error error =
-            mCommandEngine->execute(inLength, inHandles, &outChanged, &outLength, &outHandles);
+        {
+            std::lock_guard<std::mutex> lock(mCommandEngineMutex);
+            bool outChanged = false;
+            uint32_t outLength = 0;
+            hidl_vec<hidl_handle> outHandles;
+            Error error =
+                executeCommandsLocked(inLength, inHandles, &outChanged, &outLength, &outHandles);
 
-        hidl_cb(error, outChanged, outLength, outHandles);
+            hidl_cb(error, outChanged, outLength, outHandles);
+
+            mCommandEngine->reset();
+        }
 
-        mCommandEngine->reset();
+        // the reply has been sent, free the handles replaced by the commands
+        mResources->freeDeferredHandles();
 
         return Void();
     }
@@ -214,6 +239,7 @@ class ComposerClientImpl : public V2_1::hal::detail::ComposerClientImpl<Interfac
     using BaseType2_1 = V2_1::hal::detail::ComposerClientImpl<Interface, Hal>;
     using BaseType2_1::mCommandEngine;
     using BaseType2_1::mCommandEngineMutex;
+    using BaseType2_1::executeCommandsLocked;
     using BaseType2_1::mHal;
     using BaseType2_1::mResources;
 };
@@ -76,6 +76,9 @@ class ComposerCommandEngine : public V2_1::hal::ComposerCommandEngine {
             return false;
         }
 
+        // the color set through SET_LAYER_COLOR is replaced as well
+        getCurrentLayerState()->color.invalidate();
+
         auto err = mHal->setLayerFloatColor(mCurrentDisplay, mCurrentLayer, readFloatColor());
         if (err != Error::NONE) {
             mWriter.setError(getCommandLoc(), err);
@@ -84,6 +87,28 @@ class ComposerCommandEngine : public V2_1::hal::ComposerCommandEngine {
         return true;
     }
 
+    // collects the fence of a readback right after the present that read back
+    Error presentCurrentDisplay(int32_t* outPresentFence) override {
+        auto err = BaseType2_1::presentCurrentDisplay(outPresentFence);
+
+        auto resources = static_cast<ComposerResources*>(mResources);
+        bool collectFence = false;
+        resources->updateDisplayReadbackTracker(
+            mCurrentDisplay, [&](ComposerReadbackTracker& tracker) {
+                collectFence = tracker.finishPresent(err == Error::NONE);
+            });
+        base::unique_fd readbackFence;
+        if (collectFence &&
+            mHal->getReadbackBufferFence(mCurrentDisplay, &readbackFence) == Error::NONE) {
+            resources->updateDisplayReadbackTracker(
+                mCurrentDisplay, [&](ComposerReadbackTracker& tracker) {
+                    tracker.setFence(std::move(readbackFence));
+                });
+        }
+
+        return err;
+    }
+
     IComposerClient::FloatColor readFloatColor() {
         return IComposerClient::FloatColor{readFloat(), readFloat(), readFloat(), readFloat()};
     }
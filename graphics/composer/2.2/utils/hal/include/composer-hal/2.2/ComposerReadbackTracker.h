@@ -0,0 +1,83 @@
+/*
+ * Copyright 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <unistd.h>
+
+#include <utility>
+
+#include <android-base/unique_fd.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace composer {
+namespace V2_2 {
+namespace hal {
+
+// ComposerReadbackTracker collects the readback fence of one display right after the present
+// that read back, so getReadbackBufferFence does not call into the HAL, and a later
+// setReadbackBuffer does not lose it.
+//
+// It only does the bookkeeping; the caller makes the HAL calls outside of the display lock that
+// guards it.
+class ComposerReadbackTracker {
+   public:
+    // Called when the client sets a readback buffer, with whether the HAL accepted it for the
+    // next present. The fence of the previous readback is dropped either way.
+    void setBuffer(bool accepted) {
+        mArmed = accepted;
+        mHasFence = false;
+        mFence.reset();
+    }
+
+    // Called after each present. Returns true when the readback fence is to be collected.
+    bool finishPresent(bool presented) {
+        // A present that failed, e.g. to skip validation, leaves the readback to the next one
+        if (!mArmed || !presented) {
+            return false;
+        }
+        mArmed = false;
+        return true;
+    }
+
+    void setFence(base::unique_fd fence) {
+        mFence = std::move(fence);
+        mHasFence = true;
+    }
+
+    // Returns false if no readback completed since the last buffer was set.
+    bool getFence(base::unique_fd* outFence) const {
+        if (!mHasFence) {
+            return false;
+        }
+        outFence->reset(mFence >= 0 ? dup(mFence) : -1);
+        return true;
+    }
+
+   private:
+    bool mArmed = false;
+    bool mHasFence = false;
+    base::unique_fd mFence;
+};
+
+}  // namespace hal
+}  // namespace V2_2
+}  // namespace composer
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
@@ -20,7 +20,10 @@
 #warning "ComposerResources.h included without LOG_TAG"
 #endif
 
+#include <functional>
+
 #include <composer-hal/2.1/ComposerResources.h>
+#include <composer-hal/2.2/ComposerReadbackTracker.h>
 
 namespace android {
 namespace hardware {
@@ -34,21 +37,32 @@ using V2_1::hal::ComposerHandleImporter;
 
 class ComposerDisplayResource : public V2_1::hal::ComposerDisplayResource {
    public:
+    // Enough for a client rotating through triple buffered readbacks
+    static constexpr uint32_t kReadbackBufferSlotCount = 3;
+
     ComposerDisplayResource(DisplayType type, ComposerHandleImporter& importer,
                             uint32_t outputBufferCacheSize)
         : V2_1::hal::ComposerDisplayResource(type, importer, outputBufferCacheSize),
-          mReadbackBufferCache(importer, ComposerHandleCache::HandleType::BUFFER, 1) {}
+          mReadbackBufferCache(importer, ComposerHandleCache::HandleType::BUFFER,
+                               kReadbackBufferSlotCount) {}
 
     Error getReadbackBuffer(const native_handle_t* inHandle, const native_handle_t** outHandle,
                             const native_handle** outReplacedHandle) {
-        const uint32_t slot = 0;
+        // Rotate through the slots, so that setting the next buffer does not free the previous
+        // ones while the HAL may still be reading back into them
+        const uint32_t slot = mNextReadbackSlot;
+        mNextReadbackSlot = (mNextReadbackSlot + 1) % kReadbackBufferSlotCount;
         const bool fromCache = false;
         return mReadbackBufferCache.getHandle(slot, fromCache, inHandle, outHandle,
                                               outReplacedHandle);
     }
 
+    ComposerReadbackTracker& getReadbackTracker() { return mReadbackTracker; }
+
    protected:
     ComposerHandleCache mReadbackBufferCache;
+    uint32_t mNextReadbackSlot = 0;
+    ComposerReadbackTracker mReadbackTracker;
 };
 
 class ComposerResources : public V2_1::hal::ComposerResources {
@@ -68,7 +82,7 @@ class ComposerResources : public V2_1::hal::ComposerResources {
             return error;
         }
 
-        std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+        std::shared_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
 
         auto iter = mDisplayResources.find(display);
         if (iter == mDisplayResources.end()) {
@@ -77,6 +91,7 @@ class ComposerResources : public V2_1::hal::ComposerResources {
         }
         ComposerDisplayResource& displayResource =
             *static_cast<ComposerDisplayResource*>(iter->second.get());
+        auto displayLock = displayResource.lock();
 
         // update cache
         const native_handle_t* replacedHandle;
@@ -86,7 +101,22 @@ class ComposerResources : public V2_1::hal::ComposerResources {
             return error;
         }
 
-        outReplacedHandle->reset(&mImporter, replacedHandle);
+        outReplacedHandle->reset(this, replacedHandle);
+        return Error::NONE;
+    }
+
+    // Runs func on the readback tracker of the display, under the display lock
+    Error updateDisplayReadbackTracker(
+        Display display, const std::function<void(ComposerReadbackTracker&)>& func) {
+        std::shared_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
+
+        auto* displayResource =
+            static_cast<ComposerDisplayResource*>(findDisplayResourceLocked(display));
+        if (!displayResource) {
+            return Error::BAD_DISPLAY;
+        }
+        auto displayLock = displayResource->lock();
+        func(displayResource->getReadbackTracker());
         return Error::NONE;
     }
 
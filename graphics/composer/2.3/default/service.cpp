@@ -16,6 +16,9 @@
 
 #include <sched.h>
 
+#include <chrono>
+
+#include <android-base/properties.h>
 #include <android/hardware/graphics/composer/2.3/IComposer.h>
 #include <binder/ProcessState.h>
 #include <composer-passthrough/2.3/HwcLoader.h>
@@ -39,7 +42,13 @@ int main() {
 
     android::hardware::configureRpcThreadpool(4, true /* will join */);
 
-    android::sp<IComposer> composer = HwcLoader::load();
+    // Devices whose clients poll getDisplayedContentSample often can let the service answer
+    // from histograms read at most once per this many milliseconds. Answers may then be up
+    // to one interval old, so it is off by default.
+    auto contentSamplePollInterval = std::chrono::milliseconds(android::base::GetUintProperty<
+            uint32_t>("ro.vendor.hwc.content_sample_poll_interval_ms", 0));
+
+    android::sp<IComposer> composer = HwcLoader::load(contentSamplePollInterval);
     if (composer == nullptr) {
         return 1;
     }
@@ -20,6 +20,8 @@
 #warning "Composer.h included without LOG_TAG"
 #endif
 
+#include <chrono>
+
 #include <android/hardware/graphics/composer/2.3/IComposer.h>
 #include <composer-hal/2.2/Composer.h>
 #include <composer-hal/2.3/ComposerClient.h>
@@ -60,12 +62,20 @@ class ComposerImpl : public V2_2::hal::detail::ComposerImpl<Interface, Hal> {
 
         auto clientDestroyed = [this]() { onClientDestroyed(); };
         client->setOnClientDestroyed(clientDestroyed);
+        client->setContentSamplePollInterval(mContentSamplePollInterval);
 
         mClient = client;
         hidl_cb(Error::NONE, client);
         return Void();
     }
 
+    // Not part of IComposer. Applied to clients created afterwards, see
+    // ComposerClientImpl::setContentSamplePollInterval.
+    void setContentSamplePollInterval(std::chrono::nanoseconds interval) {
+        std::lock_guard<std::mutex> lock(mClientMutex);
+        mContentSamplePollInterval = interval;
+    }
+
    private:
     using BaseType2_2 = V2_2::hal::detail::ComposerImpl<Interface, Hal>;
     using BaseType2_1 = V2_1::hal::detail::ComposerImpl<Interface, Hal>;
@@ -75,6 +85,8 @@ class ComposerImpl : public V2_2::hal::detail::ComposerImpl<Interface, Hal> {
     using BaseType2_1::mHal;
     using BaseType2_1::onClientDestroyed;
     using BaseType2_1::waitForClientDestroyedLocked;
+
+    std::chrono::nanoseconds mContentSamplePollInterval{0};
 };
 
 }  // namespace detail
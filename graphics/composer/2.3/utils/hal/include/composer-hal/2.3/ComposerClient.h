@@ -23,6 +23,7 @@
 #include <android/hardware/graphics/composer/2.3/IComposerClient.h>
 #include <composer-hal/2.2/ComposerResources.h>
 #include <composer-hal/2.3/ComposerCommandEngine.h>
+#include <composer-hal/2.3/ComposerContentSampler.h>
 #include <composer-hal/2.3/ComposerHal.h>
 
 namespace android {
@@ -47,7 +48,11 @@ class ComposerClientImpl : public V2_2::hal::detail::ComposerClientImpl<Interfac
     }
 
     Return<Error> setColorMode_2_3(Display display, ColorMode mode, RenderIntent intent) override {
-        return mHal->setColorMode_2_3(display, mode, intent);
+        Error err = mHal->setColorMode_2_3(display, mode, intent);
+        if (err == Error::NONE) {
+            mResources->setDisplayMustValidateState(display, true);
+        }
+        return err;
     }
 
     Return<void> getRenderIntents_2_3(Display display, ColorMode mode,
@@ -135,38 +140,47 @@ class ComposerClientImpl : public V2_2::hal::detail::ComposerClientImpl<Interfac
         uint64_t display, IComposerClient::DisplayedContentSampling enable,
         hidl_bitfield<IComposerClient::FormatColorComponent> componentMask,
         uint64_t maxFrames) override {
-        return mHal->setDisplayedContentSamplingEnabled(display, enable, componentMask, maxFrames);
+        Error error =
+            mHal->setDisplayedContentSamplingEnabled(display, enable, componentMask, maxFrames);
+        if (error == Error::NONE) {
+            mContentSampler.resetDisplay(display);
+        }
+        return error;
     }
 
     Return<void> getDisplayedContentSample(
         uint64_t display, uint64_t maxFrames, uint64_t timestamp,
         IComposerClient::getDisplayedContentSample_cb hidl_cb) override {
-        uint64_t frameCount;
-        hidl_vec<uint64_t> sampleComponent0;
-        hidl_vec<uint64_t> sampleComponent1;
-        hidl_vec<uint64_t> sampleComponent2;
-        hidl_vec<uint64_t> sampleComponent3;
-
-        Error error = mHal->getDisplayedContentSample(display, maxFrames, timestamp, frameCount,
-                                                      sampleComponent0, sampleComponent1,
-                                                      sampleComponent2, sampleComponent3);
-        hidl_cb(error, frameCount, sampleComponent0, sampleComponent1, sampleComponent2,
-                sampleComponent3);
+        ComposerContentSampler::Sample sample;
+        Error error = mContentSampler.getSample(mHal, display, maxFrames, timestamp, &sample);
+        hidl_cb(error, sample.frameCount, sample.components[0], sample.components[1],
+                sample.components[2], sample.components[3]);
         return Void();
     }
 
+    // Not part of IComposerClient. Lets a composer service answer getDisplayedContentSample
+    // from histograms polled at most once per interval; zero, the default, always asks the HAL.
+    void setContentSamplePollInterval(std::chrono::nanoseconds interval) {
+        mContentSampler.setPollInterval(interval);
+    }
+
     Return<void> executeCommands_2_3(uint32_t inLength, const hidl_vec<hidl_handle>& inHandles,
                                      IComposerClient::executeCommands_2_2_cb hidl_cb) override {
-        std::lock_guard<std::mutex> lock(mCommandEngineMutex);
-        bool outChanged = false;
-        uint32_t outLength = 0;
-        hidl_vec<hidl_handle> outHandles;
-        Error error =
-            mCommandEngine->execute(inLength, inHandles, &outChanged, &outLength, &outHandles);
+        {
+            std::lock_guard<std::mutex> lock(mCommandEngineMutex);
+            bool outChanged = false;
+            uint32_t outLength = 0;
+            hidl_vec<hidl_handle> outHandles;
+            Error error =
+                executeCommandsLocked(inLength, inHandles, &outChanged, &outLength, &outHandles);
+
+            hidl_cb(error, outChanged, outLength, outHandles);
 
-        hidl_cb(error, outChanged, outLength, outHandles);
+            mCommandEngine->reset();
+        }
 
-        mCommandEngine->reset();
+        // the reply has been sent, free the handles replaced by the commands
+        mResources->freeDeferredHandles();
 
         return Void();
     }
@@ -190,10 +204,13 @@ class ComposerClientImpl : public V2_2::hal::detail::ComposerClientImpl<Interfac
     }
 
    private:
+    ComposerContentSampler mContentSampler;
+
     using BaseType2_2 = V2_2::hal::detail::ComposerClientImpl<Interface, Hal>;
     using BaseType2_1 = V2_1::hal::detail::ComposerClientImpl<Interface, Hal>;
     using BaseType2_1::mCommandEngine;
     using BaseType2_1::mCommandEngineMutex;
+    using BaseType2_1::executeCommandsLocked;
     using BaseType2_1::mHal;
     using BaseType2_1::mResources;
 };
@@ -0,0 +1,183 @@
+/*
+ * Copyright 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <composer-hal/2.3/ComposerHal.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace composer {
+namespace V2_3 {
+namespace hal {
+
+// ComposerContentSampler serves getDisplayedContentSample from histograms polled from the HAL
+// at a low rate, so that services querying frequently do not each force a full readout.
+//
+// Each poll only asks the HAL for the frames posted since the previous one and adds them to a
+// cumulative histogram. The cumulative histograms of the latest polls are kept, and a query
+// whose timestamp falls within them is answered with the difference between the newest one
+// and the newest one polled at or before the timestamp. A client passing the time of its
+// previous query as the timestamp therefore gets every frame exactly once.
+//
+// Queries limited by maxFrames, or reaching back before the retained polls, go to the HAL.
+// Sampling is off until a poll interval is set, as answers are up to one interval old.
+class ComposerContentSampler {
+   public:
+    static constexpr size_t kMaxPolls = 16;
+    static constexpr size_t kComponentCount = 4;
+
+    struct Sample {
+        uint64_t frameCount = 0;
+        hidl_vec<uint64_t> components[kComponentCount];
+    };
+
+    void setPollInterval(std::chrono::nanoseconds interval) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPollInterval = interval;
+        mDisplays.clear();
+    }
+
+    // Drops what was collected for the display, e.g. when its sampling is reconfigured.
+    void resetDisplay(Display display) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mDisplays.erase(display);
+    }
+
+    Error getSample(ComposerHal* hal, Display display, uint64_t maxFrames, uint64_t timestamp,
+                    Sample* outSample) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mPollInterval.count() <= 0 || maxFrames != 0) {
+            lock.unlock();
+            return getHalSample(hal, display, maxFrames, timestamp, outSample);
+        }
+
+        // Polls are serialized under the lock; concurrent queries want the same fresh data
+        std::deque<Poll>& polls = mDisplays[display];
+        const uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now().time_since_epoch())
+                                 .count();
+        if (polls.empty() || now - polls.back().timestamp >= uint64_t(mPollInterval.count())) {
+            Error error = poll(hal, display, now, &polls);
+            if (error != Error::NONE) {
+                return error;
+            }
+        }
+
+        // The first poll holds everything the HAL accumulated before it, so it cannot be split
+        const Poll* base = nullptr;
+        if (timestamp != 0) {
+            for (auto it = polls.rbegin(); it != polls.rend() && !base; ++it) {
+                if (it->timestamp <= timestamp) {
+                    base = &*it;
+                }
+            }
+            if (!base) {
+                lock.unlock();
+                return getHalSample(hal, display, maxFrames, timestamp, outSample);
+            }
+        }
+
+        const Poll& latest = polls.back();
+        outSample->frameCount = latest.frameCount - (base ? base->frameCount : 0);
+        size_t offset = 0;
+        for (size_t i = 0; i < kComponentCount; i++) {
+            hidl_vec<uint64_t>& component = outSample->components[i];
+            component.resize(latest.bucketCounts[i]);
+            for (size_t j = 0; j < component.size(); j++) {
+                component[j] = latest.counts[offset + j] - (base ? base->counts[offset + j] : 0);
+            }
+            offset += component.size();
+        }
+        return Error::NONE;
+    }
+
+   private:
+    // The cumulative histograms as of one poll, all components in one array
+    struct Poll {
+        uint64_t timestamp;
+        uint64_t frameCount;
+        size_t bucketCounts[kComponentCount];
+        std::vector<uint64_t> counts;
+    };
+
+    static Error getHalSample(ComposerHal* hal, Display display, uint64_t maxFrames,
+                              uint64_t timestamp, Sample* outSample) {
+        return hal->getDisplayedContentSample(
+            display, maxFrames, timestamp, outSample->frameCount, outSample->components[0],
+            outSample->components[1], outSample->components[2], outSample->components[3]);
+    }
+
+    // Frames posted while the HAL is being polled may be counted by two polls; the window is
+    // the duration of one HAL call and only matters for the rare frame landing in it.
+    static Error poll(ComposerHal* hal, Display display, uint64_t now, std::deque<Poll>* polls) {
+        Sample delta;
+        const uint64_t since = polls->empty() ? 0 : polls->back().timestamp;
+        Error error = getHalSample(hal, display, 0, since, &delta);
+        if (error != Error::NONE) {
+            return error;
+        }
+
+        Poll next;
+        if (!polls->empty()) {
+            next = polls->back();
+        } else {
+            next.frameCount = 0;
+            for (size_t i = 0; i < kComponentCount; i++) {
+                next.bucketCounts[i] = delta.components[i].size();
+                next.counts.resize(next.counts.size() + delta.components[i].size(), 0);
+            }
+        }
+        next.timestamp = now;
+        next.frameCount += delta.frameCount;
+        size_t offset = 0;
+        for (size_t i = 0; i < kComponentCount; i++) {
+            if (delta.components[i].size() != next.bucketCounts[i]) {
+                // The HAL changed its buckets, start over
+                polls->clear();
+                return poll(hal, display, now, polls);
+            }
+            for (size_t j = 0; j < delta.components[i].size(); j++) {
+                next.counts[offset + j] += delta.components[i][j];
+            }
+            offset += next.bucketCounts[i];
+        }
+
+        if (polls->size() == kMaxPolls) {
+            polls->pop_front();
+        }
+        polls->push_back(std::move(next));
+        return Error::NONE;
+    }
+
+    std::mutex mMutex;
+    std::chrono::nanoseconds mPollInterval{0};
+    std::unordered_map<Display, std::deque<Poll>> mDisplays;
+};
+
+}  // namespace hal
+}  // namespace V2_3
+}  // namespace composer
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
@@ -20,6 +20,8 @@
 #warning "HwcLoader.h included without LOG_TAG"
 #endif
 
+#include <chrono>
+
 #include <composer-hal/2.3/Composer.h>
 #include <composer-hal/2.3/ComposerHal.h>
 #include <composer-passthrough/2.2/HwcLoader.h>
@@ -34,7 +36,8 @@ namespace passthrough {
 
 class HwcLoader : public V2_2::passthrough::HwcLoader {
    public:
-    static IComposer* load() {
+    // contentSamplePollInterval is passed to Composer::setContentSamplePollInterval
+    static IComposer* load(std::chrono::nanoseconds contentSamplePollInterval = {}) {
         const hw_module_t* module = loadModule();
         if (!module) {
             return nullptr;
@@ -45,7 +48,9 @@ class HwcLoader : public V2_2::passthrough::HwcLoader {
             return nullptr;
         }
 
-        return createComposer(std::move(hal)).release();
+        auto composer = hal::Composer::create(std::move(hal));
+        composer->setContentSamplePollInterval(contentSamplePollInterval);
+        return composer.release();
     }
 
     // create a ComposerHal instance
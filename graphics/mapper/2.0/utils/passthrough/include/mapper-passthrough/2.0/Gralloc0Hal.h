@@ -24,7 +24,9 @@
 #include <hardware/gralloc.h>
 #include <log/log.h>
 #include <mapper-hal/2.0/MapperHal.h>
+#include <mapper-passthrough/2.0/GrallocAsyncUnlocker.h>
 #include <mapper-passthrough/2.0/GrallocBufferDescriptor.h>
+#include <mapper-passthrough/2.0/GrallocLockStats.h>
 #include <sync/sync.h>
 
 namespace android {
@@ -48,6 +50,13 @@ class Gralloc0HalImpl : public Hal {
         return true;
     }
 
+    const GrallocLockStats& getLockStats() const { return mLockStats; }
+
+    // When enabled, unlock returns at once with a fence that signals when
+    // gralloc has actually unlocked the buffer.  Returns false when the
+    // kernel cannot provide such fences.
+    bool setAsyncUnlockEnabled(bool enabled) { return mAsyncUnlocker.setEnabled(enabled); }
+
     Error createDescriptor(const IMapper::BufferDescriptorInfo& descriptorInfo,
                            BufferDescriptor* outDescriptor) override {
         if (!descriptorInfo.width || !descriptorInfo.height || !descriptorInfo.layerCount) {
@@ -92,6 +101,7 @@ class Gralloc0HalImpl : public Hal {
     }
 
     Error freeBuffer(native_handle_t* bufferHandle) override {
+        mAsyncUnlocker.waitForBuffer(bufferHandle);
         if (mModule->unregisterBuffer(mModule, bufferHandle)) {
             return Error::BAD_BUFFER;
         }
@@ -104,8 +114,11 @@ class Gralloc0HalImpl : public Hal {
     Error lock(const native_handle_t* bufferHandle, uint64_t cpuUsage,
                const IMapper::Rect& accessRegion, base::unique_fd fenceFd,
                void** outData) override {
+        mAsyncUnlocker.waitForBuffer(bufferHandle);
+
         int result;
         void* data = nullptr;
+        const auto start = GrallocLockStats::Clock::now();
         if (mMinor >= 3 && mModule->lockAsync) {
             result = mModule->lockAsync(mModule, bufferHandle, cpuUsage, accessRegion.left,
                                         accessRegion.top, accessRegion.width, accessRegion.height,
@@ -117,6 +130,7 @@ class Gralloc0HalImpl : public Hal {
                 mModule->lock(mModule, bufferHandle, cpuUsage, accessRegion.left, accessRegion.top,
                               accessRegion.width, accessRegion.height, &data);
         }
+        mLockStats.recordLock(start, false);
 
         if (result) {
             return Error::BAD_VALUE;
@@ -129,8 +143,11 @@ class Gralloc0HalImpl : public Hal {
     Error lockYCbCr(const native_handle_t* bufferHandle, uint64_t cpuUsage,
                     const IMapper::Rect& accessRegion, base::unique_fd fenceFd,
                     YCbCrLayout* outLayout) override {
+        mAsyncUnlocker.waitForBuffer(bufferHandle);
+
         int result;
         android_ycbcr ycbcr = {};
+        const auto start = GrallocLockStats::Clock::now();
         if (mMinor >= 3 && mModule->lockAsync_ycbcr) {
             result = mModule->lockAsync_ycbcr(mModule, bufferHandle, cpuUsage, accessRegion.left,
                                               accessRegion.top, accessRegion.width,
@@ -146,6 +163,7 @@ class Gralloc0HalImpl : public Hal {
                 result = -EINVAL;
             }
         }
+        mLockStats.recordLock(start, false);
 
         if (result) {
             return Error::BAD_VALUE;
@@ -161,20 +179,30 @@ class Gralloc0HalImpl : public Hal {
     }
 
     Error unlock(const native_handle_t* bufferHandle, base::unique_fd* outFenceFd) override {
-        int result;
-        int fenceFd = -1;
-        if (mMinor >= 3 && mModule->unlockAsync) {
-            result = mModule->unlockAsync(mModule, bufferHandle, &fenceFd);
-        } else {
-            result = mModule->unlock(mModule, bufferHandle);
+        if (mAsyncUnlocker.unlock(bufferHandle,
+                                  [this, bufferHandle](int* releaseFenceFd) {
+                                      return unlockBuffer(bufferHandle, releaseFenceFd);
+                                  },
+                                  outFenceFd)) {
+            return Error::NONE;
         }
 
+        int fenceFd = -1;
+        int result = unlockBuffer(bufferHandle, &fenceFd);
+
         // we always own the fenceFd even when unlock failed
         outFenceFd->reset(fenceFd);
         return result ? Error::BAD_VALUE : Error::NONE;
     }
 
    protected:
+    int unlockBuffer(const native_handle_t* bufferHandle, int* outFenceFd) {
+        if (mMinor >= 3 && mModule->unlockAsync) {
+            return mModule->unlockAsync(mModule, bufferHandle, outFenceFd);
+        }
+        return mModule->unlock(mModule, bufferHandle);
+    }
+
     virtual uint64_t getValidBufferUsageMask() const {
         return BufferUsage::CPU_READ_MASK | BufferUsage::CPU_WRITE_MASK | BufferUsage::GPU_TEXTURE |
                BufferUsage::GPU_RENDER_TARGET | BufferUsage::COMPOSER_OVERLAY |
@@ -200,6 +228,10 @@ class Gralloc0HalImpl : public Hal {
 
     const gralloc_module_t* mModule = nullptr;
     uint8_t mMinor = 0;
+
+    GrallocLockStats mLockStats;
+
+    GrallocAsyncUnlocker mAsyncUnlocker;
 };
 
 }  // namespace detail
@@ -21,12 +21,16 @@
 
 #include <inttypes.h>
 
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 #include <hardware/gralloc1.h>
 #include <log/log.h>
 #include <mapper-hal/2.0/MapperHal.h>
+#include <mapper-passthrough/2.0/GrallocAsyncUnlocker.h>
 #include <mapper-passthrough/2.0/GrallocBufferDescriptor.h>
+#include <mapper-passthrough/2.0/GrallocLockStats.h>
 
 namespace android {
 namespace hardware {
@@ -45,6 +49,8 @@ class Gralloc1HalImpl : public Hal {
    public:
     ~Gralloc1HalImpl() {
         if (mDevice) {
+            // finish the pending unlocks while the device is still open
+            mAsyncUnlocker.setEnabled(false);
             gralloc1_close(mDevice);
         }
     }
@@ -68,6 +74,24 @@ class Gralloc1HalImpl : public Hal {
         return true;
     }
 
+    // When enabled, the layout gralloc reports for a buffer is remembered
+    // across locks, so that repeated lockYCbCr calls on the same buffer only
+    // go through the gralloc lock itself.  Entries are dropped in freeBuffer.
+    void setLockCacheEnabled(bool enabled) {
+        std::lock_guard<std::mutex> lock(mLockCacheMutex);
+        mLockCacheEnabled = enabled;
+        if (!enabled) {
+            mLockCache.clear();
+        }
+    }
+
+    const GrallocLockStats& getLockStats() const { return mLockStats; }
+
+    // When enabled, unlock returns at once with a fence that signals when
+    // gralloc has unlocked the buffer and its own release fence, if any, has
+    // signaled.  Returns false when the kernel cannot provide such fences.
+    bool setAsyncUnlockEnabled(bool enabled) { return mAsyncUnlocker.setEnabled(enabled); }
+
     Error createDescriptor(const IMapper::BufferDescriptorInfo& descriptorInfo,
                            BufferDescriptor* outDescriptor) override {
         if (!descriptorInfo.width || !descriptorInfo.height || !descriptorInfo.layerCount) {
@@ -113,6 +137,12 @@ class Gralloc1HalImpl : public Hal {
     }
 
     Error freeBuffer(native_handle_t* bufferHandle) override {
+        mAsyncUnlocker.waitForBuffer(bufferHandle);
+        {
+            std::lock_guard<std::mutex> lock(mLockCacheMutex);
+            mLockCache.erase(bufferHandle);
+        }
+
         int32_t error = mDispatch.release(mDevice, bufferHandle);
         if (error == GRALLOC1_ERROR_NONE && !mCapabilities.releaseImplyDelete) {
             native_handle_close(bufferHandle);
@@ -124,12 +154,16 @@ class Gralloc1HalImpl : public Hal {
     Error lock(const native_handle_t* bufferHandle, uint64_t cpuUsage,
                const IMapper::Rect& accessRegion, base::unique_fd fenceFd,
                void** outData) override {
+        mAsyncUnlocker.waitForBuffer(bufferHandle);
+
         const uint64_t consumerUsage =
             cpuUsage & ~static_cast<uint64_t>(BufferUsage::CPU_WRITE_MASK);
         const auto accessRect = asGralloc1Rect(accessRegion);
         void* data = nullptr;
+        const auto start = GrallocLockStats::Clock::now();
         int32_t error = mDispatch.lock(mDevice, bufferHandle, cpuUsage, consumerUsage, &accessRect,
                                        &data, fenceFd.release());
+        mLockStats.recordLock(start, false);
         if (error == GRALLOC1_ERROR_NONE) {
             *outData = data;
         }
@@ -140,20 +174,34 @@ class Gralloc1HalImpl : public Hal {
     Error lockYCbCr(const native_handle_t* bufferHandle, uint64_t cpuUsage,
                     const IMapper::Rect& accessRegion, base::unique_fd fenceFd,
                     YCbCrLayout* outLayout) override {
+        mAsyncUnlocker.waitForBuffer(bufferHandle);
+
+        const auto start = GrallocLockStats::Clock::now();
+
         // prepare flex layout
         android_flex_layout flex = {};
-        int32_t error = mDispatch.getNumFlexPlanes(mDevice, bufferHandle, &flex.num_planes);
+        bool cacheHit = false;
+        int32_t error = getNumFlexPlanes(bufferHandle, &flex.num_planes, &cacheHit);
         if (error != GRALLOC1_ERROR_NONE) {
             return toError(error);
         }
-        std::vector<android_flex_plane_t> flexPlanes(flex.num_planes);
-        flex.planes = flexPlanes.data();
+
+        // YCbCr buffers have 3 or 4 planes, so avoid allocating in the common case
+        android_flex_plane_t inlinePlanes[kInlineFlexPlaneCount];
+        std::vector<android_flex_plane_t> flexPlanes;
+        if (flex.num_planes <= kInlineFlexPlaneCount) {
+            flex.planes = inlinePlanes;
+        } else {
+            flexPlanes.resize(flex.num_planes);
+            flex.planes = flexPlanes.data();
+        }
 
         const uint64_t consumerUsage =
             cpuUsage & ~static_cast<uint64_t>(BufferUsage::CPU_WRITE_MASK);
         const auto accessRect = asGralloc1Rect(accessRegion);
         error = mDispatch.lockFlex(mDevice, bufferHandle, cpuUsage, consumerUsage, &accessRect,
                                    &flex, fenceFd.release());
+        mLockStats.recordLock(start, cacheHit);
         if (error == GRALLOC1_ERROR_NONE && !toYCbCrLayout(flex, outLayout)) {
             ALOGD("unable to convert android_flex_layout to YCbCrLayout");
             // undo the lock
@@ -165,6 +213,14 @@ class Gralloc1HalImpl : public Hal {
     }
 
     Error unlock(const native_handle_t* bufferHandle, base::unique_fd* outFenceFd) override {
+        if (mAsyncUnlocker.unlock(bufferHandle,
+                                  [this, bufferHandle](int* releaseFenceFd) {
+                                      return mDispatch.unlock(mDevice, bufferHandle, releaseFenceFd);
+                                  },
+                                  outFenceFd)) {
+            return Error::NONE;
+        }
+
         int fenceFd = -1;
         int32_t error = mDispatch.unlock(mDevice, bufferHandle, &fenceFd);
 
@@ -174,6 +230,31 @@ class Gralloc1HalImpl : public Hal {
     }
 
    protected:
+    static constexpr uint32_t kInlineFlexPlaneCount = 4;
+
+    int32_t getNumFlexPlanes(const native_handle_t* bufferHandle, uint32_t* outNumPlanes,
+                             bool* outCacheHit) {
+        std::unique_lock<std::mutex> lock(mLockCacheMutex);
+        if (mLockCacheEnabled) {
+            auto iter = mLockCache.find(bufferHandle);
+            if (iter != mLockCache.end()) {
+                *outNumPlanes = iter->second;
+                *outCacheHit = true;
+                return GRALLOC1_ERROR_NONE;
+            }
+        }
+        const bool cacheEnabled = mLockCacheEnabled;
+        lock.unlock();
+
+        int32_t error = mDispatch.getNumFlexPlanes(mDevice, bufferHandle, outNumPlanes);
+        if (error == GRALLOC1_ERROR_NONE && cacheEnabled) {
+            lock.lock();
+            mLockCache[bufferHandle] = *outNumPlanes;
+        }
+
+        return error;
+    }
+
     virtual void initCapabilities() {
         uint32_t count = 0;
         mDevice->getCapabilities(mDevice, &count, nullptr);
@@ -326,6 +407,15 @@ class Gralloc1HalImpl : public Hal {
         GRALLOC1_PFN_LOCK_FLEX lockFlex;
         GRALLOC1_PFN_UNLOCK unlock;
     } mDispatch = {};
+
+    // number of flex planes of the buffers locked with lockYCbCr
+    std::mutex mLockCacheMutex;
+    bool mLockCacheEnabled = false;
+    std::unordered_map<const native_handle_t*, uint32_t> mLockCache;
+
+    GrallocLockStats mLockStats;
+
+    GrallocAsyncUnlocker mAsyncUnlocker;
 };
 
 }  // namespace detail
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#ifndef LOG_TAG
+#warning "GrallocAsyncUnlocker.h included without LOG_TAG"
+#endif
+
+#include <unistd.h>
+
+#include <condition_variable>
+#include <cstring>  // for strerror
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <android-base/unique_fd.h>
+#include <cutils/native_handle.h>
+#include <log/log.h>
+#include <sync/sync.h>
+
+// libsync exports the sw_sync timeline functions to vendor code but does not
+// ship their header
+extern "C" {
+int sw_sync_timeline_create(void);
+int sw_sync_timeline_inc(int fd, unsigned count);
+int sw_sync_fence_create(int fd, const char* name, unsigned value);
+}
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace mapper {
+namespace V2_0 {
+namespace passthrough {
+
+// GrallocAsyncUnlocker runs gralloc unlocks, and the cache maintenance they
+// imply, on a thread of its own.  The caller gets back a sw_sync fence that
+// signals once the unlock has completed and any fence gralloc returned for it
+// has signaled, so the buffer is handed on without waiting for the flush.
+//
+// Unlocks complete in the order they were queued.  A lock or free of a buffer
+// must call waitForBuffer first, so that it does not overtake a pending
+// unlock of the same buffer.
+//
+// sw_sync is not available on every kernel; enabling fails when no timeline
+// can be created and the HAL keeps unlocking synchronously.
+class GrallocAsyncUnlocker {
+   public:
+    // Unlocks a buffer, returning 0 on success and taking ownership of the
+    // fence written to outFenceFd, if any
+    using UnlockFunction = std::function<int(int* outFenceFd)>;
+
+    ~GrallocAsyncUnlocker() { setEnabled(false); }
+
+    // Returns whether asynchronous unlocks are enabled after the call
+    bool setEnabled(bool enabled) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (enabled == (mTimeline >= 0)) {
+            return enabled;
+        }
+
+        if (enabled) {
+            mTimeline.reset(sw_sync_timeline_create());
+            if (mTimeline < 0) {
+                ALOGW("sw_sync is not available, unlocking synchronously");
+                return false;
+            }
+            mQueuedCount = 0;
+            mExiting = false;
+            mThread = std::thread(&GrallocAsyncUnlocker::threadLoop, this);
+            return true;
+        }
+
+        mExiting = true;
+        mCondition.notify_all();
+        lock.unlock();
+        mThread.join();
+        lock.lock();
+        // the worker drained the queue before exiting, so every fence has signaled
+        mTimeline.reset();
+        return false;
+    }
+
+    // Queues the unlock and returns its fence in outFenceFd.  Returns false,
+    // without unlocking, when asynchronous unlocks are disabled or the fence
+    // cannot be created.
+    bool unlock(const native_handle_t* bufferHandle, UnlockFunction unlockFunction,
+                base::unique_fd* outFenceFd) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mTimeline < 0) {
+            return false;
+        }
+
+        const unsigned value = mQueuedCount + 1;
+        base::unique_fd fenceFd(sw_sync_fence_create(mTimeline, "gralloc-unlock", value));
+        if (fenceFd < 0) {
+            ALOGW("failed to create unlock fence: %s", strerror(errno));
+            return false;
+        }
+
+        mQueuedCount = value;
+        mQueue.push_back({bufferHandle, std::move(unlockFunction)});
+        mPendingBuffers[bufferHandle]++;
+        mCondition.notify_all();
+
+        *outFenceFd = std::move(fenceFd);
+        return true;
+    }
+
+    // Blocks until no unlock of the buffer is pending
+    void waitForBuffer(const native_handle_t* bufferHandle) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this, bufferHandle] {
+            return mPendingBuffers.find(bufferHandle) == mPendingBuffers.end();
+        });
+    }
+
+   private:
+    struct Request {
+        const native_handle_t* bufferHandle;
+        UnlockFunction unlockFunction;
+    };
+
+    void threadLoop() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mCondition.wait(lock, [this] { return mExiting || !mQueue.empty(); });
+            if (mQueue.empty()) {
+                return;
+            }
+
+            Request request = std::move(mQueue.front());
+            mQueue.pop_front();
+            lock.unlock();
+
+            int fenceFd = -1;
+            int error = request.unlockFunction(&fenceFd);
+            if (error) {
+                ALOGE("asynchronous unlock of buffer %p failed: %d", request.bufferHandle, error);
+            }
+            base::unique_fd releaseFence(fenceFd);
+            if (releaseFence >= 0 && sync_wait(releaseFence, -1) < 0) {
+                ALOGE("failed to wait for unlock fence: %s", strerror(errno));
+            }
+            sw_sync_timeline_inc(mTimeline, 1);
+
+            lock.lock();
+            auto iter = mPendingBuffers.find(request.bufferHandle);
+            if (--iter->second == 0) {
+                mPendingBuffers.erase(iter);
+            }
+            mCondition.notify_all();
+        }
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::thread mThread;
+    bool mExiting = false;
+
+    base::unique_fd mTimeline;
+    // value of the fence of the last queued unlock
+    unsigned mQueuedCount = 0;
+    std::deque<Request> mQueue;
+    // number of queued or running unlocks of each buffer
+    std::unordered_map<const native_handle_t*, uint32_t> mPendingBuffers;
+};
+
+}  // namespace passthrough
+}  // namespace V2_0
+}  // namespace mapper
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
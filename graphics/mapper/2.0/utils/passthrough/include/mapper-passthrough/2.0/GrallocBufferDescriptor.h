@@ -34,34 +34,57 @@ using android::hardware::graphics::common::V1_0::PixelFormat;
 constexpr uint32_t grallocBufferDescriptorSize = 7;
 constexpr uint32_t grallocBufferDescriptorMagicVersion = ((0x9487 << 16) | 0);
 
+/**
+ * Word offsets of the fields of an encoded BufferDescriptor. Two descriptors
+ * describe the same buffers exactly when all their words are equal, so the
+ * encoded form can be used as a key without decoding it.
+ */
+enum GrallocBufferDescriptorField : uint32_t {
+    kGrallocDescriptorMagicVersion = 0,
+    kGrallocDescriptorWidth,
+    kGrallocDescriptorHeight,
+    kGrallocDescriptorLayerCount,
+    kGrallocDescriptorFormat,
+    kGrallocDescriptorUsageLow,
+    kGrallocDescriptorUsageHigh,
+    kGrallocDescriptorFieldCount,
+};
+static_assert(kGrallocDescriptorFieldCount == grallocBufferDescriptorSize,
+              "every descriptor word must have a field");
+
 inline BufferDescriptor grallocEncodeBufferDescriptor(
     const IMapper::BufferDescriptorInfo& descriptorInfo) {
     BufferDescriptor descriptor;
     descriptor.resize(grallocBufferDescriptorSize);
-    descriptor[0] = grallocBufferDescriptorMagicVersion;
-    descriptor[1] = descriptorInfo.width;
-    descriptor[2] = descriptorInfo.height;
-    descriptor[3] = descriptorInfo.layerCount;
-    descriptor[4] = static_cast<uint32_t>(descriptorInfo.format);
-    descriptor[5] = static_cast<uint32_t>(descriptorInfo.usage);
-    descriptor[6] = static_cast<uint32_t>(descriptorInfo.usage >> 32);
+    descriptor[kGrallocDescriptorMagicVersion] = grallocBufferDescriptorMagicVersion;
+    descriptor[kGrallocDescriptorWidth] = descriptorInfo.width;
+    descriptor[kGrallocDescriptorHeight] = descriptorInfo.height;
+    descriptor[kGrallocDescriptorLayerCount] = descriptorInfo.layerCount;
+    descriptor[kGrallocDescriptorFormat] = static_cast<uint32_t>(descriptorInfo.format);
+    descriptor[kGrallocDescriptorUsageLow] = static_cast<uint32_t>(descriptorInfo.usage);
+    descriptor[kGrallocDescriptorUsageHigh] = static_cast<uint32_t>(descriptorInfo.usage >> 32);
 
     return descriptor;
 }
 
+inline bool grallocIsValidBufferDescriptor(const BufferDescriptor& descriptor) {
+    return descriptor.size() == grallocBufferDescriptorSize &&
+           descriptor[kGrallocDescriptorMagicVersion] == grallocBufferDescriptorMagicVersion;
+}
+
 inline bool grallocDecodeBufferDescriptor(const BufferDescriptor& descriptor,
                                           IMapper::BufferDescriptorInfo* outDescriptorInfo) {
-    if (descriptor.size() != grallocBufferDescriptorSize ||
-        descriptor[0] != grallocBufferDescriptorMagicVersion) {
+    if (!grallocIsValidBufferDescriptor(descriptor)) {
         return false;
     }
 
     *outDescriptorInfo = IMapper::BufferDescriptorInfo{
-        descriptor[1],
-        descriptor[2],
-        descriptor[3],
-        static_cast<PixelFormat>(descriptor[4]),
-        (static_cast<uint64_t>(descriptor[6]) << 32) | descriptor[5],
+        descriptor[kGrallocDescriptorWidth],
+        descriptor[kGrallocDescriptorHeight],
+        descriptor[kGrallocDescriptorLayerCount],
+        static_cast<PixelFormat>(descriptor[kGrallocDescriptorFormat]),
+        (static_cast<uint64_t>(descriptor[kGrallocDescriptorUsageHigh]) << 32) |
+            descriptor[kGrallocDescriptorUsageLow],
     };
 
     return true;
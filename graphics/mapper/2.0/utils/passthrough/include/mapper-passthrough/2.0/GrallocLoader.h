@@ -24,6 +24,7 @@
 #include <mutex>
 #include <unordered_set>
 
+#include <cutils/properties.h>
 #include <hardware/gralloc.h>
 #include <hardware/hardware.h>
 #include <log/log.h>
@@ -145,11 +146,24 @@ class GrallocLoader {
         switch (major) {
             case 1: {
                 auto hal = std::make_unique<Gralloc1Hal>();
-                return hal->initWithModule(module) ? std::move(hal) : nullptr;
+                if (!hal->initWithModule(module)) {
+                    return nullptr;
+                }
+                hal->setLockCacheEnabled(true);
+                if (isAsyncUnlockRequested()) {
+                    hal->setAsyncUnlockEnabled(true);
+                }
+                return std::move(hal);
             }
             case 0: {
                 auto hal = std::make_unique<Gralloc0Hal>();
-                return hal->initWithModule(module) ? std::move(hal) : nullptr;
+                if (!hal->initWithModule(module)) {
+                    return nullptr;
+                }
+                if (isAsyncUnlockRequested()) {
+                    hal->setAsyncUnlockEnabled(true);
+                }
+                return std::move(hal);
             }
             default:
                 ALOGE("unknown gralloc module major version %d", major);
@@ -157,6 +171,12 @@ class GrallocLoader {
         }
     }
 
+    // Asynchronous unlocks are off unless the device opts in.  They need a
+    // sw_sync timeline, which processes without access to one fall back from.
+    static bool isAsyncUnlockRequested() {
+        return property_get_bool("ro.vendor.gralloc.async_unlock", false);
+    }
+
     // create an IAllocator instance
     static IMapper* createMapper(std::unique_ptr<hal::MapperHal> hal) {
         auto mapper = std::make_unique<GrallocMapper<hal::Mapper>>();
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace mapper {
+namespace V2_0 {
+namespace passthrough {
+
+// GrallocLockStats counts the locks served by a passthrough HAL, how many of
+// them hit the lock cache, and how long gralloc took to lock.  It is updated
+// from any binder thread and can be read at any time.
+class GrallocLockStats {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    void recordLock(Clock::time_point start, bool cacheHit) {
+        const uint64_t latencyNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       Clock::now() - start)
+                                       .count();
+
+        mLockCount.fetch_add(1, std::memory_order_relaxed);
+        if (cacheHit) {
+            mCacheHitCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        mTotalLatencyNs.fetch_add(latencyNs, std::memory_order_relaxed);
+
+        uint64_t maxLatencyNs = mMaxLatencyNs.load(std::memory_order_relaxed);
+        while (latencyNs > maxLatencyNs &&
+               !mMaxLatencyNs.compare_exchange_weak(maxLatencyNs, latencyNs,
+                                                    std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t getLockCount() const { return mLockCount.load(std::memory_order_relaxed); }
+
+    uint64_t getCacheHitCount() const { return mCacheHitCount.load(std::memory_order_relaxed); }
+
+    float getCacheHitRate() const {
+        const uint64_t count = getLockCount();
+        return count ? static_cast<float>(getCacheHitCount()) / count : 0.0f;
+    }
+
+    uint64_t getAverageLatencyNs() const {
+        const uint64_t count = getLockCount();
+        return count ? mTotalLatencyNs.load(std::memory_order_relaxed) / count : 0;
+    }
+
+    uint64_t getMaxLatencyNs() const { return mMaxLatencyNs.load(std::memory_order_relaxed); }
+
+   private:
+    std::atomic<uint64_t> mLockCount{0};
+    std::atomic<uint64_t> mCacheHitCount{0};
+    std::atomic<uint64_t> mTotalLatencyNs{0};
+    std::atomic<uint64_t> mMaxLatencyNs{0};
+};
+
+}  // namespace passthrough
+}  // namespace V2_0
+}  // namespace mapper
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
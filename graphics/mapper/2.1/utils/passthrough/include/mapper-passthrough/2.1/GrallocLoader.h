@@ -52,7 +52,11 @@ class GrallocLoader : public V2_0::passthrough::GrallocLoader {
         switch (major) {
             case 1: {
                 auto hal = std::make_unique<Gralloc1Hal>();
-                return hal->initWithModule(module) ? std::move(hal) : nullptr;
+                if (!hal->initWithModule(module)) {
+                    return nullptr;
+                }
+                hal->setLockCacheEnabled(true);
+                return std::move(hal);
             }
             case 0: {
                 auto hal = std::make_unique<Gralloc0Hal>();
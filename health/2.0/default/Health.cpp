@@ -16,7 +16,15 @@
 #define LOG_TAG "android.hardware.health@2.0-impl"
 #include <android-base/logging.h>
 
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
 #include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <android-base/properties.h>
+#include <android-base/strings.h>
 #include <health2/Health.h>
 
 #include <hal_conversion.h>
@@ -30,13 +38,32 @@ namespace health {
 namespace V2_0 {
 namespace implementation {
 
+static constexpr char kUeventUpdateProperty[] = "vendor.health.uevent_update";
+static constexpr char kPowerSupplySysfsPath[] = "/sys/class/power_supply/";
+
 sp<Health> Health::instance_;
 
+// Returns the name of the power supply that |path| is an attribute of, or an empty
+// string if |path| is not under /sys/class/power_supply.
+static std::string getPowerSupplyName(const std::string& path) {
+    if (!android::base::StartsWith(path, kPowerSupplySysfsPath)) return "";
+    std::string name = path.substr(strlen(kPowerSupplySysfsPath));
+    size_t slash = name.find('/');
+    return slash == std::string::npos ? "" : name.substr(0, slash);
+}
+
 Health::Health(struct healthd_config* c) {
     // TODO(b/69268160): remove when libhealthd is removed.
     healthd_board_init(c);
     battery_monitor_ = std::make_unique<BatteryMonitor>();
     battery_monitor_->init(c);
+
+    // BatteryMonitor::init() fills in the sysfs paths that the board left empty.
+    uevent_update_enabled_ = android::base::GetBoolProperty(kUeventUpdateProperty, false);
+    battery_name_ = getPowerSupplyName(c->batteryStatusPath.string());
+    if (!c->batteryCurrentAvgPath.isEmpty()) {
+        current_avg_fd_.reset(open(c->batteryCurrentAvgPath.string(), O_RDONLY | O_CLOEXEC));
+    }
 }
 
 // Methods from IHealth follow.
@@ -150,15 +177,181 @@ Return<Result> Health::update() {
     // notifyListeners.
     battery_monitor_->updateValues();
     struct BatteryProperties props = getBatteryProperties(battery_monitor_.get());
-    bool log = healthd_board_battery_update(&props);
-    if (log) {
+    props_ = props;
+    props_valid_ = true;
+    dispatchBatteryUpdate(&props, true /* logValues */);
+
+    return Result::SUCCESS;
+}
+
+void Health::dispatchBatteryUpdate(struct BatteryProperties* props, bool logValues) {
+    bool log = healthd_board_battery_update(props);
+    if (log && logValues) {
         battery_monitor_->logValues();
     }
-    healthd_mode_ops->battery_update(&props);
-    bool chargerOnline = battery_monitor_->isChargerOnline();
+    healthd_mode_ops->battery_update(props);
+    // Same as BatteryMonitor::isChargerOnline(), which ignores changes made by the board.
+    bool chargerOnline =
+            props_.chargerAcOnline || props_.chargerUsbOnline || props_.chargerWirelessOnline;
 
     // adjust uevent / wakealarm periods
     healthd_battery_update_internal(chargerOnline);
+}
+
+namespace {
+
+enum class UeventUpdate {
+    UNCHANGED,
+    CHANGED,
+    // The uevent cannot be applied to the cached values; read everything from sysfs.
+    NEEDS_SYSFS,
+};
+
+// Same mappings as BatteryMonitor.
+const std::map<std::string, int> kBatteryStatus = {
+        {"Unknown", BATTERY_STATUS_UNKNOWN},
+        {"Charging", BATTERY_STATUS_CHARGING},
+        {"Discharging", BATTERY_STATUS_DISCHARGING},
+        {"Not charging", BATTERY_STATUS_NOT_CHARGING},
+        {"Full", BATTERY_STATUS_FULL},
+};
+
+const std::map<std::string, int> kBatteryHealth = {
+        {"Unknown", BATTERY_HEALTH_UNKNOWN},
+        {"Good", BATTERY_HEALTH_GOOD},
+        {"Overheat", BATTERY_HEALTH_OVERHEAT},
+        {"Dead", BATTERY_HEALTH_DEAD},
+        {"Over voltage", BATTERY_HEALTH_OVER_VOLTAGE},
+        {"Unspecified failure", BATTERY_HEALTH_UNSPECIFIED_FAILURE},
+        {"Cold", BATTERY_HEALTH_COLD},
+        {"Warm", BATTERY_HEALTH_GOOD},
+        {"Cool", BATTERY_HEALTH_GOOD},
+        {"Hot", BATTERY_HEALTH_OVERHEAT},
+};
+
+const std::vector<std::string> kChargerTypes = {
+        "UPS",     "Mains", "USB",    "USB_DCP",    "USB_HVDCP", "USB_CDP",
+        "USB_ACA", "USB_C", "USB_PD", "USB_PD_DRP", "Wireless",
+};
+
+// Uevent keys of a charger that BatteryMonitor reads.
+const std::vector<std::string> kChargerKeys = {"ONLINE", "CURRENT_MAX", "VOLTAGE_MAX"};
+
+template <typename T>
+bool applyValue(T value, T* field, UeventUpdate* result) {
+    if (*field != value) {
+        *field = value;
+        *result = UeventUpdate::CHANGED;
+    }
+    return true;
+}
+
+template <typename T>
+bool applyInt(const std::string& value, int scale, T* field, UeventUpdate* result) {
+    int64_t parsed;
+    if (!android::base::ParseInt(value, &parsed)) return false;
+    return applyValue(static_cast<T>(parsed / scale), field, result);
+}
+
+bool applyEnum(const std::map<std::string, int>& values, const std::string& value, int* field,
+               UeventUpdate* result) {
+    auto it = values.find(value);
+    if (it == values.end()) return false;
+    return applyValue(it->second, field, result);
+}
+
+// Apply the properties of a uevent from the battery that BatteryMonitor reads. Properties
+// that BatteryMonitor does not take from this battery's attributes are left alone; they are
+// refreshed by the next periodic update(). currentAvg is null if current_avg is not reported.
+UeventUpdate applyBatteryUevent(const PowerSupplyUevent& event, struct BatteryProperties* props,
+                                int32_t* currentAvg) {
+    UeventUpdate result = UeventUpdate::UNCHANGED;
+
+    for (const auto& [key, value] : event.properties) {
+        bool ok = true;
+        if (key == "STATUS") {
+            ok = applyEnum(kBatteryStatus, value, &props->batteryStatus, &result);
+        } else if (key == "HEALTH") {
+            ok = applyEnum(kBatteryHealth, value, &props->batteryHealth, &result);
+        } else if (key == "PRESENT") {
+            ok = applyValue(value != "0", &props->batteryPresent, &result);
+        } else if (key == "CAPACITY") {
+            ok = applyInt(value, 1, &props->batteryLevel, &result);
+        } else if (key == "VOLTAGE_NOW") {
+            ok = applyInt(value, 1000, &props->batteryVoltage, &result);
+        } else if (key == "CURRENT_NOW") {
+            // Scaled to milliamperes, as BatteryMonitor reads current_now
+            ok = applyInt(value, 1000, &props->batteryCurrent, &result);
+        } else if (key == "CURRENT_AVG") {
+            // Not applied, notifyListeners() reads it again; only tells whether it changed
+            if (currentAvg != nullptr) ok = applyInt(value, 1, currentAvg, &result);
+        } else if (key == "TEMP") {
+            ok = applyInt(value, 1, &props->batteryTemperature, &result);
+        } else if (key == "CHARGE_COUNTER") {
+            ok = applyInt(value, 1, &props->batteryChargeCounter, &result);
+        } else if (key == "CHARGE_FULL") {
+            ok = applyInt(value, 1, &props->batteryFullCharge, &result);
+        } else if (key == "CYCLE_COUNT") {
+            ok = applyInt(value, 1, &props->batteryCycleCount, &result);
+        } else if (key == "TECHNOLOGY") {
+            ok = applyValue(String8(value.c_str()), &props->batteryTechnology, &result);
+        }
+        if (!ok) return UeventUpdate::NEEDS_SYSFS;
+    }
+
+    return result;
+}
+
+}  // namespace
+
+Return<Result> Health::updateFromUevent(const PowerSupplyUevent& event) {
+    if (!uevent_update_enabled_ || !props_valid_ || event.name.empty()) {
+        return update();
+    }
+
+    struct BatteryProperties props = props_;
+    UeventUpdate result = UeventUpdate::NEEDS_SYSFS;
+
+    if (event.type == "Battery") {
+        if (!battery_name_.empty() && event.name == battery_name_) {
+            int32_t currentAvg = current_avg_;
+            result = applyBatteryUevent(event, &props,
+                                        current_avg_fd_ != -1 ? &currentAvg : nullptr);
+        }
+    } else if (std::find(kChargerTypes.begin(), kChargerTypes.end(), event.type) !=
+               kChargerTypes.end()) {
+        // The charger fields are combined over all chargers, so a change cannot be applied
+        // without the state of the others. The kernel sends every property on each uevent,
+        // so the last uevent of a charger is its current state; repeated uevents with
+        // the same state are what docks send while negotiating, and need no update.
+        std::map<std::string, std::string> state;
+        for (const auto& key : kChargerKeys) {
+            auto it = event.properties.find(key);
+            if (it != event.properties.end()) state[key] = it->second;
+        }
+        auto [it, inserted] = charger_uevents_.try_emplace(event.name, state);
+        if (!inserted && it->second == state) {
+            result = UeventUpdate::UNCHANGED;
+        } else {
+            it->second = std::move(state);
+        }
+    }
+
+    switch (result) {
+        case UeventUpdate::UNCHANGED:
+            return Result::SUCCESS;
+        case UeventUpdate::NEEDS_SYSFS:
+            return update();
+        case UeventUpdate::CHANGED:
+            break;
+    }
+
+    if (!healthd_mode_ops || !healthd_mode_ops->battery_update) {
+        return update();
+    }
+
+    props_ = props;
+    dispatchBatteryUpdate(&props, false /* logValues */);
 
     return Result::SUCCESS;
 }
@@ -182,17 +375,10 @@ void Health::notifyListeners(HealthInfo* healthInfo) {
     std::vector<DiskStats> stats;
     get_disk_stats(stats);
 
-    int32_t currentAvg = 0;
-
-    struct BatteryProperty prop;
-    status_t ret = battery_monitor_->getProperty(BATTERY_PROP_CURRENT_AVG, &prop);
-    if (ret == OK) {
-        currentAvg = static_cast<int32_t>(prop.valueInt64);
-    }
-
-    healthInfo->batteryCurrentAverage = currentAvg;
+    healthInfo->batteryCurrentAverage = getCurrentAverageValue();
     healthInfo->diskStats = stats;
     healthInfo->storageInfos = info;
+    current_avg_ = healthInfo->batteryCurrentAverage;
 
     std::lock_guard<decltype(callbacks_lock_)> lock(callbacks_lock_);
     for (auto it = callbacks_.begin(); it != callbacks_.end();) {
@@ -205,6 +391,19 @@ void Health::notifyListeners(HealthInfo* healthInfo) {
     }
 }
 
+int32_t Health::getCurrentAverageValue() {
+    if (current_avg_fd_ == -1) return 0;
+
+    char buf[32];
+    ssize_t n = TEMP_FAILURE_RETRY(pread(current_avg_fd_, buf, sizeof(buf) - 1, 0));
+    if (n <= 0) return 0;
+    buf[n] = '\0';
+
+    int32_t value;
+    if (!android::base::ParseInt(android::base::Trim(buf), &value)) return 0;
+    return value;
+}
+
 Return<void> Health::debug(const hidl_handle& handle, const hidl_vec<hidl_string>&) {
     if (handle != nullptr && handle->numFds >= 1) {
         int fd = handle->data[0];
@@ -264,17 +463,9 @@ Return<void> Health::getHealthInfo(getHealthInfo_cb _hidl_cb) {
     std::vector<DiskStats> stats;
     get_disk_stats(stats);
 
-    int32_t currentAvg = 0;
-
-    struct BatteryProperty prop;
-    status_t ret = battery_monitor_->getProperty(BATTERY_PROP_CURRENT_AVG, &prop);
-    if (ret == OK) {
-        currentAvg = static_cast<int32_t>(prop.valueInt64);
-    }
-
     V2_0::HealthInfo healthInfo = {};
     healthInfo.legacy = std::move(batteryInfo);
-    healthInfo.batteryCurrentAverage = currentAvg;
+    healthInfo.batteryCurrentAverage = getCurrentAverageValue();
     healthInfo.diskStats = stats;
     healthInfo.storageInfos = info;
 
@@ -45,6 +45,9 @@ class HealthLoopAdapter : public HealthLoop {
     void Heartbeat() override { healthd_mode_ops->heartbeat(); }
     int PrepareToWait() override { return healthd_mode_ops->preparetowait(); }
     void ScheduleBatteryUpdate() override { Health::getImplementation()->update(); }
+    void UeventBatteryUpdate(const android::hardware::health::PowerSupplyUevent& event) override {
+        Health::getImplementation()->updateFromUevent(event);
+    }
 };
 static std::unique_ptr<HealthLoopAdapter> health_loop;
 
@@ -1,11 +1,15 @@
 #ifndef ANDROID_HARDWARE_HEALTH_V2_0_HEALTH_H
 #define ANDROID_HARDWARE_HEALTH_V2_0_HEALTH_H
 
+#include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
+#include <android-base/unique_fd.h>
 #include <android/hardware/health/1.0/types.h>
 #include <android/hardware/health/2.0/IHealth.h>
+#include <health/PowerSupplyUevent.h>
 #include <healthd/BatteryMonitor.h>
 #include <hidl/Status.h>
 
@@ -37,6 +41,13 @@ struct Health : public IHealth, hidl_death_recipient {
 
     void notifyListeners(HealthInfo* info);
 
+    // Called by the health loop for each power_supply uevent. If
+    // vendor.health.uevent_update is set, the properties carried by |event| are
+    // applied to the values from the last update() and listeners are notified only
+    // when one of them changed. Otherwise, or if |event| cannot be applied without
+    // reading sysfs, this is the same as update().
+    Return<Result> updateFromUevent(const PowerSupplyUevent& event);
+
     // Methods from IHealth follow.
     Return<Result> registerCallback(const sp<IHealthInfoCallback>& callback) override;
     Return<Result> unregisterCallback(const sp<IHealthInfoCallback>& callback) override;
@@ -63,11 +74,34 @@ struct Health : public IHealth, hidl_death_recipient {
     std::vector<sp<IHealthInfoCallback>> callbacks_;
     std::unique_ptr<BatteryMonitor> battery_monitor_;
 
+    // State for updateFromUevent().
+    bool uevent_update_enabled_ = false;
+    // Power supply name of the battery that battery_monitor_ reads, if it reads one
+    // under /sys/class/power_supply.
+    std::string battery_name_;
+    // Values from the last update() with the changes from later uevents applied.
+    // Only valid if props_valid_ is set.
+    struct BatteryProperties props_;
+    bool props_valid_ = false;
+    // Charger related values of the last uevent from each charger, keyed by supply name.
+    std::map<std::string, std::map<std::string, std::string>> charger_uevents_;
+
+    // current_avg is not part of BatteryProperties, so it is read on every notification
+    // through an fd that stays open. -1 if the attribute does not exist.
+    android::base::unique_fd current_avg_fd_;
+    // The current_avg sent with the last notification, to tell whether a uevent changes it.
+    int32_t current_avg_ = 0;
+
     bool unregisterCallbackInternal(const sp<IBase>& cb);
 
     // update() and only notify the given callback, but none of the other callbacks.
     // If cb is null, do not notify any callback at all.
     Return<Result> updateAndNotify(const sp<IHealthInfoCallback>& cb);
+
+    // Pass |props| to the board and to healthd_mode_ops, and adjust the wakealarm period.
+    void dispatchBatteryUpdate(struct BatteryProperties* props, bool logValues);
+
+    int32_t getCurrentAverageValue();
 };
 
 }  // namespace implementation
@@ -15,10 +15,303 @@
  */
 #include "include/StorageHealthDefault.h"
 
-void get_storage_info(std::vector<struct StorageInfo>&) {
-    // Use defaults.
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/macros.h>
+#include <android-base/properties.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+
+using android::base::unique_fd;
+
+namespace {
+
+// batterystats asks for the health info several times in a row, e.g. once per
+// consumer of a battery update; within these the cached values are returned.
+constexpr std::chrono::seconds kDiskStatsTtl{1};
+// the life time estimates move by 10% of the rated endurance at a time
+constexpr std::chrono::minutes kStorageInfoTtl{1};
+
+constexpr char kSysBlock[] = "/sys/block";
+constexpr char kUfsHealthDescriptorGlob[] =
+        "/sys/bus/platform/drivers/ufshcd/*/health_descriptor";
+
+// Reads unsigned numbers, decimal or 0x-prefixed hexadecimal, separated by
+// whitespace out of a buffer without copying it.
+class NumberTokenizer {
+  public:
+    NumberTokenizer(const char* begin, const char* end) : mPos(begin), mEnd(end) {}
+
+    bool next(uint64_t* value) {
+        while (mPos < mEnd && isSpace(*mPos)) mPos++;
+        if (mPos == mEnd) return false;
+
+        int base = 10;
+        if (mEnd - mPos > 2 && mPos[0] == '0' && (mPos[1] == 'x' || mPos[1] == 'X')) {
+            base = 16;
+            mPos += 2;
+        }
+        uint64_t result = 0;
+        const char* start = mPos;
+        for (; mPos < mEnd && !isSpace(*mPos); mPos++) {
+            int digit = digitValue(*mPos);
+            if (digit < 0 || digit >= base) return false;
+            result = result * base + digit;
+        }
+        if (mPos == start) return false;
+        *value = result;
+        return true;
+    }
+
+  private:
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n'; }
+
+    static int digitValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    const char* mPos;
+    const char* mEnd;
+};
+
+// Reads a sysfs node from the start through a descriptor kept open, and returns
+// the number of bytes read, or -1.
+ssize_t readNode(const unique_fd& fd, char* buffer, size_t size) {
+    if (fd < 0) return -1;
+    return TEMP_FAILURE_RETRY(pread(fd, buffer, size, 0));
+}
+
+// Returns the first number of a node
+bool readNumber(const unique_fd& fd, uint64_t* value) {
+    char buffer[32];
+    ssize_t length = readNode(fd, buffer, sizeof(buffer));
+    return length > 0 && NumberTokenizer(buffer, buffer + length).next(value);
+}
+
+struct BlockDevice {
+    StorageAttribute attr;
+    // /sys/block/<name>/stat
+    unique_fd statFd;
+    // eMMC: pre_eol_info and life_time, which holds both estimates.
+    // UFS: eol_info, life_time_estimation_a and life_time_estimation_b.
+    unique_fd eolFd;
+    unique_fd lifetimeAFd;
+    unique_fd lifetimeBFd;
+    std::string version;
+};
+
+unique_fd openNode(const std::string& path) {
+    return unique_fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+}
+
+std::string readVersion(const std::string& path) {
+    std::string version;
+    if (!android::base::ReadFileToString(path, &version)) return {};
+    return android::base::Trim(version);
+}
+
+// Opens the nodes of the non removable disks once, they stay the same for the
+// life of the process.
+class StorageNodes {
+  public:
+    static StorageNodes& get() {
+        static StorageNodes nodes;
+        return nodes;
+    }
+
+    void getStorageInfo(std::vector<StorageInfo>* info) {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto now = std::chrono::steady_clock::now();
+        if (!mStorageInfoValid || now - mStorageInfoTime >= kStorageInfoTtl) {
+            readStorageInfoLocked();
+            mStorageInfoTime = now;
+            mStorageInfoValid = true;
+        }
+        *info = mStorageInfo;
+    }
+
+    void getDiskStats(std::vector<DiskStats>* stats) {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto now = std::chrono::steady_clock::now();
+        if (!mDiskStatsValid || now - mDiskStatsTime >= kDiskStatsTtl) {
+            readDiskStatsLocked();
+            mDiskStatsTime = now;
+            mDiskStatsValid = true;
+        }
+        *stats = mDiskStats;
+    }
+
+  private:
+    StorageNodes() {
+        std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(kSysBlock), closedir);
+        if (dir == nullptr) return;
+
+        std::string bootDevice = android::base::GetProperty("ro.boot.bootdevice", "");
+        while (struct dirent* entry = readdir(dir.get())) {
+            if (entry->d_name[0] == '.') continue;
+            addDevice(entry->d_name, bootDevice);
+        }
+        // readdir order is unspecified, keep the reported order stable across boots
+        std::sort(mDevices.begin(), mDevices.end(),
+                  [](const BlockDevice& a, const BlockDevice& b) {
+                      return a.attr.name < b.attr.name;
+                  });
+    }
+
+    void addDevice(const std::string& name, const std::string& bootDevice) {
+        std::string path = std::string(kSysBlock) + "/" + name;
+
+        // only physical disks have a device, and only internal ones are not removable
+        if (access((path + "/device").c_str(), F_OK) != 0) return;
+        uint64_t removable = 1;
+        if (!readNumber(openNode(path + "/removable"), &removable) || removable) return;
+
+        BlockDevice device;
+        device.attr.isInternal = true;
+        device.attr.name = name;
+        // every LU of a UFS device, and every hardware partition of an eMMC
+        // device, resolves under the boot device; only the one booted from counts
+        char realPath[PATH_MAX];
+        device.attr.isBootDevice = (name == "sda" || name == "mmcblk0") && !bootDevice.empty() &&
+                                   realpath(path.c_str(), realPath) &&
+                                   strstr(realPath, bootDevice.c_str()) != nullptr;
+        device.statFd = openNode(path + "/stat");
+        if (device.statFd < 0) return;
+
+        if (isWholeMmcDisk(name)) {
+            device.eolFd = openNode(path + "/device/pre_eol_info");
+            device.lifetimeAFd = openNode(path + "/device/life_time");
+            device.version = readVersion(path + "/device/fwrev");
+        } else if (name == "sda") {
+            std::string healthDescriptor = findUfsHealthDescriptor();
+            if (!healthDescriptor.empty()) {
+                device.eolFd = openNode(healthDescriptor + "/eol_info");
+                device.lifetimeAFd = openNode(healthDescriptor + "/life_time_estimation_a");
+                device.lifetimeBFd = openNode(healthDescriptor + "/life_time_estimation_b");
+            }
+            device.version = readVersion(path + "/device/rev");
+        }
+        mDevices.push_back(std::move(device));
+    }
+
+    // mmcblkN is the eMMC device itself; mmcblkNbootM and mmcblkNrpmb are
+    // hardware partitions of it, which share its health nodes
+    static bool isWholeMmcDisk(const std::string& name) {
+        static constexpr char kPrefix[] = "mmcblk";
+        constexpr size_t kPrefixLength = sizeof(kPrefix) - 1;
+        return android::base::StartsWith(name, kPrefix) && name.size() > kPrefixLength &&
+               std::all_of(name.begin() + kPrefixLength, name.end(),
+                           [](char c) { return isdigit(static_cast<unsigned char>(c)); });
+    }
+
+    // UFS devices have a single host controller, whose health descriptor
+    // applies to every LU; it is reported once, with the first LU
+    static std::string findUfsHealthDescriptor() {
+        glob_t globbuf;
+        std::string result;
+        if (glob(kUfsHealthDescriptorGlob, GLOB_NOSORT, nullptr, &globbuf) == 0 &&
+            globbuf.gl_pathc > 0) {
+            result = globbuf.gl_pathv[0];
+        }
+        globfree(&globbuf);
+        return result;
+    }
+
+    void readStorageInfoLocked() {
+        mStorageInfo.resize(0);
+        for (const BlockDevice& device : mDevices) {
+            if (device.eolFd < 0) continue;
+
+            StorageInfo info = {};
+            info.attr = device.attr;
+            info.version = device.version;
+            uint64_t value = 0;
+            if (readNumber(device.eolFd, &value)) info.eol = value;
+            if (device.lifetimeBFd < 0) {
+                // eMMC life_time holds "<type A> <type B>"
+                char buffer[32];
+                ssize_t length = readNode(device.lifetimeAFd, buffer, sizeof(buffer));
+                if (length > 0) {
+                    NumberTokenizer tokenizer(buffer, buffer + length);
+                    if (tokenizer.next(&value)) info.lifetimeA = value;
+                    if (tokenizer.next(&value)) info.lifetimeB = value;
+                }
+            } else {
+                if (readNumber(device.lifetimeAFd, &value)) info.lifetimeA = value;
+                if (readNumber(device.lifetimeBFd, &value)) info.lifetimeB = value;
+            }
+            mStorageInfo.push_back(std::move(info));
+        }
+    }
+
+    void readDiskStatsLocked() {
+        size_t count = 0;
+        mDiskStats.resize(mDevices.size());
+        for (const BlockDevice& device : mDevices) {
+            char buffer[256];
+            ssize_t length = readNode(device.statFd, buffer, sizeof(buffer));
+            if (length <= 0) continue;
+
+            // the fields follow the order of DiskStats; newer kernels append
+            // discard and flush statistics, which are ignored
+            uint64_t fields[11];
+            NumberTokenizer tokenizer(buffer, buffer + length);
+            size_t field = 0;
+            while (field < arraysize(fields) && tokenizer.next(&fields[field])) field++;
+            if (field < arraysize(fields)) continue;
+
+            DiskStats& stats = mDiskStats[count++];
+            stats.reads = fields[0];
+            stats.readMerges = fields[1];
+            stats.readSectors = fields[2];
+            stats.readTicks = fields[3];
+            stats.writes = fields[4];
+            stats.writeMerges = fields[5];
+            stats.writeSectors = fields[6];
+            stats.writeTicks = fields[7];
+            stats.ioInFlight = fields[8];
+            stats.ioTicks = fields[9];
+            stats.ioInQueue = fields[10];
+            if (stats.attr.name != device.attr.name) stats.attr = device.attr;
+        }
+        mDiskStats.resize(count);
+    }
+
+    std::mutex mLock;
+    std::vector<BlockDevice> mDevices;
+
+    std::vector<StorageInfo> mStorageInfo;
+    std::chrono::steady_clock::time_point mStorageInfoTime;
+    bool mStorageInfoValid = false;
+
+    std::vector<DiskStats> mDiskStats;
+    std::chrono::steady_clock::time_point mDiskStatsTime;
+    bool mDiskStatsValid = false;
+};
+
+}  // namespace
+
+void get_storage_info(std::vector<struct StorageInfo>& info) {
+    StorageNodes::get().getStorageInfo(&info);
 }
 
-void get_disk_stats(std::vector<struct DiskStats>&) {
-    // Use defaults
+void get_disk_stats(std::vector<struct DiskStats>& stats) {
+    StorageNodes::get().getDiskStats(&stats);
 }
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GarbageCollector.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace storage {
+namespace V1_0 {
+namespace implementation {
+
+using base::Trim;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+// Interval between reads of manual_gc while GC is running.
+static constexpr seconds kPollInterval{2};
+// Longer timeouts are clamped so that the deadline does not overflow.
+static constexpr uint64_t kMaxTimeoutSeconds = 24 * 60 * 60;
+
+GarbageCollector::GarbageCollector(std::string path) : mPath(std::move(path)) {
+    if (!mPath.empty()) {
+        mFd.reset(TEMP_FAILURE_RETRY(open(mPath.c_str(), O_RDWR | O_CLOEXEC)));
+        if (mFd == -1) {
+            PLOG(WARNING) << "Cannot open " << mPath;
+        }
+    }
+    mThread = std::thread(&GarbageCollector::threadLoop, this);
+}
+
+GarbageCollector::~GarbageCollector() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mExit = true;
+    }
+    mCv.notify_all();
+    mThread.join();
+}
+
+void GarbageCollector::start(uint64_t timeoutSeconds, const sp<IGarbageCollectCallback>& cb) {
+    if (mPath.empty()) {
+        LOG(WARNING) << "Cannot find Dev GC path";
+        if (cb != nullptr) {
+            auto ret = cb->onFinish(Result::UNKNOWN_ERROR);
+            if (!ret.isOk()) {
+                LOG(WARNING) << "Cannot return result to callback: " << ret.description();
+            }
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mDeadline = Clock::now() + seconds(std::min(timeoutSeconds, kMaxTimeoutSeconds));
+        if (cb != nullptr) {
+            mCallbacks.push_back(cb);
+        }
+        // A running GC picks up the new deadline and callback.
+        if (!mRunning) {
+            mRequested = true;
+        }
+    }
+    mCv.notify_all();
+}
+
+bool GarbageCollector::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mRunning) {
+            // run() writes 0 to manual_gc when it sees the deadline has passed.
+            mDeadline = Clock::now();
+            mCv.notify_all();
+            return true;
+        }
+    }
+    return writeControl("0");
+}
+
+GarbageCollector::Progress GarbageCollector::getProgress() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Progress progress = mProgress;
+    if (progress.running) {
+        progress.elapsed = duration_cast<milliseconds>(Clock::now() - mStartTime);
+    }
+    return progress;
+}
+
+bool GarbageCollector::readStatus(std::string* status) {
+    char buf[64];
+    ssize_t n = TEMP_FAILURE_RETRY(pread(mFd, buf, sizeof(buf) - 1, 0));
+    if (n < 0) {
+        return false;
+    }
+    buf[n] = '\0';
+    *status = Trim(buf);
+    return true;
+}
+
+bool GarbageCollector::writeControl(const char* value) {
+    size_t len = strlen(value);
+    return TEMP_FAILURE_RETRY(pwrite(mFd, value, len, 0)) == static_cast<ssize_t>(len);
+}
+
+void GarbageCollector::threadLoop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mCv.wait(lock, [this] { return mRequested || mExit; });
+        if (mExit) {
+            return;
+        }
+        mRequested = false;
+
+        std::vector<sp<IGarbageCollectCallback>> callbacks;
+        Result result = run(&lock, &callbacks);
+
+        lock.unlock();
+        for (const auto& cb : callbacks) {
+            auto ret = cb->onFinish(result);
+            if (!ret.isOk()) {
+                LOG(WARNING) << "Cannot return result to callback: " << ret.description();
+            }
+        }
+        lock.lock();
+    }
+}
+
+// Called with |lock| held. The lock is released around sysfs accesses and while waiting
+// for the next poll, so that start(), stop() and getProgress() do not wait for GC.
+// |callbacks| receives the callbacks of the requests served by this run.
+Result GarbageCollector::run(std::unique_lock<std::mutex>* lock,
+                             std::vector<sp<IGarbageCollectCallback>>* callbacks) {
+    Result result = Result::SUCCESS;
+
+    mRunning = true;
+    mStartTime = Clock::now();
+    mProgress = {};
+    mProgress.running = true;
+
+    LOG(INFO) << "Start Dev GC on " << mPath;
+    while (true) {
+        std::string status;
+        lock->unlock();
+        bool ok = readStatus(&status);
+        lock->lock();
+        if (!ok) {
+            PLOG(WARNING) << "Reading manual_gc failed in " << mPath;
+            result = Result::IO_ERROR;
+            break;
+        }
+        mProgress.status = status;
+        if (status == "" || status == "off" || status == "disabled") {
+            LOG(DEBUG) << "No more to do Dev GC";
+            break;
+        }
+        if (mExit || Clock::now() >= mDeadline) {
+            LOG(WARNING) << "Dev GC timeout or cancelled";
+            // Timeout is not treated as an error. Try next time.
+            break;
+        }
+
+        LOG(DEBUG) << "Trigger Dev GC on " << mPath;
+        lock->unlock();
+        ok = writeControl("1");
+        lock->lock();
+        if (!ok) {
+            PLOG(WARNING) << "Start Dev GC failed on " << mPath;
+            result = Result::IO_ERROR;
+            break;
+        }
+        mProgress.triggers++;
+
+        // Woken early by stop(), a request with a shorter timeout, or the destructor.
+        mCv.wait_until(*lock, std::min(Clock::now() + kPollInterval, mDeadline),
+                       [this] { return mExit || Clock::now() >= mDeadline; });
+    }
+
+    // Finish under the same lock start() takes: a request made from now on starts a run of
+    // its own instead of joining this one after it has stopped collecting.
+    mRunning = false;
+    *callbacks = std::move(mCallbacks);
+    mCallbacks.clear();
+
+    LOG(INFO) << "Stop Dev GC on " << mPath;
+    lock->unlock();
+    bool stopped = writeControl("0");
+    lock->lock();
+    if (!stopped) {
+        PLOG(WARNING) << "Stop Dev GC failed on " << mPath;
+        result = Result::IO_ERROR;
+    }
+
+    mProgress.running = false;
+    mProgress.elapsed = duration_cast<milliseconds>(Clock::now() - mStartTime);
+    mProgress.result = result;
+    return result;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace storage
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_HEALTH_STORAGE_V1_0_GARBAGECOLLECTOR_H
+#define ANDROID_HARDWARE_HEALTH_STORAGE_V1_0_GARBAGECOLLECTOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+#include <android/hardware/health/storage/1.0/IGarbageCollectCallback.h>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace storage {
+namespace V1_0 {
+namespace implementation {
+
+/**
+ * Runs Dev GC through the manual_gc sysfs node on a thread of its own, so that
+ * garbageCollect() returns to the binder thread immediately.
+ *
+ * A request made while GC is running does not start another run. It moves the
+ * deadline of the running one to its own timeout and is told the same result.
+ * In particular, a request with a timeout of 0 cancels the running GC, which is
+ * what a client does when the device leaves idle.
+ */
+class GarbageCollector {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    /** Snapshot of the current or last run, for debug(). */
+    struct Progress {
+        bool running = false;
+        // Number of times GC was triggered by writing 1 to manual_gc.
+        uint32_t triggers = 0;
+        // Time since the run started, or the duration of the last run.
+        std::chrono::milliseconds elapsed{0};
+        // Last value read from manual_gc.
+        std::string status;
+        // Result of the last finished run.
+        Result result = Result::SUCCESS;
+    };
+
+    /** |path| is the manual_gc node; it may be empty if the device has none. */
+    explicit GarbageCollector(std::string path);
+    ~GarbageCollector();
+
+    void start(uint64_t timeoutSeconds, const sp<IGarbageCollectCallback>& cb);
+
+    /** Stop GC if it is running. Returns false if manual_gc cannot be written. */
+    bool stop();
+
+    Progress getProgress();
+    const std::string& path() const { return mPath; }
+
+    /** Read manual_gc into |status|, trimmed. */
+    bool readStatus(std::string* status);
+
+   private:
+    void threadLoop();
+    Result run(std::unique_lock<std::mutex>* lock,
+               std::vector<sp<IGarbageCollectCallback>>* callbacks);
+    bool writeControl(const char* value);
+
+    const std::string mPath;
+    // manual_gc stays open for the life of the service; opened by the constructor, -1 if
+    // that failed.
+    android::base::unique_fd mFd;
+
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    bool mRequested = false;
+    bool mRunning = false;
+    bool mExit = false;
+    Clock::time_point mDeadline;
+    std::vector<sp<IGarbageCollectCallback>> mCallbacks;
+    Clock::time_point mStartTime;
+    Progress mProgress;
+    std::thread mThread;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace storage
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_HEALTH_STORAGE_V1_0_GARBAGECOLLECTOR_H
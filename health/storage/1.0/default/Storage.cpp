@@ -18,10 +18,8 @@
 
 #include <sstream>
 
-#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
-#include <android-base/strings.h>
 #include <fstab/fstab.h>
 
 namespace android {
@@ -31,11 +29,7 @@ namespace storage {
 namespace V1_0 {
 namespace implementation {
 
-using base::ReadFileToString;
-using base::Timer;
-using base::Trim;
 using base::WriteStringToFd;
-using base::WriteStringToFile;
 using fs_mgr::Fstab;
 using fs_mgr::ReadDefaultFstab;
 
@@ -52,55 +46,12 @@ std::string getGarbageCollectPath() {
     return "";
 }
 
+Storage::Storage() : mGarbageCollector(getGarbageCollectPath()) {}
+
+// GC runs on the thread of mGarbageCollector; cb is called from there when it finishes.
 Return<void> Storage::garbageCollect(uint64_t timeoutSeconds,
                                      const sp<IGarbageCollectCallback>& cb) {
-    Result result = Result::SUCCESS;
-    std::string path = getGarbageCollectPath();
-
-    if (path.empty()) {
-        LOG(WARNING) << "Cannot find Dev GC path";
-        result = Result::UNKNOWN_ERROR;
-    } else {
-        Timer timer;
-        LOG(INFO) << "Start Dev GC on " << path;
-        while (1) {
-            std::string require;
-            if (!ReadFileToString(path, &require)) {
-                PLOG(WARNING) << "Reading manual_gc failed in " << path;
-                result = Result::IO_ERROR;
-                break;
-            }
-            require = Trim(require);
-            if (require == "" || require == "off" || require == "disabled") {
-                LOG(DEBUG) << "No more to do Dev GC";
-                break;
-            }
-            LOG(DEBUG) << "Trigger Dev GC on " << path;
-            if (!WriteStringToFile("1", path)) {
-                PLOG(WARNING) << "Start Dev GC failed on " << path;
-                result = Result::IO_ERROR;
-                break;
-            }
-            if (timer.duration() >= std::chrono::seconds(timeoutSeconds)) {
-                LOG(WARNING) << "Dev GC timeout";
-                // Timeout is not treated as an error. Try next time.
-                break;
-            }
-            sleep(2);
-        }
-        LOG(INFO) << "Stop Dev GC on " << path;
-        if (!WriteStringToFile("0", path)) {
-            PLOG(WARNING) << "Stop Dev GC failed on " << path;
-            result = Result::IO_ERROR;
-        }
-    }
-
-    if (cb != nullptr) {
-        auto ret = cb->onFinish(result);
-        if (!ret.isOk()) {
-            LOG(WARNING) << "Cannot return result to callback: " << ret.description();
-        }
-    }
+    mGarbageCollector.start(timeoutSeconds, cb);
     return Void();
 }
 
@@ -112,17 +63,25 @@ Return<void> Storage::debug(const hidl_handle& handle, const hidl_vec<hidl_strin
     int fd = handle->data[0];
     std::stringstream output;
 
-    std::string path = getGarbageCollectPath();
+    const std::string& path = mGarbageCollector.path();
     if (path.empty()) {
         output << "Cannot find Dev GC path";
     } else {
         std::string require;
 
-        if (ReadFileToString(path, &require)) {
+        if (mGarbageCollector.readStatus(&require)) {
             output << path << ":" << require << std::endl;
         }
 
-        if (WriteStringToFile("0", path)) {
+        GarbageCollector::Progress progress = mGarbageCollector.getProgress();
+        output << (progress.running ? "running" : "last run") << ": triggered "
+               << progress.triggers << " times in " << progress.elapsed.count() << "ms";
+        if (!progress.running) {
+            output << ", result " << toString(progress.result);
+        }
+        output << std::endl;
+
+        if (mGarbageCollector.stop()) {
             output << "stop success" << std::endl;
         }
     }
@@ -20,6 +20,8 @@
 #include <android/hardware/health/storage/1.0/IStorage.h>
 #include <hidl/Status.h>
 
+#include "GarbageCollector.h"
+
 namespace android {
 namespace hardware {
 namespace health {
@@ -34,9 +36,14 @@ using ::android::hardware::hidl_vec;
 using ::android::hardware::Return;
 
 struct Storage : public IStorage {
+    Storage();
+
     Return<void> garbageCollect(uint64_t timeoutSeconds,
                                 const sp<IGarbageCollectCallback>& cb) override;
     Return<void> debug(const hidl_handle& handle, const hidl_vec<hidl_string>&) override;
+
+   private:
+    GarbageCollector mGarbageCollector;
 };
 
 }  // namespace implementation
@@ -40,8 +40,6 @@
 using namespace android;
 using namespace std::chrono_literals;
 
-#define POWER_SUPPLY_SUBSYSTEM "power_supply"
-
 namespace android {
 namespace hardware {
 namespace health {
@@ -130,7 +128,6 @@ void HealthLoop::UeventEvent(uint32_t /*epevents*/) {
     // No need to lock because uevent_fd_ is guaranteed to be initialized.
 
     char msg[UEVENT_MSG_LEN + 2];
-    char* cp;
     int n;
 
     n = uevent_kernel_multicast_recv(uevent_fd_, msg, UEVENT_MSG_LEN);
@@ -140,18 +137,12 @@ void HealthLoop::UeventEvent(uint32_t /*epevents*/) {
 
     msg[n] = '\0';
     msg[n + 1] = '\0';
-    cp = msg;
 
-    while (*cp) {
-        if (!strcmp(cp, "SUBSYSTEM=" POWER_SUPPLY_SUBSYSTEM)) {
-            ScheduleBatteryUpdate();
-            break;
-        }
+    if (ParsePowerSupplyUevent(msg, &uevent_)) UeventBatteryUpdate(uevent_);
+}
 
-        /* advance to after the next \0 */
-        while (*cp++)
-            ;
-    }
+void HealthLoop::UeventBatteryUpdate(const PowerSupplyUevent& /*event*/) {
+    ScheduleBatteryUpdate();
 }
 
 void HealthLoop::UeventInit(void) {
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <health/PowerSupplyUevent.h>
+
+#include <string.h>
+
+#define POWER_SUPPLY_SUBSYSTEM "power_supply"
+#define POWER_SUPPLY_PREFIX "POWER_SUPPLY_"
+
+namespace android {
+namespace hardware {
+namespace health {
+
+bool ParsePowerSupplyUevent(const char* msg, PowerSupplyUevent* event) {
+    bool power_supply = false;
+
+    event->name.clear();
+    event->type.clear();
+    event->properties.clear();
+
+    for (const char* cp = msg; *cp; cp += strlen(cp) + 1) {
+        if (!strcmp(cp, "SUBSYSTEM=" POWER_SUPPLY_SUBSYSTEM)) {
+            power_supply = true;
+            continue;
+        }
+
+        if (strncmp(cp, POWER_SUPPLY_PREFIX, strlen(POWER_SUPPLY_PREFIX))) continue;
+
+        const char* key = cp + strlen(POWER_SUPPLY_PREFIX);
+        const char* eq = strchr(key, '=');
+        if (eq == nullptr || eq == key) continue;
+
+        std::string name(key, eq - key);
+        if (name == "NAME") {
+            event->name = eq + 1;
+        } else if (name == "TYPE") {
+            event->type = eq + 1;
+        } else {
+            event->properties[std::move(name)] = eq + 1;
+        }
+    }
+
+    return power_supply;
+}
+
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
@@ -22,6 +22,8 @@
 #include <android-base/unique_fd.h>
 #include <healthd/healthd.h>
 
+#include <health/PowerSupplyUevent.h>
+
 namespace android {
 namespace hardware {
 namespace health {
@@ -58,6 +60,13 @@ class HealthLoop {
     // healthd_mode_ops->battery_update(BatteryProperties*).
     virtual void ScheduleBatteryUpdate() = 0;
 
+    // Called instead of ScheduleBatteryUpdate() when a power_supply uevent is
+    // received. |event| holds the POWER_SUPPLY_* pairs of the uevent, so an
+    // implementation may update only the properties that it carries and leave
+    // full sysfs reads to the periodic chores. The default implementation calls
+    // ScheduleBatteryUpdate().
+    virtual void UeventBatteryUpdate(const PowerSupplyUevent& event);
+
     // Register an epoll event. When there is an event, |func| will be
     // called with |this| as the first argument and |epevents| as the second.
     // This may be called in a different thread from where StartLoop is called
@@ -101,6 +110,9 @@ class HealthLoop {
     // If set to true, future RegisterEvent() will be rejected. This is to ensure all
     // events are registered before StartLoop().
     bool reject_event_register_ = false;
+
+    // Only used by UeventEvent(); kept to reuse its allocations.
+    PowerSupplyUevent uevent_;
 };
 
 }  // namespace health
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <map>
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace health {
+
+// The POWER_SUPPLY_* key/value pairs carried by a power_supply uevent.
+struct PowerSupplyUevent {
+    // Value of POWER_SUPPLY_NAME, e.g. "battery" or "usb".
+    std::string name;
+    // Value of POWER_SUPPLY_TYPE, e.g. "Battery", "USB" or "Mains". Empty if the
+    // kernel did not send it.
+    std::string type;
+    // All other POWER_SUPPLY_* pairs, keyed without the prefix, e.g. "CAPACITY" -> "87".
+    std::map<std::string, std::string> properties;
+};
+
+// Parse a uevent message, which is a sequence of NUL-terminated strings ending with
+// an empty string. Returns false if the message is not from the power_supply subsystem;
+// |event| is unspecified in that case.
+bool ParsePowerSupplyUevent(const char* msg, PowerSupplyUevent* event);
+
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
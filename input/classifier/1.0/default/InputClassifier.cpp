@@ -18,6 +18,10 @@
 
 #include "InputClassifier.h"
 #include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+
 #include <log/log.h>
 #include <utils/Timers.h>
 
@@ -30,28 +34,103 @@ namespace classifier {
 namespace V1_0 {
 namespace implementation {
 
+InputClassifier::InputClassifier(std::unique_ptr<MotionModel> model) : mModel(std::move(model)) {}
+
 // Methods from ::android::hardware::input::classifier::V1_0::IInputClassifier follow.
-Return<Classification> InputClassifier::classify(const MotionEvent& /*event*/) {
+Return<Classification> InputClassifier::classify(const MotionEvent& event) {
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
     /**
-     * The touchscreen data is highly device-dependent.
-     * As a result, the implementation of this method will likely be hardware-specific.
-     * Here we just report gesture as not having any classification, which means that the
-     * default action will be taken in the framework.
-     * This is equivalent to not having the InputClassifier HAL at all.
+     * The touchscreen data is highly device-dependent, so a real implementation will likely
+     * swap in a hardware-specific model. The features it is given are computed from the
+     * recent pointer samples of the device, kept in a fixed size ring, so the only allocation
+     * on this path is the state for a device seen for the first time.
      */
-    return Classification::NONE;
+    if ((static_cast<uint32_t>(event.source) & static_cast<uint32_t>(Source::TOUCHSCREEN)) !=
+        static_cast<uint32_t>(Source::TOUCHSCREEN)) {
+        return Classification::NONE;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    DeviceState& device = mDevices[event.deviceId];
+    if (event.action == Action::DOWN) {
+        device.classification = Classification::NONE;
+        device.overBudget = false;
+    }
+    device.history.push(event);
+
+    // Once classified, a gesture keeps its classification until it ends.
+    MotionFeatures features;
+    if (device.classification == Classification::NONE && !device.overBudget &&
+        device.history.extract(&features)) {
+        if (systemTime(SYSTEM_TIME_MONOTONIC) - start > kLatencyBudget) {
+            device.overBudget = true;
+        } else {
+            device.classification = mModel->classify(features);
+        }
+    }
+    const Classification classification = device.classification;
+    if (event.action == Action::UP || event.action == Action::CANCEL) {
+        device.history.clear();
+        device.classification = Classification::NONE;
+    }
+
+    const nsecs_t latency = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    recordLatencyLocked(latency);
+    if (latency > kLatencyBudget) {
+        // Too late to trust; the framework takes the default action instead.
+        device.overBudget = true;
+        return Classification::NONE;
+    }
+    return classification;
 }
 
 Return<void> InputClassifier::reset() {
-    // We don't have any internal state, so no work needed here.
+    std::lock_guard<std::mutex> lock(mLock);
+    mDevices.clear();
     return Void();
 }
 
-Return<void> InputClassifier::resetDevice(int32_t /*deviceId*/) {
-    // We don't have any internal per-device state, so no work needed here.
+Return<void> InputClassifier::resetDevice(int32_t deviceId) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mDevices.erase(deviceId);
     return Void();
 }
 
+Return<void> InputClassifier::debug(const hidl_handle& fd, const hidl_vec<hidl_string>&) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        return Void();
+    }
+    const int out = fd->data[0];
+    std::lock_guard<std::mutex> lock(mLock);
+    dprintf(out, "InputClassifier: %zu devices, %" PRIu64 " events, %" PRIu64
+                 " over the %" PRId64 " us budget, max %" PRId64 " us\n",
+            mDevices.size(), mEventCount, mOverrunCount, kLatencyBudget / 1000,
+            mMaxLatency / 1000);
+    for (size_t i = 0; i < kLatencyBuckets; i++) {
+        if (mLatencyHistogram[i] == 0) {
+            continue;
+        }
+        const bool last = i == kLatencyBuckets - 1;
+        dprintf(out, "  %s %u us: %" PRIu64 "\n", last ? ">=" : "<", last ? 1u << (i - 1) : 1u << i,
+                mLatencyHistogram[i]);
+    }
+    return Void();
+}
+
+void InputClassifier::recordLatencyLocked(nsecs_t latency) {
+    mEventCount++;
+    if (latency > kLatencyBudget) {
+        mOverrunCount++;
+    }
+    mMaxLatency = std::max(mMaxLatency, latency);
+    const uint64_t micros = latency / 1000;
+    size_t bucket = 0;
+    while (bucket < kLatencyBuckets - 1 && micros >= (1u << bucket)) {
+        bucket++;
+    }
+    mLatencyHistogram[bucket]++;
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace classifier
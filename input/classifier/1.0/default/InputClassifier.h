@@ -17,8 +17,15 @@
 #ifndef ANDROID_HARDWARE_INPUT_CLASSIFIER_V1_0_INPUTCLASSIFIER_H
 #define ANDROID_HARDWARE_INPUT_CLASSIFIER_V1_0_INPUTCLASSIFIER_H
 
+#include <map>
+#include <memory>
+#include <mutex>
+
 #include <android/hardware/input/classifier/1.0/IInputClassifier.h>
 #include <hidl/Status.h>
+#include <utils/Timers.h>
+
+#include "MotionClassifier.h"
 
 namespace android {
 namespace hardware {
@@ -27,9 +34,22 @@ namespace classifier {
 namespace V1_0 {
 namespace implementation {
 
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
 using ::android::hardware::Return;
 
 struct InputClassifier : public IInputClassifier {
+    /**
+     * The time classify() may take, measured from the call until the result is ready.
+     * A gesture whose event overruns it is left unclassified until the next DOWN, so a slow
+     * model can never hold up the events that follow.
+     */
+    static constexpr nsecs_t kLatencyBudget = 500 * 1000;  // 500 us
+
+    explicit InputClassifier(
+            std::unique_ptr<MotionModel> model = std::make_unique<LinearMotionModel>());
+
     // Methods from ::android::hardware::input::classifier::V1_0::IInputClassifier follow.
 
     Return<android::hardware::input::common::V1_0::Classification> classify(
@@ -37,6 +57,30 @@ struct InputClassifier : public IInputClassifier {
 
     Return<void> reset() override;
     Return<void> resetDevice(int32_t deviceId) override;
+
+    // Dumps the classify() latency statistics.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override;
+
+  private:
+    struct DeviceState {
+        MotionHistory history;
+        Classification classification = Classification::NONE;
+        bool overBudget = false;
+    };
+
+    // Latencies are counted in power of two microsecond buckets, the last one open ended.
+    static constexpr size_t kLatencyBuckets = 16;
+
+    void recordLatencyLocked(nsecs_t latency);
+
+    const std::unique_ptr<MotionModel> mModel;
+
+    std::mutex mLock;
+    std::map<int32_t, DeviceState> mDevices;
+    uint64_t mEventCount = 0;
+    uint64_t mOverrunCount = 0;
+    nsecs_t mMaxLatency = 0;
+    uint64_t mLatencyHistogram[kLatencyBuckets] = {};
 };
 
 }  // namespace implementation
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MotionClassifier.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+using namespace android::hardware::input::common::V1_0;
+
+namespace android {
+namespace hardware {
+namespace input {
+namespace classifier {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+constexpr float kNanosPerMilli = 1000000.0f;
+
+/**
+ * The axis bits come straight from the framework's PointerCoords, where axis n is bit (63 - n)
+ * and the values are packed in bit order.
+ */
+float getAxisValue(const PointerCoords& coords, Axis axis) {
+    const uint64_t bit = 0x8000000000000000ULL >> static_cast<uint64_t>(axis);
+    if (!(coords.bits & bit)) {
+        return 0;
+    }
+    const size_t index = __builtin_popcountll(coords.bits & ~(bit | (bit - 1)));
+    return index < coords.values.size() ? coords.values[index] : 0;
+}
+
+}  // namespace
+
+// Pressure alone stays below the threshold, so a finger resting firmly is not a deep press
+// unless it keeps pressing harder.
+const LinearMotionModel::Weights LinearMotionModel::kUncalibratedWeights = {
+        .pressureDelta = 4.0f,
+        .sizeDelta = 2.0f,
+        .pressure = 0.8f,
+        .threshold = 1.0f,
+        .maxSpeed = 0.05f,
+        .minDuration = 150 * 1000000LL,
+};
+
+void MotionHistory::clear() {
+    mHead = 0;
+    mCount = 0;
+}
+
+void MotionHistory::push(const MotionEvent& event) {
+    if (event.action == Action::DOWN) {
+        clear();
+    }
+    mDownTime = event.downTime;
+
+    const size_t slot = mHead;
+    mEventTime[slot] = event.eventTime;
+    mIdBits[slot] = 0;
+    memset(mX[slot], 0, sizeof(mX[slot]));
+    memset(mY[slot], 0, sizeof(mY[slot]));
+    memset(mPressure[slot], 0, sizeof(mPressure[slot]));
+    memset(mSize[slot], 0, sizeof(mSize[slot]));
+
+    const size_t pointerCount =
+            std::min(event.pointerProperties.size(), event.pointerCoords.size());
+    for (size_t i = 0; i < pointerCount; i++) {
+        const int32_t id = event.pointerProperties[i].id;
+        if (id < 0 || id >= static_cast<int32_t>(kMaxPointerLanes)) {
+            continue;
+        }
+        const PointerCoords& coords = event.pointerCoords[i];
+        mIdBits[slot] |= 1u << id;
+        mX[slot][id] = getAxisValue(coords, Axis::X);
+        mY[slot][id] = getAxisValue(coords, Axis::Y);
+        mPressure[slot][id] = getAxisValue(coords, Axis::PRESSURE);
+        mSize[slot][id] = getAxisValue(coords, Axis::SIZE);
+    }
+
+    mHead = (mHead + 1) % kCapacity;
+    if (mCount < kCapacity) {
+        mCount++;
+    }
+}
+
+bool MotionHistory::extract(MotionFeatures* features) const {
+    if (mCount < 2) {
+        return false;
+    }
+    const size_t cur = newest();
+    // The oldest sample that still holds at least one of the current pointers.
+    size_t old = cur;
+    uint32_t validBits = 0;
+    for (size_t age = mCount - 1; age > 0; age--) {
+        const size_t slot = (cur + kCapacity - age) % kCapacity;
+        validBits = mIdBits[slot] & mIdBits[cur];
+        if (validBits) {
+            old = slot;
+            break;
+        }
+    }
+    const int64_t dt = mEventTime[cur] - mEventTime[old];
+    if (!validBits || dt <= 0) {
+        return false;
+    }
+
+    features->validBits = validBits;
+    features->gestureDuration = mEventTime[cur] - mDownTime;
+    const float invDtMillis = kNanosPerMilli / dt;
+    for (size_t i = 0; i < kMaxPointerLanes; i++) {
+        const float mask = (validBits >> i) & 1;
+        features->vx[i] = (mX[cur][i] - mX[old][i]) * invDtMillis * mask;
+        features->vy[i] = (mY[cur][i] - mY[old][i]) * invDtMillis * mask;
+        features->pressure[i] = mPressure[cur][i] * mask;
+        features->pressureDelta[i] = (mPressure[cur][i] - mPressure[old][i]) * mask;
+        features->sizeDelta[i] = (mSize[cur][i] - mSize[old][i]) * mask;
+    }
+    for (size_t i = 0; i < kMaxPointerLanes; i++) {
+        features->speed[i] = sqrtf(features->vx[i] * features->vx[i] +
+                                   features->vy[i] * features->vy[i]);
+    }
+    return true;
+}
+
+Classification LinearMotionModel::classify(const MotionFeatures& features) const {
+    if (!mWeights) {
+        return Classification::NONE;
+    }
+    const Weights& weights = *mWeights;
+    // Deep press is a single finger gesture.
+    if (__builtin_popcount(features.validBits) != 1 ||
+        features.gestureDuration < weights.minDuration) {
+        return Classification::NONE;
+    }
+    const size_t id = __builtin_ctz(features.validBits);
+    if (features.speed[id] > weights.maxSpeed) {
+        return Classification::NONE;
+    }
+    const float score = weights.pressureDelta * features.pressureDelta[id] +
+                        weights.sizeDelta * features.sizeDelta[id] +
+                        weights.pressure * features.pressure[id];
+    return score >= weights.threshold ? Classification::DEEP_PRESS : Classification::NONE;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace classifier
+}  // namespace input
+}  // namespace hardware
+}  // namespace android
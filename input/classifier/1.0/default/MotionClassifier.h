@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_INPUT_CLASSIFIER_V1_0_MOTIONCLASSIFIER_H
+#define ANDROID_HARDWARE_INPUT_CLASSIFIER_V1_0_MOTIONCLASSIFIER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <optional>
+
+#include <android/hardware/input/common/1.0/types.h>
+
+namespace android {
+namespace hardware {
+namespace input {
+namespace classifier {
+namespace V1_0 {
+namespace implementation {
+
+using ::android::hardware::input::common::V1_0::Classification;
+using ::android::hardware::input::common::V1_0::MotionEvent;
+
+// One lane per pointer id. The framework never hands out ids above 31.
+constexpr size_t kMaxPointerLanes = 32;
+
+/**
+ * Per-pointer features of the current gesture, computed between the newest sample in the
+ * history and the oldest one still holding the same pointer.
+ *
+ * The arrays are indexed by pointer id, so every feature is computed by one branch-free loop
+ * over all the lanes that the compiler can vectorize; lanes not in validBits are zero.
+ */
+struct MotionFeatures {
+    uint32_t validBits;
+    // Time since the gesture went down, in nanoseconds.
+    int64_t gestureDuration;
+    // In pixels per millisecond.
+    float vx[kMaxPointerLanes];
+    float vy[kMaxPointerLanes];
+    float speed[kMaxPointerLanes];
+    float pressure[kMaxPointerLanes];
+    // Change over the history window.
+    float pressureDelta[kMaxPointerLanes];
+    float sizeDelta[kMaxPointerLanes];
+};
+
+/**
+ * A bounded ring of the latest pointer samples of one device, stored as structure of arrays.
+ * Pushing a sample never allocates; once the ring is full the oldest sample is dropped.
+ */
+class MotionHistory {
+  public:
+    static constexpr size_t kCapacity = 8;
+
+    // Appends the pointers of the event. A DOWN event starts a new gesture and clears the ring.
+    void push(const MotionEvent& event);
+    void clear();
+    bool empty() const { return mCount == 0; }
+
+    // Returns false if there is not enough history for any pointer.
+    bool extract(MotionFeatures* features) const;
+
+  private:
+    size_t newest() const { return (mHead + kCapacity - 1) % kCapacity; }
+
+    size_t mHead = 0;
+    size_t mCount = 0;
+    int64_t mDownTime = 0;
+    int64_t mEventTime[kCapacity];
+    uint32_t mIdBits[kCapacity];
+    float mX[kCapacity][kMaxPointerLanes];
+    float mY[kCapacity][kMaxPointerLanes];
+    float mPressure[kCapacity][kMaxPointerLanes];
+    float mSize[kCapacity][kMaxPointerLanes];
+};
+
+/**
+ * Turns the features of a gesture into a classification. Implementations are called on the
+ * input dispatch path for every event, and must not block or allocate.
+ */
+class MotionModel {
+  public:
+    virtual ~MotionModel() = default;
+    virtual Classification classify(const MotionFeatures& features) const = 0;
+};
+
+/**
+ * Reports DEEP_PRESS when a single, nearly stationary pointer scores above a threshold on a
+ * weighted sum of its pressure and contact size growth. Everything else is left unclassified.
+ *
+ * Pressure and size units differ between touchscreens, so the weights have to be calibrated
+ * for the device. Without weights the model reports nothing.
+ */
+class LinearMotionModel : public MotionModel {
+  public:
+    struct Weights {
+        float pressureDelta;
+        float sizeDelta;
+        float pressure;
+        float threshold;
+        // Faster pointers are scrolling or flinging, not pressing, in pixels per millisecond.
+        float maxSpeed;
+        // Presses shorter than this are taps, in nanoseconds.
+        int64_t minDuration;
+    };
+
+    // Placeholder weights picked on synthetic gestures, not calibrated for any device.
+    static const Weights kUncalibratedWeights;
+
+    LinearMotionModel() = default;
+    explicit LinearMotionModel(const Weights& weights) : mWeights(weights) {}
+
+    Classification classify(const MotionFeatures& features) const override;
+
+  private:
+    const std::optional<Weights> mWeights;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace classifier
+}  // namespace input
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_INPUT_CLASSIFIER_V1_0_MOTIONCLASSIFIER_H
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "MotionClassifier.h"
+
+using namespace android::hardware::input::common::V1_0;
+
+namespace android {
+namespace hardware {
+namespace input {
+namespace classifier {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+constexpr int64_t kPeriod = 8333333;  // 120 Hz
+
+struct TouchSample {
+    int32_t id;
+    float x;
+    float y;
+    float pressure;
+    float size;
+};
+
+MotionEvent getTouchEvent(Action action, int64_t downTime, int64_t eventTime,
+                          const std::vector<TouchSample>& samples) {
+    MotionEvent event = {};
+    event.action = action;
+    event.source = Source::TOUCHSCREEN;
+    event.downTime = downTime;
+    event.eventTime = eventTime;
+    event.pointerCoords.resize(samples.size());
+    event.pointerProperties.resize(samples.size());
+    for (size_t i = 0; i < samples.size(); i++) {
+        // As sent by the framework: axis n is bit (63 - n), values packed in bit order.
+        event.pointerCoords[i].bits = 0xF000000000000000ULL;  // X, Y, PRESSURE, SIZE
+        event.pointerCoords[i].values = {samples[i].x, samples[i].y, samples[i].pressure,
+                                         samples[i].size};
+        event.pointerProperties[i].id = samples[i].id;
+        event.pointerProperties[i].toolType = ToolType::FINGER;
+    }
+    return event;
+}
+
+// A gesture of the given number of moves between DOWN and UP, sampled at 120 Hz
+std::vector<MotionEvent> getGesture(size_t moves,
+                                    std::function<std::vector<TouchSample>(size_t)> sampleAt) {
+    std::vector<MotionEvent> gesture;
+    gesture.push_back(getTouchEvent(Action::DOWN, 0, 0, sampleAt(0)));
+    for (size_t i = 1; i <= moves; i++) {
+        gesture.push_back(getTouchEvent(Action::MOVE, 0, i * kPeriod, sampleAt(i)));
+    }
+    gesture.push_back(getTouchEvent(Action::UP, 0, (moves + 1) * kPeriod, sampleAt(moves)));
+    return gesture;
+}
+
+class MotionClassifierTest : public ::testing::Test {
+  protected:
+    // Classifies every event of the gesture the way InputClassifier does, and returns the
+    // time of the first DEEP_PRESS, or -1
+    int64_t getDeepPressTime(const std::vector<MotionEvent>& gesture) {
+        return getDeepPressTime(gesture, mModel);
+    }
+
+    int64_t getDeepPressTime(const std::vector<MotionEvent>& gesture, const MotionModel& model) {
+        for (const MotionEvent& event : gesture) {
+            mHistory.push(event);
+            MotionFeatures features;
+            if (mHistory.extract(&features) &&
+                model.classify(features) == Classification::DEEP_PRESS) {
+                return event.eventTime;
+            }
+        }
+        return -1;
+    }
+
+    MotionHistory mHistory;
+    LinearMotionModel mModel{LinearMotionModel::kUncalibratedWeights};
+};
+
+}  // namespace
+
+TEST_F(MotionClassifierTest, tapIsNotDeepPress) {
+    auto gesture =
+            getGesture(4, [](size_t) { return std::vector<TouchSample>{{0, 300, 600, 0.4, 0.1}}; });
+    ASSERT_EQ(-1, getDeepPressTime(gesture));
+}
+
+TEST_F(MotionClassifierTest, hardTapIsNotDeepPress) {
+    auto gesture = getGesture(8, [](size_t i) {
+        return std::vector<TouchSample>{{0, 300, 600, 0.3f + 0.08f * i, 0.1f + 0.02f * i}};
+    });
+    ASSERT_EQ(-1, getDeepPressTime(gesture));
+}
+
+TEST_F(MotionClassifierTest, restingFingerIsNotDeepPress) {
+    auto gesture = getGesture(60, [](size_t) {
+        return std::vector<TouchSample>{{0, 500, 900, 0.9, 0.3}};
+    });
+    ASSERT_EQ(-1, getDeepPressTime(gesture));
+}
+
+TEST_F(MotionClassifierTest, sustainedPressIsDeepPress) {
+    auto gesture = getGesture(60, [](size_t i) {
+        return std::vector<TouchSample>{
+                {0, 500, 900, std::min(0.3f + 0.02f * i, 1.f), std::min(0.1f + 0.005f * i, 1.f)}};
+    });
+    int64_t deepPressTime = getDeepPressTime(gesture);
+    ASSERT_NE(-1, deepPressTime);
+    ASSERT_GE(deepPressTime, LinearMotionModel::kUncalibratedWeights.minDuration);
+}
+
+TEST_F(MotionClassifierTest, modelWithoutWeightsReportsNothing) {
+    auto gesture = getGesture(60, [](size_t i) {
+        return std::vector<TouchSample>{
+                {0, 500, 900, std::min(0.3f + 0.02f * i, 1.f), std::min(0.1f + 0.005f * i, 1.f)}};
+    });
+    ASSERT_EQ(-1, getDeepPressTime(gesture, LinearMotionModel()));
+}
+
+TEST_F(MotionClassifierTest, pressingFlingIsNotDeepPress) {
+    auto gesture = getGesture(20, [](size_t i) {
+        return std::vector<TouchSample>{
+                {0, 300.f + 25 * i, 600.f - 40 * i, 0.3f + 0.02f * i, 0.1f + 0.005f * i}};
+    });
+    ASSERT_EQ(-1, getDeepPressTime(gesture));
+}
+
+TEST_F(MotionClassifierTest, pressingPinchIsNotDeepPress) {
+    auto gesture = getGesture(30, [](size_t i) {
+        return std::vector<TouchSample>{
+                {0, 400.f - 5 * i, 800.f - 5 * i, 0.3f + 0.02f * i, 0.1f + 0.005f * i},
+                {1, 600.f + 5 * i, 1000.f + 5 * i, 0.3f + 0.02f * i, 0.1f + 0.005f * i}};
+    });
+    ASSERT_EQ(-1, getDeepPressTime(gesture));
+}
+
+TEST_F(MotionClassifierTest, downStartsNewGesture) {
+    auto press = getGesture(60, [](size_t i) {
+        return std::vector<TouchSample>{
+                {0, 500, 900, std::min(0.3f + 0.02f * i, 1.f), std::min(0.1f + 0.005f * i, 1.f)}};
+    });
+    ASSERT_NE(-1, getDeepPressTime(press));
+
+    auto tap =
+            getGesture(4, [](size_t) { return std::vector<TouchSample>{{0, 300, 600, 0.4, 0.1}}; });
+    ASSERT_EQ(-1, getDeepPressTime(tap));
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace classifier
+}  // namespace input
+}  // namespace hardware
+}  // namespace android
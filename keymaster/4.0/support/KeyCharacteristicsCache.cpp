@@ -0,0 +1,141 @@
+/*
+ **
+ ** Copyright 2019, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include <keymasterV4_0/KeyCharacteristicsCache.h>
+
+#include <openssl/sha.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace support {
+
+namespace {
+
+void updateWithLength(SHA256_CTX* ctx, const hidl_vec<uint8_t>& data) {
+    uint64_t length = data.size();
+    SHA256_Update(ctx, &length, sizeof(length));
+    SHA256_Update(ctx, data.data(), data.size());
+}
+
+std::string digestOf(const hidl_vec<uint8_t>& data) {
+    std::string digest(SHA256_DIGEST_LENGTH, '\0');
+    SHA256(data.data(), data.size(), reinterpret_cast<uint8_t*>(&digest[0]));
+    return digest;
+}
+
+std::string digestOf(const hidl_vec<uint8_t>& clientId, const hidl_vec<uint8_t>& appData) {
+    // Length prefixed, so that moving bytes from one to the other changes the digest.
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    updateWithLength(&ctx, clientId);
+    updateWithLength(&ctx, appData);
+    std::string digest(SHA256_DIGEST_LENGTH, '\0');
+    SHA256_Final(reinterpret_cast<uint8_t*>(&digest[0]), &ctx);
+    return digest;
+}
+
+}  // namespace
+
+ErrorCode KeyCharacteristicsCache::getKeyCharacteristics(Keymaster& keymaster,
+                                                         const hidl_vec<uint8_t>& keyBlob,
+                                                         const hidl_vec<uint8_t>& clientId,
+                                                         const hidl_vec<uint8_t>& appData,
+                                                         KeyCharacteristics* characteristics) {
+    std::string blobDigest = digestOf(keyBlob);
+    std::string paramsDigest = digestOf(clientId, appData);
+    if (lookup(blobDigest, paramsDigest, characteristics)) return ErrorCode::OK;
+
+    // Not holding the lock across the call, which may take a while in the secure world.
+    ErrorCode result = ErrorCode::UNKNOWN_ERROR;
+    auto rc = keymaster.getKeyCharacteristics(
+        keyBlob, clientId, appData,
+        [&](ErrorCode error, const KeyCharacteristics& keyCharacteristics) {
+            result = error;
+            if (error == ErrorCode::OK) *characteristics = keyCharacteristics;
+        });
+    if (!rc.isOk()) return ErrorCode::UNKNOWN_ERROR;
+    if (result != ErrorCode::OK) {
+        keymaster.logIfKeymasterVendorError(result);
+        return result;
+    }
+
+    insert(std::move(blobDigest), std::move(paramsDigest), *characteristics);
+    return ErrorCode::OK;
+}
+
+void KeyCharacteristicsCache::put(const hidl_vec<uint8_t>& keyBlob,
+                                  const hidl_vec<uint8_t>& clientId,
+                                  const hidl_vec<uint8_t>& appData,
+                                  const KeyCharacteristics& characteristics) {
+    insert(digestOf(keyBlob), digestOf(clientId, appData), characteristics);
+}
+
+void KeyCharacteristicsCache::erase(const hidl_vec<uint8_t>& keyBlob) {
+    std::string blobDigest = digestOf(keyBlob);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(blobDigest);
+    if (it == index_.end()) return;
+    entries_.erase(it->second);
+    index_.erase(it);
+}
+
+void KeyCharacteristicsCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_.clear();
+    entries_.clear();
+}
+
+bool KeyCharacteristicsCache::lookup(const std::string& blobDigest,
+                                     const std::string& paramsDigest,
+                                     KeyCharacteristics* characteristics) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(blobDigest);
+    if (it == index_.end() || it->second->paramsDigest != paramsDigest) return false;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    *characteristics = it->second->characteristics;
+    return true;
+}
+
+void KeyCharacteristicsCache::insert(std::string blobDigest, std::string paramsDigest,
+                                     const KeyCharacteristics& characteristics) {
+    if (capacity_ == 0) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(blobDigest);
+    if (it != index_.end()) {
+        // Replace the entry, which may have been fetched with other parameters.
+        it->second->paramsDigest = std::move(paramsDigest);
+        it->second->characteristics = characteristics;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return;
+    }
+
+    entries_.push_front({blobDigest, std::move(paramsDigest), characteristics});
+    index_.emplace(std::move(blobDigest), entries_.begin());
+    if (entries_.size() > capacity_) {
+        index_.erase(entries_.back().blobDigest);
+        entries_.pop_back();
+    }
+}
+
+}  // namespace support
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
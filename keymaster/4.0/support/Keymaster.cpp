@@ -16,6 +16,7 @@
 
 #include <keymasterV4_0/Keymaster.h>
 
+#include <future>
 #include <iomanip>
 
 #include <android-base/logging.h>
@@ -79,28 +80,49 @@ std::ostream& operator<<(std::ostream& os, const Keymaster& keymaster) {
     return os;
 }
 
+// Connecting to an instance and fetching its hardware info are both binder round trips to a
+// secure world that may be slow to respond (StrongBox in particular), so each instance is set up
+// on a thread of its own.
+template <typename Wrapper>
+static std::unique_ptr<Keymaster> connectDevice(const hidl_string& name, bool required) {
+    auto& descriptor = Wrapper::WrappedIKeymasterDevice::descriptor;
+    auto device = Wrapper::WrappedIKeymasterDevice::getService(name);
+    if (!device) {
+        CHECK(!required) << "Failed to get service for " << descriptor << " with interface name "
+                         << name;
+        return nullptr;
+    }
+    std::unique_ptr<Keymaster> keymaster(new Wrapper(device, name));
+    keymaster->halVersion();
+    return keymaster;
+}
+
 template <typename Wrapper>
 std::vector<std::unique_ptr<Keymaster>> enumerateDevices(
     const sp<IServiceManager>& serviceManager) {
     Keymaster::KeymasterSet result;
+    std::vector<std::future<std::unique_ptr<Keymaster>>> devices;
 
     bool foundDefault = false;
     auto& descriptor = Wrapper::WrappedIKeymasterDevice::descriptor;
     serviceManager->listManifestByInterface(descriptor, [&](const hidl_vec<hidl_string>& names) {
         for (auto& name : names) {
             if (name == "default") foundDefault = true;
-            auto device = Wrapper::WrappedIKeymasterDevice::getService(name);
-            CHECK(device) << "Failed to get service for " << descriptor << " with interface name "
-                          << name;
-            result.push_back(std::unique_ptr<Keymaster>(new Wrapper(device, name)));
+            devices.push_back(std::async(std::launch::async, connectDevice<Wrapper>, name,
+                                         true /* required */));
         }
     });
 
     if (!foundDefault) {
         // "default" wasn't provided by listManifestByInterface.  Maybe there's a passthrough
         // implementation.
-        auto device = Wrapper::WrappedIKeymasterDevice::getService("default");
-        if (device) result.push_back(std::unique_ptr<Keymaster>(new Wrapper(device, "default")));
+        devices.push_back(std::async(std::launch::async, connectDevice<Wrapper>,
+                                     hidl_string("default"), false /* required */));
+    }
+
+    for (auto& device : devices) {
+        auto keymaster = device.get();
+        if (keymaster) result.push_back(std::move(keymaster));
     }
 
     return result;
@@ -123,8 +145,9 @@ Keymaster::KeymasterSet Keymaster::enumerateAvailableDevices() {
     auto serviceManager = IServiceManager::getService();
     CHECK(serviceManager) << "Could not retrieve ServiceManager";
 
-    auto km4s = enumerateDevices<Keymaster4>(serviceManager);
+    auto km4sFuture = std::async(std::launch::async, enumerateDevices<Keymaster4>, serviceManager);
     auto km3s = enumerateDevices<Keymaster3>(serviceManager);
+    auto km4s = km4sFuture.get();
 
     auto result = std::move(km4s);
     result.insert(result.end(), std::make_move_iterator(km3s.begin()),
@@ -140,6 +163,12 @@ Keymaster::KeymasterSet Keymaster::enumerateAvailableDevices() {
     return result;
 }
 
+const Keymaster::KeymasterSet& Keymaster::availableDevices() {
+    // Never destroyed, so that references stay valid during process exit.
+    static KeymasterSet* devices = new KeymasterSet(enumerateAvailableDevices());
+    return *devices;
+}
+
 static hidl_vec<HmacSharingParameters> getHmacParameters(
     const Keymaster::KeymasterSet& keymasters) {
     std::vector<HmacSharingParameters> params_vec;
@@ -18,6 +18,9 @@
 
 #include <assert.h>
 
+#include <algorithm>
+#include <iterator>
+
 #include <android-base/logging.h>
 
 namespace android {
@@ -85,26 +88,36 @@ inline bool keyParamEqual(const KeyParameter& a, const KeyParameter& b) {
 
 void AuthorizationSet::Sort() {
     std::sort(data_.begin(), data_.end(), keyParamLess);
+    sorted_by_tag_ = true;
+}
+
+void AuthorizationSet::UpdateSortedByTag() {
+    sorted_by_tag_ = std::is_sorted(
+            data_.begin(), data_.end(),
+            [](const KeyParameter& a, const KeyParameter& b) { return a.tag < b.tag; });
 }
 
 void AuthorizationSet::Deduplicate() {
     if (data_.empty()) return;
 
     Sort();
-    std::vector<KeyParameter> result;
 
+    // Compact in place, moving each kept element down over the dropped ones.
+    auto out = data_.begin();
     auto curr = data_.begin();
     auto prev = curr++;
     for (; curr != data_.end(); ++prev, ++curr) {
         if (prev->tag == Tag::INVALID) continue;
 
         if (!keyParamEqual(*prev, *curr)) {
-            result.push_back(std::move(*prev));
+            if (out != prev) *out = std::move(*prev);
+            ++out;
         }
     }
-    result.push_back(std::move(*prev));
+    if (out != prev) *out = std::move(*prev);
+    ++out;
 
-    std::swap(data_, result);
+    data_.erase(out, data_.end());
 }
 
 void AuthorizationSet::Union(const AuthorizationSet& other) {
@@ -112,21 +125,25 @@ void AuthorizationSet::Union(const AuthorizationSet& other) {
     Deduplicate();
 }
 
+void AuthorizationSet::Union(AuthorizationSet&& other) {
+    data_.insert(data_.end(), std::make_move_iterator(other.data_.begin()),
+                 std::make_move_iterator(other.data_.end()));
+    other.Clear();
+    Deduplicate();
+}
+
 void AuthorizationSet::Subtract(const AuthorizationSet& other) {
     Deduplicate();
 
-    auto i = other.begin();
-    while (i != other.end()) {
-        int pos = -1;
-        do {
-            pos = find(i->tag, pos);
-            if (pos != -1 && keyParamEqual(*i, data_[pos])) {
-                data_.erase(data_.begin() + pos);
-                break;
-            }
-        } while (pos != -1);
-        ++i;
-    }
+    // data_ has no duplicates now, so each element of other removes at most one element.
+    data_.erase(std::remove_if(data_.begin(), data_.end(),
+                               [&other](const KeyParameter& param) {
+                                   for (int pos = -1; (pos = other.find(param.tag, pos)) != -1;) {
+                                       if (keyParamEqual(param, other[pos])) return true;
+                                   }
+                                   return false;
+                               }),
+                data_.end());
 }
 
 void AuthorizationSet::Filter(std::function<bool(const KeyParameter&)> doKeep) {
@@ -140,6 +157,8 @@ void AuthorizationSet::Filter(std::function<bool(const KeyParameter&)> doKeep) {
 }
 
 KeyParameter& AuthorizationSet::operator[](int at) {
+    // The caller may change the tag.
+    sorted_by_tag_ = false;
     return data_[at];
 }
 
@@ -149,6 +168,7 @@ const KeyParameter& AuthorizationSet::operator[](int at) const {
 
 void AuthorizationSet::Clear() {
     data_.clear();
+    sorted_by_tag_ = true;
 }
 
 size_t AuthorizationSet::GetTagCount(Tag tag) const {
@@ -160,6 +180,13 @@ size_t AuthorizationSet::GetTagCount(Tag tag) const {
 int AuthorizationSet::find(Tag tag, int begin) const {
     auto iter = data_.begin() + (1 + begin);
 
+    if (sorted_by_tag_) {
+        iter = std::lower_bound(iter, data_.end(), tag,
+                                [](const KeyParameter& param, Tag t) { return param.tag < t; });
+        if (iter != data_.end() && iter->tag == tag) return iter - data_.begin();
+        return -1;
+    }
+
     while (iter != data_.end() && iter->tag != tag) ++iter;
 
     if (iter != data_.end()) return iter - data_.begin();
@@ -450,6 +477,7 @@ void AuthorizationSet::Serialize(std::ostream* out) const {
 
 void AuthorizationSet::Deserialize(std::istream* in) {
     deserialize(*in, &data_);
+    UpdateSortedByTag();
 }
 
 AuthorizationSetBuilder& AuthorizationSetBuilder::RsaKey(uint32_t key_size,
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <keymasterV4_0/authorization_set.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+
+namespace {
+
+// Roughly the hardware enforced characteristics of an RSA signing key as keystore sees them.
+AuthorizationSet makeKeyCharacteristics() {
+    return AuthorizationSetBuilder()
+            .RsaSigningKey(2048, 65537)
+            .Digest(Digest::SHA_2_256, Digest::SHA_2_512)
+            .Padding(PaddingMode::RSA_PKCS1_1_5_SIGN, PaddingMode::RSA_PSS)
+            .Authorization(TAG_NO_AUTH_REQUIRED)
+            .Authorization(TAG_ORIGIN, KeyOrigin::GENERATED)
+            .Authorization(TAG_OS_VERSION, 100000U)
+            .Authorization(TAG_OS_PATCHLEVEL, 201910U)
+            .Authorization(TAG_VENDOR_PATCHLEVEL, 20191005U)
+            .Authorization(TAG_BOOT_PATCHLEVEL, 20191005U)
+            .Authorization(TAG_CREATION_DATETIME, 1570000000000ULL)
+            .Authorization(TAG_APPLICATION_ID, "com.example.app", 15);
+}
+
+// The tags keystore looks up when it begins an operation on such a key.
+const Tag kLookups[] = {
+        Tag::ALGORITHM,       Tag::PURPOSE,
+        Tag::DIGEST,          Tag::PADDING,
+        Tag::KEY_SIZE,        Tag::NO_AUTH_REQUIRED,
+        Tag::USER_SECURE_ID,  Tag::AUTH_TIMEOUT,
+        Tag::ORIGIN,          Tag::ACTIVE_DATETIME,
+        Tag::USAGE_EXPIRE_DATETIME, Tag::MIN_MAC_LENGTH,
+};
+
+void lookup(benchmark::State& state, const AuthorizationSet& set) {
+    for (auto _ : state) {
+        for (Tag tag : kLookups) {
+            benchmark::DoNotOptimize(set.find(tag));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * (sizeof(kLookups) / sizeof(kLookups[0])));
+}
+
+// As built, the set is in the order of the builder calls and find() scans it.
+void BM_FindUnsorted(benchmark::State& state) {
+    lookup(state, makeKeyCharacteristics());
+}
+BENCHMARK(BM_FindUnsorted);
+
+void BM_FindSorted(benchmark::State& state) {
+    AuthorizationSet set = makeKeyCharacteristics();
+    set.Sort();
+    lookup(state, set);
+}
+BENCHMARK(BM_FindSorted);
+
+void BM_GetTagValueSorted(benchmark::State& state) {
+    AuthorizationSet set = makeKeyCharacteristics();
+    set.Sort();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(set.GetTagValue(TAG_ALGORITHM));
+        benchmark::DoNotOptimize(set.GetTagValue(TAG_KEY_SIZE));
+        benchmark::DoNotOptimize(set.GetTagValue(TAG_AUTH_TIMEOUT));
+        benchmark::DoNotOptimize(set.GetTagValue(TAG_APPLICATION_ID));
+    }
+}
+BENCHMARK(BM_GetTagValueSorted);
+
+void BM_UnionCopy(benchmark::State& state) {
+    const AuthorizationSet other = makeKeyCharacteristics();
+    for (auto _ : state) {
+        AuthorizationSet set = makeKeyCharacteristics();
+        AuthorizationSet copy = other;
+        set.Union(copy);
+        benchmark::DoNotOptimize(set.data());
+    }
+}
+BENCHMARK(BM_UnionCopy);
+
+void BM_UnionMove(benchmark::State& state) {
+    const AuthorizationSet other = makeKeyCharacteristics();
+    for (auto _ : state) {
+        AuthorizationSet set = makeKeyCharacteristics();
+        AuthorizationSet copy = other;
+        set.Union(std::move(copy));
+        benchmark::DoNotOptimize(set.data());
+    }
+}
+BENCHMARK(BM_UnionMove);
+
+void BM_Subtract(benchmark::State& state) {
+    AuthorizationSet other = AuthorizationSetBuilder()
+                                     .Authorization(TAG_OS_VERSION, 100000U)
+                                     .Authorization(TAG_OS_PATCHLEVEL, 201910U)
+                                     .Authorization(TAG_APPLICATION_ID, "com.example.app", 15);
+    other.Sort();
+    for (auto _ : state) {
+        AuthorizationSet set = makeKeyCharacteristics();
+        set.Subtract(other);
+        benchmark::DoNotOptimize(set.data());
+    }
+}
+BENCHMARK(BM_Subtract);
+
+}  // namespace
+
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,94 @@
+/*
+ **
+ ** Copyright 2019, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#ifndef HARDWARE_INTERFACES_KEYMASTER_40_SUPPORT_KEY_CHARACTERISTICS_CACHE_H_
+#define HARDWARE_INTERFACES_KEYMASTER_40_SUPPORT_KEY_CHARACTERISTICS_CACHE_H_
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <keymasterV4_0/Keymaster.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace support {
+
+/**
+ * A least recently used cache of the KeyCharacteristics of key blobs, so that a client which
+ * begins many operations with the same keys calls getKeyCharacteristics() once per key rather than
+ * once per operation.  Entries are keyed by a SHA-256 digest of the key blob; the blob itself is
+ * not kept.  A cache must only be used with one Keymaster instance.  It is thread safe.
+ */
+class KeyCharacteristicsCache {
+   public:
+    explicit KeyCharacteristicsCache(size_t capacity = 64) : capacity_(capacity) {}
+
+    /**
+     * Returns the characteristics of \p keyBlob, calling getKeyCharacteristics() on \p keymaster
+     * if they are not cached.  Only successful results are cached.
+     */
+    ErrorCode getKeyCharacteristics(Keymaster& keymaster, const hidl_vec<uint8_t>& keyBlob,
+                                    const hidl_vec<uint8_t>& clientId,
+                                    const hidl_vec<uint8_t>& appData,
+                                    KeyCharacteristics* characteristics);
+
+    /**
+     * Caches characteristics that the client got some other way, e.g. from generateKey() or
+     * importKey().
+     */
+    void put(const hidl_vec<uint8_t>& keyBlob, const hidl_vec<uint8_t>& clientId,
+             const hidl_vec<uint8_t>& appData, const KeyCharacteristics& characteristics);
+
+    /**
+     * Drops the entry for \p keyBlob.  Must be called when the blob is deleted or upgraded.
+     */
+    void erase(const hidl_vec<uint8_t>& keyBlob);
+
+    void clear();
+
+   private:
+    struct Entry {
+        std::string blobDigest;
+        // Digest of the client ID and app data the characteristics were fetched with, which
+        // getKeyCharacteristics() requires to match.
+        std::string paramsDigest;
+        KeyCharacteristics characteristics;
+    };
+
+    bool lookup(const std::string& blobDigest, const std::string& paramsDigest,
+                KeyCharacteristics* characteristics);
+    void insert(std::string blobDigest, std::string paramsDigest,
+                const KeyCharacteristics& characteristics);
+
+    const size_t capacity_;
+    std::mutex mutex_;
+    // Most recently used first.
+    std::list<Entry> entries_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+};
+
+}  // namespace support
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+#endif  // HARDWARE_INTERFACES_KEYMASTER_40_SUPPORT_KEY_CHARACTERISTICS_CACHE_H_
@@ -76,6 +76,14 @@ class Keymaster : public IKeymasterDevice {
      */
     static KeymasterSet enumerateAvailableDevices();
 
+    /**
+     * Returns the same devices as enumerateAvailableDevices(), but enumerates them only once per
+     * process.  The first call blocks until every instance has been connected; later calls return
+     * the same set.  Use this rather than enumerateAvailableDevices() if the process does not need
+     * to own the instances.
+     */
+    static const KeymasterSet& availableDevices();
+
     /**
      * Ask provided Keymaster instances to compute a shared HMAC key using
      * getHmacSharingParameters() and computeSharedHmac().  This computation is idempotent as long
@@ -43,10 +43,14 @@ class AuthorizationSet {
     AuthorizationSet(){};
 
     // Copy constructor.
-    AuthorizationSet(const AuthorizationSet& other) : data_(other.data_) {}
+    AuthorizationSet(const AuthorizationSet& other)
+        : data_(other.data_), sorted_by_tag_(other.sorted_by_tag_) {}
 
     // Move constructor.
-    AuthorizationSet(AuthorizationSet&& other) noexcept : data_(std::move(other.data_)) {}
+    AuthorizationSet(AuthorizationSet&& other) noexcept
+        : data_(std::move(other.data_)), sorted_by_tag_(other.sorted_by_tag_) {
+        other.sorted_by_tag_ = true;
+    }
 
     // Constructor from hidl_vec<KeyParameter>
     AuthorizationSet(const hidl_vec<KeyParameter>& other) { *this = other; }
@@ -54,12 +58,15 @@ class AuthorizationSet {
     // Copy assignment.
     AuthorizationSet& operator=(const AuthorizationSet& other) {
         data_ = other.data_;
+        sorted_by_tag_ = other.sorted_by_tag_;
         return *this;
     }
 
     // Move assignment.
     AuthorizationSet& operator=(AuthorizationSet&& other) noexcept {
         data_ = std::move(other.data_);
+        sorted_by_tag_ = other.sorted_by_tag_;
+        other.sorted_by_tag_ = true;
         return *this;
     }
 
@@ -72,6 +79,7 @@ class AuthorizationSet {
                 data_[i] = other[i];
             }
         }
+        UpdateSortedByTag();
         return *this;
     }
 
@@ -114,6 +122,12 @@ class AuthorizationSet {
      */
     void Union(const AuthorizationSet& set);
 
+    /**
+     * Same as above, but moves the elements out of \p set instead of copying them, so their
+     * blobs are not copied. \p set is left empty.
+     */
+    void Union(AuthorizationSet&& set);
+
     /**
      * Removes all elements in \p set from this AuthorizationSet.
      */
@@ -121,7 +135,9 @@ class AuthorizationSet {
 
     /**
      * Returns the offset of the next entry that matches \p tag, starting from the element after \p
-     * begin.  If not found, returns -1.
+     * begin.  If not found, returns -1.  This is a binary search while the set is ordered by tag,
+     * which it is after Sort(), Deduplicate(), Union() and Subtract(), and for as long as
+     * elements are pushed in tag order; otherwise it is a linear scan.
      */
     int find(Tag tag, int begin = -1) const;
 
@@ -185,8 +201,14 @@ class AuthorizationSet {
         return {};
     }
 
-    void push_back(const KeyParameter& param) { data_.push_back(param); }
-    void push_back(KeyParameter&& param) { data_.push_back(std::move(param)); }
+    void push_back(const KeyParameter& param) {
+        NoteAppended(param.tag);
+        data_.push_back(param);
+    }
+    void push_back(KeyParameter&& param) {
+        NoteAppended(param.tag);
+        data_.push_back(std::move(param));
+    }
     void push_back(const AuthorizationSet& set) {
         for (auto& entry : set) {
             push_back(entry);
@@ -225,7 +247,14 @@ class AuthorizationSet {
    private:
     NullOr<const KeyParameter&> GetEntry(Tag tag) const;
 
+    void NoteAppended(Tag tag) {
+        if (!data_.empty() && tag < data_.back().tag) sorted_by_tag_ = false;
+    }
+    void UpdateSortedByTag();
+
     std::vector<KeyParameter> data_;
+    // True if data_ is ordered by tag, which lets find() do a binary search.
+    bool sorted_by_tag_ = true;
 };
 
 class AuthorizationSetBuilder : public AuthorizationSet {
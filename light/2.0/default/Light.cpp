@@ -16,6 +16,7 @@
 
 #define LOG_TAG "light"
 
+#include <android-base/properties.h>
 #include <log/log.h>
 
 #include <stdio.h>
@@ -43,8 +44,8 @@ static_assert(BRIGHTNESS_MODE_LOW_PERSISTENCE ==
     static_cast<int>(Brightness::LOW_PERSISTENCE),
     "Brightness::LOW_PERSISTENCE must match legacy value.");
 
-Light::Light(std::map<Type, light_device_t*> &&lights)
-  : mLights(std::move(lights)) {}
+Light::Light(std::map<Type, light_device_t*> &&lights, bool softwareFlash)
+  : mLights(std::move(lights)), mSoftwareFlash(softwareFlash), mAnimator(mLights) {}
 
 // Methods from ::android::hardware::light::V2_0::ILight follow.
 Return<Status> Light::setLight(Type type, const LightState& state)  {
@@ -54,7 +55,17 @@ Return<Status> Light::setLight(Type type, const LightState& state)  {
         return Status::LIGHT_NOT_SUPPORTED;
     }
 
+    if (mSoftwareFlash && state.flashMode == Flash::TIMED && state.flashOnMs > 0 &&
+        state.flashOffMs > 0) {
+        // Off keeps the alpha byte, which legacy modules may use as brightness.
+        return mAnimator.start(type, {{state.color, static_cast<uint32_t>(state.flashOnMs)},
+                                      {state.color & 0xff000000,
+                                       static_cast<uint32_t>(state.flashOffMs)}},
+                               true /* repeat */);
+    }
+
     light_device_t* hwLight = it->second;
+    mAnimator.stop(type);
 
     light_state_t legacyState {
         .color = state.color,
@@ -174,7 +185,8 @@ ILight* HIDL_FETCH_ILight(const char* /* name */) {
         ALOGI("Could not open any lights.");
     }
 
-    return new Light(std::move(lights));
+    return new Light(std::move(lights),
+                     android::base::GetBoolProperty("ro.vendor.light.software_flash", false));
 }
 
 } // namespace implementation
@@ -23,6 +23,8 @@
 #include <hidl/MQDescriptor.h>
 #include <map>
 
+#include "LightAnimator.h"
+
 namespace android {
 namespace hardware {
 namespace light {
@@ -40,7 +42,8 @@ using ::android::hardware::hidl_string;
 using ::android::sp;
 
 struct Light : public ILight {
-    Light(std::map<Type, light_device_t*> &&lights);
+    // With softwareFlash, Flash::TIMED is played by the HAL rather than the legacy module.
+    Light(std::map<Type, light_device_t*> &&lights, bool softwareFlash = false);
 
     Return<Status> setLight(Type type, const LightState& state)  override;
     Return<void> getSupportedTypes(getSupportedTypes_cb _hidl_cb)  override;
@@ -49,6 +52,8 @@ struct Light : public ILight {
 
    private:
     std::map<Type, light_device_t*> mLights;
+    const bool mSoftwareFlash;
+    LightAnimator mAnimator;
 };
 
 extern "C" ILight* HIDL_FETCH_ILight(const char* name);
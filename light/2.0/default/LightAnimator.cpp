@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "light"
+
+#include <log/log.h>
+
+#include <algorithm>
+
+#include "LightAnimator.h"
+
+namespace android {
+namespace hardware {
+namespace light {
+namespace V2_0 {
+namespace implementation {
+
+LightAnimator::LightAnimator(const std::map<Type, light_device_t*>& lights) : mLights(lights) {}
+
+LightAnimator::~LightAnimator() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExiting = true;
+    }
+    mCondition.notify_all();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+Status LightAnimator::start(Type type, std::vector<Keyframe> keyframes, bool repeat) {
+    if (mLights.find(type) == mLights.end()) {
+        return Status::LIGHT_NOT_SUPPORTED;
+    }
+
+    uint64_t totalMs = 0;
+    for (const auto& keyframe : keyframes) {
+        totalMs += keyframe.durationMs;
+    }
+    if (keyframes.empty() || (repeat && totalMs == 0)) {
+        return Status::UNKNOWN;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (!mThread.joinable()) {
+            mThread = std::thread(&LightAnimator::threadLoop, this);
+        }
+        mAnimations[type] = {std::move(keyframes), repeat, std::chrono::milliseconds(totalMs),
+                             std::chrono::steady_clock::now(), false, 0};
+        mUpdated = true;
+    }
+    mCondition.notify_all();
+    return Status::SUCCESS;
+}
+
+void LightAnimator::stop(Type type) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mAnimations.erase(type);
+}
+
+uint32_t LightAnimator::colorAt(const Animation& animation, std::chrono::nanoseconds elapsed,
+                                std::chrono::nanoseconds* outRemaining) {
+    if (animation.repeat) {
+        elapsed %= animation.total;
+    }
+
+    for (const auto& keyframe : animation.keyframes) {
+        std::chrono::milliseconds duration(keyframe.durationMs);
+        if (elapsed < duration) {
+            *outRemaining = duration - elapsed;
+            return keyframe.color;
+        }
+        elapsed -= duration;
+    }
+
+    *outRemaining = std::chrono::nanoseconds::zero();
+    return animation.keyframes.back().color;
+}
+
+void LightAnimator::writeLocked(Type type, uint32_t color) {
+    light_device_t* hwLight = mLights.at(type);
+    light_state_t legacyState {
+        .color = color,
+        .flashMode = LIGHT_FLASH_NONE,
+        .flashOnMS = 0,
+        .flashOffMS = 0,
+        .brightnessMode = BRIGHTNESS_MODE_USER,
+    };
+
+    int ret = hwLight->set_light(hwLight, &legacyState);
+    if (ret != 0) {
+        ALOGE("animating light %d failed: %d", static_cast<int>(type), ret);
+    }
+}
+
+void LightAnimator::threadLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mExiting) {
+        mUpdated = false;
+        const auto now = std::chrono::steady_clock::now();
+        auto next = std::chrono::nanoseconds::max();
+        for (auto it = mAnimations.begin(); it != mAnimations.end();) {
+            Animation& animation = it->second;
+            std::chrono::nanoseconds remaining;
+            uint32_t color = colorAt(animation, now - animation.start, &remaining);
+            if (!animation.written || color != animation.lastColor) {
+                writeLocked(it->first, color);
+                animation.written = true;
+                animation.lastColor = color;
+            }
+            if (remaining == std::chrono::nanoseconds::zero()) {
+                it = mAnimations.erase(it);
+                continue;
+            }
+            next = std::min(next, remaining);
+            ++it;
+        }
+
+        auto woken = [this] { return mExiting || mUpdated; };
+        if (mAnimations.empty()) {
+            mCondition.wait(lock, woken);
+        } else {
+            mCondition.wait_until(lock, now + next, woken);
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ANDROID_HARDWARE_LIGHT_V2_0_LIGHTANIMATOR_H
+#define ANDROID_HARDWARE_LIGHT_V2_0_LIGHTANIMATOR_H
+
+#include <android/hardware/light/2.0/types.h>
+#include <hardware/lights.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace light {
+namespace V2_0 {
+namespace implementation {
+
+/*
+ * One step of a light animation: the light shows color for durationMs.
+ */
+struct Keyframe {
+    uint32_t color;
+    uint32_t durationMs;
+};
+
+/*
+ * Plays keyframe animations of several lights on one thread, which sleeps until the next
+ * keyframe of any light. Keyframe times are relative to the start of the animation, so a
+ * late wakeup does not delay the keyframes after it.
+ */
+class LightAnimator {
+   public:
+    explicit LightAnimator(const std::map<Type, light_device_t*>& lights);
+    ~LightAnimator();
+
+    // Starts animating the light, replacing its animation if any.
+    Status start(Type type, std::vector<Keyframe> keyframes, bool repeat);
+
+    // Stops animating the light, leaving it at its current color.
+    void stop(Type type);
+
+   private:
+    struct Animation {
+        std::vector<Keyframe> keyframes;
+        bool repeat;
+        std::chrono::milliseconds total;
+        std::chrono::steady_clock::time_point start;
+        bool written;
+        uint32_t lastColor;
+    };
+
+    void threadLoop();
+    // Returns the color of the animation at elapsed, and the time left until the next keyframe,
+    // or zero once a non-repeating animation is finished.
+    static uint32_t colorAt(const Animation& animation, std::chrono::nanoseconds elapsed,
+                            std::chrono::nanoseconds* outRemaining);
+    void writeLocked(Type type, uint32_t color);
+
+    const std::map<Type, light_device_t*>& mLights;
+
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::thread mThread;
+    bool mExiting = false;
+    // set by start so that the thread recomputes its wakeup
+    bool mUpdated = false;
+    std::map<Type, Animation> mAnimations;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_LIGHT_V2_0_LIGHTANIMATOR_H
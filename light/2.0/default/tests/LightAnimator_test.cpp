@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Light.h"
+#include "LightAnimator.h"
+
+namespace android {
+namespace hardware {
+namespace light {
+namespace V2_0 {
+namespace implementation {
+
+namespace {
+
+constexpr std::chrono::seconds kTimeout(5);
+
+constexpr uint32_t kRed = 0xffff0000;
+constexpr uint32_t kGreen = 0xff00ff00;
+constexpr uint32_t kOff = 0xff000000;
+
+// A legacy light that records the states it is set to
+class FakeLight {
+  public:
+    FakeLight() {
+        mDevice.owner = this;
+        mDevice.set_light = [](light_device_t* device, const light_state_t* state) {
+            return static_cast<Device*>(device)->owner->record(*state);
+        };
+    }
+
+    light_device_t* get() { return &mDevice; }
+
+    std::vector<light_state_t> getStates() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mStates;
+    }
+
+    // Waits until the light was set count times, and returns the states
+    std::vector<light_state_t> waitForStates(size_t count) {
+        auto deadline = std::chrono::steady_clock::now() + kTimeout;
+        std::vector<light_state_t> states = getStates();
+        while (states.size() < count && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            states = getStates();
+        }
+        return states;
+    }
+
+  private:
+    struct Device : public light_device_t {
+        FakeLight* owner;
+    };
+
+    int record(const light_state_t& state) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStates.push_back(state);
+        return 0;
+    }
+
+    Device mDevice = {};
+    std::mutex mLock;
+    std::vector<light_state_t> mStates;
+};
+
+std::vector<uint32_t> getColors(const std::vector<light_state_t>& states) {
+    std::vector<uint32_t> colors;
+    for (const auto& state : states) {
+        colors.push_back(state.color);
+    }
+    return colors;
+}
+
+}  // namespace
+
+TEST(LightAnimatorTest, playsKeyframesOnce) {
+    FakeLight light;
+    std::map<Type, light_device_t*> lights = {{Type::NOTIFICATIONS, light.get()}};
+    LightAnimator animator(lights);
+
+    ASSERT_EQ(Status::SUCCESS,
+              animator.start(Type::NOTIFICATIONS, {{kRed, 10}, {kGreen, 10}, {kOff, 10}}, false));
+
+    std::vector<uint32_t> expected = {kRed, kGreen, kOff};
+    ASSERT_EQ(expected, getColors(light.waitForStates(3)));
+    for (const auto& state : light.getStates()) {
+        ASSERT_EQ(LIGHT_FLASH_NONE, state.flashMode);
+    }
+}
+
+TEST(LightAnimatorTest, repeatsUntilStopped) {
+    FakeLight light;
+    std::map<Type, light_device_t*> lights = {{Type::NOTIFICATIONS, light.get()}};
+    LightAnimator animator(lights);
+
+    ASSERT_EQ(Status::SUCCESS,
+              animator.start(Type::NOTIFICATIONS, {{kRed, 10}, {kOff, 10}}, true));
+    std::vector<uint32_t> colors = getColors(light.waitForStates(5));
+    animator.stop(Type::NOTIFICATIONS);
+
+    ASSERT_LE(5u, colors.size());
+    for (size_t i = 0; i < colors.size(); i++) {
+        // the light is only written when its color changes
+        ASSERT_EQ(i % 2 ? kOff : kRed, colors[i]);
+    }
+}
+
+TEST(LightAnimatorTest, rejectsBadAnimations) {
+    FakeLight light;
+    std::map<Type, light_device_t*> lights = {{Type::NOTIFICATIONS, light.get()}};
+    LightAnimator animator(lights);
+
+    ASSERT_EQ(Status::LIGHT_NOT_SUPPORTED, animator.start(Type::BATTERY, {{kRed, 10}}, false));
+    ASSERT_EQ(Status::UNKNOWN, animator.start(Type::NOTIFICATIONS, {}, false));
+    // a repeating animation of no length would spin
+    ASSERT_EQ(Status::UNKNOWN, animator.start(Type::NOTIFICATIONS, {{kRed, 0}}, true));
+    ASSERT_TRUE(light.getStates().empty());
+}
+
+TEST(LightTest, softwareFlashPlaysTimedFlash) {
+    FakeLight fakeLight;
+    sp<Light> light = new Light({{Type::NOTIFICATIONS, fakeLight.get()}}, true);
+
+    LightState flash = {
+            .color = kRed,
+            .flashMode = Flash::TIMED,
+            .flashOnMs = 10,
+            .flashOffMs = 10,
+            .brightnessMode = Brightness::USER,
+    };
+    ASSERT_EQ(Status::SUCCESS, static_cast<Status>(light->setLight(Type::NOTIFICATIONS, flash)));
+    std::vector<light_state_t> states = fakeLight.waitForStates(4);
+    ASSERT_LE(4u, states.size());
+    for (size_t i = 0; i < states.size(); i++) {
+        ASSERT_EQ(LIGHT_FLASH_NONE, states[i].flashMode);
+        ASSERT_EQ(i % 2 ? kOff : kRed, states[i].color);
+    }
+
+    // setting the light again stops the flash before the new state is written
+    LightState steady = {
+            .color = kGreen,
+            .flashMode = Flash::NONE,
+            .brightnessMode = Brightness::USER,
+    };
+    ASSERT_EQ(Status::SUCCESS, static_cast<Status>(light->setLight(Type::NOTIFICATIONS, steady)));
+    size_t count = fakeLight.getStates().size();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    states = fakeLight.getStates();
+    ASSERT_EQ(count, states.size());
+    ASSERT_EQ(kGreen, states.back().color);
+}
+
+TEST(LightTest, timedFlashGoesToLegacyModuleByDefault) {
+    FakeLight fakeLight;
+    sp<Light> light = new Light({{Type::NOTIFICATIONS, fakeLight.get()}});
+
+    LightState flash = {
+            .color = kRed,
+            .flashMode = Flash::TIMED,
+            .flashOnMs = 10,
+            .flashOffMs = 10,
+            .brightnessMode = Brightness::USER,
+    };
+    ASSERT_EQ(Status::SUCCESS, static_cast<Status>(light->setLight(Type::NOTIFICATIONS, flash)));
+    std::vector<light_state_t> states = fakeLight.getStates();
+    ASSERT_EQ(1u, states.size());
+    ASSERT_EQ(LIGHT_FLASH_TIMED, states[0].flashMode);
+    ASSERT_EQ(10, states[0].flashOnMS);
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
@@ -185,6 +185,7 @@ class AudioDecHidlTest : public ::testing::VtsHalHidlTargetTestBase {
             }
             if (msg.data.extendedBufferData.rangeLength != 0) {
                 framesReceived += 1;
+                benchmark.onOutputDone(msg.data.extendedBufferData.timestampUs);
                 // For decoder components current timestamp always exceeds
                 // previous timestamp
                 EXPECT_GE(msg.data.extendedBufferData.timestampUs, timestampUs);
@@ -262,6 +263,7 @@ class AudioDecHidlTest : public ::testing::VtsHalHidlTargetTestBase {
     ::android::List<uint64_t> timestampUslist;
     bool timestampDevTest;
 
+    CodecBenchmark benchmark;
    protected:
     static void description(const std::string& description) {
         RecordProperty("description", description);
@@ -589,8 +591,10 @@ void decodeNFrames(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
                    android::Vector<BufferInfo>* oBuffer,
                    OMX_AUDIO_CODINGTYPE eEncoding, OMX_U32 kPortIndexInput,
                    OMX_U32 kPortIndexOutput, std::ifstream& eleStream,
-                   android::Vector<FrameData>* Info, int offset, int range,
-                   AudioDecHidlTest::standardComp comp, bool signalEOS = true) {
+                   const android::Vector<FrameData>* Info, int offset,
+                   int range, AudioDecHidlTest::standardComp comp,
+                   bool signalEOS = true, CodecBenchmark* benchmark = nullptr,
+                   const ElementaryStream* mappedStream = nullptr) {
     android::hardware::media::omx::V1_0::Status status;
     Message msg;
     size_t index;
@@ -621,8 +625,13 @@ void decodeNFrames(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
                 static_cast<void*>((*iBuffer)[index].mMemory->getPointer()));
             ASSERT_LE((*Info)[frameID].bytesCount,
                       static_cast<int>((*iBuffer)[index].mMemory->getSize()));
-            eleStream.read(ipBuffer, (*Info)[frameID].bytesCount);
-            ASSERT_EQ(eleStream.gcount(), (*Info)[frameID].bytesCount);
+            if (mappedStream) {
+                memcpy(ipBuffer, mappedStream->frameData(frameID),
+                       (*Info)[frameID].bytesCount);
+            } else {
+                eleStream.read(ipBuffer, (*Info)[frameID].bytesCount);
+                ASSERT_EQ(eleStream.gcount(), (*Info)[frameID].bytesCount);
+            }
             flags = (*Info)[frameID].flags;
             // Indicate to omx core that the buffer contains a full frame worth
             // of data
@@ -632,17 +641,23 @@ void decodeNFrames(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
             if (signalEOS && ((frameID == (int)Info->size() - 1) ||
                               (frameID == (offset + range - 1))))
                 flags |= OMX_BUFFERFLAG_EOS;
+            if (benchmark && !(flags & OMX_BUFFERFLAG_CODECCONFIG))
+                benchmark->onInputQueued((*Info)[frameID].timestamp);
             ASSERT_NO_FATAL_FAILURE(dispatchInputBuffer(
                 omxNode, iBuffer, index, (*Info)[frameID].bytesCount, flags,
                 (*Info)[frameID].timestamp));
             frameID++;
             iQueued = true;
+        } else if (benchmark) {
+            benchmark->onInputPoolEmpty();
         }
         // Dispatch output buffer
         if ((index = getEmptyBufferID(oBuffer)) < oBuffer->size()) {
             ASSERT_NO_FATAL_FAILURE(
                 dispatchOutputBuffer(omxNode, oBuffer, index));
             oQueued = true;
+        } else if (benchmark) {
+            benchmark->onOutputPoolEmpty();
         }
         // Reset Counters when either input or output buffer is dispatched
         if (iQueued || oQueued)
@@ -775,6 +790,83 @@ TEST_F(AudioDecHidlTest, DecodeTest) {
                                                     kPortIndexOutput));
 }
 
+// Decode throughput and latency. Disabled by default, run with
+// --gtest_also_run_disabled_tests.
+TEST_F(AudioDecHidlTest, DISABLED_DecodeBenchmark) {
+    description("Reports decode throughput and latency");
+    if (disableTest) return;
+    android::hardware::media::omx::V1_0::Status status;
+    uint32_t kPortIndexInput = 0, kPortIndexOutput = 1;
+    status = setRole(omxNode, gEnv->getRole().c_str());
+    ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+    OMX_PORT_PARAM_TYPE params;
+    status = getParam(omxNode, OMX_IndexParamAudioInit, &params);
+    if (status == ::android::hardware::media::omx::V1_0::Status::OK) {
+        ASSERT_EQ(params.nPorts, 2U);
+        kPortIndexInput = params.nStartPortNumber;
+        kPortIndexOutput = kPortIndexInput + 1;
+    }
+    char mURL[512], info[512];
+    strcpy(mURL, gEnv->getRes().c_str());
+    strcpy(info, gEnv->getRes().c_str());
+    GetURLForComponent(compName, mURL, info);
+
+    timestampDevTest = false;
+    ElementaryStream stream;
+    ASSERT_TRUE(stream.open(mURL, info));
+    const android::Vector<FrameData>& Info = stream.frames();
+
+    int32_t nChannels, nSampleRate;
+    // Configure input port
+    setDefaultPortParam(omxNode, kPortIndexInput, eEncoding);
+    if (compName == raw)
+        setDefaultPortParam(omxNode, kPortIndexInput, eEncoding, 1, 8000,
+                            OMX_AUDIO_PCMModeLinear, OMX_NumericalDataSigned,
+                            32);
+    ASSERT_NO_FATAL_FAILURE(getInputChannelInfo(
+        omxNode, kPortIndexInput, eEncoding, &nChannels, &nSampleRate));
+    // Configure output port
+    // SPECIAL CASE: Soft Vorbis, Opus and Raw Decoders do not offer way to
+    // configure output PCM port. The port undergoes auto configuration
+    // internally basing on parsed elementary stream information.
+    if (compName != vorbis && compName != opus && compName != raw) {
+        setDefaultPortParam(omxNode, kPortIndexOutput, OMX_AUDIO_CodingPCM,
+                            nChannels, nSampleRate);
+    }
+
+    android::Vector<BufferInfo> iBuffer, oBuffer;
+
+    // set state to idle
+    ASSERT_NO_FATAL_FAILURE(changeStateLoadedtoIdle(omxNode, observer, &iBuffer,
+                                                    &oBuffer, kPortIndexInput,
+                                                    kPortIndexOutput));
+    // set state to executing
+    ASSERT_NO_FATAL_FAILURE(changeStateIdletoExecute(omxNode, observer));
+    // unused, frames are copied from the mapped stream
+    std::ifstream eleStream;
+    benchmark.start();
+    ASSERT_NO_FATAL_FAILURE(decodeNFrames(
+        omxNode, observer, &iBuffer, &oBuffer, eEncoding, kPortIndexInput,
+        kPortIndexOutput, eleStream, &Info, 0, (int)Info.size(), compName, true,
+        &benchmark, &stream));
+    ASSERT_NO_FATAL_FAILURE(
+        waitOnInputConsumption(omxNode, observer, &iBuffer, &oBuffer, eEncoding,
+                               kPortIndexInput, kPortIndexOutput, compName));
+    packedArgs audioArgs = {eEncoding, compName};
+    ASSERT_NO_FATAL_FAILURE(testEOS(
+        omxNode, observer, &iBuffer, &oBuffer, false, eosFlag, nullptr,
+        portReconfiguration, kPortIndexInput, kPortIndexOutput, &audioArgs));
+    benchmark.stop();
+    benchmark.report("byte buffer output");
+    // set state to idle
+    ASSERT_NO_FATAL_FAILURE(
+        changeStateExecutetoIdle(omxNode, observer, &iBuffer, &oBuffer));
+    // set state to executing
+    ASSERT_NO_FATAL_FAILURE(changeStateIdletoLoaded(omxNode, observer, &iBuffer,
+                                                    &oBuffer, kPortIndexInput,
+                                                    kPortIndexOutput));
+}
+
 // end of sequence test
 TEST_F(AudioDecHidlTest, EOSTest_M) {
     description("Test end of stream monkeying");
@@ -55,6 +55,13 @@ using ::android::sp;
 #include <hidlmemory/mapping.h>
 #include <media/hardware/HardwareAPI.h>
 #include <media_hidl_test_common.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
 #include <memory>
 
 // set component role
@@ -717,3 +724,108 @@ void testEOS(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
     EXPECT_EQ(eosFlag, true);
     eosFlag = false;
 }
+
+void CodecBenchmark::start() {
+    running = true;
+    startUs = stopUs = android::ALooper::GetNowUs();
+    framesDone = inputPoolEmpty = outputPoolEmpty = 0;
+    pendingUs.clear();
+    latenciesUs.clear();
+}
+
+void CodecBenchmark::stop() {
+    running = false;
+    stopUs = android::ALooper::GetNowUs();
+}
+
+void CodecBenchmark::onInputQueued(uint64_t timestampUs) {
+    if (!running) return;
+    // If several inputs share a timestamp, the output is matched to the
+    // first one.
+    pendingUs.emplace(timestampUs, android::ALooper::GetNowUs());
+}
+
+void CodecBenchmark::onOutputDone(uint64_t timestampUs) {
+    if (!running) return;
+    framesDone++;
+    // Outputs that do not carry the timestamp of an input, as happens when a
+    // decoder splits an access unit, only count towards throughput.
+    auto it = pendingUs.find(timestampUs);
+    if (it == pendingUs.end()) return;
+    latenciesUs.push_back(android::ALooper::GetNowUs() - it->second);
+    pendingUs.erase(it);
+}
+
+void CodecBenchmark::report(const char* name) const {
+    int64_t elapsedUs = stopUs - startUs;
+    double fps = elapsedUs > 0 ? framesDone * 1000000.0 / elapsedUs : 0;
+    std::vector<int64_t> sorted(latenciesUs);
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](size_t percent) -> int64_t {
+        if (sorted.empty()) return 0;
+        size_t rank = (sorted.size() * percent + 99) / 100;
+        return sorted[std::max<size_t>(rank, 1) - 1];
+    };
+    std::cout << "[   INFO   ] " << name << ": " << framesDone << " frames in "
+              << elapsedUs << "us (" << fps << " frames/s), latency p50 "
+              << percentile(50) << "us p90 " << percentile(90) << "us p99 "
+              << percentile(99) << "us, input pool empty " << inputPoolEmpty
+              << " times, output pool empty " << outputPoolEmpty << " times\n";
+}
+
+ElementaryStream::~ElementaryStream() {
+    close();
+}
+
+void ElementaryStream::close() {
+    if (mData != nullptr) {
+        munmap(const_cast<uint8_t*>(mData), mSize);
+        mData = nullptr;
+    }
+    mSize = 0;
+    mFrames.clear();
+    mOffsets.clear();
+    mMaxBytesCount = 0;
+}
+
+bool ElementaryStream::open(const char* url, const char* info) {
+    close();
+
+    std::ifstream eleInfo(info);
+    if (!eleInfo.is_open()) return false;
+    int bytesCount = 0;
+    uint32_t flags = 0;
+    uint32_t timestamp = 0;
+    size_t offset = 0;
+    while (eleInfo >> bytesCount) {
+        eleInfo >> flags;
+        eleInfo >> timestamp;
+        if (bytesCount < 0) return false;
+        mFrames.push_back({bytesCount, flags, timestamp});
+        mOffsets.push_back(offset);
+        offset += bytesCount;
+        mMaxBytesCount = std::max(mMaxBytesCount, bytesCount);
+    }
+
+    int fd = ::open(url, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < offset) {
+        ::close(fd);
+        return false;
+    }
+    mSize = st.st_size;
+    void* data = MAP_FAILED;
+    if (mSize != 0) {
+        // Fault the whole stream in now rather than while frames are queued.
+        data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd,
+                    0);
+    }
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        mSize = 0;
+        return false;
+    }
+    mData = static_cast<const uint8_t*>(data);
+    return true;
+}
@@ -27,6 +27,9 @@
 #include <utils/List.h>
 #include <utils/Mutex.h>
 
+#include <map>
+#include <vector>
+
 #include <media/openmax/OMX_Index.h>
 #include <media/openmax/OMX_Core.h>
 #include <media/openmax/OMX_Component.h>
@@ -360,6 +363,74 @@ void testEOS(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
              portreconfig fptr = nullptr, OMX_U32 kPortIndexInput = 0,
              OMX_U32 kPortIndexOutput = 1, void* args = nullptr);
 
+/*
+ * Gathers throughput and latency numbers of a codec run for the benchmark
+ * tests. All methods are to be called from the test thread, which is also the
+ * one CodecObserver callbacks run on.
+ */
+class CodecBenchmark {
+   public:
+    void start();
+    void stop();
+    bool isRunning() const { return running; }
+
+    // An input buffer with the given timestamp was queued to the component.
+    void onInputQueued(uint64_t timestampUs);
+    // An output buffer with the given timestamp was returned by the component.
+    void onOutputDone(uint64_t timestampUs);
+    // The client had a buffer to queue but every buffer of the port was held
+    // by the component.
+    void onInputPoolEmpty() { inputPoolEmpty++; }
+    void onOutputPoolEmpty() { outputPoolEmpty++; }
+
+    // Prints frames/s, emptyBuffer to FillBufferDone latency percentiles and
+    // pool starvation counts.
+    void report(const char* name) const;
+
+   private:
+    bool running = false;
+    int64_t startUs = 0;
+    int64_t stopUs = 0;
+    uint32_t framesDone = 0;
+    uint32_t inputPoolEmpty = 0;
+    uint32_t outputPoolEmpty = 0;
+    // queue time of the inputs whose output is still to come, by timestamp
+    std::map<uint64_t, int64_t> pendingUs;
+    std::vector<int64_t> latenciesUs;
+};
+
+/*
+ * An elementary stream mapped into memory once, along with the frame table
+ * parsed from its .info file, so that the benchmark tests fill input buffers
+ * with a memcpy instead of a file read per frame.
+ */
+class ElementaryStream {
+   public:
+    ElementaryStream() = default;
+    ElementaryStream(const ElementaryStream&) = delete;
+    ElementaryStream& operator=(const ElementaryStream&) = delete;
+    ~ElementaryStream();
+
+    // Maps the stream in |url| and parses the frame table in |info|. Returns
+    // false if either file cannot be read or the table overruns the stream.
+    bool open(const char* url, const char* info);
+
+    const android::Vector<FrameData>& frames() const { return mFrames; }
+    int maxBytesCount() const { return mMaxBytesCount; }
+    const uint8_t* frameData(size_t frameID) const {
+        return mData + mOffsets[frameID];
+    }
+
+   private:
+    void close();
+
+    android::Vector<FrameData> mFrames;
+    std::vector<size_t> mOffsets;
+    int mMaxBytesCount = 0;
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+};
+
 // A class for test environment setup
 class ComponentTestEnvironment : public ::testing::VtsHalHidlTargetTestEnvBase {
    private:
@@ -188,6 +188,7 @@ class VideoDecHidlTest : public ::testing::VtsHalHidlTargetTestBase {
             }
             if (msg.data.extendedBufferData.rangeLength != 0) {
                 framesReceived += 1;
+                benchmark.onOutputDone(msg.data.extendedBufferData.timestampUs);
                 // For decoder components current timestamp always exceeds
                 // previous timestamp
                 EXPECT_GE(msg.data.extendedBufferData.timestampUs, timestampUs);
@@ -269,6 +270,11 @@ class VideoDecHidlTest : public ::testing::VtsHalHidlTargetTestBase {
     bool timestampDevTest;
     bool isSecure;
     bool portSettingsChange;
+    CodecBenchmark benchmark;
+
+    // Decodes the whole stream with the given output port mode and reports
+    // the benchmark numbers. Defined after the decode helpers it uses.
+    void decodeBenchmark(PortMode oPortMode, const char* name);
 
    protected:
     static void description(const std::string& description) {
@@ -541,9 +547,11 @@ void decodeNFrames(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
                    android::Vector<BufferInfo>* iBuffer,
                    android::Vector<BufferInfo>* oBuffer,
                    OMX_U32 kPortIndexInput, OMX_U32 kPortIndexOutput,
-                   std::ifstream& eleStream, android::Vector<FrameData>* Info,
-                   int offset, int range, PortMode oPortMode,
-                   bool signalEOS = true) {
+                   std::ifstream& eleStream,
+                   const android::Vector<FrameData>* Info, int offset,
+                   int range, PortMode oPortMode, bool signalEOS = true,
+                   CodecBenchmark* benchmark = nullptr,
+                   const ElementaryStream* mappedStream = nullptr) {
     android::hardware::media::omx::V1_0::Status status;
     Message msg;
     size_t index;
@@ -572,8 +580,13 @@ void decodeNFrames(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
                 static_cast<void*>((*iBuffer)[index].mMemory->getPointer()));
             ASSERT_LE((*Info)[frameID].bytesCount,
                       static_cast<int>((*iBuffer)[index].mMemory->getSize()));
-            eleStream.read(ipBuffer, (*Info)[frameID].bytesCount);
-            ASSERT_EQ(eleStream.gcount(), (*Info)[frameID].bytesCount);
+            if (mappedStream) {
+                memcpy(ipBuffer, mappedStream->frameData(frameID),
+                       (*Info)[frameID].bytesCount);
+            } else {
+                eleStream.read(ipBuffer, (*Info)[frameID].bytesCount);
+                ASSERT_EQ(eleStream.gcount(), (*Info)[frameID].bytesCount);
+            }
             flags = (*Info)[frameID].flags;
             // Indicate to omx core that the buffer contains a full frame worth
             // of data
@@ -583,17 +596,23 @@ void decodeNFrames(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
             if (signalEOS && ((frameID == (int)Info->size() - 1) ||
                               (frameID == (offset + range - 1))))
                 flags |= OMX_BUFFERFLAG_EOS;
+            if (benchmark && !(flags & OMX_BUFFERFLAG_CODECCONFIG))
+                benchmark->onInputQueued((*Info)[frameID].timestamp);
             ASSERT_NO_FATAL_FAILURE(dispatchInputBuffer(
                 omxNode, iBuffer, index, (*Info)[frameID].bytesCount, flags,
                 (*Info)[frameID].timestamp));
             frameID++;
             iQueued = true;
+        } else if (benchmark) {
+            benchmark->onInputPoolEmpty();
         }
         // Dispatch output buffer
         if ((index = getEmptyBufferID(oBuffer)) < oBuffer->size()) {
             ASSERT_NO_FATAL_FAILURE(
                 dispatchOutputBuffer(omxNode, oBuffer, index, oPortMode));
             oQueued = true;
+        } else if (benchmark) {
+            benchmark->onOutputPoolEmpty();
         }
         // Reset Counters when either input or output buffer is dispatched
         if (iQueued || oQueued)
@@ -859,6 +878,114 @@ TEST_F(VideoDecHidlTest, DecodeTest) {
                                                     kPortIndexOutput));
 }
 
+void VideoDecHidlTest::decodeBenchmark(PortMode oPortMode, const char* name) {
+    android::hardware::media::omx::V1_0::Status status;
+    uint32_t kPortIndexInput = 0, kPortIndexOutput = 1;
+    status = setRole(omxNode, gEnv->getRole().c_str());
+    ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+    OMX_PORT_PARAM_TYPE params;
+    status = getParam(omxNode, OMX_IndexParamVideoInit, &params);
+    if (status == ::android::hardware::media::omx::V1_0::Status::OK) {
+        ASSERT_EQ(params.nPorts, 2U);
+        kPortIndexInput = params.nStartPortNumber;
+        kPortIndexOutput = kPortIndexInput + 1;
+    }
+    char mURL[512], info[512];
+    strcpy(mURL, gEnv->getRes().c_str());
+    strcpy(info, gEnv->getRes().c_str());
+    GetURLForComponent(compName, mURL, info);
+
+    // Timestamp bookkeeping is left to the benchmark, so that the list
+    // lookups of the deviation test do not count towards latency.
+    timestampDevTest = false;
+    ElementaryStream stream;
+    ASSERT_TRUE(stream.open(mURL, info));
+    const android::Vector<FrameData>& Info = stream.frames();
+
+    // As the frame sizes are known ahead, use it to configure i/p buffer size
+    int maxBytesCount = ALIGN_POWER_OF_TWO(stream.maxBytesCount(), 10);
+    status = setPortBufferSize(omxNode, kPortIndexInput, maxBytesCount);
+    ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+
+    // set port mode
+    portMode[0] = PortMode::PRESET_BYTE_BUFFER;
+    portMode[1] = oPortMode;
+    status = omxNode->setPortMode(kPortIndexInput, portMode[0]);
+    ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+    status = omxNode->setPortMode(kPortIndexOutput, portMode[1]);
+    if (status != ::android::hardware::media::omx::V1_0::Status::OK) {
+        std::cout << "[   INFO   ] " << name
+                  << ": output port mode not supported, skipping\n";
+        return;
+    }
+
+    // set Port Params
+    uint32_t nFrameWidth, nFrameHeight, xFramerate;
+    getInputChannelInfo(omxNode, kPortIndexInput, &nFrameWidth, &nFrameHeight,
+                        &xFramerate);
+    // get default color format
+    OMX_COLOR_FORMATTYPE eColorFormat = OMX_COLOR_FormatUnused;
+    getDefaultColorFormat(omxNode, kPortIndexOutput, portMode[1],
+                          &eColorFormat);
+    ASSERT_NE(eColorFormat, OMX_COLOR_FormatUnused);
+    status =
+        setVideoPortFormat(omxNode, kPortIndexOutput, OMX_VIDEO_CodingUnused,
+                           eColorFormat, xFramerate);
+    EXPECT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+    setDefaultPortParam(omxNode, kPortIndexOutput, OMX_VIDEO_CodingUnused,
+                        eColorFormat, nFrameWidth, nFrameHeight, 0, xFramerate);
+
+    android::Vector<BufferInfo> iBuffer, oBuffer;
+
+    // set state to idle
+    ASSERT_NO_FATAL_FAILURE(changeStateLoadedtoIdle(
+        omxNode, observer, &iBuffer, &oBuffer, kPortIndexInput,
+        kPortIndexOutput, portMode, true));
+    // set state to executing
+    ASSERT_NO_FATAL_FAILURE(changeStateIdletoExecute(omxNode, observer));
+
+    // unused, frames are copied from the mapped stream
+    std::ifstream eleStream;
+    benchmark.start();
+    ASSERT_NO_FATAL_FAILURE(decodeNFrames(
+        omxNode, observer, &iBuffer, &oBuffer, kPortIndexInput,
+        kPortIndexOutput, eleStream, &Info, 0, (int)Info.size(), portMode[1],
+        true, &benchmark, &stream));
+    ASSERT_NO_FATAL_FAILURE(
+        waitOnInputConsumption(omxNode, observer, &iBuffer, &oBuffer,
+                               kPortIndexInput, kPortIndexOutput, portMode[1]));
+    ASSERT_NO_FATAL_FAILURE(testEOS(
+        omxNode, observer, &iBuffer, &oBuffer, false, eosFlag, portMode,
+        portReconfiguration, kPortIndexInput, kPortIndexOutput, nullptr));
+    benchmark.stop();
+    benchmark.report(name);
+    // set state to idle
+    ASSERT_NO_FATAL_FAILURE(
+        changeStateExecutetoIdle(omxNode, observer, &iBuffer, &oBuffer));
+    // set state to executing
+    ASSERT_NO_FATAL_FAILURE(changeStateIdletoLoaded(omxNode, observer, &iBuffer,
+                                                    &oBuffer, kPortIndexInput,
+                                                    kPortIndexOutput));
+}
+
+// Decode throughput and latency with byte buffer output. Disabled by default,
+// run with --gtest_also_run_disabled_tests.
+TEST_F(VideoDecHidlTest, DISABLED_DecodeBenchmarkByteBuffer) {
+    description("Reports decode throughput and latency, byte buffer output");
+    if (disableTest) return;
+    ASSERT_NO_FATAL_FAILURE(
+        decodeBenchmark(PortMode::PRESET_BYTE_BUFFER, "byte buffer output"));
+}
+
+// Decode throughput and latency with graphic buffer output. Disabled by
+// default, run with --gtest_also_run_disabled_tests.
+TEST_F(VideoDecHidlTest, DISABLED_DecodeBenchmarkGraphicBuffer) {
+    description("Reports decode throughput and latency, graphic buffer output");
+    if (disableTest) return;
+    ASSERT_NO_FATAL_FAILURE(decodeBenchmark(PortMode::DYNAMIC_ANW_BUFFER,
+                                            "graphic buffer output"));
+}
+
 // Test for adaptive playback support
 TEST_F(VideoDecHidlTest, AdaptivePlaybackTest) {
     description("Tests for Adaptive Playback support");
@@ -16,6 +16,8 @@
 
 #define LOG_TAG "android.hardware.memtrack@1.0-impl"
 
+#include <dlfcn.h>
+
 #include <log/log.h>
 
 #include <hardware/hardware.h>
@@ -29,9 +31,35 @@ namespace memtrack {
 namespace V1_0 {
 namespace implementation {
 
+namespace {
+
+// Callers sample every process in a row, e.g. procstats; one snapshot serves a whole pass
+constexpr std::chrono::milliseconds kSnapshotTtl(500);
+
+void addProcessRecords(void* cookie, pid_t pid, const memtrack_record* records,
+                       size_t num_records) {
+    auto* snapshot =
+            static_cast<std::unordered_map<int32_t, std::vector<MemtrackRecord>>*>(cookie);
+    std::vector<MemtrackRecord>& processRecords = (*snapshot)[pid];
+    processRecords.resize(num_records);
+    for (size_t i = 0; i < num_records; i++) {
+        processRecords[i].sizeInBytes = records[i].size_in_bytes;
+        processRecords[i].flags = records[i].flags;
+    }
+}
+
+}  // namespace
+
 Memtrack::Memtrack(const memtrack_module_t *module) : mModule(module) {
     if (mModule)
         mModule->init(mModule);
+    if (mModule && mModule->common.dso) {
+        mGetAllMemory = reinterpret_cast<memtrack_get_all_memory_t>(
+                dlsym(mModule->common.dso, "memtrack_get_all_memory"));
+        if (mGetAllMemory) {
+            ALOGI("memtrack module supports bulk queries");
+        }
+    }
 }
 
 Memtrack::~Memtrack() {
@@ -45,6 +73,12 @@ Return<void> Memtrack::getMemory(int32_t pid, MemtrackType type,
     size_t *size = &temp;
     int ret = 0;
 
+    if (mGetAllMemory != nullptr && getMemoryFromSnapshot(pid, type, &records))
+    {
+        _hidl_cb(MemtrackStatus::SUCCESS, records);
+        return Void();
+    }
+
     if (mModule->getMemory == nullptr)
     {
         _hidl_cb(MemtrackStatus::SUCCESS, records);
@@ -72,6 +106,40 @@ Return<void> Memtrack::getMemory(int32_t pid, MemtrackType type,
     return Void();
 }
 
+bool Memtrack::getMemoryFromSnapshot(int32_t pid, MemtrackType type,
+        hidl_vec<MemtrackRecord>* records) {
+    size_t index = static_cast<size_t>(type);
+    if (index >= static_cast<size_t>(MemtrackType::NUM_TYPES)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mSnapshotLock);
+    Snapshot& snapshot = mSnapshots[index];
+    auto now = std::chrono::steady_clock::now();
+    if (!snapshot.queried || now - snapshot.time >= kSnapshotTtl) {
+        snapshot.records.clear();
+        snapshot.status = mGetAllMemory(mModule, static_cast<int>(type), addProcessRecords,
+                &snapshot.records);
+        snapshot.queried = true;
+        snapshot.time = now;
+        if (snapshot.status != 0) {
+            ALOGV("memtrack_get_all_memory failed for type %zu: %d", index, snapshot.status);
+        }
+    }
+    if (snapshot.status != 0) {
+        // the module only answers per process for this type
+        return false;
+    }
+
+    auto iter = snapshot.records.find(pid);
+    if (iter == snapshot.records.end()) {
+        // no memory of the type for the process
+        records->resize(0);
+    } else {
+        *records = iter->second;
+    }
+    return true;
+}
 
 IMemtrack* HIDL_FETCH_IMemtrack(const char* /* name */) {
     const hw_module_t* hw_module = nullptr;
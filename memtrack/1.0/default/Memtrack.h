@@ -18,9 +18,33 @@
 #define ANDROID_HARDWARE_MEMTRACK_V1_0_MEMTRACK_H
 
 #include <android/hardware/memtrack/1.0/IMemtrack.h>
+#include <hardware/memtrack.h>
 #include <hidl/Status.h>
 
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 #include <hidl/MQDescriptor.h>
+
+/*
+ * Optional bulk query a legacy memtrack module may export from its library, for when it can
+ * account the memory of every process in one pass:
+ *
+ *   int memtrack_get_all_memory(const memtrack_module_t* module, int type,
+ *                               memtrack_bulk_callback_t callback, void* cookie);
+ *
+ * It calls callback once for each process with memory of the type, and returns 0 on success.
+ */
+extern "C" {
+typedef void (*memtrack_bulk_callback_t)(void* cookie, pid_t pid,
+                                         const struct memtrack_record* records,
+                                         size_t num_records);
+typedef int (*memtrack_get_all_memory_t)(const memtrack_module_t* module, int type,
+                                         memtrack_bulk_callback_t callback, void* cookie);
+}
+
 namespace android {
 namespace hardware {
 namespace memtrack {
@@ -43,7 +67,22 @@ struct Memtrack : public IMemtrack {
     Return<void> getMemory(int32_t pid, MemtrackType type, getMemory_cb _hidl_cb)  override;
 
   private:
+    // Memory of every process for one type, as returned by memtrack_get_all_memory
+    struct Snapshot {
+        bool queried = false;
+        // result of the last memtrack_get_all_memory
+        int status = 0;
+        std::chrono::steady_clock::time_point time;
+        std::unordered_map<int32_t, std::vector<MemtrackRecord>> records;
+    };
+
+    bool getMemoryFromSnapshot(int32_t pid, MemtrackType type, hidl_vec<MemtrackRecord>* records);
+
     const memtrack_module_t* mModule;
+    memtrack_get_all_memory_t mGetAllMemory = nullptr;
+
+    std::mutex mSnapshotLock;
+    Snapshot mSnapshots[static_cast<size_t>(MemtrackType::NUM_TYPES)];
 };
 
 extern "C" IMemtrack* HIDL_FETCH_IMemtrack(const char* name);
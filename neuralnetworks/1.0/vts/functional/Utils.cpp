@@ -41,6 +41,24 @@ constexpr uint32_t kInputPoolIndex = 0;
 constexpr uint32_t kOutputPoolIndex = 1;
 
 Request createRequest(const TestModel& testModel) {
+    RequestMemoryCache cache;
+    return cache.createRequest(testModel);
+}
+
+RequestMemoryCache::Pool& RequestMemoryCache::getPool(uint32_t index, size_t size) {
+    Pool& pool = mPools[index];
+    if (pool.pointer == nullptr || pool.memory.size() < size) {
+        pool.memory = nn::allocateSharedMemory(size);
+        CHECK_NE(pool.memory.size(), 0u);
+        pool.mapping = mapMemory(pool.memory);
+        CHECK(pool.mapping.get() != nullptr);
+        pool.pointer = static_cast<uint8_t*>(static_cast<void*>(pool.mapping->getPointer()));
+        CHECK(pool.pointer != nullptr);
+    }
+    return pool;
+}
+
+Request RequestMemoryCache::createRequest(const TestModel& testModel) {
     // Model inputs.
     hidl_vec<RequestArgument> inputs(testModel.inputIndexes.size());
     size_t inputSize = 0;
@@ -79,15 +97,14 @@ Request createRequest(const TestModel& testModel) {
         outputs[i] = {.hasNoValue = false, .location = loc, .dimensions = {}};
     }
 
-    // Allocate memory pools.
-    hidl_vec<hidl_memory> pools = {nn::allocateSharedMemory(inputSize),
-                                   nn::allocateSharedMemory(outputSize)};
-    CHECK_NE(pools[kInputPoolIndex].size(), 0u);
-    CHECK_NE(pools[kOutputPoolIndex].size(), 0u);
-    sp<IMemory> inputMemory = mapMemory(pools[kInputPoolIndex]);
-    CHECK(inputMemory.get() != nullptr);
-    uint8_t* inputPtr = static_cast<uint8_t*>(static_cast<void*>(inputMemory->getPointer()));
-    CHECK(inputPtr != nullptr);
+    // Allocate memory pools, or reuse the ones of the previous request.
+    Pool& inputPool = getPool(kInputPoolIndex, inputSize);
+    Pool& outputPool = getPool(kOutputPoolIndex, outputSize);
+    uint8_t* inputPtr = inputPool.pointer;
+
+    // A reused output pool still holds the results of the previous execution, which must not
+    // pass for the results of the next one.
+    std::fill(outputPool.pointer, outputPool.pointer + outputPool.memory.size(), 0);
 
     // Copy input data to the memory pool.
     for (uint32_t i = 0; i < testModel.inputIndexes.size(); i++) {
@@ -99,6 +116,7 @@ Request createRequest(const TestModel& testModel) {
         }
     }
 
+    hidl_vec<hidl_memory> pools = {inputPool.memory, outputPool.memory};
     return {.inputs = std::move(inputs), .outputs = std::move(outputs), .pools = std::move(pools)};
 }
 
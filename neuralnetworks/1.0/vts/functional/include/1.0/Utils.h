@@ -19,6 +19,7 @@
 
 #include <android-base/logging.h>
 #include <android/hardware/neuralnetworks/1.0/types.h>
+#include <android/hidl/memory/1.0/IMemory.h>
 #include <algorithm>
 #include <iosfwd>
 #include <string>
@@ -31,6 +32,27 @@ namespace android::hardware::neuralnetworks {
 // Create HIDL Request from the TestModel struct.
 V1_0::Request createRequest(const test_helper::TestModel& testModel);
 
+// Creates HIDL Requests like createRequest, but keeps the input and output memory pools around
+// and hands them out again to the following requests, as long as they are large enough. Repeated
+// executions then only rewrite the input data, and the driver sees the same memory every time,
+// as it does for real apps.
+class RequestMemoryCache {
+  public:
+    V1_0::Request createRequest(const test_helper::TestModel& testModel);
+
+  private:
+    struct Pool {
+        hidl_memory memory;
+        sp<hidl::memory::V1_0::IMemory> mapping;
+        uint8_t* pointer = nullptr;
+    };
+
+    // Returns the pool at the given index, reallocated if it is smaller than size.
+    Pool& getPool(uint32_t index, size_t size);
+
+    Pool mPools[2];
+};
+
 // After execution, copy out output results from the output memory pool.
 std::vector<::test_helper::TestBuffer> getOutputBuffers(const V1_0::Request& request);
 
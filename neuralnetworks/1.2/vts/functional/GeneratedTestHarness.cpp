@@ -33,8 +33,10 @@
 
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <numeric>
+#include <sstream>
 
 #include "1.0/Utils.h"
 #include "1.2/Callbacks.h"
@@ -195,13 +197,14 @@ static std::shared_ptr<::android::nn::ExecutionBurstController> CreateBurst(
 enum class Executor { ASYNC, SYNC, BURST };
 
 void EvaluatePreparedModel(const sp<IPreparedModel>& preparedModel, const TestModel& testModel,
-                           Executor executor, MeasureTiming measure, OutputType outputType) {
+                           Executor executor, MeasureTiming measure, OutputType outputType,
+                           RequestMemoryCache* memoryCache) {
     // If output0 does not have size larger than one byte, we can not test with insufficient buffer.
     if (outputType == OutputType::INSUFFICIENT && !isOutputSizeGreaterThanOne(testModel, 0)) {
         return;
     }
 
-    Request request = createRequest(testModel);
+    Request request = memoryCache->createRequest(testModel);
     if (outputType == OutputType::INSUFFICIENT) {
         makeOutputInsufficientSize(/*outputIndex=*/0, &request);
     }
@@ -315,46 +318,163 @@ void EvaluatePreparedModel(const sp<IPreparedModel>& preparedModel, const TestMo
     checkResults(testModel, outputs);
 }
 
+static const char* toString(Executor executor) {
+    switch (executor) {
+        case Executor::ASYNC:
+            return "ASYNC";
+        case Executor::SYNC:
+            return "SYNC";
+        case Executor::BURST:
+            return "BURST";
+    }
+    return "UNKNOWN";
+}
+
+// Number of untimed executions before the timed ones, and number of timed executions, per
+// executor in benchmark mode.
+constexpr uint32_t kBenchmarkWarmupRuns = 10;
+constexpr uint32_t kBenchmarkRuns = 100;
+
+// Returns the given percentile of the samples using the nearest-rank method, or UINT64_MAX if
+// there are no samples.
+static uint64_t percentile(std::vector<uint64_t> samples, uint32_t percent) {
+    if (samples.empty()) return UINT64_MAX;
+    std::sort(samples.begin(), samples.end());
+    const size_t rank = (samples.size() * percent + 99) / 100;
+    return samples[std::max<size_t>(rank, 1) - 1];
+}
+
+static std::string summarize(const char* name, const std::vector<uint64_t>& samples) {
+    std::ostringstream oss;
+    oss << name;
+    if (samples.empty()) {
+        oss << " not reported";
+    } else {
+        oss << " p50=" << percentile(samples, 50) << "us p90=" << percentile(samples, 90)
+            << "us p99=" << percentile(samples, 99) << "us";
+    }
+    return oss.str();
+}
+
+static void BenchmarkPreparedModel(const sp<IPreparedModel>& preparedModel,
+                                   const TestModel& testModel, Executor executor) {
+    SCOPED_TRACE(toString(executor));
+
+    Request request = createRequest(testModel);
+
+    // A burst is created once, so the timed executions show the benefit of reusing it.
+    std::shared_ptr<::android::nn::ExecutionBurstController> controller;
+    std::vector<intptr_t> keys;
+    if (executor == Executor::BURST) {
+        controller = CreateBurst(preparedModel);
+        ASSERT_NE(nullptr, controller.get());
+        keys.resize(request.pools.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            keys[i] = reinterpret_cast<intptr_t>(&request.pools[i]);
+        }
+    }
+
+    const auto execute = [&](Timing* timing) -> ErrorStatus {
+        hidl_vec<OutputShape> outputShapes;
+        switch (executor) {
+            case Executor::ASYNC: {
+                sp<ExecutionCallback> executionCallback = new ExecutionCallback();
+                Return<ErrorStatus> executionLaunchStatus = ExecutePreparedModel(
+                        preparedModel, request, MeasureTiming::YES, executionCallback);
+                if (!executionLaunchStatus.isOk() ||
+                    static_cast<ErrorStatus>(executionLaunchStatus) != ErrorStatus::NONE) {
+                    return ErrorStatus::GENERAL_FAILURE;
+                }
+                executionCallback->wait();
+                *timing = executionCallback->getTiming();
+                return executionCallback->getStatus();
+            }
+            case Executor::SYNC:
+                return static_cast<ErrorStatus>(ExecutePreparedModel(
+                        preparedModel, request, MeasureTiming::YES, &outputShapes, timing));
+            case Executor::BURST: {
+                ErrorStatus status;
+                std::tie(status, outputShapes, *timing) =
+                        controller->compute(request, MeasureTiming::YES, keys);
+                return status;
+            }
+        }
+        return ErrorStatus::GENERAL_FAILURE;
+    };
+
+    Timing timing;
+    for (uint32_t i = 0; i < kBenchmarkWarmupRuns; i++) {
+        ASSERT_EQ(ErrorStatus::NONE, execute(&timing));
+    }
+
+    std::vector<uint64_t> wallClock, onDevice, inDriver;
+    wallClock.reserve(kBenchmarkRuns);
+    for (uint32_t i = 0; i < kBenchmarkRuns; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        const ErrorStatus status = execute(&timing);
+        const auto end = std::chrono::steady_clock::now();
+        ASSERT_EQ(ErrorStatus::NONE, status);
+
+        wallClock.push_back(
+                std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        // The driver may leave out either time on any execution.
+        if (timing.timeOnDevice != UINT64_MAX) onDevice.push_back(timing.timeOnDevice);
+        if (timing.timeInDriver != UINT64_MAX) inDriver.push_back(timing.timeInDriver);
+    }
+
+    // The results of the last execution must still be right.
+    checkResults(testModel, getOutputBuffers(request));
+
+    const std::string report = std::string(toString(executor)) + ": " +
+                               summarize("wall clock", wallClock) + ", " +
+                               summarize("on device", onDevice) + ", " +
+                               summarize("in driver", inDriver);
+    LOG(INFO) << "NN VTS benchmark: " << report;
+    std::cout << "[          ]   " << report << std::endl;
+}
+
 void EvaluatePreparedModel(const sp<IPreparedModel>& preparedModel, const TestModel& testModel,
                            bool testDynamicOutputShape) {
+    // All executions of the model share their memory pools.
+    RequestMemoryCache memoryCache;
     if (testDynamicOutputShape) {
         EvaluatePreparedModel(preparedModel, testModel, Executor::ASYNC, MeasureTiming::NO,
-                              OutputType::UNSPECIFIED);
+                              OutputType::UNSPECIFIED, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::SYNC, MeasureTiming::NO,
-                              OutputType::UNSPECIFIED);
+                              OutputType::UNSPECIFIED, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::BURST, MeasureTiming::NO,
-                              OutputType::UNSPECIFIED);
+                              OutputType::UNSPECIFIED, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::ASYNC, MeasureTiming::YES,
-                              OutputType::UNSPECIFIED);
+                              OutputType::UNSPECIFIED, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::SYNC, MeasureTiming::YES,
-                              OutputType::UNSPECIFIED);
+                              OutputType::UNSPECIFIED, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::BURST, MeasureTiming::YES,
-                              OutputType::UNSPECIFIED);
+                              OutputType::UNSPECIFIED, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::ASYNC, MeasureTiming::NO,
-                              OutputType::INSUFFICIENT);
+                              OutputType::INSUFFICIENT, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::SYNC, MeasureTiming::NO,
-                              OutputType::INSUFFICIENT);
+                              OutputType::INSUFFICIENT, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::BURST, MeasureTiming::NO,
-                              OutputType::INSUFFICIENT);
+                              OutputType::INSUFFICIENT, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::ASYNC, MeasureTiming::YES,
-                              OutputType::INSUFFICIENT);
+                              OutputType::INSUFFICIENT, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::SYNC, MeasureTiming::YES,
-                              OutputType::INSUFFICIENT);
+                              OutputType::INSUFFICIENT, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::BURST, MeasureTiming::YES,
-                              OutputType::INSUFFICIENT);
+                              OutputType::INSUFFICIENT, &memoryCache);
     } else {
         EvaluatePreparedModel(preparedModel, testModel, Executor::ASYNC, MeasureTiming::NO,
-                              OutputType::FULLY_SPECIFIED);
+                              OutputType::FULLY_SPECIFIED, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::SYNC, MeasureTiming::NO,
-                              OutputType::FULLY_SPECIFIED);
+                              OutputType::FULLY_SPECIFIED, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::BURST, MeasureTiming::NO,
-                              OutputType::FULLY_SPECIFIED);
+                              OutputType::FULLY_SPECIFIED, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::ASYNC, MeasureTiming::YES,
-                              OutputType::FULLY_SPECIFIED);
+                              OutputType::FULLY_SPECIFIED, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::SYNC, MeasureTiming::YES,
-                              OutputType::FULLY_SPECIFIED);
+                              OutputType::FULLY_SPECIFIED, &memoryCache);
         EvaluatePreparedModel(preparedModel, testModel, Executor::BURST, MeasureTiming::YES,
-                              OutputType::FULLY_SPECIFIED);
+                              OutputType::FULLY_SPECIFIED, &memoryCache);
     }
 }
 
@@ -371,6 +491,18 @@ void Execute(const sp<IDevice>& device, const TestModel& testModel, bool testDyn
     EvaluatePreparedModel(preparedModel, testModel, testDynamicOutputShape);
 }
 
+void Benchmark(const sp<IDevice>& device, const TestModel& testModel) {
+    Model model = createModel(testModel);
+
+    sp<IPreparedModel> preparedModel;
+    createPreparedModel(device, model, &preparedModel);
+    if (preparedModel == nullptr) return;
+
+    for (Executor executor : {Executor::ASYNC, Executor::SYNC, Executor::BURST}) {
+        BenchmarkPreparedModel(preparedModel, testModel, executor);
+    }
+}
+
 void GeneratedTestBase::SetUp() {
     testing::TestWithParam<GeneratedTestParam>::SetUp();
     ASSERT_NE(kDevice, nullptr);
@@ -391,6 +523,10 @@ class GeneratedTest : public GeneratedTestBase {};
 // Tag for the dynamic output shape tests
 class DynamicOutputShapeTest : public GeneratedTest {};
 
+// Tag for the benchmarks, which time every model on each executor. They are disabled by
+// default; run them with --gtest_also_run_disabled_tests --gtest_filter=*GeneratedBenchmark*.
+class GeneratedBenchmark : public GeneratedTestBase {};
+
 TEST_P(GeneratedTest, Test) {
     Execute(kDevice, kTestModel, /*testDynamicOutputShape=*/false);
 }
@@ -399,10 +535,17 @@ TEST_P(DynamicOutputShapeTest, Test) {
     Execute(kDevice, kTestModel, /*testDynamicOutputShape=*/true);
 }
 
+TEST_P(GeneratedBenchmark, DISABLED_Benchmark) {
+    Benchmark(kDevice, kTestModel);
+}
+
 INSTANTIATE_GENERATED_TEST(GeneratedTest,
                            [](const TestModel& testModel) { return !testModel.expectFailure; });
 
 INSTANTIATE_GENERATED_TEST(DynamicOutputShapeTest,
                            [](const TestModel& testModel) { return !testModel.expectFailure; });
 
+INSTANTIATE_GENERATED_TEST(GeneratedBenchmark,
+                           [](const TestModel& testModel) { return !testModel.expectFailure; });
+
 }  // namespace android::hardware::neuralnetworks::V1_2::vts::functional
@@ -21,11 +21,14 @@
 #include <ftw.h>
 #include <gtest/gtest.h>
 #include <hidlmemory/mapping.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <random>
+#include <sstream>
 #include <thread>
 
 #include "1.2/Callbacks.h"
@@ -1202,6 +1205,83 @@ TEST_P(CompilationCachingTest, ReplaceSecuritySensitiveCache) {
     }
 }
 
+// Returns the total size in bytes of the files in the given groups.
+static uint64_t getCacheSize(const std::vector<std::vector<std::string>>& fileGroups) {
+    uint64_t size = 0;
+    for (const auto& group : fileGroups) {
+        for (const auto& filename : group) {
+            struct stat st;
+            if (stat(filename.c_str(), &st) == 0) size += st.st_size;
+        }
+    }
+    return size;
+}
+
+static int64_t median(std::vector<int64_t> samples) {
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+// Measures how much faster preparing a model from the cache is than compiling it. Disabled by
+// default, as the timings are only informative; run it with --gtest_also_run_disabled_tests.
+TEST_P(CompilationCachingTest, DISABLED_CacheWarmStartTiming) {
+    constexpr uint32_t kNumIterations = 5;
+
+    // Create test HIDL model and compile.
+    const TestModel& testModel = createTestModel();
+    const Model model = createModel(testModel);
+    if (checkEarlyTermination(model)) return;
+    if (!mIsCachingSupported) return;
+
+    std::vector<int64_t> coldTimes, warmTimes;
+    for (uint32_t i = 0; i < kNumIterations; i++) {
+        // Use a different token every time, so the driver has to really compile the model.
+        mToken[0] = static_cast<uint8_t>(i);
+
+        // Compile the model and save it to cache.
+        {
+            hidl_vec<hidl_handle> modelCache, dataCache;
+            createCacheHandles(mModelCache, AccessMode::READ_WRITE, &modelCache);
+            createCacheHandles(mDataCache, AccessMode::READ_WRITE, &dataCache);
+            const auto start = std::chrono::steady_clock::now();
+            ASSERT_NO_FATAL_FAILURE(saveModelToCache(model, modelCache, dataCache));
+            const auto end = std::chrono::steady_clock::now();
+            coldTimes.push_back(
+                    std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        }
+
+        // Retrieve preparedModel from cache.
+        {
+            sp<IPreparedModel> preparedModel = nullptr;
+            ErrorStatus status;
+            hidl_vec<hidl_handle> modelCache, dataCache;
+            createCacheHandles(mModelCache, AccessMode::READ_WRITE, &modelCache);
+            createCacheHandles(mDataCache, AccessMode::READ_WRITE, &dataCache);
+            const auto start = std::chrono::steady_clock::now();
+            ASSERT_NO_FATAL_FAILURE(
+                    prepareModelFromCache(modelCache, dataCache, &preparedModel, &status));
+            const auto end = std::chrono::steady_clock::now();
+            if (checkEarlyTermination(status)) return;
+            ASSERT_EQ(status, ErrorStatus::NONE);
+            ASSERT_NE(preparedModel, nullptr);
+            warmTimes.push_back(
+                    std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        }
+    }
+
+    const int64_t coldTime = median(coldTimes);
+    const int64_t warmTime = median(warmTimes);
+    std::ostringstream oss;
+    oss << "compile " << coldTime << "us, from cache " << warmTime << "us, model cache "
+        << mNumModelCache << " fds " << getCacheSize(mModelCache) << " bytes, data cache "
+        << mNumDataCache << " fds " << getCacheSize(mDataCache) << " bytes";
+    LOG(INFO) << "NN VTS: " << oss.str();
+    std::cout << "[          ]   " << oss.str() << std::endl;
+
+    EXPECT_LT(warmTime, coldTime) << "preparing the model from cache is not faster than "
+                                     "compiling it";
+}
+
 static const auto kNamedDeviceChoices = testing::ValuesIn(getNamedDevices());
 static const auto kOperandTypeChoices =
         testing::Values(OperandType::TENSOR_FLOAT32, OperandType::TENSOR_QUANT8_ASYMM);
@@ -1,5 +1,7 @@
 #define LOG_TAG "android.hardware.nfc@1.0-impl"
 
+#include <stdio.h>
+
 #include <log/log.h>
 
 #include <hardware/hardware.h>
@@ -12,18 +14,22 @@ namespace nfc {
 namespace V1_0 {
 namespace implementation {
 
-sp<INfcClientCallback> Nfc::mCallback = nullptr;
+NfcDataDispatcher Nfc::sDispatcher(Nfc::sendEvent, Nfc::sendData);
 
 Nfc::Nfc(nfc_nci_device_t* device) : mDevice(device) {}
 
 // Methods from ::android::hardware::nfc::V1_0::INfc follow.
 ::android::hardware::Return<NfcStatus> Nfc::open(const sp<INfcClientCallback>& clientCallback)  {
-    mCallback = clientCallback;
+    // Events of the previous session go to the previous client
+    if (!sDispatcher.drain(kDrainTimeout)) {
+        ALOGW("Events of the previous session still pending, dropping them");
+    }
+    sDispatcher.setCallback(clientCallback);
 
-    if (mDevice == nullptr || mCallback == nullptr) {
+    if (mDevice == nullptr || clientCallback == nullptr) {
         return NfcStatus::FAILED;
     }
-    mCallback->linkToDeath(this, 0 /*cookie*/);
+    clientCallback->linkToDeath(this, 0 /*cookie*/);
     int ret = mDevice->open(mDevice, eventCallback, dataCallback);
     return ret == 0 ? NfcStatus::OK : NfcStatus::FAILED;
 }
@@ -32,6 +38,7 @@ Nfc::Nfc(nfc_nci_device_t* device) : mDevice(device) {}
     if (mDevice == nullptr) {
         return -1;
     }
+    sDispatcher.noteWrite();
     return mDevice->write(mDevice, data.size(), &data[0]);
 }
 
@@ -53,11 +60,17 @@ Nfc::Nfc(nfc_nci_device_t* device) : mDevice(device) {}
 }
 
 ::android::hardware::Return<NfcStatus> Nfc::close()  {
-    if (mDevice == nullptr || mCallback == nullptr) {
+    sp<INfcClientCallback> callback = sDispatcher.getCallback();
+    if (mDevice == nullptr || callback == nullptr) {
         return NfcStatus::FAILED;
     }
-    mCallback->unlinkToDeath(this);
-    return mDevice->close(mDevice) ? NfcStatus::FAILED : NfcStatus::OK;
+    callback->unlinkToDeath(this);
+    int ret = mDevice->close(mDevice);
+    // Return only once the client has seen the events of the session, CLOSE_CPLT included
+    if (!sDispatcher.drain(kDrainTimeout)) {
+        ALOGW("Timed out delivering the events of the closed session");
+    }
+    return ret ? NfcStatus::FAILED : NfcStatus::OK;
 }
 
 ::android::hardware::Return<NfcStatus> Nfc::controlGranted()  {
@@ -74,6 +87,17 @@ Nfc::Nfc(nfc_nci_device_t* device) : mDevice(device) {}
     return mDevice->power_cycle(mDevice) ? NfcStatus::FAILED : NfcStatus::OK;
 }
 
+::android::hardware::Return<void> Nfc::debug(const hidl_handle& handle,
+                                             const hidl_vec<hidl_string>& /*options*/) {
+    if (handle == nullptr || handle->numFds < 1 || handle->data[0] < 0) {
+        ALOGE("debug called with no valid handle");
+        return Void();
+    }
+
+    std::string dump = sDispatcher.dump();
+    dprintf(handle->data[0], "%s", dump.c_str());
+    return Void();
+}
 
 INfc* HIDL_FETCH_INfc(const char * /*name*/) {
     nfc_nci_device_t* nfc_device;
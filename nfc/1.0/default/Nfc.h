@@ -5,6 +5,9 @@
 #include <hidl/Status.h>
 #include <hardware/hardware.h>
 #include <hardware/nfc.h>
+
+#include "NfcDataDispatcher.h"
+
 namespace android {
 namespace hardware {
 namespace nfc {
@@ -30,23 +33,32 @@ struct Nfc : public INfc, public hidl_death_recipient {
     ::android::hardware::Return<NfcStatus> controlGranted() override;
     ::android::hardware::Return<NfcStatus> powerCycle() override;
 
+    ::android::hardware::Return<void> debug(const hidl_handle& handle,
+                                            const hidl_vec<hidl_string>& options) override;
+
+    // Called by the legacy HAL; the client is called back from the dispatcher thread.
     static void eventCallback(uint8_t event, uint8_t status) {
-        if (mCallback != nullptr) {
-            auto ret = mCallback->sendEvent((::android::hardware::nfc::V1_0::NfcEvent)event,
-                                            (::android::hardware::nfc::V1_0::NfcStatus)status);
-            if (!ret.isOk()) {
-                ALOGW("Failed to call back into NFC process.");
-            }
-        }
+        sDispatcher.postEvent(event, status);
     }
     static void dataCallback(uint16_t data_len, uint8_t* p_data) {
+        sDispatcher.postData(p_data, data_len);
+    }
+
+    static void sendEvent(const sp<INfcClientCallback>& callback, uint8_t event,
+                          uint8_t status) {
+        auto ret = callback->sendEvent((::android::hardware::nfc::V1_0::NfcEvent)event,
+                                       (::android::hardware::nfc::V1_0::NfcStatus)status);
+        if (!ret.isOk()) {
+            ALOGW("Failed to call back into NFC process.");
+        }
+    }
+    static void sendData(const sp<INfcClientCallback>& callback, const uint8_t* p_data,
+                         size_t data_len) {
         hidl_vec<uint8_t> data;
-        data.setToExternal(p_data, data_len);
-        if (mCallback != nullptr) {
-            auto ret = mCallback->sendData(data);
-            if (!ret.isOk()) {
-                ALOGW("Failed to call back into NFC process.");
-            }
+        data.setToExternal(const_cast<uint8_t*>(p_data), data_len);
+        auto ret = callback->sendData(data);
+        if (!ret.isOk()) {
+            ALOGW("Failed to call back into NFC process.");
         }
     }
 
@@ -56,7 +68,11 @@ struct Nfc : public INfc, public hidl_death_recipient {
     }
 
    private:
-    static sp<INfcClientCallback> mCallback;
+    // How long close() and open() wait for the events of the previous session to be delivered
+    static constexpr std::chrono::milliseconds kDrainTimeout{1000};
+
+    // Holds the client callback
+    static NfcDataDispatcher sDispatcher;
     const nfc_nci_device_t*       mDevice;
 };
 
@@ -0,0 +1,183 @@
+#define LOG_TAG "android.hardware.nfc@1.0-impl"
+
+#include <cutils/properties.h>
+#include <log/log.h>
+
+#include "NfcDataDispatcher.h"
+
+namespace android {
+namespace hardware {
+namespace nfc {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+// enough for the packets of a burst in flight
+constexpr size_t kMaxFreeBuffers = 16;
+
+uint64_t toUs(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+}  // namespace
+
+NfcDataDispatcher::NfcDataDispatcher(EventSink eventSink, DataSink dataSink)
+    : mEventSink(eventSink),
+      mDataSink(dataSink),
+      mCoalesceData(property_get_bool("ro.vendor.nfc.coalesce_data", false)) {}
+
+NfcDataDispatcher::~NfcDataDispatcher() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExiting = true;
+    }
+    mCondition.notify_all();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void NfcDataDispatcher::postEvent(uint8_t event, uint8_t status) {
+    std::lock_guard<std::mutex> lock(mLock);
+    postLocked({true, event, status, {}, Clock::now()});
+}
+
+void NfcDataDispatcher::postData(const uint8_t* data, size_t length) {
+    std::lock_guard<std::mutex> lock(mLock);
+    std::vector<uint8_t> buffer = obtainBufferLocked();
+    buffer.assign(data, data + length);
+    mPacketCount++;
+    postLocked({false, 0, 0, std::move(buffer), Clock::now()});
+}
+
+void NfcDataDispatcher::noteWrite() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mTransactionPending) {
+        mTransactionPending = true;
+        mTransactionStart = Clock::now();
+    }
+}
+
+bool NfcDataDispatcher::drain(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mLock);
+    return mIdleCondition.wait_for(lock, timeout,
+                                   [this] { return mQueue.empty() && !mDelivering; });
+}
+
+sp<INfcClientCallback> NfcDataDispatcher::getCallback() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mCallback;
+}
+
+void NfcDataDispatcher::setCallback(const sp<INfcClientCallback>& callback) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mQueue.clear();
+    mCallback = callback;
+}
+
+std::string NfcDataDispatcher::dump() {
+    std::lock_guard<std::mutex> lock(mLock);
+    std::string out;
+    out += "data packets: " + std::to_string(mPacketCount) +
+           ", deliveries: " + std::to_string(mDeliveryCount) +
+           (mCoalesceData ? " (coalescing)" : "") + "\n";
+    out += "queue depth: " + std::to_string(mQueue.size()) +
+           ", max: " + std::to_string(mMaxQueueDepth) + "\n";
+    if (mDeliveryCount > 0) {
+        out += "delivery latency avg: " + std::to_string(toUs(mTotalDeliveryLatency) /
+                                                         mDeliveryCount) +
+               "us, max: " + std::to_string(toUs(mMaxDeliveryLatency)) + "us\n";
+    }
+    if (mTransactionCount > 0) {
+        out += "write to data latency avg: " +
+               std::to_string(toUs(mTotalTransactionLatency) / mTransactionCount) +
+               "us, max: " + std::to_string(toUs(mMaxTransactionLatency)) + "us over " +
+               std::to_string(mTransactionCount) + " transactions\n";
+    }
+    return out;
+}
+
+void NfcDataDispatcher::postLocked(Entry&& entry) {
+    if (!mThread.joinable()) {
+        mThread = std::thread(&NfcDataDispatcher::threadLoop, this);
+    }
+    mQueue.push_back(std::move(entry));
+    mMaxQueueDepth = std::max(mMaxQueueDepth, mQueue.size());
+    mCondition.notify_one();
+}
+
+std::vector<uint8_t> NfcDataDispatcher::obtainBufferLocked() {
+    if (mFreeBuffers.empty()) {
+        return {};
+    }
+    std::vector<uint8_t> buffer = std::move(mFreeBuffers.back());
+    mFreeBuffers.pop_back();
+    return buffer;
+}
+
+void NfcDataDispatcher::threadLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mCondition.wait(lock, [this] { return mExiting || !mQueue.empty(); });
+        if (mExiting) {
+            return;
+        }
+
+        Entry entry = std::move(mQueue.front());
+        mQueue.pop_front();
+        if (!entry.isEvent && mCoalesceData) {
+            while (!mQueue.empty() && !mQueue.front().isEvent &&
+                   entry.data.size() + mQueue.front().data.size() <= kMaxCoalescedBytes) {
+                std::vector<uint8_t>& next = mQueue.front().data;
+                entry.data.insert(entry.data.end(), next.begin(), next.end());
+                if (mFreeBuffers.size() < kMaxFreeBuffers) {
+                    mFreeBuffers.push_back(std::move(next));
+                }
+                mQueue.pop_front();
+            }
+        }
+
+        sp<INfcClientCallback> callback = mCallback;
+        mDelivering = true;
+        lock.unlock();
+        if (callback != nullptr) {
+            if (entry.isEvent) {
+                mEventSink(callback, entry.event, entry.status);
+            } else {
+                mDataSink(callback, entry.data.data(), entry.data.size());
+            }
+        }
+        callback.clear();
+        const Clock::time_point delivered = Clock::now();
+        lock.lock();
+        mDelivering = false;
+        if (mQueue.empty()) {
+            mIdleCondition.notify_all();
+        }
+
+        // the latency of a coalesced delivery is that of its oldest packet
+        const Clock::duration latency = delivered - entry.posted;
+        mDeliveryCount++;
+        mTotalDeliveryLatency += latency;
+        mMaxDeliveryLatency = std::max(mMaxDeliveryLatency, latency);
+        if (!entry.isEvent) {
+            if (mTransactionPending) {
+                const Clock::duration transactionLatency = delivered - mTransactionStart;
+                mTransactionPending = false;
+                mTransactionCount++;
+                mTotalTransactionLatency += transactionLatency;
+                mMaxTransactionLatency = std::max(mMaxTransactionLatency, transactionLatency);
+            }
+            if (mFreeBuffers.size() < kMaxFreeBuffers) {
+                mFreeBuffers.push_back(std::move(entry.data));
+            }
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace nfc
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,111 @@
+#ifndef ANDROID_HARDWARE_NFC_V1_0_NFCDATADISPATCHER_H
+#define ANDROID_HARDWARE_NFC_V1_0_NFCDATADISPATCHER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android/hardware/nfc/1.0/INfcClientCallback.h>
+
+namespace android {
+namespace hardware {
+namespace nfc {
+namespace V1_0 {
+namespace implementation {
+
+/*
+ * Delivers the events and data of the legacy NFC HAL to the client from a thread of its own,
+ * so that the vendor HAL's callbacks return without waiting on binder. Events and data are
+ * delivered in the order they were posted.
+ *
+ * The client callback is kept here, under the dispatcher lock, and each delivery goes to the
+ * callback set at the time it is made. drain() lets a session end only once everything the
+ * legacy HAL posted for it has been delivered.
+ *
+ * Consecutive data packets can also be coalesced into one delivery. This is off unless
+ * ro.vendor.nfc.coalesce_data is set, as the stock NFC stack expects one NCI packet per
+ * sendData.
+ */
+class NfcDataDispatcher {
+  public:
+    using EventSink = void (*)(const sp<INfcClientCallback>& callback, uint8_t event,
+                               uint8_t status);
+    using DataSink = void (*)(const sp<INfcClientCallback>& callback, const uint8_t* data,
+                              size_t length);
+
+    static constexpr size_t kMaxCoalescedBytes = 4096;
+
+    NfcDataDispatcher(EventSink eventSink, DataSink dataSink);
+    ~NfcDataDispatcher();
+
+    void postEvent(uint8_t event, uint8_t status);
+    void postData(const uint8_t* data, size_t length);
+
+    // Marks the start of a transaction, timed until the next data delivered.
+    void noteWrite();
+
+    // Waits until everything posted so far has been delivered, for at most timeout. Returns
+    // false on timeout. Must not be called from a sink.
+    bool drain(std::chrono::milliseconds timeout);
+
+    sp<INfcClientCallback> getCallback();
+    // Entries still queued were posted for the previous callback and are dropped.
+    void setCallback(const sp<INfcClientCallback>& callback);
+
+    std::string dump();
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        bool isEvent;
+        uint8_t event;
+        uint8_t status;
+        std::vector<uint8_t> data;
+        Clock::time_point posted;
+    };
+
+    void postLocked(Entry&& entry);
+    void threadLoop();
+    std::vector<uint8_t> obtainBufferLocked();
+
+    const EventSink mEventSink;
+    const DataSink mDataSink;
+    const bool mCoalesceData;
+
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    // signaled when the queue becomes empty and nothing is being delivered
+    std::condition_variable mIdleCondition;
+    std::thread mThread;
+    bool mExiting = false;
+    bool mDelivering = false;
+    std::deque<Entry> mQueue;
+    sp<INfcClientCallback> mCallback;
+    // buffers of delivered packets, reused for the next ones
+    std::vector<std::vector<uint8_t>> mFreeBuffers;
+
+    // statistics, guarded by mLock
+    uint64_t mPacketCount = 0;
+    uint64_t mDeliveryCount = 0;
+    size_t mMaxQueueDepth = 0;
+    Clock::duration mMaxDeliveryLatency{0};
+    Clock::duration mTotalDeliveryLatency{0};
+    bool mTransactionPending = false;
+    Clock::time_point mTransactionStart;
+    uint64_t mTransactionCount = 0;
+    Clock::duration mMaxTransactionLatency{0};
+    Clock::duration mTotalTransactionLatency{0};
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace nfc
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_NFC_V1_0_NFCDATADISPATCHER_H
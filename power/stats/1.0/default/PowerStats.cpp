@@ -24,8 +24,11 @@
 #include <android-base/strings.h>
 #include <inttypes.h>
 #include <stdlib.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <algorithm>
 #include <exception>
+#include <string_view>
 #include <thread>
 
 namespace android {
@@ -38,13 +41,23 @@ namespace implementation {
 #define MAX_FILE_PATH_LEN 128
 #define MAX_DEVICE_NAME_LEN 64
 #define MAX_QUEUE_SIZE 8192
+#define RESIDENCY_FRESHNESS_PROPERTY "vendor.powerstats.residency_freshness_ms"
+// sysfs attributes are at most a page
+#define ENERGY_BUFFER_SIZE 4096
 
 constexpr char kIioDirRoot[] = "/sys/bus/iio/devices/";
 constexpr char kDeviceName[] = "pm_device_name";
 constexpr char kDeviceType[] = "iio:device";
 constexpr uint32_t MAX_SAMPLING_RATE = 10;
+constexpr uint32_t MAX_ENERGY_STREAMS = 4;
 constexpr uint64_t WRITE_TIMEOUT_NS = 1000000000;
 
+static int64_t monotonicTimeNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
 void PowerStats::findIioPowerMonitorNodes() {
     struct dirent* ent;
     int fd;
@@ -123,45 +136,97 @@ size_t PowerStats::parsePowerRails() {
     return index;
 }
 
-int PowerStats::parseIioEnergyNode(std::string devName) {
-    int ret = 0;
-    std::string data;
-    std::string fileName = devName + "/energy_value";
-    if (!android::base::ReadFileToString(fileName, &data)) {
-        ALOGE("Error reading file: %s", fileName.c_str());
+void PowerStats::openIioEnergyNodes() {
+    for (const auto& devicePath : mPm.devicePaths) {
+        IioEnergyNode node;
+        node.fileName = devicePath + "/energy_value";
+        for (const auto& railData : mPm.railsInfo) {
+            if (railData.second.devicePath == devicePath) {
+                node.rails.emplace_back(railData.first, railData.second.index);
+            }
+        }
+        // Start from the order of enabled_rails, which the energy values usually follow
+        std::sort(node.rails.begin(), node.rails.end(),
+                  [](const auto& a, const auto& b) { return a.second < b.second; });
+        node.fd.reset(TEMP_FAILURE_RETRY(open(node.fileName.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (node.fd.get() < 0) {
+            ALOGW("Error opening file: %s", node.fileName.c_str());
+        }
+        mPm.energyNodes.push_back(std::move(node));
+    }
+    mPm.energyBuffer.resize(ENERGY_BUFFER_SIZE);
+}
+
+int PowerStats::parseIioEnergyNode(IioEnergyNode& node) {
+    if (node.fd.get() < 0) {
+        node.fd.reset(TEMP_FAILURE_RETRY(open(node.fileName.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (node.fd.get() < 0) {
+            ALOGE("Error reading file: %s", node.fileName.c_str());
+            return -1;
+        }
+    }
+    char* data = mPm.energyBuffer.data();
+    ssize_t size =
+            TEMP_FAILURE_RETRY(pread(node.fd.get(), data, mPm.energyBuffer.size() - 1, 0));
+    if (size < 0) {
+        ALOGE("Error reading file: %s", node.fileName.c_str());
+        node.fd.reset();
         return -1;
     }
+    data[size] = '\0';
 
-    std::istringstream energyData(data);
-    std::string line;
+    int ret = 0;
     uint64_t timestamp = 0;
     bool timestampRead = false;
-    while (std::getline(energyData, line)) {
-        std::vector<std::string> words = android::base::Split(line, ",");
+    // Position of the next rail in node.rails if the rails are reported in the same order as
+    // the previous time
+    size_t railPosition = 0;
+    const char* end = data + size;
+    for (const char* line = data; line < end;) {
+        const char* lineEnd = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
+        const char* comma = static_cast<const char*>(memchr(line, ',', lineEnd - line));
         if (timestampRead == false) {
-            if (words.size() == 1) {
-                timestamp = strtoull(words[0].c_str(), NULL, 10);
+            if (comma == nullptr) {
+                timestamp = strtoull(line, NULL, 10);
                 if (timestamp == 0 || timestamp == ULLONG_MAX) {
                     ALOGW("Potentially wrong timestamp: %" PRIu64, timestamp);
                 }
                 timestampRead = true;
             }
-        } else if (words.size() == 2) {
-            std::string railName = words[0];
-            if (mPm.railsInfo.count(railName) != 0) {
-                size_t index = mPm.railsInfo[railName].index;
+        } else if (comma != nullptr && memchr(comma + 1, ',', lineEnd - comma - 1) == nullptr) {
+            const std::string_view railName(line, comma - line);
+            auto& rails = node.rails;
+            size_t i = railPosition;
+            if (i >= rails.size() || rails[i].first != railName) {
+                i = std::find_if(rails.begin(), rails.end(),
+                                 [&railName](const auto& rail) { return rail.first == railName; }) -
+                    rails.begin();
+                if (i < rails.size() && i > railPosition) {
+                    std::swap(rails[i], rails[railPosition]);
+                    i = railPosition;
+                }
+            }
+            if (i < rails.size()) {
+                if (i == railPosition) {
+                    railPosition++;
+                }
+                size_t index = rails[i].second;
                 mPm.reading[index].index = index;
                 mPm.reading[index].timestamp = timestamp;
-                mPm.reading[index].energy = strtoull(words[1].c_str(), NULL, 10);
+                mPm.reading[index].energy = strtoull(comma + 1, NULL, 10);
                 if (mPm.reading[index].energy == ULLONG_MAX) {
                     ALOGW("Potentially wrong energy value: %" PRIu64, mPm.reading[index].energy);
                 }
             }
         } else {
-            ALOGW("Unexpected format in file: %s", fileName.c_str());
+            ALOGW("Unexpected format in file: %s", node.fileName.c_str());
             ret = -1;
             break;
         }
+        line = lineEnd + 1;
     }
     return ret;
 }
@@ -172,8 +237,8 @@ Status PowerStats::parseIioEnergyNodes() {
         return Status::NOT_SUPPORTED;
     }
 
-    for (const auto& devicePath : mPm.devicePaths) {
-        if (parseIioEnergyNode(devicePath) < 0) {
+    for (auto& node : mPm.energyNodes) {
+        if (parseIioEnergyNode(node) < 0) {
             ALOGE("Error in parsing power stats");
             ret = Status::FILESYSTEM_ERROR;
             break;
@@ -182,7 +247,11 @@ Status PowerStats::parseIioEnergyNodes() {
     return ret;
 }
 
-PowerStats::PowerStats() {
+PowerStats::PowerStats()
+    : mResidencySnapshot(android::base::GetIntProperty<int64_t>(RESIDENCY_FRESHNESS_PROPERTY, 0)),
+      mDebugDeltaGeneration(0),
+      mSamplerRunning(false),
+      mSamplerPeriodNs(0) {
     findIioPowerMonitorNodes();
     size_t numRails = parsePowerRails();
     if (mPm.devicePaths.empty() || numRails == 0) {
@@ -190,6 +259,19 @@ PowerStats::PowerStats() {
     } else {
         mPm.hwEnabled = true;
         mPm.reading.resize(numRails);
+        mStreamSnapshot.resize(numRails);
+        openIioEnergyNodes();
+    }
+}
+
+PowerStats::~PowerStats() {
+    {
+        std::lock_guard<std::mutex> _lock(mStreamLock);
+        mStreams.clear();
+        updateSamplerTimerLocked();
+    }
+    if (mSamplerThread.joinable()) {
+        mSamplerThread.join();
     }
 }
 
@@ -227,8 +309,8 @@ Return<void> PowerStats::getEnergyData(const hidl_vec<uint32_t>& railIndices,
     }
 
     if (railIndices.size() == 0) {
-        eVal.resize(mPm.railsInfo.size());
-        memcpy(&eVal[0], &mPm.reading[0], mPm.reading.size() * sizeof(EnergyData));
+        // The readings are only used under mPm.mLock, which is held through the callback
+        eVal.setToExternal(mPm.reading.data(), mPm.reading.size());
     } else {
         eVal.resize(railIndices.size());
         int i = 0;
@@ -248,46 +330,135 @@ Return<void> PowerStats::getEnergyData(const hidl_vec<uint32_t>& railIndices,
 
 Return<void> PowerStats::streamEnergyData(uint32_t timeMs, uint32_t samplingRate,
                                           streamEnergyData_cb _hidl_cb) {
-    std::lock_guard<std::mutex> _lock(mPm.mLock);
-    if (mPm.fmqSynchronized != nullptr) {
+    uint32_t sps = std::min(samplingRate, MAX_SAMPLING_RATE);
+    uint32_t numSamples = timeMs * sps / 1000;
+    if (numSamples == 0) {
+        _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::INVALID_INPUT);
+        return Void();
+    }
+    std::unique_ptr<MessageQueueSync> fmq(new (std::nothrow)
+                                                  MessageQueueSync(MAX_QUEUE_SIZE, true));
+    if (fmq == nullptr || fmq->isValid() == false) {
         _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::INSUFFICIENT_RESOURCES);
         return Void();
     }
-    uint32_t sps = std::min(samplingRate, MAX_SAMPLING_RATE);
-    uint32_t numSamples = timeMs * sps / 1000;
-    mPm.fmqSynchronized.reset(new (std::nothrow) MessageQueueSync(MAX_QUEUE_SIZE, true));
-    if (mPm.fmqSynchronized == nullptr || mPm.fmqSynchronized->isValid() == false) {
-        mPm.fmqSynchronized = nullptr;
+
+    std::lock_guard<std::mutex> _lock(mStreamLock);
+    if (mStreams.size() >= MAX_ENERGY_STREAMS || !startSamplerLocked()) {
         _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::INSUFFICIENT_RESOURCES);
         return Void();
     }
-    std::thread pollThread = std::thread([this, sps, numSamples]() {
-        uint64_t sleepTimeUs = 1000000 / sps;
-        uint32_t currSamples = 0;
-        while (currSamples < numSamples) {
-            mPm.mLock.lock();
-            if (parseIioEnergyNodes() == Status::SUCCESS) {
-                mPm.fmqSynchronized->writeBlocking(&mPm.reading[0], mPm.reading.size(),
-                                                   WRITE_TIMEOUT_NS);
-                mPm.mLock.unlock();
-                currSamples++;
-                if (usleep(sleepTimeUs) < 0) {
-                    ALOGW("Sleep interrupted");
-                    break;
-                }
+    // The stream, and so the descriptor, cannot go away before mStreamLock is released
+    const MessageQueueSync::Descriptor* desc = fmq->getDesc();
+    mStreams.push_back({.fmq = std::move(fmq),
+                        .remainingSamples = numSamples,
+                        .intervalNs = 1000000000 / sps,
+                        .nextSampleNs = monotonicTimeNs()});
+    updateSamplerTimerLocked();
+    _hidl_cb(*desc, numSamples, mStreamSnapshot.size(), Status::SUCCESS);
+    return Void();
+}
+
+bool PowerStats::startSamplerLocked() {
+    if (mSamplerTimerFd.get() < 0) {
+        mSamplerTimerFd.reset(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC));
+        if (mSamplerTimerFd.get() < 0) {
+            ALOGE("Failed to create the sampling timer: %s", strerror(errno));
+            return false;
+        }
+    }
+    if (!mSamplerRunning) {
+        if (mSamplerThread.joinable()) {
+            mSamplerThread.join();
+        }
+        mSamplerRunning = true;
+        mSamplerThread = std::thread([this]() { runSampler(); });
+    }
+    return true;
+}
+
+// Ticks at the interval of the fastest stream, starting now. Also wakes the sampler when the
+// streams are gone so that it can exit.
+void PowerStats::updateSamplerTimerLocked() {
+    int64_t periodNs = 0;
+    for (const auto& stream : mStreams) {
+        if (periodNs == 0 || stream.intervalNs < periodNs) {
+            periodNs = stream.intervalNs;
+        }
+    }
+    if (mSamplerTimerFd.get() < 0 || (periodNs == mSamplerPeriodNs && periodNs != 0)) {
+        return;
+    }
+    mSamplerPeriodNs = periodNs;
+    struct itimerspec spec = {.it_interval = {.tv_sec = static_cast<time_t>(periodNs / 1000000000),
+                                              .tv_nsec = static_cast<long>(periodNs % 1000000000)},
+                              .it_value = {.tv_sec = 0, .tv_nsec = 1}};
+    if (timerfd_settime(mSamplerTimerFd.get(), 0, &spec, nullptr) != 0) {
+        ALOGE("Failed to set the sampling timer: %s", strerror(errno));
+    }
+}
+
+void PowerStats::runSampler() {
+    std::unique_lock<std::mutex> lock(mStreamLock);
+    while (!mStreams.empty()) {
+        lock.unlock();
+        uint64_t expirations;
+        if (TEMP_FAILURE_RETRY(read(mSamplerTimerFd.get(), &expirations, sizeof(expirations))) <
+            0) {
+            ALOGE("Failed to wait for the sampling timer: %s", strerror(errno));
+            lock.lock();
+            break;
+        }
+
+        Status status;
+        {
+            // Only the sampling itself is done under mPm.mLock, never the publishing
+            std::lock_guard<std::mutex> _pmLock(mPm.mLock);
+            status = parseIioEnergyNodes();
+            if (status == Status::SUCCESS) {
+                std::copy(mPm.reading.begin(), mPm.reading.end(), mStreamSnapshot.begin());
+            }
+        }
+        const int64_t nowNs = monotonicTimeNs();
+
+        lock.lock();
+        if (status != Status::SUCCESS) {
+            ALOGE("Failed to sample power rails, stopping the streams");
+            break;
+        }
+        bool streamsChanged = false;
+        for (auto it = mStreams.begin(); it != mStreams.end();) {
+            // Streams slower than the timer are due at the tick closest to their next sample
+            if (nowNs + mSamplerPeriodNs / 2 < it->nextSampleNs) {
+                ++it;
+                continue;
+            }
+            it->nextSampleNs += it->intervalNs;
+            if (it->nextSampleNs < nowNs) {
+                // Missed samples are not made up for
+                it->nextSampleNs = nowNs + it->intervalNs;
+            }
+            // The sampler is the only writer, a client that does not keep up loses samples
+            // rather than holding back the other streams
+            if (it->fmq->availableToWrite() >= mStreamSnapshot.size()) {
+                it->fmq->writeBlocking(mStreamSnapshot.data(), mStreamSnapshot.size(),
+                                       WRITE_TIMEOUT_NS);
             } else {
-                mPm.mLock.unlock();
-                break;
+                ALOGW("Energy stream full, dropping a sample");
+            }
+            if (--it->remainingSamples == 0) {
+                it = mStreams.erase(it);
+                streamsChanged = true;
+            } else {
+                ++it;
             }
         }
-        mPm.mLock.lock();
-        mPm.fmqSynchronized = nullptr;
-        mPm.mLock.unlock();
-        return;
-    });
-    pollThread.detach();
-    _hidl_cb(*(mPm.fmqSynchronized)->getDesc(), numSamples, mPm.reading.size(), Status::SUCCESS);
-    return Void();
+        if (streamsChanged) {
+            updateSamplerTimerLocked();
+        }
+    }
+    mStreams.clear();
+    mSamplerRunning = false;
 }
 
 uint32_t PowerStats::addPowerEntity(const std::string& name, PowerEntityType type) {
@@ -298,10 +469,13 @@ uint32_t PowerStats::addPowerEntity(const std::string& name, PowerEntityType typ
 
 void PowerStats::addStateResidencyDataProvider(std::shared_ptr<IStateResidencyDataProvider> p) {
     std::vector<PowerEntityStateSpace> stateSpaces = p->getStateSpaces();
+    std::vector<uint32_t> ids;
     for (auto stateSpace : stateSpaces) {
         mPowerEntityStateSpaces.emplace(stateSpace.powerEntityId, stateSpace);
         mStateResidencyDataProviders.emplace(stateSpace.powerEntityId, p);
+        ids.push_back(stateSpace.powerEntityId);
     }
+    mResidencySnapshot.addProvider(p, ids);
 }
 
 Return<void> PowerStats::getPowerEntityInfo(getPowerEntityInfo_cb _hidl_cb) {
@@ -368,35 +542,25 @@ Return<void> PowerStats::getPowerEntityStateResidencyData(
         return getPowerEntityStateResidencyData(ids, _hidl_cb);
     }
 
-    std::unordered_map<uint32_t, PowerEntityStateResidencyResult> stateResidencies;
-    std::vector<PowerEntityStateResidencyResult> results;
-    results.reserve(powerEntityIds.size());
-
     // return results for only the given powerEntityIds
     bool invalidInput = false;
-    bool filesystemError = false;
+    std::vector<uint32_t> ids;
+    ids.reserve(powerEntityIds.size());
     for (auto id : powerEntityIds) {
-        auto dataProvider = mStateResidencyDataProviders.find(id);
         // skip if the given powerEntityId does not have an associated StateResidencyDataProvider
-        if (dataProvider == mStateResidencyDataProviders.end()) {
+        if (mStateResidencyDataProviders.find(id) == mStateResidencyDataProviders.end()) {
             invalidInput = true;
             continue;
         }
-
-        // get the results if we have not already done so.
-        if (stateResidencies.find(id) == stateResidencies.end()) {
-            if (!dataProvider->second->getResults(stateResidencies)) {
-                filesystemError = true;
-            }
-        }
-
-        // append results
-        auto stateResidency = stateResidencies.find(id);
-        if (stateResidency != stateResidencies.end()) {
-            results.emplace_back(stateResidency->second);
-        }
+        ids.push_back(id);
     }
 
+    // Served from the snapshot shared by the requests of the freshness window
+    std::vector<PowerEntityStateResidencyResult> results;
+    results.reserve(ids.size());
+    uint64_t generation = 0;
+    bool filesystemError = !mResidencySnapshot.getResults(ids, &generation, &results);
+
     auto ret = Status::SUCCESS;
     if (filesystemError) {
         ret = Status::FILESYSTEM_ERROR;
@@ -408,6 +572,24 @@ Return<void> PowerStats::getPowerEntityStateResidencyData(
     return Void();
 }
 
+Status PowerStats::getPowerEntityStateResidencyDelta(
+        uint64_t* generation, std::vector<PowerEntityStateResidencyResult>* results) {
+    // If not configured, return NOT_SUPPORTED
+    if (mStateResidencyDataProviders.empty() || mPowerEntityStateSpaces.empty()) {
+        return Status::NOT_SUPPORTED;
+    }
+
+    std::vector<uint32_t> ids;
+    ids.reserve(mStateResidencyDataProviders.size());
+    for (const auto& dataProvider : mStateResidencyDataProviders) {
+        ids.push_back(dataProvider.first);
+    }
+    if (!mResidencySnapshot.getResults(ids, generation, results)) {
+        return Status::FILESYSTEM_ERROR;
+    }
+    return Status::SUCCESS;
+}
+
 bool DumpResidencyDataToFd(const hidl_vec<PowerEntityInfo>& infos,
                            const hidl_vec<PowerEntityStateSpace>& stateSpaces,
                            const hidl_vec<PowerEntityStateResidencyResult>& results, int fd) {
@@ -453,7 +635,7 @@ bool DumpResidencyDataToFd(const hidl_vec<PowerEntityInfo>& infos,
     return android::base::WriteStringToFd(dumpStats.str(), fd);
 }
 
-Return<void> PowerStats::debug(const hidl_handle& handle, const hidl_vec<hidl_string>&) {
+Return<void> PowerStats::debug(const hidl_handle& handle, const hidl_vec<hidl_string>& args) {
     if (handle == nullptr || handle->numFds < 1) {
         return Void();
     }
@@ -483,12 +665,21 @@ Return<void> PowerStats::debug(const hidl_handle& handle, const hidl_vec<hidl_st
         return Void();
     }
 
-    // Get power entity state residency data
+    // Get power entity state residency data, with "--delta" only what changed since the last
+    // "--delta" dump
     hidl_vec<PowerEntityStateResidencyResult> results;
-    getPowerEntityStateResidencyData({}, [&status, &results](auto rResults, auto rStatus) {
-        status = rStatus;
-        results = rResults;
-    });
+    if (std::find(args.begin(), args.end(), "--delta") != args.end()) {
+        uint64_t generation = mDebugDeltaGeneration;
+        std::vector<PowerEntityStateResidencyResult> changed;
+        status = getPowerEntityStateResidencyDelta(&generation, &changed);
+        mDebugDeltaGeneration = generation;
+        results = changed;
+    } else {
+        getPowerEntityStateResidencyData({}, [&status, &results](auto rResults, auto rStatus) {
+            status = rStatus;
+            results = rResults;
+        });
+    }
 
     // This implementation of getPowerEntityStateResidencyData supports the
     // return of partial results if status == FILESYSTEM_ERROR.
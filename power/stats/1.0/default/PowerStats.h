@@ -17,11 +17,15 @@
 #ifndef ANDROID_HARDWARE_POWERSTATS_V1_0_POWERSTATS_H
 #define ANDROID_HARDWARE_POWERSTATS_V1_0_POWERSTATS_H
 
+#include <android-base/unique_fd.h>
 #include <android/hardware/power/stats/1.0/IPowerStats.h>
 #include <fmq/MessageQueue.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <atomic>
+#include <thread>
 #include <unordered_map>
+#include "StateResidencySnapshot.h"
 
 namespace android {
 namespace hardware {
@@ -52,13 +56,30 @@ struct RailData {
     uint32_t samplingRate;
 };
 
+struct IioEnergyNode {
+    std::string fileName;
+    // Kept open, the node is read again from the start for every sample
+    android::base::unique_fd fd;
+    // Rails of the device and their index, in the order they were last reported
+    std::vector<std::pair<std::string, uint32_t>> rails;
+};
+
 struct OnDeviceMmt {
     std::mutex mLock;
     bool hwEnabled;
     std::vector<std::string> devicePaths;
     std::map<std::string, RailData> railsInfo;
+    std::vector<IioEnergyNode> energyNodes;
+    std::vector<char> energyBuffer;
     std::vector<EnergyData> reading;
-    std::unique_ptr<MessageQueueSync> fmqSynchronized;
+};
+
+// A client of streamEnergyData()
+struct EnergyStream {
+    std::unique_ptr<MessageQueueSync> fmq;
+    uint32_t remainingSamples;
+    int64_t intervalNs;
+    int64_t nextSampleNs;
 };
 
 class IStateResidencyDataProvider {
@@ -72,6 +93,7 @@ class IStateResidencyDataProvider {
 struct PowerStats : public IPowerStats {
    public:
     PowerStats();
+    ~PowerStats();
     uint32_t addPowerEntity(const std::string& name, PowerEntityType type);
     void addStateResidencyDataProvider(std::shared_ptr<IStateResidencyDataProvider> p);
     // Methods from ::android::hardware::power::stats::V1_0::IPowerStats follow.
@@ -87,6 +109,11 @@ struct PowerStats : public IPowerStats {
         const hidl_vec<uint32_t>& powerEntityIds,
         getPowerEntityStateResidencyData_cb _hidl_cb) override;
 
+    // Returns the state residencies of the entities that changed after *generation, and sets
+    // *generation for the next call. Start from 0 to get every entity.
+    Status getPowerEntityStateResidencyDelta(uint64_t* generation,
+                                             std::vector<PowerEntityStateResidencyResult>* results);
+
     // Methods from ::android::hidl::base::V1_0::IBase follow.
     Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override;
 
@@ -94,12 +121,30 @@ struct PowerStats : public IPowerStats {
     OnDeviceMmt mPm;
     void findIioPowerMonitorNodes();
     size_t parsePowerRails();
-    int parseIioEnergyNode(std::string devName);
+    void openIioEnergyNodes();
+    int parseIioEnergyNode(IioEnergyNode& node);
     Status parseIioEnergyNodes();
+    bool startSamplerLocked();
+    void updateSamplerTimerLocked();
+    void runSampler();
     std::vector<PowerEntityInfo> mPowerEntityInfos;
     std::unordered_map<uint32_t, PowerEntityStateSpace> mPowerEntityStateSpaces;
     std::unordered_map<uint32_t, std::shared_ptr<IStateResidencyDataProvider>>
             mStateResidencyDataProviders;
+    StateResidencySnapshot mResidencySnapshot;
+    // Generation of the last "--delta" dump
+    std::atomic<uint64_t> mDebugDeltaGeneration;
+
+    // A single sampler thread reads the rails for every stream, each stream publishes through its
+    // own FMQ at its own rate.
+    std::mutex mStreamLock;
+    std::vector<EnergyStream> mStreams;
+    bool mSamplerRunning;
+    int64_t mSamplerPeriodNs;
+    std::thread mSamplerThread;
+    android::base::unique_fd mSamplerTimerFd;
+    // Last sample published to the streams, only used by the sampler thread
+    std::vector<EnergyData> mStreamSnapshot;
 };
 
 }  // namespace implementation
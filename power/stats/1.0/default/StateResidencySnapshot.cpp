@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.power.stats@1.0-service-mock"
+
+#include "StateResidencySnapshot.h"
+#include "PowerStats.h"
+
+#include <log/log.h>
+#include <algorithm>
+#include <chrono>
+
+namespace android {
+namespace hardware {
+namespace power {
+namespace stats {
+namespace V1_0 {
+namespace implementation {
+
+// Providers beyond this share the threads
+constexpr size_t MAX_RESIDENCY_WORKERS = 3;
+
+static int64_t steadyTimeNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+StateResidencySnapshot::StateResidencySnapshot(int64_t freshnessMs)
+    : mFreshnessNs(freshnessMs * 1000000),
+      mGeneration(0),
+      mRefreshTimeNs(0),
+      mRefreshing(false),
+      mNextProvider(0),
+      mPendingProviders(0),
+      mStopping(false) {}
+
+StateResidencySnapshot::~StateResidencySnapshot() {
+    {
+        std::lock_guard<std::mutex> _lock(mLock);
+        mStopping = true;
+    }
+    mWorkCondition.notify_all();
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+void StateResidencySnapshot::addProvider(std::shared_ptr<IStateResidencyDataProvider> provider,
+                                         const std::vector<uint32_t>& powerEntityIds) {
+    std::lock_guard<std::mutex> _lock(mLock);
+    auto it = std::find(mProviders.begin(), mProviders.end(), provider);
+    const size_t index = it - mProviders.begin();
+    if (it == mProviders.end()) {
+        mProviders.push_back(std::move(provider));
+        mProviderFailed.push_back(false);
+    }
+    for (uint32_t id : powerEntityIds) {
+        mEntityProviders[id] = index;
+    }
+}
+
+bool StateResidencySnapshot::getResults(const std::vector<uint32_t>& powerEntityIds,
+                                        uint64_t* generation,
+                                        std::vector<PowerEntityStateResidencyResult>* results) {
+    std::unique_lock<std::mutex> lock(mLock);
+    if (mRefreshing) {
+        // Share the refresh in progress
+        mRefreshCondition.wait(lock, [this]() { return !mRefreshing; });
+    } else if (mGeneration == 0 || steadyTimeNs() - mRefreshTimeNs >= mFreshnessNs) {
+        refreshLocked(lock);
+    }
+
+    bool ok = true;
+    for (uint32_t id : powerEntityIds) {
+        auto provider = mEntityProviders.find(id);
+        if (provider == mEntityProviders.end()) {
+            continue;
+        }
+        if (mProviderFailed[provider->second]) {
+            ok = false;
+        }
+        auto entry = mEntries.find(id);
+        if (entry != mEntries.end() && entry->second.changedGeneration > *generation) {
+            results->push_back(entry->second.result);
+        }
+    }
+    *generation = mGeneration;
+    return ok;
+}
+
+void StateResidencySnapshot::refreshLocked(std::unique_lock<std::mutex>& lock) {
+    mRefreshing = true;
+    const size_t numProviders = mProviders.size();
+    mProviderResults.resize(numProviders);
+    mNextProvider = 0;
+    mPendingProviders = numProviders;
+    const size_t numWorkers = std::min(numProviders > 0 ? numProviders - 1 : 0,
+                                       MAX_RESIDENCY_WORKERS);
+    while (mWorkers.size() < numWorkers) {
+        mWorkers.emplace_back([this]() { runWorker(); });
+    }
+    mWorkCondition.notify_all();
+    runProvidersLocked(lock);
+    mWorkDoneCondition.wait(lock, [this]() { return mPendingProviders == 0; });
+
+    mGeneration++;
+    for (auto& providerResults : mProviderResults) {
+        for (auto& result : providerResults) {
+            auto entry = mEntries.find(result.first);
+            if (entry == mEntries.end()) {
+                mEntries.emplace(result.first, Entry{std::move(result.second), mGeneration});
+            } else if (!(entry->second.result == result.second)) {
+                entry->second.result = std::move(result.second);
+                entry->second.changedGeneration = mGeneration;
+            }
+        }
+    }
+    mRefreshTimeNs = steadyTimeNs();
+    mRefreshing = false;
+    mRefreshCondition.notify_all();
+}
+
+// Runs the providers not yet taken by a thread, with mLock released while they parse their files.
+void StateResidencySnapshot::runProvidersLocked(std::unique_lock<std::mutex>& lock) {
+    while (mNextProvider < mProviders.size() && mPendingProviders > 0) {
+        const size_t index = mNextProvider++;
+        auto& results = mProviderResults[index];
+        IStateResidencyDataProvider* provider = mProviders[index].get();
+        lock.unlock();
+        results.clear();
+        const bool ok = provider->getResults(results);
+        lock.lock();
+        if (!ok) {
+            ALOGW("State residency provider %zu failed", index);
+        }
+        mProviderFailed[index] = !ok;
+        if (--mPendingProviders == 0) {
+            mWorkDoneCondition.notify_all();
+        }
+    }
+}
+
+void StateResidencySnapshot::runWorker() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mStopping) {
+        runProvidersLocked(lock);
+        mWorkCondition.wait(lock, [this]() {
+            return mStopping || (mPendingProviders > 0 && mNextProvider < mProviders.size());
+        });
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace stats
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_POWERSTATS_V1_0_STATERESIDENCYSNAPSHOT_H
+#define ANDROID_HARDWARE_POWERSTATS_V1_0_STATERESIDENCYSNAPSHOT_H
+
+#include <android/hardware/power/stats/1.0/IPowerStats.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace power {
+namespace stats {
+namespace V1_0 {
+namespace implementation {
+
+class IStateResidencyDataProvider;
+
+// Results of every IStateResidencyDataProvider, shared by the requests made within a freshness
+// window. The request that finds the snapshot stale refreshes it, running the providers in
+// parallel on a small pool of threads, and the requests arriving meanwhile wait for that refresh
+// rather than parsing the same files again.
+//
+// Every refresh is a new generation of the snapshot, and each entity remembers the generation in
+// which its residency last changed, so that callers can ask only for what changed since they last
+// looked.
+class StateResidencySnapshot {
+   public:
+    explicit StateResidencySnapshot(int64_t freshnessMs);
+    ~StateResidencySnapshot();
+
+    // Must not be called once results are requested.
+    void addProvider(std::shared_ptr<IStateResidencyDataProvider> provider,
+                     const std::vector<uint32_t>& powerEntityIds);
+
+    // Appends the results of the powerEntityIds that changed after *generation, all of them when
+    // *generation is 0, and sets *generation to the generation of the snapshot. Ids without a
+    // provider are skipped. Returns false if the provider of one of the ids failed, in which case
+    // its results may be missing or partial.
+    bool getResults(const std::vector<uint32_t>& powerEntityIds, uint64_t* generation,
+                    std::vector<PowerEntityStateResidencyResult>* results);
+
+   private:
+    struct Entry {
+        PowerEntityStateResidencyResult result;
+        uint64_t changedGeneration;
+    };
+
+    void refreshLocked(std::unique_lock<std::mutex>& lock);
+    void runProvidersLocked(std::unique_lock<std::mutex>& lock);
+    void runWorker();
+
+    const int64_t mFreshnessNs;
+    std::mutex mLock;
+    std::condition_variable mRefreshCondition;
+
+    std::vector<std::shared_ptr<IStateResidencyDataProvider>> mProviders;
+    std::unordered_map<uint32_t, size_t> mEntityProviders;
+    std::unordered_map<uint32_t, Entry> mEntries;
+    // Outcome of the last refresh of each provider
+    std::vector<bool> mProviderFailed;
+    uint64_t mGeneration;
+    int64_t mRefreshTimeNs;
+    bool mRefreshing;
+
+    // Work of the refresh in progress, the refreshing thread runs providers too
+    std::vector<std::unordered_map<uint32_t, PowerEntityStateResidencyResult>> mProviderResults;
+    size_t mNextProvider;
+    size_t mPendingProviders;
+    std::condition_variable mWorkCondition;
+    std::condition_variable mWorkDoneCondition;
+    std::vector<std::thread> mWorkers;
+    bool mStopping;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace stats
+}  // namespace power
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_POWERSTATS_V1_0_STATERESIDENCYSNAPSHOT_H
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ANDROID_HARDWARE_RADIO_V1_2_INDICATIONCOALESCER_H
+#define ANDROID_HARDWARE_RADIO_V1_2_INDICATIONCOALESCER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace android {
+namespace hardware {
+namespace radio {
+namespace V1_2 {
+namespace implementation {
+
+/**
+ * Rate limits an unsolicited indication the modem may report far more often than the
+ * framework asked for.
+ *
+ * A report arriving at least one window after the last one sent goes out right away, on the
+ * reporting thread. Reports arriving earlier replace each other, and only the latest one is
+ * sent, from a worker thread, once the window ends. A window of zero sends every report, and
+ * a window of kNever sends none.
+ *
+ * Reports are taken by value and moved into place, so a coalesced report costs the one copy
+ * the caller makes and no more.
+ */
+template <typename T>
+class IndicationCoalescer {
+   public:
+    using Sender = std::function<void(const T&)>;
+
+    static constexpr std::chrono::milliseconds kNever = std::chrono::milliseconds::max();
+
+    explicit IndicationCoalescer(Sender sender)
+        : mSender(std::move(sender)), mThread(&IndicationCoalescer::threadLoop, this) {}
+
+    ~IndicationCoalescer() {
+        {
+            std::lock_guard<std::mutex> lk(mMut);
+            mIsTerminating = true;
+        }
+        mCond.notify_one();
+        mThread.join();
+    }
+
+    void setWindow(std::chrono::milliseconds window) {
+        std::lock_guard<std::mutex> lk(mMut);
+        mWindow = window;
+        if (mWindow == kNever) {
+            mHasPending = false;
+        }
+        mCond.notify_one();
+    }
+
+    void report(T value) {
+        std::unique_lock<std::mutex> lk(mMut);
+        if (mWindow == kNever) return;
+        auto now = std::chrono::steady_clock::now();
+        if (!mHasPending && now >= mLastSent + mWindow) {
+            mLastSent = now;
+            lk.unlock();
+            mSender(value);
+            return;
+        }
+        mPending = std::move(value);
+        mHasPending = true;
+        mCond.notify_one();
+    }
+
+   private:
+    void threadLoop() {
+        std::unique_lock<std::mutex> lk(mMut);
+        while (!mIsTerminating) {
+            if (!mHasPending) {
+                mCond.wait(lk);
+                continue;
+            }
+            auto when = mLastSent + mWindow;
+            if (std::chrono::steady_clock::now() < when) {
+                mCond.wait_until(lk, when);
+                continue;
+            }
+
+            T sending = std::move(mPending);
+            mHasPending = false;
+            mLastSent = std::chrono::steady_clock::now();
+            lk.unlock();
+            mSender(sending);
+            lk.lock();
+        }
+    }
+
+    const Sender mSender;
+
+    std::mutex mMut;
+    std::condition_variable mCond;
+    bool mIsTerminating = false;
+    std::chrono::milliseconds mWindow{0};
+    std::chrono::steady_clock::time_point mLastSent;
+    bool mHasPending = false;
+    T mPending;
+
+    // Last, so that everything the thread uses is initialized before it starts.
+    std::thread mThread;
+};
+
+}  // namespace implementation
+}  // namespace V1_2
+}  // namespace radio
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_RADIO_V1_2_INDICATIONCOALESCER_H
@@ -15,6 +15,8 @@
  */
 #include "Radio.h"
 
+#include <climits>
+
 namespace android {
 namespace hardware {
 namespace radio {
@@ -645,8 +647,24 @@ Return<void> Radio::getCellInfoList(int32_t /* serial */) {
     return Void();
 }
 
-Return<void> Radio::setCellInfoListRate(int32_t /* serial */, int32_t /*rate */) {
-    // TODO implement
+Return<void> Radio::setCellInfoListRate(int32_t serial, int32_t rate) {
+    ALOGD("Radio Request: setCellInfoListRate rate %d", rate);
+
+    ::android::hardware::radio::V1_0::RadioResponseInfo info;
+    info.serial = serial;
+    info.type = ::android::hardware::radio::V1_0::RadioResponseType::SOLICITED;
+    if (rate < 0) {
+        info.error = ::android::hardware::radio::V1_0::RadioError::INVALID_ARGUMENTS;
+    } else {
+        info.error = ::android::hardware::radio::V1_0::RadioError::NONE;
+        // INT_MAX asks for cell info never to be reported.
+        mCellInfoIndications.setWindow(
+            rate == INT_MAX ? decltype(mCellInfoIndications)::kNever
+                            : std::chrono::milliseconds(rate));
+    }
+    if (mRadioResponse != nullptr) {
+        mRadioResponse->setCellInfoListRateResponse(info);
+    }
     return Void();
 }
 
@@ -871,10 +889,23 @@ Return<void> Radio::setIndicationFilter_1_2(
 }
 
 Return<void> Radio::setSignalStrengthReportingCriteria(
-    int32_t /* serial */, int32_t /*hysteresisMs*/, int32_t /*hysteresisDb */,
+    int32_t serial, int32_t hysteresisMs, int32_t /*hysteresisDb */,
     const hidl_vec<int32_t>& /* thresholdsDbm */,
     ::android::hardware::radio::V1_2::AccessNetwork /* accessNetwork */) {
-    // TODO implement
+    ALOGD("Radio Request: setSignalStrengthReportingCriteria hysteresisMs %d", hysteresisMs);
+
+    ::android::hardware::radio::V1_0::RadioResponseInfo info;
+    info.serial = serial;
+    info.type = ::android::hardware::radio::V1_0::RadioResponseType::SOLICITED;
+    if (hysteresisMs < 0) {
+        info.error = ::android::hardware::radio::V1_0::RadioError::INVALID_ARGUMENTS;
+    } else {
+        info.error = ::android::hardware::radio::V1_0::RadioError::NONE;
+        mSignalStrengthIndications.setWindow(std::chrono::milliseconds(hysteresisMs));
+    }
+    if (mRadioResponseV1_2 != nullptr) {
+        mRadioResponseV1_2->setSignalStrengthReportingCriteriaResponse(info);
+    }
     return Void();
 }
 
@@ -904,6 +935,31 @@ Return<void> Radio::deactivateDataCall_1_2(
     return Void();
 }
 
+void Radio::reportSignalStrength(
+    const ::android::hardware::radio::V1_2::SignalStrength& signalStrength) {
+    mSignalStrengthIndications.report(signalStrength);
+}
+
+void Radio::reportCellInfoList(
+    const hidl_vec<::android::hardware::radio::V1_2::CellInfo>& records) {
+    mCellInfoIndications.report(records);
+}
+
+void Radio::sendSignalStrength(
+    const ::android::hardware::radio::V1_2::SignalStrength& signalStrength) {
+    if (mRadioIndicationV1_2 != nullptr) {
+        mRadioIndicationV1_2->currentSignalStrength_1_2(
+            ::android::hardware::radio::V1_0::RadioIndicationType::UNSOLICITED, signalStrength);
+    }
+}
+
+void Radio::sendCellInfoList(const hidl_vec<::android::hardware::radio::V1_2::CellInfo>& records) {
+    if (mRadioIndicationV1_2 != nullptr) {
+        mRadioIndicationV1_2->cellInfoList_1_2(
+            ::android::hardware::radio::V1_0::RadioIndicationType::UNSOLICITED, records);
+    }
+}
+
 }  // namespace implementation
 }  // namespace V1_2
 }  // namespace radio
@@ -16,6 +16,8 @@
 #ifndef ANDROID_HARDWARE_RADIO_V1_2_RADIO_H
 #define ANDROID_HARDWARE_RADIO_V1_2_RADIO_H
 
+#include "IndicationCoalescer.h"
+
 #include <android/hardware/radio/1.2/IRadio.h>
 #include <android/hardware/radio/1.2/IRadioIndication.h>
 #include <android/hardware/radio/1.2/IRadioResponse.h>
@@ -45,6 +47,30 @@ struct Radio : public IRadio {
     sp<::android::hardware::radio::V1_2::IRadioResponse> mRadioResponseV1_2;
     sp<::android::hardware::radio::V1_2::IRadioIndication> mRadioIndicationV1_2;
 
+    /**
+     * Unsolicited signal strength and cell info reports from the modem go through these, so
+     * they reach the framework no more often than setSignalStrengthReportingCriteria's
+     * hysteresisMs and setCellInfoListRate's rate allow.
+     */
+    IndicationCoalescer<::android::hardware::radio::V1_2::SignalStrength>
+        mSignalStrengthIndications{
+            [this](const ::android::hardware::radio::V1_2::SignalStrength& signalStrength) {
+                sendSignalStrength(signalStrength);
+            }};
+    IndicationCoalescer<hidl_vec<::android::hardware::radio::V1_2::CellInfo>>
+        mCellInfoIndications{
+            [this](const hidl_vec<::android::hardware::radio::V1_2::CellInfo>& records) {
+                sendCellInfoList(records);
+            }};
+
+    // Called by the vendor modem code for every report it gets.
+    void reportSignalStrength(
+        const ::android::hardware::radio::V1_2::SignalStrength& signalStrength);
+    void reportCellInfoList(const hidl_vec<::android::hardware::radio::V1_2::CellInfo>& records);
+
+    void sendSignalStrength(const ::android::hardware::radio::V1_2::SignalStrength& signalStrength);
+    void sendCellInfoList(const hidl_vec<::android::hardware::radio::V1_2::CellInfo>& records);
+
     // Methods from ::android::hardware::radio::V1_0::IRadio follow.
     Return<void> setResponseFunctions(
         const sp<::android::hardware::radio::V1_0::IRadioResponse>& radioResponse,
@@ -17,6 +17,8 @@
 #include "Context.h"
 #include "Device.h"
 
+#include <hidlmemory/mapping.h>
+
 namespace android {
 namespace hardware {
 namespace renderscript {
@@ -64,6 +66,18 @@ static std::vector<RsType> hidl_to_rs(const hidl_vec<HidlType>& src, Operation o
     return dst;
 }
 
+// Converts into a per-thread scratch vector instead of a new one, so a pipeline issuing many
+// small calls does not allocate for each of them. The result is valid until the next
+// conversion into the same Slot on this thread; since the Rs handle types are all void*,
+// conversions that must coexist in one call need distinct slots.
+template<typename RsType, int Slot, typename HidlType, typename Operation>
+static std::vector<RsType>& hidl_to_rs_scratch(const hidl_vec<HidlType>& src, Operation operation) {
+    static thread_local std::vector<RsType> dst;
+    dst.resize(src.size());
+    std::transform(src.begin(), src.end(), dst.begin(), operation);
+    return dst;
+}
+
 template<typename ReturnType, typename SourceType>
 static ReturnType rs_to_hidl(SourceType* src) {
     return static_cast<ReturnType>(reinterpret_cast<uintptr_t>(src));
@@ -510,12 +524,12 @@ Return<void> Context::getName(ObjectBase obj, getName_cb _hidl_cb) {
 Return<Closure> Context::closureCreate(ScriptKernelID kernelID, Allocation returnValue, const hidl_vec<ScriptFieldID>& fieldIDS, const hidl_vec<int64_t>& values, const hidl_vec<int32_t>& sizes, const hidl_vec<Closure>& depClosures, const hidl_vec<ScriptFieldID>& depFieldIDS) {
     RsScriptKernelID _kernelID = hidl_to_rs<RsScriptKernelID>(kernelID);
     RsAllocation _returnValue = hidl_to_rs<RsAllocation>(returnValue);
-    std::vector<RsScriptFieldID> _fieldIDS = hidl_to_rs<RsScriptFieldID>(fieldIDS, [](ScriptFieldID val) { return hidl_to_rs<RsScriptFieldID>(val); });
+    std::vector<RsScriptFieldID>& _fieldIDS = hidl_to_rs_scratch<RsScriptFieldID, 0>(fieldIDS, [](ScriptFieldID val) { return hidl_to_rs<RsScriptFieldID>(val); });
     int64_t* _valuesPtr = const_cast<int64_t*>(values.data());
     size_t _valuesLength = values.size();
-    std::vector<int>             _sizes       = hidl_to_rs<int>(sizes,                   [](int32_t val) { return static_cast<int>(val); });
-    std::vector<RsClosure>       _depClosures = hidl_to_rs<RsClosure>(depClosures,       [](Closure val) { return hidl_to_rs<RsClosure>(val); });
-    std::vector<RsScriptFieldID> _depFieldIDS = hidl_to_rs<RsScriptFieldID>(depFieldIDS, [](ScriptFieldID val) { return hidl_to_rs<RsScriptFieldID>(val); });
+    std::vector<int>&             _sizes       = hidl_to_rs_scratch<int, 0>(sizes,                   [](int32_t val) { return static_cast<int>(val); });
+    std::vector<RsClosure>&       _depClosures = hidl_to_rs_scratch<RsClosure, 1>(depClosures,       [](Closure val) { return hidl_to_rs<RsClosure>(val); });
+    std::vector<RsScriptFieldID>& _depFieldIDS = hidl_to_rs_scratch<RsScriptFieldID, 2>(depFieldIDS, [](ScriptFieldID val) { return hidl_to_rs<RsScriptFieldID>(val); });
     RsClosure _closure = Device::getHal().ClosureCreate(mContext, _kernelID, _returnValue, _fieldIDS.data(), _fieldIDS.size(), _valuesPtr, _valuesLength, _sizes.data(), _sizes.size(), _depClosures.data(), _depClosures.size(), _depFieldIDS.data(), _depFieldIDS.size());
     return rs_to_hidl<Closure>(_closure);
 }
@@ -524,10 +538,10 @@ Return<Closure> Context::invokeClosureCreate(ScriptInvokeID invokeID, const hidl
     RsScriptInvokeID _invokeID = hidl_to_rs<RsScriptInvokeID>(invokeID);
     const void* _paramsPtr = params.data();
     size_t _paramsSize = params.size();
-    std::vector<RsScriptFieldID> _fieldIDS = hidl_to_rs<RsScriptFieldID>(fieldIDS, [](ScriptFieldID val) { return hidl_to_rs<RsScriptFieldID>(val); });
+    std::vector<RsScriptFieldID>& _fieldIDS = hidl_to_rs_scratch<RsScriptFieldID, 0>(fieldIDS, [](ScriptFieldID val) { return hidl_to_rs<RsScriptFieldID>(val); });
     const int64_t* _valuesPtr = values.data();
     size_t _valuesLength = values.size();
-    std::vector<int> _sizes = hidl_to_rs<int>(sizes, [](int32_t val) { return static_cast<int>(val); });
+    std::vector<int>& _sizes = hidl_to_rs_scratch<int, 0>(sizes, [](int32_t val) { return static_cast<int>(val); });
     RsClosure _closure = Device::getHal().InvokeClosureCreate(mContext, _invokeID, _paramsPtr, _paramsSize, _fieldIDS.data(), _fieldIDS.size(), _valuesPtr, _valuesLength, _sizes.data(), _sizes.size());
     return rs_to_hidl<Closure>(_closure);
 }
@@ -585,7 +599,7 @@ Return<ScriptGroup> Context::scriptGroupCreate(const hidl_vec<ScriptKernelID>& k
 Return<ScriptGroup2> Context::scriptGroup2Create(const hidl_string& name, const hidl_string& cacheDir, const hidl_vec<Closure>& closures) {
     const hidl_string& _name = name;
     const hidl_string& _cacheDir = cacheDir;
-    std::vector<RsClosure> _closures = hidl_to_rs<RsClosure>(closures, [](Closure val) { return hidl_to_rs<RsClosure>(val); });
+    std::vector<RsClosure>& _closures = hidl_to_rs_scratch<RsClosure, 0>(closures, [](Closure val) { return hidl_to_rs<RsClosure>(val); });
     RsScriptGroup2 _scriptGroup2 = Device::getHal().ScriptGroup2Create(mContext, _name.c_str(), _name.size(), _cacheDir.c_str(), _cacheDir.size(), _closures.data(), _closures.size());
     return rs_to_hidl<ScriptGroup2>(_scriptGroup2);
 }
@@ -613,6 +627,7 @@ Return<void> Context::scriptGroupExecute(ScriptGroup sg) {
 }
 
 Return<void> Context::objDestroy(ObjectBase obj) {
+    allocationUnbindMemory(obj);
     RsAsyncVoidPtr _obj = hidl_to_rs<RsAsyncVoidPtr>(obj);
     Device::getHal().ObjDestroy(mContext, _obj);
     return Void();
@@ -663,7 +678,7 @@ Return<void> Context::scriptInvokeV(Script vs, uint32_t slot, const hidl_vec<uin
 Return<void> Context::scriptForEach(Script vs, uint32_t slot, const hidl_vec<Allocation>& vains, Allocation vaout, const hidl_vec<uint8_t>& params, Ptr sc) {
     RsScript _vs = hidl_to_rs<RsScript>(vs);
     uint32_t _slot = slot;
-    std::vector<RsAllocation> _vains = hidl_to_rs<RsAllocation>(vains, [](Allocation val) { return hidl_to_rs<RsAllocation>(val); });
+    std::vector<RsAllocation>& _vains = hidl_to_rs_scratch<RsAllocation, 0>(vains, [](Allocation val) { return hidl_to_rs<RsAllocation>(val); });
     RsAllocation _vaout = hidl_to_rs<RsAllocation>(vaout);
     const void* _paramsPtr = hidl_to_rs<const void*>(params.data());
     size_t _paramLen = params.size();
@@ -676,7 +691,7 @@ Return<void> Context::scriptForEach(Script vs, uint32_t slot, const hidl_vec<All
 Return<void> Context::scriptReduce(Script vs, uint32_t slot, const hidl_vec<Allocation>& vains, Allocation vaout, Ptr sc) {
     RsScript _vs = hidl_to_rs<RsScript>(vs);
     uint32_t _slot = slot;
-    std::vector<RsAllocation> _vains = hidl_to_rs<RsAllocation>(vains, [](Allocation val) { return hidl_to_rs<RsAllocation>(val); });
+    std::vector<RsAllocation>& _vains = hidl_to_rs_scratch<RsAllocation, 0>(vains, [](Allocation val) { return hidl_to_rs<RsAllocation>(val); });
     RsAllocation _vaout = hidl_to_rs<RsAllocation>(vaout);
     const RsScriptCall* _sc = hidl_to_rs<const RsScriptCall*>(sc);
     size_t _scLen = _sc != nullptr ? sizeof(ScriptCall) : 0;
@@ -773,6 +788,331 @@ Return<Script> Context::scriptIntrinsicCreate(ScriptIntrinsicID id, Element elem
 }
 
 
+// Shared memory allocation I/O.
+
+bool Context::allocationBindMemory(Allocation allocation, const hidl_memory& memory) {
+    sp<IMemory> mapped = mapMemory(memory);
+    if (mapped == nullptr) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mBoundMemoryLock);
+    mBoundMemory[allocation] = mapped;
+    return true;
+}
+
+void Context::allocationUnbindMemory(Allocation allocation) {
+    sp<IMemory> unmapped;
+    std::lock_guard<std::mutex> lock(mBoundMemoryLock);
+    auto it = mBoundMemory.find(allocation);
+    if (it != mBoundMemory.end()) {
+        // unmapped outlives the lock, so the munmap happens after it is released
+        unmapped = std::move(it->second);
+        mBoundMemory.erase(it);
+    }
+}
+
+sp<IMemory> Context::getBoundRange(Allocation allocation, Size memOffset, Size sizeBytes, uint8_t** outPtr) {
+    sp<IMemory> mapped;
+    {
+        std::lock_guard<std::mutex> lock(mBoundMemoryLock);
+        auto it = mBoundMemory.find(allocation);
+        if (it == mBoundMemory.end()) {
+            return nullptr;
+        }
+        mapped = it->second;
+    }
+    uint64_t size = mapped->getSize();
+    if (memOffset > size || sizeBytes > size - memOffset) {
+        return nullptr;
+    }
+    *outPtr = static_cast<uint8_t*>(static_cast<void*>(mapped->getPointer())) + memOffset;
+    return mapped;
+}
+
+bool Context::isAllocationStorage(Allocation allocation, uint32_t lod, AllocationCubemapFace face, uint32_t z, const void* ptr) {
+    RsAllocation _allocation = hidl_to_rs<RsAllocation>(allocation);
+    RsAllocationCubemapFace _face = static_cast<RsAllocationCubemapFace>(face);
+    size_t _stride = 0;
+    const void* _storage = Device::getHal().AllocationGetPointer(mContext, _allocation, lod, _face, z, 0, &_stride, sizeof(size_t));
+    return _storage == ptr;
+}
+
+bool Context::allocation1DWriteFromMemory(Allocation allocation, uint32_t offset, uint32_t lod, uint32_t count, Size memOffset, Size sizeBytes) {
+    uint8_t* _dataPtr;
+    sp<IMemory> mapped = getBoundRange(allocation, memOffset, sizeBytes, &_dataPtr);
+    if (mapped == nullptr) {
+        return false;
+    }
+    if (offset == 0 && isAllocationStorage(allocation, lod, AllocationCubemapFace::POSITIVE_X, 0, _dataPtr)) {
+        return true;
+    }
+    RsAllocation _allocation = hidl_to_rs<RsAllocation>(allocation);
+    Device::getHal().Allocation1DData(mContext, _allocation, offset, lod, count, _dataPtr, sizeBytes);
+    return true;
+}
+
+bool Context::allocation2DWriteFromMemory(Allocation allocation, uint32_t xoff, uint32_t yoff, uint32_t lod, AllocationCubemapFace face, uint32_t w, uint32_t h, Size memOffset, Size sizeBytes, Size stride) {
+    uint8_t* _dataPtr;
+    sp<IMemory> mapped = getBoundRange(allocation, memOffset, sizeBytes, &_dataPtr);
+    if (mapped == nullptr) {
+        return false;
+    }
+    if (xoff == 0 && yoff == 0 && isAllocationStorage(allocation, lod, face, 0, _dataPtr)) {
+        return true;
+    }
+    RsAllocation _allocation = hidl_to_rs<RsAllocation>(allocation);
+    RsAllocationCubemapFace _face = static_cast<RsAllocationCubemapFace>(face);
+    Device::getHal().Allocation2DData(mContext, _allocation, xoff, yoff, lod, _face, w, h, _dataPtr, sizeBytes, stride);
+    return true;
+}
+
+bool Context::allocation3DWriteFromMemory(Allocation allocation, uint32_t xoff, uint32_t yoff, uint32_t zoff, uint32_t lod, uint32_t w, uint32_t h, uint32_t d, Size memOffset, Size sizeBytes, Size stride) {
+    uint8_t* _dataPtr;
+    sp<IMemory> mapped = getBoundRange(allocation, memOffset, sizeBytes, &_dataPtr);
+    if (mapped == nullptr) {
+        return false;
+    }
+    if (xoff == 0 && yoff == 0 && zoff == 0 && isAllocationStorage(allocation, lod, AllocationCubemapFace::POSITIVE_X, 0, _dataPtr)) {
+        return true;
+    }
+    RsAllocation _allocation = hidl_to_rs<RsAllocation>(allocation);
+    Device::getHal().Allocation3DData(mContext, _allocation, xoff, yoff, zoff, lod, w, h, d, _dataPtr, sizeBytes, stride);
+    return true;
+}
+
+bool Context::allocation1DReadToMemory(Allocation allocation, uint32_t xoff, uint32_t lod, uint32_t count, Size memOffset, Size sizeBytes) {
+    uint8_t* _dataPtr;
+    sp<IMemory> mapped = getBoundRange(allocation, memOffset, sizeBytes, &_dataPtr);
+    if (mapped == nullptr) {
+        return false;
+    }
+    if (xoff == 0 && isAllocationStorage(allocation, lod, AllocationCubemapFace::POSITIVE_X, 0, _dataPtr)) {
+        return true;
+    }
+    RsAllocation _allocation = hidl_to_rs<RsAllocation>(allocation);
+    Device::getHal().Allocation1DRead(mContext, _allocation, xoff, lod, count, _dataPtr, sizeBytes);
+    return true;
+}
+
+bool Context::allocation2DReadToMemory(Allocation allocation, uint32_t xoff, uint32_t yoff, uint32_t lod, AllocationCubemapFace face, uint32_t w, uint32_t h, Size memOffset, Size sizeBytes, Size stride) {
+    uint8_t* _dataPtr;
+    sp<IMemory> mapped = getBoundRange(allocation, memOffset, sizeBytes, &_dataPtr);
+    if (mapped == nullptr) {
+        return false;
+    }
+    if (xoff == 0 && yoff == 0 && isAllocationStorage(allocation, lod, face, 0, _dataPtr)) {
+        return true;
+    }
+    RsAllocation _allocation = hidl_to_rs<RsAllocation>(allocation);
+    RsAllocationCubemapFace _face = static_cast<RsAllocationCubemapFace>(face);
+    Device::getHal().Allocation2DRead(mContext, _allocation, xoff, yoff, lod, _face, w, h, _dataPtr, sizeBytes, stride);
+    return true;
+}
+
+bool Context::allocation3DReadToMemory(Allocation allocation, uint32_t xoff, uint32_t yoff, uint32_t zoff, uint32_t lod, uint32_t w, uint32_t h, uint32_t d, Size memOffset, Size sizeBytes, Size stride) {
+    uint8_t* _dataPtr;
+    sp<IMemory> mapped = getBoundRange(allocation, memOffset, sizeBytes, &_dataPtr);
+    if (mapped == nullptr) {
+        return false;
+    }
+    if (xoff == 0 && yoff == 0 && zoff == 0 && isAllocationStorage(allocation, lod, AllocationCubemapFace::POSITIVE_X, 0, _dataPtr)) {
+        return true;
+    }
+    RsAllocation _allocation = hidl_to_rs<RsAllocation>(allocation);
+    Device::getHal().Allocation3DRead(mContext, _allocation, xoff, yoff, zoff, lod, w, h, d, _dataPtr, sizeBytes, stride);
+    return true;
+}
+
+
+namespace {
+
+class ContextCommandReader {
+ public:
+    ContextCommandReader(const uint32_t* data, size_t size)
+        : mData(data), mSize(size), mPos(0), mCommandEnd(0) {}
+
+    bool isEmpty() const { return mPos >= mSize; }
+
+    bool beginCommand(ContextCommand* outCommand) {
+        uint32_t header = mData[mPos++];
+        *outCommand = static_cast<ContextCommand>(header & static_cast<uint32_t>(ContextCommand::OPCODE_MASK));
+        mCommandEnd = mPos + (header & static_cast<uint32_t>(ContextCommand::LENGTH_MASK));
+        return mCommandEnd <= mSize;
+    }
+
+    // true if the command body was consumed exactly
+    bool endCommand() {
+        bool ok = mOk && mPos == mCommandEnd;
+        mPos = mCommandEnd;
+        return ok;
+    }
+
+    uint32_t read() {
+        if (mPos >= mCommandEnd) {
+            mOk = false;
+            return 0;
+        }
+        return mData[mPos++];
+    }
+
+    uint64_t read64() {
+        uint64_t lo = read();
+        uint64_t hi = read();
+        return lo | (hi << 32);
+    }
+
+    template<typename RsType>
+    RsType readHandle() { return hidl_to_rs<RsType>(read64()); }
+
+    // Returns a pointer into the command buffer, the payload is not copied.
+    const void* readBlob(size_t* outSize) {
+        size_t sizeBytes = read();
+        size_t words = (sizeBytes + 3) / 4;
+        if (mCommandEnd - mPos < words) {
+            mOk = false;
+            *outSize = 0;
+            return nullptr;
+        }
+        const void* blob = &mData[mPos];
+        mPos += words;
+        *outSize = sizeBytes;
+        return blob;
+    }
+
+ private:
+    const uint32_t* mData;
+    size_t mSize;
+    size_t mPos;
+    size_t mCommandEnd;
+    bool mOk = true;
+};
+
+}  // anonymous namespace
+
+bool Context::executeCommands(const uint32_t* commands, size_t length) {
+    static thread_local std::vector<RsAllocation> _vains;
+    ContextCommandReader reader(commands, length);
+    auto& hal = Device::getHal();
+
+    while (!reader.isEmpty()) {
+        ContextCommand command;
+        if (!reader.beginCommand(&command)) {
+            return false;
+        }
+
+        switch (command) {
+            case ContextCommand::ALLOCATION_1D_WRITE: {
+                RsAllocation _allocation = reader.readHandle<RsAllocation>();
+                uint32_t _offset = reader.read();
+                uint32_t _lod = reader.read();
+                uint32_t _count = reader.read();
+                size_t _sizeBytes;
+                const void* _dataPtr = reader.readBlob(&_sizeBytes);
+                if (!reader.endCommand()) return false;
+                hal.Allocation1DData(mContext, _allocation, _offset, _lod, _count, _dataPtr, _sizeBytes);
+                break;
+            }
+            case ContextCommand::SCRIPT_INVOKE: {
+                RsScript _vs = reader.readHandle<RsScript>();
+                uint32_t _slot = reader.read();
+                if (!reader.endCommand()) return false;
+                hal.ScriptInvoke(mContext, _vs, _slot);
+                break;
+            }
+            case ContextCommand::SCRIPT_INVOKE_V: {
+                RsScript _vs = reader.readHandle<RsScript>();
+                uint32_t _slot = reader.read();
+                size_t _len;
+                const void* _dataPtr = reader.readBlob(&_len);
+                if (!reader.endCommand()) return false;
+                hal.ScriptInvokeV(mContext, _vs, _slot, _dataPtr, _len);
+                break;
+            }
+            case ContextCommand::SCRIPT_FOR_EACH: {
+                RsScript _vs = reader.readHandle<RsScript>();
+                uint32_t _slot = reader.read();
+                uint32_t _vainCount = reader.read();
+                _vains.clear();
+                for (uint32_t i = 0; i < _vainCount && i < length; i++) {
+                    _vains.push_back(reader.readHandle<RsAllocation>());
+                }
+                RsAllocation _vaout = reader.readHandle<RsAllocation>();
+                size_t _paramLen;
+                const void* _paramsPtr = reader.readBlob(&_paramLen);
+                if (!reader.endCommand() || _vains.size() != _vainCount) return false;
+                hal.ScriptForEachMulti(mContext, _vs, _slot, _vains.data(), _vains.size(), _vaout, _paramsPtr, _paramLen, nullptr, 0);
+                break;
+            }
+            case ContextCommand::SCRIPT_SET_VAR_I: {
+                RsScript _vs = reader.readHandle<RsScript>();
+                uint32_t _slot = reader.read();
+                int _value = static_cast<int32_t>(reader.read());
+                if (!reader.endCommand()) return false;
+                hal.ScriptSetVarI(mContext, _vs, _slot, _value);
+                break;
+            }
+            case ContextCommand::SCRIPT_SET_VAR_J: {
+                RsScript _vs = reader.readHandle<RsScript>();
+                uint32_t _slot = reader.read();
+                int64_t _value = static_cast<int64_t>(reader.read64());
+                if (!reader.endCommand()) return false;
+                hal.ScriptSetVarJ(mContext, _vs, _slot, _value);
+                break;
+            }
+            case ContextCommand::SCRIPT_SET_VAR_F: {
+                RsScript _vs = reader.readHandle<RsScript>();
+                uint32_t _slot = reader.read();
+                uint32_t _bits = reader.read();
+                float _value;
+                memcpy(&_value, &_bits, sizeof(_value));
+                if (!reader.endCommand()) return false;
+                hal.ScriptSetVarF(mContext, _vs, _slot, _value);
+                break;
+            }
+            case ContextCommand::SCRIPT_SET_VAR_D: {
+                RsScript _vs = reader.readHandle<RsScript>();
+                uint32_t _slot = reader.read();
+                uint64_t _bits = reader.read64();
+                double _value;
+                memcpy(&_value, &_bits, sizeof(_value));
+                if (!reader.endCommand()) return false;
+                hal.ScriptSetVarD(mContext, _vs, _slot, _value);
+                break;
+            }
+            case ContextCommand::SCRIPT_SET_VAR_V: {
+                RsScript _vs = reader.readHandle<RsScript>();
+                uint32_t _slot = reader.read();
+                size_t _len;
+                const void* _dataPtr = reader.readBlob(&_len);
+                if (!reader.endCommand()) return false;
+                hal.ScriptSetVarV(mContext, _vs, _slot, _dataPtr, _len);
+                break;
+            }
+            case ContextCommand::SCRIPT_SET_VAR_OBJ: {
+                RsScript _vs = reader.readHandle<RsScript>();
+                uint32_t _slot = reader.read();
+                RsObjectBase _obj = reader.readHandle<RsObjectBase>();
+                if (!reader.endCommand()) return false;
+                hal.ScriptSetVarObj(mContext, _vs, _slot, _obj);
+                break;
+            }
+            case ContextCommand::CLOSURE_SET_GLOBAL: {
+                RsClosure _closure = reader.readHandle<RsClosure>();
+                RsScriptFieldID _fieldID = reader.readHandle<RsScriptFieldID>();
+                int64_t _value = static_cast<int64_t>(reader.read64());
+                int _size = static_cast<int32_t>(reader.read());
+                if (!reader.endCommand()) return false;
+                hal.ClosureSetGlobal(mContext, _closure, _fieldID, _value, _size);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+
 // Methods from ::android::hidl::base::V1_0::IBase follow.
 
 
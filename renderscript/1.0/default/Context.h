@@ -17,12 +17,17 @@
 #ifndef ANDROID_HARDWARE_RENDERSCRIPT_V1_0_CONTEXT_H
 #define ANDROID_HARDWARE_RENDERSCRIPT_V1_0_CONTEXT_H
 
+#include "ContextCommandBuffer.h"
 #include "cpp/rsDispatch.h"
 #include "dlfcn.h"
 #include <android/hardware/renderscript/1.0/IContext.h>
+#include <android/hidl/memory/1.0/IMemory.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 
+#include <mutex>
+#include <unordered_map>
+
 namespace android {
 namespace hardware {
 namespace renderscript {
@@ -43,6 +48,8 @@ using ::android::hardware::renderscript::V1_0::ScriptIntrinsicID;
 using ::android::hardware::renderscript::V1_0::ThreadPriorities;
 using ::android::hardware::renderscript::V1_0::YuvFormat;
 using ::android::hidl::base::V1_0::IBase;
+using ::android::hidl::memory::V1_0::IMemory;
+using ::android::hardware::hidl_memory;
 using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
 using ::android::hardware::Return;
@@ -130,10 +137,39 @@ struct Context : public IContext {
     Return<Script> scriptCCreate(const hidl_string& resName, const hidl_string& cacheDir, const hidl_vec<uint8_t>& text) override;
     Return<Script> scriptIntrinsicCreate(ScriptIntrinsicID id, Element elem) override;
 
+    // Runs a buffer recorded with ContextCommandWriter. Not part of the HIDL interface: the
+    // RenderScript HAL is loaded in-process, so clients call this directly to issue a batch of
+    // calls at once. Returns false on the first malformed command; the commands before it have
+    // been executed.
+    bool executeCommands(const uint32_t* commands, size_t length);
+
+    // Shared memory allocation I/O, not part of the HIDL interface. A client binds a buffer to
+    // an Allocation once; the reads and writes below then name a range of that buffer instead
+    // of carrying the pixels. If the range already is the Allocation's own storage, as for a
+    // USAGE_SHARED Allocation created over the same buffer, no copy is made at all. The
+    // binding is dropped by allocationUnbindMemory or objDestroy. Each call returns false if
+    // nothing is bound or the range is outside the buffer.
+    bool allocationBindMemory(Allocation allocation, const hidl_memory& memory);
+    void allocationUnbindMemory(Allocation allocation);
+    bool allocation1DWriteFromMemory(Allocation allocation, uint32_t offset, uint32_t lod, uint32_t count, Size memOffset, Size sizeBytes);
+    bool allocation2DWriteFromMemory(Allocation allocation, uint32_t xoff, uint32_t yoff, uint32_t lod, AllocationCubemapFace face, uint32_t w, uint32_t h, Size memOffset, Size sizeBytes, Size stride);
+    bool allocation3DWriteFromMemory(Allocation allocation, uint32_t xoff, uint32_t yoff, uint32_t zoff, uint32_t lod, uint32_t w, uint32_t h, uint32_t d, Size memOffset, Size sizeBytes, Size stride);
+    bool allocation1DReadToMemory(Allocation allocation, uint32_t xoff, uint32_t lod, uint32_t count, Size memOffset, Size sizeBytes);
+    bool allocation2DReadToMemory(Allocation allocation, uint32_t xoff, uint32_t yoff, uint32_t lod, AllocationCubemapFace face, uint32_t w, uint32_t h, Size memOffset, Size sizeBytes, Size stride);
+    bool allocation3DReadToMemory(Allocation allocation, uint32_t xoff, uint32_t yoff, uint32_t zoff, uint32_t lod, uint32_t w, uint32_t h, uint32_t d, Size memOffset, Size sizeBytes, Size stride);
+
     // Methods from ::android::hidl::base::V1_0::IBase follow.
 
  private:
+    // Returns the bound buffer of allocation and, in outPtr, the start of the range. The
+    // returned reference keeps the mapping alive while the driver uses it.
+    sp<IMemory> getBoundRange(Allocation allocation, Size memOffset, Size sizeBytes, uint8_t** outPtr);
+    bool isAllocationStorage(Allocation allocation, uint32_t lod, AllocationCubemapFace face, uint32_t z, const void* ptr);
+
     RsContext mContext;
+
+    std::mutex mBoundMemoryLock;
+    std::unordered_map<Allocation, sp<IMemory>> mBoundMemory;
 };
 
 }  // namespace implementation
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_RENDERSCRIPT_V1_0_CONTEXTCOMMANDBUFFER_H
+#define ANDROID_HARDWARE_RENDERSCRIPT_V1_0_CONTEXTCOMMANDBUFFER_H
+
+#include <string.h>
+
+#include <vector>
+
+#include <android/hardware/renderscript/1.0/types.h>
+
+namespace android {
+namespace hardware {
+namespace renderscript {
+namespace V1_0 {
+namespace implementation {
+
+// Commands understood by Context::executeCommands. Like the composer command buffer, each
+// command starts with a header word holding the opcode in the upper 16 bits and the number of
+// following words in the lower 16 bits. Handles take two words, little end first.
+enum class ContextCommand : uint32_t {
+    LENGTH_MASK = 0xffff,
+    OPCODE_SHIFT = 16,
+    OPCODE_MASK = 0xffffu << OPCODE_SHIFT,
+
+    ALLOCATION_1D_WRITE = 0x001 << OPCODE_SHIFT,
+    SCRIPT_INVOKE = 0x100 << OPCODE_SHIFT,
+    SCRIPT_INVOKE_V = 0x101 << OPCODE_SHIFT,
+    SCRIPT_FOR_EACH = 0x102 << OPCODE_SHIFT,
+    SCRIPT_SET_VAR_I = 0x110 << OPCODE_SHIFT,
+    SCRIPT_SET_VAR_J = 0x111 << OPCODE_SHIFT,
+    SCRIPT_SET_VAR_F = 0x112 << OPCODE_SHIFT,
+    SCRIPT_SET_VAR_D = 0x113 << OPCODE_SHIFT,
+    SCRIPT_SET_VAR_V = 0x114 << OPCODE_SHIFT,
+    SCRIPT_SET_VAR_OBJ = 0x115 << OPCODE_SHIFT,
+    CLOSURE_SET_GLOBAL = 0x200 << OPCODE_SHIFT,
+};
+
+// Records the small, high rate Context calls of an image pipeline into one buffer, which
+// Context::executeCommands then runs in a single call. Sizes are in uint32_t's. A method
+// returns false, without writing anything, when its command does not fit the 16 bit length
+// field; the caller then issues that call directly.
+class ContextCommandWriter {
+   public:
+    void reset() { mData.clear(); }
+    const uint32_t* data() const { return mData.data(); }
+    size_t size() const { return mData.size(); }
+
+    bool allocation1DWrite(Allocation allocation, uint32_t offset, uint32_t lod, uint32_t count,
+                           const void* data, size_t sizeBytes) {
+        if (!beginCommand(ContextCommand::ALLOCATION_1D_WRITE, 2 + 3 + blobLength(sizeBytes))) {
+            return false;
+        }
+        writeHandle(allocation);
+        write(offset);
+        write(lod);
+        write(count);
+        writeBlob(data, sizeBytes);
+        return true;
+    }
+
+    bool scriptInvoke(Script vs, uint32_t slot) {
+        beginCommand(ContextCommand::SCRIPT_INVOKE, 2 + 1);
+        writeHandle(vs);
+        write(slot);
+        return true;
+    }
+
+    bool scriptInvokeV(Script vs, uint32_t slot, const void* data, size_t sizeBytes) {
+        if (!beginCommand(ContextCommand::SCRIPT_INVOKE_V, 2 + 1 + blobLength(sizeBytes))) {
+            return false;
+        }
+        writeHandle(vs);
+        write(slot);
+        writeBlob(data, sizeBytes);
+        return true;
+    }
+
+    bool scriptForEach(Script vs, uint32_t slot, const Allocation* vains, size_t vainCount,
+                       Allocation vaout, const void* params, size_t paramsBytes) {
+        if (!beginCommand(ContextCommand::SCRIPT_FOR_EACH,
+                          2 + 1 + 1 + 2 * vainCount + 2 + blobLength(paramsBytes))) {
+            return false;
+        }
+        writeHandle(vs);
+        write(slot);
+        write(static_cast<uint32_t>(vainCount));
+        for (size_t i = 0; i < vainCount; i++) {
+            writeHandle(vains[i]);
+        }
+        writeHandle(vaout);
+        writeBlob(params, paramsBytes);
+        return true;
+    }
+
+    bool scriptSetVarI(Script vs, uint32_t slot, int32_t value) {
+        beginCommand(ContextCommand::SCRIPT_SET_VAR_I, 2 + 1 + 1);
+        writeHandle(vs);
+        write(slot);
+        write(static_cast<uint32_t>(value));
+        return true;
+    }
+
+    bool scriptSetVarJ(Script vs, uint32_t slot, int64_t value) {
+        beginCommand(ContextCommand::SCRIPT_SET_VAR_J, 2 + 1 + 2);
+        writeHandle(vs);
+        write(slot);
+        write64(static_cast<uint64_t>(value));
+        return true;
+    }
+
+    bool scriptSetVarF(Script vs, uint32_t slot, float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        beginCommand(ContextCommand::SCRIPT_SET_VAR_F, 2 + 1 + 1);
+        writeHandle(vs);
+        write(slot);
+        write(bits);
+        return true;
+    }
+
+    bool scriptSetVarD(Script vs, uint32_t slot, double value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        beginCommand(ContextCommand::SCRIPT_SET_VAR_D, 2 + 1 + 2);
+        writeHandle(vs);
+        write(slot);
+        write64(bits);
+        return true;
+    }
+
+    bool scriptSetVarV(Script vs, uint32_t slot, const void* data, size_t sizeBytes) {
+        if (!beginCommand(ContextCommand::SCRIPT_SET_VAR_V, 2 + 1 + blobLength(sizeBytes))) {
+            return false;
+        }
+        writeHandle(vs);
+        write(slot);
+        writeBlob(data, sizeBytes);
+        return true;
+    }
+
+    bool scriptSetVarObj(Script vs, uint32_t slot, ObjectBase obj) {
+        beginCommand(ContextCommand::SCRIPT_SET_VAR_OBJ, 2 + 1 + 2);
+        writeHandle(vs);
+        write(slot);
+        writeHandle(obj);
+        return true;
+    }
+
+    bool closureSetGlobal(Closure closure, ScriptFieldID fieldID, int64_t value, int32_t size) {
+        beginCommand(ContextCommand::CLOSURE_SET_GLOBAL, 2 + 2 + 2 + 1);
+        writeHandle(closure);
+        writeHandle(fieldID);
+        write64(static_cast<uint64_t>(value));
+        write(static_cast<uint32_t>(size));
+        return true;
+    }
+
+   private:
+    // a byte count followed by the bytes, padded to whole words
+    static size_t blobLength(size_t sizeBytes) { return 1 + (sizeBytes + 3) / 4; }
+
+    bool beginCommand(ContextCommand command, size_t length) {
+        if (length > static_cast<uint32_t>(ContextCommand::LENGTH_MASK)) {
+            return false;
+        }
+        mData.reserve(mData.size() + 1 + length);
+        write(static_cast<uint32_t>(command) | static_cast<uint32_t>(length));
+        return true;
+    }
+
+    void write(uint32_t val) { mData.push_back(val); }
+
+    void write64(uint64_t val) {
+        write(static_cast<uint32_t>(val));
+        write(static_cast<uint32_t>(val >> 32));
+    }
+
+    void writeHandle(OpaqueHandle handle) { write64(handle); }
+
+    void writeBlob(const void* data, size_t sizeBytes) {
+        write(static_cast<uint32_t>(sizeBytes));
+        size_t offset = mData.size();
+        mData.resize(offset + (sizeBytes + 3) / 4, 0);
+        if (sizeBytes != 0) {
+            memcpy(&mData[offset], data, sizeBytes);
+        }
+    }
+
+    std::vector<uint32_t> mData;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace renderscript
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_RENDERSCRIPT_V1_0_CONTEXTCOMMANDBUFFER_H
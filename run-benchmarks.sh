@@ -0,0 +1,51 @@
+#!/bin/bash
+# Script to run the HAL benchmarks on a device and collect their results as JSON.
+#
+# Usage: run-benchmarks.sh [output-dir] [benchmark...]
+#
+# The benchmarks must have been built and synced to the device first, e.g.
+#   m <benchmark...> && adb sync data
+# With no benchmark named, every benchmark below is run. Each one writes
+# <output-dir>/<benchmark>.json, in the Google Benchmark JSON format, so the
+# results of two builds can be compared with compare.py from Google Benchmark.
+
+set -e
+
+BENCHMARKS=(
+  android.hardware.automotive.vehicle@2.0-manager-benchmarks
+  android.hardware.gnss@2.0-measurement-benchmarks
+  android.hardware.graphics.allocator@2.0-passthrough-benchmarks
+  android.hardware.graphics.composer@2.1-hal-benchmarks
+  android.hardware.sensors@2.0-mock-benchmarks
+  android.hardware.tv.tuner@1.0-demux-benchmarks
+  android.hardware.wifi@1.0-service-benchmarks
+  libkeymaster4support_benchmarks
+)
+
+OUT_DIR=${1:-benchmark-results}
+shift || true
+if [ $# -gt 0 ]; then
+  BENCHMARKS=("$@")
+fi
+
+DEVICE_DIR=/data/local/tmp/hal-benchmarks
+mkdir -p "$OUT_DIR"
+adb shell mkdir -p $DEVICE_DIR
+
+for name in "${BENCHMARKS[@]}"; do
+  binary=
+  for dir in /data/benchmarktest64 /data/benchmarktest; do
+    if adb shell test -x $dir/$name/$name; then
+      binary=$dir/$name/$name
+      break
+    fi
+  done
+  if [ -z "$binary" ]; then
+    echo "$name: not found on the device, skipping"
+    continue
+  fi
+
+  echo "Running $name"
+  adb shell $binary --benchmark_out=$DEVICE_DIR/$name.json --benchmark_out_format=json
+  adb pull $DEVICE_DIR/$name.json "$OUT_DIR/$name.json"
+done
@@ -56,7 +56,9 @@ static Result ResultFromStatus(status_t err) {
 Sensors::Sensors()
     : mInitCheck(NO_INIT),
       mSensorModule(nullptr),
-      mSensorDevice(nullptr) {
+      mSensorDevice(nullptr),
+      mPollBuffer(new sensors_event_t[kPollMaxBufferSize]),
+      mPollEvents(kPollMaxBufferSize) {
     status_t err = OK;
     if (UseMultiHal()) {
         mSensorModule = ::get_multi_hal_module_info();
@@ -162,36 +164,32 @@ Return<void> Sensors::poll(int32_t maxCount, poll_cb _hidl_cb) {
     hidl_vec<Event> out;
     hidl_vec<SensorInfo> dynamicSensorsAdded;
 
-    std::unique_ptr<sensors_event_t[]> data;
     int err = android::NO_ERROR;
 
-    { // scope of reentry lock
-
-        // This enforces a single client, meaning that a maximum of one client can call poll().
-        // If this function is re-entred, it means that we are stuck in a state that may prevent
-        // the system from proceeding normally.
-        //
-        // Exit and let the system restart the sensor-hal-implementation hidl service.
-        //
-        // This function must not call _hidl_cb(...) or return until there is no risk of blocking.
-        std::unique_lock<std::mutex> lock(mPollLock, std::try_to_lock);
-        if(!lock.owns_lock()){
-            // cannot get the lock, hidl service will go into deadlock if it is not restarted.
-            // This is guaranteed to not trigger in passthrough mode.
-            LOG(ERROR) <<
-                    "ISensors::poll() re-entry. I do not know what to do except killing myself.";
-            ::exit(-1);
-        }
+    // This enforces a single client, meaning that a maximum of one client can call poll().
+    // If this function is re-entred, it means that we are stuck in a state that may prevent
+    // the system from proceeding normally.
+    //
+    // Exit and let the system restart the sensor-hal-implementation hidl service.
+    //
+    // The lock is held until _hidl_cb(...) returns since |out| points into mPollEvents.
+    std::unique_lock<std::mutex> lock(mPollLock, std::try_to_lock);
+    if(!lock.owns_lock()){
+        // cannot get the lock, hidl service will go into deadlock if it is not restarted.
+        // This is guaranteed to not trigger in passthrough mode.
+        LOG(ERROR) <<
+                "ISensors::poll() re-entry. I do not know what to do except killing myself.";
+        ::exit(-1);
+    }
 
-        if (maxCount <= 0) {
-            err = android::BAD_VALUE;
-        } else {
-            int bufferSize = maxCount <= kPollMaxBufferSize ? maxCount : kPollMaxBufferSize;
-            data.reset(new sensors_event_t[bufferSize]);
-            err = mSensorDevice->poll(
-                    reinterpret_cast<sensors_poll_device_t *>(mSensorDevice),
-                    data.get(), bufferSize);
-        }
+    sensors_event_t *data = mPollBuffer.get();
+    if (maxCount <= 0) {
+        err = android::BAD_VALUE;
+    } else {
+        int bufferSize = maxCount <= kPollMaxBufferSize ? maxCount : kPollMaxBufferSize;
+        err = mSensorDevice->poll(
+                reinterpret_cast<sensors_poll_device_t *>(mSensorDevice),
+                data, bufferSize);
     }
 
     if (err < 0) {
@@ -223,8 +221,8 @@ Return<void> Sensors::poll(int32_t maxCount, poll_cb _hidl_cb) {
         dynamicSensorsAdded[numDynamicSensors] = info;
     }
 
-    out.resize(count);
-    convertFromSensorEvents(err, data.get(), &out);
+    convertFromSensorEvents(count, data, mPollEvents.data());
+    out.setToExternal(mPollEvents.data(), count);
 
     _hidl_cb(Result::OK, out, dynamicSensorsAdded);
 
@@ -328,16 +326,54 @@ Return<void> Sensors::configDirectReport(
     return Void();
 }
 
+// The payloads of these sensor types have the same layout in sensors_event_t
+// and Event, so they can be copied as one block.
+static_assert(sizeof(Event::u) == sizeof(sensors_event_t::data),
+              "Event payload size mismatch");
+static_assert(offsetof(Vec3, status) == offsetof(sensors_vec_t, status),
+              "Vec3 layout mismatch");
+static_assert(offsetof(Uncal, x_bias) == offsetof(uncalibrated_event_t, x_bias),
+              "Uncal layout mismatch");
+
+static bool HasPlainPayload(int32_t type) {
+    switch (type) {
+        case SENSOR_TYPE_ACCELEROMETER:
+        case SENSOR_TYPE_MAGNETIC_FIELD:
+        case SENSOR_TYPE_ORIENTATION:
+        case SENSOR_TYPE_GYROSCOPE:
+        case SENSOR_TYPE_GRAVITY:
+        case SENSOR_TYPE_LINEAR_ACCELERATION:
+        case SENSOR_TYPE_MAGNETIC_FIELD_UNCALIBRATED:
+        case SENSOR_TYPE_GYROSCOPE_UNCALIBRATED:
+        case SENSOR_TYPE_ACCELEROMETER_UNCALIBRATED:
+        case SENSOR_TYPE_ROTATION_VECTOR:
+        case SENSOR_TYPE_GAME_ROTATION_VECTOR:
+        case SENSOR_TYPE_GEOMAGNETIC_ROTATION_VECTOR:
+        case SENSOR_TYPE_POSE_6DOF:
+            return true;
+        default:
+            return false;
+    }
+}
+
 // static
 void Sensors::convertFromSensorEvents(
         size_t count,
         const sensors_event_t *srcArray,
-        hidl_vec<Event> *dstVec) {
+        Event *dstArray) {
     for (size_t i = 0; i < count; ++i) {
         const sensors_event_t &src = srcArray[i];
-        Event *dst = &(*dstVec)[i];
-
-        convertFromSensorEvent(src, dst);
+        Event *dst = &dstArray[i];
+
+        if (HasPlainPayload(src.type)) {
+            dst->timestamp = src.timestamp;
+            dst->sensorHandle = src.sensor;
+            dst->sensorType = (SensorType)src.type;
+            // Fixed size copy, lowered to vector loads and stores.
+            memcpy(&dst->u, src.data, sizeof(dst->u));
+        } else {
+            convertFromSensorEvent(src, dst);
+        }
     }
 }
 
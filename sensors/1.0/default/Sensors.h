@@ -21,7 +21,9 @@
 #include <android-base/macros.h>
 #include <android/hardware/sensors/1.0/ISensors.h>
 #include <hardware/sensors.h>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 namespace android {
 namespace hardware {
@@ -69,10 +71,14 @@ private:
     sensors_poll_device_1_t *mSensorDevice;
     std::mutex mPollLock;
 
+    // Buffers reused by every poll() call, guarded by mPollLock.
+    std::unique_ptr<sensors_event_t[]> mPollBuffer;
+    std::vector<Event> mPollEvents;
+
     int getHalDeviceVersion() const;
 
     static void convertFromSensorEvents(
-            size_t count, const sensors_event_t *src, hidl_vec<Event> *dst);
+            size_t count, const sensors_event_t *src, Event *dst);
 
     DISALLOW_COPY_AND_ASSIGN(Sensors);
 };
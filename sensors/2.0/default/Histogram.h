@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_SENSORS_V2_0_HISTOGRAM_H
+#define ANDROID_HARDWARE_SENSORS_V2_0_HISTOGRAM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+/**
+ * Counts values into buckets delimited by increasing upper bounds, with a last bucket for the
+ * values above the highest bound. Not thread safe, callers provide their own locking.
+ */
+class Histogram {
+   public:
+    Histogram(std::initializer_list<int64_t> bounds)
+        : mBounds(bounds), mCounts(mBounds.size() + 1, 0), mCount(0), mSum(0), mMax(0) {}
+
+    void add(int64_t value) {
+        size_t bucket = std::upper_bound(mBounds.begin(), mBounds.end(), value) - mBounds.begin();
+        mCounts[bucket]++;
+        mCount++;
+        mSum += value;
+        mMax = std::max(mMax, value);
+    }
+
+    uint64_t count() const { return mCount; }
+
+    /**
+     * Formats the histogram on one line, dividing the values by divisor and suffixing them with
+     * unit
+     */
+    std::string toString(int64_t divisor, const char* unit) const {
+        std::ostringstream out;
+        out << "count=" << mCount;
+        if (mCount > 0) {
+            out << " mean=" << mSum / static_cast<int64_t>(mCount) / divisor << unit
+                << " max=" << mMax / divisor << unit;
+        }
+        for (size_t i = 0; i < mCounts.size(); i++) {
+            if (i < mBounds.size()) {
+                out << " <" << mBounds[i] / divisor << unit;
+            } else {
+                out << " >=" << mBounds.back() / divisor << unit;
+            }
+            out << ":" << mCounts[i];
+        }
+        return out.str();
+    }
+
+   private:
+    std::vector<int64_t> mBounds;
+    std::vector<uint64_t> mCounts;
+    uint64_t mCount;
+    int64_t mSum;
+    int64_t mMax;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_SENSORS_V2_0_HISTOGRAM_H
@@ -18,7 +18,9 @@
 
 #include <utils/SystemClock.h>
 
+#include <algorithm>
 #include <cmath>
+#include <sstream>
 
 namespace android {
 namespace hardware {
@@ -31,48 +33,75 @@ using ::android::hardware::sensors::V1_0::SensorFlagBits;
 using ::android::hardware::sensors::V1_0::SensorStatus;
 
 static constexpr float kDefaultMaxDelayUs = 10 * 1000 * 1000;
+static constexpr uint32_t kDefaultFifoMaxEventCount = 300;
 
 Sensor::Sensor(ISensorsEventCallback* callback)
     : mIsEnabled(false),
       mSamplingPeriodNs(0),
+      mMaxReportLatencyNs(0),
       mLastSampleTimeNs(0),
+      mFifoDeadlineNs(0),
+      mLastPollTimeNs(0),
+      mIntervalJitter({100 * 1000, 500 * 1000, 1000 * 1000, 5000 * 1000, 20000 * 1000}),
       mCallback(callback),
-      mMode(OperationMode::NORMAL) {
-    mRunThread = std::thread(startThread, this);
-}
+      mMode(OperationMode::NORMAL) {}
 
-Sensor::~Sensor() {
-    std::unique_lock<std::mutex> lock(mRunMutex);
-    mStopThread = true;
-    mIsEnabled = false;
-    mWaitCV.notify_all();
-    lock.release();
-    mRunThread.join();
-}
+Sensor::~Sensor() {}
 
 const SensorInfo& Sensor::getSensorInfo() const {
     return mSensorInfo;
 }
 
-void Sensor::batch(int32_t samplingPeriodNs) {
+void Sensor::batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs) {
     if (samplingPeriodNs < mSensorInfo.minDelay * 1000) {
         samplingPeriodNs = mSensorInfo.minDelay * 1000;
     } else if (samplingPeriodNs > mSensorInfo.maxDelay * 1000) {
         samplingPeriodNs = mSensorInfo.maxDelay * 1000;
     }
+    // Sensors without a FIFO operate in continuous mode regardless of the requested latency
+    if (mSensorInfo.fifoMaxEventCount == 0 || maxReportLatencyNs < 0) {
+        maxReportLatencyNs = 0;
+    }
 
+    std::vector<Event> events;
+    std::unique_lock<std::mutex> lock(mLock);
+    if (mMaxReportLatencyNs != maxReportLatencyNs) {
+        mMaxReportLatencyNs = maxReportLatencyNs;
+        if (mMaxReportLatencyNs == 0) {
+            events = drainFifo();
+        } else {
+            mFifo.reserve(mSensorInfo.fifoMaxEventCount);
+        }
+    }
     if (mSamplingPeriodNs != samplingPeriodNs) {
         mSamplingPeriodNs = samplingPeriodNs;
-        // Wake up the 'run' thread to check if a new event should be generated now
-        mWaitCV.notify_all();
+        mLastPollTimeNs = 0;
+    }
+    lock.unlock();
+
+    if (!events.empty()) {
+        mCallback->postEvents(events, isWakeUpSensor());
     }
 }
 
 void Sensor::activate(bool enable) {
     if (mIsEnabled != enable) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
+        std::vector<Event> events;
+        std::unique_lock<std::mutex> lock(mLock);
         mIsEnabled = enable;
-        mWaitCV.notify_all();
+        if (enable) {
+            // Take the first sample on the next poll
+            mLastSampleTimeNs = 0;
+            mLastPollTimeNs = 0;
+        } else {
+            // Report what was batched so far rather than dropping it
+            events = drainFifo();
+        }
+        lock.unlock();
+
+        if (!events.empty()) {
+            mCallback->postEvents(events, isWakeUpSensor());
+        }
     }
 }
 
@@ -83,52 +112,113 @@ Result Sensor::flush() {
         return Result::BAD_VALUE;
     }
 
-    // Note: If a sensor supports batching, write all of the currently batched events for the sensor
-    // to the Event FMQ prior to writing the flush complete event.
+    // Write all of the currently batched events for the sensor to the Event FMQ prior to writing
+    // the flush complete event.
+    std::unique_lock<std::mutex> lock(mLock);
+    std::vector<Event> evs = drainFifo();
+    lock.unlock();
+
     Event ev;
     ev.sensorHandle = mSensorInfo.sensorHandle;
     ev.sensorType = SensorType::META_DATA;
     ev.u.meta.what = MetaDataEventType::META_DATA_FLUSH_COMPLETE;
-    std::vector<Event> evs{ev};
+    evs.push_back(ev);
     mCallback->postEvents(evs, isWakeUpSensor());
 
     return Result::OK;
 }
 
-void Sensor::startThread(Sensor* sensor) {
-    sensor->run();
+int64_t Sensor::getNextDeadlineNs() {
+    std::unique_lock<std::mutex> lock(mLock);
+    return getNextDeadlineLocked();
+}
+
+int64_t Sensor::getNextDeadlineLocked() {
+    if (!mIsEnabled || mMode != OperationMode::NORMAL) {
+        return -1;
+    }
+    int64_t deadline = mLastSampleTimeNs + mSamplingPeriodNs;
+    if (!mFifo.empty()) {
+        deadline = std::min(deadline, mFifoDeadlineNs);
+    }
+    return deadline;
 }
 
-void Sensor::run() {
-    std::unique_lock<std::mutex> runLock(mRunMutex);
-    constexpr int64_t kNanosecondsInSeconds = 1000 * 1000 * 1000;
+int64_t Sensor::getDueTimeNs(int64_t nowNs, int64_t slackNs) {
+    std::unique_lock<std::mutex> lock(mLock);
+    return getDueTimeLocked(nowNs, slackNs);
+}
 
-    while (!mStopThread) {
-        if (!mIsEnabled || mMode == OperationMode::DATA_INJECTION) {
-            mWaitCV.wait(runLock, [&] {
-                return ((mIsEnabled && mMode == OperationMode::NORMAL) || mStopThread);
-            });
-        } else {
-            timespec curTime;
-            clock_gettime(CLOCK_REALTIME, &curTime);
-            int64_t now = (curTime.tv_sec * kNanosecondsInSeconds) + curTime.tv_nsec;
-            int64_t nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-
-            if (now >= nextSampleTime) {
-                mLastSampleTimeNs = now;
-                nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-                mCallback->postEvents(readEvents(), isWakeUpSensor());
-            }
-
-            mWaitCV.wait_for(runLock, std::chrono::nanoseconds(nextSampleTime - now));
+int64_t Sensor::getDueTimeLocked(int64_t nowNs, int64_t slackNs) {
+    if (mSamplingPeriodNs <= 0) {
+        mSamplingPeriodNs = std::max(mSensorInfo.minDelay * 1000, 1000 * 1000);
+    }
+    // Never let the slack skip a sample
+    return nowNs + std::min(slackNs, mSamplingPeriodNs / 2);
+}
+
+int64_t Sensor::poll(int64_t nowNs, int64_t slackNs, std::vector<Event>* events) {
+    std::unique_lock<std::mutex> lock(mLock);
+    if (!mIsEnabled || mMode != OperationMode::NORMAL) {
+        return -1;
+    }
+    const int64_t dueNs = getDueTimeLocked(nowNs, slackNs);
+
+    if (dueNs >= mLastSampleTimeNs + mSamplingPeriodNs) {
+        if (mLastPollTimeNs > 0) {
+            mIntervalJitter.add(std::abs(nowNs - mLastPollTimeNs - mSamplingPeriodNs));
         }
+        mLastPollTimeNs = nowNs;
+        mLastSampleTimeNs = dueNs - dueNs % mSamplingPeriodNs;
+        batchEvents(readEvents(), nowNs, events);
+    }
+    if (!mFifo.empty() && dueNs >= mFifoDeadlineNs) {
+        events->insert(events->end(), mFifo.begin(), mFifo.end());
+        mFifo.clear();
     }
+    return getNextDeadlineLocked();
+}
+
+std::string Sensor::dumpStats() {
+    std::lock_guard<std::mutex> lock(mLock);
+    std::ostringstream out;
+    out << mSensorInfo.name.c_str() << " (handle " << mSensorInfo.sensorHandle << "): "
+        << (mIsEnabled ? "enabled" : "disabled") << " period=" << mSamplingPeriodNs / 1000 << "us"
+        << " latency=" << mMaxReportLatencyNs / 1000 << "us fifo=" << mFifo.size() << "/"
+        << mSensorInfo.fifoMaxEventCount << "\n"
+        << "  interval jitter: " << mIntervalJitter.toString(1000, "us") << "\n";
+    return out.str();
 }
 
 bool Sensor::isWakeUpSensor() {
     return mSensorInfo.flags & static_cast<uint32_t>(SensorFlagBits::WAKE_UP);
 }
 
+void Sensor::batchEvents(const std::vector<Event>& events, int64_t now,
+                         std::vector<Event>* output) {
+    if (mMaxReportLatencyNs == 0) {
+        output->insert(output->end(), events.begin(), events.end());
+        return;
+    }
+
+    for (const Event& event : events) {
+        if (mFifo.empty()) {
+            mFifoDeadlineNs = now + mMaxReportLatencyNs;
+        }
+        mFifo.push_back(event);
+        if (mFifo.size() >= mSensorInfo.fifoMaxEventCount) {
+            output->insert(output->end(), mFifo.begin(), mFifo.end());
+            mFifo.clear();
+        }
+    }
+}
+
+std::vector<Event> Sensor::drainFifo() {
+    std::vector<Event> events(mFifo.begin(), mFifo.end());
+    mFifo.clear();
+    return events;
+}
+
 std::vector<Event> Sensor::readEvents() {
     std::vector<Event> events;
     Event event;
@@ -145,9 +235,8 @@ std::vector<Event> Sensor::readEvents() {
 
 void Sensor::setOperationMode(OperationMode mode) {
     if (mMode != mode) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
+        std::unique_lock<std::mutex> lock(mLock);
         mMode = mode;
-        mWaitCV.notify_all();
     }
 }
 
@@ -208,7 +297,7 @@ AccelSensor::AccelSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
     mSensorInfo.minDelay = 20 * 1000;    // microseconds
     mSensorInfo.maxDelay = kDefaultMaxDelayUs;
     mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoMaxEventCount;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::DATA_INJECTION);
 };
@@ -227,7 +316,7 @@ PressureSensor::PressureSensor(int32_t sensorHandle, ISensorsEventCallback* call
     mSensorInfo.minDelay = 100 * 1000;  // microseconds
     mSensorInfo.maxDelay = kDefaultMaxDelayUs;
     mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoMaxEventCount;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags = 0;
 };
@@ -246,7 +335,7 @@ MagnetometerSensor::MagnetometerSensor(int32_t sensorHandle, ISensorsEventCallba
     mSensorInfo.minDelay = 20 * 1000;  // microseconds
     mSensorInfo.maxDelay = kDefaultMaxDelayUs;
     mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoMaxEventCount;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags = 0;
 };
@@ -303,7 +392,7 @@ GyroSensor::GyroSensor(int32_t sensorHandle, ISensorsEventCallback* callback) :
     mSensorInfo.minDelay = 2.5f * 1000;  // microseconds
     mSensorInfo.maxDelay = kDefaultMaxDelayUs;
     mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoMaxEventCount;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags = 0;
 };
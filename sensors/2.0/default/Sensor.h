@@ -17,12 +17,13 @@
 #ifndef ANDROID_HARDWARE_SENSORS_V2_0_SENSOR_H
 #define ANDROID_HARDWARE_SENSORS_V2_0_SENSOR_H
 
+#include "Histogram.h"
+
 #include <android/hardware/sensors/1.0/types.h>
 
-#include <condition_variable>
 #include <memory>
 #include <mutex>
-#include <thread>
+#include <string>
 #include <vector>
 
 using ::android::hardware::sensors::V1_0::Event;
@@ -49,7 +50,7 @@ class Sensor {
     virtual ~Sensor();
 
     const SensorInfo& getSensorInfo() const;
-    void batch(int32_t samplingPeriodNs);
+    void batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs);
     virtual void activate(bool enable);
     Result flush();
 
@@ -57,22 +58,84 @@ class Sensor {
     bool supportsDataInjection() const;
     Result injectEvent(const Event& event);
 
+    bool isWakeUpSensor();
+
+    /**
+     * Returns the time at which the sensor next needs to be polled, or -1 if it is idle
+     */
+    int64_t getNextDeadlineNs();
+
+    /**
+     * Returns the latest deadline that counts as due when polling at nowNs with slackNs of slack.
+     * Both the scheduler and poll use it, so that a deadline the scheduler polls for is always
+     * sampled. The slack is capped at half the sampling period, so that it never skips a sample.
+     */
+    int64_t getDueTimeNs(int64_t nowNs, int64_t slackNs);
+
+    /**
+     * Generates the samples due by nowNs, counting deadlines up to slackNs later as due, and
+     * appends the events that are ready to be reported to events. Returns the next deadline, or
+     * -1 if the sensor is idle. Sample times are kept on a grid of the sampling period, so that
+     * sensors with related rates fall due together.
+     */
+    int64_t poll(int64_t nowNs, int64_t slackNs, std::vector<Event>* events);
+
+    /**
+     * Returns a human readable summary of the sensor configuration and sampling statistics
+     */
+    std::string dumpStats();
+
    protected:
-    void run();
     virtual std::vector<Event> readEvents();
-    static void startThread(Sensor* sensor);
 
-    bool isWakeUpSensor();
+    /**
+     * Must be called with mLock held.
+     */
+    int64_t getNextDeadlineLocked();
+    int64_t getDueTimeLocked(int64_t nowNs, int64_t slackNs);
+
+    /**
+     * Queues the events in the FIFO, or appends them to output right away if the sensor is not
+     * batching. Must be called with mLock held.
+     */
+    void batchEvents(const std::vector<Event>& events, int64_t now, std::vector<Event>* output);
+
+    /**
+     * Takes the events held in the FIFO. Must be called with mLock held, the events must be posted
+     * after releasing it.
+     */
+    std::vector<Event> drainFifo();
 
     bool mIsEnabled;
     int64_t mSamplingPeriodNs;
+    int64_t mMaxReportLatencyNs;
     int64_t mLastSampleTimeNs;
     SensorInfo mSensorInfo;
 
-    std::atomic_bool mStopThread;
-    std::condition_variable mWaitCV;
-    std::mutex mRunMutex;
-    std::thread mRunThread;
+    /**
+     * Emulated hardware FIFO, holding at most fifoMaxEventCount events
+     */
+    std::vector<Event> mFifo;
+
+    /**
+     * Time at which the oldest event in the FIFO must be reported
+     */
+    int64_t mFifoDeadlineNs;
+
+    /**
+     * Time at which the last sample was actually taken, 0 if the sampling period changed since
+     */
+    int64_t mLastPollTimeNs;
+
+    /**
+     * Distance between the actual interval separating two samples and the sampling period
+     */
+    Histogram mIntervalJitter;
+
+    /**
+     * Protects the sampling state against the scheduler thread in Sensors
+     */
+    std::mutex mLock;
 
     ISensorsEventCallback* mCallback;
 
@@ -18,6 +18,10 @@
 
 #include <android/hardware/sensors/2.0/types.h>
 #include <log/log.h>
+#include <utils/SystemClock.h>
+
+#include <inttypes.h>
+#include <stdio.h>
 
 namespace android {
 namespace hardware {
@@ -35,13 +39,27 @@ using ::android::hardware::sensors::V2_0::WakeLockQueueFlagBits;
 
 constexpr const char* kWakeLockName = "SensorsHAL_WAKEUP";
 
+// Sensors falling due within this long of each other are polled in the same wake-up
+constexpr int64_t kSchedulerSlackNs = 2 * 1000 * 1000;  // 2 ms
+
 Sensors::Sensors()
     : mEventQueueFlag(nullptr),
       mNextHandle(1),
+      mWakeLockAcquiredTimeMs(0),
+      mWakeLockHeldTotalMs(0),
+      mWakeLockAcquisitions(0),
+      mWakeLockHoldTime({10, 100, 1000, 5000}),
       mOutstandingWakeUpEvents(0),
       mReadWakeLockQueueRun(false),
       mAutoReleaseWakeLockTime(0),
-      mHasWakeLock(false) {
+      mHasWakeLock(false),
+      mPendingWakeUpEvents(0),
+      mSchedulerRun(true),
+      mEventsWritten(0),
+      mEventsDropped(0),
+      mWriteFailures(0),
+      mWriteLatency({1000 * 1000, 5000 * 1000, 20000 * 1000, 100000 * 1000, 1000000 * 1000}),
+      mQueueFillLevel({25, 50, 75, 100}) {
     AddSensor<AccelSensor>();
     AddSensor<GyroSensor>();
     AddSensor<AmbientTempSensor>();
@@ -51,9 +69,17 @@ Sensors::Sensors()
     AddSensor<LightSensor>();
     AddSensor<ProximitySensor>();
     AddSensor<RelativeHumiditySensor>();
+
+    mSchedulerThread = std::thread(startSchedulerThread, this);
 }
 
 Sensors::~Sensors() {
+    {
+        std::lock_guard<std::mutex> lock(mSchedulerLock);
+        mSchedulerRun = false;
+        mSchedulerCV.notify_all();
+    }
+    mSchedulerThread.join();
     deleteEventFlag();
     mReadWakeLockQueueRun = false;
     mWakeLockThread.join();
@@ -75,6 +101,7 @@ Return<void> Sensors::getSensorsList(getSensorsList_cb _hidl_cb) {
 Return<Result> Sensors::setOperationMode(OperationMode mode) {
     for (auto sensor : mSensors) {
         sensor.second->setOperationMode(mode);
+        scheduleSensor(sensor.first);
     }
     return Result::OK;
 }
@@ -83,6 +110,7 @@ Return<Result> Sensors::activate(int32_t sensorHandle, bool enabled) {
     auto sensor = mSensors.find(sensorHandle);
     if (sensor != mSensors.end()) {
         sensor->second->activate(enabled);
+        scheduleSensor(sensorHandle);
         return Result::OK;
     }
     return Result::BAD_VALUE;
@@ -138,10 +166,11 @@ Return<Result> Sensors::initialize(
 }
 
 Return<Result> Sensors::batch(int32_t sensorHandle, int64_t samplingPeriodNs,
-                              int64_t /* maxReportLatencyNs */) {
+                              int64_t maxReportLatencyNs) {
     auto sensor = mSensors.find(sensorHandle);
     if (sensor != mSensors.end()) {
-        sensor->second->batch(samplingPeriodNs);
+        sensor->second->batch(samplingPeriodNs, maxReportLatencyNs);
+        scheduleSensor(sensorHandle);
         return Result::OK;
     }
     return Result::BAD_VALUE;
@@ -181,26 +210,162 @@ Return<void> Sensors::configDirectReport(int32_t /* sensorHandle */, int32_t /*
 }
 
 void Sensors::postEvents(const std::vector<Event>& events, bool wakeup) {
-    std::lock_guard<std::mutex> lock(mWriteLock);
-    if (mEventQueue->write(events.data(), events.size())) {
+    // Hand the events to the scheduler thread, the only writer of the Event FMQ
+    std::lock_guard<std::mutex> lock(mSchedulerLock);
+    mPendingEvents.insert(mPendingEvents.end(), events.begin(), events.end());
+    if (wakeup) {
+        mPendingWakeUpEvents += events.size();
+    }
+    mSchedulerCV.notify_all();
+}
+
+Return<void> Sensors::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* args */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        return Void();
+    }
+    int out = fd->data[0];
+
+    dprintf(out, "Sensors:\n");
+    for (const auto& sensor : mSensors) {
+        dprintf(out, "  %s", sensor.second->dumpStats().c_str());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mStatsLock);
+        dprintf(out, "Event FMQ: written=%" PRIu64 " dropped=%" PRIu64 " failed writes=%" PRIu64
+                "\n", mEventsWritten, mEventsDropped, mWriteFailures);
+        dprintf(out, "  write latency: %s\n", mWriteLatency.toString(1000, "us").c_str());
+        dprintf(out, "  fill level after write: %s\n", mQueueFillLevel.toString(1, "%").c_str());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mWakeLockLock);
+        int64_t heldTotalMs = mWakeLockHeldTotalMs;
+        if (mHasWakeLock) {
+            heldTotalMs += ::android::uptimeMillis() - mWakeLockAcquiredTimeMs;
+        }
+        dprintf(out, "Wake lock: %s outstanding=%" PRIu32 " acquisitions=%" PRIu64
+                " held total=%" PRId64 "ms\n", mHasWakeLock ? "held" : "released",
+                mOutstandingWakeUpEvents.load(), mWakeLockAcquisitions, heldTotalMs);
+        dprintf(out, "  hold time: %s\n", mWakeLockHoldTime.toString(1, "ms").c_str());
+    }
+    return Void();
+}
+
+void Sensors::writeEvents(const std::vector<Event>& events, size_t numWakeUpEvents) {
+    bool written = mEventQueue->write(events.data(), events.size());
+    if (written) {
         mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
 
-        if (wakeup) {
+        if (numWakeUpEvents > 0) {
             // Keep track of the number of outstanding WAKE_UP events in order to properly hold
             // a wake lock until the framework has secured a wake lock
-            updateWakeLock(events.size(), 0 /* eventsHandled */);
+            updateWakeLock(numWakeUpEvents, 0 /* eventsHandled */);
+        }
+    } else {
+        ALOGW("Dropped %zu events, Event FMQ is full", events.size());
+    }
+
+    int64_t now = ::android::elapsedRealtimeNano();
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    if (!written) {
+        mWriteFailures++;
+        mEventsDropped += events.size();
+        return;
+    }
+    mEventsWritten += events.size();
+    mQueueFillLevel.add(mEventQueue->availableToRead() * 100 / mEventQueue->getQuantumCount());
+    for (const Event& event : events) {
+        // Meta data and injected events do not carry a generation time
+        if (event.sensorType != SensorType::META_DATA && event.timestamp > 0 &&
+            event.timestamp <= now) {
+            mWriteLatency.add(now - event.timestamp);
         }
     }
 }
 
-void Sensors::updateWakeLock(int32_t eventsWritten, int32_t eventsHandled) {
-    std::lock_guard<std::mutex> lock(mWakeLockLock);
-    int32_t newVal = mOutstandingWakeUpEvents + eventsWritten - eventsHandled;
-    if (newVal < 0) {
-        mOutstandingWakeUpEvents = 0;
-    } else {
-        mOutstandingWakeUpEvents = newVal;
+void Sensors::scheduleSensor(int32_t sensorHandle) {
+    std::lock_guard<std::mutex> lock(mSchedulerLock);
+    uint64_t generation = ++mScheduleGenerations[sensorHandle];
+    int64_t deadlineNs = mSensors[sensorHandle]->getNextDeadlineNs();
+    if (deadlineNs >= 0) {
+        mScheduleHeap.push({deadlineNs, sensorHandle, generation});
+        mSchedulerCV.notify_all();
+    }
+}
+
+void Sensors::runScheduler() {
+    std::unique_lock<std::mutex> lock(mSchedulerLock);
+    std::vector<Event> events;
+
+    while (mSchedulerRun) {
+        int64_t now = ::android::elapsedRealtimeNano();
+        size_t numWakeUpEvents = 0;
+        while (!mScheduleHeap.empty()) {
+            ScheduledPoll entry = mScheduleHeap.top();
+            if (entry.generation != mScheduleGenerations[entry.sensorHandle]) {
+                mScheduleHeap.pop();
+                continue;
+            }
+            const std::shared_ptr<Sensor>& sensor = mSensors[entry.sensorHandle];
+            if (entry.deadlineNs > sensor->getDueTimeNs(now, kSchedulerSlackNs)) {
+                break;
+            }
+            mScheduleHeap.pop();
+            size_t numEvents = events.size();
+            int64_t deadlineNs = sensor->poll(now, kSchedulerSlackNs, &events);
+            if (sensor->isWakeUpSensor()) {
+                numWakeUpEvents += events.size() - numEvents;
+            }
+            if (deadlineNs < 0) {
+                continue;
+            }
+            if (deadlineNs <= entry.deadlineNs) {
+                // The poll did not move the sensor on; retry it later instead of spinning
+                ALOGW("Sensor %d deadline %" PRId64 " did not advance", entry.sensorHandle,
+                      deadlineNs);
+                mScheduleHeap.push(
+                        {now + kSchedulerSlackNs, entry.sensorHandle, entry.generation});
+                break;
+            }
+            mScheduleHeap.push({deadlineNs, entry.sensorHandle, entry.generation});
+        }
+
+        if (!mPendingEvents.empty()) {
+            events.insert(events.end(), mPendingEvents.begin(), mPendingEvents.end());
+            numWakeUpEvents += mPendingWakeUpEvents;
+            mPendingEvents.clear();
+            mPendingWakeUpEvents = 0;
+        }
+
+        if (!events.empty()) {
+            lock.unlock();
+            writeEvents(events, numWakeUpEvents);
+            events.clear();
+            lock.lock();
+            continue;
+        }
+
+        if (mScheduleHeap.empty()) {
+            mSchedulerCV.wait(lock);
+        } else {
+            mSchedulerCV.wait_for(lock,
+                                  std::chrono::nanoseconds(mScheduleHeap.top().deadlineNs - now));
+        }
     }
+}
+
+void Sensors::startSchedulerThread(Sensors* sensors) {
+    sensors->runScheduler();
+}
+
+void Sensors::updateWakeLock(int32_t eventsWritten, int32_t eventsHandled) {
+    uint32_t oldVal = mOutstandingWakeUpEvents.load();
+    uint32_t newVal;
+    do {
+        int64_t val = static_cast<int64_t>(oldVal) + eventsWritten - eventsHandled;
+        newVal = val < 0 ? 0 : static_cast<uint32_t>(val);
+    } while (!mOutstandingWakeUpEvents.compare_exchange_weak(oldVal, newVal));
 
     if (eventsWritten > 0) {
         // Update the time at which the last WAKE_UP event was sent
@@ -208,9 +373,19 @@ void Sensors::updateWakeLock(int32_t eventsWritten, int32_t eventsHandled) {
                                    static_cast<uint32_t>(SensorTimeout::WAKE_LOCK_SECONDS) * 1000;
     }
 
+    // Only take the lock when the wake lock may need to change hands
+    if (mHasWakeLock != (newVal > 0) || (mHasWakeLock && eventsWritten == 0)) {
+        std::lock_guard<std::mutex> lock(mWakeLockLock);
+        updateWakeLockStateLocked();
+    }
+}
+
+void Sensors::updateWakeLockStateLocked() {
     if (!mHasWakeLock && mOutstandingWakeUpEvents > 0 &&
         acquire_wake_lock(PARTIAL_WAKE_LOCK, kWakeLockName) == 0) {
         mHasWakeLock = true;
+        mWakeLockAcquiredTimeMs = ::android::uptimeMillis();
+        mWakeLockAcquisitions++;
     } else if (mHasWakeLock) {
         // Check if the wake lock should be released automatically if
         // SensorTimeout::WAKE_LOCK_SECONDS has elapsed since the last WAKE_UP event was written to
@@ -223,6 +398,9 @@ void Sensors::updateWakeLock(int32_t eventsWritten, int32_t eventsHandled) {
 
         if (mOutstandingWakeUpEvents == 0 && release_wake_lock(kWakeLockName) == 0) {
             mHasWakeLock = false;
+            int64_t heldMs = ::android::uptimeMillis() - mWakeLockAcquiredTimeMs;
+            mWakeLockHeldTotalMs += heldMs;
+            mWakeLockHoldTime.add(heldMs);
         }
     }
 }
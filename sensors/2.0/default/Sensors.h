@@ -17,6 +17,7 @@
 #ifndef ANDROID_HARDWARE_SENSORS_V2_0_SENSORS_H
 #define ANDROID_HARDWARE_SENSORS_V2_0_SENSORS_H
 
+#include "Histogram.h"
 #include "Sensor.h"
 
 #include <android/hardware/sensors/2.0/ISensors.h>
@@ -26,7 +27,10 @@
 #include <hidl/Status.h>
 
 #include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <queue>
 #include <thread>
 
 namespace android {
@@ -38,6 +42,7 @@ namespace implementation {
 using ::android::sp;
 using ::android::hardware::EventFlag;
 using ::android::hardware::hidl_array;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_memory;
 using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
@@ -85,6 +90,9 @@ struct Sensors : public ISensors, public ISensorsEventCallback {
 
     void postEvents(const std::vector<Event>& events, bool wakeup) override;
 
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override;
+
    private:
     /**
      * Add a new sensor
@@ -108,6 +116,30 @@ struct Sensors : public ISensors, public ISensorsEventCallback {
 
     static void startReadWakeLockThread(Sensors* sensors);
 
+    /**
+     * Polls the sensors as they fall due and writes the events of all sensors polled in the same
+     * wake-up to the Event FMQ in a single write
+     */
+    void runScheduler();
+
+    static void startSchedulerThread(Sensors* sensors);
+
+    /**
+     * Schedules the sensor again after its configuration changed
+     */
+    void scheduleSensor(int32_t sensorHandle);
+
+    /**
+     * Writes events to the Event FMQ, numWakeUpEvents of which come from WAKE_UP sensors. Only
+     * called from the scheduler thread.
+     */
+    void writeEvents(const std::vector<Event>& events, size_t numWakeUpEvents);
+
+    /**
+     * Acquires or releases the wake lock as needed. Must be called with mWakeLockLock held.
+     */
+    void updateWakeLockStateLocked();
+
     /**
      * Responsible for acquiring and releasing a wake lock when there are unhandled WAKE_UP events
      */
@@ -147,19 +179,23 @@ struct Sensors : public ISensors, public ISensorsEventCallback {
     int32_t mNextHandle;
 
     /**
-     * Lock to protect writes to the FMQs
+     * Lock to protect acquiring and releasing the wake lock. Counting WAKE_UP events does not take
+     * it, it is only taken when the wake lock may need to be acquired or released.
      */
-    std::mutex mWriteLock;
+    std::mutex mWakeLockLock;
 
     /**
-     * Lock to protect acquiring and releasing the wake lock
+     * Wake lock statistics, protected by mWakeLockLock
      */
-    std::mutex mWakeLockLock;
+    int64_t mWakeLockAcquiredTimeMs;
+    int64_t mWakeLockHeldTotalMs;
+    uint64_t mWakeLockAcquisitions;
+    Histogram mWakeLockHoldTime;
 
     /**
      * Track the number of WAKE_UP events that have not been handled by the framework
      */
-    uint32_t mOutstandingWakeUpEvents;
+    std::atomic<uint32_t> mOutstandingWakeUpEvents;
 
     /**
      * A thread to read the Wake Lock FMQ
@@ -174,12 +210,78 @@ struct Sensors : public ISensors, public ISensorsEventCallback {
     /**
      * Track the time when the wake lock should automatically be released
      */
-    int64_t mAutoReleaseWakeLockTime;
+    std::atomic<int64_t> mAutoReleaseWakeLockTime;
 
     /**
      * Flag to indicate if a wake lock has been acquired
      */
-    bool mHasWakeLock;
+    std::atomic_bool mHasWakeLock;
+
+    /**
+     * Events posted from other threads, such as flush and injected events, waiting for the
+     * scheduler thread to write them together with the next polled events. Protected by
+     * mSchedulerLock.
+     */
+    std::vector<Event> mPendingEvents;
+
+    /**
+     * Number of WAKE_UP events in mPendingEvents
+     */
+    size_t mPendingWakeUpEvents;
+
+    struct ScheduledPoll {
+        int64_t deadlineNs;
+        int32_t sensorHandle;
+        uint64_t generation;
+
+        bool operator>(const ScheduledPoll& other) const {
+            return deadlineNs > other.deadlineNs;
+        }
+    };
+
+    /**
+     * Timer heap of the next poll of each active sensor, earliest first. Entries whose generation
+     * no longer matches mScheduleGenerations are stale and are skipped.
+     */
+    std::priority_queue<ScheduledPoll, std::vector<ScheduledPoll>, std::greater<ScheduledPoll>>
+            mScheduleHeap;
+
+    /**
+     * Generation of the latest schedule of each sensor
+     */
+    std::map<int32_t, uint64_t> mScheduleGenerations;
+
+    /**
+     * Lock to protect the scheduler state
+     */
+    std::mutex mSchedulerLock;
+
+    std::condition_variable mSchedulerCV;
+
+    /**
+     * The single thread sampling all of the sensors
+     */
+    std::thread mSchedulerThread;
+
+    bool mSchedulerRun;
+
+    /**
+     * Event FMQ write statistics, protected by mStatsLock
+     */
+    std::mutex mStatsLock;
+    uint64_t mEventsWritten;
+    uint64_t mEventsDropped;
+    uint64_t mWriteFailures;
+
+    /**
+     * Time from the generation of an event to its write to the Event FMQ
+     */
+    Histogram mWriteLatency;
+
+    /**
+     * Event FMQ fill level right after each write, in percent
+     */
+    Histogram mQueueFillLevel;
 };
 
 }  // namespace implementation
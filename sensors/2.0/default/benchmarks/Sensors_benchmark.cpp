@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Sensors.h"
+
+#include <android/hardware/sensors/2.0/types.h>
+#include <benchmark/benchmark.h>
+#include <utils/SystemClock.h>
+
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+namespace {
+
+using ::android::hardware::sensors::V1_0::Event;
+using ::android::hardware::sensors::V1_0::SensorInfo;
+using ::android::hardware::sensors::V1_0::SensorType;
+
+constexpr size_t kEventQueueSize = 256;
+constexpr int64_t kReadTimeoutNs = 1000 * 1000 * 1000;
+
+class NullSensorsCallback : public ISensorsCallback {
+   public:
+    Return<void> onDynamicSensorsConnected(const hidl_vec<SensorInfo>& /* sensorInfos */) override {
+        return Void();
+    }
+
+    Return<void> onDynamicSensorsDisconnected(
+            const hidl_vec<int32_t>& /* sensorHandles */) override {
+        return Void();
+    }
+};
+
+/*
+ * Posts batches of events to the HAL, as a sensor does, and reads them back from the Event FMQ
+ * the way the framework does, so each iteration covers the scheduler thread hand-off, the FMQ
+ * write and the EventFlag wake-up. Arg 0 is the number of events per batch.
+ */
+void BM_PostEventsToFmq(benchmark::State& state) {
+    const size_t batchSize = static_cast<size_t>(state.range(0));
+
+    using EventMessageQueue = MessageQueue<Event, kSynchronizedReadWrite>;
+    using WakeLockMessageQueue = MessageQueue<uint32_t, kSynchronizedReadWrite>;
+    EventMessageQueue eventQueue(kEventQueueSize, true /* configureEventFlagWord */);
+    WakeLockMessageQueue wakeLockQueue(kEventQueueSize, true /* configureEventFlagWord */);
+    EventFlag* eventFlag = nullptr;
+    if (!eventQueue.isValid() || !wakeLockQueue.isValid() ||
+        EventFlag::createEventFlag(eventQueue.getEventFlagWord(), &eventFlag) != OK) {
+        state.SkipWithError("failed to create the FMQs");
+        return;
+    }
+
+    sp<Sensors> sensors = new Sensors();
+    if (sensors->initialize(*eventQueue.getDesc(), *wakeLockQueue.getDesc(),
+                            new NullSensorsCallback()) != Result::OK) {
+        state.SkipWithError("initialize failed");
+        EventFlag::deleteEventFlag(&eventFlag);
+        return;
+    }
+
+    std::vector<Event> events(batchSize);
+    for (auto& event : events) {
+        event.sensorHandle = 1;
+        event.sensorType = SensorType::ACCELEROMETER;
+    }
+    std::vector<Event> received(batchSize);
+
+    for (auto _ : state) {
+        const int64_t now = ::android::elapsedRealtimeNano();
+        for (auto& event : events) {
+            event.timestamp = now;
+        }
+        sensors->postEvents(events, false /* wakeup */);
+
+        if (!eventQueue.readBlocking(received.data(), batchSize,
+                                     static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ),
+                                     static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS),
+                                     kReadTimeoutNs, eventFlag)) {
+            state.SkipWithError("events were not written to the FMQ");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * batchSize);
+
+    sensors.clear();
+    EventFlag::deleteEventFlag(&eventFlag);
+}
+BENCHMARK(BM_PostEventsToFmq)->Arg(1)->Arg(16)->Arg(128)->UseRealTime();
+
+}  // namespace
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,478 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "HalProxy.h"
+
+#include <android/hardware/sensors/2.0/types.h>
+#include <log/log.h>
+#include <utils/SystemClock.h>
+
+#include <dlfcn.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <fstream>
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::hardware::sensors::V1_0::SensorType;
+using ::android::hardware::sensors::V2_0::EventQueueFlagBits;
+using ::android::hardware::sensors::V2_0::SensorTimeout;
+using ::android::hardware::sensors::V2_0::WakeLockQueueFlagBits;
+
+constexpr const char* kWakeLockName = "SensorsMultiHAL_WAKEUP";
+
+// One sub-HAL library name per line, lines starting with '#' are ignored
+constexpr const char* kMultiHalConfigFile = "/vendor/etc/sensors/hals.conf";
+
+HalProxy::HalProxy()
+    : mEventQueueFlag(nullptr),
+      mPendingWakeupEvents(0),
+      mWriterActive(false),
+      mEventsDropped(0),
+      mOutstandingWakeUpEvents(0),
+      mAutoReleaseWakeLockTime(0),
+      mHasWakeLock(false),
+      mReadWakeLockQueueRun(false) {
+    initializeSubHalListFromConfigFile();
+    initializeSubHals();
+}
+
+HalProxy::~HalProxy() {
+    mReadWakeLockQueueRun = false;
+    if (mWakeLockThread.joinable()) {
+        mWakeLockThread.join();
+    }
+    deleteEventFlag();
+}
+
+// Methods from ::android::hardware::sensors::V2_0::ISensors follow.
+Return<void> HalProxy::getSensorsList(getSensorsList_cb _hidl_cb) {
+    std::vector<SensorInfo> sensors;
+    for (const auto& sensor : mSensors) {
+        sensors.push_back(sensor.second);
+    }
+    _hidl_cb(sensors);
+    return Void();
+}
+
+Return<Result> HalProxy::setOperationMode(OperationMode mode) {
+    Result result = Result::OK;
+    size_t subHalIndex;
+    for (subHalIndex = 0; subHalIndex < mSubHalList.size(); subHalIndex++) {
+        result = mSubHalList[subHalIndex]->setOperationMode(mode);
+        if (result != Result::OK) {
+            ALOGE("setOperationMode failed for sub-HAL %s",
+                  mSubHalList[subHalIndex]->getName().c_str());
+            break;
+        }
+    }
+
+    if (result != Result::OK) {
+        // Put the sub-HALs that already switched back in normal mode
+        for (size_t i = 0; i < subHalIndex; i++) {
+            mSubHalList[i]->setOperationMode(OperationMode::NORMAL);
+        }
+    }
+    return result;
+}
+
+Return<Result> HalProxy::activate(int32_t sensorHandle, bool enabled) {
+    ISensorsSubHal* subHal = getSubHalForSensorHandle(sensorHandle);
+    if (subHal == nullptr) {
+        return Result::BAD_VALUE;
+    }
+    return subHal->activate(clearSubHalIndex(sensorHandle), enabled);
+}
+
+Return<Result> HalProxy::initialize(
+    const ::android::hardware::MQDescriptorSync<Event>& eventQueueDescriptor,
+    const ::android::hardware::MQDescriptorSync<uint32_t>& wakeLockDescriptor,
+    const sp<ISensorsCallback>& sensorsCallback) {
+    Result result = Result::OK;
+
+    // Ensure that all sensors are disabled
+    for (const auto& sensor : mSensors) {
+        activate(sensor.first, false /* enabled */);
+    }
+
+    // Stop the Wake Lock thread if it is currently running
+    if (mReadWakeLockQueueRun.load()) {
+        mReadWakeLockQueueRun = false;
+        mWakeLockThread.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+
+        // Save a reference to the callback
+        mCallback = sensorsCallback;
+
+        // Create the Event FMQ from the eventQueueDescriptor. Reset the read/write positions.
+        mEventQueue =
+            std::make_unique<EventMessageQueue>(eventQueueDescriptor, true /* resetPointers */);
+
+        // Ensure that any existing EventFlag is properly deleted
+        deleteEventFlag();
+
+        // Create the EventFlag that is used to signal to the framework that sensor events have
+        // been written to the Event FMQ
+        if (EventFlag::createEventFlag(mEventQueue->getEventFlagWord(), &mEventQueueFlag) != OK) {
+            result = Result::BAD_VALUE;
+        }
+
+        if (!mCallback || !mEventQueue || mEventQueueFlag == nullptr) {
+            result = Result::BAD_VALUE;
+        }
+    }
+
+    // Create the Wake Lock FMQ that is used by the framework to communicate whenever WAKE_UP
+    // events have been successfully read and handled by the framework.
+    mWakeLockQueue =
+        std::make_unique<WakeLockMessageQueue>(wakeLockDescriptor, true /* resetPointers */);
+    if (!mWakeLockQueue) {
+        result = Result::BAD_VALUE;
+    }
+
+    // Start the thread to read events from the Wake Lock FMQ
+    mReadWakeLockQueueRun = true;
+    mWakeLockThread = std::thread(startReadWakeLockThread, this);
+
+    return result;
+}
+
+Return<Result> HalProxy::batch(int32_t sensorHandle, int64_t samplingPeriodNs,
+                               int64_t maxReportLatencyNs) {
+    ISensorsSubHal* subHal = getSubHalForSensorHandle(sensorHandle);
+    if (subHal == nullptr) {
+        return Result::BAD_VALUE;
+    }
+    return subHal->batch(clearSubHalIndex(sensorHandle), samplingPeriodNs, maxReportLatencyNs);
+}
+
+Return<Result> HalProxy::flush(int32_t sensorHandle) {
+    ISensorsSubHal* subHal = getSubHalForSensorHandle(sensorHandle);
+    if (subHal == nullptr) {
+        return Result::BAD_VALUE;
+    }
+    return subHal->flush(clearSubHalIndex(sensorHandle));
+}
+
+Return<Result> HalProxy::injectSensorData(const Event& event) {
+    if (event.sensorType == SensorType::ADDITIONAL_INFO) {
+        // Operation environment data is meant for all the sub-HALs
+        Result result = Result::OK;
+        for (ISensorsSubHal* subHal : mSubHalList) {
+            Result subHalResult = subHal->injectSensorData(event);
+            if (subHalResult != Result::OK) {
+                result = subHalResult;
+            }
+        }
+        return result;
+    }
+
+    ISensorsSubHal* subHal = getSubHalForSensorHandle(event.sensorHandle);
+    if (subHal == nullptr) {
+        return Result::BAD_VALUE;
+    }
+    Event subHalEvent = event;
+    subHalEvent.sensorHandle = clearSubHalIndex(event.sensorHandle);
+    return subHal->injectSensorData(subHalEvent);
+}
+
+Return<void> HalProxy::registerDirectChannel(const SharedMemInfo& /* mem */,
+                                             registerDirectChannel_cb _hidl_cb) {
+    _hidl_cb(Result::INVALID_OPERATION, -1 /* channelHandle */);
+    return Return<void>();
+}
+
+Return<Result> HalProxy::unregisterDirectChannel(int32_t /* channelHandle */) {
+    return Result::INVALID_OPERATION;
+}
+
+Return<void> HalProxy::configDirectReport(int32_t /* sensorHandle */, int32_t /* channelHandle */,
+                                          RateLevel /* rate */, configDirectReport_cb _hidl_cb) {
+    _hidl_cb(Result::INVALID_OPERATION, 0 /* reportToken */);
+    return Return<void>();
+}
+
+Return<void> HalProxy::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* args */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        return Void();
+    }
+    int out = fd->data[0];
+
+    dprintf(out, "Sensors multi-HAL, %zu sub-HALs, %zu sensors\n", mSubHalList.size(),
+            mSensors.size());
+    for (size_t i = 0; i < mSubHalList.size(); i++) {
+        dprintf(out, "Sub-HAL %zu: %s\n%s", i, mSubHalList[i]->getName().c_str(),
+                mSubHalList[i]->dump().c_str());
+    }
+    {
+        std::lock_guard<std::mutex> lock(mPendingLock);
+        dprintf(out, "Events dropped: %" PRIu64 "\n", mEventsDropped);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mWakeLockLock);
+        dprintf(out, "Wake lock: %s, outstanding WAKE_UP events: %" PRIu32 "\n",
+                mHasWakeLock ? "held" : "released", mOutstandingWakeUpEvents);
+    }
+    return Void();
+}
+
+void HalProxy::postEventsToMessageQueue(const std::vector<Event>& events,
+                                        size_t numWakeupEvents) {
+    std::unique_lock<std::mutex> lock(mPendingLock);
+    mPendingEvents.insert(mPendingEvents.end(), events.begin(), events.end());
+    mPendingWakeupEvents += numWakeupEvents;
+    if (mWriterActive) {
+        // The thread writing the Event FMQ picks the events up once its write completes
+        return;
+    }
+
+    mWriterActive = true;
+    std::vector<Event> batch;
+    while (!mPendingEvents.empty()) {
+        batch.swap(mPendingEvents);
+        size_t batchWakeupEvents = mPendingWakeupEvents;
+        mPendingWakeupEvents = 0;
+
+        lock.unlock();
+        writeEvents(batch, batchWakeupEvents);
+        batch.clear();
+        lock.lock();
+    }
+    mWriterActive = false;
+}
+
+void HalProxy::writeEvents(const std::vector<Event>& events, size_t numWakeupEvents) {
+    std::unique_lock<std::mutex> lock(mEventQueueWriteMutex);
+    if (mEventQueue == nullptr || mEventQueueFlag == nullptr) {
+        // Not initialized yet, there is no framework to deliver the events to
+        return;
+    }
+
+    if (mEventQueue->write(events.data(), events.size())) {
+        mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
+        lock.unlock();
+
+        if (numWakeupEvents > 0) {
+            // Keep track of the number of outstanding WAKE_UP events in order to properly hold
+            // a wake lock until the framework has secured a wake lock
+            updateWakeLock(numWakeupEvents, 0 /* eventsHandled */);
+        }
+    } else {
+        lock.unlock();
+        ALOGW("Dropped %zu events, Event FMQ is full", events.size());
+        std::lock_guard<std::mutex> pendingLock(mPendingLock);
+        mEventsDropped += events.size();
+    }
+}
+
+void HalProxy::onDynamicSensorsConnected(const std::vector<SensorInfo>& dynamicSensorsAdded) {
+    sp<ISensorsCallback> callback = getCallback();
+    if (callback != nullptr) {
+        callback->onDynamicSensorsConnected(dynamicSensorsAdded);
+    }
+}
+
+void HalProxy::onDynamicSensorsDisconnected(
+        const std::vector<int32_t>& dynamicSensorHandlesRemoved) {
+    sp<ISensorsCallback> callback = getCallback();
+    if (callback != nullptr) {
+        callback->onDynamicSensorsDisconnected(dynamicSensorHandlesRemoved);
+    }
+}
+
+sp<ISensorsCallback> HalProxy::getCallback() {
+    std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+    return mCallback;
+}
+
+void HalProxy::initializeSubHalListFromConfigFile() {
+    std::ifstream subHalConfigStream(kMultiHalConfigFile);
+    if (!subHalConfigStream) {
+        ALOGE("Failed to load sensors multi-HAL config file %s", kMultiHalConfigFile);
+        return;
+    }
+
+    std::string subHalLibraryFile;
+    while (std::getline(subHalConfigStream, subHalLibraryFile)) {
+        if (subHalLibraryFile.empty() || subHalLibraryFile[0] == '#') {
+            continue;
+        }
+        if (mSubHalList.size() >= kMaxSubHalCount) {
+            ALOGE("Too many sub-HALs, ignoring %s", subHalLibraryFile.c_str());
+            continue;
+        }
+
+        void* handle = dlopen(subHalLibraryFile.c_str(), RTLD_NOW);
+        if (handle == nullptr) {
+            ALOGE("dlopen failed for library %s: %s", subHalLibraryFile.c_str(), dlerror());
+            continue;
+        }
+
+        SensorsHalGetSubHalFunc* sensorsHalGetSubHalPtr =
+                reinterpret_cast<SensorsHalGetSubHalFunc*>(dlsym(handle, SENSORS_HAL_GET_SUB_HAL));
+        if (sensorsHalGetSubHalPtr == nullptr) {
+            ALOGE("Failed to locate %s function for library %s", SENSORS_HAL_GET_SUB_HAL,
+                  subHalLibraryFile.c_str());
+            dlclose(handle);
+            continue;
+        }
+
+        uint32_t version;
+        ISensorsSubHal* subHal = (*sensorsHalGetSubHalPtr)(&version);
+        if (subHal == nullptr || version != SUB_HAL_2_0_VERSION) {
+            ALOGE("Sub-HAL library %s has an unsupported version %" PRIu32,
+                  subHalLibraryFile.c_str(), version);
+            dlclose(handle);
+            continue;
+        }
+
+        ALOGV("Loaded sub-HAL %s from %s", subHal->getName().c_str(), subHalLibraryFile.c_str());
+        mSubHalList.push_back(subHal);
+    }
+}
+
+void HalProxy::initializeSubHals() {
+    for (size_t subHalIndex = 0; subHalIndex < mSubHalList.size(); subHalIndex++) {
+        ISensorsSubHal* subHal = mSubHalList[subHalIndex];
+        mSubHalCallbacks.push_back(std::make_unique<HalProxyCallback>(this, subHalIndex));
+        if (subHal->initialize(mSubHalCallbacks.back().get()) != Result::OK) {
+            ALOGE("Failed to initialize sub-HAL %s", subHal->getName().c_str());
+            continue;
+        }
+
+        for (SensorInfo sensor : subHal->getSensorsList()) {
+            if (clearSubHalIndex(sensor.sensorHandle) != sensor.sensorHandle) {
+                ALOGE("Sub-HAL %s sensor handle %" PRId32 " does not fit in %" PRId32 " bits",
+                      subHal->getName().c_str(), sensor.sensorHandle, kSubHalIndexShift);
+                continue;
+            }
+            sensor.sensorHandle = setSubHalIndex(sensor.sensorHandle, subHalIndex);
+            mSensors[sensor.sensorHandle] = sensor;
+        }
+    }
+}
+
+ISensorsSubHal* HalProxy::getSubHalForSensorHandle(int32_t sensorHandle) {
+    if (sensorHandle < 0) {
+        return nullptr;
+    }
+    size_t subHalIndex = getSubHalIndex(sensorHandle);
+    return subHalIndex < mSubHalList.size() ? mSubHalList[subHalIndex] : nullptr;
+}
+
+void HalProxy::updateWakeLock(int32_t eventsWritten, int32_t eventsHandled) {
+    std::lock_guard<std::mutex> lock(mWakeLockLock);
+    int32_t newVal = mOutstandingWakeUpEvents + eventsWritten - eventsHandled;
+    if (newVal < 0) {
+        mOutstandingWakeUpEvents = 0;
+    } else {
+        mOutstandingWakeUpEvents = newVal;
+    }
+
+    if (eventsWritten > 0) {
+        // Update the time at which the last WAKE_UP event was sent
+        mAutoReleaseWakeLockTime = ::android::uptimeMillis() +
+                                   static_cast<uint32_t>(SensorTimeout::WAKE_LOCK_SECONDS) * 1000;
+    }
+
+    if (!mHasWakeLock && mOutstandingWakeUpEvents > 0 &&
+        acquire_wake_lock(PARTIAL_WAKE_LOCK, kWakeLockName) == 0) {
+        mHasWakeLock = true;
+    } else if (mHasWakeLock) {
+        // Check if the wake lock should be released automatically if
+        // SensorTimeout::WAKE_LOCK_SECONDS has elapsed since the last WAKE_UP event was written to
+        // the Wake Lock FMQ.
+        if (::android::uptimeMillis() > mAutoReleaseWakeLockTime) {
+            ALOGD("No events read from wake lock FMQ for %d seconds, auto releasing wake lock",
+                  SensorTimeout::WAKE_LOCK_SECONDS);
+            mOutstandingWakeUpEvents = 0;
+        }
+
+        if (mOutstandingWakeUpEvents == 0 && release_wake_lock(kWakeLockName) == 0) {
+            mHasWakeLock = false;
+        }
+    }
+}
+
+void HalProxy::readWakeLockFMQ() {
+    while (mReadWakeLockQueueRun.load()) {
+        constexpr int64_t kReadTimeoutNs = 500 * 1000 * 1000;  // 500 ms
+        uint32_t eventsHandled = 0;
+
+        // Read events from the Wake Lock FMQ. Timeout after a reasonable amount of time to ensure
+        // that any held wake lock is able to be released if it is held for too long.
+        mWakeLockQueue->readBlocking(&eventsHandled, 1 /* count */, 0 /* readNotification */,
+                                     static_cast<uint32_t>(WakeLockQueueFlagBits::DATA_WRITTEN),
+                                     kReadTimeoutNs);
+        updateWakeLock(0 /* eventsWritten */, eventsHandled);
+    }
+}
+
+void HalProxy::startReadWakeLockThread(HalProxy* halProxy) {
+    halProxy->readWakeLockFMQ();
+}
+
+void HalProxy::deleteEventFlag() {
+    status_t status = EventFlag::deleteEventFlag(&mEventQueueFlag);
+    if (status != OK) {
+        ALOGI("Failed to delete event flag: %d", status);
+    }
+}
+
+void HalProxy::HalProxyCallback::postEvents(const std::vector<Event>& events, bool wakeup) {
+    std::vector<Event> proxyEvents(events);
+    for (Event& event : proxyEvents) {
+        event.sensorHandle = setSubHalIndex(event.sensorHandle, mSubHalIndex);
+        if (event.sensorType == SensorType::DYNAMIC_SENSOR_META) {
+            event.u.dynamic.sensorHandle =
+                    setSubHalIndex(event.u.dynamic.sensorHandle, mSubHalIndex);
+        }
+    }
+    mHalProxy->postEventsToMessageQueue(proxyEvents, wakeup ? proxyEvents.size() : 0);
+}
+
+void HalProxy::HalProxyCallback::onDynamicSensorsConnected(
+        const std::vector<SensorInfo>& dynamicSensorsAdded) {
+    std::vector<SensorInfo> sensors(dynamicSensorsAdded);
+    for (SensorInfo& sensor : sensors) {
+        sensor.sensorHandle = setSubHalIndex(sensor.sensorHandle, mSubHalIndex);
+    }
+    mHalProxy->onDynamicSensorsConnected(sensors);
+}
+
+void HalProxy::HalProxyCallback::onDynamicSensorsDisconnected(
+        const std::vector<int32_t>& dynamicSensorHandlesRemoved) {
+    std::vector<int32_t> sensorHandles(dynamicSensorHandlesRemoved);
+    for (int32_t& sensorHandle : sensorHandles) {
+        sensorHandle = setSubHalIndex(sensorHandle, mSubHalIndex);
+    }
+    mHalProxy->onDynamicSensorsDisconnected(sensorHandles);
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_SENSORS_V2_0_HALPROXY_H
+#define ANDROID_HARDWARE_SENSORS_V2_0_HALPROXY_H
+
+#include "SubHal.h"
+
+#include <android/hardware/sensors/2.0/ISensors.h>
+#include <fmq/MessageQueue.h>
+#include <hardware_legacy/power.h>
+#include <hidl/MQDescriptor.h>
+#include <hidl/Status.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::sp;
+using ::android::hardware::EventFlag;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::MessageQueue;
+using ::android::hardware::MQDescriptor;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+
+/**
+ * ISensors implementation aggregating the sensors of several sub-HALs, loaded from the libraries
+ * listed in kMultiHalConfigFile. The sub-HAL index is stored in the upper bits of the sensor
+ * handles exposed to the framework.
+ */
+struct HalProxy : public ISensors {
+    using Event = ::android::hardware::sensors::V1_0::Event;
+    using OperationMode = ::android::hardware::sensors::V1_0::OperationMode;
+    using RateLevel = ::android::hardware::sensors::V1_0::RateLevel;
+    using Result = ::android::hardware::sensors::V1_0::Result;
+    using SharedMemInfo = ::android::hardware::sensors::V1_0::SharedMemInfo;
+
+    HalProxy();
+    ~HalProxy();
+
+    // Methods from ::android::hardware::sensors::V2_0::ISensors follow.
+    Return<void> getSensorsList(getSensorsList_cb _hidl_cb) override;
+
+    Return<Result> setOperationMode(OperationMode mode) override;
+
+    Return<Result> activate(int32_t sensorHandle, bool enabled) override;
+
+    Return<Result> initialize(
+        const ::android::hardware::MQDescriptorSync<Event>& eventQueueDescriptor,
+        const ::android::hardware::MQDescriptorSync<uint32_t>& wakeLockDescriptor,
+        const sp<ISensorsCallback>& sensorsCallback) override;
+
+    Return<Result> batch(int32_t sensorHandle, int64_t samplingPeriodNs,
+                         int64_t maxReportLatencyNs) override;
+
+    Return<Result> flush(int32_t sensorHandle) override;
+
+    Return<Result> injectSensorData(const Event& event) override;
+
+    Return<void> registerDirectChannel(const SharedMemInfo& mem,
+                                       registerDirectChannel_cb _hidl_cb) override;
+
+    Return<Result> unregisterDirectChannel(int32_t channelHandle) override;
+
+    Return<void> configDirectReport(int32_t sensorHandle, int32_t channelHandle, RateLevel rate,
+                                    configDirectReport_cb _hidl_cb) override;
+
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override;
+
+    /**
+     * Writes events, already using the framework sensor handles, to the Event FMQ. Called from the
+     * sub-HAL threads. Events posted while another thread is writing are written by that thread
+     * in its next write, so concurrent sub-HALs share FMQ writes and EventFlag wakes.
+     */
+    void postEventsToMessageQueue(const std::vector<Event>& events, size_t numWakeupEvents);
+
+    /**
+     * Forwards dynamic sensor connections to the framework, using the framework sensor handles
+     */
+    void onDynamicSensorsConnected(const std::vector<SensorInfo>& dynamicSensorsAdded);
+    void onDynamicSensorsDisconnected(const std::vector<int32_t>& dynamicSensorHandlesRemoved);
+
+    static constexpr int32_t kSubHalIndexShift = 24;
+    static constexpr int32_t kSensorHandleMask = (1 << kSubHalIndexShift) - 1;
+
+    /**
+     * Keep within the positive handle range
+     */
+    static constexpr size_t kMaxSubHalCount = 1 << (31 - kSubHalIndexShift);
+
+   private:
+    using EventMessageQueue = MessageQueue<Event, kSynchronizedReadWrite>;
+    using WakeLockMessageQueue = MessageQueue<uint32_t, kSynchronizedReadWrite>;
+
+    /**
+     * Callback handed to one sub-HAL, translating its sensor handles
+     */
+    class HalProxyCallback : public IHalProxyCallback {
+       public:
+        HalProxyCallback(HalProxy* halProxy, int32_t subHalIndex)
+            : mHalProxy(halProxy), mSubHalIndex(subHalIndex) {}
+
+        void postEvents(const std::vector<Event>& events, bool wakeup) override;
+        void onDynamicSensorsConnected(
+                const std::vector<SensorInfo>& dynamicSensorsAdded) override;
+        void onDynamicSensorsDisconnected(
+                const std::vector<int32_t>& dynamicSensorHandlesRemoved) override;
+
+       private:
+        HalProxy* mHalProxy;
+        int32_t mSubHalIndex;
+    };
+
+    /**
+     * Loads the sub-HAL libraries listed in kMultiHalConfigFile
+     */
+    void initializeSubHalListFromConfigFile();
+
+    /**
+     * Initializes the sub-HALs with their callback and builds the full sensor list
+     */
+    void initializeSubHals();
+
+    /**
+     * Returns the sub-HAL owning the framework sensor handle, or nullptr if there is none
+     */
+    ISensorsSubHal* getSubHalForSensorHandle(int32_t sensorHandle);
+
+    static int32_t getSubHalIndex(int32_t sensorHandle) {
+        return sensorHandle >> kSubHalIndexShift;
+    }
+
+    static int32_t clearSubHalIndex(int32_t sensorHandle) {
+        return sensorHandle & kSensorHandleMask;
+    }
+
+    static int32_t setSubHalIndex(int32_t sensorHandle, int32_t subHalIndex) {
+        return (subHalIndex << kSubHalIndexShift) | clearSubHalIndex(sensorHandle);
+    }
+
+    void writeEvents(const std::vector<Event>& events, size_t numWakeupEvents);
+
+    /**
+     * Function to read the Wake Lock FMQ and release the wake lock when appropriate
+     */
+    void readWakeLockFMQ();
+
+    static void startReadWakeLockThread(HalProxy* halProxy);
+
+    /**
+     * Responsible for acquiring and releasing a wake lock when there are unhandled WAKE_UP events
+     */
+    void updateWakeLock(int32_t eventsWritten, int32_t eventsHandled);
+
+    /**
+     * Utility function to delete the Event Flag
+     */
+    void deleteEventFlag();
+
+    /**
+     * Returns the framework callback, so that it can be called without holding
+     * mEventQueueWriteMutex
+     */
+    sp<ISensorsCallback> getCallback();
+
+    /**
+     * The sub-HALs, indexed by the upper bits of the framework sensor handles
+     */
+    std::vector<ISensorsSubHal*> mSubHalList;
+    std::vector<std::unique_ptr<HalProxyCallback>> mSubHalCallbacks;
+
+    /**
+     * All the static sensors, using the framework sensor handles
+     */
+    std::map<int32_t, SensorInfo> mSensors;
+
+    /**
+     * The Event FMQ where sensor events are written
+     */
+    std::unique_ptr<EventMessageQueue> mEventQueue;
+
+    /**
+     * The Wake Lock FMQ that is read to determine when the framework has handled WAKE_UP events
+     */
+    std::unique_ptr<WakeLockMessageQueue> mWakeLockQueue;
+
+    /**
+     * Event Flag to signal to the framework when sensor events are available to be read
+     */
+    EventFlag* mEventQueueFlag;
+
+    /**
+     * Callback for asynchronous events, such as dynamic sensor connections
+     */
+    sp<ISensorsCallback> mCallback;
+
+    /**
+     * Protects mEventQueue, mEventQueueFlag and mCallback against initialize() replacing them
+     * while a sub-HAL thread uses them. Held for the duration of each Event FMQ write.
+     */
+    std::mutex mEventQueueWriteMutex;
+
+    /**
+     * Protects mPendingEvents, mPendingWakeupEvents and mWriterActive, which hand events over to
+     * the thread currently writing the Event FMQ
+     */
+    std::mutex mPendingLock;
+    std::vector<Event> mPendingEvents;
+    size_t mPendingWakeupEvents;
+    bool mWriterActive;
+
+    /**
+     * Number of events dropped because the Event FMQ was full, protected by mPendingLock
+     */
+    uint64_t mEventsDropped;
+
+    /**
+     * Lock to protect acquiring and releasing the wake lock
+     */
+    std::mutex mWakeLockLock;
+
+    /**
+     * Track the number of WAKE_UP events that have not been handled by the framework
+     */
+    uint32_t mOutstandingWakeUpEvents;
+
+    /**
+     * Track the time when the wake lock should automatically be released
+     */
+    int64_t mAutoReleaseWakeLockTime;
+
+    /**
+     * Flag to indicate if a wake lock has been acquired
+     */
+    bool mHasWakeLock;
+
+    /**
+     * A thread to read the Wake Lock FMQ
+     */
+    std::thread mWakeLockThread;
+
+    /**
+     * Flag to indicate that the Wake Lock Thread should continue to run
+     */
+    std::atomic_bool mReadWakeLockQueueRun;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_SENSORS_V2_0_HALPROXY_H
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_SENSORS_V2_0_MULTIHAL_SUBHAL_H
+#define ANDROID_HARDWARE_SENSORS_V2_0_MULTIHAL_SUBHAL_H
+
+#include <android/hardware/sensors/1.0/types.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * Version of the sub-HAL interface below. Sub-HALs report it from sensorsHalGetSubHal() and are
+ * only loaded by a HalProxy built against the same version.
+ */
+#define SUB_HAL_2_0_VERSION 1
+
+/**
+ * Name of the function every sub-HAL library must export, see SensorsHalGetSubHalFunc
+ */
+#define SENSORS_HAL_GET_SUB_HAL "sensorsHalGetSubHal"
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::hardware::sensors::V1_0::Event;
+using ::android::hardware::sensors::V1_0::OperationMode;
+using ::android::hardware::sensors::V1_0::Result;
+using ::android::hardware::sensors::V1_0::SensorInfo;
+
+/**
+ * Callback provided by the HalProxy to each sub-HAL. Events are written to the Event FMQ from the
+ * calling thread, so sub-HALs should post all the events they have at hand in a single call.
+ */
+class IHalProxyCallback {
+   public:
+    virtual ~IHalProxyCallback() {}
+
+    /**
+     * Posts events using the sub-HAL sensor handles, which the HalProxy translates. wakeup must
+     * be set if the events come from WAKE_UP sensors.
+     */
+    virtual void postEvents(const std::vector<Event>& events, bool wakeup) = 0;
+
+    /**
+     * Reports dynamic sensors using the sub-HAL sensor handles
+     */
+    virtual void onDynamicSensorsConnected(const std::vector<SensorInfo>& dynamicSensorsAdded) = 0;
+    virtual void onDynamicSensorsDisconnected(
+            const std::vector<int32_t>& dynamicSensorHandlesRemoved) = 0;
+};
+
+/**
+ * Interface implemented by each sub-HAL. Methods have the semantics of the matching ISensors
+ * methods, with sensor handles local to the sub-HAL. Sensor handles must fit in the lower 24 bits.
+ */
+class ISensorsSubHal {
+   public:
+    virtual ~ISensorsSubHal() {}
+
+    /**
+     * Name used in logs and in the HalProxy dump
+     */
+    virtual const std::string getName() = 0;
+
+    /**
+     * Called once after loading. The callback remains valid for the lifetime of the sub-HAL.
+     */
+    virtual Result initialize(IHalProxyCallback* callback) = 0;
+
+    virtual std::vector<SensorInfo> getSensorsList() = 0;
+    virtual Result setOperationMode(OperationMode mode) = 0;
+    virtual Result activate(int32_t sensorHandle, bool enabled) = 0;
+    virtual Result batch(int32_t sensorHandle, int64_t samplingPeriodNs,
+                         int64_t maxReportLatencyNs) = 0;
+    virtual Result flush(int32_t sensorHandle) = 0;
+    virtual Result injectSensorData(const Event& event) = 0;
+
+    /**
+     * Returns state to include in the HalProxy dump
+     */
+    virtual std::string dump() { return ""; }
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+/**
+ * Returns the sub-HAL of the library and sets version to SUB_HAL_2_0_VERSION. The sub-HAL is never
+ * destroyed.
+ */
+using SensorsHalGetSubHalFunc =
+        ::android::hardware::sensors::V2_0::implementation::ISensorsSubHal*(uint32_t* version);
+
+#endif  // ANDROID_HARDWARE_SENSORS_V2_0_MULTIHAL_SUBHAL_H
@@ -21,6 +21,7 @@
 #include <android/hidl/allocator/1.0/IAllocator.h>
 #include <android/log.h>
 #include <hidlmemory/mapping.h>
+#include <string_view>
 #include <utility>
 
 using android::hardware::hidl_memory;
@@ -109,7 +110,7 @@ exit:
 int SoundTriggerHw::doLoadSoundModel(const V2_0::ISoundTriggerHw::SoundModel& soundModel,
                                      sp<SoundTriggerHw::SoundModelClient> client) {
     int32_t ret = 0;
-    struct sound_trigger_sound_model* halSoundModel;
+    std::shared_ptr<std::vector<uint8_t>> halSoundModel;
 
     ALOGV("doLoadSoundModel() data size %zu", soundModel.data.size());
 
@@ -118,17 +119,12 @@ int SoundTriggerHw::doLoadSoundModel(const V2_0::ISoundTriggerHw::SoundModel& so
         goto exit;
     }
 
-    halSoundModel = convertSoundModelToHal(&soundModel);
-    if (halSoundModel == NULL) {
-        ret = -EINVAL;
-        goto exit;
-    }
+    halSoundModel = getHalSoundModel(&soundModel);
 
     sound_model_handle_t halHandle;
-    ret = mHwDevice->load_sound_model(mHwDevice, halSoundModel, soundModelCallback_, client.get(),
-                                      &halHandle);
-
-    free(halSoundModel);
+    ret = mHwDevice->load_sound_model(
+        mHwDevice, reinterpret_cast<struct sound_trigger_sound_model*>(halSoundModel->data()),
+        soundModelCallback_, client.get(), &halHandle);
 
     if (ret != 0) {
         goto exit;
@@ -296,6 +292,15 @@ void SoundTriggerHw::onFirstRef() {
         return;
     }
 
+    sp<EventDispatcher> dispatcher = new EventDispatcher();
+    status_t status = dispatcher->run("SoundTriggerHw", PRIORITY_URGENT_AUDIO);
+    if (status == OK) {
+        mDispatcher = dispatcher;
+    } else {
+        ALOGW("couldn't start event dispatcher (%d), delivering events on the HAL thread",
+              status);
+    }
+
     ALOGI("onFirstRef() mModuleName %s mHwDevice %p", mModuleName, mHwDevice);
 }
 
@@ -303,6 +308,37 @@ SoundTriggerHw::~SoundTriggerHw() {
     if (mHwDevice != NULL) {
         sound_trigger_hw_device_close(mHwDevice);
     }
+    if (mDispatcher != 0) {
+        mDispatcher->requestExit();
+        mDispatcher->join();
+    }
+}
+
+void SoundTriggerHw::EventDispatcher::post(std::function<void()> event) {
+    AutoMutex lock(mLock);
+    mEvents.push_back(std::move(event));
+    mCond.signal();
+}
+
+void SoundTriggerHw::EventDispatcher::requestExit() {
+    AutoMutex lock(mLock);
+    Thread::requestExit();
+    mCond.signal();
+}
+
+bool SoundTriggerHw::EventDispatcher::threadLoop() {
+    std::function<void()> event;
+    {
+        AutoMutex lock(mLock);
+        while (mEvents.empty()) {
+            if (exitPending()) return false;
+            mCond.wait(mLock);
+        }
+        event = std::move(mEvents.front());
+        mEvents.pop_front();
+    }
+    event();
+    return true;
 }
 
 uint32_t SoundTriggerHw::nextUniqueModelId() {
@@ -368,17 +404,18 @@ void SoundTriggerHw::convertTriggerPhraseToHal(struct sound_trigger_phrase* halT
     strlcpy(halTriggerPhrase->text, triggerPhrase->text.c_str(), SOUND_TRIGGER_MAX_STRING_LEN);
 }
 
-struct sound_trigger_sound_model* SoundTriggerHw::convertSoundModelToHal(
+std::vector<uint8_t> SoundTriggerHw::convertSoundModelHeaderToHal(
     const V2_0::ISoundTriggerHw::SoundModel* soundModel) {
-    struct sound_trigger_sound_model* halModel = NULL;
-    if (soundModel->type == V2_0::SoundModelType::KEYPHRASE) {
-        size_t allocSize =
-            sizeof(struct sound_trigger_phrase_sound_model) + soundModel->data.size();
+    bool isKeyPhrase = soundModel->type == V2_0::SoundModelType::KEYPHRASE;
+    size_t headerSize = isKeyPhrase ? sizeof(struct sound_trigger_phrase_sound_model)
+                                    : sizeof(struct sound_trigger_sound_model);
+    // Zero filled, so that headers of the same model compare equal.
+    std::vector<uint8_t> halHeader(headerSize);
+    struct sound_trigger_sound_model* halModel =
+        reinterpret_cast<struct sound_trigger_sound_model*>(halHeader.data());
+    if (isKeyPhrase) {
         struct sound_trigger_phrase_sound_model* halKeyPhraseModel =
-            static_cast<struct sound_trigger_phrase_sound_model*>(malloc(allocSize));
-        LOG_ALWAYS_FATAL_IF(halKeyPhraseModel == NULL,
-                            "malloc failed for size %zu in convertSoundModelToHal PHRASE",
-                            allocSize);
+            reinterpret_cast<struct sound_trigger_phrase_sound_model*>(halModel);
 
         const V2_0::ISoundTriggerHw::PhraseSoundModel* keyPhraseModel =
             reinterpret_cast<const V2_0::ISoundTriggerHw::PhraseSoundModel*>(soundModel);
@@ -388,26 +425,59 @@ struct sound_trigger_sound_model* SoundTriggerHw::convertSoundModelToHal(
             convertTriggerPhraseToHal(&halKeyPhraseModel->phrases[i], &keyPhraseModel->phrases[i]);
         }
         halKeyPhraseModel->num_phrases = (unsigned int)i;
-        halModel = reinterpret_cast<struct sound_trigger_sound_model*>(halKeyPhraseModel);
-        halModel->data_offset = sizeof(struct sound_trigger_phrase_sound_model);
-    } else {
-        size_t allocSize = sizeof(struct sound_trigger_sound_model) + soundModel->data.size();
-        halModel = static_cast<struct sound_trigger_sound_model*>(malloc(allocSize));
-        LOG_ALWAYS_FATAL_IF(halModel == NULL,
-                            "malloc failed for size %zu in convertSoundModelToHal GENERIC",
-                            allocSize);
-
-        halModel->data_offset = sizeof(struct sound_trigger_sound_model);
     }
+    halModel->data_offset = headerSize;
     halModel->type = (sound_trigger_sound_model_type_t)soundModel->type;
     convertUuidToHal(&halModel->uuid, &soundModel->uuid);
     convertUuidToHal(&halModel->vendor_uuid, &soundModel->vendorUuid);
     halModel->data_size = soundModel->data.size();
-    uint8_t* dst = reinterpret_cast<uint8_t*>(halModel) + halModel->data_offset;
-    const uint8_t* src = reinterpret_cast<const uint8_t*>(&soundModel->data[0]);
-    memcpy(dst, src, soundModel->data.size());
 
-    return halModel;
+    return halHeader;
+}
+
+std::shared_ptr<std::vector<uint8_t>> SoundTriggerHw::getHalSoundModel(
+    const V2_0::ISoundTriggerHw::SoundModel* soundModel) {
+    std::vector<uint8_t> halHeader = convertSoundModelHeaderToHal(soundModel);
+    const struct sound_trigger_sound_model* halModel =
+        reinterpret_cast<const struct sound_trigger_sound_model*>(halHeader.data());
+    const uint8_t* data = soundModel->data.data();
+    size_t dataSize = soundModel->data.size();
+    size_t modelSize = halHeader.size() + dataSize;
+    size_t dataHash = std::hash<std::string_view>()(
+        std::string_view(reinterpret_cast<const char*>(data), dataSize));
+
+    AutoMutex lock(mSoundModelCacheLock);
+    for (auto it = mSoundModelCache.begin(); it != mSoundModelCache.end(); ++it) {
+        if (it->dataHash != dataHash ||
+            memcmp(&it->vendorUuid, &halModel->vendor_uuid, sizeof(it->vendorUuid)) != 0) {
+            continue;
+        }
+        // The hash only narrows the search, the bytes decide.
+        const std::vector<uint8_t>& cached = *it->model;
+        if (cached.size() == modelSize &&
+            memcmp(cached.data(), halHeader.data(), halHeader.size()) == 0 &&
+            memcmp(cached.data() + halHeader.size(), data, dataSize) == 0) {
+            ALOGV("getHalSoundModel() reusing cached model of size %zu", dataSize);
+            mSoundModelCache.splice(mSoundModelCache.begin(), mSoundModelCache, it);
+            return mSoundModelCache.front().model;
+        }
+    }
+
+    std::shared_ptr<std::vector<uint8_t>> model = std::make_shared<std::vector<uint8_t>>();
+    model->reserve(modelSize);
+    model->insert(model->end(), halHeader.begin(), halHeader.end());
+    model->insert(model->end(), data, data + dataSize);
+
+    if (modelSize > kMaxCachedSoundModelBytes) {
+        return model;
+    }
+    mSoundModelCache.push_front({halModel->vendor_uuid, dataHash, model});
+    mSoundModelCacheBytes += modelSize;
+    while (mSoundModelCacheBytes > kMaxCachedSoundModelBytes) {
+        mSoundModelCacheBytes -= mSoundModelCache.back().model->size();
+        mSoundModelCache.pop_back();
+    }
+    return model;
 }
 
 void SoundTriggerHw::convertPhraseRecognitionExtraToHal(
@@ -560,6 +630,25 @@ std::pair<bool, sp<IMemory>> memoryAsVector(const hidl_memory& m, hidl_vec<uint8
     return std::make_pair(false, memory);
 }
 
+// Looking the allocator up is a round trip to the service manager, which would
+// otherwise be paid on every recognition event, so it is only done again after
+// a failed transaction.
+Mutex gAshmemLock;
+sp<IAllocator> gAshmem;
+
+sp<IAllocator> getAshmemAllocator() {
+    AutoMutex lock(gAshmemLock);
+    if (gAshmem == 0) {
+        gAshmem = IAllocator::getService("ashmem");
+    }
+    return gAshmem;
+}
+
+void resetAshmemAllocator() {
+    AutoMutex lock(gAshmemLock);
+    gAshmem.clear();
+}
+
 // Moves the data from the vector into allocated shared memory,
 // emptying the vector.
 // It is assumed that the passed hidl_memory is a null object, so it's
@@ -571,7 +660,7 @@ std::pair<bool, sp<IMemory>> moveVectorToMemory(hidl_vec<uint8_t>* v, hidl_memor
     if (v->size() == 0) {
         return std::make_pair(true, memory);
     }
-    sp<IAllocator> ashmem = IAllocator::getService("ashmem");
+    sp<IAllocator> ashmem = getAshmemAllocator();
     if (ashmem == 0) {
         ALOGE("Failed to retrieve ashmem allocator service");
         return std::make_pair(false, memory);
@@ -581,6 +670,7 @@ std::pair<bool, sp<IMemory>> moveVectorToMemory(hidl_vec<uint8_t>* v, hidl_memor
         success = s;
         if (success) *mem = m;
     });
+    if (!r.isOk()) resetAshmemAllocator();
     if (r.isOk() && success) {
         memory = hardware::mapMemory(*mem);
         if (memory != 0) {
@@ -609,7 +699,7 @@ Return<void> SoundTriggerHw::loadSoundModel_2_1(
     auto result = memoryAsVector(soundModel.data, &soundModel_2_0.data);
     if (result.first) {
         sp<SoundModelClient> client =
-            new SoundModelClient_2_1(nextUniqueModelId(), cookie, callback);
+            new SoundModelClient_2_1(nextUniqueModelId(), cookie, callback, mDispatcher);
         _hidl_cb(doLoadSoundModel(soundModel_2_0, client), client->getId());
         return Void();
     }
@@ -631,7 +721,7 @@ Return<void> SoundTriggerHw::loadPhraseSoundModel_2_1(
     auto result = memoryAsVector(soundModel.common.data, &soundModel_2_0.common.data);
     if (result.first) {
         sp<SoundModelClient> client =
-            new SoundModelClient_2_1(nextUniqueModelId(), cookie, callback);
+            new SoundModelClient_2_1(nextUniqueModelId(), cookie, callback, mDispatcher);
         _hidl_cb(doLoadSoundModel((const V2_0::ISoundTriggerHw::SoundModel&)soundModel_2_0, client),
                  client->getId());
         return Void();
@@ -650,6 +740,16 @@ Return<int32_t> SoundTriggerHw::startRecognition_2_1(
                         : Return<int32_t>(-ENOMEM);
 }
 
+void SoundTriggerHw::SoundModelClient_2_1::dispatch(std::function<void()> event) {
+    if (mDispatcher != 0) {
+        mDispatcher->post(std::move(event));
+    } else {
+        event();
+    }
+}
+
+// The event data is moved into shared memory before returning to the legacy HAL, so the
+// binder callbacks themselves can run later on the dispatcher thread.
 void SoundTriggerHw::SoundModelClient_2_1::recognitionCallback(
     struct sound_trigger_recognition_event* halEvent) {
     if (halEvent->type == SOUND_MODEL_TYPE_KEYPHRASE) {
@@ -658,13 +758,18 @@ void SoundTriggerHw::SoundModelClient_2_1::recognitionCallback(
             &event_2_0, reinterpret_cast<sound_trigger_phrase_recognition_event*>(halEvent));
         event_2_0.common.model = mId;
         V2_1::ISoundTriggerHwCallback::PhraseRecognitionEvent event;
-        event.phraseExtras.setToExternal(event_2_0.phraseExtras.data(),
-                                         event_2_0.phraseExtras.size());
+        // Owned by event_2_0, which is gone by the time a deferred callback runs.
+        event.phraseExtras = std::move(event_2_0.phraseExtras);
         auto result = moveVectorToMemory(&event_2_0.common.data, &event.common.data);
         if (result.first) {
             // The data vector is now empty, thus copying is cheap.
             event.common.header = event_2_0.common;
-            mCallback->phraseRecognitionCallback_2_1(event, mCookie);
+            sp<V2_1::ISoundTriggerHwCallback> callback = mCallback;
+            int32_t cookie = mCookie;
+            sp<IMemory> memory = result.second;
+            dispatch([callback, cookie, event, memory]() {
+                callback->phraseRecognitionCallback_2_1(event, cookie);
+            });
         }
     } else {
         V2_1::ISoundTriggerHwCallback::RecognitionEvent event;
@@ -672,7 +777,12 @@ void SoundTriggerHw::SoundModelClient_2_1::recognitionCallback(
         event.header.model = mId;
         auto result = moveVectorToMemory(&event.header.data, &event.data);
         if (result.first) {
-            mCallback->recognitionCallback_2_1(event, mCookie);
+            sp<V2_1::ISoundTriggerHwCallback> callback = mCallback;
+            int32_t cookie = mCookie;
+            sp<IMemory> memory = result.second;
+            dispatch([callback, cookie, event, memory]() {
+                callback->recognitionCallback_2_1(event, cookie);
+            });
         }
     }
 }
@@ -684,7 +794,12 @@ void SoundTriggerHw::SoundModelClient_2_1::soundModelCallback(
     event.header.model = mId;
     auto result = moveVectorToMemory(&event.header.data, &event.data);
     if (result.first) {
-        mCallback->soundModelCallback_2_1(event, mCookie);
+        sp<V2_1::ISoundTriggerHwCallback> callback = mCallback;
+        int32_t cookie = mCookie;
+        sp<IMemory> memory = result.second;
+        dispatch([callback, cookie, event, memory]() {
+            callback->soundModelCallback_2_1(event, cookie);
+        });
     }
 }
 
@@ -28,6 +28,12 @@
 #include <utils/KeyedVector.h>
 #include <utils/threads.h>
 
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+
 namespace android {
 namespace hardware {
 namespace soundtrigger {
@@ -126,6 +132,23 @@ struct SoundTriggerHw : public ISoundTriggerHw {
     void onFirstRef() override;
 
    private:
+    // Delivers 2.1 client callbacks, in order, on a dedicated high priority thread, so that
+    // the legacy HAL's callback thread is not held up by binder transactions.
+    class EventDispatcher : public Thread {
+       public:
+        EventDispatcher() : Thread(false /*canCallJava*/) {}
+
+        void post(std::function<void()> event);
+        void requestExit() override;
+
+       private:
+        bool threadLoop() override;
+
+        Mutex mLock;
+        Condition mCond;
+        std::deque<std::function<void()>> mEvents;
+    };
+
     class SoundModelClient_2_0 : public SoundModelClient {
        public:
         SoundModelClient_2_0(uint32_t id, V2_0::ISoundTriggerHwCallback::CallbackCookie cookie,
@@ -145,8 +168,11 @@ struct SoundTriggerHw : public ISoundTriggerHw {
                                   const struct sound_trigger_properties* halProperties);
     void convertTriggerPhraseToHal(struct sound_trigger_phrase* halTriggerPhrase,
                                    const V2_0::ISoundTriggerHw::Phrase* triggerPhrase);
-    // returned HAL sound model must be freed by caller
-    struct sound_trigger_sound_model* convertSoundModelToHal(
+    // returns the HAL sound model header, without the model data
+    std::vector<uint8_t> convertSoundModelHeaderToHal(
+        const V2_0::ISoundTriggerHw::SoundModel* soundModel);
+    // returns the HAL sound model, reusing the cached one if the model did not change
+    std::shared_ptr<std::vector<uint8_t>> getHalSoundModel(
         const V2_0::ISoundTriggerHw::SoundModel* soundModel);
     void convertPhraseRecognitionExtraToHal(struct sound_trigger_phrase_recognition_extra* halExtra,
                                             const V2_0::PhraseRecognitionExtra* extra);
@@ -167,18 +193,39 @@ struct SoundTriggerHw : public ISoundTriggerHw {
     DefaultKeyedVector<int32_t, sp<SoundModelClient> > mClients;
     Mutex mLock;
 
+    // Recently loaded HAL sound models, most recent first, looked up by vendor UUID and a
+    // hash of the model data. Models are reloaded unchanged on every user or locale switch;
+    // keeping the converted copy around spares allocating and filling a multi-megabyte
+    // buffer each time. Bounded by the total size of the cached models.
+    struct CachedSoundModel {
+        sound_trigger_uuid_t vendorUuid;
+        size_t dataHash;
+        std::shared_ptr<std::vector<uint8_t>> model;
+    };
+    static constexpr size_t kMaxCachedSoundModelBytes = 16 * 1024 * 1024;
+    std::list<CachedSoundModel> mSoundModelCache;
+    size_t mSoundModelCacheBytes = 0;
+    Mutex mSoundModelCacheLock;
+
+    sp<EventDispatcher> mDispatcher;
+
     // Copied from hardware/interfaces/soundtrigger/2.1/default/SoundTriggerHw.h
     class SoundModelClient_2_1 : public SoundModelClient {
        public:
         SoundModelClient_2_1(uint32_t id, V2_1::ISoundTriggerHwCallback::CallbackCookie cookie,
-                             sp<V2_1::ISoundTriggerHwCallback> callback)
-            : SoundModelClient(id, cookie), mCallback(callback) {}
+                             sp<V2_1::ISoundTriggerHwCallback> callback,
+                             sp<EventDispatcher> dispatcher)
+            : SoundModelClient(id, cookie), mCallback(callback), mDispatcher(dispatcher) {}
 
         void recognitionCallback(struct sound_trigger_recognition_event* halEvent) override;
         void soundModelCallback(struct sound_trigger_model_event* halEvent) override;
 
        private:
+        // runs the callback on the dispatcher thread, or right away if there is none
+        void dispatch(std::function<void()> event);
+
         sp<V2_1::ISoundTriggerHwCallback> mCallback;
+        sp<EventDispatcher> mDispatcher;
     };
 };
 
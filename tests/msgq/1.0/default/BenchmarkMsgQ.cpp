@@ -15,8 +15,16 @@
  */
 
 #include "BenchmarkMsgQ.h"
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <memory>
 #include <thread>
+#include <vector>
+#include <fmq/EventFlag.h>
 #include <fmq/MessageQueue.h>
 
 namespace android {
@@ -26,6 +34,171 @@ namespace msgq {
 namespace V1_0 {
 namespace implementation {
 
+namespace {
+
+using android::hardware::EventFlag;
+using android::hardware::MessageQueue;
+
+constexpr uint32_t kMaxQueuePairs = 16;
+constexpr size_t kQueuePairQueueSize = 16 * 1024;
+constexpr int64_t kBlockingTimeoutNs = 5000000000;
+
+enum QueuePairEventFlagBits : uint32_t {
+    kNotEmpty = 1 << 0,
+    kNotFull = 1 << 1,
+};
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+void pinToCpu(uint32_t cpu) {
+    long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (numCpus <= 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % numCpus, &set);
+    // Failing to pin only makes the numbers noisier.
+    sched_setaffinity(0 /* calling thread */, sizeof(set), &set);
+}
+
+template <MQFlavor flavor>
+struct QueuePair {
+    std::unique_ptr<MessageQueue<uint8_t, flavor>> queue;
+    EventFlag* eventFlag = nullptr;
+    std::atomic<bool> writerDone{false};
+    bool failed = false;
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    std::vector<int64_t> latenciesNs;
+
+    ~QueuePair() {
+        if (eventFlag != nullptr) EventFlag::deleteEventFlag(&eventFlag);
+    }
+};
+
+template <MQFlavor flavor>
+void writePackets(QueuePair<flavor>* pair, uint32_t packetSize, uint32_t numIter,
+                  uint32_t flags, uint32_t cpu, const std::atomic<bool>* go) {
+    using Flags = IBenchmarkMsgQ::QueuePairFlags;
+    pinToCpu(cpu);
+    auto* mq = pair->queue.get();
+    bool blocking = flags & static_cast<uint32_t>(Flags::BLOCKING);
+    bool zeroCopy = flags & static_cast<uint32_t>(Flags::ZERO_COPY);
+    std::vector<uint8_t> packet(packetSize);
+    while (!go->load(std::memory_order_acquire)) std::this_thread::yield();
+
+    for (uint32_t i = 0; i < numIter; i++) {
+        if (!blocking) {
+            // Unsynchronized writes always succeed, so this is also what
+            // keeps the writer from lapping the reader.
+            while (mq->availableToWrite() < packetSize)
+                ;
+        }
+        int64_t sendTimeNs = nowNs();
+        if (zeroCopy) {
+            typename MessageQueue<uint8_t, flavor>::MemTransaction tx;
+            // Without BLOCKING, the spin above guarantees there is room.
+            while (!mq->beginWrite(packetSize, &tx)) {
+                uint32_t efState = 0;
+                if (pair->eventFlag->wait(kNotFull, &efState, kBlockingTimeoutNs,
+                                          true /* retry */) != OK) {
+                    pair->failed = true;
+                    break;
+                }
+            }
+            if (pair->failed) break;
+            const uint8_t* timestamp = reinterpret_cast<const uint8_t*>(&sendTimeNs);
+            for (size_t b = 0; b < sizeof(sendTimeNs); b++) {
+                *tx.getSlot(b) = timestamp[b];
+            }
+            mq->commitWrite(packetSize);
+            if (blocking) pair->eventFlag->wake(kNotEmpty);
+        } else {
+            memcpy(packet.data(), &sendTimeNs, sizeof(sendTimeNs));
+            bool ok = blocking ? mq->writeBlocking(packet.data(), packetSize, kNotFull, kNotEmpty,
+                                                   kBlockingTimeoutNs, pair->eventFlag)
+                               : mq->write(packet.data(), packetSize);
+            if (!ok) {
+                pair->failed = true;
+                break;
+            }
+        }
+        pair->sent++;
+    }
+    pair->writerDone.store(true, std::memory_order_release);
+}
+
+template <MQFlavor flavor>
+void readPackets(QueuePair<flavor>* pair, uint32_t packetSize, uint32_t numIter, uint32_t flags,
+                 uint32_t cpu, const std::atomic<bool>* go) {
+    using Flags = IBenchmarkMsgQ::QueuePairFlags;
+    pinToCpu(cpu);
+    auto* mq = pair->queue.get();
+    bool blocking = flags & static_cast<uint32_t>(Flags::BLOCKING);
+    bool zeroCopy = flags & static_cast<uint32_t>(Flags::ZERO_COPY);
+    std::vector<uint8_t> packet(packetSize);
+    pair->latenciesNs.reserve(numIter);
+    while (!go->load(std::memory_order_acquire)) std::this_thread::yield();
+
+    while (pair->received < numIter) {
+        if (!blocking) {
+            if (mq->availableToRead() < packetSize) {
+                // Only an unsynchronized writer can have lost packets on us,
+                // or a writer that gave up.
+                if (pair->writerDone.load(std::memory_order_acquire) &&
+                    mq->availableToRead() < packetSize) {
+                    break;
+                }
+                continue;
+            }
+        }
+        int64_t sendTimeNs = 0;
+        bool ok;
+        if (zeroCopy) {
+            typename MessageQueue<uint8_t, flavor>::MemTransaction tx;
+            ok = mq->beginRead(packetSize, &tx);
+            while (!ok && blocking) {
+                uint32_t efState = 0;
+                if (pair->eventFlag->wait(kNotEmpty, &efState, kBlockingTimeoutNs,
+                                          true /* retry */) != OK) {
+                    break;
+                }
+                ok = mq->beginRead(packetSize, &tx);
+            }
+            if (ok) {
+                uint8_t* timestamp = reinterpret_cast<uint8_t*>(&sendTimeNs);
+                for (size_t b = 0; b < sizeof(sendTimeNs); b++) {
+                    timestamp[b] = *tx.getSlot(b);
+                }
+                // Fails if an unsynchronized writer overwrote the slots meanwhile.
+                ok = mq->commitRead(packetSize);
+                if (blocking) pair->eventFlag->wake(kNotFull);
+            }
+        } else {
+            ok = blocking ? mq->readBlocking(packet.data(), packetSize, kNotFull, kNotEmpty,
+                                             kBlockingTimeoutNs, pair->eventFlag)
+                          : mq->read(packet.data(), packetSize);
+            if (ok) memcpy(&sendTimeNs, packet.data(), sizeof(sendTimeNs));
+        }
+        if (!ok) {
+            if (blocking) {
+                pair->failed = true;
+                break;
+            }
+            // An unsynchronized read that failed on overflow has resynced the
+            // read pointer, the packets in between are lost.
+            continue;
+        }
+        pair->latenciesNs.push_back(nowNs() - sendTimeNs);
+        pair->received++;
+    }
+}
+
+}  // namespace
+
 // Methods from ::android::hardware::tests::msgq::V1_0::IBenchmarkMsgQ follow.
 Return<void> BenchmarkMsgQ::configureClientInboxSyncReadWrite(
         configureClientInboxSyncReadWrite_cb _hidl_cb) {
@@ -111,6 +284,92 @@ Return<void> BenchmarkMsgQ::sendTimeData(const hidl_vec<int64_t>& clientRcvTimeA
     return Void();
 }
 
+Return<void> BenchmarkMsgQ::benchmarkQueuePairs(uint32_t numPairs, uint32_t packetSize,
+                                               uint32_t numIter,
+                                               hidl_bitfield<QueuePairFlags> flags,
+                                               benchmarkQueuePairs_cb _hidl_cb) {
+    QueuePairStats stats = {};
+    bool unsync = flags & static_cast<uint32_t>(QueuePairFlags::UNSYNCHRONIZED_WRITE);
+    bool blocking = flags & static_cast<uint32_t>(QueuePairFlags::BLOCKING);
+    if (numPairs == 0 || numPairs > kMaxQueuePairs || packetSize < sizeof(int64_t) ||
+        packetSize > kPacketSize1024 || numIter == 0 || (unsync && blocking)) {
+        _hidl_cb(false /* ret */, stats);
+        return Void();
+    }
+
+    bool ret = unsync ? RunQueuePairs<kUnsynchronizedWrite>(numPairs, packetSize, numIter, flags,
+                                                            &stats)
+                      : RunQueuePairs<kSynchronizedReadWrite>(numPairs, packetSize, numIter,
+                                                              flags, &stats);
+    if (ret) {
+        double seconds = stats.durationNs / 1e9;
+        std::cout << "Queue pairs::" << numPairs << " packet size::" << packetSize
+                  << " flags::" << flags << " messages/s::"
+                  << (seconds > 0 ? stats.messagesReceived / seconds : 0)
+                  << " latency p50/p90/p99/max::" << stats.latencyP50Ns << "/"
+                  << stats.latencyP90Ns << "/" << stats.latencyP99Ns << "/"
+                  << stats.latencyMaxNs << "ns lost::"
+                  << stats.messagesSent - stats.messagesReceived << std::endl;
+    }
+    _hidl_cb(ret, stats);
+    return Void();
+}
+
+template <MQFlavor flavor>
+bool BenchmarkMsgQ::RunQueuePairs(uint32_t numPairs, uint32_t packetSize, uint32_t numIter,
+                                  uint32_t flags, QueuePairStats* stats) {
+    bool blocking = flags & static_cast<uint32_t>(QueuePairFlags::BLOCKING);
+    std::vector<std::unique_ptr<QueuePair<flavor>>> pairs;
+    for (uint32_t i = 0; i < numPairs; i++) {
+        auto pair = std::make_unique<QueuePair<flavor>>();
+        pair->queue.reset(new (std::nothrow) MessageQueue<uint8_t, flavor>(
+                kQueuePairQueueSize, blocking /* configureEventFlagWord */));
+        if (pair->queue == nullptr || !pair->queue->isValid()) return false;
+        if (blocking &&
+            EventFlag::createEventFlag(pair->queue->getEventFlagWord(), &pair->eventFlag) != OK) {
+            return false;
+        }
+        pairs.push_back(std::move(pair));
+    }
+
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < numPairs; i++) {
+        threads.emplace_back(writePackets<flavor>, pairs[i].get(), packetSize, numIter, flags,
+                             2 * i, &go);
+        threads.emplace_back(readPackets<flavor>, pairs[i].get(), packetSize, numIter, flags,
+                             2 * i + 1, &go);
+    }
+    int64_t startNs = nowNs();
+    go.store(true, std::memory_order_release);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    stats->durationNs = nowNs() - startNs;
+
+    bool failed = false;
+    std::vector<int64_t> latenciesNs;
+    for (const auto& pair : pairs) {
+        failed |= pair->failed;
+        stats->messagesSent += pair->sent;
+        stats->messagesReceived += pair->received;
+        latenciesNs.insert(latenciesNs.end(), pair->latenciesNs.begin(),
+                           pair->latenciesNs.end());
+    }
+    if (!latenciesNs.empty()) {
+        std::sort(latenciesNs.begin(), latenciesNs.end());
+        auto percentile = [&latenciesNs](size_t percent) {
+            size_t rank = (latenciesNs.size() * percent + 99) / 100;
+            return static_cast<uint64_t>(latenciesNs[std::max<size_t>(rank, 1) - 1]);
+        };
+        stats->latencyP50Ns = percentile(50);
+        stats->latencyP90Ns = percentile(90);
+        stats->latencyP99Ns = percentile(99);
+        stats->latencyMaxNs = latenciesNs.back();
+    }
+    return !failed;
+}
+
 template <MQFlavor flavor>
 void BenchmarkMsgQ::QueueWriter(android::hardware::MessageQueue<uint8_t, flavor>* mFmqOutbox,
                                 int64_t* mTimeData,
@@ -41,6 +41,7 @@ using ::android::hardware::Void;
 using ::android::sp;
 
 using android::hardware::kSynchronizedReadWrite;
+using android::hardware::kUnsynchronizedWrite;
 using android::hardware::MQFlavor;
 
 struct BenchmarkMsgQ : public IBenchmarkMsgQ {
@@ -62,6 +63,9 @@ struct BenchmarkMsgQ : public IBenchmarkMsgQ {
     Return<void> benchmarkPingPong(uint32_t numIter) override;
     Return<void> benchmarkServiceWriteClientRead(uint32_t numIter) override;
     Return<void> sendTimeData(const hidl_vec<int64_t>& timeData) override;
+    Return<void> benchmarkQueuePairs(uint32_t numPairs, uint32_t packetSize, uint32_t numIter,
+                                     hidl_bitfield<QueuePairFlags> flags,
+                                     benchmarkQueuePairs_cb _hidl_cb) override;
 
      /*
      * This method writes numIter packets into the mFmqOutbox queue
@@ -82,6 +86,15 @@ struct BenchmarkMsgQ : public IBenchmarkMsgQ {
             android::hardware::MessageQueue<uint8_t, flavor>* mFmqOutbox,
             uint32_t numIter);
 
+    /*
+     * Runs the benchmarkQueuePairs() experiment on queues of the given flavor.
+     * Returns false if a queue could not be set up or a blocking operation
+     * timed out.
+     */
+    template <MQFlavor flavor>
+    static bool RunQueuePairs(uint32_t numPairs, uint32_t packetSize, uint32_t numIter,
+                              uint32_t flags, QueuePairStats* stats);
+
 private:
     android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqInbox;
     android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqOutbox;
@@ -17,7 +17,6 @@
 #define LOG_TAG "android.hardware.thermal@2.0-service-mock"
 
 #include <cmath>
-#include <set>
 
 #include <android-base/logging.h>
 #include <hidl/HidlTransportSupport.h>
@@ -35,8 +34,6 @@ using ::android::hardware::interfacesEqual;
 using ::android::hardware::thermal::V1_0::ThermalStatus;
 using ::android::hardware::thermal::V1_0::ThermalStatusCode;
 
-std::set<sp<IThermalChangedCallback>> gCallbacks;
-
 static const Temperature_1_0 kTemp_1_0 = {
         .type = static_cast<::android::hardware::thermal::V1_0::TemperatureType>(
                 TemperatureType::SKIN),
@@ -81,6 +78,25 @@ static const CpuUsage kCpuUsage = {
         .isOnline = true,
 };
 
+Thermal::Thermal()
+    : monitor_([this](const Temperature_2_0& temperature) {
+          sendThermalChangedCallback(temperature);
+      }) {}
+
+void Thermal::sendThermalChangedCallback(const Temperature_2_0& temperature) {
+    std::lock_guard<std::mutex> _lock(thermal_callback_mutex_);
+    for (const CallbackSetting& c : callbacks_) {
+        if (c.is_filter_type && c.type != temperature.type) {
+            continue;
+        }
+        Return<void> ret = c.callback->notifyThrottling(temperature);
+        if (!ret.isOk()) {
+            LOG(ERROR) << "Failed to notify throttling of " << temperature.name << ": "
+                       << ret.description();
+        }
+    }
+}
+
 // Methods from ::android::hardware::thermal::V1_0::IThermal follow.
 Return<void> Thermal::getTemperatures(getTemperatures_cb _hidl_cb) {
     ThermalStatus status;
@@ -112,11 +128,17 @@ Return<void> Thermal::getCurrentTemperatures(bool filterType, TemperatureType ty
     ThermalStatus status;
     status.code = ThermalStatusCode::SUCCESS;
     std::vector<Temperature_2_0> temperatures;
-    if (filterType && type != kTemp_2_0.type) {
+    if (!filterType || type == kTemp_2_0.type) {
+        temperatures = {kTemp_2_0};
+    }
+    for (auto& temperature : monitor_.getTemperatures()) {
+        if (!filterType || type == temperature.type) {
+            temperatures.push_back(std::move(temperature));
+        }
+    }
+    if (temperatures.empty()) {
         status.code = ThermalStatusCode::FAILURE;
         status.debugMessage = "Failed to read data";
-    } else {
-        temperatures = {kTemp_2_0};
     }
     _hidl_cb(status, temperatures);
     return Void();
@@ -127,11 +149,17 @@ Return<void> Thermal::getTemperatureThresholds(bool filterType, TemperatureType
     ThermalStatus status;
     status.code = ThermalStatusCode::SUCCESS;
     std::vector<TemperatureThreshold> temperature_thresholds;
-    if (filterType && type != kTempThreshold.type) {
+    if (!filterType || type == kTempThreshold.type) {
+        temperature_thresholds = {kTempThreshold};
+    }
+    for (auto& threshold : monitor_.getThresholds()) {
+        if (!filterType || type == threshold.type) {
+            temperature_thresholds.push_back(std::move(threshold));
+        }
+    }
+    if (temperature_thresholds.empty()) {
         status.code = ThermalStatusCode::FAILURE;
         status.debugMessage = "Failed to read data";
-    } else {
-        temperature_thresholds = {kTempThreshold};
     }
     _hidl_cb(status, temperature_thresholds);
     return Void();
@@ -21,6 +21,8 @@
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 
+#include "ThermalMonitor.h"
+
 namespace android {
 namespace hardware {
 namespace thermal {
@@ -55,6 +57,8 @@ struct CallbackSetting {
 
 class Thermal : public IThermal {
    public:
+    Thermal();
+
     // Methods from ::android::hardware::thermal::V1_0::IThermal follow.
     Return<void> getTemperatures(getTemperatures_cb _hidl_cb) override;
     Return<void> getCpuUsages(getCpuUsages_cb _hidl_cb) override;
@@ -75,8 +79,13 @@ class Thermal : public IThermal {
                                           getCurrentCoolingDevices_cb _hidl_cb) override;
 
    private:
+    // Notifies the registered callbacks whose filter matches of a severity change.
+    void sendThermalChangedCallback(const Temperature_2_0& temperature);
+
     std::mutex thermal_callback_mutex_;
     std::vector<CallbackSetting> callbacks_;
+    // Last, so that it stops calling back before the callbacks go away.
+    ThermalMonitor monitor_;
 };
 
 }  // namespace implementation
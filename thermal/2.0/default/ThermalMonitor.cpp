@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.thermal@2.0-service-mock"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <memory>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+#include <cutils/uevent.h>
+
+#include "ThermalMonitor.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+namespace {
+
+constexpr char kThermalSysfsRoot[] = "/sys/class/thermal";
+constexpr char kZonePrefix[] = "thermal_zone";
+constexpr size_t kUeventMsgLen = 2048;
+// Used when a trip point does not specify its own hysteresis.
+constexpr float kDefaultHysteresis = 1.0;
+
+constexpr size_t kNumSeverities = static_cast<size_t>(ThrottlingSeverity::SHUTDOWN) + 1;
+
+// Maps the kernel trip point types to the severity a zone reaches when crossing them.
+bool tripTypeToSeverity(const std::string& type, ThrottlingSeverity* severity) {
+    if (type == "active") {
+        *severity = ThrottlingSeverity::LIGHT;
+    } else if (type == "passive") {
+        *severity = ThrottlingSeverity::SEVERE;
+    } else if (type == "hot") {
+        *severity = ThrottlingSeverity::CRITICAL;
+    } else if (type == "critical") {
+        *severity = ThrottlingSeverity::SHUTDOWN;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool readMilliCelsius(const std::string& path, float* value) {
+    std::string content;
+    if (!::android::base::ReadFileToString(path, &content)) {
+        return false;
+    }
+    *value = std::strtol(content.c_str(), nullptr, 10) / 1000.0;
+    return true;
+}
+
+}  // namespace
+
+ThermalMonitor::ThermalMonitor(SeverityChangedCallback callback) : callback_(std::move(callback)) {
+    discoverZones();
+    if (zones_.empty()) {
+        LOG(INFO) << "No thermal zone with trip points to monitor";
+        return;
+    }
+    uevent_fd_.reset(uevent_open_socket(64 * 1024, true));
+    if (uevent_fd_.get() < 0) {
+        LOG(WARNING) << "Failed to open uevent socket, relying on polling only";
+    } else {
+        fcntl(uevent_fd_.get(), F_SETFL, O_NONBLOCK);
+    }
+    stop_fd_.reset(eventfd(0, EFD_CLOEXEC));
+    if (stop_fd_.get() < 0) {
+        PLOG(ERROR) << "Failed to create eventfd, not monitoring thermal zones";
+        return;
+    }
+    thread_ = std::thread(&ThermalMonitor::threadLoop, this);
+}
+
+ThermalMonitor::~ThermalMonitor() {
+    if (thread_.joinable()) {
+        uint64_t one = 1;
+        if (write(stop_fd_.get(), &one, sizeof(one)) != sizeof(one)) {
+            PLOG(ERROR) << "Failed to stop the thermal monitor";
+        }
+        thread_.join();
+    }
+}
+
+void ThermalMonitor::discoverZones() {
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(kThermalSysfsRoot), closedir);
+    if (!dir) {
+        return;
+    }
+    while (struct dirent* entry = readdir(dir.get())) {
+        if (!::android::base::StartsWith(entry->d_name, kZonePrefix)) {
+            continue;
+        }
+        std::string path = std::string(kThermalSysfsRoot) + "/" + entry->d_name;
+
+        Zone zone;
+        std::fill(std::begin(zone.hot_thresholds), std::end(zone.hot_thresholds), NAN);
+        zone.hysteresis = kDefaultHysteresis;
+        zone.value = NAN;
+        zone.severity = ThrottlingSeverity::NONE;
+        bool has_trip = false;
+        for (int trip = 0;; trip++) {
+            std::string trip_path = path + "/trip_point_" + std::to_string(trip);
+            std::string type;
+            float temp;
+            if (!::android::base::ReadFileToString(trip_path + "_type", &type) ||
+                !readMilliCelsius(trip_path + "_temp", &temp)) {
+                break;
+            }
+            ThrottlingSeverity severity;
+            if (!tripTypeToSeverity(::android::base::Trim(type), &severity)) {
+                continue;
+            }
+            float& threshold = zone.hot_thresholds[static_cast<size_t>(severity)];
+            // Of several trip points of one type, the lowest one throttles first.
+            if (std::isnan(threshold) || temp < threshold) {
+                threshold = temp;
+            }
+            float hysteresis;
+            if (readMilliCelsius(trip_path + "_hyst", &hysteresis) &&
+                hysteresis > zone.hysteresis) {
+                zone.hysteresis = hysteresis;
+            }
+            has_trip = true;
+        }
+        if (!has_trip) {
+            continue;
+        }
+
+        if (!::android::base::ReadFileToString(path + "/type", &zone.name)) {
+            continue;
+        }
+        zone.name = ::android::base::Trim(zone.name);
+        zone.temp_fd.reset(open((path + "/temp").c_str(), O_RDONLY | O_CLOEXEC));
+        if (zone.temp_fd.get() < 0) {
+            PLOG(WARNING) << "Failed to open " << path << "/temp";
+            continue;
+        }
+        LOG(INFO) << "Monitoring thermal zone " << zone.name;
+        zones_.push_back(std::move(zone));
+    }
+}
+
+std::chrono::milliseconds ThermalMonitor::pollZones() {
+    std::vector<Temperature_2_0> changed;
+    bool fast = false;
+    {
+        std::lock_guard<std::mutex> _lock(zones_mutex_);
+        for (Zone& zone : zones_) {
+            char buf[32];
+            ssize_t len = TEMP_FAILURE_RETRY(pread(zone.temp_fd.get(), buf, sizeof(buf) - 1, 0));
+            if (len <= 0) {
+                continue;
+            }
+            buf[len] = '\0';
+            zone.value = std::strtol(buf, nullptr, 10) / 1000.0;
+
+            // Go up to the highest severity reached, but only come down once the zone has
+            // cooled below the threshold by the hysteresis, so a zone hovering around a trip
+            // point does not flood the callbacks.
+            size_t severity = static_cast<size_t>(zone.severity);
+            while (severity + 1 < kNumSeverities) {
+                size_t next = severity + 1;
+                while (next < kNumSeverities && std::isnan(zone.hot_thresholds[next])) next++;
+                if (next == kNumSeverities || zone.value < zone.hot_thresholds[next]) break;
+                severity = next;
+            }
+            while (severity > 0 && (std::isnan(zone.hot_thresholds[severity]) ||
+                                    zone.value < zone.hot_thresholds[severity] - zone.hysteresis)) {
+                severity--;
+            }
+
+            if (static_cast<ThrottlingSeverity>(severity) != zone.severity) {
+                zone.severity = static_cast<ThrottlingSeverity>(severity);
+                changed.push_back({
+                        .type = TemperatureType::UNKNOWN,
+                        .name = zone.name,
+                        .value = zone.value,
+                        .throttlingStatus = zone.severity,
+                });
+            }
+
+            if (zone.severity != ThrottlingSeverity::NONE) {
+                fast = true;
+            }
+            for (size_t i = severity + 1; i < kNumSeverities; i++) {
+                if (!std::isnan(zone.hot_thresholds[i])) {
+                    fast |= zone.value >= zone.hot_thresholds[i] - kNearTripMargin;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (const auto& temperature : changed) {
+        LOG(INFO) << "Thermal zone " << temperature.name << " at " << temperature.value
+                  << " is now " << toString(temperature.throttlingStatus);
+        callback_(temperature);
+    }
+    return fast ? kFastPollInterval : kSlowPollInterval;
+}
+
+void ThermalMonitor::threadLoop() {
+    char msg[kUeventMsgLen + 2];
+    struct pollfd fds[2] = {
+            {.fd = stop_fd_.get(), .events = POLLIN},
+            {.fd = uevent_fd_.get(), .events = POLLIN},
+    };
+    nfds_t nfds = uevent_fd_.get() < 0 ? 1 : 2;
+
+    auto interval = pollZones();
+    auto next_poll = std::chrono::steady_clock::now() + interval;
+    while (true) {
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+                next_poll - std::chrono::steady_clock::now());
+        int ret = poll(fds, nfds, std::max<int64_t>(timeout.count(), 0));
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            PLOG(ERROR) << "Thermal monitor poll failed";
+            return;
+        }
+        if (fds[0].revents & POLLIN) {
+            return;
+        }
+
+        bool poll_now = std::chrono::steady_clock::now() >= next_poll;
+        if (nfds > 1 && (fds[1].revents & POLLIN)) {
+            // Drain the socket; any thermal uevent, such as a trip point crossing, calls for
+            // an immediate read.
+            ssize_t n;
+            while ((n = uevent_kernel_multicast_recv(uevent_fd_.get(), msg, kUeventMsgLen)) > 0) {
+                if (n >= static_cast<ssize_t>(kUeventMsgLen)) continue;
+                msg[n] = '\0';
+                msg[n + 1] = '\0';
+                for (const char* cp = msg; *cp; cp += strlen(cp) + 1) {
+                    if (!strcmp(cp, "SUBSYSTEM=thermal")) {
+                        poll_now = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (poll_now) {
+            interval = pollZones();
+            next_poll = std::chrono::steady_clock::now() + interval;
+        }
+    }
+}
+
+std::vector<Temperature_2_0> ThermalMonitor::getTemperatures() {
+    std::vector<Temperature_2_0> temperatures;
+    std::lock_guard<std::mutex> _lock(zones_mutex_);
+    for (const Zone& zone : zones_) {
+        if (std::isnan(zone.value)) {
+            continue;
+        }
+        temperatures.push_back({
+                .type = TemperatureType::UNKNOWN,
+                .name = zone.name,
+                .value = zone.value,
+                .throttlingStatus = zone.severity,
+        });
+    }
+    return temperatures;
+}
+
+std::vector<TemperatureThreshold> ThermalMonitor::getThresholds() {
+    std::vector<TemperatureThreshold> thresholds;
+    std::lock_guard<std::mutex> _lock(zones_mutex_);
+    for (const Zone& zone : zones_) {
+        TemperatureThreshold threshold = {
+                .type = TemperatureType::UNKNOWN,
+                .name = zone.name,
+                .vrThrottlingThreshold = NAN,
+        };
+        for (size_t i = 0; i < kNumSeverities; i++) {
+            threshold.hotThrottlingThresholds[i] = zone.hot_thresholds[i];
+            threshold.coldThrottlingThresholds[i] = NAN;
+        }
+        thresholds.push_back(threshold);
+    }
+    return thresholds;
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
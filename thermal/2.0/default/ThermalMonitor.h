@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_THERMAL_V2_0_THERMALMONITOR_H
+#define ANDROID_HARDWARE_THERMAL_V2_0_THERMALMONITOR_H
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+#include <android/hardware/thermal/2.0/IThermal.h>
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::base::unique_fd;
+using Temperature_2_0 = ::android::hardware::thermal::V2_0::Temperature;
+using ::android::hardware::thermal::V2_0::TemperatureThreshold;
+using ::android::hardware::thermal::V2_0::TemperatureType;
+using ::android::hardware::thermal::V2_0::ThrottlingSeverity;
+
+// Watches the kernel thermal zones that have trip points and reports every change of their
+// throttling severity.
+//
+// The zone temperatures are read through fds kept open for the monitor's lifetime. A trip point
+// uevent from the kernel triggers a read right away; in between, zones are polled every
+// kFastPollInterval while any of them is throttling or close to its next trip point, and every
+// kSlowPollInterval otherwise, so an idle device wakes up rarely.
+class ThermalMonitor {
+   public:
+    using SeverityChangedCallback = std::function<void(const Temperature_2_0&)>;
+
+    static constexpr std::chrono::milliseconds kFastPollInterval{1000};
+    static constexpr std::chrono::milliseconds kSlowPollInterval{10000};
+    // A zone this close to the next trip point, in Celsius, is polled fast.
+    static constexpr float kNearTripMargin = 5.0;
+
+    explicit ThermalMonitor(SeverityChangedCallback callback);
+    ~ThermalMonitor();
+
+    // The latest reading and the trip points of every monitored zone.
+    std::vector<Temperature_2_0> getTemperatures();
+    std::vector<TemperatureThreshold> getThresholds();
+
+   private:
+    struct Zone {
+        std::string name;
+        unique_fd temp_fd;
+        // Indexed by ThrottlingSeverity, NAN where the zone has no trip point.
+        float hot_thresholds[static_cast<size_t>(ThrottlingSeverity::SHUTDOWN) + 1];
+        float hysteresis;
+        float value;
+        ThrottlingSeverity severity;
+    };
+
+    void discoverZones();
+    // Reads every zone, reports severity changes and returns how long to wait for the next read.
+    std::chrono::milliseconds pollZones();
+    void threadLoop();
+
+    const SeverityChangedCallback callback_;
+
+    // Guards the value and severity of the zones, which binder threads read.
+    std::mutex zones_mutex_;
+    std::vector<Zone> zones_;
+
+    unique_fd uevent_fd_;
+    unique_fd stop_fd_;
+    std::thread thread_;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_THERMAL_V2_0_THERMALMONITOR_H
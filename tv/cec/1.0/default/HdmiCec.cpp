@@ -264,7 +264,102 @@ static_assert(HDMI_OPTION_SYSTEM_CEC_CONTROL == static_cast<int>(OptionKey::SYST
 
 sp<IHdmiCecCallback> HdmiCec::mCallback = nullptr;
 
-HdmiCec::HdmiCec(hdmi_cec_device_t* device) : mDevice(device) {}
+HdmiCec::HdmiCec(hdmi_cec_device_t* device)
+    : mDevice(device), mRxThread(&HdmiCec::rxThreadLoop, this) {}
+
+HdmiCec::~HdmiCec() {
+    {
+        std::lock_guard<std::mutex> lock(mRxLock);
+        mRxExit = true;
+    }
+    mRxCondition.notify_one();
+    mRxThread.join();
+}
+
+void HdmiCec::eventCallback(const hdmi_event_t* event, void* arg) {
+    HdmiCec* hdmiCec = static_cast<HdmiCec*>(arg);
+    if (hdmiCec == nullptr || event == nullptr) {
+        return;
+    }
+    RxEvent rxEvent = {};
+    if (event->type == HDMI_EVENT_CEC_MESSAGE) {
+        size_t length = std::min(event->cec.length,
+                static_cast<size_t>(MaxLength::MESSAGE_BODY));
+        rxEvent.isHotplug = false;
+        rxEvent.message.initiator = static_cast<CecLogicalAddress>(event->cec.initiator);
+        rxEvent.message.destination = static_cast<CecLogicalAddress>(event->cec.destination);
+        rxEvent.message.body.resize(length);
+        for (size_t i = 0; i < length; ++i) {
+            rxEvent.message.body[i] = static_cast<uint8_t>(event->cec.body[i]);
+        }
+    } else if (event->type == HDMI_EVENT_HOT_PLUG) {
+        rxEvent.isHotplug = true;
+        rxEvent.hotplug = {
+            .connected = event->hotplug.connected > 0,
+            .portId = static_cast<uint32_t>(event->hotplug.port_id)
+        };
+    } else {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(hdmiCec->mRxLock);
+        hdmiCec->mRxPending.push_back(std::move(rxEvent));
+    }
+    hdmiCec->mRxCondition.notify_one();
+}
+
+void HdmiCec::rxThreadLoop() {
+    std::vector<RxEvent> events;
+    std::unique_lock<std::mutex> lock(mRxLock);
+    while (true) {
+        mRxCondition.wait(lock, [this] { return mRxExit || !mRxPending.empty(); });
+        if (mRxExit) {
+            break;
+        }
+        // Deliver everything that arrived meanwhile in one pass; a burst of frames, as during
+        // one touch play, then costs one wakeup instead of one per frame.
+        events.swap(mRxPending);
+        sp<IHdmiCecCallback> callback = mCallback;
+        lock.unlock();
+        if (callback != nullptr) {
+            for (const RxEvent& event : events) {
+                if (event.isHotplug) {
+                    callback->onHotplugEvent(event.hotplug);
+                } else {
+                    callback->onCecMessage(event.message);
+                }
+            }
+        }
+        events.clear();
+        lock.lock();
+    }
+}
+
+HdmiCec::TxPriority HdmiCec::getTxPriority(const CecMessage& message) {
+    if (message.body.size() == 0) {
+        return TxPriority::POLLING;
+    }
+    if (message.body[0] == static_cast<uint8_t>(CecMessageType::USER_CONTROL_PRESSED) ||
+            message.body[0] == static_cast<uint8_t>(CecMessageType::USER_CONTROL_RELEASED)) {
+        return TxPriority::USER_CONTROL;
+    }
+    if (message.destination == CecLogicalAddress::BROADCAST) {
+        return TxPriority::BROADCAST;
+    }
+    return TxPriority::DIRECTED;
+}
+
+SendMessageResult HdmiCec::transmit(const CecMessage& message) {
+    cec_message_t legacyMessage {
+        .initiator = static_cast<cec_logical_address_t>(message.initiator),
+        .destination = static_cast<cec_logical_address_t>(message.destination),
+        .length = message.body.size(),
+    };
+    for (size_t i = 0; i < message.body.size(); ++i) {
+        legacyMessage.body[i] = static_cast<unsigned char>(message.body[i]);
+    }
+    return static_cast<SendMessageResult>(mDevice->send_message(mDevice, &legacyMessage));
+}
 
 // Methods from ::android::hardware::tv::cec::V1_0::IHdmiCec follow.
 Return<Result> HdmiCec::addLogicalAddress(CecLogicalAddress addr) {
@@ -306,27 +401,42 @@ Return<void> HdmiCec::getPhysicalAddress(getPhysicalAddress_cb _hidl_cb) {
 }
 
 Return<SendMessageResult> HdmiCec::sendMessage(const CecMessage& message) {
-    cec_message_t legacyMessage {
-        .initiator = static_cast<cec_logical_address_t>(message.initiator),
-        .destination = static_cast<cec_logical_address_t>(message.destination),
-        .length = message.body.size(),
-    };
-    for (size_t i = 0; i < message.body.size(); ++i) {
-        legacyMessage.body[i] = static_cast<unsigned char>(message.body[i]);
-    }
-    return static_cast<SendMessageResult>(mDevice->send_message(mDevice, &legacyMessage));
+    std::unique_lock<std::mutex> lock(mTxLock);
+
+    TxRequest request = {.priority = getTxPriority(message)};
+    auto position = std::find_if(mTxQueue.begin(), mTxQueue.end(), [&request](TxRequest* queued) {
+        return queued->priority > request.priority;
+    });
+    mTxQueue.insert(position, &request);
+    mTxCondition.wait(lock, [this, &request] {
+        return !mTxBusy && mTxQueue.front() == &request;
+    });
+    mTxQueue.pop_front();
+    mTxBusy = true;
+    lock.unlock();
+
+    SendMessageResult result = transmit(message);
+
+    lock.lock();
+    mTxBusy = false;
+    mTxCondition.notify_all();
+    return result;
 }
 
 Return<void> HdmiCec::setCallback(const sp<IHdmiCecCallback>& callback) {
-    if (mCallback != nullptr) {
-        mCallback->unlinkToDeath(this);
-        mCallback = nullptr;
+    sp<IHdmiCecCallback> oldCallback;
+    {
+        std::lock_guard<std::mutex> lock(mRxLock);
+        oldCallback = mCallback;
+        mCallback = callback;
+    }
+    if (oldCallback != nullptr) {
+        oldCallback->unlinkToDeath(this);
     }
 
     if (callback != nullptr) {
-        mCallback = callback;
-        mCallback->linkToDeath(this, 0 /*cookie*/);
-        mDevice->register_event_callback(mDevice, eventCallback, nullptr);
+        callback->linkToDeath(this, 0 /*cookie*/);
+        mDevice->register_event_callback(mDevice, eventCallback, this);
     }
     return Void();
 }
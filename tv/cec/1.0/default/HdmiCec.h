@@ -18,6 +18,11 @@
 #define ANDROID_HARDWARE_TV_CEC_V1_0_HDMICEC_H
 
 #include <algorithm>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <android/hardware/tv/cec/1.0/IHdmiCec.h>
 #include <hidl/Status.h>
@@ -49,6 +54,7 @@ using ::android::sp;
 
 struct HdmiCec : public IHdmiCec, public hidl_death_recipient {
     HdmiCec(hdmi_cec_device_t* device);
+    ~HdmiCec();
     // Methods from ::android::hardware::tv::cec::V1_0::IHdmiCec follow.
     Return<Result> addLogicalAddress(CecLogicalAddress addr)  override;
     Return<void> clearLogicalAddress()  override;
@@ -63,29 +69,7 @@ struct HdmiCec : public IHdmiCec, public hidl_death_recipient {
     Return<void> enableAudioReturnChannel(int32_t portId, bool enable)  override;
     Return<bool> isConnected(int32_t portId)  override;
 
-    static void eventCallback(const hdmi_event_t* event, void* /* arg */) {
-        if (mCallback != nullptr && event != nullptr) {
-            if (event->type == HDMI_EVENT_CEC_MESSAGE) {
-                size_t length = std::min(event->cec.length,
-                        static_cast<size_t>(MaxLength::MESSAGE_BODY));
-                CecMessage cecMessage {
-                    .initiator = static_cast<CecLogicalAddress>(event->cec.initiator),
-                    .destination = static_cast<CecLogicalAddress>(event->cec.destination),
-                };
-                cecMessage.body.resize(length);
-                for (size_t i = 0; i < length; ++i) {
-                    cecMessage.body[i] = static_cast<uint8_t>(event->cec.body[i]);
-                }
-                mCallback->onCecMessage(cecMessage);
-            } else if (event->type == HDMI_EVENT_HOT_PLUG) {
-                HotplugEvent hotplugEvent {
-                    .connected = event->hotplug.connected > 0,
-                    .portId = static_cast<uint32_t>(event->hotplug.port_id)
-                };
-                mCallback->onHotplugEvent(hotplugEvent);
-            }
-        }
-    }
+    static void eventCallback(const hdmi_event_t* event, void* arg);
 
     virtual void serviceDied(uint64_t /*cookie*/,
                              const wp<::android::hidl::base::V1_0::IBase>& /*who*/) {
@@ -93,8 +77,47 @@ struct HdmiCec : public IHdmiCec, public hidl_death_recipient {
     }
 
    private:
+    // Transmission order when several senders wait for the bus, most urgent first. Messages of
+    // the same class go out in the order they were sent.
+    enum class TxPriority {
+        USER_CONTROL,
+        POLLING,
+        DIRECTED,
+        BROADCAST,
+    };
+
+    struct TxRequest {
+        TxPriority priority;
+    };
+
+    // A frame received from the legacy HAL, waiting to be delivered to the callback.
+    struct RxEvent {
+        bool isHotplug;
+        CecMessage message;
+        HotplugEvent hotplug;
+    };
+
+    static TxPriority getTxPriority(const CecMessage& message);
+    SendMessageResult transmit(const CecMessage& message);
+    void rxThreadLoop();
+
     static sp<IHdmiCecCallback> mCallback;
     const hdmi_cec_device_t* mDevice;
+
+    // Senders take turns on the bus in TxPriority order; whoever is at the head of mTxQueue
+    // while no transmission is in progress transmits.
+    std::mutex mTxLock;
+    std::condition_variable mTxCondition;
+    std::list<TxRequest*> mTxQueue;
+    bool mTxBusy = false;
+
+    // Received frames are handed off by the legacy HAL thread and delivered to the callback in
+    // batches from mRxThread, so a slow binder transaction does not stall reception.
+    std::mutex mRxLock;
+    std::condition_variable mRxCondition;
+    std::vector<RxEvent> mRxPending;
+    bool mRxExit = false;
+    std::thread mRxThread;
 };
 
 extern "C" IHdmiCec* HIDL_FETCH_IHdmiCec(const char* name);
@@ -16,6 +16,7 @@
 
 #define LOG_TAG "android.hardware.tv.input@1.0-service"
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 
 #include "TvInput.h"
 
@@ -59,7 +60,10 @@ static_assert(TV_INPUT_EVENT_STREAM_CONFIGURATIONS_CHANGED == static_cast<int>(
 
 sp<ITvInputCallback> TvInput::mCallback = nullptr;
 
-TvInput::TvInput(tv_input_device_t* device) : mDevice(device) {
+TvInput::TvInput(tv_input_device_t* device)
+    : mDevice(device),
+      mMaxWarmStreams(android::base::GetUintProperty<size_t>("ro.vendor.tv.input.warm_streams",
+                                                             0)) {
     mCallbackOps.notify = &TvInput::notify;
 }
 
@@ -73,12 +77,20 @@ TvInput::~TvInput() {
 Return<void> TvInput::setCallback(const sp<ITvInputCallback>& callback)  {
     mCallback = callback;
     if (mCallback != nullptr) {
-        mDevice->initialize(mDevice, &mCallbackOps, nullptr);
+        mDevice->initialize(mDevice, &mCallbackOps, this);
     }
     return Void();
 }
 
 Return<void> TvInput::getStreamConfigurations(int32_t deviceId, getStreamConfigurations_cb cb)  {
+    std::lock_guard<std::mutex> lock(mLock);
+    dropStaleDevicesLocked();
+    auto cached = mStreamConfigs.find(deviceId);
+    if (cached != mStreamConfigs.end()) {
+        cb(Result::OK, cached->second);
+        return Void();
+    }
+
     int32_t configCount = 0;
     const tv_stream_config_t* configs = nullptr;
     int ret = mDevice->get_stream_configurations(mDevice, deviceId, &configCount, &configs);
@@ -96,6 +108,8 @@ Return<void> TvInput::getStreamConfigurations(int32_t deviceId, getStreamConfigu
                 ++pos;
             }
         }
+        // Kept until the device reports its configurations changed
+        mStreamConfigs[deviceId] = tvStreamConfigs;
     } else if (ret == -EINVAL) {
         res = Result::INVALID_ARGUMENTS;
     }
@@ -104,15 +118,34 @@ Return<void> TvInput::getStreamConfigurations(int32_t deviceId, getStreamConfigu
 }
 
 Return<void> TvInput::openStream(int32_t deviceId, int32_t streamId, openStream_cb cb)  {
+    std::lock_guard<std::mutex> lock(mLock);
+    dropStaleDevicesLocked();
+    const StreamKey key(deviceId, streamId);
+    for (auto it = mWarmStreams.begin(); it != mWarmStreams.end(); ++it) {
+        if (it->first == key) {
+            native_handle_t* sidebandStream = it->second;
+            mOpenStreams[key] = sidebandStream;
+            mWarmStreams.erase(it);
+            cb(Result::OK, sidebandStream);
+            return Void();
+        }
+    }
+
     tv_stream_t stream;
     stream.stream_id = streamId;
     int ret = mDevice->open_stream(mDevice, deviceId, &stream);
+    if (ret == -EBUSY && !mWarmStreams.empty()) {
+        // The hardware may be held by streams kept warm; give them up
+        closeWarmStreamsLocked(0, true /* allDevices */);
+        ret = mDevice->open_stream(mDevice, deviceId, &stream);
+    }
     Result res = Result::UNKNOWN;
     native_handle_t* sidebandStream = nullptr;
     if (ret == 0) {
         if (isSupportedStreamType(stream.type)) {
             res = Result::OK;
             sidebandStream = stream.sideband_stream_source_handle;
+            mOpenStreams[key] = sidebandStream;
         }
     } else {
         if (ret == -EBUSY) {
@@ -128,7 +161,24 @@ Return<void> TvInput::openStream(int32_t deviceId, int32_t streamId, openStream_
 }
 
 Return<Result> TvInput::closeStream(int32_t deviceId, int32_t streamId)  {
-    int ret = mDevice->close_stream(mDevice, deviceId, streamId);
+    std::lock_guard<std::mutex> lock(mLock);
+    dropStaleDevicesLocked();
+    const StreamKey key(deviceId, streamId);
+    auto open = mOpenStreams.find(key);
+    if (open != mOpenStreams.end() && mMaxWarmStreams > 0) {
+        mWarmStreams.emplace_front(key, open->second);
+        mOpenStreams.erase(open);
+        if (mWarmStreams.size() > mMaxWarmStreams) {
+            closeLegacyStream(mWarmStreams.back().first);
+            mWarmStreams.pop_back();
+        }
+        return Result::OK;
+    }
+    if (open != mOpenStreams.end()) {
+        mOpenStreams.erase(open);
+    }
+
+    int ret = closeLegacyStream(key);
     Result res = Result::UNKNOWN;
     if (ret == 0) {
         res = Result::OK;
@@ -140,9 +190,46 @@ Return<Result> TvInput::closeStream(int32_t deviceId, int32_t streamId)  {
     return res;
 }
 
+void TvInput::markDeviceStale(int32_t deviceId) {
+    std::lock_guard<std::mutex> lock(mStaleLock);
+    mStaleDevices.insert(deviceId);
+}
+
+void TvInput::dropStaleDevicesLocked() {
+    std::set<int32_t> staleDevices;
+    {
+        std::lock_guard<std::mutex> lock(mStaleLock);
+        staleDevices.swap(mStaleDevices);
+    }
+    for (int32_t deviceId : staleDevices) {
+        mStreamConfigs.erase(deviceId);
+        closeWarmStreamsLocked(deviceId, false /* allDevices */);
+    }
+}
+
+void TvInput::closeWarmStreamsLocked(int32_t deviceId, bool allDevices) {
+    for (auto it = mWarmStreams.begin(); it != mWarmStreams.end();) {
+        if (allDevices || it->first.first == deviceId) {
+            closeLegacyStream(it->first);
+            it = mWarmStreams.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+int TvInput::closeLegacyStream(const StreamKey& key) {
+    return mDevice->close_stream(mDevice, key.first, key.second);
+}
+
 // static
 void TvInput::notify(struct tv_input_device* __unused, tv_input_event_t* event,
-        void* __unused) {
+        void* data) {
+    if (data != nullptr && event != nullptr &&
+            event->type < TV_INPUT_EVENT_CAPTURE_SUCCEEDED) {
+        // Stream ids and configurations may change along with the device
+        static_cast<TvInput*>(data)->markDeviceStale(event->device_info.device_id);
+    }
     if (mCallback != nullptr && event != nullptr) {
         // Capturing is no longer supported.
         if (event->type >= TV_INPUT_EVENT_CAPTURE_SUCCEEDED) {
@@ -22,6 +22,12 @@
 
 #include <hidl/MQDescriptor.h>
 
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+
 namespace android {
 namespace hardware {
 namespace tv {
@@ -52,15 +58,36 @@ struct TvInput : public ITvInput {
     Return<Result> closeStream(int32_t deviceId, int32_t streamId)  override;
 
     static void notify(struct tv_input_device* __unused, tv_input_event_t* event,
-            void* __unused);
+            void* data);
     static uint32_t getSupportedConfigCount(uint32_t configCount,
             const tv_stream_config_t* configs);
     static bool isSupportedStreamType(int type);
 
     private:
+    using StreamKey = std::pair<int32_t, int32_t>;  // (deviceId, streamId)
+
+    // Called from notify, possibly from within a call into the legacy device, so it only
+    // records the device; the cached state is dropped by the next call.
+    void markDeviceStale(int32_t deviceId);
+    void dropStaleDevicesLocked();
+    void closeWarmStreamsLocked(int32_t deviceId, bool allDevices);
+    int closeLegacyStream(const StreamKey& key);
+
     static sp<ITvInputCallback> mCallback;
     tv_input_callback_ops_t mCallbackOps;
     tv_input_device_t* mDevice;
+
+    // Guards the state below, and is held across calls into the legacy device
+    std::mutex mLock;
+    std::map<int32_t, hidl_vec<TvStreamConfig>> mStreamConfigs;
+    std::map<StreamKey, native_handle_t*> mOpenStreams;
+    // Streams closed by the client but kept open in the legacy device, most recent first, so
+    // that switching back to an input reuses its sideband handle.
+    const size_t mMaxWarmStreams;
+    std::list<std::pair<StreamKey, native_handle_t*>> mWarmStreams;
+
+    std::mutex mStaleLock;
+    std::set<int32_t> mStaleDevices;
 };
 
 extern "C" ITvInput* HIDL_FETCH_ITvInput(const char* name);
@@ -17,7 +17,16 @@
 #define LOG_TAG "android.hardware.tv.tuner@1.0-Demux"
 
 #include "Demux.h"
+#include "Descrambler.h"
+#include <cutils/ashmem.h>
+#include <cutils/native_handle.h>
+#include <cutils/properties.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <utils/Log.h>
+#include <algorithm>
+#include <chrono>
 
 namespace android {
 namespace hardware {
@@ -28,6 +37,38 @@ namespace implementation {
 
 #define WAIT_TIMEOUT 3000000000
 
+// Frontend stream blocks queued at most for the broadcast input. A demux
+// falling further behind its frontend drops the oldest blocks.
+#define MAX_BROADCAST_BLOCKS 64
+
+// Longest section allowed by ISO/IEC 13818-1, for private sections
+#define MAX_SECTION_SIZE 4096
+
+// Recorded packets are written to the output in blocks of this many packets,
+// 188 KiB, a multiple of the 4 KiB flash page
+#define RECORD_BLOCK_PACKETS 1024
+
+// CRC-32 of ISO/IEC 13818-1 Annex A: polynomial 0x04C11DB7, MSB first, no final xor
+static uint32_t crc32Mpeg2(const uint8_t* data, size_t size) {
+    static const auto table = [] {
+        array<uint32_t, 256> t;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i << 24;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+            }
+            t[i] = crc;
+        }
+        return t;
+    }();
+
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++) {
+        crc = (crc << 8) ^ table[(crc >> 24) ^ data[i]];
+    }
+    return crc;
+}
+
 const std::vector<uint8_t> fakeDataInputBuffer{
         0x00, 0x00, 0x00, 0x01, 0x09, 0xf0, 0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xc0, 0x1e, 0xdb,
         0x01, 0x40, 0x16, 0xec, 0x04, 0x40, 0x00, 0x00, 0x03, 0x00, 0x40, 0x00, 0x00, 0x0f, 0x03,
@@ -70,6 +111,7 @@ const std::vector<uint8_t> fakeDataInputBuffer{
 Demux::Demux(uint32_t demuxId, sp<Tuner> tuner) {
     mDemuxId = demuxId;
     mTunerService = tuner;
+    mAvMemorySize = property_get_int64("ro.vendor.tuner.av_memory_size", 0);
 }
 
 Demux::~Demux() {}
@@ -81,16 +123,21 @@ Return<Result> Demux::setFrontendDataSource(uint32_t frontendId) {
         return Result::NOT_INITIALIZED;
     }
 
-    mFrontend = mTunerService->getFrontendById(frontendId);
+    sp<Frontend> frontend = mTunerService->getFrontendById(frontendId);
 
-    if (mFrontend == nullptr) {
+    if (frontend == nullptr) {
         return Result::INVALID_STATE;
     }
 
-    mFrontendSourceFile = mFrontend->getSourceFile();
+    // Leave the previous frontend
+    stopBroadcastInput();
+    mFrontend = frontend;
 
-    mTunerService->setFrontendAsDemuxSource(frontendId, mDemuxId);
-    return startBroadcastInputLoop();
+    Result result = startBroadcastInputLoop();
+    if (result == Result::SUCCESS) {
+        mFrontend->attachDemux(mDemuxId, this);
+    }
+    return result;
 }
 
 Return<void> Demux::addFilter(DemuxFilterType type, uint32_t bufferSize,
@@ -115,6 +162,11 @@ Return<void> Demux::addFilter(DemuxFilterType type, uint32_t bufferSize,
         mFilterPids.resize(filterId + 1);
         mFilterOutputs.resize(filterId + 1);
         mFilterStatus.resize(filterId + 1);
+        mPesStates.resize(filterId + 1);
+        mSectionStates.resize(filterId + 1);
+        mRecordStates.resize(filterId + 1);
+        mMediaStates.resize(filterId + 1);
+        mAvMemories.resize(filterId + 1);
     }
 
     mUsedFilterIds.insert(filterId);
@@ -140,6 +192,14 @@ Return<void> Demux::addFilter(DemuxFilterType type, uint32_t bufferSize,
         return Void();
     }
 
+    // A reused filter ID may still hold the AV memory of its previous filter
+    releaseAvMemory(filterId);
+    if ((type == DemuxFilterType::AUDIO || type == DemuxFilterType::VIDEO) && mAvMemorySize > 0 &&
+        !createAvMemory(filterId)) {
+        _hidl_cb(Result::UNKNOWN_ERROR, -1);
+        return Void();
+    }
+
     _hidl_cb(Result::SUCCESS, filterId);
     return Void();
 }
@@ -160,31 +220,49 @@ Return<void> Demux::getFilterQueueDesc(uint32_t filterId, getFilterQueueDesc_cb
 Return<Result> Demux::configureFilter(uint32_t filterId, const DemuxFilterSettings& settings) {
     ALOGV("%s", __FUNCTION__);
 
+    uint16_t pid;
     switch (mFilterEvents[filterId].filterType) {
         case DemuxFilterType::SECTION:
-            mFilterPids[filterId] = settings.section().tpid;
+            pid = settings.section().tpid;
             break;
         case DemuxFilterType::PES:
-            mFilterPids[filterId] = settings.pesData().tpid;
+            pid = settings.pesData().tpid;
             break;
         case DemuxFilterType::TS:
-            mFilterPids[filterId] = settings.ts().tpid;
+            pid = settings.ts().tpid;
             break;
         case DemuxFilterType::AUDIO:
-            mFilterPids[filterId] = settings.audio().tpid;
+            pid = settings.audio().tpid;
             break;
         case DemuxFilterType::VIDEO:
-            mFilterPids[filterId] = settings.video().tpid;
+            pid = settings.video().tpid;
             break;
         case DemuxFilterType::RECORD:
-            mFilterPids[filterId] = settings.record().tpid;
+            pid = settings.record().tpid;
             break;
         case DemuxFilterType::PCR:
-            mFilterPids[filterId] = settings.pcr().tpid;
+            pid = settings.pcr().tpid;
             break;
         default:
             return Result::UNKNOWN_ERROR;
     }
+
+    // Move the filter to the list of its new PID
+    removeFilterFromPidTable(filterId);
+    mFilterPids[filterId] = pid;
+    addFilterToPidTable(filterId);
+    {
+        std::lock_guard<std::mutex> lock(mFilterEventLock);
+        mPesStates[filterId] = PesState();
+        mSectionStates[filterId] = SectionState();
+        mRecordStates[filterId] = RecordState();
+        mMediaStates[filterId] = MediaState();
+        if (mFilterEvents[filterId].filterType == DemuxFilterType::SECTION) {
+            mSectionStates[filterId].settings = settings.section();
+        } else if (mFilterEvents[filterId].filterType == DemuxFilterType::RECORD) {
+            mRecordStates[filterId].settings = settings.record();
+        }
+    }
     return Result::SUCCESS;
 }
 
@@ -197,6 +275,7 @@ Return<Result> Demux::startFilter(uint32_t filterId) {
         return Result::INVALID_ARGUMENT;
     }
 
+    addFilterToPidTable(filterId);
     result = startFilterLoop(filterId);
 
     return result;
@@ -205,7 +284,12 @@ Return<Result> Demux::startFilter(uint32_t filterId) {
 Return<Result> Demux::stopFilter(uint32_t filterId) {
     ALOGV("%s", __FUNCTION__);
 
-    mFilterThreadRunning[filterId] = false;
+    {
+        std::lock_guard<std::mutex> lock(mFilterEventLock);
+        mFilterThreadRunning[filterId] = false;
+    }
+    mFilterEventCond.notify_all();
+    removeFilterFromPidTable(filterId);
 
     std::lock_guard<std::mutex> lock(mFilterThreadLock);
 
@@ -229,6 +313,11 @@ Return<Result> Demux::removeFilter(uint32_t filterId) {
     ALOGV("%s", __FUNCTION__);
 
     // resetFilterRecords(filterId);
+    removeFilterFromPidTable(filterId);
+    {
+        std::lock_guard<std::mutex> lock(mOutputLock);
+        mOutputFilterIds.erase(filterId);
+    }
     mUsedFilterIds.erase(filterId);
     mUnusedFilterIds.insert(filterId);
 
@@ -256,6 +345,19 @@ Return<void> Demux::getAvSyncTime(AvSyncHwId /* avSyncHwId */, getAvSyncTime_cb
 Return<Result> Demux::close() {
     ALOGV("%s", __FUNCTION__);
 
+    // Leave the frontend before the filters go away
+    stopBroadcastInput();
+
+    // Stop the filter threads, and wait for them to end, before their state goes away
+    {
+        std::lock_guard<std::mutex> lock(mFilterEventLock);
+        std::fill(mFilterThreadRunning.begin(), mFilterThreadRunning.end(), false);
+    }
+    mFilterEventCond.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(mFilterThreadLock);
+    }
+
     set<uint32_t>::iterator it;
     mInputThread = 0;
     mOutputThread = 0;
@@ -268,6 +370,24 @@ Return<Result> Demux::close() {
     mFilterEventFlags.clear();
     mFilterOutputs.clear();
     mFilterPids.clear();
+    mPesStates.clear();
+    mSectionStates.clear();
+    mRecordStates.clear();
+    mMediaStates.clear();
+    for (uint32_t filterId = 0; filterId < mAvMemories.size(); filterId++) {
+        releaseAvMemory(filterId);
+    }
+    mAvMemories.clear();
+    {
+        std::lock_guard<std::mutex> lock(mOutputLock);
+        mOutputFilterIds.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mPidTableLock);
+        for (auto& filterIds : mPidFilterIds) {
+            filterIds.clear();
+        }
+    }
     mLastUsedFilterId = -1;
 
     return Result::SUCCESS;
@@ -315,39 +435,97 @@ Return<Result> Demux::configureOutput(const DemuxOutputSettings& settings) {
     return Result::SUCCESS;
 }
 
-Return<Result> Demux::attachOutputFilter(uint32_t /*filterId*/) {
+Return<Result> Demux::attachOutputFilter(uint32_t filterId) {
     ALOGV("%s", __FUNCTION__);
 
+    if (mUsedFilterIds.find(filterId) == mUsedFilterIds.end()) {
+        ALOGW("[Demux] attaching unknown filter %d to the output", filterId);
+        return Result::INVALID_ARGUMENT;
+    }
+    if (mFilterEvents[filterId].filterType != DemuxFilterType::RECORD) {
+        ALOGW("[Demux] only record filters can be attached to the output");
+        return Result::INVALID_STATE;
+    }
+
+    std::lock_guard<std::mutex> lock(mOutputLock);
+    mOutputFilterIds.insert(filterId);
     return Result::SUCCESS;
 }
 
-Return<Result> Demux::detachOutputFilter(uint32_t /* filterId */) {
+Return<Result> Demux::detachOutputFilter(uint32_t filterId) {
     ALOGV("%s", __FUNCTION__);
 
+    std::lock_guard<std::mutex> lock(mOutputLock);
+    if (mOutputFilterIds.erase(filterId) == 0) {
+        return Result::INVALID_ARGUMENT;
+    }
     return Result::SUCCESS;
 }
 
 Return<Result> Demux::startOutput() {
     ALOGV("%s", __FUNCTION__);
 
+    if (!mOutputMQ) {
+        return Result::NOT_INITIALIZED;
+    }
+    if (!mOutputConfigured) {
+        return Result::INVALID_STATE;
+    }
+
+    std::lock_guard<std::mutex> lock(mOutputLock);
+    // A block must fit in the output FMQ to be written at once
+    size_t blockPackets =
+            std::min<size_t>(RECORD_BLOCK_PACKETS, mOutputMQ->getQuantumCount() / 188);
+    if (blockPackets == 0) {
+        ALOGW("[Demux] output FMQ is smaller than a packet");
+        return Result::INVALID_STATE;
+    }
+    mRecordBlockSize = blockPackets * 188;
+    mRecordBlock.clear();
+    mRecordBlock.reserve(mRecordBlockSize);
+    mOutputStatus = DemuxOutputStatus::DATA_READY;
+    mOutputRunning = true;
     return Result::SUCCESS;
 }
 
 Return<Result> Demux::stopOutput() {
     ALOGV("%s", __FUNCTION__);
 
+    std::lock_guard<std::mutex> lock(mOutputLock);
+    if (!mOutputRunning) {
+        return Result::SUCCESS;
+    }
+    // Write the last partial block so the recording ends with all the packets
+    if (!mRecordBlock.empty()) {
+        writeRecordBlockLocked();
+    }
+    mOutputRunning = false;
     return Result::SUCCESS;
 }
 
 Return<Result> Demux::flushOutput() {
     ALOGV("%s", __FUNCTION__);
 
+    // Drop the packets not written to the output FMQ yet
+    std::lock_guard<std::mutex> lock(mOutputLock);
+    mRecordBlock.clear();
     return Result::SUCCESS;
 }
 
 Return<Result> Demux::removeOutput() {
     ALOGV("%s", __FUNCTION__);
 
+    std::lock_guard<std::mutex> lock(mOutputLock);
+    mOutputRunning = false;
+    mRecordBlock.clear();
+    mRecordBlock.shrink_to_fit();
+    mOutputFilterIds.clear();
+    mOutputConfigured = false;
+    mOutputCallback = nullptr;
+    if (mOutputMQ) {
+        EventFlag::deleteEventFlag(&mOutputEventFlag);
+        mOutputMQ.reset();
+    }
     return Result::SUCCESS;
 }
 
@@ -451,113 +629,689 @@ Result Demux::startFilterLoop(uint32_t filterId) {
 }
 
 Result Demux::startSectionFilterHandler(uint32_t filterId) {
-    if (mFilterOutputs[filterId].empty()) {
+    std::lock_guard<std::mutex> lock(mFilterEventLock);
+    vector<uint8_t>& output = mFilterOutputs[filterId];
+    if (output.empty()) {
         return Result::SUCCESS;
     }
-    if (!writeSectionsAndCreateEvent(filterId, mFilterOutputs[filterId])) {
-        ALOGD("[Demux] filter %d fails to write into FMQ. Ending thread", filterId);
-        return Result::UNKNOWN_ERROR;
+
+    SectionState& state = mSectionStates[filterId];
+    for (size_t i = 0; i + 188 <= output.size(); i += 188) {
+        const uint8_t* packet = output.data() + i;
+        bool payloadUnitStart = (packet[1] & 0x40) != 0;
+        uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+        if ((adaptationFieldControl & 0x1) == 0) {
+            // No payload
+            continue;
+        }
+        size_t payloadOffset = 4;
+        if (adaptationFieldControl == 0x3) {
+            payloadOffset += 1 + packet[4];
+        }
+        if (payloadOffset >= 188) {
+            continue;
+        }
+        const uint8_t* payload = packet + payloadOffset;
+        size_t payloadSize = 188 - payloadOffset;
+
+        bool written = true;
+        if (payloadUnitStart) {
+            // pointer_field gives the number of bytes ending the previous section
+            size_t pointer = payload[0];
+            if (pointer + 1 > payloadSize) {
+                state.assembling = false;
+                state.section.clear();
+                continue;
+            }
+            if (state.assembling) {
+                written = appendSectionDataLocked(filterId, payload + 1, pointer);
+            }
+            state.assembling = true;
+            state.section.clear();
+            written = appendSectionDataLocked(filterId, payload + 1 + pointer,
+                                              payloadSize - 1 - pointer) &&
+                      written;
+        } else if (state.assembling) {
+            written = appendSectionDataLocked(filterId, payload, payloadSize);
+        }
+        if (!written) {
+            ALOGD("[Demux] filter %d fails to write into FMQ. Ending thread", filterId);
+            output.clear();
+            return Result::UNKNOWN_ERROR;
+        }
     }
 
-    mFilterOutputs[filterId].clear();
+    output.clear();
 
     return Result::SUCCESS;
 }
 
+bool Demux::appendSectionDataLocked(uint32_t filterId, const uint8_t* data, size_t size) {
+    SectionState& state = mSectionStates[filterId];
+    bool result = true;
+    while (size > 0 && state.assembling) {
+        // The first 3 bytes hold table_id and section_length
+        size_t needed = 3;
+        if (state.section.size() >= 3) {
+            if (state.section[0] == 0xFF) {
+                // Stuffing until the end of the packet
+                state.assembling = false;
+                state.section.clear();
+                break;
+            }
+            needed = 3 + (((state.section[1] & 0x0F) << 8) | state.section[2]);
+            if (needed == 3) {
+                // An empty section carries nothing; look for the next one
+                state.section.clear();
+                continue;
+            }
+            if (needed > MAX_SECTION_SIZE) {
+                ALOGW("[Demux] filter %d dropping section of size %zu", filterId, needed);
+                state.assembling = false;
+                state.section.clear();
+                break;
+            }
+        }
+
+        size_t take = min(needed - state.section.size(), size);
+        state.section.insert(state.section.end(), data, data + take);
+        data += take;
+        size -= take;
+
+        if (needed > 3 && state.section.size() == needed) {
+            // A complete section. Another one may follow in the same packet.
+            result = outputSectionLocked(filterId) && result;
+            state.section.clear();
+        }
+    }
+    return result;
+}
+
+bool Demux::outputSectionLocked(uint32_t filterId) {
+    SectionState& state = mSectionStates[filterId];
+    const vector<uint8_t>& section = state.section;
+
+    bool syntaxIndicator = (section[1] & 0x80) != 0;
+    if (syntaxIndicator && section.size() < 12) {
+        // Too short for the long form header and CRC_32
+        return true;
+    }
+    if (syntaxIndicator && state.settings.isCheckCrc &&
+        crc32Mpeg2(section.data(), section.size()) != 0) {
+        ALOGD("[Demux] filter %d dropping section with wrong CRC", filterId);
+        return true;
+    }
+    if (!matchSectionFilter(state.settings.bits, section)) {
+        return true;
+    }
+
+    uint8_t version = 0;
+    uint8_t sectionNum = 0;
+    uint32_t key = 0;
+    if (syntaxIndicator) {
+        version = (section[5] >> 1) & 0x1F;
+        sectionNum = section[6];
+        key = (static_cast<uint32_t>(section[0]) << 24) | (section[3] << 16) | (section[4] << 8) |
+              sectionNum;
+        if (!state.settings.isRepeat) {
+            auto it = state.versions.find(key);
+            if (it != state.versions.end() && it->second == version) {
+                // Same version as the one already sent
+                return true;
+            }
+        }
+    }
+
+    if (!writeDataToFilterMQ(section, filterId)) {
+        return false;
+    }
+    if (syntaxIndicator) {
+        state.versions[key] = version;
+    }
+
+    int size = mFilterEvents[filterId].events.size();
+    mFilterEvents[filterId].events.resize(size + 1);
+    DemuxFilterSectionEvent secEvent;
+    secEvent = {
+            .tableId = section[0],
+            .version = version,
+            .sectionNum = sectionNum,
+            .dataLength = static_cast<uint16_t>(section.size()),
+    };
+    mFilterEvents[filterId].events[size].section(secEvent);
+    return true;
+}
+
+bool Demux::matchSectionFilter(const DemuxFilterSectionBits& bits,
+                               const vector<uint8_t>& section) {
+    // As in the Linux DVB demux, the first filter byte applies to table_id and
+    // the following ones to the bytes after section_length
+    size_t count = min(bits.filter.size(), bits.mask.size());
+    bool hasNegative = false;
+    bool negativeMatched = false;
+    for (size_t i = 0; i < count; i++) {
+        size_t index = i == 0 ? 0 : i + 2;
+        if (index >= section.size()) {
+            return false;
+        }
+        uint8_t mode = i < bits.mode.size() ? bits.mode[i] : 0;
+        uint8_t diff = (section[index] ^ bits.filter[i]) & bits.mask[i];
+        // Positive match: every masked bit with mode 0 equals the filter bit
+        if (diff & ~mode) {
+            return false;
+        }
+        // Negative match: at least one masked bit with mode 1 differs
+        if (bits.mask[i] & mode) {
+            hasNegative = true;
+            negativeMatched = negativeMatched || (diff & mode) != 0;
+        }
+    }
+    return !hasNegative || negativeMatched;
+}
+
 Result Demux::startPesFilterHandler(uint32_t filterId) {
     std::lock_guard<std::mutex> lock(mFilterEventLock);
-    if (mFilterOutputs[filterId].empty()) {
+    vector<uint8_t>& output = mFilterOutputs[filterId];
+    if (output.empty()) {
         return Result::SUCCESS;
     }
 
-    for (int i = 0; i < mFilterOutputs[filterId].size(); i += 188) {
-        if (mPesSizeLeft == 0) {
-            uint32_t prefix = (mFilterOutputs[filterId][i + 4] << 16) |
-                              (mFilterOutputs[filterId][i + 5] << 8) |
-                              mFilterOutputs[filterId][i + 6];
-            ALOGD("[Demux] prefix %d", prefix);
-            if (prefix == 0x000001) {
-                // TODO handle mulptiple Pes filters
-                mPesSizeLeft =
-                        (mFilterOutputs[filterId][i + 8] << 8) | mFilterOutputs[filterId][i + 9];
-                mPesSizeLeft += 6;
-                ALOGD("[Demux] pes data length %d", mPesSizeLeft);
-            } else {
-                continue;
+    PesState& pes = mPesStates[filterId];
+    for (size_t i = 0; i + 188 <= output.size(); i += 188) {
+        const uint8_t* packet = output.data() + i;
+        bool payloadUnitStart = (packet[1] & 0x40) != 0;
+        uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+        if ((adaptationFieldControl & 0x1) == 0) {
+            // No payload
+            continue;
+        }
+        size_t payloadOffset = 4;
+        if (adaptationFieldControl == 0x3) {
+            payloadOffset += 1 + packet[4];
+        }
+        if (payloadOffset >= 188) {
+            continue;
+        }
+        const uint8_t* payload = packet + payloadOffset;
+        size_t payloadSize = 188 - payloadOffset;
+
+        if (payloadUnitStart) {
+            // A new PES ends the one in progress, which is the only way an unbounded one ends.
+            // Only a packet with payload_unit_start_indicator set carries a PES header; a start
+            // code anywhere else is just payload.
+            finishPesLocked(filterId);
+            pes.assembling = false;
+            if (payloadSize >= 6 && payload[0] == 0x00 && payload[1] == 0x00 &&
+                payload[2] == 0x01) {
+                uint32_t pesPacketLength = (payload[4] << 8) | payload[5];
+                pes.assembling = true;
+                pes.unbounded = pesPacketLength == 0;
+                pes.sizeLeft = pesPacketLength + 6;
+                pes.streamId = payload[3];
+                ALOGD("[Demux] pes data length %d", pesPacketLength);
             }
         }
-
-        int endPoint = min(184, mPesSizeLeft);
-        // append data and check size
-        vector<uint8_t>::const_iterator first = mFilterOutputs[filterId].begin() + i + 4;
-        vector<uint8_t>::const_iterator last = mFilterOutputs[filterId].begin() + i + 4 + endPoint;
-        mPesOutput.insert(mPesOutput.end(), first, last);
-        // size does not match then continue
-        mPesSizeLeft -= endPoint;
-        if (mPesSizeLeft > 0) {
+        if (!pes.assembling) {
             continue;
         }
-        // size match then create event
-        if (!writeDataToFilterMQ(mPesOutput, filterId)) {
-            mFilterOutputs[filterId].clear();
+
+        size_t size = pes.unbounded ? payloadSize : min<size_t>(payloadSize, pes.sizeLeft);
+        if (!writePesDataLocked(filterId, payload, size)) {
+            // Report what already is in the FMQ and drop the rest of this PES
+            finishPesLocked(filterId);
+            pes.assembling = false;
+            output.clear();
             return Result::INVALID_STATE;
         }
-        maySendFilterStatusCallback(filterId);
-        DemuxFilterPesEvent pesEvent;
-        pesEvent = {
-                // temp dump meta data
-                .streamId = mPesOutput[3],
-                .dataLength = static_cast<uint16_t>(mPesOutput.size()),
-        };
-        ALOGD("[Demux] assembled pes data length %d", pesEvent.dataLength);
-
-        int size = mFilterEvents[filterId].events.size();
-        mFilterEvents[filterId].events.resize(size + 1);
-        mFilterEvents[filterId].events[size].pes(pesEvent);
-        mPesOutput.clear();
+        if (!pes.unbounded) {
+            pes.sizeLeft -= size;
+            if (pes.sizeLeft == 0) {
+                finishPesLocked(filterId);
+                pes.assembling = false;
+            }
+        }
     }
 
-    mFilterOutputs[filterId].clear();
+    output.clear();
 
     return Result::SUCCESS;
 }
 
+bool Demux::writePesDataLocked(uint32_t filterId, const uint8_t* data, size_t size) {
+    PesState& pes = mPesStates[filterId];
+    while (size > 0) {
+        // The data length of a PES event is 16 bits, so a longer PES is reported
+        // in several events
+        if (pes.written == UINT16_MAX) {
+            finishPesLocked(filterId);
+        }
+        size_t chunk = min<size_t>(size, UINT16_MAX - pes.written);
+
+        // Copy the payload straight into the FMQ
+        std::lock_guard<std::mutex> lock(mWriteLock);
+        FilterMQ::MemTransaction tx;
+        if (!mFilterMQs[filterId]->beginWrite(chunk, &tx) || !tx.copyTo(data, 0, chunk) ||
+            !mFilterMQs[filterId]->commitWrite(chunk)) {
+            return false;
+        }
+        pes.written += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+void Demux::finishPesLocked(uint32_t filterId) {
+    PesState& pes = mPesStates[filterId];
+    if (pes.written == 0) {
+        return;
+    }
+
+    maySendFilterStatusCallback(filterId);
+    DemuxFilterPesEvent pesEvent;
+    pesEvent = {
+            .streamId = pes.streamId,
+            .dataLength = static_cast<uint16_t>(pes.written),
+    };
+    ALOGD("[Demux] assembled pes data length %d", pesEvent.dataLength);
+
+    int size = mFilterEvents[filterId].events.size();
+    mFilterEvents[filterId].events.resize(size + 1);
+    mFilterEvents[filterId].events[size].pes(pesEvent);
+    pes.written = 0;
+}
+
 Result Demux::startTsFilterHandler() {
     // TODO handle starting TS filter
     return Result::SUCCESS;
 }
 
 Result Demux::startMediaFilterHandler(uint32_t filterId) {
-    DemuxFilterMediaEvent mediaEvent;
-    mediaEvent = {
-            // temp dump meta data
-            .pts = 0,
-            .dataLength = 530,
-            .secureMemory = nullptr,
-    };
-    mFilterEvents[filterId].events.resize(1);
-    mFilterEvents[filterId].events[0].media() = mediaEvent;
+    std::lock_guard<std::mutex> lock(mFilterEventLock);
+    vector<uint8_t>& output = mFilterOutputs[filterId];
+    if (output.empty()) {
+        return Result::SUCCESS;
+    }
 
-    mFilterOutputs[filterId].clear();
-    // TODO handle write FQM for media stream
+    MediaState& media = mMediaStates[filterId];
+    for (size_t i = 0; i + 188 <= output.size(); i += 188) {
+        const uint8_t* packet = output.data() + i;
+        bool payloadUnitStart = (packet[1] & 0x40) != 0;
+        uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+        if ((adaptationFieldControl & 0x1) == 0) {
+            // No payload
+            continue;
+        }
+        size_t payloadOffset = 4;
+        if (adaptationFieldControl == 0x3) {
+            payloadOffset += 1 + packet[4];
+        }
+        if (payloadOffset >= 188) {
+            continue;
+        }
+        const uint8_t* payload = packet + payloadOffset;
+        size_t payloadSize = 188 - payloadOffset;
+
+        if (payloadUnitStart && payloadSize >= 9 && payload[0] == 0x00 && payload[1] == 0x00 &&
+            payload[2] == 0x01) {
+            // A new PES ends the frame in progress
+            finishMediaFrameLocked(filterId);
+            uint32_t pesPacketLength = (payload[4] << 8) | payload[5];
+            media.assembling = true;
+            media.unbounded = pesPacketLength == 0;
+            media.sizeLeft = pesPacketLength + 6;
+            if ((payload[7] & 0x80) != 0 && payloadSize >= 14) {
+                media.pts = (static_cast<uint64_t>((payload[9] >> 1) & 0x7) << 30) |
+                            (payload[10] << 22) | ((payload[11] >> 1) << 15) |
+                            (payload[12] << 7) | (payload[13] >> 1);
+            }
+            if (!mAvMemories[filterId].data) {
+                media.frameOffset = 0;
+            } else {
+                media.frameOffset = mAvMemories[filterId].writeOffset;
+            }
+
+            // Only the elementary stream data after the PES header is kept
+            size_t headerSize = min<size_t>(9 + payload[8], payloadSize);
+            if (!media.unbounded) {
+                media.sizeLeft -= min<size_t>(headerSize, media.sizeLeft);
+            }
+            payload += headerSize;
+            payloadSize -= headerSize;
+        }
+        if (!media.assembling) {
+            continue;
+        }
+
+        size_t size = media.unbounded ? payloadSize : min<size_t>(payloadSize, media.sizeLeft);
+        if (!writeMediaDataLocked(filterId, payload, size)) {
+            // Report what already is written and drop the rest of this frame
+            finishMediaFrameLocked(filterId);
+            media.assembling = false;
+            output.clear();
+            return Result::INVALID_STATE;
+        }
+        if (!media.unbounded) {
+            media.sizeLeft -= size;
+            if (media.sizeLeft == 0) {
+                finishMediaFrameLocked(filterId);
+                media.assembling = false;
+            }
+        }
+    }
+
+    output.clear();
     return Result::SUCCESS;
 }
 
+bool Demux::writeMediaDataLocked(uint32_t filterId, const uint8_t* data, size_t size) {
+    MediaState& media = mMediaStates[filterId];
+    AvMemory& memory = mAvMemories[filterId];
+    if (memory.data != nullptr) {
+        if (media.frameOffset + media.written + size > memory.size) {
+            if (media.written + size > memory.size) {
+                ALOGW("[Demux] frame larger than the AV memory of filter %d", filterId);
+                return false;
+            }
+            // Restart the frame in progress at the beginning of the memory
+            memmove(memory.data, memory.data + media.frameOffset, media.written);
+            media.frameOffset = 0;
+        }
+        memcpy(memory.data + media.frameOffset + media.written, data, size);
+        media.written += size;
+        return true;
+    }
+
+    while (size > 0) {
+        // The data length of a media event is 16 bits, so a longer frame is
+        // reported in several events
+        if (media.written == UINT16_MAX) {
+            finishMediaFrameLocked(filterId);
+        }
+        size_t chunk = min<size_t>(size, UINT16_MAX - media.written);
+
+        // Copy the data straight into the FMQ
+        std::lock_guard<std::mutex> lock(mWriteLock);
+        FilterMQ::MemTransaction tx;
+        if (!mFilterMQs[filterId]->beginWrite(chunk, &tx) || !tx.copyTo(data, 0, chunk) ||
+            !mFilterMQs[filterId]->commitWrite(chunk)) {
+            return false;
+        }
+        media.written += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+void Demux::finishMediaFrameLocked(uint32_t filterId) {
+    MediaState& media = mMediaStates[filterId];
+    if (media.written == 0) {
+        return;
+    }
+
+    DemuxFilterMediaEvent mediaEvent;
+    mediaEvent.pts = media.pts;
+    mediaEvent.dataLength = static_cast<uint16_t>(min<uint32_t>(media.written, UINT16_MAX));
+    AvMemory& memory = mAvMemories[filterId];
+    if (memory.data != nullptr) {
+        // The handle carries the AV memory and the place of the frame in it,
+        // since the event has no field for those
+        native_handle_t* handle = native_handle_create(1 /* numFds */, 2 /* numInts */);
+        if (handle != nullptr) {
+            handle->data[0] = dup(memory.fd);
+            handle->data[1] = static_cast<int>(media.frameOffset);
+            handle->data[2] = static_cast<int>(media.written);
+            mediaEvent.secureMemory.setTo(handle, true /* shouldOwn */);
+        }
+        memory.writeOffset = media.frameOffset + media.written;
+        media.frameOffset = memory.writeOffset;
+    } else {
+        maySendFilterStatusCallback(filterId);
+    }
+
+    int size = mFilterEvents[filterId].events.size();
+    mFilterEvents[filterId].events.resize(size + 1);
+    mFilterEvents[filterId].events[size].media(mediaEvent);
+    media.written = 0;
+}
+
+bool Demux::createAvMemory(uint32_t filterId) {
+    AvMemory& memory = mAvMemories[filterId];
+    int fd = ashmem_create_region("tuner_av_memory", mAvMemorySize);
+    if (fd < 0) {
+        ALOGW("[Demux] failed to create the AV memory: %s", strerror(errno));
+        return false;
+    }
+    void* data = mmap(nullptr, mAvMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        ALOGW("[Demux] failed to map the AV memory: %s", strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    memory.fd = fd;
+    memory.data = static_cast<uint8_t*>(data);
+    memory.size = mAvMemorySize;
+    memory.writeOffset = 0;
+    return true;
+}
+
+void Demux::releaseAvMemory(uint32_t filterId) {
+    AvMemory& memory = mAvMemories[filterId];
+    if (memory.data != nullptr) {
+        munmap(memory.data, memory.size);
+        ::close(memory.fd);
+    }
+    memory = AvMemory();
+}
+
 Result Demux::startRecordFilterHandler(uint32_t filterId) {
-    DemuxFilterRecordEvent recordEvent;
-    recordEvent = {
-            // temp dump meta data
-            .tpid = 0,
-            .packetNum = 0,
-    };
-    recordEvent.indexMask.tsIndexMask() = 0x01;
-    mFilterEvents[filterId].events.resize(1);
-    mFilterEvents[filterId].events[0].ts() = recordEvent;
+    std::lock_guard<std::mutex> lock(mFilterEventLock);
+    vector<uint8_t>& output = mFilterOutputs[filterId];
+    if (output.empty()) {
+        return Result::SUCCESS;
+    }
 
-    mFilterOutputs[filterId].clear();
+    // Index the packets, in the record event stream next to the data
+    RecordState& state = mRecordStates[filterId];
+    using IndexMask = DemuxFilterRecordSettings::IndexMask;
+    bool tsIndex = state.settings.indexType == DemuxRecordIndexType::TS &&
+                   state.settings.indexMask.getDiscriminator() ==
+                           IndexMask::hidl_discriminator::tsIndexMask;
+    bool scIndex = state.settings.indexType == DemuxRecordIndexType::SC &&
+                   state.settings.indexMask.getDiscriminator() ==
+                           IndexMask::hidl_discriminator::scIndexMask;
+    hidl_vec<DemuxFilterEvent::Event>& events = mFilterEvents[filterId].events;
+    for (size_t i = 0; i + 188 <= output.size(); i += 188) {
+        const uint8_t* packet = output.data() + i;
+        uint32_t mask = 0;
+        if (tsIndex) {
+            mask = getTsIndexMask(packet, state) & state.settings.indexMask.tsIndexMask();
+        } else if (scIndex) {
+            uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+            size_t payloadOffset = adaptationFieldControl == 0x3 ? 5 + packet[4] : 4;
+            if ((adaptationFieldControl & 0x1) != 0 && payloadOffset < 188) {
+                mask = getScIndexMask(packet + payloadOffset, 188 - payloadOffset, state) &
+                       state.settings.indexMask.scIndexMask();
+            }
+        }
+        if (mask != 0) {
+            DemuxFilterRecordEvent recordEvent;
+            recordEvent.tpid = state.settings.tpid;
+            if (tsIndex) {
+                recordEvent.indexMask.tsIndexMask(mask);
+            } else {
+                recordEvent.indexMask.scIndexMask(mask);
+            }
+            recordEvent.packetNum = state.packetNum;
+            events.resize(events.size() + 1);
+            events[events.size() - 1].ts(recordEvent);
+        }
+        state.packetNum++;
+    }
+
+    bool recorded = false;
+    {
+        std::lock_guard<std::mutex> outputLock(mOutputLock);
+        if (mOutputRunning && mOutputFilterIds.find(filterId) != mOutputFilterIds.end()) {
+            // Gather the packets into output blocks
+            recorded = true;
+            size_t offset = 0;
+            while (offset < output.size()) {
+                size_t size = std::min(output.size() - offset,
+                                       mRecordBlockSize - mRecordBlock.size());
+                mRecordBlock.insert(mRecordBlock.end(), output.begin() + offset,
+                                    output.begin() + offset + size);
+                offset += size;
+                if (mRecordBlock.size() == mRecordBlockSize) {
+                    writeRecordBlockLocked();
+                }
+            }
+        }
+    }
+    if (!recorded) {
+        if (!writeDataToFilterMQ(output, filterId)) {
+            output.clear();
+            return Result::INVALID_STATE;
+        }
+        maySendFilterStatusCallback(filterId);
+    }
+
+    output.clear();
     return Result::SUCCESS;
 }
 
+uint32_t Demux::getTsIndexMask(const uint8_t* packet, RecordState& state) {
+    uint32_t mask = 0;
+    if (state.packetNum == 0) {
+        mask |= static_cast<uint32_t>(DemuxTsIndex::FIRST_PACKET);
+    }
+    if ((packet[1] & 0x40) != 0) {
+        mask |= static_cast<uint32_t>(DemuxTsIndex::PAYLOAD_UNIT_START_INDICATOR);
+    }
+
+    uint8_t scramblingControl = (packet[3] >> 6) & 0x3;
+    if (state.packetNum != 0 && scramblingControl != state.scramblingControl) {
+        switch (scramblingControl) {
+            case 0x0:
+                mask |= static_cast<uint32_t>(DemuxTsIndex::CHANGE_TO_NOT_SCRAMBLED);
+                break;
+            case 0x2:
+                mask |= static_cast<uint32_t>(DemuxTsIndex::CHANGE_TO_EVEN_SCRAMBLED);
+                break;
+            case 0x3:
+                mask |= static_cast<uint32_t>(DemuxTsIndex::CHANGE_TO_ODD_SCRAMBLED);
+                break;
+        }
+    }
+    state.scramblingControl = scramblingControl;
+
+    // Adaptation field flags
+    uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+    if ((adaptationFieldControl & 0x2) != 0 && packet[4] > 0) {
+        uint8_t flags = packet[5];
+        static const DemuxTsIndex kFlagIndexes[] = {
+                DemuxTsIndex::ADAPTATION_EXTENSION_FLAG, DemuxTsIndex::PRIVATE_DATA,
+                DemuxTsIndex::SPLICING_POINT_FLAG,       DemuxTsIndex::OPCR_FLAG,
+                DemuxTsIndex::PCR_FLAG,                  DemuxTsIndex::PRIORITY_INDICATOR,
+                DemuxTsIndex::RANDOM_ACCESS_INDICATOR,   DemuxTsIndex::DISCONTINUITY_INDICATOR,
+        };
+        for (int bit = 0; bit < 8; bit++) {
+            if ((flags & (1 << bit)) != 0) {
+                mask |= static_cast<uint32_t>(kFlagIndexes[bit]);
+            }
+        }
+    }
+    return mask;
+}
+
+uint32_t Demux::getScIndexMask(const uint8_t* payload, size_t size, RecordState& state) {
+    uint32_t mask = 0;
+    // Start codes split across two packets are not detected
+    for (size_t i = 0; i + 3 < size; i++) {
+        if (payload[i] != 0 || payload[i + 1] != 0 || payload[i + 2] != 1) {
+            continue;
+        }
+        uint8_t code = payload[i + 3];
+        // The codec is not known from the recorded PID alone, so it is
+        // taken from the first sequence header: an MPEG-2 sequence_header_code
+        // or an H.264 sequence parameter set NAL unit
+        if (state.codec == RecordState::Codec::UNKNOWN) {
+            if (code == 0xB3) {
+                state.codec = RecordState::Codec::MPEG2;
+            } else if ((code & 0x9F) == 0x07 && (code & 0x60) != 0) {
+                state.codec = RecordState::Codec::H264;
+            }
+        }
+
+        if (state.codec == RecordState::Codec::MPEG2) {
+            if (code == 0xB3) {
+                mask |= static_cast<uint32_t>(DemuxScIndex::SEQUENCE);
+            } else if (code == 0x00 && i + 5 < size) {
+                // picture_coding_type follows the 10 bit temporal_reference
+                switch ((payload[i + 5] >> 3) & 0x7) {
+                    case 1:
+                        mask |= static_cast<uint32_t>(DemuxScIndex::I_FRAME);
+                        break;
+                    case 2:
+                        mask |= static_cast<uint32_t>(DemuxScIndex::P_FRAME);
+                        break;
+                    case 3:
+                        mask |= static_cast<uint32_t>(DemuxScIndex::B_FRAME);
+                        break;
+                }
+            }
+        } else if (state.codec == RecordState::Codec::H264 && (code & 0x80) == 0) {
+            switch (code & 0x1F) {
+                case 5:
+                    mask |= static_cast<uint32_t>(DemuxScIndex::I_FRAME);
+                    break;
+                case 7:
+                    mask |= static_cast<uint32_t>(DemuxScIndex::SEQUENCE);
+                    break;
+            }
+        }
+        i += 3;
+    }
+    return mask;
+}
+
+bool Demux::writeRecordBlockLocked() {
+    bool written;
+    {
+        std::lock_guard<std::mutex> lock(mWriteLock);
+        written = mOutputMQ->write(mRecordBlock.data(), mRecordBlock.size());
+    }
+    if (written) {
+        mOutputEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
+    } else {
+        ALOGW("[Demux] output overflow, %zu bytes dropped", mRecordBlock.size());
+    }
+    maySendOutputStatusCallbackLocked(!written);
+    mRecordBlock.clear();
+    return written;
+}
+
+void Demux::maySendOutputStatusCallbackLocked(bool overflow) {
+    uint32_t availableToRead = mOutputMQ->availableToRead();
+    DemuxOutputStatus newStatus = mOutputStatus;
+    if (overflow) {
+        newStatus = DemuxOutputStatus::OVERFLOW;
+    } else if (availableToRead > mOutputSettings.highThreshold) {
+        newStatus = DemuxOutputStatus::HIGH_WATER;
+    } else if (availableToRead < mOutputSettings.lowThreshold) {
+        newStatus = DemuxOutputStatus::LOW_WATER;
+    }
+    if (newStatus == mOutputStatus) {
+        return;
+    }
+    mOutputStatus = newStatus;
+    if (mOutputCallback != nullptr &&
+        (mOutputSettings.statusMask & static_cast<uint8_t>(newStatus)) != 0) {
+        mOutputCallback->onOutputStatus(newStatus);
+    }
+}
+
 Result Demux::startPcrFilterHandler() {
     // TODO handle starting PCR filter
     return Result::SUCCESS;
@@ -586,26 +1340,6 @@ bool Demux::createFilterMQ(uint32_t bufferSize, uint32_t filterId) {
     return true;
 }
 
-bool Demux::writeSectionsAndCreateEvent(uint32_t filterId, vector<uint8_t> data) {
-    // TODO check how many sections has been read
-    std::lock_guard<std::mutex> lock(mFilterEventLock);
-    if (!writeDataToFilterMQ(data, filterId)) {
-        return false;
-    }
-    int size = mFilterEvents[filterId].events.size();
-    mFilterEvents[filterId].events.resize(size + 1);
-    DemuxFilterSectionEvent secEvent;
-    secEvent = {
-            // temp dump meta data
-            .tableId = 0,
-            .version = 1,
-            .sectionNum = 1,
-            .dataLength = static_cast<uint16_t>(data.size()),
-    };
-    mFilterEvents[filterId].events[size].section(secEvent);
-    return true;
-}
-
 bool Demux::writeDataToFilterMQ(const std::vector<uint8_t>& data, uint32_t filterId) {
     std::lock_guard<std::mutex> lock(mWriteLock);
     if (mFilterMQs[filterId]->write(data.data(), data.size())) {
@@ -616,33 +1350,175 @@ bool Demux::writeDataToFilterMQ(const std::vector<uint8_t>& data, uint32_t filte
 
 bool Demux::readInputFMQ() {
     // Read input data from the input FMQ
-    int size = mInputMQ->availableToRead();
-    int inputPacketSize = mInputSettings.packetSize;
-    vector<uint8_t> dataOutputBuffer;
-    dataOutputBuffer.resize(inputPacketSize);
-
-    // Dispatch the packet to the PID matching filter output buffer
-    for (int i = 0; i < size / inputPacketSize; i++) {
-        if (!mInputMQ->read(dataOutputBuffer.data(), inputPacketSize)) {
-            return false;
+    size_t size = mInputMQ->availableToRead();
+    size_t inputPacketSize = mInputSettings.packetSize;
+    if (inputPacketSize == 0) {
+        ALOGW("[Demux] input packet size is not configured");
+        return false;
+    }
+    size_t readSize = size / inputPacketSize * inputPacketSize;
+    if (readSize == 0) {
+        return true;
+    }
+
+    // Dispatch the packets in place from the FMQ ring and release them all at once.
+    // The ring may wrap inside the read region, in which case it has two parts.
+    FilterMQ::MemTransaction tx;
+    if (!mInputMQ->beginRead(readSize, &tx)) {
+        return false;
+    }
+    const FilterMQ::MemRegion& first = tx.getFirstRegion();
+    const FilterMQ::MemRegion& second = tx.getSecondRegion();
+    vector<uint8_t> wrappedPacket;
+    {
+        std::lock_guard<std::mutex> lock(mPidTableLock);
+        for (size_t offset = 0; offset < readSize; offset += inputPacketSize) {
+            const uint8_t* packet;
+            if (offset + inputPacketSize <= first.getLength()) {
+                packet = first.getAddress() + offset;
+            } else if (offset >= first.getLength()) {
+                packet = second.getAddress() + (offset - first.getLength());
+            } else {
+                // Only a packet split by the end of the ring is copied
+                size_t head = first.getLength() - offset;
+                wrappedPacket.resize(inputPacketSize);
+                memcpy(wrappedPacket.data(), first.getAddress() + offset, head);
+                memcpy(wrappedPacket.data() + head, second.getAddress(), inputPacketSize - head);
+                packet = wrappedPacket.data();
+            }
+            startTsFilterLocked(packet, inputPacketSize);
         }
-        startTsFilter(dataOutputBuffer);
+        flushDescrambleBatchesLocked();
     }
 
-    return true;
+    return mInputMQ->commitRead(readSize);
 }
 
-void Demux::startTsFilter(vector<uint8_t> data) {
-    set<uint32_t>::iterator it;
-    for (it = mUsedFilterIds.begin(); it != mUsedFilterIds.end(); it++) {
-        uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
-        ALOGW("start ts filter pid: %d", pid);
-        if (pid == mFilterPids[*it]) {
-            mFilterOutputs[*it].insert(mFilterOutputs[*it].end(), data.begin(), data.end());
+void Demux::startTsFilter(const vector<uint8_t>& data) {
+    std::lock_guard<std::mutex> lock(mPidTableLock);
+    startTsFilterLocked(data.data(), data.size());
+    flushDescrambleBatchesLocked();
+}
+
+void Demux::startTsFilterLocked(const uint8_t* data, size_t size) {
+    if (size < 3) {
+        return;
+    }
+    // The PID is 13 bits, so it is always a valid index into the table
+    uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
+
+    Descrambler* descrambler = mPidDescramblers[pid];
+    if (descrambler == nullptr || size != 188) {
+        dispatchTsPacketLocked(data, size);
+        return;
+    }
+    // All the packets of the PID go through the batch, scrambled or not, to
+    // keep them in order
+    for (DescrambleBatch& batch : mDescrambleBatches) {
+        if (batch.descrambler == descrambler) {
+            batch.packets.insert(batch.packets.end(), data, data + size);
+            return;
         }
     }
 }
 
+void Demux::dispatchTsPacketLocked(const uint8_t* data, size_t size) {
+    uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
+
+    for (uint32_t filterId : mPidFilterIds[pid]) {
+        mFilterOutputs[filterId].insert(mFilterOutputs[filterId].end(), data, data + size);
+    }
+}
+
+void Demux::flushDescrambleBatchesLocked() {
+    for (DescrambleBatch& batch : mDescrambleBatches) {
+        if (batch.packets.empty()) {
+            continue;
+        }
+        batch.descrambler->descramble(batch.packets.data(), batch.packets.size() / 188);
+        for (size_t i = 0; i < batch.packets.size(); i += 188) {
+            dispatchTsPacketLocked(batch.packets.data() + i, 188);
+        }
+        batch.packets.clear();
+    }
+}
+
+void Demux::setPidDescrambler(uint16_t pid, Descrambler* descrambler) {
+    if (pid >= TS_PID_COUNT) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mPidTableLock);
+    Descrambler* previous = mPidDescramblers[pid];
+    mPidDescramblers[pid] = descrambler;
+    if (previous != nullptr && previous != descrambler) {
+        removeDescrambleBatchLocked(previous);
+    }
+    for (const DescrambleBatch& batch : mDescrambleBatches) {
+        if (batch.descrambler == descrambler) {
+            return;
+        }
+    }
+    mDescrambleBatches.push_back({descrambler, {}});
+}
+
+void Demux::clearPidDescrambler(uint16_t pid, Descrambler* descrambler) {
+    if (pid >= TS_PID_COUNT) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mPidTableLock);
+    if (mPidDescramblers[pid] != descrambler) {
+        return;
+    }
+    mPidDescramblers[pid] = nullptr;
+    removeDescrambleBatchLocked(descrambler);
+}
+
+void Demux::removeDescrambleBatchLocked(Descrambler* descrambler) {
+    // Only a descrambler left without PIDs loses its batch
+    if (std::find(mPidDescramblers.begin(), mPidDescramblers.end(), descrambler) !=
+        mPidDescramblers.end()) {
+        return;
+    }
+    mDescrambleBatches.erase(std::remove_if(mDescrambleBatches.begin(), mDescrambleBatches.end(),
+                                            [descrambler](const DescrambleBatch& batch) {
+                                                return batch.descrambler == descrambler;
+                                            }),
+                             mDescrambleBatches.end());
+}
+
+void Demux::addFilterToPidTable(uint32_t filterId) {
+    if (filterId >= mFilterPids.size()) {
+        return;
+    }
+    uint16_t pid = mFilterPids[filterId];
+    if (pid >= TS_PID_COUNT) {
+        ALOGW("Filter %d has invalid pid: %d", filterId, pid);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mPidTableLock);
+    vector<uint32_t>& filterIds = mPidFilterIds[pid];
+    if (std::find(filterIds.begin(), filterIds.end(), filterId) == filterIds.end()) {
+        filterIds.push_back(filterId);
+    }
+}
+
+void Demux::removeFilterFromPidTable(uint32_t filterId) {
+    if (filterId >= mFilterPids.size()) {
+        return;
+    }
+    uint16_t pid = mFilterPids[filterId];
+    if (pid >= TS_PID_COUNT) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mPidTableLock);
+    vector<uint32_t>& filterIds = mPidFilterIds[pid];
+    filterIds.erase(std::remove(filterIds.begin(), filterIds.end(), filterId), filterIds.end());
+}
+
 bool Demux::startFilterDispatcher() {
     Result result;
     set<uint32_t>::iterator it;
@@ -674,6 +1550,10 @@ bool Demux::startFilterDispatcher() {
         }
     }
 
+    // Wake up the filter threads waiting for new events
+    { std::lock_guard<std::mutex> lock(mFilterEventLock); }
+    mFilterEventCond.notify_all();
+
     return result == Result::SUCCESS;
 }
 
@@ -694,20 +1574,39 @@ void Demux::filterThreadLoop(uint32_t filterId) {
     std::lock_guard<std::mutex> lock(mFilterThreadLock);
     mFilterThreadRunning[filterId] = true;
 
+    // Takes the pending events of the filter once there are any. Returns false if the filter
+    // was stopped instead. The callbacks are made by the caller, without mFilterEventLock, so
+    // that they may call back into the demux.
+    auto takeEvents = [this, filterId](DemuxFilterEvent* event, sp<IDemuxCallback>* callback) {
+        std::unique_lock<std::mutex> lock(mFilterEventLock);
+        while (!mFilterEventCond.wait_for(lock, std::chrono::nanoseconds(WAIT_TIMEOUT), [&] {
+            return !mFilterThreadRunning[filterId] || mFilterEvents[filterId].events.size() != 0;
+        })) {
+            ALOGD("[Demux] wait for filter %d events", filterId);
+        }
+        if (!mFilterThreadRunning[filterId]) {
+            return false;
+        }
+        *event = std::move(mFilterEvents[filterId]);
+        mFilterEvents[filterId].filterType = event->filterType;
+        mFilterEvents[filterId].events.resize(0);
+        *callback = mFilterCallbacks[filterId];
+        return true;
+    };
+    DemuxFilterEvent event;
+    sp<IDemuxCallback> callback;
+
     // For the first time of filter output, implementation needs to send the filter
     // Event Callback without waiting for the DATA_CONSUMED to init the process.
-    while (mFilterThreadRunning[filterId]) {
-        if (mFilterEvents[filterId].events.size() == 0) {
-            ALOGD("[Demux] wait for filter data output.");
-            usleep(1000 * 1000);
-            continue;
-        }
+    ALOGD("[Demux] wait for filter data output.");
+    if (takeEvents(&event, &callback) && callback != nullptr) {
         // After successfully write, send a callback and wait for the read to be done
-        mFilterCallbacks[filterId]->onFilterEvent(mFilterEvents[filterId]);
-        mFilterEvents[filterId].events.resize(0);
-        mFilterStatus[filterId] = DemuxFilterStatus::DATA_READY;
-        mFilterCallbacks[filterId]->onFilterStatus(filterId, mFilterStatus[filterId]);
-        break;
+        callback->onFilterEvent(event);
+        {
+            std::lock_guard<std::mutex> lock(mFilterStatusLock);
+            mFilterStatus[filterId] = DemuxFilterStatus::DATA_READY;
+        }
+        callback->onFilterStatus(filterId, DemuxFilterStatus::DATA_READY);
     }
 
     while (mFilterThreadRunning[filterId]) {
@@ -733,15 +1632,9 @@ void Demux::filterThreadLoop(uint32_t filterId) {
 
             maySendFilterStatusCallback(filterId);
 
-            while (mFilterThreadRunning[filterId]) {
-                std::lock_guard<std::mutex> lock(mFilterEventLock);
-                if (mFilterEvents[filterId].events.size() == 0) {
-                    continue;
-                }
+            if (takeEvents(&event, &callback) && callback != nullptr) {
                 // After successfully write, send a callback and wait for the read to be done
-                mFilterCallbacks[filterId]->onFilterEvent(mFilterEvents[filterId]);
-                mFilterEvents[filterId].events.resize(0);
-                break;
+                callback->onFilterEvent(event);
             }
             // We do not wait for the last read to be done
             // VTS can verify the read result itself.
@@ -841,6 +1734,11 @@ DemuxFilterStatus Demux::checkFilterStatusChange(uint32_t filterId, uint32_t ava
 }
 
 Result Demux::startBroadcastInputLoop() {
+    {
+        std::lock_guard<std::mutex> waitLock(mBroadcastInputWaitLock);
+        mBroadcastBlocks.clear();
+        mBroadcastInputThreadRunning = true;
+    }
     pthread_create(&mBroadcastInputThread, NULL, __threadLoopBroadcast, this);
     pthread_setname_np(mBroadcastInputThread, "broadcast_input_thread");
 
@@ -855,51 +1753,67 @@ void* Demux::__threadLoopBroadcast(void* user) {
 
 void Demux::broadcastInputThreadLoop() {
     std::lock_guard<std::mutex> lock(mBroadcastInputThreadLock);
-    mBroadcastInputThreadRunning = true;
-    mKeepFetchingDataFromFrontend = true;
-
-    // open the stream and get its length
-    std::ifstream inputData(mFrontendSourceFile, std::ifstream::binary);
-    // TODO take the packet size from the frontend setting
-    int packetSize = 188;
-    int writePacketAmount = 6;
-    char* buffer = new char[packetSize];
-    ALOGW("[Demux] broadcast input thread loop start %s", mFrontendSourceFile.c_str());
-    if (!inputData.is_open()) {
-        mBroadcastInputThreadRunning = false;
-        ALOGW("[Demux] Error %s", strerror(errno));
-    }
+    ALOGW("[Demux] broadcast input thread loop start");
+
+    while (true) {
+        shared_ptr<const vector<uint8_t>> block;
+        {
+            std::unique_lock<std::mutex> waitLock(mBroadcastInputWaitLock);
+            mBroadcastInputCond.wait(waitLock, [this] {
+                return !mBroadcastInputThreadRunning || !mBroadcastBlocks.empty();
+            });
+            if (!mBroadcastInputThreadRunning) {
+                break;
+            }
+            block = std::move(mBroadcastBlocks.front());
+            mBroadcastBlocks.pop_front();
+            if (block == nullptr) {
+                // End of the frontend stream
+                mBroadcastInputThreadRunning = false;
+                break;
+            }
+        }
 
-    while (mBroadcastInputThreadRunning) {
-        // move the stream pointer for packet size * 6 every read until the end
-        while (mKeepFetchingDataFromFrontend) {
-            for (int i = 0; i < writePacketAmount; i++) {
-                inputData.read(buffer, packetSize);
-                if (!inputData) {
-                    mBroadcastInputThreadRunning = false;
-                    break;
-                }
-                // filter and dispatch filter output
-                vector<uint8_t> byteBuffer;
-                byteBuffer.resize(packetSize);
-                for (int index = 0; index < byteBuffer.size(); index++) {
-                    byteBuffer[index] = static_cast<uint8_t>(buffer[index]);
-                }
-                startTsFilter(byteBuffer);
+        // filter and dispatch filter output
+        {
+            std::lock_guard<std::mutex> pidLock(mPidTableLock);
+            for (size_t i = 0; i + 188 <= block->size(); i += 188) {
+                startTsFilterLocked(block->data() + i, 188);
             }
-            startFilterDispatcher();
-            sleep(1);
+            flushDescrambleBatchesLocked();
         }
+        startFilterDispatcher();
     }
 
     ALOGW("[Demux] Broadcast Input thread end.");
-    delete[] buffer;
-    inputData.close();
+}
+
+void Demux::pushBroadcastBlock(const shared_ptr<const vector<uint8_t>>& block) {
+    {
+        std::lock_guard<std::mutex> waitLock(mBroadcastInputWaitLock);
+        if (!mBroadcastInputThreadRunning) {
+            return;
+        }
+        if (mBroadcastBlocks.size() >= MAX_BROADCAST_BLOCKS) {
+            ALOGW("[Demux] broadcast input overflow, dropping %zu bytes",
+                  mBroadcastBlocks.front() == nullptr ? 0 : mBroadcastBlocks.front()->size());
+            mBroadcastBlocks.pop_front();
+        }
+        mBroadcastBlocks.push_back(block);
+    }
+    mBroadcastInputCond.notify_all();
 }
 
 void Demux::stopBroadcastInput() {
-    mKeepFetchingDataFromFrontend = false;
-    mBroadcastInputThreadRunning = false;
+    if (mFrontend != nullptr) {
+        mFrontend->detachDemux(mDemuxId);
+    }
+    {
+        std::lock_guard<std::mutex> waitLock(mBroadcastInputWaitLock);
+        mBroadcastInputThreadRunning = false;
+        mBroadcastBlocks.clear();
+    }
+    mBroadcastInputCond.notify_all();
     std::lock_guard<std::mutex> lock(mBroadcastInputThreadLock);
 }
 
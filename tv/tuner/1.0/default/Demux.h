@@ -20,6 +20,11 @@
 #include <android/hardware/tv/tuner/1.0/IDemux.h>
 #include <fmq/MessageQueue.h>
 #include <math.h>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
 #include <set>
 #include "Frontend.h"
 #include "Tuner.h"
@@ -45,6 +50,7 @@ using FilterMQ = MessageQueue<uint8_t, kSynchronizedReadWrite>;
 
 class Tuner;
 class Frontend;
+class Descrambler;
 
 class Demux : public IDemux {
   public:
@@ -112,13 +118,30 @@ class Demux : public IDemux {
     // Functions interacts with Tuner Service
     void stopBroadcastInput();
 
+    /**
+     * Queue a block of packets of the frontend stream for the broadcast
+     * input thread. The block is shared with the other demuxes on the same
+     * frontend. A null block ends the stream.
+     */
+    void pushBroadcastBlock(const shared_ptr<const vector<uint8_t>>& block);
+
+    /**
+     * Route the packets of a PID through a descrambler before the filters,
+     * or stop routing them. Called by the Descrambler, which must clear its
+     * PIDs before it goes away.
+     */
+    void setPidDescrambler(uint16_t pid, Descrambler* descrambler);
+    void clearPidDescrambler(uint16_t pid, Descrambler* descrambler);
+
   private:
+    // Lets the benchmarks drive the input dispatch directly
+    friend class DemuxBenchmark;
+
     // Tuner service
     sp<Tuner> mTunerService;
 
     // Frontend source
     sp<Frontend> mFrontend;
-    string mFrontendSourceFile;
 
     // A struct that passes the arguments to a newly created filter thread
     struct ThreadArgs {
@@ -152,7 +175,6 @@ class Demux : public IDemux {
     void deleteEventFlag();
     bool writeDataToFilterMQ(const std::vector<uint8_t>& data, uint32_t filterId);
     bool readDataFromMQ();
-    bool writeSectionsAndCreateEvent(uint32_t filterId, vector<uint8_t> data);
     void maySendInputStatusCallback();
     void maySendFilterStatusCallback(uint32_t filterId);
     DemuxInputStatus checkInputStatusChange(uint32_t availableToWrite, uint32_t availableToRead,
@@ -165,7 +187,23 @@ class Demux : public IDemux {
      * Each filter handler handles the data filtering/output writing/filterEvent updating.
      */
     bool readInputFMQ();
-    void startTsFilter(vector<uint8_t> data);
+    void startTsFilter(const vector<uint8_t>& data);
+    // Append the packet to the output of each filter listening to its PID,
+    // or to the batch of its descrambler.
+    // mPidTableLock must be held.
+    void startTsFilterLocked(const uint8_t* data, size_t size);
+    void dispatchTsPacketLocked(const uint8_t* data, size_t size);
+    // Descramble the batched packets and dispatch them to the filters.
+    // mPidTableLock must be held.
+    void flushDescrambleBatchesLocked();
+    void removeDescrambleBatchLocked(Descrambler* descrambler);
+    /**
+     * Add or remove a filter in the PID lookup table used by startTsFilter.
+     * A filter is in the table from configureFilter or startFilter until
+     * stopFilter or removeFilter.
+     */
+    void addFilterToPidTable(uint32_t filterId);
+    void removeFilterFromPidTable(uint32_t filterId);
     bool startFilterDispatcher();
     static void* __threadLoopFilter(void* data);
     static void* __threadLoopInput(void* user);
@@ -197,6 +235,26 @@ class Demux : public IDemux {
      * The array number is the filter ID.
      */
     vector<uint16_t> mFilterPids;
+    /**
+     * The ids of the filters listening to each PID. The array index is the PID.
+     */
+    static const uint16_t TS_PID_COUNT = 8192;
+    array<vector<uint32_t>, TS_PID_COUNT> mPidFilterIds;
+    /**
+     * The descrambler of each PID, or nullptr for the clear PIDs.
+     * The array index is the PID.
+     */
+    array<Descrambler*, TS_PID_COUNT> mPidDescramblers{};
+    /**
+     * The packets of a dispatch round waiting for their descrambler, so that
+     * each descrambler handles all its packets of the round in one call.
+     */
+    struct DescrambleBatch {
+        Descrambler* descrambler;
+        vector<uint8_t> packets;
+    };
+    vector<DescrambleBatch> mDescrambleBatches;
+    std::mutex mPidTableLock;
     vector<vector<uint8_t>> mFilterOutputs;
     vector<unique_ptr<FilterMQ>> mFilterMQs;
     vector<EventFlag*> mFilterEventFlags;
@@ -230,8 +288,7 @@ class Demux : public IDemux {
      */
     vector<bool> mFilterThreadRunning;
     bool mInputThreadRunning;
-    bool mBroadcastInputThreadRunning;
-    bool mKeepFetchingDataFromFrontend;
+    bool mBroadcastInputThreadRunning = false;
     /**
      * Lock to protect writes to the FMQs
      */
@@ -241,12 +298,24 @@ class Demux : public IDemux {
      */
     // TODO make each filter separate event lock
     std::mutex mFilterEventLock;
+    /**
+     * Signaled with mFilterEventLock when the dispatcher adds filter events
+     * or a filter is stopped
+     */
+    std::condition_variable mFilterEventCond;
     /**
      * Lock to protect writes to the input status
      */
     std::mutex mInputStatusLock;
     std::mutex mFilterStatusLock;
     std::mutex mBroadcastInputThreadLock;
+    /**
+     * The frontend stream blocks not dispatched yet, and the condition the
+     * broadcast input thread waits on for them
+     */
+    deque<shared_ptr<const vector<uint8_t>>> mBroadcastBlocks;
+    std::mutex mBroadcastInputWaitLock;
+    std::condition_variable mBroadcastInputCond;
     std::mutex mFilterThreadLock;
     std::mutex mInputThreadLock;
     /**
@@ -255,10 +324,138 @@ class Demux : public IDemux {
      */
     const uint16_t SECTION_WRITE_COUNT = 10;
 
-    // temp handle single PES filter
-    // TODO handle mulptiple Pes filters
-    int mPesSizeLeft = 0;
-    vector<uint8_t> mPesOutput;
+    /**
+     * PES reassembly state of a PES filter. The payload of the PES in progress
+     * is written to the filter FMQ as it arrives; the filter event is created
+     * once the PES is complete.
+     */
+    struct PesState {
+        bool assembling = false;
+        // PES_packet_length is 0: the PES ends where the next one starts
+        bool unbounded = false;
+        // Bytes of a bounded PES not received yet, header included
+        uint32_t sizeLeft = 0;
+        // Bytes of the PES in progress written to the filter FMQ and not
+        // reported in a filter event yet
+        uint32_t written = 0;
+        uint8_t streamId = 0;
+    };
+    /**
+     * A list of PES reassembly states. The array number is the filter ID.
+     */
+    vector<PesState> mPesStates;
+    // mFilterEventLock must be held
+    bool writePesDataLocked(uint32_t filterId, const uint8_t* data, size_t size);
+    void finishPesLocked(uint32_t filterId);
+
+    /**
+     * Section assembly state of a section filter, according to ISO/IEC 13818-1.
+     */
+    struct SectionState {
+        DemuxFilterSectionSettings settings;
+        bool assembling = false;
+        // The section in progress
+        vector<uint8_t> section;
+        /**
+         * Last version number sent for each section, keyed by table_id,
+         * table_id_extension and section_number. Used to suppress repeated
+         * sections unless settings.isRepeat is set.
+         */
+        map<uint32_t, uint8_t> versions;
+    };
+    /**
+     * A list of section assembly states. The array number is the filter ID.
+     */
+    vector<SectionState> mSectionStates;
+    // mFilterEventLock must be held
+    bool appendSectionDataLocked(uint32_t filterId, const uint8_t* data, size_t size);
+    bool outputSectionLocked(uint32_t filterId);
+    static bool matchSectionFilter(const DemuxFilterSectionBits& bits,
+                                   const vector<uint8_t>& section);
+
+    /**
+     * Indexing state of a record filter.
+     */
+    struct RecordState {
+        DemuxFilterRecordSettings settings;
+        // Packets recorded since the filter was configured
+        uint64_t packetNum = 0;
+        // transport_scrambling_control of the previous packet
+        uint8_t scramblingControl = 0;
+        // Video codec of the recorded stream, detected from its sequence headers
+        enum class Codec { UNKNOWN, MPEG2, H264 } codec = Codec::UNKNOWN;
+    };
+    /**
+     * A list of record indexing states. The array number is the filter ID.
+     */
+    vector<RecordState> mRecordStates;
+    static uint32_t getTsIndexMask(const uint8_t* packet, RecordState& state);
+    static uint32_t getScIndexMask(const uint8_t* payload, size_t size, RecordState& state);
+
+    /**
+     * Frame assembly state of an audio or video filter. Each PES carries one
+     * frame, whose elementary stream data goes to the AV memory of the
+     * filter when it has one, or else to the filter FMQ.
+     */
+    struct MediaState {
+        bool assembling = false;
+        // PES_packet_length is 0: the PES ends where the next one starts
+        bool unbounded = false;
+        // Bytes of a bounded PES not received yet, header included
+        uint32_t sizeLeft = 0;
+        uint64_t pts = 0;
+        // Bytes of the frame in progress not reported in a filter event yet
+        uint32_t written = 0;
+        // Where the frame in progress starts in the AV memory
+        size_t frameOffset = 0;
+    };
+    /**
+     * A list of frame assembly states. The array number is the filter ID.
+     */
+    vector<MediaState> mMediaStates;
+    /**
+     * Shared memory region an audio or video filter writes its frames to, so
+     * the decoder reads them in place. The frames are written one after the
+     * other and the region is reused from its start when full; the decoder
+     * must be done with a frame before the filter writes over it.
+     */
+    struct AvMemory {
+        int fd = -1;
+        uint8_t* data = nullptr;
+        size_t size = 0;
+        // Where the next frame goes
+        size_t writeOffset = 0;
+    };
+    /**
+     * A list of AV memories. The array number is the filter ID. Only the audio
+     * and video filters have one, when ro.vendor.tuner.av_memory_size is set.
+     */
+    vector<AvMemory> mAvMemories;
+    size_t mAvMemorySize = 0;
+    bool createAvMemory(uint32_t filterId);
+    void releaseAvMemory(uint32_t filterId);
+    // mFilterEventLock must be held
+    bool writeMediaDataLocked(uint32_t filterId, const uint8_t* data, size_t size);
+    void finishMediaFrameLocked(uint32_t filterId);
+
+    /**
+     * The record filters attached to the output. While the output is
+     * started their packets are gathered in mRecordBlock and written to the
+     * output FMQ one block of mRecordBlockSize bytes at a time, instead of
+     * going to the filter FMQs.
+     */
+    set<uint32_t> mOutputFilterIds;
+    vector<uint8_t> mRecordBlock;
+    size_t mRecordBlockSize = 0;
+    bool mOutputRunning = false;
+    DemuxOutputStatus mOutputStatus = DemuxOutputStatus::DATA_READY;
+    /**
+     * Lock to protect the record block and the output state
+     */
+    std::mutex mOutputLock;
+    // mOutputLock must be held
+    bool writeRecordBlockLocked();
+    void maySendOutputStatusCallbackLocked(bool overflow);
 };
 
 }  // namespace implementation
@@ -28,9 +28,37 @@ namespace tuner {
 namespace V1_0 {
 namespace implementation {
 
-Descrambler::Descrambler() {}
+AesCbcDescramblerEngine::AesCbcDescramblerEngine(const uint8_t* evenKey, const uint8_t* oddKey) {
+    AES_set_decrypt_key(evenKey, 128, &mEvenKey);
+    AES_set_decrypt_key(oddKey, 128, &mOddKey);
+}
+
+void AesCbcDescramblerEngine::descramble(uint8_t* packets, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint8_t* packet = packets + i * 188;
+        uint8_t scramblingControl = (packet[3] >> 6) & 0x3;
+        if (scramblingControl < 0x2) {
+            continue;
+        }
+        uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+        size_t payloadOffset = adaptationFieldControl == 0x3 ? 5 + packet[4] : 4;
+        if ((adaptationFieldControl & 0x1) != 0 && payloadOffset < 188) {
+            size_t size = (188 - payloadOffset) / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+            uint8_t iv[AES_BLOCK_SIZE] = {};
+            AES_cbc_encrypt(packet + payloadOffset, packet + payloadOffset, size,
+                            scramblingControl == 0x2 ? &mEvenKey : &mOddKey, iv, AES_DECRYPT);
+        }
+        packet[3] &= 0x3f;
+    }
+}
 
-Descrambler::~Descrambler() {}
+Descrambler::Descrambler(sp<Tuner> tuner) {
+    mTunerService = tuner;
+}
+
+Descrambler::~Descrambler() {
+    detachPids();
+}
 
 Return<Result> Descrambler::setDemuxSource(uint32_t demuxId) {
     ALOGV("%s", __FUNCTION__);
@@ -38,37 +66,103 @@ Return<Result> Descrambler::setDemuxSource(uint32_t demuxId) {
         ALOGW("[   WARN   ] Descrambler has already been set with a demux id %d", mSourceDemuxId);
         return Result::INVALID_STATE;
     }
+    sp<Demux> demux = mTunerService == nullptr ? nullptr : mTunerService->getDemuxById(demuxId);
+    if (demux == nullptr) {
+        ALOGW("[   WARN   ] Descrambler source demux %d isn't available", demuxId);
+        return Result::INVALID_ARGUMENT;
+    }
     mDemuxSet = true;
     mSourceDemuxId = demuxId;
+    mDemux = demux;
+    attachPids();
 
     return Result::SUCCESS;
 }
 
-Return<Result> Descrambler::setKeyToken(const hidl_vec<uint8_t>& /* keyToken */) {
+Return<Result> Descrambler::setKeyToken(const hidl_vec<uint8_t>& keyToken) {
     ALOGV("%s", __FUNCTION__);
 
+    // The default implementation takes the AES-128 keys themselves as the token:
+    // one key for both the even and the odd packets, or the even key followed
+    // by the odd key
+    if (keyToken.size() == AES_BLOCK_SIZE) {
+        setEngine(std::make_unique<AesCbcDescramblerEngine>(keyToken.data(), keyToken.data()));
+    } else if (keyToken.size() == 2 * AES_BLOCK_SIZE) {
+        setEngine(std::make_unique<AesCbcDescramblerEngine>(keyToken.data(),
+                                                            keyToken.data() + AES_BLOCK_SIZE));
+    } else {
+        ALOGW("[   WARN   ] Unsupported key token of %zu bytes", keyToken.size());
+        return Result::INVALID_ARGUMENT;
+    }
+
     return Result::SUCCESS;
 }
 
-Return<Result> Descrambler::addPid(uint16_t /* pid */) {
+Return<Result> Descrambler::addPid(uint16_t pid) {
     ALOGV("%s", __FUNCTION__);
 
+    mPids.insert(pid);
+    if (mDemux != nullptr) {
+        mDemux->setPidDescrambler(pid, this);
+    }
+
     return Result::SUCCESS;
 }
 
-Return<Result> Descrambler::removePid(uint16_t /* pid */) {
+Return<Result> Descrambler::removePid(uint16_t pid) {
     ALOGV("%s", __FUNCTION__);
 
+    if (mPids.erase(pid) == 0) {
+        return Result::INVALID_ARGUMENT;
+    }
+    if (mDemux != nullptr) {
+        mDemux->clearPidDescrambler(pid, this);
+    }
+
     return Result::SUCCESS;
 }
 
 Return<Result> Descrambler::close() {
     ALOGV("%s", __FUNCTION__);
+    detachPids();
+    mPids.clear();
+    mDemux = nullptr;
     mDemuxSet = false;
+    setEngine(nullptr);
 
     return Result::SUCCESS;
 }
 
+void Descrambler::setEngine(unique_ptr<DescramblerEngine> engine) {
+    std::lock_guard<std::mutex> lock(mEngineLock);
+    mEngine = std::move(engine);
+}
+
+void Descrambler::descramble(uint8_t* packets, size_t count) {
+    std::lock_guard<std::mutex> lock(mEngineLock);
+    if (mEngine != nullptr) {
+        mEngine->descramble(packets, count);
+    }
+}
+
+void Descrambler::attachPids() {
+    if (mDemux == nullptr) {
+        return;
+    }
+    for (uint16_t pid : mPids) {
+        mDemux->setPidDescrambler(pid, this);
+    }
+}
+
+void Descrambler::detachPids() {
+    if (mDemux == nullptr) {
+        return;
+    }
+    for (uint16_t pid : mPids) {
+        mDemux->clearPidDescrambler(pid, this);
+    }
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace tuner
@@ -19,6 +19,12 @@
 
 #include <android/hardware/tv/tuner/1.0/IDescrambler.h>
 #include <android/hardware/tv/tuner/1.0/ITuner.h>
+#include <openssl/aes.h>
+#include <memory>
+#include <mutex>
+#include <set>
+#include "Demux.h"
+#include "Tuner.h"
 
 using namespace std;
 
@@ -32,9 +38,41 @@ namespace implementation {
 using ::android::hardware::tv::tuner::V1_0::IDescrambler;
 using ::android::hardware::tv::tuner::V1_0::Result;
 
+class Demux;
+class Tuner;
+
+/**
+ * A descrambling engine working on whole batches of 188 byte TS packets.
+ *
+ * The engine descrambles the scrambled packets in place and clears their
+ * transport_scrambling_control. Clear packets are left unchanged.
+ */
+class DescramblerEngine {
+  public:
+    virtual ~DescramblerEngine() {}
+    virtual void descramble(uint8_t* packets, size_t count) = 0;
+};
+
+/**
+ * AES-128 in CBC mode over the whole 16 byte blocks of the payload, with a
+ * zero IV for each packet and the residual bytes in the clear, as in
+ * ATIS-0800006 (IDSA). The even and odd keys select on the scrambling
+ * control. BoringSSL picks the AES-NI or ARMv8 crypto extension code when
+ * the CPU has it.
+ */
+class AesCbcDescramblerEngine : public DescramblerEngine {
+  public:
+    AesCbcDescramblerEngine(const uint8_t* evenKey, const uint8_t* oddKey);
+    virtual void descramble(uint8_t* packets, size_t count) override;
+
+  private:
+    AES_KEY mEvenKey;
+    AES_KEY mOddKey;
+};
+
 class Descrambler : public IDescrambler {
   public:
-    Descrambler();
+    Descrambler(sp<Tuner> tuner);
 
     virtual Return<Result> setDemuxSource(uint32_t demuxId) override;
 
@@ -46,10 +84,34 @@ class Descrambler : public IDescrambler {
 
     virtual Return<Result> close() override;
 
+    /**
+     * Replace the descrambling engine, e.g. with a CAS specific one. Without
+     * an engine the packets go to the filters scrambled.
+     */
+    void setEngine(unique_ptr<DescramblerEngine> engine);
+
+    /**
+     * Descramble a batch of packets of the added PIDs. Called by the source
+     * demux once per dispatch round.
+     */
+    void descramble(uint8_t* packets, size_t count);
+
   private:
     virtual ~Descrambler();
+    // Route or stop routing the added PIDs of the source demux through this descrambler
+    void attachPids();
+    void detachPids();
+
+    sp<Tuner> mTunerService;
+    sp<Demux> mDemux;
     uint32_t mSourceDemuxId;
     bool mDemuxSet = false;
+    set<uint16_t> mPids;
+    unique_ptr<DescramblerEngine> mEngine;
+    /**
+     * Lock to protect the engine, used by the demux dispatch thread
+     */
+    std::mutex mEngineLock;
 };
 
 }  // namespace implementation
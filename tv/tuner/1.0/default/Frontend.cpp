@@ -18,6 +18,11 @@
 
 #include "Frontend.h"
 #include <android/hardware/tv/tuner/1.0/IFrontendCallback.h>
+#include <cutils/properties.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "Demux.h"
 #include <utils/Log.h>
 
 namespace android {
@@ -27,6 +32,10 @@ namespace tuner {
 namespace V1_0 {
 namespace implementation {
 
+// The stream is delivered at the frontend bitrate in ticks of this length
+#define BROADCAST_TICK_MS 10
+#define DEFAULT_BROADCAST_BITRATE 1000000
+
 Frontend::Frontend(FrontendType type, FrontendId id, sp<Tuner> tuner) {
     mType = type;
     mId = id;
@@ -41,6 +50,10 @@ Return<Result> Frontend::close() {
     ALOGV("%s", __FUNCTION__);
     // Reset callback
     mCallback = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mDistributorControlLock);
+        stopDistributorLocked();
+    }
 
     return Result::SUCCESS;
 }
@@ -73,7 +86,8 @@ Return<Result> Frontend::tune(const FrontendSettings& /* settings */) {
 Return<Result> Frontend::stopTune() {
     ALOGV("%s", __FUNCTION__);
 
-    mTunerService->frontendStopTune(mId);
+    std::lock_guard<std::mutex> lock(mDistributorControlLock);
+    stopDistributorLocked();
 
     return Result::SUCCESS;
 }
@@ -124,6 +138,144 @@ string Frontend::getSourceFile() {
     return mSourceStreamFile;
 }
 
+void Frontend::attachDemux(uint32_t demuxId, const sp<Demux>& demux) {
+    std::lock_guard<std::mutex> controlLock(mDistributorControlLock);
+    bool start;
+    {
+        std::lock_guard<std::mutex> lock(mDistributorLock);
+        mDemuxes[demuxId] = demux;
+        start = !mDistributorRunning;
+        mDistributorRunning = true;
+    }
+    if (!start) {
+        return;
+    }
+
+    // Reap the previous distributor, which ended with its stream
+    if (mDistributorThreadStarted) {
+        pthread_join(mDistributorThread, NULL);
+    }
+    pthread_create(&mDistributorThread, NULL, __threadLoopDistributor, this);
+    pthread_setname_np(mDistributorThread, "frontend_distributor_thread");
+    mDistributorThreadStarted = true;
+}
+
+void Frontend::detachDemux(uint32_t demuxId) {
+    std::lock_guard<std::mutex> controlLock(mDistributorControlLock);
+    bool last;
+    {
+        std::lock_guard<std::mutex> lock(mDistributorLock);
+        mDemuxes.erase(demuxId);
+        last = mDemuxes.empty();
+    }
+    if (last) {
+        stopDistributorLocked();
+    }
+}
+
+void Frontend::stopDistributorLocked() {
+    vector<sp<Demux>> demuxes;
+    {
+        std::lock_guard<std::mutex> lock(mDistributorLock);
+        mDistributorRunning = false;
+        for (auto& it : mDemuxes) {
+            sp<Demux> demux = it.second.promote();
+            if (demux != nullptr) {
+                demuxes.push_back(demux);
+            }
+        }
+        mDemuxes.clear();
+    }
+    mDistributorCond.notify_all();
+    if (mDistributorThreadStarted) {
+        pthread_join(mDistributorThread, NULL);
+        mDistributorThreadStarted = false;
+    }
+
+    // End the stream of the demuxes still attached
+    for (auto& demux : demuxes) {
+        demux->pushBroadcastBlock(nullptr);
+    }
+}
+
+void* Frontend::__threadLoopDistributor(void* user) {
+    Frontend* const self = static_cast<Frontend*>(user);
+    self->distributorThreadLoop();
+    return 0;
+}
+
+void Frontend::distributorThreadLoop() {
+    // open the stream
+    std::ifstream inputData(mSourceStreamFile, std::ifstream::binary);
+    // TODO take the packet size and the bitrate from the frontend setting
+    int packetSize = 188;
+    int64_t bitrate = property_get_int64("ro.vendor.tuner.broadcast_bitrate",
+                                         DEFAULT_BROADCAST_BITRATE);
+    int tickPacketAmount =
+            std::max<int64_t>(1, bitrate / 8 * BROADCAST_TICK_MS / 1000 / packetSize);
+    ALOGW("[Frontend] stream distributor start %s", mSourceStreamFile.c_str());
+    if (!inputData.is_open()) {
+        ALOGW("[Frontend] Error %s", strerror(errno));
+    }
+
+    auto nextTick = std::chrono::steady_clock::now();
+    bool endOfStream = !inputData.is_open();
+    while (!endOfStream) {
+        // Read the packets of one tick once, for all the demuxes
+        auto block = std::make_shared<vector<uint8_t>>(packetSize * tickPacketAmount);
+        inputData.read(reinterpret_cast<char*>(block->data()), block->size());
+        block->resize(inputData.gcount() / packetSize * packetSize);
+        endOfStream = !inputData;
+
+        vector<sp<Demux>> demuxes;
+        {
+            std::lock_guard<std::mutex> lock(mDistributorLock);
+            if (!mDistributorRunning) {
+                break;
+            }
+            for (auto& it : mDemuxes) {
+                sp<Demux> demux = it.second.promote();
+                if (demux != nullptr) {
+                    demuxes.push_back(demux);
+                }
+            }
+        }
+        if (!block->empty()) {
+            for (auto& demux : demuxes) {
+                demux->pushBroadcastBlock(block);
+            }
+        }
+
+        // Wait for the next tick, or until the distributor is stopped
+        nextTick += std::chrono::milliseconds(BROADCAST_TICK_MS);
+        std::unique_lock<std::mutex> lock(mDistributorLock);
+        mDistributorCond.wait_until(lock, nextTick, [this] { return !mDistributorRunning; });
+    }
+
+    // At the end of the stream detach all the demuxes, unless stopped. The
+    // next attached demux restarts the stream.
+    vector<sp<Demux>> demuxes;
+    {
+        std::lock_guard<std::mutex> lock(mDistributorLock);
+        if (mDistributorRunning) {
+            mDistributorRunning = false;
+            for (auto& it : mDemuxes) {
+                sp<Demux> demux = it.second.promote();
+                if (demux != nullptr) {
+                    demuxes.push_back(demux);
+                }
+            }
+            mDemuxes.clear();
+        }
+    }
+    for (auto& demux : demuxes) {
+        demux->pushBroadcastBlock(nullptr);
+    }
+
+    ALOGW("[Frontend] stream distributor end.");
+    inputData.close();
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace tuner
@@ -18,8 +18,12 @@
 #define ANDROID_HARDWARE_TV_TUNER_V1_0_FRONTEND_H_
 
 #include <android/hardware/tv/tuner/1.0/IFrontend.h>
+#include <condition_variable>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include "Tuner.h"
 
 using namespace std;
@@ -38,6 +42,7 @@ using ::android::hardware::tv::tuner::V1_0::IFrontendCallback;
 using ::android::hardware::tv::tuner::V1_0::Result;
 
 class Tuner;
+class Demux;
 
 class Frontend : public IFrontend {
   public:
@@ -68,8 +73,25 @@ class Frontend : public IFrontend {
 
     string getSourceFile();
 
+    /**
+     * Add or remove a demux receiving the stream of this frontend.
+     *
+     * The frontend reads its stream once, in blocks of packets shared by
+     * all the attached demuxes, and pushes each block to every demux with
+     * Demux::pushBroadcastBlock. The stream distributor thread starts with
+     * the first attached demux and stops with the last detached one.
+     */
+    void attachDemux(uint32_t demuxId, const sp<Demux>& demux);
+    void detachDemux(uint32_t demuxId);
+
   private:
     virtual ~Frontend();
+    static void* __threadLoopDistributor(void* user);
+    void distributorThreadLoop();
+    // Stop the distributor and end the stream of the attached demuxes.
+    // mDistributorControlLock must be held
+    void stopDistributorLocked();
+
     sp<IFrontendCallback> mCallback;
     sp<Tuner> mTunerService;
     FrontendType mType = FrontendType::UNDEFINED;
@@ -78,6 +100,25 @@ class Frontend : public IFrontend {
     const string FRONTEND_STREAM_FILE = "/vendor/etc/test1.ts";
     string mSourceStreamFile;
     std::ifstream mFrontendData;
+
+    /**
+     * The demuxes attached to the stream distributor, by demux ID. They are
+     * held weakly since each demux holds its frontend.
+     */
+    std::map<uint32_t, wp<Demux>> mDemuxes;
+    pthread_t mDistributorThread;
+    bool mDistributorThreadStarted = false;
+    bool mDistributorRunning = false;
+    /**
+     * Lock to protect mDemuxes and mDistributorRunning. The distributor
+     * waits on mDistributorCond for its next delivery tick.
+     */
+    std::mutex mDistributorLock;
+    std::condition_variable mDistributorCond;
+    /**
+     * Serializes starting and stopping the distributor thread
+     */
+    std::mutex mDistributorControlLock;
 };
 
 }  // namespace implementation
@@ -100,7 +100,7 @@ Return<void> Tuner::getDemuxCaps(getDemuxCaps_cb _hidl_cb) {
 Return<void> Tuner::openDescrambler(openDescrambler_cb _hidl_cb) {
     ALOGV("%s", __FUNCTION__);
 
-    sp<IDescrambler> descrambler = new Descrambler();
+    sp<IDescrambler> descrambler = new Descrambler(this);
 
     _hidl_cb(Result::SUCCESS, descrambler);
     return Void();
@@ -139,17 +139,14 @@ sp<Frontend> Tuner::getFrontendById(uint32_t frontendId) {
     return mFrontends[frontendId];
 }
 
-void Tuner::setFrontendAsDemuxSource(uint32_t frontendId, uint32_t demuxId) {
-    mFrontendToDemux[frontendId] = demuxId;
-}
+sp<Demux> Tuner::getDemuxById(uint32_t demuxId) {
+    ALOGV("%s", __FUNCTION__);
 
-void Tuner::frontendStopTune(uint32_t frontendId) {
-    map<uint32_t, uint32_t>::iterator it = mFrontendToDemux.find(frontendId);
-    uint32_t demuxId;
-    if (it != mFrontendToDemux.end()) {
-        demuxId = it->second;
-        mDemuxes[demuxId]->stopBroadcastInput();
+    map<uint32_t, sp<Demux>>::iterator it = mDemuxes.find(demuxId);
+    if (it == mDemuxes.end()) {
+        return nullptr;
     }
+    return it->second;
 }
 
 }  // namespace implementation
@@ -57,15 +57,12 @@ class Tuner : public ITuner {
 
     sp<Frontend> getFrontendById(uint32_t frontendId);
 
-    void setFrontendAsDemuxSource(uint32_t frontendId, uint32_t demuxId);
-
-    void frontendStopTune(uint32_t frontendId);
+    sp<Demux> getDemuxById(uint32_t demuxId);
 
   private:
     virtual ~Tuner();
     // Static mFrontends array to maintain local frontends information
     vector<sp<Frontend>> mFrontends;
-    std::map<uint32_t, uint32_t> mFrontendToDemux;
     std::map<uint32_t, sp<Demux>> mDemuxes;
     // To maintain how many Frontends we have
     int mFrontendSize;
@@ -0,0 +1,512 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "Demux.h"
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+namespace V1_0 {
+namespace implementation {
+
+class DemuxBenchmark {
+  public:
+    static bool writeInput(Demux* demux, const std::vector<uint8_t>& data) {
+        return demux->mInputMQ->write(data.data(), data.size());
+    }
+
+    static void wakeInput(Demux* demux) {
+        demux->mInputEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
+    }
+
+    static bool readInputFMQ(Demux* demux) { return demux->readInputFMQ(); }
+
+    static bool dispatch(Demux* demux) { return demux->startFilterDispatcher(); }
+
+    static void clearFilterOutputs(Demux* demux) {
+        for (auto& output : demux->mFilterOutputs) {
+            output.clear();
+        }
+    }
+
+    // Consume what the filters produced, as the client would, and return the
+    // largest amount of data found in a filter FMQ
+    static size_t drainFilters(Demux* demux) {
+        size_t highWater = 0;
+        std::vector<uint8_t> buffer;
+        for (uint32_t filterId : demux->mUsedFilterIds) {
+            FilterMQ* queue = demux->mFilterMQs[filterId].get();
+            size_t size = queue->availableToRead();
+            highWater = std::max(highWater, size);
+            buffer.resize(size);
+            queue->read(buffer.data(), size);
+        }
+        std::lock_guard<std::mutex> lock(demux->mFilterEventLock);
+        for (auto& event : demux->mFilterEvents) {
+            event.events.resize(0);
+        }
+        return highWater;
+    }
+
+    // Consume the data of a filter and let its thread send the next event
+    static void consumeFilter(Demux* demux, uint32_t filterId) {
+        FilterMQ* queue = demux->mFilterMQs[filterId].get();
+        std::vector<uint8_t> buffer(queue->availableToRead());
+        queue->read(buffer.data(), buffer.size());
+        demux->mFilterEventFlags[filterId]->wake(
+                static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED));
+    }
+};
+
+namespace {
+
+constexpr uint8_t kPacketSize = 188;
+constexpr size_t kPacketsPerRead = 64;
+// The synthetic packets are spread over this many PIDs, starting at kFirstPid
+constexpr uint16_t kPidCount = 32;
+constexpr uint16_t kFirstPid = 0x100;
+// A synthetic PES spans this many packets
+constexpr size_t kPesPackets = 4;
+constexpr uint32_t kFilterBufferSize = 1024 * 1024;
+// Paced runs deliver the input in ticks of this length
+constexpr int kTickMs = 10;
+
+// The filters of a run, and the synthetic stream they receive
+enum Mix { TS_MIX, SECTION_MIX, PES_MIX, RECORD_MIX, MIXED_MIX };
+
+class DemuxCallback : public IDemuxCallback {
+  public:
+    Return<void> onFilterEvent(const DemuxFilterEvent&) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEventTime = std::chrono::steady_clock::now();
+        mEventReceived = true;
+        mEventCond.notify_all();
+        return Void();
+    }
+    Return<void> onFilterStatus(uint32_t, DemuxFilterStatus) override { return Void(); }
+    Return<void> onOutputStatus(DemuxOutputStatus) override { return Void(); }
+    Return<void> onInputStatus(DemuxInputStatus) override { return Void(); }
+
+    void resetEvent() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEventReceived = false;
+    }
+    // Wait for the next filter event and return when it was received
+    bool waitEvent(std::chrono::steady_clock::time_point* eventTime) {
+        std::unique_lock<std::mutex> lock(mLock);
+        auto received = [this] { return mEventReceived; };
+        if (!mEventCond.wait_for(lock, std::chrono::seconds(5), received)) {
+            return false;
+        }
+        *eventTime = mEventTime;
+        return true;
+    }
+
+  private:
+    std::mutex mLock;
+    std::condition_variable mEventCond;
+    bool mEventReceived = false;
+    std::chrono::steady_clock::time_point mEventTime;
+};
+
+uint32_t crc32Mpeg2(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= static_cast<uint32_t>(data[i]) << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+void writeSectionPacket(uint8_t* packet) {
+    // One 180 byte private section with CRC per packet, after a zero pointer_field
+    packet[1] |= 0x40;
+    uint8_t* section = packet + 5;
+    const uint16_t sectionLength = 177;
+    section[0] = 0x42;
+    section[1] = 0xb0 | (sectionLength >> 8);
+    section[2] = sectionLength & 0xff;
+    section[3] = 0x00;
+    section[4] = 0x01;
+    section[5] = 0xc1;  // version 0, current
+    section[6] = 0x00;
+    section[7] = 0x00;
+    uint32_t crc = crc32Mpeg2(section, 3 + sectionLength - 4);
+    uint8_t* crcField = section + 3 + sectionLength - 4;
+    crcField[0] = crc >> 24;
+    crcField[1] = crc >> 16;
+    crcField[2] = crc >> 8;
+    crcField[3] = crc;
+    packet[4] = 0;
+}
+
+void writePesPacket(uint8_t* packet, size_t index) {
+    if (index % kPesPackets != 0) {
+        return;
+    }
+    // The first packet of a bounded video PES with a PTS
+    packet[1] |= 0x40;
+    uint8_t* pes = packet + 4;
+    const uint16_t pesPacketLength = kPesPackets * (kPacketSize - 4) - 6;
+    pes[0] = 0x00;
+    pes[1] = 0x00;
+    pes[2] = 0x01;
+    pes[3] = 0xe0;
+    pes[4] = pesPacketLength >> 8;
+    pes[5] = pesPacketLength & 0xff;
+    pes[6] = 0x80;
+    pes[7] = 0x80;
+    pes[8] = 0x05;
+    pes[9] = 0x21;
+    pes[10] = 0x00;
+    pes[11] = 0x01;
+    pes[12] = 0x00;
+    pes[13] = 0x01;
+}
+
+Mix pidMix(Mix mix, size_t pidIndex) {
+    if (mix != MIXED_MIX) {
+        return mix;
+    }
+    static const Mix kMixes[] = {SECTION_MIX, PES_MIX, RECORD_MIX};
+    return kMixes[pidIndex % 3];
+}
+
+std::vector<uint8_t> makePackets(size_t count, Mix mix = TS_MIX) {
+    std::vector<uint8_t> packets(count * kPacketSize, 0xff);
+    for (size_t i = 0; i < count; i++) {
+        uint8_t* packet = packets.data() + i * kPacketSize;
+        size_t pidIndex = i % kPidCount;
+        uint16_t pid = kFirstPid + pidIndex;
+        packet[0] = 0x47;  // sync byte
+        packet[1] = (pid >> 8) & 0x1f;
+        packet[2] = pid & 0xff;
+        packet[3] = 0x10 | ((i / kPidCount) & 0xf);  // payload only
+        switch (pidMix(mix, pidIndex)) {
+            case SECTION_MIX:
+                writeSectionPacket(packet);
+                break;
+            case PES_MIX:
+            case RECORD_MIX:
+                writePesPacket(packet, i / kPidCount);
+                break;
+            default:
+                break;
+        }
+    }
+    return packets;
+}
+
+// The recorded stream given in TUNER_BENCHMARK_TS, in whole packets, or an
+// empty stream
+const std::vector<uint8_t>& recordedStream() {
+    static const std::vector<uint8_t> stream = [] {
+        std::vector<uint8_t> data;
+        const char* path = getenv("TUNER_BENCHMARK_TS");
+        if (path == nullptr) {
+            return data;
+        }
+        std::ifstream file(path, std::ifstream::binary);
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data.resize(data.size() / kPacketSize * kPacketSize);
+        return data;
+    }();
+    return stream;
+}
+
+// The PIDs of a stream, in the order they first appear
+std::vector<uint16_t> streamPids(const std::vector<uint8_t>& stream) {
+    std::vector<uint16_t> pids;
+    for (size_t i = 0; i + kPacketSize <= stream.size(); i += kPacketSize) {
+        uint16_t pid = ((stream[i + 1] & 0x1f) << 8) | stream[i + 2];
+        if (std::find(pids.begin(), pids.end(), pid) == pids.end()) {
+            pids.push_back(pid);
+        }
+    }
+    return pids;
+}
+
+DemuxFilterType filterType(Mix mix) {
+    switch (mix) {
+        case SECTION_MIX:
+            return DemuxFilterType::SECTION;
+        case PES_MIX:
+            return DemuxFilterType::PES;
+        case RECORD_MIX:
+            return DemuxFilterType::RECORD;
+        default:
+            return DemuxFilterType::TS;
+    }
+}
+
+DemuxFilterSettings filterSettings(DemuxFilterType type, uint16_t pid) {
+    DemuxFilterSettings settings;
+    switch (type) {
+        case DemuxFilterType::SECTION: {
+            DemuxFilterSectionSettings sectionSettings{};
+            sectionSettings.tpid = pid;
+            sectionSettings.isCheckCrc = true;
+            sectionSettings.isRepeat = true;
+            settings.section(sectionSettings);
+            break;
+        }
+        case DemuxFilterType::PES: {
+            DemuxFilterPesDataSettings pesSettings{};
+            pesSettings.tpid = pid;
+            settings.pesData(pesSettings);
+            break;
+        }
+        case DemuxFilterType::RECORD: {
+            DemuxFilterRecordSettings recordSettings{};
+            recordSettings.tpid = pid;
+            recordSettings.indexType = DemuxRecordIndexType::TS;
+            recordSettings.indexMask.tsIndexMask(
+                    static_cast<uint32_t>(DemuxTsIndex::PAYLOAD_UNIT_START_INDICATOR));
+            settings.record(recordSettings);
+            break;
+        }
+        default: {
+            DemuxFilterTsSettings tsSettings{};
+            tsSettings.tpid = pid;
+            settings.ts(tsSettings);
+            break;
+        }
+    }
+    return settings;
+}
+
+uint32_t addFilter(const sp<Demux>& demux, const sp<IDemuxCallback>& cb, DemuxFilterType type,
+                   uint16_t pid) {
+    uint32_t filterId = 0;
+    demux->addFilter(type, kFilterBufferSize, cb, [&](Result, uint32_t id) { filterId = id; });
+    demux->configureFilter(filterId, filterSettings(type, pid));
+    return filterId;
+}
+
+// A demux with an input FMQ of the given size and filterCount filters of the
+// mix, on the PIDs of the stream
+sp<Demux> createDemux(const sp<IDemuxCallback>& cb, size_t inputSize, Mix mix, int filterCount,
+                      const std::vector<uint8_t>& stream) {
+    sp<Demux> demux = new Demux(0, nullptr);
+    demux->addInput(inputSize, cb);
+    DemuxInputSettings inputSettings{};
+    inputSettings.packetSize = kPacketSize;
+    demux->configureInput(inputSettings);
+
+    std::vector<uint16_t> pids = streamPids(stream);
+    for (int i = 0; i < filterCount && !pids.empty(); i++) {
+        size_t pidIndex = i % pids.size();
+        addFilter(demux, cb, filterType(pidMix(mix, pidIndex)), pids[pidIndex]);
+    }
+    return demux;
+}
+
+int64_t threadCpuNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Measures the input dispatch in packets/s with the given number of filters, each on its own
+ * PID. Every iteration writes a batch of packets into the input FMQ and dispatches them. */
+void BM_ReadInputFMQ(benchmark::State& state) {
+    const int filterCount = state.range(0);
+    sp<DemuxCallback> cb = new DemuxCallback();
+    const std::vector<uint8_t> packets = makePackets(kPacketsPerRead);
+    sp<Demux> demux = createDemux(cb, kPacketSize * kPacketsPerRead * 2, TS_MIX, filterCount,
+                                  packets);
+
+    int64_t start = threadCpuNs();
+    for (auto _ : state) {
+        DemuxBenchmark::writeInput(demux.get(), packets);
+        benchmark::DoNotOptimize(DemuxBenchmark::readInputFMQ(demux.get()));
+        DemuxBenchmark::clearFilterOutputs(demux.get());
+    }
+    state.SetItemsProcessed(state.iterations() * kPacketsPerRead);
+    state.counters["cpu_ns_per_packet"] = static_cast<double>(threadCpuNs() - start) /
+                                          (state.iterations() * kPacketsPerRead);
+
+    demux->close();
+}
+BENCHMARK(BM_ReadInputFMQ)->RangeMultiplier(4)->Range(1, 64);
+
+/* Measures the input dispatch and the filter handlers for a mix of filter types: TS, section,
+ * PES, record or all of section, PES and record. Every iteration dispatches a batch of packets
+ * and consumes the filter output as a client would. */
+void BM_FilterMix(benchmark::State& state) {
+    const Mix mix = static_cast<Mix>(state.range(0));
+    const int filterCount = state.range(1);
+    sp<DemuxCallback> cb = new DemuxCallback();
+    const std::vector<uint8_t> packets = makePackets(kPacketsPerRead * kPesPackets, mix);
+    sp<Demux> demux = createDemux(cb, packets.size() * 2, mix, filterCount, packets);
+
+    size_t highWater = 0;
+    int64_t cpuNs = 0;
+    for (auto _ : state) {
+        int64_t start = threadCpuNs();
+        DemuxBenchmark::writeInput(demux.get(), packets);
+        DemuxBenchmark::readInputFMQ(demux.get());
+        benchmark::DoNotOptimize(DemuxBenchmark::dispatch(demux.get()));
+        cpuNs += threadCpuNs() - start;
+        highWater = std::max(highWater, DemuxBenchmark::drainFilters(demux.get()));
+    }
+    size_t packetCount = packets.size() / kPacketSize;
+    state.SetItemsProcessed(state.iterations() * packetCount);
+    state.counters["cpu_ns_per_packet"] =
+            static_cast<double>(cpuNs) / (state.iterations() * packetCount);
+    state.counters["fmq_high_water_bytes"] = highWater;
+
+    demux->close();
+}
+void filterMixArgs(benchmark::internal::Benchmark* b) {
+    for (int mix : {SECTION_MIX, PES_MIX, RECORD_MIX, MIXED_MIX}) {
+        for (int filterCount : {1, 8, 64}) {
+            b->Args({mix, filterCount});
+        }
+    }
+}
+BENCHMARK(BM_FilterMix)->ArgNames({"mix", "filters"})->Apply(filterMixArgs);
+
+/* Feeds the demux at the given bitrate in Mbit/s, in ticks as the broadcast input does, and
+ * reports the share of a CPU the dispatch takes. Uses the stream of TUNER_BENCHMARK_TS when set,
+ * or else a synthetic mix of section, PES and record filters. */
+void BM_PacedInput(benchmark::State& state) {
+    const int64_t bitrate = state.range(0) * 1000000;
+    const size_t tickPackets = std::max<int64_t>(1, bitrate / 8 * kTickMs / 1000 / kPacketSize);
+    const std::vector<uint8_t>& recorded = recordedStream();
+    const std::vector<uint8_t> stream =
+            recorded.empty() ? makePackets(tickPackets * kPesPackets, MIXED_MIX) : recorded;
+    sp<DemuxCallback> cb = new DemuxCallback();
+    sp<Demux> demux = createDemux(cb, tickPackets * kPacketSize * 2, MIXED_MIX, 8, stream);
+
+    size_t offset = 0;
+    size_t highWater = 0;
+    int64_t cpuNs = 0;
+    std::vector<uint8_t> tick(tickPackets * kPacketSize);
+    auto nextTick = std::chrono::steady_clock::now();
+    for (auto _ : state) {
+        for (size_t i = 0; i < tick.size(); i += kPacketSize) {
+            std::copy(stream.begin() + offset, stream.begin() + offset + kPacketSize,
+                      tick.begin() + i);
+            offset = (offset + kPacketSize) % stream.size();
+        }
+        int64_t start = threadCpuNs();
+        DemuxBenchmark::writeInput(demux.get(), tick);
+        DemuxBenchmark::readInputFMQ(demux.get());
+        DemuxBenchmark::dispatch(demux.get());
+        cpuNs += threadCpuNs() - start;
+        highWater = std::max(highWater, DemuxBenchmark::drainFilters(demux.get()));
+
+        nextTick += std::chrono::milliseconds(kTickMs);
+        std::this_thread::sleep_until(nextTick);
+    }
+    state.SetItemsProcessed(state.iterations() * tickPackets);
+    state.counters["cpu_load"] =
+            static_cast<double>(cpuNs) / (state.iterations() * kTickMs * 1000000.0);
+    state.counters["cpu_ns_per_packet"] =
+            static_cast<double>(cpuNs) / (state.iterations() * tickPackets);
+    state.counters["fmq_high_water_bytes"] = highWater;
+
+    demux->close();
+}
+BENCHMARK(BM_PacedInput)->Arg(4)->Arg(20)->Arg(80)->Iterations(100)->UseRealTime();
+
+/* Times one PES from the client writing it into the input FMQ to the onFilterEvent callback,
+ * through the input and filter threads. With zap set, the time also covers configuring and
+ * starting the filter on a new PID, as a channel change does. */
+void filterEventLatency(benchmark::State& state, bool zap) {
+    sp<DemuxCallback> cb = new DemuxCallback();
+    const std::vector<uint8_t> packets = makePackets(kPesPackets * kPidCount, PES_MIX);
+    sp<Demux> demux = new Demux(0, nullptr);
+    demux->addInput(packets.size() * 2, cb);
+    DemuxInputSettings inputSettings{};
+    inputSettings.packetSize = kPacketSize;
+    demux->configureInput(inputSettings);
+    demux->startInput();
+    uint32_t filterId = addFilter(demux, cb, DemuxFilterType::PES, kFirstPid);
+
+    int64_t maxLatencyUs = 0;
+    uint16_t pid = kFirstPid;
+    for (auto _ : state) {
+        cb->resetEvent();
+        auto start = std::chrono::steady_clock::now();
+        if (zap) {
+            pid = kFirstPid + (pid - kFirstPid + 1) % kPidCount;
+            demux->configureFilter(filterId, filterSettings(DemuxFilterType::PES, pid));
+            demux->startFilter(filterId);
+        } else {
+            demux->startFilter(filterId);
+            start = std::chrono::steady_clock::now();
+        }
+        DemuxBenchmark::writeInput(demux.get(), packets);
+        DemuxBenchmark::wakeInput(demux.get());
+
+        std::chrono::steady_clock::time_point eventTime;
+        if (!cb->waitEvent(&eventTime)) {
+            state.SkipWithError("no filter event");
+            break;
+        }
+        auto latency = std::chrono::duration<double>(eventTime - start);
+        state.SetIterationTime(latency.count());
+        maxLatencyUs = std::max<int64_t>(
+                maxLatencyUs,
+                std::chrono::duration_cast<std::chrono::microseconds>(eventTime - start).count());
+
+        DemuxBenchmark::consumeFilter(demux.get(), filterId);
+        demux->stopFilter(filterId);
+        DemuxBenchmark::drainFilters(demux.get());
+    }
+    state.counters["max_latency_us"] = maxLatencyUs;
+
+    demux->stopInput();
+    demux->close();
+}
+
+void BM_FilterEventLatency(benchmark::State& state) {
+    filterEventLatency(state, false);
+}
+BENCHMARK(BM_FilterEventLatency)->Iterations(50)->UseManualTime();
+
+void BM_ChannelZap(benchmark::State& state) {
+    filterEventLatency(state, true);
+}
+BENCHMARK(BM_ChannelZap)->Iterations(50)->UseManualTime();
+
+}  // namespace
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
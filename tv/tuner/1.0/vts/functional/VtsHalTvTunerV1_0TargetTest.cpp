@@ -34,6 +34,7 @@
 #include <hidlmemory/FrameworkUtils.h>
 #include <utils/Condition.h>
 #include <utils/Mutex.h>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <map>
@@ -253,7 +254,7 @@ class DemuxCallback : public IDemuxCallback {
     }
 
     void testOnFilterEvent(uint32_t filterId);
-    void testFilterDataOutput();
+    bool testFilterDataOutput();
     void stopInputThread();
 
     void startPlaybackInputThread(InputConf inputConf, MQDesc& inputMQDescriptor);
@@ -326,16 +327,17 @@ void DemuxCallback::startFilterEventThread(DemuxFilterEvent event) {
     pthread_setname_np(mFilterThread, "test_playback_input_loop");
 }
 
-void DemuxCallback::testFilterDataOutput() {
+bool DemuxCallback::testFilterDataOutput() {
     android::Mutex::Autolock autoLock(mMsgLock);
     while (mPidFilterOutputCount < 1) {
         if (-ETIMEDOUT == mMsgCondition.waitRelative(mMsgLock, WAIT_TIMEOUT)) {
             EXPECT_TRUE(false) << "filter output matching pid does not output within timeout";
-            return;
+            return false;
         }
     }
     mPidFilterOutputCount = 0;
     ALOGW("[vts] pass and stop");
+    return true;
 }
 
 void DemuxCallback::stopInputThread() {
@@ -523,8 +525,11 @@ class TunerHidlTest : public ::testing::VtsHalHidlTargetTestBase {
     ::testing::AssertionResult playbackDataFlowTest(vector<FilterConf> filterConf,
                                                     InputConf inputConf,
                                                     vector<string> goldenOutputFiles);
-    ::testing::AssertionResult broadcastDataFlowTest(vector<FilterConf> filterConf,
-                                                     vector<string> goldenOutputFiles);
+    // If zapLatency is not null, it receives the time from setting the frontend data source
+    // to the first filter output
+    ::testing::AssertionResult broadcastDataFlowTest(
+            vector<FilterConf> filterConf, vector<string> goldenOutputFiles,
+            std::chrono::milliseconds* zapLatency = nullptr);
 };
 
 ::testing::AssertionResult TunerHidlTest::createFrontend(int32_t frontendId) {
@@ -801,7 +806,8 @@ class TunerHidlTest : public ::testing::VtsHalHidlTargetTestBase {
 }
 
 ::testing::AssertionResult TunerHidlTest::broadcastDataFlowTest(
-        vector<FilterConf> filterConf, vector<string> /*goldenOutputFiles*/) {
+        vector<FilterConf> filterConf, vector<string> /*goldenOutputFiles*/,
+        std::chrono::milliseconds* zapLatency) {
     Result status;
     hidl_vec<FrontendId> feIds;
 
@@ -821,6 +827,7 @@ class TunerHidlTest : public ::testing::VtsHalHidlTargetTestBase {
     FrontendSettings settings;
     settings.dvbt(dvbt);
 
+    auto zapStart = std::chrono::steady_clock::now();
     if (createDemuxWithFrontend(feIds[0], settings) != ::testing::AssertionSuccess()) {
         return ::testing::AssertionFailure();
     }
@@ -846,6 +853,10 @@ class TunerHidlTest : public ::testing::VtsHalHidlTargetTestBase {
 
     // Data Verify Module
     mDemuxCallback->testFilterDataOutput();
+    if (zapLatency != nullptr) {
+        *zapLatency = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - zapStart);
+    }
 
     // Clean Up Module
     for (int i = 0; i <= filterIdsSize; i++) {
@@ -1051,6 +1062,81 @@ TEST_F(TunerHidlTest, BroadcastDataFlowWithPesFilterTest) {
     ASSERT_TRUE(broadcastDataFlowTest(filterConf, goldenOutputFiles));
 }
 
+TEST_F(TunerHidlTest, BroadcastChannelZapLatencyTest) {
+    description("Measure the time from tuning to the first PES filter output over channel zaps");
+
+    vector<FilterConf> filterConf;
+    filterConf.resize(1);
+
+    DemuxFilterSettings filterSetting;
+    DemuxFilterPesDataSettings pesFilterSetting{
+            .tpid = 18,
+    };
+    filterSetting.pesData(pesFilterSetting);
+    FilterConf pesFilterConf{
+            .type = DemuxFilterType::PES,
+            .setting = filterSetting,
+    };
+    filterConf[0] = pesFilterConf;
+
+    vector<string> goldenOutputFiles;
+
+    const int kZapCount = 3;
+    std::chrono::milliseconds maxLatency(0);
+    for (int i = 0; i < kZapCount; i++) {
+        std::chrono::milliseconds latency(0);
+        mUsedFilterIds.clear();
+        ASSERT_TRUE(broadcastDataFlowTest(filterConf, goldenOutputFiles, &latency));
+        ALOGI("[vts] channel zap %d latency %lld ms", i, static_cast<long long>(latency.count()));
+        maxLatency = std::max(maxLatency, latency);
+    }
+    RecordProperty("max_zap_latency_ms", static_cast<int>(maxLatency.count()));
+}
+
+TEST_F(TunerHidlTest, BroadcastSharedFrontendTest) {
+    description("Feed one frontend to two demuxes at the same time and get output from both");
+
+    FrontendDvbtSettings dvbt{
+            .frequency = 1000,
+    };
+    FrontendSettings settings;
+    settings.dvbt(dvbt);
+
+    DemuxFilterSettings filterSetting;
+    DemuxFilterPesDataSettings pesFilterSetting{
+            .tpid = 18,
+    };
+    filterSetting.pesData(pesFilterSetting);
+
+    ASSERT_TRUE(createDemuxWithFrontend(0, settings));
+    ASSERT_TRUE(addFilterToDemux(DemuxFilterType::PES, filterSetting));
+    ASSERT_TRUE(getFilterMQDescriptor(mFilterId));
+    mDemuxCallback->updateFilterMQ(mFilterId, mFilterMQDescriptor);
+    ASSERT_EQ(Result::SUCCESS, mDemux->startFilter(mFilterId));
+    sp<IDemux> firstDemux = mDemux;
+    sp<DemuxCallback> firstDemuxCallback = mDemuxCallback;
+    uint32_t firstFilterId = mFilterId;
+
+    // The second demux shares the frontend of the first one
+    mDemux = nullptr;
+    mDemuxCallback = nullptr;
+    ASSERT_TRUE(createDemux());
+    ASSERT_EQ(Result::SUCCESS, mDemux->setFrontendDataSource(0));
+    ASSERT_TRUE(addFilterToDemux(DemuxFilterType::PES, filterSetting));
+    ASSERT_TRUE(getFilterMQDescriptor(mFilterId));
+    mDemuxCallback->updateFilterMQ(mFilterId, mFilterMQDescriptor);
+    ASSERT_EQ(Result::SUCCESS, mDemux->startFilter(mFilterId));
+
+    ASSERT_TRUE(firstDemuxCallback->testFilterDataOutput()) << "no output on the first demux";
+    ASSERT_TRUE(mDemuxCallback->testFilterDataOutput()) << "no output on the second demux";
+
+    ASSERT_EQ(Result::SUCCESS, firstDemux->stopFilter(firstFilterId));
+    ASSERT_EQ(Result::SUCCESS, mDemux->stopFilter(mFilterId));
+    ASSERT_EQ(Result::SUCCESS, firstDemux->close());
+    ASSERT_EQ(Result::SUCCESS, mFrontend->stopTune());
+    ASSERT_TRUE(closeDemux());
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
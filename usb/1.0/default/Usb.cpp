@@ -15,11 +15,13 @@
  */
 #include <assert.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <iostream>
 #include <fstream>
 #include <pthread.h>
 #include <stdio.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <cutils/uevent.h>
@@ -38,6 +40,10 @@ namespace implementation {
 // Set by the signal handler to destroy the thread
 volatile bool destroyThread;
 
+// A role swap raises several uevents in a row; the ports they name are
+// re-read and reported once, this long after the first of them.
+#define UEVENT_DEBOUNCE_MS 50
+
 int32_t readFile(std::string filename, std::string& contents) {
     std::ifstream file(filename);
 
@@ -115,29 +121,14 @@ Return<void> Usb::switchRole(const hidl_string& portName,
     return Void();
 }
 
-Status getCurrentRoleHelper(std::string portName,
-        PortRoleType type, uint32_t &currentRole)  {
-    std::string filename;
-    std::string roleName;
-
-    if (type == PortRoleType::POWER_ROLE) {
-        filename = "/sys/class/dual_role_usb/" +
-            portName + "/power_role";
+Status convertStringToRole(const std::string& roleName, PortRoleType type,
+        uint32_t &currentRole) {
+    if (type == PortRoleType::POWER_ROLE)
         currentRole = static_cast<uint32_t>(PortPowerRole::NONE);
-    } else if (type == PortRoleType::DATA_ROLE) {
-        filename = "/sys/class/dual_role_usb/" +
-            portName + "/data_role";
+    else if (type == PortRoleType::DATA_ROLE)
         currentRole = static_cast<uint32_t> (PortDataRole::NONE);
-    } else if (type == PortRoleType::MODE) {
-        filename = "/sys/class/dual_role_usb/" +
-            portName + "/mode";
+    else
         currentRole = static_cast<uint32_t> (PortMode::NONE);
-    }
-
-    if (readFile(filename, roleName)) {
-        ALOGE("getCurrentRole: Failed to open filesystem node");
-        return Status::ERROR;
-    }
 
     if (roleName == "dfp")
         currentRole = static_cast<uint32_t> (PortMode::DFP);
@@ -160,6 +151,22 @@ Status getCurrentRoleHelper(std::string portName,
     return Status::SUCCESS;
 }
 
+/* Reads a role node kept open by the port cache; sysfs regenerates the
+ * contents on every read from offset 0. */
+Status readRoleNode(int fd, PortRoleType type, uint32_t &currentRole) {
+    char buf[32];
+    ssize_t len = TEMP_FAILURE_RETRY(pread(fd, buf, sizeof(buf) - 1, 0));
+
+    if (len < 0) {
+        ALOGE("getCurrentRole: Failed to read filesystem node");
+        return Status::ERROR;
+    }
+    buf[len] = '\0';
+    std::string roleName(buf);
+    roleName.erase(roleName.find_last_not_of("\n") + 1);
+    return convertStringToRole(roleName, type, currentRole);
+}
+
 Status getTypeCPortNamesHelper(std::vector<std::string>& names) {
     DIR *dp;
 
@@ -237,73 +244,135 @@ Status getPortModeHelper(const std::string portName, PortMode& portMode)  {
         return Status::SUCCESS;
 }
 
-Status getPortStatusHelper (hidl_vec<PortStatus>& currentPortStatus) {
+void Usb::removePortLocked(std::map<std::string, PortNodes>::iterator it) {
+    PortNodes& port = it->second;
+
+    if (port.powerRoleFd >= 0)
+        close(port.powerRoleFd);
+    if (port.dataRoleFd >= 0)
+        close(port.dataRoleFd);
+    if (port.modeFd >= 0)
+        close(port.modeFd);
+    mPorts.erase(it);
+}
+
+Status Usb::refreshPortLocked(PortNodes& port) {
+    uint32_t currentRole;
+
+    if (readRoleNode(port.powerRoleFd, PortRoleType::POWER_ROLE,
+            currentRole) == Status::SUCCESS) {
+        port.status.currentPowerRole = static_cast<PortPowerRole> (currentRole);
+    } else {
+        ALOGE("Error while retreiving current power role");
+        return Status::ERROR;
+    }
+
+    if (readRoleNode(port.dataRoleFd, PortRoleType::DATA_ROLE,
+            currentRole) == Status::SUCCESS) {
+        port.status.currentDataRole = static_cast<PortDataRole> (currentRole);
+    } else {
+        ALOGE("Error while retreiving current data role");
+        return Status::ERROR;
+    }
+
+    if (readRoleNode(port.modeFd, PortRoleType::MODE,
+            currentRole) == Status::SUCCESS) {
+        port.status.currentMode = static_cast<PortMode> (currentRole);
+    } else {
+        ALOGE("Error while retreiving current mode");
+        return Status::ERROR;
+    }
+    return Status::SUCCESS;
+}
+
+/* Brings mPorts in line with the ports in sysfs: drops ports that are gone,
+ * sets up new ones and re-reads every port's roles. */
+Status Usb::syncPortsLocked() {
     std::vector<std::string> names;
-    Status result = getTypeCPortNamesHelper(names);
-
-    if (result == Status::SUCCESS) {
-        currentPortStatus.resize(names.size());
-        for(std::vector<std::string>::size_type i = 0; i < names.size(); i++) {
-            ALOGI("%s", names[i].c_str());
-            currentPortStatus[i].portName = names[i];
-
-            uint32_t currentRole;
-            if (getCurrentRoleHelper(names[i], PortRoleType::POWER_ROLE,
-                    currentRole) == Status::SUCCESS) {
-                currentPortStatus[i].currentPowerRole =
-                static_cast<PortPowerRole> (currentRole);
-            } else {
-                ALOGE("Error while retreiving portNames");
-                goto done;
-            }
 
-            if (getCurrentRoleHelper(names[i],
-                    PortRoleType::DATA_ROLE, currentRole) == Status::SUCCESS) {
-                currentPortStatus[i].currentDataRole =
-                        static_cast<PortDataRole> (currentRole);
-            } else {
-                ALOGE("Error while retreiving current port role");
-                goto done;
-            }
+    if (getTypeCPortNamesHelper(names) != Status::SUCCESS)
+        return Status::ERROR;
 
-            if (getCurrentRoleHelper(names[i], PortRoleType::MODE,
-                    currentRole) == Status::SUCCESS) {
-                currentPortStatus[i].currentMode =
-                    static_cast<PortMode> (currentRole);
-            } else {
-                ALOGE("Error while retreiving current data role");
-                goto done;
-            }
+    std::set<std::string> present(names.begin(), names.end());
+    for (auto it = mPorts.begin(); it != mPorts.end();) {
+        auto next = std::next(it);
+        if (present.find(it->first) == present.end())
+            removePortLocked(it);
+        it = next;
+    }
 
-            currentPortStatus[i].canChangeMode =
-                canSwitchRoleHelper(names[i], PortRoleType::MODE);
-            currentPortStatus[i].canChangeDataRole =
-                canSwitchRoleHelper(names[i], PortRoleType::DATA_ROLE);
-            currentPortStatus[i].canChangePowerRole =
-                canSwitchRoleHelper(names[i], PortRoleType::POWER_ROLE);
+    for (const std::string& name : names) {
+        auto it = mPorts.find(name);
+        if (it == mPorts.end()) {
+            ALOGI("%s", name.c_str());
+            PortNodes& port = mPorts[name];
+            port.status.portName = name;
+            port.powerRoleFd = open(appendRoleNodeHelper(name,
+                PortRoleType::POWER_ROLE).c_str(), O_RDONLY | O_CLOEXEC);
+            port.dataRoleFd = open(appendRoleNodeHelper(name,
+                PortRoleType::DATA_ROLE).c_str(), O_RDONLY | O_CLOEXEC);
+            port.modeFd = open(appendRoleNodeHelper(name,
+                PortRoleType::MODE).c_str(), O_RDONLY | O_CLOEXEC);
+            port.status.canChangeMode =
+                canSwitchRoleHelper(name, PortRoleType::MODE);
+            port.status.canChangeDataRole =
+                canSwitchRoleHelper(name, PortRoleType::DATA_ROLE);
+            port.status.canChangePowerRole =
+                canSwitchRoleHelper(name, PortRoleType::POWER_ROLE);
 
             ALOGI("canChangeMode: %d canChagedata: %d canChangePower:%d",
-                currentPortStatus[i].canChangeMode,
-                currentPortStatus[i].canChangeDataRole,
-                currentPortStatus[i].canChangePowerRole);
-
-            if (getPortModeHelper(names[i], currentPortStatus[i].supportedModes)
-                  != Status::SUCCESS) {
-                ALOGE("Error while retrieving port modes");
-                goto done;
+                port.status.canChangeMode,
+                port.status.canChangeDataRole,
+                port.status.canChangePowerRole);
+
+            if (port.powerRoleFd < 0 || port.dataRoleFd < 0 || port.modeFd < 0 ||
+                    getPortModeHelper(name, port.status.supportedModes)
+                    != Status::SUCCESS) {
+                ALOGE("Error while setting up port %s", name.c_str());
+                // Set up again on the next sync, it may still be appearing.
+                removePortLocked(mPorts.find(name));
+                return Status::ERROR;
             }
+            it = mPorts.find(name);
         }
-        return Status::SUCCESS;
+        if (refreshPortLocked(it->second) != Status::SUCCESS)
+            return Status::ERROR;
     }
-done:
-    return Status::ERROR;
+    return Status::SUCCESS;
+}
+
+Status Usb::refreshPorts(const std::set<std::string>& portNames,
+        hidl_vec<PortStatus>& currentPortStatus) {
+    Status status = Status::SUCCESS;
+
+    pthread_mutex_lock(&mPortLock);
+    bool sync = portNames.empty();
+    for (const std::string& name : portNames) {
+        auto it = mPorts.find(name);
+        if (it == mPorts.end() ||
+                refreshPortLocked(it->second) != Status::SUCCESS) {
+            sync = true;
+            break;
+        }
+    }
+    if (sync)
+        status = syncPortsLocked();
+
+    if (status == Status::SUCCESS) {
+        currentPortStatus.resize(mPorts.size());
+        size_t i = 0;
+        for (const auto& port : mPorts)
+            currentPortStatus[i++] = port.second.status;
+    }
+    pthread_mutex_unlock(&mPortLock);
+    return status;
 }
 
 Return<void> Usb::queryPortStatus() {
     hidl_vec<PortStatus> currentPortStatus;
     Status status;
 
-    status = getPortStatusHelper(currentPortStatus);
+    status = refreshPorts(std::set<std::string>(), currentPortStatus);
     Return<void> ret = mCallback->notifyPortStatusChange(currentPortStatus,
        status);
     if (!ret.isOk())
@@ -314,12 +383,29 @@ Return<void> Usb::queryPortStatus() {
 struct data {
     int uevent_fd;
     android::hardware::usb::V1_0::implementation::Usb *usb;
+    // Ports named by the uevents of the current burst; an empty name stands
+    // for a uevent that did not say which port it is about.
+    std::set<std::string> pendingPorts;
+    // When the current burst is to be reported, 0 if there is none.
+    int64_t deadlineMs;
+    // What the callback was last told, to drop bursts that changed nothing.
+    hidl_vec<PortStatus> lastPortStatus;
+    bool lastValid;
 };
 
+static int64_t nowMs() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
 static void uevent_event(uint32_t /*epevents*/, struct data *payload) {
     char msg[UEVENT_MSG_LEN + 2];
     char *cp;
     int n;
+    bool matched = false;
+    std::string portName;
 
     n = uevent_kernel_multicast_recv(payload->uevent_fd, msg, UEVENT_MSG_LEN);
     if (n <= 0)
@@ -334,19 +420,45 @@ static void uevent_event(uint32_t /*epevents*/, struct data *payload) {
     while (*cp) {
         if (!strcmp(cp, "SUBSYSTEM=dual_role_usb")) {
             ALOGE("uevent received %s", cp);
-            if (payload->usb->mCallback != NULL) {
-                hidl_vec<PortStatus> currentPortStatus;
-                Status status = getPortStatusHelper(currentPortStatus);
-                Return<void> ret =
-                    payload->usb->mCallback->notifyPortStatusChange(currentPortStatus, status);
-                if (!ret.isOk())
-                    ALOGE("error %s", ret.description().c_str());
-            }
-            break;
+            matched = true;
+        } else if (!strncmp(cp, "DEVPATH=", strlen("DEVPATH="))) {
+            const char *name = strrchr(cp, '/');
+            portName = name ? name + 1 : "";
         }
         /* advance to after the next \0 */
         while (*cp++);
     }
+
+    if (matched) {
+        payload->pendingPorts.insert(portName);
+        if (payload->deadlineMs == 0)
+            payload->deadlineMs = nowMs() + UEVENT_DEBOUNCE_MS;
+    }
+}
+
+static void report_port_status(struct data *payload) {
+    hidl_vec<PortStatus> currentPortStatus;
+    std::set<std::string> portNames;
+
+    payload->deadlineMs = 0;
+    // An unnamed uevent needs all ports re-read, which an empty set asks for.
+    if (payload->pendingPorts.find("") == payload->pendingPorts.end())
+        portNames.swap(payload->pendingPorts);
+    payload->pendingPorts.clear();
+
+    Status status = payload->usb->refreshPorts(portNames, currentPortStatus);
+    if (status == Status::SUCCESS && payload->lastValid &&
+            currentPortStatus == payload->lastPortStatus)
+        return;
+
+    if (payload->usb->mCallback != NULL) {
+        Return<void> ret =
+            payload->usb->mCallback->notifyPortStatusChange(currentPortStatus, status);
+        if (!ret.isOk())
+            ALOGE("error %s", ret.description().c_str());
+    }
+    payload->lastValid = status == Status::SUCCESS;
+    payload->lastPortStatus = currentPortStatus;
 }
 
 void* work(void* param) {
@@ -366,6 +478,8 @@ void* work(void* param) {
 
     payload.uevent_fd = uevent_fd;
     payload.usb = (android::hardware::usb::V1_0::implementation::Usb *)param;
+    payload.deadlineMs = 0;
+    payload.lastValid = false;
 
     fcntl(uevent_fd, F_SETFL, O_NONBLOCK);
 
@@ -385,8 +499,14 @@ void* work(void* param) {
 
     while (!destroyThread) {
         struct epoll_event events[64];
+        int timeout = -1;
 
-        nevents = epoll_wait(epoll_fd, events, 64, -1);
+        if (payload.deadlineMs) {
+            int64_t remaining = payload.deadlineMs - nowMs();
+            timeout = remaining > 0 ? remaining : 0;
+        }
+
+        nevents = epoll_wait(epoll_fd, events, 64, timeout);
         if (nevents == -1) {
             if (errno == EINTR)
                 continue;
@@ -399,6 +519,9 @@ void* work(void* param) {
                 (*(void (*)(int, struct data *payload))events[n].data.ptr)
                     (events[n].events, &payload);
         }
+
+        if (payload.deadlineMs && nowMs() >= payload.deadlineMs)
+            report_port_status(&payload);
     }
 
     ALOGI("exiting worker thread");
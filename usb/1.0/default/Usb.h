@@ -6,6 +6,10 @@
 #include <hidl/Status.h>
 #include <log/log.h>
 
+#include <map>
+#include <set>
+#include <string>
+
 #ifdef LOG_TAG
 #undef LOG_TAG
 #endif
@@ -37,10 +41,33 @@ struct Usb : public IUsb {
     Return<void> setCallback(const sp<IUsbCallback>& callback) override;
     Return<void> queryPortStatus() override;
 
+    // Re-reads the ports in portNames, or every port if portNames is empty
+    // or names a port that is not known yet, and returns the status of all
+    // ports.
+    Status refreshPorts(const std::set<std::string>& portNames,
+            hidl_vec<PortStatus>& currentPortStatus);
+
     sp<IUsbCallback> mCallback;
     private:
+        // A port's role nodes are kept open, so that refreshing it costs a
+        // pread() per node. Its capabilities are read once, when it appears.
+        struct PortNodes {
+            int powerRoleFd = -1;
+            int dataRoleFd = -1;
+            int modeFd = -1;
+            PortStatus status;
+        };
+
+        Status refreshPortLocked(PortNodes& port);
+        Status syncPortsLocked();
+        void removePortLocked(std::map<std::string, PortNodes>::iterator it);
+
         pthread_t mPoll;
         pthread_mutex_t mLock = PTHREAD_MUTEX_INITIALIZER;
+        // Protects mPorts, which both the uevent thread and binder threads
+        // refresh.
+        pthread_mutex_t mPortLock = PTHREAD_MUTEX_INITIALIZER;
+        std::map<std::string, PortNodes> mPorts;
 };
 
 }  // namespace implementation
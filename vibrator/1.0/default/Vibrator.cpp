@@ -17,6 +17,7 @@
 #define LOG_TAG "VibratorService"
 
 #include <inttypes.h>
+#include <stdint.h>
 
 #include <log/log.h>
 
@@ -31,10 +32,11 @@ namespace vibrator {
 namespace V1_0 {
 namespace implementation {
 
-Vibrator::Vibrator(vibrator_device_t *device) : mDevice(device) {}
+Vibrator::Vibrator(vibrator_device_t *device) : mDevice(device), mWaveformPlayer(device) {}
 
 // Methods from ::android::hardware::vibrator::V1_0::IVibrator follow.
 Return<Status> Vibrator::on(uint32_t timeout_ms) {
+    mWaveformPlayer.cancel();
     int32_t ret = mDevice->vibrator_on(mDevice, timeout_ms);
     if (ret != 0) {
         ALOGE("on command failed : %s", strerror(-ret));
@@ -44,6 +46,7 @@ Return<Status> Vibrator::on(uint32_t timeout_ms) {
 }
 
 Return<Status> Vibrator::off()  {
+    mWaveformPlayer.cancel();
     int32_t ret = mDevice->vibrator_off(mDevice);
     if (ret != 0) {
         ALOGE("off command failed : %s", strerror(-ret));
@@ -60,8 +63,48 @@ Return<Status> Vibrator::setAmplitude(uint8_t) {
     return Status::UNSUPPORTED_OPERATION;
 }
 
-Return<void> Vibrator::perform(Effect, EffectStrength, perform_cb _hidl_cb) {
-    _hidl_cb(Status::UNSUPPORTED_OPERATION, 0);
+Return<void> Vibrator::perform(Effect effect, EffectStrength strength, perform_cb _hidl_cb) {
+    // The legacy device has no amplitude control, so weaker clicks are shorter instead.
+    uint32_t clickMs;
+    switch (strength) {
+        case EffectStrength::LIGHT:
+            clickMs = 10;
+            break;
+        case EffectStrength::MEDIUM:
+            clickMs = 20;
+            break;
+        case EffectStrength::STRONG:
+            clickMs = 30;
+            break;
+        default:
+            _hidl_cb(Status::UNSUPPORTED_OPERATION, 0);
+            return Void();
+    }
+
+    std::vector<uint32_t> timingsMs;
+    std::vector<uint8_t> amplitudes;
+    switch (effect) {
+        case Effect::CLICK:
+            timingsMs = {clickMs};
+            amplitudes = {UINT8_MAX};
+            break;
+        case Effect::DOUBLE_CLICK:
+            timingsMs = {clickMs, kDoubleClickGapMs, clickMs};
+            amplitudes = {UINT8_MAX, 0, UINT8_MAX};
+            break;
+        default:
+            _hidl_cb(Status::UNSUPPORTED_OPERATION, 0);
+            return Void();
+    }
+
+    Status status = mWaveformPlayer.play(timingsMs, amplitudes, -1, nullptr);
+    uint32_t lengthMs = 0;
+    if (status == Status::OK) {
+        for (uint32_t ms : timingsMs) {
+            lengthMs += ms;
+        }
+    }
+    _hidl_cb(status, lengthMs);
     return Void();
 }
 
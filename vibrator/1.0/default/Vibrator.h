@@ -20,6 +20,9 @@
 #include <hidl/Status.h>
 
 #include <hidl/MQDescriptor.h>
+
+#include "WaveformPlayer.h"
+
 namespace android {
 namespace hardware {
 namespace vibrator {
@@ -34,10 +37,14 @@ struct Vibrator : public IVibrator {
   Return<Status> off()  override;
   Return<bool> supportsAmplitudeControl() override;
   Return<Status> setAmplitude(uint8_t amplitude) override;
+  // Plays the effect as a waveform, see WaveformPlayer; on() and off() cancel it.
   Return<void> perform(Effect effect, EffectStrength strength, perform_cb _hidl_cb) override;
 
 private:
+  static constexpr uint32_t kDoubleClickGapMs = 100;
+
   vibrator_device_t    *mDevice;
+  WaveformPlayer       mWaveformPlayer;
 };
 
 extern "C" IVibrator* HIDL_FETCH_IVibrator(const char* name);
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VibratorService"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <log/log.h>
+
+#include "WaveformPlayer.h"
+
+namespace android {
+namespace hardware {
+namespace vibrator {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+constexpr int kRealtimePriority = 2;
+
+// Cancellation is only noticed while waiting on the condition variable; the
+// last stretch before each deadline is slept with clock_nanosleep.
+constexpr std::chrono::microseconds kFineSleep{1000};
+
+void addMs(timespec* ts, uint32_t ms) {
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += static_cast<long>(ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+// Length of the run of non-zero steps starting at step, up to the end of the pattern.
+uint32_t onDurationMs(const std::vector<uint32_t>& timingsMs,
+                      const std::vector<uint8_t>& amplitudes, size_t step) {
+    uint64_t duration = 0;
+    for (; step < timingsMs.size() && amplitudes[step] != 0; step++) {
+        duration += timingsMs[step];
+    }
+    return static_cast<uint32_t>(std::min<uint64_t>(duration, UINT32_MAX));
+}
+
+}  // namespace
+
+WaveformPlayer::WaveformPlayer(vibrator_device_t* device) : mDevice(device) {}
+
+WaveformPlayer::~WaveformPlayer() {
+    CompletionCallback pending;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExiting = true;
+        if (mPending) {
+            pending = std::move(mPendingWaveform.callback);
+            mPending = false;
+        }
+        if (mActive) {
+            mDevice->vibrator_off(mDevice);
+            mActive = false;
+        }
+    }
+    mCondition.notify_all();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+    if (pending) {
+        pending(false);
+    }
+}
+
+Status WaveformPlayer::play(const std::vector<uint32_t>& timingsMs,
+                            const std::vector<uint8_t>& amplitudes, int32_t repeat,
+                            CompletionCallback callback) {
+    if (timingsMs.empty() || timingsMs.size() != amplitudes.size() ||
+        repeat >= static_cast<int32_t>(timingsMs.size())) {
+        return Status::BAD_VALUE;
+    }
+    if (repeat >= 0) {
+        uint64_t loopMs = 0;
+        for (size_t i = repeat; i < timingsMs.size(); i++) {
+            loopMs += timingsMs[i];
+        }
+        if (loopMs == 0) {
+            return Status::BAD_VALUE;
+        }
+    }
+
+    CompletionCallback replaced;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (!mThread.joinable()) {
+            mThread = std::thread(&WaveformPlayer::threadLoop, this);
+        }
+        if (mPending) {
+            replaced = std::move(mPendingWaveform.callback);
+        }
+        mGeneration++;
+        mPending = true;
+        mPendingWaveform = {timingsMs, amplitudes, repeat < 0 ? -1 : repeat, std::move(callback)};
+    }
+    mCondition.notify_all();
+
+    if (replaced) {
+        replaced(false);
+    }
+    return Status::OK;
+}
+
+void WaveformPlayer::cancel() {
+    CompletionCallback replaced;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mGeneration++;
+        if (mPending) {
+            replaced = std::move(mPendingWaveform.callback);
+            mPending = false;
+        }
+        if (mActive) {
+            mDevice->vibrator_off(mDevice);
+            mActive = false;
+        }
+    }
+    mCondition.notify_all();
+
+    if (replaced) {
+        replaced(false);
+    }
+}
+
+void WaveformPlayer::threadLoop() {
+    sched_param param = {.sched_priority = kRealtimePriority};
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0) {
+        ALOGW("cannot make the waveform thread real-time: %s", strerror(err));
+    }
+
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mCondition.wait(lock, [this] { return mExiting || mPending; });
+        if (mExiting) {
+            return;
+        }
+
+        Waveform waveform = std::move(mPendingWaveform);
+        mPending = false;
+        bool completed = playLocked(lock, waveform, mGeneration);
+
+        if (waveform.callback) {
+            lock.unlock();
+            waveform.callback(completed);
+            lock.lock();
+        }
+    }
+}
+
+// Device calls are made with the lock held, so that none follows the vibrator_off of cancel.
+bool WaveformPlayer::playLocked(std::unique_lock<std::mutex>& lock, const Waveform& waveform,
+                                uint64_t generation) {
+    timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    bool on = false;
+    bool stateKnown = false;
+    size_t step = 0;
+    while (step < waveform.timingsMs.size()) {
+        bool stepOn = waveform.amplitudes[step] != 0;
+        if (waveform.timingsMs[step] != 0 && (!stateKnown || stepOn != on)) {
+            int32_t ret = stepOn ? mDevice->vibrator_on(mDevice, onDurationMs(waveform.timingsMs,
+                                                                              waveform.amplitudes,
+                                                                              step))
+                                 : mDevice->vibrator_off(mDevice);
+            if (ret != 0) {
+                ALOGE("waveform step %zu failed : %s", step, strerror(-ret));
+            }
+            on = stepOn;
+            stateKnown = true;
+            mActive = on;
+        }
+
+        addMs(&deadline, waveform.timingsMs[step]);
+        if (!sleepUntilLocked(lock, deadline, generation)) {
+            return false;
+        }
+
+        if (++step == waveform.timingsMs.size() && waveform.repeat >= 0) {
+            step = waveform.repeat;
+            // the device timeout of the last run ended with the pattern
+            stateKnown = false;
+        }
+    }
+
+    if (on) {
+        mDevice->vibrator_off(mDevice);
+    }
+    mActive = false;
+    return true;
+}
+
+bool WaveformPlayer::sleepUntilLocked(std::unique_lock<std::mutex>& lock, const timespec& deadline,
+                                      uint64_t generation) {
+    auto coarseDeadline =
+            std::chrono::steady_clock::time_point(
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                            std::chrono::seconds(deadline.tv_sec) +
+                            std::chrono::nanoseconds(deadline.tv_nsec))) -
+            kFineSleep;
+    if (mCondition.wait_until(lock, coarseDeadline,
+                              [&] { return isCancelledLocked(generation); })) {
+        return false;
+    }
+
+    lock.unlock();
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+    }
+    lock.lock();
+    return !isCancelledLocked(generation);
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ANDROID_HARDWARE_VIBRATOR_V1_0_WAVEFORMPLAYER_H
+#define ANDROID_HARDWARE_VIBRATOR_V1_0_WAVEFORMPLAYER_H
+
+#include <time.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <android/hardware/vibrator/1.0/types.h>
+#include <hardware/vibrator.h>
+
+namespace android {
+namespace hardware {
+namespace vibrator {
+namespace V1_0 {
+namespace implementation {
+
+/*
+ * Plays timing/amplitude patterns on the legacy vibrator device from a real-time thread, so
+ * that the steps of a waveform do not each need a call from the framework. Step boundaries are
+ * absolute deadlines on CLOCK_MONOTONIC, so wakeup latency does not add up along the pattern.
+ *
+ * The legacy device has no amplitude control: a step turns the vibrator on when its amplitude
+ * is non-zero and off otherwise.
+ */
+class WaveformPlayer {
+  public:
+    // Called without locks held, on the player thread unless the waveform was replaced before
+    // it started. completed is false if the waveform was cancelled.
+    using CompletionCallback = std::function<void(bool completed)>;
+
+    explicit WaveformPlayer(vibrator_device_t* device);
+    ~WaveformPlayer();
+
+    /*
+     * Plays steps of timingsMs[i] milliseconds at amplitudes[i]. With repeat set to the index
+     * of a step, playback loops back to it at the end until cancelled. Any waveform playing
+     * is cancelled first.
+     */
+    Status play(const std::vector<uint32_t>& timingsMs, const std::vector<uint8_t>& amplitudes,
+                int32_t repeat, CompletionCallback callback);
+
+    // Stops the waveform playing, if any, and turns the vibrator off.
+    void cancel();
+
+  private:
+    struct Waveform {
+        std::vector<uint32_t> timingsMs;
+        std::vector<uint8_t> amplitudes;
+        int32_t repeat;
+        CompletionCallback callback;
+    };
+
+    void threadLoop();
+    bool playLocked(std::unique_lock<std::mutex>& lock, const Waveform& waveform,
+                    uint64_t generation);
+    bool sleepUntilLocked(std::unique_lock<std::mutex>& lock, const timespec& deadline,
+                          uint64_t generation);
+    bool isCancelledLocked(uint64_t generation) const {
+        return mExiting || generation != mGeneration;
+    }
+
+    vibrator_device_t* const mDevice;
+
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::thread mThread;
+    bool mExiting = false;
+    // bumped by every play and cancel, so that the waveform playing notices it is replaced
+    uint64_t mGeneration = 0;
+    bool mPending = false;
+    Waveform mPendingWaveform;
+    // whether the player thread may have the vibrator on
+    bool mActive = false;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_VIBRATOR_V1_0_WAVEFORMPLAYER_H
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Vibrator.h"
+#include "WaveformPlayer.h"
+
+namespace android {
+namespace hardware {
+namespace vibrator {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+constexpr std::chrono::seconds kTimeout(5);
+
+// A legacy vibrator device that records its calls; timeouts of off() calls are 0
+class FakeDevice {
+  public:
+    FakeDevice() {
+        mDevice.owner = this;
+        mDevice.vibrator_on = [](vibrator_device_t* device, unsigned int timeoutMs) {
+            return static_cast<Device*>(device)->owner->record(timeoutMs);
+        };
+        mDevice.vibrator_off = [](vibrator_device_t* device) {
+            return static_cast<Device*>(device)->owner->record(0);
+        };
+    }
+
+    vibrator_device_t* get() { return &mDevice; }
+
+    std::vector<unsigned int> getCalls() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mCalls;
+    }
+
+  private:
+    struct Device : public vibrator_device_t {
+        FakeDevice* owner;
+    };
+
+    int record(unsigned int timeoutMs) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mCalls.push_back(timeoutMs);
+        return 0;
+    }
+
+    Device mDevice = {};
+    std::mutex mLock;
+    std::vector<unsigned int> mCalls;
+};
+
+}  // namespace
+
+TEST(WaveformPlayerTest, playsStepsAndTurnsOff) {
+    FakeDevice device;
+    WaveformPlayer player(device.get());
+
+    std::promise<bool> completed;
+    ASSERT_EQ(Status::OK, player.play({20, 30, 10, 20}, {255, 0, 100, 200}, -1,
+                                      [&](bool done) { completed.set_value(done); }));
+    auto future = completed.get_future();
+    ASSERT_EQ(std::future_status::ready, future.wait_for(kTimeout));
+    ASSERT_TRUE(future.get());
+
+    // consecutive on steps are played as one
+    std::vector<unsigned int> expected = {20, 0, 30, 0};
+    ASSERT_EQ(expected, device.getCalls());
+}
+
+TEST(WaveformPlayerTest, cancelStopsRepeatingWaveform) {
+    FakeDevice device;
+    WaveformPlayer player(device.get());
+
+    std::promise<bool> completed;
+    ASSERT_EQ(Status::OK, player.play({10, 10}, {255, 0}, 0,
+                                      [&](bool done) { completed.set_value(done); }));
+    auto deadline = std::chrono::steady_clock::now() + kTimeout;
+    while (device.getCalls().size() < 4 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    player.cancel();
+
+    auto future = completed.get_future();
+    ASSERT_EQ(std::future_status::ready, future.wait_for(kTimeout));
+    ASSERT_FALSE(future.get());
+
+    std::vector<unsigned int> calls = device.getCalls();
+    ASSERT_LE(4u, calls.size());
+    ASSERT_EQ(0u, calls.back());
+}
+
+TEST(WaveformPlayerTest, playReplacesWaveform) {
+    FakeDevice device;
+    WaveformPlayer player(device.get());
+
+    std::promise<bool> first;
+    std::promise<bool> second;
+    ASSERT_EQ(Status::OK, player.play({1000}, {255}, -1,
+                                      [&](bool done) { first.set_value(done); }));
+    ASSERT_EQ(Status::OK, player.play({10}, {255}, -1,
+                                      [&](bool done) { second.set_value(done); }));
+
+    auto firstFuture = first.get_future();
+    auto secondFuture = second.get_future();
+    ASSERT_EQ(std::future_status::ready, firstFuture.wait_for(kTimeout));
+    ASSERT_FALSE(firstFuture.get());
+    ASSERT_EQ(std::future_status::ready, secondFuture.wait_for(kTimeout));
+    ASSERT_TRUE(secondFuture.get());
+}
+
+TEST(WaveformPlayerTest, rejectsBadWaveforms) {
+    FakeDevice device;
+    WaveformPlayer player(device.get());
+
+    ASSERT_EQ(Status::BAD_VALUE, player.play({}, {}, -1, nullptr));
+    ASSERT_EQ(Status::BAD_VALUE, player.play({10, 10}, {255}, -1, nullptr));
+    ASSERT_EQ(Status::BAD_VALUE, player.play({10}, {255}, 1, nullptr));
+    // a loop of no length would spin
+    ASSERT_EQ(Status::BAD_VALUE, player.play({10, 0}, {255, 0}, 1, nullptr));
+    ASSERT_TRUE(device.getCalls().empty());
+}
+
+TEST(VibratorTest, performPlaysEffect) {
+    FakeDevice device;
+    sp<Vibrator> vibrator = new Vibrator(device.get());
+
+    Status status = Status::UNKNOWN_ERROR;
+    uint32_t lengthMs = 0;
+    vibrator->perform(Effect::DOUBLE_CLICK, EffectStrength::STRONG, [&](Status s, uint32_t l) {
+        status = s;
+        lengthMs = l;
+    });
+    ASSERT_EQ(Status::OK, status);
+    ASSERT_EQ(160u, lengthMs);
+
+    auto deadline = std::chrono::steady_clock::now() + kTimeout;
+    while (device.getCalls().size() < 4 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::vector<unsigned int> expected = {30, 0, 30, 0};
+    ASSERT_EQ(expected, device.getCalls());
+}
+
+TEST(VibratorTest, performRejectsBadInput) {
+    FakeDevice device;
+    sp<Vibrator> vibrator = new Vibrator(device.get());
+
+    Status status = Status::OK;
+    uint32_t lengthMs = 1;
+    auto callback = [&](Status s, uint32_t l) {
+        status = s;
+        lengthMs = l;
+    };
+    vibrator->perform(static_cast<Effect>(-1), EffectStrength::LIGHT, callback);
+    ASSERT_EQ(Status::UNSUPPORTED_OPERATION, status);
+    ASSERT_EQ(0u, lengthMs);
+    vibrator->perform(Effect::CLICK, static_cast<EffectStrength>(-1), callback);
+    ASSERT_EQ(Status::UNSUPPORTED_OPERATION, status);
+    ASSERT_EQ(0u, lengthMs);
+    ASSERT_TRUE(device.getCalls().empty());
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
@@ -39,6 +39,11 @@ endif
 ifdef QC_WIFI_HIDL_FEATURE_DUAL_AP
 LOCAL_CPPFLAGS += -DQC_WIFI_HIDL_FEATURE_DUAL_AP
 endif
+# LZ4 frame compress the output of IWifiChip::debug().
+ifdef WIFI_HIDL_FEATURE_DEBUG_DUMP_LZ4
+LOCAL_CPPFLAGS += -DWIFI_HIDL_FEATURE_DEBUG_DUMP_LZ4
+LOCAL_STATIC_LIBRARIES += liblz4
+endif
 # Allow implicit fallthroughs in wifi_legacy_hal.cpp until they are fixed.
 LOCAL_CFLAGS += -Wno-error=implicit-fallthrough
 LOCAL_SRC_FILES := \
@@ -99,6 +104,9 @@ LOCAL_SHARED_LIBRARIES := \
     android.hardware.wifi@1.3
 LOCAL_STATIC_LIBRARIES := \
     android.hardware.wifi@1.0-service-lib
+ifdef WIFI_HIDL_FEATURE_DEBUG_DUMP_LZ4
+LOCAL_STATIC_LIBRARIES += liblz4
+endif
 LOCAL_INIT_RC := android.hardware.wifi@1.0-service.rc
 include $(BUILD_EXECUTABLE)
 
@@ -129,6 +137,9 @@ LOCAL_SHARED_LIBRARIES := \
     android.hardware.wifi@1.3
 LOCAL_STATIC_LIBRARIES := \
     android.hardware.wifi@1.0-service-lib
+ifdef WIFI_HIDL_FEATURE_DEBUG_DUMP_LZ4
+LOCAL_STATIC_LIBRARIES += liblz4
+endif
 LOCAL_INIT_RC := android.hardware.wifi@1.0-service-lazy.rc
 include $(BUILD_EXECUTABLE)
 
@@ -156,6 +167,9 @@ LOCAL_STATIC_LIBRARIES := \
     libgmock \
     libgtest \
     android.hardware.wifi@1.0-service-lib
+ifdef WIFI_HIDL_FEATURE_DEBUG_DUMP_LZ4
+LOCAL_STATIC_LIBRARIES += liblz4
+endif
 LOCAL_SHARED_LIBRARIES := \
     libbase \
     libcutils \
@@ -170,3 +184,34 @@ LOCAL_SHARED_LIBRARIES := \
     android.hardware.wifi@1.2 \
     android.hardware.wifi@1.3
 include $(BUILD_NATIVE_TEST)
+
+###
+### android.hardware.wifi benchmarks, run against a fake vendor HAL.
+###
+include $(CLEAR_VARS)
+LOCAL_MODULE := android.hardware.wifi@1.0-service-benchmarks
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_CPPFLAGS := -Wall -Werror -Wextra
+LOCAL_SRC_FILES := \
+    benchmarks/wifi_legacy_hal_benchmark.cpp \
+    tests/mock_interface_tool.cpp
+LOCAL_STATIC_LIBRARIES := \
+    libgmock \
+    android.hardware.wifi@1.0-service-lib
+ifdef WIFI_HIDL_FEATURE_DEBUG_DUMP_LZ4
+LOCAL_STATIC_LIBRARIES += liblz4
+endif
+LOCAL_SHARED_LIBRARIES := \
+    libbase \
+    libcutils \
+    libhidlbase \
+    liblog \
+    libnl \
+    libutils \
+    libwifi-hal \
+    libwifi-system-iface \
+    android.hardware.wifi@1.0 \
+    android.hardware.wifi@1.1 \
+    android.hardware.wifi@1.2 \
+    android.hardware.wifi@1.3
+include $(BUILD_NATIVE_BENCHMARK)
@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <gmock/gmock.h>
+
+#undef NAN  // This is weird, NAN is defined in bionic/libc/include/math.h:38
+#include "hidl_struct_util.h"
+#include "hidl_sync_util.h"
+#include "ringbuffer.h"
+#include "wifi_iface_util.h"
+#include "wifi_legacy_hal.h"
+#include "wifi_sta_iface.h"
+
+#include "tests/mock_interface_tool.h"
+
+using testing::NiceMock;
+using testing::Return;
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_3 {
+namespace implementation {
+namespace legacy_hal {
+namespace {
+
+constexpr char kIfaceName[] = "wlan0";
+constexpr wifi_request_id kScanCmdId = 1;
+constexpr int kNumRadios = 2;
+constexpr int kNumChannelsPerRadio = 40;
+// Time a fake cached scan results fetch keeps the caller busy, standing in
+// for the netlink round trip to the driver.
+constexpr std::chrono::microseconds kCachedResultsLatency(200);
+
+char fake_handle_storage;
+char fake_iface_storage;
+wifi_interface_handle fake_iface_handles[] = {
+    reinterpret_cast<wifi_interface_handle>(&fake_iface_storage)};
+
+std::mutex event_loop_lock;
+std::condition_variable event_loop_cv;
+wifi_cleaned_up_handler cleaned_up_handler = nullptr;
+
+wifi_scan_result_handler scan_handler;
+// Number of full cached scans returned by the fake.
+constexpr int kNumCachedScans = 4;
+
+wifi_error fakeWaitForDriverReady() { return WIFI_SUCCESS; }
+
+wifi_error fakeInitialize(wifi_handle* handle) {
+    *handle = reinterpret_cast<wifi_handle>(&fake_handle_storage);
+    return WIFI_SUCCESS;
+}
+
+void fakeEventLoop(wifi_handle handle) {
+    std::unique_lock<std::mutex> lock(event_loop_lock);
+    event_loop_cv.wait(lock, [] { return cleaned_up_handler != nullptr; });
+    const auto handler = cleaned_up_handler;
+    lock.unlock();
+    handler(handle);
+}
+
+void fakeCleanup(wifi_handle /* handle */, wifi_cleaned_up_handler handler) {
+    std::lock_guard<std::mutex> lock(event_loop_lock);
+    cleaned_up_handler = handler;
+    event_loop_cv.notify_one();
+}
+
+wifi_error fakeGetIfaces(wifi_handle /* handle */, int* num,
+                         wifi_interface_handle** handles) {
+    *num = 1;
+    *handles = fake_iface_handles;
+    return WIFI_SUCCESS;
+}
+
+wifi_error fakeGetIfaceName(wifi_interface_handle /* handle */, char* name,
+                            size_t size) {
+    strlcpy(name, kIfaceName, size);
+    return WIFI_SUCCESS;
+}
+
+wifi_error fakeGetSupportedFeatureSet(wifi_interface_handle /* handle */,
+                                      feature_set* set) {
+    *set = WIFI_FEATURE_INFRA | WIFI_FEATURE_GSCAN |
+           WIFI_FEATURE_LINK_LAYER_STATS;
+    return WIFI_SUCCESS;
+}
+
+wifi_error fakeGetLoggerSupportedFeatureSet(
+    wifi_interface_handle /* handle */, unsigned int* set) {
+    *set = WIFI_LOGGER_MEMORY_DUMP_SUPPORTED;
+    return WIFI_SUCCESS;
+}
+
+wifi_error fakeSetNodfsFlag(wifi_interface_handle /* handle */,
+                            u32 /* nodfs */) {
+    return WIFI_SUCCESS;
+}
+
+wifi_error fakeGetLinkStats(wifi_request_id id,
+                            wifi_interface_handle /* handle */,
+                            wifi_stats_result_handler handler) {
+    // Radio stats are laid out back to back, each followed by its channels.
+    static const size_t kRadioSize =
+        sizeof(wifi_radio_stat) +
+        sizeof(wifi_channel_stat) * kNumChannelsPerRadio;
+    static std::vector<uint8_t> radios = [] {
+        std::vector<uint8_t> radios(kRadioSize * kNumRadios);
+        for (int i = 0; i < kNumRadios; i++) {
+            auto radio =
+                reinterpret_cast<wifi_radio_stat*>(&radios[kRadioSize * i]);
+            radio->radio = i;
+            radio->num_channels = kNumChannelsPerRadio;
+        }
+        return radios;
+    }();
+    wifi_iface_stat iface_stat = {};
+    handler.on_link_stats_results(
+        id, &iface_stat, kNumRadios,
+        reinterpret_cast<wifi_radio_stat*>(radios.data()));
+    return WIFI_SUCCESS;
+}
+
+wifi_error fakeStartGscan(wifi_request_id /* id */,
+                          wifi_interface_handle /* handle */,
+                          wifi_scan_cmd_params /* params */,
+                          wifi_scan_result_handler handler) {
+    scan_handler = handler;
+    return WIFI_SUCCESS;
+}
+
+wifi_error fakeGetCachedGscanResults(wifi_interface_handle /* handle */,
+                                     byte /* flush */, int max,
+                                     wifi_cached_scan_results* results,
+                                     int* num) {
+    const auto deadline =
+        std::chrono::steady_clock::now() + kCachedResultsLatency;
+    *num = std::min(max, kNumCachedScans);
+    for (int i = 0; i < *num; i++) {
+        results[i].scan_id = i;
+        results[i].num_results = MAX_AP_CACHE_PER_SCAN;
+        for (int j = 0; j < MAX_AP_CACHE_PER_SCAN; j++) {
+            results[i].results[j].channel = 2412;
+            results[i].results[j].rssi = -50;
+        }
+    }
+    while (std::chrono::steady_clock::now() < deadline) {
+    }
+    return WIFI_SUCCESS;
+}
+
+}  // namespace
+
+// Stands in for the vendor HAL, so that a call only costs what the HIDL and
+// legacy HAL layers add on top of it. This definition takes precedence over
+// the one in libwifi-hal.
+wifi_error init_wifi_vendor_hal_func_table(wifi_hal_fn* fn) {
+    fn->wifi_wait_for_driver_ready = fakeWaitForDriverReady;
+    fn->wifi_initialize = fakeInitialize;
+    fn->wifi_event_loop = fakeEventLoop;
+    fn->wifi_cleanup = fakeCleanup;
+    fn->wifi_get_ifaces = fakeGetIfaces;
+    fn->wifi_get_iface_name = fakeGetIfaceName;
+    fn->wifi_get_supported_feature_set = fakeGetSupportedFeatureSet;
+    fn->wifi_get_logger_supported_feature_set =
+        fakeGetLoggerSupportedFeatureSet;
+    fn->wifi_set_nodfs_flag = fakeSetNodfsFlag;
+    fn->wifi_get_link_stats = fakeGetLinkStats;
+    fn->wifi_start_gscan = fakeStartGscan;
+    fn->wifi_get_cached_gscan_results = fakeGetCachedGscanResults;
+    return WIFI_SUCCESS;
+}
+}  // namespace legacy_hal
+
+namespace {
+
+// Legacy HAL started on the fake vendor table, with one STA iface on top.
+struct Environment {
+    std::shared_ptr<NiceMock<wifi_system::MockInterfaceTool>> iface_tool;
+    std::shared_ptr<legacy_hal::WifiLegacyHal> legacy_hal;
+    std::shared_ptr<iface_util::WifiIfaceUtil> iface_util;
+    sp<WifiStaIface> sta_iface;
+};
+
+Environment* getEnvironment() {
+    static Environment* env = [] {
+        auto env = new Environment();
+        env->iface_tool =
+            std::make_shared<NiceMock<wifi_system::MockInterfaceTool>>();
+        ON_CALL(*env->iface_tool, SetWifiUpState(testing::_))
+            .WillByDefault(Return(true));
+        env->legacy_hal =
+            std::make_shared<legacy_hal::WifiLegacyHal>(env->iface_tool);
+        env->iface_util =
+            std::make_shared<iface_util::WifiIfaceUtil>(env->iface_tool);
+        CHECK_EQ(env->legacy_hal->initialize(), legacy_hal::WIFI_SUCCESS);
+        CHECK_EQ(env->legacy_hal->start(), legacy_hal::WIFI_SUCCESS);
+        env->sta_iface = new WifiStaIface(legacy_hal::kIfaceName,
+                                          env->legacy_hal, env->iface_util);
+        // Background scan whose results events are raised by the benchmarks.
+        const auto on_results =
+            [](legacy_hal::wifi_request_id,
+               const std::vector<legacy_hal::wifi_cached_scan_results>&
+                   results) {
+                hidl_vec<StaScanData> hidl_scan_datas;
+                hidl_struct_util::convertLegacyVectorOfCachedGscanResultsToHidl(
+                    results, &hidl_scan_datas);
+                benchmark::DoNotOptimize(hidl_scan_datas);
+            };
+        CHECK_EQ(env->legacy_hal->startGscan(
+                     legacy_hal::kIfaceName, legacy_hal::kScanCmdId, {},
+                     [](legacy_hal::wifi_request_id) {}, on_results,
+                     [](legacy_hal::wifi_request_id,
+                        const legacy_hal::wifi_scan_result*, uint32_t) {}),
+                 legacy_hal::WIFI_SUCCESS);
+        return env;
+    }();
+    return env;
+}
+
+// Cost of a HIDL call that makes two vendor calls and one conversion.
+void BM_StaGetCapabilities(benchmark::State& state) {
+    sp<WifiStaIface> sta_iface = getEnvironment()->sta_iface;
+    for (auto _ : state) {
+        sta_iface->getCapabilities([](const WifiStatus& status, uint32_t caps) {
+            benchmark::DoNotOptimize(status);
+            benchmark::DoNotOptimize(caps);
+        });
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StaGetCapabilities);
+
+/* Arg 0 is the number of scan results, spread over full cached scans. */
+void BM_CachedGscanResultsConversion(benchmark::State& state) {
+    const int num_results = state.range(0);
+    std::vector<legacy_hal::wifi_cached_scan_results> cached_results(
+        (num_results + MAX_AP_CACHE_PER_SCAN - 1) / MAX_AP_CACHE_PER_SCAN);
+    for (size_t i = 0; i < cached_results.size(); i++) {
+        cached_results[i].num_results =
+            std::min<int>(MAX_AP_CACHE_PER_SCAN,
+                          num_results - i * MAX_AP_CACHE_PER_SCAN);
+    }
+    for (auto _ : state) {
+        hidl_vec<StaScanData> hidl_scan_datas;
+        hidl_struct_util::convertLegacyVectorOfCachedGscanResultsToHidl(
+            cached_results, &hidl_scan_datas);
+        benchmark::DoNotOptimize(hidl_scan_datas);
+    }
+    state.SetItemsProcessed(state.iterations() * num_results);
+}
+BENCHMARK(BM_CachedGscanResultsConversion)
+    ->Arg(1)
+    ->Arg(32)
+    ->Arg(256)
+    ->Arg(2048);
+
+/* Arg 0 is the number of 32 byte IEs carried by the full scan result. */
+void BM_FullGscanResultConversion(benchmark::State& state) {
+    constexpr size_t kIeDataLen = 32;
+    const size_t ie_length = state.range(0) * (kIeDataLen + 2);
+    std::vector<uint8_t> buffer(sizeof(legacy_hal::wifi_scan_result) +
+                                ie_length);
+    auto result =
+        reinterpret_cast<legacy_hal::wifi_scan_result*>(buffer.data());
+    result->ie_length = ie_length;
+    for (size_t offset = 0; offset < ie_length; offset += kIeDataLen + 2) {
+        result->ie_data[offset] = offset % 256;
+        result->ie_data[offset + 1] = kIeDataLen;
+    }
+    for (auto _ : state) {
+        StaScanResult hidl_scan_result;
+        hidl_struct_util::convertLegacyGscanResultToHidlNoCopy(
+            *result, true, &hidl_scan_result);
+        benchmark::DoNotOptimize(hidl_scan_result);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FullGscanResultConversion)->Arg(0)->Arg(8)->Arg(32);
+
+/* Arg 0 is the size of appended records, the ring holds 1 MiB. */
+void BM_RingbufferAppend(benchmark::State& state) {
+    Ringbuffer ring(1024 * 1024);
+    const std::vector<uint8_t> record(state.range(0));
+    for (auto _ : state) {
+        ring.append(record.data(), record.size());
+    }
+    state.SetBytesProcessed(state.iterations() * record.size());
+}
+BENCHMARK(BM_RingbufferAppend)->Arg(64)->Arg(512)->Arg(4096);
+
+/*
+ * Thread 0 keeps raising scan results events, each fetching and converting
+ * the cached results under the global lock. The other threads are clients
+ * asking for link layer stats. Arg 0 picks the client path: 0 through the
+ * STA iface HIDL method, 1 straight into the legacy HAL.
+ */
+void BM_LinkLayerStatsDuringScan(benchmark::State& state) {
+    Environment* env = getEnvironment();
+    const bool through_hidl = state.range(0) == 0;
+    for (auto _ : state) {
+        if (state.thread_index == 0 && state.threads > 1) {
+            legacy_hal::scan_handler.on_scan_event(
+                legacy_hal::kScanCmdId,
+                legacy_hal::WIFI_SCAN_RESULTS_AVAILABLE);
+        } else if (through_hidl) {
+            env->sta_iface->getLinkLayerStats_1_3(
+                [](const WifiStatus& status,
+                   const V1_3::StaLinkLayerStats& stats) {
+                    benchmark::DoNotOptimize(status);
+                    benchmark::DoNotOptimize(stats);
+                });
+        } else {
+            const auto lock = hidl_sync_util::acquireGlobalLock();
+            benchmark::DoNotOptimize(
+                env->legacy_hal->getLinkLayerStats(legacy_hal::kIfaceName));
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LinkLayerStatsDuringScan)
+    ->DenseRange(0, 1)
+    ->Threads(1)
+    ->Threads(2)
+    ->Threads(4)
+    ->Threads(8)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_3
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
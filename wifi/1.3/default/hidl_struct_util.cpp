@@ -536,18 +536,35 @@ bool convertLegacyIeToHidl(
     return true;
 }
 
+// Sets |hidl_data| to |data|, either by copying it or, when |borrow| is set,
+// by pointing the hidl_vec at it without taking ownership.
+void setHidlBytes(const uint8_t* data, size_t len, bool borrow,
+                  hidl_vec<uint8_t>* hidl_data) {
+    if (borrow) {
+        hidl_data->setToExternal(const_cast<uint8_t*>(data), len);
+    } else {
+        hidl_data->resize(len);
+        if (len > 0) {
+            memcpy(hidl_data->data(), data, len);
+        }
+    }
+}
+
+// Parses the IE blob in two passes: the first counts the IEs so that
+// |hidl_ies| is sized once, the second fills them in place. With |borrow|
+// the IE payloads point into |ie_blob| instead of being copied.
 bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
-                               std::vector<WifiInformationElement>* hidl_ies) {
+                               bool borrow,
+                               hidl_vec<WifiInformationElement>* hidl_ies) {
     if (!ie_blob || !hidl_ies) {
         return false;
     }
-    *hidl_ies = {};
-    const uint8_t* ies_begin = ie_blob;
     const uint8_t* ies_end = ie_blob + ie_blob_len;
-    const uint8_t* next_ie = ies_begin;
     using wifi_ie = legacy_hal::wifi_information_element;
     constexpr size_t kIeHeaderLen = sizeof(wifi_ie);
     // Each IE should atleast have the header (i.e |id| & |len| fields).
+    size_t num_ies = 0;
+    const uint8_t* next_ie = ie_blob;
     while (next_ie + kIeHeaderLen <= ies_end) {
         const wifi_ie& legacy_ie = (*reinterpret_cast<const wifi_ie*>(next_ie));
         uint32_t curr_ie_len = kIeHeaderLen + legacy_ie.len;
@@ -557,13 +574,7 @@ bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
                        << ", IEs End: " << (void*)ies_end;
             break;
         }
-        WifiInformationElement hidl_ie;
-        if (!convertLegacyIeToHidl(legacy_ie, &hidl_ie)) {
-            LOG(ERROR) << "Error converting IE. Id: " << legacy_ie.id
-                       << ", len: " << legacy_ie.len;
-            break;
-        }
-        hidl_ies->push_back(std::move(hidl_ie));
+        num_ies++;
         next_ie += curr_ie_len;
     }
     // Check if the blob has been fully consumed.
@@ -571,21 +582,31 @@ bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
         LOG(ERROR) << "Failed to fully parse IE blob. Next IE: "
                    << (void*)next_ie << ", IEs End: " << (void*)ies_end;
     }
+
+    hidl_ies->resize(num_ies);
+    next_ie = ie_blob;
+    for (size_t ie_idx = 0; ie_idx < num_ies; ie_idx++) {
+        const wifi_ie& legacy_ie = (*reinterpret_cast<const wifi_ie*>(next_ie));
+        WifiInformationElement& hidl_ie = (*hidl_ies)[ie_idx];
+        hidl_ie.id = legacy_ie.id;
+        setHidlBytes(legacy_ie.data, legacy_ie.len, borrow, &hidl_ie.data);
+        next_ie += kIeHeaderLen + legacy_ie.len;
+    }
     return true;
 }
 
 bool convertLegacyGscanResultToHidl(
     const legacy_hal::wifi_scan_result& legacy_scan_result, bool has_ie_data,
-    StaScanResult* hidl_scan_result) {
+    bool borrow, StaScanResult* hidl_scan_result) {
     if (!hidl_scan_result) {
         return false;
     }
     *hidl_scan_result = {};
     hidl_scan_result->timeStampInUs = legacy_scan_result.ts;
-    hidl_scan_result->ssid = std::vector<uint8_t>(
-        legacy_scan_result.ssid,
-        legacy_scan_result.ssid + strnlen(legacy_scan_result.ssid,
-                                          sizeof(legacy_scan_result.ssid) - 1));
+    setHidlBytes(
+        reinterpret_cast<const uint8_t*>(legacy_scan_result.ssid),
+        strnlen(legacy_scan_result.ssid, sizeof(legacy_scan_result.ssid) - 1),
+        borrow, &hidl_scan_result->ssid);
     memcpy(hidl_scan_result->bssid.data(), legacy_scan_result.bssid,
            hidl_scan_result->bssid.size());
     hidl_scan_result->frequency = legacy_scan_result.channel;
@@ -593,17 +614,30 @@ bool convertLegacyGscanResultToHidl(
     hidl_scan_result->beaconPeriodInMs = legacy_scan_result.beacon_period;
     hidl_scan_result->capability = legacy_scan_result.capability;
     if (has_ie_data) {
-        std::vector<WifiInformationElement> ies;
         if (!convertLegacyIeBlobToHidl(
                 reinterpret_cast<const uint8_t*>(legacy_scan_result.ie_data),
-                legacy_scan_result.ie_length, &ies)) {
+                legacy_scan_result.ie_length, borrow,
+                &hidl_scan_result->informationElements)) {
             return false;
         }
-        hidl_scan_result->informationElements = std::move(ies);
     }
     return true;
 }
 
+bool convertLegacyGscanResultToHidl(
+    const legacy_hal::wifi_scan_result& legacy_scan_result, bool has_ie_data,
+    StaScanResult* hidl_scan_result) {
+    return convertLegacyGscanResultToHidl(legacy_scan_result, has_ie_data,
+                                          false, hidl_scan_result);
+}
+
+bool convertLegacyGscanResultToHidlNoCopy(
+    const legacy_hal::wifi_scan_result& legacy_scan_result, bool has_ie_data,
+    StaScanResult* hidl_scan_result) {
+    return convertLegacyGscanResultToHidl(legacy_scan_result, has_ie_data,
+                                          true, hidl_scan_result);
+}
+
 bool convertLegacyCachedGscanResultsToHidl(
     const legacy_hal::wifi_cached_scan_results& legacy_cached_scan_result,
     StaScanData* hidl_scan_data) {
@@ -623,36 +657,31 @@ bool convertLegacyCachedGscanResultsToHidl(
 
     CHECK(legacy_cached_scan_result.num_results >= 0 &&
           legacy_cached_scan_result.num_results <= MAX_AP_CACHE_PER_SCAN);
-    std::vector<StaScanResult> hidl_scan_results;
+    hidl_scan_data->results.resize(legacy_cached_scan_result.num_results);
     for (int32_t result_idx = 0;
          result_idx < legacy_cached_scan_result.num_results; result_idx++) {
-        StaScanResult hidl_scan_result;
         if (!convertLegacyGscanResultToHidl(
                 legacy_cached_scan_result.results[result_idx], false,
-                &hidl_scan_result)) {
+                &hidl_scan_data->results[result_idx])) {
             return false;
         }
-        hidl_scan_results.push_back(hidl_scan_result);
     }
-    hidl_scan_data->results = std::move(hidl_scan_results);
     return true;
 }
 
 bool convertLegacyVectorOfCachedGscanResultsToHidl(
     const std::vector<legacy_hal::wifi_cached_scan_results>&
         legacy_cached_scan_results,
-    std::vector<StaScanData>* hidl_scan_datas) {
+    hidl_vec<StaScanData>* hidl_scan_datas) {
     if (!hidl_scan_datas) {
         return false;
     }
-    *hidl_scan_datas = {};
-    for (const auto& legacy_cached_scan_result : legacy_cached_scan_results) {
-        StaScanData hidl_scan_data;
-        if (!convertLegacyCachedGscanResultsToHidl(legacy_cached_scan_result,
-                                                   &hidl_scan_data)) {
+    hidl_scan_datas->resize(legacy_cached_scan_results.size());
+    for (size_t i = 0; i < legacy_cached_scan_results.size(); i++) {
+        if (!convertLegacyCachedGscanResultsToHidl(
+                legacy_cached_scan_results[i], &(*hidl_scan_datas)[i])) {
             return false;
         }
-        hidl_scan_datas->push_back(hidl_scan_data);
     }
     return true;
 }
@@ -828,10 +857,12 @@ bool convertLegacyLinkLayerRadioStatsToHidl(
     hidl_radio_stat->onTimeInMsForHs20Scan =
         legacy_radio_stat.stats.on_time_hs20;
 
-    std::vector<V1_3::WifiChannelStats> hidl_channel_stats;
-
-    for (const auto& channel_stat : legacy_radio_stat.channel_stats) {
-        V1_3::WifiChannelStats hidl_channel_stat;
+    hidl_radio_stat->channelStats.resize(
+        legacy_radio_stat.channel_stats.size());
+    for (size_t i = 0; i < legacy_radio_stat.channel_stats.size(); i++) {
+        const auto& channel_stat = legacy_radio_stat.channel_stats[i];
+        V1_3::WifiChannelStats& hidl_channel_stat =
+            hidl_radio_stat->channelStats[i];
         hidl_channel_stat.onTimeInMs = channel_stat.on_time;
         hidl_channel_stat.ccaBusyTimeInMs = channel_stat.cca_busy_time;
         /*
@@ -844,11 +875,8 @@ bool convertLegacyLinkLayerRadioStatsToHidl(
             channel_stat.channel.center_freq0;
         hidl_channel_stat.channel.centerFreq1 =
             channel_stat.channel.center_freq1;
-        hidl_channel_stats.push_back(hidl_channel_stat);
     }
 
-    hidl_radio_stat->channelStats = hidl_channel_stats;
-
     return true;
 }
 
@@ -894,17 +922,14 @@ bool convertLegacyLinkLayerStatsToHidl(
         legacy_stats.iface.ac[legacy_hal::WIFI_AC_VO].mpdu_lost;
     hidl_stats->iface.wmeVoPktStats.retries =
         legacy_stats.iface.ac[legacy_hal::WIFI_AC_VO].retries;
-    // radio legacy_stats conversion.
-    std::vector<V1_3::StaLinkLayerRadioStats> hidl_radios_stats;
-    for (const auto& legacy_radio_stats : legacy_stats.radios) {
-        V1_3::StaLinkLayerRadioStats hidl_radio_stats;
-        if (!convertLegacyLinkLayerRadioStatsToHidl(legacy_radio_stats,
-                                                    &hidl_radio_stats)) {
+    // radio legacy_stats conversion, directly into the output vector.
+    hidl_stats->radios.resize(legacy_stats.radios.size());
+    for (size_t i = 0; i < legacy_stats.radios.size(); i++) {
+        if (!convertLegacyLinkLayerRadioStatsToHidl(legacy_stats.radios[i],
+                                                    &hidl_stats->radios[i])) {
             return false;
         }
-        hidl_radios_stats.push_back(hidl_radio_stats);
     }
-    hidl_stats->radios = hidl_radios_stats;
     // Timestamp in the HAL wrapper here since it's not provided in the legacy
     // HAL API.
     hidl_stats->timeStampInMs = uptimeMillis();
@@ -85,11 +85,17 @@ bool convertHidlGscanParamsToLegacy(
 bool convertLegacyGscanResultToHidl(
     const legacy_hal::wifi_scan_result& legacy_scan_result, bool has_ie_data,
     StaScanResult* hidl_scan_result);
+// Same as |convertLegacyGscanResultToHidl|, except that the |ssid| and IE
+// payloads of |hidl_scan_result| point into |legacy_scan_result| instead of
+// being copied. |hidl_scan_result| must not outlive |legacy_scan_result|.
+bool convertLegacyGscanResultToHidlNoCopy(
+    const legacy_hal::wifi_scan_result& legacy_scan_result, bool has_ie_data,
+    StaScanResult* hidl_scan_result);
 // |cached_results| is assumed to not include IEs.
 bool convertLegacyVectorOfCachedGscanResultsToHidl(
     const std::vector<legacy_hal::wifi_cached_scan_results>&
         legacy_cached_scan_results,
-    std::vector<StaScanData>* hidl_scan_datas);
+    hidl_vec<StaScanData>* hidl_scan_datas);
 bool convertLegacyLinkLayerStatsToHidl(
     const legacy_hal::LinkLayerStats& legacy_stats,
     V1_3::StaLinkLayerStats* hidl_stats);
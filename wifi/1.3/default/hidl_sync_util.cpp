@@ -14,10 +14,16 @@
  * limitations under the License.
  */
 
+#include <android-base/logging.h>
+
 #include "hidl_sync_util.h"
 
 namespace {
-std::recursive_mutex g_mutex;
+// Waits for or holds of the global lock longer than this are logged.
+constexpr std::chrono::milliseconds kSlowLockThreshold(50);
+
+android::hardware::wifi::V1_3::implementation::hidl_sync_util::GlobalMutex
+    g_mutex;
 }  // namespace
 
 namespace android {
@@ -27,8 +33,60 @@ namespace V1_3 {
 namespace implementation {
 namespace hidl_sync_util {
 
-std::unique_lock<std::recursive_mutex> acquireGlobalLock() {
-    return std::unique_lock<std::recursive_mutex>{g_mutex};
+void GlobalMutex::lock() {
+    mutex_.lock();
+    if (depth_++ == 0) {
+        acquired_ = std::chrono::steady_clock::now();
+        owner_ = nullptr;
+    }
+}
+
+bool GlobalMutex::try_lock() {
+    if (!mutex_.try_lock()) {
+        return false;
+    }
+    if (depth_++ == 0) {
+        acquired_ = std::chrono::steady_clock::now();
+        owner_ = nullptr;
+    }
+    return true;
+}
+
+void GlobalMutex::unlock() {
+    std::chrono::steady_clock::duration held{0};
+    const char* owner = owner_;
+    if (--depth_ == 0) {
+        held = std::chrono::steady_clock::now() - acquired_;
+    }
+    mutex_.unlock();
+    if (held > kSlowLockThreshold) {
+        LOG(WARNING) << "Global lock held for "
+                     << std::chrono::duration_cast<std::chrono::milliseconds>(
+                            held)
+                            .count()
+                     << " ms by " << (owner ? owner : "unknown owner");
+    }
+}
+
+void GlobalMutex::setOwner(const char* owner) {
+    if (depth_ == 1) {
+        owner_ = owner;
+    }
+}
+
+GlobalLock acquireGlobalLock(const char* owner) {
+    const auto start = std::chrono::steady_clock::now();
+    GlobalLock lock{g_mutex};
+    const auto waited = std::chrono::steady_clock::now() - start;
+    g_mutex.setOwner(owner);
+    if (waited > kSlowLockThreshold) {
+        LOG(WARNING) << owner << " waited "
+                     << std::chrono::duration_cast<std::chrono::milliseconds>(
+                            waited)
+                            .count()
+                     << " ms for the global lock";
+    }
+    return lock;
 }
 
 }  // namespace hidl_sync_util
@@ -17,6 +17,7 @@
 #ifndef HIDL_SYNC_UTIL_H_
 #define HIDL_SYNC_UTIL_H_
 
+#include <chrono>
 #include <mutex>
 
 // Utility that provides a global lock to synchronize access between
@@ -27,7 +28,27 @@ namespace wifi {
 namespace V1_3 {
 namespace implementation {
 namespace hidl_sync_util {
-std::unique_lock<std::recursive_mutex> acquireGlobalLock();
+// Recursive mutex backing the global lock. It also measures how long the
+// outermost owner held it, so that slow holders show up in the logs.
+class GlobalMutex {
+   public:
+    void lock();
+    bool try_lock();
+    void unlock();
+    // Names the current outermost owner in the slow lock logs.
+    void setOwner(const char* owner);
+
+   private:
+    std::recursive_mutex mutex_;
+    // Guarded by |mutex_|.
+    unsigned depth_ = 0;
+    const char* owner_ = nullptr;
+    std::chrono::steady_clock::time_point acquired_;
+};
+using GlobalLock = std::unique_lock<GlobalMutex>;
+
+// |owner| defaults to the calling function.
+GlobalLock acquireGlobalLock(const char* owner = __builtin_FUNCTION());
 }  // namespace hidl_sync_util
 }  // namespace implementation
 }  // namespace V1_3
@@ -16,35 +16,101 @@
 
 #include <android-base/logging.h>
 
+#include <string.h>
+#include <algorithm>
+
 #include "ringbuffer.h"
 
+namespace {
+// A snapshot is retried when an append evicted records while it was being
+// copied; give up rather than spin against a very busy writer.
+constexpr int kMaxSnapshotAttempts = 8;
+}  // namespace
+
 namespace android {
 namespace hardware {
 namespace wifi {
 namespace V1_3 {
 namespace implementation {
 
-Ringbuffer::Ringbuffer(size_t maxSize) : size_(0), maxSize_(maxSize) {}
+Ringbuffer::Ringbuffer(size_t maxSize)
+    // Left uninitialized so pages are only committed once data reaches them.
+    : data_(new uint8_t[maxSize]), maxSize_(maxSize), head_(0), tail_(0) {}
 
 void Ringbuffer::append(const std::vector<uint8_t>& input) {
-    if (input.size() == 0) {
+    append(input.data(), input.size());
+}
+
+void Ringbuffer::append(const uint8_t* data, size_t size) {
+    if (size == 0) {
         return;
     }
-    if (input.size() > maxSize_) {
-        LOG(INFO) << "Oversized message of " << input.size()
-                  << " bytes is dropped";
+    const size_t record_size = kRecordHeaderSize + size;
+    if (record_size > maxSize_) {
+        LOG(INFO) << "Oversized message of " << size << " bytes is dropped";
         return;
     }
-    data_.push_back(input);
-    size_ += input.size() * sizeof(input[0]);
-    while (size_ > maxSize_) {
-        size_ -= data_.front().size() * sizeof(data_.front()[0]);
-        data_.pop_front();
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    while (head + record_size - tail > maxSize_) {
+        uint32_t length;
+        copyOut(tail, &length, sizeof(length));
+        tail += kRecordHeaderSize + length;
     }
+    // Publish the eviction before overwriting the evicted bytes, so that a
+    // concurrent snapshot notices its copy may be torn.
+    tail_.store(tail, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const uint32_t length = size;
+    copyIn(head, &length, sizeof(length));
+    copyIn(head + kRecordHeaderSize, data, size);
+    head_.store(head + record_size, std::memory_order_release);
 }
 
-const std::list<std::vector<uint8_t>>& Ringbuffer::getData() const {
-    return data_;
+std::vector<std::vector<uint8_t>> Ringbuffer::getData() const {
+    std::vector<uint8_t> raw;
+    for (int attempt = 0; attempt < kMaxSnapshotAttempts; attempt++) {
+        const uint64_t head = head_.load(std::memory_order_acquire);
+        const uint64_t tail = tail_.load(std::memory_order_acquire);
+        raw.resize(head - tail);
+        copyOut(tail, raw.data(), raw.size());
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (tail_.load(std::memory_order_relaxed) != tail) {
+            continue;
+        }
+
+        std::vector<std::vector<uint8_t>> records;
+        size_t offset = 0;
+        while (offset < raw.size()) {
+            uint32_t length;
+            memcpy(&length, raw.data() + offset, sizeof(length));
+            offset += kRecordHeaderSize;
+            records.emplace_back(raw.begin() + offset,
+                                 raw.begin() + offset + length);
+            offset += length;
+        }
+        return records;
+    }
+    LOG(ERROR) << "Ring buffer changed too quickly to be read";
+    return {};
+}
+
+void Ringbuffer::copyIn(uint64_t pos, const void* src, size_t size) {
+    const size_t offset = pos % maxSize_;
+    const size_t first = std::min(size, maxSize_ - offset);
+    memcpy(data_.get() + offset, src, first);
+    memcpy(data_.get(), static_cast<const uint8_t*>(src) + first, size - first);
+}
+
+void Ringbuffer::copyOut(uint64_t pos, void* dst, size_t size) const {
+    if (size == 0) {
+        return;
+    }
+    const size_t offset = pos % maxSize_;
+    const size_t first = std::min(size, maxSize_ - offset);
+    memcpy(dst, data_.get() + offset, first);
+    memcpy(static_cast<uint8_t*>(dst) + first, data_.get(), size - first);
 }
 
 }  // namespace implementation
@@ -17,7 +17,8 @@
 #ifndef RINGBUFFER_H_
 #define RINGBUFFER_H_
 
-#include <list>
+#include <atomic>
+#include <memory>
 #include <vector>
 
 namespace android {
@@ -28,20 +29,37 @@ namespace implementation {
 
 /**
  * Ringbuffer object used to store debug data.
+ *
+ * Records are stored back to back in a single fixed-size byte ring, each
+ * prefixed by its length. Appends come from one thread at a time (the legacy
+ * HAL callback thread) and never allocate or lock; readers take a snapshot
+ * that is validated against concurrent evictions.
  */
 class Ringbuffer {
    public:
+    // Bytes of framing stored in front of every record.
+    static constexpr size_t kRecordHeaderSize = sizeof(uint32_t);
+
+    // |maxSize| is the capacity of the ring in bytes, framing included.
     explicit Ringbuffer(size_t maxSize);
 
     // Appends the data buffer and deletes from the front until buffer is
     // within |maxSize_|.
     void append(const std::vector<uint8_t>& input);
-    const std::list<std::vector<uint8_t>>& getData() const;
+    void append(const uint8_t* data, size_t size);
+    // Returns a copy of the records currently held, oldest first.
+    std::vector<std::vector<uint8_t>> getData() const;
 
    private:
-    std::list<std::vector<uint8_t>> data_;
-    size_t size_;
+    void copyIn(uint64_t pos, const void* src, size_t size);
+    void copyOut(uint64_t pos, void* dst, size_t size) const;
+
+    std::unique_ptr<uint8_t[]> data_;
     size_t maxSize_;
+    // Monotonic byte positions; the ring offset is |pos % maxSize_|. Only the
+    // appending thread writes them.
+    std::atomic<uint64_t> head_;
+    std::atomic<uint64_t> tail_;
 };
 
 }  // namespace implementation
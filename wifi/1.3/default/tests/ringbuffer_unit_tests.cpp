@@ -29,7 +29,13 @@ namespace implementation {
 
 class RingbufferTest : public Test {
    public:
-    const uint32_t maxBufferSize_ = 10;
+    // Room for two records with a payload of |recordSize_| bytes each.
+    const uint32_t recordSize_ = 5;
+    const uint32_t maxBufferSize_ =
+        2 * (Ringbuffer::kRecordHeaderSize + recordSize_);
+    // Largest payload that fits in the buffer on its own.
+    const uint32_t maxPayloadSize_ =
+        maxBufferSize_ - Ringbuffer::kRecordHeaderSize;
     Ringbuffer buffer_{maxBufferSize_};
 };
 
@@ -38,8 +44,8 @@ TEST_F(RingbufferTest, CreateEmptyBuffer) {
 }
 
 TEST_F(RingbufferTest, CanUseFullBufferCapacity) {
-    const std::vector<uint8_t> input(maxBufferSize_ / 2, '0');
-    const std::vector<uint8_t> input2(maxBufferSize_ / 2, '1');
+    const std::vector<uint8_t> input(recordSize_, '0');
+    const std::vector<uint8_t> input2(recordSize_, '1');
     buffer_.append(input);
     buffer_.append(input2);
     ASSERT_EQ(2u, buffer_.getData().size());
@@ -48,8 +54,8 @@ TEST_F(RingbufferTest, CanUseFullBufferCapacity) {
 }
 
 TEST_F(RingbufferTest, OldDataIsRemovedOnOverflow) {
-    const std::vector<uint8_t> input(maxBufferSize_ / 2, '0');
-    const std::vector<uint8_t> input2(maxBufferSize_ / 2, '1');
+    const std::vector<uint8_t> input(recordSize_, '0');
+    const std::vector<uint8_t> input2(recordSize_, '1');
     const std::vector<uint8_t> input3 = {'G'};
     buffer_.append(input);
     buffer_.append(input2);
@@ -60,9 +66,9 @@ TEST_F(RingbufferTest, OldDataIsRemovedOnOverflow) {
 }
 
 TEST_F(RingbufferTest, MultipleOldDataIsRemovedOnOverflow) {
-    const std::vector<uint8_t> input(maxBufferSize_ / 2, '0');
-    const std::vector<uint8_t> input2(maxBufferSize_ / 2, '1');
-    const std::vector<uint8_t> input3(maxBufferSize_, '2');
+    const std::vector<uint8_t> input(recordSize_, '0');
+    const std::vector<uint8_t> input2(recordSize_, '1');
+    const std::vector<uint8_t> input3(maxPayloadSize_, '2');
     buffer_.append(input);
     buffer_.append(input2);
     buffer_.append(input3);
@@ -77,19 +83,37 @@ TEST_F(RingbufferTest, AppendingEmptyBufferDoesNotAddGarbage) {
 }
 
 TEST_F(RingbufferTest, OversizedAppendIsDropped) {
-    const std::vector<uint8_t> input(maxBufferSize_ + 1, '0');
+    const std::vector<uint8_t> input(maxPayloadSize_ + 1, '0');
     buffer_.append(input);
     ASSERT_TRUE(buffer_.getData().empty());
 }
 
 TEST_F(RingbufferTest, OversizedAppendDoesNotDropExistingData) {
-    const std::vector<uint8_t> input(maxBufferSize_, '0');
-    const std::vector<uint8_t> input2(maxBufferSize_ + 1, '1');
+    const std::vector<uint8_t> input(maxPayloadSize_, '0');
+    const std::vector<uint8_t> input2(maxPayloadSize_ + 1, '1');
     buffer_.append(input);
     buffer_.append(input2);
     ASSERT_EQ(1u, buffer_.getData().size());
     EXPECT_EQ(input, buffer_.getData().front());
 }
+
+TEST_F(RingbufferTest, RecordsWrapAroundTheEnd) {
+    // Odd sizes so that records and their headers straddle the end of the
+    // ring at varying offsets.
+    std::vector<uint8_t> last;
+    std::vector<uint8_t> previous;
+    for (uint8_t i = 0; i < 50; i++) {
+        previous = last;
+        last.assign(1 + i % 4, i);
+        buffer_.append(last);
+        const auto data = buffer_.getData();
+        ASSERT_FALSE(data.empty());
+        EXPECT_EQ(last, data.back());
+        if (data.size() > 1) {
+            EXPECT_EQ(previous, data[data.size() - 2]);
+        }
+    }
+}
 }  // namespace implementation
 }  // namespace V1_3
 }  // namespace wifi
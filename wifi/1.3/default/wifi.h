@@ -68,13 +68,13 @@ class Wifi : public V1_3::IWifi {
     WifiStatus registerEventCallbackInternal(
         const sp<IWifiEventCallback>& event_callback);
     WifiStatus startInternal();
-    WifiStatus stopInternal(std::unique_lock<std::recursive_mutex>* lock);
+    WifiStatus stopInternal(hidl_sync_util::GlobalLock* lock);
     std::pair<WifiStatus, std::vector<ChipId>> getChipIdsInternal();
     std::pair<WifiStatus, sp<IWifiChip>> getChipInternal(ChipId chip_id);
 
     WifiStatus initializeModeControllerAndLegacyHal();
     WifiStatus stopLegacyHalAndDeinitializeModeController(
-        std::unique_lock<std::recursive_mutex>* lock);
+        hidl_sync_util::GlobalLock* lock);
 
     // Instance is created in this root level |IWifi| HIDL interface object
     // and shared with all the child HIDL interface objects.
@@ -19,9 +19,13 @@
 #include <android-base/logging.h>
 #include <android-base/unique_fd.h>
 #include <cutils/properties.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
 #include <net/if.h>
+#ifdef WIFI_HIDL_FEATURE_DEBUG_DUMP_LZ4
+#include <lz4frame.h>
+#endif
 
 #include "hidl_return_util.h"
 #include "hidl_struct_util.h"
@@ -39,12 +43,24 @@ using android::hardware::wifi::V1_0::IWifiChip;
 
 constexpr char kCpioMagic[] = "070701";
 constexpr size_t kMaxBufferSizeBytes = 1024 * 1024 * 3;
+constexpr uint32_t kMaxRingBufferId = 32;
 constexpr uint32_t kMaxRingBufferFileAgeSeconds = 60 * 60 * 10;
 constexpr uint32_t kMaxRingBufferFileNum = 20;
 constexpr char kTombstoneFolderPath[] = "/data/vendor/tombstones/wifi/";
+constexpr char kVendorCallStatsName[] = "legacy_hal_call_stats";
+constexpr char kNanEventStatsName[] = "nan_event_stats";
 constexpr char kActiveWlanIfaceNameProperty[] = "wifi.active.interface";
 constexpr char kNoActiveWlanIfaceNamePropertyValue[] = "";
 constexpr unsigned kMaxWlanIfaces = 5;
+// Iface counts are packed |kIfaceCountBits| bits per type to index the table
+// of combinations supported by the current mode. Combinations allowing more
+// ifaces of a type than |kMaxIfaceCount| are clamped to it.
+constexpr size_t kIfaceCountBits = 3;
+constexpr size_t kMaxIfaceCount = (1 << kIfaceCountBits) - 1;
+constexpr std::array<IfaceType, 4> kIfaceTypes = {
+    {IfaceType::AP, IfaceType::NAN, IfaceType::P2P, IfaceType::STA}};
+constexpr size_t kNumIfaceComboKeys = size_t{1}
+                                      << (kIfaceCountBits * kIfaceTypes.size());
 
 template <typename Iface>
 void invalidateAndClear(std::vector<sp<Iface>>& ifaces, sp<Iface> iface) {
@@ -82,6 +98,19 @@ sp<Iface> findUsingName(std::vector<sp<Iface>>& ifaces,
     return nullptr;
 }
 
+// Packs the iface counts, none above |kMaxIfaceCount|, into a table index.
+// Types missing from |combo| count as 0.
+size_t packIfaceCombo(const std::map<IfaceType, size_t>& combo) {
+    size_t key = 0;
+    for (size_t i = 0; i < kIfaceTypes.size(); i++) {
+        const auto it = combo.find(kIfaceTypes[i]);
+        if (it != combo.end()) {
+            key |= it->second << (i * kIfaceCountBits);
+        }
+    }
+    return key;
+}
+
 std::string getWlanIfaceName(unsigned idx) {
     if (idx >= kMaxWlanIfaces) {
         CHECK(false) << "Requested interface beyond wlan" << kMaxWlanIfaces;
@@ -164,24 +193,165 @@ bool removeOldFilesInternal() {
     return success;
 }
 
+// Output stream for the debug dump. Bytes are written straight to the dump fd,
+// or LZ4 frame compressed on the fly when the HAL is built with
+// WIFI_HIDL_FEATURE_DEBUG_DUMP_LZ4.
+class DumpSink {
+   public:
+    explicit DumpSink(int out_fd) : out_fd_(out_fd) {
+#ifdef WIFI_HIDL_FEATURE_DEBUG_DUMP_LZ4
+        if (LZ4F_isError(
+                LZ4F_createCompressionContext(&lz4_ctx_, LZ4F_VERSION))) {
+            LOG(ERROR) << "Failed to create LZ4 context";
+            lz4_ctx_ = nullptr;
+            return;
+        }
+        lz4_buf_.resize(LZ4F_compressBound(kChunkSize, nullptr));
+        size_t len = LZ4F_compressBegin(lz4_ctx_, lz4_buf_.data(),
+                                        lz4_buf_.size(), nullptr);
+        if (LZ4F_isError(len) || !writeOut(lz4_buf_.data(), len)) {
+            LOG(ERROR) << "Failed to start LZ4 frame";
+            LZ4F_freeCompressionContext(lz4_ctx_);
+            lz4_ctx_ = nullptr;
+        }
+#endif
+    }
+
+    ~DumpSink() {
+#ifdef WIFI_HIDL_FEATURE_DEBUG_DUMP_LZ4
+        if (lz4_ctx_ != nullptr) {
+            LZ4F_freeCompressionContext(lz4_ctx_);
+        }
+#endif
+    }
+
+    bool write(const void* data, size_t size) {
+#ifdef WIFI_HIDL_FEATURE_DEBUG_DUMP_LZ4
+        if (lz4_ctx_ != nullptr) {
+            const uint8_t* src = static_cast<const uint8_t*>(data);
+            while (size > 0) {
+                const size_t chunk = std::min(size, kChunkSize);
+                size_t len =
+                    LZ4F_compressUpdate(lz4_ctx_, lz4_buf_.data(),
+                                        lz4_buf_.size(), src, chunk, nullptr);
+                if (LZ4F_isError(len)) {
+                    LOG(ERROR) << "LZ4 compression failed";
+                    return false;
+                }
+                if (!writeOut(lz4_buf_.data(), len)) {
+                    return false;
+                }
+                src += chunk;
+                size -= chunk;
+            }
+            return true;
+        }
+#endif
+        return writeOut(data, size);
+    }
+
+    // Copies the next |size| bytes of |in_fd| into the dump. The data stays
+    // in the kernel when the output is not compressed.
+    bool copyFromFd(int in_fd, size_t size) {
+#ifdef WIFI_HIDL_FEATURE_DEBUG_DUMP_LZ4
+        const bool use_sendfile = lz4_ctx_ == nullptr;
+#else
+        const bool use_sendfile = true;
+#endif
+        while (use_sendfile && size > 0) {
+            ssize_t sent = sendfile(out_fd_, in_fd, nullptr, size);
+            if (sent > 0) {
+                size -= sent;
+                continue;
+            }
+            if (sent == 0) {
+                LOG(ERROR) << "Unexpected end of file";
+                return false;
+            }
+            if (errno == EINTR) continue;
+            if (errno != EINVAL && errno != ENOSYS) {
+                PLOG(ERROR) << "Error copying file";
+                return false;
+            }
+            // The dump fd doesn't support sendfile; fall back to copying.
+            break;
+        }
+        std::array<char, 32 * 1024> read_buf;
+        while (size > 0) {
+            ssize_t bytes_read = TEMP_FAILURE_RETRY(read(
+                in_fd, read_buf.data(), std::min(size, read_buf.size())));
+            if (bytes_read == -1) {
+                PLOG(ERROR) << "Error reading file";
+                return false;
+            }
+            if (bytes_read == 0) {
+                LOG(ERROR) << "Unexpected end of file";
+                return false;
+            }
+            if (!write(read_buf.data(), bytes_read)) {
+                return false;
+            }
+            size -= bytes_read;
+        }
+        return true;
+    }
+
+    bool finish() {
+#ifdef WIFI_HIDL_FEATURE_DEBUG_DUMP_LZ4
+        if (lz4_ctx_ != nullptr) {
+            size_t len = LZ4F_compressEnd(lz4_ctx_, lz4_buf_.data(),
+                                          lz4_buf_.size(), nullptr);
+            if (LZ4F_isError(len)) {
+                LOG(ERROR) << "Failed to end LZ4 frame";
+                return false;
+            }
+            return writeOut(lz4_buf_.data(), len);
+        }
+#endif
+        return true;
+    }
+
+   private:
+    bool writeOut(const void* data, size_t size) {
+        const char* src = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t written = TEMP_FAILURE_RETRY(::write(out_fd_, src, size));
+            if (written == -1) {
+                PLOG(ERROR) << "Error writing to dump";
+                return false;
+            }
+            src += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    int out_fd_;
+#ifdef WIFI_HIDL_FEATURE_DEBUG_DUMP_LZ4
+    static constexpr size_t kChunkSize = 64 * 1024;
+    LZ4F_compressionContext_t lz4_ctx_ = nullptr;
+    std::vector<uint8_t> lz4_buf_;
+#endif
+};
+
 // Helper function for |cpioArchiveFilesInDir|
-bool cpioWriteHeader(int out_fd, struct stat& st, const char* file_name,
-                     size_t file_name_len) {
-    std::array<char, 32 * 1024> read_buf;
+bool cpioWriteHeader(DumpSink& sink, const struct stat& st,
+                     const char* file_name, size_t file_name_len) {
+    std::array<char, 128> header_buf;
     ssize_t llen =
-        sprintf(read_buf.data(),
+        sprintf(header_buf.data(),
                 "%s%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X",
                 kCpioMagic, static_cast<int>(st.st_ino), st.st_mode, st.st_uid,
                 st.st_gid, static_cast<int>(st.st_nlink),
                 static_cast<int>(st.st_mtime), static_cast<int>(st.st_size),
                 major(st.st_dev), minor(st.st_dev), major(st.st_rdev),
                 minor(st.st_rdev), static_cast<uint32_t>(file_name_len), 0);
-    if (write(out_fd, read_buf.data(), llen) == -1) {
-        PLOG(ERROR) << "Error writing cpio header to file " << file_name;
+    if (!sink.write(header_buf.data(), llen)) {
+        LOG(ERROR) << "Error writing cpio header to file " << file_name;
         return false;
     }
-    if (write(out_fd, file_name, file_name_len) == -1) {
-        PLOG(ERROR) << "Error writing filename to file " << file_name;
+    if (!sink.write(file_name, file_name_len)) {
+        LOG(ERROR) << "Error writing filename to file " << file_name;
         return false;
     }
 
@@ -189,8 +359,8 @@ bool cpioWriteHeader(int out_fd, struct stat& st, const char* file_name,
     llen = (llen + file_name_len) % 4;
     if (llen != 0) {
         const uint32_t zero = 0;
-        if (write(out_fd, &zero, 4 - llen) == -1) {
-            PLOG(ERROR) << "Error padding 0s to file " << file_name;
+        if (!sink.write(&zero, 4 - llen)) {
+            LOG(ERROR) << "Error padding 0s to file " << file_name;
             return false;
         }
     }
@@ -198,58 +368,62 @@ bool cpioWriteHeader(int out_fd, struct stat& st, const char* file_name,
 }
 
 // Helper function for |cpioArchiveFilesInDir|
-size_t cpioWriteFileContent(int fd_read, int out_fd, struct stat& st) {
-    // writing content of file
-    std::array<char, 32 * 1024> read_buf;
-    ssize_t llen = st.st_size;
-    size_t n_error = 0;
-    while (llen > 0) {
-        ssize_t bytes_read = read(fd_read, read_buf.data(), read_buf.size());
-        if (bytes_read == -1) {
-            PLOG(ERROR) << "Error reading file";
-            return ++n_error;
-        }
-        llen -= bytes_read;
-        if (write(out_fd, read_buf.data(), bytes_read) == -1) {
-            PLOG(ERROR) << "Error writing data to file";
-            return ++n_error;
-        }
-        if (bytes_read == 0) {  // this should never happen, but just in case
-                                // to unstuck from while loop
-            PLOG(ERROR) << "Unexpected read result";
-            n_error++;
-            break;
-        }
-    }
-    llen = st.st_size % 4;
+bool cpioWriteFilePadding(DumpSink& sink, const struct stat& st) {
+    const size_t llen = st.st_size % 4;
     if (llen != 0) {
         const uint32_t zero = 0;
-        if (write(out_fd, &zero, 4 - llen) == -1) {
-            PLOG(ERROR) << "Error padding 0s to file";
-            return ++n_error;
+        if (!sink.write(&zero, 4 - llen)) {
+            LOG(ERROR) << "Error padding 0s to file";
+            return false;
         }
     }
-    return n_error;
+    return true;
 }
 
 // Helper function for |cpioArchiveFilesInDir|
-bool cpioWriteFileTrailer(int out_fd) {
+bool cpioWriteFileTrailer(DumpSink& sink) {
     std::array<char, 4096> read_buf;
     read_buf.fill(0);
-    if (write(out_fd, read_buf.data(),
-              sprintf(read_buf.data(), "070701%040X%056X%08XTRAILER!!!", 1,
-                      0x0b, 0) +
-                  4) == -1) {
-        PLOG(ERROR) << "Error writing trailing bytes";
+    if (!sink.write(read_buf.data(),
+                    sprintf(read_buf.data(), "070701%040X%056X%08XTRAILER!!!",
+                            1, 0x0b, 0) +
+                        4)) {
+        LOG(ERROR) << "Error writing trailing bytes";
         return false;
     }
     return true;
 }
 
-// Archives all files in |input_dir| and writes result into |out_fd|
+// Writes the records of an in-memory ring as a single cpio entry named
+// |ring_name|, without going through a tombstone file.
+size_t cpioArchiveRingbuffer(
+    DumpSink& sink, const std::string& ring_name, ino_t ino,
+    const std::vector<std::vector<uint8_t>>& records) {
+    struct stat st = {};
+    st.st_ino = ino;
+    st.st_mode = S_IFREG | S_IRUSR | S_IWUSR;
+    st.st_uid = getuid();
+    st.st_gid = getgid();
+    st.st_nlink = 1;
+    st.st_mtime = time(0);
+    for (const auto& record : records) {
+        st.st_size += record.size();
+    }
+    if (!cpioWriteHeader(sink, st, ring_name.c_str(), ring_name.size() + 1)) {
+        return 1;
+    }
+    for (const auto& record : records) {
+        if (!sink.write(record.data(), record.size())) {
+            return 1;
+        }
+    }
+    return cpioWriteFilePadding(sink, st) ? 0 : 1;
+}
+
+// Archives all files in |input_dir| and writes result into |sink|
 // Logic obtained from //external/toybox/toys/posix/cpio.c "Output cpio archive"
 // portion
-size_t cpioArchiveFilesInDir(int out_fd, const char* input_dir) {
+size_t cpioArchiveFilesInDir(DumpSink& sink, const char* input_dir) {
     struct dirent* dp;
     size_t n_error = 0;
     std::unique_ptr<DIR, decltype(&closedir)> dir_dump(opendir(input_dir),
@@ -268,11 +442,6 @@ size_t cpioArchiveFilesInDir(int out_fd, const char* input_dir) {
         const size_t file_name_len = cur_file_name.size() + 1;
         struct stat st;
         const std::string cur_file_path = kTombstoneFolderPath + cur_file_name;
-        if (stat(cur_file_path.c_str(), &st) == -1) {
-            PLOG(ERROR) << "Failed to get file stat for " << cur_file_path;
-            n_error++;
-            continue;
-        }
         const int fd_read = open(cur_file_path.c_str(), O_RDONLY);
         if (fd_read == -1) {
             PLOG(ERROR) << "Failed to open file " << cur_file_path;
@@ -280,18 +449,22 @@ size_t cpioArchiveFilesInDir(int out_fd, const char* input_dir) {
             continue;
         }
         unique_fd file_auto_closer(fd_read);
-        if (!cpioWriteHeader(out_fd, st, cur_file_name.c_str(),
+        if (fstat(fd_read, &st) == -1) {
+            PLOG(ERROR) << "Failed to get file stat for " << cur_file_path;
+            n_error++;
+            continue;
+        }
+        if (!cpioWriteHeader(sink, st, cur_file_name.c_str(),
                              file_name_len)) {
             return ++n_error;
         }
-        size_t write_error = cpioWriteFileContent(fd_read, out_fd, st);
-        if (write_error) {
-            return n_error + write_error;
+        // The header already announced st_size bytes, so a short copy leaves
+        // the archive unusable.
+        if (!sink.copyFromFd(fd_read, st.st_size) ||
+            !cpioWriteFilePadding(sink, st)) {
+            return ++n_error;
         }
     }
-    if (!cpioWriteFileTrailer(out_fd)) {
-        return ++n_error;
-    }
     return n_error;
 }
 
@@ -608,10 +781,41 @@ Return<void> WifiChip::debug(const hidl_handle& handle,
                              const hidl_vec<hidl_string>&) {
     if (handle != nullptr && handle->numFds >= 1) {
         int fd = handle->data[0];
-        if (!writeRingbufferFilesInternal()) {
-            LOG(ERROR) << "Error writing files to flash";
+        if (!removeOldFilesInternal()) {
+            LOG(ERROR) << "Error occurred while deleting old tombstone files";
+        }
+        // Stream the rings straight from memory, followed by whatever
+        // earlier flushes left in the tombstone folder.
+        DumpSink sink(fd);
+        uint32_t n_error = 0;
+        ino_t ino = 0;
+        const auto legacy_hal = legacy_hal_.lock();
+        if (legacy_hal) {
+            const std::string stats = legacy_hal->dumpVendorCallStats();
+            n_error += cpioArchiveRingbuffer(
+                sink, kVendorCallStatsName, ++ino,
+                {std::vector<uint8_t>(stats.begin(), stats.end())});
+        }
+        if (!nan_ifaces_.empty()) {
+            std::string stats;
+            for (const auto& iface : nan_ifaces_) {
+                stats += iface->getEventStats();
+            }
+            n_error += cpioArchiveRingbuffer(
+                sink, kNanEventStatsName, ++ino,
+                {std::vector<uint8_t>(stats.begin(), stats.end())});
+        }
+        for (const auto& item : ringbuffer_map_) {
+            const auto cur_data = item.second->getData();
+            if (cur_data.empty()) {
+                continue;
+            }
+            n_error += cpioArchiveRingbuffer(sink, item.first, ++ino, cur_data);
+        }
+        n_error += cpioArchiveFilesInDir(sink, kTombstoneFolderPath);
+        if (!cpioWriteFileTrailer(sink) || !sink.finish()) {
+            n_error++;
         }
-        uint32_t n_error = cpioArchiveFilesInDir(fd, kTombstoneFolderPath);
         if (n_error != 0) {
             LOG(ERROR) << n_error << " errors occured in cpio function";
         }
@@ -703,7 +907,7 @@ WifiChip::getAvailableModesInternal() {
 }
 
 WifiStatus WifiChip::configureChipInternal(
-    /* NONNULL */ std::unique_lock<std::recursive_mutex>* lock,
+    /* NONNULL */ hidl_sync_util::GlobalLock* lock,
     ChipModeId mode_id) {
     if (!isValidModeId(mode_id)) {
         return createWifiStatus(WifiStatusCode::ERROR_INVALID_ARGS);
@@ -728,6 +932,7 @@ WifiStatus WifiChip::configureChipInternal(
         }
     }
     current_mode_id_ = mode_id;
+    buildCurrentModeIfaceComboTable();
     LOG(INFO) << "Configured chip in mode " << mode_id;
     setActiveWlanIfaceNameProperty(getFirstActiveWlanIfaceName());
     return status;
@@ -1094,8 +1299,10 @@ WifiStatus WifiChip::startLoggingToDebugRingBufferInternal(
                 std::underlying_type<WifiDebugRingBufferVerboseLevel>::type>(
                 verbose_level),
             max_interval_in_sec, min_data_size_in_bytes);
-    ringbuffer_map_.insert(std::pair<std::string, Ringbuffer>(
-        ring_name, Ringbuffer(kMaxBufferSizeBytes)));
+    if (ringbuffer_map_.find(ring_name) == ringbuffer_map_.end()) {
+        ringbuffer_map_[ring_name] =
+            std::make_unique<Ringbuffer>(kMaxBufferSizeBytes);
+    }
     return createWifiStatusFromLegacyError(legacy_status);
 }
 
@@ -1210,7 +1417,7 @@ WifiStatus WifiChip::selectTxPowerScenarioInternal_1_2(
 }
 
 WifiStatus WifiChip::handleChipConfiguration(
-    /* NONNULL */ std::unique_lock<std::recursive_mutex>* lock,
+    /* NONNULL */ hidl_sync_util::GlobalLock* lock,
     ChipModeId mode_id) {
     // If the chip is already configured in a different mode, stop
     // the legacy HAL and then start it after firmware mode change.
@@ -1269,8 +1476,8 @@ WifiStatus WifiChip::registerDebugRingBufferCallback() {
 
     android::wp<WifiChip> weak_ptr_this(this);
     const auto& on_ring_buffer_data_callback =
-        [weak_ptr_this](const std::string& name,
-                        const std::vector<uint8_t>& data,
+        [weak_ptr_this](const std::string& name, const uint8_t* data,
+                        size_t size,
                         const legacy_hal::wifi_ring_buffer_status& status) {
             const auto shared_ptr_this = weak_ptr_this.promote();
             if (!shared_ptr_this.get() || !shared_ptr_this->isValid()) {
@@ -1283,14 +1490,13 @@ WifiStatus WifiChip::registerDebugRingBufferCallback() {
                 LOG(ERROR) << "Error converting ring buffer status";
                 return;
             }
-            const auto& target = shared_ptr_this->ringbuffer_map_.find(name);
-            if (target != shared_ptr_this->ringbuffer_map_.end()) {
-                Ringbuffer& cur_buffer = target->second;
-                cur_buffer.append(data);
-            } else {
+            Ringbuffer* cur_buffer =
+                shared_ptr_this->findRingbuffer(status.ring_id, name);
+            if (cur_buffer == nullptr) {
                 LOG(ERROR) << "Ringname " << name << " not found";
                 return;
             }
+            cur_buffer->append(data, size);
         };
     legacy_hal::wifi_error legacy_status =
         legacy_hal_.lock()->registerRingBufferCallbackHandler(
@@ -1395,74 +1601,46 @@ std::vector<std::map<IfaceType, size_t>> WifiChip::expandIfaceCombinations(
     return expanded_combos;
 }
 
-bool WifiChip::canExpandedIfaceComboSupportIfaceOfTypeWithCurrentIfaces(
-    const std::map<IfaceType, size_t>& expanded_combo,
-    IfaceType requested_type) {
-    const auto current_combo = getCurrentIfaceCombination();
-
-    // Check if we have space for 1 more iface of |type| in this combo
-    for (const auto type :
-         {IfaceType::AP, IfaceType::NAN, IfaceType::P2P, IfaceType::STA}) {
-        size_t num_ifaces_needed = current_combo.at(type);
-        if (type == requested_type) {
-            num_ifaces_needed++;
+// This marks in |current_mode_iface_combos_| every expanded combination of
+// the current mode, and then every iface count vector below one of those.
+void WifiChip::buildCurrentModeIfaceComboTable() {
+    current_mode_iface_combos_.assign(kNumIfaceComboKeys, false);
+    for (const auto& combination : getCurrentModeIfaceCombinations()) {
+        for (auto& expanded_combo : expandIfaceCombinations(combination)) {
+            for (auto& type_count : expanded_combo) {
+                type_count.second = std::min(type_count.second, kMaxIfaceCount);
+            }
+            current_mode_iface_combos_[packIfaceCombo(expanded_combo)] = true;
         }
-        size_t num_ifaces_allowed = expanded_combo.at(type);
-        if (num_ifaces_needed > num_ifaces_allowed) {
-            return false;
+    }
+    // Removing one iface from a key always yields a smaller key, so a single
+    // descending pass closes the table downwards.
+    for (size_t key = kNumIfaceComboKeys; key-- > 0;) {
+        if (!current_mode_iface_combos_[key]) {
+            continue;
+        }
+        for (size_t i = 0; i < kIfaceTypes.size(); i++) {
+            const size_t one = size_t{1} << (i * kIfaceCountBits);
+            if ((key / one) & kMaxIfaceCount) {
+                current_mode_iface_combos_[key - one] = true;
+            }
         }
     }
-    return true;
 }
 
-// This method does the following:
-// a) Enumerate all possible iface combos by expanding the current
-//    ChipIfaceCombination.
-// b) Check if the requested iface type can be added to the current mode
-//    with the iface combination that is already active.
+// Checks if the requested iface type can be added to the current mode with
+// the iface combination that is already active.
 bool WifiChip::canCurrentModeSupportIfaceOfTypeWithCurrentIfaces(
     IfaceType requested_type) {
     if (!isValidModeId(current_mode_id_)) {
         LOG(ERROR) << "Chip not configured in a mode yet";
         return false;
     }
-    const auto combinations = getCurrentModeIfaceCombinations();
-    for (const auto& combination : combinations) {
-        const auto expanded_combos = expandIfaceCombinations(combination);
-        for (const auto& expanded_combo : expanded_combos) {
-            if (canExpandedIfaceComboSupportIfaceOfTypeWithCurrentIfaces(
-                    expanded_combo, requested_type)) {
-                return true;
-            }
-        }
-    }
-    return false;
+    auto combo = getCurrentIfaceCombination();
+    combo[requested_type]++;
+    return canCurrentModeSupportIfaceCombo(combo);
 }
 
-// Note: This does not consider ifaces already active. It only checks if the
-// provided expanded iface combination can support the requested combo.
-bool WifiChip::canExpandedIfaceComboSupportIfaceCombo(
-    const std::map<IfaceType, size_t>& expanded_combo,
-    const std::map<IfaceType, size_t>& req_combo) {
-    // Check if we have space for 1 more iface of |type| in this combo
-    for (const auto type :
-         {IfaceType::AP, IfaceType::NAN, IfaceType::P2P, IfaceType::STA}) {
-        if (req_combo.count(type) == 0) {
-            // Iface of "type" not in the req_combo.
-            continue;
-        }
-        size_t num_ifaces_needed = req_combo.at(type);
-        size_t num_ifaces_allowed = expanded_combo.at(type);
-        if (num_ifaces_needed > num_ifaces_allowed) {
-            return false;
-        }
-    }
-    return true;
-}
-// This method does the following:
-// a) Enumerate all possible iface combos by expanding the current
-//    ChipIfaceCombination.
-// b) Check if the requested iface combo can be added to the current mode.
 // Note: This does not consider ifaces already active. It only checks if the
 // current mode can support the requested combo.
 bool WifiChip::canCurrentModeSupportIfaceCombo(
@@ -1471,17 +1649,12 @@ bool WifiChip::canCurrentModeSupportIfaceCombo(
         LOG(ERROR) << "Chip not configured in a mode yet";
         return false;
     }
-    const auto combinations = getCurrentModeIfaceCombinations();
-    for (const auto& combination : combinations) {
-        const auto expanded_combos = expandIfaceCombinations(combination);
-        for (const auto& expanded_combo : expanded_combos) {
-            if (canExpandedIfaceComboSupportIfaceCombo(expanded_combo,
-                                                       req_combo)) {
-                return true;
-            }
+    for (const auto& type_count : req_combo) {
+        if (type_count.second > kMaxIfaceCount) {
+            return false;
         }
     }
-    return false;
+    return current_mode_iface_combos_[packIfaceCombo(req_combo)];
 }
 
 // This method does the following:
@@ -1558,6 +1731,24 @@ std::string WifiChip::allocateStaIfaceName() {
     return allocateApOrStaIfaceName(0);
 }
 
+Ringbuffer* WifiChip::findRingbuffer(uint32_t ring_id,
+                                     const std::string& name) {
+    if (ring_id < ringbuffer_by_id_.size() && ringbuffer_by_id_[ring_id]) {
+        return ringbuffer_by_id_[ring_id];
+    }
+    const auto& target = ringbuffer_map_.find(name);
+    if (target == ringbuffer_map_.end()) {
+        return nullptr;
+    }
+    if (ring_id < kMaxRingBufferId) {
+        if (ring_id >= ringbuffer_by_id_.size()) {
+            ringbuffer_by_id_.resize(ring_id + 1, nullptr);
+        }
+        ringbuffer_by_id_[ring_id] = target->second.get();
+    }
+    return target->second.get();
+}
+
 bool WifiChip::writeRingbufferFilesInternal() {
     if (!removeOldFilesInternal()) {
         LOG(ERROR) << "Error occurred while deleting old tombstone files";
@@ -1565,8 +1756,8 @@ bool WifiChip::writeRingbufferFilesInternal() {
     }
     // write ringbuffers to file
     for (const auto& item : ringbuffer_map_) {
-        const Ringbuffer& cur_buffer = item.second;
-        if (cur_buffer.getData().empty()) {
+        const auto cur_data = item.second->getData();
+        if (cur_data.empty()) {
             continue;
         }
         const std::string file_path_raw =
@@ -1577,7 +1768,7 @@ bool WifiChip::writeRingbufferFilesInternal() {
             return false;
         }
         unique_fd file_auto_closer(dump_fd);
-        for (const auto& cur_block : cur_buffer.getData()) {
+        for (const auto& cur_block : cur_data) {
             if (write(dump_fd, cur_block.data(),
                       sizeof(cur_block[0]) * cur_block.size()) == -1) {
                 PLOG(ERROR) << "Error writing to file";
@@ -19,6 +19,7 @@
 
 #include <list>
 #include <map>
+#include <memory>
 
 #include <android-base/macros.h>
 #include <android/hardware/wifi/1.3/IWifiChip.h>
@@ -167,7 +168,7 @@ class WifiChip : public V1_3::IWifiChip {
     std::pair<WifiStatus, uint32_t> getCapabilitiesInternal();
     std::pair<WifiStatus, std::vector<ChipMode>> getAvailableModesInternal();
     WifiStatus configureChipInternal(
-        std::unique_lock<std::recursive_mutex>* lock, ChipModeId mode_id);
+        hidl_sync_util::GlobalLock* lock, ChipModeId mode_id);
     std::pair<WifiStatus, uint32_t> getModeInternal();
     std::pair<WifiStatus, IWifiChip::ChipDebugInfo>
     requestChipDebugInfoInternal();
@@ -218,7 +219,7 @@ class WifiChip : public V1_3::IWifiChip {
     WifiStatus selectTxPowerScenarioInternal_1_2(TxPowerScenario scenario);
     std::pair<WifiStatus, uint32_t> getCapabilitiesInternal_1_3();
     WifiStatus handleChipConfiguration(
-        std::unique_lock<std::recursive_mutex>* lock, ChipModeId mode_id);
+        hidl_sync_util::GlobalLock* lock, ChipModeId mode_id);
     WifiStatus registerDebugRingBufferCallback();
     WifiStatus registerRadioModeChangeCallback();
 
@@ -227,14 +228,9 @@ class WifiChip : public V1_3::IWifiChip {
     std::map<IfaceType, size_t> getCurrentIfaceCombination();
     std::vector<std::map<IfaceType, size_t>> expandIfaceCombinations(
         const IWifiChip::ChipIfaceCombination& combination);
-    bool canExpandedIfaceComboSupportIfaceOfTypeWithCurrentIfaces(
-        const std::map<IfaceType, size_t>& expanded_combo,
-        IfaceType requested_type);
+    void buildCurrentModeIfaceComboTable();
     bool canCurrentModeSupportIfaceOfTypeWithCurrentIfaces(
         IfaceType requested_type);
-    bool canExpandedIfaceComboSupportIfaceCombo(
-        const std::map<IfaceType, size_t>& expanded_combo,
-        const std::map<IfaceType, size_t>& req_combo);
     bool canCurrentModeSupportIfaceCombo(
         const std::map<IfaceType, size_t>& req_combo);
     bool canCurrentModeSupportIfaceOfType(IfaceType requested_type);
@@ -245,6 +241,7 @@ class WifiChip : public V1_3::IWifiChip {
     std::string allocateApOrStaIfaceName(uint32_t start_idx);
     std::string allocateApIfaceName();
     std::string allocateStaIfaceName();
+    Ringbuffer* findRingbuffer(uint32_t ring_id, const std::string& name);
     bool writeRingbufferFilesInternal();
 
     ChipId chip_id_;
@@ -257,11 +254,18 @@ class WifiChip : public V1_3::IWifiChip {
     std::vector<sp<WifiP2pIface>> p2p_ifaces_;
     std::vector<sp<WifiStaIface>> sta_ifaces_;
     std::vector<sp<WifiRttController>> rtt_controllers_;
-    std::map<std::string, Ringbuffer> ringbuffer_map_;
+    std::map<std::string, std::unique_ptr<Ringbuffer>> ringbuffer_map_;
+    // Rings indexed by the legacy HAL ring id, filled in on the first record
+    // of each ring so the data callback skips the lookup by name.
+    std::vector<Ringbuffer*> ringbuffer_by_id_;
     bool is_valid_;
     // Members pertaining to chip configuration.
     uint32_t current_mode_id_;
     std::vector<IWifiChip::ChipMode> modes_;
+    // Whether the current mode supports each iface count vector, indexed by
+    // the counts packed together. Built once per mode change so that the
+    // checks on iface creation need not expand the combinations again.
+    std::vector<bool> current_mode_iface_combos_;
     // The legacy ring buffer callback API has only a global callback
     // registration mechanism. Use this to check if we have already
     // registered a callback.
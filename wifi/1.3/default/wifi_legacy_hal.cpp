@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <array>
 #include <chrono>
 
@@ -37,6 +38,10 @@ static constexpr uint32_t kMaxWakeReasonStatsArraySize = 32;
 static constexpr uint32_t kMaxRingBuffers = 10;
 static constexpr uint32_t kMaxStopCompleteWaitMs = 100;
 static constexpr char kDriverPropName[] = "wlan.driver.status";
+// Vendor HAL calls taking longer than this are logged and counted.
+static constexpr std::chrono::milliseconds kVendorCallDeadline(1000);
+// Range requests that may be outstanding in the vendor HAL at once.
+static constexpr size_t kMaxRttRequestsInFlight = 4;
 
 // Helper function to create a non-const char* for legacy Hal API's.
 std::vector<char> makeCharVec(const std::string& str) {
@@ -47,6 +52,9 @@ std::vector<char> makeCharVec(const std::string& str) {
 }
 }  // namespace
 
+// Calls |fn| from the legacy HAL function table, recording its latency.
+#define VENDOR_CALL(fn) wrapVendorCall(#fn, global_func_table_.fn)
+
 namespace android {
 namespace hardware {
 namespace wifi {
@@ -162,15 +170,21 @@ void onAsyncRadioModeChange(wifi_request_id id, uint32_t num_macs,
 }
 
 // Callback to be invoked for rtt results results.
-std::function<void(wifi_request_id, unsigned num_results,
-                   wifi_rtt_result* rtt_results[])>
-    on_rtt_results_internal_callback;
+// Several range requests may be in flight at once. The results of each are
+// routed back to the callback registered with its command id.
+std::map<wifi_request_id, std::function<void(wifi_request_id, unsigned,
+                                             wifi_rtt_result*[])>>
+    on_rtt_results_internal_callbacks;
 void onAsyncRttResults(wifi_request_id id, unsigned num_results,
                        wifi_rtt_result* rtt_results[]) {
     const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_rtt_results_internal_callback) {
-        on_rtt_results_internal_callback(id, num_results, rtt_results);
-        on_rtt_results_internal_callback = nullptr;
+    auto it = on_rtt_results_internal_callbacks.find(id);
+    if (it != on_rtt_results_internal_callbacks.end()) {
+        // Unregister before invoking, so the user callback may already
+        // submit the next burst under the same id.
+        const auto callback = std::move(it->second);
+        on_rtt_results_internal_callbacks.erase(it);
+        callback(id, num_results, rtt_results);
     }
 }
 
@@ -365,7 +379,7 @@ wifi_error WifiLegacyHal::start() {
         return WIFI_SUCCESS;
     }
     LOG(DEBUG) << "Waiting for the driver ready";
-    wifi_error status = global_func_table_.wifi_wait_for_driver_ready();
+    wifi_error status = VENDOR_CALL(wifi_wait_for_driver_ready)();
     if (status == WIFI_ERROR_TIMED_OUT) {
         LOG(ERROR) << "Timed out awaiting driver ready";
         return status;
@@ -377,7 +391,7 @@ wifi_error WifiLegacyHal::start() {
         LOG(ERROR) << "Failed to set WiFi interface up";
         return WIFI_ERROR_UNKNOWN;
     }
-    status = global_func_table_.wifi_initialize(&global_handle_);
+    status = VENDOR_CALL(wifi_initialize)(&global_handle_);
     if (status != WIFI_SUCCESS || !global_handle_) {
         LOG(ERROR) << "Failed to retrieve global handle";
         return status;
@@ -394,7 +408,7 @@ wifi_error WifiLegacyHal::start() {
 }
 
 wifi_error WifiLegacyHal::stop(
-    /* NONNULL */ std::unique_lock<std::recursive_mutex>* lock,
+    /* NONNULL */ hidl_sync_util::GlobalLock* lock,
     const std::function<void()>& on_stop_complete_user_callback) {
     if (!is_started_) {
         LOG(DEBUG) << "Legacy HAL already stopped";
@@ -414,7 +428,7 @@ wifi_error WifiLegacyHal::stop(
         is_started_ = false;
     };
     awaiting_event_loop_termination_ = true;
-    global_func_table_.wifi_cleanup(global_handle_, onAsyncStopComplete);
+    VENDOR_CALL(wifi_cleanup)(global_handle_, onAsyncStopComplete);
     const auto status = stop_wait_cv_.wait_for(
         *lock, std::chrono::milliseconds(kMaxStopCompleteWaitMs),
         [this] { return !awaiting_event_loop_termination_; });
@@ -428,11 +442,75 @@ wifi_error WifiLegacyHal::stop(
 
 bool WifiLegacyHal::isStarted() { return is_started_; }
 
+std::string WifiLegacyHal::dumpVendorCallStats() {
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+    std::lock_guard<std::mutex> lock(vendor_call_lock_);
+    std::string dump =
+        "api count over_deadline avg_us max_us <1ms <10ms <100ms <1s >=1s\n";
+    for (const auto& item : vendor_call_stats_) {
+        const VendorCallStats& stats = item.second;
+        dump += std::string(item.first) + " " + std::to_string(stats.count) +
+                " " + std::to_string(stats.over_deadline) + " " +
+                std::to_string(stats.total.count() / stats.count) + " " +
+                std::to_string(stats.max.count());
+        for (const auto bucket : stats.histogram) {
+            dump += " " + std::to_string(bucket);
+        }
+        dump += "\n";
+    }
+    const auto now = std::chrono::steady_clock::now();
+    for (const auto& item : vendor_calls_in_flight_) {
+        dump += std::string("in progress: ") + item.second.first + " for " +
+                std::to_string(
+                    duration_cast<milliseconds>(now - item.second.second)
+                        .count()) +
+                " ms\n";
+    }
+    return dump;
+}
+
+WifiLegacyHal::VendorCallScope::VendorCallScope(WifiLegacyHal* hal,
+                                                const char* api)
+    : hal_(hal), api_(api), start_(std::chrono::steady_clock::now()) {
+    std::lock_guard<std::mutex> lock(hal_->vendor_call_lock_);
+    hal_->vendor_calls_in_flight_[std::this_thread::get_id()] = {api_, start_};
+}
+
+WifiLegacyHal::VendorCallScope::~VendorCallScope() {
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    using std::chrono::milliseconds;
+    const auto elapsed = duration_cast<microseconds>(
+        std::chrono::steady_clock::now() - start_);
+    std::size_t bucket = 0;
+    for (auto limit = milliseconds(1);
+         bucket < 4 && elapsed >= limit; limit *= 10) {
+        bucket++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(hal_->vendor_call_lock_);
+        hal_->vendor_calls_in_flight_.erase(std::this_thread::get_id());
+        VendorCallStats& stats = hal_->vendor_call_stats_[api_];
+        stats.count++;
+        stats.total += elapsed;
+        stats.max = std::max(stats.max, elapsed);
+        stats.histogram[bucket]++;
+        if (elapsed > kVendorCallDeadline) {
+            stats.over_deadline++;
+        }
+    }
+    if (elapsed > kVendorCallDeadline) {
+        LOG(WARNING) << api_ << " took "
+                     << duration_cast<milliseconds>(elapsed).count() << " ms";
+    }
+}
+
 std::pair<wifi_error, std::string> WifiLegacyHal::getDriverVersion(
     const std::string& iface_name) {
     std::array<char, kMaxVersionStringLength> buffer;
     buffer.fill(0);
-    wifi_error status = global_func_table_.wifi_get_driver_version(
+    wifi_error status = VENDOR_CALL(wifi_get_driver_version)(
         getIfaceHandle(iface_name), buffer.data(), buffer.size());
     return {status, buffer.data()};
 }
@@ -441,7 +519,7 @@ std::pair<wifi_error, std::string> WifiLegacyHal::getFirmwareVersion(
     const std::string& iface_name) {
     std::array<char, kMaxVersionStringLength> buffer;
     buffer.fill(0);
-    wifi_error status = global_func_table_.wifi_get_firmware_version(
+    wifi_error status = VENDOR_CALL(wifi_get_firmware_version)(
         getIfaceHandle(iface_name), buffer.data(), buffer.size());
     return {status, buffer.data()};
 }
@@ -455,7 +533,7 @@ WifiLegacyHal::requestDriverMemoryDump(const std::string& iface_name) {
                            reinterpret_cast<uint8_t*>(buffer),
                            reinterpret_cast<uint8_t*>(buffer) + buffer_size);
     };
-    wifi_error status = global_func_table_.wifi_get_driver_memory_dump(
+    wifi_error status = VENDOR_CALL(wifi_get_driver_memory_dump)(
         getIfaceHandle(iface_name), {onSyncDriverMemoryDump});
     on_driver_memory_dump_internal_callback = nullptr;
     return {status, std::move(driver_dump)};
@@ -470,7 +548,7 @@ WifiLegacyHal::requestFirmwareMemoryDump(const std::string& iface_name) {
                 firmware_dump.end(), reinterpret_cast<uint8_t*>(buffer),
                 reinterpret_cast<uint8_t*>(buffer) + buffer_size);
         };
-    wifi_error status = global_func_table_.wifi_get_firmware_memory_dump(
+    wifi_error status = VENDOR_CALL(wifi_get_firmware_memory_dump)(
         getIfaceHandle(iface_name), {onSyncFirmwareMemoryDump});
     on_firmware_memory_dump_internal_callback = nullptr;
     return {status, std::move(firmware_dump)};
@@ -481,7 +559,7 @@ std::pair<wifi_error, uint32_t> WifiLegacyHal::getSupportedFeatureSet(
     feature_set set;
     static_assert(sizeof(set) == sizeof(uint32_t),
                   "Some feature_flags can not be represented in output");
-    wifi_error status = global_func_table_.wifi_get_supported_feature_set(
+    wifi_error status = VENDOR_CALL(wifi_get_supported_feature_set)(
         getIfaceHandle(iface_name), &set);
     return {status, static_cast<uint32_t>(set)};
 }
@@ -489,21 +567,21 @@ std::pair<wifi_error, uint32_t> WifiLegacyHal::getSupportedFeatureSet(
 std::pair<wifi_error, PacketFilterCapabilities>
 WifiLegacyHal::getPacketFilterCapabilities(const std::string& iface_name) {
     PacketFilterCapabilities caps;
-    wifi_error status = global_func_table_.wifi_get_packet_filter_capabilities(
+    wifi_error status = VENDOR_CALL(wifi_get_packet_filter_capabilities)(
         getIfaceHandle(iface_name), &caps.version, &caps.max_len);
     return {status, caps};
 }
 
 wifi_error WifiLegacyHal::setPacketFilter(const std::string& iface_name,
                                           const std::vector<uint8_t>& program) {
-    return global_func_table_.wifi_set_packet_filter(
+    return VENDOR_CALL(wifi_set_packet_filter)(
         getIfaceHandle(iface_name), program.data(), program.size());
 }
 
 std::pair<wifi_error, std::vector<uint8_t>>
 WifiLegacyHal::readApfPacketFilterData(const std::string& iface_name) {
     PacketFilterCapabilities caps;
-    wifi_error status = global_func_table_.wifi_get_packet_filter_capabilities(
+    wifi_error status = VENDOR_CALL(wifi_get_packet_filter_capabilities)(
         getIfaceHandle(iface_name), &caps.version, &caps.max_len);
     if (status != WIFI_SUCCESS) {
         return {status, {}};
@@ -512,7 +590,7 @@ WifiLegacyHal::readApfPacketFilterData(const std::string& iface_name) {
     // Size the buffer to read the entire program & work memory.
     std::vector<uint8_t> buffer(caps.max_len);
 
-    status = global_func_table_.wifi_read_packet_filter(
+    status = VENDOR_CALL(wifi_read_packet_filter)(
         getIfaceHandle(iface_name), /*src_offset=*/0, buffer.data(),
         buffer.size());
     return {status, move(buffer)};
@@ -521,7 +599,7 @@ WifiLegacyHal::readApfPacketFilterData(const std::string& iface_name) {
 std::pair<wifi_error, wifi_gscan_capabilities>
 WifiLegacyHal::getGscanCapabilities(const std::string& iface_name) {
     wifi_gscan_capabilities caps;
-    wifi_error status = global_func_table_.wifi_get_gscan_capabilities(
+    wifi_error status = VENDOR_CALL(wifi_get_gscan_capabilities)(
         getIfaceHandle(iface_name), &caps);
     return {status, caps};
 }
@@ -579,7 +657,7 @@ wifi_error WifiLegacyHal::startGscan(
 
     wifi_scan_result_handler handler = {onAsyncGscanFullResult,
                                         onAsyncGscanEvent};
-    wifi_error status = global_func_table_.wifi_start_gscan(
+    wifi_error status = VENDOR_CALL(wifi_start_gscan)(
         id, getIfaceHandle(iface_name), params, handler);
     if (status != WIFI_SUCCESS) {
         on_gscan_event_internal_callback = nullptr;
@@ -598,7 +676,7 @@ wifi_error WifiLegacyHal::stopGscan(const std::string& iface_name,
         return WIFI_ERROR_NOT_AVAILABLE;
     }
     wifi_error status =
-        global_func_table_.wifi_stop_gscan(id, getIfaceHandle(iface_name));
+        VENDOR_CALL(wifi_stop_gscan)(id, getIfaceHandle(iface_name));
     // If the request Id is wrong, don't stop the ongoing background scan. Any
     // other error should be treated as the end of background scan.
     if (status != WIFI_ERROR_INVALID_REQUEST_ID) {
@@ -616,7 +694,7 @@ WifiLegacyHal::getValidFrequenciesForBand(const std::string& iface_name,
     std::vector<uint32_t> freqs;
     freqs.resize(kMaxGscanFrequenciesForBand);
     int32_t num_freqs = 0;
-    wifi_error status = global_func_table_.wifi_get_valid_channels(
+    wifi_error status = VENDOR_CALL(wifi_get_valid_channels)(
         getIfaceHandle(iface_name), band, freqs.size(),
         reinterpret_cast<wifi_channel*>(freqs.data()), &num_freqs);
     CHECK(num_freqs >= 0 &&
@@ -627,7 +705,7 @@ WifiLegacyHal::getValidFrequenciesForBand(const std::string& iface_name,
 
 wifi_error WifiLegacyHal::setDfsFlag(const std::string& iface_name,
                                      bool dfs_on) {
-    return global_func_table_.wifi_set_nodfs_flag(getIfaceHandle(iface_name),
+    return VENDOR_CALL(wifi_set_nodfs_flag)(getIfaceHandle(iface_name),
                                                   dfs_on ? 0 : 1);
 }
 
@@ -636,7 +714,7 @@ wifi_error WifiLegacyHal::enableLinkLayerStats(const std::string& iface_name,
     wifi_link_layer_params params;
     params.mpdu_size_threshold = kLinkLayerStatsDataMpduSizeThreshold;
     params.aggressive_statistics_gathering = debug;
-    return global_func_table_.wifi_set_link_stats(getIfaceHandle(iface_name),
+    return VENDOR_CALL(wifi_set_link_stats)(getIfaceHandle(iface_name),
                                                   params);
 }
 
@@ -644,7 +722,7 @@ wifi_error WifiLegacyHal::disableLinkLayerStats(const std::string& iface_name) {
     // TODO: Do we care about these responses?
     uint32_t clear_mask_rsp;
     uint8_t stop_rsp;
-    return global_func_table_.wifi_clear_link_stats(
+    return VENDOR_CALL(wifi_clear_link_stats)(
         getIfaceHandle(iface_name), 0xFFFFFFFF, &clear_mask_rsp, 1, &stop_rsp);
 }
 
@@ -670,6 +748,7 @@ std::pair<wifi_error, LinkLayerStats> WifiLegacyHal::getLinkLayerStats(
                 return;
             }
             l_radio_stats_ptr = radio_stats_ptr;
+            link_stats_ptr->radios.reserve(num_radios);
             for (int i = 0; i < num_radios; i++) {
                 LinkLayerRadioStats radio;
 
@@ -692,7 +771,7 @@ std::pair<wifi_error, LinkLayerStats> WifiLegacyHal::getLinkLayerStats(
                         l_radio_stats_ptr->channels +
                             l_radio_stats_ptr->num_channels);
                 }
-                link_stats_ptr->radios.push_back(radio);
+                link_stats_ptr->radios.push_back(std::move(radio));
                 l_radio_stats_ptr =
                     (wifi_radio_stat*)((u8*)l_radio_stats_ptr +
                                        sizeof(wifi_radio_stat) +
@@ -701,10 +780,10 @@ std::pair<wifi_error, LinkLayerStats> WifiLegacyHal::getLinkLayerStats(
             }
         };
 
-    wifi_error status = global_func_table_.wifi_get_link_stats(
+    wifi_error status = VENDOR_CALL(wifi_get_link_stats)(
         0, getIfaceHandle(iface_name), {onSyncLinkLayerStatsResult});
     on_link_layer_stats_result_internal_callback = nullptr;
-    return {status, link_stats};
+    return {status, std::move(link_stats)};
 }
 
 wifi_error WifiLegacyHal::startRssiMonitoring(
@@ -727,7 +806,7 @@ wifi_error WifiLegacyHal::startRssiMonitoring(
             std::copy(bssid_ptr, bssid_ptr + 6, std::begin(bssid_arr));
             on_threshold_breached_user_callback(id, bssid_arr, rssi);
         };
-    wifi_error status = global_func_table_.wifi_start_rssi_monitoring(
+    wifi_error status = VENDOR_CALL(wifi_start_rssi_monitoring)(
         id, getIfaceHandle(iface_name), max_rssi, min_rssi,
         {onAsyncRssiThresholdBreached});
     if (status != WIFI_SUCCESS) {
@@ -741,7 +820,7 @@ wifi_error WifiLegacyHal::stopRssiMonitoring(const std::string& iface_name,
     if (!on_rssi_threshold_breached_internal_callback) {
         return WIFI_ERROR_NOT_AVAILABLE;
     }
-    wifi_error status = global_func_table_.wifi_stop_rssi_monitoring(
+    wifi_error status = VENDOR_CALL(wifi_stop_rssi_monitoring)(
         id, getIfaceHandle(iface_name));
     // If the request Id is wrong, don't stop the ongoing rssi monitoring. Any
     // other error should be treated as the end of background scan.
@@ -754,7 +833,7 @@ wifi_error WifiLegacyHal::stopRssiMonitoring(const std::string& iface_name,
 std::pair<wifi_error, wifi_roaming_capabilities>
 WifiLegacyHal::getRoamingCapabilities(const std::string& iface_name) {
     wifi_roaming_capabilities caps;
-    wifi_error status = global_func_table_.wifi_get_roaming_capabilities(
+    wifi_error status = VENDOR_CALL(wifi_get_roaming_capabilities)(
         getIfaceHandle(iface_name), &caps);
     return {status, caps};
 }
@@ -762,19 +841,19 @@ WifiLegacyHal::getRoamingCapabilities(const std::string& iface_name) {
 wifi_error WifiLegacyHal::configureRoaming(const std::string& iface_name,
                                            const wifi_roaming_config& config) {
     wifi_roaming_config config_internal = config;
-    return global_func_table_.wifi_configure_roaming(getIfaceHandle(iface_name),
+    return VENDOR_CALL(wifi_configure_roaming)(getIfaceHandle(iface_name),
                                                      &config_internal);
 }
 
 wifi_error WifiLegacyHal::enableFirmwareRoaming(const std::string& iface_name,
                                                 fw_roaming_state_t state) {
-    return global_func_table_.wifi_enable_firmware_roaming(
+    return VENDOR_CALL(wifi_enable_firmware_roaming)(
         getIfaceHandle(iface_name), state);
 }
 
 wifi_error WifiLegacyHal::configureNdOffload(const std::string& iface_name,
                                              bool enable) {
-    return global_func_table_.wifi_configure_nd_offload(
+    return VENDOR_CALL(wifi_configure_nd_offload)(
         getIfaceHandle(iface_name), enable);
 }
 
@@ -788,7 +867,7 @@ wifi_error WifiLegacyHal::startSendingOffloadedPacket(
         src_address.data(), src_address.data() + src_address.size());
     std::vector<uint8_t> dst_address_internal(
         dst_address.data(), dst_address.data() + dst_address.size());
-    return global_func_table_.wifi_start_sending_offloaded_packet(
+    return VENDOR_CALL(wifi_start_sending_offloaded_packet)(
         cmd_id, getIfaceHandle(iface_name), ether_type,
         ip_packet_data_internal.data(), ip_packet_data_internal.size(),
         src_address_internal.data(), dst_address_internal.data(), period_in_ms);
@@ -796,31 +875,31 @@ wifi_error WifiLegacyHal::startSendingOffloadedPacket(
 
 wifi_error WifiLegacyHal::stopSendingOffloadedPacket(
     const std::string& iface_name, uint32_t cmd_id) {
-    return global_func_table_.wifi_stop_sending_offloaded_packet(
+    return VENDOR_CALL(wifi_stop_sending_offloaded_packet)(
         cmd_id, getIfaceHandle(iface_name));
 }
 
 wifi_error WifiLegacyHal::setScanningMacOui(const std::string& iface_name,
                                             const std::array<uint8_t, 3>& oui) {
     std::vector<uint8_t> oui_internal(oui.data(), oui.data() + oui.size());
-    return global_func_table_.wifi_set_scanning_mac_oui(
+    return VENDOR_CALL(wifi_set_scanning_mac_oui)(
         getIfaceHandle(iface_name), oui_internal.data());
 }
 
 wifi_error WifiLegacyHal::selectTxPowerScenario(const std::string& iface_name,
                                                 wifi_power_scenario scenario) {
-    return global_func_table_.wifi_select_tx_power_scenario(
+    return VENDOR_CALL(wifi_select_tx_power_scenario)(
         getIfaceHandle(iface_name), scenario);
 }
 
 wifi_error WifiLegacyHal::resetTxPowerScenario(const std::string& iface_name) {
-    return global_func_table_.wifi_reset_tx_power_scenario(
+    return VENDOR_CALL(wifi_reset_tx_power_scenario)(
         getIfaceHandle(iface_name));
 }
 
 wifi_error WifiLegacyHal::setLatencyMode(const std::string& iface_name,
                                          wifi_latency_mode mode) {
-    return global_func_table_.wifi_set_latency_mode(getIfaceHandle(iface_name),
+    return VENDOR_CALL(wifi_set_latency_mode)(getIfaceHandle(iface_name),
                                                     mode);
 }
 
@@ -828,14 +907,14 @@ std::pair<wifi_error, uint32_t> WifiLegacyHal::getLoggerSupportedFeatureSet(
     const std::string& iface_name) {
     uint32_t supported_feature_flags;
     wifi_error status =
-        global_func_table_.wifi_get_logger_supported_feature_set(
+        VENDOR_CALL(wifi_get_logger_supported_feature_set)(
             getIfaceHandle(iface_name), &supported_feature_flags);
     return {status, supported_feature_flags};
 }
 
 wifi_error WifiLegacyHal::startPktFateMonitoring(
     const std::string& iface_name) {
-    return global_func_table_.wifi_start_pkt_fate_monitoring(
+    return VENDOR_CALL(wifi_start_pkt_fate_monitoring)(
         getIfaceHandle(iface_name));
 }
 
@@ -844,7 +923,7 @@ std::pair<wifi_error, std::vector<wifi_tx_report>> WifiLegacyHal::getTxPktFates(
     std::vector<wifi_tx_report> tx_pkt_fates;
     tx_pkt_fates.resize(MAX_FATE_LOG_LEN);
     size_t num_fates = 0;
-    wifi_error status = global_func_table_.wifi_get_tx_pkt_fates(
+    wifi_error status = VENDOR_CALL(wifi_get_tx_pkt_fates)(
         getIfaceHandle(iface_name), tx_pkt_fates.data(), tx_pkt_fates.size(),
         &num_fates);
     CHECK(num_fates <= MAX_FATE_LOG_LEN);
@@ -857,7 +936,7 @@ std::pair<wifi_error, std::vector<wifi_rx_report>> WifiLegacyHal::getRxPktFates(
     std::vector<wifi_rx_report> rx_pkt_fates;
     rx_pkt_fates.resize(MAX_FATE_LOG_LEN);
     size_t num_fates = 0;
-    wifi_error status = global_func_table_.wifi_get_rx_pkt_fates(
+    wifi_error status = VENDOR_CALL(wifi_get_rx_pkt_fates)(
         getIfaceHandle(iface_name), rx_pkt_fates.data(), rx_pkt_fates.size(),
         &num_fates);
     CHECK(num_fates <= MAX_FATE_LOG_LEN);
@@ -884,7 +963,7 @@ std::pair<wifi_error, WakeReasonStats> WifiLegacyHal::getWakeReasonStats(
         stats.driver_fw_local_wake_cnt.size();
     stats.wake_reason_cnt.driver_fw_local_wake_cnt_used = 0;
 
-    wifi_error status = global_func_table_.wifi_get_wake_reason_stats(
+    wifi_error status = VENDOR_CALL(wifi_get_wake_reason_stats)(
         getIfaceHandle(iface_name), &stats.wake_reason_cnt);
 
     CHECK(
@@ -915,14 +994,13 @@ wifi_error WifiLegacyHal::registerRingBufferCallbackHandler(
     on_ring_buffer_data_internal_callback =
         [on_user_data_callback](char* ring_name, char* buffer, int buffer_size,
                                 wifi_ring_buffer_status* status) {
-            if (status && buffer) {
-                std::vector<uint8_t> buffer_vector(
-                    reinterpret_cast<uint8_t*>(buffer),
-                    reinterpret_cast<uint8_t*>(buffer) + buffer_size);
-                on_user_data_callback(ring_name, buffer_vector, *status);
+            if (status && buffer && buffer_size > 0) {
+                on_user_data_callback(ring_name,
+                                      reinterpret_cast<uint8_t*>(buffer),
+                                      buffer_size, *status);
             }
         };
-    wifi_error status = global_func_table_.wifi_set_log_handler(
+    wifi_error status = VENDOR_CALL(wifi_set_log_handler)(
         0, getIfaceHandle(iface_name), {onAsyncRingBufferData});
     if (status != WIFI_SUCCESS) {
         on_ring_buffer_data_internal_callback = nullptr;
@@ -936,7 +1014,7 @@ wifi_error WifiLegacyHal::deregisterRingBufferCallbackHandler(
         return WIFI_ERROR_NOT_AVAILABLE;
     }
     on_ring_buffer_data_internal_callback = nullptr;
-    return global_func_table_.wifi_reset_log_handler(
+    return VENDOR_CALL(wifi_reset_log_handler)(
         0, getIfaceHandle(iface_name));
 }
 
@@ -945,7 +1023,7 @@ WifiLegacyHal::getRingBuffersStatus(const std::string& iface_name) {
     std::vector<wifi_ring_buffer_status> ring_buffers_status;
     ring_buffers_status.resize(kMaxRingBuffers);
     uint32_t num_rings = kMaxRingBuffers;
-    wifi_error status = global_func_table_.wifi_get_ring_buffers_status(
+    wifi_error status = VENDOR_CALL(wifi_get_ring_buffers_status)(
         getIfaceHandle(iface_name), &num_rings, ring_buffers_status.data());
     CHECK(num_rings <= kMaxRingBuffers);
     ring_buffers_status.resize(num_rings);
@@ -957,14 +1035,14 @@ wifi_error WifiLegacyHal::startRingBufferLogging(const std::string& iface_name,
                                                  uint32_t verbose_level,
                                                  uint32_t max_interval_sec,
                                                  uint32_t min_data_size) {
-    return global_func_table_.wifi_start_logging(
+    return VENDOR_CALL(wifi_start_logging)(
         getIfaceHandle(iface_name), verbose_level, 0, max_interval_sec,
         min_data_size, makeCharVec(ring_name).data());
 }
 
 wifi_error WifiLegacyHal::getRingBufferData(const std::string& iface_name,
                                             const std::string& ring_name) {
-    return global_func_table_.wifi_get_ring_data(getIfaceHandle(iface_name),
+    return VENDOR_CALL(wifi_get_ring_data)(getIfaceHandle(iface_name),
                                                  makeCharVec(ring_name).data());
 }
 
@@ -986,7 +1064,7 @@ wifi_error WifiLegacyHal::registerErrorAlertCallbackHandler(
                     reinterpret_cast<uint8_t*>(buffer) + buffer_size));
         }
     };
-    wifi_error status = global_func_table_.wifi_set_alert_handler(
+    wifi_error status = VENDOR_CALL(wifi_set_alert_handler)(
         0, getIfaceHandle(iface_name), {onAsyncErrorAlert});
     if (status != WIFI_SUCCESS) {
         on_error_alert_internal_callback = nullptr;
@@ -1000,7 +1078,7 @@ wifi_error WifiLegacyHal::deregisterErrorAlertCallbackHandler(
         return WIFI_ERROR_NOT_AVAILABLE;
     }
     on_error_alert_internal_callback = nullptr;
-    return global_func_table_.wifi_reset_alert_handler(
+    return VENDOR_CALL(wifi_reset_alert_handler)(
         0, getIfaceHandle(iface_name));
 }
 
@@ -1031,7 +1109,7 @@ wifi_error WifiLegacyHal::registerRadioModeChangeCallbackHandler(
             on_user_change_callback(mac_infos_vec);
         }
     };
-    wifi_error status = global_func_table_.wifi_set_radio_mode_change_handler(
+    wifi_error status = VENDOR_CALL(wifi_set_radio_mode_change_handler)(
         0, getIfaceHandle(iface_name), {onAsyncRadioModeChange});
     if (status != WIFI_SUCCESS) {
         on_radio_mode_change_internal_callback = nullptr;
@@ -1043,11 +1121,12 @@ wifi_error WifiLegacyHal::startRttRangeRequest(
     const std::string& iface_name, wifi_request_id id,
     const std::vector<wifi_rtt_config>& rtt_configs,
     const on_rtt_results_callback& on_results_user_callback) {
-    if (on_rtt_results_internal_callback) {
+    if (on_rtt_results_internal_callbacks.count(id) ||
+        on_rtt_results_internal_callbacks.size() >= kMaxRttRequestsInFlight) {
         return WIFI_ERROR_NOT_AVAILABLE;
     }
 
-    on_rtt_results_internal_callback =
+    on_rtt_results_internal_callbacks[id] =
         [on_results_user_callback](wifi_request_id id, unsigned num_results,
                                    wifi_rtt_result* rtt_results[]) {
             if (num_results > 0 && !rtt_results) {
@@ -1064,11 +1143,11 @@ wifi_error WifiLegacyHal::startRttRangeRequest(
         };
 
     std::vector<wifi_rtt_config> rtt_configs_internal(rtt_configs);
-    wifi_error status = global_func_table_.wifi_rtt_range_request(
+    wifi_error status = VENDOR_CALL(wifi_rtt_range_request)(
         id, getIfaceHandle(iface_name), rtt_configs.size(),
         rtt_configs_internal.data(), {onAsyncRttResults});
     if (status != WIFI_SUCCESS) {
-        on_rtt_results_internal_callback = nullptr;
+        on_rtt_results_internal_callbacks.erase(id);
     }
     return status;
 }
@@ -1076,7 +1155,7 @@ wifi_error WifiLegacyHal::startRttRangeRequest(
 wifi_error WifiLegacyHal::cancelRttRangeRequest(
     const std::string& iface_name, wifi_request_id id,
     const std::vector<std::array<uint8_t, 6>>& mac_addrs) {
-    if (!on_rtt_results_internal_callback) {
+    if (!on_rtt_results_internal_callbacks.count(id)) {
         return WIFI_ERROR_NOT_AVAILABLE;
     }
     static_assert(sizeof(mac_addr) == sizeof(std::array<uint8_t, 6>),
@@ -1084,13 +1163,13 @@ wifi_error WifiLegacyHal::cancelRttRangeRequest(
     // TODO: How do we handle partial cancels (i.e only a subset of enabled mac
     // addressed are cancelled).
     std::vector<std::array<uint8_t, 6>> mac_addrs_internal(mac_addrs);
-    wifi_error status = global_func_table_.wifi_rtt_range_cancel(
+    wifi_error status = VENDOR_CALL(wifi_rtt_range_cancel)(
         id, getIfaceHandle(iface_name), mac_addrs.size(),
         reinterpret_cast<mac_addr*>(mac_addrs_internal.data()));
     // If the request Id is wrong, don't stop the ongoing range request. Any
     // other error should be treated as the end of rtt ranging.
     if (status != WIFI_ERROR_INVALID_REQUEST_ID) {
-        on_rtt_results_internal_callback = nullptr;
+        on_rtt_results_internal_callbacks.erase(id);
     }
     return status;
 }
@@ -1098,7 +1177,7 @@ wifi_error WifiLegacyHal::cancelRttRangeRequest(
 std::pair<wifi_error, wifi_rtt_capabilities> WifiLegacyHal::getRttCapabilities(
     const std::string& iface_name) {
     wifi_rtt_capabilities rtt_caps;
-    wifi_error status = global_func_table_.wifi_get_rtt_capabilities(
+    wifi_error status = VENDOR_CALL(wifi_get_rtt_capabilities)(
         getIfaceHandle(iface_name), &rtt_caps);
     return {status, rtt_caps};
 }
@@ -1106,7 +1185,7 @@ std::pair<wifi_error, wifi_rtt_capabilities> WifiLegacyHal::getRttCapabilities(
 std::pair<wifi_error, wifi_rtt_responder> WifiLegacyHal::getRttResponderInfo(
     const std::string& iface_name) {
     wifi_rtt_responder rtt_responder;
-    wifi_error status = global_func_table_.wifi_rtt_get_responder_info(
+    wifi_error status = VENDOR_CALL(wifi_rtt_get_responder_info)(
         getIfaceHandle(iface_name), &rtt_responder);
     return {status, rtt_responder};
 }
@@ -1116,14 +1195,14 @@ wifi_error WifiLegacyHal::enableRttResponder(
     const wifi_channel_info& channel_hint, uint32_t max_duration_secs,
     const wifi_rtt_responder& info) {
     wifi_rtt_responder info_internal(info);
-    return global_func_table_.wifi_enable_responder(
+    return VENDOR_CALL(wifi_enable_responder)(
         id, getIfaceHandle(iface_name), channel_hint, max_duration_secs,
         &info_internal);
 }
 
 wifi_error WifiLegacyHal::disableRttResponder(const std::string& iface_name,
                                               wifi_request_id id) {
-    return global_func_table_.wifi_disable_responder(
+    return VENDOR_CALL(wifi_disable_responder)(
         id, getIfaceHandle(iface_name));
 }
 
@@ -1131,7 +1210,7 @@ wifi_error WifiLegacyHal::setRttLci(const std::string& iface_name,
                                     wifi_request_id id,
                                     const wifi_lci_information& info) {
     wifi_lci_information info_internal(info);
-    return global_func_table_.wifi_set_lci(id, getIfaceHandle(iface_name),
+    return VENDOR_CALL(wifi_set_lci)(id, getIfaceHandle(iface_name),
                                            &info_internal);
 }
 
@@ -1139,7 +1218,7 @@ wifi_error WifiLegacyHal::setRttLcr(const std::string& iface_name,
                                     wifi_request_id id,
                                     const wifi_lcr_information& info) {
     wifi_lcr_information info_internal(info);
-    return global_func_table_.wifi_set_lcr(id, getIfaceHandle(iface_name),
+    return VENDOR_CALL(wifi_set_lcr)(id, getIfaceHandle(iface_name),
                                            &info_internal);
 }
 
@@ -1175,7 +1254,7 @@ wifi_error WifiLegacyHal::nanRegisterCallbackHandlers(
     on_nan_event_schedule_update_user_callback =
         user_callbacks.on_event_schedule_update;
 
-    return global_func_table_.wifi_nan_register_handler(
+    return VENDOR_CALL(wifi_nan_register_handler)(
         getIfaceHandle(iface_name),
         {onAysncNanNotifyResponse, onAysncNanEventPublishReplied,
          onAysncNanEventPublishTerminated, onAysncNanEventMatch,
@@ -1192,13 +1271,13 @@ wifi_error WifiLegacyHal::nanEnableRequest(const std::string& iface_name,
                                            transaction_id id,
                                            const NanEnableRequest& msg) {
     NanEnableRequest msg_internal(msg);
-    return global_func_table_.wifi_nan_enable_request(
+    return VENDOR_CALL(wifi_nan_enable_request)(
         id, getIfaceHandle(iface_name), &msg_internal);
 }
 
 wifi_error WifiLegacyHal::nanDisableRequest(const std::string& iface_name,
                                             transaction_id id) {
-    return global_func_table_.wifi_nan_disable_request(
+    return VENDOR_CALL(wifi_nan_disable_request)(
         id, getIfaceHandle(iface_name));
 }
 
@@ -1206,7 +1285,7 @@ wifi_error WifiLegacyHal::nanPublishRequest(const std::string& iface_name,
                                             transaction_id id,
                                             const NanPublishRequest& msg) {
     NanPublishRequest msg_internal(msg);
-    return global_func_table_.wifi_nan_publish_request(
+    return VENDOR_CALL(wifi_nan_publish_request)(
         id, getIfaceHandle(iface_name), &msg_internal);
 }
 
@@ -1214,7 +1293,7 @@ wifi_error WifiLegacyHal::nanPublishCancelRequest(
     const std::string& iface_name, transaction_id id,
     const NanPublishCancelRequest& msg) {
     NanPublishCancelRequest msg_internal(msg);
-    return global_func_table_.wifi_nan_publish_cancel_request(
+    return VENDOR_CALL(wifi_nan_publish_cancel_request)(
         id, getIfaceHandle(iface_name), &msg_internal);
 }
 
@@ -1222,7 +1301,7 @@ wifi_error WifiLegacyHal::nanSubscribeRequest(const std::string& iface_name,
                                               transaction_id id,
                                               const NanSubscribeRequest& msg) {
     NanSubscribeRequest msg_internal(msg);
-    return global_func_table_.wifi_nan_subscribe_request(
+    return VENDOR_CALL(wifi_nan_subscribe_request)(
         id, getIfaceHandle(iface_name), &msg_internal);
 }
 
@@ -1230,7 +1309,7 @@ wifi_error WifiLegacyHal::nanSubscribeCancelRequest(
     const std::string& iface_name, transaction_id id,
     const NanSubscribeCancelRequest& msg) {
     NanSubscribeCancelRequest msg_internal(msg);
-    return global_func_table_.wifi_nan_subscribe_cancel_request(
+    return VENDOR_CALL(wifi_nan_subscribe_cancel_request)(
         id, getIfaceHandle(iface_name), &msg_internal);
 }
 
@@ -1238,7 +1317,7 @@ wifi_error WifiLegacyHal::nanTransmitFollowupRequest(
     const std::string& iface_name, transaction_id id,
     const NanTransmitFollowupRequest& msg) {
     NanTransmitFollowupRequest msg_internal(msg);
-    return global_func_table_.wifi_nan_transmit_followup_request(
+    return VENDOR_CALL(wifi_nan_transmit_followup_request)(
         id, getIfaceHandle(iface_name), &msg_internal);
 }
 
@@ -1246,7 +1325,7 @@ wifi_error WifiLegacyHal::nanStatsRequest(const std::string& iface_name,
                                           transaction_id id,
                                           const NanStatsRequest& msg) {
     NanStatsRequest msg_internal(msg);
-    return global_func_table_.wifi_nan_stats_request(
+    return VENDOR_CALL(wifi_nan_stats_request)(
         id, getIfaceHandle(iface_name), &msg_internal);
 }
 
@@ -1254,7 +1333,7 @@ wifi_error WifiLegacyHal::nanConfigRequest(const std::string& iface_name,
                                            transaction_id id,
                                            const NanConfigRequest& msg) {
     NanConfigRequest msg_internal(msg);
-    return global_func_table_.wifi_nan_config_request(
+    return VENDOR_CALL(wifi_nan_config_request)(
         id, getIfaceHandle(iface_name), &msg_internal);
 }
 
@@ -1262,7 +1341,7 @@ wifi_error WifiLegacyHal::nanTcaRequest(const std::string& iface_name,
                                         transaction_id id,
                                         const NanTCARequest& msg) {
     NanTCARequest msg_internal(msg);
-    return global_func_table_.wifi_nan_tca_request(
+    return VENDOR_CALL(wifi_nan_tca_request)(
         id, getIfaceHandle(iface_name), &msg_internal);
 }
 
@@ -1270,34 +1349,34 @@ wifi_error WifiLegacyHal::nanBeaconSdfPayloadRequest(
     const std::string& iface_name, transaction_id id,
     const NanBeaconSdfPayloadRequest& msg) {
     NanBeaconSdfPayloadRequest msg_internal(msg);
-    return global_func_table_.wifi_nan_beacon_sdf_payload_request(
+    return VENDOR_CALL(wifi_nan_beacon_sdf_payload_request)(
         id, getIfaceHandle(iface_name), &msg_internal);
 }
 
 std::pair<wifi_error, NanVersion> WifiLegacyHal::nanGetVersion() {
     NanVersion version;
     wifi_error status =
-        global_func_table_.wifi_nan_get_version(global_handle_, &version);
+        VENDOR_CALL(wifi_nan_get_version)(global_handle_, &version);
     return {status, version};
 }
 
 wifi_error WifiLegacyHal::nanGetCapabilities(const std::string& iface_name,
                                              transaction_id id) {
-    return global_func_table_.wifi_nan_get_capabilities(
+    return VENDOR_CALL(wifi_nan_get_capabilities)(
         id, getIfaceHandle(iface_name));
 }
 
 wifi_error WifiLegacyHal::nanDataInterfaceCreate(
     const std::string& iface_name, transaction_id id,
     const std::string& data_iface_name) {
-    return global_func_table_.wifi_nan_data_interface_create(
+    return VENDOR_CALL(wifi_nan_data_interface_create)(
         id, getIfaceHandle(iface_name), makeCharVec(data_iface_name).data());
 }
 
 wifi_error WifiLegacyHal::nanDataInterfaceDelete(
     const std::string& iface_name, transaction_id id,
     const std::string& data_iface_name) {
-    return global_func_table_.wifi_nan_data_interface_delete(
+    return VENDOR_CALL(wifi_nan_data_interface_delete)(
         id, getIfaceHandle(iface_name), makeCharVec(data_iface_name).data());
 }
 
@@ -1305,7 +1384,7 @@ wifi_error WifiLegacyHal::nanDataRequestInitiator(
     const std::string& iface_name, transaction_id id,
     const NanDataPathInitiatorRequest& msg) {
     NanDataPathInitiatorRequest msg_internal(msg);
-    return global_func_table_.wifi_nan_data_request_initiator(
+    return VENDOR_CALL(wifi_nan_data_request_initiator)(
         id, getIfaceHandle(iface_name), &msg_internal);
 }
 
@@ -1313,7 +1392,7 @@ wifi_error WifiLegacyHal::nanDataIndicationResponse(
     const std::string& iface_name, transaction_id id,
     const NanDataPathIndicationResponse& msg) {
     NanDataPathIndicationResponse msg_internal(msg);
-    return global_func_table_.wifi_nan_data_indication_response(
+    return VENDOR_CALL(wifi_nan_data_indication_response)(
         id, getIfaceHandle(iface_name), &msg_internal);
 }
 
@@ -1328,7 +1407,7 @@ wifi_error WifiLegacyHal::nanDataEnd(const std::string& iface_name,
     NanDataPathEndSingleNdpIdRequest msg;
     msg.num_ndp_instances = 1;
     msg.ndp_instance_id = ndpInstanceId;
-    wifi_error status = global_func_table_.wifi_nan_data_end(
+    wifi_error status = VENDOR_CALL(wifi_nan_data_end)(
         id, getIfaceHandle(iface_name), (NanDataPathEndRequest*)&msg);
     return status;
 }
@@ -1336,14 +1415,14 @@ wifi_error WifiLegacyHal::nanDataEnd(const std::string& iface_name,
 wifi_error WifiLegacyHal::setCountryCode(const std::string& iface_name,
                                          std::array<int8_t, 2> code) {
     std::string code_str(code.data(), code.data() + code.size());
-    return global_func_table_.wifi_set_country_code(getIfaceHandle(iface_name),
+    return VENDOR_CALL(wifi_set_country_code)(getIfaceHandle(iface_name),
                                                     code_str.c_str());
 }
 
 wifi_error WifiLegacyHal::retrieveIfaceHandles() {
     wifi_interface_handle* iface_handles = nullptr;
     int num_iface_handles = 0;
-    wifi_error status = global_func_table_.wifi_get_ifaces(
+    wifi_error status = VENDOR_CALL(wifi_get_ifaces)(
         global_handle_, &num_iface_handles, &iface_handles);
     if (status != WIFI_SUCCESS) {
         LOG(ERROR) << "Failed to enumerate interface handles";
@@ -1351,7 +1430,7 @@ wifi_error WifiLegacyHal::retrieveIfaceHandles() {
     }
     for (int i = 0; i < num_iface_handles; ++i) {
         std::array<char, IFNAMSIZ> iface_name_arr = {};
-        status = global_func_table_.wifi_get_iface_name(
+        status = VENDOR_CALL(wifi_get_iface_name)(
             iface_handles[i], iface_name_arr.data(), iface_name_arr.size());
         if (status != WIFI_SUCCESS) {
             LOG(WARNING) << "Failed to get interface handle name";
@@ -1394,7 +1473,7 @@ WifiLegacyHal::getGscanCachedResults(const std::string& iface_name) {
     std::vector<wifi_cached_scan_results> cached_scan_results;
     cached_scan_results.resize(kMaxCachedGscanResults);
     int32_t num_results = 0;
-    wifi_error status = global_func_table_.wifi_get_cached_gscan_results(
+    wifi_error status = VENDOR_CALL(wifi_get_cached_gscan_results)(
         getIfaceHandle(iface_name), true /* always flush */,
         cached_scan_results.size(), cached_scan_results.data(), &num_results);
     CHECK(num_results >= 0 &&
@@ -1418,7 +1497,7 @@ WifiLegacyHal::getGscanCachedResults(const std::string& iface_name) {
 wifi_error WifiLegacyHal::QcAddInterface(const std::string& iface_name,
                                          const std::string& new_ifname,
                                          uint32_t type) {
-    wifi_error status = global_func_table_.wifi_add_or_remove_virtual_intf(
+    wifi_error status = VENDOR_CALL(wifi_add_or_remove_virtual_intf)(
                            getIfaceHandle(iface_name),
                            new_ifname.c_str(), type, true);
 
@@ -1432,7 +1511,7 @@ wifi_error WifiLegacyHal::QcAddInterface(const std::string& iface_name,
 
 wifi_error WifiLegacyHal::QcRemoveInterface(const std::string& iface_name,
                                             const std::string& ifname) {
-    wifi_error status =  global_func_table_.wifi_add_or_remove_virtual_intf(
+    wifi_error status =  VENDOR_CALL(wifi_add_or_remove_virtual_intf)(
                              getIfaceHandle(iface_name),
                              ifname.c_str(), 0, false);
 
@@ -1456,7 +1535,7 @@ void WifiLegacyHal::invalidate() {
     on_ring_buffer_data_internal_callback = nullptr;
     on_error_alert_internal_callback = nullptr;
     on_radio_mode_change_internal_callback = nullptr;
-    on_rtt_results_internal_callback = nullptr;
+    on_rtt_results_internal_callbacks.clear();
     on_nan_notify_response_user_callback = nullptr;
     on_nan_event_publish_terminated_user_callback = nullptr;
     on_nan_event_match_user_callback = nullptr;
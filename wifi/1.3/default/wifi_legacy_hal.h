@@ -17,14 +17,20 @@
 #ifndef WIFI_LEGACY_HAL_H_
 #define WIFI_LEGACY_HAL_H_
 
+#include <array>
+#include <chrono>
 #include <condition_variable>
+#include <cstring>
 #include <functional>
 #include <map>
+#include <mutex>
 #include <thread>
 #include <vector>
 
 #include <wifi_system/interface_tool.h>
 
+#include "hidl_sync_util.h"
+
 // HACK: The include inside the namespace below also transitively includes a
 // bunch of libc headers into the namespace, which leads to functions like
 // socketpair being defined in
@@ -133,9 +139,10 @@ using on_rssi_threshold_breached_callback =
 using on_rtt_results_callback = std::function<void(
     wifi_request_id, const std::vector<const wifi_rtt_result*>&)>;
 
-// Callback for ring buffer data.
+// Callback for ring buffer data. The data is passed by pointer to avoid a
+// copy per record; callee must not retain the pointer.
 using on_ring_buffer_data_callback =
-    std::function<void(const std::string&, const std::vector<uint8_t>&,
+    std::function<void(const std::string&, const uint8_t*, size_t,
                        const wifi_ring_buffer_status&)>;
 
 // Callback for alerts.
@@ -179,10 +186,13 @@ class WifiLegacyHal {
     virtual wifi_error start();
     // Deinitialize the legacy HAL and wait for the event loop thread to exit
     // using a predefined timeout.
-    virtual wifi_error stop(std::unique_lock<std::recursive_mutex>* lock,
+    virtual wifi_error stop(hidl_sync_util::GlobalLock* lock,
                             const std::function<void()>& on_complete_callback);
     // Checks if legacy HAL has successfully started
     bool isStarted();
+    // Returns a text report of the per-API latency histograms of the vendor
+    // HAL calls, and of any call that is still in progress.
+    std::string dumpVendorCallStats();
     // Wrappers for all the functions in the legacy HAL function table.
     virtual std::pair<wifi_error, std::string> getDriverVersion(
         const std::string& iface_name);
@@ -375,6 +385,42 @@ class WifiLegacyHal {
 
 
    private:
+    // Latency statistics of one vendor HAL API.
+    struct VendorCallStats {
+        uint64_t count = 0;
+        uint64_t over_deadline = 0;
+        std::chrono::microseconds total{0};
+        std::chrono::microseconds max{0};
+        // Calls taking <1ms, <10ms, <100ms, <1s and longer.
+        std::array<uint64_t, 5> histogram{};
+    };
+    struct CStrLess {
+        bool operator()(const char* a, const char* b) const {
+            return strcmp(a, b) < 0;
+        }
+    };
+    // Records one vendor HAL call from construction to destruction.
+    class VendorCallScope {
+       public:
+        VendorCallScope(WifiLegacyHal* hal, const char* api);
+        ~VendorCallScope();
+
+       private:
+        WifiLegacyHal* hal_;
+        const char* api_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    // Wraps |func| from |global_func_table_| so that calling the result is
+    // timed and accounted against |api|.
+    template <typename Func>
+    auto wrapVendorCall(const char* api, Func func) {
+        return [this, api, func](auto&&... args) {
+            VendorCallScope scope(this, api);
+            return func(std::forward<decltype(args)>(args)...);
+        };
+    }
+
     // Retrieve interface handles for all the available interfaces.
     wifi_error retrieveIfaceHandles();
     wifi_interface_handle getIfaceHandle(const std::string& iface_name);
@@ -399,6 +445,12 @@ class WifiLegacyHal {
     // Flag to indicate if the legacy HAL has been started.
     bool is_started_;
     std::weak_ptr<wifi_system::InterfaceTool> iface_tool_;
+    // Vendor calls are made from both the HIDL and the event loop threads.
+    std::mutex vendor_call_lock_;
+    std::map<const char*, VendorCallStats, CStrLess> vendor_call_stats_;
+    std::map<std::thread::id,
+             std::pair<const char*, std::chrono::steady_clock::time_point>>
+        vendor_calls_in_flight_;
 };
 
 }  // namespace legacy_hal
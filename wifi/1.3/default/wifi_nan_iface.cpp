@@ -28,6 +28,31 @@ namespace V1_3 {
 namespace implementation {
 using hidl_return_util::validateAndCall;
 
+namespace {
+// Repeats of a match within this window are not delivered again.
+constexpr std::chrono::milliseconds kMatchCoalesceWindow(1000);
+// Bound on the number of (session, peer) pairs remembered.
+constexpr size_t kMaxRecentMatches = 64;
+
+// Compares all the fields, a match whose RSSI changed is always delivered.
+bool isSameMatch(const NanMatchInd& a, const NanMatchInd& b) {
+    return a.discoverySessionId == b.discoverySessionId &&
+           a.peerId == b.peerId && a.addr == b.addr &&
+           a.serviceSpecificInfo == b.serviceSpecificInfo &&
+           a.extendedServiceSpecificInfo == b.extendedServiceSpecificInfo &&
+           a.matchFilter == b.matchFilter &&
+           a.matchOccuredInBeaconFlag == b.matchOccuredInBeaconFlag &&
+           a.outOfResourceFlag == b.outOfResourceFlag &&
+           a.peerCipherType == b.peerCipherType &&
+           a.peerRequiresSecurityEnabledInNdp ==
+               b.peerRequiresSecurityEnabledInNdp &&
+           a.peerRequiresRanging == b.peerRequiresRanging &&
+           a.rangingMeasurementInCm == b.rangingMeasurementInCm &&
+           a.rangingIndicationType == b.rangingIndicationType &&
+           a.rssiValue == b.rssiValue;
+}
+}  // namespace
+
 WifiNanIface::WifiNanIface(
     const std::string& ifname,
     const std::weak_ptr<legacy_hal::WifiLegacyHal> legacy_hal,
@@ -35,7 +60,9 @@ WifiNanIface::WifiNanIface(
     : ifname_(ifname),
       legacy_hal_(legacy_hal),
       iface_util_(iface_util),
-      is_valid_(true) {
+      is_valid_(true),
+      matches_delivered_(0),
+      matches_coalesced_(0) {
     // Register all the callbacks here. these should be valid for the lifetime
     // of the object. Whenever the mode changes legacy HAL will remove
     // all of these callbacks.
@@ -272,6 +299,7 @@ WifiNanIface::WifiNanIface(
             WifiNanStatus status;
             hidl_struct_util::convertToWifiNanStatus(
                 msg.reason, msg.nan_reason, sizeof(msg.nan_reason), &status);
+            shared_ptr_this->clearRecentMatches(0);
 
             for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
                 if (!callback->eventDisabled(status).isOk()) {
@@ -290,6 +318,7 @@ WifiNanIface::WifiNanIface(
             WifiNanStatus status;
             hidl_struct_util::convertToWifiNanStatus(
                 msg.reason, msg.nan_reason, sizeof(msg.nan_reason), &status);
+            shared_ptr_this->clearRecentMatches(msg.publish_id);
 
             for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
                 if (!callback->eventPublishTerminated(msg.publish_id, status)
@@ -309,6 +338,7 @@ WifiNanIface::WifiNanIface(
             WifiNanStatus status;
             hidl_struct_util::convertToWifiNanStatus(
                 msg.reason, msg.nan_reason, sizeof(msg.nan_reason), &status);
+            shared_ptr_this->clearRecentMatches(msg.subscribe_id);
 
             for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
                 if (!callback
@@ -332,6 +362,9 @@ WifiNanIface::WifiNanIface(
                 LOG(ERROR) << "Failed to convert nan capabilities response";
                 return;
             }
+            if (shared_ptr_this->coalesceMatch(hidl_struct)) {
+                return;
+            }
 
             for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
                 if (!callback->eventMatch(hidl_struct).isOk()) {
@@ -347,6 +380,8 @@ WifiNanIface::WifiNanIface(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
+            shared_ptr_this->recent_matches_.erase(
+                {msg.publish_subscribe_id, msg.requestor_instance_id});
             for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
                 if (!callback
                          ->eventMatchExpired(msg.publish_subscribe_id,
@@ -533,6 +568,7 @@ void WifiNanIface::invalidate() {
     legacy_hal_.reset();
     event_cb_handler_.invalidate();
     event_cb_handler_1_2_.invalidate();
+    recent_matches_.clear();
     is_valid_ = false;
 }
 
@@ -540,6 +576,49 @@ bool WifiNanIface::isValid() { return is_valid_; }
 
 std::string WifiNanIface::getName() { return ifname_; }
 
+std::string WifiNanIface::getEventStats() {
+    return ifname_ + " matches_delivered " +
+           std::to_string(matches_delivered_) + " matches_coalesced " +
+           std::to_string(matches_coalesced_) + "\n";
+}
+
+bool WifiNanIface::coalesceMatch(const NanMatchInd& match) {
+    const auto now = std::chrono::steady_clock::now();
+    const auto key = std::make_pair(match.discoverySessionId, match.peerId);
+    auto it = recent_matches_.find(key);
+    if (it != recent_matches_.end() &&
+        now - it->second.time < kMatchCoalesceWindow &&
+        isSameMatch(it->second.match, match)) {
+        matches_coalesced_++;
+        return true;
+    }
+    if (it == recent_matches_.end() &&
+        recent_matches_.size() >= kMaxRecentMatches) {
+        // Evict the pair that was matched least recently.
+        auto oldest = recent_matches_.begin();
+        for (auto cur = recent_matches_.begin(); cur != recent_matches_.end();
+             cur++) {
+            if (cur->second.time < oldest->second.time) {
+                oldest = cur;
+            }
+        }
+        recent_matches_.erase(oldest);
+    }
+    recent_matches_[key] = {now, match};
+    matches_delivered_++;
+    return false;
+}
+
+void WifiNanIface::clearRecentMatches(uint8_t session_id) {
+    for (auto it = recent_matches_.begin(); it != recent_matches_.end();) {
+        if (session_id == 0 || it->first.first == session_id) {
+            it = recent_matches_.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
 std::set<sp<V1_0::IWifiNanIfaceEventCallback>>
 WifiNanIface::getEventCallbacks() {
     return event_cb_handler_.getCallbacks();
@@ -761,6 +840,8 @@ WifiStatus WifiNanIface::stopPublishRequestInternal(uint16_t cmd_id,
     legacy_hal::wifi_error legacy_status =
         legacy_hal_.lock()->nanPublishCancelRequest(ifname_, cmd_id,
                                                     legacy_msg);
+    // A new session may reuse the id before the termination event arrives.
+    clearRecentMatches(sessionId);
     return createWifiStatusFromLegacyError(legacy_status);
 }
 
@@ -783,6 +864,7 @@ WifiStatus WifiNanIface::stopSubscribeRequestInternal(uint16_t cmd_id,
     legacy_hal::wifi_error legacy_status =
         legacy_hal_.lock()->nanSubscribeCancelRequest(ifname_, cmd_id,
                                                       legacy_msg);
+    clearRecentMatches(sessionId);
     return createWifiStatusFromLegacyError(legacy_status);
 }
 
@@ -18,6 +18,8 @@
 #define WIFI_NAN_IFACE_H_
 
 #include <android-base/macros.h>
+#include <chrono>
+#include <map>
 #include <android/hardware/wifi/1.0/IWifiNanIfaceEventCallback.h>
 #include <android/hardware/wifi/1.2/IWifiNanIface.h>
 
@@ -44,6 +46,8 @@ class WifiNanIface : public V1_2::IWifiNanIface {
     void invalidate();
     bool isValid();
     std::string getName();
+    // Returns the match event delivery counters, for the debug dump.
+    std::string getEventStats();
 
     // HIDL methods exposed.
     Return<void> getName(getName_cb hidl_status_cb) override;
@@ -142,6 +146,12 @@ class WifiNanIface : public V1_2::IWifiNanIface {
         uint16_t cmd_id, const NanConfigRequest& msg,
         const V1_2::NanConfigRequestSupplemental& msg2);
 
+    // Returns true if |match| only repeats a match recently delivered for
+    // the same session and peer, and so need not be delivered again.
+    bool coalesceMatch(const NanMatchInd& match);
+    // Forgets the recent matches of |session_id| (all sessions if 0).
+    void clearRecentMatches(uint8_t session_id);
+
     // all 1_0 and descendant callbacks
     std::set<sp<V1_0::IWifiNanIfaceEventCallback>> getEventCallbacks();
     // all 1_2 and descendant callbacks
@@ -155,6 +165,14 @@ class WifiNanIface : public V1_2::IWifiNanIface {
         event_cb_handler_;
     hidl_callback_util::HidlCallbackHandler<V1_2::IWifiNanIfaceEventCallback>
         event_cb_handler_1_2_;
+    struct RecentMatch {
+        std::chrono::steady_clock::time_point time;
+        NanMatchInd match;
+    };
+    // Last match delivered per (discovery session, peer).
+    std::map<std::pair<uint8_t, uint32_t>, RecentMatch> recent_matches_;
+    uint64_t matches_delivered_;
+    uint64_t matches_coalesced_;
 
     DISALLOW_COPY_AND_ASSIGN(WifiNanIface);
 };
@@ -21,6 +21,12 @@
 #include "wifi_sta_iface.h"
 #include "wifi_status_util.h"
 
+namespace {
+// The framework and monitoring daemons poll the stats independently; serve
+// polls that land this close together from a single driver query.
+constexpr std::chrono::milliseconds kLinkLayerStatsCacheTtl(500);
+}  // namespace
+
 namespace android {
 namespace hardware {
 namespace wifi {
@@ -35,7 +41,8 @@ WifiStaIface::WifiStaIface(
     : ifname_(ifname),
       legacy_hal_(legacy_hal),
       iface_util_(iface_util),
-      is_valid_(true) {
+      is_valid_(true),
+      link_layer_stats_cached_(false) {
     // Turn on DFS channel usage for STA iface.
     legacy_hal::wifi_error legacy_status =
         legacy_hal_.lock()->setDfsFlag(ifname_, true);
@@ -398,7 +405,7 @@ WifiStatus WifiStaIface::startBackgroundScanInternal(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
-            std::vector<StaScanData> hidl_scan_datas;
+            hidl_vec<StaScanData> hidl_scan_datas;
             if (!hidl_struct_util::
                     convertLegacyVectorOfCachedGscanResultsToHidl(
                         results, &hidl_scan_datas)) {
@@ -423,8 +430,10 @@ WifiStatus WifiStaIface::startBackgroundScanInternal(
             LOG(ERROR) << "Callback invoked on an invalid object";
             return;
         }
+        // |result| stays valid for the duration of this callback, so the
+        // IEs can be sent without copying them.
         StaScanResult hidl_scan_result;
-        if (!hidl_struct_util::convertLegacyGscanResultToHidl(
+        if (!hidl_struct_util::convertLegacyGscanResultToHidlNoCopy(
                 *result, true, &hidl_scan_result)) {
             LOG(ERROR) << "Failed to convert full scan results to HIDL structs";
             return;
@@ -452,12 +461,14 @@ WifiStatus WifiStaIface::stopBackgroundScanInternal(uint32_t cmd_id) {
 }
 
 WifiStatus WifiStaIface::enableLinkLayerStatsCollectionInternal(bool debug) {
+    link_layer_stats_cached_ = false;
     legacy_hal::wifi_error legacy_status =
         legacy_hal_.lock()->enableLinkLayerStats(ifname_, debug);
     return createWifiStatusFromLegacyError(legacy_status);
 }
 
 WifiStatus WifiStaIface::disableLinkLayerStatsCollectionInternal() {
+    link_layer_stats_cached_ = false;
     legacy_hal::wifi_error legacy_status =
         legacy_hal_.lock()->disableLinkLayerStats(ifname_);
     return createWifiStatusFromLegacyError(legacy_status);
@@ -470,6 +481,12 @@ WifiStaIface::getLinkLayerStatsInternal() {
 
 std::pair<WifiStatus, V1_3::StaLinkLayerStats>
 WifiStaIface::getLinkLayerStatsInternal_1_3() {
+    const auto now = std::chrono::steady_clock::now();
+    if (link_layer_stats_cached_ &&
+        now - link_layer_stats_time_ < kLinkLayerStatsCacheTtl) {
+        return {createWifiStatus(WifiStatusCode::SUCCESS), link_layer_stats_};
+    }
+    link_layer_stats_cached_ = false;
     legacy_hal::wifi_error legacy_status;
     legacy_hal::LinkLayerStats legacy_stats;
     std::tie(legacy_status, legacy_stats) =
@@ -477,12 +494,13 @@ WifiStaIface::getLinkLayerStatsInternal_1_3() {
     if (legacy_status != legacy_hal::WIFI_SUCCESS) {
         return {createWifiStatusFromLegacyError(legacy_status), {}};
     }
-    V1_3::StaLinkLayerStats hidl_stats;
-    if (!hidl_struct_util::convertLegacyLinkLayerStatsToHidl(legacy_stats,
-                                                             &hidl_stats)) {
+    if (!hidl_struct_util::convertLegacyLinkLayerStatsToHidl(
+            legacy_stats, &link_layer_stats_)) {
         return {createWifiStatus(WifiStatusCode::ERROR_UNKNOWN), {}};
     }
-    return {createWifiStatus(WifiStatusCode::SUCCESS), hidl_stats};
+    link_layer_stats_cached_ = true;
+    link_layer_stats_time_ = now;
+    return {createWifiStatus(WifiStatusCode::SUCCESS), link_layer_stats_};
 }
 
 WifiStatus WifiStaIface::startRssiMonitoringInternal(uint32_t cmd_id,
@@ -17,6 +17,8 @@
 #ifndef WIFI_STA_IFACE_H_
 #define WIFI_STA_IFACE_H_
 
+#include <chrono>
+
 #include <android-base/macros.h>
 #include <android/hardware/wifi/1.0/IWifiStaIfaceEventCallback.h>
 #include <android/hardware/wifi/1.3/IWifiStaIface.h>
@@ -166,6 +168,11 @@ class WifiStaIface : public V1_3::IWifiStaIface {
     bool is_valid_;
     hidl_callback_util::HidlCallbackHandler<IWifiStaIfaceEventCallback>
         event_cb_handler_;
+    // Result of the last link layer stats query, handed out again to callers
+    // polling within |kLinkLayerStatsCacheTtl| of it.
+    bool link_layer_stats_cached_;
+    std::chrono::steady_clock::time_point link_layer_stats_time_;
+    V1_3::StaLinkLayerStats link_layer_stats_;
 
     DISALLOW_COPY_AND_ASSIGN(WifiStaIface);
 };